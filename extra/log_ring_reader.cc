@@ -0,0 +1,48 @@
+// Prints the messages of a log ring file written by
+// torrent::log_open_ring_file_output, oldest first.
+//
+// g++ -std=c++17 -O2 -I.. -I../src -o log_ring_reader log_ring_reader.cc
+
+#include <cinttypes>
+#include <cstdio>
+#include <fstream>
+#include <iterator>
+#include <string>
+
+#include "torrent/utils/log.h"
+#include "torrent/utils/log_buffer.h"
+
+int
+main(int argc, char** argv) {
+  if (argc != 2) {
+    std::fprintf(stderr, "usage: %s <ring file>\n", argv[0]);
+    return 1;
+  }
+
+  std::ifstream file(argv[1], std::ios::binary);
+
+  if (!file.good()) {
+    std::fprintf(stderr, "could not open '%s'\n", argv[1]);
+    return 1;
+  }
+
+  std::string buffer(std::istreambuf_iterator<char>(file), {});
+
+  const char level_char[] = { 'C', 'E', 'W', 'N', 'I', 'D' };
+
+  bool valid = torrent::log_ring_file::for_each(buffer.data(), buffer.size(), [&](auto& record, const char* data) {
+      if (record.group < torrent::LOG_NON_CASCADING)
+        std::printf("%" PRIi64 ".%06" PRIi64 " %c %.*s\n", record.timestamp / 1000000, record.timestamp % 1000000,
+                    level_char[record.group % 6], static_cast<int>(record.length), data);
+      else
+        std::printf("%" PRIi64 ".%06" PRIi64 " %.*s\n", record.timestamp / 1000000, record.timestamp % 1000000,
+                    static_cast<int>(record.length), data);
+    });
+
+  if (!valid) {
+    std::fprintf(stderr, "'%s' is not a valid log ring file\n", argv[1]);
+    return 1;
+  }
+
+  return 0;
+}
@@ -63,6 +63,7 @@ public:
   bool                is_socket() const                     { return S_ISSOCK(m_stat.st_mode); }
 
   off_t               size() const                          { return m_stat.st_size; }
+  dev_t               device() const                        { return m_stat.st_dev; }
 
   time_t              access_time() const                   { return m_stat.st_atime; }
   time_t              change_time() const                   { return m_stat.st_ctime; }
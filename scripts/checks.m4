@@ -74,6 +74,41 @@ AC_DEFUN([TORRENT_WITHOUT_EPOLL], [
 ])
 
 
+AC_DEFUN([TORRENT_CHECK_IO_URING], [
+  AC_MSG_CHECKING(for io_uring support)
+
+  AC_COMPILE_IFELSE([AC_LANG_SOURCE([
+      #include <linux/io_uring.h>
+      #include <sys/syscall.h>
+      #include <unistd.h>
+      int main() {
+        struct io_uring_getevents_arg arg;
+        struct io_uring_params params;
+        int fd = syscall(__NR_io_uring_setup, 16, &params);
+        return IORING_OP_POLL_ADD + IORING_FEAT_EXT_ARG;
+      }
+      ])],
+    [
+      AC_DEFINE(USE_IO_URING, 1, Build the io_uring poll backend.)
+      AC_MSG_RESULT(yes)
+    ], [
+      AC_MSG_RESULT(no)
+    ])
+])
+
+AC_DEFUN([TORRENT_WITHOUT_IO_URING], [
+  AC_ARG_WITH(io-uring,
+    AS_HELP_STRING([--without-io-uring],[do not build the io_uring poll backend]),
+    [
+      if test "$withval" = "yes"; then
+        TORRENT_CHECK_IO_URING
+      fi
+    ], [
+        TORRENT_CHECK_IO_URING
+    ])
+])
+
+
 AC_DEFUN([TORRENT_CHECK_KQUEUE], [
   AC_MSG_CHECKING(for kqueue support)
 
@@ -146,6 +181,145 @@ AC_DEFUN([TORRENT_CHECK_FALLOCATE], [
 ])
 
 
+AC_DEFUN([TORRENT_CHECK_COPY_FILE_RANGE], [
+  AC_MSG_CHECKING(for copy_file_range)
+
+  AC_LINK_IFELSE([AC_LANG_PROGRAM([[#define _GNU_SOURCE
+               #include <unistd.h>
+              ]], [[ return copy_file_range(0, 0, 1, 0, 0, 0);
+              ]])],[
+      AC_DEFINE(USE_COPY_FILE_RANGE, 1, copy_file_range supported.)
+      AC_MSG_RESULT(yes)
+    ],[
+      AC_MSG_RESULT(no)
+    ])
+])
+
+
+AC_DEFUN([TORRENT_CHECK_FICLONE], [
+  AC_MSG_CHECKING(for FICLONE)
+
+  AC_COMPILE_IFELSE([AC_LANG_PROGRAM([[
+              #include <linux/fs.h>
+              #include <sys/ioctl.h>
+              ]], [[ return ioctl(1, FICLONE, 0);
+              ]])],[
+      AC_DEFINE(USE_FICLONE, 1, Linux's FICLONE reflinks supported.)
+      AC_MSG_RESULT(yes)
+    ],[
+      AC_MSG_RESULT(no)
+    ])
+])
+
+
+AC_DEFUN([TORRENT_CHECK_SENDFILE], [
+  AC_MSG_CHECKING(for sendfile)
+
+  AC_LINK_IFELSE([AC_LANG_PROGRAM([[#include <sys/sendfile.h>
+              ]], [[ off_t offset = 0; sendfile(0, 0, &offset, 0); return 0;
+              ]])],[
+      AC_DEFINE(USE_SENDFILE, 1, Linux's sendfile supported.)
+      AC_MSG_RESULT(yes)
+    ],[
+      AC_MSG_RESULT(no)
+    ])
+])
+
+
+AC_DEFUN([TORRENT_CHECK_SYNC_FILE_RANGE], [
+  AC_MSG_CHECKING(for sync_file_range)
+
+  AC_LINK_IFELSE([AC_LANG_PROGRAM([[#define _GNU_SOURCE
+              #include <fcntl.h>
+              ]], [[ sync_file_range(0, 0, 0, SYNC_FILE_RANGE_WRITE); return 0;
+              ]])],[
+      AC_DEFINE(USE_SYNC_FILE_RANGE, 1, Linux's sync_file_range supported.)
+      AC_MSG_RESULT(yes)
+    ],[
+      AC_MSG_RESULT(no)
+    ])
+])
+
+
+AC_DEFUN([TORRENT_CHECK_FIEMAP], [
+  AC_MSG_CHECKING(for FS_IOC_FIEMAP)
+
+  AC_COMPILE_IFELSE([AC_LANG_PROGRAM([[
+              #include <linux/fiemap.h>
+              #include <linux/fs.h>
+              #include <sys/ioctl.h>
+              ]], [[ struct fiemap map; return ioctl(0, FS_IOC_FIEMAP, &map);
+              ]])],[
+      AC_DEFINE(USE_FIEMAP, 1, Linux's FS_IOC_FIEMAP supported.)
+      AC_MSG_RESULT(yes)
+    ],[
+      AC_MSG_RESULT(no)
+    ])
+])
+
+
+AC_DEFUN([TORRENT_CHECK_USDT], [
+  AC_MSG_CHECKING(for USDT probes)
+
+  AC_COMPILE_IFELSE([AC_LANG_PROGRAM([[
+              #include <sys/sdt.h>
+              ]], [[ DTRACE_PROBE1(libtorrent, test, 0);
+              ]])],[
+      AC_DEFINE(USE_USDT, 1, Use sys/sdt.h static tracepoints.)
+      AC_MSG_RESULT(yes)
+    ],[
+      AC_MSG_RESULT(no)
+    ])
+])
+
+
+AC_DEFUN([TORRENT_CHECK_EVENTFD], [
+  AC_MSG_CHECKING(for eventfd)
+
+  AC_LINK_IFELSE([AC_LANG_PROGRAM([[
+              #include <sys/eventfd.h>
+              ]], [[ return eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+              ]])],[
+      AC_DEFINE(USE_EVENTFD, 1, Linux's eventfd supported.)
+      AC_MSG_RESULT(yes)
+    ],[
+      AC_MSG_RESULT(no)
+    ])
+])
+
+
+AC_DEFUN([TORRENT_CHECK_SENDMMSG], [
+  AC_MSG_CHECKING(for sendmmsg and recvmmsg)
+
+  AC_LINK_IFELSE([AC_LANG_PROGRAM([[#define _GNU_SOURCE
+              #include <sys/socket.h>
+              ]], [[ struct mmsghdr msgs[2]; sendmmsg(0, msgs, 2, 0); recvmmsg(0, msgs, 2, 0, 0); return 0;
+              ]])],[
+      AC_DEFINE(USE_SENDMMSG, 1, Linux's sendmmsg and recvmmsg supported.)
+      AC_MSG_RESULT(yes)
+    ],[
+      AC_MSG_RESULT(no)
+    ])
+])
+
+
+AC_DEFUN([TORRENT_CHECK_THREAD_AFFINITY], [
+  AC_MSG_CHECKING(for pthread_setaffinity_np and sched_getcpu)
+
+  AC_LINK_IFELSE([AC_LANG_PROGRAM([[#define _GNU_SOURCE
+              #include <pthread.h>
+              #include <sched.h>
+              ]], [[ cpu_set_t set; CPU_ZERO(&set); CPU_SET(0, &set);
+                     pthread_setaffinity_np(pthread_self(), sizeof(set), &set); return sched_getcpu();
+              ]])],[
+      AC_DEFINE(USE_THREAD_AFFINITY, 1, Linux's pthread_setaffinity_np and sched_getcpu supported.)
+      AC_MSG_RESULT(yes)
+    ],[
+      AC_MSG_RESULT(no)
+    ])
+])
+
+
 AC_DEFUN([TORRENT_CHECK_POSIX_FALLOCATE], [
   AC_MSG_CHECKING(for posix_fallocate)
 
@@ -300,6 +474,24 @@ AC_DEFUN([TORRENT_WITH_ADDRESS_SPACE], [
     ])
 ])
 
+AC_DEFUN([TORRENT_WITH_LOG_LEVEL], [
+  AC_ARG_WITH(log-level,
+    AS_HELP_STRING([--with-log-level=LEVEL],[compile out log messages above critical, error, warn, notice, info or debug [[default=debug]]]),
+    [
+      case "$withval" in
+        critical) log_level=0 ;;
+        error)    log_level=1 ;;
+        warn)     log_level=2 ;;
+        notice)   log_level=3 ;;
+        info)     log_level=4 ;;
+        debug)    log_level=5 ;;
+        *)        AC_MSG_ERROR(--with-log-level requires one of critical, error, warn, notice, info or debug.) ;;
+      esac
+
+      AC_DEFINE_UNQUOTED(LT_LOG_MAX_LEVEL, $log_level, Highest log level compiled in.)
+    ])
+])
+
 AC_DEFUN([TORRENT_WITH_FASTCGI], [
   AC_ARG_WITH(fastcgi,
     AS_HELP_STRING([--with-fastcgi=PATH],[enable FastCGI RPC support (DO NOT USE)]),
@@ -41,8 +41,10 @@
 #include <functional>
 #include <csignal>
 #include <csetjmp>
+#include <unistd.h>
 
 #include "torrent/exceptions.h"
+#include "torrent/data/file.h"
 
 #include "chunk.h"
 #include "chunk_iterator.h"
@@ -167,17 +169,57 @@ Chunk::incore_length(uint32_t pos, uint32_t length) {
   return result;
 }
 
+bool
+Chunk::is_buffered() const {
+  return std::any_of(begin(), end(), [](const ChunkPart& part) { return part.mapped() == ChunkPart::MAPPED_BUFFER; });
+}
+
 bool
 Chunk::sync(int flags) {
   bool success = true;
 
   for (auto& c : *this)
-    if (!c.chunk().sync(0, c.chunk().size(), flags))
+    if (!c.sync(flags))
       success = false;
 
   return success;
 }
 
+bool
+Chunk::dup_sync_fds(std::vector<int>& fds) {
+  fds.clear();
+
+  for (auto& part : *this) {
+    if (!part.chunk().is_writable() || part.file() == NULL || part.file()->is_padding()) {
+      fds.push_back(-1);
+      continue;
+    }
+
+    int fd = -1;
+
+    if (part.file()->prepare(part.chunk().get_prot()))
+      fd = ::dup(part.file()->file_descriptor());
+
+    if (fd == -1) {
+      close_sync_fds(fds);
+      return false;
+    }
+
+    fds.push_back(fd);
+  }
+
+  return true;
+}
+
+void
+Chunk::close_sync_fds(std::vector<int>& fds) {
+  for (auto fd : fds)
+    if (fd != -1)
+      ::close(fd);
+
+  fds.clear();
+}
+
 void
 Chunk::preload(uint32_t position, uint32_t length, bool useAdvise) {
   if (position >= m_chunkSize)
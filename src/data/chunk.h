@@ -62,8 +62,19 @@ public:
   bool                is_incore(uint32_t pos, uint32_t length = ~uint32_t());
   uint32_t            incore_length(uint32_t pos, uint32_t length = ~uint32_t());
 
+  // True if any part is held in a pooled buffer rather than mapped,
+  // such parts only reach the file when synced.
+  bool                is_buffered() const;
+
   bool                sync(int flags);
 
+  // Opening files through the FileManager is only safe on the main
+  // thread, so to sync from another thread first call 'dup_sync_fds'
+  // to get duplicated descriptors for the writable file parts, and
+  // pass them to a SyncScheduler. Parts without a descriptor get -1.
+  bool                dup_sync_fds(std::vector<int>& fds);
+  static void         close_sync_fds(std::vector<int>& fds);
+
   void                preload(uint32_t position, uint32_t length, bool useAdvise);
 
   bool                to_buffer(void* buffer, uint32_t position, uint32_t length);
@@ -0,0 +1,109 @@
+#include "config.h"
+
+#include "chunk_buffer_pool.h"
+
+#include <sys/mman.h>
+
+#include "torrent/exceptions.h"
+
+namespace torrent {
+
+ChunkBufferPool::~ChunkBufferPool() {
+  clear();
+}
+
+uint64_t
+ChunkBufferPool::cached_size() const {
+  std::lock_guard<std::mutex> lock(m_lock);
+  return m_cached_size;
+}
+
+void
+ChunkBufferPool::set_max_cached_size(uint64_t bytes) {
+  std::lock_guard<std::mutex> lock(m_lock);
+
+  m_max_cached_size = bytes;
+  trim_locked(bytes);
+}
+
+MemoryChunk
+ChunkBufferPool::allocate(uint32_t length, int prot) {
+  if (length == 0)
+    throw internal_error("ChunkBufferPool::allocate(...) length == 0.");
+
+  uint32_t aligned = (length + MemoryChunk::page_size() - 1) / MemoryChunk::page_size() * MemoryChunk::page_size();
+  char*    ptr     = nullptr;
+
+  {
+    std::lock_guard<std::mutex> lock(m_lock);
+
+    auto itr = m_buffers.find(aligned);
+
+    if (itr != m_buffers.end()) {
+      ptr = itr->second.back();
+      itr->second.pop_back();
+
+      if (itr->second.empty())
+        m_buffers.erase(itr);
+
+      m_cached_size -= aligned;
+    }
+  }
+
+  if (ptr == nullptr) {
+    void* map = mmap(nullptr, aligned, PROT_READ | PROT_WRITE, MAP_PRIVATE | MemoryChunk::map_anon, -1, 0);
+
+    if (map == MAP_FAILED)
+      return MemoryChunk();
+
+    ptr = static_cast<char*>(map);
+  }
+
+  return MemoryChunk(ptr, ptr, ptr + length, prot, MAP_PRIVATE | MemoryChunk::map_anon);
+}
+
+void
+ChunkBufferPool::release(MemoryChunk& chunk) {
+  if (!chunk.is_valid())
+    throw internal_error("ChunkBufferPool::release(...) called on an invalid chunk.");
+
+  if (chunk.page_align() != 0)
+    throw internal_error("ChunkBufferPool::release(...) chunk was not allocated by the pool.");
+
+  uint32_t aligned = chunk.size_aligned();
+
+  std::lock_guard<std::mutex> lock(m_lock);
+
+  if (m_cached_size + aligned > m_max_cached_size) {
+    munmap(chunk.ptr(), aligned);
+  } else {
+    m_buffers[aligned].push_back(chunk.ptr());
+    m_cached_size += aligned;
+  }
+
+  chunk.clear();
+}
+
+void
+ChunkBufferPool::clear() {
+  std::lock_guard<std::mutex> lock(m_lock);
+  trim_locked(0);
+}
+
+void
+ChunkBufferPool::trim_locked(uint64_t target) {
+  // Drop the smallest buffers first, those come from chunks split
+  // across file boundaries and are the least likely to be reused.
+  while (m_cached_size > target && !m_buffers.empty()) {
+    auto itr = m_buffers.begin();
+
+    munmap(itr->second.back(), itr->first);
+    itr->second.pop_back();
+    m_cached_size -= itr->first;
+
+    if (itr->second.empty())
+      m_buffers.erase(itr);
+  }
+}
+
+}
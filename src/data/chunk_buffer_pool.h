@@ -0,0 +1,55 @@
+#ifndef LIBTORRENT_DATA_CHUNK_BUFFER_POOL_H
+#define LIBTORRENT_DATA_CHUNK_BUFFER_POOL_H
+
+#include <cinttypes>
+#include <map>
+#include <mutex>
+#include <vector>
+
+#include "memory_chunk.h"
+
+namespace torrent {
+
+// Page aligned anonymous buffers used by the pread/pwrite storage
+// backend. Released buffers are kept around, keyed by their page
+// aligned size, until 'max_cached_size' bytes are cached so that
+// chunks of the same size don't hit mmap/munmap on every get and
+// release.
+
+class ChunkBufferPool {
+public:
+  static constexpr uint64_t default_max_cached_size = 32 << 20;
+
+  ChunkBufferPool() = default;
+  ~ChunkBufferPool();
+  ChunkBufferPool(const ChunkBufferPool&) = delete;
+  ChunkBufferPool& operator=(const ChunkBufferPool&) = delete;
+
+  uint64_t            cached_size() const;
+  uint64_t            max_cached_size() const              { return m_max_cached_size; }
+  void                set_max_cached_size(uint64_t bytes);
+
+  // The buffer is always readable and writable, 'prot' is only
+  // recorded in the returned MemoryChunk. Returns an invalid
+  // MemoryChunk if the allocation failed.
+  MemoryChunk         allocate(uint32_t length, int prot);
+  void                release(MemoryChunk& chunk);
+
+  void                clear();
+
+private:
+  using buffer_list = std::vector<char*>;
+  using buffer_map  = std::map<uint32_t, buffer_list>;
+
+  void                trim_locked(uint64_t target);
+
+  mutable std::mutex  m_lock;
+  buffer_map          m_buffers;
+
+  uint64_t            m_cached_size{0};
+  uint64_t            m_max_cached_size{default_max_cached_size};
+};
+
+}
+
+#endif
@@ -0,0 +1,212 @@
+#include "config.h"
+
+#include "data/chunk_cache.h"
+
+#include <algorithm>
+
+#include "data/chunk_list.h"
+#include "torrent/exceptions.h"
+#include "utils/instrumentation.h"
+
+namespace torrent {
+
+void
+ChunkCache::set_max_size(uint64_t bytes) {
+  m_max_size = bytes;
+  m_target = std::min(m_target, m_max_size);
+
+  if (m_max_size == 0) {
+    clear();
+    return;
+  }
+
+  balance(false);
+}
+
+bool
+ChunkCache::is_cached(ChunkList* chunk_list, uint32_t index) const {
+  auto itr = m_index.find(key_type(chunk_list, index));
+
+  return itr != m_index.end() && (itr->second.list == list_t1 || itr->second.list == list_t2);
+}
+
+uint64_t
+ChunkCache::size(const ChunkList* chunk_list) const {
+  uint64_t bytes = 0;
+
+  for (auto list : {list_t1, list_t2})
+    for (const auto& entry : m_lists[list])
+      if (entry.chunk_list == chunk_list)
+        bytes += entry.size;
+
+  return bytes;
+}
+
+bool
+ChunkCache::insert(ChunkList* chunk_list, ChunkHandle* handle) {
+  if (!handle->is_valid() || handle->is_writable() || handle->is_blocking())
+    throw internal_error("ChunkCache::insert(...) received an invalid handle.");
+
+  if (m_max_size == 0) {
+    chunk_list->release(handle);
+    return false;
+  }
+
+  auto itr = m_index.find(key_type(chunk_list, handle->index()));
+
+  // Resident, the cache already holds a reference.
+  if (itr != m_index.end() && (itr->second.list == list_t1 || itr->second.list == list_t2)) {
+    chunk_list->release(handle);
+
+    push_front(list_t2, remove(itr));
+
+    m_hits++;
+    instrumentation_update(INSTRUMENTATION_CHUNK_CACHE_HITS, 1);
+    return true;
+  }
+
+  m_misses++;
+  instrumentation_update(INSTRUMENTATION_CHUNK_CACHE_MISSES, 1);
+
+  entry_type entry{chunk_list, handle->index(), chunk_list->chunk_size(), *handle};
+  handle->clear();
+
+  if (itr == m_index.end()) {
+    push_front(list_t1, std::move(entry));
+    balance(false);
+    return false;
+  }
+
+  // A ghost hit tells us which of recency or frequency should have
+  // been given more space.
+  bool in_b2 = itr->second.list == list_b2;
+
+  if (!in_b2) {
+    uint64_t delta = std::max<uint64_t>(entry.size, entry.size * m_sizes[list_b2] / std::max<uint64_t>(m_sizes[list_b1], 1));
+    m_target = std::min(m_target + delta, m_max_size);
+  } else {
+    uint64_t delta = std::max<uint64_t>(entry.size, entry.size * m_sizes[list_b1] / std::max<uint64_t>(m_sizes[list_b2], 1));
+    m_target -= std::min(m_target, delta);
+  }
+
+  remove(itr);
+  push_front(list_t2, std::move(entry));
+  balance(in_b2);
+
+  return false;
+}
+
+void
+ChunkCache::evict(uint64_t bytes) {
+  uint64_t target = bytes < size() ? size() - bytes : 0;
+
+  while (size() > target)
+    replace(false);
+}
+
+void
+ChunkCache::erase(ChunkList* chunk_list) {
+  for (auto itr = m_index.begin(); itr != m_index.end(); ) {
+    if (itr->first.first != chunk_list) {
+      ++itr;
+      continue;
+    }
+
+    entry_type entry = remove(itr++);
+
+    if (entry.handle.is_valid())
+      entry.chunk_list->release(&entry.handle);
+  }
+}
+
+void
+ChunkCache::clear() {
+  while (!m_index.empty()) {
+    entry_type entry = remove(m_index.begin());
+
+    if (entry.handle.is_valid())
+      entry.chunk_list->release(&entry.handle);
+  }
+
+  m_target = 0;
+}
+
+void
+ChunkCache::push_front(list_type list, entry_type&& entry) {
+  key_type key(entry.chunk_list, entry.index);
+
+  m_sizes[list] += entry.size;
+  m_lists[list].push_front(std::move(entry));
+
+  if (list == list_t1 || list == list_t2)
+    instrumentation_update(INSTRUMENTATION_CHUNK_CACHE_USAGE, m_lists[list].front().size);
+
+  m_index[key] = position_type{list, m_lists[list].begin()};
+}
+
+// The caller is responsible for releasing the handle of the returned
+// entry, ghost entries have none.
+ChunkCache::entry_type
+ChunkCache::remove(index_map::iterator itr) {
+  list_type  list  = itr->second.list;
+  entry_type entry = std::move(*itr->second.itr);
+
+  m_sizes[list] -= entry.size;
+  m_lists[list].erase(itr->second.itr);
+  m_index.erase(itr);
+
+  if (list == list_t1 || list == list_t2)
+    instrumentation_update(INSTRUMENTATION_CHUNK_CACHE_USAGE, -static_cast<int64_t>(entry.size));
+
+  return entry;
+}
+
+// Evict the least recently used entry of 't1' or 't2' into its ghost
+// list.
+void
+ChunkCache::replace(bool in_b2) {
+  list_type from;
+
+  if (m_lists[list_t1].empty() && m_lists[list_t2].empty())
+    throw internal_error("ChunkCache::replace(...) called on an empty cache.");
+
+  if (!m_lists[list_t1].empty() &&
+      (m_lists[list_t2].empty() || m_sizes[list_t1] > m_target || (in_b2 && m_sizes[list_t1] == m_target)))
+    from = list_t1;
+  else
+    from = list_t2;
+
+  const entry_type& back = m_lists[from].back();
+  entry_type entry = remove(m_index.find(key_type(back.chunk_list, back.index)));
+
+  entry.chunk_list->release(&entry.handle);
+
+  m_evictions++;
+  instrumentation_update(INSTRUMENTATION_CHUNK_CACHE_EVICTIONS, 1);
+
+  push_front(from == list_t1 ? list_b1 : list_b2, std::move(entry));
+}
+
+void
+ChunkCache::drop_ghost(list_type list) {
+  const entry_type& back = m_lists[list].back();
+
+  remove(m_index.find(key_type(back.chunk_list, back.index)));
+}
+
+void
+ChunkCache::balance(bool in_b2) {
+  while (size() > m_max_size)
+    replace(in_b2);
+
+  while (m_sizes[list_t1] + m_sizes[list_b1] > m_max_size && !m_lists[list_b1].empty())
+    drop_ghost(list_b1);
+
+  while (size() + ghost_size() > 2 * m_max_size && !m_lists[list_b2].empty())
+    drop_ghost(list_b2);
+
+  while (size() + ghost_size() > 2 * m_max_size && !m_lists[list_b1].empty())
+    drop_ghost(list_b1);
+}
+
+}
@@ -0,0 +1,112 @@
+#ifndef LIBTORRENT_DATA_CHUNK_CACHE_H
+#define LIBTORRENT_DATA_CHUNK_CACHE_H
+
+#include <cinttypes>
+#include <functional>
+#include <list>
+#include <unordered_map>
+
+#include "data/chunk_handle.h"
+
+namespace torrent {
+
+class ChunkList;
+
+// Keeps the read-only handles of recently uploaded chunks, so that
+// popular pieces stay mapped instead of being unmapped as soon as the
+// last peer is done with them.
+//
+// Entries are evicted using ARC, with the resident and ghost lists
+// measured in bytes as chunk sizes differ between downloads. Recency
+// is tracked by 't1', frequency by 't2', and 'b1' and 'b2' remember
+// the keys evicted from each to adapt the target size of 't1'.
+
+class ChunkCache {
+public:
+  ChunkCache() = default;
+  ~ChunkCache() { clear(); }
+
+  ChunkCache(const ChunkCache&) = delete;
+  ChunkCache& operator=(const ChunkCache&) = delete;
+
+  bool                is_enabled() const                    { return m_max_size != 0; }
+
+  // Caching is disabled when 0.
+  uint64_t            max_size() const                      { return m_max_size; }
+  void                set_max_size(uint64_t bytes);
+
+  uint64_t            size() const                          { return m_sizes[list_t1] + m_sizes[list_t2]; }
+  uint64_t            recent_size() const                   { return m_sizes[list_t1]; }
+  uint64_t            frequent_size() const                 { return m_sizes[list_t2]; }
+  uint64_t            ghost_size() const                    { return m_sizes[list_b1] + m_sizes[list_b2]; }
+  uint64_t            target_recent_size() const            { return m_target; }
+
+  uint64_t            hits() const                          { return m_hits; }
+  uint64_t            misses() const                        { return m_misses; }
+  uint64_t            evictions() const                     { return m_evictions; }
+
+  bool                is_cached(ChunkList* chunk_list, uint32_t index) const;
+
+  // Bytes of resident chunks belonging to the chunk list.
+  uint64_t            size(const ChunkList* chunk_list) const;
+
+  // Takes over a read-only handle being released, the handle is
+  // cleared. Returns true if the chunk was already cached.
+  bool                insert(ChunkList* chunk_list, ChunkHandle* handle);
+
+  // Evict resident chunks until 'bytes' have been released.
+  void                evict(uint64_t bytes);
+
+  // Drop all entries belonging to the chunk list.
+  void                erase(ChunkList* chunk_list);
+  void                clear();
+
+private:
+  enum list_type { list_t1, list_t2, list_b1, list_b2, list_count };
+
+  struct entry_type {
+    ChunkList*        chunk_list;
+    uint32_t          index;
+    uint32_t          size;
+    ChunkHandle       handle;
+  };
+
+  using entry_list = std::list<entry_type>;
+  using key_type   = std::pair<ChunkList*, uint32_t>;
+
+  struct key_hash {
+    size_t operator()(const key_type& key) const {
+      return std::hash<ChunkList*>()(key.first) ^ (std::hash<uint32_t>()(key.second) << 1);
+    }
+  };
+
+  struct position_type {
+    list_type            list;
+    entry_list::iterator itr;
+  };
+
+  using index_map = std::unordered_map<key_type, position_type, key_hash>;
+
+  void                push_front(list_type list, entry_type&& entry);
+  entry_type          remove(index_map::iterator itr);
+
+  void                replace(bool in_b2);
+  void                drop_ghost(list_type list);
+  void                balance(bool in_b2);
+
+  entry_list          m_lists[list_count];
+  uint64_t            m_sizes[list_count]{};
+
+  index_map           m_index;
+
+  uint64_t            m_max_size{0};
+  uint64_t            m_target{0};
+
+  uint64_t            m_hits{0};
+  uint64_t            m_misses{0};
+  uint64_t            m_evictions{0};
+};
+
+}
+
+#endif
@@ -1,16 +1,27 @@
 #include "config.h"
 
+#include <memory>
 #include <rak/error_number.h>
 
 #include "torrent/exceptions.h"
 #include "torrent/chunk_manager.h"
 #include "torrent/data/download_data.h"
+#include "torrent/utils/chrono.h"
 #include "torrent/utils/log.h"
+#include "torrent/utils/thread.h"
+#include "torrent/utils/trace.h"
 #include "utils/instrumentation.h"
+#include "utils/probe.h"
 
 #include "chunk_list.h"
 #include "chunk.h"
+#include "chunk_cache.h"
+#include "chunk_lru.h"
 #include "globals.h"
+#include "data/disk_throttle.h"
+#include "data/io_priority.h"
+#include "data/sync_scheduler.h"
+#include "data/thread_disk.h"
 
 #define LT_LOG_THIS(log_level, log_fmt, ...)                              \
   lt_log_print_data(LOG_STORAGE_##log_level, m_data, "chunk_list", log_fmt, __VA_ARGS__);
@@ -59,12 +70,25 @@ void
 ChunkList::clear() {
   LT_LOG_THIS(INFO, "Clearing.", 0);
 
+  if (m_manager != nullptr)
+    m_manager->chunk_cache()->erase(this);
+
+  cancel_writes();
+  release_shared_pending();
+
   // Don't do any sync'ing as whomever decided to shut down really
-  // doesn't care, so just de-reference all chunks in queue.
+  // doesn't care, so just de-reference all chunks in queue. Buffered
+  // chunks are still written back as their data isn't in the page
+  // cache.
   for (auto chunk : m_queue) {
     if (chunk->references() != 1 || chunk->writable() != 1)
       throw internal_error("ChunkList::clear() called but a node in the queue is still referenced.");
 
+    if (chunk->chunk()->is_buffered() && !is_write_held(chunk) && !chunk->chunk()->sync(MemoryChunk::sync_async))
+      LT_LOG_THIS(INFO, "Could not write back buffered chunk: index:%" PRIu32 ".", chunk->index());
+
+    m_manager->chunk_lru()->erase(chunk);
+
     chunk->dec_rw();
     clear_chunk(chunk);
   }
@@ -84,21 +108,39 @@ ChunkList::clear() {
     throw internal_error("ChunkList::clear() called but a node with blocking != 0 was found.");
 
   base_type::clear();
+  base_type::shrink_to_fit();
+}
+
+bool
+ChunkList::is_write_held(ChunkListNode* node) const {
+  return m_manager->is_buffered_writes() && node->chunk()->is_buffered() &&
+    m_slot_is_unverified && m_slot_is_unverified(node->index());
+}
+
+bool
+ChunkList::is_idle() const {
+  return m_queue.empty() && std::none_of(begin(), end(), std::mem_fn(&ChunkListNode::references));
 }
 
 ChunkHandle
 ChunkList::get(size_type index, int flags) {
   LT_LOG_THIS(DEBUG, "Get: index:%" PRIu32 " flags:%#x.", index, flags);
+  LT_PROBE3(chunk_get, this, index, flags);
 
   rak::error_number::clear_global();
 
+  if (m_shared_pending.load(std::memory_order_acquire))
+    release_shared_pending();
+
   ChunkListNode* node = &base_type::at(index);
 
   int allocate_flags = (flags & get_dont_log) ? ChunkManager::allocate_dont_log : 0;
   int prot_flags = MemoryChunk::prot_read | ((flags & get_writable) ? MemoryChunk::prot_write : 0);
 
   if (!node->is_valid()) {
-    if (!m_manager->allocate(m_chunk_size, allocate_flags)) {
+    uint32_t memory_size = m_manager->chunk_memory_size(m_chunk_size);
+
+    if (!m_manager->allocate(memory_size, allocate_flags)) {
       LT_LOG_THIS(DEBUG, "Could not allocate: memory:%" PRIu64 " block:%" PRIu32 ".",
                   m_manager->memory_usage(), m_manager->memory_block_count());
       return ChunkHandle::from_error(rak::error_number::e_nomem);
@@ -112,15 +154,16 @@ ChunkList::get(size_type index, int flags) {
       LT_LOG_THIS(DEBUG, "Could not create: memory:%" PRIu64 " block:%" PRIu32 " errno:%i errmsg:%s.",
                   m_manager->memory_usage(), m_manager->memory_block_count(),
                   current_error.value(), current_error.c_str());
-      m_manager->deallocate(m_chunk_size, allocate_flags | ChunkManager::allocate_revert_log);
+      m_manager->deallocate(memory_size, allocate_flags | ChunkManager::allocate_revert_log);
       return ChunkHandle::from_error(current_error.is_valid() ? current_error : rak::error_number::e_noent);
     }
 
     node->set_chunk(chunk);
+    node->set_memory_size(memory_size);
     node->set_time_modified(rak::timer());
 
   } else if (flags & get_writable && !node->chunk()->is_writable()) {
-    if (node->blocking() != 0) {
+    if (!node->try_lock_chunk()) {
       if ((flags & get_nonblock))
         return ChunkHandle::from_error(rak::error_number::e_again);
 
@@ -129,19 +172,26 @@ ChunkList::get(size_type index, int flags) {
 
     Chunk* chunk = m_slot_create_chunk(index, prot_flags);
 
-    if (chunk == NULL)
+    if (chunk == NULL) {
+      node->unlock_chunk();
       return ChunkHandle::from_error(rak::error_number::current().is_valid() ? rak::error_number::current() : rak::error_number::e_noent);
+    }
 
     delete node->chunk();
 
     node->set_chunk(chunk);
     node->set_time_modified(rak::timer());
+    node->unlock_chunk();
   }
 
+  if (ChunkLru::is_linked(node))
+    m_manager->chunk_lru()->touch(node);
+
   node->inc_references();
 
   if (flags & get_writable) {
     node->inc_writable();
+    node->inc_write_count();
 
     // Make sure that periodic syncing uses async on any subsequent
     // changes even if it was triggered before this get.
@@ -168,6 +218,7 @@ ChunkList::release(ChunkHandle* handle, int release_flags) {
     throw internal_error("ChunkList::release(...) received an unknown handle.");
 
   LT_LOG_THIS(DEBUG, "Release: index:%" PRIu32 " flags:%#x.", handle->index(), release_flags);
+  LT_PROBE3(chunk_release, this, handle->index(), release_flags);
  
   if (handle->object()->references() <= 0 ||
       (handle->is_writable() && handle->object()->writable() <= 0) ||
@@ -189,6 +240,7 @@ ChunkList::release(ChunkHandle* handle, int release_flags) {
       // Only chunks that are not already in the queue will execute
       // this branch.
       m_queue.push_back(handle->object());
+      m_manager->chunk_lru()->push_back(this, handle->object());
 
     } else {
       handle->object()->dec_rw();
@@ -206,6 +258,63 @@ ChunkList::release(ChunkHandle* handle, int release_flags) {
   handle->clear();
 }
 
+ChunkHandle
+ChunkList::get_shared(size_type index) {
+  if (index >= size())
+    throw internal_error("ChunkList::get_shared(...) index out of range.");
+
+  ChunkListNode* node = &base_type::operator[](index);
+
+  if (!node->try_inc_blocking())
+    return ChunkHandle::from_error(rak::error_number::e_again);
+
+  if (!node->try_inc_references()) {
+    node->dec_blocking();
+    return ChunkHandle::from_error(rak::error_number::e_again);
+  }
+
+  return ChunkHandle(node, false, true);
+}
+
+void
+ChunkList::release_shared(ChunkHandle* handle) {
+  if (!handle->is_valid() || handle->is_writable() || !handle->is_blocking())
+    throw internal_error("ChunkList::release_shared(...) received an invalid handle.");
+
+  ChunkListNode* node = handle->object();
+  handle->clear();
+
+  node->dec_blocking();
+
+  if (node->try_dec_references())
+    return;
+
+  auto lock = std::scoped_lock(m_shared_lock);
+  m_shared_released.push_back(node);
+  m_shared_pending.store(true, std::memory_order_release);
+}
+
+void
+ChunkList::release_shared_pending() {
+  Queue released;
+
+  {
+    auto lock = std::scoped_lock(m_shared_lock);
+    released.swap(m_shared_released);
+    m_shared_pending.store(false, std::memory_order_release);
+  }
+
+  for (auto node : released) {
+    if (node->dec_references() != 0)
+      continue;
+
+    if (is_queued(node))
+      throw internal_error("ChunkList::release_shared_pending() tried to unmap a queued chunk.");
+
+    clear_chunk(node);
+  }
+}
+
 void
 ChunkList::clear_chunk(ChunkListNode* node, int flags) {
   if (!node->is_valid())
@@ -214,7 +323,7 @@ ChunkList::clear_chunk(ChunkListNode* node, int flags) {
   delete node->chunk();
   node->set_chunk(NULL);
 
-  m_manager->deallocate(m_chunk_size, (flags & get_dont_log) ? ChunkManager::allocate_dont_log : 0);
+  m_manager->deallocate(node->memory_size(), (flags & get_dont_log) ? ChunkManager::allocate_dont_log : 0);
 }
 
 inline bool
@@ -222,9 +331,14 @@ ChunkList::sync_chunk(ChunkListNode* node, std::pair<int,bool> options) {
   if (node->references() <= 0 || node->writable() <= 0)
     throw internal_error("ChunkList::sync_chunk(...) got a node with invalid reference count.");
 
+  auto start = utils::time_since_epoch();
+
   if (!node->chunk()->sync(options.first))
     return false;
 
+  if (m_data != nullptr)
+    m_data->mutable_sync_latency()->insert(utils::time_since_epoch() - start);
+
   node->set_sync_triggered(true);
 
   // When returning here we're not properly deallocating the piece.
@@ -241,17 +355,88 @@ ChunkList::sync_chunk(ChunkListNode* node, std::pair<int,bool> options) {
   return true;
 }
 
+inline bool
+ChunkList::is_safe_sync() {
+  return m_manager->safe_sync() || m_slot_free_diskspace() <= m_manager->safe_free_diskspace();
+}
+
+void
+ChunkList::dequeue(ChunkListNode* node) {
+  m_manager->chunk_lru()->erase(node);
+  m_queue.erase(std::find(m_queue.begin(), m_queue.end(), node));
+}
+
+// Mapped chunks keep their changes in the page cache and are unmapped
+// right away, unless safe syncing needs them on disk first. The others
+// are synced and released, on the disk thread with async writes, in
+// which case their memory is freed once the writes are done.
+void
+ChunkList::evict_chunks(const Queue& nodes) {
+  LT_LOG_THIS(DEBUG, "Evict chunks: count:%zu.", nodes.size());
+
+  bool safe  = is_safe_sync();
+  int  flags = sync_force | (safe ? sync_safe : 0);
+  bool async = m_manager->is_async_write() && thread_disk() != nullptr && thread_self() != nullptr;
+
+  uint32_t           failed = 0;
+  pending_write_list writes;
+
+  for (auto node : nodes) {
+    if (!is_evictable(node) || !is_queued(node))
+      throw internal_error("ChunkList::evict_chunks(...) got a node that cannot be evicted.");
+
+    if (!safe && !node->chunk()->is_buffered()) {
+      dequeue(node);
+      node->dec_rw();
+      clear_chunk(node);
+      continue;
+    }
+
+    std::pair<int,bool> options = sync_options(node, flags);
+
+    if (async && queue_write(writes, node, options))
+      continue;
+
+    if (!sync_chunk(node, options)) {
+      failed++;
+      continue;
+    }
+
+    dequeue(node);
+  }
+
+  if (!writes.empty())
+    submit_writes(std::move(writes), flags);
+
+  if (failed)
+    m_slot_storage_error("Could not sync chunk: " + std::string(rak::error_number::current().c_str()));
+}
+
 uint32_t
 ChunkList::sync_chunks(int flags) {
   LT_LOG_THIS(DEBUG, "Sync chunks: flags:%#x.", flags);
 
+  utils::trace_span span("sync");
+
+  if (m_shared_pending.load(std::memory_order_acquire))
+    release_shared_pending();
+
   Queue::iterator split;
 
+  // A blocking sync of everything must not race the disk thread, so
+  // wait for it and sync the chunks it had not finished again here.
   if (flags & sync_all)
+    cancel_writes();
+
+  if ((flags & sync_all) && (flags & sync_discard_unverified))
     split = m_queue.begin();
+  else if (flags & sync_all)
+    split = std::stable_partition(m_queue.begin(), m_queue.end(), [this](ChunkListNode* n) {
+      return is_write_held(n);
+    });
   else
-    split = std::stable_partition(m_queue.begin(), m_queue.end(), [](ChunkListNode* n) {
-      return 1 != n->writable();
+    split = std::stable_partition(m_queue.begin(), m_queue.end(), [this](ChunkListNode* n) {
+      return 1 != n->writable() || n->is_write_pending() || is_write_held(n);
     });
 
   // Allow a flag that does more culling, so that we only get large
@@ -265,7 +450,7 @@ ChunkList::sync_chunks(int flags) {
   // If we got enough diskspace and have not requested safe syncing,
   // then sync all chunks with MS_ASYNC.
   if (!(flags & (sync_safe | sync_sloppy))) {
-    if (m_manager->safe_sync() || m_slot_free_diskspace() <= m_manager->safe_free_diskspace())
+    if (is_safe_sync())
       flags |= sync_safe;
     else
       flags |= sync_force;
@@ -277,6 +462,9 @@ ChunkList::sync_chunks(int flags) {
 
   uint32_t failed = 0;
 
+  bool async = m_manager->is_async_write() && !(flags & sync_all) && thread_disk() != nullptr && thread_self() != nullptr;
+  pending_write_list writes;
+
   for (auto itr = split, last = m_queue.end(); itr != last; ++itr) {
 
     // We can easily skip pieces by swap_iter, so there should be no
@@ -288,8 +476,27 @@ ChunkList::sync_chunks(int flags) {
 
     // if we don't want to sync, swap and break.
 
+    // Only reached with sync_discard_unverified, the buffer is
+    // released without writing it back.
+    if (is_write_held(*itr)) {
+      LT_LOG_THIS(DEBUG, "Discarding unverified chunk: index:%" PRIu32 ".", (*itr)->index());
+
+      (*itr)->dec_rw();
+
+      if ((*itr)->references() == 0)
+        clear_chunk(*itr);
+
+      continue;
+    }
+
     std::pair<int,bool> options = sync_options(*itr, flags);
 
+    // Chunks handed to the disk thread stay queued until it is done.
+    if (async && queue_write(writes, *itr, options)) {
+      std::iter_swap(itr, split++);
+      continue;
+    }
+
     if (!sync_chunk(*itr, options)) {
       std::iter_swap(itr, split++);
       
@@ -308,8 +515,14 @@ ChunkList::sync_chunks(int flags) {
     instrumentation_update(INSTRUMENTATION_MINCORE_SYNC_NOT_DEALLOCATED, std::count_if(split, m_queue.end(), std::mem_fn(&ChunkListNode::is_valid)));
   }
 
+  for (auto itr = split; itr != m_queue.end(); ++itr)
+    m_manager->chunk_lru()->erase(*itr);
+
   m_queue.erase(split, m_queue.end());
 
+  if (!writes.empty())
+    submit_writes(std::move(writes), flags);
+
   // The caller must either make sure that it is safe to close the
   // download or set the sync_ignore_error flag.
   if (failed && !(flags & sync_ignore_error))
@@ -318,6 +531,129 @@ ChunkList::sync_chunks(int flags) {
   return failed;
 }
 
+// Returns false if the chunk could not be prepared for syncing on the
+// disk thread, in which case the caller syncs it directly.
+bool
+ChunkList::queue_write(pending_write_list& writes, ChunkListNode* node, std::pair<int,bool> options) {
+  if (node->references() <= 0 || node->writable() <= 0)
+    throw internal_error("ChunkList::queue_write(...) got a node with invalid reference count.");
+
+  std::vector<int> fds;
+
+  if (!node->chunk()->dup_sync_fds(fds))
+    return false;
+
+  node->set_write_pending(true);
+  writes.push_back(pending_write{node, node->chunk(), options, node->write_count(), std::move(fds), false});
+
+  return true;
+}
+
+void
+ChunkList::submit_writes(pending_write_list&& writes, int flags) {
+  LT_LOG_THIS(DEBUG, "Queueing writes: count:%zu.", writes.size());
+
+  // Shared so that descriptors of batches dropped by 'cancel_writes'
+  // still get closed.
+  auto batch = std::shared_ptr<pending_write_list>(new pending_write_list(std::move(writes)), [](pending_write_list* w) {
+      for (auto& write : *w)
+        Chunk::close_sync_fds(write.fds);
+
+      delete w;
+    });
+
+  utils::Thread* thread = thread_self();
+  auto           start  = utils::time_since_epoch();
+
+  bool          drop_cache = m_manager->is_drop_cache();
+  DiskThrottle* throttle   = m_manager->disk_throttle();
+
+  uint64_t device = m_data != nullptr ? m_data->device() : 0;
+
+  thread_disk()->callback_device(device, this, [this, thread, flags, batch, start, drop_cache, throttle]() {
+      io_priority_set(io_class_write);
+
+      SyncScheduler scheduler;
+      scheduler.set_drop_cache(drop_cache);
+      scheduler.set_disk_throttle(throttle);
+
+      for (auto& write : *batch)
+        scheduler.add(write.chunk, write.options.first, &write.fds);
+
+      scheduler.perform();
+
+      for (unsigned int i = 0; i < batch->size(); i++)
+        (*batch)[i].success = scheduler.is_success(i);
+
+      auto latency = utils::time_since_epoch() - start;
+      auto ranges  = scheduler.range_count();
+      auto merged  = scheduler.merged_count();
+
+      thread->callback(this, [this, flags, batch, latency, ranges, merged]() {
+          LT_LOG_THIS(DEBUG, "Synced on disk thread: chunks:%zu ranges:%u merged:%u.", batch->size(), ranges, merged);
+          writes_done(*batch, flags, latency);
+        });
+    });
+}
+
+void
+ChunkList::writes_done(pending_write_list& writes, int flags, std::chrono::microseconds latency) {
+  uint32_t failed = 0;
+
+  for (auto& write : writes) {
+    ChunkListNode* node = write.node;
+
+    if (!node->is_write_pending() || node->chunk() != write.chunk)
+      throw internal_error("ChunkList::writes_done(...) node is not pending a write.");
+
+    node->set_write_pending(false);
+
+    if (!write.success) {
+      failed++;
+      continue;
+    }
+
+    node->set_sync_triggered(true);
+
+    if (m_data != nullptr)
+      m_data->mutable_sync_latency()->insert(latency);
+
+    // Keep the chunk queued if it was not a releasing sync, or if it
+    // was modified while being written.
+    if (!write.options.second || node->write_count() != write.write_count)
+      continue;
+
+    dequeue(node);
+    node->dec_rw();
+
+    if (node->references() == 0)
+      clear_chunk(node);
+  }
+
+  LT_LOG_THIS(DEBUG, "Writes done: count:%zu failed:%" PRIu32 ".", writes.size(), failed);
+
+  if (failed && !(flags & sync_ignore_error))
+    m_slot_storage_error("Could not sync chunk on the disk thread.");
+}
+
+void
+ChunkList::cancel_writes() {
+  if (std::none_of(m_queue.begin(), m_queue.end(), std::mem_fn(&ChunkListNode::is_write_pending)))
+    return;
+
+  LT_LOG_THIS(DEBUG, "Cancelling pending writes.", 0);
+
+  // Drop the queued batches, or wait for the one being written, and
+  // then drop the completions that have not been processed yet.
+  if (thread_disk() != nullptr)
+    thread_disk()->cancel_device_callbacks_and_wait(this);
+
+  thread_self()->cancel_callback_and_wait(this);
+
+  for (auto node : m_queue)
+    node->set_write_pending(false);
+}
+
 std::pair<int, bool>
 ChunkList::sync_options(ChunkListNode* node, int flags) {
   // Using if statements since some linkers have problem with static
@@ -1,7 +1,10 @@
 #ifndef LIBTORRENT_DATA_CHUNK_LIST_H
 #define LIBTORRENT_DATA_CHUNK_LIST_H
 
+#include <atomic>
+#include <chrono>
 #include <functional>
+#include <mutex>
 #include <string>
 #include <vector>
 
@@ -26,6 +29,7 @@ public:
   using slot_chunk_index = std::function<Chunk*(uint32_t, int)>;
   using slot_value       = std::function<uint64_t()>;
   using slot_string      = std::function<void(const std::string&)>;
+  using slot_index_check = std::function<bool(uint32_t)>;
 
   using base_type::value_type;
   using base_type::reference;
@@ -41,12 +45,13 @@ public:
   using base_type::empty;
   using base_type::operator[];
 
-  static constexpr int sync_all          = (1 << 0);
-  static constexpr int sync_force        = (1 << 1);
-  static constexpr int sync_safe         = (1 << 2);
-  static constexpr int sync_sloppy       = (1 << 3);
-  static constexpr int sync_use_timeout  = (1 << 4);
-  static constexpr int sync_ignore_error = (1 << 5);
+  static constexpr int sync_all                = (1 << 0);
+  static constexpr int sync_force              = (1 << 1);
+  static constexpr int sync_safe               = (1 << 2);
+  static constexpr int sync_sloppy             = (1 << 3);
+  static constexpr int sync_use_timeout        = (1 << 4);
+  static constexpr int sync_ignore_error       = (1 << 5);
+  static constexpr int sync_discard_unverified = (1 << 6);
 
   static constexpr int get_writable      = (1 << 0);
   static constexpr int get_blocking      = (1 << 1);
@@ -78,9 +83,25 @@ public:
   void                resize(size_type to_size);
   void                clear();
 
+  // No chunks are referenced or queued for syncing, so clear() would
+  // not drop any writes.
+  bool                is_idle() const;
+
   ChunkHandle         get(size_type index, int flags = 0);
   void                release(ChunkHandle* handle, int flags = 0);
 
+  // May be called from any thread. Returns a blocking read handle if
+  // the chunk is already held by another handle, else an invalid
+  // handle with e_again and the caller must ask the main thread. The
+  // chunk is never mapped or replaced, so the ChunkManager is not
+  // used.
+  //
+  // Releasing the last reference is deferred to the main thread, it
+  // is done by the next get or sync. The list must not be cleared
+  // while shared handles are held.
+  ChunkHandle         get_shared(size_type index);
+  void                release_shared(ChunkHandle* handle);
+
   // Replace use_timeout with something like performance related
   // keyword. Then use that flag to decide if we should skip
   // non-continious regions.
@@ -88,10 +109,27 @@ public:
   // Returns the number of failed syncs.
   uint32_t            sync_chunks(int flags);
 
+  // Queued chunks only the queue holds, which the ChunkManager may
+  // free with 'evict_chunks' when memory runs short.
+  static bool         is_evictable(const ChunkListNode* node) {
+    return node->references() == 1 && node->writable() == 1 && !node->is_write_pending();
+  }
+
+  void                evict_chunks(const Queue& nodes);
+
   slot_string&        slot_storage_error()  { return m_slot_storage_error; }
   slot_chunk_index&   slot_create_chunk()   { return m_slot_create_chunk; }
   slot_value&         slot_free_diskspace() { return m_slot_free_diskspace; }
 
+  // Whether the chunk still awaits a successful hash check, for
+  // holding back buffered writes.
+  slot_index_check&   slot_is_unverified()  { return m_slot_is_unverified; }
+
+  // Buffered chunks awaiting the hash check are never written back.
+  // Syncs and evictions skip them, and a sync_all with
+  // sync_discard_unverified drops them.
+  bool                is_write_held(ChunkListNode* node) const;
+
   using chunk_address_result = std::pair<iterator, Chunk::iterator>;
 
   chunk_address_result find_address(void* ptr);
@@ -101,10 +139,31 @@ private:
   ChunkList& operator=(const ChunkList&) = delete;
 
   inline bool         is_queued(ChunkListNode* node);
+  inline bool         is_safe_sync();
+
+  void                dequeue(ChunkListNode* node);
+
+  void                release_shared_pending();
 
   inline void         clear_chunk(ChunkListNode* node, int flags = 0);
   inline bool         sync_chunk(ChunkListNode* node, std::pair<int,bool> options);
 
+  struct pending_write {
+    ChunkListNode*      node;
+    Chunk*              chunk;
+    std::pair<int,bool> options;
+    uint32_t            write_count;
+    std::vector<int>    fds;
+    bool                success;
+  };
+
+  using pending_write_list = std::vector<pending_write>;
+
+  bool                queue_write(pending_write_list& writes, ChunkListNode* node, std::pair<int,bool> options);
+  void                submit_writes(pending_write_list&& writes, int flags);
+  void                writes_done(pending_write_list& writes, int flags, std::chrono::microseconds latency);
+  void                cancel_writes();
+
   Queue::iterator     partition_optimize(Queue::iterator first, Queue::iterator last, int weight, int maxDistance, bool dontSkip);
 
   inline Queue::iterator seek_range(Queue::iterator first, Queue::iterator last);
@@ -119,9 +178,14 @@ private:
   int                 m_flags{0};
   uint32_t            m_chunk_size{0};
 
+  std::mutex          m_shared_lock;
+  std::atomic<bool>   m_shared_pending{false};
+  Queue               m_shared_released;
+
   slot_string         m_slot_storage_error;
   slot_chunk_index    m_slot_create_chunk;
   slot_value          m_slot_free_diskspace;
+  slot_index_check    m_slot_is_unverified;
 };
 
 }
@@ -1,6 +1,7 @@
 #ifndef LIBTORRENT_DATA_CHUNK_LIST_NODE_H
 #define LIBTORRENT_DATA_CHUNK_LIST_NODE_H
 
+#include <atomic>
 #include <cinttypes>
 #include <new>
 #include <rak/timer.h>
@@ -8,6 +9,7 @@
 namespace torrent {
 
 class Chunk;
+class ChunkList;
 
 // ChunkNode can contain information like how long since it was last
 // used, last synced, last checked with mincore and how many
@@ -15,11 +17,20 @@ class Chunk;
 //
 // ChunkList will make sure all the nodes are cleaned up properly, so
 // no dtor is needed.
+//
+// The reference and blocking counts are atomic so that other threads
+// may take shared read handles, see ChunkList::get_shared. All other
+// members are only used by the main thread.
 
 class ChunkListNode {
 public:
   static constexpr uint32_t invalid_index = ~uint32_t();
 
+  ChunkListNode() = default;
+
+  // Only used when the ChunkList is resized, before any are shared.
+  ChunkListNode(ChunkListNode&& node) noexcept;
+
   bool                is_valid() const               { return m_chunk != NULL; }
 
   uint32_t            index() const                  { return m_index; }
@@ -37,35 +48,105 @@ public:
   bool                sync_triggered() const         { return m_asyncTriggered; }
   void                set_sync_triggered(bool v)     { m_asyncTriggered = v; }
 
-  int                 references() const             { return m_references; }
-  int                 dec_references()               { return --m_references; }
-  int                 inc_references()               { return ++m_references; }
+  // Set while the disk thread is syncing the chunk.
+  bool                is_write_pending() const       { return m_writePending; }
+  void                set_write_pending(bool v)      { m_writePending = v; }
+
+  // Counts the writable handles given out, used to tell if the chunk
+  // may have been modified during a sync.
+  uint32_t            write_count() const            { return m_writeCount; }
+  void                inc_write_count()              { m_writeCount++; }
+
+  // The memory accounted with the ChunkManager for the chunk.
+  uint32_t            memory_size() const            { return m_memorySize; }
+  void                set_memory_size(uint32_t size) { m_memorySize = size; }
+
+  int                 references() const             { return m_references.load(std::memory_order_acquire); }
+  int                 dec_references()               { return m_references.fetch_sub(1, std::memory_order_acq_rel) - 1; }
+  int                 inc_references()               { return m_references.fetch_add(1, std::memory_order_acq_rel) + 1; }
+
+  // Takes a reference only if someone else holds one, so the chunk
+  // cannot be freed meanwhile, and drops one unless it is the last.
+  bool                try_inc_references()           { return try_add(m_references, 1, 1); }
+  bool                try_dec_references()           { return try_add(m_references, 2, -1); }
 
   int                 writable() const               { return m_writable; }
   int                 dec_writable()                 { return --m_writable; }
   int                 inc_writable()                 { return ++m_writable; }
 
-  int                 blocking() const               { return m_blocking; }
-  int                 dec_blocking()                 { return --m_blocking; }
-  int                 inc_blocking()                 { return ++m_blocking; }
+  int                 blocking() const               { return m_blocking.load(std::memory_order_acquire); }
+  int                 dec_blocking()                 { return m_blocking.fetch_sub(1, std::memory_order_acq_rel) - 1; }
+  int                 inc_blocking()                 { return m_blocking.fetch_add(1, std::memory_order_acq_rel) + 1; }
+
+  // Blocking handles keep the chunk from being replaced by a writable
+  // one. The main thread locks the node while replacing the chunk, and
+  // fails if there are blocking handles.
+  bool                try_inc_blocking()             { return try_add(m_blocking, 0, 1); }
+  bool                try_lock_chunk()               { int expected = 0; return m_blocking.compare_exchange_strong(expected, -1, std::memory_order_acq_rel); }
+  void                unlock_chunk()                 { m_blocking.store(0, std::memory_order_release); }
 
   void                inc_rw()                       { inc_writable(); inc_references(); }
   void                dec_rw()                       { dec_writable(); dec_references(); }
 
+  // Links of the ChunkManager's ChunkLru, set while the node is
+  // queued for syncing.
+  ChunkList*          lru_list() const               { return m_lruList; }
+  ChunkListNode*      lru_prev() const               { return m_lruPrev; }
+  ChunkListNode*      lru_next() const               { return m_lruNext; }
+
+  void                set_lru_prev(ChunkListNode* n) { m_lruPrev = n; }
+  void                set_lru_next(ChunkListNode* n) { m_lruNext = n; }
+  void                set_lru_links(ChunkList* l, ChunkListNode* p, ChunkListNode* n) { m_lruList = l; m_lruPrev = p; m_lruNext = n; }
+
 private:
+  static bool         try_add(std::atomic<int>& value, int min, int n);
+
   uint32_t            m_index{invalid_index};
   Chunk*              m_chunk{};
+  uint32_t            m_memorySize{0};
 
-  int                 m_references{0};
+  std::atomic<int>    m_references{0};
   int                 m_writable{0};
-  int                 m_blocking{0};
+  std::atomic<int>    m_blocking{0};
 
   bool                m_asyncTriggered{false};
+  bool                m_writePending{false};
+  uint32_t            m_writeCount{0};
 
   rak::timer          m_timeModified;
   rak::timer          m_timePreloaded;
+
+  ChunkList*          m_lruList{};
+  ChunkListNode*      m_lruPrev{};
+  ChunkListNode*      m_lruNext{};
 };
 
+inline
+ChunkListNode::ChunkListNode(ChunkListNode&& node) noexcept :
+    m_index(node.m_index),
+    m_chunk(node.m_chunk),
+    m_memorySize(node.m_memorySize),
+    m_references(node.references()),
+    m_writable(node.m_writable),
+    m_blocking(node.blocking()),
+    m_asyncTriggered(node.m_asyncTriggered),
+    m_writePending(node.m_writePending),
+    m_writeCount(node.m_writeCount),
+    m_timeModified(node.m_timeModified),
+    m_timePreloaded(node.m_timePreloaded) {
+}
+
+inline bool
+ChunkListNode::try_add(std::atomic<int>& value, int min, int n) {
+  int current = value.load(std::memory_order_relaxed);
+
+  while (current >= min)
+    if (value.compare_exchange_weak(current, current + n, std::memory_order_acq_rel, std::memory_order_relaxed))
+      return true;
+
+  return false;
+}
+
 }
 
 #endif
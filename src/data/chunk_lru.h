@@ -0,0 +1,88 @@
+#ifndef LIBTORRENT_DATA_CHUNK_LRU_H
+#define LIBTORRENT_DATA_CHUNK_LRU_H
+
+#include <cinttypes>
+
+#include "data/chunk_list_node.h"
+
+namespace torrent {
+
+class ChunkList;
+
+// The chunks queued for syncing by all chunk lists, least recently
+// used first, so the ChunkManager can free the coldest mappings when
+// memory runs short without syncing every download.
+//
+// The links are kept in the nodes, making every operation O(1). A
+// chunk list must unlink its nodes before they leave its queue.
+
+class ChunkLru {
+public:
+  ChunkLru() = default;
+  ~ChunkLru() = default;
+
+  ChunkLru(const ChunkLru&) = delete;
+  ChunkLru& operator=(const ChunkLru&) = delete;
+
+  bool                empty() const                         { return m_front == nullptr; }
+  uint32_t            size() const                          { return m_size; }
+
+  ChunkListNode*      front() const                         { return m_front; }
+  ChunkListNode*      next(const ChunkListNode* node) const { return node->lru_next(); }
+
+  static bool         is_linked(const ChunkListNode* node)  { return node->lru_list() != nullptr; }
+
+  // Links the node as the most recently used.
+  void                push_back(ChunkList* chunk_list, ChunkListNode* node);
+  void                touch(ChunkListNode* node);
+  void                erase(ChunkListNode* node);
+
+private:
+  ChunkListNode*      m_front{};
+  ChunkListNode*      m_back{};
+  uint32_t            m_size{0};
+};
+
+inline void
+ChunkLru::push_back(ChunkList* chunk_list, ChunkListNode* node) {
+  node->set_lru_links(chunk_list, m_back, nullptr);
+
+  if (m_back != nullptr)
+    m_back->set_lru_next(node);
+  else
+    m_front = node;
+
+  m_back = node;
+  m_size++;
+}
+
+inline void
+ChunkLru::touch(ChunkListNode* node) {
+  if (node == m_back)
+    return;
+
+  ChunkList* chunk_list = node->lru_list();
+
+  erase(node);
+  push_back(chunk_list, node);
+}
+
+inline void
+ChunkLru::erase(ChunkListNode* node) {
+  if (node->lru_prev() != nullptr)
+    node->lru_prev()->set_lru_next(node->lru_next());
+  else
+    m_front = node->lru_next();
+
+  if (node->lru_next() != nullptr)
+    node->lru_next()->set_lru_prev(node->lru_prev());
+  else
+    m_back = node->lru_prev();
+
+  node->set_lru_links(nullptr, nullptr, nullptr);
+  m_size--;
+}
+
+}
+
+#endif
@@ -4,7 +4,10 @@
 #include <unistd.h>
 
 #include "torrent/exceptions.h"
+#include "torrent/data/file.h"
+#include "chunk_buffer_pool.h"
 #include "chunk_part.h"
+#include "socket_file.h"
 
 namespace torrent {
 
@@ -15,17 +18,61 @@ ChunkPart::clear() {
     m_chunk.unmap();
     break;
 
-  default:
+  case MAPPED_BUFFER:
+    if (m_buffer_pool == NULL)
+      throw internal_error("ChunkPart::clear() MAPPED_BUFFER part has no buffer pool.");
+
+    m_buffer_pool->release(m_chunk);
+    break;
+
   case MAPPED_STATIC:
-    throw internal_error("ChunkPart::clear() only MAPPED_MMAP supported.");
     break;
+
+  default:
+    throw internal_error("ChunkPart::clear() unknown mapping type.");
   }
 
   m_chunk.clear();
 }
 
+bool
+ChunkPart::sync(int flags) {
+  // Padding is never written, it is zeros by definition.
+  if (m_mapped == MAPPED_STATIC || (m_file != NULL && m_file->is_padding()))
+    return true;
+
+  if (m_mapped != MAPPED_BUFFER)
+    return m_chunk.sync(0, m_chunk.size(), flags);
+
+  if (!m_chunk.is_writable())
+    return true;
+
+  // The FileManager may have closed the file since the part was read.
+  if (m_file == NULL || !m_file->prepare(m_chunk.get_prot()))
+    return false;
+
+  return write_back(m_file->file_descriptor(), flags);
+}
+
+bool
+ChunkPart::write_back(int fd, int flags) {
+  if (!needs_write_back())
+    throw internal_error("ChunkPart::write_back(...) called on a part that isn't a writable buffer.");
+
+  SocketFile file(fd);
+
+  if (!file.write_buffer_chunk(m_chunk, m_file_offset))
+    return false;
+
+  return !(flags & MemoryChunk::sync_sync) || file.sync_data();
+}
+
 bool
 ChunkPart::is_incore(uint32_t pos, uint32_t length) {
+  // Zero pages don't show up in mincore until touched.
+  if (m_mapped == MAPPED_STATIC || (m_file != NULL && m_file->is_padding()))
+    return true;
+
   length = std::min(length, remaining_from(pos));
   pos = pos - m_position;
 
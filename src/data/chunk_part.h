@@ -7,13 +7,15 @@
 
 namespace torrent {
 
+class ChunkBufferPool;
 class File;
 
 class ChunkPart {
 public:
   enum mapped_type {
     MAPPED_MMAP,
-    MAPPED_STATIC
+    MAPPED_STATIC,
+    MAPPED_BUFFER
   };
 
   ChunkPart(mapped_type mapped, const MemoryChunk& c, uint32_t pos) :
@@ -26,6 +28,15 @@ public:
 
   void                clear();
 
+  // Buffered parts are written back to the file with pwrite, mmap'ed
+  // parts are msync'ed. Padding and static parts are skipped.
+  bool                sync(int flags);
+
+  // Writable buffered parts need an open file descriptor to be synced,
+  // 'write_back' lets the caller supply one.
+  bool                needs_write_back() const              { return m_mapped == MAPPED_BUFFER && m_chunk.is_writable(); }
+  bool                write_back(int fd, int flags);
+
   mapped_type         mapped() const                        { return m_mapped; }
 
   MemoryChunk&        chunk()                               { return m_chunk; }
@@ -41,6 +52,10 @@ public:
 
   void                set_file(File* f, uint64_t f_offset)  { m_file = f; m_file_offset = f_offset; }
 
+  // The pool a MAPPED_BUFFER part is returned to on clear.
+  ChunkBufferPool*    buffer_pool() const                   { return m_buffer_pool; }
+  void                set_buffer_pool(ChunkBufferPool* p)   { m_buffer_pool = p; }
+
   bool                is_incore(uint32_t pos, uint32_t length = ~uint32_t());
   uint32_t            incore_length(uint32_t pos, uint32_t length = ~uint32_t());
 
@@ -55,6 +70,8 @@ private:
   // temporary storage, etc.
   File*               m_file{};
   uint64_t            m_file_offset{0};
+
+  ChunkBufferPool*    m_buffer_pool{};
 };
 
 }
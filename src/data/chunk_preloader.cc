@@ -0,0 +1,245 @@
+#include "config.h"
+
+#include "data/chunk_preloader.h"
+
+#include <algorithm>
+#include <utility>
+
+#include "data/chunk_list.h"
+#include "data/chunk_residency.h"
+#include "data/disk_throttle.h"
+#include "data/io_priority.h"
+#include "data/thread_disk.h"
+#include "torrent/chunk_manager.h"
+#include "torrent/data/download_data.h"
+#include "torrent/exceptions.h"
+#include "torrent/utils/chrono.h"
+#include "torrent/utils/log.h"
+#include "torrent/utils/thread.h"
+
+#define LT_LOG_THIS(log_level, log_fmt, ...)                              \
+  lt_log_print_data(LOG_STORAGE_##log_level, m_chunk_list->data(), "chunk_preloader", log_fmt, __VA_ARGS__);
+
+namespace torrent {
+
+ChunkPreloader::~ChunkPreloader() {
+  clear();
+}
+
+bool
+ChunkPreloader::is_queued(uint32_t index) const {
+  return find(index) != m_entries.end();
+}
+
+bool
+ChunkPreloader::is_loaded(uint32_t index) const {
+  auto itr = find(index);
+
+  return itr != m_entries.end() && itr->loaded;
+}
+
+bool
+ChunkPreloader::insert(uint32_t index) {
+  if (index >= m_chunk_list->size())
+    throw internal_error("ChunkPreloader::insert(...) index out of range.");
+
+  expire();
+
+  if (is_queued(index) || (m_residency != nullptr && m_residency->is_resident(index)))
+    return true;
+
+  // The pread backend reads the chunk when it is retrieved, which
+  // would block the main thread.
+  if (m_chunk_manager->storage_backend() != ChunkManager::storage_mmap || m_entries.size() >= max_size)
+    return false;
+
+  uint32_t chunk_size = m_chunk_list->chunk_size();
+
+  if (m_chunk_manager->preload_memory_usage() + chunk_size > m_chunk_manager->preload_budget()) {
+    m_chunk_manager->inc_stats_not_preloaded();
+    return false;
+  }
+
+  bool inline_preload = m_chunk_manager->preload_type() == 1 || thread_disk() == nullptr;
+
+  // The main thread can't wait for read quota, so the chunk is skipped.
+  if (inline_preload &&
+      !m_chunk_manager->disk_throttle()->try_acquire(DiskThrottle::class_read, chunk_size, 1, DiskThrottle::current_time())) {
+    m_chunk_manager->inc_stats_not_preloaded();
+    return false;
+  }
+
+  ChunkHandle handle = m_chunk_list->get(index, ChunkList::get_dont_log);
+
+  if (!handle.is_valid()) {
+    m_chunk_manager->inc_stats_not_preloaded();
+    return false;
+  }
+
+  Chunk* chunk = handle.chunk();
+
+  m_entries.push_back(entry_type{handle, utils::time_since_epoch(), false, false});
+  m_memory_usage += chunk_size;
+  m_chunk_manager->inc_preload_memory_usage(chunk_size);
+
+  LT_LOG_THIS(DEBUG, "Preloading chunk: index:%" PRIu32 " queued:%zu.", index, m_entries.size());
+
+  if (inline_preload) {
+    m_entries.back().dispatched = true;
+
+    chunk->preload(0, chunk->chunk_size(), m_chunk_manager->preload_type() == 1);
+    loaded(index, chunk);
+    return true;
+  }
+
+  dispatch();
+  return true;
+}
+
+void
+ChunkPreloader::dispatch() {
+  if (m_busy)
+    return;
+
+  std::vector<request_type> requests;
+
+  for (const auto& entry : m_entries)
+    if (!entry.dispatched)
+      requests.push_back(request_type{entry.handle.index(), entry.time});
+
+  if (requests.empty())
+    return;
+
+  elevator_order(requests, m_head, utils::time_since_epoch() - max_delay);
+
+  std::vector<std::pair<uint32_t, Chunk*>> batch;
+
+  for (const auto& request : requests) {
+    auto itr = find(request.index);
+
+    itr->dispatched = true;
+    batch.emplace_back(request.index, itr->handle.chunk());
+  }
+
+  m_busy = true;
+  m_head = batch.back().first + 1;
+
+  LT_LOG_THIS(DEBUG, "Dispatching preload batch: first:%" PRIu32 " size:%zu.", batch.front().first, batch.size());
+
+  utils::Thread* thread   = thread_self();
+  DiskThrottle*  throttle = m_chunk_manager->disk_throttle();
+
+  uint64_t device = m_chunk_list->data() != nullptr ? m_chunk_list->data()->device() : 0;
+
+  thread_disk()->callback_device(device, this, [this, thread, throttle, batch = std::move(batch)]() {
+      io_priority_set(io_class_upload);
+
+      for (const auto& entry : batch) {
+        throttle->acquire(DiskThrottle::class_read, entry.second->chunk_size(), 1);
+        entry.second->preload(0, entry.second->chunk_size(), false);
+
+        thread->callback(this, [this, index = entry.first, chunk = entry.second]() {
+            loaded(index, chunk);
+          });
+      }
+
+      thread->callback(this, [this]() {
+          m_busy = false;
+          dispatch();
+        });
+    });
+}
+
+void
+ChunkPreloader::elevator_order(std::vector<request_type>& requests, uint32_t head, std::chrono::microseconds deadline) {
+  auto late = std::stable_partition(requests.begin(), requests.end(), [deadline](const request_type& r) {
+      return r.time < deadline;
+    });
+
+  std::stable_sort(requests.begin(), late, [](const request_type& a, const request_type& b) {
+      return a.time < b.time;
+    });
+
+  std::sort(late, requests.end(), [head](const request_type& a, const request_type& b) {
+      return std::make_pair(a.index < head, a.index) < std::make_pair(b.index < head, b.index);
+    });
+}
+
+bool
+ChunkPreloader::take(uint32_t index) {
+  auto itr = find(index);
+
+  if (itr == m_entries.end() || !itr->loaded)
+    return false;
+
+  erase(itr);
+  return true;
+}
+
+void
+ChunkPreloader::expire() {
+  auto expire_time = utils::time_since_epoch() - max_age;
+
+  for (auto itr = m_entries.begin(); itr != m_entries.end(); ) {
+    if (itr->loaded && itr->time < expire_time)
+      erase(itr);
+    else
+      ++itr;
+  }
+}
+
+void
+ChunkPreloader::clear() {
+  if (m_entries.empty() && !m_busy)
+    return;
+
+  // Wait for the chunk being touched, and drop the completions that
+  // have not been processed yet.
+  if (thread_disk() != nullptr)
+    thread_disk()->cancel_device_callbacks_and_wait(this);
+
+  if (thread_self() != nullptr)
+    thread_self()->cancel_callback_and_wait(this);
+
+  while (!m_entries.empty())
+    erase(std::prev(m_entries.end()));
+
+  m_busy = false;
+}
+
+ChunkPreloader::entry_list::iterator
+ChunkPreloader::find(uint32_t index) {
+  return std::find_if(m_entries.begin(), m_entries.end(), [index](const entry_type& e) { return e.handle.index() == index; });
+}
+
+ChunkPreloader::entry_list::const_iterator
+ChunkPreloader::find(uint32_t index) const {
+  return std::find_if(m_entries.begin(), m_entries.end(), [index](const entry_type& e) { return e.handle.index() == index; });
+}
+
+void
+ChunkPreloader::erase(entry_list::iterator itr) {
+  uint32_t chunk_size = m_chunk_list->chunk_size();
+
+  m_chunk_list->release(&itr->handle, ChunkList::get_dont_log);
+  m_entries.erase(itr);
+
+  m_memory_usage -= chunk_size;
+  m_chunk_manager->dec_preload_memory_usage(chunk_size);
+}
+
+void
+ChunkPreloader::loaded(uint32_t index, Chunk* chunk) {
+  auto itr = find(index);
+
+  if (itr == m_entries.end() || itr->handle.chunk() != chunk)
+    throw internal_error("ChunkPreloader::loaded(...) chunk not found.");
+
+  itr->loaded = true;
+  itr->time = utils::time_since_epoch();
+
+  if (m_residency != nullptr)
+    m_residency->set_resident(index);
+}
+
+}
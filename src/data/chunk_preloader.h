@@ -0,0 +1,108 @@
+#ifndef LIBTORRENT_DATA_CHUNK_PRELOADER_H
+#define LIBTORRENT_DATA_CHUNK_PRELOADER_H
+
+#include <chrono>
+#include <cinttypes>
+#include <vector>
+
+#include "data/chunk_handle.h"
+
+namespace torrent {
+
+class Chunk;
+class ChunkList;
+class ChunkManager;
+class ChunkResidency;
+
+// Prefetches chunks that unchoked peers are expected to request next,
+// so that the upload path doesn't stall on major page faults. The
+// pages are touched on the disk thread while the preloader holds a
+// read-only handle, which is dropped when a peer picks up the chunk or
+// after 'max_age'.
+//
+// The memory held by all preloaders is limited by
+// 'ChunkManager::preload_budget'. Chunks that the ChunkResidency, if
+// any, reports as already in the page cache are not preloaded.
+//
+// Chunks requested while the disk thread is busy are gathered and
+// handed over as one batch in elevator order, sweeping up through the
+// torrent from where the last batch ended before wrapping around, so
+// the reads for many peers are served close to sequentially. Chunks
+// that waited longer than 'max_delay' go first.
+
+class ChunkPreloader {
+public:
+  static constexpr std::chrono::seconds max_age{30};
+  static constexpr unsigned int         max_size = 32;
+
+  static constexpr std::chrono::milliseconds max_delay{500};
+
+  struct request_type {
+    uint32_t                  index;
+    std::chrono::microseconds time;
+  };
+
+  ChunkPreloader(ChunkList* chunk_list, ChunkManager* chunk_manager, ChunkResidency* residency = nullptr) :
+    m_chunk_list(chunk_list), m_chunk_manager(chunk_manager), m_residency(residency) {}
+  ~ChunkPreloader();
+
+  ChunkPreloader(const ChunkPreloader&) = delete;
+  ChunkPreloader& operator=(const ChunkPreloader&) = delete;
+
+  bool                empty() const                 { return m_entries.empty(); }
+  size_t              size() const                  { return m_entries.size(); }
+  uint64_t            memory_usage() const          { return m_memory_usage; }
+
+  bool                is_queued(uint32_t index) const;
+  bool                is_loaded(uint32_t index) const;
+
+  // Returns false if the chunk wasn't queued due to the budget, or
+  // because it could not be retrieved. Resident chunks are not queued
+  // and return true.
+  bool                insert(uint32_t index);
+
+  // Called when a peer has got its own handle to the chunk, returns
+  // true if the chunk had finished preloading.
+  bool                take(uint32_t index);
+
+  void                expire();
+  void                clear();
+
+  // Orders the requests for a sweep starting at 'head', with those
+  // requested before 'deadline' first in the order they came.
+  static void         elevator_order(std::vector<request_type>& requests, uint32_t head, std::chrono::microseconds deadline);
+
+private:
+  struct entry_type {
+    ChunkHandle               handle;
+    std::chrono::microseconds time;
+    bool                      loaded;
+    bool                      dispatched;
+  };
+
+  using entry_list = std::vector<entry_type>;
+
+  entry_list::iterator       find(uint32_t index);
+  entry_list::const_iterator find(uint32_t index) const;
+
+  void                erase(entry_list::iterator itr);
+  void                loaded(uint32_t index, Chunk* chunk);
+
+  void                dispatch();
+
+  ChunkList*          m_chunk_list;
+  ChunkManager*       m_chunk_manager;
+  ChunkResidency*     m_residency;
+
+  entry_list          m_entries;
+  uint64_t            m_memory_usage{0};
+
+  // Set while the disk thread has a batch, and the index after the
+  // last chunk of it.
+  bool                m_busy{false};
+  uint32_t            m_head{0};
+};
+
+}
+
+#endif
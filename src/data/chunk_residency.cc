@@ -0,0 +1,91 @@
+#include "config.h"
+
+#include "data/chunk_residency.h"
+
+#include "data/chunk.h"
+#include "data/chunk_list.h"
+#include "torrent/chunk_manager.h"
+#include "torrent/data/download_data.h"
+#include "torrent/exceptions.h"
+#include "torrent/utils/chrono.h"
+#include "torrent/utils/log.h"
+
+#define LT_LOG_THIS(log_level, log_fmt, ...)                              \
+  lt_log_print_data(LOG_STORAGE_##log_level, m_chunk_list->data(), "chunk_residency", log_fmt, __VA_ARGS__);
+
+namespace torrent {
+
+namespace {
+
+uint32_t
+current_seconds() {
+  return utils::cast_seconds(utils::time_since_epoch()).count();
+}
+
+}
+
+bool
+ChunkResidency::is_resident(uint32_t index) const {
+  return index < m_resident_time.size() && is_fresh(m_resident_time[index], current_seconds());
+}
+
+uint32_t
+ChunkResidency::size_resident() const {
+  uint32_t now = current_seconds();
+  uint32_t count = 0;
+
+  for (auto time : m_resident_time)
+    count += is_fresh(time, now);
+
+  return count;
+}
+
+// Chunks from the pread backend are copies that are dropped when
+// released, and pooled buffers say nothing about the page cache.
+uint32_t
+ChunkResidency::sample() {
+  if (m_chunk_manager->storage_backend() != ChunkManager::storage_mmap) {
+    clear();
+    return 0;
+  }
+
+  m_resident_time.resize(m_chunk_list->size(), 0);
+
+  uint32_t now = current_seconds();
+  uint32_t mapped = 0;
+  uint32_t resident = 0;
+
+  for (const auto& node : *m_chunk_list) {
+    if (!node.is_valid() || node.chunk()->is_buffered() || node.chunk()->chunk_size() == 0)
+      continue;
+
+    mapped++;
+
+    if (node.chunk()->is_incore(0)) {
+      m_resident_time[node.index()] = now;
+      resident++;
+    } else {
+      m_resident_time[node.index()] = 0;
+    }
+  }
+
+  LT_LOG_THIS(DEBUG, "Sampled chunk residency: mapped:%" PRIu32 " resident:%" PRIu32 ".", mapped, resident);
+
+  return mapped;
+}
+
+void
+ChunkResidency::set_resident(uint32_t index) {
+  if (index >= m_chunk_list->size())
+    throw internal_error("ChunkResidency::set_resident(...) index out of range.");
+
+  m_resident_time.resize(m_chunk_list->size(), 0);
+  m_resident_time[index] = current_seconds();
+}
+
+void
+ChunkResidency::clear() {
+  m_resident_time = std::vector<uint32_t>();
+}
+
+}
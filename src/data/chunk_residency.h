@@ -0,0 +1,57 @@
+#ifndef LIBTORRENT_DATA_CHUNK_RESIDENCY_H
+#define LIBTORRENT_DATA_CHUNK_RESIDENCY_H
+
+#include <chrono>
+#include <cinttypes>
+#include <vector>
+
+namespace torrent {
+
+class ChunkList;
+class ChunkManager;
+
+// Tracks which chunks of a download were in the page cache when last
+// seen, so that uploads can prefer requests that won't block on major
+// page faults and the preloader can skip chunks that are cached.
+//
+// Only mapped chunks can be checked with mincore, so 'sample' looks at
+// the chunks currently held by the ChunkList. Chunks that have since
+// been unmapped keep their state for 'max_age', after which the pages
+// may have been evicted. Checking residency doesn't fault pages in, so
+// sampling is cheap enough for the main thread.
+
+class ChunkResidency {
+public:
+  static constexpr std::chrono::seconds max_age{120};
+
+  ChunkResidency(ChunkList* chunk_list, ChunkManager* chunk_manager) :
+    m_chunk_list(chunk_list), m_chunk_manager(chunk_manager) {}
+
+  ChunkResidency(const ChunkResidency&) = delete;
+  ChunkResidency& operator=(const ChunkResidency&) = delete;
+
+  bool                is_resident(uint32_t index) const;
+  uint32_t            size_resident() const;
+
+  // Returns the number of mapped chunks checked.
+  uint32_t            sample();
+
+  // Marks a chunk as resident after it has been read or preloaded.
+  void                set_resident(uint32_t index);
+
+  void                clear();
+
+private:
+  bool                is_fresh(uint32_t time, uint32_t now) const { return time != 0 && now - time < max_age.count(); }
+
+  ChunkList*          m_chunk_list;
+  ChunkManager*       m_chunk_manager;
+
+  // Seconds since the epoch when the chunk was last seen resident, or
+  // zero if it wasn't.
+  std::vector<uint32_t> m_resident_time;
+};
+
+}
+
+#endif
@@ -0,0 +1,95 @@
+#include "config.h"
+
+#include "data/content_index.h"
+
+#include <algorithm>
+
+#include "download/download_wrapper.h"
+#include "torrent/data/file.h"
+#include "torrent/data/file_list.h"
+#include "utils/sha1.h"
+
+namespace torrent {
+
+bool
+ContentIndex::make_key(uint64_t torrent_size, uint32_t chunk_size, uint64_t file_offset, uint64_t file_size,
+                       const char* piece_hashes, content_key* key) {
+  uint64_t file_end = file_offset + file_size;
+
+  if (chunk_size == 0 || file_size == 0 || file_offset % chunk_size != 0)
+    return false;
+
+  if (file_end % chunk_size != 0 && file_end != torrent_size)
+    return false;
+
+  auto first = static_cast<uint32_t>(file_offset / chunk_size);
+  auto last  = static_cast<uint32_t>((file_end + chunk_size - 1) / chunk_size);
+
+  Sha1 sha1;
+  sha1.init();
+  sha1.update(piece_hashes + first * HashString::size_data, (last - first) * HashString::size_data);
+  sha1.final_c(key->digest.data());
+
+  key->size       = file_size;
+  key->chunk_size = chunk_size;
+
+  return true;
+}
+
+void
+ContentIndex::insert(const content_key& key, DownloadWrapper* download, File* file) {
+  m_index.emplace(key, value_type(download, file));
+  m_downloads[download].push_back(key);
+}
+
+void
+ContentIndex::insert_download(DownloadWrapper* download) {
+  FileList*          file_list = download->main()->file_list();
+  const std::string& hashes = download->complete_hash();
+
+  if (hashes.size() != file_list->size_chunks() * HashString::size_data)
+    return;
+
+  for (const auto& file : *file_list) {
+    content_key key;
+
+    if (file->is_padding() ||
+        !make_key(file_list->size_bytes(), file_list->chunk_size(), file->offset(), file->size_bytes(), hashes.c_str(), &key))
+      continue;
+
+    insert(key, download, file.get());
+  }
+}
+
+void
+ContentIndex::erase_download(DownloadWrapper* download) {
+  auto itr = m_downloads.find(download);
+
+  if (itr == m_downloads.end())
+    return;
+
+  for (const auto& key : itr->second) {
+    auto range = m_index.equal_range(key);
+
+    for (auto entry = range.first; entry != range.second; )
+      if (entry->second.first == download)
+        entry = m_index.erase(entry);
+      else
+        ++entry;
+  }
+
+  m_downloads.erase(itr);
+}
+
+ContentIndex::value_list
+ContentIndex::find(const content_key& key) const {
+  value_list result;
+  auto range = m_index.equal_range(key);
+
+  for (auto itr = range.first; itr != range.second; ++itr)
+    result.push_back(itr->second);
+
+  return result;
+}
+
+}
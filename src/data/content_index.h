@@ -0,0 +1,71 @@
+#ifndef LIBTORRENT_DATA_CONTENT_INDEX_H
+#define LIBTORRENT_DATA_CONTENT_INDEX_H
+
+#include <cinttypes>
+#include <map>
+#include <tuple>
+#include <vector>
+
+#include "torrent/hash_string.h"
+
+namespace torrent {
+
+class DownloadWrapper;
+class File;
+
+// Identifies the content of a file by its size and the piece hashes
+// covering it. Only files whose first and last piece are entirely
+// their own have a key, i.e. files starting on a piece boundary and
+// ending on one or at the end of the torrent, as is the case for
+// single-file torrents and those padded per BEP 47.
+struct content_key {
+  uint64_t            size;
+  uint32_t            chunk_size;
+  HashString          digest;
+
+  bool operator < (const content_key& other) const {
+    return std::tie(size, chunk_size, digest) < std::tie(other.size, other.chunk_size, other.digest);
+  }
+
+  bool operator == (const content_key& other) const {
+    return size == other.size && chunk_size == other.chunk_size && digest == other.digest;
+  }
+};
+
+// Index of the files of all downloads by content, so files found in
+// several torrents can share one file on disk, and the pieces verified
+// for one download are known to be good for the others.
+//
+// Downloads are indexed when added to the manager, using the piece
+// hashes from the torrent, so no data needs to be read.
+
+class ContentIndex {
+public:
+  using value_type = std::pair<DownloadWrapper*, File*>;
+  using value_list = std::vector<value_type>;
+
+  // The digest is the SHA1 of the piece hashes of [first, last>, and
+  // 'piece_hashes' points to those of the whole torrent.
+  static bool         make_key(uint64_t torrent_size, uint32_t chunk_size, uint64_t file_offset, uint64_t file_size,
+                               const char* piece_hashes, content_key* key);
+
+  size_t              size() const { return m_index.size(); }
+  bool                empty() const { return m_index.empty(); }
+
+  void                insert(const content_key& key, DownloadWrapper* download, File* file);
+  void                insert_download(DownloadWrapper* download);
+  void                erase_download(DownloadWrapper* download);
+
+  value_list          find(const content_key& key) const;
+
+private:
+  using index_map    = std::multimap<content_key, value_type>;
+  using download_map = std::map<DownloadWrapper*, std::vector<content_key>>;
+
+  index_map           m_index;
+  download_map        m_downloads;
+};
+
+}
+
+#endif
@@ -0,0 +1,107 @@
+#include "config.h"
+
+#include "data/device_queue.h"
+
+#include <algorithm>
+#include <pthread.h>
+
+#include "thread_main.h"
+#include "data/hash_queue.h"
+#include "torrent/utils/log.h"
+
+namespace torrent {
+
+DeviceQueue::DeviceQueue(uint64_t device, DiskThrottle* throttle) :
+  m_device(device) {
+
+  m_hash_check_queue.set_disk_throttle(throttle);
+
+  m_hash_check_queue.slot_chunk_done() = [](auto hc, const auto& hv) {
+      thread_main()->hash_queue()->chunk_done(hc, hv);
+    };
+
+  lt_log_print(LOG_STORAGE_INFO, "device_queue: starting worker for device:%" PRIu64, m_device);
+
+  m_thread = std::thread([this] { worker_loop(); });
+}
+
+DeviceQueue::~DeviceQueue() {
+  {
+    auto lock = std::scoped_lock(m_lock);
+    m_stopping = true;
+  }
+
+  m_cv.notify_all();
+  m_thread.join();
+}
+
+void
+DeviceQueue::callback(void* target, slot_void&& fn) {
+  {
+    auto lock = std::scoped_lock(m_lock);
+    m_callbacks.push_back(callback_type{target, std::move(fn)});
+  }
+
+  m_cv.notify_all();
+}
+
+void
+DeviceQueue::cancel_callback_and_wait(void* target) {
+  auto lock = std::unique_lock(m_lock);
+
+  m_callbacks.erase(std::remove_if(m_callbacks.begin(), m_callbacks.end(), [target](const callback_type& c) {
+        return c.target == target;
+      }), m_callbacks.end());
+
+  m_cv.wait(lock, [this, target] { return m_running != target; });
+}
+
+void
+DeviceQueue::interrupt() {
+  {
+    auto lock = std::scoped_lock(m_lock);
+    m_interrupted = true;
+  }
+
+  m_cv.notify_all();
+}
+
+void
+DeviceQueue::worker_loop() {
+#if defined(HAS_PTHREAD_SETNAME_NP_DARWIN)
+  pthread_setname_np("rtorrent device");
+#elif defined(HAS_PTHREAD_SETNAME_NP_GENERIC)
+  pthread_setname_np(pthread_self(), "rtorrent device");
+#endif
+
+  auto lock = std::unique_lock(m_lock);
+
+  while (true) {
+    m_cv.wait(lock, [this] { return m_stopping || m_interrupted || !m_callbacks.empty(); });
+
+    if (m_stopping)
+      return;
+
+    m_interrupted = false;
+
+    lock.unlock();
+    m_hash_check_queue.perform();
+    lock.lock();
+
+    while (!m_callbacks.empty() && !m_stopping) {
+      callback_type callback = std::move(m_callbacks.front());
+      m_callbacks.pop_front();
+
+      m_running = callback.target;
+
+      lock.unlock();
+      callback.fn();
+      lock.lock();
+
+      m_running = nullptr;
+      m_cv.notify_all();
+    }
+  }
+}
+
+}
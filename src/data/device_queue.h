@@ -0,0 +1,67 @@
+#ifndef LIBTORRENT_DATA_DEVICE_QUEUE_H
+#define LIBTORRENT_DATA_DEVICE_QUEUE_H
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+#include "data/hash_check_queue.h"
+
+namespace torrent {
+
+// Disk I/O for the downloads stored on one device, run by a worker
+// thread of its own so that a slow or saturated disk only stalls the
+// downloads on it. The worker drains its hash check queue and runs
+// the queued callbacks in order, as the disk thread does.
+//
+// Callbacks are tagged with a target like those of utils::Thread, and
+// cancel_callback_and_wait() drops the queued ones and waits for one
+// that is running.
+
+class DeviceQueue {
+public:
+  using slot_void = std::function<void()>;
+
+  DeviceQueue(uint64_t device, DiskThrottle* throttle = nullptr);
+  ~DeviceQueue();
+
+  DeviceQueue(const DeviceQueue&) = delete;
+  DeviceQueue& operator=(const DeviceQueue&) = delete;
+
+  uint64_t            device() const                { return m_device; }
+
+  HashCheckQueue*     hash_check_queue()            { return &m_hash_check_queue; }
+
+  void                callback(void* target, slot_void&& fn);
+  void                cancel_callback_and_wait(void* target);
+
+  // Wakes the worker after chunks were added to the hash check queue.
+  void                interrupt();
+
+private:
+  struct callback_type {
+    void*     target;
+    slot_void fn;
+  };
+
+  void                worker_loop();
+
+  uint64_t            m_device;
+
+  HashCheckQueue      m_hash_check_queue;
+
+  std::mutex                m_lock;
+  std::condition_variable   m_cv;
+  std::deque<callback_type> m_callbacks;
+  void*                     m_running{nullptr};
+  bool                      m_interrupted{false};
+  bool                      m_stopping{false};
+
+  std::thread         m_thread;
+};
+
+}
+
+#endif
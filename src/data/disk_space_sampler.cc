@@ -0,0 +1,128 @@
+#include "config.h"
+
+#include "data/disk_space_sampler.h"
+
+#include <algorithm>
+#include <vector>
+#include <rak/fs_stat.h>
+
+namespace torrent {
+
+DiskSpaceSampler::DiskSpaceSampler() {
+  m_slot_stat = [](const std::string& path, uint64_t* bytes) {
+      rak::fs_stat stat;
+
+      if (!stat.update(path))
+        return false;
+
+      *bytes = stat.bytes_avail();
+      return true;
+    };
+}
+
+bool
+DiskSpaceSampler::free_space(const std::string& path, std::chrono::microseconds now, uint64_t* bytes) {
+  std::shared_ptr<entry_type> entry;
+
+  {
+    auto lock = std::scoped_lock(m_lock);
+    auto& value = m_entries[path];
+
+    if (value == nullptr)
+      value = std::make_shared<entry_type>();
+
+    entry = value;
+  }
+
+  entry->last_used.store(now.count(), std::memory_order_relaxed);
+
+  if (!entry->sampled.load(std::memory_order_acquire)) {
+    entry->space.store(stat_path(path), std::memory_order_release);
+    entry->sampled.store(true, std::memory_order_release);
+
+    auto lock = std::scoped_lock(m_lock);
+    schedule(entry.get(), now);
+  }
+
+  int64_t space = entry->space.load(std::memory_order_acquire);
+
+  if (space == invalid_space)
+    return false;
+
+  *bytes = space;
+  return true;
+}
+
+void
+DiskSpaceSampler::sample(std::chrono::microseconds now) {
+  std::vector<std::pair<std::string, std::shared_ptr<entry_type>>> due;
+
+  {
+    auto lock = std::scoped_lock(m_lock);
+
+    for (auto itr = m_entries.begin(); itr != m_entries.end(); ) {
+      if (std::chrono::microseconds(itr->second->last_used.load(std::memory_order_relaxed)) + expire_interval < now) {
+        itr = m_entries.erase(itr);
+        continue;
+      }
+
+      if (itr->second->sampled.load(std::memory_order_acquire) && itr->second->next <= now) {
+        due.emplace_back(itr->first, itr->second);
+        itr->second->next = now + sample_interval;
+      }
+
+      itr++;
+    }
+  }
+
+  // Sample without the lock held, as statvfs may block.
+  for (auto& [path, entry] : due) {
+    entry->space.store(stat_path(path), std::memory_order_release);
+    entry->sampled.store(true, std::memory_order_release);
+
+    auto lock = std::scoped_lock(m_lock);
+    schedule(entry.get(), now);
+  }
+}
+
+std::chrono::microseconds
+DiskSpaceSampler::next_sample(std::chrono::microseconds now) {
+  auto lock = std::scoped_lock(m_lock);
+  auto next = now + sample_interval;
+
+  for (auto& [path, entry] : m_entries)
+    if (entry->sampled.load(std::memory_order_acquire))
+      next = std::min(next, entry->next);
+
+  return std::max(next - now, std::chrono::microseconds(0));
+}
+
+size_t
+DiskSpaceSampler::size() {
+  auto lock = std::scoped_lock(m_lock);
+
+  return m_entries.size();
+}
+
+int64_t
+DiskSpaceSampler::stat_path(const std::string& path) {
+  uint64_t bytes;
+
+  if (!m_slot_stat(path, &bytes))
+    return invalid_space;
+
+  return std::min<uint64_t>(bytes, INT64_MAX);
+}
+
+// Unknown or low space is sampled again sooner.
+void
+DiskSpaceSampler::schedule(entry_type* entry, std::chrono::microseconds now) {
+  int64_t space = entry->space.load(std::memory_order_relaxed);
+
+  if (space == invalid_space || static_cast<uint64_t>(space) < low_space)
+    entry->next = now + low_sample_interval;
+  else
+    entry->next = now + sample_interval;
+}
+
+}
@@ -0,0 +1,67 @@
+#ifndef LIBTORRENT_DATA_DISK_SPACE_SAMPLER_H
+#define LIBTORRENT_DATA_DISK_SPACE_SAMPLER_H
+
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+
+namespace torrent {
+
+// Keeps the free space of the file systems holding the paths asked
+// for, so that checks in the write path do not wait on statvfs, which
+// can take milliseconds on network file systems.
+//
+// The disk thread resamples each path in 'sample()', more often once
+// space runs low, and paths not asked for in a while are dropped. A
+// path is only sampled by the caller the first time it is asked for.
+
+class DiskSpaceSampler {
+public:
+  using slot_stat = std::function<bool(const std::string&, uint64_t*)>;
+
+  static constexpr std::chrono::microseconds sample_interval     = std::chrono::seconds(10);
+  static constexpr std::chrono::microseconds low_sample_interval = std::chrono::seconds(1);
+  static constexpr std::chrono::microseconds expire_interval     = std::chrono::minutes(10);
+
+  static constexpr uint64_t low_space = uint64_t{2} << 30;
+
+  DiskSpaceSampler();
+
+  // Returns false if the file system of 'path' could not be sampled.
+  bool                free_space(const std::string& path, std::chrono::microseconds now, uint64_t* bytes);
+
+  void                sample(std::chrono::microseconds now);
+
+  // Time until the next path is due, or 'sample_interval' if none.
+  std::chrono::microseconds next_sample(std::chrono::microseconds now);
+
+  size_t              size();
+
+  slot_stat&          slot_stat_path() { return m_slot_stat; }
+
+private:
+  static constexpr int64_t invalid_space = -1;
+
+  struct entry_type {
+    std::atomic<int64_t>      space{invalid_space};
+    std::atomic<bool>         sampled{false};
+    std::atomic<int64_t>      last_used{0};
+    std::chrono::microseconds next{0};
+  };
+
+  int64_t             stat_path(const std::string& path);
+  void                schedule(entry_type* entry, std::chrono::microseconds now);
+
+  std::mutex          m_lock;
+  std::map<std::string, std::shared_ptr<entry_type>> m_entries;
+
+  slot_stat           m_slot_stat;
+};
+
+}
+
+#endif
@@ -0,0 +1,173 @@
+#include "config.h"
+
+#include "data/disk_throttle.h"
+
+#include <algorithm>
+#include <thread>
+
+namespace torrent {
+
+static constexpr int64_t usec_per_second = 1000000;
+
+// Long waits are slept off in steps, so that limits raised meanwhile
+// take effect.
+static constexpr std::chrono::microseconds max_sleep = std::chrono::milliseconds(100);
+
+void
+DiskThrottle::bucket_type::refill(int64_t usec) {
+  if (limit == 0)
+    return;
+
+  auto rate = static_cast<int64_t>(limit);
+  auto room = rate * usec_per_second - tokens;
+
+  if (usec >= room / rate)
+    tokens = rate * usec_per_second;
+  else
+    tokens += usec * rate;
+}
+
+DiskThrottle::time_type
+DiskThrottle::bucket_type::wait_time() const {
+  if (limit == 0 || tokens >= 0)
+    return time_type(0);
+
+  auto rate = static_cast<int64_t>(limit);
+
+  return time_type((-tokens + rate - 1) / rate);
+}
+
+void
+DiskThrottle::bucket_type::charge(uint64_t units) {
+  if (limit != 0)
+    tokens -= static_cast<int64_t>(units) * usec_per_second;
+}
+
+uint64_t
+DiskThrottle::max_rate(class_type c) const {
+  auto lock = std::scoped_lock(m_lock);
+
+  return m_classes[c].bytes.limit;
+}
+
+void
+DiskThrottle::set_max_rate(class_type c, uint64_t bytes) {
+  auto lock = std::scoped_lock(m_lock);
+  auto& bucket = m_classes[c].bytes;
+
+  bucket.limit = bytes;
+  bucket.tokens = std::min(bucket.tokens, static_cast<int64_t>(bytes) * usec_per_second);
+}
+
+uint32_t
+DiskThrottle::max_iops(class_type c) const {
+  auto lock = std::scoped_lock(m_lock);
+
+  return m_classes[c].ops.limit;
+}
+
+void
+DiskThrottle::set_max_iops(class_type c, uint32_t ops) {
+  auto lock = std::scoped_lock(m_lock);
+  auto& bucket = m_classes[c].ops;
+
+  bucket.limit = ops;
+  bucket.tokens = std::min<int64_t>(bucket.tokens, int64_t{ops} * usec_per_second);
+}
+
+bool
+DiskThrottle::is_throttled(class_type c) const {
+  auto lock = std::scoped_lock(m_lock);
+
+  return m_classes[c].bytes.limit != 0 || m_classes[c].ops.limit != 0;
+}
+
+uint64_t
+DiskThrottle::rate(class_type c) const {
+  auto lock = std::scoped_lock(m_lock);
+
+  return m_classes[c].rate.rate();
+}
+
+uint64_t
+DiskThrottle::total(class_type c) const {
+  auto lock = std::scoped_lock(m_lock);
+
+  return m_classes[c].rate.total();
+}
+
+DiskThrottle::time_type
+DiskThrottle::wait_time(class_type c, time_type now) {
+  auto lock = std::scoped_lock(m_lock);
+  auto& state = refill_locked(c, now);
+
+  return std::max(state.bytes.wait_time(), state.ops.wait_time());
+}
+
+bool
+DiskThrottle::try_acquire(class_type c, uint64_t bytes, uint32_t ops, time_type now) {
+  auto lock = std::scoped_lock(m_lock);
+  auto& state = refill_locked(c, now);
+
+  if (state.bytes.wait_time() != time_type(0) || state.ops.wait_time() != time_type(0))
+    return false;
+
+  charge_locked(state, bytes, ops);
+  return true;
+}
+
+void
+DiskThrottle::acquire(class_type c, uint64_t bytes, uint32_t ops) {
+  while (true) {
+    time_type wait;
+
+    {
+      auto lock = std::scoped_lock(m_lock);
+      auto& state = refill_locked(c, current_time());
+
+      wait = std::max(state.bytes.wait_time(), state.ops.wait_time());
+
+      if (wait == time_type(0)) {
+        charge_locked(state, bytes, ops);
+        return;
+      }
+    }
+
+    std::this_thread::sleep_for(std::min(wait, max_sleep));
+  }
+}
+
+DiskThrottle::time_type
+DiskThrottle::current_time() {
+  return std::chrono::duration_cast<time_type>(std::chrono::steady_clock::now().time_since_epoch());
+}
+
+// Rate takes at most 2^28 bytes per insert.
+void
+DiskThrottle::charge_locked(class_state& state, uint64_t bytes, uint32_t ops) {
+  state.bytes.charge(bytes);
+  state.ops.charge(ops);
+
+  for (uint64_t remaining = bytes; remaining != 0; ) {
+    uint64_t step = std::min<uint64_t>(remaining, uint64_t{1} << 28);
+
+    state.rate.insert(step);
+    remaining -= step;
+  }
+}
+
+DiskThrottle::class_state&
+DiskThrottle::refill_locked(class_type c, time_type now) {
+  auto& state = m_classes[c];
+  int64_t usec = (now - state.last_refill).count();
+
+  if (usec > 0) {
+    state.bytes.refill(usec);
+    state.ops.refill(usec);
+    state.last_refill = now;
+  }
+
+  return state;
+}
+
+}
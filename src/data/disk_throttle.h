@@ -0,0 +1,89 @@
+#ifndef LIBTORRENT_DATA_DISK_THROTTLE_H
+#define LIBTORRENT_DATA_DISK_THROTTLE_H
+
+#include <array>
+#include <chrono>
+#include <cinttypes>
+#include <mutex>
+
+#include "torrent/rate.h"
+
+namespace torrent {
+
+// Caps the bytes and operations per second of the disk I/O done for
+// reading, writing and hash checking, each class with a token bucket
+// for either limit. The buckets hold a second's worth of quota, and an
+// operation may start whenever neither bucket of its class is in debt,
+// then it is charged in full. So an operation larger than the limit
+// still gets through, and those after it wait off the debt.
+//
+// The disk thread, device queues and hashing workers block in
+// 'acquire', while the main thread uses 'try_acquire' and skips what
+// is optional, such as preloads.
+//
+// A limit of zero is unlimited. The rates include all I/O done through
+// the throttle, limited or not. Thread-safe.
+
+class DiskThrottle {
+public:
+  enum class_type {
+    class_read,
+    class_write,
+    class_hash
+  };
+
+  static constexpr unsigned int class_size = 3;
+
+  using time_type = std::chrono::microseconds;
+
+  uint64_t            max_rate(class_type c) const;
+  void                set_max_rate(class_type c, uint64_t bytes);
+
+  uint32_t            max_iops(class_type c) const;
+  void                set_max_iops(class_type c, uint32_t ops);
+
+  bool                is_throttled(class_type c) const;
+
+  uint64_t            rate(class_type c) const;
+  uint64_t            total(class_type c) const;
+
+  // Time until the class may start an operation, zero if it may now.
+  time_type           wait_time(class_type c, time_type now);
+
+  // Charges the operation if the class may start it now.
+  bool                try_acquire(class_type c, uint64_t bytes, uint32_t ops, time_type now);
+
+  // Sleeps until the class may start the operation, then charges it.
+  void                acquire(class_type c, uint64_t bytes, uint32_t ops);
+
+  static time_type    current_time();
+
+private:
+  // Tokens are kept in units per microsecond, so refills never lose
+  // a fraction.
+  struct bucket_type {
+    uint64_t          limit{0};
+    int64_t           tokens{0};
+
+    void              refill(int64_t usec);
+    time_type         wait_time() const;
+    void              charge(uint64_t units);
+  };
+
+  struct class_state {
+    bucket_type       bytes;
+    bucket_type       ops;
+    time_type         last_refill{0};
+    Rate              rate{10};
+  };
+
+  class_state&        refill_locked(class_type c, time_type now);
+  void                charge_locked(class_state& state, uint64_t bytes, uint32_t ops);
+
+  mutable std::mutex  m_lock;
+  std::array<class_state, class_size> m_classes;
+};
+
+}
+
+#endif
@@ -0,0 +1,255 @@
+#include "config.h"
+
+#include "data/file_relocation.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <memory>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+
+#ifdef USE_FICLONE
+#include <linux/fs.h>
+#endif
+
+#include "torrent/utils/log.h"
+
+#define LT_LOG(log_fmt, ...)                                            \
+  lt_log_print(LOG_STORAGE, "relocation: " log_fmt, __VA_ARGS__);
+
+namespace torrent {
+
+static constexpr size_t copy_buffer_size = 1 << 20;
+
+static bool
+is_directory_entry(const relocation_entry& entry) {
+  return !entry.source.empty() && entry.source.back() == '/';
+}
+
+static std::string
+error_string(const char* msg, const std::string& path) {
+  return std::string(msg) + " '" + path + "': " + std::strerror(errno);
+}
+
+// Creates every missing directory of 'path' up to, but not including,
+// the part after the last '/'.
+static bool
+make_parent_directories(const std::string& path, std::string* error) {
+  for (auto pos = path.find('/', 1); pos != std::string::npos; pos = path.find('/', pos + 1)) {
+    std::string directory = path.substr(0, pos);
+
+    if (::mkdir(directory.c_str(), 0777) != 0 && errno != EEXIST) {
+      *error = error_string("Could not create directory", directory);
+      return false;
+    }
+  }
+
+  return true;
+}
+
+// Removes the now empty directories between 'path' and 'root', never
+// 'root' itself as it may be shared with other downloads.
+static void
+remove_empty_parents(std::string path, const std::string& root) {
+  while (true) {
+    auto pos = path.find_last_of('/');
+
+    if (pos == std::string::npos || pos <= root.size() || path.compare(0, root.size(), root) != 0)
+      return;
+
+    path.resize(pos);
+
+    if (::rmdir(path.c_str()) != 0)
+      return;
+  }
+}
+
+static void
+remove_files(const relocation_list& entries, bool sources, const std::string& root) {
+  for (const auto& entry : entries) {
+    std::string path = sources ? entry.source : entry.target;
+
+    if (is_directory_entry(entry)) {
+      path.pop_back();
+      ::rmdir(path.c_str());
+
+    } else if (::unlink(path.c_str()) != 0 && errno != ENOENT) {
+      LT_LOG("could not remove '%s': %s", path.c_str(), std::strerror(errno));
+      continue;
+    }
+
+    remove_empty_parents(path, root);
+  }
+}
+
+static bool
+copy_range_fallback(int source_fd, int target_fd, uint64_t offset, uint64_t size) {
+  auto buffer = std::make_unique<char[]>(copy_buffer_size);
+
+  while (offset < size) {
+    ssize_t done = ::pread(source_fd, buffer.get(), std::min<uint64_t>(copy_buffer_size, size - offset), offset);
+
+    if (done == -1 && errno == EINTR)
+      continue;
+
+    if (done <= 0)
+      return false;
+
+    for (ssize_t written = 0; written < done; ) {
+      ssize_t result = ::pwrite(target_fd, buffer.get() + written, done - written, offset + written);
+
+      if (result == -1 && errno == EINTR)
+        continue;
+
+      if (result <= 0)
+        return false;
+
+      written += result;
+    }
+
+    offset += done;
+  }
+
+  return true;
+}
+
+bool
+relocation_copy_file(const std::string& source, const std::string& target, std::string* error) {
+  int source_fd = ::open(source.c_str(), O_RDONLY | O_CLOEXEC);
+
+  if (source_fd == -1) {
+    *error = error_string("Could not open", source);
+    return false;
+  }
+
+  struct stat st;
+
+  if (::fstat(source_fd, &st) == -1) {
+    *error = error_string("Could not stat", source);
+    ::close(source_fd);
+    return false;
+  }
+
+  int target_fd = ::open(target.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, st.st_mode & 0777);
+
+  if (target_fd == -1) {
+    *error = error_string("Could not create", target);
+    ::close(source_fd);
+    return false;
+  }
+
+  auto     size = static_cast<uint64_t>(st.st_size);
+  uint64_t offset = 0;
+  bool     success = false;
+
+#ifdef USE_FICLONE
+  success = ::ioctl(target_fd, FICLONE, source_fd) == 0;
+#endif
+
+#ifdef USE_COPY_FILE_RANGE
+  while (!success && offset < size) {
+    ssize_t done = ::copy_file_range(source_fd, nullptr, target_fd, nullptr, size - offset, 0);
+
+    if (done == -1 && errno == EINTR)
+      continue;
+
+    // Unsupported across these file systems, finish with plain reads
+    // and writes.
+    if (done <= 0)
+      break;
+
+    offset += done;
+  }
+
+  success = success || offset == size;
+#endif
+
+  if (!success)
+    success = copy_range_fallback(source_fd, target_fd, offset, size);
+
+  if (!success)
+    *error = error_string("Could not copy to", target);
+  else if (::ftruncate(target_fd, size) == -1 || ::fdatasync(target_fd) == -1)
+    *error = error_string("Could not sync", target);
+
+  ::close(source_fd);
+  ::close(target_fd);
+
+  return error->empty();
+}
+
+bool
+relocation_link_file(const std::string& source, const std::string& target, std::string* error) {
+  if (!make_parent_directories(target, error))
+    return false;
+
+  struct stat source_stat;
+  struct stat target_stat;
+
+  // Renaming a link over the same file would leave the temporary link.
+  if (::stat(source.c_str(), &source_stat) == 0 && ::stat(target.c_str(), &target_stat) == 0 &&
+      source_stat.st_dev == target_stat.st_dev && source_stat.st_ino == target_stat.st_ino)
+    return true;
+
+  // Linked beside the target and renamed over it, so a failure leaves
+  // the target as it was.
+  std::string temp = target + ".link";
+
+  ::unlink(temp.c_str());
+
+  if (::link(source.c_str(), temp.c_str()) == -1) {
+    if (errno != EXDEV) {
+      *error = error_string("Could not link", temp);
+      return false;
+    }
+
+    if (!relocation_copy_file(source, temp, error)) {
+      ::unlink(temp.c_str());
+      return false;
+    }
+  }
+
+  if (::rename(temp.c_str(), target.c_str()) == -1) {
+    *error = error_string("Could not replace", target);
+    ::unlink(temp.c_str());
+    return false;
+  }
+
+  return true;
+}
+
+std::string
+relocation_copy(const relocation_list& entries, const std::string& root) {
+  std::string error;
+
+  for (auto itr = entries.begin(); itr != entries.end(); ++itr) {
+    bool success = make_parent_directories(itr->target, &error);
+
+    if (success && !is_directory_entry(*itr))
+      success = relocation_copy_file(itr->source, itr->target, &error);
+
+    if (!success) {
+      LT_LOG("failed: %s", error.c_str());
+
+      relocation_remove_targets(relocation_list(entries.begin(), itr + 1), root);
+      return error;
+    }
+  }
+
+  return error;
+}
+
+void
+relocation_remove_sources(const relocation_list& entries, const std::string& root) {
+  remove_files(entries, true, root);
+}
+
+void
+relocation_remove_targets(const relocation_list& entries, const std::string& root) {
+  remove_files(entries, false, root);
+}
+
+}
@@ -0,0 +1,42 @@
+#ifndef LIBTORRENT_DATA_FILE_RELOCATION_H
+#define LIBTORRENT_DATA_FILE_RELOCATION_H
+
+#include <string>
+#include <vector>
+
+namespace torrent {
+
+// Moving the files of a download to another root directory. The
+// copies are made on the disk thread while the download keeps using
+// the sources, and the sources are only removed after the download has
+// switched to the targets.
+
+struct relocation_entry {
+  std::string         source;
+  std::string         target;
+};
+
+using relocation_list = std::vector<relocation_entry>;
+
+// Copies each file with a reflink where the file system supports it,
+// else with copy_file_range, else by reading and writing. The parent
+// directories of the targets are created as needed and the copies are
+// synced. On failure the targets already copied are removed, along
+// with the directories created below 'root', and the error is
+// returned, otherwise an empty string.
+std::string relocation_copy(const relocation_list& entries, const std::string& root);
+
+// Removes the sources, or the targets, and then the directories below
+// 'root' that were left empty.
+void        relocation_remove_sources(const relocation_list& entries, const std::string& root);
+void        relocation_remove_targets(const relocation_list& entries, const std::string& root);
+
+bool        relocation_copy_file(const std::string& source, const std::string& target, std::string* error);
+
+// Replaces 'target' with a hard link to 'source', creating its parent
+// directories. Across file systems it falls back to a copy.
+bool        relocation_link_file(const std::string& source, const std::string& target, std::string* error);
+
+}
+
+#endif
@@ -2,14 +2,27 @@
 
 #include "hash_check_queue.h"
 
+#include <algorithm>
+#include <cstring>
+#include <pthread.h>
+
 #include "data/hash_chunk.h"
+#include "data/io_priority.h"
 #include "torrent/hash_string.h"
+#include "torrent/utils/log.h"
+#include "torrent/utils/trace.h"
 #include "utils/instrumentation.h"
+#include "utils/sha1_multi.h"
 
 namespace torrent {
 
-HashCheckQueue::HashCheckQueue()  = default;
-HashCheckQueue::~HashCheckQueue() = default;
+HashCheckQueue::HashCheckQueue() :
+  m_batch_lanes(sha1_multi_lanes(sha1_multi_default_engine())) {
+}
+
+HashCheckQueue::~HashCheckQueue() {
+  stop_workers();
+}
 
 // Always poke thread_disk after calling this.
 void
@@ -17,17 +30,24 @@ HashCheckQueue::push_back(HashChunk* hash_chunk) {
   if (hash_chunk == NULL || !hash_chunk->chunk()->is_loaded() || !hash_chunk->chunk()->is_blocking())
     throw internal_error("Invalid hash chunk passed to HashCheckQueue.");
 
-  auto lock = std::scoped_lock(m_lock);
+  {
+    auto lock = std::scoped_lock(m_lock);
 
-  // Set blocking...(? this needs to be possible to do after getting
-  // the chunk) When doing this make sure we verify that the handle is
-  // not previously blocked.
+    // Set blocking...(? this needs to be possible to do after getting
+    // the chunk) When doing this make sure we verify that the handle is
+    // not previously blocked.
 
-  base_type::push_back(hash_chunk);
+    push_locked(hash_chunk, false);
+  }
 
-  int64_t size = hash_chunk->chunk()->chunk()->chunk_size();
-  instrumentation_update(INSTRUMENTATION_MEMORY_HASHING_CHUNK_COUNT, 1);
-  instrumentation_update(INSTRUMENTATION_MEMORY_HASHING_CHUNK_USAGE, size);
+  m_cv.notify_one();
+}
+
+HashChunk*
+HashCheckQueue::front() {
+  auto lock = std::scoped_lock(m_lock);
+
+  return empty() ? NULL : front_locked();
 }
 
 // erase...
@@ -46,50 +66,276 @@ HashCheckQueue::push_back(HashChunk* hash_chunk) {
 
 bool
 HashCheckQueue::remove(HashChunk* hash_chunk) {
-  auto lock = std::scoped_lock(m_lock);
+  auto  lock  = std::scoped_lock(m_lock);
+  auto& queue = m_classes[hash_chunk->priority()];
 
-  bool result;
-  auto itr = std::find(begin(), end(), hash_chunk);
+  auto owner_itr = std::find_if(queue.begin(), queue.end(), [hash_chunk](auto& q) { return q.owner == hash_chunk->owner(); });
 
-  if (itr != end()) {
-    base_type::erase(itr);
-    result = true;
+  if (owner_itr == queue.end())
+    return false;
 
-    int64_t size = hash_chunk->chunk()->chunk()->chunk_size();
-    instrumentation_update(INSTRUMENTATION_MEMORY_HASHING_CHUNK_COUNT, -1);
-    instrumentation_update(INSTRUMENTATION_MEMORY_HASHING_CHUNK_USAGE, -size);
+  auto itr = std::find(owner_itr->chunks.begin(), owner_itr->chunks.end(), hash_chunk);
 
-  } else {
-    result = false;
-  }
+  if (itr == owner_itr->chunks.end())
+    return false;
+
+  owner_itr->chunks.erase(itr);
+
+  if (owner_itr->chunks.empty())
+    queue.erase(owner_itr);
+
+  m_size--;
+
+  if (hash_chunk->priority() == HashChunk::priority_verify)
+    m_verify_waiting--;
+
+  int64_t size = hash_chunk->chunk()->chunk()->chunk_size();
+  instrumentation_update(INSTRUMENTATION_MEMORY_HASHING_CHUNK_COUNT, -1);
+  instrumentation_update(INSTRUMENTATION_MEMORY_HASHING_CHUNK_USAGE, -size);
 
-  return result;
+  return true;
 }
 
 void
 HashCheckQueue::perform() {
   auto lock = std::unique_lock(m_lock);
+  batch_type batch;
 
   while (!empty()) {
-    HashChunk* hash_chunk = base_type::front();
-    base_type::pop_front();
+    pop_batch_locked(batch);
 
-    if (!hash_chunk->chunk()->is_loaded())
-      throw internal_error("HashCheckQueue::perform(): !entry.node->is_loaded().");
+    lock.unlock();
+    hash_batch(batch);
+    lock.lock();
+  }
+}
 
-    int64_t size = hash_chunk->chunk()->chunk()->chunk_size();
-    instrumentation_update(INSTRUMENTATION_MEMORY_HASHING_CHUNK_COUNT, -1);
-    instrumentation_update(INSTRUMENTATION_MEMORY_HASHING_CHUNK_USAGE, -size);
+unsigned int
+HashCheckQueue::worker_count() {
+  auto lock = std::scoped_lock(m_workers_lock);
 
-    lock.unlock();
+  return m_workers.size();
+}
+
+// The disk thread keeps draining the queue in 'perform()', so the
+// workers only add hashing capacity and a count of zero restores the
+// single-threaded behavior.
+void
+HashCheckQueue::start_workers(unsigned int count) {
+  if (count > max_workers)
+    throw input_error("Hash check worker count out of range.");
+
+  auto workers_lock = std::scoped_lock(m_workers_lock);
+
+  if (count == m_workers.size())
+    return;
+
+  {
+    auto lock = std::scoped_lock(m_lock);
+    m_stopping = true;
+  }
+
+  m_cv.notify_all();
+
+  for (auto& worker : m_workers)
+    worker.join();
+
+  m_workers.clear();
+  m_stopping = false;
+
+  lt_log_print(LOG_STORAGE_INFO, "hash_check_queue: starting %u hashing workers", count);
+
+  for (unsigned int i = 0; i < count; i++)
+    m_workers.emplace_back([this] { worker_loop(); });
+}
+
+void
+HashCheckQueue::stop_workers() {
+  start_workers(0);
+}
+
+HashChunk*
+HashCheckQueue::front_locked() {
+  for (auto& queue : m_classes)
+    if (!queue.empty())
+      return queue.front().chunks.front();
+
+  throw internal_error("HashCheckQueue::front_locked(): queue is empty.");
+}
+
+// The owner taken from is moved to the back of its class once it has
+// taken its weight in chunks, so that downloads take turns.
+HashChunk*
+HashCheckQueue::pop_front_locked() {
+  auto queue = std::find_if(m_classes.begin(), m_classes.end(), [](auto& q) { return !q.empty(); });
+
+  if (queue == m_classes.end())
+    throw internal_error("HashCheckQueue::pop_front_locked(): queue is empty.");
+
+  owner_queue& front = queue->front();
+
+  HashChunk* hash_chunk = front.chunks.front();
+  front.chunks.pop_front();
+
+  if (front.chunks.empty()) {
+    queue->pop_front();
+
+  } else if (++front.taken >= hash_chunk->weight()) {
+    front.taken = 0;
+
+    queue->push_back(std::move(front));
+    queue->pop_front();
+  }
+
+  m_size--;
+
+  if (hash_chunk->priority() == HashChunk::priority_verify)
+    m_verify_waiting--;
 
-    if (!hash_chunk->perform(~uint32_t(), true))
-      throw internal_error("HashCheckQueue::perform(): !hash_chunk->perform(~uint32_t(), true).");
+  if (!hash_chunk->chunk()->is_loaded())
+    throw internal_error("HashCheckQueue::pop_front_locked(): !entry.node->is_loaded().");
 
+  int64_t size = hash_chunk->chunk()->chunk()->chunk_size();
+  instrumentation_update(INSTRUMENTATION_MEMORY_HASHING_CHUNK_COUNT, -1);
+  instrumentation_update(INSTRUMENTATION_MEMORY_HASHING_CHUNK_USAGE, -size);
+
+  return hash_chunk;
+}
+
+// Preempted chunks are put at the front of their owner's queue, and
+// the owner at the front of the class, so they resume first.
+void
+HashCheckQueue::push_locked(HashChunk* hash_chunk, bool front) {
+  auto& queue = m_classes[hash_chunk->priority()];
+  auto  itr   = std::find_if(queue.begin(), queue.end(), [hash_chunk](auto& q) { return q.owner == hash_chunk->owner(); });
+
+  if (itr != queue.end() && front && itr != queue.begin()) {
+    owner_queue owner = std::move(*itr);
+    queue.erase(itr);
+    queue.push_front(std::move(owner));
+    itr = queue.begin();
+
+  } else if (itr == queue.end()) {
+    itr = queue.insert(front ? queue.begin() : queue.end(), owner_queue{hash_chunk->owner(), {}});
+  }
+
+  if (front)
+    itr->chunks.push_front(hash_chunk);
+  else
+    itr->chunks.push_back(hash_chunk);
+
+  m_size++;
+
+  if (hash_chunk->priority() == HashChunk::priority_verify)
+    m_verify_waiting++;
+
+  int64_t size = hash_chunk->chunk()->chunk()->chunk_size();
+  instrumentation_update(INSTRUMENTATION_MEMORY_HASHING_CHUNK_COUNT, 1);
+  instrumentation_update(INSTRUMENTATION_MEMORY_HASHING_CHUNK_USAGE, size);
+}
+
+// Chunks that are single contiguous mappings of the same size can be
+// hashed together by the multi-buffer engine, anything else is hashed
+// one at a time.
+void
+HashCheckQueue::pop_batch_locked(batch_type& batch) {
+  batch.clear();
+  batch.push_back(pop_front_locked());
+
+  if (m_batch_lanes == 1 || batch.front()->contiguous_data() == NULL)
+    return;
+
+  uint32_t chunk_size = batch.front()->chunk()->chunk()->chunk_size();
+
+  while (batch.size() < m_batch_lanes && !empty()) {
+    HashChunk* next = front_locked();
+
+    if (next->chunk()->chunk()->chunk_size() != chunk_size || next->contiguous_data() == NULL)
+      break;
+
+    batch.push_back(pop_front_locked());
+  }
+}
+
+void
+HashCheckQueue::hash_batch(const batch_type& batch) {
+  utils::trace_span span("hash");
+
+  // Batches are taken by class, so the front has the most urgent.
+  io_priority_set(batch.front()->priority() == HashChunk::priority_verify ? io_class_verify : io_class_recheck);
+
+  if (batch.size() == 1) {
+    hash_chunk(batch.front());
+    return;
+  }
+
+  const char* buffers[sha1_multi_max_lanes];
+  char        results[sha1_multi_max_lanes * 20];
+
+  if (m_disk_throttle != nullptr)
+    m_disk_throttle->acquire(DiskThrottle::class_hash, uint64_t{batch.front()->chunk()->chunk()->chunk_size()} * batch.size(), batch.size());
+
+  for (unsigned int i = 0; i < batch.size(); i++)
+    buffers[i] = batch[i]->contiguous_data();
+
+  sha1_multi(buffers, batch.size(), batch.front()->chunk()->chunk()->chunk_size(), results);
+
+  for (unsigned int i = 0; i < batch.size(); i++) {
     HashString hash;
-    hash_chunk->hash_c(hash.data());
+    std::memcpy(hash.data(), results + 20 * i, 20);
+
+    m_slot_chunk_done(batch[i], hash);
+  }
+}
+
+bool
+HashCheckQueue::hash_chunk(HashChunk* hash_chunk) {
+  while (hash_chunk->remaining() != 0 && !hash_chunk->is_cancelled()) {
+    if (hash_chunk->priority() != HashChunk::priority_verify && m_verify_waiting.load(std::memory_order_relaxed) != 0) {
+      {
+        auto lock = std::scoped_lock(m_lock);
+        push_locked(hash_chunk, true);
+      }
+
+      m_cv.notify_one();
+      return false;
+    }
+
+    if (m_disk_throttle != nullptr)
+      m_disk_throttle->acquire(DiskThrottle::class_hash, std::min(hash_chunk->remaining(), cancel_step), 1);
 
-    m_slot_chunk_done(hash_chunk, hash);
+    if (!hash_chunk->perform(cancel_step, true))
+      throw internal_error("HashCheckQueue::hash_chunk(): !hash_chunk->perform(cancel_step, true).");
+  }
+
+  HashString hash;
+  hash_chunk->hash_c(hash.data());
+
+  m_slot_chunk_done(hash_chunk, hash);
+  return true;
+}
+
+void
+HashCheckQueue::worker_loop() {
+#if defined(HAS_PTHREAD_SETNAME_NP_DARWIN)
+  pthread_setname_np("rtorrent hash");
+#elif defined(HAS_PTHREAD_SETNAME_NP_GENERIC)
+  pthread_setname_np(pthread_self(), "rtorrent hash");
+#endif
+
+  auto lock = std::unique_lock(m_lock);
+  batch_type batch;
+
+  while (true) {
+    m_cv.wait(lock, [this] { return m_stopping || !empty(); });
+
+    if (m_stopping)
+      return;
+
+    pop_batch_locked(batch);
+
+    lock.unlock();
+    hash_batch(batch);
     lock.lock();
   }
 }
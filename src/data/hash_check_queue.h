@@ -1,31 +1,46 @@
 #ifndef LIBTORRENT_DATA_HASH_CHECK_QUEUE_H
 #define LIBTORRENT_DATA_HASH_CHECK_QUEUE_H
 
+#include <array>
+#include <atomic>
+#include <condition_variable>
 #include <deque>
 #include <functional>
 #include <mutex>
+#include <thread>
+#include <vector>
+
+#include "data/disk_throttle.h"
+#include "data/hash_chunk.h"
 
 // TODO: Create separate directory for thread_disk's hash checking code.
 
 namespace torrent {
 
 class HashString;
-class HashChunk;
 
-class HashCheckQueue : private std::deque<HashChunk*> {
+// The queue is drained by the disk thread in 'perform()', and
+// optionally by a pool of hashing workers that pull chunks from the
+// same queue. The slot is called from whichever thread hashed the
+// chunk, so it must be thread-safe.
+//
+// Chunks are taken by their priority class, see HashChunk, and each
+// class takes turns between the downloads owning its chunks. A chunk
+// of a lower class being hashed is put back at the front of its
+// queue when a downloaded chunk is waiting for verification. An owner
+// takes as many chunks in a row as the weight of its chunks.
+//
+// With a DiskThrottle set, hashing waits for the quota of its class,
+// charged per 'cancel_step' or per batch.
+
+class HashCheckQueue {
 public:
-  using base_type         = std::deque<HashChunk*>;
   using slot_chunk_handle = std::function<void(HashChunk*, const HashString&)>;
 
-  using base_type::iterator;
-
-  using base_type::empty;
-  using base_type::size;
+  static constexpr unsigned int max_workers = 64;
 
-  using base_type::begin;
-  using base_type::end;
-  using base_type::front;
-  using base_type::back;
+  // Bytes hashed between checks for cancellation.
+  static constexpr uint32_t     cancel_step = 1 << 20;
 
   HashCheckQueue();
   ~HashCheckQueue();
@@ -35,13 +50,59 @@ public:
   void                push_back(HashChunk* node);
   void                perform();
 
+  bool                empty() const { return m_size == 0; }
+  size_t              size() const  { return m_size; }
+
+  // The chunk that will be taken next, or NULL.
+  HashChunk*          front();
+
   bool                remove(HashChunk* node);
 
+  unsigned int        worker_count();
+  void                start_workers(unsigned int count);
+  void                stop_workers();
+
   slot_chunk_handle&  slot_chunk_done() { return m_slot_chunk_done; }
 
+  void                set_disk_throttle(DiskThrottle* throttle) { m_disk_throttle = throttle; }
+
 private:
-  std::mutex          m_lock;
-  slot_chunk_handle   m_slot_chunk_done;
+  using batch_type = std::vector<HashChunk*>;
+
+  struct owner_queue {
+    const void*            owner;
+    std::deque<HashChunk*> chunks;
+    uint32_t               taken{0};
+  };
+
+  // Owners in the order they take turns, each with its chunks.
+  using class_queue = std::deque<owner_queue>;
+
+  HashChunk*          front_locked();
+  HashChunk*          pop_front_locked();
+  void                push_locked(HashChunk* hash_chunk, bool front);
+  void                pop_batch_locked(batch_type& batch);
+
+  // Returns false if the chunk was put back in the queue.
+  bool                hash_chunk(HashChunk* hash_chunk);
+  void                hash_batch(const batch_type& batch);
+
+  void                worker_loop();
+
+  std::mutex               m_lock;
+  std::condition_variable  m_cv;
+
+  std::array<class_queue, HashChunk::priority_size> m_classes;
+  size_t                   m_size{0};
+  std::atomic<size_t>      m_verify_waiting{0};
+
+  slot_chunk_handle        m_slot_chunk_done;
+  DiskThrottle*            m_disk_throttle{nullptr};
+  unsigned int             m_batch_lanes;
+
+  std::mutex               m_workers_lock;
+  std::vector<std::thread> m_workers;
+  bool                     m_stopping{false};
 };
 
 }
@@ -39,6 +39,7 @@
 #include "chunk.h"
 #include "chunk_list_node.h"
 #include "hash_chunk.h"
+#include "utils/probe.h"
 #include "utils/sha1.h"
 
 namespace torrent {
@@ -73,12 +74,15 @@ HashChunk::perform(uint32_t length, bool force) {
 
   bool complete = l == length;
 
+  LT_PROBE3(hash_perform_enter, m_chunk.index(), m_position, l);
+
   while (l) {
     auto node = m_chunk.chunk()->at_position(m_position);
 
     l -= perform_part(node, l);
   }
 
+  LT_PROBE2(hash_perform_exit, m_chunk.index(), complete);
   return complete;
 }
 
@@ -105,6 +109,21 @@ HashChunk::advise_willneed(uint32_t length) {
   }
 }
 
+const char*
+HashChunk::contiguous_data() {
+  uint32_t chunk_size = m_chunk.chunk()->chunk_size();
+
+  if (m_position != 0 || chunk_size == 0)
+    return NULL;
+
+  auto itr = m_chunk.chunk()->at_position(0);
+
+  if (itr == m_chunk.chunk()->end() || itr->size() != chunk_size)
+    return NULL;
+
+  return itr->chunk().begin();
+}
+
 uint32_t
 HashChunk::perform_part(Chunk::iterator itr, uint32_t length) {
   length = std::min(length, remaining_part(itr, m_position));
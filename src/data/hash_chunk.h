@@ -1,6 +1,8 @@
 #ifndef LIBTORRENT_HASH_CHUNK_H
 #define LIBTORRENT_HASH_CHUNK_H
 
+#include <algorithm>
+#include <atomic>
 #include <memory>
 
 #include "torrent/exceptions.h"
@@ -19,6 +21,16 @@ class Sha1;
 
 class HashChunk {
 public:
+  // Downloaded chunks are verified before rechecks the user asked
+  // for, which go before background rechecks.
+  enum priority_type {
+    priority_verify,
+    priority_recheck,
+    priority_background
+  };
+
+  static constexpr unsigned int priority_size = 3;
+
   ~HashChunk();
   HashChunk(ChunkHandle h);
 
@@ -33,8 +45,29 @@ public:
 
   void                advise_willneed(uint32_t length);
 
+  // Returns the chunk's memory if it is a single mapping and hashing
+  // has not started, else NULL.
+  const char*         contiguous_data();
+
   uint32_t            remaining();
 
+  priority_type       priority() const                        { return m_priority; }
+  void                set_priority(priority_type p)           { m_priority = p; }
+
+  // The download the chunk belongs to, used to take turns between
+  // downloads with chunks of the same priority.
+  const void*         owner() const                           { return m_owner; }
+  void                set_owner(const void* owner)            { m_owner = owner; }
+
+  // How many chunks the owner takes per turn.
+  uint32_t            weight() const                          { return m_weight; }
+  void                set_weight(uint32_t w)                  { m_weight = std::max<uint32_t>(w, 1); }
+
+  // Set by HashQueue::remove(...) from the main thread, the hashing
+  // thread stops at the next step and passes the chunk on as done.
+  bool                is_cancelled() const                    { return m_cancelled.load(std::memory_order_acquire); }
+  void                cancel()                                { m_cancelled.store(true, std::memory_order_release); }
+
 private:
   HashChunk(const HashChunk&) = delete;
   HashChunk& operator=(const HashChunk&) = delete;
@@ -46,6 +79,11 @@ private:
 
   ChunkHandle         m_chunk;
   std::unique_ptr<Sha1> m_hash;
+  std::atomic<bool>   m_cancelled{false};
+
+  priority_type       m_priority{priority_verify};
+  const void*         m_owner{nullptr};
+  uint32_t            m_weight{1};
 };
 
 inline uint32_t
@@ -2,9 +2,12 @@
 
 #include "data/hash_queue.h"
 
+#include <algorithm>
 #include <functional>
+#include <thread>
 #include <unistd.h>
 #include <utility>
+#include <vector>
 
 #include "globals.h"
 #include "data/chunk.h"
@@ -46,18 +49,36 @@ struct HashQueueWillneed {
 // If we're done immediately, move the chunk to the front of the list so
 // the next work cycle gets stuff done.
 void
-HashQueue::push_back(ChunkHandle handle, HashQueueNode::id_type id, slot_done_type d) {
+HashQueue::push_back(ChunkHandle handle, HashQueueNode::id_type id, slot_done_type d, HashChunk::priority_type priority) {
   LT_LOG_DATA(id, DEBUG, "Adding index:%" PRIu32 " to queue.", handle.index());
 
   if (!handle.is_loaded())
     throw internal_error("HashQueue::add(...) received an invalid chunk");
 
   auto hash_chunk = new HashChunk(handle);
+  hash_chunk->set_priority(priority);
+  hash_chunk->set_owner(id);
+
+  if (id != NULL)
+    hash_chunk->set_weight(id->disk_weight());
 
   base_type::push_back(HashQueueNode(id, hash_chunk, std::move(d)));
 
-  thread_disk()->hash_check_queue()->push_back(hash_chunk);
-  thread_disk()->interrupt();
+  thread_disk()->push_hash_chunk(id != NULL ? id->device() : 0, hash_chunk);
+}
+
+void
+HashQueue::push_back_hashed(ChunkHandle handle, HashQueueNode::id_type id, const HashString& hash, slot_done_type d) {
+  LT_LOG_DATA(id, DEBUG, "Adding hashed index:%" PRIu32 " to queue.", handle.index());
+
+  if (!handle.is_loaded())
+    throw internal_error("HashQueue::push_back_hashed(...) received an invalid chunk");
+
+  auto hash_chunk = new HashChunk(handle);
+
+  base_type::push_back(HashQueueNode(id, hash_chunk, std::move(d)));
+
+  chunk_done(hash_chunk, hash);
 }
 
 bool
@@ -72,31 +93,55 @@ HashQueue::has(HashQueueNode::id_type id, uint32_t index) {
 
 void
 HashQueue::remove(HashQueueNode::id_type id) {
-  base_type::erase(std::remove_if(begin(), end(), [id, this](auto& itr) {
-    if (itr.id() != id)
-      return false;
+  std::vector<HashChunk*> cancelled;
 
-    HashChunk *hash_chunk = itr.get_chunk();
+  for (auto& node : *this) {
+    if (node.id() != id)
+      continue;
 
-    LT_LOG_DATA(id, DEBUG, "Removing index:%" PRIu32 " from queue.", hash_chunk->handle().index());
+    HashChunk* hash_chunk = node.get_chunk();
+
+    if (!thread_disk()->remove_hash_chunk(hash_chunk)) {
+      hash_chunk->cancel();
+      cancelled.push_back(hash_chunk);
+    }
+  }
+
+  // Chunks being hashed are cancelled at the next check, so this
+  // wait is short and does not depend on the size of the chunk.
+  while (!cancelled.empty()) {
+    take_done_chunks();
 
-    bool result = thread_disk()->hash_check_queue()->remove(hash_chunk);
+    for (auto itr = m_done_list.begin(); itr != m_done_list.end(); ) {
+      auto cancelled_itr = std::find(cancelled.begin(), cancelled.end(), (*itr)->hash_chunk);
 
-    // The hash chunk was not found, so we need to wait until the hash
-    // check finishes.
-    if (!result) {
-      auto lock = std::unique_lock(m_done_chunks_lock);
+      if (cancelled_itr == cancelled.end()) {
+        itr++;
+        continue;
+      }
 
-      m_cv.wait(lock, [this, hash_chunk] { return m_done_chunks.find(hash_chunk) != m_done_chunks.end(); });
-      m_done_chunks.erase(hash_chunk);
+      delete *itr;
+      itr = m_done_list.erase(itr);
+      cancelled.erase(cancelled_itr);
     }
 
+    if (!cancelled.empty())
+      std::this_thread::yield();
+  }
+
+  base_type::erase(std::remove_if(begin(), end(), [id](auto& itr) {
+    if (itr.id() != id)
+      return false;
+
+    HashChunk *hash_chunk = itr.get_chunk();
+
+    LT_LOG_DATA(id, DEBUG, "Removing index:%" PRIu32 " from queue.", hash_chunk->handle().index());
+
     itr.slot_done()(*hash_chunk->chunk(), NULL);
     itr.clear();
 
     return true;
   }), end());
-
 }
 
 void
@@ -111,15 +156,15 @@ HashQueue::clear() {
 
 void
 HashQueue::work() {
-  auto lock = std::scoped_lock(m_done_chunks_lock);
+  take_done_chunks();
 
-  while (!m_done_chunks.empty()) {
-    HashChunk* hash_chunk = m_done_chunks.begin()->first;
-    HashString hash_value = m_done_chunks.begin()->second;
-    m_done_chunks.erase(m_done_chunks.begin());
+  while (!m_done_list.empty()) {
+    done_node* done = m_done_list.front();
+    m_done_list.pop_front();
 
-    // TODO: This is not optimal as we jump around... Check for front
-    // of HashQueue in done_chunks instead.
+    HashChunk* hash_chunk = done->hash_chunk;
+    HashString hash_value = done->hash_value;
+    delete done;
 
     auto itr = std::find_if(begin(), end(), [hash_chunk](auto& node) { return node.get_chunk() == hash_chunk; });
 
@@ -141,11 +186,26 @@ HashQueue::work() {
 
 void
 HashQueue::chunk_done(HashChunk* hash_chunk, const HashString& hash_value) {
-  auto lock = std::scoped_lock(m_done_chunks_lock);
+  auto done = new done_node{hash_chunk, hash_value, m_done_head.load(std::memory_order_relaxed)};
+  auto head = done->next;
+
+  // The node may be taken by the main thread as soon as it is pushed.
+  while (!m_done_head.compare_exchange_weak(head, done, std::memory_order_release, std::memory_order_relaxed))
+    done->next = head;
+
+  // Only interrupt the main thread for the first done chunk, the rest
+  // get picked up by the same call to work().
+  m_slot_has_work(head == nullptr);
+}
+
+void
+HashQueue::take_done_chunks() {
+  done_node* done = m_done_head.exchange(nullptr, std::memory_order_acquire);
+  auto       position = m_done_list.end();
 
-  m_done_chunks[hash_chunk] = hash_value;
-  m_slot_has_work(m_done_chunks.empty());
-  m_cv.notify_all();
+  // The list is newest first.
+  for (; done != nullptr; done = done->next)
+    position = m_done_list.insert(position, done);
 }
 
 }
@@ -1,11 +1,9 @@
 #ifndef LIBTORRENT_DATA_HASH_QUEUE_H
 #define LIBTORRENT_DATA_HASH_QUEUE_H
 
-#include <condition_variable>
+#include <atomic>
 #include <deque>
 #include <functional>
-#include <map>
-#include <mutex>
 
 #include "torrent/hash_string.h"
 #include "hash_queue_node.h"
@@ -21,11 +19,15 @@ class ThreadDisk;
 // of large resumed downloads, try to check the hash immediately. This
 // helps us in getting as much done as possible while the pages are in
 // memory.
+//
+// Hashing threads push done chunks onto a lock-free list which the
+// main thread takes in whole. Removing a download cancels its chunks
+// being hashed, so remove() only waits for the hashing threads to
+// reach their next cancellation check.
 
 class HashQueue : private std::deque<HashQueueNode> {
 public:
   using base_type        = std::deque<HashQueueNode>;
-  using done_chunks_type = std::map<HashChunk*, torrent::HashString>;
 
   using slot_done_type = HashQueueNode::slot_done_type;
   using slot_bool      = std::function<void(bool)>;
@@ -43,7 +45,12 @@ public:
   HashQueue() = default;
   ~HashQueue() { clear(); }
 
-  void                push_back(ChunkHandle handle, HashQueueNode::id_type id, slot_done_type d);
+  void                push_back(ChunkHandle handle, HashQueueNode::id_type id, slot_done_type d,
+                                HashChunk::priority_type priority = HashChunk::priority_verify);
+
+  // Queues a chunk whose hash is already known, the done slot is
+  // called from work() as for chunks hashed by the disk thread.
+  void                push_back_hashed(ChunkHandle handle, HashQueueNode::id_type id, const HashString& hash, slot_done_type d);
 
   bool                has(HashQueueNode::id_type id);
   bool                has(HashQueueNode::id_type id, uint32_t index);
@@ -58,11 +65,24 @@ public:
   void                chunk_done(HashChunk* hash_chunk, const HashString& hash_value);
 
 private:
-  done_chunks_type    m_done_chunks;
+  struct done_node {
+    HashChunk*        hash_chunk;
+    HashString        hash_value;
+    done_node*        next;
+  };
+
+  using done_list_type = std::deque<done_node*>;
+
+  // Moves the done chunks pushed by the hashing threads, oldest
+  // first, to m_done_list.
+  void                take_done_chunks();
+
   slot_bool           m_slot_has_work;
 
-  std::mutex              m_done_chunks_lock;
-  std::condition_variable m_cv;
+  std::atomic<done_node*> m_done_head{nullptr};
+
+  // Only accessed by the main thread.
+  done_list_type      m_done_list;
 };
 
 }
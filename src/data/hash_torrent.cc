@@ -1,6 +1,10 @@
 #include "config.h"
 
+#include <algorithm>
+
 #include "data/chunk_list.h"
+#include "data/thread_disk.h"
+#include "torrent/chunk_manager.h"
 #include "torrent/exceptions.h"
 #include "torrent/data/download_data.h"
 #include "torrent/utils/log.h"
@@ -8,6 +12,7 @@
 #include "hash_torrent.h"
 #include "hash_queue.h"
 #include "globals.h"
+#include "manager.h"
 
 #define LT_LOG_THIS(log_level, log_fmt, ...)                            \
   lt_log_print_data(LOG_STORAGE_##log_level, m_chunk_list->data(), "hash_torrent", log_fmt, __VA_ARGS__);
@@ -21,8 +26,9 @@ HashTorrent::HashTorrent(ChunkList* c) :
 
 bool
 HashTorrent::start(bool try_quick) {
-  LT_LOG_THIS(INFO, "Start: position:%u size:%zu try_quick:%u.",
-              m_position, m_chunk_list->size(), try_quick);
+  LT_LOG_THIS(INFO, "Start: position:%u size:%zu ranges:%zu chunks:%zu try_quick:%u.",
+              m_position, m_chunk_list->size(), m_ranges.size(),
+              m_ranges.intersect_distance(0, m_chunk_list->size()), try_quick);
 
   if (m_position == m_chunk_list->size())
     return true;
@@ -32,6 +38,17 @@ HashTorrent::start(bool try_quick) {
 
   m_outstanding = 0;
 
+  if (!try_quick && m_slot_physical_addresses) {
+    auto addresses = m_slot_physical_addresses();
+
+    if (!addresses.empty()) {
+      m_order = physical_order(m_ranges, addresses);
+      m_order_position = 0;
+
+      LT_LOG_THIS(INFO, "Checking in physical order: chunks:%zu.", m_order.size());
+    }
+  }
+
   queue(try_quick);
   return m_position == m_chunk_list->size();
 }
@@ -44,6 +61,14 @@ HashTorrent::clear() {
   m_position = 0;
   m_errno = 0;
 
+  if (m_budget_usage != 0) {
+    manager->chunk_manager()->dec_hash_recheck_usage(m_budget_usage);
+    m_budget_usage = 0;
+  }
+
+  m_order.clear();
+  m_order_position = 0;
+
   // Correct?
   rak::priority_queue_erase(&taskScheduler, &m_delayChecked);
 }
@@ -56,6 +81,18 @@ HashTorrent::is_checked() {
   return !m_chunk_list->empty() && m_position == m_chunk_list->size() && m_outstanding == -1;
 }
 
+// Chunks in the range that have not yet been queued for checking,
+// chunks currently being hashed are not included.
+uint32_t
+HashTorrent::remaining(uint32_t first, uint32_t last) const {
+  first = std::max(first, m_position);
+
+  if (first >= last)
+    return 0;
+
+  return m_ranges.intersect_distance(first, last);
+}
+
 // After all chunks are checked it won't show as is_checked until
 // after this function is called. This allows for the hash done signal
 // to be delayed.
@@ -81,7 +118,7 @@ HashTorrent::receive_chunkdone(uint32_t index) {
   //
   // Make sure we call chunkdone before torrentDone has a chance to
   // trigger.
-  m_outstanding--;
+  dec_outstanding();
 
   queue(false);
 }
@@ -99,7 +136,7 @@ HashTorrent::receive_chunk_cleared(uint32_t index) {
   if (m_ranges.has(index))
     throw internal_error("HashTorrent::receive_chunk_cleared() m_ranges.has(index).");
 
-  m_outstanding--;
+  dec_outstanding();
   m_ranges.insert(index, index + 1);
 }
 
@@ -110,8 +147,11 @@ HashTorrent::queue(bool quick) {
   if (!is_checking())
     throw internal_error("HashTorrent::queue() called but it's not running.");
 
+  if (!m_order.empty())
+    return queue_ordered();
+
   while (m_position < m_chunk_list->size()) {
-    if (m_outstanding > 10 && m_outstanding * m_chunk_list->chunk_size() > (128 << 20))
+    if (is_queue_full())
       return;
 
     // Not very efficient, but this is seldomly done.
@@ -155,27 +195,8 @@ HashTorrent::queue(bool quick) {
     // If the error number is not valid, then we've just encountered a
     // file that hasn't be created/resized. Which means we ignore it
     // when doing initial hashing.
-    if (handle.error_number().is_valid() && handle.error_number().value() != rak::error_number::e_noent) {
-      if (handle.is_valid())
-        throw internal_error("HashTorrent::queue() error, but handle.is_valid().");
-
-      // We wait for all the outstanding chunks to be checked before
-      // borking completely, else low-memory devices might not be able
-      // to finish the hash check.
-      if (m_outstanding != 0)
-        return;
-
-      // The rest of the outstanding chunks get ignored by
-      // DownloadWrapper::receive_hash_done. Obsolete.
-      clear();
-
-      m_errno = handle.error_number().value();
-
-      LT_LOG_THIS(INFO, "Completed (error): position:%u try_quick:%u errno:%i msg:'%s'.",
-                  m_position, quick, m_errno, handle.error_number().c_str());
-      rak::priority_queue_update(&taskScheduler, &m_delayChecked, cachedTime);
-      return;
-    }
+    if (handle.error_number().is_valid() && handle.error_number().value() != rak::error_number::e_noent)
+      return queue_failed(handle, quick);
 
     m_position++;
 
@@ -189,7 +210,7 @@ HashTorrent::queue(bool quick) {
     if (m_slot_check_chunk)
       m_slot_check_chunk(handle);
 
-    m_outstanding++;
+    inc_outstanding();
   }
 
   if (m_outstanding == 0) {
@@ -201,4 +222,114 @@ HashTorrent::queue(bool quick) {
   }
 }
 
+// Like queue(), but the chunks are taken from 'm_order' and removed
+// from the ranges as they are queued.
+void
+HashTorrent::queue_ordered() {
+  while (m_order_position < m_order.size()) {
+    if (is_queue_full())
+      return;
+
+    uint32_t    index  = m_order[m_order_position];
+    ChunkHandle handle = m_chunk_list->get(index, ChunkList::get_dont_log);
+
+    if (handle.error_number().is_valid() && handle.error_number().value() != rak::error_number::e_noent)
+      return queue_failed(handle, false);
+
+    m_order_position++;
+    m_ranges.erase(index, index + 1);
+
+    if (!handle.is_valid() && !handle.error_number().is_valid())
+      throw internal_error("Hash torrent errno == 0.");
+
+    if (!handle.is_valid())
+      continue;
+
+    if (m_slot_check_chunk)
+      m_slot_check_chunk(handle);
+
+    inc_outstanding();
+  }
+
+  m_order.clear();
+  m_order_position = 0;
+  m_position = m_chunk_list->size();
+
+  if (m_outstanding == 0) {
+    LT_LOG_THIS(INFO, "Completed (physical order).", 0);
+    rak::priority_queue_update(&taskScheduler, &m_delayChecked, cachedTime);
+  }
+}
+
+void
+HashTorrent::queue_failed(const ChunkHandle& handle, bool quick) {
+  if (handle.is_valid())
+    throw internal_error("HashTorrent::queue() error, but handle.is_valid().");
+
+  // We wait for all the outstanding chunks to be checked before
+  // borking completely, else low-memory devices might not be able
+  // to finish the hash check.
+  if (m_outstanding != 0)
+    return;
+
+  // The rest of the outstanding chunks get ignored by
+  // DownloadWrapper::receive_hash_done. Obsolete.
+  clear();
+
+  m_errno = handle.error_number().value();
+
+  LT_LOG_THIS(INFO, "Completed (error): position:%u try_quick:%u errno:%i msg:'%s'.",
+              m_position, quick, m_errno, handle.error_number().c_str());
+  rak::priority_queue_update(&taskScheduler, &m_delayChecked, cachedTime);
+}
+
+// Keep enough chunks in flight to feed every hashing worker, the disk
+// thread itself counts as one. Past the recheck budget each download
+// keeps a single chunk in flight.
+bool
+HashTorrent::is_queue_full() const {
+  int max_outstanding = std::max(10, 2 * static_cast<int>(thread_disk()->hash_check_queue()->worker_count() + 1));
+
+  if (m_outstanding > max_outstanding && m_outstanding * m_chunk_list->chunk_size() > (128 << 20))
+    return true;
+
+  uint64_t budget = manager->chunk_manager()->hash_recheck_budget();
+
+  return budget != 0 && m_outstanding != 0 &&
+    manager->chunk_manager()->hash_recheck_usage() + m_chunk_list->chunk_size() > budget;
+}
+
+void
+HashTorrent::inc_outstanding() {
+  m_outstanding++;
+  m_budget_usage += m_chunk_list->chunk_size();
+
+  manager->chunk_manager()->inc_hash_recheck_usage(m_chunk_list->chunk_size());
+}
+
+void
+HashTorrent::dec_outstanding() {
+  uint32_t size = std::min<uint64_t>(m_budget_usage, m_chunk_list->chunk_size());
+
+  m_outstanding--;
+  m_budget_usage -= size;
+
+  manager->chunk_manager()->dec_hash_recheck_usage(size);
+}
+
+std::vector<uint32_t>
+HashTorrent::physical_order(const Ranges& ranges, const std::vector<uint64_t>& addresses) {
+  std::vector<uint32_t> order;
+
+  for (const auto& range : ranges)
+    for (uint32_t index = range.first; index < range.second && index < addresses.size(); index++)
+      order.push_back(index);
+
+  std::stable_sort(order.begin(), order.end(), [&addresses](uint32_t a, uint32_t b) {
+      return addresses[a] < addresses[b];
+    });
+
+  return order;
+}
+
 }
@@ -4,6 +4,7 @@
 #include <cinttypes>
 #include <functional>
 #include <string>
+#include <vector>
 #include <rak/priority_queue_default.h>
 
 #include "data/chunk_handle.h"
@@ -18,6 +19,7 @@ public:
   using Ranges = ranges<uint32_t>;
 
   using slot_chunk_handle = std::function<void(ChunkHandle)>;
+  using slot_addresses    = std::function<std::vector<uint64_t>()>;
 
   HashTorrent(ChunkList* c);
   ~HashTorrent() { clear(); }
@@ -34,10 +36,27 @@ public:
   uint32_t            position() const                       { return m_position; }
   uint32_t            outstanding() const                    { return m_outstanding; }
 
+  uint32_t            remaining(uint32_t first, uint32_t last) const;
+
   int                 error_number() const                   { return m_errno; }
 
+  // Background checks yield to rechecks the user asked for, and both
+  // yield to verifying downloaded chunks.
+  bool                is_background() const                  { return m_background; }
+  void                set_background(bool state)             { m_background = state; }
+
   slot_chunk_handle&  slot_check_chunk() { return m_slot_check_chunk; }
 
+  // Returns the physical address of each chunk for checking them in
+  // that order, or nothing to check by index. While checking in
+  // physical order the queued chunks are removed from the hashing
+  // ranges and the position stays at zero until done.
+  slot_addresses&     slot_physical_addresses() { return m_slot_physical_addresses; }
+
+  // The chunks in 'ranges' ordered by address, those with unknown
+  // addresses last by index.
+  static std::vector<uint32_t> physical_order(const Ranges& ranges, const std::vector<uint64_t>& addresses);
+
   rak::priority_item& delay_checked()                        { return m_delayChecked; }
 
   void                receive_chunkdone(uint32_t index);
@@ -45,16 +64,33 @@ public:
 
 private:
   void                queue(bool quick);
+  void                queue_ordered();
+  bool                is_queue_full() const;
+
+  // Stops checking on a chunk that could not be mapped, once the
+  // outstanding chunks are done.
+  void                queue_failed(const ChunkHandle& handle, bool quick);
+
+  // Accounts the chunks in flight against ChunkManager's recheck
+  // budget.
+  void                inc_outstanding();
+  void                dec_outstanding();
 
   unsigned int        m_position{0};
   int                 m_outstanding{-1};
   Ranges              m_ranges;
 
   int                 m_errno{0};
+  bool                m_background{false};
+  uint64_t            m_budget_usage{0};
 
   ChunkList*          m_chunk_list;
 
   slot_chunk_handle   m_slot_check_chunk;
+  slot_addresses      m_slot_physical_addresses;
+
+  std::vector<uint32_t> m_order;
+  size_t              m_order_position{0};
 
   rak::priority_item  m_delayChecked;
 };
@@ -0,0 +1,75 @@
+#include "config.h"
+
+#include "data/io_priority.h"
+
+#include <atomic>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "torrent/utils/log.h"
+
+namespace torrent {
+
+namespace {
+
+// From linux/ioprio.h, which older headers lack.
+constexpr int ioprio_class_shift = 13;
+constexpr int ioprio_class_none  = 0;
+constexpr int ioprio_class_be    = 2;
+constexpr int ioprio_class_idle  = 3;
+constexpr int ioprio_who_process = 1;
+
+constexpr int
+ioprio_value(int io_class, int level) {
+  return (io_class << ioprio_class_shift) | level;
+}
+
+std::atomic<bool>         io_priority_state{false};
+thread_local io_class_type io_priority_thread{io_class_default};
+
+int
+io_class_value(io_class_type io_class) {
+  switch (io_class) {
+  case io_class_upload:  return ioprio_value(ioprio_class_be, 0);
+  case io_class_verify:  return ioprio_value(ioprio_class_be, 2);
+  case io_class_write:   return ioprio_value(ioprio_class_be, 4);
+  case io_class_recheck: return ioprio_value(ioprio_class_idle, 0);
+  default:               return ioprio_value(ioprio_class_none, 0);
+  }
+}
+
+}
+
+bool
+io_priority_enabled() {
+  return io_priority_state.load(std::memory_order_relaxed);
+}
+
+void
+io_priority_set_enabled(bool state) {
+  io_priority_state.store(state, std::memory_order_relaxed);
+}
+
+void
+io_priority_set(io_class_type io_class) {
+  if (!io_priority_enabled())
+    io_class = io_class_default;
+
+  if (io_class == io_priority_thread)
+    return;
+
+  io_priority_thread = io_class;
+
+#ifdef SYS_ioprio_set
+  // The 'who' of zero is the calling thread.
+  if (syscall(SYS_ioprio_set, ioprio_who_process, 0, io_class_value(io_class)) != 0)
+    lt_log_print(LOG_STORAGE_DEBUG, "io_priority: could not set the I/O priority (class:%i)", static_cast<int>(io_class));
+#endif
+}
+
+io_class_type
+io_priority_current() {
+  return io_priority_thread;
+}
+
+}
@@ -0,0 +1,40 @@
+#ifndef LIBTORRENT_DATA_IO_PRIORITY_H
+#define LIBTORRENT_DATA_IO_PRIORITY_H
+
+namespace torrent {
+
+// The kernel I/O priority the disk thread, device queues and hashing
+// workers switch to for each type of job, so that a background
+// recheck yields to the reads of seeding:
+//
+//  - io_class_upload, preloads for uploads: best-effort, level 0.
+//  - io_class_verify, hashing downloaded chunks: best-effort, level 2.
+//  - io_class_write, writing and syncing chunks: best-effort, level 4.
+//  - io_class_recheck, rechecks and background hashing: idle.
+//
+// The priority is only changed when it differs from the last one the
+// thread set, and only while enabled. Disabling resets a thread to the
+// default on its next job. A no-op where ioprio_set is missing, and
+// I/O schedulers that ignore priorities, such as 'none', see no
+// difference.
+
+enum io_class_type {
+  io_class_default,
+  io_class_upload,
+  io_class_verify,
+  io_class_write,
+  io_class_recheck
+};
+
+bool io_priority_enabled();
+void io_priority_set_enabled(bool state);
+
+// Sets the I/O priority of the calling thread.
+void io_priority_set(io_class_type io_class);
+
+// The class last set by the calling thread.
+io_class_type io_priority_current();
+
+}
+
+#endif
@@ -65,6 +65,7 @@ const int MemoryChunk::prot_read;
 const int MemoryChunk::prot_write;
 const int MemoryChunk::prot_none;
 const int MemoryChunk::map_shared;
+const int MemoryChunk::map_private;
 
 const int MemoryChunk::advice_normal;
 const int MemoryChunk::advice_random;
@@ -18,6 +18,7 @@ class MemoryChunk {
   static constexpr int prot_write             = PROT_WRITE;
   static constexpr int prot_none              = PROT_NONE;
   static constexpr int map_shared             = MAP_SHARED;
+  static constexpr int map_private            = MAP_PRIVATE;
   static constexpr int map_anon               = MAP_ANON;
 
 #ifdef USE_MADVISE
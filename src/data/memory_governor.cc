@@ -0,0 +1,195 @@
+#include "config.h"
+
+#include "data/memory_governor.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+
+#include "torrent/chunk_manager.h"
+#include "torrent/common.h"
+#include "torrent/utils/log.h"
+
+#define LT_LOG(log_fmt, ...)                                            \
+  lt_log_print(LOG_STORAGE_INFO, "memory_governor: " log_fmt, __VA_ARGS__);
+
+namespace torrent {
+
+namespace {
+
+// Reads a byte count, where "max" gives 0.
+bool
+read_bytes(const std::string& path, uint64_t* bytes) {
+  std::FILE* file = std::fopen(path.c_str(), "r");
+
+  if (file == nullptr)
+    return false;
+
+  char buffer[32] = {};
+  bool success = std::fgets(buffer, sizeof(buffer), file) != nullptr;
+
+  std::fclose(file);
+
+  if (!success)
+    return false;
+
+  if (std::strncmp(buffer, "max", 3) == 0) {
+    *bytes = 0;
+    return true;
+  }
+
+  return std::sscanf(buffer, "%" SCNu64, bytes) == 1;
+}
+
+bool
+read_pressure(const std::string& path, double* pressure) {
+  std::FILE* file = std::fopen(path.c_str(), "r");
+
+  if (file == nullptr)
+    return false;
+
+  bool success = std::fscanf(file, "some avg10=%lf", pressure) == 1;
+
+  std::fclose(file);
+  return success;
+}
+
+}
+
+std::string
+MemoryGovernor::find_cgroup_path() {
+  std::FILE* file = std::fopen("/proc/self/cgroup", "r");
+
+  if (file == nullptr)
+    return std::string();
+
+  char        line[4096];
+  std::string path;
+
+  // The unified hierarchy is the entry with id 0 and no controllers.
+  while (std::fgets(line, sizeof(line), file) != nullptr) {
+    if (std::strncmp(line, "0::", 3) != 0)
+      continue;
+
+    path = std::string("/sys/fs/cgroup") + (line + 3);
+    path.erase(path.find_last_not_of("\n/") + 1);
+    break;
+  }
+
+  std::fclose(file);
+  return path;
+}
+
+bool
+MemoryGovernor::read_sample(sample_type* sample) const {
+  *sample = sample_type{};
+
+  bool has_limit    = read_bytes(m_cgroup_path + "/memory.max", &sample->limit);
+  bool has_current  = read_bytes(m_cgroup_path + "/memory.current", &sample->current);
+  bool has_pressure = read_pressure(m_cgroup_path + "/memory.pressure", &sample->pressure);
+
+  if (!has_limit || !has_current)
+    sample->limit = 0;
+
+  return has_current || has_pressure;
+}
+
+bool
+MemoryGovernor::start(bool schedule) {
+  if (m_active)
+    return true;
+
+  if (m_cgroup_path.empty())
+    m_cgroup_path = find_cgroup_path();
+
+  sample_type sample;
+
+  if (m_cgroup_path.empty() || !read_sample(&sample)) {
+    LT_LOG("could not read the memory usage or pressure of the cgroup (path:%s)", m_cgroup_path.c_str());
+    return false;
+  }
+
+  m_active         = true;
+  m_under_pressure = false;
+  m_base_max       = m_chunk_manager->max_memory_usage();
+  m_base_cache     = m_chunk_manager->chunk_cache_size();
+
+  LT_LOG("started (path:%s limit:%" PRIu64 " current:%" PRIu64 " max_memory_usage:%" PRIu64 ")",
+         m_cgroup_path.c_str(), sample.limit, sample.current, m_base_max);
+
+  update(sample);
+
+  if (schedule) {
+    m_task_sample.slot() = [this] { receive_sample(); };
+    this_thread::scheduler()->wait_for_ceil_seconds(&m_task_sample, sample_interval);
+  }
+
+  return true;
+}
+
+void
+MemoryGovernor::stop() {
+  if (!m_active)
+    return;
+
+  if (m_task_sample.is_scheduled())
+    this_thread::scheduler()->erase(&m_task_sample);
+
+  m_chunk_manager->set_max_memory_usage(m_base_max);
+  m_chunk_manager->set_chunk_cache_size(m_base_cache);
+  m_chunk_manager->set_preload_paused(false);
+
+  m_active = false;
+  m_under_pressure = false;
+
+  LT_LOG("stopped", 0);
+}
+
+void
+MemoryGovernor::update(const sample_type& sample) {
+  uint64_t usage   = m_chunk_manager->memory_usage();
+  uint64_t current = m_chunk_manager->max_memory_usage();
+  uint64_t target  = m_base_max;
+
+  if (sample.limit != 0) {
+    uint64_t others   = sample.current > usage ? sample.current - usage : 0;
+    uint64_t headroom = sample.limit > others ? sample.limit - others : 0;
+
+    target = std::min(target, headroom / 4 * 3);
+  }
+
+  bool under_pressure = sample.pressure >= pressure_threshold;
+
+  if (under_pressure)
+    target = std::min(target, current - current / 8);
+  else
+    target = std::min(target, current + std::max(current / 16, min_memory_usage));
+
+  target = std::max(target, std::min(min_memory_usage, m_base_max));
+
+  if (under_pressure != m_under_pressure || target != current)
+    LT_LOG("updated (limit:%" PRIu64 " current:%" PRIu64 " pressure:%.2f max_memory_usage:%" PRIu64 ")",
+           sample.limit, sample.current, sample.pressure, target);
+
+  m_under_pressure = under_pressure;
+
+  m_chunk_manager->set_max_memory_usage(target);
+  m_chunk_manager->set_chunk_cache_size(m_base_max != 0 ? uint64_t(double(m_base_cache) * target / m_base_max) : 0);
+  m_chunk_manager->set_preload_paused(under_pressure);
+
+  // Don't wait for the next allocation to notice the smaller max.
+  if (usage > (3 * target) / 4)
+    m_chunk_manager->try_free_memory(usage - (3 * target) / 4);
+}
+
+void
+MemoryGovernor::receive_sample() {
+  sample_type sample;
+
+  if (read_sample(&sample))
+    update(sample);
+
+  this_thread::scheduler()->wait_for_ceil_seconds(&m_task_sample, sample_interval);
+}
+
+}
@@ -0,0 +1,89 @@
+#ifndef LIBTORRENT_DATA_MEMORY_GOVERNOR_H
+#define LIBTORRENT_DATA_MEMORY_GOVERNOR_H
+
+#include <chrono>
+#include <cinttypes>
+#include <string>
+
+#include "torrent/utils/scheduler.h"
+
+namespace torrent {
+
+class ChunkManager;
+
+// Fits the chunk manager's memory usage to the cgroup v2 the process
+// runs in. Every second it reads the cgroup's 'memory.max',
+// 'memory.current' and the PSI averages of 'memory.pressure', and
+// adjusts 'max_memory_usage', the chunk cache size and preloading:
+//
+//  - The max is kept below 3/4 of what the limit leaves after the
+//    memory of the rest of the cgroup.
+//  - While stalls on memory exceed 'pressure_threshold' percent over
+//    the last 10 seconds, the max shrinks by an eighth per sample and
+//    preloading is paused. Otherwise it grows back by a sixteenth.
+//  - The chunk cache is scaled with the max.
+//
+// The values the chunk manager had when started are the upper limits,
+// and are restored when stopped. Without a cgroup limit or pressure
+// file the governor only keeps those values.
+
+class MemoryGovernor {
+public:
+  struct sample_type {
+    uint64_t          limit;      // Zero if unlimited.
+    uint64_t          current;
+    double            pressure;   // Percent of time stalled, 'some avg10'.
+  };
+
+  static constexpr std::chrono::seconds sample_interval{1};
+
+  static constexpr uint64_t min_memory_usage   = uint64_t{64} << 20;
+  static constexpr double   pressure_threshold = 10.0;
+
+  MemoryGovernor(ChunkManager* chunk_manager) : m_chunk_manager(chunk_manager) {}
+  ~MemoryGovernor() { stop(); }
+
+  MemoryGovernor(const MemoryGovernor&) = delete;
+  MemoryGovernor& operator=(const MemoryGovernor&) = delete;
+
+  bool                is_active() const                     { return m_active; }
+  bool                is_under_pressure() const             { return m_under_pressure; }
+
+  // The cgroup directory, found from '/proc/self/cgroup' when started
+  // if empty.
+  const std::string&  cgroup_path() const                   { return m_cgroup_path; }
+  void                set_cgroup_path(const std::string& path) { m_cgroup_path = path; }
+
+  uint64_t            base_max_memory_usage() const         { return m_base_max; }
+
+  // Returns false if neither the memory usage nor the pressure of the
+  // cgroup can be read. Schedules the samples on the calling thread
+  // when 'schedule' is set.
+  bool                start(bool schedule = true);
+  void                stop();
+
+  // Returns false if neither file could be read.
+  bool                read_sample(sample_type* sample) const;
+
+  void                update(const sample_type& sample);
+
+  static std::string  find_cgroup_path();
+
+private:
+  void                receive_sample();
+
+  ChunkManager*       m_chunk_manager;
+  std::string         m_cgroup_path;
+
+  bool                m_active{false};
+  bool                m_under_pressure{false};
+
+  uint64_t            m_base_max{0};
+  uint64_t            m_base_cache{0};
+
+  utils::SchedulerEntry m_task_sample;
+};
+
+}
+
+#endif
@@ -0,0 +1,94 @@
+#include "config.h"
+
+#include "data/metadata_cache.h"
+
+#include "torrent/chunk_manager.h"
+
+namespace torrent {
+
+void
+MetadataCache::set_max_size(uint64_t bytes) {
+  m_max_size = bytes;
+
+  if (m_size > m_max_size)
+    evict(m_size - m_max_size);
+}
+
+DataBuffer
+MetadataCache::find(DownloadMain* download) {
+  auto itr = m_index.find(download);
+
+  if (itr == m_index.end()) {
+    m_misses++;
+    return DataBuffer();
+  }
+
+  m_hits++;
+  m_list.splice(m_list.begin(), m_list, itr->second);
+
+  return itr->second->buffer.clone();
+}
+
+DataBuffer
+MetadataCache::insert(DownloadMain* download, DataBuffer buffer) {
+  buffer.share();
+  erase(download);
+
+  uint64_t length = buffer.length();
+
+  if (length > m_max_size)
+    return buffer;
+
+  if (m_size + length > m_max_size)
+    evict(m_size + length - m_max_size);
+
+  // Reserving the memory may evict other entries when the chunk
+  // manager is short.
+  if (!m_chunk_manager->allocate(length, ChunkManager::allocate_dont_log))
+    return buffer;
+
+  m_list.push_front(entry_type{download, buffer.clone()});
+  m_index.emplace(download, m_list.begin());
+  m_size += length;
+
+  return buffer;
+}
+
+void
+MetadataCache::evict(uint64_t bytes) {
+  uint64_t target = bytes < m_size ? m_size - bytes : 0;
+
+  while (m_size > target && !m_list.empty()) {
+    remove(m_index.find(m_list.back().download));
+    m_evictions++;
+  }
+}
+
+void
+MetadataCache::erase(DownloadMain* download) {
+  auto itr = m_index.find(download);
+
+  if (itr != m_index.end())
+    remove(itr);
+}
+
+void
+MetadataCache::clear() {
+  while (!m_list.empty())
+    remove(m_index.find(m_list.back().download));
+}
+
+void
+MetadataCache::remove(index_map::iterator itr) {
+  auto entry = itr->second;
+  uint64_t length = entry->buffer.length();
+
+  entry->buffer.clear();
+  m_list.erase(entry);
+  m_index.erase(itr);
+
+  m_size -= length;
+  m_chunk_manager->deallocate(length, ChunkManager::allocate_dont_log);
+}
+
+}
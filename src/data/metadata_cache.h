@@ -0,0 +1,83 @@
+#ifndef LIBTORRENT_DATA_METADATA_CACHE_H
+#define LIBTORRENT_DATA_METADATA_CACHE_H
+
+#include <cinttypes>
+#include <list>
+#include <unordered_map>
+
+#include "net/data_buffer.h"
+
+namespace torrent {
+
+class ChunkManager;
+class DownloadMain;
+
+// Keeps the bencoded info dictionary of downloads serving ut_metadata
+// requests, so each piece sent is a reference to part of one shared
+// buffer instead of a new encoding of the info object.
+//
+// Buffers are created on the first request and evicted least recently
+// used first, both when the cache exceeds its size and when the chunk
+// manager runs short of memory. The cached bytes count towards the
+// memory usage of the chunk manager; buffers still being sent when
+// evicted are freed once the last connection is done with them.
+
+class MetadataCache {
+public:
+  MetadataCache(ChunkManager* chunk_manager) : m_chunk_manager(chunk_manager) {}
+  ~MetadataCache() { clear(); }
+
+  MetadataCache(const MetadataCache&) = delete;
+  MetadataCache& operator=(const MetadataCache&) = delete;
+
+  // Caching is disabled when 0.
+  uint64_t            max_size() const                      { return m_max_size; }
+  void                set_max_size(uint64_t bytes);
+
+  uint64_t            size() const                          { return m_size; }
+  size_t              entries() const                       { return m_index.size(); }
+
+  uint64_t            hits() const                          { return m_hits; }
+  uint64_t            misses() const                        { return m_misses; }
+  uint64_t            evictions() const                     { return m_evictions; }
+
+  // Returns a reference to the cached buffer, or an empty buffer.
+  DataBuffer          find(DownloadMain* download);
+
+  // Takes an owned buffer and returns a shared reference to it, which
+  // is also cached if it fits.
+  DataBuffer          insert(DownloadMain* download, DataBuffer buffer);
+
+  // Evict entries until 'bytes' have been released.
+  void                evict(uint64_t bytes);
+
+  void                erase(DownloadMain* download);
+  void                clear();
+
+private:
+  struct entry_type {
+    DownloadMain*     download;
+    DataBuffer        buffer;
+  };
+
+  using entry_list = std::list<entry_type>;
+  using index_map  = std::unordered_map<DownloadMain*, entry_list::iterator>;
+
+  void                remove(index_map::iterator itr);
+
+  ChunkManager*       m_chunk_manager;
+
+  entry_list          m_list;
+  index_map           m_index;
+
+  uint64_t            m_size{0};
+  uint64_t            m_max_size{0};
+
+  uint64_t            m_hits{0};
+  uint64_t            m_misses{0};
+  uint64_t            m_evictions{0};
+};
+
+}
+
+#endif
@@ -1,10 +1,13 @@
 #include "config.h"
 
 #include "socket_file.h"
+#include "chunk_buffer_pool.h"
 #include "torrent/exceptions.h"
 #include "torrent/utils/log.h"
 
+#include <algorithm>
 #include <fcntl.h>
+#include <mutex>
 #include <unistd.h>
 #include <rak/error_number.h>
 #include <rak/file_stat.h>
@@ -19,6 +22,11 @@
 #include <linux/falloc.h>
 #endif
 
+#ifdef USE_FIEMAP
+#include <linux/fiemap.h>
+#include <linux/fs.h>
+#endif
+
 #define LT_LOG_ERROR(log_fmt, ...)                                      \
   lt_log_print(LOG_STORAGE, "socket_file->%i: " log_fmt, m_fd, __VA_ARGS__);
 
@@ -130,6 +138,24 @@ SocketFile::allocate(uint64_t size, int flags) const {
   return true;
 }
 
+bool
+SocketFile::punch_hole([[maybe_unused]] uint64_t offset, [[maybe_unused]] uint64_t length) const {
+  if (!is_open())
+    throw internal_error("SocketFile::punch_hole() called on a closed file");
+
+#if defined(USE_FALLOCATE) && defined(FALLOC_FL_PUNCH_HOLE)
+  if (fallocate(m_fd, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE, offset, length) == -1) {
+    LT_LOG_ERROR("fallocate punch hole failed : %s", strerror(errno));
+    return false;
+  }
+
+  return true;
+#else
+  errno = EOPNOTSUPP;
+  return false;
+#endif
+}
+
 MemoryChunk
 SocketFile::create_padding_chunk(uint32_t length, int prot, int flags) const {
   flags |= MemoryChunk::map_anon;
@@ -142,6 +168,38 @@ SocketFile::create_padding_chunk(uint32_t length, int prot, int flags) const {
   return MemoryChunk(ptr, ptr, ptr + length, prot, flags);
 }
 
+// The region only grows, older regions are kept mapped as parts may
+// still point into them. Reads of untouched private anonymous memory
+// map the zero page, so this costs address space and page tables.
+MemoryChunk
+SocketFile::create_zero_chunk(uint32_t length) {
+  static std::mutex lock;
+  static char*      region = nullptr;
+  static size_t     region_size = 0;
+
+  if (length == 0)
+    throw internal_error("SocketFile::create_zero_chunk() received zero length");
+
+  auto guard = std::scoped_lock(lock);
+
+  if (length > region_size) {
+    size_t size = std::max<size_t>(region_size * 2, 16 << 20);
+
+    while (size < length)
+      size *= 2;
+
+    auto ptr = static_cast<char*>(mmap(nullptr, size, MemoryChunk::prot_read, MemoryChunk::map_private | MemoryChunk::map_anon | MAP_NORESERVE, -1, 0));
+
+    if (ptr == MAP_FAILED)
+      return MemoryChunk();
+
+    region = ptr;
+    region_size = size;
+  }
+
+  return MemoryChunk(region, region, region + length, MemoryChunk::prot_read, MemoryChunk::map_private);
+}
+
 MemoryChunk
 SocketFile::create_chunk(uint64_t offset, uint32_t length, int prot, int flags) const {
   if (!is_open())
@@ -162,5 +220,170 @@ SocketFile::create_chunk(uint64_t offset, uint32_t length, int prot, int flags)
   return MemoryChunk(ptr, ptr + align, ptr + align + length, prot, flags);
 }
 
+// Reserves enough address space to place the mapping at the wanted
+// alignment, maps the file over it and releases the rest.
+MemoryChunk
+SocketFile::create_huge_chunk(uint64_t offset, uint32_t length, int prot, int flags, uint32_t huge_page_size) const {
+  if (!is_open())
+    throw internal_error("SocketFile::create_huge_chunk() called on a closed file");
+
+  if (huge_page_size == 0 || huge_page_size % MemoryChunk::page_size() != 0)
+    throw internal_error("SocketFile::create_huge_chunk() received an invalid huge page size");
+
+  if (length == 0 || offset > size() || offset + length > size())
+    return MemoryChunk();
+
+  uint64_t align = offset % MemoryChunk::page_size();
+  uint64_t map_offset = offset - align;
+  size_t   map_length = length + align;
+  size_t   reserve_length = map_length + huge_page_size;
+
+  auto reserve = static_cast<char*>(mmap(nullptr, reserve_length, PROT_NONE, MAP_PRIVATE | MemoryChunk::map_anon, -1, 0));
+
+  if (reserve == MAP_FAILED)
+    return MemoryChunk();
+
+  auto reserve_base = reinterpret_cast<uintptr_t>(reserve);
+  auto target = reserve_base - reserve_base % huge_page_size + map_offset % huge_page_size;
+
+  if (target < reserve_base)
+    target += huge_page_size;
+
+  auto ptr = static_cast<char*>(mmap(reinterpret_cast<char*>(target), map_length, prot, flags | MAP_FIXED, m_fd, map_offset));
+
+  if (ptr == MAP_FAILED) {
+    munmap(reserve, reserve_length);
+    return MemoryChunk();
+  }
+
+  if (ptr != reserve)
+    munmap(reserve, ptr - reserve);
+
+  if (ptr + map_length != reserve + reserve_length)
+    munmap(ptr + map_length, (reserve + reserve_length) - (ptr + map_length));
+
+  // Fails without transparent huge page support, the mapping is
+  // usable either way.
+#ifdef MADV_HUGEPAGE
+  madvise(ptr, map_length, MADV_HUGEPAGE);
+#endif
+
+  return MemoryChunk(ptr, ptr + align, ptr + align + length, prot, flags);
+}
+
+MemoryChunk
+SocketFile::create_buffer_chunk(uint64_t offset, uint32_t length, int prot, ChunkBufferPool* pool) const {
+  if (!is_open())
+    throw internal_error("SocketFile::create_buffer_chunk() called on a closed file");
+
+  // Same extent check as 'create_chunk', so both backends fail on the
+  // same files.
+  if (length == 0 || offset > size() || offset + length > size())
+    return MemoryChunk();
+
+  MemoryChunk chunk = pool->allocate(length, prot);
+
+  if (!chunk.is_valid())
+    return MemoryChunk();
+
+  uint32_t position = 0;
+
+  while (position != length) {
+    ssize_t r = ::pread(m_fd, chunk.begin() + position, length - position, offset + position);
+
+    if (r == -1 && errno == EINTR)
+      continue;
+
+    if (r <= 0) {
+      LT_LOG_ERROR("pread failed : %s", r == 0 ? "unexpected end of file" : strerror(errno));
+
+      pool->release(chunk);
+      return MemoryChunk();
+    }
+
+    position += r;
+  }
+
+  return chunk;
+}
+
+bool
+SocketFile::write_buffer_chunk(const MemoryChunk& chunk, uint64_t offset) const {
+  if (!is_open())
+    throw internal_error("SocketFile::write_buffer_chunk() called on a closed file");
+
+  uint32_t position = 0;
+
+  while (position != chunk.size()) {
+    ssize_t r = ::pwrite(m_fd, chunk.begin() + position, chunk.size() - position, offset + position);
+
+    if (r == -1 && errno == EINTR)
+      continue;
+
+    if (r <= 0)
+      return false;
+
+    position += r;
+  }
+
+  return true;
+}
+
+bool
+SocketFile::sync_data() const {
+  if (!is_open())
+    throw internal_error("SocketFile::sync_data() called on a closed file");
+
+#ifdef SYS_DARWIN
+  return fsync(m_fd) == 0;
+#else
+  return fdatasync(m_fd) == 0;
+#endif
 }
 
+bool
+SocketFile::read_extents(std::vector<extent_type>* extents) const {
+  extents->clear();
+
+#ifdef USE_FIEMAP
+  constexpr unsigned int batch_size = 256;
+
+  std::vector<char> buffer(sizeof(struct fiemap) + batch_size * sizeof(struct fiemap_extent));
+  auto map = reinterpret_cast<struct fiemap*>(buffer.data());
+
+  uint64_t start = 0;
+
+  while (true) {
+    std::fill(buffer.begin(), buffer.end(), 0);
+
+    map->fm_start = start;
+    map->fm_length = FIEMAP_MAX_OFFSET - start;
+    map->fm_extent_count = batch_size;
+
+    if (ioctl(m_fd, FS_IOC_FIEMAP, map) == -1) {
+      extents->clear();
+      return false;
+    }
+
+    if (map->fm_mapped_extents == 0)
+      return true;
+
+    for (unsigned int i = 0; i < map->fm_mapped_extents; i++) {
+      const auto& extent = map->fm_extents[i];
+
+      // Data not yet allocated or inline has no useful address.
+      if (!(extent.fe_flags & (FIEMAP_EXTENT_UNKNOWN | FIEMAP_EXTENT_DELALLOC | FIEMAP_EXTENT_DATA_INLINE)))
+        extents->push_back(extent_type{extent.fe_logical, extent.fe_physical, extent.fe_length});
+
+      if (extent.fe_flags & FIEMAP_EXTENT_LAST)
+        return true;
+
+      start = extent.fe_logical + extent.fe_length;
+    }
+  }
+#else
+  return false;
+#endif
+}
+
+}
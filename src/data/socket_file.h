@@ -2,6 +2,7 @@
 #define LIBTORRENT_SOCKET_FILE_H
 
 #include <string>
+#include <vector>
 #include <cinttypes>
 #include <fcntl.h>
 #include <sys/types.h>
@@ -10,6 +11,8 @@
 
 namespace torrent {
 
+class ChunkBufferPool;
+
 class SocketFile {
 public:
   using fd_type = int;
@@ -23,6 +26,12 @@ public:
   static constexpr int flag_fallocate          = (1 << 0);
   static constexpr int flag_fallocate_blocking = (1 << 1);
 
+  struct extent_type {
+    uint64_t          logical;
+    uint64_t          physical;
+    uint64_t          length;
+  };
+
   SocketFile() = default;
   ~SocketFile() = default;
   SocketFile(fd_type fd) : m_fd(fd) {}
@@ -37,9 +46,35 @@ public:
 
   bool                allocate(uint64_t size, int flags = 0) const;
 
+  // Frees the blocks of [offset, offset + length>, which then reads
+  // as zeros, without changing the size. Returns false if the
+  // platform or file system doesn't support it.
+  bool                punch_hole(uint64_t offset, uint64_t length) const;
+
   MemoryChunk         create_padding_chunk(uint32_t length, int prot, int flags) const;
+
+  // Read-only zeroed memory shared by all callers, backed by the
+  // kernel's zero page. The memory is never unmapped, so parts using
+  // it are ChunkPart::MAPPED_STATIC.
+  static MemoryChunk  create_zero_chunk(uint32_t length);
   MemoryChunk         create_chunk(uint64_t offset, uint32_t length, int prot, int flags) const;
 
+  // Like 'create_chunk', but the mapping is placed so that the file
+  // offset and address are congruent modulo 'huge_page_size', and
+  // transparent huge pages are requested where supported.
+  MemoryChunk         create_huge_chunk(uint64_t offset, uint32_t length, int prot, int flags, uint32_t huge_page_size) const;
+
+  // Positional I/O alternative to 'create_chunk', the range is read
+  // into a buffer from 'pool' and must be written back explicitly.
+  MemoryChunk         create_buffer_chunk(uint64_t offset, uint32_t length, int prot, ChunkBufferPool* pool) const;
+  bool                write_buffer_chunk(const MemoryChunk& chunk, uint64_t offset) const;
+
+  bool                sync_data() const;
+
+  // Where the data of the file is stored on the device, in logical
+  // order. Returns false if the platform or file system can't tell.
+  bool                read_extents(std::vector<extent_type>* extents) const;
+
   fd_type             fd() const                                        { return m_fd; }
 
 private:
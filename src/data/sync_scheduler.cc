@@ -0,0 +1,142 @@
+#include "config.h"
+
+#include "data/sync_scheduler.h"
+
+#include <algorithm>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "data/chunk.h"
+#include "data/disk_throttle.h"
+#include "data/memory_chunk.h"
+#include "data/socket_file.h"
+#include "torrent/exceptions.h"
+
+namespace torrent {
+
+void
+SyncScheduler::add(Chunk* chunk, int flags, std::vector<int>* fds) {
+  if (fds->size() != static_cast<size_t>(std::distance(chunk->begin(), chunk->end())))
+    throw internal_error("SyncScheduler::add(...) fds->size() does not match the chunk.");
+
+  m_entries.push_back(entry_type{chunk, flags, fds, true});
+}
+
+void
+SyncScheduler::perform() {
+  for (unsigned int index = 0; index < m_entries.size(); index++) {
+    entry_type& entry = m_entries[index];
+    auto        fd    = entry.fds->begin();
+
+    for (auto part = entry.chunk->begin(); part != entry.chunk->end(); ++part, ++fd) {
+      // Anonymous memory and read-only parts.
+      if (*fd == -1) {
+        entry.success = part->sync(entry.flags) && entry.success;
+        continue;
+      }
+
+      if (part->needs_write_back()) {
+#ifndef USE_SYNC_FILE_RANGE
+        acquire_write(part->size());
+#endif
+
+        if (!part->write_back(*fd, 0)) {
+          entry.success = false;
+          continue;
+        }
+
+        add_range(index, part->file(), *fd, part->file_offset(), part->size());
+        continue;
+      }
+
+#ifdef USE_SYNC_FILE_RANGE
+      add_range(index, part->file(), *fd, part->file_offset(), part->size());
+#else
+      acquire_write(part->size());
+      entry.success = part->sync(entry.flags) && entry.success;
+#endif
+    }
+  }
+
+  flush_ranges();
+
+  for (auto& entry : m_entries)
+    Chunk::close_sync_fds(*entry.fds);
+}
+
+void
+SyncScheduler::acquire_write(uint64_t bytes) {
+  if (m_disk_throttle != nullptr)
+    m_disk_throttle->acquire(DiskThrottle::class_write, bytes, 1);
+}
+
+void
+SyncScheduler::add_range(unsigned int entry, File* file, int fd, uint64_t offset, uint64_t length) {
+  bool wait = m_entries[entry].flags & MemoryChunk::sync_sync;
+
+  m_ranges.push_back(range_type{file, fd, offset, length, wait, entry});
+}
+
+void
+SyncScheduler::flush_ranges() {
+  std::sort(m_ranges.begin(), m_ranges.end(), [](const range_type& a, const range_type& b) {
+      return a.file != b.file ? a.file < b.file : a.offset < b.offset;
+    });
+
+  m_range_count = m_ranges.size();
+
+  auto mark_failed = [this](auto first, auto last) {
+      std::for_each(first, last, [this](const range_type& r) { m_entries[r.entry].success = false; });
+    };
+
+  // Start writeback of each merged range without waiting, so the
+  // elevator gets to see all of it before any blocking sync.
+  for (auto first = m_ranges.begin(); first != m_ranges.end(); ) {
+    uint64_t end  = first->offset + first->length;
+    auto     last = std::next(first);
+
+    while (last != m_ranges.end() && last->file == first->file && last->offset <= end) {
+      end = std::max(end, last->offset + last->length);
+      ++last;
+    }
+
+    m_merged_count++;
+
+#ifdef USE_SYNC_FILE_RANGE
+    acquire_write(end - first->offset);
+
+    if (::sync_file_range(first->fd, first->offset, end - first->offset, SYNC_FILE_RANGE_WRITE) != 0)
+      mark_failed(first, last);
+#endif
+
+    first = last;
+  }
+
+  // One fdatasync per file for the chunks that requested MS_SYNC, or
+  // for all files when the written data is to be dropped from the
+  // page cache as dirty pages can't be.
+  for (auto first = m_ranges.begin(); first != m_ranges.end(); ) {
+    auto last = std::find_if(first, m_ranges.end(), [first](const range_type& r) { return r.file != first->file; });
+    auto wait = std::find_if(first, last, [this](const range_type& r) { return r.wait || m_drop_cache; });
+
+    if (wait != last)
+      acquire_write(0);
+
+    if (wait != last && !SocketFile(wait->fd).sync_data()) {
+      mark_failed(first, last);
+      first = last;
+      continue;
+    }
+
+#ifdef USE_POSIX_FADVISE
+    if (m_drop_cache)
+      std::for_each(first, last, [](const range_type& r) { posix_fadvise(r.fd, r.offset, r.length, POSIX_FADV_DONTNEED); });
+#endif
+
+    first = last;
+  }
+
+  m_ranges.clear();
+}
+
+}
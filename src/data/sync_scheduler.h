@@ -0,0 +1,81 @@
+#ifndef LIBTORRENT_DATA_SYNC_SCHEDULER_H
+#define LIBTORRENT_DATA_SYNC_SCHEDULER_H
+
+#include <cinttypes>
+#include <vector>
+
+namespace torrent {
+
+class Chunk;
+class DiskThrottle;
+class File;
+
+// Syncs a batch of chunks on the disk thread. Buffered parts are
+// written out first, then the dirty ranges of all chunks are sorted
+// and merged per file so that adjacent chunks, including those split
+// across file boundaries, are flushed with a single sync_file_range
+// call. Chunks that need a blocking sync get one fdatasync per file
+// after all writeback has been started.
+//
+// Without sync_file_range the mmap'ed parts fall back to msync.
+//
+// With 'drop_cache' set every range is waited on and then dropped
+// from the page cache with posix_fadvise.
+//
+// With a DiskThrottle set, each merged range, msync'ed part and
+// fdatasync waits for the write quota. Where sync_file_range starts
+// the writeback, buffered parts are charged with their range rather
+// than when written, as pwrite only fills the page cache.
+
+class SyncScheduler {
+public:
+  // The descriptors must come from 'Chunk::dup_sync_fds', they are
+  // closed by 'perform'.
+  void                add(Chunk* chunk, int flags, std::vector<int>* fds);
+  void                perform();
+
+  bool                is_drop_cache() const                { return m_drop_cache; }
+  void                set_drop_cache(bool state)           { m_drop_cache = state; }
+
+  void                set_disk_throttle(DiskThrottle* throttle) { m_disk_throttle = throttle; }
+
+  bool                is_success(unsigned int index) const { return m_entries.at(index).success; }
+
+  unsigned int        size() const                         { return m_entries.size(); }
+  unsigned int        range_count() const                  { return m_range_count; }
+  unsigned int        merged_count() const                 { return m_merged_count; }
+
+private:
+  struct entry_type {
+    Chunk*            chunk;
+    int               flags;
+    std::vector<int>* fds;
+    bool              success;
+  };
+
+  struct range_type {
+    File*             file;
+    int               fd;
+    uint64_t          offset;
+    uint64_t          length;
+    bool              wait;
+    unsigned int      entry;
+  };
+
+  void                add_range(unsigned int entry, File* file, int fd, uint64_t offset, uint64_t length);
+  void                flush_ranges();
+  void                acquire_write(uint64_t bytes);
+
+  std::vector<entry_type> m_entries;
+  std::vector<range_type> m_ranges;
+
+  unsigned int        m_range_count{0};
+  unsigned int        m_merged_count{0};
+
+  bool                m_drop_cache{false};
+  DiskThrottle*       m_disk_throttle{nullptr};
+};
+
+}
+
+#endif
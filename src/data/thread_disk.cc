@@ -2,6 +2,9 @@
 
 #include "data/thread_disk.h"
 
+#include <algorithm>
+#include <vector>
+
 #include "thread_main.h"
 #include "data/hash_queue.h"
 #include "torrent/exceptions.h"
@@ -15,6 +18,7 @@ namespace torrent {
 ThreadDisk* ThreadDisk::m_thread_disk{nullptr};
 
 ThreadDisk::~ThreadDisk() {
+  stop_device_queues();
   m_thread_disk = nullptr;
 }
 
@@ -39,6 +43,91 @@ ThreadDisk::thread_disk() {
   return m_thread_disk;
 }
 
+size_t
+ThreadDisk::device_queue_count() {
+  auto lock = std::scoped_lock(m_device_queues_lock);
+
+  return m_device_queues.size();
+}
+
+DeviceQueue*
+ThreadDisk::device_queue(uint64_t device) {
+  if (!m_device_queues_enabled || device == 0)
+    return nullptr;
+
+  auto lock = std::scoped_lock(m_device_queues_lock);
+  auto& queue = m_device_queues[device];
+
+  if (queue == nullptr)
+    queue = std::make_unique<DeviceQueue>(device, m_disk_throttle);
+
+  return queue.get();
+}
+
+void
+ThreadDisk::set_disk_throttle(DiskThrottle* throttle) {
+  m_disk_throttle = throttle;
+  m_hash_check_queue.set_disk_throttle(throttle);
+}
+
+void
+ThreadDisk::callback_device(uint64_t device, void* target, std::function<void()>&& fn) {
+  if (auto queue = device_queue(device))
+    queue->callback(target, std::move(fn));
+  else
+    callback(target, std::move(fn));
+}
+
+void
+ThreadDisk::cancel_device_callbacks_and_wait(void* target) {
+  cancel_callback_and_wait(target);
+
+  // Queues are only removed when stopping, so the lock need not be
+  // held while waiting on the callbacks.
+  std::vector<DeviceQueue*> queues;
+
+  {
+    auto lock = std::scoped_lock(m_device_queues_lock);
+
+    for (auto& queue : m_device_queues)
+      queues.push_back(queue.second.get());
+  }
+
+  for (auto queue : queues)
+    queue->cancel_callback_and_wait(target);
+}
+
+void
+ThreadDisk::push_hash_chunk(uint64_t device, HashChunk* hash_chunk) {
+  if (auto queue = device_queue(device)) {
+    queue->hash_check_queue()->push_back(hash_chunk);
+    queue->interrupt();
+    return;
+  }
+
+  m_hash_check_queue.push_back(hash_chunk);
+  interrupt();
+}
+
+bool
+ThreadDisk::remove_hash_chunk(HashChunk* hash_chunk) {
+  if (m_hash_check_queue.remove(hash_chunk))
+    return true;
+
+  auto lock = std::scoped_lock(m_device_queues_lock);
+
+  return std::any_of(m_device_queues.begin(), m_device_queues.end(), [hash_chunk](auto& queue) {
+      return queue.second->hash_check_queue()->remove(hash_chunk);
+    });
+}
+
+void
+ThreadDisk::stop_device_queues() {
+  auto lock = std::scoped_lock(m_device_queues_lock);
+
+  m_device_queues.clear();
+}
+
 void
 ThreadDisk::init_thread() {
   if (!Poll::slot_create_poll())
@@ -66,16 +155,20 @@ ThreadDisk::call_events() {
       throw internal_error("Already trigged shutdown.");
 
     m_flags |= flag_did_shutdown;
+    m_hash_check_queue.stop_workers();
+    stop_device_queues();
     throw shutdown_exception();
   }
 
   m_hash_check_queue.perform();
   process_callbacks();
+
+  m_disk_space.sample(this_thread::cached_time());
 }
 
 std::chrono::microseconds
 ThreadDisk::next_timeout() {
-  return std::chrono::microseconds(10s);
+  return std::min(std::chrono::microseconds(10s), m_disk_space.next_sample(this_thread::cached_time()));
 }
 
 }
@@ -1,6 +1,13 @@
 #ifndef LIBTORRENT_DATA_THREAD_DISK_H
 #define LIBTORRENT_DATA_THREAD_DISK_H
 
+#include <atomic>
+#include <map>
+#include <memory>
+#include <mutex>
+
+#include "data/device_queue.h"
+#include "data/disk_space_sampler.h"
 #include "data/hash_check_queue.h"
 #include "torrent/common.h"
 #include "torrent/utils/thread.h"
@@ -19,6 +26,39 @@ public:
 
   HashCheckQueue* hash_check_queue() { return &m_hash_check_queue; }
 
+  // Free space of the file systems in use, resampled by this thread.
+  DiskSpaceSampler* disk_space()     { return &m_disk_space; }
+
+  // Throttles the hashing of this thread and the device queues, must
+  // be set before either starts.
+  DiskThrottle*   disk_throttle()                    { return m_disk_throttle; }
+  void            set_disk_throttle(DiskThrottle* throttle);
+
+  // When enabled, the I/O of downloads on a known device is done by a
+  // DeviceQueue for that device instead of this thread. Queues are
+  // created on first use and kept until the thread is destroyed.
+  bool            is_device_queues() const           { return m_device_queues_enabled; }
+  void            set_device_queues(bool state)      { m_device_queues_enabled = state; }
+
+  size_t          device_queue_count();
+
+  // Returns nullptr if disabled or 'device' is zero, the unknown device.
+  DeviceQueue*    device_queue(uint64_t device);
+
+  // Runs 'fn' on the queue of the device, or on this thread.
+  void            callback_device(uint64_t device, void* target, std::function<void()>&& fn);
+
+  // Cancels the callbacks of 'target' on this thread and all device
+  // queues.
+  void            cancel_device_callbacks_and_wait(void* target);
+
+  // Adds the chunk to the hash check queue of the device, or of this
+  // thread, and wakes it.
+  void            push_hash_chunk(uint64_t device, HashChunk* hash_chunk);
+
+  // Removes the chunk from whichever hash check queue holds it.
+  bool            remove_hash_chunk(HashChunk* hash_chunk);
+
   void            init_thread() override;
 
 private:
@@ -29,7 +69,16 @@ private:
 
   static ThreadDisk* m_thread_disk;
 
+  void            stop_device_queues();
+
   HashCheckQueue  m_hash_check_queue;
+  DiskSpaceSampler m_disk_space;
+  DiskThrottle*   m_disk_throttle{nullptr};
+
+  std::atomic<bool> m_device_queues_enabled{false};
+
+  std::mutex      m_device_queues_lock;
+  std::map<uint64_t, std::unique_ptr<DeviceQueue>> m_device_queues;
 };
 
 inline ThreadDisk* thread_disk() {
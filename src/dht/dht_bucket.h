@@ -37,6 +37,7 @@
 #ifndef LIBTORRENT_DHT_BUCKET_H
 #define LIBTORRENT_DHT_BUCKET_H
 
+#include <cstring>
 #include <list>
 
 #include "globals.h"
@@ -44,63 +44,24 @@
 #include "dht_node.h"
 #include "dht_tracker.h"
 #include "torrent/hash_string.h"
+#include "torrent/memory_manager.h"
 
 namespace torrent {
 
-// Hash functions for HashString keys, and dereferencing HashString pointers.
-
-// Since the first few bits are very similar if not identical (since the IDs
-// will be close to our own node ID), we use an offset of 64 bits in the hash
-// string. These bits will be uniformly distributed until the number of DHT
-// nodes on the planet approaches 2^64 which is... unlikely.
-// An offset of 64 bits provides 96 significant bits which is fine as long as
-// the size of size_t does not exceed 12 bytes, while still having correctly
-// aligned 64-bit access.
-static constexpr unsigned int hashstring_hash_ofs = 8;
-
-struct hashstring_ptr_hash {
-  size_t operator () (const HashString* n) const {
-#if USE_ALIGNED
-    size_t result = 0;
-    const char *first = n->data() + hashstring_hash_ofs;
-    const char *last = first + sizeof(size_t);
-
-    while (first != last)
-      result = (result << 8) + *first++;
-    
-    return result;
-#else
-    return *reinterpret_cast<const size_t*>(n->data() + hashstring_hash_ofs);
-#endif
-  }
-};
-
-struct hashstring_hash {
-  size_t operator () (const HashString& n) const {
-#if USE_ALIGNED
-    size_t result = 0;
-    const char *first = n.data() + hashstring_hash_ofs;
-    const char *last = first + sizeof(size_t);
-
-    while (first != last)
-      result = (result << 8) + *first++;
-    
-    return result;
-#else
-    return *reinterpret_cast<const size_t*>(n.data() + hashstring_hash_ofs);
-#endif
-  }
-};
-
 // Compare HashString pointers by dereferencing them.
 struct hashstring_ptr_equal {
-  size_t operator () (const HashString* one, const HashString* two) const 
+  bool operator () (const HashString* one, const HashString* two) const
   { return *one == *two; }
 };
 
-class DhtNodeList : public std::unordered_map<const HashString*, DhtNode*, hashstring_ptr_hash, hashstring_ptr_equal> {
+template <typename Key, typename Value>
+using dht_map_allocator = memory_counting_allocator<std::pair<const Key, Value>, MemoryManager::category_dht>;
+
+class DhtNodeList : public std::unordered_map<const HashString*, DhtNode*, hash_string_hash, hashstring_ptr_equal,
+                                              dht_map_allocator<const HashString*, DhtNode*>> {
 public:
-  using base_type = std::unordered_map<const HashString*, DhtNode*, hashstring_ptr_hash, hashstring_ptr_equal>;
+  using base_type = std::unordered_map<const HashString*, DhtNode*, hash_string_hash, hashstring_ptr_equal,
+                                       dht_map_allocator<const HashString*, DhtNode*>>;
 
   // Define accessor iterator with more convenient access to the key and
   // element values.  Allows changing the map definition more easily if needed.
@@ -119,9 +80,11 @@ public:
 
 };
 
-class DhtTrackerList : public std::unordered_map<HashString, DhtTracker*, hashstring_hash> {
+class DhtTrackerList : public std::unordered_map<HashString, DhtTracker*, hash_string_hash, std::equal_to<HashString>,
+                                                 dht_map_allocator<HashString, DhtTracker*>> {
 public:
-  using base_type = std::unordered_map<HashString, DhtTracker*, hashstring_hash>;
+  using base_type = std::unordered_map<HashString, DhtTracker*, hash_string_hash, std::equal_to<HashString>,
+                                       dht_map_allocator<HashString, DhtTracker*>>;
 
   template<typename T>
   struct accessor_wrapper : public T {
@@ -0,0 +1,85 @@
+#include "config.h"
+
+#include "dht/dht_message.h"
+
+#include "torrent/object_stream.h"
+
+namespace torrent {
+
+// List of all possible keys we need/support in a DHT message.
+// Unsupported keys we receive are dropped (ignored) while decoding.
+// See torrent/object_static_map.h for how this works.
+template <>
+constexpr DhtMessage::key_list_type DhtMessage::base_type::keys = {
+  { key_a_id,       "a::id*S" },
+  { key_a_infoHash, "a::info_hash*S" },
+  { key_a_port,     "a::port", },
+  { key_a_scrape,   "a::scrape" },
+  { key_a_seed,     "a::seed" },
+  { key_a_target,   "a::target*S" },
+  { key_a_token,    "a::token*S" },
+
+  { key_e_0,        "e[]*" },
+  { key_e_1,        "e[]*" },
+
+  { key_q,          "q*S" },
+
+  { key_r_BFpe,     "r::BFpe*S" },
+  { key_r_BFsd,     "r::BFsd*S" },
+  { key_r_id,       "r::id*S" },
+  { key_r_nodes,    "r::nodes*S" },
+  { key_r_token,    "r::token*S" },
+  { key_r_values,   "r::values*L" },
+
+  { key_t,          "t*S" },
+  { key_v,          "v*" },
+  { key_y,          "y*S" },
+};
+
+template <>
+constexpr DhtMessage::key_hash_type DhtMessage::base_type::key_hash = static_map_make_hash<DhtMessage::base_type>();
+
+bool
+dht_message_read(const char* first, const char* last, DhtMessage& message, int& type, const HashString*& node_id) {
+  try {
+    static_map_read_bencode(first, last, message);
+  } catch (bencode_error& e) {
+    return false;
+  }
+
+  if (!message[key_t].is_raw_string())
+    throw dht_error(dht_error_protocol, "No transaction ID");
+
+  // Restrict the length of Transaction IDs. We echo them in our replies.
+  if (message[key_t].as_raw_string().size() > 20)
+    throw dht_error(dht_error_protocol, "Transaction ID length too long");
+
+  if (!message[key_y].is_raw_string())
+    throw dht_error(dht_error_protocol, "No message type");
+
+  if (message[key_y].as_raw_string().size() != 1)
+    throw dht_error(dht_error_bad_method, "Unsupported message type");
+
+  type = message[key_y].as_raw_string().data()[0];
+
+  // Queries and replies have node ID in different dictionaries.
+  if (type == 'r' || type == 'q') {
+    if (!message[type == 'q' ? key_a_id : key_r_id].is_raw_string())
+      throw dht_error(dht_error_protocol, "Invalid `id' value");
+
+    raw_string nodeIdStr = message[type == 'q' ? key_a_id : key_r_id].as_raw_string();
+
+    if (nodeIdStr.size() < HashString::size_data)
+      throw dht_error(dht_error_protocol, "`id' value too short");
+
+    node_id = HashString::cast_from(nodeIdStr.data());
+  }
+
+  // Sanity check the returned transaction ID.
+  if ((type == 'r' || type == 'e') && message[key_t].as_raw_string().size() != 1)
+    throw dht_error(dht_error_protocol, "Invalid transaction ID type/length.");
+
+  return true;
+}
+
+}
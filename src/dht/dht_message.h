@@ -0,0 +1,88 @@
+#ifndef LIBTORRENT_DHT_MESSAGE_H
+#define LIBTORRENT_DHT_MESSAGE_H
+
+#include "torrent/exceptions.h"
+#include "torrent/hash_string.h"
+#include "torrent/object_static_map.h"
+
+namespace torrent {
+
+// Possible bencode keys in a DHT message.
+enum dht_keys {
+  key_a_id,
+  key_a_infoHash,
+  key_a_port,
+  key_a_scrape,
+  key_a_seed,
+  key_a_target,
+  key_a_token,
+
+  key_e_0,
+  key_e_1,
+
+  key_q,
+
+  key_r_BFpe,
+  key_r_BFsd,
+  key_r_id,
+  key_r_nodes,
+  key_r_token,
+  key_r_values,
+
+  key_t,
+  key_v,
+  key_y,
+
+  key_LAST,
+};
+
+class DhtMessage : public static_map_type<dht_keys, key_LAST> {
+public:
+  using base_type = static_map_type<dht_keys, key_LAST>;
+
+  DhtMessage() : data_end(data) {};
+
+  // Must be big enough to hold one of the possible variable-sized reply data.
+  // Currently either:
+  // - error message (size doesn't really matter, it'll be truncated at worst)
+  // - announce token (8 bytes, needs 20 bytes buffer to build)
+  // Never more than one of the above.
+  // And additionally for queries we send:
+  // - transaction ID (3 bytes)
+  static constexpr size_t data_size = 64;
+  char data[data_size];
+  char* data_end;
+};
+
+// DHT error codes.
+constexpr int dht_error_generic    = 201;
+constexpr int dht_error_server     = 202;
+constexpr int dht_error_protocol   = 203;
+constexpr int dht_error_bad_method = 204;
+
+// Error in DHT protocol, avoids std::string ctor from communication_error
+class dht_error : public network_error {
+public:
+  dht_error(int code, const char* message) : m_message(message), m_code(code) {}
+
+  virtual int          code() const throw()   { return m_code; }
+  virtual const char*  what() const throw()   { return m_message; }
+
+private:
+  const char*  m_message;
+  int          m_code;
+};
+
+// Decodes a KRPC message in a single pass without allocating, the
+// strings in 'message' and 'node_id' point into the buffer. Returns
+// false if the data is not a bencode dictionary, which should be
+// dropped without a reply to prevent bounce loops.
+//
+// Throws dht_error if the message is not valid KRPC, with 'type' and
+// 'node_id' set when known so the sender can be blamed. Other
+// bencode errors are thrown as bencode_error.
+bool dht_message_read(const char* first, const char* last, DhtMessage& message, int& type, const HashString*& node_id);
+
+}
+
+#endif
@@ -38,10 +38,12 @@
 #include "globals.h"
 
 #include "torrent/exceptions.h"
+#include "torrent/memory_manager.h"
 #include "torrent/object.h"
 #include "torrent/utils/log.h"
 
 #include "net/address_list.h" // For SA.
+#include "utils/object_pool.h"
 
 #include "dht_node.h"
 
@@ -64,6 +66,17 @@ DhtNode::DhtNode(const HashString& id, const rak::socket_address* sa) :
   //   throw resource_error("Address not af_inet or in6addr_any");
 }
 
+DhtNode::DhtNode(const HashString& id, const rak::socket_address* sa, unsigned int last_seen, unsigned int rtt) :
+  HashString(id),
+  m_socketAddress(*sa),
+  m_lastSeen(last_seen) {
+
+  LT_LOG_THIS("restoring (address:%s)", sa->pretty_address_str().c_str());
+
+  set_rtt(rtt);
+  update();
+}
+
 DhtNode::DhtNode(const std::string& id, const Object& cache) :
     HashString(*HashString::cast_from(id.c_str())),
     m_lastSeen(cache.get_key_value("t")) {
@@ -80,6 +93,19 @@ DhtNode::DhtNode(const std::string& id, const Object& cache) :
   update();
 }
 
+void*
+DhtNode::operator new(size_t size) {
+  void* ptr = object_pool<DhtNode>::allocate(size);
+  MemoryManager::inc_usage(MemoryManager::category_dht, size);
+  return ptr;
+}
+
+void
+DhtNode::operator delete(void* ptr, size_t size) noexcept {
+  MemoryManager::dec_usage(MemoryManager::category_dht, size);
+  object_pool<DhtNode>::deallocate(ptr, size);
+}
+
 char*
 DhtNode::store_compact(char* buffer) const {
   HashString::cast_from(buffer)->assign(data());
@@ -39,6 +39,7 @@
 
 #include "globals.h"
 
+#include <algorithm>
 #include <rak/socket_address.h>
 
 #include "torrent/hash_string.h"
@@ -58,11 +59,15 @@ public:
   static constexpr unsigned int max_failed_replies = 5;
 
   DhtNode(const HashString& id, const rak::socket_address* sa);
+  DhtNode(const HashString& id, const rak::socket_address* sa, unsigned int last_seen, unsigned int rtt);
   DhtNode(const std::string& id, const Object& cache);
   ~DhtNode() = default;
   DhtNode(const DhtNode&) = delete;
   DhtNode& operator=(const DhtNode&) = delete;
 
+  static void*                operator new(size_t size);
+  static void                 operator delete(void* ptr, size_t size) noexcept;
+
   const HashString&           id() const                 { return *this; }
   raw_string                  id_raw_string() const      { return raw_string(data(), size_data); }
   const rak::socket_address*  address() const            { return &m_socketAddress; }
@@ -76,6 +81,10 @@ public:
   bool                        is_bad() const             { return m_recentlyInactive >= max_failed_replies; };
   bool                        is_active() const          { return m_lastSeen; }
 
+  // Round trip time of the last reply in milliseconds, zero if unknown.
+  unsigned int                rtt() const                { return m_rtt; }
+  void                        set_rtt(unsigned int ms)   { m_rtt = std::min(ms, 0xffffu); }
+
   // Update is called once every 15 minutes.
   void                        update()                   { m_recentlyActive = age() < 15 * 60; }
                                                          
@@ -89,6 +98,10 @@ public:
 
   bool                        is_in_range(const DhtBucket* b) { return b->is_in_range(*this); }
 
+  // Record index in the routing table snapshot, if any.
+  uint32_t                    snapshot_slot() const      { return m_snapshotSlot; }
+  void                        set_snapshot_slot(uint32_t slot) { m_snapshotSlot = slot; }
+
   // Store compact node information (26 bytes address, port and ID) in the given
   // buffer and return pointer to end of stored information.
   char*                       store_compact(char* buffer) const;
@@ -104,6 +117,8 @@ private:
   unsigned int        m_lastSeen;
   bool                m_recentlyActive{};
   unsigned int        m_recentlyInactive{};
+  uint16_t            m_rtt{};
+  uint32_t            m_snapshotSlot{~uint32_t()};
   DhtBucket*          m_bucket{};
 };
 
@@ -0,0 +1,85 @@
+#include "config.h"
+
+#include "dht/dht_quota.h"
+
+#include <algorithm>
+
+#include "torrent/utils/random.h"
+
+namespace torrent {
+
+static_assert(DhtQuota::width == 2048, "DhtQuota::indices assumes 11-bit row indices.");
+
+DhtQuota::DhtQuota() :
+  m_key((uint64_t{random_uniform_uint32()} << 32) | random_uniform_uint32(),
+        (uint64_t{random_uniform_uint32()} << 32) | random_uniform_uint32()) {
+}
+
+// One hash provides the index into every row.
+void
+DhtQuota::indices(uint32_t address, unsigned int* result) const {
+  uint64_t hash = m_key.hash(&address, sizeof(address));
+
+  for (unsigned int i = 0; i != depth; i++, hash >>= 11)
+    result[i] = hash & (width - 1);
+}
+
+void
+DhtQuota::decay(uint32_t now) {
+  if (now - m_windowStart < window)
+    return;
+
+  // Halve once per elapsed window, long idle periods clear the sketch.
+  unsigned int shift = std::min<uint32_t>((now - m_windowStart) / window, 16);
+
+  for (auto& row : m_rows)
+    for (auto& counter : row)
+      counter >>= shift;
+
+  m_windowStart = now;
+}
+
+// Conservative update: only the counters equal to the current minimum
+// are incremented, which keeps the overestimate from collisions low.
+DhtQuota::admission_type
+DhtQuota::insert(uint32_t address, uint32_t now) {
+  decay(now);
+
+  unsigned int idx[depth];
+  indices(address, idx);
+
+  unsigned int count = 0xffff;
+
+  for (unsigned int i = 0; i != depth; i++)
+    count = std::min<unsigned int>(count, m_rows[i][idx[i]]);
+
+  if (count >= hard_limit)
+    return drop;
+
+  for (unsigned int i = 0; i != depth; i++)
+    if (m_rows[i][idx[i]] == count)
+      m_rows[i][idx[i]] = count + 1;
+
+  return count >= soft_limit ? admit_quiet : admit;
+}
+
+unsigned int
+DhtQuota::estimate(uint32_t address) const {
+  unsigned int idx[depth];
+  indices(address, idx);
+
+  unsigned int count = 0xffff;
+
+  for (unsigned int i = 0; i != depth; i++)
+    count = std::min<unsigned int>(count, m_rows[i][idx[i]]);
+
+  return count;
+}
+
+void
+DhtQuota::clear() {
+  for (auto& row : m_rows)
+    row.fill(0);
+}
+
+}
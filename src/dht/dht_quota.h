@@ -0,0 +1,65 @@
+#ifndef LIBTORRENT_DHT_QUOTA_H
+#define LIBTORRENT_DHT_QUOTA_H
+
+#include <array>
+#include <cstdint>
+
+#include "utils/siphash.h"
+
+namespace torrent {
+
+// Per-source packet counters for admission control of incoming DHT
+// packets, kept in a count-min sketch so that memory use is fixed no
+// matter how many addresses contact us. Counters are halved every
+// window, so a source sending a steady 'rate' packets per second
+// settles around 2 * rate * window.
+//
+// The sketch is keyed with a random SipHash key so that remote hosts
+// cannot pick addresses that collide with a victim's counters.
+
+class DhtQuota {
+public:
+  static constexpr unsigned int depth  = 4;
+  static constexpr unsigned int width  = 2048;
+  static constexpr unsigned int window = 10;
+
+  // Sources over the soft limit get no error replies, sources over
+  // the hard limit are dropped before parsing. In packets per second.
+  static constexpr unsigned int soft_rate = 10;
+  static constexpr unsigned int hard_rate = 20;
+
+  static constexpr unsigned int soft_limit = 2 * soft_rate * window;
+  static constexpr unsigned int hard_limit = 2 * hard_rate * window;
+
+  enum admission_type {
+    admit,
+    admit_quiet,
+    drop
+  };
+
+  DhtQuota();
+
+  // Count a packet from the address, network byte order, and decide
+  // whether to process it. Time is in seconds.
+  admission_type      insert(uint32_t address, uint32_t now);
+
+  // Current estimate of the counter, never below the actual count.
+  unsigned int        estimate(uint32_t address) const;
+
+  void                clear();
+
+private:
+  using row_type = std::array<uint16_t, width>;
+
+  void                decay(uint32_t now);
+  void                indices(uint32_t address, unsigned int* result) const;
+
+  SipHash             m_key;
+  uint32_t            m_windowStart{};
+
+  std::array<row_type, depth> m_rows{};
+};
+
+}
+
+#endif
@@ -2,6 +2,8 @@
 
 #include "dht_router.h"
 
+#include <algorithm>
+#include <cstring>
 #include <sstream>
 
 #include "dht_bucket.h"
@@ -16,6 +18,8 @@
 #include "torrent/net/socket_address.h"
 #include "torrent/tracker/dht_controller.h"
 #include "torrent/utils/log.h"
+#include "torrent/utils/random.h"
+#include "torrent/utils/startup_profile.h"
 #include "torrent/utils/thread.h"
 #include "utils/sha1.h"
 
@@ -29,8 +33,8 @@ HashString DhtRouter::zero_id;
 DhtRouter::DhtRouter(const Object& cache, const rak::socket_address* sa) :
   DhtNode(zero_id, sa),  // actual ID is set later
   m_server(this),
-  m_curToken(random()),
-  m_prevToken(random()) {
+  m_curToken(random_token_key()),
+  m_prevToken(random_token_key()) {
 
   HashString ones_id;
 
@@ -61,6 +65,7 @@ DhtRouter::DhtRouter(const Object& cache, const rak::socket_address* sa) :
 
   set_bucket(new DhtBucket(zero_id, ones_id));
   m_routingTable.emplace(bucket()->id_range_end(), bucket());
+  m_bucketIndex[0] = bucket();
 
   if (cache.has_key("nodes")) {
     const Object::map_type& nodes = cache.get_key_map("nodes");
@@ -110,9 +115,13 @@ DhtRouter::start(int port) {
 
   m_server.start(port);
 
+  if (m_nodes.size() < num_bootstrap_complete)
+    utils::startup_begin(std::string(), utils::startup_dht_bootstrap);
+
   // Set timeout slot and schedule it to be called immediately for initial bootstrapping if
   // necessary.
   m_task_timeout.slot() = [this] { receive_timeout_bootstrap(); };
+  m_task_announce.slot() = [this] { start_announces(); };
 
   this_thread::scheduler()->wait_for_ceil_seconds(&m_task_timeout, 1s);
 }
@@ -121,23 +130,122 @@ void
 DhtRouter::stop() {
   this_thread::resolver()->cancel(this);
   this_thread::scheduler()->erase(&m_task_timeout);
+  this_thread::scheduler()->erase(&m_task_announce);
 
   m_server.stop();
+  m_snapshot.sync();
+
+  std::deque<announce_type> queue;
+  queue.swap(m_announceQueue);
+
+  for (auto& entry : queue)
+    entry.tracker->receive_failed("DHT server not active.");
+
+  m_closestNodes.clear();
 }
 
-// Start a DHT get_peers and announce_peer request.
+// Queue a DHT get_peers and announce_peer request.
 void
 DhtRouter::announce(const HashString& info_hash, TrackerDht* tracker) {
-  m_server.announce(*find_bucket(info_hash)->second, info_hash, tracker);
+  m_announceQueue.push_back(announce_type{info_hash, tracker});
+
+  start_announces();
 }
 
 // Cancel any running requests from the given tracker.
 // If info or tracker is not NULL, only cancel matching requests.
 void
 DhtRouter::cancel_announce(const HashString* info_hash, const TrackerDht* tracker) {
+  std::vector<TrackerDht*> cancelled;
+
+  auto last = std::remove_if(m_announceQueue.begin(), m_announceQueue.end(), [&](const announce_type& entry) {
+      if ((info_hash != nullptr && entry.info_hash != *info_hash) || (tracker != nullptr && entry.tracker != tracker))
+        return false;
+
+      cancelled.push_back(entry.tracker);
+      return true;
+    });
+
+  m_announceQueue.erase(last, m_announceQueue.end());
+
+  // The trackers are notified after the queue is consistent, as they
+  // may announce again.
+  for (auto queued : cancelled)
+    queued->receive_failed("DHT announce cancelled.");
+
   m_server.cancel_announce(info_hash, tracker);
 }
 
+// Start queued announces until this second's budget is used up, and
+// retry the rest on the next second.
+void
+DhtRouter::start_announces() {
+  if (m_announceTime != cachedTime.seconds()) {
+    m_announceTime = cachedTime.seconds();
+    m_announceCount = 0;
+  }
+
+  while (!m_announceQueue.empty() && m_announceCount < announces_per_second) {
+    announce_type entry = m_announceQueue.front();
+    m_announceQueue.pop_front();
+    m_announceCount++;
+
+    m_server.announce(*find_bucket(entry.info_hash), entry.info_hash, entry.tracker);
+  }
+
+  if (!m_announceQueue.empty() && !m_task_announce.is_scheduled())
+    this_thread::scheduler()->wait_for_ceil_seconds(&m_task_announce, 1s);
+}
+
+void
+DhtRouter::store_closest_nodes(const HashString& id, const std::vector<DhtNode*>& nodes) {
+  closest_nodes_type entry{cachedTime.seconds(), {}};
+
+  for (auto node : nodes) {
+    if (!node->is_good())
+      continue;
+
+    entry.nodes.emplace_back(node->id(), *node->address());
+
+    if (entry.nodes.size() == DhtBucket::num_nodes)
+      break;
+  }
+
+  if (entry.nodes.empty())
+    return;
+
+  m_closestNodes[id] = std::move(entry);
+
+  if (m_closestNodes.size() <= max_closest_nodes)
+    return;
+
+  auto oldest = std::min_element(m_closestNodes.begin(), m_closestNodes.end(), [](const auto& a, const auto& b) {
+      return a.second.time < b.second.time;
+    });
+
+  m_closestNodes.erase(oldest);
+}
+
+// The stored target with the longest common prefix is always one of
+// the two neighbours of the ID in sorted order.
+const DhtRouter::closest_node_list*
+DhtRouter::find_closest_nodes(const HashString& id) {
+  auto next = m_closestNodes.lower_bound(id);
+  auto best = next;
+
+  if (next != m_closestNodes.begin()) {
+    auto prev = std::prev(next);
+
+    if (next == m_closestNodes.end() || DhtSearch::is_closer(prev->first, next->first, id))
+      best = prev;
+  }
+
+  if (best == m_closestNodes.end() || best->second.time + static_cast<int32_t>(timeout_closest_nodes) < cachedTime.seconds())
+    return NULL;
+
+  return &best->second.nodes;
+}
+
 DhtTracker*
 DhtRouter::get_tracker(const HashString& hash, bool create) {
   DhtTrackerList::accessor itr = m_trackers.find(hash);
@@ -165,7 +273,7 @@ DhtRouter::want_node(const HashString& id) {
 
   // We are always interested in more nodes for our own bucket (causing it
   // to be split if full); in other buckets only if there's space.
-  DhtBucket* b = find_bucket(id)->second;
+  DhtBucket* b = find_bucket(id);
   return b == bucket() || b->has_space();
 }
 
@@ -183,19 +291,16 @@ DhtRouter::get_node(const HashString& id) {
   return itr.node();
 }
 
-DhtRouter::DhtBucketList::iterator
+DhtBucket*
 DhtRouter::find_bucket(const HashString& id) {
-  auto itr = m_routingTable.lower_bound(id);
+  DhtBucket* b = m_bucketIndex[std::min(hash_string_common_prefix(id, this->id()), m_bucketDepth)];
 
 #ifdef USE_EXTRA_DEBUG
-  if (itr == m_routingTable.end())
-    throw internal_error("DHT Buckets not covering entire ID space.");
-
-  if (!itr->second->is_in_range(id))
-    throw internal_error("DhtRouter::find_bucket, m_routingTable.lower_bound did not find correct bucket.");
+  if (!b->is_in_range(id))
+    throw internal_error("DhtRouter::find_bucket, bucket index did not find correct bucket.");
 #endif
 
-  return itr;
+  return b;
 }
 
 void
@@ -245,6 +350,8 @@ DhtRouter::node_queried(const HashString& id, const rak::socket_address* sa) {
   if (node->is_good())
     node->bucket()->touch();
 
+  m_snapshot.update(node);
+
   return node;
 }
 
@@ -252,7 +359,7 @@ DhtRouter::node_queried(const HashString& id, const rak::socket_address* sa) {
 // Check that it matches the information we have, set that it has replied
 // and update the bucket mtime.
 DhtNode*
-DhtRouter::node_replied(const HashString& id, const rak::socket_address* sa) {
+DhtRouter::node_replied(const HashString& id, const rak::socket_address* sa, unsigned int rtt) {
   DhtNode* node = get_node(id);
 
   if (node == NULL) {
@@ -264,6 +371,9 @@ DhtRouter::node_replied(const HashString& id, const rak::socket_address* sa) {
 
     if (!add_node_to_bucket(node))   // deletes the node if it fails
       return NULL;
+
+    if (m_numRefresh < 2 && m_nodes.size() == num_bootstrap_complete)
+      utils::startup_end(std::string(), utils::startup_dht_bootstrap);
   }
 
   if (node->address()->sa_inet()->address_n() != sa->sa_inet()->address_n())
@@ -272,6 +382,11 @@ DhtRouter::node_replied(const HashString& id, const rak::socket_address* sa) {
   node->replied();
   node->bucket()->touch();
 
+  if (rtt != 0)
+    node->set_rtt(rtt);
+
+  m_snapshot.update(node);
+
   return node;
 }
 
@@ -341,6 +456,41 @@ DhtRouter::store_cache(Object* container) const {
   return container;
 }
 
+bool
+DhtRouter::open_snapshot(const std::string& path) {
+  for (auto& node : m_nodes)
+    node.second->set_snapshot_slot(DhtSnapshot::invalid_slot);
+
+  DhtSnapshot::record_list records;
+
+  if (!m_snapshot.open(path, &records))
+    return false;
+
+  for (auto& node : m_nodes)
+    if (node.second->bucket() != NULL)
+      m_snapshot.update(node.second);
+
+  // Most recently seen nodes first, so they win any contested bucket.
+  std::sort(records.begin(), records.end(), [](auto& a, auto& b) { return a.last_seen > b.last_seen; });
+
+  for (const auto& record : records) {
+    const HashString* id = HashString::cast_from(record.id);
+
+    if (get_node(*id) != NULL || !want_node(*id))
+      continue;
+
+    rak::socket_address sa;
+    sa.sa_inet()->clear();
+    sa.sa_inet()->set_address_n(record.address);
+    sa.sa_inet()->set_port_n(record.port);
+
+    add_node_to_bucket(m_nodes.add_node(new DhtNode(*id, &sa, record.last_seen, record.rtt)));
+  }
+
+  LT_LOG_THIS("opened snapshot (path:%s restored:%zu nodes:%zu)", path.c_str(), records.size(), m_nodes.size());
+  return true;
+}
+
 tracker::DhtController::statistics_type
 DhtRouter::get_statistics() const {
   tracker::DhtController::statistics_type stats(*m_server.upload_throttle_node()->rate(), *m_server.download_throttle_node()->rate());
@@ -358,6 +508,14 @@ DhtRouter::get_statistics() const {
   stats.errors_received  = m_server.errors_received();
   stats.errors_caught    = m_server.errors_caught();
 
+  stats.dropped_quota     = m_server.dropped_quota();
+  stats.dropped_malformed = m_server.dropped_malformed();
+  stats.errors_suppressed = m_server.errors_suppressed();
+
+  stats.searches_completed = m_server.searches_completed();
+  stats.search_latency     = m_server.search_latency();
+  stats.announces_queued   = m_announceQueue.size();
+
   stats.num_nodes        = m_nodes.size();
   stats.num_buckets      = m_routingTable.size();
 
@@ -416,7 +574,7 @@ DhtRouter::receive_timeout() {
   this_thread::scheduler()->wait_for_ceil_seconds(&m_task_timeout, std::chrono::seconds(timeout_update));
 
   m_prevToken = m_curToken;
-  m_curToken = random();
+  m_curToken = random_token_key();
 
   // Do some periodic accounting, refreshing buckets and marking
   // bad nodes.
@@ -458,20 +616,34 @@ DhtRouter::receive_timeout() {
     }
   }
 
+  // Forget closest nodes that are too old to be a useful starting point.
+  for (auto itr = m_closestNodes.begin(); itr != m_closestNodes.end(); ) {
+    if (itr->second.time + static_cast<int32_t>(timeout_closest_nodes) < cachedTime.seconds())
+      itr = m_closestNodes.erase(itr);
+    else
+      ++itr;
+  }
+
   m_server.update();
 
   m_numRefresh++;
 }
 
+SipHash
+DhtRouter::random_token_key() {
+  return SipHash((uint64_t{random_uniform_uint32()} << 32) | random_uniform_uint32(),
+                 (uint64_t{random_uniform_uint32()} << 32) | random_uniform_uint32());
+}
+
+// Tokens are a keyed hash of the address, which unlike SHA1 needs no
+// per-query context setup.
 char*
-DhtRouter::generate_token(const rak::socket_address* sa, int token, char buffer[20]) {
-  Sha1 sha;
-  uint32_t key = sa->sa_inet()->address_n();
+DhtRouter::generate_token(const rak::socket_address* sa, const SipHash& key, char buffer[size_token]) {
+  uint32_t address = sa->sa_inet()->address_n();
+  uint64_t token = key.hash(&address, sizeof(address));
 
-  sha.init();
-  sha.update(&token, sizeof(token));
-  sha.update(&key, 4);
-  sha.final_c(buffer);
+  static_assert(sizeof(token) == size_token, "DhtRouter::generate_token size mismatch.");
+  std::memcpy(buffer, &token, size_token);
 
   return buffer;
 }
@@ -482,7 +654,7 @@ DhtRouter::token_valid(raw_string token, const rak::socket_address* sa) {
     return false;
 
   // Compare given token to the reference token.
-  char reference[20];
+  char reference[size_token];
 
   // First try current token.
   //
@@ -502,11 +674,11 @@ DhtRouter::find_node(const rak::socket_address* sa) {
   return NULL;
 }
 
-DhtRouter::DhtBucketList::iterator
-DhtRouter::split_bucket(const DhtBucketList::iterator& itr, DhtNode* node) {
+DhtBucket*
+DhtRouter::split_bucket(DhtBucket* target, DhtNode* node) {
   // Split bucket. Current bucket keeps the upper half thus keeping the
   // map key valid, new bucket is the lower half of the original bucket.
-  DhtBucket* newBucket = itr->second->split(id());
+  DhtBucket* other = target->split(id());
 
   // If our bucket has a child now (the new bucket), move ourself into it.
   if (bucket()->child() != NULL)
@@ -515,32 +687,38 @@ DhtRouter::split_bucket(const DhtBucketList::iterator& itr, DhtNode* node) {
   if (!bucket()->is_in_range(id()))
     throw internal_error("DhtRouter::split_bucket router ID ended up in wrong bucket.");
 
-  // Insert new bucket with iterator hint = just before current bucket.
-  auto other = m_routingTable.emplace_hint(itr, newBucket->id_range_end(), newBucket);
+  m_routingTable.emplace(other->id_range_end(), other);
 
-  // Check that the bucket we're not adding the node to isn't empty.
-  if (other->second->is_in_range(node->id())) {
-    if (itr->second->empty())
-      bootstrap_bucket(itr->second);
+  // Only our own bucket is split, the half without our ID takes its
+  // place in the index and ours moves one level deeper.
+  if (m_bucketDepth + 1 >= m_bucketIndex.size())
+    throw internal_error("DhtRouter::split_bucket bucket index overflow.");
 
-  } else {
-    if (other->second->empty())
-      bootstrap_bucket(other->second);
+  m_bucketIndex[m_bucketDepth] = bucket() == other ? target : other;
+  m_bucketIndex[++m_bucketDepth] = bucket();
 
-    other = itr;
+  // Check that the bucket we're not adding the node to isn't empty.
+  if (other->is_in_range(node->id())) {
+    if (target->empty())
+      bootstrap_bucket(target);
+
+    return other;
   }
 
-  return other;
+  if (other->empty())
+    bootstrap_bucket(other);
+
+  return target;
 }
 
 bool
 DhtRouter::add_node_to_bucket(DhtNode* node) {
-  auto itr = find_bucket(node->id());
+  DhtBucket* target = find_bucket(node->id());
 
-  while (itr->second->is_full()) {
+  while (target->is_full()) {
     // Bucket is full. If there are any bad nodes, remove the oldest.
-    DhtBucket::iterator nodeItr = itr->second->find_replacement_candidate();
-    if (nodeItr == itr->second->end())
+    DhtBucket::iterator nodeItr = target->find_replacement_candidate();
+    if (nodeItr == target->end())
       throw internal_error("DhtBucket::find_candidate returned no node.");
 
     if ((*nodeItr)->is_bad()) {
@@ -549,17 +727,19 @@ DhtRouter::add_node_to_bucket(DhtNode* node) {
     } else {
       // Bucket is full of good nodes; if our own ID falls in
       // range then split the bucket else discard new node.
-      if (itr->second != bucket()) {
+      if (target != bucket()) {
         delete_node(m_nodes.find(&node->id()));
         return false;
       }
 
-      itr = split_bucket(itr, node);
+      target = split_bucket(target, node);
     }
   }
 
-  itr->second->add_node(node);
-  node->set_bucket(itr->second);
+  target->add_node(node);
+  node->set_bucket(target);
+
+  m_snapshot.update(node);
   return true;
 }
 
@@ -571,6 +751,8 @@ DhtRouter::delete_node(const DhtNodeList::accessor& itr) {
   if (itr.node()->bucket() != NULL)
     itr.node()->bucket()->remove_node(itr.node());
 
+  m_snapshot.erase(itr.node());
+
   delete itr.node();
 
   m_nodes.erase(itr);
@@ -581,8 +763,8 @@ DhtRouter::bootstrap() {
   // Contact up to 8 nodes from the contact list (newest first).
   for (int count = 0; count < 8 && !m_contacts->empty(); count++) {
     // Currently discarding SOCK_DGRAM.
-    this_thread::resolver()->resolve_specific(this, m_contacts->back().first.c_str(), rak::socket_address::pf_inet, [this](auto sa, int) {
-      if (sa != nullptr)
+    this_thread::resolver()->resolve_specific(this, m_contacts->back().first.c_str(), rak::socket_address::pf_inet, [this](const sa_inet_storage& sa, int) {
+      if (!sa.empty())
         contact(sa.get(), m_contacts->back().second);
     });
 
@@ -1,15 +1,22 @@
 #ifndef LIBTORRENT_DHT_ROUTER_H
 #define LIBTORRENT_DHT_ROUTER_H
 
+#include <array>
+#include <deque>
+#include <map>
+#include <vector>
+
 #include "dht/dht_node.h"
 #include "dht/dht_hash_map.h"
 #include "dht/dht_server.h"
+#include "dht/dht_snapshot.h"
 #include "rak/socket_address.h"
 #include "torrent/hash_string.h"
 #include "torrent/object.h"
 #include "torrent/net/types.h"
 #include "torrent/tracker/dht_controller.h"
 #include "torrent/utils/scheduler.h"
+#include "utils/siphash.h"
 
 namespace torrent {
 
@@ -30,6 +37,15 @@ public:
   static constexpr unsigned int timeout_bucket_bootstrap =     15 * 60;  // Bootstrap idle buckets after 15 minutes.
   static constexpr unsigned int timeout_remove_node      = 4 * 60 * 60;  // Remove unresponsive nodes after 4 hours.
   static constexpr unsigned int timeout_peer_announce    =     30 * 60;  // Remove peers which haven't reannounced for 30 minutes.
+  static constexpr unsigned int timeout_closest_nodes    =     10 * 60;  // Reuse closest nodes found by searches for 10 minutes.
+
+  // Announces are queued and at most this many started each second,
+  // spreading the searches of many torrents over time.
+  static constexpr unsigned int announces_per_second = 16;
+
+  // Number of recent search results kept as starting points for
+  // searches with nearby targets.
+  static constexpr unsigned int max_closest_nodes = 512;
 
   // A node ID of all zero.
   static HashString zero_id;
@@ -68,17 +84,29 @@ public:
   // Whenever a node queries us, replies, or is confirmed inactive (no reply) or
   // invalid (reply with wrong ID), we need to update its status.
   DhtNode*            node_queried(const HashString& id, const rak::socket_address* sa);
-  DhtNode*            node_replied(const HashString& id, const rak::socket_address* sa);
+  DhtNode*            node_replied(const HashString& id, const rak::socket_address* sa, unsigned int rtt = 0);
   DhtNode*            node_inactive(const HashString& id, const rak::socket_address* sa);
   void                node_invalid(const HashString& id);
 
   // Store compact node information (26 bytes) for nodes closest to the
   // given ID in the given buffer, return new buffer end.
-  raw_string          get_closest_nodes(const HashString& id)  { return find_bucket(id)->second->full_bucket(); }
+  raw_string          get_closest_nodes(const HashString& id)  { return find_bucket(id)->full_bucket(); }
+
+  // Remember the good nodes closest to a search target, and return the
+  // recent result whose target shares the longest prefix with the
+  // given ID, or NULL if none.
+  using closest_node_list = std::vector<std::pair<HashString, rak::socket_address>>;
+
+  void                       store_closest_nodes(const HashString& id, const std::vector<DhtNode*>& nodes);
+  const closest_node_list*   find_closest_nodes(const HashString& id);
 
   // Store DHT cache in the given container.
   Object*             store_cache(Object* container) const;
 
+  // Keep the routing table in a memory-mapped snapshot file, adding
+  // any nodes it holds from the previous session.
+  bool                open_snapshot(const std::string& path);
+
   // Create and verify a token. Tokens are valid between 15-30 minutes from creation.
   raw_string          make_token(const rak::socket_address* sa, char* buffer);
   bool                token_valid(raw_string token, const rak::socket_address* sa);
@@ -101,14 +129,16 @@ private:
 
   using DhtBucketList = std::map<const HashString, DhtBucket*>;
 
-  DhtBucketList::iterator find_bucket(const HashString& id);
+  // Buckets are only ever split along our own ID, so the bucket of an
+  // ID is determined by the length of the prefix it shares with ours.
+  using DhtBucketIndex = std::array<DhtBucket*, HashString::size_data * 8 + 1>;
+
+  DhtBucket*          find_bucket(const HashString& id);
 
   bool                add_node_to_bucket(DhtNode* node);
   void                delete_node(const DhtNodeList::accessor& itr);
 
-  void                store_closest_nodes(const HashString& id, DhtBucket* bucket);
-
-  DhtBucketList::iterator split_bucket(const DhtBucketList::iterator& itr, DhtNode* node);
+  DhtBucket*          split_bucket(DhtBucket* target, DhtNode* node);
 
   void                bootstrap();
   void                bootstrap_bucket(const DhtBucket* bucket);
@@ -116,14 +146,41 @@ private:
   void                receive_timeout();
   void                receive_timeout_bootstrap();
 
-  // buffer needs to hold an SHA1 hash (20 bytes), not just the token (8 bytes)
-  char*               generate_token(const rak::socket_address* sa, int token, char buffer[20]);
+  void                start_announces();
+
+  static SipHash      random_token_key();
+  char*               generate_token(const rak::socket_address* sa, const SipHash& key, char buffer[size_token]);
+
+  struct announce_type {
+    HashString        info_hash;
+    TrackerDht*       tracker;
+  };
+
+  struct closest_nodes_type {
+    int32_t           time;
+    closest_node_list nodes;
+  };
+
+  using ClosestNodesMap = std::map<HashString, closest_nodes_type>;
 
   utils::SchedulerEntry m_task_timeout;
+  utils::SchedulerEntry m_task_announce;
+
+  std::deque<announce_type> m_announceQueue;
+  int32_t             m_announceTime{0};
+  unsigned int        m_announceCount{0};
+
+  ClosestNodesMap     m_closestNodes;
 
   DhtServer           m_server{nullptr};
+  DhtSnapshot         m_snapshot;
   DhtNodeList         m_nodes;
   DhtBucketList       m_routingTable;
+
+  // Entry N is the bucket of IDs sharing exactly N leading bits with
+  // ours for N below the depth, the entry at the depth is our bucket.
+  DhtBucketIndex      m_bucketIndex{};
+  unsigned int        m_bucketDepth{0};
   DhtTrackerList      m_trackers;
 
   std::unique_ptr<std::deque<contact_t>> m_contacts;
@@ -133,8 +190,8 @@ private:
   bool                m_networkUp;
 
   // Secret keys used for generating announce tokens.
-  int                 m_curToken;
-  int                 m_prevToken;
+  SipHash             m_curToken;
+  SipHash             m_prevToken;
 };
 
 inline raw_string
@@ -4,6 +4,8 @@
 
 #include <algorithm>
 #include <cstdio>
+#include <cstring>
+#include <sys/socket.h>
 
 #include "globals.h"
 #include "manager.h"
@@ -11,6 +13,7 @@
 #include "dht/dht_bucket.h"
 #include "dht/dht_router.h"
 #include "dht/dht_transaction.h"
+#include "net/utp_manager.h"
 #include "torrent/exceptions.h"
 #include "torrent/connection_manager.h"
 #include "torrent/download_info.h"
@@ -27,45 +30,6 @@
 
 namespace torrent {
 
-// List of all possible keys we need/support in a DHT message.
-// Unsupported keys we receive are dropped (ignored) while decoding.
-// See torrent/object_static_map.h for how this works.
-template <>
-const DhtMessage::key_list_type DhtMessage::base_type::keys = {
-  { key_a_id,       "a::id*S" },
-  { key_a_infoHash, "a::info_hash*S" },
-  { key_a_port,     "a::port", },
-  { key_a_target,   "a::target*S" },
-  { key_a_token,    "a::token*S" },
-
-  { key_e_0,        "e[]*" },
-  { key_e_1,        "e[]*" },
-
-  { key_q,          "q*S" },
-
-  { key_r_id,       "r::id*S" },
-  { key_r_nodes,    "r::nodes*S" },
-  { key_r_token,    "r::token*S" },
-  { key_r_values,   "r::values*L" },
-
-  { key_t,          "t*S" },
-  { key_v,          "v*" },
-  { key_y,          "y*S" },
-};
-
-// Error in DHT protocol, avoids std::string ctor from communication_error
-class dht_error : public network_error {
-public:
-  dht_error(int code, const char* message) : m_message(message), m_code(code) {}
-
-  virtual int          code() const throw()   { return m_code; }
-  virtual const char*  what() const throw()   { return m_message; }
-
-private:
-  const char*  m_message;
-  int          m_code;
-};
-
 DhtServer::DhtServer(DhtRouter* router) :
     m_router(router),
     m_uploadThrottle(manager->upload_throttle()->throttle_list()),
@@ -123,15 +87,17 @@ DhtServer::start(int port) {
     throw;
   }
 
-  m_uploadNode.set_list_iterator(m_uploadThrottle->end());
+  m_read_buffer.resize(batch_size * max_datagram_size);
+
   m_uploadNode.slot_activate() = [this] { receive_throttle_up_activate(); };
 
-  m_downloadNode.set_list_iterator(m_downloadThrottle->end());
   m_downloadThrottle->insert(&m_downloadNode);
 
   thread_main()->poll()->open(this);
   thread_main()->poll()->insert_read(this);
   thread_main()->poll()->insert_error(this);
+
+  manager->utp_manager()->start(this);
 }
 
 void
@@ -141,6 +107,8 @@ DhtServer::stop() {
 
   LT_LOG_THIS("stopping", 0);
 
+  manager->utp_manager()->stop();
+
   clear_transactions();
 
   this_thread::scheduler()->erase(&m_task_timeout);
@@ -166,6 +134,11 @@ DhtServer::reset_statistics() {
   m_repliesReceived = 0;
   m_errorsReceived = 0;
   m_errorsCaught = 0;
+  m_searchesCompleted = 0;
+  m_searchLatency = 0;
+  m_droppedQuota = 0;
+  m_droppedMalformed = 0;
+  m_errorsSuppressed = 0;
 
   m_uploadNode.rate()->set_total(0);
   m_downloadNode.rate()->set_total(0);
@@ -198,6 +171,12 @@ void
 DhtServer::announce(const DhtBucket& contacts, const HashString& infoHash, TrackerDht* tracker) {
   auto announce = new DhtAnnounce(infoHash, tracker, contacts);
 
+  // Start from the closest nodes a recent search found for a nearby
+  // target, skipping most of the walk through the routing table.
+  if (auto closest = m_router->find_closest_nodes(infoHash))
+    for (const auto& node : *closest)
+      announce->add_contact(node.first, &node.second);
+
   DhtSearch::const_accessor n;
   while ((n = announce->get_contact()) != announce->end())
     add_transaction(new DhtTransactionFindNode(n), packet_prio_high);
@@ -214,7 +193,7 @@ DhtServer::cancel_announce(const HashString* info_hash, const TrackerDht* tracke
   auto itr = m_transactions.begin();
 
   while (itr != m_transactions.end()) {
-    if (itr->second->is_search() && itr->second->as_search()->search()->is_announce()) {
+    if (itr->second->is_search() && !itr->second->as_search()->is_abandoned() && itr->second->as_search()->search()->is_announce()) {
       auto announce = static_cast<DhtAnnounce*>(itr->second->as_search()->search());
 
       if ((info_hash == nullptr || announce->target() == *info_hash) && (tracker == nullptr || announce->tracker() == tracker)) {
@@ -290,8 +269,19 @@ DhtServer::create_get_peers_response(const DhtMessage& req, const rak::socket_ad
 
   DhtTracker* tracker = m_router->get_tracker(*info_hash, false);
 
+  // BEP 33 scrapes are answered with the seed and peer bloom filters
+  // instead of a peer list.
+  if (tracker && !tracker->empty() && req[key_a_scrape].is_value() && req[key_a_scrape].as_value() != 0) {
+    reply[key_r_BFsd] = tracker->bloom_seeds();
+    reply[key_r_BFpe] = tracker->bloom_peers();
+    return;
+  }
+
+  // We only reply over IPv4, so only IPv4 peers are useful.
+  raw_list values = tracker ? tracker->get_peers() : raw_list();
+
   // If we're not tracking or have no peers, send closest nodes.
-  if (!tracker || tracker->empty()) {
+  if (values.empty()) {
     raw_string nodes = m_router->get_closest_nodes(*info_hash);
 
     if (nodes.empty())
@@ -300,7 +290,7 @@ DhtServer::create_get_peers_response(const DhtMessage& req, const rak::socket_ad
     reply[key_r_nodes] = nodes;
 
   } else {
-    reply[key_r_values] = tracker->get_peers();
+    reply[key_r_values] = values;
   }
 }
 
@@ -315,7 +305,9 @@ DhtServer::create_announce_peer_response(const DhtMessage& req, const rak::socke
     throw dht_error(dht_error_protocol, "Token invalid.");
 
   DhtTracker* tracker = m_router->get_tracker(*HashString::cast_from(info_hash.data()), true);
-  tracker->add_peer(sa->sa_inet()->address_n(), req[key_a_port].as_value());
+  bool seed = req[key_a_seed].is_value() && req[key_a_seed].as_value() != 0;
+
+  tracker->add_peer(sa->sa_inet()->address_n(), req[key_a_port].as_value(), seed);
 }
 
 void
@@ -349,7 +341,8 @@ DhtServer::process_response(const HashString& id, const rak::socket_address* sa,
 
     switch (transaction->type()) {
       case DhtTransaction::DHT_FIND_NODE:
-        parse_find_node_reply(transaction->as_find_node(), response[key_r_nodes].as_raw_string());
+        if (!transaction->as_find_node()->is_abandoned())
+          parse_find_node_reply(transaction->as_find_node(), response[key_r_nodes].as_raw_string());
         break;
 
       case DhtTransaction::DHT_GET_PEERS:
@@ -362,7 +355,7 @@ DhtServer::process_response(const HashString& id, const rak::socket_address* sa,
     }
 
     // Mark node responsive only if all processing was successful, without errors.
-    m_router->node_replied(id, sa);
+    m_router->node_replied(id, sa, transaction->rtt());
 
   } catch (std::exception& e) {
     drop_packet(itr->second->packet());
@@ -442,26 +435,45 @@ DhtServer::parse_get_peers_reply(DhtTransactionGetPeers* transaction, const DhtM
 
 void
 DhtServer::find_node_next(DhtTransactionSearch* transaction) {
+  DhtSearch* search = transaction->search();
+
   int priority = packet_prio_low;
-  if (transaction->search()->is_announce())
+  if (search->is_announce())
     priority = packet_prio_high;
 
   DhtSearch::const_accessor node;
-  while ((node = transaction->search()->get_contact()) != transaction->search()->end())
+  while ((node = search->get_contact()) != search->end())
     add_transaction(new DhtTransactionFindNode(node), priority);
 
-  if (!transaction->search()->is_announce())
-    return;
+  // Once the closest nodes have replied, pending queries to nodes further
+  // away can't change the result, so don't wait for them.
+  if (search->is_converged())
+    search->abandon_pending();
+
+  if (search->complete()) {
+    m_searchesCompleted++;
+    m_searchLatency += search->latency();
 
-  auto announce = static_cast<DhtAnnounce*>(transaction->search());
-  if (announce->complete()) {
-    // We have found the 8 closest nodes to the info hash. Retrieve peers
-    // from them and announce to them.
-    for (node = announce->start_announce(); node != announce->end(); ++node)
-      add_transaction(new DhtTransactionGetPeers(node), packet_prio_high);
+    m_router->store_closest_nodes(search->target(), search->nodes());
   }
 
-  announce->update_status();
+  if (search->is_announce()) {
+    auto announce = static_cast<DhtAnnounce*>(search);
+
+    if (announce->complete()) {
+      // We have found the 8 closest nodes to the info hash. Retrieve peers
+      // from them and announce to them.
+      for (auto announce_node : announce->start_announce())
+        add_transaction(new DhtTransactionGetPeers(DhtSearch::const_accessor(announce_node, announce)), packet_prio_high);
+    }
+
+    announce->update_status();
+  }
+
+  // The search is normally deleted along with its last transaction,
+  // which can't happen if this one was abandoned.
+  if (transaction->is_abandoned() && search->complete())
+    delete search;
 }
 
 void
@@ -624,7 +636,7 @@ DhtServer::failed_transaction(transaction_itr itr, bool quick) {
   if (!quick && m_networkUp && transaction->packet() == NULL && transaction->id() != m_router->zero_id)
     m_router->node_inactive(transaction->id(), transaction->address());
 
-  if (transaction->type() == DhtTransaction::DHT_FIND_NODE) {
+  if (transaction->type() == DhtTransaction::DHT_FIND_NODE && !transaction->as_find_node()->is_abandoned()) {
     if (quick)
       transaction->as_find_node()->set_stalled();
     else
@@ -667,122 +679,153 @@ DhtServer::clear_transactions() {
 
 void
 DhtServer::event_read() {
-  uint32_t total = 0;
+  uint32_t            total = 0;
+  rak::socket_address addresses[batch_size];
+
+#ifdef USE_SENDMMSG
+  mmsghdr msgs[batch_size];
+  iovec   iovecs[batch_size];
 
   while (true) {
-    Object request;
-    rak::socket_address sa;
-    int type = '?';
-    DhtMessage message;
-    const HashString* nodeId = NULL;
+    std::memset(msgs, 0, sizeof(msgs));
 
-    try {
-      char buffer[2048];
-      int32_t read = read_datagram(buffer, sizeof(buffer), &sa);
+    for (unsigned int i = 0; i < batch_size; i++) {
+      iovecs[i].iov_base = m_read_buffer.data() + i * max_datagram_size;
+      iovecs[i].iov_len  = max_datagram_size;
 
-      if (read < 0)
-        break;
+      msgs[i].msg_hdr.msg_name    = &addresses[i];
+      msgs[i].msg_hdr.msg_namelen = sizeof(rak::socket_address);
+      msgs[i].msg_hdr.msg_iov     = &iovecs[i];
+      msgs[i].msg_hdr.msg_iovlen  = 1;
+    }
 
-      // We can currently only process mapped-IPv4 addresses, not real IPv6.
-      // Translate them to an af_inet socket_address.
-      if (sa.family() == rak::socket_address::af_inet6)
-        sa = sa.sa_inet6()->normalize_address();
+    int count = ::recvmmsg(m_fileDesc, msgs, batch_size, MSG_DONTWAIT, nullptr);
 
-      if (sa.family() != rak::socket_address::af_inet)
-        continue;
+    if (count <= 0)
+      break;
 
-      total += read;
+    for (int i = 0; i < count; i++) {
+      const char* buffer = m_read_buffer.data() + i * max_datagram_size;
 
-      // If it's not a valid bencode dictionary at all, it's probably not a DHT
-      // packet at all, so we don't throw an error to prevent bounce loops.
-      try {
-        static_map_read_bencode(buffer, buffer + read, message);
-      } catch (bencode_error& e) {
+      if (UtpManager::is_packet(buffer, msgs[i].msg_len)) {
+        manager->utp_manager()->process_packet(buffer, msgs[i].msg_len, addresses[i]);
         continue;
       }
 
-      if (!message[key_t].is_raw_string())
-        throw dht_error(dht_error_protocol, "No transaction ID");
+      total += msgs[i].msg_len;
+      process_datagram(buffer, msgs[i].msg_len, addresses[i]);
+    }
 
-      // Restrict the length of Transaction IDs. We echo them in our replies.
-      if(message[key_t].as_raw_string().size() > 20) {
-		  throw dht_error(dht_error_protocol, "Transaction ID length too long");
-      }
+    if (static_cast<unsigned int>(count) < batch_size)
+      break;
+  }
+#else
+  while (true) {
+    int32_t read = read_datagram(m_read_buffer.data(), max_datagram_size, &addresses[0]);
 
-      if (!message[key_y].is_raw_string())
-        throw dht_error(dht_error_protocol, "No message type");
+    if (read < 0)
+      break;
 
-      if (message[key_y].as_raw_string().size() != 1)
-        throw dht_error(dht_error_bad_method, "Unsupported message type");
+    if (UtpManager::is_packet(m_read_buffer.data(), read)) {
+      manager->utp_manager()->process_packet(m_read_buffer.data(), read, addresses[0]);
+      continue;
+    }
 
-      type = message[key_y].as_raw_string().data()[0];
+    total += read;
+    process_datagram(m_read_buffer.data(), read, addresses[0]);
+  }
+#endif
 
-      // Queries and replies have node ID in different dictionaries.
-      if (type == 'r' || type == 'q') {
-        if (!message[type == 'q' ? key_a_id : key_r_id].is_raw_string())
-          throw dht_error(dht_error_protocol, "Invalid `id' value");
+  // uTP packets are counted by the peer connections reading from
+  // their bridges, and the replies of the batch are sent together.
+  manager->utp_manager()->flush();
 
-        raw_string nodeIdStr = message[type == 'q' ? key_a_id : key_r_id].as_raw_string();
+  m_downloadThrottle->node_used_unthrottled(total);
+  m_downloadNode.rate()->insert(total);
 
-        if (nodeIdStr.size() < HashString::size_data)
-          throw dht_error(dht_error_protocol, "`id' value too short");
+  start_write();
+}
 
-        nodeId = HashString::cast_from(nodeIdStr.data());
-      }
+void
+DhtServer::process_datagram(const char* buffer, int32_t read, rak::socket_address& sa) {
+  int type = '?';
+  DhtMessage message;
+  const HashString* nodeId = NULL;
+  DhtQuota::admission_type admission = DhtQuota::admit;
 
-      // Sanity check the returned transaction ID.
-      if ((type == 'r' || type == 'e') && 
-          (!message[key_t].is_raw_string() || message[key_t].as_raw_string().size() != 1))
-        throw dht_error(dht_error_protocol, "Invalid transaction ID type/length.");
+  try {
+    // We can currently only process mapped-IPv4 addresses, not real IPv6.
+    // Translate them to an af_inet socket_address.
+    if (sa.family() == rak::socket_address::af_inet6)
+      sa = sa.sa_inet6()->normalize_address();
 
-      // Stupid broken implementations.
-      if (nodeId != NULL && *nodeId == m_router->id())
-        throw dht_error(dht_error_protocol, "Send your own ID, not mine");
+    if (sa.family() != rak::socket_address::af_inet) {
+      m_droppedMalformed++;
+      return;
+    }
 
-      switch (type) {
-        case 'q':
-          process_query(*nodeId, &sa, message);
-          break;
+    // Sources flooding us are dropped before any parsing is done, so
+    // they cannot crowd out other nodes' queries and our replies.
+    admission = m_quota.insert(sa.sa_inet()->address_n(), cachedTime.seconds());
 
-        case 'r':
-          process_response(*nodeId, &sa, message);
-          break;
+    if (admission == DhtQuota::drop) {
+      m_droppedQuota++;
+      return;
+    }
 
-        case 'e':
-          process_error(&sa, message);
-          break;
+    // If it's not a valid bencode dictionary at all, it's probably not a DHT
+    // packet at all, so we don't throw an error to prevent bounce loops.
+    if (!dht_message_read(buffer, buffer + read, message, type, nodeId)) {
+      m_droppedMalformed++;
+      return;
+    }
 
-        default:
-          throw dht_error(dht_error_bad_method, "Unknown message type.");
-      }
+    // Stupid broken implementations.
+    if (nodeId != NULL && *nodeId == m_router->id())
+      throw dht_error(dht_error_protocol, "Send your own ID, not mine");
 
-    // If node was querying us, reply with error packet, otherwise mark the node as "query failed",
-    // so that if it repeatedly sends malformed replies we will drop it instead of propagating it
-    // to other nodes.
-    } catch (bencode_error& e) {
-      if ((type == 'r' || type == 'e') && nodeId != NULL) {
-        m_router->node_inactive(*nodeId, &sa);
-      } else {
-        snprintf(message.data_end, message.data + message.data_size - message.data_end - 1, "Malformed packet: %s", e.what());
-        message.data[message.data_size - 1] = '\0';
-        create_error(message, &sa, dht_error_protocol, message.data_end);
-      }
+    switch (type) {
+      case 'q':
+        process_query(*nodeId, &sa, message);
+        break;
+
+      case 'r':
+        process_response(*nodeId, &sa, message);
+        break;
 
-    } catch (dht_error& e) {
-      if ((type == 'r' || type == 'e') && nodeId != NULL)
-        m_router->node_inactive(*nodeId, &sa);
-      else
-        create_error(message, &sa, e.code(), e.what());
+      case 'e':
+        process_error(&sa, message);
+        break;
 
-    } catch (network_error& e) {
+      default:
+        throw dht_error(dht_error_bad_method, "Unknown message type.");
+    }
 
+  // If node was querying us, reply with error packet, otherwise mark the node as "query failed",
+  // so that if it repeatedly sends malformed replies we will drop it instead of propagating it
+  // to other nodes.
+  } catch (bencode_error& e) {
+    if ((type == 'r' || type == 'e') && nodeId != NULL) {
+      m_router->node_inactive(*nodeId, &sa);
+    } else if (admission == DhtQuota::admit_quiet) {
+      m_errorsSuppressed++;
+    } else {
+      snprintf(message.data_end, message.data + message.data_size - message.data_end - 1, "Malformed packet: %s", e.what());
+      message.data[message.data_size - 1] = '\0';
+      create_error(message, &sa, dht_error_protocol, message.data_end);
     }
-  }
 
-  m_downloadThrottle->node_used_unthrottled(total);
-  m_downloadNode.rate()->insert(total);
+  } catch (dht_error& e) {
+    if ((type == 'r' || type == 'e') && nodeId != NULL)
+      m_router->node_inactive(*nodeId, &sa);
+    else if (admission == DhtQuota::admit_quiet)
+      m_errorsSuppressed++;
+    else
+      create_error(message, &sa, e.code(), e.what());
 
-  start_write();
+  } catch (network_error& e) {
+
+  }
 }
 
 bool
@@ -790,62 +833,145 @@ DhtServer::process_queue(packet_queue& queue, uint32_t* quota) {
   uint32_t used = 0;
 
   while (!queue.empty()) {
-    DhtTransactionPacket* packet = queue.front();
-    DhtTransaction::key_type transactionKey = 0;
-    if(packet->has_transaction())
-      transactionKey = packet->transaction()->key(packet->id());
-
-    // Make sure its transaction hasn't timed out yet, if it has/had one
-    // and don't bother sending non-transaction packets (replies) after 
-    // more than 15 seconds in the queue.
-    if (packet->has_failed() || packet->age() > 15) {
-      delete packet;
-      queue.pop_front();
-      continue;
+    DhtTransactionPacket* packets[batch_size];
+    unsigned int          count = 0;
+    uint32_t              reserved = 0;
+    bool                  exhausted = false;
+
+    // Gather packets from the front of the queue that fit in the
+    // quota, dropping those that no longer need to be sent.
+    auto itr = queue.begin();
+
+    while (itr != queue.end() && count < batch_size) {
+      DhtTransactionPacket* packet = *itr;
+
+      // Make sure its transaction hasn't timed out yet, if it has/had one
+      // and don't bother sending non-transaction packets (replies) after
+      // more than 15 seconds in the queue.
+      if (packet->has_failed() || packet->age() > 15) {
+        delete packet;
+        itr = queue.erase(itr);
+        continue;
+      }
+
+      if (reserved + packet->length() > *quota) {
+        exhausted = true;
+        break;
+      }
+
+      reserved += packet->length();
+      packets[count++] = packet;
+      ++itr;
     }
 
-    if (packet->length() > *quota) {
+    if (count == 0) {
+      if (!exhausted)
+        break;
+
       m_uploadThrottle->node_used(&m_uploadNode, used);
       return false;
     }
 
-    queue.pop_front();
+    queue.erase(queue.begin(), queue.begin() + count);
 
-    try {
-      int written = write_datagram(packet->c_str(), packet->length(), packet->address());
+    unsigned int sent = write_packets(packets, count);
 
-      if (written == -1)
-        throw network_error();
+    for (unsigned int i = 0; i < sent; i++) {
+      used += packets[i]->length();
+      *quota -= packets[i]->length();
 
-      used += written;
-      *quota -= written;
+      finish_packet(packets[i], true);
+    }
 
-      if (static_cast<unsigned int>(written) != packet->length())
-        throw network_error();
+    // The packet after the sent ones failed, the rest are put back
+    // for the next round first as failing a transaction may drop
+    // queued packets.
+    for (unsigned int i = count; i > sent + 1; i--)
+      queue.push_front(packets[i - 1]);
 
-    } catch (network_error& e) {
-      // Couldn't write packet, maybe something wrong with node address or routing, so mark node as bad.
-      if (packet->has_transaction()) {
-        auto itr = m_transactions.find(transactionKey);
-        if (itr == m_transactions.end())
-          throw internal_error("DhtServer::process_queue could not find transaction.");
+    if (sent != count)
+      finish_packet(packets[sent], false);
+  }
 
-        failed_transaction(itr, false);
-      }
-    }
+  m_uploadThrottle->node_used(&m_uploadNode, used);
+  return true;
+}
+
+unsigned int
+DhtServer::write_packets(DhtTransactionPacket** packets, unsigned int count) {
+#ifdef USE_SENDMMSG
+  mmsghdr                   msgs[batch_size];
+  iovec                     iovecs[batch_size];
+  rak::socket_address_inet6 mapped[batch_size];
+
+  std::memset(msgs, 0, sizeof(msgs));
+
+  for (unsigned int i = 0; i < count; i++) {
+    rak::socket_address* sa = packets[i]->address();
 
-    if (packet->has_transaction()) {
-      // here transaction can be already deleted by failed_transaction.
-      auto itr = m_transactions.find(transactionKey);
-      if (itr != m_transactions.end())
-        packet->transaction()->set_packet(NULL);
+    iovecs[i].iov_base = const_cast<char*>(packets[i]->c_str());
+    iovecs[i].iov_len  = packets[i]->length();
+
+    if (m_ipv6_socket && sa->family() == rak::socket_address::pf_inet) {
+      mapped[i] = sa->sa_inet()->to_mapped_address();
+
+      msgs[i].msg_hdr.msg_name    = mapped[i].c_sockaddr();
+      msgs[i].msg_hdr.msg_namelen = sizeof(rak::socket_address_inet6);
+    } else {
+      msgs[i].msg_hdr.msg_name    = sa->c_sockaddr();
+      msgs[i].msg_hdr.msg_namelen = sa->length();
     }
 
-    delete packet;
+    msgs[i].msg_hdr.msg_iov    = &iovecs[i];
+    msgs[i].msg_hdr.msg_iovlen = 1;
   }
 
-  m_uploadThrottle->node_used(&m_uploadNode, used);
-  return true;
+  int result = ::sendmmsg(m_fileDesc, msgs, count, 0);
+
+  if (result <= 0)
+    return 0;
+
+  for (int i = 0; i < result; i++)
+    if (msgs[i].msg_len != packets[i]->length())
+      return i;
+
+  return result;
+#else
+  for (unsigned int i = 0; i < count; i++) {
+    int written = write_datagram(packets[i]->c_str(), packets[i]->length(), packets[i]->address());
+
+    if (written == -1 || static_cast<unsigned int>(written) != packets[i]->length())
+      return i;
+  }
+
+  return count;
+#endif
+}
+
+void
+DhtServer::finish_packet(DhtTransactionPacket* packet, bool sent) {
+  DhtTransaction::key_type transactionKey = 0;
+
+  if (packet->has_transaction())
+    transactionKey = packet->transaction()->key(packet->id());
+
+  // Couldn't write packet, maybe something wrong with node address or routing, so mark node as bad.
+  if (!sent && packet->has_transaction()) {
+    auto itr = m_transactions.find(transactionKey);
+    if (itr == m_transactions.end())
+      throw internal_error("DhtServer::process_queue could not find transaction.");
+
+    failed_transaction(itr, false);
+  }
+
+  if (packet->has_transaction()) {
+    // here transaction can be already deleted by failed_transaction.
+    auto itr = m_transactions.find(transactionKey);
+    if (itr != m_transactions.end())
+      packet->transaction()->set_packet(NULL);
+  }
+
+  delete packet;
 }
 
 void
@@ -4,7 +4,9 @@
 #include <array>
 #include <deque>
 #include <map>
+#include <vector>
 
+#include "dht/dht_quota.h"
 #include "dht/dht_transaction.h"
 #include "net/socket_datagram.h"
 #include "net/throttle_node.h"
@@ -27,6 +29,10 @@ class TrackerDht;
 
 class DhtServer : public SocketDatagram {
 public:
+  // Datagrams received and sent per recvmmsg and sendmmsg call.
+  static constexpr unsigned int batch_size        = 32;
+  static constexpr unsigned int max_datagram_size = 2048;
+
   DhtServer(DhtRouter* self);
   ~DhtServer() override;
 
@@ -41,6 +47,18 @@ public:
   unsigned int        replies_received() const           { return m_repliesReceived; }
   unsigned int        errors_received() const            { return m_errorsReceived; }
   unsigned int        errors_caught() const              { return m_errorsCaught; }
+  unsigned int        searches_completed() const         { return m_searchesCompleted; }
+
+  // Packets dropped before parsing for exceeding the per-source quota
+  // or not being a valid message, and error replies not sent to
+  // sources over the soft quota.
+  unsigned int        dropped_quota() const              { return m_droppedQuota; }
+  unsigned int        dropped_malformed() const          { return m_droppedMalformed; }
+  unsigned int        errors_suppressed() const          { return m_errorsSuppressed; }
+
+  // Average time in milliseconds for a search to converge or run out of nodes.
+  unsigned int        search_latency() const             { return m_searchesCompleted ? m_searchLatency / m_searchesCompleted : 0; }
+
   void                reset_statistics();
 
   // Contact a node to see if it replies. Set id=0 if unknown.
@@ -72,12 +90,6 @@ public:
   void                event_error() override;
 
 private:
-  // DHT error codes.
-  static constexpr int dht_error_generic    = 201;
-  static constexpr int dht_error_server     = 202;
-  static constexpr int dht_error_protocol   = 203;
-  static constexpr int dht_error_bad_method = 204;
-
   struct [[gnu::packed]] compact_node_info {
     char                 _id[20];
     SocketAddressCompact _addr;
@@ -108,6 +120,8 @@ private:
 
   void                start_write();
 
+  void                process_datagram(const char* buffer, int32_t length, rak::socket_address& sa);
+
   void                process_query(const HashString& id, const rak::socket_address* sa, const DhtMessage& req);
   void                process_response(const HashString& id, const rak::socket_address* sa, const DhtMessage& req);
   void                process_error(const rak::socket_address* sa, const DhtMessage& error);
@@ -135,6 +149,11 @@ private:
   void                clear_transactions();
 
   bool                process_queue(packet_queue& queue, uint32_t* quota);
+
+  // Returns the number of packets sent in full before the first one
+  // that failed, if any.
+  unsigned int        write_packets(DhtTransactionPacket** packets, unsigned int count);
+  void                finish_packet(DhtTransactionPacket* packet, bool sent);
   void                receive_timeout();
 
   DhtRouter*          m_router{};
@@ -142,6 +161,8 @@ private:
   packet_queue        m_lowQueue;
   transaction_map     m_transactions;
 
+  std::vector<char>   m_read_buffer;
+
   utils::SchedulerEntry m_task_timeout;
 
   ThrottleNode        m_uploadNode{60};
@@ -155,6 +176,13 @@ private:
   unsigned int        m_repliesReceived{};
   unsigned int        m_errorsReceived{};
   unsigned int        m_errorsCaught{};
+  unsigned int        m_searchesCompleted{};
+  uint64_t            m_searchLatency{};
+  unsigned int        m_droppedQuota{};
+  unsigned int        m_droppedMalformed{};
+  unsigned int        m_errorsSuppressed{};
+
+  DhtQuota            m_quota;
 
   bool                m_networkUp{false};
 };
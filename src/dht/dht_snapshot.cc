@@ -0,0 +1,145 @@
+#include "config.h"
+
+#include "dht/dht_snapshot.h"
+
+#include <algorithm>
+#include <cstring>
+#include <iterator>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "dht/dht_node.h"
+#include "torrent/utils/log.h"
+
+#define LT_LOG(log_fmt, ...)                                            \
+  lt_log_print_subsystem(torrent::LOG_DHT_ROUTER, "dht_snapshot", log_fmt, __VA_ARGS__);
+
+namespace torrent {
+
+bool
+DhtSnapshot::open(const std::string& path, record_list* previous) {
+  close();
+
+  size_t length = sizeof(header_type) + max_nodes * sizeof(record_type);
+  int    fd     = ::open(path.c_str(), O_RDWR | O_CREAT, 0644);
+
+  if (fd == -1) {
+    LT_LOG("could not open file (path:%s error:%s)", path.c_str(), std::strerror(errno));
+    return false;
+  }
+
+  struct stat st;
+
+  if (fstat(fd, &st) == -1 || (static_cast<size_t>(st.st_size) != length && ftruncate(fd, length) == -1)) {
+    LT_LOG("could not resize file (path:%s error:%s)", path.c_str(), std::strerror(errno));
+    ::close(fd);
+    return false;
+  }
+
+  void* ptr = mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  ::close(fd);
+
+  if (ptr == MAP_FAILED) {
+    LT_LOG("could not map file (path:%s error:%s)", path.c_str(), std::strerror(errno));
+    return false;
+  }
+
+  auto header = static_cast<header_type*>(ptr);
+
+  m_records = reinterpret_cast<record_type*>(header + 1);
+  m_length  = length;
+
+  bool valid = static_cast<size_t>(st.st_size) == length &&
+               header->magic == magic &&
+               header->version == version &&
+               header->record_size == sizeof(record_type) &&
+               header->max_nodes == max_nodes;
+
+  if (valid && previous != nullptr)
+    std::copy_if(m_records, m_records + max_nodes, std::back_inserter(*previous),
+                 [](const record_type& r) { return r.port != 0; });
+
+  LT_LOG("opened (path:%s valid:%d nodes:%zu)", path.c_str(), valid, previous != nullptr ? previous->size() : 0);
+
+  std::memset(ptr, 0, length);
+  header->magic       = magic;
+  header->version     = version;
+  header->record_size = sizeof(record_type);
+  header->max_nodes   = max_nodes;
+
+  // Hand out low slots first so a lightly populated table only dirties
+  // the first few pages.
+  m_free.resize(max_nodes);
+
+  for (uint32_t i = 0; i != max_nodes; ++i)
+    m_free[i] = max_nodes - 1 - i;
+
+  return true;
+}
+
+void
+DhtSnapshot::close() {
+  if (m_records == nullptr)
+    return;
+
+  void* ptr = reinterpret_cast<header_type*>(m_records) - 1;
+
+  msync(ptr, m_length, MS_ASYNC);
+  munmap(ptr, m_length);
+
+  m_records = nullptr;
+  m_length  = 0;
+  m_size    = 0;
+  m_free.clear();
+}
+
+void
+DhtSnapshot::sync() {
+  if (m_records != nullptr)
+    msync(reinterpret_cast<header_type*>(m_records) - 1, m_length, MS_ASYNC);
+}
+
+void
+DhtSnapshot::update(DhtNode* node) {
+  if (m_records == nullptr || node->address()->family() != rak::socket_address::af_inet)
+    return;
+
+  uint32_t slot = node->snapshot_slot();
+
+  if (slot == invalid_slot) {
+    if (m_free.empty())
+      return;
+
+    slot = m_free.back();
+    m_free.pop_back();
+    m_size++;
+
+    node->set_snapshot_slot(slot);
+  }
+
+  record_type* record = m_records + slot;
+
+  std::memcpy(record->id, node->data(), sizeof(record->id));
+  record->address   = node->address()->sa_inet()->address_n();
+  record->port      = node->address()->sa_inet()->port_n();
+  record->rtt       = node->rtt();
+  record->last_seen = node->last_seen();
+}
+
+void
+DhtSnapshot::erase(DhtNode* node) {
+  uint32_t slot = node->snapshot_slot();
+
+  if (m_records == nullptr || slot == invalid_slot)
+    return;
+
+  std::memset(m_records + slot, 0, sizeof(record_type));
+  m_free.push_back(slot);
+  m_size--;
+
+  node->set_snapshot_slot(invalid_slot);
+}
+
+}
@@ -0,0 +1,85 @@
+#ifndef LIBTORRENT_DHT_SNAPSHOT_H
+#define LIBTORRENT_DHT_SNAPSHOT_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace torrent {
+
+class DhtNode;
+
+// Routing table snapshot kept in a memory-mapped file. Every node in
+// the table owns a fixed-size record which is rewritten in place
+// whenever the node changes, so the file is always current and the
+// kernel writes back the dirty pages without a full serialization.
+//
+// On startup the records of the previous session are read back, which
+// lets the router rejoin the DHT without bootstrapping from scratch.
+
+class DhtSnapshot {
+public:
+  static constexpr uint32_t magic     = 0x4c544448;  // "HDTL"
+  static constexpr uint32_t version   = 1;
+  static constexpr uint32_t max_nodes = 2048;
+
+  static constexpr uint32_t invalid_slot = ~uint32_t();
+
+  struct header_type {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t record_size;
+    uint32_t max_nodes;
+    char     reserved[16];
+  };
+
+  // Address and port are in network byte order, rtt in milliseconds
+  // with zero meaning unknown. Unused records have a zero port.
+  struct record_type {
+    char     id[20];
+    uint32_t address;
+    uint16_t port;
+    uint16_t rtt;
+    uint32_t last_seen;
+  };
+
+  static_assert(sizeof(header_type) == 32, "DhtSnapshot::header_type has invalid size.");
+  static_assert(sizeof(record_type) == 32, "DhtSnapshot::record_type has invalid size.");
+
+  using record_list = std::vector<record_type>;
+
+  DhtSnapshot() = default;
+  ~DhtSnapshot() { close(); }
+  DhtSnapshot(const DhtSnapshot&) = delete;
+  DhtSnapshot& operator=(const DhtSnapshot&) = delete;
+
+  bool                is_open() const                 { return m_records != nullptr; }
+
+  // Map the file at the given path, creating it if needed. Records of
+  // a valid snapshot are moved to 'previous' and the file is cleared,
+  // nodes get new slots as they are added to the routing table.
+  // Returns false and leaves the snapshot closed on failure.
+  bool                open(const std::string& path, record_list* previous);
+  void                close();
+
+  // Schedule write back of dirty pages without blocking.
+  void                sync();
+
+  uint32_t            size() const                    { return m_size; }
+
+  // Write the node to its slot, allocating one if it has none. Nodes
+  // without IPv4 addresses or when the file is full are skipped.
+  void                update(DhtNode* node);
+  void                erase(DhtNode* node);
+
+private:
+  record_type*        m_records{};
+  size_t              m_length{};
+  uint32_t            m_size{};
+
+  std::vector<uint32_t> m_free;
+};
+
+}
+
+#endif
@@ -36,68 +36,335 @@
 
 #include "config.h"
 
+#include <cstring>
+
+#include "torrent/exceptions.h"
 #include "torrent/object.h"
+#include "utils/sha1.h"
 
 #include "dht_tracker.h"
 
 namespace torrent {
 
+template <typename Compact>
+static inline bool
+peer_address_equal(const Compact& lhs, const Compact& rhs) {
+  return std::memcmp(&lhs.addr, &rhs.addr, sizeof(lhs.addr)) == 0;
+}
+
+// FNV-1a over the address, the port is not part of the key.
+template <typename Compact>
+static inline uint32_t
+peer_address_hash(const Compact& peer) {
+  auto     first = reinterpret_cast<const unsigned char*>(&peer.addr);
+  uint32_t hash = 2166136261u;
+
+  for (auto itr = first; itr != first + sizeof(peer.addr); ++itr)
+    hash = (hash ^ *itr) * 16777619u;
+
+  return hash;
+}
+
+// Returns the position of the peer in the index, or of the empty
+// position where it would be inserted.
+template <typename Compact>
+size_t
+DhtPeerRing<Compact>::index_find(const Compact& peer) const {
+  size_t mask = m_index.size() - 1;
+  size_t pos = peer_address_hash(peer) & mask;
+
+  while (m_index[pos] != 0 && !peer_address_equal(m_entries[m_index[pos] - 1].peer, peer))
+    pos = (pos + 1) & mask;
+
+  return pos;
+}
+
+// Backward shift deletion, moves later entries of the probe chain
+// into the hole so lookups never need tombstones.
+template <typename Compact>
 void
-DhtTracker::add_peer(uint32_t addr, uint16_t port) {
-  if (port == 0)
-    return;
+DhtPeerRing<Compact>::index_erase(size_t pos) {
+  size_t mask = m_index.size() - 1;
+  size_t next = pos;
+
+  while (true) {
+    next = (next + 1) & mask;
 
-  SocketAddressCompact compact(addr, port);
+    if (m_index[next] == 0)
+      break;
 
-  unsigned int oldest = 0;
-  uint32_t minSeen = ~uint32_t();
+    size_t home = peer_address_hash(m_entries[m_index[next] - 1].peer) & mask;
 
-  // Check if peer exists. If not, find oldest peer.
-  for (unsigned int i = 0; i < size(); i++) {
-    if (m_peers[i].peer.addr == compact.addr) {
-      m_peers[i].peer.port = compact.port;
-      m_lastSeen[i] = cachedTime.seconds();
-      return;
+    // Leave the entry if its home lies cyclically in (pos, next].
+    if (pos <= next ? (pos < home && home <= next) : (pos < home || home <= next))
+      continue;
 
-    } else if (m_lastSeen[i] < minSeen) {
-      minSeen = m_lastSeen[i];
-      oldest = i;
+    m_index[pos] = m_index[next];
+    pos = next;
+  }
+
+  m_index[pos] = 0;
+}
+
+template <typename Compact>
+void
+DhtPeerRing<Compact>::set_entry(size_t s, const Compact& peer) {
+  static_assert(sizeof(entry_type) == sizeof(entry_type::header) + sizeof(Compact), "DhtPeerRing::entry_type is packed incorrectly.");
+
+  entry_type& entry = m_entries[s];
+
+  if (sizeof(entry.header) == 2)
+    std::memcpy(entry.header, "6:", 2);
+  else
+    std::memcpy(entry.header, "18:", 3);
+
+  entry.peer = peer;
+  m_entries[s + m_capacity] = entry;
+}
+
+template <typename Compact>
+void
+DhtPeerRing<Compact>::pop_tail() {
+  index_erase(index_find(m_entries[m_tail].peer));
+
+  m_tail = (m_tail + 1) % m_capacity;
+  m_size--;
+}
+
+// Moves the tail peer to the head, which for a full ring only needs
+// the tail to advance.
+template <typename Compact>
+void
+DhtPeerRing<Compact>::rotate_tail(uint32_t now) {
+  m_info[m_tail].queued = now;
+
+  if (m_size != m_capacity) {
+    size_t head = slot(m_size);
+
+    set_entry(head, m_entries[m_tail].peer);
+    m_info[head] = m_info[m_tail];
+    m_index[index_find(m_entries[head].peer)] = head + 1;
+  }
+
+  m_tail = (m_tail + 1) % m_capacity;
+}
+
+template <typename Compact>
+void
+DhtPeerRing<Compact>::grow() {
+  vector_type<entry_type> entries;
+  vector_type<info_type>  info;
+
+  entries.swap(m_entries);
+  info.swap(m_info);
+
+  size_t old_capacity = m_capacity;
+  size_t old_tail = m_tail;
+
+  m_capacity = std::min(std::max<size_t>(2 * m_capacity, 8), m_max_capacity);
+  m_tail = 0;
+
+  size_t index_size = 1;
+
+  while (index_size < 2 * m_capacity)
+    index_size *= 2;
+
+  m_entries.resize(2 * m_capacity);
+  m_info.resize(m_capacity);
+  m_index.assign(index_size, 0);
+
+  for (size_t i = 0; i != m_size; i++) {
+    size_t old_slot = (old_tail + i) % old_capacity;
+
+    set_entry(i, entries[old_slot].peer);
+    m_info[i] = info[old_slot];
+    m_index[index_find(entries[old_slot].peer)] = i + 1;
+  }
+}
+
+template <typename Compact>
+bool
+DhtPeerRing<Compact>::insert(const Compact& peer, const info_type& info) {
+  if (m_max_capacity == 0)
+    return false;
+
+  if (m_size != 0) {
+    size_t pos = index_find(peer);
+
+    // Known peers are refreshed in place and moved to the head once
+    // they reach the tail.
+    if (m_index[pos] != 0) {
+      size_t s = m_index[pos] - 1;
+      bool   stale = m_info[s].seed != info.seed;
+
+      set_entry(s, peer);
+      m_info[s].last_seen = info.last_seen;
+      m_info[s].seed = info.seed;
+
+      return stale;
     }
   }
 
-  // If peer doesn't exist, append to list if the table is not full.
-  if (size() < max_size) {
-    m_peers.emplace_back(compact);
-    m_lastSeen.push_back(cachedTime.seconds());
+  bool stale = false;
+
+  if (m_size == m_capacity) {
+    if (m_capacity < m_max_capacity) {
+      grow();
+
+    } else {
+      // Replace the oldest peer that has not reannounced since it was
+      // queued. Rotated peers are not visited twice.
+      while (m_info[m_tail].last_seen > m_info[m_tail].queued)
+        rotate_tail(info.last_seen);
 
-  // Peer doesn't exist and table is full: replace oldest peer.
-  } else {
-    m_peers[oldest] = compact;
-    m_lastSeen[oldest] = cachedTime.seconds();
+      pop_tail();
+      stale = true;
+    }
   }
+
+  size_t s = slot(m_size++);
+
+  set_entry(s, peer);
+  m_info[s] = info;
+  m_index[index_find(peer)] = s + 1;
+
+  return stale;
 }
 
-// Return compact info as bencoded string (8 bytes per peer) for up to 30 peers,
+// Return compact info as bencoded string for up to maxPeers peers,
 // returning different peers for each call if there are more.
+template <typename Compact>
 raw_list
-DhtTracker::get_peers(unsigned int maxPeers) {
-  if (sizeof(BencodeAddress) != 8)
-    throw internal_error("DhtTracker::BencodeAddress is packed incorrectly.");
+DhtPeerRing<Compact>::get_peers(unsigned int maxPeers) const {
+  if (m_size == 0)
+    return raw_list();
 
-  auto first = m_peers.begin();
-  auto last  = m_peers.end();
+  const entry_type* first = &m_entries[m_tail];
+  size_t            count = m_size;
 
-  // If we have more than max_peers, randomly return block of peers.
+  // If we have more than maxPeers, randomly return block of peers.
   // The peers in overlapping blocks get picked twice as often, but
   // that's better than returning fewer peers.
-  if (m_peers.size() > maxPeers) {
-    unsigned int blocks = (m_peers.size() + maxPeers - 1) / maxPeers;
+  if (m_size > maxPeers) {
+    unsigned int blocks = (m_size + maxPeers - 1) / maxPeers;
+
+    first += (random() % blocks) * (m_size - maxPeers) / (blocks - 1);
+    count = maxPeers;
+  }
+
+  return raw_list(first->bencode(), count * sizeof(entry_type));
+}
+
+template <typename Compact>
+bool
+DhtPeerRing<Compact>::prune(uint32_t minSeen, uint32_t now) {
+  size_t old_size = m_size;
 
-    first += (random() % blocks) * (m_peers.size() - maxPeers) / (blocks - 1);
-    last = first + maxPeers;
+  while (m_size != 0 && m_info[m_tail].queued < minSeen) {
+    if (m_info[m_tail].last_seen < minSeen)
+      pop_tail();
+    else
+      rotate_tail(now);
   }
 
-  return raw_list(first->bencode(), last->bencode() - first->bencode());
+  return m_size != old_size;
+}
+
+template <typename Compact>
+template <typename Func>
+void
+DhtPeerRing<Compact>::for_each_info(Func func) const {
+  for (size_t i = 0; i != m_size; i++)
+    func(m_info[slot(i)]);
+}
+
+template class DhtPeerRing<SocketAddressCompact>;
+template class DhtPeerRing<SocketAddressCompact6>;
+
+// BEP 33 sets two bits in a 2048 bit filter, taken from the first
+// four bytes of the SHA-1 of the IP address. We store the bit
+// indices so the filters can be rebuilt without rehashing.
+DhtTracker::info_type
+DhtTracker::make_info(const void* addr, unsigned int length, bool seed) {
+  unsigned char hash[20];
+
+  Sha1 sha;
+  sha.init();
+  sha.update(addr, length);
+  sha.final_c(hash);
+
+  info_type info;
+  info.last_seen = cachedTime.seconds();
+  info.queued = info.last_seen;
+  info.bloom[0] = (hash[0] | hash[1] << 8) % (bloom_size * 8);
+  info.bloom[1] = (hash[2] | hash[3] << 8) % (bloom_size * 8);
+  info.seed = seed;
+
+  return info;
+}
+
+void
+DhtTracker::add_peer(uint32_t addr, uint16_t port, bool seed) {
+  if (port == 0)
+    return;
+
+  info_type info = make_info(&addr, sizeof(addr), seed);
+
+  if (m_peers.insert(SocketAddressCompact(addr, htons(port)), info))
+    m_bloomValid = false;
+
+  bloom_insert(info);
+}
+
+void
+DhtTracker::add_peer(const in6_addr& addr, uint16_t port, bool seed) {
+  if (port == 0)
+    return;
+
+  info_type info = make_info(&addr, sizeof(addr), seed);
+
+  if (m_peers6.insert(SocketAddressCompact6(addr, htons(port)), info))
+    m_bloomValid = false;
+
+  bloom_insert(info);
+}
+
+void
+DhtTracker::bloom_insert(const info_type& info) {
+  if (!m_bloomValid)
+    return;
+
+  char* filter = info.seed ? m_bloomSeeds : m_bloomPeers;
+
+  for (auto index : info.bloom)
+    filter[index / 8] |= 1 << (index % 8);
+}
+
+void
+DhtTracker::bloom_update() {
+  if (m_bloomValid)
+    return;
+
+  std::memset(m_bloomSeeds, 0, bloom_size);
+  std::memset(m_bloomPeers, 0, bloom_size);
+  m_bloomValid = true;
+
+  auto insert = [this](const info_type& info) { bloom_insert(info); };
+
+  m_peers.for_each_info(insert);
+  m_peers6.for_each_info(insert);
+}
+
+raw_string
+DhtTracker::bloom_seeds() {
+  bloom_update();
+  return raw_string(m_bloomSeeds, bloom_size);
+}
+
+raw_string
+DhtTracker::bloom_peers() {
+  bloom_update();
+  return raw_string(m_bloomPeers, bloom_size);
 }
 
 // Remove old announces.
@@ -105,14 +372,8 @@ void
 DhtTracker::prune(uint32_t maxAge) {
   uint32_t minSeen = cachedTime.seconds() - maxAge;
 
-  for (unsigned int i = 0; i < m_lastSeen.size(); i++)
-    if (m_lastSeen[i] < minSeen) m_peers[i].peer.port = 0;
-
-  m_peers.erase(std::remove_if(m_peers.begin(), m_peers.end(), std::mem_fn(&BencodeAddress::empty)), m_peers.end());
-  m_lastSeen.erase(std::remove_if(m_lastSeen.begin(), m_lastSeen.end(), [minSeen](auto seen) { return seen < minSeen; }), m_lastSeen.end());
-
-  if (m_peers.size() != m_lastSeen.size())
-    throw internal_error("DhtTracker::prune did inconsistent peer pruning.");
+  if (m_peers.prune(minSeen, cachedTime.seconds()) | m_peers6.prune(minSeen, cachedTime.seconds()))
+    m_bloomValid = false;
 }
 
 }
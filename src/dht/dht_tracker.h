@@ -40,13 +40,92 @@
 #include "globals.h"
 
 #include <vector>
+#include <netinet/in.h>
 #include <rak/socket_address.h>
 
 #include "net/address_list.h" // For SA.
+#include "torrent/memory_manager.h"
 #include "torrent/object_raw_bencode.h"
 
 namespace torrent {
 
+struct DhtPeerInfo {
+  uint32_t  last_seen;
+  uint32_t  queued;
+  uint16_t  bloom[2];
+  bool      seed;
+};
+
+// Ring of compact peer addresses for one address family, ordered by
+// the time each peer was queued at the head. Reannounces only update
+// the peer in place; when a refreshed peer reaches the tail it gets a
+// second chance and is moved back to the head, so aging out and
+// replacing the oldest peer are amortized O(1).
+//
+// Each entry is stored twice, at 'slot' and 'slot + capacity', which
+// keeps any run of peers starting inside the ring contiguous for
+// get_peers. An open addressing index maps addresses to slots. Tables
+// start small and grow until they reach the capacity allowed by the
+// memory budget.
+template <typename Compact>
+class DhtPeerRing {
+public:
+  // We need to store the address as a bencoded string.
+  struct [[gnu::packed]] entry_type {
+    char     header[sizeof(Compact) < 10 ? 2 : 3];
+    Compact  peer;
+
+    const char*  bencode() const { return header; }
+  };
+
+  using info_type = DhtPeerInfo;
+
+  static constexpr size_t bytes_per_peer = 2 * sizeof(entry_type) + sizeof(info_type) + 2 * sizeof(uint32_t);
+
+  DhtPeerRing(size_t max_memory) : m_max_capacity(max_memory / bytes_per_peer) {}
+
+  bool                empty() const                { return m_size == 0; }
+  size_t              size() const                 { return m_size; }
+  size_t              capacity() const             { return m_capacity; }
+  size_t              max_capacity() const         { return m_max_capacity; }
+
+  // Adds the peer or refreshes it if already known. Returns true if
+  // this evicted another peer or changed the seed state of a known
+  // one.
+  bool                insert(const Compact& peer, const info_type& info);
+  raw_list            get_peers(unsigned int maxPeers) const;
+
+  // Removes peers not seen since 'minSeen' that were queued before
+  // it, returns true if any were removed.
+  bool                prune(uint32_t minSeen, uint32_t now);
+
+  template <typename Func>
+  void                for_each_info(Func func) const;
+
+private:
+  size_t              slot(size_t i) const         { return (m_tail + i) % m_capacity; }
+
+  size_t              index_find(const Compact& peer) const;
+  void                index_erase(size_t pos);
+
+  void                set_entry(size_t s, const Compact& peer);
+  void                pop_tail();
+  void                rotate_tail(uint32_t now);
+  void                grow();
+
+  template <typename T>
+  using vector_type = std::vector<T, memory_counting_allocator<T, MemoryManager::category_dht>>;
+
+  vector_type<entry_type>  m_entries;
+  vector_type<info_type>   m_info;
+  vector_type<uint32_t>    m_index;
+
+  size_t                   m_tail{0};
+  size_t                   m_size{0};
+  size_t                   m_capacity{0};
+  size_t                   m_max_capacity;
+};
+
 // Container for peers tracked in a torrent.
 
 class DhtTracker {
@@ -57,38 +136,50 @@ public:
   // equal to a FIND_NODE reply (8*26 bytes).
   static constexpr unsigned int max_peers = 32;
 
-  // Maximum number of peers we keep track of. For torrents with more peers,
-  // we replace the oldest peer with each new announce to avoid excessively
-  // large peer tables for very active torrents.
-  static constexpr unsigned int max_size = 128;
+  // Memory budget for the peers of each address family. For torrents
+  // with more peers, we replace the oldest peer with each new announce
+  // to avoid excessively large peer tables for very active torrents.
+  static constexpr size_t max_memory = 16 << 10;
 
-  bool                empty() const                { return m_peers.empty(); }
-  size_t              size() const                 { return m_peers.size(); }
+  // Size in bytes of the BEP 33 seed and peer bloom filters.
+  static constexpr unsigned int bloom_size = 256;
 
-  void                add_peer(uint32_t addr, uint16_t port);
-  raw_list            get_peers(unsigned int maxPeers = max_peers);
+  DhtTracker() : m_peers(max_memory), m_peers6(max_memory) {}
+
+  bool                empty() const                { return m_peers.empty() && m_peers6.empty(); }
+  size_t              size() const                 { return m_peers.size() + m_peers6.size(); }
+
+  // The port is in host byte order.
+  void                add_peer(uint32_t addr, uint16_t port, bool seed = false);
+  void                add_peer(const in6_addr& addr, uint16_t port, bool seed = false);
+
+  raw_list            get_peers(unsigned int maxPeers = max_peers) const  { return m_peers.get_peers(maxPeers); }
+  raw_list            get_peers6(unsigned int maxPeers = max_peers) const { return m_peers6.get_peers(maxPeers); }
+
+  // BEP 33 scrape filters, rebuilt on demand after peers were removed.
+  raw_string          bloom_seeds();
+  raw_string          bloom_peers();
 
   // Remove old announces from the tracker that have not reannounced for
   // more than the given number of seconds.
   void                prune(uint32_t maxAge);
 
 private:
-  // We need to store the address as a bencoded string.
-  struct [[gnu::packed]] BencodeAddress {
-    char                 header[2];
-    SocketAddressCompact peer;
-
-    BencodeAddress(const SocketAddressCompact& p) : peer(p) { header[0] = '6'; header[1] = ':'; }
+  using PeerList  = DhtPeerRing<SocketAddressCompact>;
+  using PeerList6 = DhtPeerRing<SocketAddressCompact6>;
+  using info_type = DhtPeerInfo;
 
-    const char*  bencode() const { return header; }
+  static info_type    make_info(const void* addr, unsigned int length, bool seed);
 
-    bool         empty() const   { return !peer.port; }
-  };
+  void                bloom_insert(const info_type& info);
+  void                bloom_update();
 
-  using PeerList = std::vector<BencodeAddress>;
+  PeerList            m_peers;
+  PeerList6           m_peers6;
 
-  PeerList               m_peers;
-  std::vector<uint32_t>  m_lastSeen;
+  bool                m_bloomValid{true};
+  char                m_bloomSeeds[bloom_size]{};
+  char                m_bloomPeers[bloom_size]{};
 };
 
 }
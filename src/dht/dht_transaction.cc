@@ -1,5 +1,6 @@
 #include "config.h"
 
+#include <algorithm>
 #include <cassert>
 
 #include "torrent/exceptions.h"
@@ -12,9 +13,8 @@
 namespace torrent {
 
 DhtSearch::DhtSearch(const HashString& target, const DhtBucket& contacts)
-  : base_type(dht_compare_closer(target)),
-    m_next(end()),
-    m_target(target) {
+  : m_target(target),
+    m_startTime(cachedTime) {
 
   add_contacts(contacts);
 }
@@ -24,23 +24,25 @@ DhtSearch::~DhtSearch() {
   // of a transaction that triggers this destructor, that should always be the
   // case.
   assert(!m_pending && "DhtSearch::~DhtSearch called with pending transactions.");
-  assert(m_concurrency == 3 && "DhtSearch::~DhtSearch called with invalid concurrency limit.");
+  assert(!m_stalled && "DhtSearch::~DhtSearch called with stalled transactions.");
 
-  for (accessor itr = begin(); itr != end(); ++itr)
-    delete itr.node();
+  for (auto node : m_nodes)
+    delete node;
 }
 
 bool
 DhtSearch::add_contact(const HashString& id, const rak::socket_address* sa) {
-  auto n = new DhtNode(id, sa);
-  bool added = emplace(n, this).second;
+  auto itr = std::lower_bound(m_nodes.begin(), m_nodes.end(), id, [this](const DhtNode* node, const HashString& id) {
+      return is_closer(*node, id, m_target);
+    });
 
-  if (!added)
-    delete n;
-  else
-    m_restart = true;
+  if (itr != m_nodes.end() && (*itr)->id() == id)
+    return false;
+
+  m_nodes.insert(itr, new DhtNode(id, sa));
+  m_restart = true;
 
-  return added;
+  return true;
 }
 
 void
@@ -96,72 +98,110 @@ DhtSearch::trim(bool final) {
   int needClosest = final ? 0 : max_contacts;
   int needGood = is_announce() ? max_announce : 0;
 
+  auto last = m_nodes.begin();
+
   // We're done if we can't find any more nodes to contact.
-  m_next = end();
+  m_next = m_nodes.size();
 
-  for (accessor itr = base_type::begin(); itr != end(); ) {
+  for (auto node : m_nodes) {
     // If we have all we need, delete current node unless it is
     // currently being contacted.
-    if (!itr.node()->is_active() && needClosest <= 0 && (!itr.node()->is_good() || needGood <= 0)) {
-      delete itr.node();
-      erase(itr++);
+    if (!node->is_active() && needClosest <= 0 && (!node->is_good() || needGood <= 0)) {
+      delete node;
       continue;
     }
 
     // Otherwise adjust needed counts appropriately.
     needClosest--;
-    needGood -= itr.node()->is_good();
+    needGood -= node->is_good();
 
     // Remember the first uncontacted node as the closest one to contact next.
-    if (m_next == end() && node_uncontacted(itr.node()))
-      m_next = const_accessor(itr);
+    if (m_next == m_nodes.size() && node_uncontacted(node))
+      m_next = std::distance(m_nodes.begin(), last);
 
-    ++itr;
+    *last++ = node;
   }
 
+  if (m_next == m_nodes.size())
+    m_next = std::distance(m_nodes.begin(), last);
+
+  m_nodes.erase(last, m_nodes.end());
   m_restart = false;
 }
 
 DhtSearch::const_accessor
 DhtSearch::get_contact() {
-  if (m_pending >= m_concurrency)
+  if (m_pending >= m_alpha + m_stalled)
     return end();
 
   if (m_restart)
     trim(false);
 
-  const_accessor ret = m_next;
-  if (ret == end())
-    return ret;
+  if (m_next == m_nodes.size() || is_converged())
+    return end();
+
+  DhtNode* node = m_nodes[m_next];
 
-  set_node_active(ret, true);
+  set_node_active(node, true);
   m_pending++;
   m_contacted++;
 
   // Find next node to contact: any node we haven't contacted yet.
-  while (++m_next != end()) {
-    if (node_uncontacted(m_next.node()))
+  while (++m_next != m_nodes.size()) {
+    if (node_uncontacted(m_nodes[m_next]))
       break;
   }
 
-  return ret;
+  return const_accessor(node, this);
+}
+
+bool
+DhtSearch::is_converged() const {
+  unsigned int replied = 0;
+
+  for (auto node : m_nodes) {
+    if (node->is_bad())
+      continue;
+
+    // A closer node is still pending or uncontacted.
+    if (!node->is_good() || node->is_active())
+      return false;
+
+    if (++replied == converge_nodes)
+      return true;
+  }
+
+  return false;
 }
 
 void
-DhtSearch::node_status(const_accessor& n, bool success) {
-  if (n == end() || !n.node()->is_active())
+DhtSearch::abandon_pending() {
+  // Abandoning removes the transaction from the list.
+  while (!m_transactions.empty())
+    m_transactions.back()->abandon();
+}
+
+void
+DhtSearch::node_status(DhtNode* node, bool success) {
+  if (node == nullptr || !node->is_active())
     throw internal_error("DhtSearch::node_status called for invalid/inactive node.");
 
   if (success) {
-    n.node()->set_good();
+    node->set_good();
     m_replied++;
 
+    if (m_alpha > min_alpha)
+      m_alpha--;
+
   } else {
-    n.node()->set_bad();
+    node->set_bad();
+
+    if (m_alpha < max_alpha)
+      m_alpha++;
   }
 
   m_pending--;
-  set_node_active(n, false);
+  set_node_active(node, false);
 }
 
 DhtAnnounce::~DhtAnnounce() {
@@ -188,24 +228,24 @@ DhtAnnounce::~DhtAnnounce() {
     m_tracker->receive_success();
 }
 
-DhtSearch::const_accessor
+const DhtSearch::node_list&
 DhtAnnounce::start_announce() {
   trim(true);
 
   if (empty())
-    return end();
+    return m_nodes;
 
-  if (!complete() || m_next != end() || size() > DhtBucket::num_nodes)
+  if (!complete() || m_next != m_nodes.size() || size() > DhtBucket::num_nodes)
     throw internal_error("DhtSearch::start_announce called in inconsistent state.");
 
   m_contacted = m_pending = size();
   m_replied = 0;
   m_tracker->set_dht_state(TrackerDht::state_announcing);
 
-  for (const_accessor itr(begin()); itr != end(); ++itr)
-    set_node_active(itr, true);
+  for (auto node : m_nodes)
+    set_node_active(node, true);
 
-  return const_accessor(begin());
+  return m_nodes;
 }
 
 void
@@ -231,13 +271,24 @@ DhtTransaction::~DhtTransaction() {
     m_packet->set_failed();
 }
 
+DhtTransactionSearch::DhtTransactionSearch(int quick_timeout, int timeout, const DhtSearch::const_accessor& node)
+  : DhtTransaction(quick_timeout, timeout, node.node()->id(), node.node()->address()),
+    m_node(node),
+    m_search(node.search()) {
+
+  if (!m_hasQuickTimeout)
+    m_search->m_stalled++;
+
+  m_search->m_transactions.push_back(this);
+}
+
 void
 DhtTransactionSearch::set_stalled() {
   if (!m_hasQuickTimeout)
     throw internal_error("DhtTransactionSearch::set_stalled called on already stalled transaction.");
 
   m_hasQuickTimeout = false;
-  m_search->m_concurrency++;
+  m_search->m_stalled++;
 }
 
 void
@@ -249,13 +300,35 @@ DhtTransactionSearch::complete(bool success) {
     throw internal_error("DhtTransactionSearch::complete called for node from wrong search.");
 
   if (!m_hasQuickTimeout)
-    m_search->m_concurrency--;
+    m_search->m_stalled--;
+
+  auto& transactions = m_search->m_transactions;
+  transactions.erase(std::find(transactions.begin(), transactions.end(), this));
 
-  m_search->node_status(m_node, success);
+  m_search->node_status(m_node.node(), success);
   m_node = m_search->end();
 }
 
+// The node is dropped from the search as if it had failed, but without
+// raising alpha since it was not given the chance to reply.
+void
+DhtTransactionSearch::abandon() {
+  if (m_node == m_search->end())
+    throw internal_error("DhtTransactionSearch::abandon called on completed transaction.");
+
+  unsigned int alpha = m_search->m_alpha;
+
+  complete(false);
+
+  m_search->m_alpha = alpha;
+  m_search = nullptr;
+  m_hasQuickTimeout = false;
+}
+
 DhtTransactionSearch::~DhtTransactionSearch() {
+  if (m_search == nullptr)
+    return;
+
   if (m_node != m_search->end())
     complete(false);
 
@@ -37,13 +37,13 @@
 #ifndef LIBTORRENT_DHT_TRANSACTION_H
 #define LIBTORRENT_DHT_TRANSACTION_H
 
-#include <map>
 #include <memory>
+#include <vector>
 #include <rak/socket_address.h>
 
+#include "dht/dht_message.h"
 #include "dht/dht_node.h"
 #include "torrent/hash_string.h"
-#include "torrent/object_static_map.h"
 #include "tracker/tracker_dht.h"
 
 namespace torrent {
@@ -70,28 +70,16 @@ class DhtTransactionAnnouncePeer;
 // lead to an announce to the closest nodes.
 
 
-// Compare predicate for ID closeness.
-struct dht_compare_closer {
-  dht_compare_closer(const HashString& target) : m_target(target) { }
-
-  bool operator () (const DhtNode* one, const DhtNode* two) const;
-
-  const HashString&               target() const   { return m_target; }
-  raw_string                      target_raw_string() const { return raw_string(m_target.data(), HashString::size_data); }
-
-  private:
-  const HashString&    m_target;
-};
-
-// DhtSearch contains a list of nodes sorted by closeness to the given target,
-// and returns what nodes to contact with up to three concurrent transactions pending.
-// The map element is the DhtSearch object itself to allow the returned accessors
-// to know which search a given node belongs to.
-class DhtSearch : protected std::map<DhtNode*, DhtSearch*, dht_compare_closer> {
+// DhtSearch contains a flat array of nodes sorted by closeness to the
+// given target, and returns what nodes to contact with up to alpha
+// concurrent transactions pending. Accessors hold the node and its
+// search rather than a position, so they remain valid as closer nodes
+// are inserted.
+class DhtSearch {
   friend class DhtTransactionSearch;
 
 public:
-  using base_type = std::map<DhtNode*, DhtSearch*, dht_compare_closer>;
+  using node_list = std::vector<DhtNode*>;
 
   // Number of closest potential contact nodes to keep.
   static constexpr unsigned int max_contacts = 18;
@@ -99,67 +87,93 @@ public:
   // Number of closest nodes we actually announce to.
   static constexpr unsigned int max_announce = 3;
 
+  // Concurrent queries start at min_alpha, grow by one for each node
+  // that fails to reply and shrink again for each reply.
+  static constexpr unsigned int min_alpha = 3;
+  static constexpr unsigned int max_alpha = 8;
+
+  // The lookup has converged once this many of the closest nodes not
+  // known to be bad have replied.
+  static constexpr unsigned int converge_nodes = DhtBucket::num_nodes;
+
   DhtSearch(const HashString& target, const DhtBucket& contacts);
   virtual ~DhtSearch();
 
-  // Wrapper for iterators, allowing more convenient access to the key
-  // and element values, which also makes it easier to change the container
-  // without having to modify much code using iterators.
-  template <typename T>
-  struct accessor_wrapper : public T {
-    accessor_wrapper() = default;
-    accessor_wrapper(const T& itr) : T(itr) { }
+  class const_accessor {
+  public:
+    const_accessor() = default;
+    const_accessor(DhtNode* node, DhtSearch* search) : m_node(node), m_search(search) { }
 
-    DhtNode*                        node() const     { return (**this).first; }
-    DhtSearch*                      search() const   { return (**this).second; }
-  };
+    DhtNode*                        node() const     { return m_node; }
+    DhtSearch*                      search() const   { return m_search; }
 
-  using const_accessor = accessor_wrapper<base_type::const_iterator>;
-  using accessor       = accessor_wrapper<base_type::iterator>;
+    bool operator == (const const_accessor& other) const { return m_node == other.m_node && m_search == other.m_search; }
+    bool operator != (const const_accessor& other) const { return !(*this == other); }
+
+  private:
+    DhtNode*                        m_node{};
+    DhtSearch*                      m_search{};
+  };
 
   // Add a potential node to contact for the search.
   bool                 add_contact(const HashString& id, const rak::socket_address* sa);
   void                 add_contacts(const DhtBucket& contacts);
 
-  // Return next node to contact. Up to concurrent_searches nodes are returned,
-  // and end() after that. Don't advance the accessor to get further contacts!
+  // Return next node to contact. Up to alpha nodes are returned, and
+  // end() after that or once the search has converged.
   const_accessor       get_contact();
 
   // Search statistics.
   int                  num_contacted()                   { return m_contacted; }
   int                  num_replied()                     { return m_replied; }
+  unsigned int         alpha() const                     { return m_alpha; }
+
+  // Time since the search started, in milliseconds.
+  uint32_t             latency() const                   { return (cachedTime - m_startTime).usec() / 1000; }
 
   bool                 start()                           { m_started = true; return m_pending; }
   bool                 complete() const                  { return m_started && !m_pending; }
 
+  bool                 is_converged() const;
+
+  // Give up on the pending transactions, leaving them to time out
+  // without affecting the search.
+  void                 abandon_pending();
+
   const HashString&    target() const                    { return m_target; }
   raw_string           target_raw_string() const         { return raw_string(m_target.data(), HashString::size_data); }
 
   virtual bool         is_announce() const               { return false; }
 
-  // Expose the otherwise private end() function but return an accessor,
-  // to allow code checking whether get_contact returned a valid accessor.
-  const_accessor       end() const                       { return base_type::end(); }
+  bool                 empty() const                     { return m_nodes.empty(); }
+  size_t               size() const                      { return m_nodes.size(); }
+  const node_list&     nodes() const                     { return m_nodes; }
+
+  const_accessor       end()                             { return const_accessor(nullptr, this); }
 
   // Used by the sorting/comparison predicate to see which node is closer.
   static bool          is_closer(const HashString& one, const HashString& two, const HashString& target);
 
 protected:
   void                 trim(bool final);
-  void                 node_status(const_accessor& n, bool success);
-  void                 set_node_active(const_accessor& n, bool active);
+  void                 node_status(DhtNode* node, bool success);
+  void                 set_node_active(DhtNode* node, bool active);
+
+  node_list            m_nodes;
 
   // Statistics about contacted nodes.
   unsigned int         m_pending{0};
   unsigned int         m_contacted{0};
   unsigned int         m_replied{0};
-  unsigned int         m_concurrency{3};
+  unsigned int         m_alpha{min_alpha};
+  unsigned int         m_stalled{0};
 
   bool                 m_restart{false};  // If true, trim nodes and reset m_next on the following get_contact call.
   bool                 m_started{false};
 
-  // Next node to return in get_contact, is end() if we have no more contactable nodes.
-  const_accessor       m_next;
+  // Index of the next node to return in get_contact, is m_nodes.size()
+  // if we have no more contactable nodes.
+  size_t               m_next{0};
 
 private:
   DhtSearch(const DhtSearch&) = delete;
@@ -168,6 +182,9 @@ private:
   bool                 node_uncontacted(const DhtNode* node) const;
 
   HashString           m_target;
+  rak::timer           m_startTime;
+
+  std::vector<DhtTransactionSearch*> m_transactions;
 };
 
 class DhtAnnounce : public DhtSearch {
@@ -181,10 +198,10 @@ public:
 
   const TrackerDht*    tracker() const                   { return m_tracker; }
 
-  // Start announce and return final set of nodes in get_contact() calls.
+  // Start announce and return final set of nodes to announce to.
   // This resets DhtSearch's completed() function, which now
   // counts announces instead.
-  const_accessor       start_announce();
+  const node_list&     start_announce();
 
   void                 receive_peers(raw_list peers) { m_tracker->receive_peers(peers); }
   void                 update_status() { m_tracker->receive_progress(m_replied, m_contacted); }
@@ -193,49 +210,6 @@ private:
   TrackerDht*          m_tracker;
 };
 
-// Possible bencode keys in a DHT message.
-enum dht_keys {
-  key_a_id,
-  key_a_infoHash,
-  key_a_port,
-  key_a_target,
-  key_a_token,
-
-  key_e_0,
-  key_e_1,
-
-  key_q,
-
-  key_r_id,
-  key_r_nodes,
-  key_r_token,
-  key_r_values,
-
-  key_t,
-  key_v,
-  key_y,
-
-  key_LAST,
-};
-
-class DhtMessage : public static_map_type<dht_keys, key_LAST> {
-public:
-  using base_type = static_map_type<dht_keys, key_LAST>;
-
-  DhtMessage() : data_end(data) {};
-
-  // Must be big enough to hold one of the possible variable-sized reply data.
-  // Currently either:
-  // - error message (size doesn't really matter, it'll be truncated at worst)
-  // - announce token (8 bytes, needs 20 bytes buffer to build)
-  // Never more than one of the above.
-  // And additionally for queries we send:
-  // - transaction ID (3 bytes)
-  static constexpr size_t data_size = 64;
-  char data[data_size];
-  char* data_end;
-};
-
 // Class holding transaction data to be transmitted.
 class DhtTransactionPacket {
 public:
@@ -306,6 +280,9 @@ public:
   const rak::socket_address*  address()            { return &m_sa; }
 
   int                         timeout()            { return m_timeout; }
+
+  // Milliseconds since the transaction was created.
+  unsigned int                rtt() const          { return (cachedTime - m_created).usec() / 1000; }
   int                         quick_timeout()      { return m_quickTimeout; }
   bool                        has_quick_timeout()  { return m_hasQuickTimeout; }
 
@@ -334,6 +311,7 @@ private:
   rak::socket_address    m_sa;
   int                    m_timeout;
   int                    m_quickTimeout;
+  rak::timer             m_created{cachedTime};
   DhtTransactionPacket*  m_packet{};
 };
 
@@ -346,15 +324,17 @@ public:
   DhtSearch::const_accessor  node()                       { return m_node; }
   DhtSearch*                 search()                     { return m_search; }
 
+  // Abandoned transactions no longer belong to a search, replies and
+  // timeouts for them only update the routing table.
+  bool                       is_abandoned() const         { return m_search == nullptr; }
+
   void                       set_stalled();
 
   void                       complete(bool success);
+  void                       abandon();
 
 protected: 
-  DhtTransactionSearch(int quick_timeout, int timeout, DhtSearch::const_accessor& node)
-    : DhtTransaction(quick_timeout, timeout, node.node()->id(), node.node()->address()),
-      m_node(node),
-      m_search(node.search()) { if (!m_hasQuickTimeout) m_search->m_concurrency++; }
+  DhtTransactionSearch(int quick_timeout, int timeout, const DhtSearch::const_accessor& node);
 
 private:
   DhtSearch::const_accessor  m_node; 
@@ -372,7 +352,7 @@ public:
 
 class DhtTransactionFindNode : public DhtTransactionSearch {
 public:
-  DhtTransactionFindNode(DhtSearch::const_accessor& node)
+  DhtTransactionFindNode(const DhtSearch::const_accessor& node)
     : DhtTransactionSearch(4, 30, node) { }
 
   transaction_type           type() override               { return DHT_FIND_NODE; }
@@ -380,7 +360,7 @@ public:
 
 class DhtTransactionGetPeers : public DhtTransactionSearch {
 public:
-  DhtTransactionGetPeers(DhtSearch::const_accessor& node)
+  DhtTransactionGetPeers(const DhtSearch::const_accessor& node)
     : DhtTransactionSearch(-1, 30, node) { }
 
   transaction_type           type() override               { return DHT_GET_PEERS; }
@@ -409,21 +389,12 @@ private:
 
 inline bool
 DhtSearch::is_closer(const HashString& one, const HashString& two, const HashString& target) {
-  for (unsigned int i=0; i<one.size(); i++)
-    if (one[i] != two[i])
-      return static_cast<uint8_t>(one[i] ^ target[i]) < static_cast<uint8_t>(two[i] ^ target[i]);
-
-  return false;
+  return hash_string_is_closer(one, two, target);
 }
 
 inline void
-DhtSearch::set_node_active(const_accessor& n, bool active) {
-  n.node()->m_lastSeen = active;
-}
-
-inline bool
-dht_compare_closer::operator () (const DhtNode* one, const DhtNode* two) const {
-  return DhtSearch::is_closer(*one, *two, m_target);
+DhtSearch::set_node_active(DhtNode* node, bool active) {
+  node->m_lastSeen = active;
 }
 
 inline DhtTransaction::key_type
@@ -38,34 +38,183 @@
 
 #include <stdlib.h>
 #include <algorithm>
-#include <iterator>
 
 #include "torrent/exceptions.h"
 #include "available_list.h"
 
 namespace torrent {
 
+size_t
+AvailableList::compact6_hash::operator () (const SocketAddressCompact6& sa) const {
+  uint64_t words[3]{};
+  std::memcpy(words, &sa, sizeof(SocketAddressCompact6));
+
+  return std::hash<uint64_t>()(words[0] ^ (words[1] * 0x9e3779b97f4a7c15ull) ^ (words[2] << 32));
+}
+
+void
+AvailableList::clear() {
+  m_inet.clear();
+  m_inet6.clear();
+  m_inet_set.clear();
+  m_inet6_set.clear();
+  m_priority.clear();
+}
+
 AvailableList::value_type
 AvailableList::pop_random() {
   if (empty())
     throw internal_error("AvailableList::pop_random() called on an empty container");
 
-  size_type idx = random() % size();
+  value_type sa;
+
+  if (pop_priority(&sa))
+    return sa;
+
+  return pop_index(random() % size());
+}
+
+AvailableList::value_type
+AvailableList::pop_random(int family) {
+  if (empty())
+    throw internal_error("AvailableList::pop_random(family) called on an empty container");
 
-  value_type tmp = *(begin() + idx);
-  *(begin() + idx) = back();
+  value_type sa;
 
-  pop_back();
+  if (pop_priority(&sa))
+    return sa;
 
-  return tmp;
+  if ((family == AF_INET && !m_inet.empty()) || m_inet6.empty())
+    return pop_inet(random() % m_inet.size());
+  else
+    return pop_inet6(random() % m_inet6.size());
 }
 
-void
+AvailableList::value_type
+AvailableList::pop_best(int family, size_type samples, const slot_score& score) {
+  if (empty())
+    throw internal_error("AvailableList::pop_best(...) called on an empty container");
+
+  value_type sa;
+
+  if (pop_priority(&sa))
+    return sa;
+
+  bool      use_inet = (family == AF_INET && !m_inet.empty()) || m_inet6.empty();
+  size_type size     = use_inet ? m_inet.size() : m_inet6.size();
+
+  // Scan all addresses if there are no more than the samples.
+  bool      scan_all   = samples >= size;
+  size_type best_idx   = scan_all ? 0 : random() % size;
+  int64_t   best_score = score(use_inet ? value_type(m_inet[best_idx]) : value_type(m_inet6[best_idx]));
+
+  for (size_type i = 1; i < std::min(samples, size); i++) {
+    size_type idx     = scan_all ? i : random() % size;
+    int64_t   current = score(use_inet ? value_type(m_inet[idx]) : value_type(m_inet6[idx]));
+
+    if (current > best_score) {
+      best_idx = idx;
+      best_score = current;
+    }
+  }
+
+  return use_inet ? pop_inet(best_idx) : pop_inet6(best_idx);
+}
+
+bool
+AvailableList::pop_priority(value_type* sa) {
+  while (!m_priority.empty()) {
+    *sa = m_priority.front();
+    m_priority.pop_front();
+
+    if (contains(*sa)) {
+      erase(*sa);
+      return true;
+    }
+  }
+
+  return false;
+}
+
+AvailableList::value_type
+AvailableList::pop_index(size_type idx) {
+  if (idx < m_inet.size())
+    return pop_inet(idx);
+  else
+    return pop_inet6(idx - m_inet.size());
+}
+
+AvailableList::value_type
+AvailableList::pop_inet(size_type idx) {
+  SocketAddressCompact sa = m_inet[idx];
+
+  m_inet[idx] = m_inet.back();
+  m_inet.pop_back();
+  m_inet_set.erase(inet_key(sa));
+
+  return sa;
+}
+
+AvailableList::value_type
+AvailableList::pop_inet6(size_type idx) {
+  SocketAddressCompact6 sa = m_inet6[idx];
+
+  m_inet6[idx] = m_inet6.back();
+  m_inet6.pop_back();
+  m_inet6_set.erase(sa);
+
+  return sa;
+}
+
+bool
+AvailableList::contains(const rak::socket_address& sa) const {
+  switch (sa.family()) {
+  case rak::socket_address::af_inet:
+    return m_inet_set.find(inet_key(SocketAddressCompact(sa.sa_inet()))) != m_inet_set.end();
+  case rak::socket_address::af_inet6:
+    return m_inet6_set.find(SocketAddressCompact6(sa.sa_inet6())) != m_inet6_set.end();
+  default:
+    return false;
+  }
+}
+
+bool
 AvailableList::push_back(const rak::socket_address* sa) {
-  if (std::find(begin(), end(), *sa) != end())
-    return;
+  switch (sa->family()) {
+  case rak::socket_address::af_inet:
+    return push_back(SocketAddressCompact(sa->sa_inet()));
+  case rak::socket_address::af_inet6:
+    return push_back(SocketAddressCompact6(sa->sa_inet6()));
+  default:
+    return false;
+  }
+}
+
+bool
+AvailableList::push_back(const SocketAddressCompact& sa) {
+  if (!m_inet_set.insert(inet_key(sa)).second)
+    return false;
+
+  m_inet.push_back(sa);
+  return true;
+}
+
+bool
+AvailableList::push_back(const SocketAddressCompact6& sa) {
+  if (!m_inet6_set.insert(sa).second)
+    return false;
+
+  m_inet6.push_back(sa);
+  return true;
+}
+
+bool
+AvailableList::push_priority(const rak::socket_address* sa) {
+  if (!push_back(sa) && !contains(*sa))
+    return false;
 
-  base_type::push_back(*sa);
+  m_priority.push_back(*sa);
+  return true;
 }
 
 void
@@ -73,26 +222,75 @@ AvailableList::insert(AddressList* l) {
   if (!want_more())
     return;
 
-  std::sort(begin(), end());
+  for (const auto& sa : *l)
+    push_back(&sa);
+}
+
+// Set nodes are estimated as the value and a next pointer, plus the
+// bucket array.
+size_t
+AvailableList::sizeof_data() const {
+  return m_inet.capacity() * sizeof(SocketAddressCompact) + m_inet6.capacity() * sizeof(SocketAddressCompact6) +
+    m_inet_set.size() * (sizeof(uint64_t) + sizeof(void*)) + m_inet_set.bucket_count() * sizeof(void*) +
+    m_inet6_set.size() * (sizeof(SocketAddressCompact6) + sizeof(void*)) + m_inet6_set.bucket_count() * sizeof(void*) +
+    m_priority.size() * sizeof(value_type);
+}
+
+void
+AvailableList::shrink(size_type max) {
+  // Drop random addresses other than the prioritized ones, which are
+  // taken out while shrinking.
+  std::deque<value_type> priority;
+
+  for (const auto& sa : m_priority) {
+    if (!contains(sa))
+      continue;
+
+    erase(sa);
+    priority.push_back(sa);
+  }
+
+  while (!empty() && size() + priority.size() > max)
+    pop_index(random() % size());
+
+  for (const auto& sa : priority)
+    push_back(&sa);
 
-  // Can i use use the std::remove* semantics for this, and just copy
-  // to 'l'?.
-  //
-  // 'l' is guaranteed to be sorted, so we can just do
-  // std::set_difference.
-  AddressList difference;
-  std::set_difference(l->begin(), l->end(), begin(), end(), std::back_inserter(difference));
+  m_priority.swap(priority);
+  m_priority.shrink_to_fit();
 
-  static_cast<base_type*>(this)->insert(end(), difference.begin(), difference.end());
+  m_inet.shrink_to_fit();
+  m_inet6.shrink_to_fit();
+  m_inet_set.rehash(0);
+  m_inet6_set.rehash(0);
 }
 
 void
 AvailableList::erase(const rak::socket_address& sa) {
-  auto itr = std::find(begin(), end(), sa);
+  if (!contains(sa))
+    return;
+
+  if (sa.family() == rak::socket_address::af_inet) {
+    SocketAddressCompact compact(sa.sa_inet());
+
+    auto itr = std::find_if(m_inet.begin(), m_inet.end(), [&compact](const SocketAddressCompact& e) {
+        return e.addr == compact.addr && e.port == compact.port;
+      });
+
+    *itr = m_inet.back();
+    m_inet.pop_back();
+    m_inet_set.erase(inet_key(compact));
+
+  } else {
+    SocketAddressCompact6 compact(sa.sa_inet6());
+
+    auto itr = std::find_if(m_inet6.begin(), m_inet6.end(), [&compact](const SocketAddressCompact6& e) {
+        return compact6_equal()(e, compact);
+      });
 
-  if (itr != end()) {
-    *itr = back();
-    pop_back();
+    *itr = m_inet6.back();
+    m_inet6.pop_back();
+    m_inet6_set.erase(compact);
   }
 }
 
@@ -37,63 +37,119 @@
 #ifndef LIBTORRENT_DOWNLOAD_AVAILABLE_LIST_H
 #define LIBTORRENT_DOWNLOAD_AVAILABLE_LIST_H
 
+#include <cstring>
+#include <deque>
+#include <functional>
+#include <unordered_set>
 #include <vector>
-#include <list>
 
 #include <rak/socket_address.h>
 
 #include "net/address_list.h"
+#include "torrent/memory_manager.h"
 
 namespace torrent {
 
-class AvailableList : private std::vector<rak::socket_address> {
+// Addresses of peers we may connect to, stored as packed 6 and 18
+// byte compact entries. A hash set of the entries allows adding
+// without checking the whole list for duplicates, and pop_random()
+// swaps the last entry into the hole.
+//
+// Addresses added with push_priority() are popped first, in the order
+// they were added, regardless of family or score.
+
+class AvailableList {
 public:
-  using base_type = std::vector<rak::socket_address>;
-  using size_type = uint32_t;
-
-  using base_type::value_type;
-  using base_type::reference;
-  using base_type::const_reference;
-
-  using base_type::iterator;
-  using base_type::const_iterator;
-  using base_type::reverse_iterator;
-  using base_type::size;
-  using base_type::capacity;
-  using base_type::reserve;
-  using base_type::empty;
-  using base_type::clear;
-
-  using base_type::back;
-  using base_type::pop_back;
-  using base_type::begin;
-  using base_type::end;
-  using base_type::rbegin;
-  using base_type::rend;
+  using value_type = rak::socket_address;
+  using size_type  = uint32_t;
+  using slot_score = std::function<int64_t(const value_type&)>;
+
+  size_type           size() const                       { return m_inet.size() + m_inet6.size(); }
+  bool                empty() const                      { return m_inet.empty() && m_inet6.empty(); }
+  void                clear();
+
+  size_type           size_inet() const                  { return m_inet.size(); }
+  size_type           size_inet6() const                 { return m_inet6.size(); }
 
   value_type          pop_random();
 
+  // Pops an address of the family if there is one, otherwise of the
+  // other family.
+  value_type          pop_random(int family);
+
+  // Pops the highest scored of 'samples' random addresses, or of all
+  // if there are no more, preferring the family like pop_random.
+  value_type          pop_best(int family, size_type samples, const slot_score& score);
+
   // Fuzzy size limit.
   size_type           max_size() const                   { return m_maxSize; }
   void                set_max_size(size_type s)          { m_maxSize = s; }
 
   bool                want_more() const                  { return size() <= m_maxSize; }
 
-  // This push is somewhat inefficient as it iterates through the
-  // whole container to see if the address already exists.
-  void                push_back(const rak::socket_address* sa);
+  bool                contains(const rak::socket_address& sa) const;
+
+  // Returns false if the address was already in the list or is not
+  // an inet or inet6 address.
+  bool                push_back(const rak::socket_address* sa);
+  bool                push_back(const SocketAddressCompact& sa);
+  bool                push_back(const SocketAddressCompact6& sa);
+
+  // Adds the address unless already present, and queues it to be
+  // popped before the others.
+  bool                push_priority(const rak::socket_address* sa);
+
+  size_type           size_priority() const               { return m_priority.size(); }
 
   void                insert(AddressList* l);
+
+  // Drops random addresses until at most 'max' remain, and releases
+  // the unused capacity.
+  void                shrink(size_type max);
+
+  size_t              sizeof_data() const;
+
+  // Only the membership test is constant time, removing an address
+  // that is in the list searches for it.
   void                erase(const rak::socket_address& sa);
-  void                erase(iterator itr)                 { *itr = back(); pop_back(); }
-  
+
   // A place to temporarily put addresses before re-adding them to the
   // AvailableList.
   AddressList*        buffer()                            { return &m_buffer; }
 
 private:
+  struct compact6_hash {
+    size_t operator () (const SocketAddressCompact6& sa) const;
+  };
+
+  struct compact6_equal {
+    bool operator () (const SocketAddressCompact6& a, const SocketAddressCompact6& b) const {
+      return std::memcmp(&a, &b, sizeof(SocketAddressCompact6)) == 0;
+    }
+  };
+
+  bool                pop_priority(value_type* sa);
+
+  value_type          pop_index(size_type idx);
+  value_type          pop_inet(size_type idx);
+  value_type          pop_inet6(size_type idx);
+
+  static uint64_t     inet_key(const SocketAddressCompact& sa) { return (uint64_t(sa.addr) << 16) | sa.port; }
+
   size_type           m_maxSize{1000};
 
+  template <typename T>
+  using allocator_type = memory_counting_allocator<T, MemoryManager::category_available_list>;
+
+  std::vector<SocketAddressCompact, allocator_type<SocketAddressCompact>>   m_inet;
+  std::vector<SocketAddressCompact6, allocator_type<SocketAddressCompact6>> m_inet6;
+
+  std::unordered_set<uint64_t, std::hash<uint64_t>, std::equal_to<uint64_t>, allocator_type<uint64_t>> m_inet_set;
+  std::unordered_set<SocketAddressCompact6, compact6_hash, compact6_equal, allocator_type<SocketAddressCompact6>> m_inet6_set;
+
+  // May hold addresses since erased or popped, which are skipped.
+  std::deque<value_type> m_priority;
+
   AddressList         m_buffer;
 };
 
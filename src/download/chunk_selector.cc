@@ -69,6 +69,8 @@ void
 ChunkSelector::cleanup() {
   m_data->mutable_untouched_bitfield()->clear();
   m_statistics = NULL;
+
+  clear_deadlines();
 }
 
 // Consider if ChunksSelector::not_using_index(...) needs to be
@@ -92,6 +94,26 @@ ChunkSelector::find(PeerChunks* pc, [[maybe_unused]] bool highPriority) {
   if (m_position == invalid_chunk)
     return invalid_chunk;
 
+  if (m_locality_window == 0)
+    return find_rarest(pc);
+
+  uint32_t index = find_adjacent(pc);
+
+  if (index != invalid_chunk) {
+    pc->set_locality(index + 1, pc->locality_left() - 1);
+    return index;
+  }
+
+  index = find_rarest(pc);
+
+  if (index != invalid_chunk)
+    pc->set_locality(index + 1, m_locality_window);
+
+  return index;
+}
+
+uint32_t
+ChunkSelector::find_rarest(PeerChunks* pc) {
   // When we're a seeder, 'm_sharedQueue' is used. Since the peer's
   // bitfield is guaranteed to be filled we can use the same code as
   // for non-seeders. This generalization does incur a slight
@@ -99,13 +121,10 @@ ChunkSelector::find(PeerChunks* pc, [[maybe_unused]] bool highPriority) {
   // set.
   rak::partial_queue* queue = pc->is_seeder() ? &m_sharedQueue : pc->download_cache();
 
-  // Randomize position on average every 16 chunks to prevent
-  // inefficient distribution with a slow seed and fast peers
-  // all arriving at the same position.
-  if ((random() & 63) == 0) {
-    m_position = random() % size();
+  // Drop the cached queue on average every 64 chunks so it picks up
+  // changes in rarity.
+  if ((random() & 63) == 0)
     queue->clear();
-  }
 
   if (queue->is_enabled()) {
 
@@ -127,8 +146,7 @@ ChunkSelector::find(PeerChunks* pc, [[maybe_unused]] bool highPriority) {
 
   queue->clear();
 
-  (search_linear(pc->bitfield(), queue, m_data->high_priority(), m_position, size()) &&
-   search_linear(pc->bitfield(), queue, m_data->high_priority(), 0, m_position));
+  search_rarest(pc->bitfield(), queue, m_data->high_priority());
 
   if (queue->prepare_pop()) {
     // Set that the peer has high priority pieces cached.
@@ -139,8 +157,7 @@ ChunkSelector::find(PeerChunks* pc, [[maybe_unused]] bool highPriority) {
     // Urgh...
     queue->clear();
 
-    (search_linear(pc->bitfield(), queue, m_data->normal_priority(), m_position, size()) &&
-     search_linear(pc->bitfield(), queue, m_data->normal_priority(), 0, m_position));
+    search_rarest(pc->bitfield(), queue, m_data->normal_priority());
 
     if (!queue->prepare_pop())
       return invalid_chunk;
@@ -154,11 +171,116 @@ ChunkSelector::find(PeerChunks* pc, [[maybe_unused]] bool highPriority) {
   return pos;
 }
 
+uint32_t
+ChunkSelector::find_adjacent(PeerChunks* pc) {
+  uint32_t next = pc->locality_next();
+
+  if (pc->locality_left() == 0 || next >= size())
+    return invalid_chunk;
+
+  const download_data::priority_ranges* ranges =
+    m_data->high_priority()->has(next - 1) ? m_data->high_priority() : m_data->normal_priority();
+
+  uint32_t last = next + std::min(m_locality_window, size() - next);
+
+  for (uint32_t index = next; index != last; index++)
+    if (m_data->untouched_bitfield()->get(index) && pc->bitfield()->get(index) && ranges->has(index))
+      return index;
+
+  return invalid_chunk;
+}
+
 bool
 ChunkSelector::is_wanted(uint32_t index) const {
   return m_data->untouched_bitfield()->get(index) && (m_data->normal_priority()->has(index) || m_data->high_priority()->has(index));
 }
 
+bool
+ChunkSelector::has_wanted(const Bitfield* bf) const {
+  if (bf->empty() || m_data->untouched_bitfield()->empty())
+    return false;
+
+  for (auto ranges : { m_data->high_priority(), m_data->normal_priority() })
+    for (const auto& range : *ranges)
+      if (bf->count_and(*m_data->untouched_bitfield(), std::min(range.first, size()), std::min(range.second, size())) != 0)
+        return true;
+
+  return false;
+}
+
+void
+ChunkSelector::set_deadline(uint32_t first, uint32_t last, std::chrono::microseconds deadline) {
+  if (first > last)
+    throw internal_error("ChunkSelector::set_deadline(...) first > last.");
+
+  for (uint32_t index = first; index != last; index++) {
+    auto [itr, inserted] = m_deadlines.emplace(index, deadline);
+
+    if (!inserted) {
+      m_deadline_order.erase({itr->second, index});
+      itr->second = deadline;
+    }
+
+    m_deadline_order.emplace(deadline, index);
+  }
+}
+
+void
+ChunkSelector::clear_deadlines() {
+  m_deadlines.clear();
+  m_deadline_order.clear();
+}
+
+std::chrono::microseconds
+ChunkSelector::deadline(uint32_t index) const {
+  auto itr = m_deadlines.find(index);
+
+  return itr != m_deadlines.end() ? itr->second : std::chrono::microseconds{};
+}
+
+uint32_t
+ChunkSelector::find_deadline(PeerChunks* pc, uint32_t chunk_size) {
+  if (m_deadlines.empty() || empty())
+    return invalid_chunk;
+
+  auto     now  = this_thread::cached_time();
+  uint64_t rate = pc->download_throttle()->rate()->rate();
+
+  for (auto itr = m_deadline_order.begin(); itr != m_deadline_order.end();) {
+    uint32_t index = itr->second;
+
+    if (index >= size() || m_data->completed_bitfield()->get(index)) {
+      m_deadlines.erase(index);
+      itr = m_deadline_order.erase(itr);
+      continue;
+    }
+
+    auto current = itr++;
+
+    if (!m_data->untouched_bitfield()->get(index) || !pc->bitfield()->get(index) || !is_wanted(index))
+      continue;
+
+    auto remaining = current->first - now;
+
+    // Far from the deadline any peer will do, while late chunks go to
+    // whoever is actually sending data.
+    if (remaining >= deadline_near_window)
+      return index;
+
+    if (remaining <= std::chrono::microseconds{}) {
+      if (rate != 0)
+        return index;
+
+      continue;
+    }
+
+    if (rate * remaining.count() >= uint64_t{chunk_size} * 1000000)
+      return index;
+  }
+
+  return invalid_chunk;
+}
+
 void
 ChunkSelector::using_index(uint32_t index) {
   if (index >= size())
@@ -213,62 +335,39 @@ ChunkSelector::received_have_chunk(PeerChunks* pc, uint32_t index) {
   return true;
 }
 
-bool
-ChunkSelector::search_linear(const Bitfield* bf, rak::partial_queue* pq, const download_data::priority_ranges* ranges, uint32_t first, uint32_t last) {
-  auto itr = ranges->find(first);
-
-  while (itr != ranges->end() && itr->first < last) {
-
-    if (!search_linear_range(bf, pq, std::max(first, itr->first), std::min(last, itr->second)))
-      return false;
-
-    ++itr;    
-  }
+void
+ChunkSelector::search_rarest(const Bitfield* bf, rak::partial_queue* pq, const download_data::priority_ranges* ranges) {
+  if (ranges->empty())
+    return;
 
-  return true;
-}
+  const Bitfield* untouched = m_data->untouched_bitfield();
 
-// Could propably add another argument for max seen or something, this
-// would be used to find better chunks to request.
-inline bool
-ChunkSelector::search_linear_range(const Bitfield* bf, rak::partial_queue* pq, uint32_t first, uint32_t last) {
-  if (first >= last || last > size())
-    throw internal_error("ChunkSelector::search_linear_range(...) received an invalid range.");
+  // Every chunk found is at least as common as the previous ones, so
+  // stop once there's enough to fill one layer.
+  uint32_t remaining = pq->max_layer_size();
 
-  Bitfield::const_iterator local  = m_data->untouched_bitfield()->begin() + first / 8;
-  Bitfield::const_iterator source = bf->begin() + first / 8;
+  for (uint32_t r = 0; r <= ChunkStatistics::max_accounted; r++) {
+    uint32_t first = m_statistics->rarity_begin(r);
+    uint32_t count = m_statistics->rarity_end(r) - first;
 
-  // Unset any bits before 'first'.
-  Bitfield::value_type wanted = (*source & *local) & Bitfield::mask_from(first % 8);
+    if (count == 0)
+      continue;
 
-  while (m_data->untouched_bitfield()->position(local + 1) < last) {
-    if (wanted && !search_linear_byte(pq, m_data->untouched_bitfield()->position(local), wanted))
-      return false;
+    uint32_t offset = random() % count;
 
-    wanted = (*++source & *++local);
-  }
-  
-  // Unset any bits from 'last'.
-  wanted &= Bitfield::mask_before(last - m_data->untouched_bitfield()->position(local));
+    for (uint32_t i = 0; i != count; i++) {
+      uint32_t index = m_statistics->rarest_at(first + (offset + i) % count);
 
-  if (wanted)
-    return search_linear_byte(pq, m_data->untouched_bitfield()->position(local), wanted);
-  else
-    return true;
-}
+      if (!untouched->get(index) || !bf->get(index) || !ranges->has(index))
+        continue;
 
-// Take pointer to partial_queue
-inline bool
-ChunkSelector::search_linear_byte(rak::partial_queue* pq, uint32_t index, Bitfield::value_type wanted) {
-  for (int i = 0; i < 8; ++i) {
-    if (!(wanted & Bitfield::mask_at(i)))
-      continue;
+      if (!pq->insert(r, index))
+        return;
 
-    if (!pq->insert(m_statistics->rarity(index + i), index + i) && pq->is_full())
-      return false;
+      if (--remaining == 0)
+        return;
+    }
   }
-
-  return true;
 }
 
 void
@@ -37,7 +37,10 @@
 #ifndef LIBTORRENT_DOWNLOAD_CHUNK_SELECTOR_H
 #define LIBTORRENT_DOWNLOAD_CHUNK_SELECTOR_H
 
+#include <chrono>
 #include <cinttypes>
+#include <map>
+#include <set>
 #include <rak/partial_queue.h>
 
 #include "torrent/bitfield.h"
@@ -61,6 +64,10 @@ class ChunkSelector {
 public:
   static constexpr auto invalid_chunk = ~uint32_t{0};
 
+  // Chunks further than this from their deadline are picked for any
+  // peer, closer chunks only for peers fast enough to finish them.
+  static constexpr std::chrono::seconds deadline_near_window{10};
+
   ChunkSelector(download_data* data) : m_data(data) {}
 
   bool                empty() const                 { return size() == 0; }
@@ -83,8 +90,36 @@ public:
 
   uint32_t            find(PeerChunks* pc, bool highPriority);
 
+  // With a non-zero window, each chunk picked for a peer is followed
+  // by the next wanted chunk it has within 'window' chunks after it,
+  // skipping those already in progress or completed, for up to
+  // 'window' picks. Rarest-first then picks where the peer's next run
+  // starts. This keeps writes mostly sequential for disks that handle
+  // random writes poorly, at some cost to the spread of rare chunks.
+  uint32_t            locality_window() const       { return m_locality_window; }
+  void                set_locality_window(uint32_t w) { m_locality_window = w; }
+
   bool                is_wanted(uint32_t index) const;
 
+  // Returns true if 'bf' has any untouched chunk with a priority.
+  bool                has_wanted(const Bitfield* bf) const;
+
+  // Chunks in [first, last> get an absolute deadline, replacing any
+  // earlier one. These are picked in deadline order before the
+  // rarest-first search, which keeps running for the remaining
+  // chunks.
+  void                set_deadline(uint32_t first, uint32_t last, std::chrono::microseconds deadline);
+  void                clear_deadlines();
+
+  // Returns zero if the chunk has no deadline.
+  std::chrono::microseconds deadline(uint32_t index) const;
+  size_t              size_deadlines() const        { return m_deadlines.size(); }
+
+  // Returns the untouched chunk with the earliest deadline that 'pc'
+  // can be expected to finish in time, or invalid_chunk. Completed
+  // chunks are pruned from the deadline list.
+  uint32_t            find_deadline(PeerChunks* pc, uint32_t chunk_size);
+
   // Call this to set the index as being downloaded, finished etc,
   // thus ignored. Propably should find a better name for this.
   void                using_index(uint32_t index);
@@ -101,16 +136,22 @@ public:
   bool                received_have_chunk(PeerChunks* pc, uint32_t index);
 
 private:
-  bool                search_linear(const Bitfield* bf, rak::partial_queue* pq, const download_data::priority_ranges* ranges, uint32_t first, uint32_t last);
-  inline bool         search_linear_range(const Bitfield* bf, rak::partial_queue* pq, uint32_t first, uint32_t last);
-  inline bool         search_linear_byte(rak::partial_queue* pq, uint32_t index, Bitfield::value_type wanted);
+  uint32_t            find_rarest(PeerChunks* pc);
+
+  // Returns the chunk extending the peer's current run, in the same
+  // priority as its last pick, or invalid_chunk.
+  uint32_t            find_adjacent(PeerChunks* pc);
 
-//   inline uint32_t     search_rarest(const Bitfield* bf, priority_ranges* ranges, uint32_t first, uint32_t last);
-//   inline uint32_t     search_rarest_range(const Bitfield* bf, uint32_t first, uint32_t last);
-//   inline uint32_t     search_rarest_byte(uint8_t wanted);
+  // Fills 'pq' with the rarest wanted chunks in 'bf', walking the
+  // rarity buckets of ChunkStatistics from the rarest. Ties are
+  // broken by starting each bucket at a random position.
+  void                search_rarest(const Bitfield* bf, rak::partial_queue* pq, const download_data::priority_ranges* ranges);
 
   void                advance_position();
 
+  using deadline_map   = std::map<uint32_t, std::chrono::microseconds>;
+  using deadline_order = std::set<std::pair<std::chrono::microseconds, uint32_t>>;
+
   download_data*      m_data;
 
   ChunkStatistics*    m_statistics;
@@ -118,6 +159,10 @@ private:
   rak::partial_queue  m_sharedQueue;
 
   uint32_t            m_position;
+  uint32_t            m_locality_window{0};
+
+  deadline_map        m_deadlines;
+  deadline_order      m_deadline_order;
 };
 
 }
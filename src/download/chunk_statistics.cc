@@ -43,9 +43,33 @@
 #include "chunk_statistics.h"
 
 #include <algorithm>
+#include <cstring>
 
 namespace torrent {
 
+namespace {
+
+// Maps a bitfield byte to eight counter increments, with byte 'k' of
+// the word holding bit 'k' of the bitfield byte.
+struct expand_table {
+  expand_table() {
+    for (unsigned int i = 0; i < 256; i++) {
+      uint8_t bytes[8];
+
+      for (unsigned int k = 0; k < 8; k++)
+        bytes[k] = (i & Bitfield::mask_at(k)) != 0;
+
+      std::memcpy(&values[i], bytes, sizeof(bytes));
+    }
+  }
+
+  uint64_t values[256];
+};
+
+const expand_table bitfield_expand_table;
+
+}
+
 inline bool
 ChunkStatistics::should_add(PeerChunks* pc) {
   return m_accounted < max_accounted;
@@ -57,6 +81,30 @@ ChunkStatistics::initialize(size_type s) {
     throw internal_error("ChunkStatistics::initialize(...) called on an initialized object.");
 
   base_type::resize(s);
+
+  m_order.resize(s);
+  m_order_position.resize(s);
+
+  for (size_type i = 0; i != s; i++) {
+    m_order[i] = i;
+    m_order_position[i] = i;
+  }
+
+  m_rarity_first.fill(s);
+  m_rarity_first[0] = 0;
+}
+
+double
+ChunkStatistics::distributed_copies() const {
+  if (empty())
+    return m_complete;
+
+  size_type rarity = 0;
+
+  while (rarity_begin(rarity) == rarity_end(rarity))
+    rarity++;
+
+  return m_complete + rarity + static_cast<double>(size() - rarity_end(rarity)) / size();
 }
 
 void
@@ -65,6 +113,119 @@ ChunkStatistics::clear() {
     throw internal_error("ChunkStatistics::clear() m_complete != 0.");
 
   base_type::clear();
+  base_type::shrink_to_fit();
+
+  m_order.clear();
+  m_order.shrink_to_fit();
+  m_order_position.clear();
+  m_order_position.shrink_to_fit();
+  m_rarity_first.fill(0);
+}
+
+void
+ChunkStatistics::swap_order(size_type pos_a, size_type pos_b) {
+  std::swap(m_order[pos_a], m_order[pos_b]);
+
+  m_order_position[m_order[pos_a]] = pos_a;
+  m_order_position[m_order[pos_b]] = pos_b;
+}
+
+// Move the chunk to the end of its bucket and shrink the bucket,
+// leaving it first in the next one.
+void
+ChunkStatistics::increment(size_type index) {
+  value_type r = base_type::operator[](index);
+
+  if (r == max_accounted)
+    throw internal_error("ChunkStatistics::increment(...) rarity overflow.");
+
+  swap_order(m_order_position[index], --m_rarity_first[r + 1]);
+  base_type::operator[](index)++;
+}
+
+void
+ChunkStatistics::decrement(size_type index) {
+  value_type r = base_type::operator[](index);
+
+  if (r == 0)
+    throw internal_error("ChunkStatistics::decrement(...) rarity underflow.");
+
+  swap_order(m_order_position[index], m_rarity_first[r]++);
+  base_type::operator[](index)--;
+}
+
+// Sparse bitfields update the buckets chunk by chunk. Denser ones add
+// eight counters at a time from a lookup table and rebuild the
+// order. The counters are at most 'max_accounted', and the peer was
+// either not yet counted or is being removed, so no counter carries
+// into or borrows from its neighbour.
+template <bool Add>
+void
+ChunkStatistics::add_bitfield(const Bitfield* bitfield) {
+  if (bitfield->size_bits() != size())
+    throw internal_error("ChunkStatistics::add_bitfield(...) bitfield size mismatch.");
+
+  if (static_cast<uint64_t>(bitfield->size_set()) * bulk_update_ratio < size()) {
+    for (auto index = bitfield->find_first_set(); index != bitfield->size_bits(); index = bitfield->find_first_set(index + 1))
+      if (Add)
+        increment(index);
+      else
+        decrement(index);
+
+    return;
+  }
+
+  add_bitfield_counters<Add>(bitfield);
+  rebuild_order();
+}
+
+// Updates the counters without touching the rarity order, the caller
+// must call rebuild_order() afterwards.
+template <bool Add>
+void
+ChunkStatistics::add_bitfield_counters(const Bitfield* bitfield) {
+  uint8_t*       counters = base_type::data();
+  const uint8_t* bits     = bitfield->begin();
+  size_type      words    = size() / 8;
+
+  for (size_type i = 0; i != words; i++) {
+    uint64_t c;
+    std::memcpy(&c, counters + 8 * i, sizeof(c));
+
+    if (Add)
+      c += bitfield_expand_table.values[bits[i]];
+    else
+      c -= bitfield_expand_table.values[bits[i]];
+
+    std::memcpy(counters + 8 * i, &c, sizeof(c));
+  }
+
+  for (size_type index = words * 8; index != size(); index++)
+    if (Add)
+      counters[index] += bitfield->get(index);
+    else
+      counters[index] -= bitfield->get(index);
+}
+
+// Counting sort of the chunks by rarity.
+void
+ChunkStatistics::rebuild_order() {
+  m_rarity_first.fill(0);
+
+  for (auto c : static_cast<const base_type&>(*this))
+    m_rarity_first[c + 1]++;
+
+  for (size_type r = 1; r != m_rarity_first.size(); r++)
+    m_rarity_first[r] += m_rarity_first[r - 1];
+
+  auto next = m_rarity_first;
+
+  for (size_type index = 0; index != size(); index++) {
+    size_type pos = next[base_type::operator[](index)]++;
+
+    m_order[pos] = index;
+    m_order_position[index] = pos;
+  }
 }
 
 void
@@ -82,11 +243,7 @@ ChunkStatistics::received_connect(PeerChunks* pc) {
     pc->set_using_counter(true);
     m_accounted++;
 
-    auto itr = base_type::begin();
-
-    // Use a bitfield iterator instead.
-    for (Bitfield::size_type index = 0; index < pc->bitfield()->size_bits(); ++index, ++itr)
-      *itr += pc->bitfield()->get(index);
+    add_bitfield<true>(pc->bitfield());
   }
 }
 
@@ -110,11 +267,7 @@ ChunkStatistics::received_disconnect(PeerChunks* pc) {
 
     m_accounted--;
 
-    auto itr = base_type::begin();
-
-    // Use a bitfield iterator instead.
-    for (Bitfield::size_type index = 0; index < pc->bitfield()->size_bits(); ++index, ++itr)
-      *itr -= pc->bitfield()->get(index);
+    add_bitfield<false>(pc->bitfield());
   }
 }
 
@@ -137,7 +290,7 @@ ChunkStatistics::received_have_chunk(PeerChunks* pc, uint32_t index, uint32_t le
   
   if (pc->using_counter()) {
 
-    base_type::operator[](index)++;
+    increment(index);
 
     // The below code should not cause useless work to be done in case
     // of immediate disconnect.
@@ -149,6 +302,11 @@ ChunkStatistics::received_have_chunk(PeerChunks* pc, uint32_t index, uint32_t le
       m_accounted--;
 
       std::transform(base_type::begin(), base_type::end(), base_type::begin(), [] (auto c) { return c - 1; });
+
+      // Every chunk had a rarity of at least one, so shifting the
+      // buckets down keeps the order valid.
+      std::copy(m_rarity_first.begin() + 1, m_rarity_first.end(), m_rarity_first.begin());
+      m_rarity_first.back() = size();
     }
 
   } else {
@@ -160,4 +318,40 @@ ChunkStatistics::received_have_chunk(PeerChunks* pc, uint32_t index, uint32_t le
   }
 }
 
+void
+ChunkStatistics::received_disconnect(PeerChunks** first, PeerChunks** last) {
+  if (last - first == 1)
+    return received_disconnect(*first);
+
+  bool changed = false;
+
+  for (; first != last; first++) {
+    PeerChunks* pc = *first;
+
+    if (!pc->using_counter())
+      continue;
+
+    pc->set_using_counter(false);
+
+    if (pc->bitfield()->is_all_set()) {
+      m_complete--;
+      continue;
+    }
+
+    if (m_accounted == 0)
+      throw internal_error("ChunkStatistics::received_disconnect(...) m_accounted == 0.");
+
+    if (pc->bitfield()->size_bits() != size())
+      throw internal_error("ChunkStatistics::received_disconnect(...) bitfield size mismatch.");
+
+    m_accounted--;
+
+    add_bitfield_counters<false>(pc->bitfield());
+    changed = true;
+  }
+
+  if (changed)
+    rebuild_order();
+}
+
 }
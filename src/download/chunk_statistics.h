@@ -37,11 +37,13 @@
 #ifndef LIBTORRENT_DOWNLOAD_CHUNK_STATISTICS_H
 #define LIBTORRENT_DOWNLOAD_CHUNK_STATISTICS_H
 
+#include <array>
 #include <cinttypes>
 #include <vector>
 
 namespace torrent {
 
+class Bitfield;
 class PeerChunks;
 
 class ChunkStatistics : public std::vector<uint8_t> {
@@ -61,6 +63,10 @@ public:
 
   static constexpr size_type max_accounted = 255;
 
+  // Bitfields with at least 1/ratio of the chunks set are added to
+  // the counters in bulk instead of chunk by chunk.
+  static constexpr size_type bulk_update_ratio = 4;
+
   ChunkStatistics() = default;
   ~ChunkStatistics() = default;
   ChunkStatistics(const ChunkStatistics&) = delete;
@@ -72,6 +78,11 @@ public:
   // Number of non-complete peers whom's bitfield is added to the
   // statistics.
   size_type           accounted() const             { return m_accounted; }
+
+  // Estimated number of complete copies among the peers, the
+  // seeders and the rarity of the rarest chunk plus the fraction of
+  // chunks more common than it.
+  double              distributed_copies() const;
   
   void                initialize(size_type s);
   void                clear();
@@ -91,6 +102,10 @@ public:
   void                received_connect(PeerChunks* pc);
   void                received_disconnect(PeerChunks* pc);
 
+  // Removes the peers in bulk, subtracting their bitfields from the
+  // counters and rebuilding the rarity order only once.
+  void                received_disconnect(PeerChunks** first, PeerChunks** last);
+
   // The caller must ensure that the chunk index is valid and has not
   // been set already.
   void                received_have_chunk(PeerChunks* pc, uint32_t index, uint32_t length);
@@ -102,10 +117,36 @@ public:
 
   const_reference     operator [] (size_type n) const { return base_type::operator[](n); }
 
+  // The chunks are also kept ordered by rarity, with the positions
+  // [rarity_begin(r), rarity_end(r)> holding the chunks of rarity
+  // 'r' in no particular order. Changing the rarity of a chunk swaps
+  // it to the edge of its bucket and moves the bucket boundary, so
+  // updates are O(1).
+  size_type           rarity_begin(size_type r) const { return m_rarity_first[r]; }
+  size_type           rarity_end(size_type r) const   { return m_rarity_first[r + 1]; }
+
+  size_type           rarest_at(size_type pos) const  { return m_order[pos]; }
+
 private:
   inline bool         should_add(PeerChunks* pc);
+
+  void                increment(size_type index);
+  void                decrement(size_type index);
+  void                swap_order(size_type pos_a, size_type pos_b);
+
+  template <bool Add>
+  void                add_bitfield(const Bitfield* bitfield);
+  template <bool Add>
+  void                add_bitfield_counters(const Bitfield* bitfield);
+  void                rebuild_order();
+
   size_type           m_complete{};
   size_type           m_accounted{};
+
+  std::vector<size_type> m_order;
+  std::vector<size_type> m_order_position;
+
+  std::array<size_type, max_accounted + 2> m_rarity_first{};
 };
 
 }
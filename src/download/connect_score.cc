@@ -0,0 +1,37 @@
+#include "config.h"
+
+#include "download/connect_score.h"
+
+#include <algorithm>
+
+#include "torrent/net/socket_address.h"
+#include "torrent/peer/peer_info.h"
+
+namespace torrent {
+
+int64_t
+connect_score::calculate(const sockaddr* sa, const PeerInfo* peer_info, const sockaddr* own_address, int64_t hint) {
+  int64_t score = hint;
+
+  if (own_address != nullptr) {
+    int64_t bits = sa_common_prefix(sa, own_address);
+
+    if (sa->sa_family == AF_INET6 && !sa_is_v4mapped(sa))
+      bits = std::min<int64_t>(bits, 64) / 2;
+
+    score += bits * prefix_weight;
+  }
+
+  if (peer_info == nullptr)
+    return score;
+
+  if (peer_info->is_local())
+    score += local_weight;
+
+  if (peer_info->rtt().count() != 0)
+    score += rtt_weight * rtt_half / (rtt_half + peer_info->rtt().count());
+
+  return score - int64_t{peer_info->failed_counter()} * failed_weight;
+}
+
+}
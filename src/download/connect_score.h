@@ -0,0 +1,37 @@
+#ifndef LIBTORRENT_DOWNLOAD_CONNECT_SCORE_H
+#define LIBTORRENT_DOWNLOAD_CONNECT_SCORE_H
+
+#include <cstdint>
+
+struct sockaddr;
+
+namespace torrent {
+
+class PeerInfo;
+
+// Rates connection candidates, higher is better. Candidates gain from
+// a low round trip time on earlier connections, from the length of
+// the address prefix shared with our own address and from the client's
+// hint, while failed connections count against them. Local peers
+// always come first.
+//
+// A shared bit of an inet address is worth 'prefix_weight', with
+// inet6 prefixes counted at half a bit per bit up to /64. The rtt
+// bonus is 'rtt_weight' at zero and halves at 'rtt_half'
+// microseconds.
+
+struct connect_score {
+  static constexpr int64_t prefix_weight  = 16;
+  static constexpr int64_t rtt_weight     = 1000;
+  static constexpr int64_t rtt_half       = 10000;
+  static constexpr int64_t failed_weight  = 250;
+  static constexpr int64_t local_weight   = int64_t{1} << 32;
+
+  // 'peer_info' may be null for addresses never connected to, and
+  // 'own_address' unspec.
+  static int64_t      calculate(const sockaddr* sa, const PeerInfo* peer_info, const sockaddr* own_address, int64_t hint);
+};
+
+}
+
+#endif
@@ -5,6 +5,7 @@
 
 #include "torrent/exceptions.h"
 #include "torrent/bitfield.h"
+#include "torrent/common.h"
 #include "torrent/data/block.h"
 #include "torrent/data/block_list.h"
 #include "torrent/data/block_transfer.h"
@@ -26,15 +27,15 @@ Delegator::delegate(PeerChunks* peerChunks, uint32_t affinity, uint32_t maxPiece
   // in progress.
 
   // TODO: What if the hash failed? Don't want data from that peer again.
-  if (affinity >= 0) {
-    for (BlockList* itr : m_transfers) {
-      if (new_transfers.size() >= maxPieces)
-        return new_transfers;
+  auto affinity_itr = m_transfers.find(affinity);
 
-      if (affinity == itr->index())
-        delegate_from_blocklist(new_transfers, maxPieces, itr, peerInfo);
-    }
-  }
+  if (affinity_itr != m_transfers.end())
+    delegate_from_blocklist(new_transfers, maxPieces, *affinity_itr, peerInfo);
+
+  if (new_transfers.size() >= maxPieces)
+    return new_transfers;
+
+  delegate_deadline(new_transfers, maxPieces, peerChunks);
 
   // Prioritize full seeders
   if (peerChunks->is_seeder()) {
@@ -42,7 +43,7 @@ Delegator::delegate(PeerChunks* peerChunks, uint32_t affinity, uint32_t maxPiece
       if (new_transfers.size() >= maxPieces)
         return new_transfers;
 
-      if (itr->by_seeder())
+      if (itr->by_seeder() && itr->has_stalled())
         delegate_from_blocklist(new_transfers, maxPieces, itr, peerInfo);
     }
 
@@ -60,7 +61,7 @@ Delegator::delegate(PeerChunks* peerChunks, uint32_t affinity, uint32_t maxPiece
     if (new_transfers.size() >= maxPieces)
       return new_transfers;
 
-    if (itr->priority() == PRIORITY_HIGH && peerChunks->bitfield()->get(itr->index()))
+    if (itr->priority() == PRIORITY_HIGH && itr->has_stalled() && peerChunks->bitfield()->get(itr->index()))
       delegate_from_blocklist(new_transfers, maxPieces, itr, peerInfo);
   }
 
@@ -72,40 +73,48 @@ Delegator::delegate(PeerChunks* peerChunks, uint32_t affinity, uint32_t maxPiece
     if (new_transfers.size() >= maxPieces)
       return new_transfers;
 
-    if (itr->priority() == PRIORITY_NORMAL && peerChunks->bitfield()->get(itr->index()))
+    if (itr->priority() == PRIORITY_NORMAL && itr->has_stalled() && peerChunks->bitfield()->get(itr->index()))
       delegate_from_blocklist(new_transfers, maxPieces, itr, peerInfo);
   }
 
   // Create new normal priority pieces.
   delegate_new_chunks(new_transfers, maxPieces, peerChunks, false);
 
-  if (!m_aggressive)
-    return new_transfers;
+  delegate_stragglers(new_transfers, maxPieces, peerChunks);
+
+  if (m_aggressive)
+    delegate_endgame(new_transfers, maxPieces, peerChunks);
+
+  return new_transfers;
+}
 
-  // In aggressive mode, look for possible downloads that already have
-  // one or more transfers queued.
+std::vector<BlockTransfer*>
+Delegator::delegate_allowed_fast(PeerChunks* peerChunks, uint32_t maxPieces) {
+  std::vector<BlockTransfer*> new_transfers;
 
-  // No more than 4 per piece.
-  uint16_t overlapped = 5;
+  if (!m_slot_chunk_wanted)
+    return new_transfers;
 
-  for (BlockList* itr : m_transfers) {
+  for (uint32_t index : *peerChunks->allowed_fast()) {
     if (new_transfers.size() >= maxPieces)
-      return new_transfers;
+      break;
 
-    if (peerChunks->bitfield()->get(itr->index()) && itr->priority() != PRIORITY_OFF) {
-      for (auto bl_itr = itr->begin(); bl_itr != itr->end() && overlapped != 0; bl_itr++) {
-        if (new_transfers.size() >= maxPieces || bl_itr->size_not_stalled() >= overlapped)
-          break;
-
-        if (!bl_itr->is_finished()) {
-          BlockTransfer* inserted_info = bl_itr->insert(peerInfo);
-          if (inserted_info != NULL) {
-            new_transfers.push_back(inserted_info);
-            overlapped = bl_itr->size_not_stalled();
-          }
-        }
-      }
+    if (!peerChunks->bitfield()->get(index))
+      continue;
+
+    auto itr = m_transfers.find(index);
+
+    if (itr == m_transfers.end()) {
+      if (!m_slot_chunk_wanted(index))
+        continue;
+
+      itr = m_transfers.insert(Piece(index, 0, m_slot_chunk_size(index)), block_size);
+
+      (*itr)->set_by_seeder(peerChunks->is_seeder());
+      (*itr)->set_priority(PRIORITY_NORMAL);
     }
+
+    delegate_from_blocklist(new_transfers, maxPieces, *itr, peerChunks->peer_info());
   }
 
   return new_transfers;
@@ -133,8 +142,156 @@ Delegator::delegate_new_chunks(std::vector<BlockTransfer*> &transfers, uint32_t
   }
 }
 
+// Chunks with a deadline go before the rarest-first chunks. Those
+// about to miss it get their unfinished blocks requested from a second
+// peer, as the first one to arrive completes the block.
+void
+Delegator::delegate_deadline(std::vector<BlockTransfer*> &transfers, uint32_t maxPieces, PeerChunks* pc) {
+  if (!m_slot_chunk_deadline || !m_slot_chunk_find_deadline)
+    return;
+
+  auto now = this_thread::cached_time();
+
+  for (BlockList* itr : m_transfers) {
+    if (transfers.size() >= maxPieces)
+      return;
+
+    if (m_slot_chunk_deadline(itr->index()) != std::chrono::microseconds{} && pc->bitfield()->get(itr->index()))
+      delegate_from_blocklist(transfers, maxPieces, itr, pc->peer_info());
+  }
+
+  while (transfers.size() < maxPieces) {
+    uint32_t index = m_slot_chunk_find_deadline(pc);
+
+    if (index == ~uint32_t{0})
+      break;
+
+    auto itr = m_transfers.insert(Piece(index, 0, m_slot_chunk_size(index)), block_size);
+
+    (*itr)->set_by_seeder(pc->is_seeder());
+    (*itr)->set_priority(PRIORITY_HIGH);
+
+    delegate_from_blocklist(transfers, maxPieces, *itr, pc->peer_info());
+  }
+
+  for (BlockList* itr : m_transfers) {
+    if (transfers.size() >= maxPieces)
+      return;
+
+    auto deadline = m_slot_chunk_deadline(itr->index());
+
+    if (deadline == std::chrono::microseconds{} || deadline - now > m_duplicate_window || !pc->bitfield()->get(itr->index()))
+      continue;
+
+    for (auto bl_itr = itr->begin(); bl_itr != itr->end() && transfers.size() < maxPieces; bl_itr++) {
+      if (bl_itr->is_finished() || bl_itr->size_not_stalled() >= 2)
+        continue;
+
+      BlockTransfer* inserted_info = bl_itr->insert(pc->peer_info());
+
+      if (inserted_info != NULL)
+        transfers.push_back(inserted_info);
+    }
+  }
+}
+
+void
+Delegator::delegate_stragglers(std::vector<BlockTransfer*> &transfers, uint32_t maxPieces, PeerChunks* pc) {
+  if (m_straggler_timeout == std::chrono::microseconds{})
+    return;
+
+  auto now = this_thread::cached_time();
+
+  for (BlockList* itr : m_transfers) {
+    if (!pc->bitfield()->get(itr->index()) || itr->priority() == PRIORITY_OFF)
+      continue;
+
+    for (auto bl_itr = itr->begin(); bl_itr != itr->end() && transfers.size() < maxPieces; bl_itr++) {
+      if (bl_itr->is_finished() || bl_itr->size_all() == 0 || bl_itr->size_all() >= max_straggler_requests)
+        continue;
+
+      auto is_recent = [&](const BlockTransfer* transfer) {
+        return now - transfer->request_timestamp() < m_straggler_timeout;
+      };
+
+      if (std::any_of(bl_itr->queued()->begin(), bl_itr->queued()->end(), is_recent) ||
+          std::any_of(bl_itr->transfers()->begin(), bl_itr->transfers()->end(), is_recent))
+        continue;
+
+      BlockTransfer* inserted_info = bl_itr->insert(pc->peer_info());
+
+      if (inserted_info != NULL)
+        transfers.push_back(inserted_info);
+    }
+
+    if (transfers.size() >= maxPieces)
+      return;
+  }
+}
+
+// In end-game mode, unfinished blocks that already have requests are
+// also requested from this peer, within the duplicate budget and only
+// if it is expected to answer sooner. The first to arrive completes
+// the block, which cancels the other requests.
+void
+Delegator::delegate_endgame(std::vector<BlockTransfer*> &transfers, uint32_t maxPieces, PeerChunks* pc) {
+  if (m_endgame_duplicates == 0)
+    return;
+
+  auto latency = m_slot_peer_latency ? m_slot_peer_latency(pc->peer_info()) : std::chrono::microseconds{};
+
+  for (BlockList* itr : m_transfers) {
+    if (transfers.size() >= maxPieces)
+      return;
+
+    if (!pc->bitfield()->get(itr->index()) || itr->priority() == PRIORITY_OFF)
+      continue;
+
+    for (auto bl_itr = itr->begin(); bl_itr != itr->end() && transfers.size() < maxPieces; bl_itr++) {
+      if (bl_itr->is_finished() || bl_itr->size_not_stalled() > m_endgame_duplicates)
+        continue;
+
+      if (!is_faster_than_requests(latency, &*bl_itr))
+        continue;
+
+      BlockTransfer* inserted_info = bl_itr->insert(pc->peer_info());
+
+      if (inserted_info != NULL)
+        transfers.push_back(inserted_info);
+    }
+  }
+}
+
+// Peers without a measured latency are only preferred over others
+// without one.
+bool
+Delegator::is_faster_than_requests(std::chrono::microseconds latency, const Block* block) {
+  if (!m_slot_peer_latency)
+    return true;
+
+  auto is_slower = [&](BlockTransfer* transfer) {
+    if (transfer->stall() != 0 || transfer->peer_info() == NULL)
+      return true;
+
+    auto other = m_slot_peer_latency(transfer->peer_info());
+
+    if (other == std::chrono::microseconds{})
+      return true;
+
+    return latency != std::chrono::microseconds{} && latency < other;
+  };
+
+  return std::all_of(block->queued()->begin(), block->queued()->end(), is_slower) &&
+         std::all_of(block->transfers()->begin(), block->transfers()->end(), is_slower);
+}
+
 void
 Delegator::delegate_from_blocklist(std::vector<BlockTransfer*> &transfers, uint32_t maxPieces, BlockList* c, PeerInfo* peerInfo) {
+  // Most chunks in progress have all their blocks requested, so skip
+  // those without walking the blocks.
+  if (!c->has_stalled())
+    return;
+
   for (auto i = c->begin(); i != c->end() && transfers.size() < maxPieces; ++i) {
     // If not finished and stalled, and no one is downloading this, then assign
     if (!i->is_finished() && i->is_stalled() && i->size_all() == 0)
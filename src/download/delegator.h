@@ -1,6 +1,7 @@
 #ifndef LIBTORRENT_DELEGATOR_H
 #define LIBTORRENT_DELEGATOR_H
 
+#include <chrono>
 #include <functional>
 #include <string>
 #include <vector>
@@ -20,33 +21,86 @@ class Delegator {
 public:
   using slot_peer_chunk = std::function<uint32_t(PeerChunks*, bool)>;
   using slot_size       = std::function<uint32_t(uint32_t)>;
+  using slot_wanted     = std::function<bool(uint32_t)>;
+  using slot_deadline_chunk = std::function<uint32_t(PeerChunks*)>;
+  using slot_deadline   = std::function<std::chrono::microseconds(uint32_t)>;
+  using slot_latency    = std::function<std::chrono::microseconds(PeerInfo*)>;
 
   static constexpr unsigned int block_size = 1 << 14;
 
+  // Blocks of chunks this close to their deadline are requested from
+  // more than one peer.
+  static constexpr std::chrono::seconds default_duplicate_window{2};
+
   TransferList*       transfer_list()                     { return &m_transfers; }
   const TransferList* transfer_list() const               { return &m_transfers; }
 
   std::vector<BlockTransfer*> delegate(PeerChunks* peerChunks, uint32_t affinity, uint32_t maxPieces);
 
+  // Only delegates from the chunks the peer allows us to request while
+  // it chokes us, see BEP 6.
+  std::vector<BlockTransfer*> delegate_allowed_fast(PeerChunks* peerChunks, uint32_t maxPieces);
+
   bool               get_aggressive()                     { return m_aggressive; }
   void               set_aggressive(bool a)               { m_aggressive = a; }
 
   slot_peer_chunk&   slot_chunk_find()                    { return m_slot_chunk_find; }
   slot_size&         slot_chunk_size()                    { return m_slot_chunk_size; }
+  slot_wanted&       slot_chunk_wanted()                  { return m_slot_chunk_wanted; }
+
+  auto               duplicate_window() const             { return m_duplicate_window; }
+  void               set_duplicate_window(std::chrono::microseconds w) { m_duplicate_window = w; }
+
+  // Blocks not received within this long of being requested are also
+  // requested from other peers, up to 'max_straggler_requests' peers
+  // per block. Zero disables.
+  static constexpr unsigned int max_straggler_requests = 3;
+
+  auto               straggler_timeout() const            { return m_straggler_timeout; }
+  void               set_straggler_timeout(std::chrono::microseconds t) { m_straggler_timeout = t; }
+
+  // In end-game mode blocks may be requested from this many peers on
+  // top of the first, counting only requests that have not stalled.
+  // Zero disables duplicate requests.
+  static constexpr unsigned int default_endgame_duplicates = 1;
+
+  unsigned int       endgame_duplicates() const           { return m_endgame_duplicates; }
+  void               set_endgame_duplicates(unsigned int d) { m_endgame_duplicates = d; }
+
+  // Optional, the average request latency of a peer or zero if not
+  // measured. End-game duplicates then only go to peers with a lower
+  // latency than those already requesting the block.
+  slot_latency&      slot_peer_latency()                  { return m_slot_peer_latency; }
+
+  // Optional, used for chunks the client wants by a deadline.
+  slot_deadline_chunk& slot_chunk_find_deadline()         { return m_slot_chunk_find_deadline; }
+  slot_deadline&     slot_chunk_deadline()                { return m_slot_chunk_deadline; }
 
 private:
   void               delegate_from_blocklist(std::vector<BlockTransfer*> &transfers, uint32_t maxPieces, BlockList* c, PeerInfo* peerInfo);
   void               delegate_new_chunks(std::vector<BlockTransfer*> &transfers, uint32_t maxPieces, PeerChunks* pc, bool highPriority);
+  void               delegate_deadline(std::vector<BlockTransfer*> &transfers, uint32_t maxPieces, PeerChunks* pc);
+  void               delegate_stragglers(std::vector<BlockTransfer*> &transfers, uint32_t maxPieces, PeerChunks* pc);
+  void               delegate_endgame(std::vector<BlockTransfer*> &transfers, uint32_t maxPieces, PeerChunks* pc);
+  bool               is_faster_than_requests(std::chrono::microseconds latency, const Block* block);
   Block*             delegate_seeder(PeerChunks* peerChunks);
 
   TransferList       m_transfers;
 
   bool               m_aggressive{false};
+  unsigned int       m_endgame_duplicates{default_endgame_duplicates};
+
+  std::chrono::microseconds m_duplicate_window{default_duplicate_window};
+  std::chrono::microseconds m_straggler_timeout{};
 
   // Propably should add a m_slotChunkStart thing, which will take
   // care of enabling etc, and will be possible to listen to.
   slot_peer_chunk    m_slot_chunk_find;
   slot_size          m_slot_chunk_size;
+  slot_wanted        m_slot_chunk_wanted;
+  slot_deadline_chunk m_slot_chunk_find_deadline;
+  slot_deadline      m_slot_chunk_deadline;
+  slot_latency       m_slot_peer_latency;
 };
 
 }
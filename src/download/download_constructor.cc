@@ -20,14 +20,31 @@
 
 namespace torrent {
 
-bool
-download_constructor_is_single_path(Object::map_type::const_reference v) {
-  return v.first.rfind("name.", 0) == 0 && v.second.is_string();
+// Map keys are std::string for Object and raw_string for object_view.
+template <typename Key>
+static bool
+download_constructor_has_prefix(const Key& key, const char* prefix) {
+  size_t length = std::strlen(prefix);
+
+  return key.size() >= length && std::memcmp(key.data(), prefix, length) == 0;
+}
+
+template <typename Key>
+static std::string
+download_constructor_key_suffix(const Key& key, size_t pos) {
+  return std::string(key.data() + pos, key.size() - pos);
+}
+
+template <typename Entry>
+static bool
+download_constructor_is_single_path(const Entry& v) {
+  return download_constructor_has_prefix(v.first, "name.") && v.second.is_string();
 };
 
-bool
-download_constructor_is_multi_path(Object::map_type::const_reference v) {
-  return v.first.rfind("path.", 0) == 0 && v.second.is_list();
+template <typename Entry>
+static bool
+download_constructor_is_multi_path(const Entry& v) {
+  return download_constructor_has_prefix(v.first, "path.") && v.second.is_list();
 };
 
 void
@@ -35,6 +52,22 @@ DownloadConstructor::initialize(Object& b) {
   if (!b.has_key_map("info") && b.has_key_string("magnet-uri"))
     parse_magnet_uri(b, b.get_key_string("magnet-uri"));
 
+  initialize_info(b);
+}
+
+// Magnet URIs are turned into an info dictionary, which needs an Object
+// to insert into.
+void
+DownloadConstructor::initialize(const object_view& b) {
+  if (!b.has_key_map("info") && b.has_key_string("magnet-uri"))
+    throw input_error("Magnet URI must be loaded as an Object.");
+
+  initialize_info(b);
+}
+
+template <typename T>
+void
+DownloadConstructor::initialize_info(const T& b) {
   if (b.has_key_string("encoding"))
     m_defaultEncoding = b.get_key_string("encoding");
 
@@ -51,8 +84,9 @@ DownloadConstructor::initialize(Object& b) {
 
 // Currently using a hack of the path thingie to extract the correct
 // torrent name.
+template <typename T>
 void
-DownloadConstructor::parse_name(const Object& b) {
+DownloadConstructor::parse_name(const T& b) {
   if (is_invalid_path_element(b.get_key("name")))
     throw input_error("Bad torrent file, \"name\" is an invalid path name.");
 
@@ -65,7 +99,7 @@ DownloadConstructor::parse_name(const Object& b) {
   for (const auto& map : b.as_map()) {
     if (download_constructor_is_single_path(map)) {
       pathList.emplace_back();
-      pathList.back().set_encoding(map.first.substr(sizeof("name.") - 1));
+      pathList.back().set_encoding(download_constructor_key_suffix(map.first, sizeof("name.") - 1));
       pathList.back().push_back(map.second.as_string());
     }
   }
@@ -81,8 +115,9 @@ DownloadConstructor::parse_name(const Object& b) {
   m_download->info()->set_name(name.front());
 }
 
+template <typename T>
 void
-DownloadConstructor::parse_info(const Object& b) {
+DownloadConstructor::parse_info(const T& b) {
   FileList* fileList = m_download->main()->file_list();
 
   if (!fileList->empty())
@@ -134,21 +169,37 @@ DownloadConstructor::parse_info(const Object& b) {
 
 void
 DownloadConstructor::parse_tracker(const Object& b) {
-  const Object::list_type* announce_list = NULL;
+  parse_tracker_list(b);
+}
 
-  if (b.has_key_list("announce-list") &&
+void
+DownloadConstructor::parse_tracker(const object_view& b) {
+  parse_tracker_list(b);
+}
 
-      // Some torrent makers create empty/invalid 'announce-list'
-      // entries while still having valid 'announce'.
-      !(announce_list = &b.get_key_list("announce-list"))->empty() &&
-      std::any_of(announce_list->begin(), announce_list->end(), std::mem_fn(&Object::is_list))) {
-    for (const auto& group : *announce_list) {
+template <typename List>
+static bool
+download_constructor_has_group(const List& announce_list) {
+  return std::any_of(announce_list.begin(), announce_list.end(), [](const auto& group) { return group.is_list(); });
+}
+
+template <typename T>
+void
+DownloadConstructor::parse_tracker_list(const T& b) {
+  add_web_seeds(b);
+
+  // Some torrent makers create empty/invalid 'announce-list' entries
+  // while still having valid 'announce'.
+  if (b.has_key_list("announce-list") &&
+      download_constructor_has_group(b.get_key_list("announce-list"))) {
+    for (const auto& group : b.get_key_list("announce-list")) {
       add_tracker_group(group);
     }
   } else if (b.has_key("announce")) {
     add_tracker_single(b.get_key("announce"), 0);
 
-  } else if (!manager->dht_controller()->is_valid() || m_download->info()->is_private()) {
+  } else if ((!manager->dht_controller()->is_valid() || m_download->info()->is_private()) &&
+             m_download->main()->web_seed_urls()->empty()) {
     throw bencode_error("Could not find any trackers");
   }
 
@@ -164,8 +215,9 @@ DownloadConstructor::parse_tracker(const Object& b) {
   m_download->main()->tracker_list()->randomize_group_entries();
 }
 
+template <typename T>
 void
-DownloadConstructor::add_tracker_group(const Object& b) {
+DownloadConstructor::add_tracker_group(const T& b) {
   if (!b.is_list())
     throw bencode_error("Tracker group list not a list");
 
@@ -176,16 +228,45 @@ DownloadConstructor::add_tracker_group(const Object& b) {
   }
 }
 
+template <typename T>
 void
-DownloadConstructor::add_tracker_single(const Object& b, int group) {
+DownloadConstructor::add_tracker_single(const T& b, int group) {
   if (!b.is_string())
     throw bencode_error("Tracker entry not a string");
 
   m_download->main()->tracker_list()->insert_url(group, rak::trim_classic(b.as_string()));
 }
 
+// BEP 19 'url-list' is either a single url or a list of them, entries
+// that aren't strings are ignored.
+template <typename T>
+void
+DownloadConstructor::add_web_seeds(const T& b) {
+  if (m_download->info()->is_meta_download())
+    return;
+
+  auto add_url = [this](const auto& url) {
+      if (!url.is_string())
+        return;
+
+      auto trimmed = rak::trim_classic(std::string(url.as_string()));
+
+      if (!trimmed.empty())
+        m_download->main()->web_seed_urls()->push_back(trimmed);
+    };
+
+  if (b.has_key_string("url-list")) {
+    add_url(b.get_key("url-list"));
+
+  } else if (b.has_key_list("url-list")) {
+    for (const auto& url : b.get_key_list("url-list"))
+      add_url(url);
+  }
+}
+
+template <typename T>
 void
-DownloadConstructor::add_dht_node(const Object& b) {
+DownloadConstructor::add_dht_node(const T& b) {
   if (!b.is_list() || b.as_list().size() < 2)
     return;
 
@@ -202,18 +283,24 @@ DownloadConstructor::add_dht_node(const Object& b) {
   manager->dht_controller()->add_node(host, el->as_value());
 }
 
+template <typename T>
 bool
-DownloadConstructor::is_valid_path_element(const Object& b) {
+DownloadConstructor::is_valid_path_element(const T& b) {
+  if (!b.is_string())
+    return false;
+
+  const std::string& str = b.as_string();
+
   return
-    b.is_string() &&
-    b.as_string() != "." &&
-    b.as_string() != ".." &&
-    std::find(b.as_string().begin(), b.as_string().end(), '/') == b.as_string().end() &&
-    std::find(b.as_string().begin(), b.as_string().end(), '\0') == b.as_string().end();
+    str != "." &&
+    str != ".." &&
+    std::find(str.begin(), str.end(), '/') == str.end() &&
+    std::find(str.begin(), str.end(), '\0') == str.end();
 }
 
+template <typename T>
 void
-DownloadConstructor::parse_single_file(const Object& b, uint32_t chunkSize) {
+DownloadConstructor::parse_single_file(const T& b, uint32_t chunkSize) {
   if (is_invalid_path_element(b.get_key("name")))
     throw input_error("Bad torrent file, \"name\" is an invalid path name.");
 
@@ -232,7 +319,7 @@ DownloadConstructor::parse_single_file(const Object& b, uint32_t chunkSize) {
       continue;
 
     pathList.emplace_back();
-    pathList.back().set_encoding(map.first.substr(sizeof("name.") - 1));
+    pathList.back().set_encoding(download_constructor_key_suffix(map.first, sizeof("name.") - 1));
     pathList.back().push_back(map.second.as_string());
   }
 
@@ -243,9 +330,10 @@ DownloadConstructor::parse_single_file(const Object& b, uint32_t chunkSize) {
   fileList->update_paths(fileList->begin(), fileList->end());
 }
 
+template <typename T>
 void
-DownloadConstructor::parse_multi_files(const Object& b, uint32_t chunk_size) {
-  const Object::list_type& object_list = b.as_list();
+DownloadConstructor::parse_multi_files(const T& b, uint32_t chunk_size) {
+  const auto& object_list = b.as_list();
 
   // Multi file torrent
   if (object_list.empty())
@@ -263,7 +351,7 @@ DownloadConstructor::parse_multi_files(const Object& b, uint32_t chunk_size) {
 
     for (const auto& path : object.as_map())
       if (download_constructor_is_multi_path(path))
-        path_list.push_back(create_path(path.second.as_list(), path.first.substr(sizeof("path.") - 1)));
+        path_list.push_back(create_path(path.second.as_list(), download_constructor_key_suffix(path.first, sizeof("path.") - 1)));
 
     if (path_list.empty())
       throw input_error("Bad torrent file, an entry has no valid filename.");
@@ -293,19 +381,20 @@ DownloadConstructor::parse_multi_files(const Object& b, uint32_t chunk_size) {
   file_list->update_paths(file_list->begin(), file_list->end());
 }
 
+template <typename List>
 inline Path
-DownloadConstructor::create_path(const Object::list_type& plist, const std::string& enc) {
+DownloadConstructor::create_path(const List& plist, const std::string& enc) {
   // Make sure we are given a proper file path.
   if (plist.empty())
     throw input_error("Bad torrent file, \"path\" has zero entries.");
 
-  if (std::any_of(plist.begin(), plist.end(), &DownloadConstructor::is_invalid_path_element))
+  if (std::any_of(plist.begin(), plist.end(), [](const auto& element) { return is_invalid_path_element(element); }))
     throw input_error("Bad torrent file, \"path\" has zero entries or a zero length entry.");
 
   Path p;
   p.set_encoding(enc);
 
-  std::transform(plist.begin(), plist.end(), std::back_inserter(p), std::mem_fn(&Object::as_string_c));
+  std::transform(plist.begin(), plist.end(), std::back_inserter(p), [](const auto& element) { return element.as_string_c(); });
 
   return p;
 }
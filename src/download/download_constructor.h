@@ -4,6 +4,7 @@
 #include <list>
 
 #include "torrent/object.h"
+#include "torrent/object_view.h"
 
 namespace torrent {
 
@@ -16,28 +17,37 @@ using EncodingList = std::list<std::string>;
 class DownloadConstructor {
 public:
   void                initialize(Object& b);
+  void                initialize(const object_view& b);
 
   void                parse_tracker(const Object& b);
+  void                parse_tracker(const object_view& b);
 
   void                set_download(DownloadWrapper* d)         { m_download = d; }
   void                set_encoding_list(const EncodingList* e) { m_encodingList = e; }
 
 private:
-  void                parse_name(const Object& b);
-  void                parse_info(const Object& b);
+  // The parsers are shared between Object and object_view, which have
+  // the same accessors.
+  template <typename T> void initialize_info(const T& b);
+  template <typename T> void parse_tracker_list(const T& b);
+
+  template <typename T> void parse_name(const T& b);
+  template <typename T> void parse_info(const T& b);
   void                parse_magnet_uri(Object& b, const std::string& uri);
 
-  void                add_tracker_group(const Object& b);
-  void                add_tracker_single(const Object& b, int group);
-  void                add_dht_node(const Object& b);
+  template <typename T> void add_tracker_group(const T& b);
+  template <typename T> void add_tracker_single(const T& b, int group);
+  template <typename T> void add_dht_node(const T& b);
+  template <typename T> void add_web_seeds(const T& b);
 
-  static bool         is_valid_path_element(const Object& b);
-  static bool         is_invalid_path_element(const Object& b) { return !is_valid_path_element(b); }
+  template <typename T> static bool is_valid_path_element(const T& b);
+  template <typename T> static bool is_invalid_path_element(const T& b) { return !is_valid_path_element(b); }
 
-  void                parse_single_file(const Object& b, uint32_t chunkSize);
-  void                parse_multi_files(const Object& b, uint32_t chunkSize);
+  template <typename T> void parse_single_file(const T& b, uint32_t chunkSize);
+  template <typename T> void parse_multi_files(const T& b, uint32_t chunkSize);
 
-  inline Path         create_path(const Object::list_type& plist, const std::string& enc);
+  template <typename List>
+  inline Path         create_path(const List& plist, const std::string& enc);
   inline Path         choose_path(std::list<Path>* pathList);
 
   DownloadWrapper*    m_download{};
@@ -2,16 +2,25 @@
 
 #include "download/download_main.h"
 
+#include <algorithm>
 #include <cassert>
 #include <cstring>
 #include <limits>
 
 #include "manager.h"
+#include "data/chunk_cache.h"
 #include "data/chunk_list.h"
+#include "data/chunk_preloader.h"
+#include "data/chunk_residency.h"
+#include "data/metadata_cache.h"
 #include "download/available_list.h"
 #include "download/chunk_selector.h"
 #include "download/chunk_statistics.h"
+#include "download/connect_score.h"
 #include "download/download_wrapper.h"
+#include "download/web_seed.h"
+#include "net/bind_list.h"
+#include "net/socket_fd.h"
 #include "protocol/extensions.h"
 #include "protocol/handshake_manager.h"
 #include "protocol/initial_seed.h"
@@ -19,8 +28,11 @@
 #include "protocol/peer_factory.h"
 #include "torrent/download.h"
 #include "torrent/exceptions.h"
+#include "torrent/chunk_manager.h"
 #include "torrent/throttle.h"
+#include "torrent/connection_manager.h"
 #include "torrent/data/file_list.h"
+#include "torrent/data/file_manager.h"
 #include "torrent/download/download_manager.h"
 #include "torrent/download/choke_queue.h"
 #include "torrent/download/choke_group.h"
@@ -43,6 +55,8 @@ DownloadMain::DownloadMain() :
     m_tracker_list(new TrackerList),
 
     m_chunkList(new ChunkList),
+    m_chunkResidency(new ChunkResidency(m_chunkList, manager->chunk_manager())),
+    m_chunkPreloader(new ChunkPreloader(m_chunkList, manager->chunk_manager(), m_chunkResidency)),
     m_chunkSelector(new ChunkSelector(file_list()->mutable_data())),
     m_chunkStatistics(new ChunkStatistics),
     m_connectionList(new ConnectionList(this)) {
@@ -53,6 +67,12 @@ DownloadMain::DownloadMain() :
 
   m_delegator.slot_chunk_find() = [this](auto pc, auto prio) { return m_chunkSelector->find(pc, prio); };
   m_delegator.slot_chunk_size() = [this](auto i) { return file_list()->chunk_index_size(i); };
+  m_delegator.slot_chunk_wanted() = [this](auto i) { return m_chunkSelector->is_wanted(i); };
+  m_delegator.slot_chunk_find_deadline() = [this](auto pc) { return m_chunkSelector->find_deadline(pc, file_list()->chunk_size()); };
+  m_delegator.slot_chunk_deadline()      = [this](auto i) { return m_chunkSelector->deadline(i); };
+  m_delegator.slot_peer_latency()        = [](auto peer) {
+    return peer->connection() != NULL ? peer->connection()->request_list()->request_latency().average() : std::chrono::microseconds{};
+  };
 
   m_delegator.transfer_list()->slot_canceled()  = [this](auto i) { m_chunkSelector->not_using_index(i); };
   m_delegator.transfer_list()->slot_queued()    = [this](auto i) { m_chunkSelector->using_index(i); };
@@ -61,27 +81,37 @@ DownloadMain::DownloadMain() :
 
   m_delayDisconnectPeers.slot() = [this] { m_connectionList->disconnect_queued(); };
   m_taskTrackerRequest.slot()   = [this] { receive_tracker_request(); };
+  m_taskHaveFlush.slot()        = [this] { receive_have_flush(); };
 
   m_chunkList->set_data(file_list()->mutable_data());
   m_chunkList->slot_create_chunk()   = [this](auto i, auto p) { return file_list()->create_chunk_index(i, p); };
   m_chunkList->slot_free_diskspace() = [this] { return file_list()->free_diskspace(); };
+  m_chunkList->slot_is_unverified()  = [this](auto i) { return m_delegator.transfer_list()->find(i) != m_delegator.transfer_list()->end(); };
 }
 
 DownloadMain::~DownloadMain() {
   assert(!m_taskTrackerRequest.is_queued() && "DownloadMain::~DownloadMain(): m_taskTrackerRequest is queued.");
+  assert(!m_taskHaveFlush.is_queued() && "DownloadMain::~DownloadMain(): m_taskHaveFlush is queued.");
 
   assert(m_info->size_pex() == 0 && "DownloadMain::~DownloadMain(): m_info->size_pex() != 0.");
 
+  manager->chunk_manager()->metadata_cache()->erase(this);
+
+  m_web_seeds.clear();
+
   delete m_tracker_list;
   delete m_connectionList;
 
   delete m_chunkStatistics;
+  delete m_chunkPreloader;
+  delete m_chunkResidency;
   delete m_chunkList;
   delete m_chunkSelector;
   delete m_info;
 
   m_ut_pex_delta.clear();
   m_ut_pex_initial.clear();
+  m_bitfield_snapshot.clear();
 }
 
 void
@@ -99,16 +129,35 @@ DownloadMain::post_initialize() {
 }
 
 std::pair<ThrottleList*, ThrottleList*>
-DownloadMain::throttles(const sockaddr* sa) {
+DownloadMain::throttles(const sockaddr* sa, SocketFd fd) {
   ThrottlePair pair = ThrottlePair(NULL, NULL);
 
+  if (peer_list()->is_local(sa))
+    return std::make_pair(manager->local_upload_throttle()->throttle_list(),
+                          manager->local_download_throttle()->throttle_list());
+
   if (manager->connection_manager()->address_throttle())
     pair = manager->connection_manager()->address_throttle()(sa);
 
+  if (auto bind_entry = manager->connection_manager()->bind_list()->find_socket(fd)) {
+    pair.first  = pair.first  == NULL ? bind_entry->upload_throttle : pair.first;
+    pair.second = pair.second == NULL ? bind_entry->download_throttle : pair.second;
+  }
+
   return std::make_pair(pair.first == NULL ? upload_throttle() : pair.first->throttle_list(),
                         pair.second == NULL ? download_throttle() : pair.second->throttle_list());
 }
 
+void
+DownloadMain::set_throttle_weight(uint32_t w) {
+  m_throttle_weight = w;
+
+  for (auto& connection : *connection_list()) {
+    connection->m_ptr()->peer_chunks()->upload_throttle()->set_weight(w);
+    connection->m_ptr()->peer_chunks()->download_throttle()->set_weight(w);
+  }
+}
+
 void
 DownloadMain::open(int flags) {
   if (info()->is_open())
@@ -130,7 +179,7 @@ DownloadMain::close() {
   if (!info()->is_open())
     return;
 
-  info()->unset_flags(DownloadInfo::flag_open);
+  info()->unset_flags(DownloadInfo::flag_open | DownloadInfo::flag_paused);
 
   // Don't close the tracker manager here else it will cause STOPPED
   // requests to be lost. TODO: Check that this is valid.
@@ -143,6 +192,8 @@ DownloadMain::close() {
   // Clear the chunklist last as it requires all referenced chunks to
   // be released.
   m_chunkStatistics->clear();
+  m_chunkPreloader->clear();
+  m_chunkResidency->clear();
   m_chunkList->clear();
   m_chunkSelector->cleanup();
 }
@@ -154,12 +205,26 @@ void DownloadMain::start() {
   if (info()->is_active())
     throw internal_error("Tried to start an active download");
 
+  info()->unset_flags(DownloadInfo::flag_paused);
   info()->set_flags(DownloadInfo::flag_active);
   chunk_list()->set_flags(ChunkList::flag_active);
 
   m_delegator.set_aggressive(false);
   update_endgame();  
 
+  if (info()->is_meta_download())
+    m_metadata_fetch.start(&m_delegator);
+
+  m_idle_since = cachedTime;
+
+  if (!file_list()->is_done()) {
+    for (const auto& url : m_web_seed_urls)
+      m_web_seeds.emplace_back(std::make_unique<WebSeed>(this, url));
+
+    for (const auto& seed : m_web_seeds)
+      seed->try_request();
+  }
+
   receive_connect_peers();
 }  
 
@@ -168,6 +233,8 @@ DownloadMain::stop() {
   if (!info()->is_active())
     return;
 
+  wake();
+
   // Set this early so functions like receive_connect_peers() knows
   // not to eat available peers.
   info()->unset_flags(DownloadInfo::flag_active);
@@ -179,13 +246,117 @@ DownloadMain::stop() {
   delete m_initialSeeding;
   m_initialSeeding = NULL;
 
+  m_chunkPreloader->clear();
+  m_metadata_fetch.stop(&m_delegator);
+  m_web_seeds.clear();
+
   priority_queue_erase(&taskScheduler, &m_delayDisconnectPeers);
   priority_queue_erase(&taskScheduler, &m_taskTrackerRequest);
+  priority_queue_erase(&taskScheduler, &m_taskHaveFlush);
 
   if (info()->upload_unchoked() != 0 || info()->download_unchoked() != 0)
     throw internal_error("DownloadMain::stop(): info()->upload_unchoked() != 0 || info()->download_unchoked() != 0.");
 }
 
+void
+DownloadMain::set_paused() {
+  if (info()->is_active())
+    throw internal_error("DownloadMain::set_paused() called on an active download.");
+
+  info()->set_flags(DownloadInfo::flag_paused);
+  m_paused_since = cachedTime;
+}
+
+uint64_t
+DownloadMain::paused_memory_usage() const {
+  return manager->chunk_manager()->chunk_cache()->size(m_chunkList);
+}
+
+// Files are reopened on demand, so closing them is safe even with
+// chunks still waiting to be synced.
+void
+DownloadMain::release_warm() {
+  if (info()->is_active())
+    throw internal_error("DownloadMain::release_warm() called on an active download.");
+
+  if (info()->is_paused())
+    lt_log_print_info(LOG_TORRENT_INFO, info(), "download", "Demoting paused download: cached:%" PRIu64 ".", paused_memory_usage());
+
+  info()->unset_flags(DownloadInfo::flag_paused);
+
+  manager->chunk_manager()->chunk_cache()->erase(m_chunkList);
+  manager->chunk_manager()->metadata_cache()->erase(this);
+
+  for (const auto& file : *file_list())
+    manager->file_manager()->close(file.get());
+}
+
+bool
+DownloadMain::is_idle() {
+  return
+    connection_list()->empty() &&
+    m_slotCountHandshakes(this) == 0 &&
+    m_delegator.transfer_list()->empty() &&
+    m_initialSeeding == NULL;
+}
+
+// The chunk statistics are all zero without connections and the
+// unreferenced chunk list nodes hold nothing but their index, so both
+// are rebuilt from the file list on wake.
+bool
+DownloadMain::hibernate() {
+  if (!info()->is_active() || info()->is_hibernating() || !is_idle())
+    return false;
+
+  m_chunkPreloader->clear();
+  manager->chunk_manager()->chunk_cache()->erase(m_chunkList);
+  manager->chunk_manager()->metadata_cache()->erase(this);
+
+  if (!m_chunkList->is_idle())
+    return false;
+
+  priority_queue_erase(&taskScheduler, &m_delayDisconnectPeers);
+  priority_queue_erase(&taskScheduler, &m_taskTrackerRequest);
+  m_tracker_controller.stop_requesting();
+
+  m_chunkStatistics->clear();
+  m_chunkList->clear();
+  have_queue_type().swap(m_haveQueue);
+
+  info()->set_flags(DownloadInfo::flag_hibernating);
+
+  lt_log_print_info(LOG_TORRENT_INFO, info(), "download", "Hibernating: chunks:%" PRIu32 ".", file_list()->size_chunks());
+  return true;
+}
+
+void
+DownloadMain::wake() {
+  if (!info()->is_hibernating())
+    return;
+
+  m_chunkList->resize(file_list()->size_chunks());
+  m_chunkStatistics->initialize(file_list()->size_chunks());
+
+  info()->unset_flags(DownloadInfo::flag_hibernating);
+  m_idle_since = cachedTime;
+
+  lt_log_print_info(LOG_TORRENT_INFO, info(), "download", "Waking up.");
+}
+
+void
+DownloadMain::update_hibernation(uint32_t timeout) {
+  if (!info()->is_active() || info()->is_hibernating())
+    return;
+
+  if (!is_idle()) {
+    m_idle_since = cachedTime;
+    return;
+  }
+
+  if (timeout != 0 && m_idle_since + rak::timer::from_seconds(timeout) <= cachedTime)
+    hibernate();
+}
+
 bool
 DownloadMain::start_initial_seeding() {
   if (!file_list()->is_done())
@@ -207,10 +378,12 @@ DownloadMain::initial_seeding_done(PeerConnectionBase* pcb) {
   // the connection list, so don't treat it as an error. Make sure to
   // catch close_connection() at the caller of new_peer(...) and just
   // close the filedesc before proceeding as normal.
-  auto pcb_itr = std::find(m_connectionList->begin(), m_connectionList->end(), pcb);
+  auto pcb_itr = m_connectionList->find_peer(pcb);
 
   if (pcb_itr != m_connectionList->end()) {
     std::iter_swap(m_connectionList->begin(), pcb_itr);
+    m_connectionList->update_indices();
+
     m_connectionList->erase_remaining(m_connectionList->begin() + 1, ConnectionList::disconnect_available);
   } else {
     m_connectionList->erase_remaining(m_connectionList->begin(), ConnectionList::disconnect_available);
@@ -235,6 +408,44 @@ DownloadMain::update_endgame() {
     m_delegator.set_aggressive(true);
 }
 
+// Entries are kept newest first with unique, increasing timestamps so
+// each connection can remember the last one it wrote.
+void
+DownloadMain::queue_have(uint32_t index) {
+  if (!m_haveQueue.empty() && m_haveQueue.front().first >= cachedTime)
+    m_haveQueue.emplace_front(m_haveQueue.front().first + 1, index);
+  else
+    m_haveQueue.emplace_front(cachedTime, index);
+
+  if (!m_taskHaveFlush.is_queued())
+    priority_queue_insert(&taskScheduler, &m_taskHaveFlush, cachedTime + rak::timer::from_milliseconds(have_flush_interval));
+}
+
+DataBuffer
+DownloadMain::bitfield_snapshot() {
+  const Bitfield* bitfield = file_list()->bitfield();
+  uint64_t generation = file_list()->data()->completed_generation();
+
+  if (m_bitfield_snapshot.empty() || m_bitfield_generation != generation) {
+    char* data = new char[bitfield->size_bytes()];
+    std::memcpy(data, bitfield->begin(), bitfield->size_bytes());
+
+    m_bitfield_snapshot.clear();
+    m_bitfield_snapshot.set(data, data + bitfield->size_bytes(), true);
+    m_bitfield_snapshot.share();
+
+    m_bitfield_generation = generation;
+  }
+
+  return m_bitfield_snapshot.clone();
+}
+
+void
+DownloadMain::receive_have_flush() {
+  for (auto& connection : *m_connectionList)
+    connection->m_ptr()->flush_have_queue();
+}
+
 void
 DownloadMain::receive_chunk_done(unsigned int index) {
   ChunkHandle handle = m_chunkList->get(index);
@@ -273,20 +484,73 @@ DownloadMain::receive_connect_peers() {
   AddressList* alist = peer_list()->available_list()->buffer();
 
   if (!alist->empty()) {
-    alist->sort();
     peer_list()->insert_available(alist);
     alist->clear();
   }
 
-  while (!peer_list()->available_list()->empty() &&
+  if (manager->connection_manager()->connect_rate() != 0)
+    manager->connection_manager()->request_connect();
+  else
+    connect_peers(ConnectionManager::unlimited_connect_budget);
+}
+
+uint32_t
+DownloadMain::connect_deficit() {
+  if (!info()->is_active() || peer_list()->available_list()->empty())
+    return 0;
+
+  uint32_t size = connection_list()->size();
+  uint32_t handshakes = m_slotCountHandshakes(this);
+
+  if (size >= connection_list()->min_size() || size + handshakes >= connection_list()->max_size())
+    return 0;
+
+  return std::min({ connection_list()->min_size() - size,
+                    connection_list()->max_size() - size - handshakes,
+                    peer_list()->available_list()->size() });
+}
+
+int64_t
+DownloadMain::connect_score(const rak::socket_address& sa, ConnectionManager* cm) {
+  const rak::socket_address* own_address = &manager->observed_address(sa.family());
+
+  if (own_address->family() == rak::socket_address::af_unspec)
+    own_address = &manager->observed_address(AF_INET6);
+
+  int64_t hint = cm->slot_connect_score() ? cm->slot_connect_score()(sa.c_sockaddr()) : 0;
+
+  return connect_score::calculate(sa.c_sockaddr(), peer_list()->find_address(sa.c_sockaddr()), own_address->c_sockaddr(), hint);
+}
+
+uint32_t
+DownloadMain::connect_peers(uint32_t max_attempts) {
+  ConnectionManager* cm = manager->connection_manager();
+
+  uint32_t attempts = 0;
+  uint32_t samples  = cm->connect_samples();
+  int      family   = cm->is_prefer_ipv6() ? AF_INET6 : AF_INET;
+
+  while (attempts < max_attempts &&
+         !peer_list()->available_list()->empty() &&
          manager->connection_manager()->can_connect() &&
          connection_list()->size() < connection_list()->min_size() &&
          connection_list()->size() + m_slotCountHandshakes(this) < connection_list()->max_size()) {
-    rak::socket_address sa = peer_list()->available_list()->pop_random();
+    rak::socket_address sa;
+
+    if (samples <= 1 || static_cast<uint32_t>(::random() % 100) < cm->connect_diversity())
+      sa = peer_list()->available_list()->pop_random(family);
+    else
+      sa = peer_list()->available_list()->pop_best(family, samples, [this, cm](auto& candidate) { return connect_score(candidate, cm); });
+
+    family = sa.family() == AF_INET ? AF_INET6 : AF_INET;
 
-    if (connection_list()->find(sa.c_sockaddr()) == connection_list()->end())
+    if (connection_list()->find(sa.c_sockaddr()) == connection_list()->end()) {
       m_slotStartHandshake(sa, this);
+      attempts++;
+    }
   }
+
+  return attempts;
 }
 
 void
@@ -314,6 +578,49 @@ SocketAddressCompact_less(const SocketAddressCompact& a, const SocketAddressComp
   return (a.addr < b.addr) || ((a.addr == b.addr) && (a.port < b.port));
 };
 
+bool
+SocketAddressCompact6_less(const SocketAddressCompact6& a, const SocketAddressCompact6& b) {
+  int result = std::memcmp(&a.addr, &b.addr, sizeof(in6_addr));
+
+  return result < 0 || (result == 0 && a.port < b.port);
+};
+
+// Replace 'list' with the sorted 'current' addresses, limited to
+// 'max_size', and return the differences in 'added' and 'removed'.
+template <typename List, typename Less>
+static void
+pex_list_update(List& list, List& current, List& added, List& removed, size_t max_size, Less less) {
+  std::sort(current.begin(), current.end(), less);
+
+  added.reserve(current.size());
+  std::set_difference(current.begin(), current.end(), list.begin(), list.end(), std::back_inserter(added), less);
+
+  removed.reserve(list.size());
+  std::set_difference(list.begin(), list.end(), current.begin(), current.end(), std::back_inserter(removed), less);
+
+  if (current.size() > max_size) {
+    // This test is only correct as long as we have a constant max
+    // size.
+    if (added.size() < current.size() - max_size)
+      throw internal_error("DownloadMain::do_peer_exchange() added.size() < current.size() - m_info->max_size_pex_list().");
+
+    // Randomize this:
+    added.erase(added.end() - (current.size() - max_size), added.end());
+
+    // Create the new list by removing any 'removed' addresses from
+    // the original list and then adding the new addresses.
+    list.erase(std::set_difference(list.begin(), list.end(), removed.begin(), removed.end(), list.begin(), less), list.end());
+    list.insert(list.end(), added.begin(), added.end());
+
+    std::sort(list.begin(), list.end(), less);
+
+  } else {
+    list.swap(current);
+  }
+
+  current.clear();
+}
+
 void
 DownloadMain::do_peer_exchange() {
   if (!info()->is_active())
@@ -341,14 +648,24 @@ DownloadMain::do_peer_exchange() {
 
   // Return if we don't really want to do anything?
 
-  ProtocolExtension::PEXList current;
+  ProtocolExtension::PEXList  current;
+  ProtocolExtension::PEXList6 current6;
 
   for (auto& connection : *m_connectionList) {
     auto pcb = connection->m_ptr();
     auto sa  = rak::socket_address::cast_from(pcb->peer_info()->socket_address());
 
-    if (pcb->peer_info()->listen_port() != 0 && sa->family() == rak::socket_address::af_inet)
-      current.emplace_back(sa->sa_inet()->address_n(), htons(pcb->peer_info()->listen_port()));
+    if (pcb->peer_info()->listen_port() != 0) {
+      rak::socket_address address = *sa;
+
+      if (address.family() == rak::socket_address::af_inet6)
+        address = address.sa_inet6()->normalize_address();
+
+      if (address.family() == rak::socket_address::af_inet)
+        current.emplace_back(address.sa_inet()->address_n(), htons(pcb->peer_info()->listen_port()));
+      else if (address.family() == rak::socket_address::af_inet6)
+        current6.emplace_back(address.sa_inet6()->address(), htons(pcb->peer_info()->listen_port()));
+    }
 
     if (!pcb->extensions()->is_remote_supported(ProtocolExtension::UT_PEX))
       continue;
@@ -368,62 +685,30 @@ DownloadMain::do_peer_exchange() {
       continue;
     }
 
-    // Still using the old buffer? Make a copy in this rare case.
-    DataBuffer* message = pcb->extension_message();
-
-    if (!message->empty() && (message->data() == m_ut_pex_initial.data() || message->data() == m_ut_pex_delta.data())) {
-      auto buffer = new char[message->length()];
-      memcpy(buffer, message->data(), message->length());
-      message->set(buffer, buffer + message->length(), true);
-    }
-
     pcb->do_peer_exchange();
   }
 
-  std::sort(current.begin(), current.end(), SocketAddressCompact_less);
-
-  ProtocolExtension::PEXList added;
-  added.reserve(current.size());
-  std::set_difference(current.begin(), current.end(), m_ut_pex_list.begin(), m_ut_pex_list.end(), std::back_inserter(added), SocketAddressCompact_less);
+  ProtocolExtension::PEXList  added;
+  ProtocolExtension::PEXList  removed;
+  ProtocolExtension::PEXList6 added6;
+  ProtocolExtension::PEXList6 removed6;
 
-  ProtocolExtension::PEXList removed;
-  removed.reserve(m_ut_pex_list.size());
-  std::set_difference(m_ut_pex_list.begin(), m_ut_pex_list.end(), current.begin(), current.end(), std::back_inserter(removed), SocketAddressCompact_less);
-
-  if (current.size() > m_info->max_size_pex_list()) {
-    // This test is only correct as long as we have a constant max
-    // size.
-    if (added.size() < current.size() - m_info->max_size_pex_list())
-      throw internal_error("DownloadMain::do_peer_exchange() added.size() < current.size() - m_info->max_size_pex_list().");
+  pex_list_update(m_ut_pex_list, current, added, removed, m_info->max_size_pex_list(), SocketAddressCompact_less);
+  pex_list_update(m_ut_pex_list6, current6, added6, removed6, m_info->max_size_pex_list(), SocketAddressCompact6_less);
 
-    // Randomize this:
-    added.erase(added.end() - (current.size() - m_info->max_size_pex_list()), added.end());
-
-    // Create the new m_ut_pex_list by removing any 'removed'
-    // addresses from the original list and then adding the new
-    // addresses.
-    m_ut_pex_list.erase(
-      std::set_difference(
-        m_ut_pex_list.begin(), m_ut_pex_list.end(), removed.begin(), removed.end(), m_ut_pex_list.begin(), SocketAddressCompact_less),
-      m_ut_pex_list.end());
-    m_ut_pex_list.insert(m_ut_pex_list.end(), added.begin(), added.end());
-
-    std::sort(m_ut_pex_list.begin(), m_ut_pex_list.end(), SocketAddressCompact_less);
-
-  } else {
-    m_ut_pex_list.swap(current);
-  }
-
-  current.clear();
+  // Connections still writing the previous messages keep their own
+  // reference to them.
   m_ut_pex_delta.clear();
 
   // If no peers were added or removed, the initial message is still correct and
   // the delta message stays emptied. Otherwise generate the appropriate messages.
-  if (!added.empty() || !m_ut_pex_list.empty()) {
-    m_ut_pex_delta = ProtocolExtension::generate_ut_pex_message(added, removed);
+  if (!added.empty() || !m_ut_pex_list.empty() || !added6.empty() || !m_ut_pex_list6.empty()) {
+    m_ut_pex_delta = ProtocolExtension::generate_ut_pex_message(added, removed, added6, removed6);
+    m_ut_pex_delta.share();
 
     m_ut_pex_initial.clear();
-    m_ut_pex_initial = ProtocolExtension::generate_ut_pex_message(m_ut_pex_list, current);
+    m_ut_pex_initial = ProtocolExtension::generate_ut_pex_message(m_ut_pex_list, current, m_ut_pex_list6, current6);
+    m_ut_pex_initial.share();
   }
 }
 
@@ -2,6 +2,7 @@
 #define LIBTORRENT_DOWNLOAD_MAIN_H
 
 #include <deque>
+#include <memory>
 #include <utility>
 
 #include "globals.h"
@@ -9,16 +10,20 @@
 #include "data/chunk_handle.h"
 #include "download/available_list.h"
 #include "download/delegator.h"
+#include "download/metadata_fetch.h"
 #include "net/data_buffer.h"
 #include "torrent/download_info.h"
 #include "torrent/download/group_entry.h"
 #include "torrent/data/file_list.h"
 #include "torrent/peer/peer_list.h"
 #include "torrent/tracker/wrappers.h"
+#include "torrent/utils/latency_histogram.h"
 
 namespace torrent {
 
 class ChunkList;
+class ChunkPreloader;
+class ChunkResidency;
 class ChunkSelector;
 class ChunkStatistics;
 
@@ -27,13 +32,17 @@ class ConnectionList;
 class DownloadWrapper;
 class HandshakeManager;
 class DownloadInfo;
+class SocketFd;
 class ThrottleList;
 class InitialSeeding;
+class WebSeed;
 
 class DownloadMain {
 public:
   using have_queue_type = std::deque<std::pair<rak::timer, uint32_t>>;
   using pex_list        = std::vector<SocketAddressCompact>;
+  using pex_list6       = std::vector<SocketAddressCompact6>;
+  using web_seed_list   = std::vector<std::unique_ptr<WebSeed>>;
 
   DownloadMain();
   ~DownloadMain();
@@ -49,6 +58,30 @@ public:
   void                start();
   void                stop();
 
+  // An active download without connections, handshakes or transfers
+  // can release its per-chunk state while it waits for peers. It is
+  // restored by wake() before any handshake is started or accepted.
+  bool                is_idle();
+
+  bool                hibernate();
+  void                wake();
+
+  // A paused download is stopped but keeps its file handles and the
+  // chunks held by the chunk cache until started or demoted.
+  void                set_paused();
+  rak::timer          paused_since() const { return m_paused_since; }
+
+  // The cached chunk memory kept by a paused download.
+  uint64_t            paused_memory_usage() const;
+
+  // Releases what a stopped download kept warm and clears the paused
+  // state.
+  void                release_warm();
+
+  // Hibernates once the download has been idle for 'timeout'
+  // seconds, never if zero.
+  void                update_hibernation(uint32_t timeout);
+
   class choke_group*       choke_group()                           { return m_choke_group; }
   const class choke_group* c_choke_group() const                   { return m_choke_group; }
   void                     set_choke_group(class choke_group* grp) { m_choke_group = grp; }
@@ -60,12 +93,31 @@ public:
 
   // Only retrieve writable chunks when the download is active.
   ChunkList*          chunk_list()                               { return m_chunkList; }
+  ChunkPreloader*     chunk_preloader()                          { return m_chunkPreloader; }
+  ChunkResidency*     chunk_residency()                          { return m_chunkResidency; }
   ChunkSelector*      chunk_selector()                           { return m_chunkSelector; }
   ChunkStatistics*    chunk_statistics()                         { return m_chunkStatistics; }
 
   Delegator*          delegator()                                { return &m_delegator; }
 
+  // Time from delegating a block to receiving its first byte, for
+  // all connections of this download.
+  utils::latency_histogram* request_latency()                    { return &m_request_latency; }
+
+  MetadataFetch*      metadata_fetch()                           { return &m_metadata_fetch; }
+
+  // Urls of the BEP 19 web seeds, which are started with the
+  // download unless it is done.
+  std::vector<std::string>* web_seed_urls()                      { return &m_web_seed_urls; }
+  web_seed_list*      web_seeds()                                { return &m_web_seeds; }
+
+  // HAVE messages of chunks completed within have_flush_interval
+  // are written together by each connection, idle connections are
+  // woken once per interval rather than for every chunk.
+  static constexpr uint32_t have_flush_interval = 500;
+
   have_queue_type*    have_queue()                               { return &m_haveQueue; }
+  void                queue_have(uint32_t index);
 
   InitialSeeding*     initial_seeding()                          { return m_initialSeeding; }
   bool                start_initial_seeding();
@@ -75,7 +127,9 @@ public:
   FileList*           file_list()                                { return &m_fileList; }
   PeerList*           peer_list()                                { return &m_peerList; }
 
-  std::pair<ThrottleList*, ThrottleList*> throttles(const sockaddr* sa);
+  // Throttles for a peer at 'sa' connected through 'fd', which is
+  // matched against the bind addresses.
+  std::pair<ThrottleList*, ThrottleList*> throttles(const sockaddr* sa, SocketFd fd);
 
   ThrottleList*       upload_throttle()                          { return m_uploadThrottle; }
   void                set_upload_throttle(ThrottleList* t)       { m_uploadThrottle = t; }
@@ -83,11 +137,23 @@ public:
   ThrottleList*       download_throttle()                        { return m_downloadThrottle; }
   void                set_download_throttle(ThrottleList* t)     { m_downloadThrottle = t; }
 
+  // Weight of this download's peers in the throttles, follows the
+  // resource manager priority.
+  uint32_t            throttle_weight() const                    { return m_throttle_weight; }
+  void                set_throttle_weight(uint32_t w);
+
   group_entry*        up_group_entry()                           { return &m_up_group_entry; }
   group_entry*        down_group_entry()                         { return &m_down_group_entry; }
 
+  // The messages are shared by all connections, each holding a
+  // reference until written.
   DataBuffer          get_ut_pex(bool initial)                   { return (initial ? m_ut_pex_initial : m_ut_pex_delta).clone(); }
 
+  // A copy of our completed bitfield shared by the handshakes sending
+  // it, taken again once the bitfield has changed. Handshakes keep
+  // the copy they got until it is written.
+  DataBuffer          bitfield_snapshot();
+
   bool                want_pex_msg()                             { return m_info->is_pex_active() && m_peerList.available_list()->want_more(); };
 
   void                set_metadata_size(size_t s);
@@ -110,6 +176,17 @@ public:
   void                add_peer(const rak::socket_address& sa);
 
   void                receive_connect_peers();
+
+  // The number of outgoing connections wanted, limited by the
+  // available addresses.
+  uint32_t            connect_deficit();
+
+  // Starts up to 'max_attempts' outgoing handshakes, alternating
+  // between IPv4 and IPv6 addresses starting with the preferred
+  // family so neither is starved. Candidates are scored if
+  // ConnectionManager::connect_samples is set. Returns the attempts
+  // made.
+  uint32_t            connect_peers(uint32_t max_attempts);
   void                receive_chunk_done(unsigned int index);
   void                receive_corrupt_chunk(PeerInfo* peerInfo);
 
@@ -117,6 +194,7 @@ public:
   void                receive_tracker_request();
 
   void                receive_do_peer_exchange();
+  void                receive_have_flush();
 
   void                do_peer_exchange();
 
@@ -132,6 +210,8 @@ private:
   void                setup_start();
   void                setup_stop();
 
+  int64_t             connect_score(const rak::socket_address& sa, ConnectionManager* cm);
+
   DownloadInfo*       m_info;
 
   tracker::TrackerControllerWrapper m_tracker_controller;
@@ -143,10 +223,16 @@ private:
   group_entry         m_down_group_entry;
 
   ChunkList*          m_chunkList;
+  ChunkResidency*     m_chunkResidency;
+  ChunkPreloader*     m_chunkPreloader;
   ChunkSelector*      m_chunkSelector;
   ChunkStatistics*    m_chunkStatistics;
 
   Delegator           m_delegator;
+  utils::latency_histogram m_request_latency;
+  MetadataFetch       m_metadata_fetch;
+  std::vector<std::string> m_web_seed_urls;
+  web_seed_list       m_web_seeds;
   have_queue_type     m_haveQueue;
   InitialSeeding*     m_initialSeeding{};
 
@@ -156,10 +242,15 @@ private:
 
   DataBuffer          m_ut_pex_delta;
   DataBuffer          m_ut_pex_initial;
+
+  DataBuffer          m_bitfield_snapshot;
+  uint64_t            m_bitfield_generation{0};
   pex_list            m_ut_pex_list;
+  pex_list6           m_ut_pex_list6;
 
   ThrottleList*       m_uploadThrottle{};
   ThrottleList*       m_downloadThrottle{};
+  uint32_t            m_throttle_weight{1};
 
   slot_start_handshake_type m_slotStartHandshake;
   slot_stop_handshakes_type m_slotStopHandshakes;
@@ -173,6 +264,10 @@ private:
 
   rak::priority_item  m_delayDisconnectPeers;
   rak::priority_item  m_taskTrackerRequest;
+  rak::priority_item  m_taskHaveFlush;
+
+  rak::timer          m_idle_since;
+  rak::timer          m_paused_since;
 };
 
 }
@@ -0,0 +1,129 @@
+#include "config.h"
+
+#include "download/download_prepare_queue.h"
+
+#include <memory>
+
+#include "thread_main.h"
+#include "torrent/exceptions.h"
+#include "torrent/utils/log.h"
+
+namespace torrent {
+
+// Torrents still queued are dropped, and results not yet delivered
+// are canceled as the library is being cleaned up.
+DownloadPrepareQueue::~DownloadPrepareQueue() {
+  {
+    auto lock = std::scoped_lock(m_lock);
+    m_queue.clear();
+  }
+
+  stop_workers();
+  thread_main()->cancel_callback(this);
+}
+
+void
+DownloadPrepareQueue::push_back(Object* object, slot_download_prepared slot) {
+  {
+    auto workers_lock = std::scoped_lock(m_workers_lock);
+
+    if (m_workers.empty()) {
+      prepare(entry_type{object, std::move(slot)});
+      return;
+    }
+
+    auto lock = std::scoped_lock(m_lock);
+    m_queue.push_back(entry_type{object, std::move(slot)});
+  }
+
+  m_cv.notify_one();
+}
+
+unsigned int
+DownloadPrepareQueue::worker_count() {
+  auto lock = std::scoped_lock(m_workers_lock);
+
+  return m_workers.size();
+}
+
+// Torrents left in the queue when the workers are stopped are
+// prepared on the calling thread.
+void
+DownloadPrepareQueue::start_workers(unsigned int count) {
+  if (count > max_workers)
+    throw input_error("Download prepare worker count out of range.");
+
+  auto workers_lock = std::scoped_lock(m_workers_lock);
+
+  if (count == m_workers.size())
+    return;
+
+  {
+    auto lock = std::scoped_lock(m_lock);
+    m_stopping = true;
+  }
+
+  m_cv.notify_all();
+
+  for (auto& worker : m_workers)
+    worker.join();
+
+  m_workers.clear();
+  m_stopping = false;
+
+  if (count == 0) {
+    auto lock = std::unique_lock(m_lock);
+
+    while (!m_queue.empty()) {
+      entry_type entry = std::move(m_queue.front());
+      m_queue.pop_front();
+
+      lock.unlock();
+      prepare(std::move(entry));
+      lock.lock();
+    }
+
+    return;
+  }
+
+  lt_log_print(LOG_TORRENT_INFO, "download_prepare_queue: starting %u workers", count);
+
+  for (unsigned int i = 0; i < count; i++)
+    m_workers.emplace_back([this] { worker_loop(); });
+}
+
+void
+DownloadPrepareQueue::stop_workers() {
+  start_workers(0);
+}
+
+// The callback must be copyable, so the result is shared with it.
+void
+DownloadPrepareQueue::prepare(entry_type entry) {
+  auto prepared = std::make_shared<DownloadPrepared>(download_prepare(entry.object));
+
+  thread_main()->callback(this, [prepared, slot = std::move(entry.slot)]() {
+      slot(std::move(*prepared));
+    });
+}
+
+void
+DownloadPrepareQueue::worker_loop() {
+  auto lock = std::unique_lock(m_lock);
+
+  while (true) {
+    m_cv.wait(lock, [this] { return m_stopping || !m_queue.empty(); });
+
+    if (m_stopping)
+      return;
+
+    entry_type entry = std::move(m_queue.front());
+    m_queue.pop_front();
+
+    lock.unlock();
+    prepare(std::move(entry));
+    lock.lock();
+  }
+}
+
+}
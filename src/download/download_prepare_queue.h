@@ -0,0 +1,50 @@
+#ifndef LIBTORRENT_DOWNLOAD_DOWNLOAD_PREPARE_QUEUE_H
+#define LIBTORRENT_DOWNLOAD_DOWNLOAD_PREPARE_QUEUE_H
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "torrent/torrent.h"
+
+namespace torrent {
+
+// Runs 'download_prepare' on a pool of worker threads and hands the
+// results to the main thread through callbacks, for loading many
+// torrents at startup.
+
+class DownloadPrepareQueue {
+public:
+  static constexpr unsigned int max_workers = 64;
+
+  ~DownloadPrepareQueue();
+
+  void                push_back(Object* object, slot_download_prepared slot);
+
+  unsigned int        worker_count();
+  void                start_workers(unsigned int count);
+  void                stop_workers();
+
+private:
+  struct entry_type {
+    Object*                object;
+    slot_download_prepared slot;
+  };
+
+  void                prepare(entry_type entry);
+  void                worker_loop();
+
+  std::mutex               m_lock;
+  std::condition_variable  m_cv;
+  std::deque<entry_type>   m_queue;
+
+  std::mutex               m_workers_lock;
+  std::vector<std::thread> m_workers;
+  bool                     m_stopping{false};
+};
+
+}
+
+#endif
@@ -2,26 +2,36 @@
 
 #include "download/download_wrapper.h"
 
+#include "data/chunk.h"
 #include "data/chunk_list.h"
+#include "data/chunk_residency.h"
 #include "data/hash_queue.h"
 #include "data/hash_torrent.h"
 #include "download/available_list.h"
 #include "download/chunk_selector.h"
+#include "download/web_seed.h"
 #include "protocol/handshake_manager.h"
 #include "protocol/peer_connection_base.h"
+#include "torrent/chunk_manager.h"
+#include "torrent/connection_manager.h"
+#include "torrent/data/block_list.h"
 #include "torrent/data/file.h"
 #include "torrent/data/file_list.h"
 #include "torrent/data/file_manager.h"
+#include "torrent/data/transfer_list.h"
 #include "torrent/peer/connection_list.h"
 #include "torrent/peer/peer.h"
 #include "torrent/tracker/manager.h"
 #include "torrent/tracker_controller.h"
 #include "torrent/tracker_list.h"
 #include "torrent/utils/log.h"
+#include "torrent/utils/startup_profile.h"
 #include "tracker/thread_tracker.h"
 #include "utils/functional.h"
 #include "utils/sha1.h"
 
+#include "manager.h"
+
 #define LT_LOG_THIS(log_fmt, ...)                                       \
   lt_log_print_info(LOG_TORRENT_INFO, this->info(), "download", log_fmt, __VA_ARGS__);
 #define LT_LOG_STORAGE_ERRORS(log_fmt, ...)                             \
@@ -86,12 +96,20 @@ DownloadWrapper::initialize(const std::string& hash, const std::string& id, uint
   m_hash_checker = std::make_unique<HashTorrent>(m_main->chunk_list());
 
   // Connect various signals and slots.
-  m_hash_checker->slot_check_chunk()     = [this](auto h) { check_chunk_hash(h); };
+  m_hash_checker->slot_check_chunk()     = [this](auto h) {
+      check_chunk_hash(h, m_hash_checker->is_background() ? HashChunk::priority_background : HashChunk::priority_recheck);
+    };
+  m_hash_checker->slot_physical_addresses() = [this] {
+      if (!manager->chunk_manager()->is_hash_physical_order())
+        return std::vector<uint64_t>();
+
+      return m_main->file_list()->chunk_physical_addresses();
+    };
   m_hash_checker->delay_checked().slot() = [this] { receive_initial_hash(); };
 
   m_main->post_initialize();
 
-  m_main->tracker_controller().set_slots([this](auto l) { return receive_tracker_success(l); },
+  m_main->tracker_controller().set_slots([this](const auto& t, auto l) { return receive_tracker_success(t, l); },
                                          [this](auto& m) { return receive_tracker_failed(m); });
 }
 
@@ -107,8 +125,10 @@ DownloadWrapper::close() {
 
   // This could/should be async as we do not care that much if it
   // succeeds or not, any chunks not included in that last
-  // hash_resume_save get ignored anyway.
-  m_main->chunk_list()->sync_chunks(ChunkList::sync_all | ChunkList::sync_force | ChunkList::sync_sloppy | ChunkList::sync_ignore_error);
+  // hash_resume_save get ignored anyway. Buffered chunks that were
+  // not verified are dropped along with the transfer list.
+  m_main->chunk_list()->sync_chunks(ChunkList::sync_all | ChunkList::sync_force | ChunkList::sync_sloppy | ChunkList::sync_ignore_error |
+                                    ChunkList::sync_discard_unverified);
 
   m_main->close();
 
@@ -128,6 +148,8 @@ DownloadWrapper::receive_initial_hash() {
   if (info()->is_active())
     throw internal_error("DownloadWrapper::receive_initial_hash() but we're in a bad state.");
 
+  utils::startup_end(info()->hash().str(), utils::startup_hash_check);
+
   if (!m_hash_checker->is_checking()) {
     receive_storage_error("Hash checker was unable to map chunk: " + std::string(rak::error_number(m_hash_checker->error_number()).c_str()));
 
@@ -141,6 +163,8 @@ DownloadWrapper::receive_initial_hash() {
     // marked by HashTorrent that are not accounted for.
     m_main->chunk_selector()->initialize(m_main->chunk_statistics());
     receive_update_priorities();
+
+    push_event(EventJournal::event_hash_done);
   }
 
   if (data()->slot_initial_hash())
@@ -170,6 +194,8 @@ DownloadWrapper::receive_hash_done(ChunkHandle handle, const char* hash) {
     return;
   }
 
+  bool invalid_metadata = false;
+
   // If hash == NULL we're clearing the queue, so do nothing.
   if (hash != NULL) {
     if (!m_hash_checker->is_checked())
@@ -181,7 +207,13 @@ DownloadWrapper::receive_hash_done(ChunkHandle handle, const char* hash) {
     if (data()->untouched_bitfield()->get(handle.index()))
       throw internal_error("DownloadWrapper::receive_hash_done(...) received a chunk that isn't set in ChunkSelector.");
 
-    if (std::memcmp(hash, chunk_hash(handle.index()), 20) == 0) {
+    if (std::memcmp(hash, chunk_hash(handle.index()), 20) == 0 && !receive_metadata_done(handle)) {
+      // The metadata matches the info hash, so fetching it again would
+      // not help. Fail the download once the chunk is released.
+      m_main->delegator()->transfer_list()->hash_failed(handle.index(), handle.chunk());
+      invalid_metadata = true;
+
+    } else if (std::memcmp(hash, chunk_hash(handle.index()), 20) == 0) {
       bool was_partial = data()->wanted_chunks() != 0;
 
       m_main->file_list()->mark_completed(handle.index());
@@ -196,10 +228,7 @@ DownloadWrapper::receive_hash_done(ChunkHandle handle, const char* hash) {
         priority_queue_update(&taskScheduler, &m_main->delay_partially_done(), cachedTime);
       }
 
-      if (!m_main->have_queue()->empty() && m_main->have_queue()->front().first >= cachedTime)
-        m_main->have_queue()->emplace_front(m_main->have_queue()->front().first + 1, handle.index());
-      else
-        m_main->have_queue()->emplace_front(cachedTime, handle.index());
+      m_main->queue_have(handle.index());
 
     } else {
       // This needs to ensure the chunk is still valid.
@@ -209,15 +238,49 @@ DownloadWrapper::receive_hash_done(ChunkHandle handle, const char* hash) {
 
     data()->call_chunk_done(handle.object());
     m_main->chunk_list()->release(&handle);
+
+  if (invalid_metadata)
+    receive_storage_error("Metadata is not a valid info dictionary.");
+}
+
+bool
+DownloadWrapper::receive_metadata_done(ChunkHandle& handle) {
+  if (!info()->is_meta_download())
+    return true;
+
+  std::string buffer(handle.chunk()->chunk_size(), '\0');
+  handle.chunk()->to_buffer(&buffer[0], 0, buffer.size());
+
+  if (!m_main->metadata_fetch()->finish(buffer.data(), buffer.size())) {
+    LT_LOG_THIS("metadata is not a valid info dictionary: size:%zu failed:%" PRIu32,
+                buffer.size(), m_main->metadata_fetch()->failed_count());
+    return false;
+  }
+
+  LT_LOG_THIS("metadata complete: size:%zu time_to_metadata:%" PRIi64 "ms",
+              buffer.size(), static_cast<int64_t>(m_main->metadata_fetch()->time_to_metadata().count() / 1000));
+  return true;
 }
 
 void
-DownloadWrapper::check_chunk_hash(ChunkHandle handle) {
+DownloadWrapper::check_chunk_hash(ChunkHandle handle, HashChunk::priority_type priority) {
   // TODO: Hack...
   ChunkHandle new_handle = m_main->chunk_list()->get(handle.index(), ChunkList::get_blocking);
   m_main->chunk_list()->release(&handle);
 
-  hash_queue()->push_back(new_handle, data(), [this](auto c, auto h) { receive_hash_done(c, h); });
+  // Downloaded chunks are usually hashed as their blocks arrived.
+  TransferList* transfer_list = m_main->delegator()->transfer_list();
+  auto          block_list    = transfer_list->find(new_handle.index());
+
+  if (block_list != transfer_list->end() && (*block_list)->is_hash_complete()) {
+    HashString hash;
+    (*block_list)->hash_final(hash.data());
+
+    hash_queue()->push_back_hashed(new_handle, data(), hash, [this](auto c, auto h) { receive_hash_done(c, h); });
+    return;
+  }
+
+  hash_queue()->push_back(new_handle, data(), [this](auto c, auto h) { receive_hash_done(c, h); }, priority);
 }
 
 void
@@ -229,21 +292,30 @@ DownloadWrapper::receive_storage_error(const std::string& str) {
   m_main->tracker_controller().close();
 
   LT_LOG_STORAGE_ERRORS("%s", str.c_str());
+  push_event(EventJournal::event_storage_error);
 }
 
 uint32_t
-DownloadWrapper::receive_tracker_success(AddressList* l) {
-  uint32_t inserted = m_main->peer_list()->insert_available(l);
+DownloadWrapper::receive_tracker_success(const tracker::Tracker& tracker, AddressList* l) {
+  auto source = tracker.type() == TRACKER_DHT ? PeerList::source_dht : PeerList::source_tracker;
+
+  uint32_t inserted = m_main->peer_list()->insert_available(l, source);
   m_main->receive_connect_peers();
   m_main->receive_tracker_success();
 
+  utils::startup_end(info()->hash().str(), utils::startup_first_announce);
+
   ::utils::slot_list_call(info()->signal_tracker_success());
+  push_event(EventJournal::event_tracker_success, inserted);
   return inserted;
 }
 
 void
 DownloadWrapper::receive_tracker_failed(const std::string& msg) {
+  utils::startup_end(info()->hash().str(), utils::startup_first_announce);
+
   ::utils::slot_list_call(info()->signal_tracker_failed(), msg);
+  push_event(EventJournal::event_tracker_failed);
 }
 
 void
@@ -258,6 +330,19 @@ DownloadWrapper::receive_tick(uint32_t ticks) {
   if (!info()->is_open())
     return;
 
+  if (info()->is_active()) {
+    m_main->chunk_residency()->sample();
+
+    // Idle web seeds retry in case chunks became wanted again.
+    for (const auto& seed : *m_main->web_seeds())
+      seed->try_request();
+  }
+
+  for (const auto& peer : *m_main->connection_list()) {
+    peer->m_ptr()->update_tcp_info();
+    peer->m_ptr()->update_socket_tuning();
+  }
+
   // Every 2 minutes.
   if (ticks % 4 == 0) {
     if (info()->is_active()) {
@@ -285,6 +370,7 @@ DownloadWrapper::receive_tick(uint32_t ticks) {
     return (cachedTime - rak::timer::from_seconds(600)) < p.first;
   }).base(), haveQueue->end());
 
+  m_main->update_hibernation(manager->hibernate_timeout());
   m_main->receive_connect_peers();
 }
 
@@ -296,37 +382,92 @@ DownloadWrapper::receive_update_priorities() {
   data()->mutable_high_priority()->clear();
   data()->mutable_normal_priority()->clear();
 
-  for (auto& file : *m_main->file_list()) {
-    switch (file->priority()) {
-    case PRIORITY_NORMAL:
-    {
-      File::range_type range = file->range();
+  for (auto& file : *m_main->file_list())
+    insert_file_priority(file.get());
 
-      if (file->has_flags(File::flag_prioritize_first) && range.first != range.second) {
-        data()->mutable_high_priority()->insert(range.first, range.first + 1);
-        range.first++;
-      }
+  bool was_partial = data()->wanted_chunks() != 0;
+  data()->update_wanted_chunks();
 
-      if (file->has_flags(File::flag_prioritize_last) && range.first != range.second) {
-        data()->mutable_high_priority()->insert(range.second - 1, range.second);
-        range.second--;
-      }
+  updated_priorities(was_partial);
+}
+
+// Only the chunks of files [first, last> are recomputed, along with
+// those of neighbouring files sharing their first or last chunk.
+void
+DownloadWrapper::receive_update_priorities(uint32_t first, uint32_t last) {
+  FileList* file_list = m_main->file_list();
+
+  if (first >= last || last > file_list->size())
+    throw input_error("File range is out of bounds.");
+
+  auto first_itr = file_list->begin() + first;
+  auto last_itr = file_list->begin() + last;
+
+  uint32_t chunk_first = (*first_itr)->range().first;
+  uint32_t chunk_last = std::max(chunk_first, (*std::prev(last_itr))->range().second);
+
+  while (first_itr != file_list->begin() && (*std::prev(first_itr))->range().second > chunk_first)
+    first_itr--;
+
+  while (last_itr != file_list->end() && (*last_itr)->range().first < chunk_last)
+    last_itr++;
+
+  LT_LOG_THIS("update priorities: files:%" PRIu32 "-%" PRIu32 " chunks:%" PRIu32 "-%" PRIu32 " wanted_chunks:%" PRIu32,
+              first, last, chunk_first, chunk_last, data()->wanted_chunks());
+
+  uint32_t wanted_chunks = data()->wanted_chunks() - data()->calc_wanted_chunks(chunk_first, chunk_last);
+
+  data()->mutable_high_priority()->erase(chunk_first, chunk_last);
+  data()->mutable_normal_priority()->erase(chunk_first, chunk_last);
+
+  // Neighbouring files may reach outside the span, the parts outside
+  // are already in the ranges.
+  for (; first_itr != last_itr; first_itr++)
+    insert_file_priority(first_itr->get());
+
+  bool was_partial = data()->wanted_chunks() != 0;
+  data()->set_wanted_chunks(wanted_chunks + data()->calc_wanted_chunks(chunk_first, chunk_last));
 
-      data()->mutable_normal_priority()->insert(range);
-      break;
+  updated_priorities(was_partial);
+}
+
+void
+DownloadWrapper::push_event(EventJournal::event_type type, uint32_t value) {
+  manager->event_journal()->push(type, info()->hash(), value);
+}
+
+void
+DownloadWrapper::insert_file_priority(File* file) {
+  switch (file->priority()) {
+  case PRIORITY_NORMAL:
+  {
+    File::range_type range = file->range();
+
+    if (file->has_flags(File::flag_prioritize_first) && range.first != range.second) {
+      data()->mutable_high_priority()->insert(range.first, range.first + 1);
+      range.first++;
     }
-    case PRIORITY_HIGH:
-      data()->mutable_high_priority()->insert(file->range().first, file->range().second);
-      break;
-    default:
-      break;
+
+    if (file->has_flags(File::flag_prioritize_last) && range.first != range.second) {
+      data()->mutable_high_priority()->insert(range.second - 1, range.second);
+      range.second--;
     }
-  }
 
-  bool was_partial = data()->wanted_chunks() != 0;
-  data()->update_wanted_chunks();
+    data()->mutable_normal_priority()->insert(range);
+    break;
+  }
+  case PRIORITY_HIGH:
+    data()->mutable_high_priority()->insert(file->range().first, file->range().second);
+    break;
+  default:
+    break;
+  }
+}
 
+void
+DownloadWrapper::updated_priorities(bool was_partial) {
   m_main->chunk_selector()->update_priorities();
+  push_event(EventJournal::event_priority, data()->wanted_chunks());
 
   for (const auto& peer : *m_main->connection_list()) {
     peer->m_ptr()->update_interested();
@@ -359,6 +500,8 @@ DownloadWrapper::finished_download() {
 
   m_main->connection_list()->erase_seeders();
   info()->mutable_down_rate()->reset_rate();
+
+  push_event(EventJournal::event_completed);
 }
 
 }
@@ -2,13 +2,16 @@
 #define LIBTORRENT_DOWNLOAD_WRAPPER_H
 
 #include "data/chunk_handle.h"
+#include "data/hash_chunk.h"
 #include "download_main.h"
+#include "torrent/download/event_journal.h"
 
 namespace torrent {
 
 // Remember to clean up the pointers, DownloadWrapper won't do it.
 
 class AddressList;
+class File;
 class FileManager;
 class HashQueue;
 class HashTorrent;
@@ -60,19 +63,29 @@ public:
   void                receive_initial_hash();
   void                receive_hash_done(ChunkHandle handle, const char* hash);
 
-  void                check_chunk_hash(ChunkHandle handle);
+  void                check_chunk_hash(ChunkHandle handle, HashChunk::priority_type priority = HashChunk::priority_verify);
+
+  // Returns false if the chunk of a meta download is not a valid info
+  // dictionary.
+  bool                receive_metadata_done(ChunkHandle& handle);
 
   void                receive_storage_error(const std::string& str);
-  uint32_t            receive_tracker_success(AddressList* l);
+  uint32_t            receive_tracker_success(const tracker::Tracker& tracker, AddressList* l);
   void                receive_tracker_failed(const std::string& msg);
 
   void                receive_tick(uint32_t ticks);
 
   void                receive_update_priorities();
+  void                receive_update_priorities(uint32_t first, uint32_t last);
+
+  void                push_event(EventJournal::event_type type, uint32_t value = 0);
 
 private:
   void                finished_download();
 
+  void                insert_file_priority(File* file);
+  void                updated_priorities(bool was_partial);
+
   std::unique_ptr<DownloadMain> m_main;
   std::unique_ptr<Object>       m_bencode;
   std::unique_ptr<HashTorrent>  m_hash_checker;
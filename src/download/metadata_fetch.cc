@@ -0,0 +1,79 @@
+#include "config.h"
+
+#include "download/metadata_fetch.h"
+
+#include "download/delegator.h"
+#include "torrent/exceptions.h"
+#include "torrent/hash_string.h"
+#include "torrent/object.h"
+#include "torrent/object_stream.h"
+#include "torrent/utils/thread.h"
+
+namespace torrent {
+
+std::chrono::microseconds
+MetadataFetch::time_to_metadata() const {
+  if (!is_finished())
+    return std::chrono::microseconds{};
+
+  return m_finish_time - m_start_time;
+}
+
+// The start time is kept across restarts of an unfinished download,
+// so the time to metadata includes any time spent stopped.
+void
+MetadataFetch::start(Delegator* delegator) {
+  if (!is_started())
+    m_start_time = this_thread::cached_time();
+
+  delegator->set_straggler_timeout(straggler_timeout);
+}
+
+void
+MetadataFetch::stop(Delegator* delegator) {
+  delegator->set_straggler_timeout(std::chrono::microseconds{});
+}
+
+bool
+MetadataFetch::finish(const char* data, size_t length) {
+  if (!validate(data, length)) {
+    m_failed_count++;
+    return false;
+  }
+
+  if (!is_finished())
+    m_finish_time = this_thread::cached_time();
+
+  return true;
+}
+
+// Checks the fields DownloadConstructor::parse_info requires, so that
+// a client loading the metadata does not fail after the download has
+// been reported done.
+bool
+MetadataFetch::validate(const char* data, size_t length) {
+  Object info;
+
+  try {
+    if (object_read_bencode_c(data, data + length, &info) != data + length)
+      return false;
+
+  } catch (const bencode_error&) {
+    return false;
+  }
+
+  if (!info.is_map() || (info.flags() & Object::flag_unordered))
+    return false;
+
+  if (!info.has_key_string("name") || !info.has_key_value("piece length") || !info.has_key_string("pieces"))
+    return false;
+
+  const std::string& pieces = info.get_key_string("pieces");
+
+  if (pieces.empty() || pieces.size() % HashString::size_data != 0)
+    return false;
+
+  return info.has_key_value("length") || info.has_key_list("files");
+}
+
+}
@@ -0,0 +1,53 @@
+#ifndef LIBTORRENT_DOWNLOAD_METADATA_FETCH_H
+#define LIBTORRENT_DOWNLOAD_METADATA_FETCH_H
+
+#include <chrono>
+#include <cstddef>
+
+namespace torrent {
+
+class Delegator;
+
+// Coordinates fetching the info dictionary of a magnet link with
+// ut_metadata (BEP 9). Each metadata piece is a block of the single
+// chunk of the meta download, so the delegator already hands
+// different pieces to different peers. Pieces a peer has not delivered
+// within the straggler timeout are requested from another peer, and
+// whichever arrives first completes the piece.
+//
+// The assembled dictionary is hash checked against the info hash like
+// any chunk, then validated to hold what parsing the torrent requires
+// before the download is reported done.
+
+class MetadataFetch {
+public:
+  static constexpr std::chrono::seconds straggler_timeout{5};
+
+  bool                is_started() const                  { return m_start_time != std::chrono::microseconds{}; }
+  bool                is_finished() const                 { return m_finish_time != std::chrono::microseconds{}; }
+
+  // Time from starting the download to having valid metadata, zero
+  // until finished.
+  std::chrono::microseconds time_to_metadata() const;
+
+  uint32_t            failed_count() const                { return m_failed_count; }
+
+  void                start(Delegator* delegator);
+  void                stop(Delegator* delegator);
+
+  // Returns false if the hash checked metadata is not a usable info
+  // dictionary, in which case it is downloaded again.
+  bool                finish(const char* data, size_t length);
+
+  static bool         validate(const char* data, size_t length);
+
+private:
+  std::chrono::microseconds m_start_time{};
+  std::chrono::microseconds m_finish_time{};
+
+  uint32_t            m_failed_count{0};
+};
+
+}
+
+#endif
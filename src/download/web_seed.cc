@@ -0,0 +1,433 @@
+#include "config.h"
+
+#include "download/web_seed.h"
+
+#include <algorithm>
+#include <locale>
+#include <rak/socket_address.h>
+#include <rak/string_manip.h>
+
+#include "globals.h"
+#include "data/chunk.h"
+#include "data/chunk_list.h"
+#include "download/delegator.h"
+#include "download/download_main.h"
+#include "net/throttle_list.h"
+#include "torrent/download_info.h"
+#include "torrent/http.h"
+#include "torrent/data/block.h"
+#include "torrent/data/block_list.h"
+#include "torrent/data/block_transfer.h"
+#include "torrent/data/file.h"
+#include "torrent/data/file_list.h"
+#include "torrent/peer/peer_info.h"
+#include "torrent/utils/log.h"
+
+#define LT_LOG_SEED(log_fmt, ...)                                       \
+  lt_log_print_info(LOG_TORRENT_INFO, m_download->info(), "web_seed", "%s: " log_fmt, m_url.c_str(), __VA_ARGS__);
+
+namespace torrent {
+
+namespace {
+
+// Percent-encodes a path segment as in RFC 3986, leaving only the
+// unreserved characters as they are.
+std::string
+escape_path_segment(const std::string& segment) {
+  std::string result;
+  result.reserve(segment.size());
+
+  for (char c : segment) {
+    if (std::isalnum(c, std::locale::classic()) || c == '-' || c == '.' || c == '_' || c == '~') {
+      result += c;
+    } else {
+      result += '%';
+      result += rak::value_to_hexchar<1>(c);
+      result += rak::value_to_hexchar<0>(c);
+    }
+  }
+
+  return result;
+}
+
+}
+
+WebSeed::WebSeed(DownloadMain* download, std::string url) :
+    m_download(download),
+    m_url(std::move(url)) {
+
+  rak::socket_address address;
+  address.clear();
+
+  m_peer_info = std::make_unique<PeerInfo>(address.c_sockaddr());
+
+  m_peer_chunks.set_peer_info(m_peer_info.get());
+  m_peer_chunks.bitfield()->set_size_bits(download->file_list()->size_chunks());
+  m_peer_chunks.bitfield()->allocate();
+  m_peer_chunks.bitfield()->set_all();
+  m_peer_chunks.bitfield()->share_uniform();
+
+  m_peer_chunks.download_throttle()->set_weight(download->throttle_weight());
+  m_peer_chunks.download_throttle()->slot_activate() = [this] { try_request(); };
+
+  m_request_list.set_delegator(download->delegator());
+  m_request_list.set_peer_chunks(&m_peer_chunks);
+  m_request_list.set_download_request_latency(download->request_latency());
+
+  m_task_request.slot() = [this] { try_request(); };
+}
+
+WebSeed::~WebSeed() {
+  this_thread::scheduler()->erase(&m_task_request);
+
+  if (is_busy())
+    m_http->close();
+
+  clear_request();
+
+  if (m_download->download_throttle() != nullptr)
+    m_download->download_throttle()->erase(m_peer_chunks.download_throttle());
+}
+
+bool
+WebSeed::is_disabled() const {
+  return m_failed >= max_failed || m_peer_info->failed_counter() >= max_failed;
+}
+
+std::string
+WebSeed::file_url(const std::string& url, const std::string& name, const File* file, bool multi_file) {
+  std::string result = url;
+
+  // Single file torrents use the url as is, unless it names a
+  // directory.
+  if (!multi_file && (result.empty() || result.back() != '/'))
+    return result;
+
+  if (result.empty() || result.back() != '/')
+    result += '/';
+
+  result += escape_path_segment(name);
+
+  if (!multi_file)
+    return result;
+
+  for (const auto& element : *file->path())
+    result += '/' + escape_path_segment(element);
+
+  return result;
+}
+
+WebSeed::segment_list
+WebSeed::create_segments(const std::string& url, const std::string& name, const FileList* file_list, uint64_t first, uint64_t last) {
+  segment_list segments;
+
+  for (const auto& file : *file_list) {
+    if (file->offset() + file->size_bytes() <= first || file->size_bytes() == 0)
+      continue;
+
+    if (file->offset() >= last)
+      break;
+
+    uint64_t begin = std::max(first, file->offset());
+    uint64_t end   = std::min(last, file->offset() + file->size_bytes());
+
+    // BEP 47 padding files are not on the server, their zeros are
+    // filled in locally.
+    if (file->is_padding()) {
+      segments.push_back(segment_type{std::string(), begin - file->offset(), end - begin});
+      continue;
+    }
+
+    segments.push_back(segment_type{file_url(url, name, file.get(), file_list->is_multi_file()),
+                                    begin - file->offset(), end - begin});
+  }
+
+  return segments;
+}
+
+void
+WebSeed::try_request() {
+  if (is_busy() || is_disabled() || !Http::slot_factory() ||
+      !m_download->info()->is_active() || m_download->file_list()->is_done())
+    return;
+
+  ThrottleList* throttle = m_download->download_throttle();
+  ThrottleNode* node     = m_peer_chunks.download_throttle();
+  uint32_t      max_blocks = max_request_blocks;
+
+  if (throttle != nullptr) {
+    throttle->insert(node);
+
+    if (throttle->is_enabled()) {
+      uint32_t quota = throttle->node_quota(node);
+
+      if (quota == 0) {
+        this_thread::scheduler()->update_wait_for_ceil_seconds(&m_task_request, 1s);
+        return;
+      }
+
+      max_blocks = std::clamp<uint32_t>(quota / Delegator::block_size, 1, max_request_blocks);
+    }
+  }
+
+  auto pieces = m_request_list.delegate(max_blocks);
+
+  if (pieces.empty())
+    return;
+
+  // Only the run of consecutive blocks starting with the first is
+  // requested, the others are released for the next request or other
+  // peers.
+  FileList* file_list = m_download->file_list();
+
+  uint64_t first = file_list->chunk_index_position(pieces.front()->index()) + pieces.front()->offset();
+  uint64_t last  = first;
+
+  std::vector<Piece> released;
+
+  for (auto piece : pieces) {
+    uint64_t position = file_list->chunk_index_position(piece->index()) + piece->offset();
+
+    if (position != last || !released.empty()) {
+      released.push_back(*piece);
+      continue;
+    }
+
+    m_pieces.push_back(*piece);
+    last += piece->length();
+  }
+
+  for (const auto& piece : released)
+    m_request_list.rejected(piece);
+
+  m_segments = create_segments(m_url, m_download->info()->name(), file_list, first, last);
+
+  if (m_http == nullptr) {
+    m_http.reset(Http::slot_factory()());
+    m_stream = std::make_unique<WebSeedStream>(this);
+
+    m_http->signal_done().emplace_back([this] { receive_done(); });
+    m_http->signal_failed().emplace_back([this](const auto& msg) { receive_failed(msg); });
+  }
+
+  start_segment();
+}
+
+void
+WebSeed::start_segment() {
+  while (!m_segments.empty() && m_segments.front().is_padding()) {
+    if (!receive_padding(m_segments.front().length))
+      return request_failed("could not fill padding");
+
+    m_segments.pop_front();
+  }
+
+  if (m_segments.empty())
+    return finish_request();
+
+  const auto& segment = m_segments.front();
+
+  m_segment_received = 0;
+
+  m_http->set_url(segment.url);
+  m_http->set_stream(m_stream.get());
+  m_http->set_timeout(request_timeout);
+  m_http->set_range(segment.offset, segment.length);
+  m_http->start();
+}
+
+bool
+WebSeed::receive_data(const char* data, size_t length) {
+  if (m_segments.empty() || m_segment_received + length > m_segments.front().length)
+    return false;
+
+  m_segment_received += length;
+
+  while (length != 0) {
+    uint32_t used = receive_block(data, std::min<size_t>(length, Delegator::block_size));
+
+    if (used == 0)
+      return false;
+
+    data   += used;
+    length -= used;
+  }
+
+  return true;
+}
+
+bool
+WebSeed::receive_padding(uint64_t length) {
+  static const char zeros[Delegator::block_size] = {};
+
+  while (length != 0) {
+    uint32_t used = receive_block(zeros, std::min<uint64_t>(length, Delegator::block_size));
+
+    if (used == 0)
+      return false;
+
+    length -= used;
+  }
+
+  return true;
+}
+
+// Mirrors how connections process piece messages, with the blocks
+// of a request arriving back to back.
+uint32_t
+WebSeed::receive_block(const char* data, uint32_t length) {
+  if (!m_request_list.is_downloading()) {
+    if (m_pieces.empty())
+      return 0;
+
+    Piece piece = m_pieces.front();
+    m_pieces.pop_front();
+
+    m_request_list.downloading(piece);
+  }
+
+  BlockTransfer* transfer = m_request_list.transfer();
+
+  length = std::min(length, transfer->piece().length() - transfer->position());
+
+  uint32_t remaining = length;
+
+  // Skip data the leading transfer already has, and take over as the
+  // leader once ahead of it.
+  if (transfer->is_valid() && !transfer->is_leader()) {
+    uint32_t skip = 0;
+
+    if (transfer->block()->leader() != nullptr)
+      skip = std::min(remaining, transfer->block()->leader()->position() - transfer->position());
+
+    transfer->adjust_position(skip);
+    m_download->info()->mutable_skip_rate()->insert(skip);
+
+    data      += skip;
+    remaining -= skip;
+
+    if (remaining != 0)
+      transfer->block()->change_leader(transfer);
+  }
+
+  if (remaining != 0) {
+    if (transfer->is_valid() && transfer->is_leader()) {
+      if (!m_chunk.is_valid() || m_chunk.index() != transfer->index()) {
+        if (m_chunk.is_valid())
+          m_download->chunk_list()->release(&m_chunk);
+
+        m_chunk = m_download->chunk_list()->get(transfer->index(), ChunkList::get_writable);
+
+        if (!m_chunk.is_valid()) {
+          LT_LOG_SEED("chunk write error: index:%" PRIu32 " error:%s", transfer->index(), m_chunk.error_number().c_str());
+          return 0;
+        }
+      }
+
+      m_chunk.chunk()->from_buffer(data, transfer->piece().offset() + transfer->position(), remaining);
+
+    } else {
+      m_download->info()->mutable_skip_rate()->insert(remaining);
+    }
+
+    transfer->adjust_position(remaining);
+  }
+
+  if (m_download->download_throttle() != nullptr)
+    m_download->download_throttle()->node_used(m_peer_chunks.download_throttle(), length);
+
+  m_download->info()->mutable_down_rate()->insert(length);
+
+  if (transfer->is_finished())
+    finish_block();
+
+  return length;
+}
+
+void
+WebSeed::finish_block() {
+  BlockTransfer* transfer = m_request_list.transfer();
+
+  if (transfer->is_leader()) {
+    transfer->block()->parent()->hash_finished_blocks(m_chunk.chunk());
+
+    m_request_list.finished();
+    m_chunk.object()->set_time_modified(cachedTime);
+
+  } else {
+    m_request_list.skipped();
+  }
+
+  if (m_chunk.is_valid() && (m_pieces.empty() || m_pieces.front().index() != m_chunk.index()))
+    m_download->chunk_list()->release(&m_chunk);
+}
+
+void
+WebSeed::receive_done() {
+  m_http->close();
+
+  if (m_segment_received != m_segments.front().length)
+    return request_failed("reply shorter than the requested range");
+
+  m_segments.pop_front();
+  start_segment();
+}
+
+void
+WebSeed::finish_request() {
+  clear_request();
+
+  m_failed = 0;
+  this_thread::scheduler()->update_wait_for(&m_task_request, 0s);
+}
+
+void
+WebSeed::receive_failed(const std::string& message) {
+  m_http->close();
+  request_failed(message);
+}
+
+void
+WebSeed::request_failed(const std::string& message) {
+  clear_request();
+
+  m_failed++;
+
+  LT_LOG_SEED("request failed: failed:%" PRIu32 " message:%s", m_failed, message.c_str());
+
+  if (!is_disabled())
+    this_thread::scheduler()->update_wait_for_ceil_seconds(&m_task_request, retry_delay * m_failed);
+}
+
+void
+WebSeed::clear_request() {
+  m_segments.clear();
+  m_pieces.clear();
+
+  m_request_list.clear();
+
+  if (m_chunk.is_valid())
+    m_download->chunk_list()->release(&m_chunk);
+}
+
+std::streambuf::int_type
+WebSeedStream::overflow(std::streambuf::int_type c) {
+  using traits_type = std::streambuf::traits_type;
+
+  if (traits_type::eq_int_type(c, traits_type::eof()))
+    return traits_type::not_eof(c);
+
+  char ch = traits_type::to_char_type(c);
+
+  if (!m_seed->receive_data(&ch, 1))
+    return traits_type::eof();
+
+  return c;
+}
+
+std::streamsize
+WebSeedStream::xsputn(const char* s, std::streamsize n) {
+  return m_seed->receive_data(s, n) ? n : 0;
+}
+
+}
@@ -0,0 +1,141 @@
+#ifndef LIBTORRENT_DOWNLOAD_WEB_SEED_H
+#define LIBTORRENT_DOWNLOAD_WEB_SEED_H
+
+#include <deque>
+#include <iostream>
+#include <memory>
+#include <string>
+
+#include "data/chunk_handle.h"
+#include "protocol/peer_chunks.h"
+#include "protocol/request_list.h"
+#include "torrent/utils/scheduler.h"
+
+namespace torrent {
+
+class DownloadMain;
+class File;
+class FileList;
+class Http;
+class PeerInfo;
+class WebSeedStream;
+
+// Downloads from a BEP 19 web seed, an HTTP server holding the files
+// of the torrent. Towards the delegator it is a seeding peer with its
+// own PeerInfo, PeerChunks and RequestList, so chunks are picked
+// rarest-first and blocks are shared with connections in end-game
+// like for any peer.
+//
+// Each request covers a run of consecutive blocks, fetched with one
+// HTTP range request per file the run touches, and the data is
+// written to the chunks as it arrives. The ranges of padding files
+// are zero-filled without a request. The throttle of the download
+// is charged for the data, and requests are only started and sized
+// while it has quota.
+//
+// Requests go through the client's Http factory, which must support
+// ranges. Seeds that keep failing or sending corrupt chunks are
+// disabled until the download is restarted.
+
+class WebSeed {
+public:
+  static constexpr uint32_t max_request_blocks = 256;
+  static constexpr uint32_t max_failed         = 5;
+  static constexpr uint32_t request_timeout    = 60;
+
+  static constexpr std::chrono::seconds retry_delay{30};
+
+  WebSeed(DownloadMain* download, std::string url);
+  ~WebSeed();
+  WebSeed(const WebSeed&) = delete;
+  WebSeed& operator=(const WebSeed&) = delete;
+
+  const std::string&  url() const                 { return m_url; }
+
+  bool                is_busy() const             { return !m_segments.empty(); }
+  bool                is_disabled() const;
+
+  uint32_t            failed_count() const        { return m_failed; }
+
+  PeerInfo*           peer_info()                 { return m_peer_info.get(); }
+  RequestList*        request_list()              { return &m_request_list; }
+
+  // Starts a request unless busy, disabled or there is nothing to
+  // download.
+  void                try_request();
+
+  // Called by the stream with the body of the current request,
+  // returns false to abort it.
+  bool                receive_data(const char* data, size_t length);
+
+  // Padding segments have no url.
+  struct segment_type {
+    bool              is_padding() const { return url.empty(); }
+
+    std::string       url;
+    uint64_t          offset;
+    uint64_t          length;
+  };
+
+  using segment_list = std::deque<segment_type>;
+
+  // The url of a file, as described by BEP 19.
+  static std::string  file_url(const std::string& url, const std::string& name, const File* file, bool multi_file);
+
+  // The file ranges covering the torrent range [first, last>.
+  static segment_list create_segments(const std::string& url, const std::string& name, const FileList* file_list,
+                                      uint64_t first, uint64_t last);
+
+private:
+  void                start_segment();
+  void                finish_request();
+
+  void                receive_done();
+  void                receive_failed(const std::string& message);
+  void                request_failed(const std::string& message);
+
+  bool                receive_padding(uint64_t length);
+  uint32_t            receive_block(const char* data, uint32_t length);
+  void                finish_block();
+
+  void                clear_request();
+
+  DownloadMain*       m_download;
+  std::string         m_url;
+
+  std::unique_ptr<PeerInfo> m_peer_info;
+  PeerChunks          m_peer_chunks;
+  RequestList         m_request_list;
+
+  std::unique_ptr<Http>          m_http;
+  std::unique_ptr<WebSeedStream> m_stream;
+
+  // Blocks of the request not yet started, in the order they arrive,
+  // and the files ranges still to fetch.
+  std::deque<Piece>        m_pieces;
+  segment_list             m_segments;
+  uint64_t                 m_segment_received{0};
+
+  ChunkHandle         m_chunk;
+
+  uint32_t            m_failed{0};
+
+  utils::SchedulerEntry m_task_request;
+};
+
+// Output stream handed to Http, which passes the body to the web
+// seed.
+class WebSeedStream : private std::streambuf, public std::iostream {
+public:
+  WebSeedStream(WebSeed* seed) : std::iostream(this), m_seed(seed) {}
+
+private:
+  std::streambuf::int_type overflow(std::streambuf::int_type c) override;
+  std::streamsize     xsputn(const char* s, std::streamsize n) override;
+
+  WebSeed*            m_seed;
+};
+
+}
+
+#endif
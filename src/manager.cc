@@ -2,26 +2,40 @@
 
 #include "manager.h"
 
+#include <algorithm>
+#include <iterator>
+#include <vector>
+
 #include "data/chunk_list.h"
+#include "data/content_index.h"
 #include "data/hash_queue.h"
 #include "data/hash_torrent.h"
 #include "dht/dht_router.h"
+#include "download/available_list.h"
 #include "download/download_wrapper.h"
 #include "download/download_main.h"
+#include "download/download_prepare_queue.h"
 #include "protocol/handshake_manager.h"
+#include "net/address_list.h"
 #include "net/listen.h"
+#include "net/local_discovery.h"
+#include "net/utp_manager.h"
 #include "torrent/chunk_manager.h"
 #include "torrent/connection_manager.h"
 #include "torrent/data/file_manager.h"
 #include "torrent/download/choke_group.h"
 #include "torrent/download/choke_queue.h"
+#include "torrent/download/event_journal.h"
 #include "torrent/download/download_manager.h"
 #include "torrent/download/resource_manager.h"
+#include "torrent/memory_manager.h"
 #include "torrent/peer/client_list.h"
+#include "torrent/peer/peer_list.h"
 #include "torrent/throttle.h"
 #include "torrent/tracker/dht_controller.h"
 #include "torrent/tracker/manager.h"
 #include "utils/instrumentation.h"
+#include "utils/tick_wheel.h"
 
 namespace torrent {
 
@@ -30,23 +44,44 @@ Manager* manager = NULL;
 Manager::Manager() :
     m_chunk_manager(new ChunkManager),
     m_connection_manager(new ConnectionManager),
+    m_content_index(new ContentIndex),
     m_download_manager(new DownloadManager),
+    m_event_journal(new EventJournal),
     m_file_manager(new FileManager),
     m_handshake_manager(new HandshakeManager),
+    m_memory_manager(new MemoryManager),
     m_resource_manager(new ResourceManager),
+    m_utp_manager(new UtpManager),
+    m_download_ticks(new TickWheel(download_tick_period, download_tick_buckets)),
+
+    m_download_prepare_queue(new DownloadPrepareQueue),
 
     m_client_list(new ClientList),
     m_dht_controller(new tracker::DhtController),
 
     m_uploadThrottle(Throttle::create_throttle()),
-    m_downloadThrottle(Throttle::create_throttle()) {
+    m_downloadThrottle(Throttle::create_throttle()),
+    m_local_upload_throttle(Throttle::create_throttle()),
+    m_local_download_throttle(Throttle::create_throttle()) {
+
+  m_observed_inet.clear();
+  m_observed_inet6.clear();
 
   m_task_tick.slot() = [this] { receive_tick(); };
   torrent::this_thread::scheduler()->wait_for_ceil_seconds(&m_task_tick, 1s);
+  m_download_ticks->start();
 
   m_handshake_manager->slot_download_id() = [this](auto hash) { return m_download_manager->find_main(hash); };
   m_handshake_manager->slot_download_obfuscated() = [this](auto hash) { return m_download_manager->find_main_obfuscated(hash); };
   m_connection_manager->listen()->slot_accepted() = [this](auto fd, auto sa) { return m_handshake_manager->add_incoming(fd, sa); };
+  m_utp_manager->slot_accepted() = [this](auto fd, auto& sa) { return m_handshake_manager->add_incoming_utp(fd, sa); };
+  m_utp_manager->slot_filter() = [this](auto& sa) {
+      return (m_connection_manager->utp_options() & ConnectionManager::utp_incoming) &&
+        m_connection_manager->can_connect() && m_connection_manager->filter(sa.c_sockaddr());
+    };
+  m_connection_manager->slot_connect() = [this](uint32_t budget) { return receive_connect(budget); };
+  m_connection_manager->slot_connect_deficit() = [this] { return connect_deficit(); };
+  m_memory_manager->add_shed_slot([this](auto category, auto) { receive_shed_memory(category); });
 
   m_resource_manager->push_group("default");
   m_resource_manager->group_back()->up_queue()->set_heuristics(choke_queue::HEURISTICS_UPLOAD_LEECH);
@@ -55,13 +90,21 @@ Manager::Manager() :
 
 Manager::~Manager() {
   torrent::this_thread::scheduler()->erase(&m_task_tick);
+  m_download_ticks->stop();
+
+  // Workers may still be reading the encoding list.
+  m_download_prepare_queue.reset();
 
   m_handshake_manager->clear();
   m_download_manager->clear();
   m_dht_controller.reset();
+  m_utp_manager.reset();
+  m_local_discovery.reset();
 
   Throttle::destroy_throttle(m_uploadThrottle);
   Throttle::destroy_throttle(m_downloadThrottle);
+  Throttle::destroy_throttle(m_local_upload_throttle);
+  Throttle::destroy_throttle(m_local_download_throttle);
 
   instrumentation_tick();
 }
@@ -81,8 +124,11 @@ Manager::initialize_download(DownloadWrapper* d) {
   // TODO: The resource manager doesn't need to know about this
   // download until we start/stop the torrent.
   m_download_manager->insert(d);
+  m_download_ticks->insert(d, [d](uint32_t round) { d->receive_tick(round); });
   m_resource_manager->insert(d->main(), 1);
+  m_event_journal->push(EventJournal::event_added, d->info()->hash());
   m_chunk_manager->insert(d->main()->chunk_list());
+  m_content_index->insert_download(d);
 
   d->main()->chunk_list()->set_chunk_size(d->main()->file_list()->chunk_size());
 
@@ -97,8 +143,184 @@ Manager::cleanup_download(DownloadWrapper* d) {
 
   m_resource_manager->erase(d->main());
   m_chunk_manager->erase(d->main()->chunk_list());
+  m_content_index->erase_download(d);
 
+  m_download_ticks->erase(d);
   m_download_manager->erase(d);
+  m_event_journal->push(EventJournal::event_removed, d->info()->hash());
+}
+
+uint32_t
+Manager::connect_deficit() {
+  uint32_t deficit = 0;
+
+  for (auto wrapper : *m_download_manager)
+    deficit += wrapper->main()->connect_deficit();
+
+  return deficit;
+}
+
+// Split the connect budget between the downloads in proportion to the
+// number of peers they are missing, giving the remainder to those
+// missing the most.
+uint32_t
+Manager::receive_connect(uint32_t budget) {
+  std::vector<std::pair<DownloadMain*, uint32_t>> wanted;
+  uint64_t total = 0;
+
+  for (auto wrapper : *m_download_manager) {
+    uint32_t deficit = wrapper->main()->connect_deficit();
+
+    if (deficit == 0)
+      continue;
+
+    wanted.emplace_back(wrapper->main(), deficit);
+    total += deficit;
+  }
+
+  if (total == 0)
+    return 0;
+
+  uint32_t attempts = 0;
+
+  if (budget >= total) {
+    for (auto& entry : wanted)
+      attempts += entry.first->connect_peers(entry.second);
+
+    return attempts;
+  }
+
+  std::sort(wanted.begin(), wanted.end(), [](auto& a, auto& b) { return a.second > b.second; });
+
+  std::vector<uint32_t> shares;
+  uint32_t remainder = budget;
+
+  for (auto& entry : wanted) {
+    shares.push_back(uint64_t(budget) * entry.second / total);
+    remainder -= shares.back();
+  }
+
+  for (size_t i = 0; i < wanted.size(); i++)
+    attempts += wanted[i].first->connect_peers(shares[i] + (i < remainder ? 1 : 0));
+
+  return attempts;
+}
+
+// Halves the available lists, or drops peers not connected to in the
+// last day even if they have failed before.
+void
+Manager::receive_shed_memory(int category) {
+  for (auto wrapper : *m_download_manager) {
+    auto peer_list = wrapper->main()->peer_list();
+
+    switch (category) {
+    case MemoryManager::category_available_list:
+      peer_list->available_list()->shrink(peer_list->available_list()->size() / 2);
+      break;
+    case MemoryManager::category_peer_list:
+      peer_list->cull_peers(PeerList::cull_old);
+      break;
+    default:
+      break;
+    }
+  }
+}
+
+// Demotes the paused downloads that have been paused the longest
+// until the rest fit the paused budget, or all of them if the chunk
+// memory is exhausted.
+void
+Manager::demote_paused() {
+  std::vector<std::pair<DownloadMain*, uint64_t>> paused;
+  uint64_t total = 0;
+
+  for (auto wrapper : *m_download_manager) {
+    if (!wrapper->info()->is_paused())
+      continue;
+
+    paused.emplace_back(wrapper->main(), wrapper->main()->paused_memory_usage());
+    total += paused.back().second;
+  }
+
+  if (paused.empty())
+    return;
+
+  uint64_t budget = m_chunk_manager->memory_usage() >= m_chunk_manager->max_memory_usage() ? 0 : m_chunk_manager->paused_budget();
+
+  std::sort(paused.begin(), paused.end(), [](const auto& a, const auto& b) {
+      return a.first->paused_since() < b.first->paused_since();
+    });
+
+  for (auto itr = paused.begin(); itr != paused.end() && (total > budget || budget == 0); itr++) {
+    itr->first->release_warm();
+    total -= itr->second;
+  }
+}
+
+void
+Manager::set_observed_address(const rak::socket_address& sa) {
+  if (sa.family() == AF_INET)
+    m_observed_inet = sa;
+  else if (sa.family() == AF_INET6)
+    m_observed_inet6 = sa;
+}
+
+// Opens or closes the socket to follow the settings and the listen
+// port, then announces the active public downloads.
+void
+Manager::update_local_discovery() {
+  uint16_t port = m_connection_manager->listen_port();
+
+  if (!m_connection_manager->is_local_discovery() || !m_connection_manager->listen()->is_open() || port == 0) {
+    m_local_discovery.reset();
+    m_local_announced.clear();
+    return;
+  }
+
+  if (m_local_discovery == nullptr || m_local_discovery->listen_port() != port) {
+    m_local_discovery = std::make_unique<LocalDiscovery>();
+    m_local_discovery->slot_peer_found() = [this](auto& hash, auto& sa) { receive_local_peer(hash, sa); };
+    m_local_announced.clear();
+
+    if (!m_local_discovery->open(port)) {
+      m_local_discovery.reset();
+      return;
+    }
+  }
+
+  std::vector<HashString> active;
+
+  for (auto wrapper : *m_download_manager)
+    if (wrapper->info()->is_active() && !wrapper->info()->is_private())
+      active.push_back(wrapper->info()->hash());
+
+  std::sort(active.begin(), active.end());
+
+  if (m_ticks % local_announce_ticks == 0) {
+    m_local_discovery->announce(active);
+
+  } else {
+    std::vector<HashString> added;
+
+    std::set_difference(active.begin(), active.end(), m_local_announced.begin(), m_local_announced.end(), std::back_inserter(added));
+    m_local_discovery->announce(added);
+  }
+
+  m_local_announced = std::move(active);
+}
+
+void
+Manager::receive_local_peer(const HashString& hash, const rak::socket_address& sa) {
+  DownloadMain* download = m_download_manager->find_main(hash.c_str());
+
+  if (download == nullptr || !download->info()->is_active() || download->info()->is_private())
+    return;
+
+  AddressList addresses;
+  addresses.push_back(sa);
+
+  download->peer_list()->insert_available(&addresses, PeerList::source_local);
+  download->receive_connect_peers();
 }
 
 void
@@ -110,16 +332,12 @@ Manager::receive_tick() {
 
   m_resource_manager->receive_tick();
   m_chunk_manager->periodic_sync();
+  m_memory_manager->check_budgets();
+  demote_paused();
+  update_local_discovery();
 
-  // To ensure the downloads get equal chance over time at using
-  // various limited resources, like sockets for handshakes, cycle the
-  // group in reverse order.
-  if (!m_download_manager->empty()) {
-    auto split = m_download_manager->end() - m_ticks % m_download_manager->size() - 1;
-
-    std::for_each(split, m_download_manager->end(), [this](auto wrapper) { return wrapper->receive_tick(m_ticks); });
-    std::for_each(m_download_manager->begin(), split, [this](auto wrapper) { return wrapper->receive_tick(m_ticks); });
-  }
+  // The downloads are ticked by 'm_download_ticks', spread over the
+  // same period.
 
   // If you change the interval, make sure the keepalives gets
   // triggered every 120 seconds.
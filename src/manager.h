@@ -4,29 +4,53 @@
 #include <list>
 #include <memory>
 #include <string>
+#include <vector>
+#include <rak/socket_address.h>
 
 #include "torrent/common.h"
 #include "torrent/utils/scheduler.h"
 
 namespace torrent {
 
+class ContentIndex;
 class DownloadManager;
+class DownloadPrepareQueue;
+class EventJournal;
 class FileManager;
+class LocalDiscovery;
 class ResourceManager;
+class TickWheel;
+class UtpManager;
 
 using EncodingList = std::list<std::string>;
 
 class Manager {
 public:
+  // Ticks between announcing all downloads with local service
+  // discovery.
+  static constexpr unsigned int local_announce_ticks = 10;
+
+  // Each download ticks once every 'download_tick_period', the
+  // downloads spread over one bucket per second.
+  static constexpr std::chrono::seconds download_tick_period{30};
+  static constexpr uint32_t             download_tick_buckets = 30;
+
   Manager();
   ~Manager();
 
   ChunkManager*       chunk_manager()      { return m_chunk_manager.get(); }
   ConnectionManager*  connection_manager() { return m_connection_manager.get(); }
+  ContentIndex*       content_index()      { return m_content_index.get(); }
   DownloadManager*    download_manager()   { return m_download_manager.get(); }
+  EventJournal*       event_journal()      { return m_event_journal.get(); }
   FileManager*        file_manager()       { return m_file_manager.get(); }
   HandshakeManager*   handshake_manager()  { return m_handshake_manager.get(); }
+  MemoryManager*      memory_manager()     { return m_memory_manager.get(); }
   ResourceManager*    resource_manager()   { return m_resource_manager.get(); }
+  UtpManager*         utp_manager()        { return m_utp_manager.get(); }
+  LocalDiscovery*     local_discovery()    { return m_local_discovery.get(); }
+
+  DownloadPrepareQueue* download_prepare_queue() { return m_download_prepare_queue.get(); }
 
   ClientList*             client_list()    { return m_client_list.get(); }
   tracker::DhtController* dht_controller() { return m_dht_controller.get(); }
@@ -36,18 +60,46 @@ public:
   Throttle*           upload_throttle()    { return m_uploadThrottle; }
   Throttle*           download_throttle()  { return m_downloadThrottle; }
 
+  // Unlimited throttles used by local peers.
+  Throttle*           local_upload_throttle()    { return m_local_upload_throttle; }
+  Throttle*           local_download_throttle()  { return m_local_download_throttle; }
+
+  // Our address as seen on the latest outgoing connection of the
+  // family, cleared if none.
+  const rak::socket_address& observed_address(int family) const { return family == AF_INET6 ? m_observed_inet6 : m_observed_inet; }
+  void                set_observed_address(const rak::socket_address& sa);
+
+  uint32_t            hibernate_timeout() const          { return m_hibernate_timeout; }
+  void                set_hibernate_timeout(uint32_t s)  { m_hibernate_timeout = s; }
+
   void                initialize_download(DownloadWrapper* d);
   void                cleanup_download(DownloadWrapper* d);
 
   void                receive_tick();
 
 private:
+  uint32_t            connect_deficit();
+  uint32_t            receive_connect(uint32_t budget);
+  void                receive_shed_memory(int category);
+  void                demote_paused();
+
+  void                update_local_discovery();
+  void                receive_local_peer(const HashString& hash, const rak::socket_address& sa);
+
   std::unique_ptr<ChunkManager>      m_chunk_manager;
   std::unique_ptr<ConnectionManager> m_connection_manager;
+  std::unique_ptr<ContentIndex>      m_content_index;
   std::unique_ptr<DownloadManager>   m_download_manager;
+  std::unique_ptr<EventJournal>      m_event_journal;
   std::unique_ptr<FileManager>       m_file_manager;
   std::unique_ptr<HandshakeManager>  m_handshake_manager;
+  std::unique_ptr<MemoryManager>     m_memory_manager;
   std::unique_ptr<ResourceManager>   m_resource_manager;
+  std::unique_ptr<UtpManager>        m_utp_manager;
+  std::unique_ptr<LocalDiscovery>    m_local_discovery;
+  std::unique_ptr<TickWheel>         m_download_ticks;
+
+  std::unique_ptr<DownloadPrepareQueue> m_download_prepare_queue;
 
   std::unique_ptr<ClientList>             m_client_list;
   std::unique_ptr<tracker::DhtController> m_dht_controller;
@@ -56,6 +108,17 @@ private:
 
   Throttle*           m_uploadThrottle;
   Throttle*           m_downloadThrottle;
+  Throttle*           m_local_upload_throttle;
+  Throttle*           m_local_download_throttle;
+
+  uint32_t            m_hibernate_timeout{0};
+
+  rak::socket_address m_observed_inet;
+  rak::socket_address m_observed_inet6;
+
+  // Downloads announced by local service discovery, new ones are
+  // announced on the next tick and all of them every few minutes.
+  std::vector<HashString> m_local_announced;
 
   unsigned int          m_ticks{0};
   utils::SchedulerEntry m_task_tick;
@@ -0,0 +1,134 @@
+#include "config.h"
+
+#include "net/bind_list.h"
+
+#include <algorithm>
+
+#include "net/listen.h"
+#include "net/socket_fd.h"
+#include "torrent/exceptions.h"
+#include "torrent/rate.h"
+#include "torrent/throttle.h"
+
+namespace torrent {
+
+BindList::~BindList() {
+  clear();
+}
+
+void
+BindList::set_selection(uint32_t s) {
+  if (s != select_round_robin && s != select_least_loaded)
+    throw input_error("Invalid bind address selection.");
+
+  m_selection = s;
+}
+
+void
+BindList::insert(const sockaddr* sa, uint32_t weight) {
+  const rak::socket_address* rsa = rak::socket_address::cast_from(sa);
+
+  if (rsa->family() != rak::socket_address::af_inet || rsa->sa_inet()->is_address_any())
+    throw input_error("Tried to add a bind address that is not an af_inet address.");
+
+  if (weight == 0)
+    throw input_error("Tried to add a bind address with a weight of zero.");
+
+  if (find(sa) != nullptr)
+    throw input_error("Tried to add a bind address twice.");
+
+  entry_type entry;
+  entry.address.sa_inet()->clear();
+  entry.address.sa_inet()->set_address_n(rsa->sa_inet()->address_n());
+  entry.weight = weight;
+  entry.upload_throttle = Throttle::create_throttle();
+  entry.download_throttle = Throttle::create_throttle();
+
+  m_list.push_back(std::move(entry));
+}
+
+void
+BindList::clear() {
+  for (auto& entry : m_list) {
+    entry.listen.reset();
+
+    Throttle::destroy_throttle(entry.upload_throttle);
+    Throttle::destroy_throttle(entry.download_throttle);
+  }
+
+  m_list.clear();
+}
+
+// Smooth weighted round-robin: every pick raises each entry by its
+// weight and lowers the picked one by the total, spreading the picks
+// of heavier entries out instead of handing them out in runs.
+//
+// With least loaded the entry with the least traffic per weight wins,
+// the round-robin order breaking ties so idle entries still take
+// turns.
+BindList::entry_type*
+BindList::select() {
+  if (m_list.empty())
+    return nullptr;
+
+  int64_t total = 0;
+
+  for (auto& entry : m_list) {
+    entry.current_weight += entry.weight;
+    total += entry.weight;
+  }
+
+  auto best = m_list.begin();
+
+  if (m_selection == select_least_loaded) {
+    uint64_t best_load = load(*best);
+
+    for (auto itr = std::next(m_list.begin()); itr != m_list.end(); itr++) {
+      uint64_t itr_load = load(*itr);
+
+      if (itr_load < best_load || (itr_load == best_load && itr->current_weight > best->current_weight)) {
+        best = itr;
+        best_load = itr_load;
+      }
+    }
+
+  } else {
+    best = std::max_element(m_list.begin(), m_list.end(), [](auto& a, auto& b) {
+        return a.current_weight < b.current_weight;
+      });
+  }
+
+  best->current_weight -= total;
+  return &*best;
+}
+
+BindList::entry_type*
+BindList::find(const sockaddr* sa) {
+  const rak::socket_address* rsa = rak::socket_address::cast_from(sa);
+
+  if (rsa->family() != rak::socket_address::af_inet)
+    return nullptr;
+
+  auto itr = std::find_if(m_list.begin(), m_list.end(), [rsa](auto& entry) {
+      return entry.address.sa_inet()->address_n() == rsa->sa_inet()->address_n();
+    });
+
+  return itr != m_list.end() ? &*itr : nullptr;
+}
+
+BindList::entry_type*
+BindList::find_socket(SocketFd fd) {
+  rak::socket_address sa;
+
+  if (m_list.empty() || !fd.getsockname(&sa))
+    return nullptr;
+
+  return find(sa.c_sockaddr());
+}
+
+uint64_t
+BindList::load(const entry_type& entry) {
+  return (entry.upload_throttle->rate()->rate() + entry.download_throttle->rate()->rate()) / entry.weight;
+}
+
+}
@@ -0,0 +1,81 @@
+#ifndef LIBTORRENT_NET_BIND_LIST_H
+#define LIBTORRENT_NET_BIND_LIST_H
+
+#include <cinttypes>
+#include <memory>
+#include <vector>
+#include <rak/socket_address.h>
+
+namespace torrent {
+
+class Listen;
+class SocketFd;
+class Throttle;
+
+// The local addresses of a multi-homed host. Outgoing connections are
+// spread over them, either by smooth weighted round-robin or to the
+// address with the least traffic per weight, and each address has its
+// own upload and download throttles. The throttles are unlimited until
+// given a max rate.
+//
+// Only af_inet addresses are accepted, matching the single bind
+// address.
+
+class BindList {
+public:
+  static constexpr uint32_t select_round_robin  = 0;
+  static constexpr uint32_t select_least_loaded = 1;
+
+  struct entry_type {
+    rak::socket_address     address;
+    uint32_t                weight;
+    int64_t                 current_weight{0};
+
+    Throttle*               upload_throttle;
+    Throttle*               download_throttle;
+
+    std::unique_ptr<Listen> listen;
+  };
+
+  using list_type = std::vector<entry_type>;
+
+  BindList() = default;
+  ~BindList();
+
+  BindList(const BindList&) = delete;
+  BindList& operator=(const BindList&) = delete;
+
+  bool                empty() const                     { return m_list.empty(); }
+  uint32_t            size() const                      { return m_list.size(); }
+
+  entry_type&         at(uint32_t index)                { return m_list.at(index); }
+  const entry_type&   at(uint32_t index) const          { return m_list.at(index); }
+
+  uint32_t            selection() const                 { return m_selection; }
+  void                set_selection(uint32_t s);
+
+  // Throws input_error on an invalid or duplicate address, or a weight
+  // of zero. The port is ignored.
+  void                insert(const sockaddr* sa, uint32_t weight);
+  void                clear();
+
+  // Returns null when empty.
+  entry_type*         select();
+
+  entry_type*         find(const sockaddr* sa);
+
+  // Finds the entry of the address the socket is bound to, without a
+  // syscall when empty.
+  entry_type*         find_socket(SocketFd fd);
+
+  // Traffic per weight over the throttles' rate window.
+  static uint64_t     load(const entry_type& entry);
+
+private:
+  list_type           m_list;
+  uint32_t            m_selection{select_round_robin};
+};
+
+}
+
+#endif
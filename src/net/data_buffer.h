@@ -43,6 +43,11 @@
 namespace torrent {
 
 // Recipient must call clear() when done with the buffer.
+//
+// A buffer may instead be shared, in which case its data is
+// immutable and freed when the last copy is cleared. Copies of a
+// shared buffer only add a reference, allowing one message to be
+// queued on many connections without copying.
 struct DataBuffer {
   DataBuffer() = default;
   DataBuffer(char* data, char* end)   : m_data(data), m_end(end) {}
@@ -54,12 +59,19 @@ struct DataBuffer {
   char*               end() const          { return m_end; }
 
   bool                owned() const        { return m_owned; }
+  bool                shared() const       { return m_shared != nullptr; }
   bool                empty() const        { return m_data == NULL; }
   size_t              length() const       { return m_end - m_data; }
 
   void                clear();
   void                set(char* data, char* end, bool owned);
 
+  // Turn an owned buffer into a shared one.
+  void                share();
+
+  // Returns a reference to part of a shared buffer.
+  DataBuffer          slice(size_t offset, size_t length) const;
+
 private:
   char*               m_data{};
   char*               m_end{};
@@ -67,6 +79,8 @@ private:
   // Used to indicate if buffer held by PCB is its own and needs to be
   // deleted after transmission (false if shared with other connections).
   bool                m_owned{true};
+
+  std::shared_ptr<char[]> m_shared;
 };
 
 inline void
@@ -76,6 +90,7 @@ DataBuffer::clear() {
 
   m_data = m_end = NULL;
   m_owned = false;
+  m_shared.reset();
 }
 
 inline void
@@ -83,8 +98,25 @@ DataBuffer::set(char* data, char* end, bool owned) {
   m_data = data;
   m_end = end;
   m_owned = owned;
+  m_shared.reset();
+}
+
+inline void
+DataBuffer::share() {
+  if (empty() || !m_owned)
+    return;
+
+  m_shared.reset(m_data);
+  m_owned = false;
 }
 
+inline DataBuffer
+DataBuffer::slice(size_t offset, size_t length) const {
+  DataBuffer d = clone();
+  d.m_data += offset;
+  d.m_end = d.m_data + length;
+  return d;
+}
 }
 
 #endif
@@ -4,12 +4,16 @@
 
 #include "listen.h"
 
+#include <cstring>
+#include <future>
+#include <mutex>
 #include <unistd.h>
 #include <arpa/inet.h>
 #include <netinet/in.h>
 #include <sys/socket.h>
 
 #include "manager.h"
+#include "net/thread_net.h"
 #include "rak/socket_address.h"
 #include "torrent/exceptions.h"
 #include "torrent/connection_manager.h"
@@ -19,6 +23,150 @@
 
 namespace torrent {
 
+class ListenShard : public SocketBase {
+public:
+  ListenShard(Listen* parent) : m_parent(parent), m_owner(thread_self()) {}
+  ~ListenShard() override { close(); }
+
+  bool                open(const rak::socket_address& sa, int backlog, int cpu);
+  void                close();
+
+  const char*         type_name() const override { return "listen_shard"; }
+
+  void                event_read() override;
+  void                event_write() override;
+  void                event_error() override;
+
+private:
+  void                call_net(const std::function<void ()>& fn);
+  void                process_accepted();
+
+  Listen*             m_parent;
+  utils::Thread*      m_owner;
+
+  std::mutex          m_mutex;
+  std::vector<std::pair<SocketFd, rak::socket_address>> m_accepted;
+};
+
+// Runs 'fn' on thread_net and waits for it, or runs it directly if the
+// thread has not been started.
+void
+ListenShard::call_net(const std::function<void ()>& fn) {
+  if (!thread_net()->is_active()) {
+    fn();
+    return;
+  }
+
+  std::promise<void> done;
+
+  thread_net()->callback(this, [&fn, &done]() { fn(); done.set_value(); });
+  done.get_future().wait();
+}
+
+bool
+ListenShard::open(const rak::socket_address& sa, int backlog, int cpu) {
+  if (!get_fd().open_stream() ||
+      !get_fd().set_nonblock() ||
+      !get_fd().set_reuse_address(true) ||
+      !get_fd().set_reuse_port(true))
+    throw resource_error("Could not allocate socket for listening.");
+
+  if (cpu >= 0 && !get_fd().set_incoming_cpu(cpu))
+    lt_log_print(LOG_CONNECTION_LISTEN, "could not set incoming cpu %i on listen shard", cpu);
+
+  if (m_parent->m_defer_accept != 0 && !get_fd().set_defer_accept(m_parent->m_defer_accept))
+    lt_log_print(LOG_CONNECTION_LISTEN, "could not set deferred accept on listen shard");
+
+  if (!get_fd().bind(sa) || !get_fd().listen(backlog)) {
+    get_fd().close();
+    get_fd().clear();
+    return false;
+  }
+
+  manager->connection_manager()->inc_socket_count();
+
+  call_net([this]() {
+      thread_self()->poll()->open(this);
+      thread_self()->poll()->insert_read(this);
+      thread_self()->poll()->insert_error(this);
+    });
+
+  return true;
+}
+
+void
+ListenShard::close() {
+  if (!get_fd().is_valid())
+    return;
+
+  call_net([this]() {
+      thread_net()->poll()->remove_read(this);
+      thread_net()->poll()->remove_error(this);
+      thread_net()->poll()->close(this);
+    });
+
+  m_owner->cancel_callback_and_wait(this);
+
+  for (auto& accepted : m_accepted)
+    accepted.first.close();
+
+  m_accepted.clear();
+
+  manager->connection_manager()->dec_socket_count();
+
+  get_fd().close();
+  get_fd().clear();
+}
+
+// Drains the backlog on thread_net, only the first connection queued
+// since the last hand-off schedules a callback on the owning thread.
+void
+ListenShard::event_read() {
+  rak::socket_address sa;
+  SocketFd fd;
+
+  auto lock = std::scoped_lock(m_mutex);
+  bool was_empty = m_accepted.empty();
+
+  while ((fd = get_fd().accept(&sa)).is_valid())
+    m_accepted.emplace_back(fd, sa);
+
+  if (was_empty && !m_accepted.empty())
+    m_owner->callback(this, [this]() { process_accepted(); });
+}
+
+void
+ListenShard::process_accepted() {
+  std::vector<std::pair<SocketFd, rak::socket_address>> accepted;
+
+  {
+    auto lock = std::scoped_lock(m_mutex);
+    accepted.swap(m_accepted);
+  }
+
+  for (auto& connection : accepted)
+    m_parent->m_slot_accepted(connection.first, connection.second);
+}
+
+void
+ListenShard::event_write() {
+  throw internal_error("Listener does not support write().");
+}
+
+void
+ListenShard::event_error() {
+  int error = get_fd().get_error();
+
+  if (error != 0)
+    throw internal_error("Listener shard received an error event: " + std::string(std::strerror(error)));
+}
+
+Listen::Listen() = default;
+
+Listen::~Listen() {
+  close();
+}
+
 bool
 Listen::open(uint16_t first, uint16_t last, int backlog, const rak::socket_address* bindAddress) {
   close();
@@ -33,9 +181,16 @@ Listen::open(uint16_t first, uint16_t last, int backlog, const rak::socket_addre
 
   if (!get_fd().open_stream() ||
       !get_fd().set_nonblock() ||
-      !get_fd().set_reuse_address(true))
+      !get_fd().set_reuse_address(true) ||
+      (m_shards > 1 && !get_fd().set_reuse_port(true)))
     throw resource_error("Could not allocate socket for listening.");
 
+  if (m_shards > 1 && m_incoming_cpu && !get_fd().set_incoming_cpu(0))
+    lt_log_print(LOG_CONNECTION_LISTEN, "could not set incoming cpu 0 on listen port");
+
+  if (m_defer_accept != 0 && !get_fd().set_defer_accept(m_defer_accept))
+    lt_log_print(LOG_CONNECTION_LISTEN, "could not set deferred accept on listen port");
+
   rak::socket_address sa;
 
   // TODO: Temporary until we refactor:
@@ -60,8 +215,19 @@ Listen::open(uint16_t first, uint16_t last, int backlog, const rak::socket_addre
       thread_self()->poll()->insert_read(this);
       thread_self()->poll()->insert_error(this);
 
-      lt_log_print(LOG_CONNECTION_LISTEN, "listen port %" PRIu64 " opened with backlog set to %i",
-                   m_port, backlog);
+      for (uint32_t i = 1; i < m_shards; i++) {
+        auto shard = std::make_unique<ListenShard>(this);
+
+        if (!shard->open(sa, backlog, m_incoming_cpu ? int(i) : -1)) {
+          lt_log_print(LOG_CONNECTION_LISTEN, "could not open listen shard %u on port %" PRIu64, i, m_port);
+          break;
+        }
+
+        m_shard_list.push_back(std::move(shard));
+      }
+
+      lt_log_print(LOG_CONNECTION_LISTEN, "listen port %" PRIu64 " opened with backlog set to %i and %zu shards",
+                   m_port, backlog, m_shard_list.size() + 1);
 
       return true;
 
@@ -81,6 +247,8 @@ void Listen::close() {
   if (!get_fd().is_valid())
     return;
 
+  m_shard_list.clear();
+
   thread_self()->poll()->remove_read(this);
   thread_self()->poll()->remove_error(this);
   thread_self()->poll()->close(this);
@@ -39,6 +39,8 @@
 
 #include <cinttypes>
 #include <functional>
+#include <memory>
+#include <vector>
 #include <rak/socket_address.h>
 
 #include "socket_base.h"
@@ -46,11 +48,14 @@
 
 namespace torrent {
 
+class ListenShard;
+
 class Listen : public SocketBase {
 public:
   using slot_connection = std::function<void(SocketFd, const rak::socket_address&)>;
 
-  ~Listen() override { close(); }
+  Listen();
+  ~Listen() override;
 
   bool                open(uint16_t first, uint16_t last, int backlog, const rak::socket_address* bindAddress);
   void                close();
@@ -59,6 +64,22 @@ public:
 
   uint16_t            port() const { return m_port; }
 
+  // Number of SO_REUSEPORT sockets sharing the port. The first accepts
+  // on the owning thread and the others on thread_net, which hands the
+  // connections back to the owning thread. With 'incoming_cpu' the
+  // kernel steers connections handled by cpu N to socket N. Set before
+  // opening.
+  uint32_t            shards() const                { return m_shards; }
+  bool                is_incoming_cpu() const       { return m_incoming_cpu; }
+
+  void                set_shards(uint32_t s)        { m_shards = s; }
+  void                set_incoming_cpu(bool state)  { m_incoming_cpu = state; }
+
+  // Seconds the kernel holds new connections that have not sent any
+  // data, zero to disable. Set before opening.
+  int                 defer_accept() const          { return m_defer_accept; }
+  void                set_defer_accept(int seconds) { m_defer_accept = seconds; }
+
   slot_connection&    slot_accepted() { return m_slot_accepted; }
 
   void                event_read() override;
@@ -66,9 +87,16 @@ public:
   void                event_error() override;
 
 private:
+  friend class ListenShard;
+
   uint64_t            m_port{0};
+  uint32_t            m_shards{1};
+  bool                m_incoming_cpu{false};
+  int                 m_defer_accept{0};
 
   slot_connection     m_slot_accepted;
+
+  std::vector<std::unique_ptr<ListenShard>> m_shard_list;
 };
 
 } // namespace torrent
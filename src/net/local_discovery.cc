@@ -0,0 +1,290 @@
+#include "config.h"
+
+#include "net/local_discovery.h"
+
+#include <cstdlib>
+#include <cstring>
+#include <future>
+#include <strings.h>
+
+#include "manager.h"
+#include "net/thread_net.h"
+#include "torrent/connection_manager.h"
+#include "torrent/exceptions.h"
+#include "torrent/poll.h"
+#include "torrent/utils/log.h"
+#include "torrent/utils/thread.h"
+
+#define LT_LOG(log_fmt, ...)                                            \
+  lt_log_print(LOG_CONNECTION, "local_discovery: " log_fmt, __VA_ARGS__);
+
+namespace torrent {
+
+namespace {
+
+// Runs 'fn' on thread_net and waits for it, or runs it directly if the
+// thread has not been started.
+void
+call_net(void* target, const std::function<void ()>& fn) {
+  if (!thread_net()->is_active()) {
+    fn();
+    return;
+  }
+
+  std::promise<void> done;
+
+  thread_net()->callback(target, [&fn, &done]() { fn(); done.set_value(); });
+  done.get_future().wait();
+}
+
+const char*
+find_line_end(const char* first, const char* last) {
+  for (; first + 1 < last; first++)
+    if (first[0] == '\r' && first[1] == '\n')
+      return first;
+
+  return last;
+}
+
+}
+
+LocalDiscovery::LocalDiscovery() {
+  char buffer[17];
+  snprintf(buffer, sizeof(buffer), "%08lx%08lx", ::random() & 0xffffffff, ::random() & 0xffffffff);
+
+  m_cookie = buffer;
+
+  m_group.sa_inet()->clear();
+  m_group.sa_inet()->set_address_c_str(multicast_address);
+  m_group.sa_inet()->set_port(multicast_port);
+}
+
+LocalDiscovery::~LocalDiscovery() {
+  close();
+}
+
+bool
+LocalDiscovery::open(uint16_t listen_port) {
+  close();
+
+  if (!get_fd().open_datagram_inet())
+    return false;
+
+  rak::socket_address bind_address;
+  bind_address.sa_inet()->clear();
+  bind_address.sa_inet()->set_address_any();
+  bind_address.sa_inet()->set_port(multicast_port);
+
+  if (!get_fd().set_nonblock() ||
+      !get_fd().set_reuse_address(true) ||
+      !get_fd().bind(bind_address) ||
+      !get_fd().add_multicast_membership(m_group)) {
+    LT_LOG("could not open multicast socket: %s", std::strerror(errno));
+
+    get_fd().close();
+    get_fd().clear();
+    return false;
+  }
+
+  m_listen_port = listen_port;
+  m_owner = thread_self();
+
+  manager->connection_manager()->inc_socket_count();
+
+  // Without an active thread_net this runs on the caller, so the poll
+  // is kept for close.
+  call_net(this, [this]() {
+      m_poll = thread_self()->poll();
+      m_poll->open(this);
+      m_poll->insert_read(this);
+      m_poll->insert_error(this);
+    });
+
+  LT_LOG("opened : port:%" PRIu16 " cookie:%s", m_listen_port, m_cookie.c_str());
+  return true;
+}
+
+void
+LocalDiscovery::close() {
+  if (!get_fd().is_valid())
+    return;
+
+  call_net(this, [this]() {
+      m_poll->remove_read(this);
+      m_poll->remove_error(this);
+      m_poll->close(this);
+    });
+
+  m_poll = nullptr;
+
+  if (thread_net()->is_active())
+    thread_net()->cancel_callback_and_wait(this);
+
+  m_owner->cancel_callback_and_wait(this);
+  m_received.clear();
+
+  manager->connection_manager()->dec_socket_count();
+
+  get_fd().close();
+  get_fd().clear();
+
+  LT_LOG("closed", 0);
+}
+
+void
+LocalDiscovery::announce(const hash_list& hashes) {
+  if (!is_open() || hashes.empty())
+    return;
+
+  auto messages = create_announces(m_listen_port, hashes, m_cookie);
+
+  auto send = [this, messages = std::move(messages)]() {
+      for (const auto& message : messages)
+        if (write_datagram(message.data(), message.size(), &m_group) == -1)
+          LT_LOG("could not send announce: %s", std::strerror(errno));
+    };
+
+  if (thread_net()->is_active())
+    thread_net()->callback(this, std::move(send));
+  else
+    send();
+}
+
+std::vector<std::string>
+LocalDiscovery::create_announces(uint16_t port, const hash_list& hashes, const std::string& cookie) {
+  std::string header = "BT-SEARCH * HTTP/1.1\r\n"
+    "Host: " + std::string(multicast_address) + ":" + std::to_string(multicast_port) + "\r\n"
+    "Port: " + std::to_string(port) + "\r\n";
+  std::string footer = "cookie: " + cookie + "\r\n\r\n\r\n";
+
+  std::vector<std::string> messages;
+  std::string current;
+
+  for (const auto& hash : hashes) {
+    std::string line = "Infohash: " + hash_string_to_hex_str(hash) + "\r\n";
+
+    if (!current.empty() && header.size() + current.size() + line.size() + footer.size() > max_message_size) {
+      messages.push_back(header + current + footer);
+      current.clear();
+    }
+
+    current += line;
+  }
+
+  messages.push_back(header + current + footer);
+  return messages;
+}
+
+bool
+LocalDiscovery::parse_announce(const char* data, size_t length, uint16_t* port, hash_list* hashes, std::string* cookie) {
+  const char* first = data;
+  const char* last  = data + length;
+  const char* line_end = find_line_end(first, last);
+
+  static const char request_line[] = "BT-SEARCH * HTTP/1.1";
+
+  if (line_end - first != sizeof(request_line) - 1 || std::memcmp(first, request_line, sizeof(request_line) - 1) != 0)
+    return false;
+
+  *port = 0;
+  hashes->clear();
+  cookie->clear();
+
+  for (first = line_end + 2; first < last; first = line_end + 2) {
+    line_end = find_line_end(first, last);
+
+    if (line_end == first)
+      break;
+
+    auto separator = static_cast<const char*>(std::memchr(first, ':', line_end - first));
+
+    if (separator == nullptr)
+      continue;
+
+    std::string name(first, separator);
+    std::string value(separator + 1, line_end);
+
+    value.erase(0, value.find_first_not_of(' '));
+    value.erase(value.find_last_not_of(' ') + 1);
+
+    if (strcasecmp(name.c_str(), "port") == 0) {
+      char* end;
+      unsigned long result = std::strtoul(value.c_str(), &end, 10);
+
+      if (value.empty() || *end != '\0' || result == 0 || result > 0xffff)
+        return false;
+
+      *port = result;
+
+    } else if (strcasecmp(name.c_str(), "infohash") == 0) {
+      HashString hash;
+
+      if (value.size() != HashString::size_data * 2 ||
+          hash_string_from_hex_c_str(value.c_str(), hash) == value.c_str())
+        continue;
+
+      hashes->push_back(hash);
+
+    } else if (strcasecmp(name.c_str(), "cookie") == 0) {
+      *cookie = value;
+    }
+  }
+
+  return *port != 0 && !hashes->empty();
+}
+
+void
+LocalDiscovery::event_read() {
+  char buffer[max_message_size * 2];
+  rak::socket_address sa;
+
+  uint16_t    port;
+  hash_list   hashes;
+  std::string cookie;
+
+  auto lock = std::scoped_lock(m_mutex);
+  bool was_empty = m_received.empty();
+
+  int read;
+
+  while ((read = read_datagram(buffer, sizeof(buffer), &sa)) > 0) {
+    if (sa.family() != rak::socket_address::af_inet ||
+        !parse_announce(buffer, read, &port, &hashes, &cookie) ||
+        cookie == m_cookie)
+      continue;
+
+    sa.set_port(port);
+
+    for (const auto& hash : hashes)
+      if (m_received.size() < max_batch_size)
+        m_received.push_back(received_type{hash, sa});
+  }
+
+  if (was_empty && !m_received.empty())
+    m_owner->callback(this, [this]() { process_received(); });
+}
+
+void
+LocalDiscovery::process_received() {
+  std::vector<received_type> received;
+
+  {
+    auto lock = std::scoped_lock(m_mutex);
+    received.swap(m_received);
+  }
+
+  for (const auto& entry : received)
+    m_slot_peer(entry.hash, entry.address);
+}
+
+void
+LocalDiscovery::event_write() {
+  throw internal_error("LocalDiscovery::event_write() called.");
+}
+
+void
+LocalDiscovery::event_error() {
+  LT_LOG("socket error: %s", std::strerror(get_fd().get_error()));
+}
+
+}
@@ -0,0 +1,90 @@
+#ifndef LIBTORRENT_NET_LOCAL_DISCOVERY_H
+#define LIBTORRENT_NET_LOCAL_DISCOVERY_H
+
+#include <functional>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <rak/socket_address.h>
+
+#include "net/socket_datagram.h"
+#include "torrent/hash_string.h"
+
+namespace torrent {
+
+namespace utils {
+class Thread;
+}
+
+// Local Service Discovery (BEP 14), announces the downloads on the
+// IPv4 multicast group and passes on the peers announced by others.
+//
+// The socket is polled by thread_net, which also sends the
+// announces. Received announces are handed back to the thread that
+// opened the socket through 'slot_peer', in batches.
+
+class LocalDiscovery : public SocketDatagram {
+public:
+  using hash_list = std::vector<HashString>;
+  using slot_peer = std::function<void(const HashString&, const rak::socket_address&)>;
+
+  static constexpr uint16_t     multicast_port    = 6771;
+  static constexpr const char*  multicast_address = "239.192.152.143";
+
+  // Announces are split to stay below the usual path MTU.
+  static constexpr size_t       max_message_size  = 1400;
+  static constexpr size_t       max_batch_size    = 1024;
+
+  LocalDiscovery();
+  ~LocalDiscovery() override;
+
+  bool                is_open() const                 { return get_fd().is_valid(); }
+
+  const std::string&  cookie() const                  { return m_cookie; }
+
+  bool                open(uint16_t listen_port);
+  void                close();
+
+  uint16_t            listen_port() const             { return m_listen_port; }
+
+  void                announce(const hash_list& hashes);
+
+  slot_peer&          slot_peer_found()               { return m_slot_peer; }
+
+  // Returns the messages announcing 'hashes', as few as fit.
+  static std::vector<std::string> create_announces(uint16_t port, const hash_list& hashes, const std::string& cookie);
+
+  // Parses an announce, ignoring headers other than port, infohash
+  // and cookie. Returns false if it is not a valid announce.
+  static bool         parse_announce(const char* data, size_t length, uint16_t* port, hash_list* hashes, std::string* cookie);
+
+  const char*         type_name() const override      { return "local_discovery"; }
+
+  void                event_read() override;
+  void                event_write() override;
+  void                event_error() override;
+
+private:
+  struct received_type {
+    HashString          hash;
+    rak::socket_address address;
+  };
+
+  void                process_received();
+
+  std::string         m_cookie;
+  uint16_t            m_listen_port{0};
+
+  rak::socket_address m_group;
+  utils::Thread*      m_owner{nullptr};
+  Poll*               m_poll{nullptr};
+
+  std::mutex                 m_mutex;
+  std::vector<received_type> m_received;
+
+  slot_peer           m_slot_peer;
+};
+
+}
+
+#endif
@@ -9,14 +9,13 @@
 
 namespace torrent {
 
-template <uint16_t tmpl_size>
+template <uint32_t tmpl_size>
 class ProtocolBuffer {
 public:
   using value_type = uint8_t;
   using iterator   = value_type*;
-  // TODO: Change to 32-bit,
-  using size_type       = uint16_t;
-  using difference_type = int16_t;
+  using size_type       = uint32_t;
+  using difference_type = int32_t;
 
   void                reset()                       { m_position = m_end = begin(); }
   void                reset_position()              { m_position = m_buffer; }
@@ -37,7 +36,7 @@ public:
   uint64_t            read_64()                     { return read_int<uint64_t>(); }
   uint64_t            peek_64()                     { return peek_int<uint64_t>(); }
 
-  uint8_t             peek_8_at(size_type pos)      { return *(m_position + pos); }
+  uint8_t             peek_8_at(size_type pos) const { return *(m_position + pos); }
 
   template <typename Out>
   void                read_range(Out first, Out last);
@@ -100,7 +99,7 @@ private:
   value_type          m_buffer[tmpl_size];
 };
 
-template <uint16_t tmpl_size>
+template <uint32_t tmpl_size>
 inline bool
 ProtocolBuffer<tmpl_size>::consume(difference_type v) {
   m_position += v;
@@ -111,7 +110,7 @@ ProtocolBuffer<tmpl_size>::consume(difference_type v) {
   return true;
 }
 
-template <uint16_t tmpl_size>
+template <uint32_t tmpl_size>
 inline uint16_t
 ProtocolBuffer<tmpl_size>::read_16() {
 #ifndef USE_ALIGNED
@@ -124,7 +123,7 @@ ProtocolBuffer<tmpl_size>::read_16() {
 #endif
 }
 
-template <uint16_t tmpl_size>
+template <uint32_t tmpl_size>
 inline uint16_t
 ProtocolBuffer<tmpl_size>::peek_16() {
 #ifndef USE_ALIGNED
@@ -134,7 +133,7 @@ ProtocolBuffer<tmpl_size>::peek_16() {
 #endif
 }
 
-template <uint16_t tmpl_size>
+template <uint32_t tmpl_size>
 inline uint32_t
 ProtocolBuffer<tmpl_size>::read_32() {
 #ifndef USE_ALIGNED
@@ -147,7 +146,7 @@ ProtocolBuffer<tmpl_size>::read_32() {
 #endif
 }
 
-template <uint16_t tmpl_size>
+template <uint32_t tmpl_size>
 inline uint32_t
 ProtocolBuffer<tmpl_size>::peek_32() {
 #ifndef USE_ALIGNED
@@ -157,7 +156,7 @@ ProtocolBuffer<tmpl_size>::peek_32() {
 #endif
 }
 
-template <uint16_t tmpl_size>
+template <uint32_t tmpl_size>
 template <typename T>
 inline T
 ProtocolBuffer<tmpl_size>::read_int() {
@@ -169,7 +168,7 @@ ProtocolBuffer<tmpl_size>::read_int() {
   return t;
 }
 
-template <uint16_t tmpl_size>
+template <uint32_t tmpl_size>
 template <typename T>
 inline T
 ProtocolBuffer<tmpl_size>::peek_int() {
@@ -181,7 +180,7 @@ ProtocolBuffer<tmpl_size>::peek_int() {
   return t;
 }
 
-template <uint16_t tmpl_size>
+template <uint32_t tmpl_size>
 inline void
 ProtocolBuffer<tmpl_size>::write_16(uint16_t v) {
 #ifndef USE_ALIGNED
@@ -194,7 +193,7 @@ ProtocolBuffer<tmpl_size>::write_16(uint16_t v) {
 #endif
 }
 
-template <uint16_t tmpl_size>
+template <uint32_t tmpl_size>
 inline void
 ProtocolBuffer<tmpl_size>::write_32(uint32_t v) {
 #ifndef USE_ALIGNED
@@ -207,7 +206,7 @@ ProtocolBuffer<tmpl_size>::write_32(uint32_t v) {
 #endif
 }
 
-template <uint16_t tmpl_size>
+template <uint32_t tmpl_size>
 inline void
 ProtocolBuffer<tmpl_size>::write_32_n(uint32_t v) {
   *reinterpret_cast<uint32_t*>(m_end) = v;
@@ -216,7 +215,7 @@ ProtocolBuffer<tmpl_size>::write_32_n(uint32_t v) {
   validate_end();
 }
 
-template <uint16_t tmpl_size>
+template <uint32_t tmpl_size>
 template <typename Out>
 void
 ProtocolBuffer<tmpl_size>::read_range(Out first, Out last) {
@@ -226,7 +225,7 @@ ProtocolBuffer<tmpl_size>::read_range(Out first, Out last) {
   validate_position();
 }
 
-template <uint16_t tmpl_size>
+template <uint32_t tmpl_size>
 template <typename Out>
 void
 ProtocolBuffer<tmpl_size>::read_len(Out start, unsigned int len) {
@@ -236,7 +235,7 @@ ProtocolBuffer<tmpl_size>::read_len(Out start, unsigned int len) {
   validate_position();
 }
 
-template <uint16_t tmpl_size>
+template <uint32_t tmpl_size>
 template <typename T>
 inline void
 ProtocolBuffer<tmpl_size>::write_int(T v) {
@@ -247,7 +246,7 @@ ProtocolBuffer<tmpl_size>::write_int(T v) {
   validate_end();
 }
 
-template <uint16_t tmpl_size>
+template <uint32_t tmpl_size>
 template <typename In>
 void
 ProtocolBuffer<tmpl_size>::write_range(In first, In last) {
@@ -257,7 +256,7 @@ ProtocolBuffer<tmpl_size>::write_range(In first, In last) {
   validate_end();
 }
 
-template <uint16_t tmpl_size>
+template <uint32_t tmpl_size>
 template <typename In>
 void
 ProtocolBuffer<tmpl_size>::write_len(In start, unsigned int len) {
@@ -267,7 +266,7 @@ ProtocolBuffer<tmpl_size>::write_len(In start, unsigned int len) {
   validate_end();
 }
 
-template <uint16_t tmpl_size>
+template <uint32_t tmpl_size>
 void
 ProtocolBuffer<tmpl_size>::move_unused() {
   std::memmove(begin(), position(), remaining());
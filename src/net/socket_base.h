@@ -23,6 +23,8 @@ public:
   const SocketFd&     get_fd() const      { return *reinterpret_cast<const SocketFd*>(&m_fileDesc); }
   void                set_fd(SocketFd fd) { m_fileDesc = fd.get_fd(); }
 
+  bool                is_ipv6_socket() const { return m_ipv6_socket; }
+
   bool                read_oob(void* buffer);
   bool                write_oob(const void* buffer);
 
@@ -9,6 +9,7 @@
 #include <netinet/in.h>
 #include <netinet/in_systm.h>
 #include <netinet/ip.h>
+#include <netinet/tcp.h>
 #include <rak/socket_address.h>
 
 #include "torrent/exceptions.h"
@@ -40,6 +41,20 @@ SocketFd::set_priority(priority_type p) {
     return setsockopt(m_fd, IPPROTO_IP, IP_TOS, &opt, sizeof(opt)) == 0;
 }
 
+bool
+SocketFd::add_multicast_membership(const rak::socket_address& group) {
+  check_valid();
+
+  if (m_ipv6_socket || group.family() != rak::socket_address::af_inet)
+    return false;
+
+  ip_mreq mreq{};
+  mreq.imr_multiaddr = group.sa_inet()->address();
+  mreq.imr_interface.s_addr = htonl(INADDR_ANY);
+
+  return setsockopt(m_fd, IPPROTO_IP, IP_ADD_MEMBERSHIP, &mreq, sizeof(mreq)) == 0;
+}
+
 bool
 SocketFd::set_reuse_address(bool state) {
   check_valid();
@@ -48,6 +63,38 @@ SocketFd::set_reuse_address(bool state) {
   return setsockopt(m_fd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt)) == 0;
 }
 
+bool
+SocketFd::set_reuse_port(bool state) {
+  check_valid();
+#ifdef SO_REUSEPORT
+  int opt = state;
+
+  return setsockopt(m_fd, SOL_SOCKET, SO_REUSEPORT, &opt, sizeof(opt)) == 0;
+#else
+  return !state;
+#endif
+}
+
+bool
+SocketFd::set_incoming_cpu(int cpu) {
+  check_valid();
+#ifdef SO_INCOMING_CPU
+  return setsockopt(m_fd, SOL_SOCKET, SO_INCOMING_CPU, &cpu, sizeof(cpu)) == 0;
+#else
+  return false;
+#endif
+}
+
+bool
+SocketFd::set_defer_accept(int seconds) {
+  check_valid();
+#ifdef TCP_DEFER_ACCEPT
+  return setsockopt(m_fd, IPPROTO_TCP, TCP_DEFER_ACCEPT, &seconds, sizeof(seconds)) == 0;
+#else
+  return false;
+#endif
+}
+
 bool
 SocketFd::set_ipv6_v6only(bool state) {
   check_valid();
@@ -126,6 +173,12 @@ SocketFd::open_datagram() {
   return true;
 }
 
+bool
+SocketFd::open_datagram_inet() {
+  m_ipv6_socket = false;
+  return (m_fd = socket(rak::socket_address::pf_inet, SOCK_DGRAM, 0)) != -1;
+}
+
 bool
 SocketFd::open_local() {
   return (m_fd = socket(rak::socket_address::pf_local, SOCK_STREAM, 0)) != -1;
@@ -224,11 +277,21 @@ SocketFd::accept(rak::socket_address* sa) {
   check_valid();
   socklen_t len = sizeof(rak::socket_address);
 
+  // Accepted sockets are made non-blocking without a separate fcntl
+  // where accept4 is available.
+#ifdef SOCK_NONBLOCK
+  if (sa == NULL) {
+    return SocketFd(::accept4(m_fd, NULL, &len, SOCK_NONBLOCK), m_ipv6_socket);
+  }
+
+  int fd = ::accept4(m_fd, sa->c_sockaddr(), &len, SOCK_NONBLOCK);
+#else
   if (sa == NULL) {
     return SocketFd(::accept(m_fd, NULL, &len), m_ipv6_socket);
   }
 
   int fd = ::accept(m_fd, sa->c_sockaddr(), &len);
+#endif
 
   if (fd != -1 && m_ipv6_socket && sa->family() == rak::socket_address::af_inet6) {
     *sa = sa->sa_inet6()->normalize_address();
@@ -237,6 +300,13 @@ SocketFd::accept(rak::socket_address* sa) {
   return SocketFd(fd, m_ipv6_socket);
 }
 
+int
+SocketFd::peek(void* buffer, unsigned int length) {
+  check_valid();
+
+  return ::recv(m_fd, buffer, length, MSG_PEEK | MSG_DONTWAIT);
+}
+
 // unsigned int
 // SocketFd::get_read_queue_size() const {
 //   unsigned int v;
@@ -28,10 +28,23 @@ public:
 
   bool                set_nonblock();
   bool                set_reuse_address(bool state);
+  bool                set_reuse_port(bool state);
   bool                set_ipv6_v6only(bool state);
 
+  // Linux only, has a listening socket sharing a port with
+  // SO_REUSEPORT receive the connections handled by 'cpu'.
+  bool                set_incoming_cpu(int cpu);
+
+  // Linux only, delays waking the listening socket until data has
+  // arrived on a new connection or 'seconds' have passed.
+  bool                set_defer_accept(int seconds);
+
   bool                set_priority(priority_type p);
 
+  // Joins the IPv4 multicast group on the default interface, for
+  // sockets opened with 'open_datagram_inet'.
+  bool                add_multicast_membership(const rak::socket_address& group);
+
   bool                set_send_buffer_size(uint32_t s);
   bool                set_receive_buffer_size(uint32_t s);
 
@@ -39,6 +52,7 @@ public:
 
   bool                open_stream();
   bool                open_datagram();
+  bool                open_datagram_inet();
   bool                open_local();
 
   static bool         open_socket_pair(int& fd1, int& fd2);
@@ -58,6 +72,11 @@ public:
   bool                listen(int size);
   SocketFd            accept(rak::socket_address* sa);
 
+  // Copies up to 'length' bytes already received without consuming
+  // them. Returns 0 if the peer closed the connection and -1 if
+  // nothing has arrived yet or on errors.
+  int                 peek(void* buffer, unsigned int length);
+
 //   unsigned int        get_read_queue_size() const;
 //   unsigned int        get_write_queue_size() const;
 
@@ -12,7 +12,7 @@ namespace torrent {
 
 class socket_listen : public socket_event {
 public:
-  using accepted_ftor = std::function<void(int, sa_unique_ptr)>;
+  using accepted_ftor = std::function<void(int, const sa_inet_storage&)>;
 
   int  backlog() const;
 
@@ -7,6 +7,10 @@
 #include <cstring>
 #include <rak/error_number.h>
 
+#ifdef USE_SENDFILE
+#include <sys/sendfile.h>
+#endif
+
 namespace torrent {
 
 std::string
@@ -60,4 +64,85 @@ SocketStream::write_stream_throws(const void* buf, uint32_t length) {
   return r;
 }
 
+uint32_t
+SocketStream::read_vector_throws(const iovec* vec, int count) {
+  if (count == 0)
+    throw internal_error("Tried to read to an empty vector.");
+
+  ssize_t r = ::readv(m_fileDesc, vec, count);
+
+  if (r == 0)
+    throw close_connection();
+
+  if (r < 0) {
+    if (rak::error_number::current().is_blocked_momentary())
+      return 0;
+    else if (rak::error_number::current().is_closed())
+      throw close_connection();
+    else if (rak::error_number::current().is_blocked_prolonged())
+      throw blocked_connection();
+    else
+      throw connection_error(rak::error_number::current().value());
+  }
+
+  return r;
+}
+
+uint32_t
+SocketStream::write_vector_throws(const iovec* vec, int count) {
+  if (count == 0)
+    throw internal_error("Tried to write an empty vector.");
+
+  ssize_t r = ::writev(m_fileDesc, vec, count);
+
+  if (r == 0)
+    throw close_connection();
+
+  if (r < 0) {
+    if (rak::error_number::current().is_blocked_momentary())
+      return 0;
+    else if (rak::error_number::current().is_closed())
+      throw close_connection();
+    else if (rak::error_number::current().is_blocked_prolonged())
+      throw blocked_connection();
+    else
+      throw connection_error(rak::error_number::current().value());
+  }
+
+  return r;
+}
+
+uint32_t
+SocketStream::write_file_throws([[maybe_unused]] int fd, [[maybe_unused]] uint64_t offset, uint32_t length) {
+  if (length == 0)
+    throw internal_error("Tried to write to buffer length 0.");
+
+#ifdef USE_SENDFILE
+  auto    file_offset = static_cast<off_t>(offset);
+  ssize_t r           = ::sendfile(m_fileDesc, fd, &file_offset, length);
+
+  // The socket doesn't report a closed connection through a zero
+  // return value here, so this is the file being shorter than expected.
+  if (r == 0)
+    throw storage_error("sendfile reached end of file");
+
+  if (r < 0) {
+    if (rak::error_number::current().is_blocked_momentary())
+      return 0;
+    else if (rak::error_number::current().is_closed())
+      throw close_connection();
+    else if (rak::error_number::current().is_blocked_prolonged())
+      throw blocked_connection();
+    else if (errno == EIO || errno == EINVAL || errno == ENOSYS || errno == EOVERFLOW)
+      throw storage_error("sendfile failed: " + std::string(std::strerror(errno)));
+    else
+      throw connection_error(rak::error_number::current().value());
+  }
+
+  return r;
+#else
+  throw internal_error("SocketStream::write_file_throws(...) called without sendfile support.");
+#endif
+}
+
 }
@@ -39,6 +39,7 @@
 
 #include <sys/types.h>
 #include <sys/socket.h>
+#include <sys/uio.h>
 
 #include "torrent/exceptions.h"
 #include "socket_base.h"
@@ -56,6 +57,16 @@ public:
   uint32_t            read_stream_throws(void* buf, uint32_t length);
   uint32_t            write_stream_throws(const void* buf, uint32_t length);
 
+  // Sends 'length' bytes starting at 'offset' of the file descriptor
+  // straight from the page cache. Only available with USE_SENDFILE,
+  // errors from the file side throw storage_error.
+  uint32_t            write_file_throws(int fd, uint64_t offset, uint32_t length);
+
+  // Scatter and gather versions of the above using a single readv or
+  // writev call.
+  uint32_t            read_vector_throws(const iovec* vec, int count);
+  uint32_t            write_vector_throws(const iovec* vec, int count);
+
   // Handles all the error catching etc. Returns true if the buffer is
   // finished reading/writing.
   bool                read_buffer(void* buf, uint32_t length, uint32_t& pos);
@@ -17,7 +17,6 @@ namespace torrent {
 
 ThrottleInternal::ThrottleInternal(int flags) :
     m_flags(flags),
-    m_next_slave(m_slave_list.end()),
     m_time_last_tick(torrent::this_thread::cached_time()) {
 
   if (is_root())
@@ -28,14 +27,16 @@ ThrottleInternal::~ThrottleInternal() {
   if (is_root())
     torrent::this_thread::scheduler()->erase(&m_task_tick);
 
-  for (const auto& t : m_slave_list)
+  for (const auto& t : m_slave_list) {
+    delete t->m_throttleList;
     delete t;
+  }
 }
 
 void
 ThrottleInternal::enable() {
   m_throttleList->enable();
-  std::for_each(m_slave_list.begin(), m_slave_list.end(), [](auto* t) { t->m_throttleList->enable(); });
+  std::for_each(m_slave_list.begin(), m_slave_list.end(), std::mem_fn(&ThrottleInternal::enable));
 
   if (is_root()) {
     // We need to start the ticks, and make sure we set timeLastTick
@@ -48,7 +49,7 @@ ThrottleInternal::enable() {
 
 void
 ThrottleInternal::disable() {
-  std::for_each(m_slave_list.begin(), m_slave_list.end(), [](auto* t) { t->m_throttleList->disable(); });
+  std::for_each(m_slave_list.begin(), m_slave_list.end(), std::mem_fn(&ThrottleInternal::disable));
   m_throttleList->disable();
 
   if (is_root())
@@ -61,61 +62,96 @@ ThrottleInternal::create_slave() {
 
   slave->m_maxRate = m_maxRate;
   slave->m_throttleList = new ThrottleList();
+  slave->m_throttleList->set_pacing(m_throttleList->is_pacing());
 
   if (m_throttleList->is_enabled())
     slave->enable();
 
   m_slave_list.push_back(slave);
-  m_next_slave = m_slave_list.end();
 
   return slave;
 }
 
+void
+ThrottleInternal::set_pacing(bool state) {
+  m_throttleList->set_pacing(state);
+
+  for (auto slave : m_slave_list)
+    slave->set_pacing(state);
+}
+
+void
+ThrottleInternal::set_high_resolution(bool state) {
+  if (state == is_high_resolution())
+    return;
+
+  m_flags ^= flag_high_resolution;
+
+  // Reschedule a running tick so it matches the new interval, the
+  // next one would otherwise be at most a second late or too early.
+  if (is_root() && m_task_tick.is_scheduled())
+    schedule_tick(true);
+}
+
 void
 ThrottleInternal::receive_tick() {
-  if (torrent::this_thread::cached_time() < m_time_last_tick + 90ms)
+  auto min_interval = is_high_resolution() ? high_resolution_interval - 1ms : std::chrono::microseconds(90ms);
+
+  if (torrent::this_thread::cached_time() < m_time_last_tick + min_interval)
     throw internal_error("ThrottleInternal::receive_tick() called at a to short interval.");
 
   uint64_t count_usec = (torrent::this_thread::cached_time() - m_ptr()->m_time_last_tick).count();
+  uint64_t quota_usec = count_usec * m_maxRate + m_quota_remainder;
 
-  uint32_t quota    = count_usec * m_maxRate / 1000000;
+  uint32_t quota    = quota_usec / 1000000;
   uint32_t fraction = count_usec * fraction_base / 1000000;
 
+  m_quota_remainder = quota_usec % 1000000;
+
   receive_quota(quota, fraction);
+  schedule_tick(false);
 
-  torrent::this_thread::scheduler()->wait_for_ceil_seconds(&m_task_tick, std::chrono::microseconds(calculate_interval()));
   m_time_last_tick = torrent::this_thread::cached_time();
 }
 
+void
+ThrottleInternal::schedule_tick(bool update) {
+  auto scheduler = torrent::this_thread::scheduler();
+
+  if (is_high_resolution() && update)
+    scheduler->update_wait_for(&m_task_tick, high_resolution_interval);
+  else if (is_high_resolution())
+    scheduler->wait_for(&m_task_tick, high_resolution_interval);
+  else if (update)
+    scheduler->update_wait_for_ceil_seconds(&m_task_tick, std::chrono::microseconds(calculate_interval()));
+  else
+    scheduler->wait_for_ceil_seconds(&m_task_tick, std::chrono::microseconds(calculate_interval()));
+}
+
 int32_t
 ThrottleInternal::receive_quota(uint32_t quota, uint32_t fraction) {
   m_unused_quota += quota;
 
-  while (m_next_slave != m_slave_list.end()) {
-    // TODO: Add logging and see if the use of 'quota' below is causing the quota to be
-    // over-allocated to the next slave, instead of a smoother distribution.
-    //
-    // E.g. we might want to spread it over the next few slaves, especially if we have a very large
-    // number.
-
-    uint32_t need = std::min<uint32_t>(quota, static_cast<uint64_t>(fraction) * (*m_next_slave)->max_rate() >> fraction_bits);
+  calculate_shares(quota, fraction);
 
-    if (need > m_unused_quota)
-      break;
-
-    m_unused_quota -= (*m_next_slave)->receive_quota(need, fraction);
-    m_throttleList->add_rate((*m_next_slave)->throttle_list()->rate_added());
-
-    ++m_next_slave;
+  for (size_t i = 0; i != m_slave_list.size(); i++) {
+    m_unused_quota -= m_slave_list[i]->receive_quota(m_shares[i], fraction);
+    m_throttleList->add_rate(m_slave_list[i]->throttle_list()->rate_added());
   }
 
-  uint32_t need = std::min<uint32_t>(quota, static_cast<uint64_t>(fraction) * m_maxRate >> fraction_bits);
+  if (m_throttleList->is_pacing()) {
+    m_pacing_quota += m_shares.back();
+    m_pacing_fraction += fraction;
 
-  if (m_next_slave == m_slave_list.end() && need <= m_unused_quota) {
-    m_unused_quota -= m_throttleList->update_quota(need);
-    m_next_slave = m_slave_list.begin();
+    if (m_pacing_fraction >= fraction_base) {
+      m_throttleList->update_pacing(m_pacing_quota * fraction_base / m_pacing_fraction);
+      m_pacing_quota = 0;
+      m_pacing_fraction = 0;
+    }
   }
 
+  m_unused_quota -= m_throttleList->update_quota(m_shares.back());
+
   // Return how much quota we used, but keep as much as one allocation's worth until the next tick
   // to avoid rounding errors.
   int32_t used = quota;
@@ -129,4 +165,59 @@ ThrottleInternal::receive_quota(uint32_t quota, uint32_t fraction) {
   return used;
 }
 
+void
+ThrottleInternal::calculate_shares(uint32_t quota, uint32_t fraction) {
+  size_t size = m_slave_list.size() + 1;
+
+  m_shares.assign(size, 0);
+  m_ceilings.resize(size);
+
+  uint32_t available = m_unused_quota;
+  uint64_t total_min = 0;
+
+  for (size_t i = 0; i != m_slave_list.size(); i++) {
+    ThrottleInternal* slave = m_slave_list[i];
+
+    m_ceilings[i] = slave->m_maxRate == 0 ? quota : std::min(quota, rate_quota(slave->m_maxRate, fraction));
+    m_shares[i]   = std::min(m_ceilings[i], rate_quota(slave->m_minRate, fraction));
+
+    total_min += m_shares[i];
+  }
+
+  m_ceilings.back() = m_maxRate == 0 ? quota : std::min(quota, rate_quota(m_maxRate, fraction));
+
+  // When the guaranteed rates can't all be met, scale them down
+  // proportionally.
+  if (total_min > available) {
+    for (size_t i = 0; i != m_slave_list.size(); i++)
+      m_shares[i] = static_cast<uint64_t>(m_shares[i]) * available / total_min;
+
+    return;
+  }
+
+  uint32_t spare = available - total_min;
+
+  // Split the spare quota evenly between those below their ceiling,
+  // repeating with what is left when some reach it.
+  while (spare != 0) {
+    uint32_t wanting = 0;
+
+    for (size_t i = 0; i != size; i++)
+      if (m_shares[i] < m_ceilings[i])
+        wanting++;
+
+    if (wanting == 0)
+      break;
+
+    uint32_t share = std::max<uint32_t>(spare / wanting, 1);
+
+    for (size_t i = 0; i != size && spare != 0; i++) {
+      uint32_t given = std::min(std::min(share, m_ceilings[i] - m_shares[i]), spare);
+
+      m_shares[i] += given;
+      spare -= given;
+    }
+  }
+}
+
 }
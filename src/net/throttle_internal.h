@@ -9,10 +9,17 @@
 
 namespace torrent {
 
+// Throttles form a tree, with each slave drawing its quota from the
+// parent. Every tick a parent first hands each slave its guaranteed
+// min rate, then splits what is left evenly between the slaves and
+// its own throttle list, never giving a slave more than its max
+// rate. Slaves with a max rate of zero may borrow all spare quota.
+
 class ThrottleInternal : public Throttle {
 public:
   static constexpr int flag_none = 0;
   static constexpr int flag_root = 1;
+  static constexpr int flag_high_resolution = 2;
 
   ThrottleInternal(int flags);
   ~ThrottleInternal();
@@ -20,10 +27,14 @@ public:
   ThrottleInternal*   create_slave();
 
   bool                is_root()         { return m_flags & flag_root; }
+  bool                is_high_resolution() const { return m_flags & flag_high_resolution; }
 
   void                enable();
   void                disable();
 
+  void                set_pacing(bool state);
+  void                set_high_resolution(bool state);
+
 private:
   // Fraction is a fixed-precision value with the given number of bits after the decimal point.
   static constexpr uint32_t fraction_bits = 16;
@@ -32,17 +43,35 @@ private:
   using SlaveList = std::vector<ThrottleInternal*>;
 
   void                receive_tick();
+  void                schedule_tick(bool update);
 
   // Distribute quota, return amount of quota used. May be negative
   // if it had more unused quota than is now allowed.
   int32_t             receive_quota(uint32_t quota, uint32_t fraction);
 
+  // Fills 'm_shares' with the quota for each slave, followed by the
+  // quota for our own throttle list.
+  void                calculate_shares(uint32_t quota, uint32_t fraction);
+
+  static uint32_t     rate_quota(uint64_t rate, uint32_t fraction) { return (static_cast<uint64_t>(fraction) * rate) >> fraction_bits; }
+
   int                 m_flags;
   SlaveList           m_slave_list;
-  SlaveList::iterator m_next_slave;
+
+  std::vector<uint32_t> m_shares;
+  std::vector<uint32_t> m_ceilings;
 
   uint32_t            m_unused_quota{0};
 
+  // Sub-byte quota carried over between ticks, in byte-microseconds,
+  // as short ticks at low rates would otherwise lose a large part.
+  uint64_t            m_quota_remainder{0};
+
+  // Pacing rates are updated about once a second rather than every
+  // tick, as that visits every node of the throttle list.
+  uint64_t            m_pacing_quota{0};
+  uint32_t            m_pacing_fraction{0};
+
   std::chrono::microseconds m_time_last_tick;
   utils::SchedulerEntry     m_task_tick;
 };
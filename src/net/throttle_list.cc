@@ -6,6 +6,7 @@
 
 #include "throttle_list.h"
 #include "throttle_node.h"
+#include "utils/probe.h"
 
 namespace torrent {
 
@@ -13,40 +14,93 @@ ThrottleList::ThrottleList() :
   m_minChunkSize(2 << 10),
   m_maxChunkSize(16 << 10),
 
-  m_rateSlow(60),
-  m_splitActive(end()) {
+  m_rateSlow(60) {
 }
 
 bool
 ThrottleList::is_active(const ThrottleNode* node) const {
-  return std::find(begin(), const_iterator(m_splitActive), node) != m_splitActive;
+  return node->m_list == this && node->m_queuePosition == ThrottleNode::not_queued;
 }
 
 bool
 ThrottleList::is_inactive(const ThrottleNode* node) const {
-  return std::find(const_iterator(m_splitActive), end(), node) != end();
+  return node->m_list == this && node->m_queuePosition != ThrottleNode::not_queued;
 }
 
 bool
 ThrottleList::is_throttled(const ThrottleNode* node) const {
-  return node->list_iterator() != end();
+  return node->m_list == this;
 }
 
 // The quota already present in the node is preserved and unallocated
 // quota is transferred to the node. The node's quota will be less
-// than or equal to 'm_minChunkSize'.
+// than or equal to 'm_maxChunkSize' times the node's weight.
 inline void
 ThrottleList::allocate_quota(ThrottleNode* node) {
   if (node->quota() >= m_minChunkSize)
     return;
 
-  int quota = std::min(m_maxChunkSize - node->quota(), m_unallocatedQuota);
+  uint32_t max_quota = std::min<uint64_t>(static_cast<uint64_t>(m_maxChunkSize) * node->weight() * (m_pacing ? pacing_chunk_factor : 1),
+                                          std::numeric_limits<int32_t>::max());
+
+  if (node->quota() >= max_quota)
+    return;
+
+  uint32_t quota = std::min(max_quota - node->quota(), m_unallocatedQuota);
 
   node->set_quota(node->quota() + quota);
   m_outstandingQuota += quota;
   m_unallocatedQuota -= quota;
 }
 
+void
+ThrottleList::set_node_pacing(ThrottleNode* node, uint64_t rate) {
+  uint64_t current = node->m_pacingRate;
+
+  if (rate == current)
+    return;
+
+  if (rate != 0 && current != 0 && (rate > current ? rate - current : current - rate) <= current / 8)
+    return;
+
+  node->m_pacingRate = rate;
+
+  if (node->m_slot_pacing_rate)
+    node->m_slot_pacing_rate(rate);
+}
+
+void
+ThrottleList::queue_push(ThrottleNode* node) {
+  node->m_queuePosition = m_queueOffset + m_queue.size();
+  m_queue.push_back(node);
+  m_inactive++;
+}
+
+void
+ThrottleList::queue_erase(ThrottleNode* node) {
+  m_queue[node->m_queuePosition - m_queueOffset] = nullptr;
+  node->m_queuePosition = ThrottleNode::not_queued;
+  m_inactive--;
+}
+
+// Only drop the served front of the queue once it is at least half of
+// the queue, so each entry is moved a bounded number of times.
+void
+ThrottleList::queue_compact() {
+  if (m_queueBegin == 0)
+    return;
+
+  if (m_queueBegin == m_queue.size())
+    m_queue.clear();
+  else if (m_queueBegin * 2 >= m_queue.size())
+    m_queue.erase(m_queue.begin(), m_queue.begin() + m_queueBegin);
+  else
+    return;
+
+  m_queueOffset += m_queueBegin;
+  m_queueBegin = 0;
+}
+
 void
 ThrottleList::enable() {
   if (m_enabled)
@@ -54,8 +108,8 @@ ThrottleList::enable() {
 
   m_enabled = true;
 
-  if (!empty() && m_splitActive == begin())
-    throw internal_error("ThrottleList::enable() m_splitActive is invalid.");
+  if (m_inactive != 0)
+    throw internal_error("ThrottleList::enable() inactive nodes found in a disabled list.");
 }
 
 void
@@ -69,10 +123,49 @@ ThrottleList::disable() {
   m_unallocatedQuota = 0;
   m_unusedUnthrottledQuota = 0;
 
-  std::for_each(begin(), end(), std::mem_fn(&ThrottleNode::clear_quota));
-  std::for_each(m_splitActive, end(), std::mem_fn(&ThrottleNode::activate));
+  std::for_each(m_nodes.begin(), m_nodes.end(), std::mem_fn(&ThrottleNode::clear_quota));
+  std::for_each(m_nodes.begin(), m_nodes.end(), [this](ThrottleNode* node) { set_node_pacing(node, 0); });
+
+  // Reset the queue before activating the nodes in case the slots call
+  // back into the list.
+  std::vector<ThrottleNode*> queue;
+  queue.swap(m_queue);
+
+  auto first = queue.begin() + m_queueBegin;
+  auto last  = std::remove(first, queue.end(), nullptr);
+
+  m_queueOffset += queue.size();
+  m_queueBegin = 0;
+  m_inactive = 0;
+
+  std::for_each(first, last, [](ThrottleNode* node) { node->m_queuePosition = ThrottleNode::not_queued; });
+  std::for_each(first, last, std::mem_fn(&ThrottleNode::activate));
+}
+
+// Turning pacing off clears the nodes' rates.
+void
+ThrottleList::set_pacing(bool state) {
+  if (state == m_pacing)
+    return;
+
+  m_pacing = state;
+
+  if (!m_pacing)
+    std::for_each(m_nodes.begin(), m_nodes.end(), [this](ThrottleNode* node) { set_node_pacing(node, 0); });
+}
+
+void
+ThrottleList::update_pacing(uint64_t rate) {
+  if (!m_pacing || m_nodes.empty())
+    return;
+
+  uint64_t total_weight = 0;
 
-  m_splitActive = end();
+  for (auto node : m_nodes)
+    total_weight += node->weight();
+
+  for (auto node : m_nodes)
+    set_node_pacing(node, std::max<uint64_t>(rate * node->weight() / total_weight, m_minChunkSize));
 }
 
 int32_t
@@ -80,6 +173,8 @@ ThrottleList::update_quota(uint32_t quota) {
   if (!m_enabled)
     throw internal_error("ThrottleList::update_quota(...) called but the object is not enabled.");
 
+  LT_PROBE2(throttle_update_enter, this, quota);
+
   // Distribute new quota to unthrottled quota first, and use
   // left-over unthrottled quota from last turn to be allocated
   // to throttled nodes this turn.
@@ -91,25 +186,43 @@ ThrottleList::update_quota(uint32_t quota) {
   m_unusedUnthrottledQuota = quota;
 
   // Add remaining to the next, even when less than activate border.
-  while (m_splitActive != end()) {
-    allocate_quota(*m_splitActive);
+  // The activate slot may deactivate other nodes, so the queue is
+  // indexed anew on each iteration.
+  while (m_queueBegin != m_queue.size()) {
+    ThrottleNode* node = m_queue[m_queueBegin];
 
-    if ((*m_splitActive)->quota() < m_minChunkSize)
+    if (node == nullptr) {
+      m_queueBegin++;
+      continue;
+    }
+
+    allocate_quota(node);
+
+    if (node->quota() < m_minChunkSize)
       break;
 
-    (*m_splitActive)->activate();
-    m_splitActive++;
+    m_queue[m_queueBegin++] = nullptr;
+    node->m_queuePosition = ThrottleNode::not_queued;
+    m_inactive--;
+
+    node->activate();
   }
 
-  // Use 'quota' as an upper bound to avoid accumulating unused quota
-  // over time. Return actually used amount of quota.
-  int32_t used = quota;
+  queue_compact();
 
-  if (m_unallocatedQuota > quota) {
-    used -= m_unallocatedQuota - quota;
-    m_unallocatedQuota = quota;
+  // Use 'quota' as an upper bound to avoid accumulating unused quota
+  // over time, but keep a min chunk's worth so the short ticks of
+  // high resolution throttles can still activate a node. Return
+  // actually used amount of quota.
+  uint32_t limit = std::max(quota, m_minChunkSize);
+  int32_t  used  = quota;
+
+  if (m_unallocatedQuota > limit) {
+    used -= m_unallocatedQuota - limit;
+    m_unallocatedQuota = limit;
   }
 
+  LT_PROBE2(throttle_update_exit, this, used);
   return used;
 }
 
@@ -144,7 +257,7 @@ ThrottleList::node_used(ThrottleNode* node, uint32_t used) {
   add_rate(used);
   node->rate()->insert(used);
 
-  if (used == 0 || !m_enabled || node->list_iterator() == end())
+  if (used == 0 || !m_enabled || node->m_list != this)
     return used;
 
   uint32_t quota = std::min(used, node->quota());
@@ -179,39 +292,36 @@ ThrottleList::node_deactivate(ThrottleNode* node) {
                          "ThrottleList::node_deactivate(...) called on an inactive node." :
                          "ThrottleList::node_deactivate(...) could not find node.");
 
-  base_type::splice(end(), *this, node->list_iterator());
-
-  if (m_splitActive == end())
-    m_splitActive = node->list_iterator();
+  queue_push(node);
 }
 
 void
 ThrottleList::insert(ThrottleNode* node) {
-  if (node->list_iterator() != end())
+  if (node->m_list == this)
     return;
 
-  if (!m_enabled) {
-    // Add to waiting queue.
-    node->set_list_iterator(base_type::insert(end(), node));
-    node->clear_quota();
+  if (node->m_list != nullptr)
+    throw internal_error("ThrottleList::insert(...) node is in another list.");
 
-  } else {
-    // Add before the active split, so if we only need to decrement
-    // m_splitActive to change the queue it is in.
-    node->set_list_iterator(base_type::insert(m_splitActive, node));
-    allocate_quota(node);
-  }
+  node->m_list = this;
+  node->m_index = m_nodes.size();
+  m_nodes.push_back(node);
 
-  m_size++;
+  // Inserted nodes are active, if enabled try to give them enough
+  // quota to start transmitting right away.
+  if (!m_enabled)
+    node->clear_quota();
+  else
+    allocate_quota(node);
 }
 
 void
 ThrottleList::erase(ThrottleNode* node) {
-  if (node->list_iterator() == end())
+  if (node->m_list != this)
     return;
 
-  if (m_size == 0)
-    throw internal_error("ThrottleList::erase(...) called on an empty list.");
+  if (node->m_index >= m_nodes.size() || m_nodes[node->m_index] != node)
+    throw internal_error("ThrottleList::erase(...) node index is invalid.");
 
   // Do we need an if-statement here?
   if (node->quota() != 0) {
@@ -222,14 +332,18 @@ ThrottleList::erase(ThrottleNode* node) {
     m_unallocatedQuota += node->quota();
   }
 
-  if (node->list_iterator() == m_splitActive)
-    m_splitActive = base_type::erase(node->list_iterator());
-  else
-    base_type::erase(node->list_iterator());
+  if (node->m_queuePosition != ThrottleNode::not_queued)
+    queue_erase(node);
+
+  // The socket is usually being closed, so leave it be.
+  node->m_pacingRate = 0;
+
+  m_nodes[node->m_index] = m_nodes.back();
+  m_nodes[node->m_index]->m_index = node->m_index;
+  m_nodes.pop_back();
 
   node->clear_quota();
-  node->set_list_iterator(end());
-  m_size--;
+  node->m_list = nullptr;
 }
 
 }
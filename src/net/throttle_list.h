@@ -1,7 +1,8 @@
 #ifndef LIBTORRENT_NET_THROTTLE_LIST_H
 #define LIBTORRENT_NET_THROTTLE_LIST_H
 
-#include <list>
+#include <cstdint>
+#include <vector>
 
 #include "torrent/rate.h"
 
@@ -12,21 +13,24 @@ namespace torrent {
 
 class ThrottleNode;
 
-class ThrottleList : private std::list<ThrottleNode*> {
+// Quota is handed out using deficit round-robin; nodes that run out
+// of quota are deactivated and appended to a queue, and each tick the
+// queue is served from the front with nodes keeping their partial
+// quota as the deficit until they reach 'm_minChunkSize'. A node's
+// weight scales the largest chunk it may be given in one round, so
+// higher weighted nodes get a proportionally larger share.
+//
+// Both the node array and the queue are contiguous and nodes keep
+// their own position, so insert, erase and state queries are O(1)
+// and a tick only visits the nodes that are waiting for quota.
+//
+// When pacing, each node is also given its weighted share of the
+// list's rate for the kernel to pace its socket with, and nodes get
+// larger chunks of quota as the accounting only needs to hold the
+// rate over the tick.
+
+class ThrottleList {
 public:
-  using base_type = std::list<ThrottleNode*>;
-
-  using base_type::iterator;
-  using base_type::const_iterator;
-  using base_type::reverse_iterator;
-  using base_type::clear;
-  using base_type::size;
-
-  using base_type::begin;
-  using base_type::end;
-  using base_type::rbegin;
-  using base_type::rend;
-
   ThrottleList();
 
   bool                is_enabled() const             { return m_enabled; }
@@ -40,11 +44,22 @@ public:
   void                enable();
   void                disable();
 
+  bool                is_pacing() const              { return m_pacing; }
+  void                set_pacing(bool state);
+
+  // Multiplies the largest chunk of quota a node is given.
+  static constexpr uint32_t pacing_chunk_factor = 4;
+
+  // Splits 'rate', in bytes per second, between the nodes. Only nodes
+  // whose share changed by more than an eighth are updated.
+  void                update_pacing(uint64_t rate);
+
   // Returns the amount of quota used. May be negative if it had unused
   // quota left over from the last call that was more than is now allowed.
   int32_t             update_quota(uint32_t quota);
 
-  uint32_t            size() const                   { return m_size; }
+  uint32_t            size() const                   { return m_nodes.size(); }
+  uint32_t            size_inactive() const          { return m_inactive; }
 
   uint32_t            outstanding_quota() const      { return m_outstandingQuota; }
   uint32_t            unallocated_quota() const      { return m_unallocatedQuota; }
@@ -74,8 +89,14 @@ public:
 private:
   inline void         allocate_quota(ThrottleNode* node);
 
+  void                set_node_pacing(ThrottleNode* node, uint64_t rate);
+
+  void                queue_push(ThrottleNode* node);
+  void                queue_erase(ThrottleNode* node);
+  void                queue_compact();
+
   bool                m_enabled{false};
-  uint32_t            m_size{0};
+  bool                m_pacing{false};
 
   uint32_t            m_outstandingQuota{0};
   uint32_t            m_unallocatedQuota{0};
@@ -88,12 +109,17 @@ private:
 
   Rate                m_rateSlow;
 
-  // [m_splitActive,end> contains nodes that are inactive and need
-  // more quote, sorted from the most urgent
-  // node. [begin,m_splitActive> holds nodes with a large enough quota
-  // to transmit, but are blocking. These are sorted from the longest
-  // blocking node.
-  iterator            m_splitActive;
+  // All nodes in the list, in no particular order.
+  std::vector<ThrottleNode*> m_nodes;
+
+  // Inactive nodes waiting for quota, served from 'm_queueBegin' in
+  // the order they were deactivated. Erased nodes leave a null entry
+  // behind that is skipped. Node positions are counted from
+  // 'm_queueOffset' so dropping the front does not renumber them.
+  std::vector<ThrottleNode*> m_queue;
+  uint32_t            m_queueBegin{0};
+  uint64_t            m_queueOffset{0};
+  uint32_t            m_inactive{0};
 };
 
 }
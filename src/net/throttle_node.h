@@ -49,10 +49,10 @@ class SocketBase;
 
 class ThrottleNode {
 public:
-  using iterator       = ThrottleList::iterator;
-  using const_iterator = ThrottleList::const_iterator;
-
   using slot_void = std::function<void()>;
+  using slot_rate = std::function<void(uint64_t)>;
+
+  static constexpr uint32_t max_weight = 16;
 
   ThrottleNode(uint32_t rateSpan) : m_rate(rateSpan)  { clear_quota(); }
   ~ThrottleNode() = default;
@@ -64,23 +64,41 @@ public:
   void                clear_quota()                   { m_quota = 0; }
   void                set_quota(uint32_t q)           { m_quota = q; }
 
-  iterator            list_iterator()                 { return m_listIterator; }
-  const_iterator      list_iterator() const           { return m_listIterator; }
-  void                set_list_iterator(iterator itr) { m_listIterator = itr; }
+  // The weight is clamped to [1, max_weight].
+  uint32_t            weight() const                  { return m_weight; }
+  void                set_weight(uint32_t w)          { m_weight = w < 1 ? 1 : (w > max_weight ? max_weight : w); }
+
+  const ThrottleList* throttle_list() const           { return m_list; }
 
   void                activate()                      { if (m_slot_activate) m_slot_activate(); }
 
   slot_void&          slot_activate()                 { return m_slot_activate; }
 
+  // Called by a pacing ThrottleList with the node's share of the
+  // list's rate, or zero to clear it.
+  uint64_t            pacing_rate() const             { return m_pacingRate; }
+  slot_rate&          slot_pacing_rate()              { return m_slot_pacing_rate; }
+
 private:
+  friend class ThrottleList;
+
   ThrottleNode(const ThrottleNode&) = delete;
   ThrottleNode& operator=(const ThrottleNode&) = delete;
 
+  static constexpr uint64_t not_queued = ~uint64_t();
+
   uint32_t            m_quota;
-  iterator            m_listIterator;
+  uint32_t            m_weight{1};
+
+  ThrottleList*       m_list{};
+  uint32_t            m_index{0};
+  uint64_t            m_queuePosition{not_queued};
+
+  uint64_t            m_pacingRate{0};
 
   Rate                m_rate;
   slot_void           m_slot_activate;
+  slot_rate           m_slot_pacing_rate;
 };
 
 }
@@ -2,6 +2,7 @@
 
 #include "net/udns_resolver.h"
 
+#include <algorithm>
 #include <netdb.h>
 #include <netinet/in.h>
 #include <sys/socket.h>
@@ -77,12 +78,33 @@ UdnsResolver::resolve(void* requester, const std::string& hostname, int family,
   query->hostname = hostname;
   query->family = family;
   query->callback = std::move(callback);
-  query->parent = this;
+
+  lookup_key key(hostname, family);
+
+  if (resolve_cached(query, key))
+    return;
+
+  auto lookup_itr = m_lookups.find(key);
+
+  if (lookup_itr != m_lookups.end()) {
+    LT_LOG("joining lookup : requester:%p name:%s family:%d queries:%zu",
+           requester, hostname.c_str(), family, lookup_itr->second->queries.size());
+
+    lookup_itr->second->queries.push_back(query.get());
+
+    auto lock = std::scoped_lock(m_mutex);
+    m_queries.insert({requester, std::move(query)});
+    return;
+  }
+
+  auto lookup = std::make_unique<Lookup>();
+  lookup->key = key;
+  lookup->parent = this;
 
   if (family == AF_INET || family == AF_UNSPEC) {
-    query->a4_query = ::dns_submit_a4(m_ctx, hostname.c_str(), 0, a4_callback_wrapper, query.get());
+    lookup->a4_query = ::dns_submit_a4(m_ctx, hostname.c_str(), 0, a4_callback_wrapper, lookup.get());
 
-    if (query->a4_query == nullptr) {
+    if (lookup->a4_query == nullptr) {
       LT_LOG("malformed A query : requester:%p name:%s", requester, hostname.c_str());
 
       // Unrecoverable errors, like ENOMEM.
@@ -92,35 +114,35 @@ UdnsResolver::resolve(void* requester, const std::string& hostname, int family,
       // UDNS will fail immediately during submission of malformed domain names,
       // e.g., `..`. In order to maintain a clean interface, keep track of this
       // query internally so we can call the callback later with a failure code.
-      query->error_sin = EAI_NONAME;
+      query->error = EAI_NONAME;
 
       auto lock = std::scoped_lock(m_mutex);
-      m_malformed_queries.insert({requester, std::move(query)});
+      m_completed_queries.insert({requester, std::move(query)});
 
       return;
     }
   }
 
   if (family == AF_INET6 || family == AF_UNSPEC) {
-    query->a6_query = ::dns_submit_a6(m_ctx, hostname.c_str(), 0, a6_callback_wrapper, query.get());
+    lookup->a6_query = ::dns_submit_a6(m_ctx, hostname.c_str(), 0, a6_callback_wrapper, lookup.get());
 
     // It should be impossible for dns_submit_a6 to fail if dns_submit_a4
     // succeeded, but just in case, make it a hard failure.
-    if (query->a6_query == nullptr) {
+    if (lookup->a6_query == nullptr) {
       LT_LOG("malformed AAAA query : requester:%p name:%s", requester, hostname.c_str());
 
       if (::dns_status(m_ctx) != DNS_E_BADQUERY)
         throw new internal_error("dns_submit_a6 failed");
 
-      if (query->a4_query != nullptr) {
-        ::dns_cancel(m_ctx, query->a4_query);
-        query->a4_query = nullptr;
+      if (lookup->a4_query != nullptr) {
+        ::dns_cancel(m_ctx, lookup->a4_query);
+        lookup->a4_query = nullptr;
       }
 
-      query->error_sin = EAI_NONAME;
+      query->error = EAI_NONAME;
 
       auto lock = std::scoped_lock(m_mutex);
-      m_malformed_queries.insert({requester, std::move(query)});
+      m_completed_queries.insert({requester, std::move(query)});
 
       return;
     }
@@ -128,10 +150,51 @@ UdnsResolver::resolve(void* requester, const std::string& hostname, int family,
 
   LT_LOG("resolving : requester:%p name:%s family:%d", requester, hostname.c_str(), family);
 
+  lookup->queries.push_back(query.get());
+  m_lookups.emplace(key, std::move(lookup));
+
   auto lock = std::scoped_lock(m_mutex);
   m_queries.insert({requester, std::move(query)});
 }
 
+bool
+UdnsResolver::resolve_cached(std::unique_ptr<Query>& query, const lookup_key& key) {
+  auto itr = m_cache.find(key);
+
+  if (itr == m_cache.end())
+    return false;
+
+  if (itr->second.expires <= this_thread::cached_time()) {
+    m_cache.erase(itr);
+    return false;
+  }
+
+  LT_LOG("cached : requester:%p name:%s family:%d error:%d", query->requester, query->hostname.c_str(), query->family, itr->second.error);
+
+  query->result_sin = itr->second.result_sin;
+  query->result_sin6 = itr->second.result_sin6;
+  query->error = itr->second.error;
+
+  auto lock = std::scoped_lock(m_mutex);
+  m_completed_queries.insert({query->requester, std::move(query)});
+  return true;
+}
+
+// Expired entries are otherwise only removed when looked up.
+void
+UdnsResolver::prune_cache() {
+  auto now = this_thread::cached_time();
+
+  for (auto itr = m_cache.begin(); itr != m_cache.end(); )
+    if (itr->second.expires <= now)
+      itr = m_cache.erase(itr);
+    else
+      itr++;
+
+  if (m_cache.size() >= max_cache_size)
+    m_cache.clear();
+}
+
 void
 UdnsResolver::cancel(void* requester) {
   auto lock = std::scoped_lock(m_mutex);
@@ -142,32 +205,31 @@ UdnsResolver::cancel(void* requester) {
   for (auto itr = range.first; itr != range.second; ++itr)
     itr->second->canceled = true;
 
-  range = m_malformed_queries.equal_range(requester);
-  unsigned int malformed_count = std::distance(range.first, range.second);
+  range = m_completed_queries.equal_range(requester);
+  unsigned int completed_count = std::distance(range.first, range.second);
 
   for (auto itr = range.first; itr != range.second; ++itr)
     itr->second->canceled = true;
 
-  LT_LOG("canceled : requester:%p queries:%d malformed:%d", requester, query_count, malformed_count);
+  LT_LOG("canceled : requester:%p queries:%d completed:%d", requester, query_count, completed_count);
 }
 
 void
 UdnsResolver::flush() {
   {
     auto lock = std::scoped_lock(m_mutex);
-    auto malformed_queries = std::move(m_malformed_queries);
+    auto completed_queries = std::move(m_completed_queries);
 
-    for (auto& query : malformed_queries) {
+    for (auto& query : completed_queries) {
       if (query.second->canceled)
         continue;
 
-      LT_LOG("flushing malformed query : requester:%p name:%s", query.first, query.second->hostname.c_str());
+      LT_LOG("flushing completed query : requester:%p name:%s", query.first, query.second->hostname.c_str());
 
-      int error = query.second->error_sin != 0 ? query.second->error_sin : query.second->error_sin6;
-      if (error == 0)
-        throw internal_error("attempting to flush malformed query with no error");
+      if (query.second->error == 0 && query.second->result_sin.empty() && query.second->result_sin6.empty())
+        throw internal_error("attempting to flush completed query with no result or error");
 
-      query.second->callback(nullptr, nullptr, error);
+      query.second->callback(query.second->result_sin, query.second->result_sin6, query.second->error);
     }
   }
 
@@ -214,18 +276,6 @@ UdnsResolver::find_query(Query* query) {
   return m_queries.end();
 }
 
-UdnsResolver::query_map::iterator
-UdnsResolver::find_malformed_query(Query* query) {
-  auto range = m_malformed_queries.equal_range(query->requester);
-
-  for (auto itr = range.first; itr != range.second; ++itr) {
-    if (itr->second.get() == query)
-      return itr;
-  }
-
-  return m_malformed_queries.end();
-}
-
 void
 UdnsResolver::process_timeouts() {
   int timeout = ::dns_timeouts(m_ctx, -1, 0);
@@ -244,96 +294,111 @@ UdnsResolver::process_timeouts() {
 
 void
 UdnsResolver::a4_callback_wrapper(struct ::dns_ctx *ctx, ::dns_rr_a4 *result, void *data) {
-  auto query = static_cast<UdnsResolver::Query*>(data);
-
-  auto lock = std::scoped_lock(query->parent->m_mutex);
+  auto lookup = static_cast<UdnsResolver::Lookup*>(data);
 
-  if (query->deleted) {
-    LT_LOG("A records received, but query was deleted : requester:%p name:%s", query->requester, query->hostname.c_str());
-    throw internal_error("UdnsResolver::a4_callback_wrapper called with deleted query");
-  }
-
-  auto itr = query->parent->find_query(static_cast<UdnsResolver::Query*>(data));
-  if (itr == query->parent->m_queries.end())
-    throw internal_error("UdnsResolver::a4_callback_wrapper called with invalid query");
+  auto lock = std::scoped_lock(lookup->parent->m_mutex);
 
-  query->a4_query = nullptr;
+  lookup->a4_query = nullptr;
 
   if (result == nullptr || result->dnsa4_nrr == 0) {
-    query->error_sin = udnserror_to_gaierror(::dns_status(ctx));
+    lookup->error_sin = udnserror_to_gaierror(::dns_status(ctx));
 
-    LT_LOG("no A records received : requester:%p name:%s error:'%s'",
-           query->requester, query->hostname.c_str(), gai_strerror(query->error_sin));
+    LT_LOG("no A records received : name:%s error:'%s'", lookup->key.first.c_str(), gai_strerror(lookup->error_sin));
 
-    process_result(itr);
+    process_result(lookup);
     return;
   }
 
-  query->result_sin = sin_make();
-  query->result_sin->sin_addr = result->dnsa4_addr[0];
+  sockaddr_in sin{};
+  sin.sin_family = AF_INET;
+  sin.sin_addr = result->dnsa4_addr[0];
 
-  LT_LOG("A records received : requester:%p name:%s nrr:%d",
-         query->requester, query->hostname.c_str(), result->dnsa4_nrr);
+  lookup->result_sin = sa_inet_storage(&sin);
+  lookup->ttl = std::min(lookup->ttl, result->dnsa4_ttl);
 
-  process_result(itr);
+  LT_LOG("A records received : name:%s nrr:%d ttl:%u", lookup->key.first.c_str(), result->dnsa4_nrr, result->dnsa4_ttl);
+
+  process_result(lookup);
 }
 
 void
 UdnsResolver::a6_callback_wrapper(struct ::dns_ctx *ctx, ::dns_rr_a6 *result, void *data) {
-  auto query = static_cast<UdnsResolver::Query*>(data);
+  auto lookup = static_cast<UdnsResolver::Lookup*>(data);
 
-  auto lock = std::scoped_lock(query->parent->m_mutex);
+  auto lock = std::scoped_lock(lookup->parent->m_mutex);
 
-  if (query->deleted) {
-    LT_LOG("AAAA records received, but query was deleted : requester:%p name:%s", query->requester, query->hostname.c_str());
-    throw internal_error("UdnsResolver::a6_callback_wrapper called with deleted query");
-  }
-
-  auto itr = query->parent->find_query(query);
-  if (itr == query->parent->m_queries.end())
-    throw internal_error("UdnsResolver::a6_callback_wrapper called with invalid query");
-
-  query->a6_query = nullptr;
+  lookup->a6_query = nullptr;
 
   if (result == nullptr || result->dnsa6_nrr == 0) {
-    query->error_sin6 = udnserror_to_gaierror(::dns_status(ctx));
+    lookup->error_sin6 = udnserror_to_gaierror(::dns_status(ctx));
 
-    LT_LOG("no AAAA records received, calling back with error : requester:%p name:%s error:'%s'",
-           query->requester, query->hostname.c_str(), gai_strerror(query->error_sin6));
+    LT_LOG("no AAAA records received : name:%s error:'%s'", lookup->key.first.c_str(), gai_strerror(lookup->error_sin6));
 
-    process_result(itr);
+    process_result(lookup);
     return;
   }
 
-  query->result_sin6 = sin6_make();
-  query->result_sin6->sin6_addr = result->dnsa6_addr[0];
+  sockaddr_in6 sin6{};
+  sin6.sin6_family = AF_INET6;
+  sin6.sin6_addr = result->dnsa6_addr[0];
+
+  lookup->result_sin6 = sa_inet_storage(&sin6);
+  lookup->ttl = std::min(lookup->ttl, result->dnsa6_ttl);
 
-  LT_LOG("AAAA records received : requester:%p name:%s nrr:%d",
-         query->requester, query->hostname.c_str(), result->dnsa6_nrr);
+  LT_LOG("AAAA records received : name:%s nrr:%d ttl:%u", lookup->key.first.c_str(), result->dnsa6_nrr, result->dnsa6_ttl);
 
-  process_result(itr);
+  process_result(lookup);
 }
 
 void
-UdnsResolver::process_result(query_map::iterator itr) {
-  if (itr->second->a4_query != nullptr || itr->second->a6_query != nullptr)
+UdnsResolver::process_result(Lookup* lookup) {
+  if (lookup->a4_query != nullptr || lookup->a6_query != nullptr)
     return;
 
-  auto query = itr->second->parent->erase_query(itr);
+  auto parent = lookup->parent;
+  auto lookup_itr = parent->m_lookups.find(lookup->key);
 
-  if (query->canceled) {
-    LT_LOG("processing results, canceled : requester:%p name:%s", query->requester, query->hostname.c_str());
-    return;
-  }
+  if (lookup_itr == parent->m_lookups.end() || lookup_itr->second.get() != lookup)
+    throw internal_error("UdnsResolver::process_result called with invalid lookup");
 
-  LT_LOG("processing results, calling back : requester:%p name:%s", query->requester, query->hostname.c_str());
+  auto owned_lookup = std::move(lookup_itr->second);
+  parent->m_lookups.erase(lookup_itr);
 
-  if (query->result_sin == nullptr && query->result_sin6 == nullptr) {
-    query->callback(nullptr, nullptr, query->error_sin != 0 ? query->error_sin : query->error_sin6);
-    return;
+  const sa_inet_storage& result_sin = lookup->result_sin;
+  const sa_inet_storage& result_sin6 = lookup->result_sin6;
+  int                    error = 0;
+
+  if (result_sin.empty() && result_sin6.empty())
+    error = lookup->error_sin != 0 ? lookup->error_sin : lookup->error_sin6;
+
+  std::chrono::microseconds ttl = error == 0
+    ? std::chrono::microseconds(std::min<std::chrono::seconds>(std::chrono::seconds(lookup->ttl), max_cache_ttl))
+    : std::chrono::microseconds(negative_cache_ttl);
+
+  if (error != EAI_AGAIN && error != EAI_MEMORY && ttl.count() != 0) {
+    if (parent->m_cache.size() >= max_cache_size)
+      parent->prune_cache();
+
+    parent->m_cache[lookup->key] = CacheEntry{result_sin, result_sin6, error, this_thread::cached_time() + ttl};
   }
 
-  query->callback(query->result_sin, query->result_sin6, 0);
+  for (auto query_ptr : lookup->queries) {
+    auto itr = parent->find_query(query_ptr);
+
+    if (itr == parent->m_queries.end())
+      throw internal_error("UdnsResolver::process_result called with invalid query");
+
+    auto query = parent->erase_query(itr);
+
+    if (query->canceled) {
+      LT_LOG("processing results, canceled : requester:%p name:%s", query->requester, query->hostname.c_str());
+      continue;
+    }
+
+    LT_LOG("processing results, calling back : requester:%p name:%s", query->requester, query->hostname.c_str());
+
+    query->callback(result_sin, result_sin6, error);
+  }
 }
 
 } // namespace torrent
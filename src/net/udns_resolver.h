@@ -1,9 +1,11 @@
 #ifndef LIBTORRENT_NET_UDNSEVENT_H
 #define LIBTORRENT_NET_UDNSEVENT_H
 
+#include <chrono>
 #include <map>
 #include <mutex>
 #include <string>
+#include <vector>
 
 #include "torrent/event.h"
 #include "torrent/net/types.h"
@@ -16,9 +18,21 @@ struct dns_rr_a6;
 
 namespace torrent {
 
+// Concurrent resolves of the same hostname and family share a single
+// lookup, and its result is cached for the record TTL, capped at
+// max_cache_ttl. Failures other than temporary ones are cached for
+// negative_cache_ttl.
+//
+// The results are kept and passed to callbacks by value, so resolving
+// does not allocate a sockaddr per requester.
 class UdnsResolver : public Event {
 public:
-  using resolver_callback = std::function<void(sin_shared_ptr, sin6_shared_ptr, int)>;
+  using resolver_callback = std::function<void(const sa_inet_storage&, const sa_inet_storage&, int)>;
+  using lookup_key        = std::pair<std::string, int>;
+
+  static constexpr std::chrono::seconds max_cache_ttl{3600};
+  static constexpr std::chrono::seconds negative_cache_ttl{60};
+  static constexpr size_t               max_cache_size{4096};
 
   struct Query {
     void*             requester;
@@ -26,19 +40,40 @@ public:
     int               family;
     resolver_callback callback;
 
-    UdnsResolver*     parent;
     bool              canceled{false};
     bool              deleted{false};
+
+    // Set for queries completed without a lookup.
+    sa_inet_storage   result_sin;
+    sa_inet_storage   result_sin6;
+    int               error{0};
+  };
+
+  struct Lookup {
+    lookup_key        key;
+    UdnsResolver*     parent;
     ::dns_query*      a4_query{nullptr};
     ::dns_query*      a6_query{nullptr};
 
-    sin_shared_ptr    result_sin;
-    sin6_shared_ptr   result_sin6;
+    sa_inet_storage   result_sin;
+    sa_inet_storage   result_sin6;
     int               error_sin{0};
     int               error_sin6{0};
+    unsigned int      ttl{~0u};
+
+    std::vector<Query*> queries;
   };
 
-  using query_map = std::multimap<void*, std::unique_ptr<Query>>;
+  struct CacheEntry {
+    sa_inet_storage           result_sin;
+    sa_inet_storage           result_sin6;
+    int                       error;
+    std::chrono::microseconds expires;
+  };
+
+  using query_map  = std::multimap<void*, std::unique_ptr<Query>>;
+  using lookup_map = std::map<lookup_key, std::unique_ptr<Lookup>>;
+  using cache_map  = std::map<lookup_key, CacheEntry>;
 
   UdnsResolver();
   ~UdnsResolver() override;
@@ -53,6 +88,10 @@ public:
 
   void                flush();
 
+  size_t              size_lookups() const { return m_lookups.size(); }
+  size_t              size_cache() const   { return m_cache.size(); }
+  void                clear_cache()        { m_cache.clear(); }
+
   void                event_read() override;
   void                event_write() override;
   void                event_error() override;
@@ -60,14 +99,16 @@ public:
 protected:
   std::unique_ptr<Query> erase_query(query_map::iterator itr);
   query_map::iterator    find_query(Query* query);
-  query_map::iterator    find_malformed_query(Query* query);
+
+  bool                resolve_cached(std::unique_ptr<Query>& query, const lookup_key& key);
+  void                prune_cache();
 
   void                process_canceled();
   void                process_timeouts();
 
   static void         a4_callback_wrapper(struct ::dns_ctx *ctx, ::dns_rr_a4 *result, void *data);
   static void         a6_callback_wrapper(struct ::dns_ctx *ctx, ::dns_rr_a6 *result, void *data);
-  static void         process_result(query_map::iterator itr);
+  static void         process_result(Lookup* lookup);
 
   static bool         m_initialized;
 
@@ -76,7 +117,12 @@ protected:
 
   std::mutex          m_mutex;
   query_map           m_queries;
-  query_map           m_malformed_queries;
+
+  // Malformed and cached queries, called back on the next flush.
+  query_map           m_completed_queries;
+
+  lookup_map          m_lookups;
+  cache_map           m_cache;
 };
 
 } // namespace torrent
@@ -0,0 +1,106 @@
+#include "config.h"
+
+#include "net/utp_ledbat.h"
+
+#include <algorithm>
+
+namespace torrent {
+
+UtpLedbat::UtpLedbat(uint32_t packet_size) :
+  m_packet_size(packet_size),
+  m_window(2 * packet_size) {
+}
+
+uint32_t
+UtpLedbat::queuing_delay() const {
+  if (!m_has_sample)
+    return 0;
+
+  uint32_t current = m_filter[0];
+
+  for (auto delay : m_filter)
+    if (delay_less(delay, current))
+      current = delay;
+
+  return delay_less(current, m_base_delay) ? 0 : current - m_base_delay;
+}
+
+void
+UtpLedbat::add_sample(uint32_t delay, uint32_t now) {
+  uint32_t minute = now / 60;
+
+  if (!m_has_sample) {
+    m_history.fill(delay);
+    m_filter.fill(delay);
+
+    m_history_minute = minute;
+    m_has_sample = true;
+
+  } else if (minute != m_history_minute) {
+    m_history_minute = minute;
+    m_history_pos = (m_history_pos + 1) % history_size;
+    m_history[m_history_pos] = delay;
+
+  } else if (delay_less(delay, m_history[m_history_pos])) {
+    m_history[m_history_pos] = delay;
+  }
+
+  m_filter[m_filter_pos] = delay;
+  m_filter_pos = (m_filter_pos + 1) % filter_size;
+
+  update_base_delay();
+}
+
+void
+UtpLedbat::update_base_delay() {
+  m_base_delay = m_history[0];
+
+  for (auto delay : m_history)
+    if (delay_less(delay, m_base_delay))
+      m_base_delay = delay;
+}
+
+// Slow start doubles the window each round trip until the queuing
+// delay reaches half the target, after which the window follows the
+// LEDBAT controller. The window is only grown while it is used.
+void
+UtpLedbat::on_ack(uint32_t acked, uint32_t flight) {
+  if (acked == 0)
+    return;
+
+  int64_t off_target = int64_t{target_delay} - queuing_delay();
+
+  if (m_slow_start && off_target < target_delay / 2)
+    m_slow_start = false;
+
+  if (off_target > 0 && flight + m_packet_size < m_window)
+    return;
+
+  int64_t window = m_window;
+
+  if (m_slow_start) {
+    window += acked;
+
+  } else {
+    double delay_factor = double(off_target) / target_delay;
+    double window_factor = double(std::min(acked, m_window)) / m_window;
+
+    window += static_cast<int64_t>(max_increase * delay_factor * window_factor);
+  }
+
+  m_window = std::clamp<int64_t>(window, m_packet_size, max_window);
+}
+
+void
+UtpLedbat::on_loss() {
+  m_slow_start = false;
+  m_window = std::max(m_window / 2, m_packet_size);
+}
+
+void
+UtpLedbat::on_timeout() {
+  m_slow_start = false;
+  m_window = m_packet_size;
+}
+
+}
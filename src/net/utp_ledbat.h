@@ -0,0 +1,72 @@
+#ifndef LIBTORRENT_NET_UTP_LEDBAT_H
+#define LIBTORRENT_NET_UTP_LEDBAT_H
+
+#include <array>
+#include <cstdint>
+
+namespace torrent {
+
+// LEDBAT congestion control as used by uTP in BEP 29. The window grows
+// while the one-way delay of our packets stays below the target and
+// shrinks as queuing delay builds up, so uTP yields to other traffic
+// sharing the link.
+//
+// Delays are the timestamp differences the peer echoes back, which
+// include the offset between the clocks of the hosts. The lowest delay
+// seen over the last few minutes is taken as the base delay and only
+// the delay above it is counted as queuing. Comparisons handle the
+// wrapping of the 32 bit microsecond timestamps.
+
+class UtpLedbat {
+public:
+  static constexpr uint32_t     target_delay   = 100000;
+  static constexpr uint32_t     max_increase   = 3000;
+  static constexpr uint32_t     max_window     = 1 << 20;
+
+  // Minutes of base delay history, and the number of recent samples
+  // whose minimum is used as the current delay.
+  static constexpr unsigned int history_size   = 2;
+  static constexpr unsigned int filter_size    = 3;
+
+  explicit UtpLedbat(uint32_t packet_size);
+
+  uint32_t            window() const            { return m_window; }
+  uint32_t            base_delay() const        { return m_base_delay; }
+  uint32_t            queuing_delay() const;
+
+  bool                is_slow_start() const     { return m_slow_start; }
+  bool                has_sample() const        { return m_has_sample; }
+
+  // Add a delay in microseconds measured by the peer, 'now' is the
+  // current time in seconds.
+  void                add_sample(uint32_t delay, uint32_t now);
+
+  // Called with the number of bytes acked and the number of bytes that
+  // were in flight before the ack.
+  void                on_ack(uint32_t acked, uint32_t flight);
+  void                on_loss();
+  void                on_timeout();
+
+private:
+  static bool         delay_less(uint32_t a, uint32_t b) { return static_cast<int32_t>(a - b) < 0; }
+
+  void                update_base_delay();
+
+  uint32_t            m_packet_size;
+  uint32_t            m_window;
+  bool                m_slow_start{true};
+
+  bool                m_has_sample{false};
+  uint32_t            m_base_delay{0};
+
+  uint32_t            m_history_minute{0};
+  unsigned int        m_history_pos{0};
+  std::array<uint32_t, history_size> m_history{};
+
+  unsigned int        m_filter_pos{0};
+  std::array<uint32_t, filter_size> m_filter{};
+};
+
+}
+
+#endif
@@ -0,0 +1,266 @@
+#include "config.h"
+
+#include "net/utp_manager.h"
+
+#include <cstdlib>
+#include <cstring>
+#include <sys/socket.h>
+
+#include "net/socket_datagram.h"
+#include "net/utp_socket.h"
+#include "torrent/exceptions.h"
+#include "torrent/utils/log.h"
+#include "torrent/utils/thread.h"
+
+#define LT_LOG_SA(sa, log_fmt, ...)                                     \
+  lt_log_print(LOG_CONNECTION_UTP, "utp->%s: " log_fmt, (sa).address_str().c_str(), __VA_ARGS__);
+
+namespace torrent {
+
+UtpManager::UtpManager() = default;
+
+UtpManager::~UtpManager() {
+  stop();
+}
+
+void
+UtpManager::start(SocketDatagram* server) {
+  if (m_server != nullptr)
+    throw internal_error("UtpManager::start(...) called while already active.");
+
+  m_server = server;
+  m_task_tick.slot() = [this] { receive_tick(); };
+}
+
+void
+UtpManager::stop() {
+  if (m_server == nullptr)
+    return;
+
+  for (auto& entry : m_sockets)
+    entry.second->reset();
+
+  flush();
+
+  m_sockets.clear();
+  m_ack_list.clear();
+
+  this_thread::scheduler()->erase(&m_task_tick);
+  m_server = nullptr;
+}
+
+SocketFd
+UtpManager::connect(const rak::socket_address& sa) {
+  if (m_server == nullptr || m_sockets.size() >= max_sockets)
+    return SocketFd();
+
+  uint16_t recv_id = ::random();
+
+  while (m_sockets.find(key_type(sa, recv_id)) != m_sockets.end())
+    recv_id++;
+
+  auto socket = std::make_unique<UtpSocket>(this, sa, recv_id, recv_id + 1);
+  SocketFd fd = socket->open_bridge();
+
+  if (!fd.is_valid())
+    return SocketFd();
+
+  socket->connect();
+
+  m_sockets.emplace(key_type(sa, recv_id), std::move(socket));
+
+  schedule_tick();
+  flush();
+
+  return fd;
+}
+
+// A DHT message is a bencoded dictionary starting with 'd', which
+// never matches the version nibble.
+bool
+UtpManager::is_packet(const char* buffer, uint32_t length) {
+  return length >= UtpHeader::size && (buffer[0] & 0xf) == UtpHeader::version && (static_cast<uint8_t>(buffer[0]) >> 4) <= UtpHeader::ST_SYN;
+}
+
+void
+UtpManager::process_packet(const char* buffer, uint32_t length, const rak::socket_address& source) {
+  UtpHeader header;
+  uint32_t offset = UtpHeader::read(buffer, length, &header);
+
+  if (m_server == nullptr || offset == 0) {
+    m_packets_dropped++;
+    return;
+  }
+
+  rak::socket_address sa = source;
+
+  if (sa.family() == rak::socket_address::af_inet6)
+    sa = sa.sa_inet6()->normalize_address();
+
+  m_packets_received++;
+
+  if (header.type == UtpHeader::ST_SYN) {
+    auto itr = m_sockets.find(key_type(sa, header.connection_id + 1));
+
+    if (itr != m_sockets.end()) {
+      itr->second->process_packet(header, buffer + offset, length - offset);
+      return;
+    }
+
+    if (m_sockets.size() >= max_sockets || !m_slot_filter || !m_slot_filter(sa)) {
+      LT_LOG_SA(sa, "refused connection", 0);
+
+      send_reset(sa, header.connection_id, header.seq_nr);
+      m_packets_dropped++;
+      return;
+    }
+
+    auto socket = std::make_unique<UtpSocket>(this, sa, header.connection_id + 1, header.connection_id);
+    socket->accept(header);
+
+    m_sockets.emplace(key_type(sa, header.connection_id + 1), std::move(socket));
+    schedule_tick();
+    return;
+  }
+
+  auto itr = m_sockets.find(key_type(sa, header.connection_id));
+
+  if (itr == m_sockets.end()) {
+    if (header.type == UtpHeader::ST_DATA || header.type == UtpHeader::ST_FIN)
+      send_reset(sa, header.connection_id, header.seq_nr);
+
+    m_packets_dropped++;
+    return;
+  }
+
+  itr->second->process_packet(header, buffer + offset, length - offset);
+}
+
+void
+UtpManager::send(const rak::socket_address& sa, const char* buffer, uint32_t length) {
+  m_send_queue.push_back(queued_packet{sa, std::string(buffer, length)});
+}
+
+// The connection id of a reset is the one the peer expects on its
+// packets, which for unknown connections is the one it sent.
+void
+UtpManager::send_reset(const rak::socket_address& sa, uint16_t connection_id, uint16_t ack_nr) {
+  UtpHeader header;
+  char buffer[UtpHeader::size];
+
+  header.type = UtpHeader::ST_RESET;
+  header.connection_id = connection_id;
+  header.timestamp = this_thread::cached_time().count();
+  header.seq_nr = ::random();
+  header.ack_nr = ack_nr;
+  header.write(buffer);
+
+  send(sa, buffer, UtpHeader::size);
+}
+
+void
+UtpManager::accepted(UtpSocket* socket, SocketFd fd) {
+  LT_LOG_SA(socket->address(), "handing over connection: fd:%i", fd.get_fd());
+
+  if (!m_slot_accepted) {
+    fd.close();
+    return;
+  }
+
+  m_slot_accepted(fd, socket->address());
+}
+
+void
+UtpManager::flush() {
+  for (auto socket : m_ack_list)
+    socket->send_ack();
+
+  m_ack_list.clear();
+
+  if (m_server == nullptr) {
+    m_send_queue.clear();
+    return;
+  }
+
+  int fd = m_server->file_descriptor();
+  unsigned int sent = 0;
+
+#ifdef USE_SENDMMSG
+  mmsghdr                   msgs[batch_size];
+  iovec                     iovecs[batch_size];
+  rak::socket_address_inet6 mapped[batch_size];
+
+  while (sent < m_send_queue.size()) {
+    unsigned int count = std::min<size_t>(m_send_queue.size() - sent, batch_size);
+
+    std::memset(msgs, 0, sizeof(msgs));
+
+    for (unsigned int i = 0; i < count; i++) {
+      queued_packet& packet = m_send_queue[sent + i];
+
+      iovecs[i].iov_base = &packet.data[0];
+      iovecs[i].iov_len  = packet.data.size();
+
+      if (m_server->is_ipv6_socket() && packet.address.family() == rak::socket_address::af_inet) {
+        mapped[i] = packet.address.sa_inet()->to_mapped_address();
+
+        msgs[i].msg_hdr.msg_name    = mapped[i].c_sockaddr();
+        msgs[i].msg_hdr.msg_namelen = sizeof(rak::socket_address_inet6);
+      } else {
+        msgs[i].msg_hdr.msg_name    = packet.address.c_sockaddr();
+        msgs[i].msg_hdr.msg_namelen = packet.address.length();
+      }
+
+      msgs[i].msg_hdr.msg_iov    = &iovecs[i];
+      msgs[i].msg_hdr.msg_iovlen = 1;
+    }
+
+    int result = ::sendmmsg(fd, msgs, count, MSG_DONTWAIT);
+
+    // Packets that could not be sent count as lost.
+    if (result <= 0)
+      break;
+
+    sent += result;
+    m_packets_sent += result;
+  }
+#else
+  (void)fd;
+
+  for (auto& packet : m_send_queue) {
+    if (m_server->write_datagram(packet.data.data(), packet.data.size(), &packet.address) == -1)
+      break;
+
+    sent++;
+    m_packets_sent++;
+  }
+#endif
+
+  m_packets_dropped += m_send_queue.size() - sent;
+  m_send_queue.clear();
+}
+
+void
+UtpManager::receive_tick() {
+  for (auto& entry : m_sockets)
+    entry.second->process_timeout();
+
+  flush();
+
+  for (auto itr = m_sockets.begin(); itr != m_sockets.end(); ) {
+    if (itr->second->is_closed())
+      itr = m_sockets.erase(itr);
+    else
+      ++itr;
+  }
+
+  schedule_tick();
+}
+
+void
+UtpManager::schedule_tick() {
+  if (!m_sockets.empty() && !m_task_tick.is_scheduled())
+    this_thread::scheduler()->wait_for(&m_task_tick, std::chrono::microseconds(tick_interval));
+}
+
+}
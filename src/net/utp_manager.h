@@ -0,0 +1,109 @@
+#ifndef LIBTORRENT_NET_UTP_MANAGER_H
+#define LIBTORRENT_NET_UTP_MANAGER_H
+
+#include <functional>
+#include <map>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "net/socket_fd.h"
+#include "rak/socket_address.h"
+#include "torrent/utils/scheduler.h"
+
+namespace torrent {
+
+class SocketDatagram;
+class UtpSocket;
+
+// Demultiplexes uTP packets arriving on the DHT socket to their
+// connections and sends the packets of all connections through it.
+// Packets are queued and written in batches with sendmmsg when the
+// current read batch, socket event or timer tick is done, at which
+// point pending acks are also sent so that acks for packets of the
+// same batch are coalesced.
+//
+// Runs on the thread of the DHT server.
+
+class UtpManager {
+public:
+  using slot_accepted_type = std::function<void(SocketFd, const rak::socket_address&)>;
+  using slot_filter_type   = std::function<bool(const rak::socket_address&)>;
+
+  static constexpr unsigned int batch_size  = 32;
+  static constexpr size_t       max_sockets = 4096;
+
+  // Timer for retransmissions, in microseconds.
+  static constexpr int64_t      tick_interval = 100000;
+
+  UtpManager();
+  ~UtpManager();
+
+  bool                is_active() const                   { return m_server != nullptr; }
+  size_t              size() const                        { return m_sockets.size(); }
+
+  uint64_t            packets_received() const            { return m_packets_received; }
+  uint64_t            packets_sent() const                { return m_packets_sent; }
+  uint64_t            packets_dropped() const             { return m_packets_dropped; }
+
+  // Starts and stops sharing the datagram socket, stopping closes all
+  // connections.
+  void                start(SocketDatagram* server);
+  void                stop();
+
+  // Returns the end of the socket pair to use for the connection, or
+  // an invalid fd if not active.
+  SocketFd            connect(const rak::socket_address& sa);
+
+  // Called with the local end of incoming connections once their
+  // first data has arrived.
+  slot_accepted_type& slot_accepted()                     { return m_slot_accepted; }
+
+  // Decides whether to accept a connection from the address.
+  slot_filter_type&   slot_filter()                       { return m_slot_filter; }
+
+  static bool         is_packet(const char* buffer, uint32_t length);
+
+  void                process_packet(const char* buffer, uint32_t length, const rak::socket_address& sa);
+
+  void                send(const rak::socket_address& sa, const char* buffer, uint32_t length);
+  void                send_reset(const rak::socket_address& sa, uint16_t connection_id, uint16_t ack_nr);
+
+  void                insert_ack(UtpSocket* socket)       { m_ack_list.push_back(socket); }
+  void                accepted(UtpSocket* socket, SocketFd fd);
+
+  // Sends pending acks and queued packets.
+  void                flush();
+
+private:
+  using key_type      = std::pair<rak::socket_address, uint16_t>;
+  using socket_map    = std::map<key_type, std::unique_ptr<UtpSocket>>;
+
+  struct queued_packet {
+    rak::socket_address address;
+    std::string         data;
+  };
+
+  void                receive_tick();
+  void                schedule_tick();
+
+  SocketDatagram*     m_server{nullptr};
+
+  socket_map          m_sockets;
+  std::vector<UtpSocket*>    m_ack_list;
+  std::vector<queued_packet> m_send_queue;
+
+  uint64_t            m_packets_received{0};
+  uint64_t            m_packets_sent{0};
+  uint64_t            m_packets_dropped{0};
+
+  slot_accepted_type  m_slot_accepted;
+  slot_filter_type    m_slot_filter;
+
+  utils::SchedulerEntry m_task_tick;
+};
+
+}
+
+#endif
@@ -0,0 +1,625 @@
+#include "config.h"
+
+#define __STDC_FORMAT_MACROS
+
+#include "net/utp_socket.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cinttypes>
+#include <cstdlib>
+#include <cstring>
+#include <netinet/in.h>
+#include <sys/socket.h>
+
+#include "net/utp_manager.h"
+#include "torrent/exceptions.h"
+#include "torrent/poll.h"
+#include "torrent/utils/log.h"
+#include "torrent/utils/thread.h"
+
+#define LT_LOG_UTP(log_fmt, ...)                                        \
+  lt_log_print(LOG_CONNECTION_UTP, "utp->%s:%" PRIu16 ": " log_fmt,     \
+               m_address.address_str().c_str(), m_recv_id, __VA_ARGS__);
+
+namespace torrent {
+
+static inline uint32_t
+utp_time() {
+  return static_cast<uint32_t>(this_thread::cached_time().count());
+}
+
+static inline uint32_t
+utp_seconds() {
+  return static_cast<uint32_t>(this_thread::cached_seconds().count());
+}
+
+static inline uint16_t
+read_16(const uint8_t* data) {
+  return (uint16_t{data[0]} << 8) | data[1];
+}
+
+static inline uint32_t
+read_32(const uint8_t* data) {
+  return (uint32_t{data[0]} << 24) | (uint32_t{data[1]} << 16) | (uint32_t{data[2]} << 8) | data[3];
+}
+
+static inline void
+write_16(uint8_t* data, uint16_t value) {
+  data[0] = value >> 8;
+  data[1] = value;
+}
+
+static inline void
+write_32(uint8_t* data, uint32_t value) {
+  data[0] = value >> 24;
+  data[1] = value >> 16;
+  data[2] = value >> 8;
+  data[3] = value;
+}
+
+uint32_t
+UtpHeader::read(const char* buffer, uint32_t length, UtpHeader* header) {
+  auto data = reinterpret_cast<const uint8_t*>(buffer);
+
+  if (length < size || (data[0] & 0xf) != version || (data[0] >> 4) > ST_SYN)
+    return 0;
+
+  header->type           = data[0] >> 4;
+  header->connection_id  = read_16(data + 2);
+  header->timestamp      = read_32(data + 4);
+  header->timestamp_diff = read_32(data + 8);
+  header->window         = read_32(data + 12);
+  header->seq_nr         = read_16(data + 16);
+  header->ack_nr         = read_16(data + 18);
+
+  uint8_t  extension = data[1];
+  uint32_t offset = size;
+
+  while (extension != 0) {
+    if (length - offset < 2 || length - offset - 2 < data[offset + 1])
+      return 0;
+
+    extension = data[offset];
+    offset += 2 + data[offset + 1];
+  }
+
+  return offset;
+}
+
+void
+UtpHeader::write(char* buffer) const {
+  auto data = reinterpret_cast<uint8_t*>(buffer);
+
+  data[0] = (type << 4) | version;
+  data[1] = 0;
+
+  write_16(data + 2, connection_id);
+  write_32(data + 4, timestamp);
+  write_32(data + 8, timestamp_diff);
+  write_32(data + 12, window);
+  write_16(data + 16, seq_nr);
+  write_16(data + 18, ack_nr);
+}
+
+UtpSocket::UtpSocket(UtpManager* manager, const rak::socket_address& sa, uint16_t recv_id, uint16_t send_id) :
+  m_manager(manager),
+  m_address(sa),
+  m_recv_id(recv_id),
+  m_send_id(send_id),
+  m_last_receive(utp_seconds()) {
+}
+
+UtpSocket::~UtpSocket() {
+  close_local();
+}
+
+SocketFd
+UtpSocket::open_bridge() {
+  int fd1;
+  int fd2;
+
+  if (!SocketFd::open_socket_pair(fd1, fd2))
+    return SocketFd();
+
+  if (!SocketFd(fd1).set_nonblock() || !SocketFd(fd2).set_nonblock()) {
+    ::close(fd1);
+    ::close(fd2);
+    return SocketFd();
+  }
+
+  set_fd(SocketFd(fd1));
+
+  thread_self()->poll()->open(this);
+  thread_self()->poll()->insert_error(this);
+
+  return SocketFd(fd2);
+}
+
+void
+UtpSocket::connect() {
+  LT_LOG_UTP("connecting", 0);
+
+  set_state(STATE_SYN_SENT);
+  queue_packet(UtpHeader::ST_SYN, NULL, 0);
+}
+
+// Our first data packet uses the sequence number sent in the state
+// packet, which the initiator takes as the last one before it.
+void
+UtpSocket::accept(const UtpHeader& syn) {
+  LT_LOG_UTP("accepted", 0);
+
+  m_seq_nr = ::random();
+  m_ack_nr = syn.seq_nr;
+  m_last_ack_nr = m_seq_nr - 1;
+
+  m_reply_delay = utp_time() - syn.timestamp;
+  m_peer_window = syn.window;
+
+  set_state(STATE_SYN_RECV);
+  send_control(UtpHeader::ST_STATE);
+}
+
+void
+UtpSocket::process_packet(const UtpHeader& header, const char* payload, uint32_t length) {
+  if (is_closed())
+    return;
+
+  m_last_receive = utp_seconds();
+  m_reply_delay = utp_time() - header.timestamp;
+  m_peer_window = header.window;
+
+  switch (header.type) {
+  case UtpHeader::ST_RESET:
+    LT_LOG_UTP("received reset", 0);
+
+    set_state(STATE_CLOSED);
+    close_local();
+    return;
+
+  case UtpHeader::ST_SYN:
+    // Our state packet was lost.
+    if (m_state == STATE_SYN_RECV)
+      send_control(UtpHeader::ST_STATE);
+
+    return;
+
+  default:
+    break;
+  }
+
+  if (m_state == STATE_SYN_SENT) {
+    if (header.type != UtpHeader::ST_STATE)
+      return;
+
+    LT_LOG_UTP("connected", 0);
+
+    m_ack_nr = header.seq_nr - 1;
+    set_state(STATE_CONNECTED);
+  }
+
+  SocketFd accepted_fd;
+
+  if (m_state == STATE_SYN_RECV) {
+    if (header.type == UtpHeader::ST_FIN) {
+      reset();
+      return;
+    }
+
+    if (header.type != UtpHeader::ST_DATA || length == 0)
+      return;
+
+    if (!(accepted_fd = open_bridge()).is_valid()) {
+      reset();
+      return;
+    }
+
+    set_state(STATE_CONNECTED);
+  }
+
+  if (header.timestamp_diff != 0)
+    m_ledbat.add_sample(header.timestamp_diff, utp_seconds());
+
+  uint32_t flight = m_flight;
+  uint32_t acked = 0;
+
+  if (ack_packets(header.ack_nr, &acked)) {
+    m_timeouts = 0;
+    m_duplicate_acks = 0;
+
+    if (m_rtt != 0)
+      m_timeout = std::clamp(m_rtt + 4 * m_rtt_var, min_timeout, max_timeout);
+
+    m_ledbat.on_ack(acked, flight);
+
+  } else if (header.type == UtpHeader::ST_STATE && header.ack_nr == m_last_ack_nr && !m_send_list.empty() &&
+             ++m_duplicate_acks == 3) {
+    packet_type& packet = m_send_list.front();
+
+    // Cut the window once per window of data.
+    if (seq_distance(packet.seq_nr, m_loss_seq_nr) >= 0) {
+      m_ledbat.on_loss();
+      m_loss_seq_nr = m_seq_nr;
+    }
+
+    send_packet(packet);
+  }
+
+  m_last_ack_nr = header.ack_nr;
+
+  if (header.type == UtpHeader::ST_DATA || header.type == UtpHeader::ST_FIN)
+    receive_data(header, payload, length);
+
+  if (accepted_fd.is_valid())
+    m_manager->accepted(this, accepted_fd);
+
+  if (m_state == STATE_FIN_SENT && m_send_list.empty()) {
+    LT_LOG_UTP("closed", 0);
+
+    set_state(STATE_CLOSED);
+    close_local();
+    return;
+  }
+
+  finish_local();
+  update_local();
+
+  if (can_send())
+    read_local();
+}
+
+void
+UtpSocket::process_timeout() {
+  if (is_closed())
+    return;
+
+  uint32_t idle = utp_seconds() - m_last_receive;
+
+  if (idle > idle_timeout || (m_state == STATE_SYN_RECV && idle > accept_timeout)) {
+    LT_LOG_UTP("idle timeout", 0);
+    reset();
+    return;
+  }
+
+  if (m_send_list.empty())
+    return;
+
+  packet_type& packet = m_send_list.front();
+
+  if (utp_time() - packet.sent_time < m_timeout)
+    return;
+
+  if (++m_timeouts > (m_state == STATE_SYN_SENT ? max_syn_timeouts : max_timeouts)) {
+    LT_LOG_UTP("timed out: state:%i", m_state);
+    reset();
+    return;
+  }
+
+  m_ledbat.on_timeout();
+  m_loss_seq_nr = m_seq_nr;
+  m_timeout = std::min(m_timeout * 2, max_timeout);
+
+  send_packet(packet);
+}
+
+void
+UtpSocket::send_ack() {
+  if (m_ack_pending && !is_closed())
+    send_control(UtpHeader::ST_STATE);
+
+  m_ack_pending = false;
+}
+
+void
+UtpSocket::reset() {
+  if (is_closed())
+    return;
+
+  send_control(UtpHeader::ST_RESET);
+  set_state(STATE_CLOSED);
+  close_local();
+}
+
+void
+UtpSocket::event_read() {
+  read_local();
+  update_local();
+
+  m_manager->flush();
+}
+
+void
+UtpSocket::event_write() {
+  write_local();
+  finish_local();
+  update_local();
+
+  m_manager->flush();
+}
+
+void
+UtpSocket::event_error() {
+  reset();
+
+  m_manager->flush();
+}
+
+uint32_t
+UtpSocket::receive_window() const {
+  return receive_buffer - std::min<uint32_t>(receive_buffer, m_received.size() + m_reorder_bytes);
+}
+
+void
+UtpSocket::set_state(state_type state) {
+  m_state = state;
+}
+
+void
+UtpSocket::set_ack_pending() {
+  if (m_ack_pending)
+    return;
+
+  m_ack_pending = true;
+  m_manager->insert_ack(this);
+}
+
+void
+UtpSocket::write_header(char* buffer, uint8_t type, uint16_t seq_nr) {
+  UtpHeader header;
+
+  header.type           = type;
+  header.connection_id  = type == UtpHeader::ST_SYN ? m_recv_id : m_send_id;
+  header.timestamp      = utp_time();
+  header.timestamp_diff = m_reply_delay;
+  header.window         = receive_window();
+  header.seq_nr         = seq_nr;
+  header.ack_nr         = m_ack_nr;
+
+  header.write(buffer);
+}
+
+void
+UtpSocket::send_control(uint8_t type) {
+  char buffer[UtpHeader::size];
+
+  write_header(buffer, type, m_seq_nr);
+  m_manager->send(m_address, buffer, UtpHeader::size);
+
+  m_ack_pending = false;
+}
+
+void
+UtpSocket::send_packet(packet_type& packet) {
+  write_header(&packet.data[0], packet.type, packet.seq_nr);
+  m_manager->send(m_address, packet.data.data(), packet.data.size());
+
+  packet.sent_time = utp_time();
+  packet.transmissions++;
+
+  m_ack_pending = false;
+}
+
+void
+UtpSocket::queue_packet(uint8_t type, const char* payload, uint32_t length) {
+  packet_type packet{type, m_seq_nr++, 0, 0, std::string(UtpHeader::size + length, '\0')};
+
+  if (length != 0)
+    std::memcpy(&packet.data[UtpHeader::size], payload, length);
+
+  m_send_list.push_back(std::move(packet));
+  m_flight += length;
+
+  send_packet(m_send_list.back());
+}
+
+// Returns true if any packets were acked, acks beyond the packets sent
+// are ignored.
+bool
+UtpSocket::ack_packets(uint16_t ack_nr, uint32_t* acked) {
+  if (m_send_list.empty() || seq_distance(ack_nr, m_seq_nr - 1) > 0)
+    return false;
+
+  uint32_t now = utp_time();
+  bool result = false;
+
+  while (!m_send_list.empty() && seq_distance(m_send_list.front().seq_nr, ack_nr) <= 0) {
+    packet_type& packet = m_send_list.front();
+    uint32_t length = packet.data.size() - UtpHeader::size;
+
+    if (packet.transmissions == 1)
+      update_rtt(now - packet.sent_time);
+
+    *acked += length;
+    m_flight -= length;
+    result = true;
+
+    m_send_list.pop_front();
+  }
+
+  return result;
+}
+
+void
+UtpSocket::update_rtt(uint32_t sample) {
+  if (m_rtt == 0) {
+    m_rtt = sample;
+    m_rtt_var = sample / 2;
+    return;
+  }
+
+  uint32_t delta = m_rtt > sample ? m_rtt - sample : sample - m_rtt;
+
+  m_rtt_var = m_rtt_var + (int64_t{delta} - m_rtt_var) / 4;
+  m_rtt = m_rtt + (int64_t{sample} - m_rtt) / 8;
+}
+
+void
+UtpSocket::receive_data(const UtpHeader& header, const char* payload, uint32_t length) {
+  set_ack_pending();
+
+  if (m_fin_received && seq_distance(header.seq_nr, m_fin_seq_nr) > 0)
+    return;
+
+  int16_t distance = seq_distance(header.seq_nr, m_ack_nr + 1);
+
+  if (distance < 0)
+    return;
+
+  if (header.type == UtpHeader::ST_FIN) {
+    m_fin_received = true;
+    m_fin_seq_nr = header.seq_nr;
+  }
+
+  if (distance > 0) {
+    if (static_cast<uint32_t>(distance) >= reorder_size || m_reorder_bytes + length > receive_buffer)
+      return;
+
+    if (m_reorder_list.emplace(header.seq_nr, std::string(payload, length)).second)
+      m_reorder_bytes += length;
+
+    return;
+  }
+
+  deliver(payload, length);
+  m_ack_nr++;
+
+  for (auto itr = m_reorder_list.find(m_ack_nr + 1); itr != m_reorder_list.end(); itr = m_reorder_list.find(m_ack_nr + 1)) {
+    deliver(itr->second.data(), itr->second.size());
+
+    m_reorder_bytes -= itr->second.size();
+    m_reorder_list.erase(itr);
+    m_ack_nr++;
+  }
+}
+
+void
+UtpSocket::deliver(const char* payload, uint32_t length) {
+  if (length == 0 || !get_fd().is_valid() || m_local_shutdown)
+    return;
+
+  if (m_received.empty()) {
+    int written = ::send(m_fileDesc, payload, length, MSG_NOSIGNAL);
+
+    if (written < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+      return;
+
+    written = std::max(written, 0);
+
+    payload += written;
+    length -= written;
+  }
+
+  m_received.append(payload, length);
+}
+
+// Allow one packet to be in flight even if the peer advertises a zero
+// window, so that the window is probed.
+bool
+UtpSocket::can_send() const {
+  if (m_state != STATE_CONNECTED || m_local_eof || !get_fd().is_valid())
+    return false;
+
+  return m_flight == 0 || m_flight + payload_size <= std::min(m_ledbat.window(), m_peer_window);
+}
+
+void
+UtpSocket::read_local() {
+  char buffer[payload_size];
+
+  while (can_send()) {
+    int length = ::recv(m_fileDesc, buffer, payload_size, 0);
+
+    if (length > 0) {
+      queue_packet(UtpHeader::ST_DATA, buffer, length);
+      continue;
+    }
+
+    if (length < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR))
+      break;
+
+    // The peer connection closed its end.
+    LT_LOG_UTP("sending fin", 0);
+
+    m_local_eof = true;
+    m_received.clear();
+
+    queue_packet(UtpHeader::ST_FIN, NULL, 0);
+    set_state(STATE_FIN_SENT);
+    break;
+  }
+}
+
+void
+UtpSocket::write_local() {
+  uint32_t window = receive_window();
+
+  while (!m_received.empty()) {
+    int written = ::send(m_fileDesc, m_received.data(), m_received.size(), MSG_NOSIGNAL);
+
+    if (written > 0) {
+      m_received.erase(0, written);
+      continue;
+    }
+
+    if (written < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR))
+      break;
+
+    m_received.clear();
+  }
+
+  // Tell the peer once a throttled connection has made room.
+  if (window < receive_buffer / 2 && receive_window() >= receive_buffer / 2)
+    set_ack_pending();
+}
+
+void
+UtpSocket::update_local() {
+  if (!get_fd().is_valid())
+    return;
+
+  Poll* poll = thread_self()->poll();
+
+  if (can_send()) {
+    if (!poll->in_read(this))
+      poll->insert_read(this);
+  } else if (poll->in_read(this)) {
+    poll->remove_read(this);
+  }
+
+  if (!m_received.empty()) {
+    if (!poll->in_write(this))
+      poll->insert_write(this);
+  } else if (poll->in_write(this)) {
+    poll->remove_write(this);
+  }
+}
+
+// Shut down the bridge once the peer's fin and everything before it
+// has been passed on.
+void
+UtpSocket::finish_local() {
+  if (!m_fin_received || m_ack_nr != m_fin_seq_nr || !m_received.empty() || m_local_shutdown || !get_fd().is_valid())
+    return;
+
+  LT_LOG_UTP("received fin", 0);
+
+  ::shutdown(m_fileDesc, SHUT_WR);
+  m_local_shutdown = true;
+}
+
+void
+UtpSocket::close_local() {
+  if (!get_fd().is_valid())
+    return;
+
+  thread_self()->poll()->remove_read(this);
+  thread_self()->poll()->remove_write(this);
+  thread_self()->poll()->remove_error(this);
+  thread_self()->poll()->close(this);
+
+  get_fd().close();
+  get_fd().clear();
+}
+
+}
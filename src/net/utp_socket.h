@@ -0,0 +1,196 @@
+#ifndef LIBTORRENT_NET_UTP_SOCKET_H
+#define LIBTORRENT_NET_UTP_SOCKET_H
+
+#include <cstdint>
+#include <deque>
+#include <map>
+#include <string>
+
+#include "net/socket_base.h"
+#include "net/utp_ledbat.h"
+#include "rak/socket_address.h"
+
+namespace torrent {
+
+class UtpManager;
+
+// Packet header of BEP 29, in network byte order on the wire.
+
+class UtpHeader {
+public:
+  static constexpr uint8_t  version = 1;
+  static constexpr uint32_t size    = 20;
+
+  enum type_enum : uint8_t {
+    ST_DATA,
+    ST_FIN,
+    ST_STATE,
+    ST_RESET,
+    ST_SYN
+  };
+
+  // Returns the offset of the payload, or zero if 'buffer' does not
+  // hold a valid packet. Extensions such as selective acks are skipped.
+  static uint32_t     read(const char* buffer, uint32_t length, UtpHeader* header);
+
+  // Writes the header without extensions.
+  void                write(char* buffer) const;
+
+  uint8_t             type{};
+  uint16_t            connection_id{};
+  uint32_t            timestamp{};
+  uint32_t            timestamp_diff{};
+  uint32_t            window{};
+  uint16_t            seq_nr{};
+  uint16_t            ack_nr{};
+};
+
+// A uTP connection bridged to a local stream socket pair. Handshake and
+// PeerConnectionBase use the other end of the pair as they would a TCP
+// socket, so throttling, encryption and the peer protocol work
+// unchanged, while this end is polled to move data between the pair and
+// the packets of the connection.
+//
+// Sequence numbers are compared as signed 16 bit distances. Packets
+// received out of order are held until the gap is filled, and sent
+// packets are kept until acked and retransmitted on timeouts or three
+// duplicate acks.
+
+class UtpSocket : public SocketBase {
+public:
+  enum state_type {
+    STATE_SYN_SENT,
+    STATE_SYN_RECV,
+    STATE_CONNECTED,
+    STATE_FIN_SENT,
+    STATE_CLOSED
+  };
+
+  static constexpr uint32_t packet_size      = 1400;
+  static constexpr uint32_t payload_size     = packet_size - UtpHeader::size;
+  static constexpr uint32_t receive_buffer   = 1 << 20;
+  static constexpr uint32_t reorder_size     = 512;
+
+  // Timeouts are in microseconds, the retransmission timeout doubles
+  // for each consecutive timeout.
+  static constexpr uint32_t initial_timeout  = 1000000;
+  static constexpr uint32_t min_timeout      = 500000;
+  static constexpr uint32_t max_timeout      = 16000000;
+  static constexpr uint32_t max_syn_timeouts = 3;
+  static constexpr uint32_t max_timeouts     = 6;
+
+  // Seconds without receiving anything before a connection is dropped,
+  // incoming connections must send data within the shorter timeout.
+  static constexpr uint32_t idle_timeout     = 300;
+  static constexpr uint32_t accept_timeout   = 30;
+
+  UtpSocket(UtpManager* manager, const rak::socket_address& sa, uint16_t recv_id, uint16_t send_id);
+  ~UtpSocket() override;
+
+  const char*         type_name() const override    { return "utp"; }
+
+  state_type          state() const                 { return m_state; }
+  bool                is_closed() const             { return m_state == STATE_CLOSED; }
+  bool                is_ack_pending() const        { return m_ack_pending; }
+
+  const rak::socket_address& address() const       { return m_address; }
+  uint16_t            recv_id() const               { return m_recv_id; }
+
+  uint32_t            window() const                { return m_ledbat.window(); }
+  uint32_t            flight() const                { return m_flight; }
+
+  // Creates the socket pair and returns the end for the peer
+  // connection, or an invalid fd on failure.
+  SocketFd            open_bridge();
+
+  void                connect();
+  void                accept(const UtpHeader& syn);
+
+  void                process_packet(const UtpHeader& header, const char* payload, uint32_t length);
+  void                process_timeout();
+
+  void                send_ack();
+  void                reset();
+
+  void                event_read() override;
+  void                event_write() override;
+  void                event_error() override;
+
+private:
+  struct packet_type {
+    uint8_t           type;
+    uint16_t          seq_nr;
+    uint32_t          sent_time;
+    uint32_t          transmissions;
+    std::string       data;
+  };
+
+  static int16_t      seq_distance(uint16_t a, uint16_t b) { return static_cast<int16_t>(a - b); }
+
+  uint32_t            receive_window() const;
+
+  void                set_state(state_type state);
+  void                set_ack_pending();
+
+  void                write_header(char* buffer, uint8_t type, uint16_t seq_nr);
+  void                send_control(uint8_t type);
+  void                send_packet(packet_type& packet);
+  void                queue_packet(uint8_t type, const char* payload, uint32_t length);
+
+  bool                ack_packets(uint16_t ack_nr, uint32_t* acked);
+  void                update_rtt(uint32_t sample);
+
+  void                receive_data(const UtpHeader& header, const char* payload, uint32_t length);
+  void                deliver(const char* payload, uint32_t length);
+
+  bool                can_send() const;
+
+  void                read_local();
+  void                write_local();
+  void                update_local();
+  void                finish_local();
+  void                close_local();
+
+  UtpManager*         m_manager;
+  rak::socket_address m_address;
+  state_type          m_state{STATE_SYN_SENT};
+
+  uint16_t            m_recv_id;
+  uint16_t            m_send_id;
+  uint16_t            m_seq_nr{1};
+  uint16_t            m_ack_nr{0};
+
+  bool                m_ack_pending{false};
+
+  bool                m_local_eof{false};
+  bool                m_local_shutdown{false};
+  bool                m_fin_received{false};
+  uint16_t            m_fin_seq_nr{0};
+
+  uint32_t            m_last_receive{0};
+  uint32_t            m_reply_delay{0};
+  uint32_t            m_peer_window{packet_size};
+  uint32_t            m_flight{0};
+
+  uint32_t            m_rtt{0};
+  uint32_t            m_rtt_var{0};
+  uint32_t            m_timeout{initial_timeout};
+  uint32_t            m_timeouts{0};
+
+  uint16_t            m_last_ack_nr{0};
+  uint32_t            m_duplicate_acks{0};
+  uint16_t            m_loss_seq_nr{0};
+
+  std::deque<packet_type>         m_send_list;
+  std::map<uint16_t, std::string> m_reorder_list;
+  uint32_t            m_reorder_bytes{0};
+
+  // Received data the bridge could not take yet.
+  std::string         m_received;
+
+  UtpLedbat           m_ledbat{packet_size};
+};
+
+}
+
+#endif
@@ -0,0 +1,58 @@
+#include "config.h"
+
+#include "protocol/allowed_fast.h"
+
+#include <algorithm>
+#include <cstring>
+
+#include "torrent/net/socket_address.h"
+#include "utils/sha1.h"
+
+namespace torrent {
+
+std::vector<uint32_t>
+allowed_fast_set(const sockaddr* sa, const HashString& info_hash, uint32_t size_chunks, uint32_t k) {
+  std::vector<uint32_t> result;
+
+  sa_unique_ptr mapped;
+
+  if (sa_is_v4mapped(sa)) {
+    mapped = sa_from_v4mapped(sa);
+    sa = mapped.get();
+  }
+
+  if (!sa_is_inet(sa) || size_chunks == 0)
+    return result;
+
+  k = std::min(k, size_chunks);
+  result.reserve(k);
+
+  // The address is in network order, so masking the last byte is done
+  // on the raw bytes.
+  char x[20 + 4];
+  std::memcpy(x, &reinterpret_cast<const sockaddr_in*>(sa)->sin_addr.s_addr, 4);
+  x[3] = 0;
+  std::memcpy(x + 4, info_hash.data(), HashString::size_data);
+
+  Sha1 sha1;
+  unsigned int length = sizeof(x);
+
+  while (result.size() < k) {
+    sha1.init();
+    sha1.update(x, length);
+    sha1.final_c(x);
+    length = 20;
+
+    for (int i = 0; i < 5 && result.size() < k; i++) {
+      auto bytes = reinterpret_cast<const uint8_t*>(x) + i * 4;
+      uint32_t index = ((uint32_t)bytes[0] << 24 | (uint32_t)bytes[1] << 16 | (uint32_t)bytes[2] << 8 | bytes[3]) % size_chunks;
+
+      if (std::find(result.begin(), result.end(), index) == result.end())
+        result.push_back(index);
+    }
+  }
+
+  return result;
+}
+
+}
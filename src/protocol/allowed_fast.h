@@ -0,0 +1,21 @@
+#ifndef LIBTORRENT_PROTOCOL_ALLOWED_FAST_H
+#define LIBTORRENT_PROTOCOL_ALLOWED_FAST_H
+
+#include <cstdint>
+#include <vector>
+
+#include "torrent/hash_string.h"
+#include "torrent/net/types.h"
+
+namespace torrent {
+
+// Generates the allowed fast set of BEP 6 for a peer, the 'k' chunks
+// it may request while choked. The set depends only on the /24 of the
+// peer's IPv4 address and the info hash, so peers can't get more by
+// reconnecting. Returns an empty set for addresses that aren't IPv4 or
+// v4-mapped.
+std::vector<uint32_t> allowed_fast_set(const sockaddr* sa, const HashString& info_hash, uint32_t size_chunks, uint32_t k);
+
+}
+
+#endif
@@ -0,0 +1,30 @@
+#include "config.h"
+
+#include "protocol/encryption_info.h"
+
+#include "data/chunk.h"
+#include "data/chunk_iterator.h"
+#include "torrent/exceptions.h"
+
+namespace torrent {
+
+void
+EncryptionInfo::encrypt_chunk(Chunk* chunk, uint32_t position, uint32_t length, void* dest) {
+  if (position + length > chunk->chunk_size())
+    throw internal_error("EncryptionInfo::encrypt_chunk(...) position + length > chunk_size.");
+
+  if (length == 0)
+    return;
+
+  Chunk::data_type data;
+  ChunkIterator itr(chunk, position, position + length);
+
+  do {
+    data = itr.data();
+    m_encrypt.crypt(data.first, dest, data.second);
+
+    dest = static_cast<char*>(dest) + data.second;
+  } while (itr.next());
+}
+
+}
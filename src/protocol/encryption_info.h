@@ -37,12 +37,21 @@
 #ifndef LIBTORRENT_PROTOCOL_ENCRYPTION_H
 #define LIBTORRENT_PROTOCOL_ENCRYPTION_H
 
+#include <cstdint>
+
 #include "utils/rc4.h"
 
 namespace torrent {
 
+class Chunk;
+
 class EncryptionInfo {
 public:
+  // Encrypts 'length' bytes of the chunk from 'position' into 'dest',
+  // reading each chunk part directly instead of copying the data to
+  // 'dest' and encrypting it in place.
+  void                encrypt_chunk(Chunk* chunk, uint32_t position, uint32_t length, void* dest);
+
   void                encrypt(const void *indata, void *outdata, unsigned int length) { m_encrypt.crypt(indata, outdata, length); }
   void                encrypt(void *data, unsigned int length)                        { m_encrypt.crypt(data, length); }
   void                decrypt(const void *indata, void *outdata, unsigned int length) { m_decrypt.crypt(indata, outdata, length); }
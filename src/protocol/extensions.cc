@@ -41,10 +41,12 @@
 
 #include <cstdio>
 
+#include "data/metadata_cache.h"
 #include "download/available_list.h"
 #include "download/download_main.h"
 #include "download/download_wrapper.h"
 #include "protocol/peer_connection_base.h"
+#include "torrent/chunk_manager.h"
 #include "torrent/connection_manager.h"
 #include "torrent/object_stream.h"
 #include "torrent/download/download_manager.h"
@@ -57,7 +59,7 @@
 namespace torrent {
 
 template <>
-const ExtHandshakeMessage::key_list_type ExtHandshakeMessage::keys = {
+constexpr ExtHandshakeMessage::key_list_type ExtHandshakeMessage::keys = {
   { key_e,            "e" },
   { key_m_utMetadata, "m::ut_metadata" },
   { key_m_utPex,      "m::ut_pex" },
@@ -68,18 +70,28 @@ const ExtHandshakeMessage::key_list_type ExtHandshakeMessage::keys = {
 };
 
 template <>
-const ExtPEXMessage::key_list_type ExtPEXMessage::keys = {
+constexpr ExtHandshakeMessage::key_hash_type ExtHandshakeMessage::key_hash = static_map_make_hash<ExtHandshakeMessage>();
+
+template <>
+constexpr ExtPEXMessage::key_list_type ExtPEXMessage::keys = {
   { key_pex_added,    "added*S" },
+  { key_pex_added6,   "added6*S" },
 };
 
+template <>
+constexpr ExtPEXMessage::key_hash_type ExtPEXMessage::key_hash = static_map_make_hash<ExtPEXMessage>();
+
 // DEBUG: Add type info.
 template <>
-const ExtMetadataMessage::key_list_type ExtMetadataMessage::keys = {
+constexpr ExtMetadataMessage::key_list_type ExtMetadataMessage::keys = {
   { key_msgType,      "msg_type" },
   { key_piece,        "piece" },
   { key_totalSize,    "total_size" },
 };
 
+template <>
+constexpr ExtMetadataMessage::key_hash_type ExtMetadataMessage::key_hash = static_map_make_hash<ExtMetadataMessage>();
+
 struct message_type {
   const char* key;
   ext_handshake_keys index;
@@ -189,27 +201,46 @@ ProtocolExtension::generate_toggle_message(MessageType t, bool on) {
 }
 
 DataBuffer
-ProtocolExtension::generate_ut_pex_message(const PEXList& added, const PEXList& removed) {
-  if (added.empty() && removed.empty())
+ProtocolExtension::generate_ut_pex_message(const PEXList& added, const PEXList& removed,
+                                           const PEXList6& added6, const PEXList6& removed6) {
+  if (added.empty() && removed.empty() && added6.empty() && removed6.empty())
     return DataBuffer();
 
-  int added_len   = added.size() * 6;
-  int removed_len = removed.size() * 6;
+  bool has_inet6 = !added6.empty() || !removed6.empty();
+
+  int added_len    = added.size() * sizeof(SocketAddressCompact);
+  int removed_len  = removed.size() * sizeof(SocketAddressCompact);
+  int added6_len   = added6.size() * sizeof(SocketAddressCompact6);
+  int removed6_len = removed6.size() * sizeof(SocketAddressCompact6);
+  int max_len      = 64 + added_len + removed_len + added6_len + removed6_len;
 
-  // Manually create bencoded map { "added" => added, "dropped" => dropped }
-  auto buffer = new char[32 + added_len + removed_len];
+  // Manually create bencoded map { "added" => added, "added6" =>
+  // added6, "dropped" => dropped, "dropped6" => dropped6 }
+  auto buffer = new char[max_len];
   auto end = buffer;
 
   end += sprintf(end, "d5:added%d:", added_len);
-  memcpy(end, added.begin()->c_str(), added_len);
+  memcpy(end, added.data(), added_len);
   end += added_len;
 
+  if (has_inet6) {
+    end += sprintf(end, "6:added6%d:", added6_len);
+    memcpy(end, added6.data(), added6_len);
+    end += added6_len;
+  }
+
   end += sprintf(end, "7:dropped%d:", removed_len);
-  memcpy(end, removed.begin()->c_str(), removed_len);
+  memcpy(end, removed.data(), removed_len);
   end += removed_len;
 
+  if (has_inet6) {
+    end += sprintf(end, "8:dropped6%d:", removed6_len);
+    memcpy(end, removed6.data(), removed6_len);
+    end += removed6_len;
+  }
+
   *end++ = 'e';
-  if (end - buffer > 32 + added_len + removed_len)
+  if (end - buffer > max_len)
     throw internal_error("ProtocolExtension::ut_pex_message wrote beyond buffer.");
 
   return DataBuffer(buffer, end);
@@ -332,21 +363,19 @@ ProtocolExtension::parse_ut_pex() {
   static_map_read_bencode(m_read, m_readPos, message);
 
   // TODO: Check if pex is enabled?
-  if (!message[key_pex_added].is_raw_string())
-    return true;
+  if (message[key_pex_added].is_raw_string()) {
+    raw_string peers = message[key_pex_added].as_raw_string();
 
-  raw_string peers = message[key_pex_added].as_raw_string();
+    if (!peers.empty())
+      m_download->peer_list()->insert_available_compact(peers.data(), peers.size(), AF_INET, PeerList::source_pex);
+  }
 
-  if (peers.empty())
-    return true;
+  if (message[key_pex_added6].is_raw_string()) {
+    raw_string peers = message[key_pex_added6].as_raw_string();
 
-  // TODO: Sort the list before adding it.
-  AddressList l;
-  l.parse_address_compact(peers);
-  l.sort();
-  l.erase(std::unique(l.begin(), l.end()), l.end());
- 
-  m_download->peer_list()->insert_available(&l);
+    if (!peers.empty())
+      m_download->peer_list()->insert_available_compact(peers.data(), peers.size(), AF_INET6, PeerList::source_pex);
+  }
 
   return true;
 }
@@ -398,20 +427,26 @@ ProtocolExtension::send_metadata_piece(size_t piece) {
     return;
   }
 
-  // These messages will be rare, so we'll just build the
-  // metadata here instead of caching it uselessly.
-  auto buffer = new char[metadataSize];
-  object_write_bencode_c(object_write_to_buffer, NULL, object_buffer_t(buffer, buffer + metadataSize), 
-                         &(*manager->download_manager()->find(m_download->info()))->bencode()->get_key("info"));
+  MetadataCache* cache = manager->chunk_manager()->metadata_cache();
+  DataBuffer metadata = cache->find(m_download);
+
+  if (metadata.empty()) {
+    auto buffer = new char[metadataSize];
+    object_write_bencode_c(object_write_to_buffer, NULL, object_buffer_t(buffer, buffer + metadataSize),
+                           &(*manager->download_manager()->find(m_download->info()))->bencode()->get_key("info"));
+
+    metadata = cache->insert(m_download, DataBuffer(buffer, buffer + metadataSize));
+  }
 
   // data: { "msg_type" => 1, "piece" => ..., "total_size" => ... } followed by piece data (outside of dictionary)
-  size_t length = piece == pieceEnd - 1 ? m_download->info()->metadata_size() % metadata_piece_size : metadata_piece_size;
+  size_t offset = piece << metadata_piece_shift;
+  size_t length = std::min(metadataSize - offset, metadata_piece_size);
+
   m_pendingType = UT_METADATA;
-  m_pending = build_bencode((2 * sizeof(size_t)) + length + 120, "d8:msg_typei1e5:piecei%zue10:total_sizei%zuee", piece, metadataSize);
+  m_pending = build_bencode((2 * sizeof(size_t)) + 120, "d8:msg_typei1e5:piecei%zue10:total_sizei%zuee", piece, metadataSize);
+  m_pendingPayload = metadata.slice(offset, length);
 
-  memcpy(m_pending.end(), buffer + (piece << metadata_piece_shift), length);
-  m_pending.set(m_pending.data(), m_pending.end() + length, m_pending.owned());
-  delete [] buffer;
+  metadata.clear();
 }
 
 bool
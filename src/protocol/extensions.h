@@ -26,7 +26,8 @@ public:
     SKIP_EXTENSION,
   };
 
-  using PEXList = std::vector<SocketAddressCompact>;
+  using PEXList  = std::vector<SocketAddressCompact>;
+  using PEXList6 = std::vector<SocketAddressCompact6>;
 
   static constexpr int    flag_default           = 1<<0;
   static constexpr int    flag_initial_handshake = 1<<1;
@@ -61,7 +62,10 @@ public:
 
   DataBuffer          generate_handshake_message();
   static DataBuffer   generate_toggle_message(MessageType t, bool on);
-  static DataBuffer   generate_ut_pex_message(const PEXList& added, const PEXList& removed);
+
+  // The IPv6 lists are only included when either is non-empty.
+  static DataBuffer   generate_ut_pex_message(const PEXList& added, const PEXList& removed,
+                                              const PEXList6& added6 = PEXList6(), const PEXList6& removed6 = PEXList6());
 
   // Return peer's extension ID for the given extension type, or 0 if
   // disabled by peer.
@@ -102,9 +106,11 @@ public:
   bool                request_metadata_piece(const Piece* p);
 
   // To handle cases where the extension protocol needs to send a reply.
+  // The payload, if any, is sent after the message data.
   bool                has_pending_message() const      { return m_pendingType != HANDSHAKE; }
   MessageType         pending_message_type() const     { return m_pendingType; }
   DataBuffer          pending_message_data()           { return m_pending.release(); }
+  DataBuffer          pending_message_payload()        { return m_pendingPayload.release(); }
   void                clear_pending_message()          { if (m_pending.empty()) m_pendingType = HANDSHAKE; }
 
 private:
@@ -138,6 +144,7 @@ private:
 
   MessageType         m_pendingType{HANDSHAKE};
   DataBuffer          m_pending;
+  DataBuffer          m_pendingPayload;
 };
 
 enum ext_handshake_keys {
@@ -153,6 +160,7 @@ enum ext_handshake_keys {
 
 enum ext_pex_keys {
   key_pex_added,
+  key_pex_added6,
   key_pex_LAST
 };
 
@@ -2,6 +2,7 @@
 
 #include "handshake.h"
 
+#include <algorithm>
 #include <cassert>
 #include <stdio.h>
 
@@ -66,17 +67,41 @@ Handshake::Handshake(SocketFd fd, HandshakeManager* m, int encryptionOptions) :
 
   m_readBuffer.reset();
   m_writeBuffer.reset();
-
-  m_task_timeout.slot() = [this, m] { m->receive_timeout(this); };
 }
 
 Handshake::~Handshake() {
-  assert(!m_task_timeout.is_scheduled());
+  assert(m_timeout == std::chrono::microseconds());
   assert(!get_fd().is_valid());
 
   m_encryption.cleanup();
 }
 
+int
+Handshake::check_incoming(const char* buffer, uint32_t length, int encryption_options, const char** hash) {
+  *hash = NULL;
+
+  if (length == 0)
+    return 0;
+
+  bool allow_encrypted = encryption_options & (ConnectionManager::encryption_allow_incoming | ConnectionManager::encryption_require);
+
+  // Same rule as read_encryption_key, anything but a complete protocol
+  // string is the start of an encryption key.
+  if (length < 20)
+    return allow_encrypted || static_cast<uint8_t>(buffer[0]) == 19 ? 0 : e_handshake_not_bittorrent;
+
+  if (static_cast<uint8_t>(buffer[0]) != 19 || std::memcmp(buffer + 1, m_protocol, 19) != 0)
+    return allow_encrypted ? 0 : e_handshake_not_bittorrent;
+
+  if (encryption_options & ConnectionManager::encryption_require)
+    return e_handshake_unencrypted_rejected;
+
+  if (length >= part1_size)
+    *hash = buffer + 28;
+
+  return 0;
+}
+
 void
 Handshake::initialize_incoming(const sockaddr* sa) {
   m_incoming = true;
@@ -92,7 +117,7 @@ Handshake::initialize_incoming(const sockaddr* sa) {
   thread_self()->poll()->insert_error(this);
 
   // Use lower timeout here.
-  this_thread::scheduler()->wait_for_ceil_seconds(&m_task_timeout, 60s);
+  m_manager->set_timeout(this, 60s);
 }
 
 void
@@ -105,7 +130,7 @@ Handshake::initialize_outgoing(const sockaddr* sa, DownloadMain* d, PeerInfo* pe
   m_incoming = false;
   m_address = sa_copy(sa);
 
-  std::make_pair(m_uploadThrottle, m_downloadThrottle) = m_download->throttles(m_address.get());
+  std::make_pair(m_uploadThrottle, m_downloadThrottle) = m_download->throttles(m_address.get(), get_fd());
 
   m_state = CONNECTING;
 
@@ -113,7 +138,7 @@ Handshake::initialize_outgoing(const sockaddr* sa, DownloadMain* d, PeerInfo* pe
   thread_self()->poll()->insert_write(this);
   thread_self()->poll()->insert_error(this);
 
-  this_thread::scheduler()->wait_for_ceil_seconds(&m_task_timeout, 60s);
+  m_manager->set_timeout(this, 60s);
 }
 
 void
@@ -123,7 +148,8 @@ Handshake::deactivate_connection() {
 
   m_state = INACTIVE;
 
-  this_thread::scheduler()->erase(&m_task_timeout);
+  m_manager->erase_timeout(this);
+  m_encryption.cancel_compute_secret();
 
   thread_self()->poll()->remove_read(this);
   thread_self()->poll()->remove_write(this);
@@ -166,6 +192,14 @@ Handshake::destroy_connection() {
   }
 }
 
+// Incoming handshakes learn their download from the info hash, the
+// manager indexes them by it from then on.
+void
+Handshake::set_download(DownloadMain* d) {
+  m_manager->index_download(this, d);
+  m_download = d;
+}
+
 int
 Handshake::retry_options() {
   uint32_t options = m_encryption.options() & ~ConnectionManager::encryption_enable_retry;
@@ -246,15 +280,25 @@ Handshake::read_encryption_key() {
   if (m_readBuffer.size_end() < 96)
     return false;
 
-  // If the handshake fails after this, it wasn't because the peer
-  // doesn't like encrypted connections, so don't retry unencrypted.
-  m_encryption.set_retry(HandshakeEncryption::RETRY_NONE);
+  if (!m_encryption.has_secret()) {
+    // If the handshake fails after this, it wasn't because the peer
+    // doesn't like encrypted connections, so don't retry unencrypted.
+    m_encryption.set_retry(HandshakeEncryption::RETRY_NONE);
 
-  if (m_incoming)
-    prepare_key_plus_pad();
+    if (m_incoming)
+      prepare_key_plus_pad();
+
+    // Stop reading until the secret is known, our public key is still
+    // written in the meantime.
+    if (m_encryption.compute_secret(m_readBuffer.position(), [this](bool result) { receive_secret(result); })) {
+      thread_self()->poll()->remove_read(this);
+      return false;
+    }
+
+    if (!m_encryption.has_secret())
+      throw handshake_error(ConnectionManager::handshake_failed, e_handshake_invalid_encryption);
+  }
 
-  if(!m_encryption.key()->compute_secret(m_readBuffer.position(), 96))
-    throw handshake_error(ConnectionManager::handshake_failed, e_handshake_invalid_encryption);
   m_readBuffer.consume(96);
 
   // Determine the synchronisation string.
@@ -271,6 +315,17 @@ Handshake::read_encryption_key() {
   return true;
 }
 
+void
+Handshake::receive_secret(bool result) {
+  if (!result) {
+    m_manager->receive_failed(this, ConnectionManager::handshake_failed, e_handshake_invalid_encryption);
+    return;
+  }
+
+  thread_self()->poll()->insert_read(this);
+  event_read();
+}
+
 // Handshake::read_encryption_sync()
 // *E 96, [96, enc_pad_read_size>
 bool
@@ -319,12 +374,12 @@ Handshake::read_encryption_skey() {
     return false;
 
   m_encryption.deobfuscate_hash(reinterpret_cast<char*>(m_readBuffer.position()));
-  m_download = m_manager->download_info_obfuscated(reinterpret_cast<char*>(m_readBuffer.position()));
+  set_download(m_manager->download_info_obfuscated(reinterpret_cast<char*>(m_readBuffer.position())));
   m_readBuffer.consume(20);
 
   validate_download();
 
-  std::make_pair(m_uploadThrottle, m_downloadThrottle) = m_download->throttles(m_address.get());
+  std::make_pair(m_uploadThrottle, m_downloadThrottle) = m_download->throttles(m_address.get(), get_fd());
 
   m_encryption.initialize_encrypt(m_download->info()->hash().c_str(), m_incoming);
   m_encryption.initialize_decrypt(m_download->info()->hash().c_str(), m_incoming);
@@ -472,12 +527,12 @@ Handshake::read_info() {
         throw handshake_error(ConnectionManager::handshake_failed, e_handshake_invalid_value);
 
     } else {
-      m_download = m_manager->download_info(reinterpret_cast<char*>(m_readBuffer.position()));
+      set_download(m_manager->download_info(reinterpret_cast<char*>(m_readBuffer.position())));
     }
 
     validate_download();
 
-    std::make_pair(m_uploadThrottle, m_downloadThrottle) = m_download->throttles(m_address.get());
+    std::make_pair(m_uploadThrottle, m_downloadThrottle) = m_download->throttles(m_address.get(), get_fd());
 
     prepare_handshake();
 
@@ -507,19 +562,38 @@ Handshake::read_peer() {
 
   // Replay HAVE messages we receive after starting to send the bitfield.
   // This avoids replaying HAVEs for pieces received between starting the
-  // handshake and now (e.g. when connecting takes longer). Ideally we
-  // should make a snapshot of the bitfield here in case it changes while
-  // we're sending it (if it can't be sent in one write() call).
+  // handshake and now (e.g. when connecting takes longer). The bitfield
+  // is sent from a snapshot taken now, in case it changes while it
+  // can't be sent in one write() call.
   m_initialized_time = this_thread::cached_time();
 
+  const Bitfield* bitfield = m_download->file_list()->bitfield();
+
   // The download is just starting so we're not sending any
-  // bitfield. Pretend we wrote it already.
-  if (m_download->file_list()->bitfield()->is_all_unset() || m_download->initial_seeding() != NULL) {
-    m_writePos = m_download->file_list()->bitfield()->size_bytes();
-    m_writeBuffer.write_32(0);
+  // bitfield. Pretend we wrote it already. Peers supporting the fast
+  // extension get HAVE_NONE instead of the keep-alive, and HAVE_ALL
+  // instead of a full bitfield.
+  if (bitfield->is_all_unset() || m_download->initial_seeding() != NULL) {
+    Buffer::iterator old_end = m_writeBuffer.end();
+    m_writePos = bitfield->size_bytes();
+
+    if (m_peerInfo->supports_fast()) {
+      m_writeBuffer.write_32(1);
+      m_writeBuffer.write_8(protocol_have_none);
+    } else {
+      m_writeBuffer.write_32(0);
+    }
 
     if (m_encryption.info()->is_encrypted())
-      m_encryption.info()->encrypt(m_writeBuffer.end() - 4, 4);
+      m_encryption.info()->encrypt(old_end, m_writeBuffer.end() - old_end);
+
+  } else if (m_peerInfo->supports_fast() && bitfield->is_all_set()) {
+    m_writePos = bitfield->size_bytes();
+    m_writeBuffer.write_32(1);
+    m_writeBuffer.write_8(protocol_have_all);
+
+    if (m_encryption.info()->is_encrypted())
+      m_encryption.info()->encrypt(m_writeBuffer.end() - 5, 5);
 
   } else {
     prepare_bitfield();
@@ -529,7 +603,7 @@ Handshake::read_peer() {
   thread_self()->poll()->insert_write(this);
 
   // Give some extra time for reading/writing the bitfield.
-  this_thread::scheduler()->update_wait_for_ceil_seconds(&m_task_timeout, 120s);
+  m_manager->set_timeout(this, 120s);
 
   return true;
 }
@@ -566,10 +640,10 @@ Handshake::read_extension() {
   // In addition, make sure there's at least 5 bytes available after
   // the PEX message has been read, so that we can fit the preamble of
   // the BITFIELD message.
-  if (need + 5 > m_readBuffer.reserved_left()) {
+  if (need + 5 > static_cast<int32_t>(m_readBuffer.reserved_left())) {
     m_readBuffer.move_unused();
 
-    if (need + 5 > m_readBuffer.reserved_left())
+    if (need + 5 > static_cast<int32_t>(m_readBuffer.reserved_left()))
       throw handshake_error(ConnectionManager::handshake_failed, e_handshake_invalid_value);
   }
 
@@ -601,10 +675,10 @@ Handshake::read_port() {
 
   int32_t need = m_readBuffer.peek_32() + 4 - m_readBuffer.remaining();
 
-  if (need + 5 > m_readBuffer.reserved_left()) {
+  if (need + 5 > static_cast<int32_t>(m_readBuffer.reserved_left())) {
     m_readBuffer.move_unused();
 
-    if (need + 5 > m_readBuffer.reserved_left())
+    if (need + 5 > static_cast<int32_t>(m_readBuffer.reserved_left()))
       throw handshake_error(ConnectionManager::handshake_failed, e_handshake_invalid_value);
   }
 
@@ -798,6 +872,27 @@ restart:
 
         m_state = READ_BITFIELD;
 
+      } else if (m_readBuffer.peek_8_at(4) == protocol_have_all || m_readBuffer.peek_8_at(4) == protocol_have_none) {
+        // Fast extension replacements for the bitfield, handled as a
+        // bitfield that has been read completely.
+        const Bitfield* bitfield = m_download->file_list()->bitfield();
+
+        if (!m_peerInfo->supports_fast() || !m_bitfield.empty() || m_readBuffer.read_32() != 1)
+          throw handshake_error(ConnectionManager::handshake_failed, e_handshake_invalid_value);
+
+        bool have_all = m_readBuffer.read_8() == protocol_have_all;
+
+        m_bitfield.set_size_bits(bitfield->size_bits());
+        m_bitfield.allocate();
+
+        if (have_all)
+          m_bitfield.set_all();
+        else
+          m_bitfield.unset_all();
+
+        m_readPos = m_bitfield.size_bytes();
+        m_state = READ_BITFIELD;
+
       } else if (m_readBuffer.peek_8_at(4) == protocol_extension && m_extensions->is_initial_handshake()) {
         m_readPos = 0;
         m_state = READ_EXT;
@@ -856,20 +951,29 @@ restart:
 
 bool
 Handshake::fill_read_buffer(int size) {
-  LT_LOG_EXTRA_DEBUG_SA(m_address, "fill_read_buffer : size:%i remaining:%" PRIu16 " reserved_left:%" PRIu16,
+  LT_LOG_EXTRA_DEBUG_SA(m_address, "fill_read_buffer : size:%i remaining:%" PRIu32 " reserved_left:%" PRIu32,
                         size, m_readBuffer.remaining(), m_readBuffer.reserved_left())
 
-  if (m_readBuffer.remaining() < size) {
-    if (size - m_readBuffer.remaining() > m_readBuffer.reserved_left())
+  int remaining = m_readBuffer.remaining();
+
+  if (remaining < size) {
+    if (size - remaining > static_cast<int>(m_readBuffer.reserved_left()))
       throw internal_error("Handshake::fill_read_buffer(...) Buffer overflow.");
 
-    int read = m_readBuffer.move_end(read_unthrottled(m_readBuffer.end(), size - m_readBuffer.remaining()));
+    // During the encryption negotiation the bytes past 'size' may be
+    // under a different cipher, so only read ahead after it.
+    int target = size;
+
+    if (m_state >= READ_INFO)
+      target = std::max(size, std::min<int>(read_ahead_size, remaining + m_readBuffer.reserved_left()));
+
+    int read = m_readBuffer.move_end(read_unthrottled(m_readBuffer.end(), target - remaining));
 
     if (m_encryption.info()->decrypt_valid())
       m_encryption.info()->decrypt(m_readBuffer.end() - read, read);
   }
 
-  return m_readBuffer.remaining() >= size;
+  return static_cast<int>(m_readBuffer.remaining()) >= size;
 }
 
 inline void
@@ -880,6 +984,8 @@ Handshake::validate_download() {
     throw handshake_error(ConnectionManager::handshake_dropped, e_handshake_inactive_download);
   if (!m_download->info()->is_accepting_new_peers())
     throw handshake_error(ConnectionManager::handshake_dropped, e_handshake_not_accepting_connections);
+
+  m_download->wake();
 }
 
 void
@@ -969,7 +1075,7 @@ Handshake::prepare_proxy_connect() {
   int advance = snprintf(reinterpret_cast<char*>(m_writeBuffer.position()), m_writeBuffer.reserved_left(),
                          "CONNECT %s:%hu HTTP/1.0\r\n\r\n", sap_addr_str(m_address).c_str(), sap_port(m_address));
 
-  if (advance == -1 || advance > m_writeBuffer.reserved_left())
+  if (advance == -1 || advance > static_cast<int>(m_writeBuffer.reserved_left()))
     throw internal_error("Handshake::prepare_proxy_connect() snprintf failed.");
 
   m_writeBuffer.move_end(advance);
@@ -1033,6 +1139,7 @@ Handshake::prepare_handshake() {
 
   std::memset(m_writeBuffer.end(), 0, 8);
   *(m_writeBuffer.end()+5) |= 0x10;    // support extension protocol
+  *(m_writeBuffer.end()+7) |= 0x04;    // support fast extension
   if (manager->dht_controller()->is_active())
     *(m_writeBuffer.end()+7) |= 0x01;  // DHT support, enable PORT message
   m_writeBuffer.move_end(8);
@@ -1080,7 +1187,9 @@ Handshake::prepare_peer_info() {
 
 void
 Handshake::prepare_bitfield() {
-  m_writeBuffer.write_32(m_download->file_list()->bitfield()->size_bytes() + 1);
+  m_bitfield_snapshot = m_download->bitfield_snapshot();
+
+  m_writeBuffer.write_32(m_bitfield_snapshot.length() + 1);
   m_writeBuffer.write_8(protocol_bitfield);
 
   if (m_encryption.info()->is_encrypted())
@@ -1165,9 +1274,25 @@ Handshake::write_bitfield() {
   if (m_writeDone != false)
     throw internal_error("Handshake::event_write() m_writeDone != false.");
 
-  if (m_writeBuffer.remaining())
+  // Plaintext bitfields are sent straight from the shared snapshot,
+  // together with what is left of the handshake in a single writev.
+  if (m_writePos != bitfield->size_bytes() && !m_encryption.info()->is_encrypted()) {
+    iovec vec[2] = {
+      { m_writeBuffer.position(), static_cast<size_t>(m_writeBuffer.remaining()) },
+      { m_bitfield_snapshot.data() + m_writePos, bitfield->size_bytes() - m_writePos }
+    };
+
+    int      first   = m_writeBuffer.remaining() != 0 ? 0 : 1;
+    uint32_t written = m_uploadThrottle->node_used_unthrottled(write_vector_throws(vec + first, 2 - first));
+    uint32_t header  = std::min<uint32_t>(written, m_writeBuffer.remaining());
+
+    m_writeBuffer.consume(header);
+    m_writePos += written - header;
+
+  } else if (m_writeBuffer.remaining()) {
     if (!m_writeBuffer.consume(write_unthrottled(m_writeBuffer.position(), m_writeBuffer.remaining())))
       return;
+  }
 
   if (m_writePos != bitfield->size_bytes()) {
     if (m_encryption.info()->is_encrypted()) {
@@ -1177,7 +1302,7 @@ Handshake::write_bitfield() {
       uint32_t length = std::min<uint32_t>(bitfield->size_bytes() - m_writePos, m_writeBuffer.reserved()) - m_writeBuffer.size_end();
 
       if (length > 0) {
-        std::memcpy(m_writeBuffer.end(), bitfield->begin() + m_writePos + m_writeBuffer.size_end(), length);
+        std::memcpy(m_writeBuffer.end(), m_bitfield_snapshot.data() + m_writePos + m_writeBuffer.size_end(), length);
         m_encryption.info()->encrypt(m_writeBuffer.end(), length);
         m_writeBuffer.move_end(length);
       }
@@ -1189,10 +1314,6 @@ Handshake::write_bitfield() {
         std::memmove(m_writeBuffer.begin(), m_writeBuffer.begin() + length, m_writeBuffer.size_end() - length);
 
       m_writeBuffer.move_end(-length);
-
-    } else {
-      m_writePos += write_unthrottled(bitfield->begin() + m_writePos,
-                                      bitfield->size_bytes() - m_writePos);
     }
   }
 
@@ -1201,6 +1322,8 @@ Handshake::write_bitfield() {
   // data until reading is done. Since we're done writing, remove us from the
   // poll in that case.
   if (m_writePos == bitfield->size_bytes()) {
+    m_bitfield_snapshot.clear();
+
     if (!m_readDone)
       thread_self()->poll()->remove_write(this);
     else
@@ -1,6 +1,7 @@
 #ifndef LIBTORRENT_HANDSHAKE_H
 #define LIBTORRENT_HANDSHAKE_H
 
+#include "net/data_buffer.h"
 #include "net/protocol_buffer.h"
 #include "net/socket_stream.h"
 #include "torrent/bitfield.h"
@@ -26,16 +27,30 @@ public:
 
   static constexpr uint32_t protocol_bitfield  = 5;
   static constexpr uint32_t protocol_port      = 9;
+  static constexpr uint32_t protocol_have_all  = 14;
+  static constexpr uint32_t protocol_have_none = 15;
   static constexpr uint32_t protocol_extension = 20;
 
   static constexpr uint32_t enc_negotiation_size = 8 + 4 + 2;
   static constexpr uint32_t enc_pad_size         = 512;
   static constexpr uint32_t enc_pad_read_size    = 96 + enc_pad_size + 20;
 
+  // Once the encryption is settled, reads take whatever has arrived up
+  // to this much, so the handshake, bitfield and extension messages
+  // sent together are read with one call. Anything left over is handed
+  // to the peer connection and must fit its read buffer.
+  static constexpr uint32_t read_ahead_size = 512;
+
   static constexpr uint32_t buffer_size = enc_pad_read_size + 20 + enc_negotiation_size + enc_pad_size + 2 + handshake_size + read_message_size;
 
   using Buffer = ProtocolBuffer<buffer_size>;
 
+  // Checks data peeked from an incoming connection before a handshake
+  // is created for it, returning the e_handshake_* error it would fail
+  // with or 0. The info hash is set once the plaintext header up to it
+  // has arrived.
+  static int          check_incoming(const char* buffer, uint32_t length, int encryption_options, const char** hash);
+
   enum State {
     INACTIVE,
     CONNECTING,
@@ -81,6 +96,7 @@ public:
   const sockaddr*     socket_address() const        { return m_address.get(); }
 
   DownloadMain*       download()                    { return m_download; }
+  void                set_download(DownloadMain* d);
   Bitfield*           bitfield()                    { return &m_bitfield; }
 
   void                deactivate_connection();
@@ -92,6 +108,11 @@ public:
 
   std::chrono::microseconds initialized_time() const { return m_initialized_time; }
 
+  // When the handshake times out, zero if not queued. Managed by
+  // HandshakeManager.
+  std::chrono::microseconds timeout() const         { return m_timeout; }
+  void                set_timeout(std::chrono::microseconds t) { m_timeout = t; }
+
   void                event_read() override;
   void                event_write() override;
   void                event_error() override;
@@ -110,6 +131,7 @@ protected:
   // Check what is unnessesary.
   bool                read_proxy_connect();
   bool                read_encryption_key();
+  void                receive_secret(bool result);
   bool                read_encryption_sync();
   bool                read_encryption_skey();
   bool                read_encryption_negotiation();
@@ -146,10 +168,13 @@ protected:
   DownloadMain*       m_download{};
   Bitfield            m_bitfield;
 
+  // The bitfield being written, see DownloadMain::bitfield_snapshot.
+  DataBuffer          m_bitfield_snapshot;
+
   ThrottleList*       m_uploadThrottle;
   ThrottleList*       m_downloadThrottle;
 
-  utils::SchedulerEntry     m_task_timeout;
+  std::chrono::microseconds m_timeout{};
   std::chrono::microseconds m_initialized_time;
 
   uint32_t            m_readPos;
@@ -40,7 +40,10 @@
 
 #include <algorithm>
 #include <functional>
+#include <string>
 
+#include "thread_main.h"
+#include "data/thread_disk.h"
 #include "torrent/connection_manager.h"
 #include "torrent/exceptions.h"
 #include "utils/diffie_hellman.h"
@@ -69,19 +72,92 @@ HandshakeEncryption::should_retry() const {
   return (m_options & ConnectionManager::encryption_enable_retry) != 0 && m_retry != HandshakeEncryption::RETRY_NONE;
 }
 
+static DiffieHellmanPool&
+key_pool() {
+  static DiffieHellmanPool pool(HandshakeEncryption::dh_prime, HandshakeEncryption::dh_prime_length,
+                                HandshakeEncryption::dh_generator, HandshakeEncryption::dh_generator_length,
+                                HandshakeEncryption::key_pool_size);
+  return pool;
+}
+
+static ThreadDisk*
+active_thread_disk() {
+  auto thread = thread_disk();
+
+  return thread != nullptr && thread->is_active() ? thread : nullptr;
+}
+
+// Takes a pregenerated key and, if the pool runs low, refills it on
+// the disk thread. Without a running disk thread the pool stays empty
+// and keys are generated here as before.
 bool
 HandshakeEncryption::initialize() {
-  m_key = new DiffieHellman(dh_prime, dh_prime_length, dh_generator, dh_generator_length);
+  m_key = key_pool().pop().release();
+
+  auto thread = active_thread_disk();
+
+  if (thread != nullptr && key_pool().try_start_fill())
+    thread->callback(&key_pool(), [] { key_pool().fill(); });
 
   return m_key->is_valid();
 }
 
 void
 HandshakeEncryption::cleanup() {
+  cancel_compute_secret();
+
   delete m_key;
   m_key = NULL;
 }
 
+bool
+HandshakeEncryption::has_secret() const {
+  return m_key != NULL && m_key->size() > 0;
+}
+
+bool
+HandshakeEncryption::compute_secret(const unsigned char* pubkey, slot_secret_type slot) {
+  if (m_computing_secret)
+    throw internal_error("HandshakeEncryption::compute_secret(...) already computing.");
+
+  auto thread = active_thread_disk();
+
+  if (thread == nullptr) {
+    m_key->compute_secret(pubkey, dh_prime_length);
+    return false;
+  }
+
+  m_computing_secret = true;
+
+  auto key = m_key;
+  auto peer_key = std::string(reinterpret_cast<const char*>(pubkey), dh_prime_length);
+
+  thread->callback(this, [this, key, peer_key, slot]() {
+      bool result = key->compute_secret(reinterpret_cast<const unsigned char*>(peer_key.data()), peer_key.size());
+
+      thread_main()->callback(this, [this, result, slot]() {
+          m_computing_secret = false;
+          slot(result);
+        });
+    });
+
+  return true;
+}
+
+// The disk thread callback is cancelled, or waited for if already
+// running, before the reply it may have queued on the main thread.
+void
+HandshakeEncryption::cancel_compute_secret() {
+  if (!m_computing_secret)
+    return;
+
+  if (thread_disk() != nullptr)
+    thread_disk()->cancel_callback_and_wait(this);
+
+  thread_main()->cancel_callback(this);
+  m_computing_secret = false;
+}
+
 bool
 HandshakeEncryption::compare_vc(const void* buf) {
   return std::memcmp(buf, vc_data, vc_length) == 0;
@@ -38,6 +38,7 @@
 #define LIBTORRENT_PROTOCOL_HANDSHAKE_ENCRYPTION_H
 
 #include <cstring>
+#include <functional>
 
 #include "encryption_info.h"
 
@@ -65,6 +66,10 @@ public:
   static const unsigned char vc_data[];
   static constexpr unsigned int  vc_length = 8;
 
+  static constexpr unsigned int  key_pool_size = 32;
+
+  using slot_secret_type = std::function<void (bool)>;
+
   HandshakeEncryption(int options) :
     m_options(options)
     {}
@@ -97,6 +102,16 @@ public:
   bool                initialize();
   void                cleanup();
 
+  bool                has_secret() const;
+  bool                is_computing_secret() const                  { return m_computing_secret; }
+
+  // Computes the shared secret from the peer's public key, on the disk
+  // thread when it is running. Returns true if the computation was
+  // deferred, in which case 'slot' is called from the main thread with
+  // the result. Otherwise the secret was computed before returning.
+  bool                compute_secret(const unsigned char* pubkey, slot_secret_type slot);
+  void                cancel_compute_secret();
+
   void                initialize_decrypt(const char* origHash, bool incoming);
   void                initialize_encrypt(const char* origHash, bool incoming);
 
@@ -123,6 +138,8 @@ private:
   unsigned int        m_syncLength{0};
 
   unsigned int        m_lengthIA{0};
+
+  bool                m_computing_secret{false};
 };
 
 }
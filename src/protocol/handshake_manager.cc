@@ -1,5 +1,6 @@
 #include "config.h"
 
+#include <string_view>
 #include <rak/socket_address.h>
 
 #include "torrent/exceptions.h"
@@ -7,12 +8,17 @@
 #include "download/download_main.h"
 #include "torrent/connection_manager.h"
 #include "torrent/download_info.h"
+#include "torrent/net/fd.h"
 #include "torrent/net/socket_address.h"
 #include "torrent/peer/peer_info.h"
 #include "torrent/peer/client_list.h"
 #include "torrent/peer/connection_list.h"
+#include "torrent/utils/chrono.h"
 #include "torrent/utils/log.h"
 
+#include "net/bind_list.h"
+#include "net/utp_manager.h"
+
 #include "peer_connection_base.h"
 #include "handshake.h"
 #include "handshake_manager.h"
@@ -29,11 +35,35 @@
 
 namespace torrent {
 
+static_assert(Handshake::read_ahead_size <= PeerConnectionBase::ProtocolRead::buffer_size,
+              "Handshake::read_ahead_size larger than the peer connection read buffer.");
+
 ProtocolExtension HandshakeManager::DefaultExtensions = ProtocolExtension::make_default();
 
+HandshakeManager::HandshakeManager() {
+  m_task_timeout.slot() = [this] { receive_timeouts(); };
+}
+
+HandshakeManager::~HandshakeManager() {
+  clear();
+
+  if (m_task_timeout.is_scheduled())
+    this_thread::scheduler()->erase(&m_task_timeout);
+}
+
+size_t
+HandshakeManager::address_hash::operator () (const rak::socket_address& sa) const {
+  if (sa.family() == rak::socket_address::af_inet6)
+    return std::hash<std::string_view>()(std::string_view(reinterpret_cast<const char*>(sa.sa_inet6()->address_ptr()), sizeof(in6_addr))) ^ sa.port();
+
+  return (size_t(sa.sa_inet()->address_n()) << 16) ^ sa.port();
+}
+
 HandshakeManager::size_type
 HandshakeManager::size_info(DownloadMain* info) const {
-  return std::count_if(base_type::begin(), base_type::end(), [info](Handshake* h) { return info == h->download(); });
+  auto itr = m_download_index.find(info);
+
+  return itr != m_download_index.end() ? itr->second.size() : 0;
 }
 
 void
@@ -45,44 +75,139 @@ HandshakeManager::clear() {
     delete h;
   };
   base_type::clear();
+
+  m_address_index.clear();
+  m_download_index.clear();
 }
 
 void
-HandshakeManager::erase(Handshake* handshake) {
-  auto itr = std::find(base_type::begin(), base_type::end(), handshake);
+HandshakeManager::insert(Handshake* handshake) {
+  base_type::insert(handshake);
+
+  m_address_index.emplace(*rak::socket_address::cast_from(handshake->socket_address()), handshake);
 
-  if (itr == base_type::end())
+  if (handshake->download() != NULL)
+    m_download_index[handshake->download()].insert(handshake);
+}
+
+void
+HandshakeManager::erase(Handshake* handshake) {
+  if (base_type::erase(handshake) == 0)
     throw internal_error("HandshakeManager::erase(...) could not find handshake.");
 
-  base_type::erase(itr);
+  auto range = m_address_index.equal_range(*rak::socket_address::cast_from(handshake->socket_address()));
+  auto address_itr = std::find_if(range.first, range.second, [handshake](auto& v) { return v.second == handshake; });
+
+  if (address_itr == range.second)
+    throw internal_error("HandshakeManager::erase(...) could not find handshake in the address index.");
+
+  m_address_index.erase(address_itr);
+
+  auto download_itr = m_download_index.find(handshake->download());
+
+  if (download_itr != m_download_index.end() && download_itr->second.erase(handshake) != 0 && download_itr->second.empty())
+    m_download_index.erase(download_itr);
 }
 
 bool
 HandshakeManager::find(const rak::socket_address& sa) {
-  return std::any_of(base_type::begin(), base_type::end(), [&sa](auto p2) {
-    return p2->peer_info() && sa == *rak::socket_address::cast_from(p2->peer_info()->socket_address());
-  });
+  return m_address_index.find(sa) != m_address_index.end();
 }
 
 void
 HandshakeManager::erase_download(DownloadMain* info) {
-  auto split = std::partition(base_type::begin(), base_type::end(), [info](Handshake* h) {
-    return info != h->download();
-  });
+  auto download_itr = m_download_index.find(info);
+
+  if (download_itr == m_download_index.end())
+    return;
+
+  auto handshakes = std::move(download_itr->second);
+  m_download_index.erase(download_itr);
+
+  for (auto h : handshakes) {
+    erase(h);
 
-  std::for_each(split, base_type::end(), [](auto h) {
     h->deactivate_connection();
     h->destroy_connection();
 
     delete h;
-  });
-  base_type::erase(split, base_type::end());
+  }
+}
+
+void
+HandshakeManager::index_download(Handshake* h, DownloadMain* download) {
+  if (h->download() == download)
+    return;
+
+  auto download_itr = m_download_index.find(h->download());
+
+  if (download_itr != m_download_index.end() && download_itr->second.erase(h) != 0 && download_itr->second.empty())
+    m_download_index.erase(download_itr);
+
+  if (download != NULL)
+    m_download_index[download].insert(h);
+}
+
+void
+HandshakeManager::set_timeout(Handshake* h, std::chrono::microseconds timeout) {
+  if (h->timeout() != std::chrono::microseconds())
+    m_timeouts.erase(std::make_pair(h->timeout(), h));
+
+  h->set_timeout(utils::ceil_seconds(this_thread::cached_time() + timeout));
+  m_timeouts.emplace(h->timeout(), h);
+
+  update_timeout_task();
+}
+
+void
+HandshakeManager::erase_timeout(Handshake* h) {
+  if (h->timeout() == std::chrono::microseconds())
+    return;
+
+  m_timeouts.erase(std::make_pair(h->timeout(), h));
+  h->set_timeout(std::chrono::microseconds());
+
+  update_timeout_task();
+}
+
+void
+HandshakeManager::update_timeout_task() {
+  if (m_timeouts.empty()) {
+    if (m_task_timeout.is_scheduled())
+      this_thread::scheduler()->erase(&m_task_timeout);
+
+    return;
+  }
+
+  auto next = m_timeouts.begin()->first;
+
+  if (!m_task_timeout.is_scheduled() || m_task_timeout.time() != next)
+    this_thread::scheduler()->update_wait_until(&m_task_timeout, next);
+}
+
+// Failing a handshake erases its timeout, retries get new ones at the
+// back of the queue.
+void
+HandshakeManager::receive_timeouts() {
+  auto now = this_thread::cached_time();
+
+  while (!m_timeouts.empty() && m_timeouts.begin()->first <= now) {
+    Handshake* h = m_timeouts.begin()->second;
+
+    receive_timeout(h);
+
+    if (!m_timeouts.empty() && m_timeouts.begin()->second == h)
+      throw internal_error("HandshakeManager::receive_timeouts() handshake timeout not erased.");
+  }
+
+  update_timeout_task();
 }
 
 void
 HandshakeManager::add_incoming(SocketFd fd, const rak::socket_address& sa) {
   if (!manager->connection_manager()->can_connect() ||
       !manager->connection_manager()->filter(sa.c_sockaddr()) ||
+      !check_incoming(fd, sa) ||
       !setup_socket(fd)) {
     fd.close();
     return;
@@ -90,12 +215,34 @@ HandshakeManager::add_incoming(SocketFd fd, const rak::socket_address& sa) {
 
   LT_LOG_SA(&sa, "accepted incoming connection: fd:%i", fd.get_fd());
 
+  create_incoming(fd, sa);
+}
+
+// The socket options of setup_socket do not apply to the local socket
+// bridging the connection.
+void
+HandshakeManager::add_incoming_utp(SocketFd fd, const rak::socket_address& sa) {
+  if (!manager->connection_manager()->can_connect() ||
+      !manager->connection_manager()->filter(sa.c_sockaddr()) ||
+      !check_incoming(fd, sa) ||
+      !fd.set_nonblock()) {
+    fd.close();
+    return;
+  }
+
+  LT_LOG_SA(&sa, "accepted incoming utp connection: fd:%i", fd.get_fd());
+
+  create_incoming(fd, sa);
+}
+
+void
+HandshakeManager::create_incoming(SocketFd fd, const rak::socket_address& sa) {
   manager->connection_manager()->inc_socket_count();
 
   auto h = new Handshake(fd, this, manager->connection_manager()->encryption_options());
   h->initialize_incoming(sa.c_sockaddr());
 
-  base_type::push_back(h);
+  insert(h);
 }
 
 void
@@ -119,19 +266,42 @@ HandshakeManager::create_outgoing(const rak::socket_address& sa, DownloadMain* d
   if (peerInfo == NULL || peerInfo->failed_counter() > max_failed)
     return;
 
+  // Start encrypted with peers whose last connection was, rather than
+  // only after a failed plaintext handshake.
+  if (peerInfo->is_encrypted() &&
+      (encryption_options & ConnectionManager::encryption_enable_retry) &&
+      !(encryption_options & ConnectionManager::encryption_retrying))
+    encryption_options |= ConnectionManager::encryption_try_outgoing;
+
+  download->wake();
+
   SocketFd fd;
+  encryption_options &= ~ConnectionManager::encryption_use_utp;
+
   const rak::socket_address* bindAddress = rak::socket_address::cast_from(manager->connection_manager()->bind_address());
+
+  if (auto bind_entry = manager->connection_manager()->bind_list()->select())
+    bindAddress = &bind_entry->address;
+
   const rak::socket_address* connectAddress = &sa;
 
   if (rak::socket_address::cast_from(manager->connection_manager()->proxy_address())->is_valid()) {
     connectAddress = rak::socket_address::cast_from(manager->connection_manager()->proxy_address());
     encryption_options |= ConnectionManager::encryption_use_proxy;
+
+  } else if ((manager->connection_manager()->utp_options() & ConnectionManager::utp_outgoing) &&
+             !(encryption_options & ConnectionManager::encryption_retrying) &&
+             (fd = manager->utp_manager()->connect(sa)).is_valid()) {
+    encryption_options |= ConnectionManager::encryption_use_utp;
   }
 
-  if (!fd.open_stream() ||
-      !setup_socket(fd) ||
-      (bindAddress->is_bindable() && !fd.bind(*bindAddress)) ||
-      !fd.connect(*connectAddress)) {
+  if (encryption_options & ConnectionManager::encryption_use_utp) {
+    // Connected through the bridge.
+
+  } else if (!fd.open_stream() ||
+             !setup_socket(fd) ||
+             (bindAddress->is_bindable() && !fd.bind(*bindAddress)) ||
+             !fd.connect(*connectAddress)) {
 
     if (fd.is_valid())
       fd.close();
@@ -155,7 +325,7 @@ HandshakeManager::create_outgoing(const rak::socket_address& sa, DownloadMain* d
   auto handshake = new Handshake(fd, this, encryption_options);
   handshake->initialize_outgoing(sa.c_sockaddr(), download, peerInfo);
 
-  base_type::push_back(handshake);
+  insert(handshake);
 }
 
 void
@@ -229,7 +399,25 @@ HandshakeManager::receive_failed(Handshake* handshake, int message, int error) {
 
   LT_LOG_SAP(sa, "Received error: message:%x %s.", message, strerror(error));
 
-  if (handshake->encryption()->should_retry()) {
+  // A uTP connection closed before the peer sent anything most likely
+  // never reached a peer that speaks uTP.
+  bool utp_failed =
+    (handshake->encryption()->options() & ConnectionManager::encryption_use_utp) &&
+    error == e_handshake_network_read_error &&
+    (handshake->state() == Handshake::READ_ENC_KEY || handshake->state() == Handshake::READ_INFO);
+
+  if (utp_failed) {
+    int retry_options = (handshake->encryption()->options() & ~ConnectionManager::encryption_use_utp) | ConnectionManager::encryption_retrying;
+    DownloadMain* download = handshake->download();
+
+    LT_LOG_SAP(sa, "Retrying over tcp.", 0);
+
+    rak::socket_address sa_copy;
+    sa_copy.copy_sockaddr(sa.get());
+
+    create_outgoing(sa_copy, download, retry_options);
+
+  } else if (handshake->encryption()->should_retry()) {
     int retry_options = handshake->retry_options() | ConnectionManager::encryption_retrying;
     DownloadMain* download = handshake->download();
 
@@ -253,6 +441,42 @@ HandshakeManager::receive_timeout(Handshake* h) {
                  e_handshake_network_timeout);
 }
 
+// Looks at whatever the peer has sent so far, dropping connections
+// that would fail the handshake before allocating one. Peers always
+// send first on incoming connections, so with deferred accept an empty
+// socket is an idle connection that outlived the defer timeout.
+bool
+HandshakeManager::check_incoming(SocketFd fd, const rak::socket_address& sa) {
+  char buffer[Handshake::part1_size];
+  int length = fd.peek(buffer, sizeof(buffer));
+
+  if (length == 0) {
+    LT_LOG_SA(&sa, "dropped incoming connection: fd:%i reason:'closed before handshake'", fd.get_fd());
+    return false;
+  }
+
+  if (length < 0) {
+    if (manager->connection_manager()->listen_defer_accept() == 0)
+      return true;
+
+    LT_LOG_SA(&sa, "dropped incoming connection: fd:%i reason:'no data after deferred accept'", fd.get_fd());
+    return false;
+  }
+
+  const char* hash;
+  int error = Handshake::check_incoming(buffer, length, manager->connection_manager()->encryption_options(), &hash);
+
+  if (error == 0 && hash != NULL && download_info(hash) == NULL)
+    error = e_handshake_unknown_download;
+
+  if (error != 0) {
+    LT_LOG_SA(&sa, "dropped incoming connection: fd:%i reason:'%s'", fd.get_fd(), strerror(error));
+    return false;
+  }
+
+  return true;
+}
+
 bool
 HandshakeManager::setup_socket(SocketFd fd) {
   if (!fd.set_nonblock())
@@ -269,6 +493,17 @@ HandshakeManager::setup_socket(SocketFd fd) {
   if (m->receive_buffer_size() != 0 && !fd.set_receive_buffer_size(m->receive_buffer_size()))
     return false;
 
+  // The remaining options are best effort, the fd functions log
+  // failures such as unsupported options or unknown algorithms.
+  if (m->notsent_lowat() != 0)
+    fd_set_tcp_notsent_lowat(fd.get_fd(), m->notsent_lowat());
+
+  if (!m->congestion().empty())
+    fd_set_tcp_congestion(fd.get_fd(), m->congestion());
+
+  if (m->busy_poll() != 0)
+    fd_set_busy_poll(fd.get_fd(), m->busy_poll());
+
   return true;
 }
 
@@ -1,12 +1,16 @@
 #ifndef LIBTORRENT_NET_HANDSHAKE_MANAGER_H
 #define LIBTORRENT_NET_HANDSHAKE_MANAGER_H
 
+#include <chrono>
 #include <functional>
 #include <inttypes.h>
+#include <set>
 #include <string>
-#include <rak/unordered_vector.h>
+#include <unordered_map>
+#include <unordered_set>
 #include <rak/socket_address.h>
 #include <torrent/connection_manager.h>
+#include <torrent/utils/scheduler.h>
 
 #include "net/socket_fd.h"
 
@@ -17,9 +21,14 @@ class DownloadManager;
 class DownloadMain;
 class PeerConnectionBase;
 
-class HandshakeManager : private rak::unordered_vector<Handshake*> {
+// The pending handshakes are indexed by the address of their
+// connection and by download, and their timeouts are kept in one
+// sorted queue served by a single scheduler entry. Incoming handshakes
+// join the download index once the info hash has been read.
+
+class HandshakeManager : private std::unordered_set<Handshake*> {
 public:
-  using base_type = rak::unordered_vector<Handshake*>;
+  using base_type = std::unordered_set<Handshake*>;
   using size_type = uint32_t;
 
   using slot_download = std::function<DownloadMain*(const char*)>;
@@ -29,20 +38,22 @@ public:
 
   using base_type::empty;
 
-  HandshakeManager() = default;
-  ~HandshakeManager() { clear(); }
+  HandshakeManager();
+  ~HandshakeManager();
 
   size_type           size() const { return base_type::size(); }
   size_type           size_info(DownloadMain* info) const;
 
   void                clear();
 
+  // Is there a handshake connected to 'sa'.
   bool                find(const rak::socket_address& sa);
 
   void                erase_download(DownloadMain* info);
 
   // Cleanup.
   void                add_incoming(SocketFd fd, const rak::socket_address& sa);
+  void                add_incoming_utp(SocketFd fd, const rak::socket_address& sa);
   void                add_outgoing(const rak::socket_address& sa, DownloadMain* info);
 
   slot_download&      slot_download_id()         { return m_slot_download_id; }
@@ -58,19 +69,48 @@ public:
 
   ProtocolExtension*  default_extensions() const                        { return &DefaultExtensions; }
 
+  // For internal usage by Handshake.
+  //
+  // The timeout is rounded up to whole seconds so handshakes started
+  // within the same second time out together.
+  void                set_timeout(Handshake* h, std::chrono::microseconds timeout);
+  void                erase_timeout(Handshake* h);
+
+  void                index_download(Handshake* h, DownloadMain* download);
+
 private:
   HandshakeManager(const HandshakeManager&) = delete;
   HandshakeManager& operator=(const HandshakeManager&) = delete;
 
+  void                create_incoming(SocketFd fd, const rak::socket_address& sa);
   void                create_outgoing(const rak::socket_address& sa, DownloadMain* info, int encryptionOptions);
+  void                insert(Handshake* handshake);
   void                erase(Handshake* handshake);
 
   bool                setup_socket(SocketFd fd);
+  bool                check_incoming(SocketFd fd, const rak::socket_address& sa);
+
+  void                receive_timeouts();
+  void                update_timeout_task();
+
+  struct address_hash {
+    size_t operator () (const rak::socket_address& sa) const;
+  };
+
+  using address_index  = std::unordered_multimap<rak::socket_address, Handshake*, address_hash>;
+  using download_index = std::unordered_map<DownloadMain*, std::unordered_set<Handshake*>>;
+  using timeout_queue  = std::set<std::pair<std::chrono::microseconds, Handshake*>>;
 
   static ProtocolExtension DefaultExtensions;
 
   slot_download       m_slot_download_id;
   slot_download       m_slot_download_obfuscated;
+
+  address_index       m_address_index;
+  download_index      m_download_index;
+
+  timeout_queue       m_timeouts;
+  utils::SchedulerEntry m_task_timeout;
 };
 
 }
@@ -40,6 +40,9 @@
 
 #include "torrent/download/choke_group.h"
 #include "torrent/download/choke_queue.h"
+#include "torrent/utils/chrono.h"
+#include "torrent/utils/log.h"
+#include "torrent/utils/thread.h"
 #include "download/chunk_statistics.h"
 
 #include "initial_seed.h"
@@ -54,7 +57,8 @@ PeerInfo* const InitialSeeding::chunk_done    = (PeerInfo*) 2;
 InitialSeeding::InitialSeeding(DownloadMain* download) :
     m_chunksLeft(download->file_list()->size_chunks()),
     m_download(download),
-    m_peerChunks(std::make_unique<PeerInfo*[]>(m_chunksLeft)) {
+    m_peerChunks(std::make_unique<PeerInfo*[]>(m_chunksLeft)),
+    m_startTime(this_thread::cached_time()) {
 }
 
 InitialSeeding::~InitialSeeding() {
@@ -66,6 +70,23 @@ InitialSeeding::valid_peer(PeerInfo* peer) {
   return peer > chunk_done;
 }
 
+uint32_t
+InitialSeeding::propagated(PeerInfo* peer) const {
+  auto itr = m_propagated.find(peer);
+
+  return itr != m_propagated.end() ? itr->second : 0;
+}
+
+// Compared to the average of peers that have passed on anything, so
+// everyone is fast until the first chunk has propagated.
+bool
+InitialSeeding::is_fast(PeerInfo* peer) const {
+  if (m_propagated.empty())
+    return true;
+
+  return static_cast<uint64_t>(propagated(peer)) * m_propagated.size() >= m_propagatedTotal;
+}
+
 void
 InitialSeeding::clear_peer(PeerInfo* peer) {
   if (!valid_peer(peer))
@@ -80,6 +101,8 @@ InitialSeeding::clear_peer(PeerInfo* peer) {
 
 void
 InitialSeeding::chunk_seen(uint32_t index, PeerConnectionBase* pcb) {
+  update_copies();
+
   // When we have two other seeds, trust that the download will
   // be sufficiently seeded and switch to normal seeding. This is
   // mainly for when the user accidentally enables initial seeding.
@@ -101,8 +124,15 @@ InitialSeeding::chunk_seen(uint32_t index, PeerConnectionBase* pcb) {
   if (old == peer || old == chunk_done)
     return;
 
-  // We've seen two peers on the swarm receive this chunk.
+  // We've seen two peers on the swarm receive this chunk, so the peer
+  // we sent it to passed it on.
   m_peerChunks[index] = chunk_done;
+
+  if (valid_peer(old)) {
+    m_propagated[old]++;
+    m_propagatedTotal++;
+  }
+
   if (--m_chunksLeft == 0)
     complete(pcb);
 
@@ -126,27 +156,10 @@ InitialSeeding::new_peer(PeerConnectionBase* pcb) {
   // We don't go through the peer's entire bitfield here. This eliminates
   // cheating by sending a bogus bitfield if it figures out we are initial
   // seeding, to drop us out of it. We should see HAVE messages for pieces
-  // it has that we were waiting for anyway. We will check individual chunks
-  // as we are about to offer them, to avoid the overhead of checking each
-  // peer's bitfield as well. If it really was cheating, the pieces it isn't
-  // sharing will be sent during the second round of initial seeding.
-
-  // If we're on the second round, don't check
-  // it until we're about to offer a chunk.
-  if (m_peerChunks[m_nextChunk] != chunk_unsent)
-    return;
-
-  // But during primary initial seeding (some chunks not sent at all),
-  // check that nobody already has the next chunk we were going to send.
-  while (m_peerChunks[m_nextChunk] == chunk_unsent && (*m_download->chunk_statistics())[m_nextChunk]) {
-    // Could set to chunk_done if enough peers have it, but if that was the
-    // last one it could cause initial seeding to end and all connections to
-    // be closed, and now is a bad time for that (still being set up). Plus
-    // this gives us the opportunity to wait for HAVE messages and resend
-    // the chunk if it's not being shared.
-    m_peerChunks[m_nextChunk] = chunk_unknown;
-    find_next(false, pcb);
-  }
+  // it has that we were waiting for anyway. Chunks are checked against
+  // the chunk statistics and the bitfield of the peer as we are about to
+  // offer them. If it really was cheating, the pieces it isn't sharing
+  // will be sent during the second round of initial seeding.
 }
 
 uint32_t
@@ -178,43 +191,23 @@ InitialSeeding::chunk_offer(PeerConnectionBase* pcb, uint32_t chunkDone) {
     // else since the disconnection. So offer a new one.
   }
 
-  uint32_t index = m_nextChunk;
-  bool secondary = false;
-
-  // If we already sent this chunk to someone else, we're on the second
-  // (or more) round. We might have already found this chunk elsewhere on
-  // the swarm since then and need to find a different one if so.
-  if (m_peerChunks[index] != chunk_unsent) {
-    secondary = true;
+  uint32_t index = find_next(pcb, is_fast(peer));
 
-    // Accounting for peers whose bitfield we didn't check when connecting.
-    // If the chunk stats say there are enough peers who have it, believe that.
-    if (m_peerChunks[index] != chunk_done && (*m_download->chunk_statistics())[index] > 1)
-      chunk_complete(index, pcb);
-
-    if (m_peerChunks[index] == chunk_done)
-      index = find_next(true, pcb);
-  }
+  if (index == no_offer)
+    return no_offer;
 
   // When we only have one chunk left and we already offered it
   // to someone who hasn't shared it yet, offer it to everyone
   // else. We do not override the peer we sent it to, so they
   // cannot be unblocked, but when initial seeding completes
   // everyone is unblocked anyway.
-  if (m_chunksLeft == 1 && valid_peer(m_peerChunks[index])) {
+  if (valid_peer(m_peerChunks[index])) {
     peer->set_flags(PeerInfo::flag_blocked);
     return index;
   }
 
-  // Make sure we don't accidentally offer a chunk it has
-  // already, or it would never even request it from us.
-  // We'll just offer it to the next peer instead.
-  if (pcb->bitfield()->get(index))
-    return no_offer;
-
   m_peerChunks[index] = peer;
   peer->set_flags(PeerInfo::flag_blocked);
-  find_next(secondary, pcb);
   return index;
 }
 
@@ -223,42 +216,65 @@ InitialSeeding::should_upload(uint32_t index) {
   return m_peerChunks[index] != chunk_done;
 }
 
+// Chunks are searched in order of rarity, first those never sent that
+// no peer has, then any not yet done. Chunks the peer has or that are
+// being sent to another peer are skipped, the latter are only offered
+// when it is the last chunk left. Slow peers get the second candidate
+// to leave the rarest to fast ones.
 uint32_t
-InitialSeeding::find_next(bool secondary, PeerConnectionBase* pcb) {
-  if (!secondary) {
-    // Primary seeding: find next chunk not sent yet.
-    while (++m_nextChunk < m_download->file_list()->size_chunks()) {
-      if (m_peerChunks[m_nextChunk] == chunk_unsent) {
-        if (!(*m_download->chunk_statistics())[m_nextChunk])
-          return m_nextChunk;
-
-        // Someone has this one already. We don't know if we sent it or not.
-        m_peerChunks[m_nextChunk] = chunk_unknown;
+InitialSeeding::find_next(PeerConnectionBase* pcb, bool fast) {
+  ChunkStatistics* statistics = m_download->chunk_statistics();
+  const Bitfield*  bitfield   = pcb->bitfield();
+
+  uint32_t candidate = no_offer;
+  uint32_t inFlight  = no_offer;
+
+  for (int secondary = 0; secondary != 2; secondary++) {
+    uint32_t end = secondary ? statistics->size() : statistics->rarity_end(0);
+
+    for (uint32_t pos = 0; pos != end; pos++) {
+      uint32_t index = statistics->rarest_at(pos);
+
+      if (!secondary && m_peerChunks[index] != chunk_unsent)
+        continue;
+
+      if (m_peerChunks[index] == chunk_done)
+        continue;
+
+      // Accounting for peers whose bitfield we didn't check when connecting.
+      // If the chunk stats say there are enough peers who have it, believe that.
+      if ((*statistics)[index] > 1) {
+        chunk_complete(index, pcb);
+        continue;
       }
-    }
 
-    // Went through all chunks. Continue with secondary seeding.
-    m_nextChunk--;
-  }
+      if (bitfield->get(index))
+        continue;
+
+      if (valid_peer(m_peerChunks[index])) {
+        if (inFlight == no_offer)
+          inFlight = index;
+
+        continue;
+      }
 
-  // Secondary seeding: find next chunk that's not done yet.
-  do {
-    if (++m_nextChunk == m_download->file_list()->size_chunks())
-      m_nextChunk = 0;
+      if (fast || candidate != no_offer)
+        return index;
 
-    if (m_peerChunks[m_nextChunk] != chunk_done && (*m_download->chunk_statistics())[m_nextChunk] > 1)
-      chunk_complete(m_nextChunk, pcb);
+      candidate = index;
+    }
 
-  } while (m_peerChunks[m_nextChunk] == chunk_done);
+    if (candidate != no_offer)
+      return candidate;
+  }
 
-  return m_nextChunk;
+  return m_chunksLeft == 1 ? inFlight : no_offer;
 }
 
 void
 InitialSeeding::complete(PeerConnectionBase* pcb) {
   unblock_all();
   m_chunksLeft = 0;
-  m_nextChunk = no_offer;
 
   // We think all chunks should be well seeded now. Check to make sure.
   for (uint32_t i = 0; i < m_download->file_list()->size_chunks(); i++) {
@@ -266,8 +282,6 @@ InitialSeeding::complete(PeerConnectionBase* pcb) {
       // Chunk too rare, send it again before switching to normal seeding.
       m_chunksLeft++;
       m_peerChunks[i] = chunk_unsent;
-      if (m_nextChunk == no_offer)
-        m_nextChunk = i;
     }
   }
 
@@ -283,4 +297,17 @@ InitialSeeding::unblock_all() {
     peer.second->unset_flags(PeerInfo::flag_blocked);
 }
 
+void
+InitialSeeding::update_copies() {
+  auto copies = static_cast<uint32_t>(m_download->chunk_statistics()->distributed_copies());
+
+  if (copies <= m_copiesReported)
+    return;
+
+  m_copiesReported = copies;
+
+  lt_log_print_info(LOG_TORRENT_INFO, m_download->info(), "initial_seed", "Distributed copies: %" PRIu32 " after %" PRIi64 " seconds, %" PRIu32 " chunks left.",
+                    copies, static_cast<int64_t>(utils::cast_seconds(this_thread::cached_time() - m_startTime).count()), m_chunksLeft);
+}
+
 }
@@ -37,10 +37,19 @@
 #ifndef LIBTORRENT_PROTOCOL_INITIAL_SEED_H
 #define LIBTORRENT_PROTOCOL_INITIAL_SEED_H
 
+#include <chrono>
+#include <unordered_map>
+
 #include "download/download_main.h"
 
 namespace torrent {
 
+// Offers each peer the least propagated chunk it does not have, as
+// counted by the chunk statistics, and marks a chunk done once it has
+// been seen on two peers. Peers that pass on the chunks offered to
+// them are credited, and those with at least the average credit are
+// offered the rarest chunk while others get the next one.
+
 class InitialSeeding {
 public:
   InitialSeeding(DownloadMain* download);
@@ -60,6 +69,11 @@ public:
   // false if given chunk is already well-seeded now. True otherwise.
   bool                should_upload(uint32_t index);
 
+  uint32_t            chunks_left() const                 { return m_chunksLeft; }
+
+  // Number of chunks offered to the peer that it passed on to others.
+  uint32_t            propagated(PeerInfo* peer) const;
+
 private:
   InitialSeeding(const InitialSeeding&) = delete;
   InitialSeeding& operator=(const InitialSeeding&) = delete;
@@ -68,7 +82,8 @@ private:
   static PeerInfo* const chunk_unknown; // Peer has chunk, we don't know who we sent it to.
   static PeerInfo* const chunk_done;    // Chunk properly distributed by peer.
 
-  uint32_t            find_next(bool secondary, PeerConnectionBase* pcb);
+  uint32_t            find_next(PeerConnectionBase* pcb, bool fast);
+  bool                is_fast(PeerInfo* peer) const;
 
   bool                valid_peer(PeerInfo* peer);
   void                clear_peer(PeerInfo* peer);
@@ -77,12 +92,20 @@ private:
   void                complete(PeerConnectionBase* pcb);
   void                unblock_all();
 
-  uint32_t            m_nextChunk{0};
+  void                update_copies();
+
   uint32_t            m_chunksLeft;
   DownloadMain*       m_download;
   std::unique_ptr<PeerInfo*[]> m_peerChunks;
-};
 
+  // Peers are only used as keys, entries of peers removed from the
+  // peer list are never dereferenced.
+  std::unordered_map<PeerInfo*, uint32_t> m_propagated;
+  uint32_t            m_propagatedTotal{0};
+
+  std::chrono::microseconds m_startTime;
+  uint32_t            m_copiesReported{0};
+};
 }
 
 #endif
@@ -2,6 +2,7 @@
 #define LIBTORRENT_PROTOCOL_PEER_CHUNKS_H
 
 #include <list>
+#include <vector>
 #include <rak/partial_queue.h>
 #include <rak/timer.h>
 
@@ -17,6 +18,10 @@ class PeerInfo;
 class PeerChunks {
 public:
   using piece_list_type = std::list<Piece>;
+  using index_list_type = std::vector<uint32_t>;
+
+  // Most ALLOWED_FAST indices kept from a peer.
+  static constexpr size_t max_allowed_fast = 32;
 
   bool                is_seeder() const             { return m_bitfield.is_all_set(); }
 
@@ -35,6 +40,18 @@ public:
   piece_list_type*       upload_queue()             { return &m_uploadQueue; }
   const piece_list_type* upload_queue() const       { return &m_uploadQueue; }
   piece_list_type*       cancel_queue()             { return &m_cancelQueue; }
+  piece_list_type*       reject_queue()             { return &m_rejectQueue; }
+
+  // Chunks the peer lets us request while it chokes us, from its
+  // ALLOWED_FAST messages.
+  index_list_type*       allowed_fast()             { return &m_allowedFast; }
+  const index_list_type* allowed_fast() const       { return &m_allowedFast; }
+
+  // The chunk after the last one picked for this peer and the picks
+  // left in its run, see ChunkSelector::locality_window.
+  uint32_t            locality_next() const         { return m_localityNext; }
+  uint32_t            locality_left() const         { return m_localityLeft; }
+  void                set_locality(uint32_t next, uint32_t left) { m_localityNext = next; m_localityLeft = left; }
 
   // Timer used to figure out what HAVE_PIECE messages have not been
   // sent.
@@ -60,6 +77,11 @@ private:
 
   piece_list_type     m_uploadQueue;
   piece_list_type     m_cancelQueue;
+  piece_list_type     m_rejectQueue;
+  index_list_type     m_allowedFast;
+
+  uint32_t            m_localityNext{~uint32_t{0}};
+  uint32_t            m_localityLeft{0};
 
   rak::timer          m_haveTimer;
 
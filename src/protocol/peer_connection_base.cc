@@ -41,25 +41,35 @@
 #include <rak/error_number.h>
 #include <rak/string_manip.h>
 
+#include "data/chunk_cache.h"
 #include "data/chunk_iterator.h"
 #include "data/chunk_list.h"
+#include "data/chunk_preloader.h"
+#include "data/chunk_residency.h"
+#include "data/disk_throttle.h"
 #include "download/chunk_selector.h"
 #include "download/chunk_statistics.h"
 #include "download/download_main.h"
 #include "net/socket_base.h"
 #include "torrent/exceptions.h"
 #include "torrent/data/block.h"
+#include "torrent/data/block_list.h"
 #include "torrent/chunk_manager.h"
 #include "torrent/connection_manager.h"
+#include "torrent/data/file.h"
 #include "torrent/download_info.h"
+#include "torrent/net/fd.h"
 #include "torrent/throttle.h"
 #include "torrent/download/choke_group.h"
 #include "torrent/download/choke_queue.h"
+#include "torrent/memory_manager.h"
+#include "torrent/peer/peer_capture.h"
 #include "torrent/peer/peer_info.h"
 #include "torrent/peer/connection_list.h"
 #include "torrent/utils/log.h"
 #include "utils/instrumentation.h"
 
+#include "allowed_fast.h"
 #include "extensions.h"
 #include "peer_connection_base.h"
 
@@ -70,6 +80,10 @@
 
 namespace torrent {
 
+// Keep state the read and write paths don't use on every event in
+// cold_type, so this stays within a few cache lines.
+static_assert(sizeof(PeerConnectionBase) <= 24 * 64, "PeerConnectionBase hot part grew too large.");
+
 inline void
 log_mincore_stats_func(bool is_incore, bool new_index, bool& continous) {
   if (!new_index && is_incore) {
@@ -91,23 +105,36 @@ log_mincore_stats_func(bool is_incore, bool new_index, bool& continous) {
   continous = is_incore;
 }
 
+const size_t PeerConnectionBase::sizeof_connection =
+  sizeof(PeerConnectionBase) + sizeof(ProtocolRead) + sizeof(ProtocolWrite) + sizeof(cold_type);
+
 PeerConnectionBase::PeerConnectionBase() :
   m_down(new ProtocolRead()),
-  m_up(new ProtocolWrite()) {
+  m_up(new ProtocolWrite()),
+  m_cold(new cold_type) {
 
   m_peerInfo = nullptr;
+
+  MemoryManager::inc_usage(MemoryManager::category_connections, sizeof_connection);
 }
 
 PeerConnectionBase::~PeerConnectionBase() {
+  MemoryManager::dec_usage(MemoryManager::category_connections, sizeof_connection);
+
   delete m_up;
   delete m_down;
 
-  delete m_encryptBuffer;
+  // Data still queued is dropped with the connection.
+  if (m_encryptBuffer != nullptr)
+    m_encryptBuffer->reset();
+
+  encrypt_buffer_release();
 
   if (m_extensions != NULL && !m_extensions->is_default())
     delete m_extensions;
 
-  m_extensionMessage.clear();
+  m_cold->extension_message.clear();
+  m_cold->extension_payload.clear();
 }
 
 void
@@ -126,7 +153,8 @@ PeerConnectionBase::initialize(DownloadMain* download, PeerInfo* peerInfo, Socke
   m_peerInfo = peerInfo;
   m_download = download;
 
-  m_encryption = *encryptionInfo;
+  m_cold->encryption = *encryptionInfo;
+  m_encrypted = encryptionInfo->is_encrypted();
   m_extensions = extensions;
 
   m_extensions->set_connection(this);
@@ -136,19 +164,30 @@ PeerConnectionBase::initialize(DownloadMain* download, PeerInfo* peerInfo, Socke
 
   m_peerChunks.set_peer_info(m_peerInfo);
   m_peerChunks.bitfield()->swap(*bitfield);
+  m_peerChunks.bitfield()->share_uniform();
 
-  std::pair<ThrottleList*, ThrottleList*> throttles = m_download->throttles(m_peerInfo->socket_address());
+  std::pair<ThrottleList*, ThrottleList*> throttles = m_download->throttles(m_peerInfo->socket_address(), get_fd());
   m_up->set_throttle(throttles.first);
   m_down->set_throttle(throttles.second);
 
-  m_peerChunks.upload_throttle()->set_list_iterator(m_up->throttle()->end());
+  m_peerChunks.upload_throttle()->set_weight(m_download->throttle_weight());
   m_peerChunks.upload_throttle()->slot_activate() = [this] { receive_throttle_up_activate(); };
+  m_peerChunks.upload_throttle()->slot_pacing_rate() = [this](uint64_t rate) {
+      if (get_fd().is_valid())
+        fd_set_max_pacing_rate(get_fd().get_fd(), rate);
+    };
 
-  m_peerChunks.download_throttle()->set_list_iterator(m_down->throttle()->end());
+  m_peerChunks.download_throttle()->set_weight(m_download->throttle_weight());
   m_peerChunks.download_throttle()->slot_activate() = [this] { receive_throttle_down_activate(); };
 
   request_list()->set_delegator(m_download->delegator());
   request_list()->set_peer_chunks(&m_peerChunks);
+  request_list()->set_download_request_latency(m_download->request_latency());
+
+  // Initial seeding hands out chunks itself, so doesn't allow any.
+  if (m_peerInfo->supports_fast() && !m_download->info()->is_meta_download() && m_download->initial_seeding() == NULL)
+    m_cold->allowed_fast = allowed_fast_set(m_peerInfo->socket_address(), m_download->info()->hash(),
+                                            m_download->file_list()->size_chunks(), allowed_fast_size);
 
   try {
     initialize_custom();
@@ -163,13 +202,30 @@ PeerConnectionBase::initialize(DownloadMain* download, PeerInfo* peerInfo, Socke
     return;
   }
 
-  thread_main()->poll()->open(this);
+  // The read and write handlers loop until the socket would block or
+  // the throttle removes the interest, as required when edge-triggered.
+  if (manager->connection_manager()->is_edge_triggered())
+    thread_main()->poll()->open_edge_triggered(this);
+  else
+    thread_main()->poll()->open(this);
+
   thread_main()->poll()->insert_read(this);
   thread_main()->poll()->insert_write(this);
   thread_main()->poll()->insert_error(this);
 
   m_timeLastRead = cachedTime;
 
+  // Sample the rtt of the handshake, and learn our own address from
+  // outgoing connections for scoring connection candidates.
+  update_tcp_info();
+
+  if (!m_peerInfo->is_incoming()) {
+    rak::socket_address local_address;
+
+    if (get_fd().getsockname(&local_address))
+      manager->set_observed_address(local_address);
+  }
+
   m_download->chunk_statistics()->received_connect(&m_peerChunks);
 
   // Hmm... cleanup?
@@ -193,6 +249,7 @@ PeerConnectionBase::cleanup() {
 
   // TODO: Verify that transfer counter gets modified by this...
   m_request_list.clear();
+  m_capture.reset();
 
   up_chunk_release();
   down_chunk_release();
@@ -365,10 +422,8 @@ PeerConnectionBase::load_up_chunk() {
   if (!m_upChunk.is_valid())
     throw storage_error("File chunk read error: " + std::string(m_upChunk.error_number().c_str()));
 
-  if (is_encrypted() && m_encryptBuffer == NULL) {
-    m_encryptBuffer = new EncryptBuffer();
-    m_encryptBuffer->reset();
-  }
+  if (is_encrypted())
+    encrypt_buffer_acquire();
 
   m_incoreContinous = false;
 
@@ -377,16 +432,24 @@ PeerConnectionBase::load_up_chunk() {
 
   m_incoreContinous = true;
 
+  ChunkManager* cm = manager->chunk_manager();
+
+  if (m_download->chunk_preloader()->take(m_upPiece.index())) {
+    cm->inc_stats_preload_hits();
+    return;
+  }
+
   // Also check if we've already preloaded in the recent past, even
   // past unmaps.
-  ChunkManager* cm = manager->chunk_manager();
   uint32_t preloadSize = m_upChunk.chunk()->chunk_size() - m_upPiece.offset();
 
   if (cm->preload_type() == 0 ||
       m_upChunk.object()->time_preloaded() >= cachedTime - rak::timer::from_seconds(60) ||
+      m_download->chunk_residency()->is_resident(m_upPiece.index()) ||
 
       preloadSize < cm->preload_min_size() ||
-      m_peerChunks.upload_throttle()->rate()->rate() < cm->preload_required_rate() * ((preloadSize + (2 << 20) - 1) / (2 << 20))) {
+      m_peerChunks.upload_throttle()->rate()->rate() < cm->preload_required_rate() * ((preloadSize + (2 << 20) - 1) / (2 << 20)) ||
+      !cm->disk_throttle()->try_acquire(DiskThrottle::class_read, preloadSize, 1, DiskThrottle::current_time())) {
     cm->inc_stats_not_preloaded();
     return;
   }
@@ -431,6 +494,54 @@ PeerConnectionBase::should_connection_unchoke(choke_queue* cq) const {
   return true;
 }
 
+// Moves the socket between the default and fast buffer sizes of the
+// ConnectionManager as the peer's rate crosses 'fast_peer_rate'.
+void
+PeerConnectionBase::update_socket_tuning() {
+  ConnectionManager* cm = manager->connection_manager();
+
+  if (cm->fast_peer_rate() == 0 || !get_fd().is_valid())
+    return;
+
+  uint64_t rate = std::max<uint64_t>(up_rate()->rate(), down_rate()->rate());
+  bool fast = m_fast_socket ? rate >= cm->fast_peer_rate() / 2 : rate >= cm->fast_peer_rate();
+
+  if (fast == m_fast_socket)
+    return;
+
+  m_fast_socket = fast;
+
+  uint32_t send_size = fast ? cm->fast_send_buffer_size() : cm->send_buffer_size();
+  uint32_t receive_size = fast ? cm->fast_receive_buffer_size() : cm->receive_buffer_size();
+
+  if (send_size != 0)
+    fd_set_send_buffer_size(get_fd().get_fd(), send_size);
+
+  if (receive_size != 0)
+    fd_set_receive_buffer_size(get_fd().get_fd(), receive_size);
+}
+
+void
+PeerConnectionBase::update_tcp_info() {
+  if (!get_fd().is_valid())
+    return;
+
+  m_cold->tcp_retrans = m_cold->tcp_info.total_retrans;
+
+  fd_get_tcp_info(get_fd().get_fd(), &m_cold->tcp_info);
+  request_list()->set_path_rtt(m_cold->tcp_info.rtt);
+  m_peerInfo->add_rtt_sample(m_cold->tcp_info.rtt);
+}
+
+bool
+PeerConnectionBase::is_path_stalled() const {
+  const fd_tcp_info& info = m_cold->tcp_info;
+
+  return info.is_valid() &&
+    info.total_retrans != m_cold->tcp_retrans &&
+    info.last_data_recv >= std::chrono::seconds(30);
+}
+
 bool
 PeerConnectionBase::down_chunk_start(const Piece& piece) {
   if (!request_list()->downloading(piece)) {
@@ -478,6 +589,10 @@ PeerConnectionBase::down_chunk_finished() {
     if (!m_downChunk.is_valid())
       throw internal_error("PeerConnectionBase::down_chunk_finished() Transfer is the leader, but no chunk allocated.");
 
+    // Hash the block while it is still in the cache rather than
+    // reading the whole chunk back once complete.
+    transfer->block()->parent()->hash_finished_blocks(m_downChunk.chunk());
+
     request_list()->finished();
     m_downChunk.object()->set_time_modified(cachedTime);
 
@@ -522,24 +637,67 @@ PeerConnectionBase::down_chunk() {
     return false;
   }
 
-  uint32_t bytesTransfered = 0;
   BlockTransfer* transfer = m_request_list.transfer();
 
+  uint32_t first = transfer->piece().offset() + transfer->position();
+  uint32_t last  = transfer->piece().offset() + std::min(transfer->position() + quota, transfer->piece().length());
+
+  iovec    vec[max_gather_parts + 1];
+  int      count = 0;
+  uint32_t length = 0;
+
   Chunk::data_type data;
-  ChunkIterator itr(m_downChunk.chunk(),
-                    transfer->piece().offset() + transfer->position(),
-                    transfer->piece().offset() + std::min(transfer->position() + quota, transfer->piece().length()));
+  ChunkIterator itr(m_downChunk.chunk(), first, last);
 
   do {
     data = itr.data();
-    data.second = read_stream_throws(data.first, data.second);
+    vec[count++] = iovec{data.first, data.second};
 
-    if (is_encrypted())
-      m_encryption.decrypt(data.first, data.second);
+    length += data.second;
+  } while (count < max_gather_parts && itr.next());
 
-    bytesTransfered += data.second;
+  // When this read can finish the piece, also read the header of the
+  // next message into the empty protocol buffer. If it is another
+  // piece, its payload then goes straight to the chunk as well
+  // instead of being copied from the buffer.
+  uint32_t header_length = 0;
 
-  } while (data.second != 0 && itr.forward(data.second));
+  if (transfer->position() + length == transfer->piece().length() && m_down->buffer()->remaining() == 0) {
+    m_down->buffer()->reset();
+
+    header_length = ProtocolBase::sizeof_piece;
+    vec[count++] = iovec{m_down->buffer()->end(), header_length};
+  }
+
+  uint32_t read = read_vector_throws(vec, count);
+  uint32_t bytesTransfered = std::min(read, length);
+
+  if (is_encrypted()) {
+    uint32_t left = read;
+
+    for (int i = 0; i != count && left != 0; i++) {
+      uint32_t part = std::min<uint32_t>(left, vec[i].iov_len);
+
+      m_cold->encryption.decrypt(vec[i].iov_base, part);
+      left -= part;
+    }
+  }
+
+  if (m_capture != nullptr) {
+    uint32_t left = read;
+
+    for (int i = 0; i != count && left != 0; i++) {
+      uint32_t part = std::min<uint32_t>(left, vec[i].iov_len);
+
+      capture_write(vec[i].iov_base, part);
+      left -= part;
+    }
+  }
+
+  if (read > length) {
+    m_down->buffer()->move_end(read - length);
+    m_down->throttle()->node_used_unthrottled(read - length);
+  }
 
   transfer->adjust_position(bytesTransfered);
 
@@ -581,7 +739,9 @@ PeerConnectionBase::down_chunk_skip() {
   throttle->node_used(m_peerChunks.download_throttle(), length);
 
   if (is_encrypted())
-    m_encryption.decrypt(m_nullBuffer, length);
+    m_cold->encryption.decrypt(m_nullBuffer, length);
+
+  capture_read(m_nullBuffer, length);
 
   if (down_chunk_skip_process(m_nullBuffer, length) != length)
     throw internal_error("PeerConnectionBase::down_chunk_skip() down_chunk_skip_process(m_nullBuffer, length) != length.");
@@ -695,8 +855,9 @@ PeerConnectionBase::down_extension() {
     m_down->throttle()->node_used_unthrottled(bytes);
     
     if (is_encrypted())
-      m_encryption.decrypt(m_extensions->read_position(), bytes);
+      m_cold->encryption.decrypt(m_extensions->read_position(), bytes);
 
+    capture_read(m_extensions->read_position(), bytes);
     m_extensions->read_move(bytes);
   }
 
@@ -732,13 +893,42 @@ PeerConnectionBase::up_chunk_encrypt(uint32_t quota) {
     quota = std::min<uint32_t>(quota - m_encryptBuffer->remaining(), m_encryptBuffer->reserved_left());
   }
 
-  m_upChunk.chunk()->to_buffer(m_encryptBuffer->end(), m_upPiece.offset() + m_encryptBuffer->remaining(), quota);
-  m_encryption.encrypt(m_encryptBuffer->end(), quota);
+  m_cold->encryption.encrypt_chunk(m_upChunk.chunk(), m_upPiece.offset() + m_encryptBuffer->remaining(), quota, m_encryptBuffer->end());
   m_encryptBuffer->move_end(quota);
 
   return m_encryptBuffer->remaining();
 }
 
+// Hands the file ranges backing the chunk parts to sendfile, parts
+// whose file has been closed by the FileManager are written from the
+// mapping instead.
+inline uint32_t
+PeerConnectionBase::up_chunk_sendfile(uint32_t quota) {
+  uint32_t bytesTransfered = 0;
+  Chunk::data_type data;
+  ChunkIterator itr(m_upChunk.chunk(), m_upPiece.offset(), m_upPiece.offset() + quota);
+
+  do {
+    data = itr.data();
+
+#ifdef USE_SENDFILE
+    ChunkPart* part = itr.chunk_part();
+
+    if (part->mapped() == ChunkPart::MAPPED_MMAP && part->file() != NULL && part->file()->is_open())
+      data.second = write_file_throws(part->file()->file_descriptor(),
+                                      part->file_offset() + itr.memory_chunk_first(),
+                                      data.second);
+    else
+#endif
+      data.second = write_stream_throws(data.first, data.second);
+
+    bytesTransfered += data.second;
+
+  } while (data.second != 0 && itr.forward(data.second));
+
+  return bytesTransfered;
+}
+
 bool
 PeerConnectionBase::up_chunk() {
   if (!m_up->throttle()->is_throttled(m_peerChunks.upload_throttle()))
@@ -766,6 +956,9 @@ PeerConnectionBase::up_chunk() {
     bytesTransfered = write_stream_throws(m_encryptBuffer->position(), quota);
     m_encryptBuffer->consume(bytesTransfered);
 
+  } else if (manager->connection_manager()->is_zero_copy_upload()) {
+    bytesTransfered = up_chunk_sendfile(std::min(quota, m_upPiece.length()));
+
   } else {
     Chunk::data_type data;
     ChunkIterator itr(m_upChunk.chunk(), m_upPiece.offset(), m_upPiece.offset() + std::min(quota, m_upPiece.length()));
@@ -780,6 +973,7 @@ PeerConnectionBase::up_chunk() {
   }
 
   m_up->throttle()->node_used(m_peerChunks.upload_throttle(), bytesTransfered);
+  m_timeLastUpload = cachedTime;
   m_download->info()->mutable_up_rate()->insert(bytesTransfered);
 
   // Just modifying the piece to cover the remaining data ends up
@@ -790,33 +984,116 @@ PeerConnectionBase::up_chunk() {
   return m_upPiece.length() == 0;
 }
 
+// Encrypted connections need the data copied to encrypt it, and with
+// zero copy uploads the piece goes through sendfile.
 bool
-PeerConnectionBase::up_extension() {
-  if (m_extensionOffset == extension_must_encrypt) {
-    if (m_extensionMessage.owned()) {
-      m_encryption.encrypt(m_extensionMessage.data(), m_extensionMessage.length());
+PeerConnectionBase::up_chunk_can_gather() {
+  return !is_encrypted() && !manager->connection_manager()->is_zero_copy_upload();
+}
 
-    } else {
-      auto buffer = new char[m_extensionMessage.length()];
+// Writes the remaining messages, which end with a piece header, in the
+// same writev as the first part of the piece that the throttle quota
+// allows. Returns true if all of the messages were written, the rest
+// of the piece is then left to up_chunk().
+bool
+PeerConnectionBase::up_chunk_gather() {
+  if (!m_up->throttle()->is_throttled(m_peerChunks.upload_throttle()))
+    throw internal_error("PeerConnectionBase::up_chunk_gather() tried to write a piece but is not in throttle list");
 
-      m_encryption.encrypt(m_extensionMessage.data(), buffer, m_extensionMessage.length());
-      m_extensionMessage.set(buffer, buffer + m_extensionMessage.length(), true);
-    }
+  if (!m_upChunk.chunk()->is_readable())
+    throw internal_error("PeerConnectionBase::up_chunk_gather() chunk not readable, permission denided");
+
+  uint32_t header_length = m_up->buffer()->remaining();
+  uint32_t length = std::min(m_up->throttle()->node_quota(m_peerChunks.upload_throttle()), m_upPiece.length());
+
+  iovec vec[max_gather_parts + 1];
+  int   count = 0;
+
+  vec[count++] = iovec{m_up->buffer()->position(), header_length};
+
+  if (length != 0) {
+    Chunk::data_type data;
+    ChunkIterator itr(m_upChunk.chunk(), m_upPiece.offset(), m_upPiece.offset() + length);
 
-    m_extensionOffset = 0;
+    do {
+      data = itr.data();
+      vec[count++] = iovec{data.first, data.second};
+    } while (count <= max_gather_parts && itr.next());
   }
 
-  if (m_extensionOffset >= m_extensionMessage.length())
+  uint32_t written = write_vector_throws(vec, count);
+  uint32_t header_written = std::min(written, header_length);
+  uint32_t bytesTransfered = written - header_written;
+
+  m_up->buffer()->consume(m_up->throttle()->node_used_unthrottled(header_written));
+
+  if (bytesTransfered != 0) {
+    m_up->throttle()->node_used(m_peerChunks.upload_throttle(), bytesTransfered);
+    m_download->info()->mutable_up_rate()->insert(bytesTransfered);
+
+    m_upPiece.set_offset(m_upPiece.offset() + bytesTransfered);
+    m_upPiece.set_length(m_upPiece.length() - bytesTransfered);
+  }
+
+  return header_written == header_length;
+}
+
+// Buffers not owned by the connection are shared with others, so
+// they are copied to be encrypted.
+static void
+encrypt_extension_buffer(EncryptionInfo* encryption, DataBuffer* buffer) {
+  if (buffer->empty())
+    return;
+
+  if (buffer->owned()) {
+    encryption->encrypt(buffer->data(), buffer->length());
+    return;
+  }
+
+  auto copy = new char[buffer->length()];
+
+  encryption->encrypt(buffer->data(), copy, buffer->length());
+  buffer->set(copy, copy + buffer->length(), true);
+}
+
+bool
+PeerConnectionBase::up_extension() {
+  DataBuffer& message = m_cold->extension_message;
+  DataBuffer& payload = m_cold->extension_payload;
+
+  if (m_cold->extension_offset == extension_must_encrypt) {
+    encrypt_extension_buffer(&m_cold->encryption, &message);
+    encrypt_extension_buffer(&m_cold->encryption, &payload);
+
+    m_cold->extension_offset = 0;
+  }
+
+  uint32_t message_length = message.length();
+  uint32_t total_length = message_length + payload.length();
+
+  if (m_cold->extension_offset >= total_length)
     throw internal_error("PeerConnectionBase::up_extension bad offset.");
 
-  uint32_t written = write_stream_throws(m_extensionMessage.data() + m_extensionOffset, m_extensionMessage.length() - m_extensionOffset);
-  m_up->throttle()->node_used_unthrottled(written);
-  m_extensionOffset += written;
+  if (m_cold->extension_offset < message_length) {
+    uint32_t written = write_stream_throws(message.data() + m_cold->extension_offset, message_length - m_cold->extension_offset);
+    m_up->throttle()->node_used_unthrottled(written);
+    m_cold->extension_offset += written;
 
-  if (m_extensionOffset < m_extensionMessage.length())
-    return false;
+    if (m_cold->extension_offset < message_length)
+      return false;
+  }
+
+  if (m_cold->extension_offset < total_length) {
+    uint32_t written = write_stream_throws(payload.data() + (m_cold->extension_offset - message_length), total_length - m_cold->extension_offset);
+    m_up->throttle()->node_used_unthrottled(written);
+    m_cold->extension_offset += written;
+
+    if (m_cold->extension_offset < total_length)
+      return false;
+  }
 
-  m_extensionMessage.clear();
+  message.clear();
+  payload.clear();
 
   // If we have an unprocessed message, process it now and enable reads again.
   if (m_extensions->is_complete() && !m_extensions->is_invalid()) {
@@ -838,27 +1115,102 @@ PeerConnectionBase::down_chunk_release() {
 
 void
 PeerConnectionBase::up_chunk_release() {
-  if (m_upChunk.is_valid())
+  if (!m_upChunk.is_valid())
+    return;
+
+  ChunkCache* cache = manager->chunk_manager()->chunk_cache();
+
+  if (cache->is_enabled())
+    cache->insert(m_download->chunk_list(), &m_upChunk);
+  else
     m_download->chunk_list()->release(&m_upChunk);
 }
 
+// The protocol buffers are small and always kept, while the larger
+// encryption buffer and the chunk reference are only needed while
+// pieces are being uploaded.
+void
+PeerConnectionBase::release_idle_buffers() {
+  if (m_up->get_state() != ProtocolWrite::IDLE ||
+      !m_peerChunks.upload_queue()->empty() ||
+      cachedTime - m_timeLastUpload < rak::timer::from_seconds(idle_buffer_timeout))
+    return;
+
+  if (m_encryptBuffer != nullptr && m_encryptBuffer->remaining() != 0)
+    return;
+
+  up_chunk_release();
+  encrypt_buffer_release();
+}
+
+bool
+PeerConnectionBase::is_allowed_fast(uint32_t index) const {
+  return std::find(m_cold->allowed_fast.begin(), m_cold->allowed_fast.end(), index) != m_cold->allowed_fast.end() &&
+    m_download->file_list()->bitfield()->get(index);
+}
+
+// Peers supporting the fast extension get told of every request we
+// won't serve, while those choked may still request the chunks of
+// their allowed fast set.
 void
 PeerConnectionBase::read_request_piece(const Piece& p) {
   auto itr = std::find(m_peerChunks.upload_queue()->begin(),
                        m_peerChunks.upload_queue()->end(),
                        p);
 
-  if (m_upChoke.choked() || itr != m_peerChunks.upload_queue()->end() || p.length() > (1 << 17)) {
+  if (itr != m_peerChunks.upload_queue()->end())
+    return;
+
+  if ((m_upChoke.choked() && !is_allowed_fast(p.index())) || p.length() > (1 << 17)) {
     LT_LOG_PIECE_EVENTS("(up)   request_ignored  %" PRIu32 " %" PRIu32 " %" PRIu32,
                         p.index(), p.offset(), p.length());
+
+    if (m_peerInfo->supports_fast()) {
+      m_peerChunks.reject_queue()->push_back(p);
+      write_insert_poll_safe();
+    }
+
     return;
   }
 
   m_peerChunks.upload_queue()->push_back(p);
   write_insert_poll_safe();
 
+  if (m_upChoke.choked())
+    m_up->throttle()->insert(m_peerChunks.upload_throttle());
+
   LT_LOG_PIECE_EVENTS("(up)   request_added    %" PRIu32 " %" PRIu32 " %" PRIu32,
                       p.index(), p.offset(), p.length());
+
+  if (manager->chunk_manager()->is_preload_adaptive())
+    preload_predict(p);
+}
+
+// Prefetch chunks the peer has queued requests for, and the following
+// chunk when the peer is nearing the end of the chunk being uploaded
+// and doesn't have the next one.
+void
+PeerConnectionBase::preload_predict(const Piece& p) {
+  if (!m_download->file_list()->is_valid_piece(p))
+    return;
+
+  ChunkPreloader* preloader = m_download->chunk_preloader();
+  uint32_t        chunk_size = m_download->file_list()->chunk_index_size(p.index());
+
+  if ((!m_upChunk.is_valid() || m_upChunk.index() != p.index()) &&
+      m_download->file_list()->bitfield()->get(p.index()))
+    preloader->insert(p.index());
+
+  uint32_t next = p.index() + 1;
+
+  if (!m_upChunk.is_valid() || m_upChunk.index() + 1 != next ||
+      p.offset() + p.length() < chunk_size - chunk_size / 4 ||
+      next >= m_download->file_list()->size_chunks() ||
+      m_peerChunks.bitfield()->get(next) ||
+      !m_download->file_list()->bitfield()->get(next))
+    return;
+
+  preloader->insert(next);
 }
 
 void
@@ -870,6 +1222,13 @@ PeerConnectionBase::read_cancel_piece(const Piece& p) {
   if (itr != m_peerChunks.upload_queue()->end()) {
     m_peerChunks.upload_queue()->erase(itr);
 
+    // The fast extension has every request answered, canceled ones
+    // with a reject.
+    if (m_peerInfo->supports_fast()) {
+      m_peerChunks.reject_queue()->push_back(p);
+      write_insert_poll_safe();
+    }
+
     LT_LOG_PIECE_EVENTS("(up)   cancel_requested %" PRIu32 " %" PRIu32 " %" PRIu32,
                         p.index(), p.offset(), p.length());
   } else {
@@ -878,10 +1237,31 @@ PeerConnectionBase::read_cancel_piece(const Piece& p) {
   }
 }  
 
+// Serve requests for the chunk already held, or for chunks in the
+// page cache, before requests that would block on a major page
+// fault. Peers don't depend on the order, but initial seeding does.
 void
 PeerConnectionBase::write_prepare_piece() {
-  m_upPiece = m_peerChunks.upload_queue()->front();
-  m_peerChunks.upload_queue()->pop_front();
+  static constexpr size_t lookahead = 8;
+
+  auto upload_queue = m_peerChunks.upload_queue();
+  auto itr = upload_queue->begin();
+
+  auto is_ready = [this](const Piece& p) {
+      return (m_upChunk.is_valid() && m_upChunk.index() == p.index()) ||
+        m_download->chunk_residency()->is_resident(p.index());
+    };
+
+  if (m_download->initial_seeding() == NULL && !is_ready(*itr)) {
+    auto last = std::next(itr, std::min(upload_queue->size(), lookahead));
+    auto ready = std::find_if(std::next(itr), last, is_ready);
+
+    if (ready != last)
+      itr = ready;
+  }
+
+  m_upPiece = *itr;
+  upload_queue->erase(itr);
 
   // Move these checks somewhere else?
   if (!m_download->file_list()->is_valid_piece(m_upPiece) ||
@@ -903,17 +1283,52 @@ PeerConnectionBase::write_prepare_piece() {
                       m_upPiece.index(), m_upPiece.length(), m_upPiece.offset());
 }
 
+// Sends our allowed fast set and the queued rejects.
 void
-PeerConnectionBase::write_prepare_extension(int type, const DataBuffer& message) {
-  m_up->write_extension(m_extensions->id(type), message.length());
+PeerConnectionBase::write_prepare_fast() {
+  while (m_cold->allowed_fast_sent != m_cold->allowed_fast.size() && m_up->can_write_allowed_fast())
+    m_up->write_allowed_fast(m_cold->allowed_fast[m_cold->allowed_fast_sent++]);
+
+  while (!m_peerChunks.reject_queue()->empty() && m_up->can_write_reject()) {
+    m_up->write_reject(m_peerChunks.reject_queue()->front());
+    m_peerChunks.reject_queue()->pop_front();
+  }
+}
 
-  m_extensionOffset = 0;
-  m_extensionMessage = message;
+// Drops the requests of a peer we choke, except allowed fast ones of
+// peers supporting the fast extension which get rejects for the rest.
+void
+PeerConnectionBase::choke_upload_queue() {
+  auto upload_queue = m_peerChunks.upload_queue();
+
+  if (!m_peerInfo->supports_fast()) {
+    upload_queue->clear();
+    return;
+  }
+
+  for (auto itr = upload_queue->begin(); itr != upload_queue->end();) {
+    if (is_allowed_fast(itr->index())) {
+      ++itr;
+      continue;
+    }
+
+    m_peerChunks.reject_queue()->push_back(*itr);
+    itr = upload_queue->erase(itr);
+  }
+}
+
+void
+PeerConnectionBase::write_prepare_extension(int type, const DataBuffer& message, const DataBuffer& payload) {
+  m_up->write_extension(m_extensions->id(type), message.length() + payload.length());
+
+  m_cold->extension_offset = 0;
+  m_cold->extension_message = message;
+  m_cold->extension_payload = payload;
 
   // Need to encrypt the buffer, but not until the m_up
   // write buffer has been flushed, so flag it for now.
   if (is_encrypted())
-    m_extensionOffset = extension_must_encrypt;
+    m_cold->extension_offset = extension_must_encrypt;
 }
 
 // High stall count peers should request if we're *not* in endgame, or
@@ -921,7 +1336,12 @@ PeerConnectionBase::write_prepare_extension(int type, const DataBuffer& message)
 // from high stall counts when we are doing decent speeds.
 bool
 PeerConnectionBase::should_request() {
-  if (m_downChoke.choked() || !m_downInterested || !m_downUnchoked)
+  // Peers supporting the fast extension take requests for their
+  // allowed fast chunks while choking us.
+  if (!m_downUnchoked)
+    return m_downInterested && !m_peerChunks.allowed_fast()->empty();
+
+  if (m_downChoke.choked() || !m_downInterested)
     // || m_down->get_state() == ProtocolRead::READ_SKIP_PIECE)
     return false;
 
@@ -955,7 +1375,7 @@ PeerConnectionBase::try_request_pieces() {
     int maxQueued = pipeSize - request_list()->queued_size();
     int maxPieces = std::max(std::min(maxRequests, maxQueued), 1);
     
-    std::vector<const Piece*> pieces = request_list()->delegate(maxPieces);
+    std::vector<const Piece*> pieces = request_list()->delegate(maxPieces, !m_downUnchoked);
     if (pieces.empty()) {
       return false;
     }
@@ -1015,7 +1435,10 @@ PeerConnectionBase::send_pex_message() {
 // Extension protocol needs to send a reply.
 bool
 PeerConnectionBase::send_ext_message() {
-  write_prepare_extension(m_extensions->pending_message_type(), m_extensions->pending_message_data());
+  DataBuffer message = m_extensions->pending_message_data();
+  DataBuffer payload = m_extensions->pending_message_payload();
+
+  write_prepare_extension(m_extensions->pending_message_type(), message, payload);
   m_extensions->clear_pending_message();
   return true;
 }
@@ -1024,4 +1447,47 @@ void
 PeerConnectionBase::receive_metadata_piece(uint32_t piece, const char* data, uint32_t length) {
 }
 
+bool
+PeerConnectionBase::start_capture(const std::string& path) {
+  if (!get_fd().is_valid())
+    throw internal_error("PeerConnectionBase::start_capture() called on a closed connection.");
+
+  if (m_down->get_state() != ProtocolRead::IDLE)
+    return false;
+
+  PeerCapture::header_type header{};
+  header.magic     = PeerCapture::magic;
+  header.version   = PeerCapture::version;
+  header.flags     = (m_peerInfo->supports_fast() ? PeerCapture::flag_fast : 0) |
+                     (m_peerInfo->supports_extensions() ? PeerCapture::flag_extensions : 0) |
+                     (m_downUnchoked ? PeerCapture::flag_unchoked : 0);
+  header.size_bits = m_peerChunks.bitfield()->size_bits();
+
+  std::memcpy(header.info_hash, m_download->info()->hash().data(), sizeof(header.info_hash));
+  std::memcpy(header.peer_id, m_peerInfo->id().data(), sizeof(header.peer_id));
+
+  auto capture = std::make_unique<PeerCapture>();
+  capture->open(path, header, reinterpret_cast<const char*>(m_peerChunks.bitfield()->begin()), m_peerChunks.bitfield()->size_bytes());
+
+  m_capture = std::move(capture);
+
+  // The rest of a message already in the read buffer.
+  capture_write(m_down->buffer()->position(), m_down->buffer()->remaining());
+  return true;
+}
+
+void
+PeerConnectionBase::stop_capture() {
+  m_capture.reset();
+}
+
+void
+PeerConnectionBase::capture_write(const void* data, uint32_t length) {
+  m_capture->write(this_thread::cached_time().count(), data, length);
+
+  if (!m_capture->is_open())
+    m_capture.reset();
+}
+
+
 }
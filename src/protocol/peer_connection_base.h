@@ -1,6 +1,8 @@
 #ifndef LIBTORRENT_PROTOCOL_PEER_CONNECTION_BASE_H
 #define LIBTORRENT_PROTOCOL_PEER_CONNECTION_BASE_H
 
+#include <memory>
+
 #include "globals.h"
 #include "thread_main.h"
 #include "data/chunk_handle.h"
@@ -11,6 +13,7 @@
 #include "protocol/protocol_base.h"
 #include "protocol/request_list.h"
 #include "torrent/poll.h"
+#include "torrent/net/fd.h"
 #include "torrent/peer/peer.h"
 #include "torrent/peer/choke_status.h"
 
@@ -26,6 +29,7 @@ namespace torrent {
 
 class choke_queue;
 class DownloadMain;
+class PeerCapture;
 
 class PeerConnectionBase : public Peer, public SocketStream {
 public:
@@ -42,14 +46,35 @@ public:
   // Find an optimal number for this.
   static constexpr uint32_t read_size = 64;
 
+  // Chunk parts read or written along with a piece header in one
+  // readv or writev.
+  static constexpr int      max_gather_parts = 15;
+
   // Bitmasks for peer exchange messages to send.
   static constexpr int PEX_DO      = (1 << 0);
   static constexpr int PEX_ENABLE  = (1 << 1);
   static constexpr int PEX_DISABLE = (1 << 2);
 
+  // Seconds without uploading after which the encryption buffer and
+  // upload chunk are released.
+  static constexpr int32_t idle_buffer_timeout = 60;
+
+  // Chunks peers supporting the fast extension may request from us
+  // while choked.
+  static constexpr uint32_t allowed_fast_size = 10;
+
+  // Memory accounted for each connection, excluding the encryption
+  // buffer and extension messages.
+  static const size_t sizeof_connection;
+
   PeerConnectionBase();
   ~PeerConnectionBase() override;
 
+  // The connection types share a pool sized for the largest one, see
+  // peer_factory.cc.
+  static void*        operator new(size_t size);
+  static void         operator delete(void* ptr, size_t size) noexcept;
+
   const char*         type_name() const override      { return "pcb"; }
 
   void                initialize(DownloadMain* download, PeerInfo* p, SocketFd fd, Bitfield* bitfield, EncryptionInfo* encryptionInfo, ProtocolExtension* extensions);
@@ -69,8 +94,8 @@ public:
   bool                is_seeder() const               { return m_peerChunks.is_seeder(); }
   bool                is_not_seeder() const           { return !m_peerChunks.is_seeder(); }
 
-  bool                is_encrypted() const            { return m_encryption.is_encrypted(); }
-  bool                is_obfuscated() const           { return m_encryption.is_obfuscated(); }
+  bool                is_encrypted() const            { return m_encrypted; }
+  bool                is_obfuscated() const           { return m_cold->encryption.is_obfuscated(); }
 
   PeerInfo*           mutable_peer_info()             { return m_peerInfo; }
 
@@ -85,9 +110,16 @@ public:
   const RequestList*  request_list() const          { return &m_request_list; }
 
   ProtocolExtension*  extensions()                    { return m_extensions; }
-  DataBuffer*         extension_message()             { return &m_extensionMessage; }
+  DataBuffer*         extension_message()             { return &m_cold->extension_message; }
 
   void                do_peer_exchange()              { m_sendPEXMask |= PEX_DO; }
+
+  // Records the decrypted stream received from the peer to 'path',
+  // starting with the next message. Returns false while a message is
+  // partially read, try again later. Throws storage_error.
+  bool                start_capture(const std::string& path);
+  void                stop_capture();
+  bool                is_capturing() const            { return m_capture != nullptr; }
   inline void         set_peer_exchange(bool state);
 
   // These must be implemented by the child class.
@@ -95,6 +127,10 @@ public:
   virtual void        update_interested() = 0;
   virtual bool        receive_keepalive() = 0;
 
+  // Wakes the connection if the download has HAVE messages it should
+  // write.
+  virtual void        flush_have_queue() {}
+
   bool                receive_upload_choke(bool choke);
   bool                receive_download_choke(bool choke);
 
@@ -113,19 +149,50 @@ public:
 
   bool                should_connection_unchoke(choke_queue* cq) const;
 
+  void                update_socket_tuning();
+
+  // Sampled from the kernel every tick by the download, zero where
+  // unsupported.
+  const fd_tcp_info&  tcp_info() const                { return m_cold->tcp_info; }
+  void                update_tcp_info();
+
+  // The connection retransmitted since the previous sample and no data
+  // has arrived for a tick.
+  bool                is_path_stalled() const;
+
 protected:
   static constexpr uint32_t extension_must_encrypt = ~uint32_t();
 
+  // State not touched on every read and write, allocated separately
+  // so the RC4 keys don't push the fields used by the read and write
+  // paths apart.
+  struct cold_type {
+    EncryptionInfo    encryption;
+
+    DataBuffer        extension_message;
+    DataBuffer        extension_payload;
+    uint32_t          extension_offset{0};
+
+    fd_tcp_info       tcp_info{};
+    uint32_t          tcp_retrans{0};
+
+    // Our allowed fast set for the peer, and how much of it has been
+    // sent.
+    std::vector<uint32_t> allowed_fast;
+    uint32_t          allowed_fast_sent{0};
+  };
+
   inline bool         read_remaining();
   inline bool         write_remaining();
 
   void                load_up_chunk();
 
   void                read_request_piece(const Piece& p);
+  void                preload_predict(const Piece& p);
   void                read_cancel_piece(const Piece& p);
 
   void                write_prepare_piece();
-  void                write_prepare_extension(int type, const DataBuffer& message);
+  void                write_prepare_extension(int type, const DataBuffer& message, const DataBuffer& payload = DataBuffer());
 
   bool                down_chunk_start(const Piece& p);
   void                down_chunk_finished();
@@ -140,17 +207,34 @@ protected:
 
   bool                down_extension();
 
+  void                capture_read(const void* data, uint32_t length) { if (m_capture != nullptr) capture_write(data, length); }
+  void                capture_write(const void* data, uint32_t length);
+
   bool                up_chunk();
+  bool                up_chunk_can_gather();
+  bool                up_chunk_gather();
   inline uint32_t     up_chunk_encrypt(uint32_t quota);
+  inline uint32_t     up_chunk_sendfile(uint32_t quota);
 
   bool                up_extension();
 
   void                down_chunk_release();
   void                up_chunk_release();
 
+  // Returns the encryption buffer and the upload chunk of a
+  // connection that has not uploaded for a while.
+  void                release_idle_buffers();
+
+  void                encrypt_buffer_acquire();
+  void                encrypt_buffer_release();
+
   bool                should_request();
   bool                try_request_pieces();
 
+  bool                is_allowed_fast(uint32_t index) const;
+  void                write_prepare_fast();
+  void                choke_upload_queue();
+
   bool                send_pex_message();
   bool                send_ext_message();
 
@@ -191,15 +275,21 @@ protected:
   int                 m_sendPEXMask{0};
 
   rak::timer          m_timeLastRead;
-
-  DataBuffer          m_extensionMessage;
-  uint32_t            m_extensionOffset;
+  rak::timer          m_timeLastUpload;
 
   EncryptBuffer*      m_encryptBuffer{};
-  EncryptionInfo      m_encryption;
   ProtocolExtension*  m_extensions{};
 
   bool m_incoreContinous{false};
+  bool                m_fast_socket{false};
+
+  // Copy of the cold encryption state's flag, as it is checked on
+  // every read and write.
+  bool                m_encrypted{false};
+
+  std::unique_ptr<PeerCapture> m_capture;
+
+  std::unique_ptr<cold_type> m_cold;
 };
 
 inline void
@@ -16,6 +16,7 @@
 #include "torrent/peer/peer_info.h"
 #include "torrent/tracker/dht_controller.h"
 #include "torrent/utils/log.h"
+#include "utils/probe.h"
 
 #include "extensions.h"
 #include "initial_seed.h"
@@ -66,9 +67,8 @@ PeerConnection<type>::update_interested() {
   if (m_downInterested)
     return;
 
-  // Consider just setting to interested without checking the
-  // bitfield. The status might change by the time we get unchoked
-  // anyway.
+  if (!m_download->chunk_selector()->has_wanted(m_peerChunks.bitfield()))
+    return;
 
   m_sendInterested = !m_downInterested;
   m_downInterested = true;
@@ -95,9 +95,11 @@ PeerConnection<type>::receive_keepalive() {
     m_up->write_keepalive();
 
     if (is_encrypted())
-      m_encryption.encrypt(old_end, m_up->buffer()->end() - old_end);
+      m_cold->encryption.encrypt(old_end, m_up->buffer()->end() - old_end);
   }
 
+  release_idle_buffers();
+
   if (type != Download::CONNECTION_LEECH)
     return true;
 
@@ -123,7 +125,10 @@ PeerConnection<type>::receive_keepalive() {
   // if (request_list()->empty())
   //   return true;
 
-  if (m_downStall >= 2)
+  // A connection that is retransmitting without receiving anything is
+  // stalled on the path, so don't wait another keepalive before
+  // handing its requests to other peers.
+  if (m_downStall >= 2 || (m_downStall != 0 && is_path_stalled()))
     request_list()->stall_prolonged();
   else if (m_downStall++ != 0)
     request_list()->stall_initial();
@@ -131,6 +136,25 @@ PeerConnection<type>::receive_keepalive() {
   return true;
 }
 
+// HAVE messages are otherwise only written along with other messages
+// or the next keepalive.
+template<Download::ConnectionType type>
+void
+PeerConnection<type>::flush_have_queue() {
+  if (type != Download::CONNECTION_LEECH)
+    return;
+
+  for (const auto& entry : *m_download->have_queue()) {
+    if (m_peerChunks.have_timer() > entry.first)
+      return;
+
+    if (!m_peerChunks.bitfield()->get(entry.second)) {
+      write_insert_poll_safe();
+      return;
+    }
+  }
+}
+
 // We keep the message in the buffer if it is incomplete instead of
 // keeping the state and remembering the read information. This
 // shouldn't happen very often compared to full reads.
@@ -174,6 +198,8 @@ PeerConnection<type>::read_message() {
   // Temporary.
   m_down->set_last_command(static_cast<ProtocolBase::Protocol>(buf->peek_8()));
 
+  LT_PROBE3(peer_read_message, this, buf->peek_8(), length);
+
   switch (buf->read_8()) {
   case ProtocolBase::CHOKE:
     if (type != Download::CONNECTION_LEECH)
@@ -234,7 +260,7 @@ PeerConnection<type>::read_message() {
     if (!m_down->can_read_request_body())
       break;
 
-    if (!m_upChoke.choked()) {
+    if (!m_upChoke.choked() || m_peerInfo->supports_fast()) {
       write_insert_poll_safe();
       read_request_piece(m_down->read_request());
 
@@ -286,6 +312,46 @@ PeerConnection<type>::read_message() {
     read_cancel_piece(m_down->read_request());
     return true;
 
+  case ProtocolBase::SUGGEST_PIECE:
+    if (!m_peerInfo->supports_fast())
+      throw communication_error("Received a fast extension message from a peer not supporting it.");
+
+    if (!m_down->can_read_suggest_body())
+      break;
+
+    buf->read_32();
+    return true;
+
+  case ProtocolBase::HAVE_ALL:
+  case ProtocolBase::HAVE_NONE:
+    throw communication_error("Received HAVE_ALL or HAVE_NONE after the first message.");
+
+  case ProtocolBase::REJECT_PIECE:
+    if (!m_peerInfo->supports_fast())
+      throw communication_error("Received a fast extension message from a peer not supporting it.");
+
+    if (!m_down->can_read_reject_body())
+      break;
+
+    // Rejected blocks are released at once so other peers can be
+    // asked, rather than waiting for the choke timeout.
+    if (request_list()->rejected(m_down->read_request()) && type == Download::CONNECTION_LEECH) {
+      m_tryRequest = true;
+      write_insert_poll_safe();
+    }
+
+    return true;
+
+  case ProtocolBase::ALLOWED_FAST:
+    if (!m_peerInfo->supports_fast())
+      throw communication_error("Received a fast extension message from a peer not supporting it.");
+
+    if (!m_down->can_read_allowed_fast_body())
+      break;
+
+    read_allowed_fast(buf->read_32());
+    return true;
+
   case ProtocolBase::PORT:
     if (!m_down->can_read_port_body())
       break;
@@ -350,26 +416,33 @@ PeerConnection<type>::event_read() {
     do {
 
       switch (m_down->get_state()) {
-      case ProtocolRead::IDLE:
-        if (m_down->buffer()->size_end() < read_size) {
-          unsigned int length = read_stream_throws(m_down->buffer()->end(), read_size - m_down->buffer()->size_end());
+      case ProtocolRead::IDLE: {
+        // A piece header read along with the end of the previous piece
+        // is handled before reading more, so the payload is read
+        // straight into the chunk.
+        bool has_piece_header = m_down->has_piece_header();
+
+        if (m_down->buffer()->size_end() < PeerConnectionData<type>::read_size && !has_piece_header) {
+          unsigned int length = read_stream_throws(m_down->buffer()->end(), PeerConnectionData<type>::read_size - m_down->buffer()->size_end());
           m_down->throttle()->node_used_unthrottled(length);
 
           if (is_encrypted())
-            m_encryption.decrypt(m_down->buffer()->end(), length);
+            m_cold->encryption.decrypt(m_down->buffer()->end(), length);
 
+          capture_read(m_down->buffer()->end(), length);
           m_down->buffer()->move_end(length);
         }
 
         while (read_message());
         
-        if (m_down->buffer()->size_end() == read_size) {
+        if (m_down->buffer()->size_end() == PeerConnectionData<type>::read_size || has_piece_header) {
           m_down->buffer()->move_unused();
           break;
         } else {
           m_down->buffer()->move_unused();
           return;
         }
+      }
 
       case ProtocolRead::READ_PIECE:
         if (type != Download::CONNECTION_LEECH)
@@ -463,16 +536,12 @@ PeerConnection<type>::fill_write_buffer() {
     m_up->write_choke(m_upChoke.choked());
 
     if (m_upChoke.choked()) {
-      m_up->throttle()->erase(m_peerChunks.upload_throttle());
       up_chunk_release();
-      m_peerChunks.upload_queue()->clear();
-
-      if (m_encryptBuffer != NULL) {
-        if (m_encryptBuffer->remaining())
-          throw internal_error("Deleting encryptBuffer with encrypted data remaining.");
+      choke_upload_queue();
 
-        delete m_encryptBuffer;
-        m_encryptBuffer = NULL;
+      if (m_peerChunks.upload_queue()->empty()) {
+        m_up->throttle()->erase(m_peerChunks.upload_throttle());
+        encrypt_buffer_release();
       }
 
     } else {
@@ -501,6 +570,16 @@ PeerConnection<type>::fill_write_buffer() {
     }
   }
 
+  // Cancels go first so that duplicate requests of completed blocks
+  // are dropped before the peer starts sending them.
+  while (type == Download::CONNECTION_LEECH && !m_peerChunks.cancel_queue()->empty() && m_up->can_write_cancel()) {
+    m_up->write_cancel(m_peerChunks.cancel_queue()->front());
+    m_peerChunks.cancel_queue()->pop_front();
+  }
+
+  if (m_peerInfo->supports_fast())
+    write_prepare_fast();
+
   DownloadMain::have_queue_type* haveQueue = m_download->have_queue();
 
   if (type == Download::CONNECTION_LEECH && 
@@ -512,8 +591,13 @@ PeerConnection<type>::fill_write_buffer() {
       return m_peerChunks.have_timer() > v.first;
     });
 
+    // Peers that already have the chunk are not told, as they have
+    // no use for it.
     do {
-      m_up->write_have((--last)->second);
+      --last;
+
+      if (!m_peerChunks.bitfield()->get(last->second))
+        m_up->write_have(last->second);
     } while (last != haveQueue->begin() && m_up->can_write_have());
 
     m_peerChunks.set_have_timer(last->first + 1);
@@ -522,11 +606,6 @@ PeerConnection<type>::fill_write_buffer() {
   if (type == Download::CONNECTION_INITIAL_SEED && m_up->can_write_have())
     offer_chunk();
 
-  while (type == Download::CONNECTION_LEECH && !m_peerChunks.cancel_queue()->empty() && m_up->can_write_cancel()) {
-    m_up->write_cancel(m_peerChunks.cancel_queue()->front());
-    m_peerChunks.cancel_queue()->pop_front();
-  }
-
   if (m_sendPEXMask && m_up->can_write_extension() &&
       send_pex_message()) {
     // Don't do anything else if send_pex_message() succeeded.
@@ -535,15 +614,20 @@ PeerConnection<type>::fill_write_buffer() {
              send_ext_message()) {
     // Same.
 
-  } else if (!m_upChoke.choked() &&
-             !m_peerChunks.upload_queue()->empty() &&
+  } else if (!m_peerChunks.upload_queue()->empty() &&
              m_up->can_write_piece() &&
              (type != Download::CONNECTION_INITIAL_SEED || should_upload())) {
+    // While choked the queue only holds allowed fast requests.
     write_prepare_piece();
+
+  } else if (m_upChoke.choked() && m_peerChunks.upload_queue()->empty()) {
+    m_up->throttle()->erase(m_peerChunks.upload_throttle());
   }
 
+  LT_PROBE3(peer_write_message, this, m_up->last_command(), m_up->buffer()->end() - old_end);
+
   if (is_encrypted())
-    m_encryption.encrypt(old_end, m_up->buffer()->end() - old_end);
+    m_cold->encryption.encrypt(old_end, m_up->buffer()->end() - old_end);
 }
 
 template<Download::ConnectionType type>
@@ -566,6 +650,17 @@ PeerConnection<type>::event_write() {
         m_up->set_state(ProtocolWrite::MSG);
 
       case ProtocolWrite::MSG:
+        if (m_up->last_command() == ProtocolBase::PIECE && up_chunk_can_gather()) {
+          load_up_chunk();
+
+          if (!up_chunk_gather())
+            return;
+
+          m_up->buffer()->reset();
+          m_up->set_state(m_upPiece.length() != 0 ? ProtocolWrite::WRITE_PIECE : ProtocolWrite::IDLE);
+          break;
+        }
+
         if (!m_up->buffer()->consume(m_up->throttle()->node_used_unthrottled(write_stream_throws(m_up->buffer()->position(), m_up->buffer()->remaining()))))
           return;
 
@@ -650,6 +745,8 @@ PeerConnection<type>::read_have_chunk(uint32_t index) {
   // Disconnect seeds when we are seeding (but not for initial seeding
   // so that we keep accurate chunk statistics until that is done).
   if (m_peerChunks.bitfield()->is_all_set()) {
+    m_peerChunks.bitfield()->share_uniform();
+
     if (type == Download::CONNECTION_SEED || 
         (type != Download::CONNECTION_INITIAL_SEED && m_download->file_list()->is_done()))
       throw close_connection();
@@ -688,6 +785,24 @@ PeerConnection<type>::read_have_chunk(uint32_t index) {
   }
 }
 
+template<Download::ConnectionType type>
+void
+PeerConnection<type>::read_allowed_fast(uint32_t index) {
+  auto allowed_fast = m_peerChunks.allowed_fast();
+
+  if (index >= m_peerChunks.bitfield()->size_bits() ||
+      allowed_fast->size() >= PeerChunks::max_allowed_fast ||
+      std::find(allowed_fast->begin(), allowed_fast->end(), index) != allowed_fast->end())
+    return;
+
+  allowed_fast->push_back(index);
+
+  if (type == Download::CONNECTION_LEECH && !m_downUnchoked && m_downInterested) {
+    m_tryRequest = true;
+    write_insert_poll_safe();
+  }
+}
+
 template<>
 void
 PeerConnection<Download::CONNECTION_INITIAL_SEED>::offer_chunk() {
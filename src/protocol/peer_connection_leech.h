@@ -44,13 +44,24 @@
 namespace torrent {
 
 // Type-specific data.
+//
+// The 'read_size' is how much is read into the message buffer at a
+// time. Leeching connections keep it small as piece data beyond it is
+// read straight into the chunk, while seeding connections only
+// receive short messages and read as many as fit in the buffer.
 template<Download::ConnectionType type> struct PeerConnectionData;
 
-template<> struct PeerConnectionData<Download::CONNECTION_LEECH> { };
+template<> struct PeerConnectionData<Download::CONNECTION_LEECH> {
+  static constexpr uint32_t read_size = PeerConnectionBase::read_size;
+};
 
-template<> struct PeerConnectionData<Download::CONNECTION_SEED> { };
+template<> struct PeerConnectionData<Download::CONNECTION_SEED> {
+  static constexpr uint32_t read_size = ProtocolBase::buffer_size;
+};
 
 template<> struct PeerConnectionData<Download::CONNECTION_INITIAL_SEED> {
+  static constexpr uint32_t read_size = ProtocolBase::buffer_size;
+
   PeerConnectionData() : lastIndex(~uint32_t()) { }
   uint32_t lastIndex;
   uint32_t bytesLeft;
@@ -65,6 +76,7 @@ public:
   void                initialize_custom() override;
   void                update_interested() override;
   bool                receive_keepalive() override;
+  void                flush_have_queue() override;
 
   void                event_read() override;
   void                event_write() override;
@@ -75,6 +87,7 @@ private:
 
   inline bool         read_message();
   void                read_have_chunk(uint32_t index);
+  void                read_allowed_fast(uint32_t index);
 
   void                offer_chunk();
   bool                should_upload();
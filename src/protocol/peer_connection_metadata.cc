@@ -53,7 +53,7 @@ PeerConnectionMetadata::receive_keepalive() {
     m_up->write_keepalive();
 
     if (is_encrypted())
-      m_encryption.encrypt(old_end, m_up->buffer()->end() - old_end);
+      m_cold->encryption.encrypt(old_end, m_up->buffer()->end() - old_end);
   }
 
   return true;
@@ -97,6 +97,23 @@ PeerConnectionMetadata::read_message() {
   case ProtocolBase::UNCHOKE:
   case ProtocolBase::INTERESTED:
   case ProtocolBase::NOT_INTERESTED:
+  case ProtocolBase::HAVE_ALL:
+  case ProtocolBase::HAVE_NONE:
+    return true;
+
+  case ProtocolBase::SUGGEST_PIECE:
+  case ProtocolBase::ALLOWED_FAST:
+    if (!m_down->can_read_allowed_fast_body())
+      break;
+
+    buf->read_32();
+    return true;
+
+  case ProtocolBase::REJECT_PIECE:
+    if (!m_down->can_read_reject_body())
+      break;
+
+    m_down->read_request();
     return true;
 
   case ProtocolBase::HAVE:
@@ -205,8 +222,9 @@ PeerConnectionMetadata::event_read() {
           m_down->throttle()->node_used_unthrottled(length);
 
           if (is_encrypted())
-            m_encryption.decrypt(m_down->buffer()->end(), length);
+            m_cold->encryption.decrypt(m_down->buffer()->end(), length);
 
+          capture_read(m_down->buffer()->end(), length);
           m_down->buffer()->move_end(length);
         }
 
@@ -291,7 +309,7 @@ PeerConnectionMetadata::fill_write_buffer() {
   }
 
   if (is_encrypted())
-    m_encryption.encrypt(old_end, m_up->buffer()->end() - old_end);
+    m_cold->encryption.encrypt(old_end, m_up->buffer()->end() - old_end);
 }
 
 void
@@ -373,6 +391,7 @@ PeerConnectionMetadata::read_skip_bitfield() {
     length = read_stream_throws(m_nullBuffer, length);
     if (!length)
       return false;
+    capture_read(m_nullBuffer, length);
     m_skipLength -= length;
   }
 
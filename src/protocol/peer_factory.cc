@@ -40,8 +40,87 @@
 #include "peer_connection_leech.h"
 #include "peer_connection_metadata.h"
 
+#include <algorithm>
+
+#include "torrent/exceptions.h"
+#include "torrent/memory_manager.h"
+#include "utils/object_pool.h"
+
 namespace torrent {
 
+// Defined here as the pool block size depends on all connection types.
+constexpr size_t peer_connection_block_size =
+  std::max({ sizeof(PeerConnection<Download::CONNECTION_LEECH>),
+             sizeof(PeerConnection<Download::CONNECTION_SEED>),
+             sizeof(PeerConnection<Download::CONNECTION_INITIAL_SEED>),
+             sizeof(PeerConnectionMetadata) });
+
+using peer_connection_pool = object_pool<PeerConnectionBase, peer_connection_block_size>;
+
+void*
+PeerConnectionBase::operator new(size_t size) {
+  return peer_connection_pool::allocate(size);
+}
+
+void
+PeerConnectionBase::operator delete(void* ptr, size_t size) noexcept {
+  peer_connection_pool::deallocate(ptr, size);
+}
+
+object_pool_stats
+peer_connection_pool_stats() {
+  return peer_connection_pool::stats();
+}
+
+using protocol_base_pool = object_pool<ProtocolBase>;
+using encrypt_buffer_pool = object_pool<PeerConnectionBase::EncryptBuffer>;
+
+void*
+ProtocolBase::operator new(size_t size) {
+  return protocol_base_pool::allocate(size);
+}
+
+void
+ProtocolBase::operator delete(void* ptr, size_t size) noexcept {
+  protocol_base_pool::deallocate(ptr, size);
+}
+
+void
+PeerConnectionBase::encrypt_buffer_acquire() {
+  if (m_encryptBuffer != nullptr)
+    return;
+
+  m_encryptBuffer = new (encrypt_buffer_pool::allocate(sizeof(EncryptBuffer))) EncryptBuffer();
+  m_encryptBuffer->reset();
+
+  MemoryManager::inc_usage(MemoryManager::category_connections, sizeof(EncryptBuffer));
+}
+
+void
+PeerConnectionBase::encrypt_buffer_release() {
+  if (m_encryptBuffer == nullptr)
+    return;
+
+  if (m_encryptBuffer->remaining())
+    throw internal_error("PeerConnectionBase::encrypt_buffer_release() encrypted data remaining.");
+
+  MemoryManager::dec_usage(MemoryManager::category_connections, sizeof(EncryptBuffer));
+
+  m_encryptBuffer->~EncryptBuffer();
+  encrypt_buffer_pool::deallocate(m_encryptBuffer, sizeof(EncryptBuffer));
+  m_encryptBuffer = nullptr;
+}
+
+object_pool_stats
+protocol_base_pool_stats() {
+  return protocol_base_pool::stats();
+}
+
+object_pool_stats
+encrypt_buffer_pool_stats() {
+  return encrypt_buffer_pool::stats();
+}
+
 PeerConnectionBase*
 createPeerConnectionDefault(bool encrypted) {
   PeerConnectionBase* pc = new PeerConnection<Download::CONNECTION_LEECH>;
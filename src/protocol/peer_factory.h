@@ -40,12 +40,17 @@
 namespace torrent {
 
 class PeerConnectionBase;
+struct object_pool_stats;
 
 PeerConnectionBase* createPeerConnectionDefault(bool encrypted);
 PeerConnectionBase* createPeerConnectionSeed(bool encrypted);
 PeerConnectionBase* createPeerConnectionInitialSeed(bool encrypted);
 PeerConnectionBase* createPeerConnectionMetadata(bool encrypted);
 
+object_pool_stats   peer_connection_pool_stats();
+object_pool_stats   protocol_base_pool_stats();
+object_pool_stats   encrypt_buffer_pool_stats();
+
 }
 
 #endif
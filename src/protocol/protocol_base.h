@@ -64,6 +64,13 @@ public:
     CANCEL,
     PORT, // = 9
 
+    // Fast extension, BEP 6.
+    SUGGEST_PIECE = 13,
+    HAVE_ALL,
+    HAVE_NONE,
+    REJECT_PIECE,
+    ALLOWED_FAST, // = 17
+
     EXTENSION_PROTOCOL = 20,
 
     NONE,      // These are not part of the protocol
@@ -86,6 +93,11 @@ public:
     m_buffer.reset();
   }
 
+  // Allocated from a shared pool as every connection creates and
+  // destroys a read and a write side.
+  static void*        operator new(size_t size);
+  static void         operator delete(void* ptr, size_t size) noexcept;
+
   Protocol            last_command() const                    { return m_lastCommand; }
   void                set_last_command(Protocol p)            { m_lastCommand = p; }
 
@@ -112,6 +124,8 @@ public:
   void                write_piece(const Piece& p);
   void                write_port(uint16_t port);
   void                write_extension(uint8_t id, uint32_t length);
+  void                write_reject(const Piece& p);
+  void                write_allowed_fast(uint32_t index);
 
   static constexpr size_type sizeof_keepalive    = 4;
   static constexpr size_type sizeof_choke        = 5;
@@ -129,6 +143,11 @@ public:
   static constexpr size_type sizeof_port_body    = 2;
   static constexpr size_type sizeof_extension    = 6;
   static constexpr size_type sizeof_extension_body=1;
+  static constexpr size_type sizeof_suggest_body = 4;
+  static constexpr size_type sizeof_reject       = 17;
+  static constexpr size_type sizeof_reject_body  = 12;
+  static constexpr size_type sizeof_allowed_fast = 9;
+  static constexpr size_type sizeof_allowed_fast_body = 4;
 
   bool                can_write_keepalive() const             { return m_buffer.reserved_left() >= sizeof_keepalive; }
   bool                can_write_choke() const                 { return m_buffer.reserved_left() >= sizeof_choke; }
@@ -140,6 +159,8 @@ public:
   bool                can_write_piece() const                 { return m_buffer.reserved_left() >= sizeof_piece; }
   bool                can_write_port() const                  { return m_buffer.reserved_left() >= sizeof_port; }
   bool                can_write_extension() const             { return m_buffer.reserved_left() >= sizeof_extension; }
+  bool                can_write_reject() const                { return m_buffer.reserved_left() >= sizeof_reject; }
+  bool                can_write_allowed_fast() const          { return m_buffer.reserved_left() >= sizeof_allowed_fast; }
 
   size_type           max_write_request() const               { return m_buffer.reserved_left() / sizeof_request; }
 
@@ -149,6 +170,12 @@ public:
   bool                can_read_piece_body() const             { return m_buffer.remaining() >= sizeof_piece_body; }
   bool                can_read_port_body() const              { return m_buffer.remaining() >= sizeof_port_body; }
   bool                can_read_extension_body() const         { return m_buffer.remaining() >= sizeof_extension_body; }
+  bool                can_read_suggest_body() const           { return m_buffer.remaining() >= sizeof_suggest_body; }
+  bool                can_read_reject_body() const            { return m_buffer.remaining() >= sizeof_reject_body; }
+  bool                can_read_allowed_fast_body() const      { return m_buffer.remaining() >= sizeof_allowed_fast_body; }
+
+  // The buffer starts with a complete piece message header.
+  bool                has_piece_header() const                { return m_buffer.remaining() >= sizeof_piece && m_buffer.peek_8_at(4) == PIECE; }
 
 
 protected:
@@ -247,6 +274,22 @@ ProtocolBase::write_extension(uint8_t id, uint32_t length) {
   m_buffer.write_8(id);
 }
 
+inline void
+ProtocolBase::write_reject(const Piece& p) {
+  m_buffer.write_32(13);
+  write_command(REJECT_PIECE);
+  m_buffer.write_32(p.index());
+  m_buffer.write_32(p.offset());
+  m_buffer.write_32(p.length());
+}
+
+inline void
+ProtocolBase::write_allowed_fast(uint32_t index) {
+  m_buffer.write_32(5);
+  write_command(ALLOWED_FAST);
+  m_buffer.write_32(index);
+}
+
 }
 
 #endif
@@ -56,19 +56,6 @@ request_list_constants::destroy<BlockTransfer*>(BlockTransfer*& obj) {
 // time on the queued pieces. This makes it possible to get going
 // again if the remote queue got cleared.
 
-// It is assumed invalid transfers have been removed.
-struct request_list_same_piece {
-  request_list_same_piece(const Piece& p) : m_piece(p) {}
-
-  bool operator () (const BlockTransfer* d) {
-    return
-      m_piece.index() == d->piece().index() &&
-      m_piece.offset() == d->piece().offset();
-  }
-
-  Piece m_piece;
-};
-
 RequestList::~RequestList() {
   assert(m_transfer == nullptr);
   assert(m_queues.empty());
@@ -78,8 +65,10 @@ RequestList::~RequestList() {
 }
 
 std::vector<const Piece*>
-RequestList::delegate(uint32_t maxPieces) {
-  std::vector<BlockTransfer*> transfers = m_delegator->delegate(m_peerChunks, m_affinity, maxPieces);
+RequestList::delegate(uint32_t maxPieces, bool allowed_fast) {
+  std::vector<BlockTransfer*> transfers = allowed_fast
+    ? m_delegator->delegate_allowed_fast(m_peerChunks, maxPieces)
+    : m_delegator->delegate(m_peerChunks, m_affinity, maxPieces);
 
   std::vector<const Piece*> pieces;
 
@@ -88,6 +77,14 @@ RequestList::delegate(uint32_t maxPieces) {
 
   instrumentation_update(INSTRUMENTATION_TRANSFER_REQUESTS_DELEGATED, transfers.size());
 
+  auto now = torrent::this_thread::cached_time();
+
+  if (m_transfer == nullptr && queued_empty() && stalled_empty() &&
+      (m_rtt_probe_time == std::chrono::microseconds{} || now - m_rtt_probe_time >= timeout_rtt_probe)) {
+    m_rtt_probe      = transfers.front()->piece();
+    m_rtt_probe_time = now;
+  }
+
   for (auto transfer : transfers) {
     m_queues.push_back(bucket_queued, transfer);
     pieces.push_back(&transfer->piece());
@@ -101,9 +98,9 @@ RequestList::delegate(uint32_t maxPieces) {
 
 void
 RequestList::stall_initial() {
-  queue_bucket_for_all_in_queue(m_queues, bucket_queued, &Block::stalled);
+  m_queues.for_each(bucket_queued, &Block::stalled);
   m_queues.move_all_to(bucket_queued, bucket_stalled);
-  queue_bucket_for_all_in_queue(m_queues, bucket_unordered, &Block::stalled);
+  m_queues.for_each(bucket_unordered, &Block::stalled);
   m_queues.move_all_to(bucket_unordered, bucket_stalled);
 }
 
@@ -112,9 +109,9 @@ RequestList::stall_prolonged() {
   if (m_transfer != nullptr)
     Block::stalled(m_transfer);
 
-  queue_bucket_for_all_in_queue(m_queues, bucket_queued, &Block::stalled);
+  m_queues.for_each(bucket_queued, &Block::stalled);
   m_queues.move_all_to(bucket_queued, bucket_stalled);
-  queue_bucket_for_all_in_queue(m_queues, bucket_unordered, &Block::stalled);
+  m_queues.for_each(bucket_unordered, &Block::stalled);
   m_queues.move_all_to(bucket_unordered, bucket_stalled);
 
   // Currently leave the the requests until the peer gets disconnected. (?)
@@ -126,6 +123,7 @@ RequestList::choked() {
   // updated within a short timespan?
 
   m_last_choke = torrent::this_thread::cached_time();
+  m_rtt_probe_time = std::chrono::microseconds{};
 
   if (m_queues.queue_empty(bucket_queued) && m_queues.queue_empty(bucket_unordered))
     return;
@@ -159,32 +157,39 @@ RequestList::delay_remove_choked() {
   m_queues.clear(bucket_choked);
 }
 
+// Transfers requested before the one received are either coming out
+// of order or were skipped by the peer.
 void
-RequestList::prepare_process_unordered(queues_type::iterator itr) {
-  m_queues.move_to(bucket_queued, m_queues.begin(bucket_queued), itr,
-                   bucket_unordered);
+RequestList::prepare_process_unordered(BlockTransfer* transfer) {
+  while (m_queues.front(bucket_queued) != transfer) {
+    BlockTransfer* unordered = m_queues.front(bucket_queued);
+
+    m_queues.move_to(unordered, bucket_unordered);
+    unordered->request_hook().mark = m_unordered_epoch;
+  }
 
   if (m_delay_process_unordered.is_scheduled())
     return;
 
   torrent::this_thread::scheduler()->wait_for_ceil_seconds(&m_delay_process_unordered, timeout_process_unordered);
 
-  m_last_unordered_position = unordered_size();
+  m_unordered_epoch++;
 }
 
 void
 RequestList::delay_process_unordered() {
-  m_last_unordered_position = std::min(m_last_unordered_position, unordered_size());
+  uint32_t finished = 0;
 
-  instrumentation_update(INSTRUMENTATION_TRANSFER_REQUESTS_FINISHED, m_last_unordered_position);
+  while (!unordered_empty() && m_queues.front(bucket_unordered)->request_hook().mark != m_unordered_epoch) {
+    m_queues.destroy(m_queues.front(bucket_unordered));
+    finished++;
+  }
 
-  m_queues.destroy(bucket_unordered,
-                   m_queues.begin(bucket_unordered),
-                   m_queues.begin(bucket_unordered) + m_last_unordered_position);
+  instrumentation_update(INSTRUMENTATION_TRANSFER_REQUESTS_FINISHED, finished);
 
-  m_last_unordered_position = unordered_size();
+  m_unordered_epoch++;
 
-  if (m_last_unordered_position != 0)
+  if (!unordered_empty())
     torrent::this_thread::scheduler()->wait_for_ceil_seconds(&m_delay_process_unordered, timeout_process_unordered);
 }
 
@@ -199,6 +204,20 @@ RequestList::clear() {
   m_queues.clear(bucket_choked);
 }
 
+bool
+RequestList::rejected(const Piece& piece) {
+  BlockTransfer* transfer = m_queues.find(request_list_constants::key(piece));
+
+  if (transfer == nullptr)
+    return false;
+
+  if (m_rtt_probe_time != std::chrono::microseconds{} && piece.index() == m_rtt_probe.index() && piece.offset() == m_rtt_probe.offset())
+    m_rtt_probe_time = std::chrono::microseconds{};
+
+  m_queues.destroy(transfer);
+  return true;
+}
+
 bool
 RequestList::downloading(const Piece& piece) {
   if (m_transfer != nullptr)
@@ -206,44 +225,42 @@ RequestList::downloading(const Piece& piece) {
 
   instrumentation_update(INSTRUMENTATION_TRANSFER_REQUESTS_DOWNLOADING, 1);
 
-  std::pair<int, queues_type::iterator> itr =
-    queue_bucket_find_if_in_any(m_queues, request_list_same_piece(piece));
-
-  switch (itr.first) {
-  case bucket_queued:
-    if (itr.second != m_queues.begin(bucket_queued))
-      prepare_process_unordered(itr.second);
+  if (m_rtt_probe_time != std::chrono::microseconds{} && piece.index() == m_rtt_probe.index() && piece.offset() == m_rtt_probe.offset()) {
+    update_rtt(torrent::this_thread::cached_time() - m_rtt_probe_time);
+    m_rtt_probe_time = std::chrono::microseconds{};
+  }
 
-    m_transfer = m_queues.take(itr.first, itr.second);
-    break;
+  {
+    BlockTransfer* transfer = m_queues.find(request_list_constants::key(piece));
 
-  case bucket_unordered:
-    // Do unordered take of element here to avoid copy shifting the whole deque. (?)
-    //
-    // Alternatively, move back some elements to bucket_queued.
+    if (transfer == nullptr)
+      goto downloading_error;
 
-    if (std::distance(m_queues.begin(itr.first), itr.second) < static_cast<std::ptrdiff_t>(m_last_unordered_position))
-      m_last_unordered_position--;
+    switch (m_queues.bucket(transfer)) {
+    case bucket_queued:
+      if (transfer != m_queues.front(bucket_queued))
+        prepare_process_unordered(transfer);
 
-    m_transfer = m_queues.take(itr.first, itr.second);
-    break;
+      m_transfer = m_queues.take(transfer);
+      break;
 
-  case bucket_stalled:
-    // Do special handling of unordered pieces.
+    case bucket_unordered:
+    case bucket_stalled:
+      m_transfer = m_queues.take(transfer);
+      break;
 
-    m_transfer = m_queues.take(itr.first, itr.second);
-    break;
-  case bucket_choked:
-    m_transfer = m_queues.take(itr.first, itr.second);
+    case bucket_choked:
+      m_transfer = m_queues.take(transfer);
 
-    // We make sure that the choked queue eventually gets cleared if
-    // the peer has skipped sending some pieces from the choked queue.
-    torrent::this_thread::scheduler()->update_wait_for_ceil_seconds(&m_delay_remove_choked, timeout_choked_received);
-    break;
+      // We make sure that the choked queue eventually gets cleared if
+      // the peer has skipped sending some pieces from the choked queue.
+      torrent::this_thread::scheduler()->update_wait_for_ceil_seconds(&m_delay_remove_choked, timeout_choked_received);
+      break;
 
-  default:
-    goto downloading_error;
-  };
+    default:
+      throw internal_error("RequestList::downloading(...) transfer in an invalid bucket.");
+    };
+  }
 
   // We received an invalid piece length, propably zero length due to
   // the peer not being able to transfer the requested piece.
@@ -263,6 +280,15 @@ RequestList::downloading(const Piece& piece) {
   if (!m_transfer->is_valid())
     return false;
 
+  {
+    auto latency = torrent::this_thread::cached_time() - m_transfer->request_timestamp();
+
+    m_request_latency.insert(latency);
+
+    if (m_download_request_latency != nullptr)
+      m_download_request_latency->insert(latency);
+  }
+
   m_transfer->block()->transfering(m_transfer);
   return true;
 
@@ -330,21 +356,44 @@ RequestList::is_interested_in_active() const {
 
 uint32_t
 RequestList::calculate_pipe_size(uint32_t rate) {
-  // Change into KB.
-  rate /= 1024;
+  if (m_delegator->get_aggressive()) {
+    // Change into KB.
+    rate /= 1024;
+
+    if (rate < 10)
+      m_pipe_size_target = rate / 5 + 1;
+    else
+      m_pipe_size_target = rate / 10 + 2;
+
+  } else if (m_rtt == std::chrono::microseconds{} && m_path_rtt == std::chrono::microseconds{}) {
+    rate /= 1024;
 
-  if (!m_delegator->get_aggressive()) {
     if (rate < 20)
-      return rate + 2;
+      m_pipe_size_target = rate + 2;
     else
-      return rate / 5 + 18;
+      m_pipe_size_target = rate / 5 + 18;
 
   } else {
-    if (rate < 10)
-      return rate / 5 + 1;
-    else
-      return rate / 10 + 2;
+    // The measured rate is limited by the pipe size, so the doubling
+    // lets it grow until the connection is saturated.
+    auto rtt = m_rtt != std::chrono::microseconds{} ? m_rtt : m_path_rtt;
+    uint64_t bdp = uint64_t{rate} * rtt.count() / (uint64_t{1000000} * Delegator::block_size);
+
+    m_pipe_size_target = std::min<uint64_t>(2 * bdp + pipe_size_min, pipe_size_max);
   }
+
+  return m_pipe_size_target;
+}
+
+void
+RequestList::update_rtt(std::chrono::microseconds sample) {
+  if (sample < std::chrono::microseconds{1})
+    sample = std::chrono::microseconds{1};
+
+  if (m_rtt == std::chrono::microseconds{})
+    m_rtt = sample;
+  else
+    m_rtt = (m_rtt * 7 + sample) / 8;
 }
 
 }
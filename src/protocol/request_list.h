@@ -5,9 +5,10 @@
 #include <vector>
 
 #include "torrent/data/block_transfer.h"
+#include "torrent/utils/latency_histogram.h"
 #include "torrent/utils/scheduler.h"
 #include "utils/instrumentation.h"
-#include "utils/queue_buckets.h"
+#include "utils/intrusive_buckets.h"
 
 namespace torrent {
 
@@ -24,11 +25,17 @@ struct request_list_constants {
 
   template <typename Type>
   static void destroy(Type& obj);
+
+  using hook_type = BlockTransfer::queue_hook;
+
+  static hook_type& hook(BlockTransfer* obj)           { return obj->request_hook(); }
+  static uint64_t   key(const BlockTransfer* obj)      { return key(obj->piece()); }
+  static uint64_t   key(const Piece& piece)            { return (uint64_t(piece.index()) << 32) | piece.offset(); }
 };
 
 class RequestList {
 public:
-  using queues_type = torrent::queue_buckets<BlockTransfer*, request_list_constants>;
+  using queues_type = torrent::intrusive_buckets<BlockTransfer, request_list_constants>;
 
   static constexpr int bucket_queued    = 0;
   static constexpr int bucket_unordered = 1;
@@ -38,13 +45,19 @@ public:
   static constexpr std::chrono::microseconds timeout_remove_choked{6s};
   static constexpr std::chrono::microseconds timeout_choked_received{60s};
   static constexpr std::chrono::microseconds timeout_process_unordered{60s};
+  static constexpr std::chrono::microseconds timeout_rtt_probe{30s};
+
+  // Bounds of the pipe size chosen from the round-trip time.
+  static constexpr uint32_t pipe_size_min = 4;
+  static constexpr uint32_t pipe_size_max = 2048;
 
   RequestList();
   ~RequestList();
 
   // Some parameters here, like how fast we are downloading and stuff
-  // when we start considering those.
-  std::vector<const Piece*>  delegate(uint32_t maxPieces);
+  // when we start considering those. With 'allowed_fast' only the
+  // chunks the choking peer allows are requested.
+  std::vector<const Piece*>  delegate(uint32_t maxPieces, bool allowed_fast = false);
 
   void                 stall_initial();
   void                 stall_prolonged();
@@ -57,6 +70,10 @@ public:
   // The returned transfer must still be valid.
   bool                 downloading(const Piece& piece);
 
+  // Drops the request the peer rejected so the block can be delegated
+  // to other peers at once. Returns false if it wasn't requested.
+  bool                 rejected(const Piece& piece);
+
   void                 finished();
   void                 skipped();
 
@@ -77,7 +94,25 @@ public:
   size_t               choked_size() const                { return m_queues.queue_size(bucket_choked); }
 
   uint32_t             pipe_size() const;
+
+  // Once a round-trip time has been measured the pipe is sized to
+  // twice the bandwidth-delay product, otherwise it falls back on a
+  // rate based guess. Until the first request is timed the kernel's
+  // round-trip time of the connection is used, if known. The last
+  // result is kept for monitoring.
   uint32_t             calculate_pipe_size(uint32_t rate);
+  uint32_t             pipe_size_target() const           { return m_pipe_size_target; }
+
+  // Smoothed round-trip time, zero until the first sample.
+  std::chrono::microseconds rtt() const                   { return m_rtt; }
+
+  std::chrono::microseconds path_rtt() const              { return m_path_rtt; }
+  void                 set_path_rtt(std::chrono::microseconds rtt) { m_path_rtt = rtt; }
+
+  // Time from delegating a block to receiving its first byte. Each
+  // sample is also added to the download's histogram, if set.
+  const utils::latency_histogram& request_latency() const { return m_request_latency; }
+  void                 set_download_request_latency(utils::latency_histogram* h) { m_download_request_latency = h; }
 
   Delegator*           delegator()                       { return m_delegator; }
   void                 set_delegator(Delegator* d)       { m_delegator = d; }
@@ -93,9 +128,11 @@ public:
 private:
   void                 delay_remove_choked();
 
-  void                 prepare_process_unordered(queues_type::iterator itr);
+  void                 prepare_process_unordered(BlockTransfer* transfer);
   void                 delay_process_unordered();
 
+  void                 update_rtt(std::chrono::microseconds sample);
+
   Delegator*           m_delegator{};
   PeerChunks*          m_peerChunks{};
 
@@ -107,7 +144,21 @@ private:
 
   std::chrono::microseconds m_last_choke{};
   std::chrono::microseconds m_last_unchoke{};
-  size_t                    m_last_unordered_position{0};
+
+  // Unordered transfers are marked with the current epoch, and those
+  // of past epochs are dropped when the timer runs.
+  uint32_t                  m_unordered_epoch{0};
+
+  // Requests sent while the pipe is empty are answered after one
+  // round-trip, so one such request at a time is used for sampling.
+  Piece                     m_rtt_probe;
+  std::chrono::microseconds m_rtt_probe_time{};
+  std::chrono::microseconds m_rtt{};
+  std::chrono::microseconds m_path_rtt{};
+  uint32_t                  m_pipe_size_target{0};
+
+  utils::latency_histogram  m_request_latency;
+  utils::latency_histogram* m_download_request_latency{};
 
   torrent::utils::SchedulerEntry m_delay_remove_choked;
   torrent::utils::SchedulerEntry m_delay_process_unordered;
@@ -11,6 +11,7 @@
 #include "torrent/net/resolver.h"
 #include "torrent/utils/chrono.h"
 #include "torrent/utils/log.h"
+#include "torrent/utils/scheduler.h"
 #include "utils/instrumentation.h"
 
 namespace torrent {
@@ -46,6 +47,10 @@ ThreadMain::init_thread() {
 
   m_instrumentation_index = INSTRUMENTATION_POLLING_DO_POLL_MAIN - INSTRUMENTATION_POLLING_DO_POLL;
 
+  // The main thread holds the request and handshake timers of every
+  // peer connection.
+  m_scheduler->set_mode(utils::Scheduler::MODE_WHEEL);
+
   init_thread_local();
 
   // We should only initialize things here that depend on main thread, as we want to call
@@ -37,8 +37,10 @@
 #include "config.h"
 
 #include <algorithm>
+#include <map>
+#include <memory>
+#include <mutex>
 
-#include "rak/algorithm.h"
 #include "utils/instrumentation.h"
 
 #include "bitfield.h"
@@ -46,6 +48,94 @@
 
 namespace torrent {
 
+namespace {
+
+using word_type = uint64_t;
+
+inline word_type
+load_word(const Bitfield::value_type* data, Bitfield::size_type index) {
+  word_type w;
+  std::memcpy(&w, data + index * sizeof(word_type), sizeof(word_type));
+  return w;
+}
+
+// Converts between the in-memory word and one where the first bit of
+// the word is the most significant bit.
+inline word_type
+ordered_word(word_type w) {
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+  return __builtin_bswap64(w);
+#else
+  return w;
+#endif
+}
+
+// Mask of the bits [first, last) of an ordered word, with 'last'
+// being at most 64.
+inline word_type
+ordered_mask(unsigned int first, unsigned int last) {
+  return (~word_type() >> first) & (last == 64 ? ~word_type() : ~(~word_type() >> last));
+}
+
+template <bool Set>
+inline void
+assign_range(Bitfield::value_type* data, Bitfield::size_type first, Bitfield::size_type last) {
+  for (; first != last && first % 8 != 0; first++)
+    if (Set)
+      data[first / 8] |= Bitfield::mask_at(first % 8);
+    else
+      data[first / 8] &= ~Bitfield::mask_at(first % 8);
+
+  Bitfield::size_type bytes = (last - first) / 8;
+
+  std::memset(data + first / 8, Set ? ~Bitfield::value_type() : Bitfield::value_type(), bytes);
+  first += bytes * 8;
+
+  for (; first != last; first++)
+    if (Set)
+      data[first / 8] |= Bitfield::mask_at(first % 8);
+    else
+      data[first / 8] &= ~Bitfield::mask_at(first % 8);
+}
+
+// Shared data of the uniform bitfields, keyed by size and whether the
+// bits are set. Never destroyed, as bitfields may outlive it otherwise.
+struct uniform_entry {
+  uint32_t                     references{};
+  std::unique_ptr<word_type[]> words;
+};
+
+using uniform_key = std::pair<Bitfield::size_type, bool>;
+using uniform_map = std::map<uniform_key, uniform_entry>;
+
+std::mutex   uniform_lock;
+uniform_map* uniform_entries = new uniform_map;
+
+void
+append_varint(std::string& str, Bitfield::size_type value) {
+  for (; value >= 0x80; value >>= 7)
+    str.push_back(static_cast<char>(value | 0x80));
+
+  str.push_back(static_cast<char>(value));
+}
+
+bool
+read_varint(const char*& first, const char* last, Bitfield::size_type& value) {
+  value = 0;
+
+  for (unsigned int shift = 0; first != last && shift < 32; shift += 7) {
+    auto byte = static_cast<uint8_t>(*first++);
+    value |= static_cast<Bitfield::size_type>(byte & 0x7f) << shift;
+
+    if (!(byte & 0x80))
+      return true;
+  }
+
+  return false;
+}
+
+}
+
 void
 Bitfield::set_size_bits(size_type s) {
   if (m_data != NULL)
@@ -62,45 +152,103 @@ Bitfield::set_size_set(size_type s) {
   m_set = s;
 }
 
+// Storage is rounded up to whole words, and the last word cleared so
+// the padding after 'size_bytes()' stays zero.
 void
 Bitfield::allocate() { 
   if (m_data != NULL)
     return;
 
-  m_data = new value_type[size_bytes()];
+  auto words = new word_type[size_words()];
+
+  if (size_words() != 0)
+    words[size_words() - 1] = 0;
+
+  m_data = reinterpret_cast<value_type*>(words);
 
-  instrumentation_update(INSTRUMENTATION_MEMORY_BITFIELDS, static_cast<int64_t>(size_bytes()));
+  instrumentation_update(INSTRUMENTATION_MEMORY_BITFIELDS, static_cast<int64_t>(size_words() * sizeof(word_type)));
 }
 
 void
 Bitfield::unallocate() {
+  if (m_shared) {
+    release_shared();
+    return;
+  }
+
   if (m_data == NULL)
     return;
 
-  delete [] m_data;
+  delete [] reinterpret_cast<word_type*>(m_data);
   m_data = NULL;
 
-  instrumentation_update(INSTRUMENTATION_MEMORY_BITFIELDS, -static_cast<int64_t>(size_bytes()));
+  instrumentation_update(INSTRUMENTATION_MEMORY_BITFIELDS, -static_cast<int64_t>(size_words() * sizeof(word_type)));
 }
 
 void
-Bitfield::update() {
-  // Clears the unused bits.
-  clear_tail();
+Bitfield::share_uniform() {
+  if (m_shared || m_data == NULL || m_size == 0 || !(is_all_set() || is_all_unset()))
+    return;
 
-  m_set = 0;
+  auto lock = std::scoped_lock(uniform_lock);
+  auto& entry = (*uniform_entries)[uniform_key(m_size, m_set != 0)];
 
-  iterator itr = m_data;
-  iterator last = end();
+  if (entry.references++ == 0) {
+    entry.words = std::make_unique<word_type[]>(size_words());
+    std::memcpy(entry.words.get(), m_data, size_words() * sizeof(word_type));
 
-  while (itr + sizeof(unsigned int) <= last) {
-    m_set += rak::popcount_wrapper(*reinterpret_cast<unsigned int*>(itr));
-    itr += sizeof(unsigned int);
+    instrumentation_update(INSTRUMENTATION_MEMORY_BITFIELDS, static_cast<int64_t>(size_words() * sizeof(word_type)));
   }
 
-  while (itr != last) {
-    m_set += rak::popcount_wrapper(*itr++);
+  unallocate();
+
+  m_data = reinterpret_cast<value_type*>(entry.words.get());
+  m_shared = true;
+}
+
+void
+Bitfield::copy_shared() {
+  auto words = new word_type[size_words()];
+  std::memcpy(words, m_data, size_words() * sizeof(word_type));
+
+  release_shared();
+
+  m_data = reinterpret_cast<value_type*>(words);
+
+  instrumentation_update(INSTRUMENTATION_MEMORY_BITFIELDS, static_cast<int64_t>(size_words() * sizeof(word_type)));
+}
+
+// The size and set count of a shared bitfield cannot change, so they
+// still give the key of its entry.
+void
+Bitfield::release_shared() {
+  auto lock = std::scoped_lock(uniform_lock);
+  auto itr = uniform_entries->find(uniform_key(m_size, m_set != 0));
+
+  if (itr == uniform_entries->end() || reinterpret_cast<value_type*>(itr->second.words.get()) != m_data)
+    throw internal_error("Bitfield::release_shared() could not find the shared data.");
+
+  if (--itr->second.references == 0) {
+    uniform_entries->erase(itr);
+
+    instrumentation_update(INSTRUMENTATION_MEMORY_BITFIELDS, -static_cast<int64_t>(size_words() * sizeof(word_type)));
   }
+
+  m_data = NULL;
+  m_shared = false;
+}
+
+void
+Bitfield::update() {
+  unshare();
+
+  // Clears the unused bits.
+  clear_tail();
+
+  m_set = 0;
+
+  for (size_type i = 0, last = size_words(); i != last; i++)
+    m_set += __builtin_popcountll(load_word(m_data, i));
 }
 
 void
@@ -112,6 +260,10 @@ Bitfield::copy(const Bitfield& bf) {
 
   if (bf.m_data == NULL) {
     m_data = NULL;
+  } else if (bf.m_shared) {
+    allocate();
+    std::memcpy(m_data, bf.m_data, size_bytes());
+    share_uniform();
   } else {
     allocate();
     std::memcpy(m_data, bf.m_data, size_bytes());
@@ -122,46 +274,173 @@ void
 Bitfield::swap(Bitfield& bf) noexcept {
   std::swap(m_size, bf.m_size);
   std::swap(m_set, bf.m_set);
+  std::swap(m_shared, bf.m_shared);
   std::swap(m_data, bf.m_data);
 }
 
 void
 Bitfield::set_all() {
+  if (m_shared && is_all_set())
+    return;
+
+  unshare();
   m_set = m_size;
 
   std::memset(m_data, ~value_type(), size_bytes());
   clear_tail();
 }
 
+void
+Bitfield::set_range(size_type first, size_type last) {
+  if (first > last || last > m_size)
+    throw internal_error("Bitfield::set_range(...) received an invalid range.");
+
+  unshare();
+  m_set += (last - first) - count_range(first, last);
+  assign_range<true>(m_data, first, last);
+}
+
 void
 Bitfield::unset_all() {
+  if (m_shared && is_all_unset())
+    return;
+
+  unshare();
   m_set = 0;
 
   std::memset(m_data, value_type(), size_bytes());
 }
 
-// Quick hack. Speed improvements would require that m_set is kept
-// up-to-date.
 void
-Bitfield::set_range(size_type first, size_type last) {
-  while (first != last)
-    set(first++);
+Bitfield::unset_range(size_type first, size_type last) {
+  if (first > last || last > m_size)
+    throw internal_error("Bitfield::unset_range(...) received an invalid range.");
+
+  unshare();
+  m_set -= count_range(first, last);
+  assign_range<false>(m_data, first, last);
 }
 
-void
-Bitfield::unset_range(size_type first, size_type last) {
-  while (first != last)
-    unset(first++);
+// The full words in the middle are loaded and combined without any
+// reordering, which lets the compiler vectorize the loop.
+template <typename Op>
+Bitfield::size_type
+Bitfield::count_words(const Bitfield* bf, size_type first, size_type last, Op op) const {
+  if (first > last || last > m_size)
+    throw internal_error("Bitfield::count_words(...) received an invalid range.");
+
+  if (bf != NULL && bf->m_size != m_size)
+    throw internal_error("Bitfield::count_words(...) bitfield size mismatch.");
+
+  if (first == last)
+    return 0;
+
+  const value_type* other = bf != NULL ? bf->m_data : m_data;
+
+  auto word_at = [&](size_type i) { return op(load_word(m_data, i), load_word(other, i)); };
+
+  size_type first_word = first / 64;
+  size_type last_word  = (last - 1) / 64;
+
+  if (first_word == last_word)
+    return __builtin_popcountll(word_at(first_word) & ordered_word(ordered_mask(first % 64, last - last_word * 64)));
+
+  size_type count = __builtin_popcountll(word_at(first_word) & ordered_word(ordered_mask(first % 64, 64)));
+
+  for (size_type i = first_word + 1; i != last_word; i++)
+    count += __builtin_popcountll(word_at(i));
+
+  return count + __builtin_popcountll(word_at(last_word) & ordered_word(ordered_mask(0, last - last_word * 64)));
 }
 
-// size_type
-// Bitfield::count_range(size_type first, size_type last) {
-//   size_type count = 0;
+Bitfield::size_type
+Bitfield::count_range(size_type first, size_type last) const {
+  return count_words(NULL, first, last, [](word_type a, word_type) { return a; });
+}
 
-//   // Some archs have bitcounting instructions, look into writing a
-//   // wrapper for those.
-//   for (iterator itr = m_data, last = end(); itr != last; ++itr)
-//     m_set += bit_count_256[*itr];
-// }
+Bitfield::size_type
+Bitfield::count_and(const Bitfield& bf, size_type first, size_type last) const {
+  return count_words(&bf, first, last, [](word_type a, word_type b) { return a & b; });
+}
+
+Bitfield::size_type
+Bitfield::count_and_not(const Bitfield& bf, size_type first, size_type last) const {
+  return count_words(&bf, first, last, [](word_type a, word_type b) { return a & ~b; });
+}
+
+template <bool Set>
+Bitfield::size_type
+Bitfield::find_first(size_type first) const {
+  if (first >= m_size)
+    return m_size;
+
+  size_type index = first / 64;
+  size_type last  = size_words();
+
+  word_type w = ordered_word(Set ? load_word(m_data, index) : ~load_word(m_data, index)) & ordered_mask(first % 64, 64);
+
+  while (w == 0) {
+    if (++index == last)
+      return m_size;
+
+    w = ordered_word(Set ? load_word(m_data, index) : ~load_word(m_data, index));
+  }
+
+  // The padding bits are unset, so clamp to the size when searching
+  // for unset bits.
+  return std::min<size_type>(index * 64 + __builtin_clzll(w), m_size);
+}
+
+Bitfield::size_type
+Bitfield::find_first_set(size_type first) const {
+  return find_first<true>(first);
+}
+
+Bitfield::size_type
+Bitfield::find_first_unset(size_type first) const {
+  return find_first<false>(first);
+}
+
+std::string
+bitfield_encode_runs(const Bitfield& bitfield) {
+  std::string result;
+
+  Bitfield::size_type position = 0;
+  bool                set = false;
+
+  while (position != bitfield.size_bits()) {
+    auto next = set ? bitfield.find_first_unset(position) : bitfield.find_first_set(position);
+
+    append_varint(result, next - position);
+
+    position = next;
+    set = !set;
+  }
+
+  return result;
+}
+
+bool
+bitfield_decode_runs(Bitfield& bitfield, const char* first, const char* last) {
+  Bitfield::size_type position = 0;
+  bool                set = false;
+
+  bitfield.unset_all();
+
+  while (first != last) {
+    Bitfield::size_type run;
+
+    if (!read_varint(first, last, run) || run > bitfield.size_bits() - position)
+      return false;
+
+    if (set)
+      bitfield.set_range(position, position + run);
+
+    position += run;
+    set = !set;
+  }
+
+  return position == bitfield.size_bits();
+}
 
 }
@@ -38,6 +38,7 @@
 #define LIBTORRENT_BITFIELD_H
 
 #include <cstring>
+#include <string>
 #include <torrent/common.h>
 
 namespace torrent {
@@ -64,6 +65,7 @@ public:
 
   size_type           size_bits() const             { return m_size; }
   size_type           size_bytes() const            { return (m_size + 7) / 8; }
+  size_type           size_words() const            { return (m_size + 63) / 64; }
 
   size_type           size_set() const              { return m_set; }
   size_type           size_unset() const            { return m_size - m_set; }
@@ -80,6 +82,14 @@ public:
   void                allocate();
   void                unallocate();
 
+  // Points a bitfield that is all set or all unset at read-only data
+  // shared by the uniform bitfields of the same size and value, so
+  // that e.g. the bitfields of seeders take no memory of their own.
+  // The data is copied on the first change, or when a mutable
+  // iterator is taken.
+  void                share_uniform();
+  bool                is_shared() const             { return m_shared; }
+
   void                clear()                       { unallocate(); m_size = 0; m_set = 0; }
   void                clear_tail()                  { if (m_size % 8) *(end() - 1) &= mask_before(m_size % 8); }
 
@@ -92,21 +102,36 @@ public:
   void                unset_all();
   void                unset_range(size_type first, size_type last);
 
-  // size_type           count_range(size_type first, size_type last) const;
+  // The data is allocated in whole 64 bit words with the bytes past
+  // 'size_bytes()' kept cleared, so the functions below work a word
+  // at a time. Functions taking another bitfield require it to have
+  // the same size.
+  size_type           count_range(size_type first, size_type last) const;
+
+  // Count the bits set in both bitfields, or set in this and unset in
+  // 'bf'.
+  size_type           count_and(const Bitfield& bf) const                                         { return count_and(bf, 0, m_size); }
+  size_type           count_and(const Bitfield& bf, size_type first, size_type last) const;
+  size_type           count_and_not(const Bitfield& bf) const                                     { return count_and_not(bf, 0, m_size); }
+  size_type           count_and_not(const Bitfield& bf, size_type first, size_type last) const;
+
+  // Returns 'size_bits()' if no bit is found.
+  size_type           find_first_set(size_type first = 0) const;
+  size_type           find_first_unset(size_type first = 0) const;
 
   bool                get(size_type idx) const      { return m_data[idx / 8] & mask_at(idx % 8); }
 
-  void                set(size_type idx)            { m_set += !get(idx); m_data[idx / 8] |=  mask_at(idx % 8); }
-  void                unset(size_type idx)          { m_set -=  get(idx); m_data[idx / 8] &= ~mask_at(idx % 8); }
+  void                set(size_type idx)            { unshare(); m_set += !get(idx); m_data[idx / 8] |=  mask_at(idx % 8); }
+  void                unset(size_type idx)          { unshare(); m_set -=  get(idx); m_data[idx / 8] &= ~mask_at(idx % 8); }
 
-  iterator            begin()                       { return m_data; }
+  iterator            begin()                       { unshare(); return m_data; }
   const_iterator      begin() const                 { return m_data; }
-  iterator            end()                         { return m_data + size_bytes(); }
+  iterator            end()                         { return begin() + size_bytes(); }
   const_iterator      end() const                   { return m_data + size_bytes(); }
 
   size_type           position(const_iterator itr) const  { return (itr - m_data) * 8; }
 
-  void                from_c_str(const char* str)   { std::memcpy(m_data, str, size_bytes()); update(); }
+  void                from_c_str(const char* str)   { std::memcpy(begin(), str, size_bytes()); update(); }
 
   // Remember to use modulo.
   static value_type   mask_at(size_type idx)        { return 1 << (7 - idx); }
@@ -114,12 +139,32 @@ public:
   static value_type   mask_from(size_type idx)      { return static_cast<value_type>(~0) >> idx; }
 
 private:
+  void                unshare()                     { if (m_shared) copy_shared(); }
+  void                copy_shared();
+  void                release_shared();
+
+  template <typename Op>
+  size_type           count_words(const Bitfield* bf, size_type first, size_type last, Op op) const;
+
+  template <bool Set>
+  size_type           find_first(size_type first) const;
+
   size_type           m_size{};
   size_type           m_set{};
+  bool                m_shared{};
 
   value_type*         m_data{};
 };
 
+// Run-length encoding of a bitfield, for resume data. The runs are
+// the lengths of alternating ranges of unset and set bits, starting
+// with unset, each stored as a LEB128 varint.
+//
+// Decoding requires an allocated bitfield of the encoded size, and
+// returns false if the runs do not add up to it.
+std::string bitfield_encode_runs(const Bitfield& bitfield) LIBTORRENT_EXPORT;
+bool        bitfield_decode_runs(Bitfield& bitfield, const char* first, const char* last) LIBTORRENT_EXPORT;
+
 }
 
 #endif
@@ -36,11 +36,19 @@
 
 #include "config.h"
 
+#include <algorithm>
 #include <sys/types.h>
 #include <sys/time.h>
 #include <sys/resource.h>
 
+#include "data/chunk_buffer_pool.h"
+#include "data/chunk_cache.h"
 #include "data/chunk_list.h"
+#include "data/chunk_lru.h"
+#include "data/disk_throttle.h"
+#include "data/io_priority.h"
+#include "data/memory_governor.h"
+#include "data/metadata_cache.h"
 #include "utils/instrumentation.h"
 
 #include "exceptions.h"
@@ -53,14 +61,142 @@ namespace torrent {
 // the client really requires alot more memory it should call this
 // itself.
 ChunkManager::ChunkManager() :
-    m_maxMemoryUsage((estimate_max_memory_usage() * 4) / 5) {
+    m_maxMemoryUsage((estimate_max_memory_usage() * 4) / 5),
+    m_bufferPool(std::make_unique<ChunkBufferPool>()),
+    m_chunkCache(std::make_unique<ChunkCache>()),
+    m_chunkLru(std::make_unique<ChunkLru>()),
+    m_metadataCache(std::make_unique<MetadataCache>(this)),
+    m_diskThrottle(std::make_unique<DiskThrottle>()),
+    m_memoryGovernor(std::make_unique<MemoryGovernor>(this)) {
+
+  m_metadataCache->set_max_size(default_metadata_cache_size);
 }
 
 ChunkManager::~ChunkManager() {
+  m_memoryGovernor->stop();
+  m_metadataCache->clear();
+
   if (m_memoryUsage != 0 || m_memoryBlockCount != 0)
     throw internal_error("ChunkManager::~ChunkManager() m_memoryUsage != 0 || m_memoryBlockCount != 0.");
 }
 
+void
+ChunkManager::set_storage_backend(int backend) {
+  if (backend != storage_mmap && backend != storage_pread)
+    throw input_error("Invalid storage backend.");
+
+  m_storageBackend = backend;
+}
+
+static DiskThrottle::class_type
+disk_io_class(int type) {
+  if (type < ChunkManager::disk_io_read || type > ChunkManager::disk_io_hash)
+    throw input_error("Invalid disk I/O type.");
+
+  return static_cast<DiskThrottle::class_type>(type);
+}
+
+uint64_t
+ChunkManager::disk_max_rate(int type) const {
+  return m_diskThrottle->max_rate(disk_io_class(type));
+}
+
+void
+ChunkManager::set_disk_max_rate(int type, uint64_t bytes) {
+  if (bytes > (uint64_t{1} << 40))
+    throw input_error("Disk rate must be between 0 and 2^40.");
+
+  m_diskThrottle->set_max_rate(disk_io_class(type), bytes);
+}
+
+uint32_t
+ChunkManager::disk_max_iops(int type) const {
+  return m_diskThrottle->max_iops(disk_io_class(type));
+}
+
+void
+ChunkManager::set_disk_max_iops(int type, uint32_t ops) {
+  m_diskThrottle->set_max_iops(disk_io_class(type), ops);
+}
+
+uint64_t
+ChunkManager::disk_rate(int type) const {
+  return m_diskThrottle->rate(disk_io_class(type));
+}
+
+bool
+ChunkManager::is_io_priority() const {
+  return io_priority_enabled();
+}
+
+void
+ChunkManager::set_io_priority(bool state) {
+  io_priority_set_enabled(state);
+}
+
+uint32_t
+ChunkManager::chunk_memory_size(uint32_t chunk_size) const {
+  if (!m_hugePages || m_storageBackend != storage_mmap || chunk_size < huge_page_size)
+    return chunk_size;
+
+  return (chunk_size + huge_page_size - 1) / huge_page_size * huge_page_size;
+}
+
+bool
+ChunkManager::is_memory_governor() const {
+  return m_memoryGovernor->is_active();
+}
+
+void
+ChunkManager::set_memory_governor(bool state) {
+  if (!state) {
+    m_memoryGovernor->stop();
+    return;
+  }
+
+  if (!m_memoryGovernor->start())
+    throw input_error("Could not read the memory usage of the cgroup.");
+}
+
+uint64_t
+ChunkManager::preload_budget() const {
+  if (m_preloadPaused)
+    return 0;
+
+  if (m_preloadBudget == 0)
+    return m_maxMemoryUsage / 16;
+
+  return std::min(m_preloadBudget, m_maxMemoryUsage);
+}
+
+uint64_t
+ChunkManager::paused_budget() const {
+  if (m_pausedBudget == 0)
+    return m_maxMemoryUsage / 8;
+
+  return std::min(m_pausedBudget, m_maxMemoryUsage);
+}
+
+uint64_t
+ChunkManager::chunk_cache_size() const {
+  return m_chunkCache->max_size();
+}
+
+void
+ChunkManager::set_chunk_cache_size(uint64_t bytes) {
+  m_chunkCache->set_max_size(bytes);
+}
+
+uint64_t
+ChunkManager::metadata_cache_size() const {
+  return m_metadataCache->max_size();
+}
+
+void
+ChunkManager::set_metadata_cache_size(uint64_t bytes) {
+  m_metadataCache->set_max_size(bytes);
+}
+
 uint64_t
 ChunkManager::sync_queue_memory_usage() const {
   uint64_t size = 0;
@@ -117,6 +253,8 @@ ChunkManager::erase(ChunkList* chunkList) {
   if (itr == base_type::end())
     throw internal_error("ChunkManager::erase(...) itr == base_type::end().");
 
+  m_chunkCache->erase(chunkList);
+
   std::iter_swap(itr, --base_type::end());
   base_type::pop_back();
 
@@ -125,6 +263,15 @@ ChunkManager::erase(ChunkList* chunkList) {
 
 bool
 ChunkManager::allocate(uint32_t size, int flags) {
+  // Cached chunks are the cheapest to give up, though they are only
+  // unmapped if no peer is using them.
+  if (m_memoryUsage + size > (3 * m_maxMemoryUsage) / 4)
+    m_chunkCache->evict(m_memoryUsage + size - (3 * m_maxMemoryUsage) / 4);
+
+  // Metadata is cheap to encode again when requested.
+  if (m_memoryUsage + size > (3 * m_maxMemoryUsage) / 4)
+    m_metadataCache->evict(m_memoryUsage + size - (3 * m_maxMemoryUsage) / 4);
+
   if (m_memoryUsage + size > (3 * m_maxMemoryUsage) / 4)
     try_free_memory((1 * m_maxMemoryUsage) / 4);
 
@@ -168,16 +315,20 @@ ChunkManager::deallocate(uint32_t size, int flags) {
 
 void
 ChunkManager::try_free_memory(uint64_t size) {
+  uint64_t target = size <= m_memoryUsage ? (m_memoryUsage - size) : 0;
+
+  evict_queued(target);
+
   // Ensure that we don't call this function too often when futile as
   // it might be somewhat expensive.
   //
   // Note that it won't be able to free chunks that are scheduled for
   // hash checking, so a too low max memory setting will give problem
   // at high transfer speed.
-  if (m_timerStarved + 10 >= cachedTime.seconds())
+  if (m_memoryUsage <= target || m_timerStarved + 10 >= cachedTime.seconds())
     return;
 
-  sync_all(0, size <= m_memoryUsage ? (m_memoryUsage - size) : 0);
+  sync_all(0, target);
 
   // The caller must ensure he tries to free a sufficiently large
   // amount of memory to ensure it, and other users, has enough memory
@@ -185,6 +336,47 @@ ChunkManager::try_free_memory(uint64_t size) {
   m_timerStarved = cachedTime.seconds();
 }
 
+// Picks the coldest queued chunks nothing else holds until they cover
+// the memory to free, and hands them to their chunk lists in one batch
+// each. Chunks synced on the disk thread free their memory later.
+void
+ChunkManager::evict_queued(uint64_t target) {
+  if (m_memoryUsage <= target || m_chunkLru->empty())
+    return;
+
+  std::vector<std::pair<ChunkList*, ChunkListNode*>> candidates;
+  uint64_t                                           size = 0;
+
+  for (ChunkListNode* node = m_chunkLru->front(); node != nullptr && m_memoryUsage - size > target; node = m_chunkLru->next(node)) {
+    if (!ChunkList::is_evictable(node) || node->lru_list()->is_write_held(node))
+      continue;
+
+    candidates.emplace_back(node->lru_list(), node);
+    size += std::min<uint64_t>(node->memory_size(), m_memoryUsage - size);
+  }
+
+  if (candidates.empty())
+    return;
+
+  std::stable_sort(candidates.begin(), candidates.end(), [](const auto& a, const auto& b) { return a.first < b.first; });
+
+  ChunkList::Queue nodes;
+
+  for (auto itr = candidates.begin(); itr != candidates.end(); ) {
+    auto last = std::find_if(itr, candidates.end(), [itr](const auto& c) { return c.first != itr->first; });
+
+    nodes.clear();
+
+    for (auto c = itr; c != last; ++c)
+      nodes.push_back(c->second);
+
+    itr->first->evict_chunks(nodes);
+    itr = last;
+  }
+
+  m_statsEvicted += candidates.size();
+}
+
 void
 ChunkManager::periodic_sync() {
   sync_all(ChunkList::sync_use_timeout, 0);
@@ -1,11 +1,19 @@
 #ifndef LIBTORRENT_CHUNK_MANAGER_H
 #define LIBTORRENT_CHUNK_MANAGER_H
 
+#include <memory>
 #include <vector>
 #include <torrent/common.h>
 
 namespace torrent {
 
+class ChunkBufferPool;
+class ChunkCache;
+class ChunkLru;
+class DiskThrottle;
+class MemoryGovernor;
+class MetadataCache;
+
 // TODO: Currently all chunk lists are inserted, despite the download
 // not being open/active.
 
@@ -38,6 +46,16 @@ public:
   uint64_t            max_memory_usage() const                  { return m_maxMemoryUsage; }
   void                set_max_memory_usage(uint64_t bytes)      { m_maxMemoryUsage = bytes; }
 
+  // Adjust the max memory usage, the chunk cache size and preloading
+  // every second to the limit and memory pressure of the process's
+  // cgroup v2, see MemoryGovernor. The values set before enabling are
+  // the upper limits and are restored when disabled, changing them
+  // meanwhile has no lasting effect.
+  //
+  // Throws input_error if the cgroup's memory files can't be read.
+  bool                is_memory_governor() const;
+  void                set_memory_governor(bool state);
+
   // Estimate the max memory usage possible, capped at 1GB.
   static uint64_t     estimate_max_memory_usage();
 
@@ -71,6 +89,153 @@ public:
   uint32_t            preload_required_rate() const             { return m_preloadRequiredRate; }
   void                set_preload_required_rate(uint32_t bytes) { m_preloadRequiredRate = bytes; }
 
+  // Prefetch the chunks queued by unchoked peers on the disk thread,
+  // rather than only preloading the chunk being uploaded.
+  bool                is_preload_adaptive() const               { return m_preloadAdaptive; }
+  void                set_preload_adaptive(bool state)          { m_preloadAdaptive = state; }
+
+  // The memory prefetched chunks may hold, defaults to a sixteenth of
+  // the max memory usage when set to 0.
+  uint64_t            preload_budget() const;
+  void                set_preload_budget(uint64_t bytes)        { m_preloadBudget = bytes; }
+
+  uint64_t            preload_memory_usage() const              { return m_preloadMemoryUsage; }
+
+  // For internal usage, prefetching stops while paused.
+  bool                is_preload_paused() const                 { return m_preloadPaused; }
+  void                set_preload_paused(bool state)            { m_preloadPaused = state; }
+
+  // For internal usage.
+  void                inc_preload_memory_usage(uint32_t bytes)  { m_preloadMemoryUsage += bytes; }
+  void                dec_preload_memory_usage(uint32_t bytes)  { m_preloadMemoryUsage -= bytes; }
+
+  // Chunks are either mmap'ed, or read into pooled buffers with
+  // pread and written back with pwrite when synced. Only chunks
+  // created after the change use the new backend.
+  static constexpr int storage_mmap  = 0;
+  static constexpr int storage_pread = 1;
+
+  int                 storage_backend() const                   { return m_storageBackend; }
+  void                set_storage_backend(int backend);
+
+  // With the mmap backend, the parts of chunks spanning several files
+  // that are smaller than this are read into pooled buffers as with
+  // the pread backend. This avoids a mapping per file for torrents
+  // with many tiny files, but the parts are read with blocking preads
+  // on the main thread when the chunk is created. Disabled by default.
+  static constexpr uint32_t default_buffered_part_size = 0;
+
+  uint32_t            buffered_part_size() const                { return m_bufferedPartSize; }
+  void                set_buffered_part_size(uint32_t bytes)    { m_bufferedPartSize = bytes; }
+
+  // Chunks being downloaded are read into pooled buffers also with
+  // the mmap backend, so received blocks are collected in memory and
+  // written back per file part with one pwrite. Syncs and evictions
+  // hold them back until they pass the hash check, and closing the
+  // download drops them, thus failed data never reaches the disk.
+  bool                is_buffered_writes() const                { return m_bufferedWrites; }
+  void                set_buffered_writes(bool state)           { m_bufferedWrites = state; }
+
+  // Hand periodic chunk syncs to the disk thread as a batch instead of
+  // calling msync/pwrite on the main thread. Syncs of all chunks, as
+  // done when closing a download, stay blocking.
+  bool                is_async_write() const                    { return m_asyncWrite; }
+  void                set_async_write(bool state)               { m_asyncWrite = state; }
+
+  // Once the disk thread has written a chunk, wait for it to reach
+  // the disk and advise the kernel to drop it from the page cache, so
+  // that bulk downloads don't evict the data being seeded. Only used
+  // with async writes, and pages still mapped by mmap'ed chunks are
+  // kept.
+  bool                is_drop_cache() const                     { return m_dropCache; }
+  void                set_drop_cache(bool state)                { m_dropCache = state; }
+
+  // Map mmap'ed chunk parts of at least 'huge_page_size' bytes at
+  // addresses aligned with their file offset modulo the huge page
+  // size, and advise the kernel to back them with transparent huge
+  // pages. This cuts TLB misses when hashing and uploading large
+  // pieces, on file systems whose page cache supports large folios.
+  //
+  // Such chunks are accounted in 'memory_usage' rounded up to whole
+  // huge pages. Only chunks created after the change are affected.
+  static constexpr uint32_t huge_page_size = 2 << 20;
+
+  bool                is_huge_pages() const                     { return m_hugePages; }
+  void                set_huge_pages(bool state)                { m_hugePages = state; }
+
+  // Give the disk I/O of hash checks, preloads and writes done off the
+  // main thread kernel I/O priorities by job, with rechecks in the
+  // idle class and preloads for uploads first, see 'io_priority.h'.
+  // Linux only.
+  bool                is_io_priority() const;
+  void                set_io_priority(bool state);
+
+  // Hash check the chunks of a download in the order of their address
+  // on the device, where the file system can tell, rather than by
+  // index. Saves seeking on rotating disks with fragmented files.
+  bool                is_hash_physical_order() const            { return m_hashPhysicalOrder; }
+  void                set_hash_physical_order(bool state)       { m_hashPhysicalOrder = state; }
+
+  // The bytes of rechecked chunks all downloads may have queued for
+  // hashing, each download always gets one. Unlimited when set to 0,
+  // leaving only the per-download limit.
+  uint64_t            hash_recheck_budget() const               { return m_hashRecheckBudget; }
+  void                set_hash_recheck_budget(uint64_t bytes)   { m_hashRecheckBudget = bytes; }
+
+  uint64_t            hash_recheck_usage() const                { return m_hashRecheckUsage; }
+
+  // For internal usage.
+  void                inc_hash_recheck_usage(uint32_t bytes)    { m_hashRecheckUsage += bytes; }
+  void                dec_hash_recheck_usage(uint32_t bytes)    { m_hashRecheckUsage -= bytes; }
+
+  // Caps the bytes and operations per second of the disk I/O done on
+  // the disk thread and device queues for reads, writes and hash
+  // checks, zero being unlimited. Covers preloads, hashing, and the
+  // writes and syncs of async writes; the main thread only skips
+  // preloads when over the read limit. The rates are of all I/O done
+  // through the throttle.
+  static constexpr int disk_io_read  = 0;
+  static constexpr int disk_io_write = 1;
+  static constexpr int disk_io_hash  = 2;
+
+  uint64_t            disk_max_rate(int type) const;
+  void                set_disk_max_rate(int type, uint64_t bytes);
+
+  uint32_t            disk_max_iops(int type) const;
+  void                set_disk_max_iops(int type, uint32_t ops);
+
+  uint64_t            disk_rate(int type) const;
+
+  // For internal usage.
+  DiskThrottle*       disk_throttle()                           { return m_diskThrottle.get(); }
+
+  // The memory accounted for a chunk of 'chunk_size' bytes.
+  uint32_t            chunk_memory_size(uint32_t chunk_size) const;
+
+  // Keep recently uploaded chunks mapped, evicted by ARC once the
+  // cached chunks exceed this many bytes. Set to 0 to disable.
+  uint64_t            chunk_cache_size() const;
+  void                set_chunk_cache_size(uint64_t bytes);
+
+  // Keep the bencoded info dictionaries of downloads serving
+  // ut_metadata requests, evicted least recently used first once they
+  // exceed this many bytes. Set to 0 to disable.
+  static constexpr uint64_t default_metadata_cache_size = 16 << 20;
+
+  uint64_t            metadata_cache_size() const;
+  void                set_metadata_cache_size(uint64_t bytes);
+
+  // The cached chunks paused downloads may keep, defaults to an
+  // eighth of the max memory usage when set to 0.
+  uint64_t            paused_budget() const;
+  void                set_paused_budget(uint64_t bytes)         { m_pausedBudget = bytes; }
+
+  // For internal usage.
+  ChunkBufferPool*    buffer_pool()                             { return m_bufferPool.get(); }
+  ChunkCache*         chunk_cache()                             { return m_chunkCache.get(); }
+  ChunkLru*           chunk_lru()                               { return m_chunkLru.get(); }
+  MetadataCache*      metadata_cache()                          { return m_metadataCache.get(); }
+  MemoryGovernor*     memory_governor()                         { return m_memoryGovernor.get(); }
 
   void                insert(ChunkList* chunkList);
   void                erase(ChunkList* chunkList);
@@ -92,6 +257,9 @@ public:
   bool                allocate(uint32_t size, int flags = 0);
   void                deallocate(uint32_t size, int flags = 0);
 
+  // Frees the least recently used chunks queued for syncing by any
+  // download, falling back to syncing every download at most once
+  // every 10 seconds.
   void                try_free_memory(uint64_t size);
 
   void                periodic_sync();
@@ -104,11 +272,19 @@ public:
   uint32_t            stats_not_preloaded() const               { return m_statsNotPreloaded; }
   void                inc_stats_not_preloaded()                 { m_statsNotPreloaded++; }
 
+  // Uploads that found their chunk already prefetched.
+  uint32_t            stats_preload_hits() const                { return m_statsPreloadHits; }
+  void                inc_stats_preload_hits()                  { m_statsPreloadHits++; }
+
+  // Queued chunks freed or handed to the sync to free memory.
+  uint32_t            stats_evicted() const                     { return m_statsEvicted; }
+
 private:
   ChunkManager(const ChunkManager&) = delete;
   ChunkManager& operator=(const ChunkManager&) = delete;
 
   void                sync_all(int flags, uint64_t target) LIBTORRENT_NO_EXPORT;
+  void                evict_queued(uint64_t target) LIBTORRENT_NO_EXPORT;
 
   uint64_t            m_memoryUsage{0};
   uint64_t            m_maxMemoryUsage;
@@ -122,9 +298,32 @@ private:
   uint32_t            m_preloadType{0};
   uint32_t            m_preloadMinSize{256 << 10};
   uint32_t            m_preloadRequiredRate{5 << 10};
+  bool                m_preloadAdaptive{false};
+  uint64_t            m_preloadBudget{0};
+  uint64_t            m_preloadMemoryUsage{0};
+  bool                m_preloadPaused{false};
+  uint64_t            m_pausedBudget{0};
+
+  int                 m_storageBackend{storage_mmap};
+  uint32_t            m_bufferedPartSize{default_buffered_part_size};
+  bool                m_asyncWrite{false};
+  bool                m_bufferedWrites{false};
+  bool                m_dropCache{false};
+  bool                m_hugePages{false};
+  bool                m_hashPhysicalOrder{false};
+  uint64_t            m_hashRecheckBudget{0};
+  uint64_t            m_hashRecheckUsage{0};
+  std::unique_ptr<ChunkBufferPool> m_bufferPool;
+  std::unique_ptr<ChunkCache>      m_chunkCache;
+  std::unique_ptr<ChunkLru>        m_chunkLru;
+  std::unique_ptr<MetadataCache>   m_metadataCache;
+  std::unique_ptr<DiskThrottle>    m_diskThrottle;
+  std::unique_ptr<MemoryGovernor>  m_memoryGovernor;
 
   uint32_t            m_statsPreloaded{0};
   uint32_t            m_statsNotPreloaded{0};
+  uint32_t            m_statsPreloadHits{0};
+  uint32_t            m_statsEvicted{0};
 
   int32_t             m_timerStarved{0};
   size_type           m_lastFreed{0};
@@ -31,6 +31,7 @@ enum tracker_enum {
 // headers clean.
 class AddressList;
 class AvailableList;
+class BindList;
 class Bitfield;
 class Block;
 class BlockFailed;
@@ -52,6 +53,7 @@ class DownloadWrapper;
 class FileList;
 class FileManager;
 class Event;
+class EventJournal;
 class File;
 class FileList;
 class Handshake;
@@ -60,7 +62,9 @@ class HashString;
 class Listen;
 class Manager;
 class MemoryChunk;
+class MemoryManager;
 class Object;
+class object_view;
 class Path;
 class Peer;
 class PeerConnectionBase;
@@ -71,6 +75,7 @@ class Poll;
 class ProtocolExtension;
 class Rate;
 class ResourceManager;
+class SessionStore;
 class SocketSet;
 class Throttle;
 class TrackerController;
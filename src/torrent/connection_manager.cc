@@ -1,14 +1,17 @@
 #include "config.h"
 
+#include <algorithm>
 #include <sys/types.h>
 
 #include "manager.h"
 #include "thread_main.h"
+#include "net/bind_list.h"
 #include "net/listen.h"
 #include "rak/socket_address.h"
 #include "torrent/connection_manager.h"
 #include "torrent/error.h"
 #include "torrent/exceptions.h"
+#include "torrent/utils/log.h"
 
 namespace torrent {
 
@@ -16,14 +19,21 @@ ConnectionManager::ConnectionManager() :
   m_bindAddress((new rak::socket_address())->c_sockaddr()),
   m_localAddress((new rak::socket_address())->c_sockaddr()),
   m_proxyAddress((new rak::socket_address())->c_sockaddr()),
-  m_listen(new Listen) {
+  m_listen(new Listen),
+  m_bind_list(new BindList) {
 
   rak::socket_address::cast_from(m_bindAddress)->clear();
   rak::socket_address::cast_from(m_localAddress)->clear();
   rak::socket_address::cast_from(m_proxyAddress)->clear();
+
+  m_task_connect.slot() = [this] { receive_connect(); };
 }
 
 ConnectionManager::~ConnectionManager() {
+  if (m_task_connect.is_scheduled())
+    torrent::this_thread::scheduler()->erase(&m_task_connect);
+
+  delete m_bind_list;
   delete m_listen;
 
   delete m_bindAddress;
@@ -36,6 +46,53 @@ ConnectionManager::can_connect() const {
   return m_size < m_maxSize;
 }
 
+// The budget is the time since the last attempt was accounted for at
+// the connect rate, capped at one second.
+uint32_t
+ConnectionManager::connect_budget() const {
+  if (m_connect_rate == 0)
+    return unlimited_connect_budget;
+
+  auto now  = torrent::this_thread::cached_time();
+  auto base = std::max(m_connect_time, now - std::chrono::microseconds(1s));
+
+  if (base >= now)
+    return 0;
+
+  return (now - base).count() * m_connect_rate / std::chrono::microseconds(1s).count();
+}
+
+void
+ConnectionManager::consume_connect_budget(uint32_t attempts) {
+  if (m_connect_rate == 0 || attempts == 0)
+    return;
+
+  auto now = torrent::this_thread::cached_time();
+
+  m_connect_time = std::max(m_connect_time, now - std::chrono::microseconds(1s));
+  m_connect_time += std::chrono::microseconds(1s) * attempts / m_connect_rate;
+}
+
+void
+ConnectionManager::request_connect() {
+  if (!m_task_connect.is_scheduled())
+    torrent::this_thread::scheduler()->wait_for(&m_task_connect, std::chrono::microseconds(0));
+}
+
+void
+ConnectionManager::receive_connect() {
+  if (!m_slot_connect || !m_slot_connect_deficit)
+    return;
+
+  uint32_t budget = connect_budget();
+
+  if (budget != 0)
+    consume_connect_budget(m_slot_connect(budget));
+
+  if (m_connect_rate != 0 && m_slot_connect_deficit() != 0)
+    torrent::this_thread::scheduler()->wait_for(&m_task_connect, 1s);
+}
+
 void
 ConnectionManager::set_send_buffer_size(uint32_t s) {
   m_sendBufferSize = s;
@@ -81,6 +138,57 @@ ConnectionManager::set_proxy_address(const sockaddr* sa) {
   rak::socket_address::cast_from(m_proxyAddress)->copy(*rsa, rsa->length());
 }
 
+uint32_t
+ConnectionManager::bind_address_count() const {
+  return m_bind_list->size();
+}
+
+const sockaddr*
+ConnectionManager::bind_address_at(uint32_t index) const {
+  return m_bind_list->at(index).address.c_sockaddr();
+}
+
+uint32_t
+ConnectionManager::bind_address_weight(uint32_t index) const {
+  return m_bind_list->at(index).weight;
+}
+
+Throttle*
+ConnectionManager::bind_upload_throttle(uint32_t index) {
+  return m_bind_list->at(index).upload_throttle;
+}
+
+Throttle*
+ConnectionManager::bind_download_throttle(uint32_t index) {
+  return m_bind_list->at(index).download_throttle;
+}
+
+void
+ConnectionManager::add_bind_address(const sockaddr* sa, uint32_t weight) {
+  if (m_listen->is_open())
+    throw input_error("bind addresses must be set before listen port is opened");
+
+  m_bind_list->insert(sa, weight);
+}
+
+void
+ConnectionManager::clear_bind_addresses() {
+  if (m_listen->is_open())
+    throw input_error("bind addresses must be set before listen port is opened");
+
+  m_bind_list->clear();
+}
+
+uint32_t
+ConnectionManager::bind_selection() const {
+  return m_bind_list->selection();
+}
+
+void
+ConnectionManager::set_bind_selection(uint32_t s) {
+  m_bind_list->set_selection(s);
+}
+
 uint32_t
 ConnectionManager::filter(const sockaddr* sa) {
   if (!m_slot_filter)
@@ -89,18 +197,45 @@ ConnectionManager::filter(const sockaddr* sa) {
     return m_slot_filter(sa);
 }
 
+// With bind addresses the port is picked on the first address, the
+// others then listen on the same port. An address that cannot does
+// not accept connections, but is still used for outgoing ones.
 bool
 ConnectionManager::listen_open(port_type begin, port_type end) {
-  if (!m_listen->open(begin, end, m_listen_backlog, rak::socket_address::cast_from(m_bindAddress)))
+  const rak::socket_address* bind_address = rak::socket_address::cast_from(m_bindAddress);
+
+  if (!m_bind_list->empty())
+    bind_address = &m_bind_list->at(0).address;
+
+  if (!m_listen->open(begin, end, m_listen_backlog, bind_address))
     return false;
 
   m_listen_port = m_listen->port();
 
+  for (uint32_t i = 1; i < m_bind_list->size(); i++) {
+    auto& entry = m_bind_list->at(i);
+
+    entry.listen = std::make_unique<Listen>();
+    entry.listen->set_shards(m_listen->shards());
+    entry.listen->set_incoming_cpu(m_listen->is_incoming_cpu());
+    entry.listen->set_defer_accept(m_listen->defer_accept());
+    entry.listen->slot_accepted() = m_listen->slot_accepted();
+
+    if (!entry.listen->open(m_listen_port, m_listen_port, m_listen_backlog, &entry.address)) {
+      lt_log_print(LOG_CONNECTION_LISTEN, "could not open listen port %" PRIu16 " on bind address %s",
+                   m_listen_port, entry.address.address_str().c_str());
+      entry.listen.reset();
+    }
+  }
+
   return true;
 }
 
 void
 ConnectionManager::listen_close() {
+  for (uint32_t i = 1; i < m_bind_list->size(); i++)
+    m_bind_list->at(i).listen.reset();
+
   m_listen->close();
 }
 
@@ -115,4 +250,57 @@ ConnectionManager::set_listen_backlog(int v) {
   m_listen_backlog = v;
 }
 
+void
+ConnectionManager::set_connect_diversity(uint32_t p) {
+  if (p > 100)
+    throw input_error("connect diversity must be a percentage");
+
+  m_connect_diversity = p;
+}
+
+uint32_t
+ConnectionManager::listen_shards() const {
+  return m_listen->shards();
+}
+
+bool
+ConnectionManager::listen_incoming_cpu() const {
+  return m_listen->is_incoming_cpu();
+}
+
+void
+ConnectionManager::set_listen_shards(uint32_t v) {
+  if (v < 1 || v > 256)
+    throw input_error("listen shards value out of bounds");
+
+  if (m_listen->is_open())
+    throw input_error("listen shards value must be set before listen port is opened");
+
+  m_listen->set_shards(v);
+}
+
+void
+ConnectionManager::set_listen_incoming_cpu(bool state) {
+  if (m_listen->is_open())
+    throw input_error("listen incoming cpu must be set before listen port is opened");
+
+  m_listen->set_incoming_cpu(state);
+}
+
+uint32_t
+ConnectionManager::listen_defer_accept() const {
+  return m_listen->defer_accept();
+}
+
+void
+ConnectionManager::set_listen_defer_accept(uint32_t seconds) {
+  if (seconds > 600)
+    throw input_error("listen defer accept value out of bounds");
+
+  if (m_listen->is_open())
+    throw input_error("listen defer accept must be set before listen port is opened");
+
+  m_listen->set_defer_accept(seconds);
+}
+
 }
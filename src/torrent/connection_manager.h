@@ -3,12 +3,14 @@
 
 #include <functional>
 #include <list>
+#include <string>
 #include <arpa/inet.h>
 #include <netinet/in.h>
 #include <netinet/in_systm.h>
 #include <netinet/ip.h>
 #include <sys/socket.h>
 #include <torrent/common.h>
+#include <torrent/utils/scheduler.h>
 
 namespace torrent {
 
@@ -46,6 +48,10 @@ public:
   // Internal to libtorrent.
   static constexpr uint32_t encryption_use_proxy        = (1 << 6);
   static constexpr uint32_t encryption_retrying         = (1 << 7);
+  static constexpr uint32_t encryption_use_utp          = (1 << 8);
+
+  static constexpr uint32_t utp_incoming                = (1 << 0);
+  static constexpr uint32_t utp_outgoing                = (1 << 1);
 
   enum {
     handshake_incoming           = 1,
@@ -62,6 +68,11 @@ public:
   using slot_filter_type   = std::function<uint32_t(const sockaddr*)>;
   using slot_throttle_type = std::function<ThrottlePair(const sockaddr*)>;
 
+  using slot_connect_type         = std::function<uint32_t(uint32_t budget)>;
+  using slot_connect_deficit_type = std::function<uint32_t()>;
+
+  static constexpr uint32_t unlimited_connect_budget = ~uint32_t();
+
   ConnectionManager();
   ~ConnectionManager();
   ConnectionManager(const ConnectionManager&) = delete;
@@ -91,6 +102,30 @@ public:
   void                set_receive_buffer_size(uint32_t s);
   void                set_encryption_options(uint32_t options); 
 
+  // Socket tuning applied to new peer connections, zero or empty
+  // leaves the kernel default. See fd_set_tcp_notsent_lowat etc.
+  uint32_t            notsent_lowat() const                   { return m_notsent_lowat; }
+  const std::string&  congestion() const                      { return m_congestion; }
+  uint32_t            busy_poll() const                       { return m_busy_poll; }
+
+  void                set_notsent_lowat(uint32_t bytes)       { m_notsent_lowat = bytes; }
+  void                set_congestion(const std::string& name) { m_congestion = name; }
+  void                set_busy_poll(uint32_t usec)            { m_busy_poll = usec; }
+
+  // Connections whose upload or download rate reaches 'fast_peer_rate'
+  // get the fast buffer sizes, and return to the default sizes when
+  // below half of it. Checked every 30 seconds, zero disables.
+  //
+  // With default sizes of zero the buffers of a demoted connection are
+  // left as they are, the kernel's autotuning cannot be restored.
+  uint32_t            fast_peer_rate() const                  { return m_fast_peer_rate; }
+  uint32_t            fast_send_buffer_size() const           { return m_fast_send_buffer_size; }
+  uint32_t            fast_receive_buffer_size() const        { return m_fast_receive_buffer_size; }
+
+  void                set_fast_peer_rate(uint32_t bytes)      { m_fast_peer_rate = bytes; }
+  void                set_fast_send_buffer_size(uint32_t s)   { m_fast_send_buffer_size = s; }
+  void                set_fast_receive_buffer_size(uint32_t s) { m_fast_receive_buffer_size = s; }
+
   // Setting the addresses creates a copy of the address.
   const sockaddr*     bind_address() const                    { return m_bindAddress; }
   const sockaddr*     local_address() const                   { return m_localAddress; }
@@ -100,6 +135,31 @@ public:
   void                set_local_address(const sockaddr* sa);
   void                set_proxy_address(const sockaddr* sa);
 
+  // Local addresses of a multi-homed host, which replace the bind
+  // address for peer connections. Each outgoing connection is bound to
+  // one of them, picked by weighted round-robin or as the address with
+  // the least traffic per weight, and the listen port is opened on all
+  // of them. Must be set before the port is opened.
+  //
+  // Peer connections through an address use its own throttles instead
+  // of the global throttles, unlimited until given a max rate. The
+  // tracker and DHT sockets keep using the bind address.
+  static constexpr uint32_t bind_select_round_robin  = 0;
+  static constexpr uint32_t bind_select_least_loaded = 1;
+
+  uint32_t            bind_address_count() const;
+  const sockaddr*     bind_address_at(uint32_t index) const;
+  uint32_t            bind_address_weight(uint32_t index) const;
+
+  Throttle*           bind_upload_throttle(uint32_t index);
+  Throttle*           bind_download_throttle(uint32_t index);
+
+  void                add_bind_address(const sockaddr* sa, uint32_t weight = 1);
+  void                clear_bind_addresses();
+
+  uint32_t            bind_selection() const;
+  void                set_bind_selection(uint32_t s);
+
   uint32_t            filter(const sockaddr* sa);
   void                set_filter(const slot_filter_type& s)   { m_slot_filter = s; }
 
@@ -114,12 +174,29 @@ public:
   void                set_listen_port(port_type p)            { m_listen_port = p; }
   void                set_listen_backlog(int v);
 
+  // Number of SO_REUSEPORT sockets accepting on the listen port, the
+  // extra sockets are served by the network thread. With
+  // 'listen_incoming_cpu' each socket receives the connections handled
+  // by the matching cpu. Must be set before the port is opened.
+  uint32_t            listen_shards() const;
+  bool                listen_incoming_cpu() const;
+  void                set_listen_shards(uint32_t v);
+  void                set_listen_incoming_cpu(bool state);
+
+  // Have the kernel hold incoming connections until the peer sends
+  // data, for up to 'seconds'. Connections handed over without any
+  // data are then dropped before a handshake is created. Must be set
+  // before the port is opened.
+  uint32_t            listen_defer_accept() const;
+  void                set_listen_defer_accept(uint32_t seconds);
+
   // The slot returns a ThrottlePair to use for the given address, or
   // NULLs to use the default throttle.
   slot_throttle_type& address_throttle()  { return m_slot_address_throttle; }
 
   // For internal usage.
   Listen*             listen()            { return m_listen; }
+  BindList*           bind_list()         { return m_bind_list; }
 
   bool                is_block_ipv4() const  { return m_block_ipv4; }
   void                set_block_ipv4(bool v) { m_block_ipv4 = v; }
@@ -130,6 +207,69 @@ public:
   bool                is_prefer_ipv6() const  { return m_prefer_ipv6; }
   void                set_prefer_ipv6(bool v) { m_prefer_ipv6 = v; }
 
+  // Upload piece data to unencrypted peers with sendfile instead of
+  // copying it out of the mapped chunk. Ignored when libtorrent was
+  // built without sendfile support.
+  bool                is_zero_copy_upload() const  { return m_zero_copy_upload; }
+  void                set_zero_copy_upload(bool v) { m_zero_copy_upload = v; }
+
+  // Register peer connections edge-triggered, which keeps their poll
+  // interest changes out of the kernel. Only affects connections
+  // opened afterwards, and is ignored by the kqueue and io_uring
+  // backends.
+  bool                is_edge_triggered() const    { return m_edge_triggered; }
+  void                set_edge_triggered(bool v)   { m_edge_triggered = v; }
+
+  // Accept and open uTP connections, sharing the UDP socket of the
+  // DHT which must be running. Outgoing uTP connections that fail
+  // before the peer answers are retried over TCP.
+  uint32_t            utp_options() const          { return m_utp_options; }
+  void                set_utp_options(uint32_t o)  { m_utp_options = o; }
+
+  // Announce the public downloads with local service discovery (BEP
+  // 14) while the listen port is open, and connect to the peers
+  // announced by others. Local peers bypass the global throttles and
+  // are prioritized when unchoking. Applied on the next tick.
+  bool                is_local_discovery() const   { return m_local_discovery; }
+  void                set_local_discovery(bool v)  { m_local_discovery = v; }
+
+  // Limit outgoing connection attempts to this many per second, with
+  // bursts of up to a second's worth. Zero for no limit.
+  uint32_t            connect_rate() const         { return m_connect_rate; }
+  void                set_connect_rate(uint32_t r) { m_connect_rate = r; }
+
+  // Pick connection candidates as the best of 'connect_samples'
+  // random addresses, scored by the rtt of earlier connections, the
+  // address prefix shared with ours and the client's hint. The hint
+  // could rate peers in the same AS or region, see connect_score for
+  // the scale. To keep trying other peers, 'connect_diversity' percent
+  // of the candidates are still picked at random. Zero or one samples
+  // picks all at random.
+  using slot_connect_score_type = std::function<int64_t(const sockaddr*)>;
+
+  uint32_t            connect_samples() const          { return m_connect_samples; }
+  void                set_connect_samples(uint32_t s)  { m_connect_samples = s; }
+
+  uint32_t            connect_diversity() const        { return m_connect_diversity; }
+  void                set_connect_diversity(uint32_t p);
+
+  slot_connect_score_type& slot_connect_score()        { return m_slot_connect_score; }
+
+  // For internal usage.
+  //
+  // When rate limited, downloads call request_connect() instead of
+  // connecting directly. The attempts allowed by the budget are then
+  // handed out in batches by 'slot_connect', which returns the number
+  // of attempts made, and repeated every second while
+  // 'slot_connect_deficit' reports downloads still want more peers.
+  uint32_t            connect_budget() const;
+  void                consume_connect_budget(uint32_t attempts);
+
+  void                request_connect();
+
+  slot_connect_type&         slot_connect()         { return m_slot_connect; }
+  slot_connect_deficit_type& slot_connect_deficit() { return m_slot_connect_deficit; }
+
 private:
   size_type           m_size{0};
   size_type           m_maxSize{0};
@@ -139,11 +279,20 @@ private:
   uint32_t            m_receiveBufferSize{0};
   int                 m_encryptionOptions{encryption_none};
 
+  uint32_t            m_notsent_lowat{0};
+  std::string         m_congestion;
+  uint32_t            m_busy_poll{0};
+
+  uint32_t            m_fast_peer_rate{0};
+  uint32_t            m_fast_send_buffer_size{0};
+  uint32_t            m_fast_receive_buffer_size{0};
+
   sockaddr*           m_bindAddress;
   sockaddr*           m_localAddress;
   sockaddr*           m_proxyAddress;
 
   Listen*             m_listen;
+  BindList*           m_bind_list;
   port_type           m_listen_port{0};
   uint32_t            m_listen_backlog{SOMAXCONN};
 
@@ -153,6 +302,22 @@ private:
   bool                m_block_ipv4{false};
   bool                m_block_ipv6{false};
   bool                m_prefer_ipv6{false};
+  bool                m_zero_copy_upload{false};
+  bool                m_edge_triggered{false};
+  bool                m_local_discovery{false};
+  uint32_t            m_utp_options{0};
+
+  void                receive_connect();
+
+  uint32_t                  m_connect_rate{0};
+  uint32_t                  m_connect_samples{0};
+  uint32_t                  m_connect_diversity{25};
+  slot_connect_score_type   m_slot_connect_score;
+  std::chrono::microseconds m_connect_time{};
+
+  utils::SchedulerEntry     m_task_connect;
+  slot_connect_type         m_slot_connect;
+  slot_connect_deficit_type m_slot_connect_deficit;
 };
 
 }
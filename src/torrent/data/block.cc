@@ -80,12 +80,22 @@ Block::~Block() {
   delete m_failedList;
 }
 
+size_t
+Block::sizeof_heap() const {
+  size_t size = m_queued.sizeof_heap() + m_transfers.sizeof_heap() + size_all() * sizeof(BlockTransfer);
+
+  if (m_failedList != NULL)
+    size += sizeof(BlockFailed) + m_failedList->capacity() * sizeof(BlockFailed::value_type) + m_failedList->size() * m_piece.length();
+
+  return size;
+}
+
 BlockTransfer*
 Block::insert(PeerInfo* peerInfo) {
   if (find_queued(peerInfo) || find_transfer(peerInfo))
     return NULL;
 
-  m_notStalled++;
+  inc_not_stalled();
 
   auto itr = m_queued.insert(m_queued.end(), new BlockTransfer());
 
@@ -94,6 +104,7 @@ Block::insert(PeerInfo* peerInfo) {
   (*itr)->set_piece(m_piece);
   (*itr)->set_state(BlockTransfer::STATE_QUEUED);
   (*itr)->set_request_time(cachedTime.seconds());
+  (*itr)->set_request_timestamp(this_thread::cached_time());
   (*itr)->set_position(0);
   (*itr)->set_stall(0);
   (*itr)->set_failed_index(BlockFailed::invalid_index);
@@ -109,7 +120,8 @@ Block::erase(BlockTransfer* transfer) {
   if (transfer->peer_info() != NULL)
     throw internal_error("Block::erase(...) transfer has non-null peer info");
 
-  m_notStalled -= transfer->stall() == 0;
+  if (transfer->stall() == 0)
+    dec_not_stalled();
 
   if (transfer->is_queued()) {
     auto itr = std::find(m_queued.begin(), m_queued.end(), transfer);
@@ -227,7 +239,8 @@ Block::completed(BlockTransfer* transfer) {
   if (static_cast<Block::size_type>(std::count_if(m_parent->begin(), m_parent->end(), std::mem_fn(&Block::is_finished))) < m_parent->finished())
     throw internal_error("Block::completed(...) Finished blocks too large.");
 
-  m_notStalled -= transfer->stall() == 0;
+  if (transfer->stall() == 0)
+    dec_not_stalled();
 
   transfer->set_block(NULL);
   transfer->set_stall(~uint32_t());
@@ -251,6 +264,9 @@ Block::completed(BlockTransfer* transfer) {
   if (m_transfers.empty() || m_transfers.back() != transfer)
     throw internal_error("Block::completed(...) m_transfers.empty() || m_transfers.back() != transfer.");
 
+  if (m_notStalled == 0)
+    m_parent->dec_stalled();
+
   m_state = STATE_COMPLETED;
 
   return m_parent->is_all_finished();
@@ -258,6 +274,9 @@ Block::completed(BlockTransfer* transfer) {
 
 void
 Block::retry_transfer() {
+  if (m_state == STATE_COMPLETED && m_notStalled == 0)
+    m_parent->inc_stalled();
+
   m_state = STATE_INCOMPLETE;
 }
 
@@ -270,7 +289,8 @@ Block::transfer_dissimilar(BlockTransfer* transfer) {
   if (!transfer->is_not_leader() || m_leader == transfer)
     throw internal_error("Block::transfer_dissimilar(...) transfer is the leader.");
 
-  m_notStalled -= transfer->stall() == 0;
+  if (transfer->stall() == 0)
+    dec_not_stalled();
 
   // Why not just delete? Gets done by completed(), though when
   // erasing the leader we need to remove dissimilar unless we have
@@ -287,7 +307,7 @@ Block::stalled_transfer(BlockTransfer* transfer) {
     if (m_notStalled == 0)
       throw internal_error("Block::stalled(...) m_notStalled == 0.");
 
-    m_notStalled--;
+    dec_not_stalled();
 
     // Do magic here.
   }
@@ -363,13 +383,26 @@ Block::invalidate_transfer(BlockTransfer* transfer) {
     return; // Consider if this should be an exception.
   }
 
-  m_notStalled -= (transfer->stall() == 0);
+  if (transfer->stall() == 0)
+    dec_not_stalled();
 
   // Do the canceling magic here. 
   if (transfer->peer_info()->connection() != NULL)
     transfer->peer_info()->connection()->cancel_transfer(transfer);
 }
 
+void
+Block::inc_not_stalled() {
+  if (m_notStalled++ == 0 && m_state == STATE_INCOMPLETE)
+    m_parent->dec_stalled();
+}
+
+void
+Block::dec_not_stalled() {
+  if (--m_notStalled == 0 && m_state == STATE_INCOMPLETE)
+    m_parent->inc_stalled();
+}
+
 void
 Block::remove_erased_transfers() {
   auto split = std::stable_partition(m_transfers.begin(), m_transfers.end(), [](auto block) { return !block->is_erased(); });
@@ -4,6 +4,7 @@
 #include <vector>
 #include <torrent/common.h>
 #include <torrent/data/block_transfer.h>
+#include <torrent/data/block_transfer_list.h>
 #include <cstdlib>
 
 namespace torrent {
@@ -13,10 +14,9 @@ namespace torrent {
 
 class LIBTORRENT_EXPORT Block {
 public:
-  // Using vectors as they will remain small, thus the cost of erase
-  // should be small. Later we can do faster erase by ignoring the
-  // ordering.
-  using transfer_list_type = std::vector<BlockTransfer*>;
+  // The lists remain small, thus the cost of erase should be small.
+  // Later we can do faster erase by ignoring the ordering.
+  using transfer_list_type = block_transfer_list;
   using size_type          = uint32_t;
 
   enum state_type {
@@ -89,6 +89,10 @@ public:
   BlockFailed*              failed_list()                                { return m_failedList; }
   void                      set_failed_list(BlockFailed* f)              { m_failedList = f; }
 
+  // Bytes allocated by the block outside the BlockList's array,
+  // including its transfers and failed data.
+  size_t                    sizeof_heap() const;
+
   static void               create_dummy(BlockTransfer* transfer, PeerInfo* peerInfo, const Piece& piece);
 
   // If the queued or transfering is already removed from the block it
@@ -99,6 +103,10 @@ private:
 
   void                      invalidate_transfer(BlockTransfer* transfer) LIBTORRENT_NO_EXPORT;
 
+  // Keeps the parent's count of stalled incomplete blocks in sync.
+  void                      inc_not_stalled() LIBTORRENT_NO_EXPORT;
+  void                      dec_not_stalled() LIBTORRENT_NO_EXPORT;
+
   void                      remove_erased_transfers() LIBTORRENT_NO_EXPORT;
   void                      remove_non_leader_transfers() LIBTORRENT_NO_EXPORT;
 
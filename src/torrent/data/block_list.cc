@@ -39,6 +39,10 @@
 #include <algorithm>
 #include <functional>
 
+#include "data/chunk.h"
+#include "data/chunk_iterator.h"
+#include "utils/sha1.h"
+
 #include "block_transfer.h"
 #include "block_list.h"
 #include "exceptions.h"
@@ -67,19 +71,91 @@ BlockList::BlockList(const Piece& piece, uint32_t blockLength) :
 
   base_type::back().set_parent(this);
   base_type::back().set_piece(Piece(m_piece.index(), offset, (m_piece.length() % blockLength) ? m_piece.length() % blockLength : blockLength));
+
+  m_stalled = size();
 }
 
 // The default dtor's handles cleaning up the blocks and block transfers.
 BlockList::~BlockList() = default;
 
+size_t
+BlockList::sizeof_data() const {
+  size_t size = sizeof(BlockList) + capacity() * sizeof(Block);
+
+  for (const auto& block : *this)
+    size += block.sizeof_heap();
+
+  if (m_hash != nullptr)
+    size += sizeof(Sha1);
+
+  return size;
+}
+
 void
 BlockList::do_all_failed() {
   clear_finished();
   set_attempt(0);
+  hash_reset();
 
   // Clear leaders when we want to redownload the chunk.
   std::for_each(begin(), end(), std::mem_fn(&Block::failed_leader));
   std::for_each(begin(), end(), std::mem_fn(&Block::retry_transfer));
 }
 
+void
+BlockList::do_blocks_failed(const std::vector<size_type>& blocks) {
+  for (auto index : blocks) {
+    Block& block = (*this)[index];
+
+    if (!block.is_finished())
+      throw internal_error("BlockList::do_blocks_failed(...) block is not finished.");
+
+    block.failed_leader();
+    block.retry_transfer();
+    m_finished--;
+  }
+
+  hash_reset();
+}
+
+void
+BlockList::hash_finished_blocks(Chunk* chunk) {
+  if (m_hash == nullptr) {
+    m_hash = std::make_unique<Sha1>();
+    m_hash->init();
+  }
+
+  for (; m_hash_blocks != size() && (*this)[m_hash_blocks].is_finished(); m_hash_blocks++) {
+    const Piece& piece = (*this)[m_hash_blocks].piece();
+
+    if (piece.offset() != m_hash_position || piece.offset() + piece.length() > chunk->chunk_size())
+      throw internal_error("BlockList::hash_finished_blocks(...) block out of range.");
+
+    ChunkIterator itr(chunk, piece.offset(), piece.offset() + piece.length());
+
+    do {
+      Chunk::data_type data = itr.data();
+      m_hash->update(data.first, data.second);
+    } while (itr.next());
+
+    m_hash_position += piece.length();
+  }
+}
+
+void
+BlockList::hash_final(char* buffer) {
+  if (m_hash == nullptr || !is_hash_complete())
+    throw internal_error("BlockList::hash_final(...) hash is not complete.");
+
+  m_hash->final_c(buffer);
+  hash_reset();
+}
+
+void
+BlockList::hash_reset() {
+  m_hash.reset();
+  m_hash_blocks = 0;
+  m_hash_position = 0;
+}
+
 }
@@ -1,6 +1,7 @@
 #ifndef LIBTORRENT_BLOCK_LIST_H
 #define LIBTORRENT_BLOCK_LIST_H
 
+#include <memory>
 #include <vector>
 #include <torrent/common.h>
 #include <torrent/data/block.h>
@@ -8,6 +9,8 @@
 
 namespace torrent {
 
+class Sha1;
+
 class LIBTORRENT_EXPORT BlockList : private std::vector<Block> {
 public:
   using size_type = uint32_t;
@@ -45,6 +48,13 @@ public:
   void                inc_finished()                { m_finished++; }
   void                clear_finished()              { m_finished = 0; }
 
+  // Incomplete blocks with no active transfer, these are the ones
+  // that can be delegated without duplicating requests.
+  size_type           stalled() const               { return m_stalled; }
+  bool                has_stalled() const           { return m_stalled != 0; }
+  void                inc_stalled()                 { m_stalled++; }
+  void                dec_stalled()                 { m_stalled--; }
+
   uint32_t            failed() const                { return m_failed; }
 
   // Temporary, just increment for now.
@@ -60,17 +70,43 @@ public:
   bool                by_seeder() const             { return m_bySeeder; }
   void                set_by_seeder(bool state)     { m_bySeeder = state; }
 
+  // Memory used by the in-flight piece, excluding the chunk.
+  size_t              sizeof_data() const;
+
   void                do_all_failed();
 
+  // Re-downloads only the listed blocks, keeping the data of the
+  // others in the chunk.
+  void                do_blocks_failed(const std::vector<size_type>& blocks);
+
+  // Finished blocks are hashed in order as they complete, so the
+  // chunk hash is usually ready once the last block arrives. Blocks
+  // finished out of order are read back from 'chunk' when the gap
+  // before them is filled.
+  uint32_t            hash_position() const         { return m_hash_position; }
+  bool                is_hash_complete() const      { return m_hash_position == m_piece.length(); }
+
+  void                hash_finished_blocks(Chunk* chunk);
+
+  // Writes the hash and resets the incremental hash, which must be
+  // complete.
+  void                hash_final(char* buffer);
+  void                hash_reset();
+
 private:
   Piece               m_piece;
   priority_enum       m_priority{PRIORITY_OFF};
 
   size_type           m_finished{0};
+  size_type           m_stalled{0};
   uint32_t            m_failed{0};
   uint32_t            m_attempt{0};
 
   bool                m_bySeeder{false};
+
+  std::unique_ptr<Sha1> m_hash;
+  size_type           m_hash_blocks{0};
+  uint32_t            m_hash_position{0};
 };
 
 }
@@ -16,6 +16,14 @@ public:
 
   using key_type = PeerInfo*;
 
+  // Links of the request queues of the peer connection.
+  struct queue_hook {
+    BlockTransfer*    prev{};
+    BlockTransfer*    next{};
+    int               bucket{-1};
+    uint32_t          mark{};
+  };
+
   enum state_type {
     STATE_ERASED,
     STATE_QUEUED,
@@ -49,6 +57,9 @@ public:
   state_type          state() const                 { return m_state; }
   int32_t             request_time() const          { return m_request_time; }
 
+  // Cached time when the block was delegated to the peer.
+  std::chrono::microseconds request_timestamp() const { return m_request_timestamp; }
+
   // Adjust the position after any actions like erasing it from a
   // Block, but before if finishing.
   uint32_t            position() const              { return m_position; }
@@ -60,6 +71,7 @@ public:
   void                set_piece(const Piece& p)     { m_piece = p; }
   void                set_state(state_type s)       { m_state = s; }
   void                set_request_time(int32_t t)   { m_request_time = t; }
+  void                set_request_timestamp(std::chrono::microseconds t) { m_request_timestamp = t; }
 
   void                set_position(uint32_t p)      { m_position = p; }
   void                adjust_position(uint32_t p)   { m_position += p; }
@@ -67,6 +79,8 @@ public:
   void                set_stall(uint32_t s)         { m_stall = s; }
   void                set_failed_index(uint32_t i)  { m_failedIndex = i; }
 
+  queue_hook&         request_hook()                { return m_request_hook; }
+
 private:
   key_type            m_peer_info{};
   Block*              m_block{};
@@ -74,10 +88,13 @@ private:
 
   state_type          m_state;
   int32_t             m_request_time;
+  std::chrono::microseconds m_request_timestamp{};
 
   uint32_t            m_position;
   uint32_t            m_stall;
   uint32_t            m_failedIndex;
+
+  queue_hook          m_request_hook;
 };
 
 inline
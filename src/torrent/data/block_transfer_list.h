@@ -0,0 +1,117 @@
+#ifndef LIBTORRENT_DATA_BLOCK_TRANSFER_LIST_H
+#define LIBTORRENT_DATA_BLOCK_TRANSFER_LIST_H
+
+#include <algorithm>
+#include <cstdint>
+#include <torrent/common.h>
+
+namespace torrent {
+
+// Transfers of a block, usually one or two, so they are kept inline in
+// the Block and only spill to the heap in endgame or when many peers
+// are queued for the same block. Iterators are plain pointers and are
+// invalidated by insertions.
+
+class LIBTORRENT_EXPORT block_transfer_list {
+public:
+  using value_type     = BlockTransfer*;
+  using iterator       = BlockTransfer**;
+  using const_iterator = BlockTransfer* const*;
+  using size_type      = uint32_t;
+
+  static constexpr size_type inline_size = 2;
+
+  block_transfer_list() = default;
+  ~block_transfer_list()                                   { if (is_overflow()) delete[] m_storage.heap; }
+
+  block_transfer_list(const block_transfer_list&) = delete;
+  block_transfer_list& operator=(const block_transfer_list&) = delete;
+
+  block_transfer_list(block_transfer_list&& other) noexcept { swap(other); }
+  block_transfer_list& operator=(block_transfer_list&& other) noexcept { swap(other); return *this; }
+
+  bool                is_overflow() const                  { return m_capacity > inline_size; }
+
+  bool                empty() const                        { return m_size == 0; }
+  size_type           size() const                         { return m_size; }
+  size_type           capacity() const                     { return m_capacity; }
+
+  // Bytes allocated outside the owning object.
+  size_t              sizeof_heap() const                  { return is_overflow() ? m_capacity * sizeof(value_type) : 0; }
+
+  iterator            begin()                              { return data(); }
+  iterator            end()                                { return data() + m_size; }
+  const_iterator      begin() const                        { return data(); }
+  const_iterator      end() const                          { return data() + m_size; }
+
+  value_type&         front()                              { return *begin(); }
+  value_type&         back()                               { return *(end() - 1); }
+  value_type          front() const                        { return *begin(); }
+  value_type          back() const                         { return *(end() - 1); }
+
+  value_type&         operator[](size_type i)              { return data()[i]; }
+  value_type          operator[](size_type i) const        { return data()[i]; }
+
+  iterator            insert(iterator position, value_type v);
+  iterator            erase(iterator position)             { return erase(position, position + 1); }
+  iterator            erase(iterator first, iterator last);
+
+  void                push_back(value_type v)              { insert(end(), v); }
+  void                clear()                              { m_size = 0; }
+
+  void                swap(block_transfer_list& other) noexcept;
+
+private:
+  union storage_type {
+    value_type        inline_data[inline_size];
+    value_type*       heap;
+  };
+
+  iterator            data()                               { return is_overflow() ? m_storage.heap : m_storage.inline_data; }
+  const_iterator      data() const                         { return is_overflow() ? m_storage.heap : m_storage.inline_data; }
+
+  size_type           m_size{0};
+  size_type           m_capacity{inline_size};
+  storage_type        m_storage{};
+};
+
+inline block_transfer_list::iterator
+block_transfer_list::insert(iterator position, value_type v) {
+  size_type index = position - begin();
+
+  if (m_size == m_capacity) {
+    auto heap = new value_type[m_capacity * 2];
+    std::copy(begin(), end(), heap);
+
+    if (is_overflow())
+      delete[] m_storage.heap;
+
+    m_storage.heap = heap;
+    m_capacity *= 2;
+  }
+
+  std::copy_backward(begin() + index, end(), end() + 1);
+  m_size++;
+
+  data()[index] = v;
+  return begin() + index;
+}
+
+inline block_transfer_list::iterator
+block_transfer_list::erase(iterator first, iterator last) {
+  auto new_end = std::copy(last, end(), first);
+
+  m_size = new_end - begin();
+  return first;
+}
+
+inline void
+block_transfer_list::swap(block_transfer_list& other) noexcept {
+  std::swap(m_size, other.m_size);
+  std::swap(m_capacity, other.m_capacity);
+  std::swap(m_storage, other.m_storage);
+}
+
+}
+
+#endif
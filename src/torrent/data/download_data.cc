@@ -36,6 +36,8 @@
 
 #include "config.h"
 
+#include <algorithm>
+
 #include "torrent/exceptions.h"
 
 #include "download_data.h"
@@ -72,6 +74,29 @@ download_data::calc_wanted_chunks() const {
   return result;
 }
 
+// Calculate the number of chunks in [first, last> remaining to be
+// downloaded.
+uint32_t
+download_data::calc_wanted_chunks(uint32_t first, uint32_t last) const {
+  if (first >= last || m_completed_bitfield.is_all_set())
+    return 0;
+
+  uint32_t result = 0;
+
+  for (auto ranges : { &m_normal_priority, &m_high_priority }) {
+    for (auto itr = ranges->find(first); itr != ranges->end() && itr->first < last; itr++) {
+      uint32_t idx = std::max(itr->first, first);
+      uint32_t idx_last = std::min(itr->second, last);
+
+      // Chunks in both ranges are only counted in the normal priority ones.
+      for (; idx != idx_last; idx++)
+        result += !m_completed_bitfield.get(idx) && (ranges == &m_normal_priority || !m_normal_priority.has(idx));
+    }
+  }
+
+  return result;
+}
+
 void
 download_data::verify_wanted_chunks(const char* where) const {
   if (m_wanted_chunks != calc_wanted_chunks())
@@ -6,6 +6,7 @@
 #include <torrent/common.h>
 #include <torrent/bitfield.h>
 #include <torrent/hash_string.h>
+#include <torrent/utils/latency_histogram.h>
 #include <torrent/utils/ranges.h>
 
 namespace torrent {
@@ -31,12 +32,27 @@ public:
   const Bitfield*        completed_bitfield() const    { return &m_completed_bitfield; }
   const Bitfield*        untouched_bitfield() const    { return &m_untouched_bitfield; }
 
+  // Changes whenever the completed bitfield may have been modified.
+  uint64_t               completed_generation() const  { return m_completed_generation; }
+
   const priority_ranges* high_priority() const         { return &m_high_priority; }
   const priority_ranges* normal_priority() const       { return &m_normal_priority; }
 
   uint32_t               wanted_chunks() const         { return m_wanted_chunks; }
 
+  // The device holding the root directory, zero if unknown.
+  uint64_t               device() const                { return m_device; }
+
+  // Time taken by chunk syncs, measured from when the disk thread was
+  // handed the chunk for asynchronous writes.
+  const utils::latency_histogram& sync_latency() const { return m_sync_latency; }
+
+  // The share of disk I/O relative to other downloads, the chunks
+  // this download hashes in a row when taking turns with others.
+  uint32_t               disk_weight() const           { return m_disk_weight; }
+
   uint32_t               calc_wanted_chunks() const;
+  uint32_t               calc_wanted_chunks(uint32_t first, uint32_t last) const;
   void                   verify_wanted_chunks(const char* where) const;
 
   slot_void&             slot_initial_hash() const        { return m_slot_initial_hash; }
@@ -54,15 +70,20 @@ protected:
 
   HashString&            mutable_hash()                { return m_hash; }
 
-  Bitfield*              mutable_completed_bitfield()  { return &m_completed_bitfield; }
+  Bitfield*              mutable_completed_bitfield()  { m_completed_generation++; return &m_completed_bitfield; }
   Bitfield*              mutable_untouched_bitfield()  { return &m_untouched_bitfield; }
 
   priority_ranges*       mutable_high_priority()       { return &m_high_priority; }
   priority_ranges*       mutable_normal_priority()     { return &m_normal_priority; }
 
+  utils::latency_histogram* mutable_sync_latency()     { return &m_sync_latency; }
+
   void                   update_wanted_chunks()        { m_wanted_chunks = calc_wanted_chunks(); }
   void                   set_wanted_chunks(uint32_t n) { m_wanted_chunks = n; }
 
+  void                   set_device(uint64_t device)   { m_device = device; }
+  void                   set_disk_weight(uint32_t w)   { m_disk_weight = w; }
+
   void                   call_download_done()          { if (m_slot_download_done) m_slot_download_done(); }
   void                   call_partially_done()         { if (m_slot_partially_done) m_slot_partially_done(); }
   void                   call_partially_restarted()    { if (m_slot_partially_restarted) m_slot_partially_restarted(); }
@@ -72,11 +93,16 @@ private:
 
   Bitfield               m_completed_bitfield;
   Bitfield               m_untouched_bitfield;
+  uint64_t               m_completed_generation{0};
 
   priority_ranges        m_high_priority;
   priority_ranges        m_normal_priority;
 
   uint32_t               m_wanted_chunks{0};
+  uint64_t               m_device{0};
+  uint32_t               m_disk_weight{1};
+
+  utils::latency_histogram m_sync_latency;
 
   mutable slot_void      m_slot_initial_hash;
   mutable slot_void      m_slot_download_done;
@@ -1,12 +1,17 @@
 #include "config.h"
 
 #include <cassert>
+#include <memory>
+#include <unistd.h>
 #include <rak/error_number.h>
 #include <rak/file_stat.h>
 
 #include "data/memory_chunk.h"
 #include "data/socket_file.h"
+#include "data/thread_disk.h"
 #include "torrent/exceptions.h"
+#include "torrent/utils/log.h"
+#include "torrent/utils/thread.h"
 
 #include "file.h"
 #include "file_manager.h"
@@ -25,6 +30,7 @@ const int File::flag_prioritize_first;
 const int File::flag_prioritize_last;
 
 const int File::flag_attr_padding;
+const int File::flag_allocating;
 
 File::~File() {
   assert((is_padding() || !is_open()) && "File::~File() called on an open file.");
@@ -76,8 +82,10 @@ File::prepare(int prot, int flags) {
   // set. If so don't quit as we need to try re-sizing, instead call
   // resize_file.
 
-  if (is_open() && has_permissions(prot))
+  if (is_open() && has_permissions(prot)) {
+    manager->file_manager()->touch(this);
     return true;
+  }
 
   // For now don't allow overridding this check in prepare.
   if (m_flags & flag_create_queued)
@@ -142,7 +150,14 @@ File::resize_file() {
   if (!SocketFile(m_fd).set_size(m_size))
     return false;
 
-  if (m_flags & flag_fallocate) {
+  // Deselected files are left sparse, so that only the blocks of
+  // chunks shared with wanted neighbours take up space.
+  if ((m_flags & flag_fallocate) && m_priority != PRIORITY_OFF) {
+    if (thread_disk() != nullptr && thread_self() != nullptr) {
+      allocate_async();
+      return true;
+    }
+
     // Only do non-blocking fallocate.
     if (!SocketFile(m_fd).allocate(m_size, SocketFile::flag_fallocate))
       return false;
@@ -151,4 +166,55 @@ File::resize_file() {
   return true;
 }
 
+// Preallocating large files may take seconds, so it is done on the
+// disk thread with a duplicate of the descriptor. The file already
+// has its final size and may be used meanwhile, and as the disk
+// thread isn't blocking anything it may fall back to writing zeros.
+//
+// A failed preallocation only leaves the file sparse, so it is logged
+// rather than treated as a storage error.
+void
+File::allocate_async() {
+  int dup_fd = ::dup(m_fd);
+
+  if (dup_fd == -1) {
+    SocketFile(m_fd).allocate(m_size, SocketFile::flag_fallocate);
+    return;
+  }
+
+  // Shared so that the descriptor is closed even if the job is
+  // canceled before it runs.
+  auto fd = std::shared_ptr<int>(new int(dup_fd), [](int* p) {
+      ::close(*p);
+      delete p;
+    });
+
+  utils::Thread* thread = thread_self();
+  uint64_t       size   = m_size;
+
+  m_flags |= flag_allocating;
+
+  thread_disk()->callback(this, [this, thread, fd, size]() {
+      bool success = SocketFile(*fd).allocate(size, SocketFile::flag_fallocate | SocketFile::flag_fallocate_blocking);
+
+      thread->callback(this, [this, success]() {
+          m_flags &= ~flag_allocating;
+
+          if (!success)
+            lt_log_print(LOG_STORAGE_WARN, "Could not preallocate file '%s'.", m_frozen_path.c_str());
+        });
+    });
+}
+
+void
+File::cancel_allocate() {
+  if (!is_allocating())
+    return;
+
+  thread_disk()->cancel_callback_and_wait(this);
+  thread_self()->cancel_callback_and_wait(this);
+
+  m_flags &= ~flag_allocating;
+}
+
 }
@@ -9,6 +9,7 @@ namespace torrent {
 class LIBTORRENT_EXPORT File {
 public:
   friend class FileList;
+  friend class FileManager;
 
   using range_type = std::pair<uint32_t, uint32_t>;
 
@@ -23,6 +24,13 @@ public:
 
   static constexpr int flag_attr_padding       = (1 << 7);
 
+  // Set by libtorrent while the file is being preallocated.
+  static constexpr int flag_allocating         = (1 << 8);
+
+  // Set by libtorrent while a lazily opened file waits for its first
+  // access to create its directories and open it.
+  static constexpr int flag_prepare_queued     = (1 << 9);
+
   File() =default;
   ~File();
 
@@ -36,6 +44,8 @@ public:
   bool                is_resize_queued() const                 { return m_flags & flag_resize_queued; }
   bool                is_previously_created() const            { return m_flags & flag_previously_created; }
   bool                is_padding() const                       { return m_flags & flag_attr_padding; }
+  bool                is_allocating() const                    { return m_flags & flag_allocating; }
+  bool                is_prepare_queued() const                { return m_flags & flag_prepare_queued; }
 
   bool                has_flags(int flags)                     { return m_flags & flags; }
 
@@ -105,6 +115,8 @@ private:
   File& operator=(const File&) = delete;
 
   bool                resize_file();
+  void                allocate_async();
+  void                cancel_allocate();
 
   int                 m_fd{-1};
   int                 m_protection{0};
@@ -117,6 +129,12 @@ private:
   uint64_t            m_size{0};
   uint64_t            m_last_touched{0};
 
+  // Position in FileManager and its list of open files, ordered from
+  // least to most recently touched.
+  uint32_t            m_manager_index{0};
+  File*               m_lru_prev{};
+  File*               m_lru_next{};
+
   range_type          m_range;
 
   uint32_t            m_completed{0};
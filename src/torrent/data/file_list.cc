@@ -16,13 +16,18 @@
 #include "manager.h"
 #include "piece.h"
 #include "data/chunk.h"
+#include "data/chunk_buffer_pool.h"
+#include "data/file_relocation.h"
 #include "data/memory_chunk.h"
 #include "data/socket_file.h"
+#include "data/thread_disk.h"
+#include "torrent/chunk_manager.h"
 #include "torrent/exceptions.h"
 #include "torrent/path.h"
 #include "torrent/data/file.h"
 #include "torrent/data/file_manager.h"
 #include "torrent/utils/log.h"
+#include "torrent/utils/thread.h"
 
 #define LT_LOG_FL(log_level, log_fmt, ...)                              \
   lt_log_print_data(LOG_STORAGE_##log_level, (&m_data), "file_list", log_fmt, __VA_ARGS__);
@@ -81,6 +86,11 @@ FileList::is_multi_file() const {
   return m_multi_file;
 }
 
+size_t
+FileList::size_allocating_files() const {
+  return std::count_if(begin(), end(), [](const auto& file) { return file->is_allocating(); });
+}
+
 uint64_t
 FileList::completed_bytes() const {
   // Chunk size needs to be cast to a uint64_t for the below to work.
@@ -146,17 +156,30 @@ FileList::set_max_file_size(uint64_t size) {
 
 // This function should really ensure that we arn't dealing files
 // spread over multiple mount-points.
+//
+// The disk thread keeps the free space sampled, so this is cheap
+// enough for the write path.
 uint64_t
 FileList::free_diskspace() const {
   uint64_t freeDiskspace = std::numeric_limits<uint64_t>::max();
 
   for (const auto& link : m_indirect_links) {
-    rak::fs_stat stat;
+    uint64_t bytes;
 
-    if (!stat.update(link))
-      continue;
+    if (thread_disk() != nullptr) {
+      if (!thread_disk()->disk_space()->free_space(link, this_thread::cached_time(), &bytes))
+        continue;
+
+    } else {
+      rak::fs_stat stat;
 
-    freeDiskspace = std::min<uint64_t>(freeDiskspace, stat.bytes_avail());
+      if (!stat.update(link))
+        continue;
+
+      bytes = stat.bytes_avail();
+    }
+
+    freeDiskspace = std::min<uint64_t>(freeDiskspace, bytes);
   }
 
   return freeDiskspace != std::numeric_limits<uint64_t>::max() ? freeDiskspace : 0;
@@ -182,9 +205,10 @@ FileList::split(iterator position, split_type* first, split_type* last) {
   size_type index = std::distance(begin(), position);
   size_type length = std::distance(first, last);
 
-  // This is inefficient, but the simplest way to do it with unique_ptr vector i could find.
-  for (size_type i = 0; i < length - 1; i++)
-    base_type::insert(begin() + index, nullptr);
+  m_file_ends.clear();
+
+  base_type new_files(length - 1);
+  base_type::insert(begin() + index, std::make_move_iterator(new_files.begin()), std::make_move_iterator(new_files.end()));
 
   position = begin() + index;
 
@@ -216,6 +240,8 @@ FileList::iterator
 FileList::merge(iterator first, iterator last, const Path& path) {
   auto new_file = std::make_unique<File>();
 
+  m_file_ends.clear();
+
   // Set the path before deleting any iterators in case it refers to
   // one of the objects getting deleted.
   *(new_file->mutable_path()) = path;
@@ -327,6 +353,7 @@ FileList::initialize(uint64_t torrentSize, uint32_t chunkSize) {
   m_chunk_size = chunkSize;
   m_torrent_size = torrentSize;
   m_root_dir = ".";
+  m_file_ends.clear();
 
   m_data.mutable_completed_bitfield()->set_size_bits((size_bytes() + chunk_size() - 1) / chunk_size());
 
@@ -402,6 +429,19 @@ FileList::open(int flags) {
 
       entry->set_flags_protected(File::flag_active);
 
+      if ((flags & open_lazy) && !(flags & open_no_create)) {
+        entry->set_flags_protected(File::flag_prepare_queued);
+
+        // Zero-length files are never touched by create_chunk, so
+        // create them now.
+        if (entry->size_bytes() == 0 && !prepare_queued_file(entry.get()))
+          throw storage_error("Could not open file: " + std::string(rak::error_number::current().c_str()));
+
+        continue;
+      }
+
+      entry->unset_flags_protected(File::flag_prepare_queued);
+
       if (!open_file(&*entry, lastPath, flags)) {
         // This needs to check if the error was due to open_no_create
         // being set or not.
@@ -418,10 +458,12 @@ FileList::open(int flags) {
 
   } catch (local_error& e) {
     for (auto& entry : *this) {
-      entry->unset_flags_protected(File::flag_active);
+      entry->unset_flags_protected(File::flag_active | File::flag_prepare_queued);
       manager->file_manager()->close(entry.get());
     }
 
+    m_created_directories.clear();
+
     if (itr == end()) {
       LT_LOG_FL(ERROR, "Failed to prepare file list: %s", e.what());
     } else {
@@ -437,6 +479,10 @@ FileList::open(int flags) {
   m_is_open = true;
   m_frozen_root_dir = m_root_dir;
 
+  // Disk I/O is queued per device, see ThreadDisk::device_queue().
+  rak::file_stat root_stat;
+  m_data.set_device(root_stat.update(m_root_dir) ? root_stat.device() : 0);
+
   // For meta-downloads, if the file exists, we have to assume that
   // it is either 0 or 1 length or the correct size. If the size
   // turns out wrong later, a storage_error will be thrown elsewhere
@@ -459,20 +505,76 @@ FileList::close() {
 
   LT_LOG_FL(INFO, "Closing.", 0);
 
+  // A copy still in progress is finished before being dropped, and its
+  // targets are left in place.
+  if (m_is_relocating) {
+    thread_disk()->cancel_callback_and_wait(this);
+    thread_self()->cancel_callback_and_wait(this);
+
+    m_is_relocating = false;
+
+    if (auto slot = std::move(m_slot_relocate))
+      slot("Download closed during relocation.");
+
+    m_slot_relocate = slot_relocate();
+  }
+
   for (auto& entry : *this) {
     if (entry->is_padding())
       continue;
 
-    entry->unset_flags_protected(File::flag_active);
+    entry->unset_flags_protected(File::flag_active | File::flag_prepare_queued);
+    entry->cancel_allocate();
     manager->file_manager()->close(entry.get());
   }
 
   m_is_open = false;
   m_indirect_links.clear();
+  m_created_directories.clear();
 
   m_data.mutable_completed_bitfield()->unallocate();
 }
 
+std::vector<uint64_t>
+FileList::chunk_physical_addresses() const {
+  std::vector<uint64_t> addresses(size_chunks(), ~uint64_t());
+  std::vector<SocketFile::extent_type> extents;
+
+  for (const auto& entry : *this) {
+    if (entry->is_padding() || entry->size_bytes() == 0 || entry->frozen_path().empty())
+      continue;
+
+    SocketFile fd;
+
+    if (!fd.open(entry->frozen_path(), MemoryChunk::prot_read, 0))
+      continue;
+
+    bool has_extents = fd.read_extents(&extents);
+    fd.close();
+
+    if (!has_extents)
+      continue;
+
+    // The chunks starting in this file, the extents are in logical
+    // order.
+    uint64_t end = entry->offset() + entry->size_bytes();
+    auto     itr = extents.begin();
+
+    for (uint64_t index = (entry->offset() + chunk_size() - 1) / chunk_size();
+         index < size_chunks() && index * chunk_size() < end; index++) {
+      uint64_t offset = index * chunk_size() - entry->offset();
+
+      while (itr != extents.end() && itr->logical + itr->length <= offset)
+        itr++;
+
+      if (itr != extents.end() && itr->logical <= offset)
+        addresses[index] = itr->physical + (offset - itr->logical);
+    }
+  }
+
+  return addresses;
+}
+
 void
 FileList::make_directory(Path::const_iterator pathBegin, Path::const_iterator pathEnd, Path::const_iterator startItr) {
   std::string path = m_root_dir;
@@ -500,6 +602,56 @@ FileList::make_directory(Path::const_iterator pathBegin, Path::const_iterator pa
   }
 }
 
+// Creates the parent directories of a lazily opened file, skipping
+// those already created for other files. Returns false with errno set
+// on failure, as it is called when creating chunks.
+bool
+FileList::make_directory_cached(const Path* path) {
+  std::string current = m_root_dir;
+
+  for (auto itr = path->begin(); itr != path->end(); ) {
+    current += "/" + *itr;
+
+    bool is_last = ++itr == path->end();
+
+    if (!is_last && m_created_directories.find(current) != m_created_directories.end())
+      continue;
+
+    rak::file_stat fileStat;
+
+    if (fileStat.update_link(current) &&
+        fileStat.is_link() &&
+        std::find(m_indirect_links.begin(), m_indirect_links.end(), current) == m_indirect_links.end())
+      m_indirect_links.push_back(current);
+
+    if (is_last)
+      break;
+
+    if (::mkdir(current.c_str(), 0777) != 0 && errno != EEXIST) {
+      LT_LOG_FL(ERROR, "Could not create directory '%s': %s", current.c_str(), std::strerror(errno));
+      return false;
+    }
+
+    m_created_directories.insert(current);
+  }
+
+  return true;
+}
+
+bool
+FileList::prepare_queued_file(File* node) {
+  rak::error_number::clear_global();
+
+  if (!make_directory_cached(node->path()))
+    return false;
+
+  if (!open_file(node, *node->path(), open_no_create))
+    return false;
+
+  node->unset_flags_protected(File::flag_prepare_queued);
+  return true;
+}
+
 bool
 FileList::open_file(File* node, const Path& lastPath, int flags) {
   rak::error_number::clear_global();
@@ -538,23 +690,40 @@ FileList::open_file(File* node, const Path& lastPath, int flags) {
 }
 
 MemoryChunk
-FileList::create_chunk_part(FileList::iterator itr, uint64_t offset, uint32_t length, int prot) {
+FileList::create_chunk_part(FileList::iterator itr, uint64_t offset, uint32_t length, int prot, bool buffered) {
   offset -= (*itr)->offset();
   length = std::min<uint64_t>(length, (*itr)->size_bytes() - offset);
 
-  if ((*itr)->is_padding())
-    return SocketFile().create_padding_chunk(length, prot, MemoryChunk::map_shared);
+  // Read-only padding shares one zeroed region. Writable padding gets
+  // private anonymous memory, where untouched pages are the zero page
+  // and whatever peers send is discarded with the mapping.
+  if ((*itr)->is_padding()) {
+    if (!(prot & MemoryChunk::prot_write))
+      return SocketFile::create_zero_chunk(length);
+
+    return SocketFile().create_padding_chunk(length, prot, MemoryChunk::map_private);
+  }
 
   if (static_cast<int64_t>(offset) < 0)
     throw internal_error("FileList::chunk_part(...) caught a negative offset", data()->hash());
 
   // Check that offset != length of file.
 
+  if ((*itr)->is_prepare_queued() && !prepare_queued_file(itr->get()))
+    return MemoryChunk();
+
   if (!(*itr)->prepare(prot))
     return MemoryChunk();
 
+  if (buffered)
+    return SocketFile((*itr)->file_descriptor()).create_buffer_chunk(offset, length, prot, manager->chunk_manager()->buffer_pool());
 
-  auto chunk = SocketFile((*itr)->file_descriptor()).create_chunk(offset, length, prot, MemoryChunk::map_shared);
+  MemoryChunk chunk;
+
+  if (manager->chunk_manager()->is_huge_pages() && length >= ChunkManager::huge_page_size)
+    chunk = SocketFile((*itr)->file_descriptor()).create_huge_chunk(offset, length, prot, MemoryChunk::map_shared, ChunkManager::huge_page_size);
+  else
+    chunk = SocketFile((*itr)->file_descriptor()).create_chunk(offset, length, prot, MemoryChunk::map_shared);
 
   if (!chunk.is_valid())
     return MemoryChunk();
@@ -574,8 +743,12 @@ FileList::create_chunk(uint64_t offset, uint32_t length, int prot) {
     throw internal_error("Tried to access chunk out of range in FileList", data()->hash());
 
   auto chunk = std::make_unique<Chunk>();
+  bool buffered = manager->chunk_manager()->storage_backend() == ChunkManager::storage_pread ||
+                  (manager->chunk_manager()->is_buffered_writes() && (prot & MemoryChunk::prot_write));
+  uint32_t buffered_part_size = manager->chunk_manager()->buffered_part_size();
+  uint32_t chunk_length = length;
 
-  auto itr = std::find_if(begin(), end(), [offset](const value_type& file) { return file->is_valid_position(offset); });
+  auto itr = find_file(offset);
 
   for (; length != 0; ++itr) {
     if (itr == end())
@@ -584,7 +757,16 @@ FileList::create_chunk(uint64_t offset, uint32_t length, int prot) {
     if ((*itr)->size_bytes() == 0)
       continue;
 
-    MemoryChunk mc = create_chunk_part(itr, offset, length, prot);
+    uint64_t part_length = std::min<uint64_t>(length, (*itr)->offset() + (*itr)->size_bytes() - offset);
+    bool small_part = part_length < buffered_part_size && part_length < chunk_length;
+
+    // Padding is always backed by anonymous memory.
+    auto mapped = (buffered || small_part) ? ChunkPart::MAPPED_BUFFER : ChunkPart::MAPPED_MMAP;
+
+    if ((*itr)->is_padding())
+      mapped = (prot & MemoryChunk::prot_write) ? ChunkPart::MAPPED_MMAP : ChunkPart::MAPPED_STATIC;
+
+    MemoryChunk mc = create_chunk_part(itr, offset, length, prot, mapped == ChunkPart::MAPPED_BUFFER);
 
     if (!mc.is_valid())
       return NULL;
@@ -595,9 +777,12 @@ FileList::create_chunk(uint64_t offset, uint32_t length, int prot) {
     if (mc.size() > length)
       throw internal_error("FileList::create_chunk(...) mc.size() > length.", data()->hash());
 
-    chunk->push_back(ChunkPart::MAPPED_MMAP, mc);
+    chunk->push_back(mapped, mc);
     chunk->back().set_file(itr->get(), offset - (*itr)->offset());
 
+    if (mapped == ChunkPart::MAPPED_BUFFER)
+      chunk->back().set_buffer_pool(manager->chunk_manager()->buffer_pool());
+
     offset += mc.size();
     length -= mc.size();
   }
@@ -646,7 +831,7 @@ FileList::mark_completed(uint32_t index) {
 
 FileList::iterator
 FileList::inc_completed(iterator firstItr, uint32_t index) {
-  firstItr     = std::find_if(firstItr, end(), [index](value_type& file) { return index < file->range_second(); });
+  firstItr     = std::max(firstItr, find_file(static_cast<uint64_t>(index) * m_chunk_size));
   auto lastItr = std::find_if(firstItr, end(), [index](value_type& file) { return index+1 < file->range_second(); });
 
   if (firstItr == end())
@@ -688,11 +873,199 @@ FileList::update_completed() {
   }
 }
 
+uint64_t
+FileList::punch_unwanted() {
+  if (!is_open())
+    throw internal_error("FileList::punch_unwanted() called on a closed file list.", data()->hash());
+
+  Bitfield keep;
+  keep.set_size_bits(size_chunks());
+  keep.allocate();
+  keep.unset_all();
+
+  for (const auto& entry : *this)
+    if (entry->priority() != PRIORITY_OFF && !entry->is_padding() && entry->size_bytes() != 0)
+      keep.set_range(entry->range_first(), entry->range_second());
+
+  Bitfield* completed = m_data.mutable_completed_bitfield();
+  uint64_t  punched = 0;
+
+  for (auto& entry : *this) {
+    if (entry->priority() != PRIORITY_OFF || entry->is_padding() || entry->size_bytes() == 0)
+      continue;
+
+    uint32_t first = entry->range_first();
+    uint32_t last  = entry->range_second();
+
+    while (first != last && keep.get(first))
+      first++;
+
+    while (first != last && keep.get(last - 1))
+      last--;
+
+    if (first == last || !entry->is_created())
+      continue;
+
+    uint64_t offset = std::max(static_cast<uint64_t>(first) * m_chunk_size, entry->offset());
+    uint64_t end    = std::min(static_cast<uint64_t>(last) * m_chunk_size, entry->offset() + entry->size_bytes());
+
+    if (!entry->prepare(MemoryChunk::prot_read | MemoryChunk::prot_write) ||
+        !SocketFile(entry->file_descriptor()).punch_hole(offset - entry->offset(), end - offset)) {
+      LT_LOG_FL(WARN, "Could not punch hole in '%s': %s", entry->frozen_path().c_str(), std::strerror(errno));
+      continue;
+    }
+
+    if (!completed->empty())
+      completed->unset_range(first, last);
+
+    punched += end - offset;
+  }
+
+  if (punched != 0 && !completed->empty())
+    update_completed();
+
+  return punched;
+}
+
+void
+FileList::relocate(const std::string& path, slot_relocate slot) {
+  if (!is_open())
+    throw input_error("Tried to relocate a closed download.");
+
+  if (m_is_relocating)
+    throw input_error("Tried to relocate a download that is already being relocated.");
+
+  if (m_data.is_not_partially_done())
+    throw input_error("Tried to relocate a download with wanted chunks left.");
+
+  std::string::size_type last = path.find_last_not_of('/');
+  std::string root = last == std::string::npos ? std::string(".") : path.substr(0, last + 1);
+
+  if (root == m_frozen_root_dir)
+    throw input_error("Tried to relocate a download to its current root directory.");
+
+  auto entries = std::make_shared<relocation_list>();
+
+  for (const auto& entry : *this) {
+    if (entry->is_padding())
+      continue;
+
+    std::string file_path = entry->path()->as_string();
+    rak::file_stat file_stat;
+
+    // Files never created are opened in the new root when needed.
+    if (!entry->path()->back().empty() && !file_stat.update(entry->frozen_path()))
+      continue;
+
+    entries->push_back(relocation_entry{m_frozen_root_dir + file_path, root + file_path});
+  }
+
+  LT_LOG_FL(INFO, "Relocating: root:'%s' files:%zu.", root.c_str(), entries->size());
+
+  m_is_relocating = true;
+  m_slot_relocate = std::move(slot);
+
+  uint32_t completed = completed_chunks();
+
+  if (thread_disk() == nullptr || thread_self() == nullptr) {
+    relocate_done(entries, root, completed, relocation_copy(*entries, root));
+    return;
+  }
+
+  utils::Thread* thread = thread_self();
+
+  thread_disk()->callback(this, [this, thread, entries, root, completed]() {
+      std::string error = relocation_copy(*entries, root);
+
+      thread->callback(this, [this, entries, root, completed, error]() {
+          relocate_done(entries, root, completed, error);
+        });
+    });
+}
+
+// The mappings of chunks in use still refer to the old files, which
+// stay readable until they are unmapped even after being removed.
+void
+FileList::relocate_done(const std::shared_ptr<relocation_list>& entries, const std::string& root, uint32_t completed, const std::string& error) {
+  slot_relocate slot = std::move(m_slot_relocate);
+  std::string   result = error;
+
+  m_is_relocating = false;
+  m_slot_relocate = slot_relocate();
+
+  if (result.empty() && completed_chunks() != completed) {
+    result = "Download changed during relocation.";
+    relocation_remove_targets(*entries, root);
+  }
+
+  if (!result.empty()) {
+    LT_LOG_FL(ERROR, "Failed to relocate: %s", result.c_str());
+
+    if (slot)
+      slot(result);
+
+    return;
+  }
+
+  std::string old_root = m_frozen_root_dir;
+
+  for (auto& entry : *this) {
+    if (entry->is_padding())
+      continue;
+
+    entry->cancel_allocate();
+    manager->file_manager()->close(entry.get());
+
+    if (entry->frozen_path().empty())
+      continue;
+
+    entry->set_frozen_path(root + entry->path()->as_string());
+
+    if (!entry->is_created())
+      entry->set_flags_protected(File::flag_prepare_queued);
+  }
+
+  m_root_dir = m_frozen_root_dir = root;
+  m_indirect_links.assign(1, root);
+  m_created_directories.clear();
+
+  rak::file_stat root_stat;
+  m_data.set_device(root_stat.update(m_root_dir) ? root_stat.device() : 0);
+
+  LT_LOG_FL(INFO, "Relocated: root:'%s' old_root:'%s'.", root.c_str(), old_root.c_str());
+
+  // Removal is keyed on the list rather than the file list, so that
+  // closing the download doesn't leave the old files behind.
+  if (thread_disk() != nullptr)
+    thread_disk()->callback(entries.get(), [entries, old_root]() { relocation_remove_sources(*entries, old_root); });
+  else
+    relocation_remove_sources(*entries, old_root);
+
+  if (slot)
+    slot(std::string());
+}
+
+// Returns the first file holding the byte at 'offset', skipping empty
+// files, or end() if the offset is past the last file.
+FileList::iterator
+FileList::find_file(uint64_t offset) {
+  if (m_file_ends.size() != size()) {
+    m_file_ends.clear();
+    m_file_ends.reserve(size());
+
+    for (auto& file : *this)
+      m_file_ends.push_back(file->offset() + file->size_bytes());
+  }
+
+  return begin() + std::distance(m_file_ends.begin(), std::upper_bound(m_file_ends.begin(), m_file_ends.end(), offset));
+}
+
 void
 FileList::reset_filesize(int64_t size) {
   LT_LOG_FL(INFO, "Resetting torrent size: size:%" PRIi64 ".", size);
 
   close();
+  m_file_ends.clear();
   m_chunk_size = size;
   m_torrent_size = size;
   (*begin())->set_size_bytes(size);
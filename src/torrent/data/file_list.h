@@ -4,6 +4,8 @@
 #include <algorithm>
 #include <functional>
 #include <memory>
+#include <set>
+#include <string>
 #include <vector>
 #include <torrent/common.h>
 #include <torrent/path.h>
@@ -19,6 +21,8 @@ class DownloadMain;
 class DownloadWrapper;
 class Handshake;
 
+struct relocation_entry;
+
 class LIBTORRENT_EXPORT FileList : private std::vector<std::unique_ptr<File>> {
 public:
   friend class Content;
@@ -64,6 +68,7 @@ public:
   bool                is_done() const                                 { return completed_chunks() == size_chunks(); }
   bool                is_valid_piece(const Piece& piece) const;
   bool                is_root_dir_created() const;
+  bool                is_relocating() const                           { return m_is_relocating; }
 
   // Check if the torrent is loaded as a multi-file torrent. This may
   // return true even for a torrent with just one file.
@@ -74,6 +79,9 @@ public:
   uint64_t            size_bytes() const                              { return m_torrent_size; }
   uint32_t            size_chunks() const                             { return bitfield()->size_bits(); }
 
+  // Files that are still being preallocated on the disk thread.
+  size_t              size_allocating_files() const;
+
   uint32_t            completed_chunks() const                        { return bitfield()->size_set(); }
   uint64_t            completed_bytes() const;
   uint64_t            left_bytes() const;
@@ -120,6 +128,13 @@ protected:
   static constexpr int open_no_create        = (1 << 0);
   static constexpr int open_require_all_open = (1 << 1);
 
+  // Defer creating directories and opening files until
+  // 'create_chunk' first touches them. Same bit as
+  // Download::start_lazy_open.
+  static constexpr int open_lazy             = (1 << 4);
+
+  using slot_relocate = std::function<void(const std::string&)>;
+
   void                initialize(uint64_t torrentSize, uint32_t chunkSize) LIBTORRENT_NO_EXPORT;
 
   void                open(int flags) LIBTORRENT_NO_EXPORT;
@@ -140,10 +155,31 @@ protected:
   // size after the first extension handshake.
   void                reset_filesize(int64_t) LIBTORRENT_NO_EXPORT;
 
+  // Punches holes in the files with PRIORITY_OFF, except in chunks
+  // shared with other files, and marks the emptied chunks as not
+  // completed. Returns the number of bytes freed.
+  uint64_t            punch_unwanted() LIBTORRENT_NO_EXPORT;
+
+  // Copies the files to the root directory 'path' on the disk thread
+  // and then switches the open file list over to it, keeping the
+  // completed chunks. The slot receives an empty string on success,
+  // else the error.
+  void                relocate(const std::string& path, slot_relocate slot) LIBTORRENT_NO_EXPORT;
+
+  // The address on the device of the first byte of each chunk, or
+  // ~uint64_t() if unknown, for ordering hash checks by the physical
+  // layout of the files.
+  std::vector<uint64_t> chunk_physical_addresses() const LIBTORRENT_NO_EXPORT;
+
 private:
   bool                open_file(File* node, const Path& lastPath, int flags) LIBTORRENT_NO_EXPORT;
   void                make_directory(Path::const_iterator pathBegin, Path::const_iterator pathEnd, Path::const_iterator startItr) LIBTORRENT_NO_EXPORT;
-  MemoryChunk         create_chunk_part(FileList::iterator itr, uint64_t offset, uint32_t length, int prot) LIBTORRENT_NO_EXPORT;
+  bool                make_directory_cached(const Path* path) LIBTORRENT_NO_EXPORT;
+  bool                prepare_queued_file(File* node) LIBTORRENT_NO_EXPORT;
+  void                relocate_done(const std::shared_ptr<std::vector<relocation_entry>>& entries, const std::string& root, uint32_t completed, const std::string& error) LIBTORRENT_NO_EXPORT;
+  MemoryChunk         create_chunk_part(FileList::iterator itr, uint64_t offset, uint32_t length, int prot, bool buffered) LIBTORRENT_NO_EXPORT;
+
+  iterator            find_file(uint64_t offset) LIBTORRENT_NO_EXPORT;
 
   download_data       m_data;
 
@@ -157,9 +193,20 @@ private:
 
   path_list           m_indirect_links;
 
+  // Directories known to exist, so lazily opened files in the same
+  // directory don't repeat the mkdir calls.
+  std::set<std::string> m_created_directories;
+
+  bool                m_is_relocating{false};
+  slot_relocate       m_slot_relocate;
+
   // Reorder next minor version bump:
   bool                m_multi_file{false};
   std::string         m_frozen_root_dir;
+
+  // End offsets of the files, built on demand and cleared whenever
+  // files are split, merged or resized.
+  std::vector<uint64_t> m_file_ends;
 };
 
 }
@@ -2,10 +2,8 @@
 
 #include "file_manager.h"
 
-#include <algorithm>
 #include <cassert>
 #include <fcntl.h>
-#include <limits>
 
 #include "manager.h"
 #include "data/socket_file.h"
@@ -58,9 +56,9 @@ FileManager::open(value_type file, int prot, int flags) {
     posix_fadvise(fd.fd(), 0, 0, POSIX_FADV_RANDOM);
 #endif
 
+  file->m_manager_index = size();
   base_type::push_back(file);
-
-  // Consider storing the position of the file here.
+  lru_push_back(file);
 
   m_files_opened_counter++;
   return true;
@@ -79,32 +77,63 @@ FileManager::close(value_type file) {
   file->set_protection(0);
   file->set_file_descriptor(-1);
 
-  auto itr = std::find(begin(), end(), file);
-
-  if (itr == end())
-    throw internal_error("FileManager::close_file(...) itr == end().");
+  if (file->m_manager_index >= size() || (*this)[file->m_manager_index] != file)
+    throw internal_error("FileManager::close_file(...) file not found.");
 
-  *itr = back();
+  back()->m_manager_index = file->m_manager_index;
+  (*this)[file->m_manager_index] = back();
   base_type::pop_back();
 
+  lru_erase(file);
+
   m_files_closed_counter++;
 }
 
-struct FileManagerActivity {
-  void operator ()(File* f) {
-    if (f->is_open() && f->last_touched() <= m_last) {
-      m_last = f->last_touched();
-      m_file = f;
-    }
-  }
+void
+FileManager::touch(value_type file) {
+  if (!file->is_open() || file->is_padding() || file == m_lru_last)
+    return;
 
-  uint64_t m_last{std::numeric_limits<int64_t>::max()};
-  File*    m_file{};
-};
+  lru_erase(file);
+  lru_push_back(file);
+}
 
 void
 FileManager::close_least_active() {
-  close(std::for_each(begin(), end(), FileManagerActivity()).m_file);
+  if (m_lru_first == nullptr)
+    return;
+
+  close(m_lru_first);
+  m_files_evicted_counter++;
+}
+
+void
+FileManager::lru_push_back(value_type file) {
+  file->m_lru_prev = m_lru_last;
+  file->m_lru_next = nullptr;
+
+  if (m_lru_last != nullptr)
+    m_lru_last->m_lru_next = file;
+  else
+    m_lru_first = file;
+
+  m_lru_last = file;
+}
+
+void
+FileManager::lru_erase(value_type file) {
+  if (file->m_lru_prev != nullptr)
+    file->m_lru_prev->m_lru_next = file->m_lru_next;
+  else
+    m_lru_first = file->m_lru_next;
+
+  if (file->m_lru_next != nullptr)
+    file->m_lru_next->m_lru_prev = file->m_lru_prev;
+  else
+    m_lru_last = file->m_lru_prev;
+
+  file->m_lru_prev = nullptr;
+  file->m_lru_next = nullptr;
 }
 
 }
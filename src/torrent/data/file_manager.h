@@ -36,23 +36,34 @@ public:
   bool                open(value_type file, int prot, int flags);
   void                close(value_type file);
 
+  // Open files are kept in a list ordered by when they were last
+  // touched, so the least active is found without a scan.
+  void                touch(value_type file);
   void                close_least_active();
 
   // Statistics:
-  uint64_t            files_opened_counter() const { return m_files_opened_counter; }
-  uint64_t            files_closed_counter() const { return m_files_closed_counter; }
-  uint64_t            files_failed_counter() const { return m_files_failed_counter; }
+  uint64_t            files_opened_counter() const  { return m_files_opened_counter; }
+  uint64_t            files_closed_counter() const  { return m_files_closed_counter; }
+  uint64_t            files_failed_counter() const  { return m_files_failed_counter; }
+  uint64_t            files_evicted_counter() const { return m_files_evicted_counter; }
 
 private:
   FileManager(const FileManager&) = delete;
   FileManager& operator=(const FileManager&) = delete;
 
+  void                lru_push_back(value_type file);
+  void                lru_erase(value_type file);
+
   size_type           m_max_open_files{0};
   bool                m_advise_random{false};
 
   uint64_t            m_files_opened_counter{0};
   uint64_t            m_files_closed_counter{0};
   uint64_t            m_files_failed_counter{0};
+  uint64_t            m_files_evicted_counter{0};
+
+  File*               m_lru_first{};
+  File*               m_lru_last{};
 };
 
 }
@@ -71,6 +71,16 @@ TransferList::find(uint32_t index) const {
   return std::find_if(begin(), end(), [index](BlockList* b) { return index == b->index(); });
 }
 
+size_t
+TransferList::sizeof_data() const {
+  size_t size = capacity() * sizeof(value_type);
+
+  for (const auto& block_list : *this)
+    size += block_list->sizeof_data();
+
+  return size;
+}
+
 void
 TransferList::clear() {
   for (const auto& block_list : *this) {
@@ -176,12 +186,17 @@ TransferList::hash_failed(uint32_t index, Chunk* chunk) {
   if (!std::all_of((*blockListItr)->begin(), (*blockListItr)->end(), std::mem_fn(&Block::is_finished)))
     throw internal_error("TransferList::hash_failed(...) Finished blocks does not match size.");
 
+  // Retried blocks are written back to the chunk, so it is hashed
+  // in whole from here on.
+  (*blockListItr)->hash_reset();
+
   m_failedCount++;
 
   // Could propably also check promoted against size of the block
   // list.
 
-  if ((*blockListItr)->attempt() == 0) {
+  switch ((*blockListItr)->attempt()) {
+  case 0: {
     unsigned int promoted = update_failed(*blockListItr, chunk);
 
     if (promoted > 0 || promoted < (*blockListItr)->size()) {
@@ -194,10 +209,24 @@ TransferList::hash_failed(uint32_t index, Chunk* chunk) {
 
       return;
     }
+
+    break;
   }
 
-  // Should we check if there's any peers whom have sent us bad data
-  // before, and just clear those first?
+  case 1:
+    // The most popular data failed, so re-download only the blocks
+    // peers disagree on.
+    if (retry_disputed(*blockListItr))
+      return;
+
+    break;
+
+  default:
+    // Keep the data of the disputed blocks from the last attempt so
+    // the peers who sent it can be told apart later.
+    update_failed(*blockListItr, chunk);
+    break;
+  }
 
   // Re-download the blocks.
   (*blockListItr)->do_all_failed();
@@ -290,4 +319,30 @@ TransferList::retry_most_popular(BlockList* blockList, Chunk* chunk) {
   m_slot_completed(blockList->index());
 }
 
+// Blocks with more than one version of the data in the failed list
+// were sent differently by different peers, so at least one of them
+// is bad. Blocks where everyone agreed are most likely good, though
+// with v1 hashes there is no way to be certain.
+//
+// Returns false if no block, or every block, is disputed, in which
+// case the whole chunk needs to be downloaded again.
+bool
+TransferList::retry_disputed(BlockList* blockList) {
+  std::vector<BlockList::size_type> disputed;
+
+  for (BlockList::size_type i = 0; i < blockList->size(); i++) {
+    BlockFailed* failed_list = (*blockList)[i].failed_list();
+
+    if (failed_list != NULL && failed_list->size() > 1)
+      disputed.push_back(i);
+  }
+
+  if (disputed.empty() || disputed.size() == blockList->size())
+    return false;
+
+  blockList->set_attempt(2);
+  blockList->do_blocks_failed(disputed);
+  return true;
+}
+
 }
@@ -38,6 +38,9 @@ public:
 
   const completed_list_type& completed_list() const { return m_completedList; }
 
+  // Memory used by the in-flight pieces, see BlockList::sizeof_data().
+  size_t              sizeof_data() const;
+
   uint32_t            succeeded_count() const { return m_succeededCount; }
   uint32_t            failed_count() const { return m_failedCount; }
 
@@ -68,6 +71,7 @@ private:
   void                mark_failed_peers(BlockList* blockList, Chunk* chunk);
 
   void                retry_most_popular(BlockList* blockList, Chunk* chunk);
+  bool                retry_disputed(BlockList* blockList);
 
   slot_chunk_index    m_slot_canceled;
   slot_chunk_index    m_slot_completed;
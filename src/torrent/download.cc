@@ -2,9 +2,12 @@
 
 #include <cinttypes>
 
+#include "manager.h"
 #include "data/block.h"
 #include "data/block_list.h"
 #include "data/chunk_list.h"
+#include "data/content_index.h"
+#include "data/file_relocation.h"
 #include "data/hash_queue.h"
 #include "data/hash_torrent.h"
 #include "download/available_list.h"
@@ -18,9 +21,13 @@
 #include "torrent/download/choke_queue.h"
 #include "torrent/download_info.h"
 #include "torrent/data/file.h"
+#include "torrent/data/file_manager.h"
 #include "torrent/peer/connection_list.h"
+#include "torrent/peer/peer_list.h"
+#include "torrent/data/transfer_list.h"
 #include "torrent/tracker_list.h"
 #include "torrent/utils/log.h"
+#include "torrent/utils/startup_profile.h"
 
 #include "exceptions.h"
 #include "download.h"
@@ -54,6 +61,8 @@ Download::open(int flags) {
   if (m_ptr->info()->is_open())
     return;
 
+  utils::startup_scope startup(m_ptr->info()->hash().str(), utils::startup_open);
+
   LT_LOG_THIS(INFO, "Opening torrent: flags:%0x.", flags);
 
   // Currently always open with no_create, as start will make sure
@@ -72,6 +81,8 @@ Download::open(int flags) {
 
   for (auto& file : *m_ptr->main()->file_list())
     file->set_flags(fileFlags);
+
+  m_ptr->push_event(EventJournal::event_opened);
 }
 
 void
@@ -80,7 +91,12 @@ Download::close(int flags) {
     stop(0);
 
   LT_LOG_THIS(INFO, "Closing torrent: flags:%0x.", flags);
+
+  bool was_open = m_ptr->info()->is_open();
   m_ptr->close();
+
+  if (was_open)
+    m_ptr->push_event(EventJournal::event_closed);
 }
 
 void
@@ -133,8 +149,12 @@ Download::start(int flags) {
                       info->uploaded_baseline(), info->completed_baseline());
   }
 
-  if (!(flags & start_skip_tracker))
+  if (!(flags & start_skip_tracker)) {
+    utils::startup_begin(info->hash().str(), utils::startup_first_announce);
     m_ptr->main()->tracker_controller().send_start_event();
+  }
+
+  m_ptr->push_event(EventJournal::event_started);
 }
 
 void
@@ -145,15 +165,39 @@ Download::stop(int flags) {
   LT_LOG_THIS(INFO, "Stopping torrent: flags:%0x.", flags);
 
   m_ptr->main()->stop();
+  m_ptr->main()->release_warm();
 
   if (!(flags & stop_skip_tracker))
     m_ptr->main()->tracker_controller().send_stop_event();
 
   m_ptr->main()->tracker_controller().disable();
+  m_ptr->push_event(EventJournal::event_stopped);
 }
 
 bool
-Download::hash_check(bool tryQuick) {
+Download::is_paused() const {
+  return m_ptr->info()->is_paused();
+}
+
+void
+Download::pause(int flags) {
+  if (!m_ptr->info()->is_active())
+    return;
+
+  LT_LOG_THIS(INFO, "Pausing torrent: flags:%0x.", flags);
+
+  m_ptr->main()->stop();
+  m_ptr->main()->set_paused();
+
+  if (!(flags & stop_skip_tracker))
+    m_ptr->main()->tracker_controller().send_stop_event();
+
+  m_ptr->main()->tracker_controller().disable();
+  m_ptr->push_event(EventJournal::event_paused);
+}
+
+bool
+Download::hash_check(bool tryQuick, bool background) {
   if (m_ptr->hash_checker()->is_checking())
     throw internal_error("Download::hash_check(...) called but the hash is already being checked.");
 
@@ -165,7 +209,7 @@ Download::hash_check(bool tryQuick) {
 
   Bitfield* bitfield = m_ptr->data()->mutable_completed_bitfield();
 
-  LT_LOG_THIS(INFO, "Checking hash: allocated:%i try_quick:%i.", !bitfield->empty(), (int)tryQuick);
+  LT_LOG_THIS(INFO, "Checking hash: allocated:%i try_quick:%i background:%i.", !bitfield->empty(), (int)tryQuick, (int)background);
 
   if (bitfield->empty()) {
     // The bitfield still hasn't been allocated, so no resume data was
@@ -178,6 +222,10 @@ Download::hash_check(bool tryQuick) {
 
   m_ptr->main()->file_list()->update_completed();
 
+  m_ptr->hash_checker()->set_background(background);
+
+  utils::startup_begin(m_ptr->info()->hash().str(), utils::startup_hash_check);
+
   return m_ptr->hash_checker()->start(tryQuick);
 }
 
@@ -205,6 +253,21 @@ Download::is_hash_checking() const {
   return m_ptr->hash_checker()->is_checking();
 }
 
+bool
+Download::is_hibernating() const {
+  return m_ptr->info()->is_hibernating();
+}
+
+bool
+Download::hibernate() {
+  return m_ptr->main()->hibernate();
+}
+
+void
+Download::wake() {
+  m_ptr->main()->wake();
+}
+
 void
 Download::set_pex_enabled(bool enabled) {
   if (enabled)
@@ -263,6 +326,12 @@ Download::connection_list() const {
   return m_ptr->main()->connection_list();
 }
 
+uint64_t
+Download::memory_usage() const {
+  return peer_list()->sizeof_data() + transfer_list()->sizeof_data() +
+    connection_list()->size() * PeerConnectionBase::sizeof_connection;
+}
+
 uint64_t
 Download::bytes_done() const {
   uint64_t a = 0;
@@ -282,6 +351,11 @@ Download::chunks_hashed() const {
   return m_ptr->hash_checker()->position();
 }
 
+uint32_t
+Download::chunks_to_hash(uint32_t first, uint32_t last) const {
+  return m_ptr->hash_checker()->remaining(first, last);
+}
+
 const uint8_t*
 Download::chunks_seen() const {
   return !m_ptr->main()->chunk_statistics()->empty() ? &*m_ptr->main()->chunk_statistics()->begin() : NULL;
@@ -368,6 +442,11 @@ Download::peers_accounted() const {
   return m_ptr->main()->chunk_statistics()->accounted();
 }
 
+double
+Download::distributed_copies() const {
+  return m_ptr->main()->chunk_statistics()->distributed_copies();
+}
+
 uint32_t
 Download::peers_currently_unchoked() const {
   return m_ptr->main()->choke_group()->up_queue()->size_unchoked();
@@ -468,6 +547,19 @@ Download::set_uploads_max(uint32_t v) {
   m_ptr->main()->choke_group()->up_queue()->balance_entry(m_ptr->main()->up_group_entry());
 }
 
+uint32_t
+Download::disk_weight() const {
+  return m_ptr->data()->disk_weight();
+}
+
+void
+Download::set_disk_weight(uint32_t v) {
+  if (v < 1 || v > max_disk_weight)
+    throw input_error("Disk weight must be between 1 and 16.");
+
+  m_ptr->data()->set_disk_weight(v);
+}
+
 void
 Download::set_uploads_min(uint32_t v) {
   if (v > (1 << 16))
@@ -560,6 +652,141 @@ Download::update_priorities() {
   m_ptr->receive_update_priorities();
 }
 
+void
+Download::update_priorities(uint32_t first, uint32_t last) {
+  m_ptr->receive_update_priorities(first, last);
+}
+
+uint64_t
+Download::punch_unwanted_files() {
+  if (m_ptr->info()->is_active())
+    throw input_error("Download::punch_unwanted_files() Download is active.");
+
+  if (!m_ptr->info()->is_open() || !m_ptr->hash_checker()->is_checked())
+    throw input_error("Download::punch_unwanted_files() Download is not hash checked.");
+
+  uint64_t punched = m_ptr->main()->file_list()->punch_unwanted();
+
+  if (punched == 0)
+    return 0;
+
+  LT_LOG_THIS(INFO, "Punched holes in unwanted files: bytes:%" PRIu64 ".", punched);
+
+  // The untouched bitfield must again include the emptied chunks.
+  m_ptr->main()->chunk_selector()->initialize(m_ptr->main()->chunk_statistics());
+  m_ptr->receive_update_priorities();
+
+  return punched;
+}
+
+void
+Download::relocate(const std::string& path, std::function<void(const std::string&)> slot) {
+  m_ptr->main()->file_list()->relocate(path, std::move(slot));
+}
+
+uint32_t
+Download::share_identical_files() {
+  if (!m_ptr->info()->is_open() || m_ptr->hash_checker()->is_checked() || m_ptr->hash_checker()->is_checking())
+    throw input_error("Download::share_identical_files() Download in invalid state.");
+
+  FileList*          file_list = m_ptr->main()->file_list();
+  const std::string& hashes = m_ptr->complete_hash();
+
+  if (hashes.size() != file_list->size_chunks() * HashString::size_data)
+    return 0;
+
+  Bitfield* bitfield = m_ptr->data()->mutable_completed_bitfield();
+
+  if (bitfield->empty()) {
+    bitfield->allocate();
+    bitfield->unset_all();
+  }
+
+  uint32_t shared = 0;
+
+  for (auto& file : *file_list) {
+    content_key key;
+
+    if (file->is_padding() || file->frozen_path().empty() ||
+        !ContentIndex::make_key(file_list->size_bytes(), file_list->chunk_size(), file->offset(), file->size_bytes(), hashes.c_str(), &key))
+      continue;
+
+    for (const auto& [other, other_file] : manager->content_index()->find(key)) {
+      if (other == m_ptr || !other->hash_checker()->is_checked() || other_file->frozen_path().empty() ||
+          other_file->completed_chunks() != other_file->size_chunks())
+        continue;
+
+      std::string error;
+
+      manager->file_manager()->close(file.get());
+
+      if (!relocation_link_file(other_file->frozen_path(), file->frozen_path(), &error)) {
+        LT_LOG_THIS(WARN, "Could not share file '%s': %s", file->frozen_path().c_str(), error.c_str());
+        continue;
+      }
+
+      LT_LOG_THIS(INFO, "Sharing file: path:'%s' source:'%s'.", file->frozen_path().c_str(), other_file->frozen_path().c_str());
+
+      bitfield->set_range(file->range_first(), file->range_second());
+      m_ptr->hash_checker()->hashing_ranges().erase(file->range_first(), file->range_second());
+
+      shared++;
+      break;
+    }
+  }
+
+  if (shared != 0)
+    file_list->update_completed();
+
+  return shared;
+}
+
+void
+Download::set_chunk_deadline(uint32_t first, uint32_t last, std::chrono::microseconds budget) {
+  if (first > last || last > m_ptr->main()->file_list()->size_chunks())
+    throw input_error("Chunk deadline range is out of bounds.");
+
+  if (budget < std::chrono::microseconds{})
+    throw input_error("Chunk deadline budget cannot be negative.");
+
+  m_ptr->main()->chunk_selector()->set_deadline(first, last, this_thread::cached_time() + budget);
+}
+
+void
+Download::clear_chunk_deadlines() {
+  m_ptr->main()->chunk_selector()->clear_deadlines();
+}
+
+uint32_t
+Download::chunk_locality_window() const {
+  return m_ptr->main()->chunk_selector()->locality_window();
+}
+
+void
+Download::set_chunk_locality_window(uint32_t window) {
+  m_ptr->main()->chunk_selector()->set_locality_window(window);
+}
+
+uint32_t
+Download::endgame_duplicates() const {
+  return m_ptr->main()->delegator()->endgame_duplicates();
+}
+
+void
+Download::set_endgame_duplicates(uint32_t duplicates) {
+  m_ptr->main()->delegator()->set_endgame_duplicates(duplicates);
+}
+
+const utils::latency_histogram&
+Download::request_latency() const {
+  return *m_ptr->main()->request_latency();
+}
+
+std::chrono::microseconds
+Download::metadata_fetch_time() const {
+  return m_ptr->main()->metadata_fetch()->time_to_metadata();
+}
+
 void
 Download::add_peer(const sockaddr* sa, int port) {
   if (m_ptr->info()->is_private())
@@ -1,6 +1,7 @@
 #ifndef LIBTORRENT_DOWNLOAD_H
 #define LIBTORRENT_DOWNLOAD_H
 
+#include <functional>
 #include <list>
 #include <vector>
 #include <string>
@@ -31,6 +32,10 @@ public:
   static constexpr int start_keep_baseline   = (1 << 2);
   static constexpr int start_skip_tracker    = (1 << 3);
 
+  // Create directories and open files on first access rather than all
+  // of them when starting, for torrents with very many files.
+  static constexpr int start_lazy_open       = (1 << 4);
+
   static constexpr int stop_skip_tracker     = (1 << 0);
 
   Download(DownloadWrapper* d = NULL) : m_ptr(d) {}
@@ -48,19 +53,37 @@ public:
   // finished and a hash done signal has been queued.
   //
   // Chunk ranges that have valid resume data won't be checked.
-  bool                hash_check(bool tryQuick);
+  //
+  // A 'background' check yields to user requested checks, and all
+  // checks yield to verifying downloaded chunks.
+  bool                hash_check(bool tryQuick, bool background = false);
   void                hash_stop();
 
   // Start/stop the download. The torrent must be open.
   void                start(int flags = 0);
   void                stop(int flags = 0);
 
+  // Stops the download but keeps its file handles and cached chunks,
+  // so that 'start' resumes it without reopening them. Paused
+  // downloads are demoted to stopped once together they hold more
+  // than ChunkManager::paused_budget, oldest first, or all of them
+  // when the chunk memory is exhausted.
+  bool                is_paused() const;
+  void                pause(int flags = 0);
+
   // Does not check if the download has been removed.
   bool                is_valid() const { return m_ptr; }
 
   bool                is_hash_checked() const;
   bool                is_hash_checking() const;
 
+  // An idle active download may hibernate, releasing its chunk list
+  // and statistics until a peer connects. Returns false if the
+  // download is busy or already hibernating.
+  bool                is_hibernating() const;
+  bool                hibernate();
+  void                wake();
+
   void                set_pex_enabled(bool enabled);
 
   Object*             bencode();
@@ -77,11 +100,19 @@ public:
   ConnectionList*       connection_list();
   const ConnectionList* connection_list() const;
 
+  // Memory attributed to this download besides its chunks, which are
+  // accounted by ChunkManager.
+  uint64_t            memory_usage() const;
+
   // Bytes completed.
   uint64_t            bytes_done() const;
 
   uint32_t            chunks_hashed() const;
 
+  // Chunks in the range that still need to be hash checked, pass the
+  // range of a file to get its progress.
+  uint32_t            chunks_to_hash(uint32_t first, uint32_t last) const;
+
   const uint8_t*      chunks_seen() const;
 
   // Set the number of finished chunks for closed torrents.
@@ -107,6 +138,9 @@ public:
   uint32_t            peers_complete() const;
   uint32_t            peers_accounted() const;
 
+  // Estimated number of complete copies held by connected peers.
+  double              distributed_copies() const;
+
   uint32_t            peers_currently_unchoked() const;
   uint32_t            peers_currently_interested() const;
 
@@ -127,6 +161,13 @@ public:
   uint32_t            downloads_min() const;
   void                set_downloads_min(uint32_t v);
 
+  // Relative share of the disk I/O when downloads contend for it,
+  // between 1 and 'max_disk_weight'. See ChunkManager::set_disk_max_rate.
+  static constexpr uint32_t max_disk_weight = 16;
+
+  uint32_t            disk_weight() const;
+  void                set_disk_weight(uint32_t v);
+
   void                set_upload_throttle(Throttle* t);
   void                set_download_throttle(Throttle* t);
 
@@ -161,6 +202,60 @@ public:
   // all the peer bitfields to see if we are still interested.
   void                update_priorities();
 
+  // Like update_priorities(), but only recomputes the chunks of files
+  // [first, last>. Set the priorities of a batch of adjacent files
+  // and call this once, rather than updating after every file.
+  void                update_priorities(uint32_t first, uint32_t last);
+
+  // Frees the disk space of deselected files, keeping chunks shared
+  // with wanted files. Those chunks are no longer completed and are
+  // downloaded again if the files are later selected. The download
+  // must be hash checked and stopped. Returns the bytes freed.
+  uint64_t            punch_unwanted_files();
+
+  // Moves the files to the root directory 'path'. They are copied on
+  // the disk thread, with reflinks where the file system allows, while
+  // the download keeps seeding from the old files. The download then
+  // switches to the copies without a recheck and the old files are
+  // removed. All wanted chunks must be done.
+  //
+  // The slot is called with an empty string once the download uses
+  // the new root directory, else with the error.
+  void                relocate(const std::string& path, std::function<void(const std::string&)> slot);
+
+  // Replaces files with hard links to identical, completed files of
+  // other downloads, found by size and piece hashes, and marks their
+  // chunks as completed so they are not hashed. Call after opening and
+  // before the hash check. Returns the number of files shared.
+  uint32_t            share_identical_files();
+
+  // Ask for chunks [first, last> to be completed within 'budget' from
+  // now, e.g. for streaming. They are requested earliest deadline
+  // first from peers fast enough to make it, and duplicated to other
+  // peers when about to miss the deadline.
+  void                set_chunk_deadline(uint32_t first, uint32_t last, std::chrono::microseconds budget);
+  void                clear_chunk_deadlines();
+
+  // Chunks after the last one picked for a peer are preferred for up
+  // to 'window' more picks, so pieces are written mostly in order on
+  // disks that do poorly with random writes. Zero, the default, picks
+  // every chunk rarest-first.
+  uint32_t            chunk_locality_window() const;
+  void                set_chunk_locality_window(uint32_t window);
+
+  // Number of peers a block is requested from besides the first in
+  // end-game mode, preferring those with the lowest request latency.
+  uint32_t            endgame_duplicates() const;
+  void                set_endgame_duplicates(uint32_t duplicates);
+
+  // Time from requesting a block to receiving its first byte, over
+  // all peers of the download.
+  const utils::latency_histogram& request_latency() const;
+
+  // Time taken to fetch valid metadata of a magnet link, zero until
+  // done or if the download was not started from one.
+  std::chrono::microseconds metadata_fetch_time() const;
+
   void                add_peer(const sockaddr* addr, int port);
 
   DownloadWrapper*    ptr() { return m_ptr; }
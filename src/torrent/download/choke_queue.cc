@@ -10,6 +10,7 @@
 #include "torrent/peer/connection_list.h"
 #include "torrent/peer/choke_status.h"
 #include "torrent/utils/log.h"
+#include "utils/probe.h"
 
 #include "choke_queue.h"
 
@@ -61,8 +62,39 @@ choke_queue::max_alternate() const {
     return (m_currently_unchoked + 9) / 10;
 }
 
+static void
+sort_weights_tail(choke_queue::iterator first, choke_queue::iterator last, uint32_t count) {
+  if (static_cast<uint32_t>(std::distance(first, last)) <= count) {
+    std::sort(first, last, choke_manager_less);
+    return;
+  }
+
+  std::nth_element(first, last - count, last, choke_manager_less);
+  std::sort(last - count, last, choke_manager_less);
+}
+
+void
+choke_queue::sort_weights(iterator first, iterator last, uint32_t count) {
+  if (static_cast<uint32_t>(std::distance(first, last)) <= count) {
+    std::sort(first, last, choke_manager_less);
+    return;
+  }
+
+  for (uint32_t order = 0; order + 1 < order_max_size; order++) {
+    auto order_last = std::partition(first, last, [order](const value_type& v) { return v.weight / order_base <= order; });
+
+    sort_weights_tail(first, order_last, count);
+    first = order_last;
+  }
+
+  sort_weights_tail(first, last, count);
+}
+
+// Only the queued connections that may be unchoked this round need to
+// be sorted, which is bounded by 'quota' and by what is needed to
+// fill 'min_slots'. The unchoked lists are small and fully sorted.
 group_stats
-choke_queue::prepare_weights(group_stats gs) {
+choke_queue::prepare_weights(group_stats gs, uint32_t quota) {
   // gs.sum_min_needed = 0;
   // gs.sum_max_needed = 0;
   // gs.sum_max_leftovers = 0; // Needs to reflect how many we can optimistically unchoke after choking unchoked connections?
@@ -73,8 +105,11 @@ choke_queue::prepare_weights(group_stats gs) {
     m_heuristics_list[m_heuristics].slot_choke_weight(group->mutable_unchoked()->begin(), group->mutable_unchoked()->end());
     std::sort(group->mutable_unchoked()->begin(), group->mutable_unchoked()->end(), choke_manager_less);
 
+    uint32_t min_slots = std::min(group->min_slots(), group->max_slots());
+    uint32_t min_needed = min_slots - std::min<uint32_t>(min_slots, group->unchoked()->size());
+
     m_heuristics_list[m_heuristics].slot_unchoke_weight(group->mutable_queued()->begin(), group->mutable_queued()->end());
-    std::sort(group->mutable_queued()->begin(), group->mutable_queued()->end(), choke_manager_less);
+    sort_weights(group->mutable_queued()->begin(), group->mutable_queued()->end(), quota + std::min(min_needed, unlimited - quota));
 
     // Aggregate the statistics... Remember to update them after
     // optimistic/pessimistic unchokes.
@@ -147,15 +182,16 @@ choke_queue::retrieve_connections(group_stats gs, container_type* queued, contai
   return gs;
 }
 
-void
-choke_queue::rebuild_containers(container_type* queued, container_type* unchoked) {
-  queued->clear();
-  unchoked->clear();
+uint32_t
+choke_queue::size_group_queued() const {
+  return std::accumulate(m_group_container.begin(), m_group_container.end(), uint32_t(),
+                         [](uint32_t size, group_entry* group) { return size + group->queued()->size(); });
+}
 
-  for (auto& group : m_group_container) {
-    queued->insert(queued->end(), group->queued()->begin(), group->queued()->end());
-    unchoked->insert(unchoked->end(), group->unchoked()->begin(), group->unchoked()->end());
-  }
+uint32_t
+choke_queue::size_group_unchoked() const {
+  return std::accumulate(m_group_container.begin(), m_group_container.end(), uint32_t(),
+                         [](uint32_t size, group_entry* group) { return size + group->unchoked()->size(); });
 }
 
 void
@@ -178,7 +214,7 @@ choke_queue::balance() {
   group_stats gs;
   std::memset(&gs, 0, sizeof(group_stats));
 
-  gs = prepare_weights(gs);
+  gs = prepare_weights(gs, std::min(m_maxUnchoked, uint32_t{1} << 20));
   gs = retrieve_connections(gs, &queued, &unchoked);
 
   if (gs.changed_unchoked != 0)
@@ -222,12 +258,13 @@ choke_queue::balance_entry(group_entry* entry) {
   m_heuristics_list[m_heuristics].slot_choke_weight(entry->mutable_unchoked()->begin(), entry->mutable_unchoked()->end());
   std::sort(entry->mutable_unchoked()->begin(), entry->mutable_unchoked()->end(), choke_manager_less);
 
-  m_heuristics_list[m_heuristics].slot_unchoke_weight(entry->mutable_queued()->begin(), entry->mutable_queued()->end());
-  std::sort(entry->mutable_queued()->begin(), entry->mutable_queued()->end(), choke_manager_less);
-
   int count = 0;
   unsigned int min_slots = std::min(entry->min_slots(), entry->max_slots());
 
+  m_heuristics_list[m_heuristics].slot_unchoke_weight(entry->mutable_queued()->begin(), entry->mutable_queued()->end());
+  sort_weights(entry->mutable_queued()->begin(), entry->mutable_queued()->end(),
+               min_slots - std::min<uint32_t>(min_slots, entry->unchoked()->size()));
+
   while (!entry->unchoked()->empty() && entry->unchoked()->size() > entry->max_slots())
     count -= m_slotConnection(entry->unchoked()->back().connection, true);
 
@@ -239,27 +276,24 @@ choke_queue::balance_entry(group_entry* entry) {
 
 int
 choke_queue::cycle(uint32_t quota) {
+  LT_PROBE2(choke_cycle_enter, this, quota);
+
   // TODO: This should not use the old values, but rather the number
   // of unchoked this round.
-  // HACKKKKKK
-  container_type queued;
-  container_type unchoked;
-
-  rebuild_containers(&queued, &unchoked);
-
-  int oldSize = unchoked.size();
+  int oldSize = size_group_unchoked();
   uint32_t alternate = max_alternate();
 
-  queued.clear();
-  unchoked.clear();
+  container_type queued;
+  container_type unchoked;
 
   group_stats gs;
   std::memset(&gs, 0, sizeof(group_stats));
 
-  gs = prepare_weights(gs);
+  quota = std::min(quota, m_maxUnchoked);
+
+  gs = prepare_weights(gs, quota);
   gs = retrieve_connections(gs, &queued, &unchoked);
 
-  quota = std::min(quota, m_maxUnchoked);
   quota = quota - std::min(quota, gs.now_unchoked);
 
   uint32_t adjust = (unchoked.size() < quota) ? (quota - unchoked.size()) : 0; 
@@ -279,12 +313,126 @@ choke_queue::cycle(uint32_t quota) {
   if (unchoked.size() > quota)
     throw internal_error("choke_queue::cycle() unchoked.size() > quota.");
 
-  rebuild_containers(&queued, &unchoked); // Remove...
+  uint32_t new_size = size_group_unchoked();
 
   lt_log_print(LOG_PEER_DEBUG, "After cycle; queued:%u unchoked:%u unchoked_count:%i old_size:%i.",
-               (unsigned)queued.size(), (unsigned)unchoked.size(), unchoked_count, oldSize);
+               size_group_queued(), new_size, unchoked_count, oldSize);
+
+  LT_PROBE3(choke_cycle_exit, this, new_size, oldSize);
+  return (static_cast<int>(new_size) - oldSize); // + gs.changed_unchoke
+}
+
+namespace {
+
+struct global_candidate {
+  PeerConnectionBase* connection;
+  uint32_t            queue;
+  uint32_t            entry;
+  uint64_t            rate;
+  bool                unchoked;
+  bool                selected;
+};
+
+struct global_entry {
+  uint32_t            min_slots;
+  uint32_t            max_slots;
+  uint32_t            selected;
+};
 
-  return (static_cast<int>(unchoked.size()) - oldSize); // + gs.changed_unchoke
+}
+
+// Connections of a group_entry below its min_slots are unchoked
+// first, then the slots less the optimistic share go to the
+// connections with the highest rate. The optimistic share and any
+// unused slots go to choked connections in random order, preferred
+// peers first, and what remains keeps currently unchoked connections.
+int
+choke_queue::cycle_global(const std::vector<choke_queue*>& queues, uint32_t quota) {
+  std::vector<global_candidate> candidates;
+  std::vector<global_entry> entries;
+  std::vector<uint32_t> queue_selected(queues.size());
+
+  for (uint32_t queue_index = 0; queue_index < queues.size(); queue_index++) {
+    bool is_up = queues[queue_index]->m_heuristics != HEURISTICS_DOWNLOAD_LEECH;
+
+    for (auto group : queues[queue_index]->m_group_container) {
+      uint32_t entry_index = entries.size();
+      entries.push_back(global_entry{std::min(group->min_slots(), group->max_slots()), group->max_slots(), 0});
+
+      auto add_candidate = [&](const weighted_connection& wc, bool unchoked) {
+        ThrottleNode* throttle = is_up ? wc.connection->peer_chunks()->upload_throttle() : wc.connection->peer_chunks()->download_throttle();
+
+        candidates.push_back(global_candidate{wc.connection, queue_index, entry_index, throttle->rate()->rate(), unchoked, false});
+      };
+
+      for (const auto& wc : *group->unchoked())
+        add_candidate(wc, true);
+
+      for (const auto& wc : *group->queued())
+        add_candidate(wc, false);
+    }
+  }
+
+  std::sort(candidates.begin(), candidates.end(), [](const auto& lhs, const auto& rhs) { return lhs.rate > rhs.rate; });
+
+  uint32_t selected = 0;
+  uint32_t optimistic = (quota + 9) / 10;
+
+  auto try_select = [&](global_candidate& candidate) {
+    global_entry& entry = entries[candidate.entry];
+
+    if (selected >= quota || candidate.selected ||
+        entry.selected >= entry.max_slots ||
+        queue_selected[candidate.queue] >= queues[candidate.queue]->m_maxUnchoked)
+      return;
+
+    candidate.selected = true;
+    entry.selected++;
+    queue_selected[candidate.queue]++;
+    selected++;
+  };
+
+  for (auto& candidate : candidates)
+    if (entries[candidate.entry].selected < entries[candidate.entry].min_slots)
+      try_select(candidate);
+
+  for (auto& candidate : candidates) {
+    if (selected + optimistic >= quota || candidate.rate == 0)
+      break;
+
+    try_select(candidate);
+  }
+
+  std::vector<std::pair<uint32_t, global_candidate*>> optimistic_candidates;
+
+  for (auto& candidate : candidates)
+    if (!candidate.unchoked && !candidate.selected)
+      optimistic_candidates.emplace_back((uint32_t{candidate.connection->peer_info()->is_prioritized()} << 16) + ::random() % (1 << 16), &candidate);
+
+  std::sort(optimistic_candidates.begin(), optimistic_candidates.end(), [](const auto& lhs, const auto& rhs) { return lhs.first > rhs.first; });
+
+  for (auto& candidate : optimistic_candidates)
+    try_select(*candidate.second);
+
+  for (auto& candidate : candidates)
+    if (candidate.unchoked)
+      try_select(candidate);
+
+  // Choke first so the queues never go above their limits.
+  int change = 0;
+
+  for (auto& candidate : candidates)
+    if (candidate.unchoked && !candidate.selected)
+      change -= queues[candidate.queue]->m_slotConnection(candidate.connection, true);
+
+  for (auto& candidate : candidates)
+    if (!candidate.unchoked && candidate.selected)
+      change += queues[candidate.queue]->m_slotConnection(candidate.connection, false);
+
+  lt_log_print(LOG_PEER_DEBUG, "Called global cycle; quota:%u optimistic:%u candidates:%zu selected:%u change:%i.",
+               quota, optimistic, candidates.size(), selected, change);
+
+  return change;
 }
 
 void
@@ -604,6 +752,17 @@ choke_queue::adjust_choke_range(iterator first, iterator last,
 
 // Note that these algorithms fail if the rate >= 2^30.
 
+// The upload rate is an average that lags behind peers that have
+// only just been given more bandwidth, so it is credited up to
+// double if the congestion window shows the path can carry it.
+static uint32_t
+upload_capacity(PeerConnectionBase* pc) {
+  uint64_t rate = pc->peer_chunks()->upload_throttle()->rate()->rate();
+  uint64_t path_rate = pc->tcp_info().path_rate();
+
+  return std::min<uint64_t>(std::max(rate, std::min(path_rate, 2 * rate)), choke_queue::order_base - 1);
+}
+
 // Need to add the recently unchoked check here?
 
 void
@@ -636,7 +795,7 @@ calculate_upload_unchoke(choke_queue::iterator first, choke_queue::iterator last
     } else {
       // This will be our optimistic unchoke queue, should be
       // semi-random. Give lower weights to known stingy peers.
-      int order = 1 + first->connection->peer_info()->is_preferred();
+      int order = 1 + first->connection->peer_info()->is_prioritized();
 
       first->weight = order * choke_queue::order_base + ::random() % (1 << 10);
     }
@@ -650,8 +809,8 @@ calculate_upload_unchoke(choke_queue::iterator first, choke_queue::iterator last
 void
 calculate_upload_choke_seed(choke_queue::iterator first, choke_queue::iterator last) {
   while (first != last) {
-    int order = 1; // + first->connection->peer_info()->is_preferred();
-    uint32_t upload_rate = first->connection->peer_chunks()->upload_throttle()->rate()->rate() / 16;
+    int order = 1; // + first->connection->peer_info()->is_prioritized();
+    uint32_t upload_rate = upload_capacity(first->connection) / 16;
 
     first->weight = order * choke_queue::order_base - 1 - upload_rate;
     first++;
@@ -661,7 +820,7 @@ calculate_upload_choke_seed(choke_queue::iterator first, choke_queue::iterator l
 void
 calculate_upload_unchoke_seed(choke_queue::iterator first, choke_queue::iterator last) {
   while (first != last) {
-    int order = first->connection->peer_info()->is_preferred();
+    int order = first->connection->peer_info()->is_prioritized();
 
     first->weight = order * choke_queue::order_base + ::random() % (1 << 10);
     first++;
@@ -684,8 +843,8 @@ calculate_choke_upload_leech_experimental(choke_queue::iterator first, choke_que
       continue;
     }
 
-    // Preferred peers will get 4 times higher weight.
-    int multiplier = 1 + 3 * first->connection->peer_info()->is_preferred();
+    // Preferred and local peers will get 4 times higher weight.
+    int multiplier = 1 + 3 * first->connection->peer_info()->is_prioritized();
 
     uint32_t download_rate = first->connection->peer_chunks()->download_throttle()->rate()->rate() / 64;
     uint32_t upload_rate   = first->connection->peer_chunks()->upload_throttle()->rate()->rate() / (64 * 4);
@@ -702,7 +861,7 @@ calculate_unchoke_upload_leech_experimental(choke_queue::iterator first, choke_q
   while (first != last) {
     // Consider checking for is_down_remote_unchoked().
     if (first->connection->is_down_local_unchoked()) {
-      int multiplier = 1 + 3 * first->connection->peer_info()->is_preferred();
+      int multiplier = 1 + 3 * first->connection->peer_info()->is_prioritized();
 
       uint32_t download_rate = first->connection->peer_chunks()->download_throttle()->rate()->rate() / 64;
 
@@ -711,10 +870,10 @@ calculate_unchoke_upload_leech_experimental(choke_queue::iterator first, choke_q
     } else {
       // This will be our optimistic unchoke queue, should be
       // semi-random. Give lower weights to known stingy peers and
-      // higher weight for preferred ones.
+      // higher weight for preferred and local ones.
       int base = (1 << 10);
 
-      if (first->connection->peer_info()->is_preferred())
+      if (first->connection->peer_info()->is_prioritized())
         base *= 4;
 
       // else if (<peer is stingy>)
@@ -39,6 +39,7 @@
 
 #include <torrent/common.h>
 
+#include <algorithm>
 #include <cinttypes>
 #include <functional>
 #include <list>
@@ -118,6 +119,10 @@ public:
   uint32_t            size_queued() const                     { return m_currently_queued; }
   uint32_t            size_total() const                      { return size_unchoked() + size_queued(); }
 
+  // A cycle only changes anything when there are queued connections
+  // or more unchoked than the quota allows.
+  bool                is_cycle_needed(uint32_t quota) const   { return size_queued() != 0 || size_unchoked() > std::min(quota, m_maxUnchoked); }
+
   // This must be unsigned.
   uint32_t            max_unchoked() const                    { return m_maxUnchoked; }
   int32_t             max_unchoked_signed() const             { return m_maxUnchoked; }
@@ -139,6 +144,18 @@ public:
 
   static void         move_connections(choke_queue* src, choke_queue* dest, DownloadMain* download, group_entry* base);
 
+  // Cycles 'queues' together, giving 'quota' slots to the connections
+  // with the highest measured rate across all of them while keeping a
+  // share for optimistic unchokes. The queue and group_entry slot
+  // limits are kept. Returns the change in unchoked connections.
+  static int          cycle_global(const std::vector<choke_queue*>& queues, uint32_t quota);
+
+  // Orders the range by weight order, with only the 'count' highest
+  // connections of each order sorted at its end. Callers take at most
+  // 'count' connections from the back of an order, so this is
+  // equivalent to a full sort for them.
+  static void         sort_weights(iterator first, iterator last, uint32_t count);
+
   heuristics_enum     heuristics() const                       { return m_heuristics; }
   void                set_heuristics(heuristics_enum hs)       { m_heuristics = hs; }
 
@@ -156,9 +173,11 @@ private:
   choke_queue(const choke_queue&) = delete;
   choke_queue& operator=(const choke_queue&) = delete;
 
-  group_stats         prepare_weights(group_stats gs);
+  group_stats         prepare_weights(group_stats gs, uint32_t quota);
   group_stats         retrieve_connections(group_stats gs, container_type* queued, container_type* unchoked);
-  void                rebuild_containers(container_type* queued, container_type* unchoked);
+
+  uint32_t            size_group_queued() const;
+  uint32_t            size_group_unchoked() const;
 
   inline uint32_t     max_alternate() const;
 
@@ -46,9 +46,11 @@ namespace torrent {
 
 DownloadManager::iterator
 DownloadManager::insert(DownloadWrapper* d) {
-  if (find(d->info()->hash()) != end())
+  if (!m_hash_index.emplace(d->info()->hash(), d).second)
     throw internal_error("Could not add torrent as it already exists.");
 
+  m_hash_obfuscated_index[d->info()->hash_obfuscated()] = d;
+
   return base_type::insert(end(), d);
 }
 
@@ -58,13 +60,19 @@ DownloadManager::erase(DownloadWrapper* d) {
 
   if (itr == end())
     throw internal_error("Tried to remove a torrent that doesn't exist");
-    
+
+  m_hash_index.erase(d->info()->hash());
+  m_hash_obfuscated_index.erase(d->info()->hash_obfuscated());
+
   delete *itr;
   return base_type::erase(itr);
 }
 
 void
 DownloadManager::clear() {
+  m_hash_index.clear();
+  m_hash_obfuscated_index.clear();
+
   while (!empty()) {
     delete base_type::back();
     base_type::pop_back();
@@ -78,7 +86,12 @@ DownloadManager::find(const std::string& hash) {
 
 DownloadManager::iterator
 DownloadManager::find(const HashString& hash) {
-  return std::find_if(begin(), end(), [hash](const auto& wrapper){ return hash == wrapper->info()->hash(); });
+  auto index_itr = m_hash_index.find(hash);
+
+  if (index_itr == m_hash_index.end())
+    return end();
+
+  return std::find(begin(), end(), index_itr->second);
 }
 
 DownloadManager::iterator
@@ -93,24 +106,22 @@ DownloadManager::find_chunk_list(ChunkList* cl) {
 
 DownloadMain*
 DownloadManager::find_main(const char* hash) {
-  auto hash_str = *HashString::cast_from(hash);
-  auto itr = std::find_if(begin(), end(), [hash_str](const auto& wrapper){ return hash_str == wrapper->info()->hash(); });
+  auto itr = m_hash_index.find(*HashString::cast_from(hash));
 
-  if (itr == end())
+  if (itr == m_hash_index.end())
     return NULL;
   else
-    return (*itr)->main();
+    return itr->second->main();
 }
 
 DownloadMain*
 DownloadManager::find_main_obfuscated(const char* hash) {
-  auto hash_str = *HashString::cast_from(hash);
-  auto itr = std::find_if(begin(), end(), [hash_str](const auto& wrapper){ return hash_str == wrapper->info()->hash_obfuscated(); });
+  auto itr = m_hash_obfuscated_index.find(*HashString::cast_from(hash));
 
-  if (itr == end())
+  if (itr == m_hash_obfuscated_index.end())
     return NULL;
   else
-    return (*itr)->main();
+    return itr->second->main();
 }
 
 }
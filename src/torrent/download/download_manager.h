@@ -37,10 +37,13 @@
 #ifndef LIBTORRENT_DOWNLOAD_MANAGER_H
 #define LIBTORRENT_DOWNLOAD_MANAGER_H
 
+#include <cstring>
 #include <string>
+#include <unordered_map>
 #include <vector>
 
 #include <torrent/common.h>
+#include <torrent/hash_string.h>
 
 namespace torrent {
 
@@ -95,6 +98,14 @@ public:
   iterator            erase(DownloadWrapper* d) LIBTORRENT_NO_EXPORT;
 
   void                clear() LIBTORRENT_NO_EXPORT;
+
+private:
+  using index_type = std::unordered_map<HashString, DownloadWrapper*, hash_string_hash>;
+
+  // Incoming handshakes look up the download by its info hash, or by
+  // SHA1("req2", info hash) for encrypted ones.
+  index_type          m_hash_index;
+  index_type          m_hash_obfuscated_index;
 };
 
 }
@@ -0,0 +1,53 @@
+#include "config.h"
+
+#include "torrent/download/event_journal.h"
+
+#include <algorithm>
+
+#include "globals.h"
+#include "torrent/exceptions.h"
+
+namespace torrent {
+
+EventJournal::EventJournal(size_t capacity) {
+  set_capacity(capacity);
+}
+
+void
+EventJournal::set_capacity(size_t capacity) {
+  if (capacity == 0)
+    throw input_error("Event journal capacity must be non-zero.");
+
+  m_records.clear();
+  m_records.resize(capacity);
+  m_size = 0;
+}
+
+void
+EventJournal::push(event_type type, const HashString& hash, uint32_t value) {
+  EventRecord& record = m_records[m_head % m_records.size()];
+
+  record.sequence  = m_head;
+  record.timestamp = cachedTime.usec();
+  record.hash      = hash;
+  record.type      = type;
+  record.value     = value;
+
+  m_head++;
+  m_size = std::min(m_size + 1, m_records.size());
+}
+
+bool
+EventJournal::drain(uint64_t& sequence, std::vector<EventRecord>& records, size_t max_count) {
+  bool complete = sequence >= tail();
+
+  if (!complete)
+    sequence = tail();
+
+  for (; sequence < m_head && max_count != 0; sequence++, max_count--)
+    records.push_back(m_records[sequence % m_records.size()]);
+
+  return complete;
+}
+
+}
@@ -0,0 +1,88 @@
+#ifndef LIBTORRENT_TORRENT_DOWNLOAD_EVENT_JOURNAL_H
+#define LIBTORRENT_TORRENT_DOWNLOAD_EVENT_JOURNAL_H
+
+#include <vector>
+#include <torrent/common.h>
+#include <torrent/hash_string.h>
+
+namespace torrent {
+
+// Compact record of a change to a download. The meaning of 'value'
+// depends on the type:
+//
+// event_tracker_success: peers inserted from the reply.
+// event_priority: wanted chunks after the change.
+//
+// Otherwise it is zero.
+
+struct LIBTORRENT_EXPORT EventRecord {
+  uint64_t            sequence;
+  int64_t             timestamp;
+  HashString          hash;
+  uint32_t            type;
+  uint32_t            value;
+};
+
+// Ring buffer of the changes to the downloads, so clients can drain
+// what changed since their last visit rather than polling every
+// download. Each record gets a sequence number one higher than the
+// last, and a client keeps the sequence to continue from.
+//
+// Once full the oldest records are overwritten. A client that falls
+// behind is told so by 'drain', and should then resync from a full
+// poll, e.g. with 'stats_snapshot()'.
+//
+// Records are pushed and drained on the main thread.
+
+class LIBTORRENT_EXPORT EventJournal {
+public:
+  enum event_type : uint32_t {
+    event_added,
+    event_removed,
+    event_opened,
+    event_closed,
+    event_started,
+    event_stopped,
+    event_paused,
+    event_hash_done,
+    event_completed,
+    event_tracker_success,
+    event_tracker_failed,
+    event_priority,
+    event_storage_error
+  };
+
+  static constexpr size_t default_capacity = 4096;
+
+  EventJournal(size_t capacity = default_capacity);
+
+  size_t              capacity() const { return m_records.size(); }
+
+  // Clears the journal, the sequence numbers keep counting.
+  void                set_capacity(size_t capacity);
+
+  // Sequence number of the next record pushed, and of the oldest one
+  // still kept.
+  uint64_t            head() const { return m_head; }
+  uint64_t            tail() const { return m_head - m_size; }
+
+  size_t              size() const { return m_size; }
+  bool                empty() const { return m_size == 0; }
+
+  void                push(event_type type, const HashString& hash, uint32_t value = 0);
+
+  // Appends the records from 'sequence' onward to 'records', at most
+  // 'max_count' of them, and moves 'sequence' past them. Returns
+  // false if records after 'sequence' were already overwritten, the
+  // remaining ones are still appended.
+  bool                drain(uint64_t& sequence, std::vector<EventRecord>& records, size_t max_count = ~size_t());
+
+private:
+  std::vector<EventRecord> m_records;
+  uint64_t            m_head{0};
+  size_t              m_size{0};
+};
+
+}
+
+#endif
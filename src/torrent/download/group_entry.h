@@ -121,10 +121,11 @@ inline void group_entry::connection_queued(PeerConnectionBase* pcb) {
 
 inline void
 group_entry::connection_choked(PeerConnectionBase* pcb) {
-  container_type::iterator itr = std::find_if(m_unchoked.begin(), m_unchoked.end(),
-                                              std::bind(&weighted_connection::operator==, std::placeholders::_1, pcb));
+  // Searched from the back as choke_queue takes connections from there.
+  auto itr = std::find_if(m_unchoked.rbegin(), m_unchoked.rend(),
+                          std::bind(&weighted_connection::operator==, std::placeholders::_1, pcb));
 
-  if (itr == m_unchoked.end()) throw internal_error("group_entry::connection_choked(pcb) failed.");
+  if (itr == m_unchoked.rend()) throw internal_error("group_entry::connection_choked(pcb) failed.");
 
   std::swap(*itr, m_unchoked.back());
   m_unchoked.pop_back();
@@ -132,10 +133,11 @@ group_entry::connection_choked(PeerConnectionBase* pcb) {
 
 inline void
 group_entry::connection_unqueued(PeerConnectionBase* pcb) {
-  container_type::iterator itr = std::find_if(m_queued.begin(), m_queued.end(),
-                                              std::bind(&weighted_connection::operator==, std::placeholders::_1, pcb));
+  // Searched from the back as choke_queue takes connections from there.
+  auto itr = std::find_if(m_queued.rbegin(), m_queued.rend(),
+                          std::bind(&weighted_connection::operator==, std::placeholders::_1, pcb));
 
-  if (itr == m_queued.end()) throw internal_error("group_entry::connection_unqueued(pcb) failed.");
+  if (itr == m_queued.rend()) throw internal_error("group_entry::connection_unqueued(pcb) failed.");
 
   std::swap(*itr, m_queued.back());
   m_queued.pop_back();
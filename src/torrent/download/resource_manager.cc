@@ -2,6 +2,7 @@
 
 #include <algorithm>
 #include <functional>
+#include <iterator>
 #include <limits>
 #include <numeric>
 
@@ -44,6 +45,7 @@ ResourceManager::insert(const resource_manager_entry& entry) {
   DownloadMain* download = itr->download();
 
   download->set_choke_group(choke_base_type::at(entry.group()));
+  download->set_throttle_weight(entry.priority());
 
   if (will_realloc) {
     update_group_iterators();
@@ -190,6 +192,7 @@ ResourceManager::set_priority(iterator itr, uint16_t pri) {
   LT_LOG_ITR("set priority: %" PRIu16, 0)
 
   itr->set_priority(pri);
+  itr->download()->set_throttle_weight(pri);
 }
 
 void
@@ -311,6 +314,17 @@ ResourceManager::total_weight() const {
   return total;
 }
 
+int
+ResourceManager::cycle_queue(choke_queue* queue, unsigned int quota) {
+  if (!queue->is_cycle_needed(quota)) {
+    m_groups_skipped_counter++;
+    return 0;
+  }
+
+  m_groups_cycled_counter++;
+  return queue->cycle(quota);
+}
+
 int
 ResourceManager::balance_unchoked(unsigned int weight, unsigned int max_unchoked, bool is_up) {
   int change = 0;
@@ -321,13 +335,28 @@ ResourceManager::balance_unchoked(unsigned int weight, unsigned int max_unchoked
     while (group_itr != choke_base_type::end()) {
       choke_queue* cm = is_up ? (*group_itr)->up_queue() : (*group_itr)->down_queue();
 
-      change += cm->cycle(std::numeric_limits<unsigned int>::max());
+      change += cycle_queue(cm, std::numeric_limits<unsigned int>::max());
       group_itr++;
     }
 
     return change;
   }
 
+  if (is_up && m_globalUploadUnchoke) {
+    std::vector<choke_queue*> queues;
+    std::transform(choke_base_type::begin(), choke_base_type::end(), std::back_inserter(queues), std::mem_fn(&choke_group::up_queue));
+
+    if (std::none_of(queues.begin(), queues.end(), [max_unchoked](auto queue) { return queue->is_cycle_needed(max_unchoked); })) {
+      m_groups_skipped_counter += queues.size();
+      return 0;
+    }
+
+    LT_LOG_THIS("balancing upload unchoked slots globally; current_unchoked:%u max_unchoked:%u", m_currentlyUploadUnchoked, max_unchoked);
+
+    m_groups_cycled_counter += queues.size();
+    return choke_queue::cycle_global(queues, max_unchoked);
+  }
+
   unsigned int quota = max_unchoked;
 
   // We put the downloads with fewest interested first so that those
@@ -359,7 +388,7 @@ ResourceManager::balance_unchoked(unsigned int weight, unsigned int max_unchoked
     choke_queue* cm = is_up ? group->up_queue() : group->down_queue();
 
     // change += cm->cycle(weight != 0 ? (quota * itr->priority()) / weight : 0);
-    change += cm->cycle(weight != 0 ? quota / weight : 0);
+    change += cycle_queue(cm, weight != 0 ? quota / weight : 0);
 
     quota -= cm->size_unchoked();
     // weight -= itr->priority();
@@ -45,7 +45,8 @@
 namespace torrent {
 
 // This class will handle the division of various resources like
-// uploads. For now the weight is equal to the value of the priority.
+// uploads. For now the weight is equal to the value of the priority,
+// which is also used as the throttle weight of the download's peers.
 //
 // Although the ConnectionManager class keeps a tally of open sockets,
 // we still need to balance them across the different downloads so
@@ -54,6 +55,7 @@ namespace torrent {
 // Add unlimited handling later.
 
 class choke_group;
+class choke_queue;
 class DownloadMain;
 class Rate;
 class ResourceManager;
@@ -141,6 +143,13 @@ public:
   void                set_max_upload_unchoked(unsigned int m);
   void                set_max_download_unchoked(unsigned int m);
 
+  // Rank the interested peers of all downloads together by upload
+  // rate when assigning the upload slots, instead of splitting the
+  // slots between the choke groups. Only used when the upload slots
+  // are limited.
+  bool                is_global_upload_unchoke() const          { return m_globalUploadUnchoke; }
+  void                set_global_upload_unchoke(bool state)     { m_globalUploadUnchoke = state; }
+
   void                receive_upload_unchoke(int num);
   void                receive_download_unchoke(int num);
 
@@ -149,6 +158,12 @@ public:
 
   void                receive_tick();
 
+  // Choke queues cycled or skipped by receive_tick(), a queue is
+  // skipped when it has no queued connections and is within its
+  // quota.
+  uint64_t            groups_cycled_counter() const             { return m_groups_cycled_counter; }
+  uint64_t            groups_skipped_counter() const            { return m_groups_skipped_counter; }
+
 private:
   ResourceManager(const ResourceManager&) = delete;
   ResourceManager& operator=(const ResourceManager&) = delete;
@@ -160,6 +175,7 @@ private:
 
   unsigned int        total_weight() const;
 
+  int                 cycle_queue(choke_queue* queue, unsigned int quota);
   int                 balance_unchoked(unsigned int weight, unsigned int max_unchoked, bool is_up);
 
   unsigned int        m_currentlyUploadUnchoked{0};
@@ -167,6 +183,11 @@ private:
 
   unsigned int        m_maxUploadUnchoked{0};
   unsigned int        m_maxDownloadUnchoked{0};
+
+  bool                m_globalUploadUnchoke{false};
+
+  uint64_t            m_groups_cycled_counter{0};
+  uint64_t            m_groups_skipped_counter{0};
 };
 
 }
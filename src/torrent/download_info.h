@@ -41,6 +41,8 @@ public:
   static constexpr int flag_meta_download       = (1 << 6);
   static constexpr int flag_pex_enabled         = (1 << 7);
   static constexpr int flag_pex_active          = (1 << 8);
+  static constexpr int flag_hibernating         = (1 << 9);
+  static constexpr int flag_paused              = (1 << 10);
 
   static constexpr int public_flags = flag_accepting_seeders;
 
@@ -68,6 +70,8 @@ public:
   bool                is_meta_download() const                     { return m_flags & flag_meta_download; }
   bool                is_pex_enabled() const                       { return m_flags & flag_pex_enabled; }
   bool                is_pex_active() const                        { return m_flags & flag_pex_active; }
+  bool                is_hibernating() const                       { return m_flags & flag_hibernating; }
+  bool                is_paused() const                            { return m_flags & flag_paused; }
 
   int                 flags() const                                { return m_flags; }
 
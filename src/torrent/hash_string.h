@@ -4,6 +4,7 @@
 #ifndef LIBTORRENT_HASH_STRING_H
 #define LIBTORRENT_HASH_STRING_H
 
+#include <cstdint>
 #include <cstring>
 #include <string>
 #include <iterator>
@@ -53,8 +54,8 @@ public:
 
   void                assign(const value_type* src)     { std::memcpy(data(), src, size()); }
 
-  bool                equal_to(const char* hash) const     { return std::memcmp(m_data, hash, size()) == 0; }
-  bool                not_equal_to(const char* hash) const { return std::memcmp(m_data, hash, size()) != 0; }
+  bool                equal_to(const char* hash) const;
+  bool                not_equal_to(const char* hash) const { return !equal_to(hash); }
 
   static HashString   new_zero();
 
@@ -77,6 +78,88 @@ std::string hash_string_to_html_str(const HashString& hash) LIBTORRENT_EXPORT;
 
 inline const char* hash_string_to_hex_first(const HashString& hash, char* first) { hash_string_to_hex(hash, first); return first; }
 
+// Hashes are compared and ordered as two 64-bit words and a final
+// 32-bit word, loaded so that the first byte of the hash is the most
+// significant.
+inline uint64_t
+hash_string_word(const char* hash, unsigned int index) {
+  uint64_t w = 0;
+  std::memcpy(&w, hash + index * sizeof(w), index == 2 ? 4 : sizeof(w));
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+  return __builtin_bswap64(w);
+#else
+  return w;
+#endif
+}
+
+inline uint64_t hash_string_word(const HashString& hash, unsigned int index) { return hash_string_word(hash.data(), index); }
+
+inline bool
+hash_string_equal(const char* one, const char* two) {
+  uint64_t a[2], b[2];
+  uint32_t a_tail, b_tail;
+
+  std::memcpy(a, one, sizeof(a));
+  std::memcpy(b, two, sizeof(b));
+  std::memcpy(&a_tail, one + sizeof(a), sizeof(a_tail));
+  std::memcpy(&b_tail, two + sizeof(b), sizeof(b_tail));
+
+  return ((a[0] ^ b[0]) | (a[1] ^ b[1]) | (a_tail ^ b_tail)) == 0;
+}
+
+inline int
+hash_string_compare(const HashString& one, const HashString& two) {
+  for (unsigned int i = 0; i != 3; i++) {
+    uint64_t a = hash_string_word(one, i);
+    uint64_t b = hash_string_word(two, i);
+
+    if (a != b)
+      return a < b ? -1 : 1;
+  }
+
+  return 0;
+}
+
+// Number of leading bits the hashes have in common, 160 if equal.
+inline unsigned int
+hash_string_common_prefix(const HashString& one, const HashString& two) {
+  for (unsigned int i = 0; i != 3; i++) {
+    uint64_t diff = hash_string_word(one, i) ^ hash_string_word(two, i);
+
+    if (diff != 0)
+      return i * 64 + __builtin_clzll(diff);
+  }
+
+  return HashString::size_data * 8;
+}
+
+// Check whether hash one is closer to target than hash two by XOR
+// distance.
+inline bool
+hash_string_is_closer(const HashString& one, const HashString& two, const HashString& target) {
+  for (unsigned int i = 0; i != 3; i++) {
+    uint64_t t = hash_string_word(target, i);
+    uint64_t a = hash_string_word(one, i) ^ t;
+    uint64_t b = hash_string_word(two, i) ^ t;
+
+    if (a != b)
+      return a < b;
+  }
+
+  return false;
+}
+
+// Hasher for unordered containers keyed by info hashes or DHT node
+// IDs. The leading bits of node IDs close to our own are nearly
+// identical, so the word at offset 8 is used; it is uniformly
+// distributed for both.
+struct hash_string_hash {
+  static constexpr unsigned int offset = 8;
+
+  size_t operator () (const HashString& hash) const { size_t v; std::memcpy(&v, hash.data() + offset, sizeof(v)); return v; }
+  size_t operator () (const HashString* hash) const { return (*this)(*hash); }
+};
+
 inline HashString
 HashString::new_zero() {
   HashString hash;
@@ -84,24 +167,29 @@ HashString::new_zero() {
   return hash;
 }
 
+inline bool
+HashString::equal_to(const char* hash) const {
+  return hash_string_equal(m_data, hash);
+}
+
 inline bool
 operator == (const HashString& one, const HashString& two) {
-  return std::memcmp(one.begin(), two.begin(), HashString::size_data) == 0;
+  return hash_string_equal(one.data(), two.data());
 }
 
 inline bool
 operator != (const HashString& one, const HashString& two) {
-  return std::memcmp(one.begin(), two.begin(), HashString::size_data) != 0;
+  return !hash_string_equal(one.data(), two.data());
 }
 
 inline bool
 operator < (const HashString& one, const HashString& two) {
-  return std::memcmp(one.begin(), two.begin(), HashString::size_data) < 0;
+  return hash_string_compare(one, two) < 0;
 }
 
 inline bool
 operator <= (const HashString& one, const HashString& two) {
-  return std::memcmp(one.begin(), two.begin(), HashString::size_data) <= 0;
+  return hash_string_compare(one, two) <= 0;
 }
 
 }
@@ -50,6 +50,14 @@ public:
   uint32_t       timeout() const { return m_timeout; }
   void           set_timeout(uint32_t seconds) { m_timeout = seconds; }
 
+  // Byte range to request, used by web seeds. A length of zero
+  // requests the whole resource. Implementations must fail the
+  // request rather than write more than the range, e.g. when the
+  // server ignores it and replies with the whole file.
+  uint64_t       range_offset() const { return m_range_offset; }
+  uint64_t       range_length() const { return m_range_length; }
+  void           set_range(uint64_t offset, uint64_t length) { m_range_offset = offset; m_range_length = length; }
+
   // The owner of the Http object must close it as soon as possible
   // after receiving the signal, as the implementation may allocate
   // limited resources during its lifetime.
@@ -71,6 +79,9 @@ protected:
   // When you change this to a different type, update curl_get.cc where it multiplies 1s*m_timeout.
   uint32_t       m_timeout{};
 
+  uint64_t       m_range_offset{};
+  uint64_t       m_range_length{};
+
   signal_void    m_signal_done;
   signal_string  m_signal_failed;
 
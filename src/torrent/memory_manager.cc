@@ -0,0 +1,67 @@
+#include "config.h"
+
+#include "torrent/memory_manager.h"
+
+#include "torrent/exceptions.h"
+#include "torrent/utils/log.h"
+
+#define LT_LOG(log_fmt, ...)                                            \
+  lt_log_print(LOG_NOTICE, "memory_manager: " log_fmt, __VA_ARGS__);
+
+namespace torrent {
+
+std::atomic<uint64_t> MemoryManager::m_usage[category_size]{};
+
+MemoryManager::MemoryManager() = default;
+MemoryManager::~MemoryManager() = default;
+
+uint64_t
+MemoryManager::usage_total() {
+  uint64_t total = 0;
+
+  for (int i = 0; i != category_size; i++)
+    total += usage(static_cast<category_type>(i));
+
+  return total;
+}
+
+void
+MemoryManager::set_budget(category_type category, uint64_t bytes) {
+  if (category >= category_size)
+    throw input_error("MemoryManager::set_budget(...) invalid category.");
+
+  m_budget[category] = bytes;
+}
+
+void
+MemoryManager::check_budgets() {
+  for (int i = 0; i != category_size; i++) {
+    auto category = static_cast<category_type>(i);
+    auto used = usage(category);
+
+    if (m_budget[i] == 0 || used <= m_budget[i])
+      continue;
+
+    LT_LOG("shedding %s : usage:%" PRIu64 " budget:%" PRIu64, category_name(category), used, m_budget[i]);
+
+    m_stats_shed[i]++;
+
+    for (auto& slot : m_shed_slots)
+      slot(category, used - m_budget[i]);
+  }
+}
+
+const char*
+MemoryManager::category_name(category_type category) {
+  switch (category) {
+  case category_peer_list:      return "peer_list";
+  case category_available_list: return "available_list";
+  case category_connections:    return "connections";
+  case category_dht:            return "dht";
+  case category_log:            return "log";
+  default:
+    throw input_error("MemoryManager::category_name(...) invalid category.");
+  }
+}
+
+}
@@ -0,0 +1,107 @@
+#ifndef LIBTORRENT_MEMORY_MANAGER_H
+#define LIBTORRENT_MEMORY_MANAGER_H
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <vector>
+#include <torrent/common.h>
+
+namespace torrent {
+
+// Accounts the memory of the library's larger data structures besides
+// chunks, which ChunkManager tracks. Containers use
+// 'memory_counting_allocator' to add to the usage of their category,
+// and owners of individually allocated objects call 'inc_usage' and
+// 'dec_usage'. The counters are global and atomic as allocations
+// happen on all threads and before the manager exists.
+//
+// Categories may be given a soft budget. Once per tick the shed slots
+// are called for each category over budget with the excess, and may
+// free memory such as by trimming available lists or culling peer
+// lists. The manager installs slots for those two, the client may add
+// its own.
+
+class LIBTORRENT_EXPORT MemoryManager {
+public:
+  enum category_type {
+    category_peer_list,
+    category_available_list,
+    category_connections,
+    category_dht,
+    category_log,
+    category_size
+  };
+
+  using slot_shed = std::function<void(category_type, uint64_t)>;
+
+  MemoryManager();
+  ~MemoryManager();
+  MemoryManager(const MemoryManager&) = delete;
+  MemoryManager& operator=(const MemoryManager&) = delete;
+
+  static uint64_t     usage(category_type category)                { return m_usage[category].load(std::memory_order_relaxed); }
+  static uint64_t     usage_total();
+
+  // For internal usage.
+  static void         inc_usage(category_type category, uint64_t bytes) { m_usage[category].fetch_add(bytes, std::memory_order_relaxed); }
+  static void         dec_usage(category_type category, uint64_t bytes) { m_usage[category].fetch_sub(bytes, std::memory_order_relaxed); }
+
+  // A budget of 0 disables shedding for the category.
+  uint64_t            budget(category_type category) const         { return m_budget[category]; }
+  void                set_budget(category_type category, uint64_t bytes);
+
+  void                add_shed_slot(slot_shed slot)                { m_shed_slots.push_back(std::move(slot)); }
+
+  // Number of times the category has been shed.
+  uint32_t            stats_shed(category_type category) const     { return m_stats_shed[category]; }
+
+  // Calls the shed slots for categories over budget.
+  void                check_budgets();
+
+  static const char*  category_name(category_type category);
+
+private:
+  static std::atomic<uint64_t> m_usage[category_size];
+
+  uint64_t               m_budget[category_size]{};
+  uint32_t               m_stats_shed[category_size]{};
+  std::vector<slot_shed> m_shed_slots;
+};
+
+// Standard allocator that adds the bytes it allocates to the usage of
+// 'Category'.
+template <typename T, MemoryManager::category_type Category>
+class memory_counting_allocator {
+public:
+  using value_type = T;
+
+  template <typename U>
+  struct rebind { using other = memory_counting_allocator<U, Category>; };
+
+  memory_counting_allocator() = default;
+
+  template <typename U>
+  memory_counting_allocator(const memory_counting_allocator<U, Category>&) noexcept {}
+
+  T* allocate(size_t n) {
+    T* p = std::allocator<T>().allocate(n);
+    MemoryManager::inc_usage(Category, n * sizeof(T));
+    return p;
+  }
+
+  void deallocate(T* p, size_t n) noexcept {
+    MemoryManager::dec_usage(Category, n * sizeof(T));
+    std::allocator<T>().deallocate(p, n);
+  }
+
+  template <typename U>
+  bool operator == (const memory_counting_allocator<U, Category>&) const noexcept { return true; }
+  template <typename U>
+  bool operator != (const memory_counting_allocator<U, Category>&) const noexcept { return false; }
+};
+
+}
+
+#endif
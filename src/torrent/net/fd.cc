@@ -54,6 +54,16 @@ int fd__listen(int socket, int backlog) { return ::listen(socket, backlog); }
 int fd__setsockopt_int(int socket, int level, int option_name, int option_value) { return ::setsockopt(socket, level, option_name, &option_value, sizeof(int)); }
 int fd__socket(int domain, int type, int protocol) { return ::socket(domain, type, protocol); }
 
+namespace {
+
+[[maybe_unused]] int
+setsockopt_unsupported() {
+  errno = ENOPROTOOPT;
+  return -1;
+}
+
+}
+
 int
 fd_open(fd_flags flags) {
   int domain;
@@ -150,19 +160,19 @@ fd_close(int fd) {
   LT_LOG_FD("fd_close succeeded");
 }
 
-fd_sap_tuple
+fd_sa_tuple
 fd_accept(int fd) {
-  sa_unique_ptr sap = sa_make_inet6();
-  socklen_t socklen = sap_length(sap);
+  sa_inet_storage sa;
+  socklen_t socklen = sa_inet_storage::capacity();
 
-  int accept_fd = fd__accept(fd, sap.get(), &socklen);
+  int accept_fd = fd__accept(fd, sa.get(), &socklen);
 
   if (accept_fd == -1) {
     LT_LOG_FD_ERROR("fd_accept failed");
-    return fd_sap_tuple{-1, nullptr};
+    return fd_sa_tuple{-1, sa_inet_storage()};
   }
 
-  return fd_sap_tuple{accept_fd, std::move(sap)};
+  return fd_sa_tuple{accept_fd, sa};
 }
 
 bool
@@ -236,6 +246,127 @@ fd_set_tcp_nodelay(int fd) {
   return true;
 }
 
+bool
+fd_set_send_buffer_size(int fd, uint32_t size) {
+  if (fd__setsockopt_int(fd, SOL_SOCKET, SO_SNDBUF, size) == -1) {
+    LT_LOG_FD_VALUE_ERROR("fd_set_send_buffer_size failed", size);
+    return false;
+  }
+
+  LT_LOG_FD_VALUE("fd_set_send_buffer_size succeeded", size);
+  return true;
+}
+
+bool
+fd_set_receive_buffer_size(int fd, uint32_t size) {
+  if (fd__setsockopt_int(fd, SOL_SOCKET, SO_RCVBUF, size) == -1) {
+    LT_LOG_FD_VALUE_ERROR("fd_set_receive_buffer_size failed", size);
+    return false;
+  }
+
+  LT_LOG_FD_VALUE("fd_set_receive_buffer_size succeeded", size);
+  return true;
+}
+
+bool
+fd_set_tcp_notsent_lowat(int fd, uint32_t bytes) {
+#ifdef TCP_NOTSENT_LOWAT
+  int result = fd__setsockopt_int(fd, IPPROTO_TCP, TCP_NOTSENT_LOWAT, bytes);
+#else
+  int result = setsockopt_unsupported();
+#endif
+
+  if (result == -1) {
+    LT_LOG_FD_VALUE_ERROR("fd_set_tcp_notsent_lowat failed", bytes);
+    return false;
+  }
+
+  LT_LOG_FD_VALUE("fd_set_tcp_notsent_lowat succeeded", bytes);
+  return true;
+}
+
+bool
+fd_set_tcp_congestion(int fd, const std::string& algorithm) {
+#ifdef TCP_CONGESTION
+  int result = ::setsockopt(fd, IPPROTO_TCP, TCP_CONGESTION, algorithm.c_str(), algorithm.size());
+#else
+  int result = setsockopt_unsupported();
+#endif
+
+  if (result == -1) {
+    LT_LOG("fd->%i: fd_set_tcp_congestion failed : value:%s errno:%i message:'%s'",
+           fd, algorithm.c_str(), errno, std::strerror(errno));
+    return false;
+  }
+
+  LT_LOG("fd->%i: fd_set_tcp_congestion succeeded : value:%s", fd, algorithm.c_str());
+  return true;
+}
+
+bool
+fd_set_busy_poll(int fd, uint32_t usec) {
+#ifdef SO_BUSY_POLL
+  int result = fd__setsockopt_int(fd, SOL_SOCKET, SO_BUSY_POLL, usec);
+#else
+  int result = setsockopt_unsupported();
+#endif
+
+  if (result == -1) {
+    LT_LOG_FD_VALUE_ERROR("fd_set_busy_poll failed", usec);
+    return false;
+  }
+
+  LT_LOG_FD_VALUE("fd_set_busy_poll succeeded", usec);
+  return true;
+}
+
+bool
+fd_set_max_pacing_rate(int fd, uint64_t rate) {
+  uint32_t value = (rate == 0 || rate >= ~uint32_t()) ? ~uint32_t() : rate;
+
+#ifdef SO_MAX_PACING_RATE
+  int result = ::setsockopt(fd, SOL_SOCKET, SO_MAX_PACING_RATE, &value, sizeof(value));
+#else
+  int result = setsockopt_unsupported();
+#endif
+
+  if (result == -1) {
+    LT_LOG("fd->%i: fd_set_max_pacing_rate failed : value:%" PRIu64 " errno:%i message:'%s'",
+           fd, rate, errno, std::strerror(errno));
+    return false;
+  }
+
+  LT_LOG("fd->%i: fd_set_max_pacing_rate succeeded : value:%" PRIu64, fd, rate);
+  return true;
+}
+
+bool
+fd_get_tcp_info(int fd, fd_tcp_info* info) {
+  *info = fd_tcp_info{};
+
+#if defined(TCP_INFO) && defined(__linux__)
+  struct tcp_info ti{};
+  socklen_t length = sizeof(ti);
+
+  if (::getsockopt(fd, IPPROTO_TCP, TCP_INFO, &ti, &length) == -1) {
+    LT_LOG_FD_ERROR("fd_get_tcp_info failed");
+    return false;
+  }
+
+  info->rtt = std::chrono::microseconds(ti.tcpi_rtt);
+  info->rtt_var = std::chrono::microseconds(ti.tcpi_rttvar);
+  info->last_data_recv = std::chrono::milliseconds(ti.tcpi_last_data_recv);
+  info->snd_cwnd = ti.tcpi_snd_cwnd;
+  info->snd_mss = ti.tcpi_snd_mss;
+  info->total_retrans = ti.tcpi_total_retrans;
+  return true;
+#else
+  setsockopt_unsupported();
+  LT_LOG_FD_ERROR("fd_get_tcp_info failed");
+  return false;
+#endif
+}
+
 bool
 fd_set_v6only(int fd, bool state) {
   if (fd__setsockopt_int(fd, IPPROTO_IPV6, IPV6_V6ONLY, state) == -1) {
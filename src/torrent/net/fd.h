@@ -1,6 +1,7 @@
 #ifndef LIBTORRENT_NET_FD_H
 #define LIBTORRENT_NET_FD_H
 
+#include <chrono>
 #include <string>
 #include <torrent/common.h>
 #include <torrent/net/types.h>
@@ -24,7 +25,7 @@ void fd_open_pipe(int& fd1, int& fd2) LIBTORRENT_EXPORT;
 void fd_open_socket_pair(int& fd1, int& fd2) LIBTORRENT_EXPORT;
 void fd_close(int fd) LIBTORRENT_EXPORT;
 
-fd_sap_tuple fd_accept(int fd) LIBTORRENT_EXPORT;
+fd_sa_tuple  fd_accept(int fd) LIBTORRENT_EXPORT;
 
 bool fd_bind(int fd, const sockaddr* sa) LIBTORRENT_EXPORT;
 bool fd_connect(int fd, const sockaddr* sa) LIBTORRENT_EXPORT;
@@ -35,6 +36,45 @@ bool fd_set_reuse_address(int fd, bool state) LIBTORRENT_EXPORT;
 bool fd_set_tcp_nodelay(int fd) LIBTORRENT_EXPORT;
 bool fd_set_v6only(int fd, bool state) LIBTORRENT_EXPORT;
 
+bool fd_set_send_buffer_size(int fd, uint32_t size) LIBTORRENT_EXPORT;
+bool fd_set_receive_buffer_size(int fd, uint32_t size) LIBTORRENT_EXPORT;
+
+// Linux only, these fail with ENOPROTOOPT where unsupported.
+//
+// TCP_NOTSENT_LOWAT limits the unsent data queued in the kernel, so
+// writes are paced by the throttles rather than the send buffer.
+// SO_BUSY_POLL is in microseconds.
+bool fd_set_tcp_notsent_lowat(int fd, uint32_t bytes) LIBTORRENT_EXPORT;
+bool fd_set_tcp_congestion(int fd, const std::string& algorithm) LIBTORRENT_EXPORT;
+bool fd_set_busy_poll(int fd, uint32_t usec) LIBTORRENT_EXPORT;
+
+// SO_MAX_PACING_RATE in bytes per second, zero clears the limit. Sent
+// data is spread out by TCP's internal pacing or the fq qdisc.
+bool fd_set_max_pacing_rate(int fd, uint64_t rate) LIBTORRENT_EXPORT;
+
+// Kernel view of a TCP connection, from TCP_INFO. Fields the platform
+// does not report are left zero.
+struct fd_tcp_info {
+  std::chrono::microseconds rtt;
+  std::chrono::microseconds rtt_var;
+  std::chrono::milliseconds last_data_recv;
+
+  uint32_t snd_cwnd;
+  uint32_t snd_mss;
+  uint32_t total_retrans;
+
+  bool     is_valid() const { return rtt.count() != 0; }
+
+  // Rate the congestion window allows over the path, in bytes per
+  // second.
+  uint64_t path_rate() const {
+    return is_valid() ? uint64_t{snd_cwnd} * snd_mss * 1000000 / rtt.count() : 0;
+  }
+};
+
+// Linux only, fails with ENOPROTOOPT where unsupported.
+bool fd_get_tcp_info(int fd, fd_tcp_info* info) LIBTORRENT_EXPORT;
+
 // Defined with gnu::weak so that we can override them in tests.
 [[gnu::weak]] int fd__accept(int socket, sockaddr *address, socklen_t *address_len) LIBTORRENT_EXPORT;
 [[gnu::weak]] int fd__bind(int socket, const sockaddr *address, socklen_t address_len) LIBTORRENT_EXPORT;
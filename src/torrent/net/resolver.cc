@@ -20,7 +20,7 @@ Resolver::init() {
 void
 Resolver::resolve_both(void* requester, const std::string& hostname, int family, both_callback&& callback) {
   thread_net()->callback(requester, [this, requester, hostname, family, callback = std::move(callback)]() {
-      thread_net()->udns()->resolve(requester, hostname, family, [this, requester, callback = std::move(callback)](sin_shared_ptr sin, sin6_shared_ptr sin6, int err) {
+      thread_net()->udns()->resolve(requester, hostname, family, [this, requester, callback = std::move(callback)](const sa_inet_storage& sin, const sa_inet_storage& sin6, int err) {
           m_thread->callback(requester, [sin, sin6, err, callback = std::move(callback)]() {
               callback(sin, sin6, err);
             });
@@ -34,22 +34,16 @@ Resolver::resolve_preferred(void* requester, const std::string& hostname, int fa
     throw internal_error("Invalid preferred family.");
 
   thread_net()->callback(requester, [this, requester, hostname, family, preferred, callback = std::move(callback)]() {
-      thread_net()->udns()->resolve(requester, hostname, family, [this, requester, preferred, callback = std::move(callback)](sin_shared_ptr sin, sin6_shared_ptr sin6, int err) {
-          sa_shared_ptr result;
+      thread_net()->udns()->resolve(requester, hostname, family, [this, requester, preferred, callback = std::move(callback)](const sa_inet_storage& sin, const sa_inet_storage& sin6, int err) {
+          sa_inet_storage result;
 
           if (err == 0) {
-            if (sin != nullptr && sin6 != nullptr) {
-              if (preferred == AF_INET)
-                result = sa_copy_in(sin.get());
-              else
-                result = sa_copy_in6(sin6.get());
-
-            } else if (sin != nullptr) {
-              result = sa_copy_in(sin.get());
-
-            } else if (sin6 != nullptr) {
-              result = sa_copy_in6(sin6.get());
-            }
+            if (!sin.empty() && !sin6.empty())
+              result = preferred == AF_INET ? sin : sin6;
+            else if (!sin.empty())
+              result = sin;
+            else
+              result = sin6;
           }
 
           m_thread->callback(requester, [result, err, callback = std::move(callback)]() {
@@ -62,15 +56,15 @@ Resolver::resolve_preferred(void* requester, const std::string& hostname, int fa
 void
 Resolver::resolve_specific(void* requester, const std::string& hostname, int family, single_callback&& callback) {
   thread_net()->callback(requester, [this, requester, hostname, family, callback = std::move(callback)]() {
-      thread_net()->udns()->resolve(requester, hostname, family, [this, requester, family, callback = std::move(callback)](sin_shared_ptr sin, sin6_shared_ptr sin6, int err) {
-          sa_shared_ptr result;
+      thread_net()->udns()->resolve(requester, hostname, family, [this, requester, family, callback = std::move(callback)](const sa_inet_storage& sin, const sa_inet_storage& sin6, int err) {
+          sa_inet_storage result;
 
-          if(err == 0) {
-            if (family == AF_INET && sin != nullptr)
-              result = sa_copy_in(sin.get());
+          if (err == 0) {
+            if (family == AF_INET)
+              result = sin;
 
-            if (family == AF_INET6 && sin6 != nullptr)
-              result = sa_copy_in6(sin6.get());
+            if (family == AF_INET6)
+              result = sin6;
           }
 
           m_thread->callback(requester, [result, err, callback = std::move(callback)]() {
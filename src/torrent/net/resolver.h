@@ -11,8 +11,9 @@ namespace torrent::net {
 
 class LIBTORRENT_EXPORT Resolver {
 public:
-  using both_callback   = std::function<void(c_sin_shared_ptr, c_sin6_shared_ptr, int)>;
-  using single_callback = std::function<void(c_sa_shared_ptr, int)>;
+  // Addresses are passed by value, and are empty when not resolved.
+  using both_callback   = std::function<void(const sa_inet_storage& sin, const sa_inet_storage& sin6, int)>;
+  using single_callback = std::function<void(const sa_inet_storage& sa, int)>;
 
   Resolver() = default;
   ~Resolver() = default;
@@ -465,6 +465,57 @@ sin6_equal_addr(const sockaddr_in6* lhs, const sockaddr_in6* rhs) {
   return std::equal(lhs->sin6_addr.s6_addr, lhs->sin6_addr.s6_addr + 16, rhs->sin6_addr.s6_addr);
 }
 
+static unsigned int
+bytes_common_prefix(const uint8_t* lhs, const uint8_t* rhs, size_t size) {
+  unsigned int bits = 0;
+
+  for (size_t i = 0; i < size; i++) {
+    uint8_t diff = lhs[i] ^ rhs[i];
+
+    if (diff != 0)
+      return bits + __builtin_clz(diff) - 24;
+
+    bits += 8;
+  }
+
+  return bits;
+}
+
+// Returns the address bytes, with v4-mapped addresses as inet.
+static const uint8_t*
+sa_prefix_bytes(const sockaddr* sa, size_t* size) {
+  switch (sa->sa_family) {
+  case AF_INET:
+    *size = 4;
+    return reinterpret_cast<const uint8_t*>(&reinterpret_cast<const sockaddr_in*>(sa)->sin_addr.s_addr);
+  case AF_INET6:
+    if (sa_is_v4mapped(sa)) {
+      *size = 4;
+      return reinterpret_cast<const sockaddr_in6*>(sa)->sin6_addr.s6_addr + 12;
+    }
+
+    *size = 16;
+    return reinterpret_cast<const sockaddr_in6*>(sa)->sin6_addr.s6_addr;
+  default:
+    *size = 0;
+    return nullptr;
+  }
+}
+
+unsigned int
+sa_common_prefix(const sockaddr* lhs, const sockaddr* rhs) {
+  size_t lhs_size;
+  size_t rhs_size;
+
+  const uint8_t* lhs_bytes = sa_prefix_bytes(lhs, &lhs_size);
+  const uint8_t* rhs_bytes = sa_prefix_bytes(rhs, &rhs_size);
+
+  if (lhs_size == 0 || lhs_size != rhs_size)
+    return 0;
+
+  return bytes_common_prefix(lhs_bytes, rhs_bytes, lhs_size);
+}
+
 std::string
 sa_addr_str(const sockaddr* sa) {
   if (sa == NULL)
@@ -77,6 +77,10 @@ bool        sa_equal_addr(const sockaddr* lhs, const sockaddr* rhs) LIBTORRENT_E
 bool        sin_equal_addr(const sockaddr_in* lhs, const sockaddr_in* rhs) LIBTORRENT_EXPORT;
 bool        sin6_equal_addr(const sockaddr_in6* lhs, const sockaddr_in6* rhs) LIBTORRENT_EXPORT;
 
+// Number of leading address bits shared, with v4-mapped addresses
+// compared as inet. Zero if the families differ.
+unsigned int sa_common_prefix(const sockaddr* lhs, const sockaddr* rhs) LIBTORRENT_EXPORT;
+
 std::string sa_addr_str(const sockaddr* sa) LIBTORRENT_EXPORT;
 std::string sin_addr_str(const sockaddr_in* sa) LIBTORRENT_EXPORT;
 std::string sin6_addr_str(const sockaddr_in6* sa) LIBTORRENT_EXPORT;
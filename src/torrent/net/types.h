@@ -3,10 +3,9 @@
 
 #include <memory>
 #include <tuple>
+#include <netinet/in.h>
 #include <sys/socket.h>
 
-struct sockaddr_in;
-struct sockaddr_in6;
 struct sockaddr_un;
 
 namespace torrent {
@@ -33,11 +32,72 @@ using c_sun_shared_ptr  = std::shared_ptr<const sockaddr_un>;
 
 using fd_sap_tuple = std::tuple<int, std::unique_ptr<sockaddr>>;
 
+// An inet or inet6 address stored inline, for passing addresses by
+// value where allocating a sockaddr for each would be wasteful. Other
+// families are not kept, and an empty address is zeroed AF_UNSPEC.
+
+class sa_inet_storage {
+public:
+  sa_inet_storage() : m_sin6{} {}
+
+  explicit sa_inet_storage(const sockaddr* sa);
+  explicit sa_inet_storage(const sockaddr_in* sin) : m_sin6{} { m_sin = *sin; }
+  explicit sa_inet_storage(const sockaddr_in6* sin6) : m_sin6{*sin6} {}
+
+  bool                empty() const  { return family() == AF_UNSPEC; }
+  bool                is_inet() const  { return family() == AF_INET; }
+  bool                is_inet6() const { return family() == AF_INET6; }
+
+  int                 family() const { return m_sa.sa_family; }
+  socklen_t           length() const;
+
+  // Largest length, e.g. for accept().
+  static constexpr socklen_t capacity() { return sizeof(sockaddr_in6); }
+
+  sockaddr*           get()       { return &m_sa; }
+  const sockaddr*     get() const { return &m_sa; }
+
+  // Only valid for the matching family.
+  const sockaddr_in*  get_in() const  { return &m_sin; }
+  const sockaddr_in6* get_in6() const { return &m_sin6; }
+
+  void                clear() { *this = sa_inet_storage(); }
+
+private:
+  union {
+    sockaddr          m_sa;
+    sockaddr_in       m_sin;
+    sockaddr_in6      m_sin6;
+  };
+};
+
+using fd_sa_tuple = std::tuple<int, sa_inet_storage>;
+
 struct listen_result_type {
   int fd;
   sa_unique_ptr address;
 };
 
+inline
+sa_inet_storage::sa_inet_storage(const sockaddr* sa) : m_sin6{} {
+  if (sa == nullptr)
+    return;
+
+  if (sa->sa_family == AF_INET)
+    m_sin = *reinterpret_cast<const sockaddr_in*>(sa);
+  else if (sa->sa_family == AF_INET6)
+    m_sin6 = *reinterpret_cast<const sockaddr_in6*>(sa);
+}
+
+inline socklen_t
+sa_inet_storage::length() const {
+  switch (family()) {
+  case AF_INET:  return sizeof(sockaddr_in);
+  case AF_INET6: return sizeof(sockaddr_in6);
+  default:       return 0;
+  }
+}
+
 }
 
 #endif
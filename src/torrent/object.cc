@@ -70,7 +70,7 @@ Object::get_key(const std::string& k) const {
 Object&
 Object::get_key(const char* k) {
   check_throw(TYPE_MAP);
-  auto itr = _map().find(std::string(k));
+  auto itr = _map().find(k);
 
   if (itr == _map().end())
     throw bencode_error("Object operator [" + std::string(k) + "] could not find element");
@@ -81,7 +81,7 @@ Object::get_key(const char* k) {
 const Object&
 Object::get_key(const char* k) const {
   check_throw(TYPE_MAP);
-  auto itr = _map().find(std::string(k));
+  auto itr = _map().find(k);
 
   if (itr == _map().end())
     throw bencode_error("Object operator [" + std::string(k) + "] could not find element");
@@ -89,6 +89,18 @@ Object::get_key(const char* k) const {
   return itr->second;
 }
 
+Object&
+Object::insert_key_move(const key_type& k, Object& b) {
+  check_throw(TYPE_MAP);
+
+  // Take 'b' out first as it may be an entry of this map, which the
+  // insert could reallocate.
+  Object tmp;
+  tmp.move(b);
+
+  return _map()[k].move(tmp);
+}
+
 Object::map_insert_type
 Object::insert_preserve_type(const key_type& k, Object& b) {
   check_throw(TYPE_MAP);
@@ -103,7 +115,7 @@ Object::insert_preserve_type(const key_type& k, Object& b) {
 }
 
 Object&
-Object::move(Object& src) noexcept {
+Object::move(Object& src) {
   if (this == &src)
     return *this;
 
@@ -114,7 +126,7 @@ Object::move(Object& src) noexcept {
 }
 
 Object&
-Object::swap(Object& src) noexcept {
+Object::swap(Object& src) {
   if (this == &src)
     return *this;
 
@@ -148,10 +160,9 @@ Object::merge_copy(const Object& object, uint32_t skip_mask, uint32_t maxDepth)
     for (const auto& map : object.as_map()) {
       destItr = std::find_if(destItr, dest.end(), [&map](const auto& v) { return map.first <= v.first; });
 
-      if (map.first < destItr->first)
-        // destItr remains valid and pointing to the next possible
-        // position.
-        dest.insert(destItr, map);
+      if (destItr == dest.end() || map.first < destItr->first)
+        // Inserting invalidates destItr, continue after the new entry.
+        destItr = std::next(dest.insert(destItr, map));
       else
         destItr->second.merge_copy(map.second, maxDepth - 1);
     }
@@ -195,9 +206,10 @@ Object::operator = (const Object& src) {
   switch (type()) {
   case TYPE_STRING:   new (&_string()) string_type(src._string()); break;
   case TYPE_LIST:     new (&_list()) list_type(src._list()); break;
-  case TYPE_MAP:      _map_ptr() = new map_type(src._map()); break;
+  case TYPE_MAP:      _map_ptr() = new_map(std::pmr::get_default_resource(), src._map()); break;
   case TYPE_DICT_KEY: new (&_dict_key()) dict_key_type(src._dict_key()); _dict_key().second = new Object(*src._dict_key().second); break;
-  default: t_pod = src.t_pod; break;
+  case TYPE_NONE:     break;
+  default:            t_pod = src.t_pod; break;
   }
 
   return *this;
@@ -219,7 +231,7 @@ Object object_create_normal(const raw_list& obj) {
   raw_list::iterator last = obj.end();
 
   while (first != last) {
-    auto new_entry = result.as_list().insert(result.as_list().end(), Object());
+    auto new_entry = result.as_list().emplace(result.as_list().end());
 
     first = object_read_bencode_c(first, last, &*new_entry, 128);
 
@@ -239,27 +251,25 @@ Object object_create_normal(const raw_map& obj) {
   raw_list::iterator first = obj.begin();
   raw_list::iterator last = obj.end();
 
-  Object::string_type prev;
+  raw_string prev;
 
   while (first != last) {
     raw_string raw_str = object_read_bencode_c_string(first, last);
     first = raw_str.end();
 
-    Object::string_type key_str = raw_str.as_string();
-
     // We do not set flag_unordered if the first key was zero
     // length, while multiple zero length keys will trigger the
     // unordered_flag.
-    if (key_str <= prev && !result.as_map().empty())
+    if (!(prev < raw_str) && !result.as_map().empty())
       result.set_internal_flags(Object::flag_unordered);
 
-    Object* value = &result.as_map()[key_str];
+    Object* value = &result.as_map()[raw_str.as_string()];
     first = object_read_bencode_c(first, last, value, 128);
 
     if (value->flags() & Object::flag_unordered)
       result.set_internal_flags(Object::flag_unordered);
 
-    key_str.swap(prev);
+    prev = raw_str;
   }
 
   return result;
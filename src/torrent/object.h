@@ -39,20 +39,29 @@
 
 #include <limits>
 #include <map>
+#include <memory_resource>
 #include <string>
 #include <vector>
 #include <torrent/common.h>
 #include <torrent/exceptions.h>
 #include <torrent/object_raw_bencode.h>
+#include <torrent/utils/flat_map.h>
 
 namespace torrent {
 
+// Lists and maps use polymorphic allocators so that trees can be
+// built in an object_arena. Copies always allocate from the default
+// resource, moves keep the source's resource and swaps keep each
+// container in its own.
+
 class LIBTORRENT_EXPORT Object {
 public:
   using value_type    = int64_t;
   using string_type   = std::string;
-  using list_type     = std::vector<Object>;
-  using map_type      = std::map<std::string, Object>;
+  using list_type     = std::pmr::vector<Object>;
+  // Dictionaries are sorted vectors, inserting or erasing keys
+  // invalidates references to the other entries.
+  using map_type      = flat_map<std::string, Object, std::pmr::polymorphic_allocator<std::pair<std::string, Object>>>;
   using map_ptr_type  = map_type*;
   using key_type      = map_type::key_type;
   using dict_key_type = std::pair<std::string, Object*>;
@@ -101,6 +110,7 @@ public:
   Object(const value_type v)   : m_flags(TYPE_VALUE) { new (&_value()) value_type(v); }
   Object(const char* s)        : m_flags(TYPE_STRING) { new (&_string()) string_type(s); }
   Object(const string_type& s) : m_flags(TYPE_STRING) { new (&_string()) string_type(s); }
+  Object(string_type&& s)      : m_flags(TYPE_STRING) { new (&_string()) string_type(std::move(s)); }
   Object(const raw_bencode& r) : m_flags(TYPE_RAW_BENCODE) { new (&_raw_bencode()) raw_bencode(r); }
   Object(const raw_string& r)  : m_flags(TYPE_RAW_STRING) { new (&_raw_string()) raw_string(r); }
   Object(const raw_list& r)    : m_flags(TYPE_RAW_LIST) { new (&_raw_list()) raw_list(r); }
@@ -109,15 +119,19 @@ public:
   Object() {}
   ~Object() { clear(); }
   Object(const Object& b);
+  Object(Object&& b) noexcept { move_construct(b); }
   Object& operator=(const Object& b);
+  Object& operator=(Object&& b) noexcept;
 
   // TODO: Move this out of the class namespace, call them
   // make_object_. 
   static Object       create_empty(type_type t);
   static Object       create_value()  { return Object(value_type()); }
   static Object       create_string() { return Object(string_type()); }
-  static Object       create_list()   { Object tmp; tmp.m_flags = TYPE_LIST; new (&tmp._list()) list_type(); return tmp; }
-  static Object       create_map()    { Object tmp; tmp.m_flags = TYPE_MAP; tmp._map_ptr() = new map_type(); return tmp; }
+  static Object       create_list()   { return create_list(std::pmr::get_default_resource()); }
+  static Object       create_map()    { return create_map(std::pmr::get_default_resource()); }
+  static Object       create_list(std::pmr::memory_resource* resource);
+  static Object       create_map(std::pmr::memory_resource* resource);
   static Object       create_dict_key();
 
   static Object       create_raw_bencode(raw_bencode obj = raw_bencode());
@@ -213,8 +227,8 @@ public:
   template <typename T> map_type&          get_key_map(const T& k)          { return get_key(k).as_map(); }
   template <typename T> const map_type&    get_key_map(const T& k) const    { return get_key(k).as_map(); }
 
-  Object&             insert_key(const key_type& k, const Object& b) { check_throw(TYPE_MAP); return _map()[k] = b; }
-  Object&             insert_key_move(const key_type& k, Object& b)  { check_throw(TYPE_MAP); return _map()[k].move(b); }
+  Object&             insert_key(const key_type& k, const Object& b) { check_throw(TYPE_MAP); return _map().insert_or_assign(k, b).first->second; }
+  Object&             insert_key_move(const key_type& k, Object& b);
 
   // 'insert_preserve_*' inserts the object 'b' if the key 'k' does
   // not exist, else it returns the old entry. The type specific
@@ -232,9 +246,11 @@ public:
   Object&             insert_back(const Object& b)                   { check_throw(TYPE_LIST); return *_list().insert(_list().end(), b); }
 
   // Copy and merge operations:
-  Object&             move(Object& b) noexcept;
-  Object&             swap(Object& b) noexcept;
-  Object&             swap_same_type(Object& b) noexcept;
+  // These may allocate when the two objects use different memory
+  // resources, e.g. when swapping with an object_arena tree.
+  Object&             move(Object& b);
+  Object&             swap(Object& b);
+  Object&             swap_same_type(Object& b);
 
   // Only map entries are merged.
   Object&             merge_move(Object& object, uint32_t maxDepth = ~uint32_t());
@@ -243,9 +259,16 @@ public:
                                  uint32_t maxDepth = ~uint32_t());
 
   // Internal:
-  void                swap_same_type(Object& left, Object& right) noexcept;
+  void                swap_same_type(Object& left, Object& right);
 
  private:
+  // The map itself is allocated from the same resource as its nodes.
+  template <typename... Args>
+  static map_type*    new_map(std::pmr::memory_resource* resource, Args&&... args);
+  static void         delete_map(map_type* map);
+
+  void                move_construct(Object& b) noexcept;
+
   bool                check(map_type::const_iterator itr, type_type t) const { return itr != _map().end() && itr->second.type() == t; }
   void                check_throw(type_type t) const                         { if (t != type()) throw bencode_error("Wrong object type."); }
 
@@ -347,7 +370,7 @@ Object::Object(const Object& b) :
     m_flags(b.m_flags & (mask_type | mask_public)) {
 
   switch (type()) {
-  case TYPE_NONE:
+  case TYPE_NONE:        break;
   case TYPE_RAW_BENCODE:
   case TYPE_RAW_STRING: 
   case TYPE_RAW_LIST: 
@@ -355,13 +378,92 @@ Object::Object(const Object& b) :
   case TYPE_VALUE:       t_pod = b.t_pod; break;
   case TYPE_STRING:      new (&_string()) string_type(b._string()); break;
   case TYPE_LIST:        new (&_list()) list_type(b._list()); break;
-  case TYPE_MAP:         _map_ptr() = new map_type(b._map()); break;
+  case TYPE_MAP:         _map_ptr() = new_map(std::pmr::get_default_resource(), b._map()); break;
   case TYPE_DICT_KEY:
     new (&_dict_key().first) string_type(b._dict_key().first);
     _dict_key().second = new Object(*b._dict_key().second); break;
   }
 }
 
+inline void
+Object::move_construct(Object& b) noexcept {
+  m_flags = b.m_flags & (mask_type | mask_public);
+
+  switch (type()) {
+  case TYPE_NONE:
+    return;
+  case TYPE_RAW_BENCODE:
+  case TYPE_RAW_STRING:
+  case TYPE_RAW_LIST:
+  case TYPE_RAW_MAP:
+  case TYPE_VALUE:
+  case TYPE_MAP:
+    // Maps are owned through the pointer.
+    t_pod = b.t_pod;
+    b.m_flags = TYPE_NONE;
+    return;
+  case TYPE_STRING:   new (&_string()) string_type(std::move(b._string())); break;
+  case TYPE_LIST:     new (&_list()) list_type(std::move(b._list())); break;
+  case TYPE_DICT_KEY:
+    new (&_dict_key()) dict_key_type(std::move(b._dict_key()));
+    b._dict_key().second = nullptr; break;
+  }
+
+  b.clear();
+}
+
+// The source may be an element of this object, so it is moved out
+// before clearing.
+inline Object&
+Object::operator = (Object&& b) noexcept {
+  if (&b == this)
+    return *this;
+
+  Object tmp(std::move(b));
+
+  clear();
+  move_construct(tmp);
+
+  return *this;
+}
+
+inline Object
+Object::create_list(std::pmr::memory_resource* resource) {
+  Object tmp;
+  tmp.m_flags = TYPE_LIST;
+  new (&tmp._list()) list_type(resource);
+  return tmp;
+}
+
+inline Object
+Object::create_map(std::pmr::memory_resource* resource) {
+  Object tmp;
+  tmp._map_ptr() = new_map(resource);
+  tmp.m_flags = TYPE_MAP;
+  return tmp;
+}
+
+template <typename... Args>
+inline Object::map_type*
+Object::new_map(std::pmr::memory_resource* resource, Args&&... args) {
+  void* ptr = resource->allocate(sizeof(map_type), alignof(map_type));
+
+  try {
+    return new (ptr) map_type(std::forward<Args>(args)..., resource);
+  } catch (...) {
+    resource->deallocate(ptr, sizeof(map_type), alignof(map_type));
+    throw;
+  }
+}
+
+inline void
+Object::delete_map(map_type* map) {
+  std::pmr::memory_resource* resource = map->get_allocator().resource();
+
+  map->~map_type();
+  resource->deallocate(map, sizeof(map_type), alignof(map_type));
+}
+
 inline Object
 Object::create_empty(type_type t) {
   switch (t) {
@@ -451,7 +553,7 @@ Object::clear() {
   switch (type()) {
   case TYPE_STRING:   _string().~string_type(); break;
   case TYPE_LIST:     _list().~list_type(); break;
-  case TYPE_MAP:      delete _map_ptr(); break;
+  case TYPE_MAP:      delete_map(_map_ptr()); break;
   case TYPE_DICT_KEY: delete _dict_key().second; _dict_key().~dict_key_type(); break;
   default: break;
   }
@@ -460,13 +562,35 @@ Object::clear() {
   m_flags = TYPE_NONE;
 }
 
+// Containers from different resources cannot be swapped directly, so
+// their elements are copied across instead. Moving the elements would
+// leave nested containers in the old resource.
+template <typename Container>
+inline void
+object_swap_container(Container& left, Container& right) {
+  if (left.get_allocator() == right.get_allocator()) {
+    left.swap(right);
+    return;
+  }
+
+  Container tmp(left, right.get_allocator());
+  left = right;
+  right = std::move(tmp);
+}
+
 inline void
-Object::swap_same_type(Object& left, Object& right) noexcept {
+Object::swap_same_type(Object& left, Object& right) {
   std::swap(left.m_flags, right.m_flags);
 
   switch (left.type()) {
   case Object::TYPE_STRING:   left._string().swap(right._string()); break;
-  case Object::TYPE_LIST:     left._list().swap(right._list()); break;
+  case Object::TYPE_LIST:     object_swap_container(left._list(), right._list()); break;
+  case Object::TYPE_MAP:
+    if (left._map().get_allocator() == right._map().get_allocator())
+      std::swap(left._map_ptr(), right._map_ptr());
+    else
+      object_swap_container(left._map(), right._map());
+    break;
   case Object::TYPE_DICT_KEY:
     std::swap(left._dict_key().first, right._dict_key().first);
     std::swap(left._dict_key().second, right._dict_key().second); break;
@@ -474,7 +598,7 @@ Object::swap_same_type(Object& left, Object& right) noexcept {
   }
 }
 
-inline void swap(Object& left, Object& right) noexcept { left.swap(right); }
+inline void swap(Object& left, Object& right) { left.swap(right); }
 
 inline bool
 object_equal(const Object& left, const Object& right) {
@@ -0,0 +1,19 @@
+#include "config.h"
+
+#include "torrent/object_arena.h"
+#include "torrent/object_stream.h"
+
+namespace torrent {
+
+object_arena::object_arena(size_t block_size) :
+  m_resource(block_size) {
+}
+
+const char*
+object_arena::read_bencode(const char* first, const char* last) {
+  m_root.clear();
+
+  return object_read_bencode_c(first, last, &m_root, resource(), 0);
+}
+
+}
@@ -0,0 +1,48 @@
+#ifndef LIBTORRENT_OBJECT_ARENA_H
+#define LIBTORRENT_OBJECT_ARENA_H
+
+#include <memory_resource>
+#include <torrent/common.h>
+#include <torrent/object.h>
+
+namespace torrent {
+
+// Owns a monotonic buffer that an Object tree is built in, so parsing
+// a torrent or resume file allocates lists and maps from a few large
+// blocks that are released together when the arena is destroyed.
+//
+// Strings are still std::string, short keys and values fit in the
+// small string buffer while longer ones use the heap.
+//
+// Copies of objects in the arena allocate from the default resource
+// and may outlive it, objects moved out still refer to the arena.
+
+class LIBTORRENT_EXPORT object_arena {
+public:
+  static constexpr size_t default_block_size = 16 << 10;
+
+  explicit object_arena(size_t block_size = default_block_size);
+  object_arena(const object_arena&) = delete;
+  object_arena& operator=(const object_arena&) = delete;
+
+  Object&             root()                    { return m_root; }
+  const Object&       root() const              { return m_root; }
+
+  std::pmr::memory_resource* resource()         { return &m_resource; }
+
+  Object              create_list()             { return Object::create_list(resource()); }
+  Object              create_map()              { return Object::create_map(resource()); }
+
+  // Parse bencode into root(), returns the end of the element.
+  const char*         read_bencode(const char* first, const char* last);
+
+private:
+  // Declared first so that the tree is destroyed before its memory.
+  std::pmr::monotonic_buffer_resource m_resource;
+
+  Object              m_root;
+};
+
+}
+
+#endif
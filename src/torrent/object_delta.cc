@@ -0,0 +1,206 @@
+#include "config.h"
+
+#include "torrent/object_delta.h"
+
+#include <iterator>
+
+#include "torrent/exceptions.h"
+
+namespace torrent {
+
+static bool
+object_delta_is_skipped(const Object& object, uint32_t skip_mask) {
+  return object.is_empty() || (object.flags() & skip_mask);
+}
+
+static bool
+object_delta_equal(const Object& left, const Object& right, uint32_t skip_mask) {
+  if (left.type() != right.type())
+    return false;
+
+  switch (left.type()) {
+  case Object::TYPE_NONE:         return true;
+  case Object::TYPE_VALUE:        return left.as_value() == right.as_value();
+  case Object::TYPE_STRING:       return left.as_string() == right.as_string();
+  case Object::TYPE_RAW_BENCODE:  return left.as_raw_bencode() == right.as_raw_bencode();
+  case Object::TYPE_RAW_STRING:   return left.as_raw_string() == right.as_raw_string();
+  case Object::TYPE_RAW_LIST:     return left.as_raw_list() == right.as_raw_list();
+  case Object::TYPE_RAW_MAP:      return left.as_raw_map() == right.as_raw_map();
+
+  case Object::TYPE_LIST: {
+    auto left_itr = left.as_list().begin();
+    auto right_itr = right.as_list().begin();
+
+    while (true) {
+      while (left_itr != left.as_list().end() && object_delta_is_skipped(*left_itr, skip_mask))
+        left_itr++;
+
+      while (right_itr != right.as_list().end() && object_delta_is_skipped(*right_itr, skip_mask))
+        right_itr++;
+
+      if (left_itr == left.as_list().end() || right_itr == right.as_list().end())
+        return left_itr == left.as_list().end() && right_itr == right.as_list().end();
+
+      if (!object_delta_equal(*left_itr++, *right_itr++, skip_mask))
+        return false;
+    }
+  }
+
+  case Object::TYPE_MAP: {
+    auto left_itr = left.as_map().begin();
+    auto right_itr = right.as_map().begin();
+
+    while (true) {
+      while (left_itr != left.as_map().end() && object_delta_is_skipped(left_itr->second, skip_mask))
+        left_itr++;
+
+      while (right_itr != right.as_map().end() && object_delta_is_skipped(right_itr->second, skip_mask))
+        right_itr++;
+
+      if (left_itr == left.as_map().end() || right_itr == right.as_map().end())
+        return left_itr == left.as_map().end() && right_itr == right.as_map().end();
+
+      if (left_itr->first != right_itr->first || !object_delta_equal(left_itr->second, right_itr->second, skip_mask))
+        return false;
+
+      left_itr++;
+      right_itr++;
+    }
+  }
+
+  default:
+    // Dictionary keys and functions are not written, and there is
+    // no value to compare.
+    return false;
+  }
+}
+
+static void
+object_delta_push(Object& delta, const Object& path, const Object* value) {
+  Object& operation = delta.insert_back(Object::create_list());
+  operation.insert_back(path);
+
+  if (value != nullptr)
+    operation.insert_back(*value);
+}
+
+static void
+object_delta_map(Object& delta, Object& path, const Object& base, const Object& current, uint32_t skip_mask) {
+  auto base_itr = base.as_map().begin();
+  auto base_last = base.as_map().end();
+  auto current_itr = current.as_map().begin();
+  auto current_last = current.as_map().end();
+
+  while (true) {
+    while (base_itr != base_last && object_delta_is_skipped(base_itr->second, skip_mask))
+      base_itr++;
+
+    while (current_itr != current_last && object_delta_is_skipped(current_itr->second, skip_mask))
+      current_itr++;
+
+    if (base_itr == base_last && current_itr == current_last)
+      return;
+
+    if (current_itr == current_last || (base_itr != base_last && base_itr->first < current_itr->first)) {
+      path.insert_back(base_itr->first);
+      object_delta_push(delta, path, nullptr);
+      path.as_list().pop_back();
+
+      base_itr++;
+      continue;
+    }
+
+    path.insert_back(current_itr->first);
+
+    if (base_itr == base_last || current_itr->first < base_itr->first) {
+      object_delta_push(delta, path, &current_itr->second);
+
+    } else {
+      if (base_itr->second.is_map() && current_itr->second.is_map())
+        object_delta_map(delta, path, base_itr->second, current_itr->second, skip_mask);
+      else if (!object_delta_equal(base_itr->second, current_itr->second, skip_mask))
+        object_delta_push(delta, path, &current_itr->second);
+
+      base_itr++;
+    }
+
+    path.as_list().pop_back();
+    current_itr++;
+  }
+}
+
+// Erasing does not create the path, while setting replaces anything
+// on it that is not a dictionary.
+static Object*
+object_delta_child(Object& object, const std::string& key, bool create) {
+  if (!create) {
+    if (!object.is_map())
+      return nullptr;
+
+    auto itr = object.as_map().find(key);
+    return itr != object.as_map().end() ? &itr->second : nullptr;
+  }
+
+  if (!object.is_map())
+    object = Object::create_map();
+
+  return &object.as_map()[key];
+}
+
+Object
+object_delta(const Object& base, const Object& current, uint32_t skip_mask) {
+  Object delta = Object::create_list();
+  Object path = Object::create_list();
+
+  if (base.is_map() && current.is_map())
+    object_delta_map(delta, path, base, current, skip_mask);
+  else if (!object_delta_equal(base, current, skip_mask))
+    object_delta_push(delta, path, &current);
+
+  return delta;
+}
+
+void
+object_apply_delta(Object& object, const Object& delta) {
+  if (!delta.is_list())
+    throw bencode_error("Invalid object delta.");
+
+  for (const auto& operation : delta.as_list()) {
+    if (!operation.is_list() || operation.as_list().empty() || operation.as_list().size() > 2 ||
+        !operation.as_list().front().is_list())
+      throw bencode_error("Invalid object delta.");
+
+    const Object::list_type& path = operation.as_list().front().as_list();
+    const Object* value = operation.as_list().size() == 2 ? &operation.as_list().back() : nullptr;
+
+    for (const auto& key : path)
+      if (!key.is_string())
+        throw bencode_error("Invalid object delta.");
+
+    if (path.empty()) {
+      if (value == nullptr)
+        throw bencode_error("Invalid object delta.");
+
+      object = *value;
+      continue;
+    }
+
+    Object* target = &object;
+    auto last_key = std::prev(path.end());
+
+    for (auto itr = path.begin(); target != nullptr && itr != last_key; itr++)
+      target = object_delta_child(*target, itr->as_string(), value != nullptr);
+
+    if (value != nullptr) {
+      if (!target->is_map())
+        *target = Object::create_map();
+
+      target->insert_key(last_key->as_string(), *value);
+
+    } else if (target != nullptr && target->is_map()) {
+      target->erase_key(last_key->as_string());
+    }
+  }
+}
+
+}
@@ -0,0 +1,34 @@
+#ifndef LIBTORRENT_OBJECT_DELTA_H
+#define LIBTORRENT_OBJECT_DELTA_H
+
+#include <torrent/common.h>
+#include <torrent/object.h>
+
+namespace torrent {
+
+// The union of two bencode streams, for saving only what changed in
+// e.g. the resume data of a download since the last full save. The
+// client keeps the object as last written, appends the delta against
+// it to a journal on each save and compacts by applying the journal
+// to the full object and writing that.
+//
+// A delta is a list of operations, each a list of the path of
+// dictionary keys followed by the new value, or no value to erase the
+// key:
+//
+//   lll17:libtorrent_resume8:bitfielde3:...ell8:rtorrent7:custom1eee
+//
+// Dictionaries are compared key by key, other elements are replaced
+// whole when they differ. Entries that object_write_bencode would not
+// write, empty or with a flag in 'skip_mask', are treated as absent.
+// Deltas of consecutive saves can be applied in order or concatenated.
+
+Object object_delta(const Object& base, const Object& current, uint32_t skip_mask = 0) LIBTORRENT_EXPORT;
+
+// Dictionaries on the path are created or replace other elements as
+// needed. Throws bencode_error if the delta is malformed.
+void   object_apply_delta(Object& object, const Object& delta) LIBTORRENT_EXPORT;
+
+}
+
+#endif
@@ -72,6 +72,12 @@ public:
   bool operator == (const raw_object& rhs) const { return m_size == rhs.m_size && std::memcmp(m_data, rhs.m_data, m_size) == 0; }
   bool operator != (const raw_object& rhs) const { return m_size != rhs.m_size || std::memcmp(m_data, rhs.m_data, m_size) != 0; }
 
+  // Same ordering as std::string, used for bencode dictionary keys.
+  bool operator < (const raw_object& rhs) const {
+    int result = std::min(m_size, rhs.m_size) == 0 ? 0 : std::memcmp(m_data, rhs.m_data, std::min(m_size, rhs.m_size));
+    return result < 0 || (result == 0 && m_size < rhs.m_size);
+  }
+
 protected:
   iterator  m_data;
   size_type m_size;
@@ -90,6 +96,7 @@ protected:
                                                 \
   bool operator == (const this_type& rhs) const { return raw_object::operator==(rhs); } \
   bool operator != (const this_type& rhs) const { return raw_object::operator!=(rhs); } \
+  bool operator < (const this_type& rhs) const { return raw_object::operator<(rhs); } \
 
 // A raw_bencode object shall always contain valid bencode data or be
 // empty.
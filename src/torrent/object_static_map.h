@@ -39,6 +39,7 @@
 
 #include <cstring>
 #include <algorithm>
+#include <torrent/exceptions.h>
 #include <torrent/object.h>
 
 namespace torrent {
@@ -59,6 +60,59 @@ struct static_map_entry_type {
   torrent::Object object;
 };
 
+// Perfect hash of the strings the parser looks keys up by: each key
+// up to its '*' or end, and each prefix ending at a '::' or '[]'. A
+// slot holds the first mapping with that string and its length, zero
+// if empty. Built at compile time by 'static_map_make_hash', so a
+// lookup is one hash and one compare.
+
+struct static_map_hash_entry {
+  uint16_t index;
+  uint16_t length;
+};
+
+struct static_map_key_hash {
+  const static_map_hash_entry* entries;
+  uint32_t                     mask;
+  uint32_t                     seed;
+
+  // Keys are hashed and compared as two little-endian words, with
+  // the bytes past 'length' cleared. The key looked up is usually
+  // still being written, so it is read a byte at a time to avoid
+  // stalling on store forwarding, while the mapped keys are loaded
+  // whole.
+  static constexpr uint64_t key_word(const char* key, size_t length, size_t offset);
+  static uint64_t           load_word(const char* key, size_t length, size_t offset);
+
+  static constexpr uint32_t hash(uint64_t first, uint64_t second, uint32_t seed);
+
+  // Returns the match as 'find_key_match' does. The key need not be
+  // null-terminated, and 'length' must be less than 'max_key_size'.
+  std::pair<const static_map_mapping_type*, unsigned int>
+  find(const static_map_mapping_type* keys, const char* key, size_t length) const;
+};
+
+// Four slots per key, so a seed is found in a few tries.
+constexpr size_t
+static_map_hash_size(size_t length) {
+  size_t size = 16;
+
+  while (size < 4 * length)
+    size *= 2;
+
+  return size;
+}
+
+template <size_t tmpl_length>
+struct static_map_hash_type {
+  static constexpr size_t size = static_map_hash_size(tmpl_length);
+
+  constexpr static_map_key_hash view() const { return static_map_key_hash{ entries, size - 1, seed }; }
+
+  uint32_t              seed;
+  static_map_hash_entry entries[size];
+};
+
 template <typename tmpl_key_type, size_t tmpl_length>
 class static_map_type {
 public:
@@ -70,8 +124,14 @@ public:
   typedef mapping_type    key_list_type[tmpl_length];
   typedef entry_type      value_list_type[tmpl_length];
 
+  using key_hash_type  = static_map_hash_type<tmpl_length>;
+
   static constexpr size_t size = tmpl_length;
+
+  // Both are defined for each map as constexpr, see
+  // 'static_map_make_hash'.
   static const key_list_type keys;
+  static const key_hash_type key_hash;
 
   entry_type*         values() { return m_values; }
   const entry_type*   values() const { return m_values; }
@@ -116,6 +176,141 @@ find_key_match(const static_map_mapping_type* first, const static_map_mapping_ty
   return find_key_match(first, last, key, key + strlen(key));
 }
 
+constexpr uint64_t
+static_map_key_hash::key_word(const char* key, size_t length, size_t offset) {
+  uint64_t word = 0;
+
+  for (size_t i = offset; i < offset + 8 && i < length; i++)
+    word |= uint64_t{static_cast<uint8_t>(key[i])} << (8 * (i - offset));
+
+  return word;
+}
+
+inline uint64_t
+static_map_key_hash::load_word(const char* key, size_t length, size_t offset) {
+  uint64_t word;
+  std::memcpy(&word, key + offset, sizeof(word));
+
+#if __BYTE_ORDER__ != __ORDER_LITTLE_ENDIAN__
+  word = __builtin_bswap64(word);
+#endif
+
+  if (length >= offset + 8)
+    return word;
+
+  if (length <= offset)
+    return 0;
+
+  return word & ((uint64_t{1} << (8 * (length - offset))) - 1);
+}
+
+constexpr uint32_t
+static_map_key_hash::hash(uint64_t first, uint64_t second, uint32_t seed) {
+  uint64_t h = (first + seed * 0x9e3779b97f4a7c15) * 0xbf58476d1ce4e5b9;
+
+  h ^= (second + (h >> 29)) * 0x94d049bb133111eb;
+  h ^= h >> 32;
+
+  return static_cast<uint32_t>(h);
+}
+
+inline static_map_key_search_result
+static_map_key_hash::find(const static_map_mapping_type* keys, const char* key, size_t length) const {
+  uint64_t first = key_word(key, length, 0);
+  uint64_t second = key_word(key, length, 8);
+
+  const static_map_hash_entry& entry = entries[hash(first, second, seed) & mask];
+  const char* match = keys[entry.index].key;
+
+  if (entry.length == 0 || entry.length != length ||
+      load_word(match, length, 0) != first || load_word(match, length, 8) != second)
+    return static_map_key_search_result(keys, 0);
+
+  return static_map_key_search_result(keys + entry.index, length);
+}
+
+// Use as:
+//
+// template <>
+// constexpr Map::key_list_type Map::keys = { ... };
+//
+// template <>
+// constexpr Map::key_hash_type Map::key_hash = static_map_make_hash<Map>();
+//
+// Fails to compile if the keys are invalid or no seed is found.
+template <typename tmpl_map_type>
+constexpr typename tmpl_map_type::key_hash_type
+static_map_make_hash() {
+  using table_type = typename tmpl_map_type::key_hash_type;
+
+  const auto& keys = tmpl_map_type::keys;
+
+  static_map_hash_entry strings[table_type::size]{};
+  size_t                count = 0;
+
+  for (uint16_t index = 0; index < tmpl_map_type::size; index++) {
+    const char* key = keys[index].key;
+
+    for (uint16_t pos = 0; pos < static_map_mapping_type::max_key_size; pos++) {
+      bool is_end = key[pos] == '\0' || key[pos] == '*';
+      bool is_split = static_cast<size_t>(pos) + 1 < static_map_mapping_type::max_key_size &&
+        ((key[pos] == ':' && key[pos + 1] == ':') || (key[pos] == '[' && key[pos + 1] == ']'));
+
+      if (!is_end && !is_split)
+        continue;
+
+      if (pos == 0)
+        throw internal_error("static_map_make_hash: empty key.");
+
+      bool is_known = false;
+
+      for (size_t i = 0; i < count && !is_known; i++) {
+        if (strings[i].length != pos)
+          continue;
+
+        is_known = true;
+
+        for (uint16_t j = 0; j < pos && is_known; j++)
+          is_known = keys[strings[i].index].key[j] == key[j];
+      }
+
+      if (!is_known) {
+        if (count == table_type::size)
+          throw internal_error("static_map_make_hash: too many keys.");
+
+        strings[count++] = static_map_hash_entry{ index, pos };
+      }
+
+      if (is_end)
+        break;
+
+      pos++;
+    }
+  }
+
+  for (uint32_t seed = 0; seed < (1 << 16); seed++) {
+    table_type table{ seed, {} };
+    bool       is_perfect = true;
+
+    for (size_t i = 0; i < count && is_perfect; i++) {
+      const char* key = keys[strings[i].index].key;
+
+      uint32_t hash = static_map_key_hash::hash(static_map_key_hash::key_word(key, strings[i].length, 0),
+                                                static_map_key_hash::key_word(key, strings[i].length, 8),
+                                                seed);
+      auto& slot = table.entries[hash & (table_type::size - 1)];
+
+      is_perfect = slot.length == 0;
+      slot = strings[i];
+    }
+
+    if (is_perfect)
+      return table;
+  }
+
+  throw internal_error("static_map_make_hash: no perfect hash found.");
+}
+
 }
 
 #endif
@@ -217,6 +217,11 @@ object_read_bencode(std::istream* input, Object* object, uint32_t depth) {
 
 const char*
 object_read_bencode_c(const char* first, const char* last, Object* object, uint32_t depth) {
+  return object_read_bencode_c(first, last, object, std::pmr::get_default_resource(), depth);
+}
+
+const char*
+object_read_bencode_c(const char* first, const char* last, Object* object, std::pmr::memory_resource* resource, uint32_t depth) {
   if (first == last)
     throw torrent::bencode_error("Invalid bencode data.");
 
@@ -235,14 +240,14 @@ object_read_bencode_c(const char* first, const char* last, Object* object, uint3
       break;
 
     first++;
-    *object = Object::create_list();
+    *object = Object::create_list(resource);
 
     while (first != last) {
       if (*first == 'e')
 	return first + 1;
 
       auto itr = object->as_list().insert(object->as_list().end(), Object());
-      first = object_read_bencode_c(first, last, &*itr, depth);
+      first = object_read_bencode_c(first, last, &*itr, resource, depth);
 
       // The unordered flag is inherited also from list elements who
       // have been marked as unordered, though e.g. unordered strings
@@ -258,9 +263,11 @@ object_read_bencode_c(const char* first, const char* last, Object* object, uint3
       break;
 
     first++;
-    *object = Object::create_map();
+    *object = Object::create_map(resource);
 
-    Object::string_type prev;
+    // Keys are compared in the input buffer and copied only once,
+    // into the map.
+    raw_string prev;
 
     while (first != last) {
       if (*first == 'e')
@@ -269,21 +276,19 @@ object_read_bencode_c(const char* first, const char* last, Object* object, uint3
       raw_string raw_str = object_read_bencode_c_string(first, last);
       first = raw_str.end();
 
-      Object::string_type str = raw_str.as_string();
-
       // We do not set flag_unordered if the first key was zero
       // length, while multiple zero length keys will trigger the
       // unordered_flag.
-      if (str <= prev && !object->as_map().empty())
+      if (!(prev < raw_str) && !object->as_map().empty())
         object->set_internal_flags(Object::flag_unordered);
 
-      Object* value = &object->as_map()[str];
-      first = object_read_bencode_c(first, last, value, depth);
+      Object* value = &object->as_map()[raw_str.as_string()];
+      first = object_read_bencode_c(first, last, value, resource, depth);
 
       if (value->flags() & Object::flag_unordered)
         object->set_internal_flags(Object::flag_unordered);
 
-      str.swap(prev);
+      prev = raw_str;
     }
 
     break;
@@ -651,7 +656,8 @@ static_map_read_bencode_c(const char* first,
                          const char* last,
                          static_map_entry_type* entry_values,
                          const static_map_mapping_type* first_key,
-                         const static_map_mapping_type* last_key) {
+                         const static_map_mapping_type* last_key,
+                         const static_map_key_hash& key_hash) {
   // Temp hack... validate that we got valid bencode data...
 //   {
 //     torrent::Object obj;
@@ -672,6 +678,8 @@ static_map_read_bencode_c(const char* first,
   static_map_stack_type* stack_itr = stack;
   stack_itr->clear();
 
+  const static_map_mapping_type* key_list = first_key;
+
   char current_key[static_map_mapping_type::max_key_size + 2] = "";
 
   while (first != last) {
@@ -699,12 +707,18 @@ static_map_read_bencode_c(const char* first,
       continue;
     }
 
+    size_t key_length = stack_itr->next_key + raw_key.size();
+
     memcpy(current_key + stack_itr->next_key, raw_key.data(), raw_key.size());
-    current_key[stack_itr->next_key + raw_key.size()] = '\0';
+    current_key[key_length] = '\0';
+
+    // Keys are expected in sorted order, so a match before the keys
+    // already consumed falls back to the scan from 'first_key' to
+    // keep its result for unsorted or repeated keys.
+    static_map_key_search_result key_search = key_hash.find(key_list, current_key, key_length);
 
-    // Locate the right key. Optimize this by remembering previous
-    // position...
-    static_map_key_search_result key_search = find_key_match(first_key, last_key, current_key);    
+    if (key_search.second != 0 && key_search.first < first_key)
+      key_search = find_key_match(first_key, last_key, current_key);
 
     // We're not interest in this object, skip it.
     if (key_search.second == 0) {
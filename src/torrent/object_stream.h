@@ -38,6 +38,7 @@
 #define LIBTORRENT_OBJECT_STREAM_H
 
 #include <ios>
+#include <memory_resource>
 #include <string>
 #include <torrent/common.h>
 
@@ -48,12 +49,14 @@ class raw_string;
 std::string object_sha1(const Object* object) LIBTORRENT_EXPORT;
 
 raw_string  object_read_bencode_c_string(const char* first, const char* last) LIBTORRENT_EXPORT;
+const char* object_read_bencode_c_value(const char* first, const char* last, int64_t& value) LIBTORRENT_EXPORT;
 
 // Assumes the stream's locale has been set to POSIX or C.  Max depth
 // is 1024, this ensures files consisting of only 'l' don't segfault
 // the client.
 void        object_read_bencode(std::istream* input, Object* object, uint32_t depth = 0) LIBTORRENT_EXPORT;
 const char* object_read_bencode_c(const char* first, const char* last, Object* object, uint32_t depth = 0) LIBTORRENT_EXPORT;
+const char* object_read_bencode_c(const char* first, const char* last, Object* object, std::pmr::memory_resource* resource, uint32_t depth) LIBTORRENT_EXPORT;
 const char* object_read_bencode_skip_c(const char* first, const char* last) LIBTORRENT_EXPORT;
 
 std::istream& operator >> (std::istream& input, Object& object) LIBTORRENT_EXPORT;
@@ -87,6 +90,7 @@ template<typename tmpl_key_type, size_t tmpl_length>
 class static_map_type;
 struct static_map_mapping_type;
 struct static_map_entry_type;
+struct static_map_key_hash;
 
 // Convert buffer to static key map. Inlined because we don't want
 // a separate wrapper function for each template argument.
@@ -94,7 +98,7 @@ template<typename tmpl_key_type, size_t tmpl_length>
 inline const char*
 static_map_read_bencode(const char* first, const char* last,
                        static_map_type<tmpl_key_type, tmpl_length>& object) {
-  return static_map_read_bencode_c(first, last, object.values(), object.keys, object.keys + object.size);
+  return static_map_read_bencode_c(first, last, object.values(), object.keys, object.keys + object.size, object.key_hash.view());
 };
 
 template <typename tmpl_key_type, size_t tmpl_length>
@@ -109,7 +113,8 @@ static_map_read_bencode_c(const char* first,
                          const char* last,
                          static_map_entry_type* entry_values,
                          const static_map_mapping_type* first_key,
-                         const static_map_mapping_type* last_key) LIBTORRENT_EXPORT;
+                         const static_map_mapping_type* last_key,
+                         const static_map_key_hash& key_hash) LIBTORRENT_EXPORT;
 
 object_buffer_t
 static_map_write_bencode_c_wrap(object_write_t writeFunc,
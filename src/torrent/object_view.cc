@@ -0,0 +1,225 @@
+#include "config.h"
+
+#include "torrent/object_view.h"
+
+#include <algorithm>
+#include <limits>
+
+#include "torrent/exceptions.h"
+#include "torrent/object_stream.h"
+
+namespace torrent {
+
+// Containers that are still open, with the last key of dictionaries
+// for the ordering check.
+struct object_index_open {
+  uint32_t    node;
+  raw_string  last_key;
+  bool        has_key;
+  bool        want_value;
+};
+
+object_index::object_index(const char* first, const char* last) :
+  m_first(first) {
+
+  if (static_cast<size_t>(last - first) > std::numeric_limits<uint32_t>::max())
+    throw bencode_error("Invalid bencode data.");
+
+  std::vector<object_index_open> stack;
+  const char* itr = first;
+
+  do {
+    if (itr == last)
+      throw bencode_error("Invalid bencode data.");
+
+    if (!stack.empty() && *itr == 'e') {
+      object_index_open& top = stack.back();
+
+      if (top.want_value)
+        throw bencode_error("Invalid bencode data.");
+
+      node_type& node = m_nodes[top.node];
+      node.last = ++itr - first;
+      node.next = m_nodes.size();
+
+      uint8_t flags = node.flags;
+      stack.pop_back();
+
+      if (!stack.empty())
+        m_nodes[stack.back().node].flags |= flags & flag_unordered;
+
+      continue;
+    }
+
+    if (!stack.empty() && m_nodes[stack.back().node].type == type_map) {
+      object_index_open& top = stack.back();
+
+      if (!top.want_value) {
+        if (*itr < '0' || *itr > '9')
+          throw bencode_error("Invalid bencode data.");
+
+        itr = push_string(itr, last);
+
+        const node_type& key_node = m_nodes.back();
+        raw_string key(first + key_node.first, key_node.last - key_node.first);
+
+        // Same rule as object_read_bencode_c, a zero length first key
+        // is ordered while repeated zero length keys are not.
+        if (top.has_key && !(top.last_key < key))
+          m_nodes[top.node].flags |= flag_unordered;
+
+        top.last_key = key;
+        top.has_key = true;
+        top.want_value = true;
+        continue;
+      }
+
+      top.want_value = false;
+    }
+
+    switch (*itr) {
+    case 'i': {
+      const char* value_first = itr + 1;
+      int64_t value;
+      const char* value_last = object_read_bencode_c_value(value_first, last, value);
+
+      if (value_last == last || *value_last != 'e')
+        throw bencode_error("Invalid bencode data.");
+
+      uint32_t pos = m_nodes.size();
+      m_nodes.push_back(node_type{static_cast<uint32_t>(itr - first),
+                                  static_cast<uint32_t>(value_first - first),
+                                  static_cast<uint32_t>(value_last - first),
+                                  pos + 1, type_value, 0});
+      itr = value_last + 1;
+      break;
+    }
+    case 'l':
+    case 'd':
+      if (stack.size() + 1 >= max_depth)
+        throw bencode_error("Invalid bencode data.");
+
+      stack.push_back(object_index_open{static_cast<uint32_t>(m_nodes.size()), raw_string(), false, false});
+      m_nodes.push_back(node_type{static_cast<uint32_t>(itr - first), 0, 0, 0,
+                                  static_cast<uint8_t>(*itr == 'l' ? type_list : type_map), 0});
+      itr++;
+      break;
+
+    default:
+      if (*itr < '0' || *itr > '9')
+        throw bencode_error("Invalid bencode data.");
+
+      itr = push_string(itr, last);
+      break;
+    }
+
+  } while (!stack.empty());
+}
+
+const char*
+object_index::push_string(const char* first, const char* last) {
+  raw_string str = object_read_bencode_c_string(first, last);
+  uint32_t pos = m_nodes.size();
+
+  m_nodes.push_back(node_type{static_cast<uint32_t>(first - m_first),
+                              static_cast<uint32_t>(str.begin() - m_first),
+                              static_cast<uint32_t>(str.end() - m_first),
+                              pos + 1, type_string, 0});
+  return str.end();
+}
+
+void
+object_view::check_throw(uint8_t t) const {
+  if (!is_type(t))
+    throw bencode_error("Wrong object type.");
+}
+
+int64_t
+object_view::as_value() const {
+  check_throw(object_index::type_value);
+
+  int64_t value;
+  object_read_bencode_c_value(data(node().first), data(node().last), value);
+
+  return value;
+}
+
+raw_string
+object_view::as_raw_string() const {
+  check_throw(object_index::type_string);
+
+  return raw_string(data(node().first), node().last - node().first);
+}
+
+object_view::list_type
+object_view::as_list() const {
+  check_throw(object_index::type_list);
+
+  return list_type(list_iterator(m_index, m_pos + 1), list_iterator(m_index, node().next));
+}
+
+object_view::map_type
+object_view::as_map() const {
+  check_throw(object_index::type_map);
+
+  return map_type(map_iterator(m_index, m_pos + 1, node().next), map_iterator(m_index, node().next, node().next));
+}
+
+raw_bencode
+object_view::as_raw_bencode() const {
+  if (!is_valid())
+    throw bencode_error("Wrong object type.");
+
+  // Containers record their end in 'last', values and strings record
+  // the content so the end is found through the terminator.
+  uint32_t last = node().last;
+
+  if (node().type == object_index::type_value)
+    last++;
+
+  return raw_bencode(data(node().raw), last - node().raw);
+}
+
+object_view
+object_view::find_key(key_type key) const {
+  if (!is_map())
+    return object_view();
+
+  object_view result;
+
+  for (const auto& entry : as_map()) {
+    if (!(key == entry.first))
+      continue;
+
+    result = entry.second;
+
+    if (!is_unordered())
+      break;
+  }
+
+  return result;
+}
+
+object_view
+object_view::get_key(key_type key) const {
+  check_throw(object_index::type_map);
+
+  object_view result = find_key(key);
+
+  if (!result.is_valid())
+    throw bencode_error("Object operator [" + key.as_string() + "] could not find element");
+
+  return result;
+}
+
+Object
+object_view::to_object(std::pmr::memory_resource* resource) const {
+  raw_bencode raw = as_raw_bencode();
+
+  Object object;
+  object_read_bencode_c(raw.begin(), raw.end(), &object, resource, 0);
+
+  return object;
+}
+
+}
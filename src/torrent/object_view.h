@@ -0,0 +1,265 @@
+#ifndef LIBTORRENT_OBJECT_VIEW_H
+#define LIBTORRENT_OBJECT_VIEW_H
+
+#include <cstddef>
+#include <cstring>
+#include <iterator>
+#include <string>
+#include <utility>
+#include <vector>
+#include <torrent/common.h>
+#include <torrent/object.h>
+#include <torrent/object_raw_bencode.h>
+
+namespace torrent {
+
+class object_view;
+
+// Index of a bencode buffer, built in a single pass that records only
+// the offsets of each element. Nothing is copied out of the buffer, so
+// it must outlive the index and all views into it.
+//
+// Throws bencode_error on invalid input, accepting the same data as
+// object_read_bencode_c. Buffers are limited to 4 GiB.
+
+class LIBTORRENT_EXPORT object_index {
+public:
+  static constexpr uint32_t max_depth = 1024;
+
+  object_index(const char* first, const char* last);
+
+  object_view         root() const;
+
+  // End of the indexed element, the buffer may hold trailing data.
+  const char*         end() const               { return m_first + m_nodes.front().last; }
+  size_t              size() const              { return m_nodes.size(); }
+
+private:
+  friend class object_view;
+
+  enum node_type_enum : uint8_t {
+    type_value,
+    type_string,
+    type_list,
+    type_map
+  };
+
+  static constexpr uint8_t flag_unordered = 0x1;
+
+  // Elements in pre-order, 'raw' is the start of the element, for
+  // strings first/last is the content and for values the digits.
+  // 'next' is the index following the element and its children.
+  struct node_type {
+    uint32_t          raw;
+    uint32_t          first;
+    uint32_t          last;
+    uint32_t          next;
+    uint8_t           type;
+    uint8_t           flags;
+  };
+
+  const char*         push_string(const char* first, const char* last);
+
+  const char*         m_first;
+  std::vector<node_type> m_nodes;
+};
+
+// Read-only view of an element in an object_index, resolving values,
+// strings and dictionary keys on demand. Accessors follow the naming
+// of Object so that code can be written for both, the 'raw' variants
+// return strings that point into the buffer.
+//
+// Dictionary lookups scan the entries, which for the small
+// dictionaries in torrent and resume files is cheaper than building a
+// map. With duplicate keys the last entry is used, as with Object.
+
+class LIBTORRENT_EXPORT object_view {
+public:
+  class key_type {
+  public:
+    key_type(const char* str) : m_data(str), m_size(std::strlen(str)) {}
+    key_type(const std::string& str) : m_data(str.data()), m_size(str.size()) {}
+    key_type(const raw_string& str) : m_data(str.data()), m_size(str.size()) {}
+
+    std::string       as_string() const         { return std::string(m_data, m_size); }
+
+    bool operator == (const raw_string& rhs) const { return m_size == rhs.size() && std::memcmp(m_data, rhs.data(), m_size) == 0; }
+
+  private:
+    const char*       m_data;
+    size_t            m_size;
+  };
+
+  class list_iterator;
+  class map_iterator;
+
+  template <typename Iterator>
+  class range_type {
+  public:
+    range_type(Iterator first, Iterator last) : m_first(first), m_last(last) {}
+
+    Iterator          begin() const             { return m_first; }
+    Iterator          end() const               { return m_last; }
+
+    bool              empty() const             { return m_first == m_last; }
+    size_t            size() const;
+
+  private:
+    Iterator          m_first;
+    Iterator          m_last;
+  };
+
+  using list_type = range_type<list_iterator>;
+  using map_type  = range_type<map_iterator>;
+
+  object_view() = default;
+
+  bool                is_valid() const          { return m_index != nullptr; }
+  bool                is_value() const          { return is_type(object_index::type_value); }
+  bool                is_string() const         { return is_type(object_index::type_string); }
+  bool                is_list() const           { return is_type(object_index::type_list); }
+  bool                is_map() const            { return is_type(object_index::type_map); }
+
+  // Set if the keys of this dictionary, or of any dictionary it
+  // contains, are not in strictly increasing order.
+  bool                is_unordered() const      { return is_valid() && (node().flags & object_index::flag_unordered); }
+  uint32_t            flags() const             { return is_unordered() ? Object::flag_unordered : 0; }
+
+  int64_t             as_value() const;
+  raw_string          as_raw_string() const;
+  std::string         as_string() const         { return as_raw_string().as_string(); }
+  std::string         as_string_c() const       { return as_string(); }
+  list_type           as_list() const;
+  map_type            as_map() const;
+
+  // The complete bencode of the element, e.g. to hash an info
+  // dictionary exactly as it was received.
+  raw_bencode         as_raw_bencode() const;
+
+  bool                has_key(key_type key) const          { return find_key(key).is_valid(); }
+  bool                has_key_value(key_type key) const    { return find_key(key).is_value(); }
+  bool                has_key_string(key_type key) const   { return find_key(key).is_string(); }
+  bool                has_key_list(key_type key) const     { return find_key(key).is_list(); }
+  bool                has_key_map(key_type key) const      { return find_key(key).is_map(); }
+
+  object_view         get_key(key_type key) const;
+  int64_t             get_key_value(key_type key) const    { return get_key(key).as_value(); }
+  std::string         get_key_string(key_type key) const   { return get_key(key).as_string(); }
+  raw_string          get_key_raw_string(key_type key) const { return get_key(key).as_raw_string(); }
+  list_type           get_key_list(key_type key) const;
+  map_type            get_key_map(key_type key) const;
+
+  // Returns an invalid view if not found or not a dictionary.
+  object_view         find_key(key_type key) const;
+
+  // Build an Object of the element, for the parts that need one.
+  Object              to_object(std::pmr::memory_resource* resource = std::pmr::get_default_resource()) const;
+
+private:
+  friend class object_index;
+
+  object_view(const object_index* index, uint32_t pos) : m_index(index), m_pos(pos) {}
+
+  const object_index::node_type& node() const   { return m_index->m_nodes[m_pos]; }
+  const char*         data(uint32_t offset) const { return m_index->m_first + offset; }
+
+  bool                is_type(uint8_t t) const  { return is_valid() && node().type == t; }
+  void                check_throw(uint8_t t) const;
+
+  const object_index* m_index{};
+  uint32_t            m_pos{};
+};
+
+class object_view::list_iterator {
+public:
+  using iterator_category = std::forward_iterator_tag;
+  using value_type        = object_view;
+  using difference_type   = std::ptrdiff_t;
+  using pointer           = const object_view*;
+  using reference         = const object_view&;
+
+  list_iterator() = default;
+  list_iterator(const object_index* index, uint32_t pos) : m_view(index, pos) {}
+
+  reference           operator * () const       { return m_view; }
+  pointer             operator -> () const      { return &m_view; }
+
+  list_iterator&      operator ++ ()            { m_view.m_pos = m_view.node().next; return *this; }
+  list_iterator       operator ++ (int)         { list_iterator tmp = *this; ++*this; return tmp; }
+
+  bool operator == (const list_iterator& rhs) const { return m_view.m_pos == rhs.m_view.m_pos; }
+  bool operator != (const list_iterator& rhs) const { return m_view.m_pos != rhs.m_view.m_pos; }
+
+private:
+  object_view         m_view;
+};
+
+class object_view::map_iterator {
+public:
+  using iterator_category = std::forward_iterator_tag;
+  using value_type        = std::pair<raw_string, object_view>;
+  using difference_type   = std::ptrdiff_t;
+  using pointer           = const value_type*;
+  using reference         = const value_type&;
+
+  map_iterator() = default;
+  map_iterator(const object_index* index, uint32_t pos, uint32_t last) : m_index(index), m_pos(pos), m_last(last) { update(); }
+
+  reference           operator * () const       { return m_value; }
+  pointer             operator -> () const      { return &m_value; }
+
+  map_iterator&       operator ++ ()            { m_pos = m_value.second.node().next; update(); return *this; }
+  map_iterator        operator ++ (int)         { map_iterator tmp = *this; ++*this; return tmp; }
+
+  bool operator == (const map_iterator& rhs) const { return m_pos == rhs.m_pos; }
+  bool operator != (const map_iterator& rhs) const { return m_pos != rhs.m_pos; }
+
+private:
+  void                update();
+
+  const object_index* m_index{};
+  uint32_t            m_pos{};
+  uint32_t            m_last{};
+  value_type          m_value;
+};
+
+inline object_view
+object_index::root() const {
+  return object_view(this, 0);
+}
+
+inline object_view::list_type
+object_view::get_key_list(key_type key) const {
+  return get_key(key).as_list();
+}
+
+inline object_view::map_type
+object_view::get_key_map(key_type key) const {
+  return get_key(key).as_map();
+}
+
+inline void
+object_view::map_iterator::update() {
+  if (m_pos == m_last)
+    return;
+
+  object_view key(m_index, m_pos);
+
+  m_value.first  = key.as_raw_string();
+  m_value.second = object_view(m_index, m_pos + 1);
+}
+
+template <typename Iterator>
+inline size_t
+object_view::range_type<Iterator>::size() const {
+  size_t count = 0;
+
+  for (auto itr = m_first; itr != m_last; ++itr)
+    count++;
+
+  return count;
+}
+
+}
+
+#endif
@@ -3,8 +3,10 @@
 #include "torrent/peer/connection_list.h"
 
 #include <algorithm>
+#include <iterator>
 #include <rak/socket_address.h>
 
+#include "download/chunk_statistics.h"
 #include "download/download_main.h"
 #include "net/address_list.h"
 #include "protocol/peer_connection_base.h"
@@ -14,6 +16,7 @@
 #include "torrent/download/choke_queue.h"
 #include "torrent/peer/peer.h"
 #include "torrent/peer/peer_info.h"
+#include "torrent/rate.h"
 #include "utils/functional.h"
 
 // When a peer is connected it should be removed from the list of
@@ -73,6 +76,7 @@ ConnectionList::insert(PeerInfo* peerInfo, const SocketFd& fd, Bitfield* bitfiel
     return NULL;
   }
 
+  peerConnection->m_connection_index = size();
   base_type::push_back(peerConnection);
 
   m_download->info()->change_flags(DownloadInfo::flag_accepting_new_peers, size() < m_maxSize);
@@ -100,12 +104,30 @@ ConnectionList::erase(iterator pos, int flags) {
   // emited otherwise some listeners might do stuff with the
   // assumption that the connection will remain in the list.
   *pos = base_type::back();
+  (*pos)->m_connection_index = std::distance(begin(), pos);
   base_type::pop_back();
 
+  peerConnection->m_connection_index = ~uint32_t();
+
   m_download->info()->change_flags(DownloadInfo::flag_accepting_new_peers, size() < m_maxSize);
 
   ::utils::slot_list_call(m_signalDisconnected, peerConnection);
 
+  // Remember how the connection went, so it can be saved with the
+  // resume data.
+  PeerInfo* peerInfo = peerConnection->mutable_peer_info();
+
+  peerInfo->set_last_rates(peerConnection->c_peer_chunks()->download_throttle()->rate()->rate(),
+                           peerConnection->c_peer_chunks()->upload_throttle()->rate()->rate());
+
+  peerInfo->unset_flags(PeerInfo::mask_history);
+
+  if (peerConnection->c_peer_chunks()->bitfield()->is_all_set())
+    peerInfo->set_flags(PeerInfo::flag_seeder);
+
+  if (peerConnection->is_encrypted())
+    peerInfo->set_flags(PeerInfo::flag_encrypted);
+
   // Before of after the signal?
   peerConnection->cleanup();
   peerConnection->mutable_peer_info()->set_connection(NULL);
@@ -120,12 +142,15 @@ ConnectionList::erase(iterator pos, int flags) {
 
 void
 ConnectionList::erase(Peer* p, int flags) {
-  erase(std::find(begin(), end(), p), flags);
+  erase(find_peer(p), flags);
 }
 
 void
 ConnectionList::erase(PeerInfo* peerInfo, int flags) {
-  auto itr = std::find(begin(), end(), peerInfo->connection());
+  if (peerInfo->connection() == NULL)
+    return;
+
+  auto itr = find_peer(peerInfo->connection());
 
   if (itr == end())
     return;
@@ -137,6 +162,8 @@ void
 ConnectionList::erase_remaining(iterator pos, int flags) {
   flags |= disconnect_quick;
 
+  disconnect_statistics(pos, end());
+
   // Need to do it one connection at the time to ensure that when the
   // signal is emited everything is in a valid state.
   while (pos != end())
@@ -147,20 +174,47 @@ ConnectionList::erase_remaining(iterator pos, int flags) {
 
 void
 ConnectionList::erase_seeders() {
-  erase_remaining(std::partition(begin(), end(), [](Peer* p) { return p->c_ptr()->is_not_seeder(); }),
-                  disconnect_unwanted);
+  auto seeders = std::partition(begin(), end(), [](Peer* p) { return p->c_ptr()->is_not_seeder(); });
+
+  update_indices();
+  erase_remaining(seeders, disconnect_unwanted);
 }
 
 void
 ConnectionList::disconnect_queued() {
-  for (const auto& queue : m_disconnectQueue) {
-    auto conn_itr = find(queue.c_str());
+  auto queue_last = m_disconnectQueue.begin() + std::min<size_type>(m_disconnectQueue.size(), disconnect_batch_size);
 
-    if (conn_itr != end())
-      erase(conn_itr, 0);
-  }
+  // Erasing reorders the list, so move the connections to the back
+  // first and erase them from there.
+  auto last = end();
 
-  m_disconnectQueue.clear();
+  std::for_each(m_disconnectQueue.begin(), queue_last, [&](const HashString& id) {
+      auto conn_itr = std::find_if(begin(), last, [&id](Peer* p) { return id == p->m_ptr()->peer_info()->id(); });
+
+      if (conn_itr != last)
+        std::iter_swap(conn_itr, --last);
+    });
+
+  m_disconnectQueue.erase(m_disconnectQueue.begin(), queue_last);
+
+  update_indices();
+  disconnect_statistics(last, end());
+
+  while (last != end())
+    erase(--end(), 0);
+
+  if (!m_disconnectQueue.empty())
+    priority_queue_insert(&taskScheduler, &m_download->delay_disconnect_peers(), cachedTime + rak::timer(1));
+}
+
+void
+ConnectionList::disconnect_statistics(iterator first, iterator last) {
+  std::vector<PeerChunks*> peer_chunks;
+  peer_chunks.reserve(std::distance(first, last));
+
+  std::transform(first, last, std::back_inserter(peer_chunks), [](Peer* p) { return p->m_ptr()->peer_chunks(); });
+
+  m_download->chunk_statistics()->received_disconnect(peer_chunks.data(), peer_chunks.data() + peer_chunks.size());
 }
 
 struct connection_list_less {
@@ -193,9 +247,24 @@ ConnectionList::find(const sockaddr* sa) {
   });
 }
 
+ConnectionList::iterator
+ConnectionList::find_peer(const Peer* p) {
+  if (p->m_connection_index >= size() || base_type::operator[](p->m_connection_index) != p)
+    return end();
+
+  return begin() + p->m_connection_index;
+}
+
+void
+ConnectionList::update_indices() {
+  for (size_type i = 0; i < size(); i++)
+    base_type::operator[](i)->m_connection_index = i;
+}
+
 void
 ConnectionList::set_difference(AddressList* l) {
   std::sort(begin(), end(), connection_list_less());
+  update_indices();
 
   l->erase(std::set_difference(l->begin(), l->end(), begin(), end(), l->begin(), connection_list_less()),
            l->end());
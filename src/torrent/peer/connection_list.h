@@ -96,11 +96,18 @@ public:
   static constexpr int disconnect_unwanted  = (1 << 2);
   static constexpr int disconnect_delayed   = (1 << 3);
 
+  // Delayed disconnects handled per pass of the event loop, the rest
+  // are left for the next pass.
+  static constexpr size_type disconnect_batch_size = 64;
+
   ConnectionList(DownloadMain* download);
   ~ConnectionList() = default;
   ConnectionList(const ConnectionList&) = delete;
   ConnectionList& operator=(const ConnectionList&) = delete;
 
+  // Erasing moves the last connection into the erased position, so
+  // the order of the list is not preserved.
+  //
   // Make these protected?
   iterator            erase(iterator pos, int flags);
   void                erase(Peer* p, int flags);
@@ -144,6 +151,16 @@ protected:
 
   void                disconnect_queued() LIBTORRENT_NO_EXPORT;
 
+  // Removes the bitfields of the connections from the chunk
+  // statistics in one pass ahead of erasing them.
+  void                disconnect_statistics(iterator first, iterator last) LIBTORRENT_NO_EXPORT;
+
+  // Returns end() if 'p' is not in this list.
+  iterator            find_peer(const Peer* p) LIBTORRENT_NO_EXPORT;
+
+  // Updates the stored positions after the list has been reordered.
+  void                update_indices() LIBTORRENT_NO_EXPORT;
+
 private:
   DownloadMain*       m_download;
 
@@ -0,0 +1,221 @@
+#include "config.h"
+
+#include "torrent/peer/ip_filter.h"
+
+#include <algorithm>
+#include <array>
+#include <limits>
+#include <netinet/in.h>
+
+#include "torrent/exceptions.h"
+
+namespace torrent {
+
+namespace {
+
+using ipv6_address = ip_filter::ipv6_address;
+
+bool         address_is_max(uint32_t address) { return address == std::numeric_limits<uint32_t>::max(); }
+uint32_t     address_next(uint32_t address)   { return address + 1; }
+uint32_t     address_prev(uint32_t address)   { return address - 1; }
+
+bool
+address_is_max(const ipv6_address& address) {
+  return address.high == std::numeric_limits<uint64_t>::max() && address.low == std::numeric_limits<uint64_t>::max();
+}
+
+ipv6_address
+address_next(const ipv6_address& address) {
+  return ipv6_address{address.high + (address.low == std::numeric_limits<uint64_t>::max()), address.low + 1};
+}
+
+ipv6_address
+address_prev(const ipv6_address& address) {
+  return ipv6_address{address.high - (address.low == 0), address.low - 1};
+}
+
+// Splits the ranges at every boundary and gives each piece the bitwise
+// or of the values of the ranges covering it, by counting how many
+// ranges set each bit.
+template <typename Address>
+std::vector<ip_filter::range_type<Address>>
+flatten_ranges(const std::vector<ip_filter::range_type<Address>>& ranges, const Address& max_address) {
+  struct event_type {
+    Address  address;
+    unsigned value;
+    bool     open;
+  };
+
+  std::vector<event_type> events;
+  events.reserve(ranges.size() * 2);
+
+  for (const auto& range : ranges) {
+    events.push_back(event_type{range.first, static_cast<unsigned>(range.value), true});
+
+    if (!address_is_max(range.last))
+      events.push_back(event_type{address_next(range.last), static_cast<unsigned>(range.value), false});
+  }
+
+  std::sort(events.begin(), events.end(), [](const event_type& a, const event_type& b) { return a.address < b.address; });
+
+  std::array<uint32_t, std::numeric_limits<unsigned>::digits> counts{};
+  std::vector<ip_filter::range_type<Address>> result;
+
+  unsigned current_value = 0;
+  Address  current_first{};
+
+  auto close_range = [&](const Address& last) {
+      if (current_value == 0)
+        return;
+
+      if (!result.empty() && result.back().value == static_cast<int>(current_value) && address_next(result.back().last) == current_first)
+        result.back().last = last;
+      else
+        result.push_back(ip_filter::range_type<Address>{current_first, last, static_cast<int>(current_value)});
+    };
+
+  for (auto itr = events.begin(); itr != events.end(); ) {
+    Address address = itr->address;
+
+    for (; itr != events.end() && itr->address == address; itr++)
+      for (unsigned bit = 0, value = itr->value; value != 0; bit++, value >>= 1)
+        if (value & 1)
+          counts[bit] += itr->open ? 1 : -1;
+
+    unsigned value = 0;
+
+    for (unsigned bit = 0; bit < counts.size(); bit++)
+      if (counts[bit] != 0)
+        value |= 1u << bit;
+
+    if (value == current_value)
+      continue;
+
+    close_range(address_prev(address));
+
+    current_value = value;
+    current_first = address;
+  }
+
+  close_range(max_address);
+  return result;
+}
+
+}
+
+ip_filter::ipv6_address
+ip_filter::ipv6_address::from_bytes(const uint8_t* bytes) {
+  ipv6_address address{0, 0};
+
+  for (int i = 0; i < 8; i++)
+    address.high = (address.high << 8) | bytes[i];
+
+  for (int i = 8; i < 16; i++)
+    address.low = (address.low << 8) | bytes[i];
+
+  return address;
+}
+
+// The range holding the address, if any, is the first whose last
+// address is not below it. The index narrows the search to the ranges
+// ending in the address' bucket and the one after.
+int
+ip_filter::at_ipv4(uint32_t address) const {
+  if (m_ipv4.empty())
+    return 0;
+
+  uint32_t bucket = address >> (32 - ipv4_index_bits);
+
+  auto first = m_ipv4.begin() + m_ipv4_index[bucket];
+  auto last  = m_ipv4.begin() + std::min<size_t>(m_ipv4_index[bucket + 1] + 1, m_ipv4.size());
+
+  auto itr = std::lower_bound(first, last, address, [](const ipv4_range& range, uint32_t a) { return range.last < a; });
+
+  return itr != last && itr->first <= address ? itr->value : 0;
+}
+
+int
+ip_filter::at_ipv6(const ipv6_address& address) const {
+  auto itr = std::lower_bound(m_ipv6.begin(), m_ipv6.end(), address, [](const ipv6_range& range, const ipv6_address& a) { return range.last < a; });
+
+  return itr != m_ipv6.end() && !(address < itr->first) ? itr->value : 0;
+}
+
+int
+ip_filter::at(const sockaddr* sa) const {
+  switch (sa->sa_family) {
+  case AF_INET:
+    return at_ipv4(ntohl(reinterpret_cast<const sockaddr_in*>(sa)->sin_addr.s_addr));
+
+  case AF_INET6:
+  {
+    const in6_addr* addr = &reinterpret_cast<const sockaddr_in6*>(sa)->sin6_addr;
+
+    if (IN6_IS_ADDR_V4MAPPED(addr))
+      return at_ipv4((uint32_t(addr->s6_addr[12]) << 24) | (uint32_t(addr->s6_addr[13]) << 16) |
+                     (uint32_t(addr->s6_addr[14]) << 8) | uint32_t(addr->s6_addr[15]));
+
+    return at_ipv6(ipv6_address::from_bytes(addr->s6_addr));
+  }
+  default:
+    return 0;
+  }
+}
+
+size_t
+ip_filter::sizeof_data() const {
+  return m_ipv4.size() * sizeof(ipv4_range) + m_ipv4_index.size() * sizeof(uint32_t) + m_ipv6.size() * sizeof(ipv6_range);
+}
+
+void
+ip_filter_builder::insert_ipv4(uint32_t first, uint32_t last, int value) {
+  if (last < first)
+    throw input_error("IP filter range ends before it starts.");
+
+  if (value != 0)
+    m_ipv4.push_back(ip_filter::ipv4_range{first, last, value});
+}
+
+void
+ip_filter_builder::insert_ipv6(const ip_filter::ipv6_address& first, const ip_filter::ipv6_address& last, int value) {
+  if (last < first)
+    throw input_error("IP filter range ends before it starts.");
+
+  if (value != 0)
+    m_ipv6.push_back(ip_filter::ipv6_range{first, last, value});
+}
+
+std::shared_ptr<const ip_filter>
+ip_filter_builder::build() {
+  auto filter = std::make_shared<ip_filter>();
+
+  filter->m_ipv4 = flatten_ranges(m_ipv4, std::numeric_limits<uint32_t>::max());
+  filter->m_ipv6 = flatten_ranges(m_ipv6, ip_filter::ipv6_address{std::numeric_limits<uint64_t>::max(), std::numeric_limits<uint64_t>::max()});
+
+  if (!filter->m_ipv4.empty()) {
+    auto& ranges = filter->m_ipv4;
+    auto& index = filter->m_ipv4_index;
+
+    index.resize((size_t(1) << ip_filter::ipv4_index_bits) + 1);
+
+    size_t position = 0;
+
+    for (size_t bucket = 0; bucket + 1 < index.size(); bucket++) {
+      uint32_t bucket_first = uint32_t(bucket) << (32 - ip_filter::ipv4_index_bits);
+
+      while (position < ranges.size() && ranges[position].last < bucket_first)
+        position++;
+
+      index[bucket] = position;
+    }
+
+    index.back() = ranges.size();
+  }
+
+  m_ipv4 = std::vector<ip_filter::ipv4_range>();
+  m_ipv6 = std::vector<ip_filter::ipv6_range>();
+
+  return filter;
+}
+
+}
@@ -0,0 +1,86 @@
+#ifndef LIBTORRENT_PEER_IP_FILTER_H
+#define LIBTORRENT_PEER_IP_FILTER_H
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+#include <torrent/common.h>
+
+struct sockaddr;
+
+namespace torrent {
+
+// Immutable table of address ranges mapped to PeerInfo flags, applied
+// to every incoming and outgoing peer address. The IPv4 ranges are a
+// flat sorted array with an index on the top 16 bits of the address,
+// so a lookup reads the index and one or two cache lines of ranges.
+// IPv6 ranges are binary searched.
+//
+// Tables are built with ip_filter_builder, which may run on any
+// thread, and installed with PeerList::set_ip_filter.
+
+class LIBTORRENT_EXPORT ip_filter {
+public:
+  struct ipv6_address {
+    uint64_t high;
+    uint64_t low;
+
+    static ipv6_address from_bytes(const uint8_t* bytes);
+
+    bool operator < (const ipv6_address& rhs) const  { return high < rhs.high || (high == rhs.high && low < rhs.low); }
+    bool operator == (const ipv6_address& rhs) const { return high == rhs.high && low == rhs.low; }
+  };
+
+  template <typename Address>
+  struct range_type {
+    Address first;
+    Address last;
+    int     value;
+  };
+
+  using ipv4_range = range_type<uint32_t>;
+  using ipv6_range = range_type<ipv6_address>;
+
+  static constexpr unsigned int ipv4_index_bits = 16;
+
+  // Returns 0 for addresses in no range. IPv4 addresses are in host
+  // byte order, and IPv4-mapped IPv6 addresses use the IPv4 ranges.
+  int                 at_ipv4(uint32_t address) const;
+  int                 at_ipv6(const ipv6_address& address) const;
+  int                 at(const sockaddr* sa) const;
+
+  const std::vector<ipv4_range>& ipv4_ranges() const { return m_ipv4; }
+  const std::vector<ipv6_range>& ipv6_ranges() const { return m_ipv6; }
+
+  size_t              sizeof_data() const;
+
+private:
+  friend class ip_filter_builder;
+
+  std::vector<ipv4_range> m_ipv4;
+  std::vector<uint32_t>   m_ipv4_index;
+  std::vector<ipv6_range> m_ipv6;
+};
+
+// Ranges are inclusive and may be inserted in any order. Addresses in
+// overlapping ranges get the bitwise or of their values, and adjacent
+// ranges with equal values are merged.
+
+class LIBTORRENT_EXPORT ip_filter_builder {
+public:
+  void                insert_ipv4(uint32_t first, uint32_t last, int value);
+  void                insert_ipv6(const ip_filter::ipv6_address& first, const ip_filter::ipv6_address& last, int value);
+
+  size_t              size() const { return m_ipv4.size() + m_ipv6.size(); }
+
+  // Leaves the builder empty.
+  std::shared_ptr<const ip_filter> build();
+
+private:
+  std::vector<ip_filter::ipv4_range> m_ipv4;
+  std::vector<ip_filter::ipv6_range> m_ipv6;
+};
+
+}
+
+#endif
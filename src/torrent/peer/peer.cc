@@ -76,7 +76,13 @@ const Bitfield*   Peer::bitfield() const   { return c_ptr()->c_peer_chunks()->bi
 
 uint32_t Peer::incoming_queue_size() const { return c_ptr()->request_list()->queued_size(); }
 uint32_t Peer::outgoing_queue_size() const { return c_ptr()->c_peer_chunks()->upload_queue()->size(); }  
-uint32_t Peer::chunks_done() const         { return c_ptr()->c_peer_chunks()->bitfield()->size_set(); }  
+uint32_t Peer::chunks_done() const         { return c_ptr()->c_peer_chunks()->bitfield()->size_set(); }
+
+uint32_t Peer::request_pipe_size() const   { return c_ptr()->request_list()->pipe_size_target(); }
+std::chrono::microseconds Peer::request_rtt() const { return c_ptr()->request_list()->rtt(); }
+const fd_tcp_info& Peer::tcp_info() const   { return c_ptr()->tcp_info(); }
+
+const utils::latency_histogram& Peer::request_latency() const { return c_ptr()->request_list()->request_latency(); }  
 
 const BlockTransfer*
 Peer::transfer() const {
@@ -95,4 +101,8 @@ Peer::disconnect(int flags) {
   m_ptr()->download()->connection_list()->erase(this, flags);
 }
 
+bool Peer::start_capture(const std::string& path) { return m_ptr()->start_capture(path); }
+void Peer::stop_capture()                         { m_ptr()->stop_capture(); }
+bool Peer::is_capturing() const                   { return c_ptr()->is_capturing(); }
+
 }
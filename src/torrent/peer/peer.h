@@ -39,7 +39,9 @@
 
 #include <string>
 #include <torrent/common.h>
+#include <torrent/net/fd.h>
 #include <torrent/peer/peer_info.h>
+#include <torrent/utils/latency_histogram.h>
 
 namespace torrent {
 
@@ -90,6 +92,18 @@ public:
   const BlockTransfer* transfer() const;
 
   uint32_t             incoming_queue_size() const;
+
+  // Request pipe depth last chosen for this peer, and the measured
+  // round-trip time it is based on. Zero rtt means no sample yet.
+  uint32_t             request_pipe_size() const;
+  std::chrono::microseconds request_rtt() const;
+
+  // Kernel statistics of the connection, sampled every 30 seconds.
+  // Zero until the first sample or where TCP_INFO is unsupported.
+  const fd_tcp_info&   tcp_info() const;
+
+  // Time from requesting a block to receiving its first byte.
+  const utils::latency_histogram& request_latency() const;
   uint32_t             outgoing_queue_size() const;
 
   uint32_t             chunks_done() const;
@@ -98,6 +112,13 @@ public:
 
   void                 disconnect(int flags);
 
+  // Records the decrypted stream received from the peer, see
+  // PeerCapture. Starting returns false while a message is partially
+  // read. Throws storage_error.
+  bool                 start_capture(const std::string& path);
+  void                 stop_capture();
+  bool                 is_capturing() const;
+
   //
   // New interface:
   //
@@ -108,11 +129,16 @@ public:
   const PeerConnectionBase* c_ptr() const { return reinterpret_cast<const PeerConnectionBase*>(this); }
 
 protected:
+  friend class ConnectionList;
+
   Peer() = default;
 
   bool                 operator == (const Peer& p) const;
 
   PeerInfo*            m_peerInfo;
+
+  // Position in the download's ConnectionList, kept up to date by it.
+  uint32_t             m_connection_index{~uint32_t()};
 };
 
 }
@@ -0,0 +1,122 @@
+#include "config.h"
+
+#include "torrent/peer/peer_capture.h"
+
+#include <cerrno>
+#include <cstring>
+
+#include "torrent/exceptions.h"
+#include "torrent/utils/log.h"
+
+#define LT_LOG(log_fmt, ...)                                            \
+  lt_log_print(LOG_CONNECTION, "peer_capture: " log_fmt, __VA_ARGS__);
+
+namespace torrent {
+
+PeerCapture::~PeerCapture() {
+  close();
+}
+
+void
+PeerCapture::open(const std::string& path, const header_type& header, const char* bitfield, uint32_t bitfield_size) {
+  close();
+
+  m_file = std::fopen(path.c_str(), "wb");
+
+  if (m_file == nullptr)
+    throw storage_error("Could not create peer capture '" + path + "': " + std::strerror(errno));
+
+  if (std::fwrite(&header, sizeof(header), 1, m_file) != 1 ||
+      (bitfield_size != 0 && std::fwrite(bitfield, bitfield_size, 1, m_file) != 1)) {
+    close();
+    throw storage_error("Could not write peer capture '" + path + "': " + std::strerror(errno));
+  }
+
+  m_path  = path;
+  m_start = -1;
+
+  LT_LOG("started (path:%s)", path.c_str());
+}
+
+void
+PeerCapture::close() {
+  if (m_file == nullptr)
+    return;
+
+  if (std::fclose(m_file) != 0)
+    LT_LOG("could not close (path:%s error:'%s')", m_path.c_str(), std::strerror(errno));
+
+  m_file = nullptr;
+}
+
+// A write error stops the capture rather than the connection.
+void
+PeerCapture::write(int64_t time, const void* data, uint32_t length) {
+  if (m_file == nullptr || length == 0)
+    return;
+
+  if (m_start == -1)
+    m_start = time;
+
+  record_header header{static_cast<uint64_t>(time - m_start), length, 0};
+
+  if (std::fwrite(&header, sizeof(header), 1, m_file) != 1 ||
+      std::fwrite(data, length, 1, m_file) != 1) {
+    LT_LOG("could not write, stopping (path:%s error:'%s')", m_path.c_str(), std::strerror(errno));
+    close();
+  }
+}
+
+PeerCaptureReader::~PeerCaptureReader() {
+  close();
+}
+
+void
+PeerCaptureReader::open(const std::string& path) {
+  close();
+
+  m_file = std::fopen(path.c_str(), "rb");
+
+  if (m_file == nullptr)
+    throw input_error("Could not open peer capture '" + path + "': " + std::strerror(errno));
+
+  if (std::fread(&m_header, sizeof(m_header), 1, m_file) != 1 ||
+      m_header.magic != PeerCapture::magic ||
+      m_header.version != PeerCapture::version) {
+    close();
+    throw input_error("Invalid peer capture '" + path + "'");
+  }
+
+  m_bitfield.resize((m_header.size_bits + 7) / 8);
+
+  if (!m_bitfield.empty() && std::fread(&m_bitfield[0], m_bitfield.size(), 1, m_file) != 1) {
+    close();
+    throw input_error("Invalid peer capture '" + path + "'");
+  }
+}
+
+void
+PeerCaptureReader::close() {
+  if (m_file != nullptr)
+    std::fclose(m_file);
+
+  m_file = nullptr;
+}
+
+bool
+PeerCaptureReader::read(uint64_t* time, std::string* data) {
+  PeerCapture::record_header header;
+
+  if (m_file == nullptr || std::fread(&header, sizeof(header), 1, m_file) != 1)
+    return false;
+
+  data->resize(header.length);
+
+  if (header.length == 0 || std::fread(&(*data)[0], header.length, 1, m_file) != 1)
+    return false;
+
+  *time = header.time;
+  return true;
+}
+
+}
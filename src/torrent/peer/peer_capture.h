@@ -0,0 +1,94 @@
+#ifndef LIBTORRENT_PEER_PEER_CAPTURE_H
+#define LIBTORRENT_PEER_PEER_CAPTURE_H
+
+#include <cstdio>
+#include <string>
+#include <torrent/common.h>
+#include <torrent/hash_string.h>
+
+namespace torrent {
+
+// Recording of the decrypted bytes received from a peer, with the time
+// each read arrived, for replaying the stream against the peer wire
+// code. The capture starts at a message boundary and the header holds
+// the state the earlier messages established: the peer's bitfield at
+// that point, whether it had unchoked us and whether it supports the
+// fast and extension protocols.
+//
+// The file is the header, the bitfield bytes and then the records,
+// each a record_header followed by its data. Numbers are stored in
+// native byte order.
+
+class LIBTORRENT_EXPORT PeerCapture {
+public:
+  static constexpr uint32_t magic   = 0x4350544c;  // "LTPC"
+  static constexpr uint32_t version = 1;
+
+  static constexpr uint32_t flag_fast       = 1 << 0;
+  static constexpr uint32_t flag_extensions = 1 << 1;
+  static constexpr uint32_t flag_unchoked   = 1 << 2;
+
+  struct header_type {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t flags;
+    uint32_t size_bits;
+    char     info_hash[HashString::size_data];
+    char     peer_id[HashString::size_data];
+  };
+
+  struct record_header {
+    uint64_t time;        // Microseconds since the capture started.
+    uint32_t length;
+    uint32_t reserved;
+  };
+
+  static_assert(sizeof(header_type) == 56, "PeerCapture::header_type has invalid size.");
+  static_assert(sizeof(record_header) == 16, "PeerCapture::record_header has invalid size.");
+
+  PeerCapture() = default;
+  ~PeerCapture();
+  PeerCapture(const PeerCapture&) = delete;
+  PeerCapture& operator=(const PeerCapture&) = delete;
+
+  bool                is_open() const { return m_file != nullptr; }
+
+  // Throws storage_error.
+  void                open(const std::string& path, const header_type& header, const char* bitfield, uint32_t bitfield_size);
+  void                close();
+
+  void                write(int64_t time, const void* data, uint32_t length);
+
+private:
+  std::FILE*          m_file{nullptr};
+  std::string         m_path;
+  int64_t             m_start{0};
+};
+
+class LIBTORRENT_EXPORT PeerCaptureReader {
+public:
+  PeerCaptureReader() = default;
+  ~PeerCaptureReader();
+  PeerCaptureReader(const PeerCaptureReader&) = delete;
+  PeerCaptureReader& operator=(const PeerCaptureReader&) = delete;
+
+  // Throws input_error on a file that is not a capture.
+  void                open(const std::string& path);
+  void                close();
+
+  const PeerCapture::header_type& header() const { return m_header; }
+  const std::string&  bitfield() const           { return m_bitfield; }
+
+  // Returns false at the end of the capture, a truncated last record
+  // is ignored.
+  bool                read(uint64_t* time, std::string* data);
+
+private:
+  std::FILE*                m_file{nullptr};
+  PeerCapture::header_type  m_header{};
+  std::string               m_bitfield;
+};
+
+}
+
+#endif
@@ -36,12 +36,15 @@
 
 #include "config.h"
 
+#include <algorithm>
 #include <cstring>
+#include <limits>
 #include <rak/socket_address.h>
 
 #include "protocol/extensions.h"
 #include "protocol/peer_connection_base.h"
 #include "utils/instrumentation.h"
+#include "utils/object_pool.h"
 
 #include "exceptions.h"
 #include "peer_info.h"
@@ -70,6 +73,31 @@ PeerInfo::~PeerInfo() {
   delete rak::socket_address::cast_from(m_address);
 }
 
+void*
+PeerInfo::operator new(size_t size) {
+  return object_pool<PeerInfo>::allocate(size);
+}
+
+void
+PeerInfo::operator delete(void* ptr, size_t size) noexcept {
+  object_pool<PeerInfo>::deallocate(ptr, size);
+}
+
+// New samples are weighed by 1/4, as each is already the kernel's
+// smoothed rtt of a connection.
+void
+PeerInfo::add_rtt_sample(std::chrono::microseconds rtt) {
+  if (rtt.count() <= 0)
+    return;
+
+  uint64_t sample = std::min<uint64_t>(rtt.count(), std::numeric_limits<uint32_t>::max());
+
+  if (m_rtt == 0)
+    m_rtt = sample;
+  else
+    m_rtt = (uint64_t{m_rtt} * 3 + sample) / 4;
+}
+
 void
 PeerInfo::set_port(uint16_t port) {
   rak::socket_address::cast_from(m_address)->set_port(port);
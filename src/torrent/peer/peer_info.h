@@ -37,6 +37,7 @@
 #ifndef LIBTORRENT_PEER_INFO_H
 #define LIBTORRENT_PEER_INFO_H
 
+#include <chrono>
 #include <torrent/exceptions.h>
 #include <torrent/hash_string.h>
 #include <torrent/peer/client_info.h>
@@ -59,14 +60,22 @@ public:
   static constexpr int flag_restart   = (1 << 4);
   static constexpr int flag_unwanted  = (1 << 5);
   static constexpr int flag_preferred = (1 << 6);
+  static constexpr int flag_local     = (1 << 7);   // Found by local service discovery.
+  static constexpr int flag_seeder    = (1 << 8);   // Had all chunks when last disconnected.
+  static constexpr int flag_encrypted = (1 << 9);   // Last connection was encrypted.
 
   static constexpr int mask_ip_table = flag_unwanted | flag_preferred;
+  static constexpr int mask_history  = flag_seeder | flag_encrypted;
 
   PeerInfo(const sockaddr* address);
   ~PeerInfo();
   PeerInfo(const PeerInfo&) = delete;
   PeerInfo& operator=(const PeerInfo&) = delete;
 
+  // Allocated from a pool as peer lists see a lot of churn.
+  static void*        operator new(size_t size);
+  static void         operator delete(void* ptr, size_t size) noexcept;
+
   bool                is_connected() const                  { return m_flags & flag_connected; }
   bool                is_incoming() const                   { return m_flags & flag_incoming; }
   bool                is_handshake() const                  { return m_flags & flag_handshake; }
@@ -74,9 +83,18 @@ public:
   bool                is_restart() const                    { return m_flags & flag_restart; }
   bool                is_unwanted() const                   { return m_flags & flag_unwanted; }
   bool                is_preferred() const                  { return m_flags & flag_preferred; }
+  bool                is_local() const                      { return m_flags & flag_local; }
+  bool                is_seeder() const                     { return m_flags & flag_seeder; }
+  bool                is_encrypted() const                  { return m_flags & flag_encrypted; }
+
+  // Preferred and local peers get priority when unchoking.
+  bool                is_prioritized() const                { return m_flags & (flag_preferred | flag_local); }
 
   int                 flags() const                         { return m_flags; }
 
+  // Only sets the flags in mask_history, for loading resume data.
+  void                set_history_flags(int flags)          { m_flags = (m_flags & ~mask_history) | (flags & mask_history); }
+
   const HashString&   id() const                            { return m_id; }
   const char*         id_hex() const                        { return m_id_hex; }
 
@@ -98,8 +116,19 @@ public:
   uint32_t            last_handshake() const                { return m_lastHandshake; }
   void                set_last_handshake(uint32_t tvsec)    { m_lastHandshake = tvsec; }
 
+  // Transfer rates in bytes per second when the last connection to
+  // the peer was closed.
+  uint32_t            last_down_rate() const                { return m_lastDownRate; }
+  uint32_t            last_up_rate() const                  { return m_lastUpRate; }
+  void                set_last_rates(uint32_t down, uint32_t up) { m_lastDownRate = down; m_lastUpRate = up; }
+
+  // Smoothed round trip time the kernel measured on connections to
+  // the peer, kept across reconnects. Zero if never measured.
+  std::chrono::microseconds rtt() const                     { return std::chrono::microseconds(m_rtt); }
+
   bool                supports_dht() const                  { return m_options[7] & 0x01; }
   bool                supports_extensions() const           { return m_options[5] & 0x10; }
+  bool                supports_fast() const                 { return m_options[7] & 0x04; }
 
   //
   // Internal to libTorrent:
@@ -110,6 +139,8 @@ public:
   void                inc_transfer_counter();
   void                dec_transfer_counter();
 
+  void                add_rtt_sample(std::chrono::microseconds rtt);
+
 protected:
   void                set_flags(int flags)                  { m_flags |= flags; }
   void                unset_flags(int flags)                { m_flags &= ~flags; }
@@ -138,8 +169,11 @@ private:
   uint32_t            m_transferCounter{0};
   uint32_t            m_lastConnection{0};
   uint32_t            m_lastHandshake{0};
+  uint32_t            m_lastDownRate{0};
+  uint32_t            m_lastUpRate{0};
 
   uint16_t            m_listenPort{0};
+  uint32_t            m_rtt{0};
 
   // Replace this with a union. Since the user never copies PeerInfo
   // it should be safe to not require sockaddr_in6 to be part of it.
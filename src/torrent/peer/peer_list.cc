@@ -5,8 +5,11 @@
 #include <rak/socket_address.h>
 
 #include "download/available_list.h"
+#include "torrent/memory_manager.h"
 #include "torrent/peer/client_list.h"
+#include "torrent/peer/peer_list_seen.h"
 #include "torrent/utils/log.h"
+#include "torrent/utils/thread.h"
 
 #include "download_info.h"
 #include "exceptions.h"
@@ -14,6 +17,7 @@
 #include "manager.h"
 #include "peer_info.h"
 #include "peer_list.h"
+#include "peer_list_index.h"
 
 #define LT_LOG_EVENTS(log_fmt, ...)                                     \
   lt_log_print_info(LOG_PEER_LIST_EVENTS, m_info, "peer_list", log_fmt, __VA_ARGS__);
@@ -23,7 +27,20 @@
 
 namespace torrent {
 
-ipv4_table PeerList::m_ipv4_table;
+// A PeerInfo and its node in the map.
+static constexpr size_t sizeof_peer_info = sizeof(PeerInfo) + sizeof(PeerList::value_type) + 4 * sizeof(void*);
+
+std::shared_ptr<const ip_filter> PeerList::m_ip_filter;
+
+std::shared_ptr<const ip_filter>
+PeerList::current_ip_filter() {
+  return std::atomic_load(&m_ip_filter);
+}
+
+void
+PeerList::set_ip_filter(std::shared_ptr<const ip_filter> filter) {
+  std::atomic_store(&m_ip_filter, std::move(filter));
+}
 
 // TODO: Clean up...
 bool
@@ -55,7 +72,9 @@ socket_address_less(const sockaddr* s1, const sockaddr* s2) {
 //
 
 PeerList::PeerList() :
-    m_available_list(std::make_unique<AvailableList>()) {
+    m_available_list(std::make_unique<AvailableList>()),
+    m_index(std::make_unique<PeerListIndex>()),
+    m_seen(std::make_unique<PeerListSeen>()) {
 }
 
 PeerList::~PeerList() {
@@ -65,7 +84,10 @@ PeerList::~PeerList() {
   for (const auto& v : *this) {
     delete v.second;
   }
+
+  MemoryManager::dec_usage(MemoryManager::category_peer_list, size() * sizeof_peer_info);
   base_type::clear();
+  m_index->clear();
 
   m_info = NULL;
 }
@@ -89,14 +111,12 @@ PeerList::insert_address(const sockaddr* sa, int flags) {
 
   const rak::socket_address* address = rak::socket_address::cast_from(sa);
 
-  range_type range = base_type::equal_range(sock_key);
-
   // Do some special handling if we got a new port number but the
   // address was present.
   //
   // What we do depends on the flags, but for now just allow one
   // PeerInfo per address key and do nothing.
-  if (range.first != range.second) {
+  if (m_index->find(sock_key) != NULL) {
     LT_LOG_EVENTS("address already exists " LT_LOG_SA_FMT,
                   address->address_str().c_str(), address->port());
     return NULL;
@@ -104,20 +124,22 @@ PeerList::insert_address(const sockaddr* sa, int flags) {
 
   auto peerInfo = new PeerInfo(sa);
   peerInfo->set_listen_port(address->port());
-  uint32_t host_byte_order_ipv4_addr = address->sa_inet()->address_h();
 
-  // IPv4 addresses stored in host byte order in ipv4_table so they are comparable. ntohl has been called
-  if(m_ipv4_table.defined(host_byte_order_ipv4_addr))
-    peerInfo->set_flags(m_ipv4_table.at(host_byte_order_ipv4_addr) & PeerInfo::mask_ip_table);
-  
+  if (auto filter = current_ip_filter())
+    peerInfo->set_flags(filter->at(sa) & PeerInfo::mask_ip_table);
+
   manager->client_list()->retrieve_unknown(&peerInfo->mutable_client_info());
 
-  base_type::insert(range.second, value_type(sock_key, peerInfo));
+  insert_peer_info(sock_key, peerInfo);
 
   if ((flags & address_available) && peerInfo->listen_port() != 0) {
-    m_available_list->push_back(address);
-    LT_LOG_EVENTS("added available address " LT_LOG_SA_FMT,
-                  address->address_str().c_str(), address->port());
+    if (flags & address_priority)
+      m_available_list->push_priority(address);
+    else
+      m_available_list->push_back(address);
+
+    LT_LOG_EVENTS("added available address " LT_LOG_SA_FMT " priority:%i",
+                  address->address_str().c_str(), address->port(), (flags & address_priority) != 0);
   } else {
     LT_LOG_EVENTS("added unavailable address " LT_LOG_SA_FMT,
                   address->address_str().c_str(), address->port());
@@ -126,93 +148,186 @@ PeerList::insert_address(const sockaddr* sa, int flags) {
   return peerInfo;
 }
 
-inline bool
-socket_address_less_rak(const rak::socket_address& s1, const rak::socket_address& s2) {
-  return socket_address_less(s1.c_sockaddr(), s2.c_sockaddr());
-}
+// The filter is loaded once per batch of addresses.
+struct PeerList::insert_counters {
+  source_type source;
+  std::shared_ptr<const ip_filter> filter;
+
+  uint32_t received{0};
+  uint32_t inserted{0};
+  uint32_t invalid{0};
+  uint32_t duplicate{0};
+  uint32_t filtered{0};
+  uint32_t unneeded{0};
+  uint32_t updated{0};
+
+  insert_counters(source_type s) : source(s), filter(current_ip_filter()) {}
+};
 
 uint32_t
-PeerList::insert_available(const void* al) {
+PeerList::insert_available(const void* al, source_type source) {
   auto addressList = static_cast<const AddressList*>(al);
 
-  uint32_t inserted = 0;
-  uint32_t invalid = 0;
-  uint32_t unneeded = 0;
-  uint32_t updated = 0;
+  insert_counters counters(source);
+
+  for (const auto& addr : *addressList)
+    insert_available_address(addr.c_sockaddr(), counters);
+
+  log_inserted(counters);
+  return counters.inserted;
+}
 
-  if (m_available_list->size() + addressList->size() > m_available_list->capacity())
-    m_available_list->reserve(m_available_list->size() + addressList->size() + 128);
+// Decodes the compact 6 or 18 byte entries directly rather than
+// building an AddressList first.
+uint32_t
+PeerList::insert_available_compact(const char* data, size_t length, int family, source_type source) {
+  insert_counters counters(source);
 
-  // Optimize this so that we don't traverse the tree for every
-  // insert, since we know 'al' is sorted.
+  if (family == AF_INET) {
+    for (const char* itr = data; itr + sizeof(SocketAddressCompact) <= data + length; itr += sizeof(SocketAddressCompact))
+      insert_available_address(rak::socket_address(*reinterpret_cast<const SocketAddressCompact*>(itr)).c_sockaddr(), counters);
 
-  auto availItr  = m_available_list->begin();
-  auto availLast = m_available_list->end();
+  } else if (family == AF_INET6) {
+    for (const char* itr = data; itr + sizeof(SocketAddressCompact6) <= data + length; itr += sizeof(SocketAddressCompact6))
+      insert_available_address(rak::socket_address(*reinterpret_cast<const SocketAddressCompact6*>(itr)).c_sockaddr(), counters);
 
-  for (const auto& addr : *addressList) {
-    if (!socket_address_key::is_comparable_sockaddr(addr.c_sockaddr()) || addr.port() == 0) {
-      invalid++;
-      LT_LOG_ADDRESS("skipped invalid address " LT_LOG_SA_FMT, addr.address_str().c_str(), addr.port());
-      continue;
-    }
+  } else {
+    throw internal_error("PeerList::insert_available_compact(...) invalid family.");
+  }
 
-    availItr = std::find_if(availItr, availLast, [&addr](const rak::socket_address& sa) {
-      return socket_address_less_rak(sa, addr);
-    });
+  log_inserted(counters);
+  return counters.inserted;
+}
 
-    if (availItr != availLast && !socket_address_less(availItr->c_sockaddr(), addr.c_sockaddr())) {
-      // The address is already in m_available_list, so don't bother
-      // going further.
-      unneeded++;
-      continue;
-    }
+void
+PeerList::insert_available_address(const sockaddr* sa, insert_counters& counters) {
+  const rak::socket_address& addr = *rak::socket_address::cast_from(sa);
 
-    socket_address_key sock_key = socket_address_key::from_sockaddr(addr.c_sockaddr());
+  counters.received++;
+
+  if (!socket_address_key::is_comparable_sockaddr(addr.c_sockaddr()) || addr.port() == 0) {
+    counters.invalid++;
+    LT_LOG_ADDRESS("skipped invalid address " LT_LOG_SA_FMT, addr.address_str().c_str(), addr.port());
+    return;
+  }
+
+  // Local peers are marked even when already seen from elsewhere.
+  if (counters.source == source_local &&
+      (counters.filter == nullptr || !(counters.filter->at(addr.c_sockaddr()) & PeerInfo::flag_unwanted)))
+    insert_local(addr.c_sockaddr());
+
+  if (counters.source != source_other && !m_seen->insert(addr.c_sockaddr(), this_thread::cached_time())) {
+    counters.duplicate++;
+    return;
+  }
+
+  if (counters.filter != nullptr && (counters.filter->at(addr.c_sockaddr()) & PeerInfo::flag_unwanted)) {
+    counters.filtered++;
+    LT_LOG_ADDRESS("skipped filtered address " LT_LOG_SA_FMT, addr.address_str().c_str(), addr.port());
+    return;
+  }
+
+  if (m_available_list->contains(addr)) {
+    // The address is already in m_available_list, so don't bother
+    // going further.
+    counters.unneeded++;
+    return;
+  }
 
-    // Check if the peerinfo exists, if it does, check if we would
-    // ever want to connect. Just update the timer for the last
-    // availability notice if the peer isn't really ideal, but might
-    // be used in an emergency.
-    range_type range = base_type::equal_range(sock_key);
+  socket_address_key sock_key = socket_address_key::from_sockaddr(addr.c_sockaddr());
 
-    if (range.first != range.second) {
-      // Add some logic here to select the best PeerInfo, but for now
-      // just assume the first one is the only one that exists.
-      PeerInfo* peerInfo = range.first->second;
+  // Check if the peerinfo exists, if it does, check if we would
+  // ever want to connect. Just update the timer for the last
+  // availability notice if the peer isn't really ideal, but might
+  // be used in an emergency.
+  auto entry = m_index->find(sock_key);
 
-      if (peerInfo->listen_port() == 0)
-        peerInfo->set_port(addr.port());
+  if (entry != NULL) {
+    // Add some logic here to select the best PeerInfo, but for now
+    // just assume the first one is the only one that exists.
+    PeerInfo* peerInfo = entry->first;
 
-      if (peerInfo->connection() != NULL ||
-          peerInfo->last_handshake() + 600 > static_cast<uint32_t>(cachedTime.seconds())) {
-        updated++;
-        continue;
-      }
+    if (peerInfo->listen_port() == 0)
+      peerInfo->set_port(addr.port());
 
-      // If the peer has sent us bad chunks or we just connected or
-      // tried to do so a few minutes ago, only update its
-      // availability timer.
+    if (peerInfo->connection() != NULL ||
+        peerInfo->last_handshake() + 600 > static_cast<uint32_t>(cachedTime.seconds())) {
+      counters.updated++;
+      return;
     }
 
-    // Should we perhaps add to available list even though we don't
-    // want the peer, just to ensure we don't need to search for the
-    // PeerInfo every time it gets reported. Though I'd assume it
-    // won't happen often enough to be worth it.
+    // If the peer has sent us bad chunks or we just connected or
+    // tried to do so a few minutes ago, only update its
+    // availability timer.
+  }
+
+  // Should we perhaps add to available list even though we don't
+  // want the peer, just to ensure we don't need to search for the
+  // PeerInfo every time it gets reported. Though I'd assume it
+  // won't happen often enough to be worth it.
+
+  counters.inserted++;
+  m_available_list->push_back(&addr);
+
+  LT_LOG_ADDRESS("added available address " LT_LOG_SA_FMT, addr.address_str().c_str(), addr.port());
+}
 
-    inserted++;
-    m_available_list->push_back(&addr);
+// Creates an unconnected PeerInfo to hold the flag if the host is not
+// known yet.
+void
+PeerList::insert_local(const sockaddr* sa) {
+  socket_address_key sock_key = socket_address_key::from_sockaddr(sa);
+  auto entry = m_index->find(sock_key);
 
-    LT_LOG_ADDRESS("added available address " LT_LOG_SA_FMT, addr.address_str().c_str(), addr.port());
+  if (entry != NULL) {
+    entry->first->set_flags(PeerInfo::flag_local);
+    return;
   }
 
+  auto peerInfo = new PeerInfo(sa);
+  peerInfo->set_listen_port(rak::socket_address::cast_from(sa)->port());
+  peerInfo->set_flags(PeerInfo::flag_local);
+
+  manager->client_list()->retrieve_unknown(&peerInfo->mutable_client_info());
+
+  insert_peer_info(sock_key, peerInfo);
+}
+
+bool
+PeerList::is_local(const sockaddr* sa) const {
+  auto peer_info = find_address(sa);
+  return peer_info != NULL && peer_info->is_local();
+}
+
+const PeerInfo*
+PeerList::find_address(const sockaddr* sa) const {
+  socket_address_key sock_key = socket_address_key::from_sockaddr(sa);
+
+  if (!sock_key.is_valid())
+    return NULL;
+
+  auto entry = m_index->find(sock_key);
+  return entry != NULL ? entry->first : NULL;
+}
+
+void
+PeerList::log_inserted(const insert_counters& counters) {
+  auto& stats = m_source_stats[counters.source];
+
+  stats.received  += counters.received;
+  stats.duplicate += counters.duplicate;
+  stats.filtered  += counters.filtered;
+  stats.inserted  += counters.inserted;
+
   LT_LOG_EVENTS("inserted peers"
-                " inserted:%" PRIu32 " invalid:%" PRIu32
+                " source:%i inserted:%" PRIu32 " invalid:%" PRIu32
+                " duplicate:%" PRIu32 " filtered:%" PRIu32
                 " unneeded:%" PRIu32 " updated:%" PRIu32
                 " total:%" PRIuPTR " available:%" PRIuPTR,
-                inserted, invalid, unneeded, updated,
+                counters.source, counters.inserted, counters.invalid,
+                counters.duplicate, counters.filtered,
+                counters.unneeded, counters.updated,
                 size(), m_available_list->size());
-
-  return inserted;
 }
 
 uint32_t
@@ -232,12 +347,10 @@ PeerList::connected(const sockaddr* sa, int flags) {
       !socket_address_key::is_comparable_sockaddr(sa))
     return NULL;
 
-  uint32_t host_byte_order_ipv4_addr = address->sa_inet()->address_h();
   int filter_value = 0;
 
-  // IPv4 addresses stored in host byte order in ipv4_table so they are comparable. ntohl has been called
-  if(m_ipv4_table.defined(host_byte_order_ipv4_addr))
-    filter_value = m_ipv4_table.at(host_byte_order_ipv4_addr);
+  if (auto filter = current_ip_filter())
+    filter_value = filter->at(sa);
 
   // We should also remove any PeerInfo objects already for this
   // address.
@@ -247,18 +360,18 @@ PeerList::connected(const sockaddr* sa, int flags) {
   }
 
   PeerInfo* peerInfo;
-  range_type range = base_type::equal_range(sock_key);
+  auto entry = m_index->find(sock_key);
 
-  if (range.first == range.second) {
+  if (entry == NULL) {
     // Create a new entry.
     peerInfo = new PeerInfo(sa);
     peerInfo->set_flags(filter_value & PeerInfo::mask_ip_table);
 
-    base_type::insert(range.second, value_type(sock_key, peerInfo));
+    insert_peer_info(sock_key, peerInfo);
 
-  } else if (!range.first->second->is_connected()) {
+  } else if (!entry->first->is_connected()) {
     // Use an old entry.
-    peerInfo = range.first->second;
+    peerInfo = entry->first;
     peerInfo->set_port(address->port());
 
   } else {
@@ -269,8 +382,8 @@ PeerList::connected(const sockaddr* sa, int flags) {
     // This also ensure we can connect to peers running on the same
     // host as the tracker.
     // if (flags & connect_keep_handshakes &&
-    //     range.first->second->is_handshake() &&
-    //     rak::socket_address::cast_from(range.first->second->socket_address())->port() != address->port())
+    //     entry->first->is_handshake() &&
+    //     rak::socket_address::cast_from(entry->first->socket_address())->port() != address->port())
     //   m_available_list->buffer()->push_back(*address);
 
     LT_LOG_EVENTS("connecting peer rejected, already connected (buggy, fixme): " LT_LOG_SA_FMT, address->address_str().c_str(), address->port());
@@ -284,7 +397,7 @@ PeerList::connected(const sockaddr* sa, int flags) {
     peerInfo = new PeerInfo(sa);
     peerInfo->set_flags(filter_value & PeerInfo::mask_ip_table);
 
-    base_type::insert(range.second, value_type(sock_key, peerInfo));
+    insert_peer_info(sock_key, peerInfo);
   }
 
   if (flags & connect_filter_recent &&
@@ -356,6 +469,12 @@ PeerList::disconnected(iterator itr, int flags) {
   return ++itr;
 }
 
+size_t
+PeerList::sizeof_data() const {
+  return size() * sizeof_peer_info + m_index->capacity() * sizeof(PeerListIndex::entry_type) +
+    m_seen->sizeof_data() + m_available_list->sizeof_data();
+}
+
 uint32_t
 PeerList::cull_peers(int flags) {
   uint32_t counter = 0;
@@ -386,7 +505,7 @@ PeerList::cull_peers(int flags) {
     auto tmp = itr++;
     PeerInfo* peerInfo = tmp->second;
 
-    base_type::erase(tmp);
+    erase_peer_info(tmp);
     delete peerInfo;
 
     counter++;
@@ -395,4 +514,25 @@ PeerList::cull_peers(int flags) {
   return counter;
 }
 
+// Multimap inserts at the end of the range of equal keys, so the
+// first PeerInfo with a key only changes when it is erased.
+void
+PeerList::insert_peer_info(const socket_address_key& sock_key, PeerInfo* peer_info) {
+  base_type::insert(value_type(sock_key, peer_info));
+  m_index->insert(sock_key, peer_info);
+
+  MemoryManager::inc_usage(MemoryManager::category_peer_list, sizeof_peer_info);
+}
+
+void
+PeerList::erase_peer_info(iterator itr) {
+  auto next = std::next(itr);
+  PeerInfo* next_peer_info = (next != base_type::end() && next->first == itr->first) ? next->second : NULL;
+
+  m_index->erase(itr->first, itr->second, next_peer_info);
+  base_type::erase(itr);
+
+  MemoryManager::dec_usage(MemoryManager::category_peer_list, sizeof_peer_info);
+}
+
 }
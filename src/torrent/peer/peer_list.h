@@ -5,13 +5,13 @@
 #include <memory>
 #include <torrent/common.h>
 #include <torrent/net/socket_address_key.h>
-#include <torrent/utils/extents.h>
+#include <torrent/peer/ip_filter.h>
 
 namespace torrent {
 
 class DownloadInfo;
-
-using ipv4_table = extents<uint32_t, int>;
+class PeerListIndex;
+class PeerListSeen;
 
 class LIBTORRENT_EXPORT PeerList : private std::multimap<socket_address_key, PeerInfo*> {
 public:
@@ -36,6 +36,7 @@ public:
   using base_type::empty;
 
   static constexpr int address_available       = (1 << 0);
+  static constexpr int address_priority        = (1 << 1);   // Connect before other available addresses.
 
   static constexpr int connect_incoming        = (1 << 0);
   static constexpr int connect_keep_handshakes = (1 << 1);
@@ -50,6 +51,29 @@ public:
   static constexpr int cull_old                = (1 << 0);
   static constexpr int cull_keep_interesting   = (1 << 1);
 
+  // Where addresses passed to insert_available came from. Addresses
+  // from trackers, DHT, PEX and local service discovery already seen
+  // recently from any of them are dropped.
+  //
+  // Addresses from local service discovery are marked as local peers,
+  // which bypass the global throttles and are prioritized when
+  // unchoking.
+  enum source_type {
+    source_tracker,
+    source_dht,
+    source_pex,
+    source_other,
+    source_local,
+    source_size
+  };
+
+  struct source_stats {
+    uint64_t received{0};
+    uint64_t duplicate{0};
+    uint64_t filtered{0};
+    uint64_t inserted{0};
+  };
+
   PeerList();
   ~PeerList();
   PeerList(const PeerList&) = delete;
@@ -58,15 +82,34 @@ public:
   PeerInfo*           insert_address(const sockaddr* address, int flags);
 
   // This will be used internally only for the moment.
-  uint32_t            insert_available(const void* al) LIBTORRENT_NO_EXPORT;
+  uint32_t            insert_available(const void* al, source_type source = source_other) LIBTORRENT_NO_EXPORT;
+
+  // Inserts compact AF_INET or AF_INET6 addresses as sent by trackers
+  // and in PEX messages.
+  uint32_t            insert_available_compact(const char* data, size_t length, int family, source_type source = source_pex) LIBTORRENT_NO_EXPORT;
+
+  const source_stats& stats(source_type source) const { return m_source_stats[source]; }
+
+  // Whether the host has been announced by local service discovery.
+  bool                is_local(const sockaddr* sa) const;
+
+  // The PeerInfo of the host, ignoring the port, or null.
+  const PeerInfo*     find_address(const sockaddr* sa) const;
 
-  static ipv4_table*  ipv4_filter() { return &m_ipv4_table; }
+  // The filter is replaced atomically, lookups keep the table they
+  // loaded alive until done.
+  static std::shared_ptr<const ip_filter> current_ip_filter();
+  static void         set_ip_filter(std::shared_ptr<const ip_filter> filter);
 
   const std::unique_ptr<AvailableList>& available_list() { return m_available_list; }
   uint32_t            available_list_size() const;
 
   uint32_t            cull_peers(int flags);
 
+  // Memory used by the PeerInfo objects, the available list and the
+  // lookup tables.
+  size_t              sizeof_data() const;
+
   const_iterator         begin() const  { return base_type::begin(); }
   const_iterator         end() const    { return base_type::end(); }
   const_reverse_iterator rbegin() const { return base_type::rbegin(); }
@@ -83,10 +126,23 @@ protected:
   iterator            disconnected(iterator itr, int flags) LIBTORRENT_NO_EXPORT;
 
 private:
-  static ipv4_table   m_ipv4_table;
+  struct insert_counters;
+
+  void                insert_available_address(const sockaddr* sa, insert_counters& counters) LIBTORRENT_NO_EXPORT;
+  void                insert_local(const sockaddr* sa) LIBTORRENT_NO_EXPORT;
+  void                log_inserted(const insert_counters& counters) LIBTORRENT_NO_EXPORT;
+
+  void                insert_peer_info(const socket_address_key& sock_key, PeerInfo* peer_info) LIBTORRENT_NO_EXPORT;
+  void                erase_peer_info(iterator itr) LIBTORRENT_NO_EXPORT;
+
+  static std::shared_ptr<const ip_filter> m_ip_filter;
 
   DownloadInfo*       m_info;
   std::unique_ptr<AvailableList> m_available_list;
+  std::unique_ptr<PeerListIndex> m_index;
+  std::unique_ptr<PeerListSeen>  m_seen;
+
+  source_stats        m_source_stats[source_size];
 };
 
 }
@@ -0,0 +1,83 @@
+#include "config.h"
+
+#include "torrent/peer/peer_list_index.h"
+
+#include "torrent/exceptions.h"
+
+namespace torrent {
+
+void
+PeerListIndex::insert(const socket_address_key& key, PeerInfo* peer_info) {
+  if (m_table.empty() || (m_size + 1) * 4 > m_table.size() * 3)
+    grow();
+
+  entry_type* entry = &m_table[find_slot(key)];
+
+  if (entry->count++ != 0)
+    return;
+
+  entry->key = key;
+  entry->first = peer_info;
+  m_size++;
+}
+
+void
+PeerListIndex::erase(const socket_address_key& key, PeerInfo* peer_info, PeerInfo* next) {
+  entry_type* entry = find(key);
+
+  if (entry == NULL)
+    throw internal_error("PeerListIndex::erase(...) key not found.");
+
+  if (entry->count > 1) {
+    if (entry->first == peer_info) {
+      if (next == NULL)
+        throw internal_error("PeerListIndex::erase(...) first entry erased without a replacement.");
+
+      entry->first = next;
+    }
+
+    entry->count--;
+    return;
+  }
+
+  // Shift back the following entries in the probe sequence that would
+  // otherwise no longer be reachable.
+  size_t hole = entry - m_table.data();
+  size_t slot = hole;
+
+  while (true) {
+    slot = (slot + 1) & mask();
+
+    if (m_table[slot].count == 0)
+      break;
+
+    size_t ideal = hash(m_table[slot].key) & mask();
+
+    if (((slot - ideal) & mask()) < ((slot - hole) & mask()))
+      continue;
+
+    m_table[hole] = m_table[slot];
+    hole = slot;
+  }
+
+  m_table[hole] = entry_type{};
+  m_size--;
+}
+
+void
+PeerListIndex::clear() {
+  m_table = table_type();
+  m_size = 0;
+}
+
+void
+PeerListIndex::grow() {
+  table_type old_table(m_table.empty() ? min_capacity : m_table.size() * 2);
+  old_table.swap(m_table);
+
+  for (const auto& entry : old_table)
+    if (entry.count != 0)
+      m_table[find_slot(entry.key)] = entry;
+}
+
+}
@@ -0,0 +1,102 @@
+#ifndef LIBTORRENT_PEER_LIST_INDEX_H
+#define LIBTORRENT_PEER_LIST_INDEX_H
+
+#include <cstdint>
+#include <vector>
+
+#include "torrent/common.h"
+#include "torrent/memory_manager.h"
+#include "torrent/net/socket_address_key.h"
+
+namespace torrent {
+
+// Open addressing hash index over the address keys in a PeerList, so
+// the lookups done for every PEX, DHT and tracker address avoid
+// walking the tree. Each entry holds the number of PeerInfo objects
+// with that key, allowing several ports per host, and the first one in
+// the list's order.
+//
+// Uses linear probing with backward shift deletion, and keeps the load
+// below 3/4 by doubling the table.
+
+class PeerListIndex {
+public:
+  static constexpr uint32_t min_capacity = 64;
+
+  struct entry_type {
+    socket_address_key key;
+    PeerInfo*          first;
+    uint32_t           count;
+  };
+
+  size_t              size() const     { return m_size; }
+  size_t              capacity() const { return m_table.size(); }
+  bool                empty() const    { return m_size == 0; }
+
+  // Returns NULL if no PeerInfo with the key is in the list.
+  entry_type*         find(const socket_address_key& key);
+
+  // Adds a PeerInfo with the key, it becomes the first only if there
+  // was none.
+  void                insert(const socket_address_key& key, PeerInfo* peer_info);
+
+  // Removes a PeerInfo with the key. If it was the first then 'next'
+  // must be the following PeerInfo with the same key, or NULL if it
+  // was the last one.
+  void                erase(const socket_address_key& key, PeerInfo* peer_info, PeerInfo* next);
+
+  void                clear();
+
+  static uint64_t     hash(const socket_address_key& key);
+
+private:
+  size_t              mask() const { return m_table.size() - 1; }
+
+  size_t              find_slot(const socket_address_key& key) const;
+  void                grow();
+
+  using table_type = std::vector<entry_type, memory_counting_allocator<entry_type, MemoryManager::category_peer_list>>;
+
+  table_type              m_table;
+  size_t                  m_size{0};
+};
+
+inline uint64_t
+PeerListIndex::hash(const socket_address_key& key) {
+  static_assert(sizeof(socket_address_key) <= 24, "socket_address_key larger than expected");
+
+  uint64_t words[3]{};
+  std::memcpy(words, &key, sizeof(socket_address_key));
+
+  uint64_t h = words[0] * 0x9e3779b97f4a7c15ull;
+  h = (h ^ (h >> 29) ^ words[1]) * 0xbf58476d1ce4e5b9ull;
+  h = (h ^ (h >> 32) ^ words[2]) * 0x94d049bb133111ebull;
+
+  return h ^ (h >> 31);
+}
+
+// Returns the slot holding the key, or the empty slot ending the
+// probe sequence. The table must not be empty.
+inline size_t
+PeerListIndex::find_slot(const socket_address_key& key) const {
+  size_t slot = hash(key) & mask();
+
+  while (m_table[slot].count != 0 && !(m_table[slot].key == key))
+    slot = (slot + 1) & mask();
+
+  return slot;
+}
+
+inline PeerListIndex::entry_type*
+PeerListIndex::find(const socket_address_key& key) {
+  if (m_size == 0)
+    return NULL;
+
+  entry_type* entry = &m_table[find_slot(key)];
+
+  return entry->count != 0 ? entry : NULL;
+}
+
+}
+
+#endif
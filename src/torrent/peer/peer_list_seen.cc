@@ -0,0 +1,77 @@
+#include "config.h"
+
+#include "torrent/peer/peer_list_seen.h"
+
+#include <cstring>
+#include <netinet/in.h>
+
+#include "torrent/exceptions.h"
+
+namespace torrent {
+
+bool
+PeerListSeen::insert(const sockaddr* sa, std::chrono::microseconds now) {
+  rotate(now);
+
+  uint64_t k = key(sa);
+
+  if (m_previous.find(k) != m_previous.end())
+    return false;
+
+  return m_current.insert(k).second;
+}
+
+void
+PeerListSeen::clear() {
+  m_current.clear();
+  m_previous.clear();
+  m_rotated = std::chrono::microseconds();
+}
+
+size_t
+PeerListSeen::sizeof_data() const {
+  return size() * (sizeof(uint64_t) + sizeof(void*)) + (m_current.bucket_count() + m_previous.bucket_count()) * sizeof(void*);
+}
+
+uint64_t
+PeerListSeen::key(const sockaddr* sa) {
+  switch (sa->sa_family) {
+  case AF_INET:
+  {
+    auto sin = reinterpret_cast<const sockaddr_in*>(sa);
+
+    return (uint64_t(ntohl(sin->sin_addr.s_addr)) << 16) | ntohs(sin->sin_port);
+  }
+  case AF_INET6:
+  {
+    auto sin6 = reinterpret_cast<const sockaddr_in6*>(sa);
+
+    uint64_t words[2];
+    std::memcpy(words, &sin6->sin6_addr, sizeof(words));
+
+    uint64_t h = (words[0] ^ ntohs(sin6->sin6_port)) * 0x9e3779b97f4a7c15ull;
+    h = (h ^ (h >> 32) ^ words[1]) * 0xbf58476d1ce4e5b9ull;
+
+    // IPv4 keys use only the low 48 bits.
+    return (h ^ (h >> 31)) | (uint64_t(1) << 63);
+  }
+  default:
+    throw internal_error("PeerListSeen::key(...) invalid family.");
+  }
+}
+
+void
+PeerListSeen::rotate(std::chrono::microseconds now) {
+  if (now < m_rotated + window)
+    return;
+
+  if (now < m_rotated + 2 * window)
+    m_previous = std::move(m_current);
+  else
+    m_previous.clear();
+
+  m_current.clear();
+  m_rotated = now;
+}
+
+}
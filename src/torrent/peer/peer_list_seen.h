@@ -0,0 +1,50 @@
+#ifndef LIBTORRENT_PEER_LIST_SEEN_H
+#define LIBTORRENT_PEER_LIST_SEEN_H
+
+#include <chrono>
+#include <cstdint>
+#include <unordered_set>
+
+#include "torrent/memory_manager.h"
+
+struct sockaddr;
+
+namespace torrent {
+
+// Addresses recently reported to a PeerList by trackers, DHT and PEX,
+// so the same address arriving from several sources is dropped before
+// any index or available list lookup.
+//
+// Entries are 64 bit keys, exact for IPv4 and a hash for IPv6, kept in
+// two generations that rotate every window. An address is thus
+// remembered for between one and two windows, and a rare IPv6 hash
+// collision only delays an address to a later window.
+
+class PeerListSeen {
+public:
+  static constexpr std::chrono::seconds window{120};
+
+  // Returns false if the address was seen in the current or previous
+  // window, otherwise remembers it.
+  bool                insert(const sockaddr* sa, std::chrono::microseconds now);
+
+  size_t              size() const { return m_current.size() + m_previous.size(); }
+  size_t              sizeof_data() const;
+  void                clear();
+
+  static uint64_t     key(const sockaddr* sa);
+
+private:
+  using set_type = std::unordered_set<uint64_t, std::hash<uint64_t>, std::equal_to<uint64_t>,
+                                      memory_counting_allocator<uint64_t, MemoryManager::category_peer_list>>;
+
+  void                rotate(std::chrono::microseconds now);
+
+  set_type                  m_current;
+  set_type                  m_previous;
+  std::chrono::microseconds m_rotated{};
+};
+
+}
+
+#endif
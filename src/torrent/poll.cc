@@ -0,0 +1,74 @@
+#include "config.h"
+
+#include "torrent/poll.h"
+
+#include "torrent/poll_internal.h"
+#include "torrent/utils/log.h"
+
+namespace torrent {
+
+std::function<Poll*()> Poll::m_slot_create_poll;
+
+// TODO: Use unique_ptr
+Poll*
+Poll::create(int max_open_sockets) {
+#if defined(USE_EPOLL)
+  PollInternal* internal = poll_epoll_create(max_open_sockets);
+#elif defined(USE_KQUEUE)
+  PollInternal* internal = poll_kqueue_create(max_open_sockets);
+#else
+  PollInternal* internal = nullptr;
+#endif
+
+  if (internal == nullptr)
+    return nullptr;
+
+  auto poll = new Poll();
+  poll->m_internal.reset(internal);
+
+  return poll;
+}
+
+Poll*
+Poll::create_io_uring(int max_open_sockets) {
+#ifdef USE_IO_URING
+  PollInternal* internal = poll_uring_create(max_open_sockets);
+
+  if (internal != nullptr) {
+    auto poll = new Poll();
+    poll->m_internal.reset(internal);
+
+    return poll;
+  }
+
+  lt_log_print(LOG_WARN, "io_uring setup failed, falling back to the default poll backend");
+#endif
+
+  return create(max_open_sockets);
+}
+
+Poll::~Poll() = default;
+
+const char*          Poll::backend_name() const          { return m_internal->backend_name(); }
+
+unsigned int         Poll::do_poll(int64_t timeout_usec) { return m_internal->do_poll(timeout_usec); }
+uint32_t             Poll::open_max() const              { return m_internal->open_max(); }
+
+void                 Poll::open(Event* event)                { m_internal->open(event); }
+void                 Poll::close(Event* event)               { m_internal->close(event); }
+void                 Poll::open_edge_triggered(Event* event) { m_internal->open_edge_triggered(event); }
+void                 Poll::closed(Event* event)              { m_internal->closed(event); }
+
+bool                 Poll::in_read(Event* event)         { return m_internal->in_read(event); }
+bool                 Poll::in_write(Event* event)        { return m_internal->in_write(event); }
+bool                 Poll::in_error(Event* event)        { return m_internal->in_error(event); }
+
+void                 Poll::insert_read(Event* event)     { m_internal->insert_read(event); }
+void                 Poll::insert_write(Event* event)    { m_internal->insert_write(event); }
+void                 Poll::insert_error(Event* event)    { m_internal->insert_error(event); }
+
+void                 Poll::remove_read(Event* event)     { m_internal->remove_read(event); }
+void                 Poll::remove_write(Event* event)    { m_internal->remove_write(event); }
+void                 Poll::remove_error(Event* event)    { m_internal->remove_error(event); }
+
+}
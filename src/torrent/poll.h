@@ -12,10 +12,18 @@ class PollInternal;
 
 class LIBTORRENT_EXPORT Poll {
 public:
+  // Creates the default backend, epoll or kqueue.
   static Poll*        create(int max_open_sockets);
 
+  // Uses io_uring if it was built in and the kernel supports it, and
+  // falls back to create(...) otherwise. Select it by returning it
+  // from slot_create_poll().
+  static Poll*        create_io_uring(int max_open_sockets);
+
   ~Poll();
 
+  const char*         backend_name() const;
+
   // TODO: Make protected.
   unsigned int        do_poll(int64_t timeout_usec);
 
@@ -29,6 +37,12 @@ public:
   void                open(Event* event);
   void                close(Event* event);
 
+  // Like open(...), but the event is edge-triggered where supported
+  // and level-triggered otherwise. The event must read and write
+  // until the socket would block, or remove the interest, before
+  // returning from its handlers.
+  void                open_edge_triggered(Event* event);
+
   // More efficient interface when closing the file descriptor.
   // Automatically removes the event from all polls.
   // Event::get_fd() may or may not be closed already.
@@ -60,9 +74,6 @@ private:
   Poll(const Poll&) = delete;
   Poll& operator=(const Poll&) = delete;
 
-  int                 poll(int msec);
-  unsigned int        process();
-
   static std::function<Poll*()> m_slot_create_poll;
 
   std::unique_ptr<PollInternal> m_internal;
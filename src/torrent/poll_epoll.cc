@@ -2,11 +2,13 @@
 
 #ifdef USE_EPOLL
 
-#include "torrent/poll.h"
+#include "torrent/poll_internal.h"
 
 #include <algorithm>
 #include <cassert>
 #include <cerrno>
+#include <memory>
+#include <vector>
 #include <unistd.h>
 #include <sys/epoll.h>
 #include <sys/time.h>
@@ -16,23 +18,81 @@
 #include "torrent/event.h"
 #include "torrent/utils/log.h"
 #include "torrent/utils/thread.h"
+#include "utils/instrumentation.h"
+#include "utils/probe.h"
 
 #define LT_LOG_EVENT(event, log_level, log_fmt, ...)                    \
   lt_log_print(LOG_SOCKET_##log_level, "epoll->%s(%i): " log_fmt, event->type_name(), event->file_descriptor(), __VA_ARGS__);
 
 namespace torrent {
 
-std::function<Poll*()> Poll::m_slot_create_poll;
-
-class PollInternal {
+// Interest changes are not passed to the kernel right away, instead
+// the fd is added to a change list and the final mask is registered
+// with a single epoll_ctl call right before epoll_wait. Sockets often
+// flip their write interest several times during one event loop
+// iteration, and those updates then cost nothing.
+//
+// Events for masks still registered in the kernel are filtered
+// against the table in process(), so a delayed removal never causes a
+// spurious callback.
+//
+// Edge-triggered fds are registered for both read and write as long
+// as any interest is set, and interest changes after that only update
+// the table. An edge filtered out while the interest was removed is
+// not reported again, so adding interest queues a ready event that is
+// dispatched by the next process() call. The handlers must read or
+// write until the socket would block, or remove the interest.
+
+class PollEpoll : public PollInternal {
 public:
   using Table = std::vector<std::pair<uint32_t, Event*>>;
 
+  // Set in m_registered while the fd is in m_changes.
+  static constexpr uint32_t flag_changed = (1u << 31);
+  // Set in m_registered for fds opened edge-triggered.
+  static constexpr uint32_t flag_edge    = (1u << 30);
+  static constexpr uint32_t flag_mask    = flag_changed | flag_edge;
+
+  static constexpr uint32_t edge_mask    = EPOLLIN | EPOLLOUT | EPOLLERR;
+
+  ~PollEpoll() override;
+
+  const char*         backend_name() const override { return "epoll"; }
+
+  unsigned int        do_poll(int64_t timeout_usec) override;
+  uint32_t            open_max() const override;
+
+  void                open(Event* event) override;
+  void                close(Event* event) override;
+  void                open_edge_triggered(Event* event) override;
+  void                closed(Event* event) override;
+
+  bool                in_read(Event* event) override;
+  bool                in_write(Event* event) override;
+  bool                in_error(Event* event) override;
+
+  void                insert_read(Event* event) override;
+  void                insert_write(Event* event) override;
+  void                insert_error(Event* event) override;
+
+  void                remove_read(Event* event) override;
+  void                remove_write(Event* event) override;
+  void                remove_error(Event* event) override;
+
+  int                 poll(int msec);
+  unsigned int        process();
+
   inline uint32_t     event_mask(Event* e);
   inline void         set_event_mask(Event* e, uint32_t m);
 
   void                flush_events();
-  void                modify(torrent::Event* event, unsigned short op, uint32_t mask);
+  void                flush_event(int fd);
+
+  void                modify(torrent::Event* event, uint32_t mask);
+  void                epoll_modify(int fd, uint32_t registered, uint32_t mask, bool edge);
+
+  void                insert_ready(Event* event, uint32_t mask);
+  unsigned int        process_ready();
 
   int                 m_fd;
 
@@ -41,10 +101,17 @@ public:
 
   Table                                 m_table;
   std::unique_ptr<struct epoll_event[]> m_events;
+
+  // The mask known by the kernel for each fd.
+  std::vector<uint32_t>                 m_registered;
+  std::vector<int>                      m_changes;
+
+  // Ready events queued for edge-triggered fds.
+  std::vector<std::pair<int, uint32_t>> m_ready;
 };
 
 inline uint32_t
-PollInternal::event_mask(Event* e) {
+PollEpoll::event_mask(Event* e) {
   assert(e->file_descriptor() != -1);
 
   Table::value_type entry = m_table[e->file_descriptor()];
@@ -52,27 +119,72 @@ PollInternal::event_mask(Event* e) {
 }
 
 inline void
-PollInternal::set_event_mask(Event* e, uint32_t m) {
+PollEpoll::set_event_mask(Event* e, uint32_t m) {
   assert(e->file_descriptor() != -1);
 
   m_table[e->file_descriptor()] = Table::value_type(m, e);
 }
 
 void
-PollInternal::modify(Event* event, unsigned short op, uint32_t mask) {
+PollEpoll::modify(Event* event, uint32_t mask) {
   if (event_mask(event) == mask)
     return;
 
-  LT_LOG_EVENT(event, DEBUG, "modify event : op:%hx mask:%hx", op, mask);
+  LT_LOG_EVENT(event, DEBUG, "modify event : mask:%hx", mask);
+
+  instrumentation_update(INSTRUMENTATION_POLLING_MODIFY_CHANGES, 1);
+
+  set_event_mask(event, mask);
+
+  int fd = event->file_descriptor();
+
+  if (m_registered[fd] & flag_changed)
+    return;
+
+  m_registered[fd] |= flag_changed;
+  m_changes.push_back(fd);
+}
+
+void
+PollEpoll::flush_events() {
+  for (int fd : m_changes)
+    flush_event(fd);
+
+  m_changes.clear();
+}
+
+// Does not remove the fd from m_changes, it is skipped by the next
+// flush_events() call.
+void
+PollEpoll::flush_event(int fd) {
+  if (!(m_registered[fd] & flag_changed))
+    return;
+
+  bool     edge       = m_registered[fd] & flag_edge;
+  uint32_t registered = m_registered[fd] & ~flag_mask;
+  uint32_t mask       = m_table[fd].first;
+
+  if (edge && mask != 0)
+    mask = edge_mask;
+
+  m_registered[fd] = mask | (edge ? flag_edge : 0);
+
+  if (registered != mask)
+    epoll_modify(fd, registered, mask, edge);
+}
+
+void
+PollEpoll::epoll_modify(int fd, uint32_t registered, uint32_t mask, bool edge) {
+  unsigned short op = registered == 0 ? EPOLL_CTL_ADD : (mask == 0 ? EPOLL_CTL_DEL : EPOLL_CTL_MOD);
 
   epoll_event e;
   e.data.u64 = 0;
-  e.data.fd = event->file_descriptor();
-  e.events = mask;
+  e.data.fd = fd;
+  e.events = edge ? (mask | EPOLLET) : mask;
 
-  set_event_mask(event, mask);
+  instrumentation_update(INSTRUMENTATION_POLLING_MODIFY_SYSCALLS, 1);
 
-  if (epoll_ctl(m_fd, op, event->file_descriptor(), &e)) {
+  if (epoll_ctl(m_fd, op, fd, &e)) {
     // Socket was probably already closed. Ignore this.
     if (op == EPOLL_CTL_DEL && errno == ENOENT)
       return;
@@ -88,85 +200,129 @@ PollInternal::modify(Event* event, unsigned short op, uint32_t mask) {
       errno = 0;
     }
 
-    if (errno || epoll_ctl(m_fd, retry, event->file_descriptor(), &e)) {
+    if (errno || epoll_ctl(m_fd, retry, fd, &e)) {
       char errmsg[1024];
       snprintf(errmsg, sizeof(errmsg),
                "Poll::modify(...) epoll_ctl(%d, %d -> %d, %d, [%p:%x]) = %d: %s",
-               m_fd, op, retry, event->file_descriptor(), event, mask, errno, strerror(errno));
+               m_fd, op, retry, fd, m_table[fd].second, mask, errno, strerror(errno));
 
       throw internal_error(errmsg);
     }
   }
 }
 
-// TODO: Use unique_ptr
-Poll*
-Poll::create(int max_open_sockets) {
+void
+PollEpoll::insert_ready(Event* event, uint32_t mask) {
+  if (!(m_registered[event->file_descriptor()] & flag_edge))
+    return;
+
+  m_ready.emplace_back(event->file_descriptor(), mask);
+}
+
+// Only events queued before the call are dispatched, so a handler
+// that adds interest again does not keep the loop spinning.
+unsigned int
+PollEpoll::process_ready() {
+  unsigned int count = 0;
+  size_t       size  = m_ready.size();
+
+  for (size_t i = 0; i != size; i++) {
+    auto entry = m_ready[i];
+    auto evItr = m_table.begin() + entry.first;
+
+    if (entry.second & EPOLLIN && evItr->second != nullptr && evItr->first & EPOLLIN) {
+      count++;
+      thread_self()->call_event(evItr->second, &Event::event_read);
+    }
+
+    // Re-read in case the read handler closed the fd.
+    if (m_ready[i].second & EPOLLOUT && evItr->second != nullptr && evItr->first & EPOLLOUT) {
+      count++;
+      thread_self()->call_event(evItr->second, &Event::event_write);
+    }
+  }
+
+  m_ready.erase(m_ready.begin(), m_ready.begin() + size);
+  return count;
+}
+
+PollInternal*
+poll_epoll_create(int max_open_sockets) {
   int fd = epoll_create(max_open_sockets);
 
   if (fd == -1)
     return nullptr;
 
-  auto poll = new Poll();
-  poll->m_internal = std::make_unique<PollInternal>();
+  auto poll = new PollEpoll();
 
-  poll->m_internal->m_table.resize(max_open_sockets);
-  poll->m_internal->m_fd = fd;
-  poll->m_internal->m_max_events = 1024;
-  poll->m_internal->m_events = std::make_unique<struct epoll_event[]>(poll->m_internal->m_max_events);
+  poll->m_table.resize(max_open_sockets);
+  poll->m_registered.resize(max_open_sockets);
+  poll->m_fd = fd;
+  poll->m_max_events = 1024;
+  poll->m_events = std::make_unique<struct epoll_event[]>(poll->m_max_events);
 
   return poll;
 }
 
-Poll::~Poll() {
-  m_internal->m_table.clear();
+PollEpoll::~PollEpoll() {
+  m_table.clear();
 
-  ::close(m_internal->m_fd);
+  ::close(m_fd);
 }
 
 unsigned int
-Poll::do_poll(int64_t timeout_usec) {
+PollEpoll::do_poll(int64_t timeout_usec) {
+  LT_PROBE1(poll_enter, timeout_usec);
+
   int status = poll((timeout_usec + 999 + 10) / 1000);
 
   if (status == -1) {
     if (errno != EINTR)
       throw internal_error("Poll::work(): " + std::string(std::strerror(errno)));
 
+    LT_PROBE1(poll_exit, 0);
     return 0;
   }
 
-  return process();
+  unsigned int count = process();
+
+  LT_PROBE1(poll_exit, count);
+  return count;
 }
 
 int
-Poll::poll(int msec) {
-  int nfds = ::epoll_wait(m_internal->m_fd, m_internal->m_events.get(), m_internal->m_max_events, msec);
+PollEpoll::poll(int msec) {
+  flush_events();
+
+  if (!m_ready.empty())
+    msec = 0;
+
+  int nfds = ::epoll_wait(m_fd, m_events.get(), m_max_events, msec);
 
   if (nfds == -1)
     return -1;
 
-  m_internal->m_waiting_events = nfds;
+  m_waiting_events = nfds;
   return nfds;
 }
 
-// We check m_internal->m_table to make sure the Event is still listening to the
+// We check m_table to make sure the Event is still listening to the
 // event, so it is safe to remove Event's while in working.
 //
 // TODO: Do we want to guarantee if the Event has been removed from
 // some event but not closed, it won't call that event? Think so...
 unsigned int
-Poll::process() {
+PollEpoll::process() {
   unsigned int count = 0;
 
-  for (epoll_event *itr = m_internal->m_events.get(), *last = m_internal->m_events.get() + m_internal->m_waiting_events; itr != last; ++itr) {
+  for (epoll_event *itr = m_events.get(), *last = m_events.get() + m_waiting_events; itr != last; ++itr) {
     // TODO: These should be asserts?
-    if (itr->data.fd < 0 || static_cast<size_t>(itr->data.fd) >= m_internal->m_table.size())
+    if (itr->data.fd < 0 || static_cast<size_t>(itr->data.fd) >= m_table.size())
       continue;
 
-    if (thread_self()->callbacks_should_interrupt_polling())
-      thread_self()->process_callbacks(true);
+    process_interrupting_callbacks();
 
-    auto evItr = m_internal->m_table.begin() + itr->data.fd;
+    auto evItr = m_table.begin() + itr->data.fd;
 
     // Each branch must check for data.ptr != nullptr to allow the socket
     // to remove itself between the calls.
@@ -176,156 +332,180 @@ Poll::process() {
 
     if (itr->events & EPOLLERR && evItr->second != nullptr && evItr->first & EPOLLERR) {
       count++;
-      evItr->second->event_error();
+      thread_self()->call_event(evItr->second, &Event::event_error);
     }
 
     if (itr->events & EPOLLIN && evItr->second != nullptr && evItr->first & EPOLLIN) {
       count++;
-      evItr->second->event_read();
+      thread_self()->call_event(evItr->second, &Event::event_read);
     }
 
     if (itr->events & EPOLLOUT && evItr->second != nullptr && evItr->first & EPOLLOUT) {
       count++;
-      evItr->second->event_write();
+      thread_self()->call_event(evItr->second, &Event::event_write);
     }
   }
 
-  m_internal->m_waiting_events = 0;
+  m_waiting_events = 0;
+
+  if (!m_ready.empty())
+    count += process_ready();
+
   return count;
 }
 
 uint32_t
-Poll::open_max() const {
-  return m_internal->m_table.size();
+PollEpoll::open_max() const {
+  return m_table.size();
 }
 
 void
-Poll::open(Event* event) {
+PollEpoll::open(Event* event) {
   LT_LOG_EVENT(event, DEBUG, "open event", 0);
 
-  if (m_internal->event_mask(event) != 0)
+  if (event_mask(event) != 0)
     throw internal_error("Poll::open(...) called but the file descriptor is active");
+
+  m_registered[event->file_descriptor()] &= ~PollEpoll::flag_edge;
 }
 
 void
-Poll::close(Event* event) {
+PollEpoll::open_edge_triggered(Event* event) {
+  LT_LOG_EVENT(event, DEBUG, "open event : edge-triggered", 0);
+
+  if (event_mask(event) != 0)
+    throw internal_error("Poll::open_edge_triggered(...) called but the file descriptor is active");
+
+  m_registered[event->file_descriptor()] |= PollEpoll::flag_edge;
+}
+
+void
+PollEpoll::close(Event* event) {
   LT_LOG_EVENT(event, DEBUG, "close event", 0);
 
-  if (m_internal->event_mask(event) != 0)
+  if (event_mask(event) != 0)
     throw internal_error("Poll::close(...) called but the file descriptor is active");
 
-  m_internal->m_table[event->file_descriptor()] = PollInternal::Table::value_type();
+  // The fd is still open, so pending removals must reach the kernel
+  // before the caller closes it.
+  flush_event(event->file_descriptor());
+
+  m_table[event->file_descriptor()] = PollEpoll::Table::value_type();
+  m_registered[event->file_descriptor()] &= ~PollEpoll::flag_edge;
+
+  for (auto& entry : m_ready)
+    if (entry.first == event->file_descriptor())
+      entry.second = 0;
 
   // Clear the event list just in case we open a new socket with the
   // same fd while in the middle of calling Poll::perform.
-  for (epoll_event *itr = m_internal->m_events.get(), *last = m_internal->m_events.get() + m_internal->m_waiting_events; itr != last; ++itr)
+  for (epoll_event *itr = m_events.get(), *last = m_events.get() + m_waiting_events; itr != last; ++itr)
     if (itr->data.fd == event->file_descriptor())
       itr->events = 0;
 }
 
 void
-Poll::closed(Event* event) {
+PollEpoll::closed(Event* event) {
   LT_LOG_EVENT(event, DEBUG, "closed event", 0);
 
   // Kernel removes closed FDs automatically, so just clear the mask and remove it from pending calls.
   // Don't touch if the FD was re-used before we received the close notification.
-  if (m_internal->m_table[event->file_descriptor()].second == event)
-    m_internal->m_table[event->file_descriptor()] = PollInternal::Table::value_type();
+  if (m_table[event->file_descriptor()].second == event) {
+    m_table[event->file_descriptor()] = PollEpoll::Table::value_type();
+
+    // Keep the changed flag so the fd's entry in m_changes stays
+    // unique, the flush then sees nothing to do.
+    m_registered[event->file_descriptor()] &= PollEpoll::flag_changed;
+
+    for (auto& entry : m_ready)
+      if (entry.first == event->file_descriptor())
+        entry.second = 0;
+  }
 
-  // for (epoll_event *itr = m_internal->m_events.get(), *last = m_internal->m_events.get() + m_internal->m_waiting_events; itr != last; ++itr) {
+  // for (epoll_event *itr = m_events.get(), *last = m_events.get() + m_waiting_events; itr != last; ++itr) {
   //   if (itr->data.fd == event->file_descriptor())
   //     itr->events = 0;
   // }
 }
 
 bool
-Poll::in_read(Event* event) {
-  return m_internal->event_mask(event) & EPOLLIN;
+PollEpoll::in_read(Event* event) {
+  return event_mask(event) & EPOLLIN;
 }
 
 bool
-Poll::in_write(Event* event) {
-  return m_internal->event_mask(event) & EPOLLOUT;
+PollEpoll::in_write(Event* event) {
+  return event_mask(event) & EPOLLOUT;
 }
 
 bool
-Poll::in_error(Event* event) {
-  return m_internal->event_mask(event) & EPOLLERR;
+PollEpoll::in_error(Event* event) {
+  return event_mask(event) & EPOLLERR;
 }
 
 void
-Poll::insert_read(Event* event) {
-  if (m_internal->event_mask(event) & EPOLLIN)
+PollEpoll::insert_read(Event* event) {
+  if (event_mask(event) & EPOLLIN)
     return;
 
   LT_LOG_EVENT(event, DEBUG, "insert read", 0);
 
-  m_internal->modify(event,
-                     m_internal->event_mask(event) ? EPOLL_CTL_MOD : EPOLL_CTL_ADD,
-                     m_internal->event_mask(event) | EPOLLIN);
+  modify(event, event_mask(event) | EPOLLIN);
+  insert_ready(event, EPOLLIN);
 }
 
 void
-Poll::insert_write(Event* event) {
-  if (m_internal->event_mask(event) & EPOLLOUT)
+PollEpoll::insert_write(Event* event) {
+  if (event_mask(event) & EPOLLOUT)
     return;
 
   LT_LOG_EVENT(event, DEBUG, "insert write", 0);
 
-  m_internal->modify(event,
-                     m_internal->event_mask(event) ? EPOLL_CTL_MOD : EPOLL_CTL_ADD,
-                     m_internal->event_mask(event) | EPOLLOUT);
+  modify(event, event_mask(event) | EPOLLOUT);
+  insert_ready(event, EPOLLOUT);
 }
 
 void
-Poll::insert_error(Event* event) {
-  if (m_internal->event_mask(event) & EPOLLERR)
+PollEpoll::insert_error(Event* event) {
+  if (event_mask(event) & EPOLLERR)
     return;
 
   LT_LOG_EVENT(event, DEBUG, "insert error", 0);
 
-  m_internal->modify(event,
-                     m_internal->event_mask(event) ? EPOLL_CTL_MOD : EPOLL_CTL_ADD,
-                     m_internal->event_mask(event) | EPOLLERR);
+  modify(event, event_mask(event) | EPOLLERR);
 }
 
 void
-Poll::remove_read(Event* event) {
-  if (!(m_internal->event_mask(event) & EPOLLIN))
+PollEpoll::remove_read(Event* event) {
+  if (!(event_mask(event) & EPOLLIN))
     return;
 
   LT_LOG_EVENT(event, DEBUG, "remove read", 0);
 
-  uint32_t mask = m_internal->event_mask(event) & ~EPOLLIN;
-  m_internal->modify(event,
-                     mask ? EPOLL_CTL_MOD : EPOLL_CTL_DEL,
-                     mask);
+  uint32_t mask = event_mask(event) & ~EPOLLIN;
+  modify(event, mask);
 }
 
 void
-Poll::remove_write(Event* event) {
-  if (!(m_internal->event_mask(event) & EPOLLOUT))
+PollEpoll::remove_write(Event* event) {
+  if (!(event_mask(event) & EPOLLOUT))
     return;
 
   LT_LOG_EVENT(event, DEBUG, "remove write", 0);
 
-  uint32_t mask = m_internal->event_mask(event) & ~EPOLLOUT;
-  m_internal->modify(event,
-                     mask ? EPOLL_CTL_MOD : EPOLL_CTL_DEL,
-                     mask);
+  uint32_t mask = event_mask(event) & ~EPOLLOUT;
+  modify(event, mask);
 }
 
 void
-Poll::remove_error(Event* event) {
-  if (!(m_internal->event_mask(event) & EPOLLERR))
+PollEpoll::remove_error(Event* event) {
+  if (!(event_mask(event) & EPOLLERR))
     return;
 
   LT_LOG_EVENT(event, DEBUG, "remove error", 0);
 
-  uint32_t mask = m_internal->event_mask(event) & ~EPOLLERR;
-  m_internal->modify(event,
-                     mask ? EPOLL_CTL_MOD : EPOLL_CTL_DEL,
-                     mask);
+  uint32_t mask = event_mask(event) & ~EPOLLERR;
+  modify(event, mask);
 }
 
 }
@@ -0,0 +1,58 @@
+#ifndef LIBTORRENT_TORRENT_POLL_INTERNAL_H
+#define LIBTORRENT_TORRENT_POLL_INTERNAL_H
+
+#include <cinttypes>
+
+#include "torrent/utils/thread.h"
+
+namespace torrent {
+
+class Event;
+
+// Each polling backend implements the Poll interface as a subclass,
+// so several backends can be built in and picked at runtime.
+class PollInternal {
+public:
+  virtual ~PollInternal() = default;
+
+  virtual const char*  backend_name() const = 0;
+
+  virtual unsigned int do_poll(int64_t timeout_usec) = 0;
+  virtual uint32_t     open_max() const = 0;
+
+  virtual void         open(Event* event) = 0;
+  virtual void         close(Event* event) = 0;
+  virtual void         open_edge_triggered(Event* event) = 0;
+  virtual void         closed(Event* event) = 0;
+
+  virtual bool         in_read(Event* event) = 0;
+  virtual bool         in_write(Event* event) = 0;
+  virtual bool         in_error(Event* event) = 0;
+
+  virtual void         insert_read(Event* event) = 0;
+  virtual void         insert_write(Event* event) = 0;
+  virtual void         insert_error(Event* event) = 0;
+
+  virtual void         remove_read(Event* event) = 0;
+  virtual void         remove_write(Event* event) = 0;
+  virtual void         remove_error(Event* event) = 0;
+
+protected:
+  static void          process_interrupting_callbacks();
+};
+
+// Runs the callbacks that should not wait for the rest of the events.
+inline void
+PollInternal::process_interrupting_callbacks() {
+  if (thread_self()->callbacks_should_interrupt_polling())
+    thread_self()->process_callbacks(true);
+}
+
+// Return nullptr if the backend cannot be set up.
+PollInternal*        poll_epoll_create(int max_open_sockets);
+PollInternal*        poll_kqueue_create(int max_open_sockets);
+PollInternal*        poll_uring_create(int max_open_sockets);
+
+}
+
+#endif
@@ -2,11 +2,13 @@
 
 #ifdef USE_KQUEUE
 
-#include "poll.h"
+#include "torrent/poll_internal.h"
 
 #include <algorithm>
 #include <cassert>
 #include <cerrno>
+#include <memory>
+#include <vector>
 #include <unistd.h>
 #include <sys/event.h>
 #include <sys/time.h>
@@ -16,6 +18,7 @@
 #include "utils/thread.h"
 #include "torrent/exceptions.h"
 #include "torrent/event.h"
+#include "utils/probe.h"
 
 // TODO: Add new log category.
 #define LT_LOG_EVENT(event, log_level, log_fmt, ...)                    \
@@ -23,9 +26,7 @@
 
 namespace torrent {
 
-std::function<Poll*()> Poll::m_slot_create_poll;
-
-class PollInternal {
+class PollKqueue : public PollInternal {
 public:
   using Table = std::vector<std::pair<uint32_t, Event*>>;
 
@@ -33,6 +34,33 @@ public:
   static constexpr uint32_t flag_write = (1 << 1);
   static constexpr uint32_t flag_error = (1 << 2);
 
+  ~PollKqueue() override;
+
+  const char*         backend_name() const override { return "kqueue"; }
+
+  unsigned int        do_poll(int64_t timeout_usec) override;
+  uint32_t            open_max() const override;
+
+  void                open(Event* event) override;
+  void                close(Event* event) override;
+  void                open_edge_triggered(Event* event) override;
+  void                closed(Event* event) override;
+
+  bool                in_read(Event* event) override;
+  bool                in_write(Event* event) override;
+  bool                in_error(Event* event) override;
+
+  void                insert_read(Event* event) override;
+  void                insert_write(Event* event) override;
+  void                insert_error(Event* event) override;
+
+  void                remove_read(Event* event) override;
+  void                remove_write(Event* event) override;
+  void                remove_error(Event* event) override;
+
+  int                 poll(int msec);
+  unsigned int        process();
+
   inline uint32_t     event_mask(Event* e);
   inline void         set_event_mask(Event* e, uint32_t m);
 
@@ -51,7 +79,7 @@ public:
 };
 
 inline uint32_t
-PollInternal::event_mask(Event* e) {
+PollKqueue::event_mask(Event* e) {
   assert(e->file_descriptor() != -1);
 
   Table::value_type entry = m_table[e->file_descriptor()];
@@ -59,14 +87,14 @@ PollInternal::event_mask(Event* e) {
 }
 
 inline void
-PollInternal::set_event_mask(Event* e, uint32_t m) {
+PollKqueue::set_event_mask(Event* e, uint32_t m) {
   assert(e->file_descriptor() != -1);
 
   m_table[e->file_descriptor()] = Table::value_type(m, e);
 }
 
 void
-PollInternal::flush_events() {
+PollKqueue::flush_events() {
   timespec timeout = { 0, 0 };
 
   int nfds = ::kevent(m_fd,
@@ -77,20 +105,20 @@ PollInternal::flush_events() {
                       &timeout);
 
   if (nfds == -1)
-    throw internal_error("PollInternal::flush_events() error: " + std::string(std::strerror(errno)));
+    throw internal_error("PollKqueue::flush_events() error: " + std::string(std::strerror(errno)));
 
   m_changed_events = 0;
   m_waiting_events += nfds;
 }
 
 void
-PollInternal::modify(Event* event, unsigned short op, short mask) {
+PollKqueue::modify(Event* event, unsigned short op, short mask) {
   LT_LOG_EVENT(event, DEBUG, "modify event : op:%hx mask:%hx changed:%u", op, mask, m_changed_events);
 
   // Flush the changed filters to the kernel if the buffer is full.
   if (m_changed_events == m_max_events) {
     if (::kevent(m_fd, m_changes.get(), m_changed_events, nullptr, 0, nullptr) == -1)
-      throw internal_error("PollInternal::modify() error: " + std::string(std::strerror(errno)));
+      throw internal_error("PollKqueue::modify() error: " + std::string(std::strerror(errno)));
 
     m_changed_events = 0;
   }
@@ -101,55 +129,59 @@ PollInternal::modify(Event* event, unsigned short op, short mask) {
   EV_SET(itr, event->file_descriptor(), mask, op, 0, 0, event);
 }
 
-// TODO: Use unique_ptr
-Poll*
-Poll::create(int max_open_sockets) {
+PollInternal*
+poll_kqueue_create(int max_open_sockets) {
   int fd = kqueue();
 
   if (fd == -1)
     return nullptr;
 
-  auto poll = new Poll();
-  poll->m_internal = std::make_unique<PollInternal>();
+  auto poll = new PollKqueue();
 
-  poll->m_internal->m_table.resize(max_open_sockets);
-  poll->m_internal->m_fd = fd;
-  poll->m_internal->m_max_events = 1024;
-  poll->m_internal->m_events = std::make_unique<struct kevent[]>(poll->m_internal->m_max_events);
-  poll->m_internal->m_changes = std::make_unique<struct kevent[]>(max_open_sockets);
+  poll->m_table.resize(max_open_sockets);
+  poll->m_fd = fd;
+  poll->m_max_events = 1024;
+  poll->m_events = std::make_unique<struct kevent[]>(poll->m_max_events);
+  poll->m_changes = std::make_unique<struct kevent[]>(max_open_sockets);
 
   return poll;
 }
 
-Poll::~Poll() {
-  m_internal->m_table.clear();
+PollKqueue::~PollKqueue() {
+  m_table.clear();
 
-  ::close(m_internal->m_fd);
+  ::close(m_fd);
 }
 
 unsigned int
-Poll::do_poll(int64_t timeout_usec) {
+PollKqueue::do_poll(int64_t timeout_usec) {
+  LT_PROBE1(poll_enter, timeout_usec);
+
   int status = poll((timeout_usec + 999 + 10) / 1000);
 
   if (status == -1) {
     if (errno != EINTR)
       throw internal_error("Poll::work(): " + std::string(std::strerror(errno)));
 
+    LT_PROBE1(poll_exit, 0);
     return 0;
   }
 
-  return process();
+  unsigned int count = process();
+
+  LT_PROBE1(poll_exit, count);
+  return count;
 }
 
 int
-Poll::poll(int msec) {
+PollKqueue::poll(int msec) {
   timespec timeout = { msec / 1000, (msec % 1000) * 1000000 };
 
-  int nfds = ::kevent(m_internal->m_fd,
-                      m_internal->m_changes.get(),
-                      m_internal->m_changed_events,
-                      m_internal->m_events.get() + m_internal->m_waiting_events,
-                      m_internal->m_max_events - m_internal->m_waiting_events,
+  int nfds = ::kevent(m_fd,
+                      m_changes.get(),
+                      m_changed_events,
+                      m_events.get() + m_waiting_events,
+                      m_max_events - m_waiting_events,
                       &timeout);
 
   // Clear the changed events even on fail as we might have received a
@@ -157,32 +189,31 @@ Poll::poll(int msec) {
   // consumed.
   //
   // There's a chance a bad changed event could make kevent return -1,
-  // but it won't as long as there is room enough in m_internal->m_events.
-  m_internal->m_changed_events = 0;
+  // but it won't as long as there is room enough in m_events.
+  m_changed_events = 0;
 
   if (nfds == -1)
     return -1;
 
-  m_internal->m_waiting_events += nfds;
+  m_waiting_events += nfds;
   return nfds;
 }
 
 unsigned int
-Poll::process() {
+PollKqueue::process() {
   unsigned int count = 0;
 
-  for (struct kevent *itr = m_internal->m_events.get(), *last = m_internal->m_events.get() + m_internal->m_waiting_events; itr != last; ++itr) {
-    if (itr->ident >= m_internal->m_table.size())
+  for (struct kevent *itr = m_events.get(), *last = m_events.get() + m_waiting_events; itr != last; ++itr) {
+    if (itr->ident >= m_table.size())
       continue;
 
-    if (thread_self()->callbacks_should_interrupt_polling())
-      thread_self()->process_callbacks(true);
+    process_interrupting_callbacks();
 
-    auto evItr = m_internal->m_table.begin() + itr->ident;
+    auto evItr = m_table.begin() + itr->ident;
 
     if ((itr->flags & EV_ERROR) && evItr->second != nullptr) {
-      if (evItr->first & PollInternal::flag_error)
-        evItr->second->event_error();
+      if (evItr->first & PollKqueue::flag_error)
+        thread_self()->call_event(evItr->second, &Event::event_error);
 
       count++;
 
@@ -192,143 +223,149 @@ Poll::process() {
 
     // Also check current mask.
 
-    if (itr->filter == EVFILT_READ && evItr->second != nullptr && evItr->first & PollInternal::flag_read) {
+    if (itr->filter == EVFILT_READ && evItr->second != nullptr && evItr->first & PollKqueue::flag_read) {
       count++;
-      evItr->second->event_read();
+      thread_self()->call_event(evItr->second, &Event::event_read);
     }
 
-    if (itr->filter == EVFILT_WRITE && evItr->second != nullptr && evItr->first & PollInternal::flag_write) {
+    if (itr->filter == EVFILT_WRITE && evItr->second != nullptr && evItr->first & PollKqueue::flag_write) {
       count++;
-      evItr->second->event_write();
+      thread_self()->call_event(evItr->second, &Event::event_write);
     }
   }
 
-  m_internal->m_waiting_events = 0;
+  m_waiting_events = 0;
   return count;
 }
 
 uint32_t
-Poll::open_max() const {
-  return m_internal->m_table.size();
+PollKqueue::open_max() const {
+  return m_table.size();
 }
 
 void
-Poll::open(Event* event) {
+PollKqueue::open(Event* event) {
   LT_LOG_EVENT(event, DEBUG, "open event", 0);
 
-  if (m_internal->event_mask(event) != 0)
+  if (event_mask(event) != 0)
     throw internal_error("Poll::open(...) called but the file descriptor is active");
 }
 
+// Edge-triggered events are only supported by epoll.
+void
+PollKqueue::open_edge_triggered(Event* event) {
+  open(event);
+}
+
 void
-Poll::close(Event* event) {
+PollKqueue::close(Event* event) {
   LT_LOG_EVENT(event, DEBUG, "close event", 0);
 
-  if (m_internal->event_mask(event) != 0)
+  if (event_mask(event) != 0)
     throw internal_error("Poll::close(...) called but the file descriptor is active");
 
-  m_internal->m_table[event->file_descriptor()] = PollInternal::Table::value_type();
+  m_table[event->file_descriptor()] = PollKqueue::Table::value_type();
 
   // Shouldn't be needed anymore.
-  for (struct kevent *itr = m_internal->m_events.get(), *last = m_internal->m_events.get() + m_internal->m_waiting_events; itr != last; ++itr)
+  for (struct kevent *itr = m_events.get(), *last = m_events.get() + m_waiting_events; itr != last; ++itr)
     if (itr->udata == event)
       itr->udata = nullptr;
 
-  auto last_itr = std::remove_if(m_internal->m_changes.get(),
-                                 m_internal->m_changes.get() + m_internal->m_changed_events,
+  auto last_itr = std::remove_if(m_changes.get(),
+                                 m_changes.get() + m_changed_events,
                                  [event](const struct kevent& ke) { return ke.udata == event; });
 
-  m_internal->m_changed_events = last_itr - m_internal->m_changes.get();
+  m_changed_events = last_itr - m_changes.get();
 }
 
 void
-Poll::closed(Event* event) {
+PollKqueue::closed(Event* event) {
   LT_LOG_EVENT(event, DEBUG, "closed event", 0);
 
   // Kernel removes closed FDs automatically, so just clear the mask
   // and remove it from pending calls.  Don't touch if the FD was
   // re-used before we received the close notification.
-  if (m_internal->m_table[event->file_descriptor()].second == event)
-    m_internal->m_table[event->file_descriptor()] = PollInternal::Table::value_type();
+  if (m_table[event->file_descriptor()].second == event)
+    m_table[event->file_descriptor()] = PollKqueue::Table::value_type();
 
   // Shouldn't be needed anymore.
-  for (struct kevent *itr = m_internal->m_events.get(), *last = m_internal->m_events.get() + m_internal->m_waiting_events; itr != last; ++itr)
+  for (struct kevent *itr = m_events.get(), *last = m_events.get() + m_waiting_events; itr != last; ++itr)
     if (itr->udata == event)
       itr->udata = nullptr;
 
-  auto last_itr = std::remove_if(m_internal->m_changes.get(),
-                                 m_internal->m_changes.get() + m_internal->m_changed_events,
+  auto last_itr = std::remove_if(m_changes.get(),
+                                 m_changes.get() + m_changed_events,
                                  [event](const struct kevent& ke) { return ke.udata == event; });
 
-  m_internal->m_changed_events = last_itr - m_internal->m_changes.get();
+  m_changed_events = last_itr - m_changes.get();
 }
 
 bool
-Poll::in_read(Event* event) {
-  return m_internal->event_mask(event) & PollInternal::flag_read;
+PollKqueue::in_read(Event* event) {
+  return event_mask(event) & PollKqueue::flag_read;
 }
 
 bool
-Poll::in_write(Event* event) {
-  return m_internal->event_mask(event) & PollInternal::flag_write;
+PollKqueue::in_write(Event* event) {
+  return event_mask(event) & PollKqueue::flag_write;
 }
 
 bool
-Poll::in_error(Event* event) {
-  return m_internal->event_mask(event) & PollInternal::flag_error;
+PollKqueue::in_error(Event* event) {
+  return event_mask(event) & PollKqueue::flag_error;
 }
 
 void
-Poll::insert_read(Event* event) {
-  if (m_internal->event_mask(event) & PollInternal::flag_read)
+PollKqueue::insert_read(Event* event) {
+  if (event_mask(event) & PollKqueue::flag_read)
     return;
 
   LT_LOG_EVENT(event, DEBUG, "insert read", 0);
 
-  m_internal->set_event_mask(event, m_internal->event_mask(event) | PollInternal::flag_read);
-  m_internal->modify(event, EV_ADD, EVFILT_READ);
+  set_event_mask(event, event_mask(event) | PollKqueue::flag_read);
+  modify(event, EV_ADD, EVFILT_READ);
 }
 
 void
-Poll::insert_write(Event* event) {
-  if (m_internal->event_mask(event) & PollInternal::flag_write)
+PollKqueue::insert_write(Event* event) {
+  if (event_mask(event) & PollKqueue::flag_write)
     return;
 
   LT_LOG_EVENT(event, DEBUG, "insert write", 0);
 
-  m_internal->set_event_mask(event, m_internal->event_mask(event) | PollInternal::flag_write);
-  m_internal->modify(event, EV_ADD, EVFILT_WRITE);
+  set_event_mask(event, event_mask(event) | PollKqueue::flag_write);
+  modify(event, EV_ADD, EVFILT_WRITE);
 }
 
 void
-Poll::insert_error(Event* event) {
+PollKqueue::insert_error(Event* event) {
   LT_LOG_EVENT(event, DEBUG, "insert error", 0);
 }
 
 void
-Poll::remove_read(Event* event) {
-  if (!(m_internal->event_mask(event) & PollInternal::flag_read))
+PollKqueue::remove_read(Event* event) {
+  if (!(event_mask(event) & PollKqueue::flag_read))
     return;
 
   LT_LOG_EVENT(event, DEBUG, "remove read", 0);
 
-  m_internal->set_event_mask(event, m_internal->event_mask(event) & ~PollInternal::flag_read);
-  m_internal->modify(event, EV_DELETE, EVFILT_READ);
+  set_event_mask(event, event_mask(event) & ~PollKqueue::flag_read);
+  modify(event, EV_DELETE, EVFILT_READ);
 }
 
 void
-Poll::remove_write(Event* event) {
-  if (!(m_internal->event_mask(event) & PollInternal::flag_write))
+PollKqueue::remove_write(Event* event) {
+  if (!(event_mask(event) & PollKqueue::flag_write))
     return;
 
   LT_LOG_EVENT(event, DEBUG, "remove write", 0);
 
-  m_internal->set_event_mask(event, m_internal->event_mask(event) & ~PollInternal::flag_write);
-  m_internal->modify(event, EV_DELETE, EVFILT_WRITE);
+  set_event_mask(event, event_mask(event) & ~PollKqueue::flag_write);
+  modify(event, EV_DELETE, EVFILT_WRITE);
 }
 
 void
-Poll::remove_error(Event* event) {
+PollKqueue::remove_error(Event* event) {
   LT_LOG_EVENT(event, DEBUG, "remove error", 0);
 }
 
@@ -0,0 +1,608 @@
+#include "config.h"
+
+#ifdef USE_IO_URING
+
+#include "torrent/poll_internal.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cerrno>
+#include <cstring>
+#include <memory>
+#include <csignal>
+#include <vector>
+#include <sys/poll.h>
+#include <unistd.h>
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+
+#include "torrent/exceptions.h"
+#include "torrent/event.h"
+#include "torrent/utils/log.h"
+#include "torrent/utils/thread.h"
+#include "utils/probe.h"
+
+#define LT_LOG_EVENT(event, log_level, log_fmt, ...)                    \
+  lt_log_print(LOG_SOCKET_##log_level, "uring->%s(%i): " log_fmt, event->type_name(), event->file_descriptor(), __VA_ARGS__);
+
+// Each fd has at most one one-shot IORING_OP_POLL_ADD armed. Interest
+// changes only mark the fd as changed, and all changes are turned into
+// submission entries in one batch right before waiting, so a full
+// event loop iteration costs a single io_uring_enter call.
+//
+// Multishot polls are not used as they only complete on new wakeups,
+// which would turn the level-triggered semantics Poll guarantees into
+// edge-triggered ones. Re-arming a one-shot poll checks the current
+// readiness, so data left unread by a throttled socket is reported
+// again.
+
+namespace torrent {
+
+class PollUring : public PollInternal {
+public:
+  static constexpr uint32_t flag_read  = (1 << 0);
+  static constexpr uint32_t flag_write = (1 << 1);
+  static constexpr uint32_t flag_error = (1 << 2);
+
+  static constexpr unsigned int ring_entries = 1024;
+
+  struct Entry {
+    Event*   event{};
+    uint32_t mask{};
+
+    // The poll currently armed in the kernel, if any.
+    uint32_t armed_mask{};
+    uint32_t generation{};
+    bool     changed{};
+  };
+
+  using Table = std::vector<Entry>;
+
+  ~PollUring() override;
+
+  const char*         backend_name() const override { return "io_uring"; }
+
+  unsigned int        do_poll(int64_t timeout_usec) override;
+  uint32_t            open_max() const override;
+
+  void                open(Event* event) override;
+  void                close(Event* event) override;
+  void                open_edge_triggered(Event* event) override;
+  void                closed(Event* event) override;
+
+  bool                in_read(Event* event) override;
+  bool                in_write(Event* event) override;
+  bool                in_error(Event* event) override;
+
+  void                insert_read(Event* event) override;
+  void                insert_write(Event* event) override;
+  void                insert_error(Event* event) override;
+
+  void                remove_read(Event* event) override;
+  void                remove_write(Event* event) override;
+  void                remove_error(Event* event) override;
+
+  int                 poll(int msec);
+  unsigned int        process();
+
+  bool                setup(unsigned int max_open_sockets);
+
+  inline uint32_t     event_mask(Event* e);
+  inline void         set_event_mask(Event* e, uint32_t m);
+
+  void                mark_changed(int fd);
+  void                flush_changes();
+
+  io_uring_sqe*       get_sqe();
+  int                 enter(unsigned int to_submit, unsigned int min_complete, const timespec* timeout);
+
+  static uint64_t     user_data(int fd, uint32_t generation) { return (uint64_t(generation) << 32) | uint32_t(fd); }
+  static short        poll_events(uint32_t mask);
+
+  int                 m_fd{-1};
+
+  Table               m_table;
+  std::vector<int>    m_changes;
+
+  unsigned int        m_max_events{};
+  unsigned int        m_waiting_events{};
+  unsigned int        m_pending_submit{};
+
+  std::unique_ptr<io_uring_cqe[]> m_events;
+
+  void*               m_sq_ring{MAP_FAILED};
+  void*               m_cq_ring{MAP_FAILED};
+  size_t              m_sq_ring_size{};
+  size_t              m_cq_ring_size{};
+
+  io_uring_sqe*       m_sqes{static_cast<io_uring_sqe*>(MAP_FAILED)};
+  size_t              m_sqes_size{};
+
+  unsigned*           m_sq_head{};
+  unsigned*           m_sq_tail{};
+  unsigned*           m_sq_array{};
+  unsigned            m_sq_mask{};
+  unsigned            m_sq_entries{};
+
+  unsigned*           m_cq_head{};
+  unsigned*           m_cq_tail{};
+  io_uring_cqe*       m_cqes{};
+  unsigned            m_cq_mask{};
+};
+
+PollUring::~PollUring() {
+  if (m_sqes != MAP_FAILED)
+    munmap(m_sqes, m_sqes_size);
+
+  if (m_cq_ring != MAP_FAILED && m_cq_ring != m_sq_ring)
+    munmap(m_cq_ring, m_cq_ring_size);
+
+  if (m_sq_ring != MAP_FAILED)
+    munmap(m_sq_ring, m_sq_ring_size);
+
+  if (m_fd != -1)
+    ::close(m_fd);
+}
+
+bool
+PollUring::setup(unsigned int max_open_sockets) {
+  io_uring_params params;
+  std::memset(&params, 0, sizeof(params));
+
+  // Every open socket may have a poll outstanding, so size the
+  // completion queue for that and let the kernel buffer any overflow.
+  params.flags      = IORING_SETUP_CQSIZE;
+  params.cq_entries = std::max(ring_entries * 2, std::min(max_open_sockets, 65536u));
+
+  m_fd = ::syscall(__NR_io_uring_setup, ring_entries, &params);
+
+  if (m_fd == -1)
+    return false;
+
+  if (!(params.features & IORING_FEAT_EXT_ARG) || !(params.features & IORING_FEAT_NODROP))
+    return false;
+
+  m_sq_ring_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+  m_cq_ring_size = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+
+  if (params.features & IORING_FEAT_SINGLE_MMAP)
+    m_sq_ring_size = m_cq_ring_size = std::max(m_sq_ring_size, m_cq_ring_size);
+
+  m_sq_ring = mmap(nullptr, m_sq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_fd, IORING_OFF_SQ_RING);
+
+  if (m_sq_ring == MAP_FAILED)
+    return false;
+
+  if (params.features & IORING_FEAT_SINGLE_MMAP)
+    m_cq_ring = m_sq_ring;
+  else
+    m_cq_ring = mmap(nullptr, m_cq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_fd, IORING_OFF_CQ_RING);
+
+  if (m_cq_ring == MAP_FAILED)
+    return false;
+
+  m_sqes_size = params.sq_entries * sizeof(io_uring_sqe);
+  m_sqes = static_cast<io_uring_sqe*>(mmap(nullptr, m_sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_fd, IORING_OFF_SQES));
+
+  if (m_sqes == MAP_FAILED)
+    return false;
+
+  auto sq_ring = static_cast<char*>(m_sq_ring);
+  auto cq_ring = static_cast<char*>(m_cq_ring);
+
+  m_sq_head    = reinterpret_cast<unsigned*>(sq_ring + params.sq_off.head);
+  m_sq_tail    = reinterpret_cast<unsigned*>(sq_ring + params.sq_off.tail);
+  m_sq_array   = reinterpret_cast<unsigned*>(sq_ring + params.sq_off.array);
+  m_sq_mask    = *reinterpret_cast<unsigned*>(sq_ring + params.sq_off.ring_mask);
+  m_sq_entries = params.sq_entries;
+
+  m_cq_head = reinterpret_cast<unsigned*>(cq_ring + params.cq_off.head);
+  m_cq_tail = reinterpret_cast<unsigned*>(cq_ring + params.cq_off.tail);
+  m_cqes    = reinterpret_cast<io_uring_cqe*>(cq_ring + params.cq_off.cqes);
+  m_cq_mask = *reinterpret_cast<unsigned*>(cq_ring + params.cq_off.ring_mask);
+
+  m_table.resize(max_open_sockets);
+  m_max_events = 1024;
+  m_events = std::make_unique<io_uring_cqe[]>(m_max_events);
+
+  return true;
+}
+
+inline uint32_t
+PollUring::event_mask(Event* e) {
+  assert(e->file_descriptor() != -1);
+
+  const Entry& entry = m_table[e->file_descriptor()];
+  return entry.event != e ? 0 : entry.mask;
+}
+
+inline void
+PollUring::set_event_mask(Event* e, uint32_t m) {
+  assert(e->file_descriptor() != -1);
+
+  Entry& entry = m_table[e->file_descriptor()];
+  entry.event = e;
+  entry.mask = m;
+
+  mark_changed(e->file_descriptor());
+}
+
+void
+PollUring::mark_changed(int fd) {
+  Entry& entry = m_table[fd];
+
+  if (entry.changed)
+    return;
+
+  entry.changed = true;
+  m_changes.push_back(fd);
+}
+
+short
+PollUring::poll_events(uint32_t mask) {
+  short events = 0;
+
+  if (mask & flag_read)
+    events |= POLLIN;
+  if (mask & flag_write)
+    events |= POLLOUT;
+  if (mask & flag_error)
+    events |= POLLERR;
+
+  return events;
+}
+
+io_uring_sqe*
+PollUring::get_sqe() {
+  unsigned head = __atomic_load_n(m_sq_head, __ATOMIC_ACQUIRE);
+  unsigned tail = *m_sq_tail;
+
+  // Hand the queued entries to the kernel if the ring is full.
+  if (tail - head == m_sq_entries) {
+    if (enter(m_pending_submit, 0, nullptr) == -1 && errno != EINTR && errno != EAGAIN && errno != EBUSY)
+      throw internal_error("PollUring::get_sqe() io_uring_enter failed: " + std::string(std::strerror(errno)));
+
+    head = __atomic_load_n(m_sq_head, __ATOMIC_ACQUIRE);
+
+    if (tail - head == m_sq_entries)
+      throw internal_error("PollUring::get_sqe() submission queue is full.");
+  }
+
+  io_uring_sqe* sqe = m_sqes + (tail & m_sq_mask);
+  std::memset(sqe, 0, sizeof(*sqe));
+
+  m_sq_array[tail & m_sq_mask] = tail & m_sq_mask;
+  __atomic_store_n(m_sq_tail, tail + 1, __ATOMIC_RELEASE);
+
+  m_pending_submit++;
+  return sqe;
+}
+
+int
+PollUring::enter(unsigned int to_submit, unsigned int min_complete, const timespec* timeout) {
+  unsigned int flags = 0;
+
+  io_uring_getevents_arg arg;
+  std::memset(&arg, 0, sizeof(arg));
+
+  if (min_complete != 0) {
+    flags |= IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG;
+
+    __kernel_timespec ts;
+
+    if (timeout != nullptr) {
+      ts.tv_sec = timeout->tv_sec;
+      ts.tv_nsec = timeout->tv_nsec;
+      arg.ts = reinterpret_cast<uint64_t>(&ts);
+    }
+
+    arg.sigmask_sz = _NSIG / 8;
+
+    int result = ::syscall(__NR_io_uring_enter, m_fd, to_submit, min_complete, flags, &arg, sizeof(arg));
+
+    if (result >= 0)
+      m_pending_submit -= std::min<unsigned int>(result, m_pending_submit);
+
+    return result;
+  }
+
+  int result = ::syscall(__NR_io_uring_enter, m_fd, to_submit, 0, flags, nullptr, 0);
+
+  if (result >= 0)
+    m_pending_submit -= std::min<unsigned int>(result, m_pending_submit);
+
+  return result;
+}
+
+// Turn the coalesced interest changes into submission entries. The
+// generation in the user data lets us ignore completions for polls
+// that were replaced or belong to a previous user of the fd.
+void
+PollUring::flush_changes() {
+  for (int fd : m_changes) {
+    Entry& entry = m_table[fd];
+    entry.changed = false;
+
+    if (entry.armed_mask == entry.mask)
+      continue;
+
+    if (entry.armed_mask != 0) {
+      io_uring_sqe* sqe = get_sqe();
+      sqe->opcode = IORING_OP_POLL_REMOVE;
+      sqe->fd = -1;
+      sqe->addr = user_data(fd, entry.generation);
+      sqe->user_data = user_data(fd, ~uint32_t());
+
+      entry.armed_mask = 0;
+    }
+
+    if (entry.mask != 0) {
+      io_uring_sqe* sqe = get_sqe();
+      sqe->opcode = IORING_OP_POLL_ADD;
+      sqe->fd = fd;
+      sqe->poll_events = poll_events(entry.mask);
+      sqe->user_data = user_data(fd, ++entry.generation);
+
+      if (entry.generation == ~uint32_t())
+        sqe->user_data = user_data(fd, entry.generation = 0);
+
+      entry.armed_mask = entry.mask;
+    }
+  }
+
+  m_changes.clear();
+}
+
+PollInternal*
+poll_uring_create(int max_open_sockets) {
+  auto poll = std::make_unique<PollUring>();
+
+  if (!poll->setup(max_open_sockets))
+    return nullptr;
+
+  return poll.release();
+}
+
+unsigned int
+PollUring::do_poll(int64_t timeout_usec) {
+  LT_PROBE1(poll_enter, timeout_usec);
+
+  int status = poll((timeout_usec + 999 + 10) / 1000);
+
+  if (status == -1) {
+    if (errno != EINTR)
+      throw internal_error("Poll::work(): " + std::string(std::strerror(errno)));
+
+    LT_PROBE1(poll_exit, 0);
+    return 0;
+  }
+
+  unsigned int count = process();
+
+  LT_PROBE1(poll_exit, count);
+  return count;
+}
+
+int
+PollUring::poll(int msec) {
+  flush_changes();
+
+  timespec timeout = { msec / 1000, (msec % 1000) * 1000000 };
+
+  unsigned head = *m_cq_head;
+
+  if (__atomic_load_n(m_cq_tail, __ATOMIC_ACQUIRE) == head || m_pending_submit != 0) {
+    bool wait = __atomic_load_n(m_cq_tail, __ATOMIC_ACQUIRE) == head;
+
+    if (enter(m_pending_submit, wait ? 1 : 0, wait ? &timeout : nullptr) == -1) {
+      if (errno == ETIME || errno == EBUSY || errno == EAGAIN)
+        errno = EINTR;
+
+      return -1;
+    }
+  }
+
+  unsigned tail = __atomic_load_n(m_cq_tail, __ATOMIC_ACQUIRE);
+  unsigned count = std::min(tail - head, m_max_events);
+
+  for (unsigned i = 0; i < count; i++)
+    m_events[i] = m_cqes[(head + i) & m_cq_mask];
+
+  __atomic_store_n(m_cq_head, head + count, __ATOMIC_RELEASE);
+
+  m_waiting_events = count;
+  return count;
+}
+
+// We check m_table to make sure the Event is still listening to the
+// event, so it is safe to remove Event's while in working.
+unsigned int
+PollUring::process() {
+  unsigned int count = 0;
+
+  for (io_uring_cqe *itr = m_events.get(), *last = m_events.get() + m_waiting_events; itr != last; ++itr) {
+    int      fd         = itr->user_data & 0xffffffff;
+    uint32_t generation = itr->user_data >> 32;
+
+    if (fd < 0 || static_cast<size_t>(fd) >= m_table.size())
+      continue;
+
+    auto entry = m_table.begin() + fd;
+
+    // Results of poll removals and replaced polls.
+    if (generation != entry->generation || entry->armed_mask == 0)
+      continue;
+
+    // The one-shot poll is done, re-arm it on the next flush if the
+    // socket is still interested in events.
+    entry->armed_mask = 0;
+    mark_changed(fd);
+
+    if (itr->res < 0)
+      continue;
+
+    process_interrupting_callbacks();
+
+    // Each branch must check for event != nullptr to allow the socket
+    // to remove itself between the calls.
+
+    if (itr->res & POLLERR && entry->event != nullptr && entry->mask & flag_error) {
+      count++;
+      thread_self()->call_event(entry->event, &Event::event_error);
+    }
+
+    if (itr->res & (POLLIN | POLLHUP) && entry->event != nullptr && entry->mask & flag_read) {
+      count++;
+      thread_self()->call_event(entry->event, &Event::event_read);
+    }
+
+    if (itr->res & POLLOUT && entry->event != nullptr && entry->mask & flag_write) {
+      count++;
+      thread_self()->call_event(entry->event, &Event::event_write);
+    }
+  }
+
+  m_waiting_events = 0;
+  return count;
+}
+
+uint32_t
+PollUring::open_max() const {
+  return m_table.size();
+}
+
+void
+PollUring::open(Event* event) {
+  LT_LOG_EVENT(event, DEBUG, "open event", 0);
+
+  if (event_mask(event) != 0)
+    throw internal_error("Poll::open(...) called but the file descriptor is active");
+}
+
+// Edge-triggered events are only supported by epoll.
+void
+PollUring::open_edge_triggered(Event* event) {
+  open(event);
+}
+
+void
+PollUring::close(Event* event) {
+  LT_LOG_EVENT(event, DEBUG, "close event", 0);
+
+  if (event_mask(event) != 0)
+    throw internal_error("Poll::close(...) called but the file descriptor is active");
+
+  auto& entry = m_table[event->file_descriptor()];
+  entry.event = nullptr;
+  entry.mask = 0;
+
+  // An armed poll keeps a reference to the file, so it must be removed
+  // for the close to take effect.
+  if (entry.armed_mask != 0)
+    mark_changed(event->file_descriptor());
+
+  // Clear the event list just in case we open a new socket with the
+  // same fd while in the middle of calling Poll::perform.
+  for (io_uring_cqe *itr = m_events.get(), *last = m_events.get() + m_waiting_events; itr != last; ++itr)
+    if (int(itr->user_data & 0xffffffff) == event->file_descriptor())
+      itr->res = 0;
+}
+
+void
+PollUring::closed(Event* event) {
+  LT_LOG_EVENT(event, DEBUG, "closed event", 0);
+
+  // Unlike epoll the kernel does not drop polls on close, so keep the
+  // armed state around until the removal is submitted. Don't touch if
+  // the FD was re-used before we received the close notification.
+  auto& entry = m_table[event->file_descriptor()];
+
+  if (entry.event != event)
+    return;
+
+  entry.event = nullptr;
+  entry.mask = 0;
+
+  if (entry.armed_mask != 0)
+    mark_changed(event->file_descriptor());
+}
+
+bool
+PollUring::in_read(Event* event) {
+  return event_mask(event) & flag_read;
+}
+
+bool
+PollUring::in_write(Event* event) {
+  return event_mask(event) & flag_write;
+}
+
+bool
+PollUring::in_error(Event* event) {
+  return event_mask(event) & flag_error;
+}
+
+void
+PollUring::insert_read(Event* event) {
+  if (event_mask(event) & flag_read)
+    return;
+
+  LT_LOG_EVENT(event, DEBUG, "insert read", 0);
+
+  set_event_mask(event, event_mask(event) | flag_read);
+}
+
+void
+PollUring::insert_write(Event* event) {
+  if (event_mask(event) & flag_write)
+    return;
+
+  LT_LOG_EVENT(event, DEBUG, "insert write", 0);
+
+  set_event_mask(event, event_mask(event) | flag_write);
+}
+
+void
+PollUring::insert_error(Event* event) {
+  if (event_mask(event) & flag_error)
+    return;
+
+  LT_LOG_EVENT(event, DEBUG, "insert error", 0);
+
+  set_event_mask(event, event_mask(event) | flag_error);
+}
+
+void
+PollUring::remove_read(Event* event) {
+  if (!(event_mask(event) & flag_read))
+    return;
+
+  LT_LOG_EVENT(event, DEBUG, "remove read", 0);
+
+  set_event_mask(event, event_mask(event) & ~flag_read);
+}
+
+void
+PollUring::remove_write(Event* event) {
+  if (!(event_mask(event) & flag_write))
+    return;
+
+  LT_LOG_EVENT(event, DEBUG, "remove write", 0);
+
+  set_event_mask(event, event_mask(event) & ~flag_write);
+}
+
+void
+PollUring::remove_error(Event* event) {
+  if (!(event_mask(event) & flag_error))
+    return;
+
+  LT_LOG_EVENT(event, DEBUG, "remove error", 0);
+
+  set_event_mask(event, event_mask(event) & ~flag_error);
+}
+
+}
+
+#endif // USE_IO_URING
@@ -36,17 +36,36 @@
 
 #include "config.h"
 
+#include <algorithm>
+
 #include "globals.h"
 #include "rate.h"
 #include "exceptions.h"
 
 namespace torrent {
 
+// The window covers the current bucket and the 'span / width' buckets
+// before it, as entries exactly 'span' seconds old were kept by the
+// previous implementation.
 inline void
 Rate::discard_old() const {
-  while (!m_container.empty() && m_container.back().first < cachedTime.seconds() - m_span) {
-    m_current -= m_container.back().second;
-    m_container.pop_back();
+  timer_type now = cachedTime.seconds() / m_width;
+
+  if (now == m_last)
+    return;
+
+  if (now < m_last || now - m_last >= m_used) {
+    std::fill_n(m_buckets.get(), m_used, 0);
+    m_current = 0;
+    m_last = now;
+    return;
+  }
+
+  while (m_last != now) {
+    rate_type& bucket = m_buckets[++m_last % m_used];
+
+    m_current -= bucket;
+    bucket = 0;
   }
 }
 
@@ -57,6 +76,24 @@ Rate::rate() const {
   return m_current / m_span;
 }
 
+void
+Rate::set_span(timer_type s) {
+  if (s <= 0)
+    throw internal_error("Rate::set_span(...) received an invalid span.");
+
+  timer_type width = (s + bucket_count - 2) / (bucket_count - 1);
+  timer_type used  = s / width + 1;
+
+  if (m_buckets == nullptr || used != m_used)
+    m_buckets = std::make_unique<rate_type[]>(used);
+
+  m_span  = s;
+  m_width = width;
+  m_used  = used;
+
+  reset_rate();
+}
+
 void
 Rate::insert(rate_type bytes) {
   discard_old();
@@ -64,13 +101,17 @@ Rate::insert(rate_type bytes) {
   if (m_current > (rate_type{1} << 40) || bytes > (rate_type{1} << 28))
     throw internal_error("Rate::insert(bytes) received out-of-bounds values..");
 
-  if (m_container.empty() || m_container.front().first != cachedTime.seconds())
-    m_container.emplace_front(cachedTime.seconds(), bytes);
-  else
-    m_container.front().second += bytes;
+  m_buckets[m_last % m_used] += bytes;
 
   m_total += bytes;
   m_current += bytes;
 }
 
+void
+Rate::reset_rate() {
+  std::fill_n(m_buckets.get(), m_used, 0);
+  m_current = 0;
+  m_last = cachedTime.seconds() / m_width;
+}
+
 }
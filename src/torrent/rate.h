@@ -37,14 +37,21 @@
 #ifndef LIBTORRENT_UTILS_RATE_H
 #define LIBTORRENT_UTILS_RATE_H
 
-#include <deque>
+#include <memory>
 #include <torrent/common.h>
 
 namespace torrent {
 
-// Keep the current rate count up to date for each call to rate() and
-// insert(...). This requires a mutable since rate() can be const, but
-// is justified as we avoid iterating the deque for each call.
+// Bytes transfered during the last 'span' seconds, kept in a fixed
+// ring of buckets that each cover 'bucket_width' seconds. The running
+// sum is updated as buckets leave the window, so rate() is O(1). The
+// buckets are allocated when the span is set, keeping the object small
+// enough to embed several in each peer connection. This requires a
+// mutable since rate() can be const.
+//
+// Spans of up to 'bucket_count - 1' seconds have one bucket per
+// second, longer spans are tracked with a resolution of
+// 'bucket_width' seconds.
 
 class LIBTORRENT_EXPORT Rate {
 public:
@@ -52,10 +59,9 @@ public:
   using rate_type  = uint64_t;
   using total_type = uint64_t;
 
-  using value_type = std::pair<timer_type, rate_type>;
-  using queue_type = std::deque<value_type>;
+  static constexpr unsigned int bucket_count = 64;
 
-  Rate(timer_type span) :  m_span(span) {}
+  Rate(timer_type span)                                       { set_span(span); }
 
   // Bytes per second.
   rate_type           rate() const;
@@ -64,13 +70,16 @@ public:
   total_type          total() const                           { return m_total; }
   void                set_total(total_type bytes)             { m_total = bytes; }
 
-  // Interval in seconds used to calculate the rate.
+  // Interval in seconds used to calculate the rate, changing it
+  // resets the rate.
   timer_type          span() const                            { return m_span; }
-  void                set_span(timer_type s)                  { m_span = s; }
+  void                set_span(timer_type s);
+
+  timer_type          bucket_width() const                    { return m_width; }
 
   void                insert(rate_type bytes);
 
-  void                reset_rate()                            { m_current = 0; m_container.clear(); }
+  void                reset_rate();
   
   bool                operator <  (Rate& r) const             { return rate() < r.rate(); }
   bool                operator >  (Rate& r) const             { return rate() > r.rate(); }
@@ -85,11 +94,16 @@ public:
 private:
   inline void         discard_old() const;
 
-  mutable queue_type  m_container;
+  mutable std::unique_ptr<rate_type[]> m_buckets;
+
+  // Index, in units of 'm_width' seconds, of the newest bucket.
+  mutable timer_type  m_last{0};
 
   mutable rate_type   m_current{0};
   total_type          m_total{0};
   timer_type          m_span;
+  timer_type          m_width;
+  timer_type          m_used{0};
 };
 
 }
@@ -0,0 +1,194 @@
+#include "config.h"
+
+#include "torrent/stats_snapshot.h"
+
+#include "manager.h"
+#include "torrent/download/download_manager.h"
+#include "download/download_wrapper.h"
+#include "torrent/download.h"
+#include "torrent/download_info.h"
+#include "torrent/tracker_list.h"
+#include "torrent/data/file_list.h"
+#include "torrent/peer/connection_list.h"
+#include "torrent/peer/peer.h"
+#include "torrent/tracker/wrappers.h"
+
+namespace torrent {
+
+// FNV-1a over whole words, only used to tell whether a row changed.
+static inline void
+checksum_add(uint64_t& checksum, uint64_t value) {
+  checksum = (checksum ^ value) * 0x100000001b3;
+}
+
+static uint32_t
+download_flags(Download& download) {
+  uint32_t flags = 0;
+  auto     info = download.info();
+  auto     controller = download.tracker_controller();
+
+  flags |= info->is_open()               ? StatsSnapshot::flag_open : 0;
+  flags |= info->is_active()             ? StatsSnapshot::flag_active : 0;
+  flags |= info->is_paused()             ? StatsSnapshot::flag_paused : 0;
+  flags |= info->is_hibernating()        ? StatsSnapshot::flag_hibernating : 0;
+  flags |= download.is_hash_checking()   ? StatsSnapshot::flag_hash_checking : 0;
+  flags |= download.is_hash_checked()    ? StatsSnapshot::flag_hash_checked : 0;
+  flags |= controller.is_active()        ? StatsSnapshot::flag_tracker_active : 0;
+  flags |= controller.is_requesting()    ? StatsSnapshot::flag_tracker_requesting : 0;
+  flags |= controller.is_failure_mode()  ? StatsSnapshot::flag_tracker_failure : 0;
+
+  return flags;
+}
+
+static uint32_t
+peer_flags(const Peer* peer) {
+  uint32_t flags = 0;
+
+  flags |= peer->is_incoming()        ? StatsSnapshot::peer_incoming : 0;
+  flags |= peer->is_encrypted()       ? StatsSnapshot::peer_encrypted : 0;
+  flags |= peer->is_up_choked()       ? StatsSnapshot::peer_up_choked : 0;
+  flags |= peer->is_up_interested()   ? StatsSnapshot::peer_up_interested : 0;
+  flags |= peer->is_down_choked()     ? StatsSnapshot::peer_down_choked : 0;
+  flags |= peer->is_down_interested() ? StatsSnapshot::peer_down_interested : 0;
+  flags |= peer->is_snubbed()         ? StatsSnapshot::peer_snubbed : 0;
+
+  return flags;
+}
+
+// Fills the peer rows of a download from 'first', returning the
+// checksum of their values.
+static uint64_t
+fill_peers(StatsSnapshot* snapshot, const ConnectionList* connections, uint32_t first) {
+  uint64_t checksum = 0;
+  size_t   size = first + connections->size();
+
+  snapshot->peer.resize(size);
+  snapshot->peer_flags.resize(size);
+  snapshot->peer_down_rate.resize(size);
+  snapshot->peer_up_rate.resize(size);
+  snapshot->peer_rate.resize(size);
+  snapshot->peer_chunks_done.resize(size);
+
+  uint32_t row = first;
+
+  for (const Peer* peer : *connections) {
+    snapshot->peer[row]             = peer;
+    snapshot->peer_flags[row]       = peer_flags(peer);
+    snapshot->peer_down_rate[row]   = peer->down_rate()->rate();
+    snapshot->peer_up_rate[row]     = peer->up_rate()->rate();
+    snapshot->peer_rate[row]        = peer->peer_rate()->rate();
+    snapshot->peer_chunks_done[row] = peer->chunks_done();
+
+    checksum_add(checksum, reinterpret_cast<uintptr_t>(peer));
+    checksum_add(checksum, snapshot->peer_flags[row]);
+    checksum_add(checksum, snapshot->peer_down_rate[row]);
+    checksum_add(checksum, snapshot->peer_up_rate[row]);
+    checksum_add(checksum, snapshot->peer_rate[row]);
+    checksum_add(checksum, snapshot->peer_chunks_done[row]);
+
+    row++;
+  }
+
+  return checksum;
+}
+
+void
+stats_snapshot(StatsSnapshot* snapshot, int flags) {
+  auto   download_manager = manager->download_manager();
+  size_t size = download_manager->size();
+
+  size_t old_size = snapshot->hash.size();
+
+  snapshot->generation++;
+
+  snapshot->hash.resize(size);
+  snapshot->version.resize(size);
+  snapshot->flags.resize(size);
+  snapshot->down_rate.resize(size);
+  snapshot->up_rate.resize(size);
+  snapshot->skip_rate.resize(size);
+  snapshot->down_total.resize(size);
+  snapshot->up_total.resize(size);
+  snapshot->bytes_done.resize(size);
+  snapshot->bytes_total.resize(size);
+  snapshot->chunks_done.resize(size);
+  snapshot->chunks_total.resize(size);
+  snapshot->peers_connected.resize(size);
+  snapshot->peers_complete.resize(size);
+  snapshot->peers_unchoked.resize(size);
+  snapshot->peers_interested.resize(size);
+  snapshot->trackers.resize(size);
+  snapshot->checksum.resize(size);
+  snapshot->peer_first.resize(size + 1);
+
+  uint32_t row = 0;
+  uint32_t peer_row = 0;
+
+  for (DownloadWrapper* wrapper : *download_manager) {
+    Download download(wrapper);
+
+    auto info = download.info();
+    auto file_list = download.file_list();
+    auto connections = download.connection_list();
+
+    bool moved = row >= old_size || snapshot->hash[row] != info->hash();
+
+    snapshot->hash[row]             = info->hash();
+    snapshot->flags[row]            = download_flags(download);
+    snapshot->down_rate[row]        = info->down_rate()->rate();
+    snapshot->up_rate[row]          = info->up_rate()->rate();
+    snapshot->skip_rate[row]        = info->skip_rate()->rate();
+    snapshot->down_total[row]       = info->down_rate()->total();
+    snapshot->up_total[row]         = info->up_rate()->total();
+    snapshot->bytes_done[row]       = download.bytes_done();
+    snapshot->bytes_total[row]      = file_list->size_bytes();
+    snapshot->chunks_done[row]      = file_list->completed_chunks();
+    snapshot->chunks_total[row]     = file_list->size_chunks();
+    snapshot->peers_connected[row]  = connections->size();
+    snapshot->peers_complete[row]   = download.peers_complete();
+    snapshot->peers_unchoked[row]   = download.peers_currently_unchoked();
+    snapshot->peers_interested[row] = download.peers_currently_interested();
+    snapshot->trackers[row]         = download.tracker_list()->size();
+    snapshot->peer_first[row]       = peer_row;
+
+    uint64_t checksum = 0xcbf29ce484222325;
+
+    checksum_add(checksum, snapshot->flags[row]);
+    checksum_add(checksum, snapshot->down_rate[row]);
+    checksum_add(checksum, snapshot->up_rate[row]);
+    checksum_add(checksum, snapshot->skip_rate[row]);
+    checksum_add(checksum, snapshot->down_total[row]);
+    checksum_add(checksum, snapshot->up_total[row]);
+    checksum_add(checksum, snapshot->bytes_done[row]);
+    checksum_add(checksum, snapshot->bytes_total[row]);
+    checksum_add(checksum, snapshot->chunks_done[row]);
+    checksum_add(checksum, snapshot->chunks_total[row]);
+    checksum_add(checksum, snapshot->peers_connected[row]);
+    checksum_add(checksum, snapshot->peers_complete[row]);
+    checksum_add(checksum, snapshot->peers_unchoked[row]);
+    checksum_add(checksum, snapshot->peers_interested[row]);
+    checksum_add(checksum, snapshot->trackers[row]);
+
+    if (!(flags & stats_skip_peers)) {
+      checksum_add(checksum, fill_peers(snapshot, connections, peer_row));
+      peer_row += connections->size();
+    }
+
+    if (moved || checksum != snapshot->checksum[row])
+      snapshot->version[row] = snapshot->generation;
+
+    snapshot->checksum[row] = checksum;
+    row++;
+  }
+
+  snapshot->peer_first[row] = peer_row;
+
+  snapshot->peer.resize(peer_row);
+  snapshot->peer_flags.resize(peer_row);
+  snapshot->peer_down_rate.resize(peer_row);
+  snapshot->peer_up_rate.resize(peer_row);
+  snapshot->peer_rate.resize(peer_row);
+  snapshot->peer_chunks_done.resize(peer_row);
+}
+
+}
@@ -0,0 +1,97 @@
+#ifndef LIBTORRENT_TORRENT_STATS_SNAPSHOT_H
+#define LIBTORRENT_TORRENT_STATS_SNAPSHOT_H
+
+#include <vector>
+#include <torrent/common.h>
+#include <torrent/hash_string.h>
+
+namespace torrent {
+
+// The common metrics of all downloads and their connected peers, as
+// columns filled by 'stats_snapshot()' in one pass over the download
+// list. Keep the object between calls so the columns are reused, a
+// client polling thousands of downloads then neither allocates nor
+// goes through the per-download getters.
+//
+// Download row 'i' is the i'th download of the download list, and its
+// peers are rows [peer_first[i], peer_first[i + 1]) of the peer
+// columns. Peer pointers are only valid until the main thread runs
+// again.
+//
+// Each call bumps 'generation', and 'version[i]' is the generation in
+// which the values of download 'i' or its peers last changed. A client
+// can skip the downloads with a version at or below the generation it
+// last processed. Downloads that were added or moved to another row
+// count as changed.
+
+class LIBTORRENT_EXPORT StatsSnapshot {
+public:
+  static constexpr uint32_t flag_open               = (1 << 0);
+  static constexpr uint32_t flag_active             = (1 << 1);
+  static constexpr uint32_t flag_paused             = (1 << 2);
+  static constexpr uint32_t flag_hibernating        = (1 << 3);
+  static constexpr uint32_t flag_hash_checking      = (1 << 4);
+  static constexpr uint32_t flag_hash_checked       = (1 << 5);
+  static constexpr uint32_t flag_tracker_active     = (1 << 6);
+  static constexpr uint32_t flag_tracker_requesting = (1 << 7);
+  static constexpr uint32_t flag_tracker_failure    = (1 << 8);
+
+  static constexpr uint32_t peer_incoming           = (1 << 0);
+  static constexpr uint32_t peer_encrypted          = (1 << 1);
+  static constexpr uint32_t peer_up_choked          = (1 << 2);
+  static constexpr uint32_t peer_up_interested      = (1 << 3);
+  static constexpr uint32_t peer_down_choked        = (1 << 4);
+  static constexpr uint32_t peer_down_interested    = (1 << 5);
+  static constexpr uint32_t peer_snubbed            = (1 << 6);
+
+  size_t              download_count() const { return hash.size(); }
+  size_t              peer_count() const     { return peer.size(); }
+
+  uint64_t              generation{0};
+
+  // Download columns.
+  std::vector<HashString> hash;
+  std::vector<uint64_t>   version;
+  std::vector<uint32_t>   flags;
+
+  std::vector<uint64_t>   down_rate;
+  std::vector<uint64_t>   up_rate;
+  std::vector<uint64_t>   skip_rate;
+  std::vector<uint64_t>   down_total;
+  std::vector<uint64_t>   up_total;
+
+  std::vector<uint64_t>   bytes_done;
+  std::vector<uint64_t>   bytes_total;
+  std::vector<uint32_t>   chunks_done;
+  std::vector<uint32_t>   chunks_total;
+
+  std::vector<uint32_t>   peers_connected;
+  std::vector<uint32_t>   peers_complete;
+  std::vector<uint32_t>   peers_unchoked;
+  std::vector<uint32_t>   peers_interested;
+  std::vector<uint32_t>   trackers;
+
+  // One more entry than there are downloads.
+  std::vector<uint32_t>   peer_first;
+
+  // Peer columns.
+  std::vector<const Peer*> peer;
+  std::vector<uint32_t>   peer_flags;
+  std::vector<uint64_t>   peer_down_rate;
+  std::vector<uint64_t>   peer_up_rate;
+  std::vector<uint64_t>   peer_rate;
+  std::vector<uint32_t>   peer_chunks_done;
+
+  // For internal usage.
+  std::vector<uint64_t>   checksum;
+};
+
+// With 'stats_skip_peers' the peer columns are left empty and only
+// the download rows are versioned.
+static constexpr int stats_skip_peers = (1 << 0);
+
+void                stats_snapshot(StatsSnapshot* snapshot, int flags = 0) LIBTORRENT_EXPORT;
+
+}
+
+#endif
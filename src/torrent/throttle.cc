@@ -105,11 +105,39 @@ Throttle::set_max_rate(uint64_t v) {
     m_ptr()->disable();
 }
 
+void
+Throttle::set_min_rate(uint64_t v) {
+  if (v > (UINT_MAX - 1))
+    throw input_error("Throttle rate must be between 0 and 4294967295.");
+
+  m_minRate = v;
+}
+
 const Rate*
 Throttle::rate() const {
   return m_throttleList->rate_slow();
 }
 
+bool
+Throttle::is_pacing() const {
+  return m_throttleList->is_pacing();
+}
+
+void
+Throttle::set_pacing(bool state) {
+  m_ptr()->set_pacing(state);
+}
+
+bool
+Throttle::is_high_resolution() const {
+  return c_ptr()->is_high_resolution();
+}
+
+void
+Throttle::set_high_resolution(bool state) {
+  m_ptr()->set_high_resolution(state);
+}
+
 uint32_t
 Throttle::calculate_min_chunk_size() const {
   // Just for each modification, make this into a function, rather
@@ -17,12 +17,34 @@ public:
 
   bool                is_throttled();
 
-  // 0 == UNLIMITED.
+  // 0 == UNLIMITED. Slaves with a max rate of 0 may use all the
+  // quota the parent can spare.
   uint64_t            max_rate() const { return m_maxRate; }
   void                set_max_rate(uint64_t v);
 
+  // The rate a slave is guaranteed before spare quota is shared with
+  // the other slaves, ignored by the root throttle.
+  uint64_t            min_rate() const { return m_minRate; }
+  void                set_min_rate(uint64_t v);
+
   const Rate*         rate() const;
 
+  // Hands each peer its share of the rate as the socket's
+  // SO_MAX_PACING_RATE, so the kernel spreads out the data instead of
+  // sending each tick's quota in a burst. Applies to the slaves, and
+  // only has an effect on upload throttles.
+  bool                is_pacing() const;
+  void                set_pacing(bool state);
+
+  // Ticks every 'high_resolution_interval' instead of every 0.1 to 1
+  // second rounded up to whole seconds, handing out smaller quotas
+  // more often for less bursty traffic at the cost of more wakeups.
+  // Only the root throttle ticks, the slaves follow it.
+  static constexpr std::chrono::microseconds high_resolution_interval{10000};
+
+  bool                is_high_resolution() const;
+  void                set_high_resolution(bool state);
+
   ThrottleList*       throttle_list()  { return m_throttleList; }
 
 protected:
@@ -37,6 +59,7 @@ protected:
   uint32_t            calculate_interval() const LIBTORRENT_NO_EXPORT;
 
   uint64_t            m_maxRate;
+  uint64_t            m_minRate{0};
 
   ThrottleList*       m_throttleList;
 };
@@ -8,14 +8,17 @@
 #include "data/hash_queue.h"
 #include "data/hash_torrent.h"
 #include "data/thread_disk.h"
+#include "dht/dht_node.h"
 #include "download/download_constructor.h"
 #include "download/download_manager.h"
+#include "download/download_prepare_queue.h"
 #include "download/download_wrapper.h"
 #include "net/thread_net.h"
 #include "protocol/handshake_manager.h"
 #include "protocol/peer_factory.h"
 #include "rak/address_info.h"
 #include "rak/string_manip.h"
+#include "torrent/chunk_manager.h"
 #include "torrent/connection_manager.h"
 #include "torrent/exceptions.h"
 #include "torrent/object.h"
@@ -23,9 +26,12 @@
 #include "torrent/throttle.h"
 #include "torrent/poll.h"
 #include "torrent/peer/connection_list.h"
+#include "torrent/peer/peer_info.h"
 #include "torrent/download/resource_manager.h"
+#include "torrent/utils/startup_profile.h"
 #include "tracker/thread_tracker.h"
 #include "utils/instrumentation.h"
+#include "utils/object_pool.h"
 
 namespace torrent {
 
@@ -68,6 +74,8 @@ initialize() {
   if (manager != NULL)
     throw internal_error("torrent::initialize(...) called but the library has already been initialized");
 
+  utils::startup_scope startup(std::string(), utils::startup_initialize);
+
   cachedTime = rak::timer::current();
 
   instrumentation_initialize();
@@ -83,6 +91,7 @@ initialize() {
   manager->connection_manager()->set_max_size(thread_main()->poll()->open_max() - maxFiles - calculate_reserved(thread_main()->poll()->open_max()));
   manager->file_manager()->set_max_open_files(maxFiles);
 
+  thread_disk()->set_disk_throttle(manager->chunk_manager()->disk_throttle());
   thread_disk()->init_thread();
   thread_net()->init_thread();
   thread_tracker()->init_thread();
@@ -130,7 +139,9 @@ ChunkManager*      chunk_manager() { return manager->chunk_manager(); }
 ClientList*        client_list() { return manager->client_list(); }
 ConnectionManager* connection_manager() { return manager->connection_manager(); }
 FileManager*       file_manager() { return manager->file_manager(); }
+MemoryManager*     memory_manager() { return manager->memory_manager(); }
 ResourceManager*   resource_manager() { return manager->resource_manager(); }
+EventJournal*      event_journal() { return manager->event_journal(); }
 
 tracker::DhtController* dht_controller() { return manager->dht_controller(); }
 
@@ -139,6 +150,32 @@ total_handshakes() {
   return manager->handshake_manager()->size();
 }
 
+static void
+metrics_insert_pool(MetricList& metrics, const char* live_name, const char* cached_name, const object_pool_stats& stats) {
+  metrics.emplace_back(live_name, stats.live);
+  metrics.emplace_back(cached_name, stats.cached);
+}
+
+MetricList
+metrics_snapshot() {
+  MetricList metrics;
+
+  metrics_insert_pool(metrics, "pool_peer_connection_live", "pool_peer_connection_cached", peer_connection_pool_stats());
+  metrics_insert_pool(metrics, "pool_protocol_base_live", "pool_protocol_base_cached", protocol_base_pool_stats());
+  metrics_insert_pool(metrics, "pool_encrypt_buffer_live", "pool_encrypt_buffer_cached", encrypt_buffer_pool_stats());
+  metrics_insert_pool(metrics, "pool_peer_info_live", "pool_peer_info_cached", object_pool<PeerInfo>::stats());
+  metrics_insert_pool(metrics, "pool_dht_node_live", "pool_dht_node_cached", object_pool<DhtNode>::stats());
+
+#ifdef LT_INSTRUMENTATION
+  auto values = instrumentation_snapshot();
+
+  for (int i = 0; i != INSTRUMENTATION_MAX_SIZE; i++)
+    metrics.emplace_back(instrumentation_name(static_cast<instrumentation_enum>(i)), values[i]);
+#endif
+
+  return metrics;
+}
+
 Throttle* down_throttle_global() { return manager->download_throttle(); }
 Throttle* up_throttle_global() { return manager->upload_throttle(); }
 
@@ -148,44 +185,89 @@ const char* version() { return VERSION; }
 
 uint32_t hash_queue_size() { return thread_main()->hash_queue()->size(); }
 
+uint32_t hash_worker_count() { return thread_disk()->hash_check_queue()->worker_count(); }
+void     set_hash_worker_count(uint32_t count) { thread_disk()->hash_check_queue()->start_workers(count); }
+
+bool disk_device_queues() { return thread_disk()->is_device_queues(); }
+void set_disk_device_queues(bool state) { thread_disk()->set_device_queues(state); }
+
+uint32_t download_hibernate_timeout() { return manager->hibernate_timeout(); }
+void     set_download_hibernate_timeout(uint32_t seconds) { manager->set_hibernate_timeout(seconds); }
+
 EncodingList*
 encoding_list() {
   return manager->encoding_list();
 }
 
-Download
-download_add(Object* object, uint32_t tracker_key) {
-  auto download = std::make_unique<DownloadWrapper>();
+DownloadPrepared::DownloadPrepared() = default;
+DownloadPrepared::DownloadPrepared(DownloadPrepared&& src) noexcept = default;
+DownloadPrepared& DownloadPrepared::operator = (DownloadPrepared&& src) noexcept = default;
+DownloadPrepared::~DownloadPrepared() = default;
 
-  DownloadConstructor ctor;
-  ctor.set_download(download.get());
-  ctor.set_encoding_list(manager->encoding_list());
+DownloadPrepared
+download_prepare(Object* object) {
+  DownloadPrepared prepared;
+  prepared.m_object = object;
 
-  ctor.initialize(*object);
+  auto start = std::chrono::steady_clock::now();
 
-  std::string infoHash;
-  if (download->info()->is_meta_download())
-    infoHash = object->get_key("info").get_key("pieces").as_string();
-  else
-    infoHash = object_sha1(&object->get_key("info"));
+  try {
+    auto download = std::make_unique<DownloadWrapper>();
 
-  if (manager->download_manager()->find(infoHash) != manager->download_manager()->end())
-    throw input_error("Info hash already used by another torrent.");
+    DownloadConstructor ctor;
+    ctor.set_download(download.get());
+    ctor.set_encoding_list(manager->encoding_list());
+
+    ctor.initialize(*object);
 
-  if (!download->info()->is_meta_download()) {
-    char buffer[1024];
-    uint64_t metadata_size = 0;
-    object_write_bencode_c(&object_write_to_size, &metadata_size, object_buffer_t(buffer, buffer + sizeof(buffer)), &object->get_key("info"));
-    download->main()->set_metadata_size(metadata_size);
+    if (download->info()->is_meta_download())
+      prepared.m_info_hash = object->get_key("info").get_key("pieces").as_string();
+    else
+      prepared.m_info_hash = object_sha1(&object->get_key("info"));
+
+    if (!download->info()->is_meta_download()) {
+      char buffer[1024];
+      object_write_bencode_c(&object_write_to_size, &prepared.m_metadata_size, object_buffer_t(buffer, buffer + sizeof(buffer)), &object->get_key("info"));
+    }
+
+    prepared.m_download = std::move(download);
+    prepared.m_parse_time = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start);
+
+  } catch (...) {
+    prepared.m_download.reset();
+    prepared.m_error = std::current_exception();
   }
 
+  return prepared;
+}
+
+Download
+download_add(DownloadPrepared prepared, uint32_t tracker_key) {
+  if (prepared.m_error != nullptr)
+    std::rethrow_exception(prepared.m_error);
+
+  if (prepared.m_download == nullptr)
+    throw input_error("Download was not prepared.");
+
+  auto& download = prepared.m_download;
+  Object* object = prepared.m_object;
+
+  if (manager->download_manager()->find(prepared.m_info_hash) != manager->download_manager()->end())
+    throw input_error("Info hash already used by another torrent.");
+
+  if (!download->info()->is_meta_download())
+    download->main()->set_metadata_size(prepared.m_metadata_size);
+
   std::string local_id = PEER_NAME + rak::generate_random<std::string>(20 - std::string(PEER_NAME).size());
 
   download->set_hash_queue(thread_main()->hash_queue());
-  download->initialize(infoHash, local_id, tracker_key);
+  download->initialize(prepared.m_info_hash, local_id, tracker_key);
 
   // Add trackers, etc, after setting the info hash so that log
   // entries look sane.
+  DownloadConstructor ctor;
+  ctor.set_download(download.get());
+  ctor.set_encoding_list(manager->encoding_list());
   ctor.parse_tracker(*object);
 
   // Default PeerConnection factory functions.
@@ -197,11 +279,36 @@ download_add(Object* object, uint32_t tracker_key) {
   manager->initialize_download(download.get());
 
   download->set_bencode(object);
+
+  utils::startup_record(prepared.m_info_hash, utils::startup_parse, prepared.m_parse_time);
+
   return Download(download.release());
 }
 
+Download
+download_add(Object* object, uint32_t tracker_key) {
+  return download_add(download_prepare(object), tracker_key);
+}
+
+void
+download_prepare_async(Object* object, slot_download_prepared slot) {
+  manager->download_prepare_queue()->push_back(object, std::move(slot));
+}
+
+uint32_t
+download_prepare_worker_count() {
+  return manager->download_prepare_queue()->worker_count();
+}
+
+void
+set_download_prepare_worker_count(uint32_t count) {
+  manager->download_prepare_queue()->start_workers(count);
+}
+
 void
 download_remove(Download d) {
+  utils::startup_erase(d.info()->hash().str());
+
   manager->cleanup_download(d.ptr());
 }
 
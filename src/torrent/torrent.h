@@ -1,8 +1,14 @@
 #ifndef LIBTORRENT_TORRENT_H
 #define LIBTORRENT_TORRENT_H
 
+#include <chrono>
+#include <exception>
+#include <functional>
 #include <list>
+#include <memory>
 #include <string>
+#include <utility>
+#include <vector>
 #include <torrent/common.h>
 #include <torrent/download.h>
 
@@ -27,8 +33,12 @@ ChunkManager*       chunk_manager() LIBTORRENT_EXPORT;
 ClientList*         client_list() LIBTORRENT_EXPORT;
 ConnectionManager*  connection_manager() LIBTORRENT_EXPORT;
 FileManager*        file_manager() LIBTORRENT_EXPORT;
+MemoryManager*      memory_manager() LIBTORRENT_EXPORT;
 ResourceManager*    resource_manager() LIBTORRENT_EXPORT;
 
+// Changes to the downloads, see torrent/download/event_journal.h.
+EventJournal*       event_journal() LIBTORRENT_EXPORT;
+
 tracker::DhtController* dht_controller() LIBTORRENT_EXPORT;
 
 uint32_t            total_handshakes() LIBTORRENT_EXPORT;
@@ -41,9 +51,32 @@ const Rate*         up_rate() LIBTORRENT_EXPORT;
 
 const char*         version() LIBTORRENT_EXPORT;
 
+// Instrumentation counters and gauges merged over all threads, named
+// like 'transfer_requests_delegated'. Counters are totals since
+// initialize(). Only the object pool gauges, e.g. 'pool_peer_info_live'
+// and 'pool_peer_info_cached', are included if built without
+// instrumentation.
+using MetricList = std::vector<std::pair<const char*, int64_t>>;
+
+MetricList          metrics_snapshot() LIBTORRENT_EXPORT;
+
 // Disk access tuning.
 uint32_t            hash_queue_size() LIBTORRENT_EXPORT;
 
+// Number of threads hashing chunks in addition to the disk thread.
+uint32_t            hash_worker_count() LIBTORRENT_EXPORT;
+void                set_hash_worker_count(uint32_t count) LIBTORRENT_EXPORT;
+
+// Give each device holding downloads a worker of its own for hashing,
+// preloading and writes, rather than sharing the disk thread.
+bool                disk_device_queues() LIBTORRENT_EXPORT;
+void                set_disk_device_queues(bool state) LIBTORRENT_EXPORT;
+
+// Seconds an active download must be without connections, handshakes
+// and transfers before it releases its chunk state, zero to disable.
+uint32_t            download_hibernate_timeout() LIBTORRENT_EXPORT;
+void                set_download_hibernate_timeout(uint32_t seconds) LIBTORRENT_EXPORT;
+
 using DList        = std::list<Download>;
 using EncodingList = std::list<std::string>;
 
@@ -61,6 +94,52 @@ EncodingList*       encoding_list() LIBTORRENT_EXPORT;
 Download            download_add(Object* s, uint32_t tracker_key) LIBTORRENT_EXPORT;
 void                download_remove(Download d) LIBTORRENT_EXPORT;
 
+// Parsing the torrent, building its file list and hashing the info
+// dictionary only touch the new download, so 'download_prepare' may
+// be called from any thread while the main thread does the cheap
+// registration in 'download_add'. The encoding list must not change
+// meanwhile. Errors are kept and rethrown by 'download_add'.
+//
+// 'download_prepare_async' prepares on a pool of worker threads and
+// calls 'slot' from the main thread as each torrent is done. Without
+// workers the torrent is prepared immediately on the calling thread,
+// and torrents still queued at 'cleanup' are dropped without calling
+// 'slot'.
+class LIBTORRENT_EXPORT DownloadPrepared {
+public:
+  DownloadPrepared();
+  DownloadPrepared(DownloadPrepared&& src) noexcept;
+  DownloadPrepared& operator = (DownloadPrepared&& src) noexcept;
+  ~DownloadPrepared();
+
+  bool                is_valid() const  { return m_download != nullptr || m_error != nullptr; }
+  bool                is_error() const  { return m_error != nullptr; }
+
+  Object*             object() const    { return m_object; }
+  const std::string&  info_hash() const { return m_info_hash; }
+
+private:
+  friend DownloadPrepared download_prepare(Object* s);
+  friend Download         download_add(DownloadPrepared prepared, uint32_t tracker_key);
+
+  Object*                          m_object{};
+  std::unique_ptr<DownloadWrapper> m_download;
+  std::string                      m_info_hash;
+  uint64_t                         m_metadata_size{};
+  std::chrono::microseconds        m_parse_time{};
+  std::exception_ptr               m_error;
+};
+
+using slot_download_prepared = std::function<void (DownloadPrepared)>;
+
+DownloadPrepared    download_prepare(Object* s) LIBTORRENT_EXPORT;
+Download            download_add(DownloadPrepared prepared, uint32_t tracker_key) LIBTORRENT_EXPORT;
+
+void                download_prepare_async(Object* s, slot_download_prepared slot) LIBTORRENT_EXPORT;
+
+uint32_t            download_prepare_worker_count() LIBTORRENT_EXPORT;
+void                set_download_prepare_worker_count(uint32_t count) LIBTORRENT_EXPORT;
+
 // Add all downloads to dlist. The client is responsible for clearing
 // it before the call.
 void                download_list(DList& dlist) LIBTORRENT_EXPORT;
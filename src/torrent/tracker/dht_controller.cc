@@ -111,6 +111,15 @@ DhtController::add_node(const std::string& host, int port) {
     m_router->add_contact(host, port);
 }
 
+bool
+DhtController::open_snapshot(const std::string& path) {
+  if (!m_router)
+    throw internal_error("DhtController::open_snapshot called but DHT not initialized.");
+
+  LT_LOG_THIS("opening snapshot (path:%s)", path.c_str());
+  return m_router->open_snapshot(path);
+}
+
 Object*
 DhtController::store_cache(Object* container) {
   if (!m_router)
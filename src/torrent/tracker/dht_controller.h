@@ -28,6 +28,18 @@ public:
     unsigned int       errors_received{};
     unsigned int       errors_caught{};
 
+    // Incoming packets dropped for exceeding the per-source quota or
+    // being malformed, and error replies withheld from sources over
+    // the soft quota.
+    unsigned int       dropped_quota{};
+    unsigned int       dropped_malformed{};
+    unsigned int       errors_suppressed{};
+
+    // DHT search statistics, latency is the average in milliseconds.
+    unsigned int       searches_completed{};
+    unsigned int       search_latency{};
+    unsigned int       announces_queued{};
+
     // DHT node info.
     unsigned int       num_nodes{};
     unsigned int       num_buckets{};
@@ -63,6 +75,11 @@ public:
   // Store DHT cache in the given container and return the container.
   Object*             store_cache(Object* container);
 
+  // Keep the routing table in a memory-mapped file that is updated as
+  // nodes change, restoring the nodes saved by the previous session.
+  // Call after initialize and before start.
+  bool                open_snapshot(const std::string& path);
+
   // Add a node by host (from a torrent file), or by address from explicit add_node
   // command or the BT PORT message.
   void                add_node(const std::string& host, int port);
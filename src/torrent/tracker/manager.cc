@@ -2,10 +2,14 @@
 
 #include "torrent/tracker/manager.h"
 
+#include <algorithm>
+#include <atomic>
 #include <cassert>
+#include <cmath>
 #include <utility>
 
 #include "src/manager.h"
+#include "tracker/tracker_udp.h"
 #include "tracker/tracker_worker.h"
 #include "torrent/exceptions.h"
 #include "torrent/download_info.h"
@@ -14,21 +18,65 @@
 #include "torrent/tracker/tracker.h"
 #include "torrent/utils/log.h"
 #include "torrent/utils/thread.h"
+#include "torrent/utils/uri_parser.h"
+#include "utils/instrumentation.h"
+#include "utils/spsc_queue.h"
 
 #define LT_LOG_TRACKER_EVENTS(log_fmt, ...)                             \
   lt_log_print_subsystem(LOG_TRACKER_EVENTS, "tracker::manager", log_fmt, __VA_ARGS__);
 
 namespace torrent::tracker {
 
+// The queue has a single producer, the thread running the tracker
+// workers. While 'overflowed' is set the producer appends to
+// 'overflow' instead, which the main thread only takes once the queue
+// is empty.
+struct Manager::EventChannel {
+  struct entry_type {
+    TrackerWorker*        worker{};
+    std::function<void()> event;
+  };
+
+  spsc_queue<entry_type>  queue{event_queue_size};
+  std::atomic<bool>       drain_scheduled{false};
+
+  std::mutex              overflow_lock;
+  std::atomic<bool>       overflowed{false};
+  std::vector<entry_type> overflow;
+  std::atomic<uint64_t>   overflows{0};
+
+  // Main thread only.
+  std::deque<entry_type>  backlog;
+};
+
 Manager::Manager(utils::Thread* main_thread, utils::Thread* tracker_thread) :
   m_main_thread(main_thread),
-  m_tracker_thread(tracker_thread) {
+  m_tracker_thread(tracker_thread),
+  m_event_channel(std::make_unique<EventChannel>()) {
 
   if (m_main_thread == nullptr)
     throw internal_error("tracker::Manager::Manager(...) main_thread is null.");
 
   if (m_tracker_thread == nullptr)
     throw internal_error("tracker::Manager::Manager(...) tracker_thread is null.");
+
+  m_task_announces.slot() = [this] { process_announces(); };
+  m_task_udp_scrapes.slot() = [this] { process_udp_scrapes(); };
+}
+
+Manager::~Manager() {
+  if (m_task_announces.is_scheduled())
+    m_task_announces.scheduler()->erase(&m_task_announces);
+
+  instrumentation_update(INSTRUMENTATION_TRACKER_ANNOUNCE_QUEUE, -static_cast<int64_t>(m_announce_queued.size()));
+
+  if (m_task_udp_scrapes.is_scheduled())
+    m_task_udp_scrapes.scheduler()->erase(&m_task_udp_scrapes);
+
+  m_main_thread->cancel_callback_and_wait(this);
+
+  collect_events();
+  instrumentation_update(INSTRUMENTATION_TRACKER_EVENT_QUEUE, -static_cast<int64_t>(m_event_channel->backlog.size()));
 }
 
 TrackerControllerWrapper
@@ -61,39 +109,335 @@ Manager::remove_controller(TrackerControllerWrapper controller) {
   if (m_controllers.erase(controller) != 1)
     throw internal_error("tracker::Manager::remove_controller(...) controller not found or has multiple references.");
 
-  for (auto& tracker : *controller.get()->tracker_list())
+  for (auto& tracker : *controller.get()->tracker_list()) {
+    erase_announce(tracker.get_worker());
     remove_events(tracker.get_worker());
+  }
 
   LT_LOG_TRACKER_EVENTS("removed controller: info_hash:%s", hash_string_to_hex_str(controller.info_hash()).c_str());
 }
 
+size_t
+Manager::size_event_queue() const {
+  std::scoped_lock lock(m_event_channel->overflow_lock);
+
+  return m_event_channel->queue.size() + m_event_channel->overflow.size() + m_event_channel->backlog.size();
+}
+
+size_t
+Manager::max_size_event_queue() const {
+  return m_event_channel->queue.max_size();
+}
+
+uint64_t
+Manager::event_queue_overflows() const {
+  return m_event_channel->overflows.load(std::memory_order_relaxed);
+}
+
+void
+Manager::set_announce_rate(double per_second) {
+  if (per_second < 0.0)
+    throw input_error("Announce rate must be zero or positive.");
+
+  m_announce_rate = per_second;
+  process_announces();
+}
+
+void
+Manager::set_announce_burst(unsigned int burst) {
+  if (burst == 0)
+    throw input_error("Announce burst must be positive.");
+
+  m_announce_burst = burst;
+  process_announces();
+}
+
+void
+Manager::set_announce_jitter(std::chrono::seconds jitter) {
+  if (jitter < 0s)
+    throw input_error("Announce jitter must be zero or positive.");
+
+  m_announce_jitter = jitter;
+}
+
 void
 Manager::send_event(tracker::Tracker& tracker, tracker::TrackerState::event_enum new_event) {
   assert(std::this_thread::get_id() == m_main_thread->thread_id());
 
-  // TODO: Currently executing in main thread, but should be in tracker thread.
-  tracker.get_worker()->send_event(new_event);
+  erase_announce(tracker.get_worker());
+
+  bool is_regular = new_event == tracker::TrackerState::EVENT_NONE;
+
+  // DHT announces don't go to a tracker host.
+  if (tracker.type() == TRACKER_DHT || (m_announce_rate == 0.0 && (!is_regular || m_announce_jitter == 0s))) {
+    // TODO: Currently executing in main thread, but should be in tracker thread.
+    tracker.get_worker()->send_event(new_event);
+    return;
+  }
+
+  auto now = this_thread::cached_time();
+  auto key = utils::uri_host_key(tracker.url());
+
+  auto [host_itr, inserted] = m_announce_hosts.try_emplace(key);
+
+  if (inserted) {
+    host_itr->second.tokens      = m_announce_burst;
+    host_itr->second.time_refill = now;
+  }
+
+  auto request = AnnounceRequest{tracker.m_worker, tracker.get_worker(), new_event};
+
+  if (!is_regular) {
+    host_itr->second.priority.push_back(std::move(request));
+  } else {
+    auto jitter = std::chrono::microseconds(m_announce_jitter).count();
+    auto time   = now + std::chrono::microseconds(jitter != 0 ? random() % jitter : 0);
+
+    host_itr->second.regular.emplace(time, std::move(request));
+  }
+
+  m_announce_queued[tracker.get_worker()] = std::move(key);
+  instrumentation_update(INSTRUMENTATION_TRACKER_ANNOUNCE_QUEUE, 1);
+
+  process_announces();
+}
+
+void
+Manager::process_announces() {
+  if (m_task_announces.is_scheduled())
+    this_thread::scheduler()->erase(&m_task_announces);
+
+  auto now  = this_thread::cached_time();
+  auto next = std::chrono::microseconds::max();
+
+  std::vector<AnnounceRequest> ready;
+
+  for (auto itr = m_announce_hosts.begin(); itr != m_announce_hosts.end();) {
+    auto& host = itr->second;
+
+    host.tokens      = std::min<double>(m_announce_burst, host.tokens + (now - host.time_refill).count() * m_announce_rate / 1e6);
+    host.time_refill = now;
+
+    while (m_announce_rate == 0.0 || host.tokens >= 1.0) {
+      if (!host.priority.empty()) {
+        ready.push_back(std::move(host.priority.front()));
+        host.priority.pop_front();
+
+      } else if (!host.regular.empty() && host.regular.begin()->first <= now) {
+        ready.push_back(std::move(host.regular.begin()->second));
+        host.regular.erase(host.regular.begin());
+
+      } else {
+        break;
+      }
+
+      if (m_announce_rate != 0.0)
+        host.tokens -= 1.0;
+    }
+
+    if (host.priority.empty() && host.regular.empty()) {
+      if (m_announce_rate == 0.0 || host.tokens >= m_announce_burst)
+        itr = m_announce_hosts.erase(itr);
+      else
+        itr++;
+
+      continue;
+    }
+
+    auto time_token = now;
+
+    if (m_announce_rate != 0.0 && host.tokens < 1.0)
+      time_token += std::chrono::microseconds(static_cast<int64_t>(std::ceil((1.0 - host.tokens) * 1e6 / m_announce_rate)));
+
+    if (host.priority.empty())
+      next = std::min(next, std::max(time_token, host.regular.begin()->first));
+    else
+      next = std::min(next, time_token);
+
+    itr++;
+  }
+
+  for (auto& request : ready) {
+    m_announce_queued.erase(request.worker_ptr);
+    instrumentation_update(INSTRUMENTATION_TRACKER_ANNOUNCE_QUEUE, -1);
+
+    auto tracker = Tracker(request.worker.lock());
+
+    if (!tracker.is_valid() || !tracker.is_usable())
+      continue;
+
+    instrumentation_update(INSTRUMENTATION_TRACKER_ANNOUNCE_SENT, 1);
+
+    tracker.get_worker()->send_event(request.event);
+  }
+
+  if (next != std::chrono::microseconds::max())
+    this_thread::scheduler()->wait_until(&m_task_announces, next);
+}
+
+void
+Manager::erase_announce(TrackerWorker* worker) {
+  auto queued_itr = m_announce_queued.find(worker);
+
+  if (queued_itr == m_announce_queued.end())
+    return;
+
+  auto host_itr = m_announce_hosts.find(queued_itr->second);
+
+  m_announce_queued.erase(queued_itr);
+  instrumentation_update(INSTRUMENTATION_TRACKER_ANNOUNCE_QUEUE, -1);
+
+  if (host_itr == m_announce_hosts.end())
+    throw internal_error("tracker::Manager::erase_announce(...) host not found.");
+
+  auto& host = host_itr->second;
+
+  auto priority_itr = std::find_if(host.priority.begin(), host.priority.end(), [worker](auto& r) { return r.worker_ptr == worker; });
+
+  if (priority_itr != host.priority.end()) {
+    host.priority.erase(priority_itr);
+    return;
+  }
+
+  auto regular_itr = std::find_if(host.regular.begin(), host.regular.end(), [worker](auto& r) { return r.second.worker_ptr == worker; });
+
+  if (regular_itr == host.regular.end())
+    throw internal_error("tracker::Manager::erase_announce(...) request not found.");
+
+  host.regular.erase(regular_itr);
 }
 
 void
 Manager::send_scrape(tracker::Tracker& tracker) {
   assert(std::this_thread::get_id() == m_main_thread->thread_id());
 
+  if (tracker.type() == TRACKER_UDP) {
+    auto& workers = m_udp_scrapes[tracker.url()];
+
+    auto itr = std::find_if(workers.begin(), workers.end(), [&tracker](const std::weak_ptr<TrackerWorker>& w) {
+        return w.lock() == tracker.m_worker;
+      });
+
+    if (itr == workers.end())
+      workers.emplace_back(tracker.m_worker);
+
+    if (!m_task_udp_scrapes.is_scheduled())
+      this_thread::scheduler()->wait_for_ceil_seconds(&m_task_udp_scrapes, udp_scrape_delay);
+
+    return;
+  }
+
   // TODO: Currently executing in main thread, but should be in tracker thread.
   tracker.get_worker()->send_scrape();
 }
 
+// Groups the queued UDP scrapes by tracker url and sends each group
+// through its first tracker, in as few requests as the packet size
+// allows.
+void
+Manager::process_udp_scrapes() {
+  assert(std::this_thread::get_id() == m_main_thread->thread_id());
+
+  auto scrapes = std::move(m_udp_scrapes);
+  m_udp_scrapes.clear();
+
+  for (auto& [url, workers] : scrapes) {
+    std::vector<std::shared_ptr<TrackerWorker>> ready;
+
+    for (auto& weak_worker : workers) {
+      auto tracker = Tracker(weak_worker.lock());
+
+      if (tracker.is_valid() && !tracker.is_busy() && tracker.is_usable())
+        ready.push_back(std::move(tracker.m_worker));
+    }
+
+    for (size_t first = 0; first < ready.size(); first += TrackerUdp::max_scrape_hashes) {
+      size_t last = std::min<size_t>(ready.size(), first + TrackerUdp::max_scrape_hashes);
+
+      TrackerUdp::scrape_batch_type batch(ready.begin() + first + 1, ready.begin() + last);
+
+      LT_LOG_TRACKER_EVENTS("sending udp scrape batch : hashes:%zu url:%s", last - first, url.c_str());
+
+      static_cast<TrackerUdp*>(ready[first].get())->send_scrape_batch(std::move(batch));
+    }
+  }
+}
+
 
 // Events are queued by the trackers and run in the main thread.
 void
 Manager::add_event(torrent::TrackerWorker* tracker_worker, std::function<void()> event) {
-  m_main_thread->callback(tracker_worker, std::move(event));
+  auto& channel = *m_event_channel;
+  auto  entry   = EventChannel::entry_type{tracker_worker, std::move(event)};
+
+  if (channel.overflowed.load(std::memory_order_acquire) || !channel.queue.try_push(std::move(entry))) {
+    std::scoped_lock lock(channel.overflow_lock);
+
+    channel.overflowed.store(true, std::memory_order_release);
+    channel.overflow.push_back(std::move(entry));
+    channel.overflows.fetch_add(1, std::memory_order_relaxed);
+
+    instrumentation_update(INSTRUMENTATION_TRACKER_EVENT_OVERFLOW, 1);
+  }
+
+  instrumentation_update(INSTRUMENTATION_TRACKER_EVENT_QUEUE, 1);
+
+  if (!channel.drain_scheduled.exchange(true))
+    m_main_thread->callback(this, [this] { process_events(); });
 }
 
 void
 Manager::remove_events(torrent::TrackerWorker* tracker_worker) {
+  collect_events();
+
+  auto& backlog = m_event_channel->backlog;
+  auto  itr     = std::remove_if(backlog.begin(), backlog.end(), [tracker_worker](auto& e) { return e.worker == tracker_worker; });
+
+  instrumentation_update(INSTRUMENTATION_TRACKER_EVENT_QUEUE, -static_cast<int64_t>(std::distance(itr, backlog.end())));
+  backlog.erase(itr, backlog.end());
+
   m_main_thread->cancel_callback_and_wait(tracker_worker);
   m_tracker_thread->cancel_callback_and_wait(tracker_worker);
 }
 
+// Moves the queued events to the backlog, taking the overflow only
+// once the queue is empty, as the producer doesn't use the queue until
+// 'overflowed' is cleared.
+void
+Manager::collect_events() {
+  auto& channel = *m_event_channel;
+
+  while (true) {
+    while (auto entry = channel.queue.try_pop())
+      channel.backlog.push_back(std::move(*entry));
+
+    std::scoped_lock lock(channel.overflow_lock);
+
+    if (!channel.queue.empty())
+      continue;
+
+    std::move(channel.overflow.begin(), channel.overflow.end(), std::back_inserter(channel.backlog));
+    channel.overflow.clear();
+    channel.overflowed.store(false, std::memory_order_release);
+    return;
+  }
+}
+
+// Events may add or remove other events while running.
+void
+Manager::process_events() {
+  auto& channel = *m_event_channel;
+
+  channel.drain_scheduled.store(false);
+  collect_events();
+
+  while (!channel.backlog.empty()) {
+    auto entry = std::move(channel.backlog.front());
+    channel.backlog.pop_front();
+
+    instrumentation_update(INSTRUMENTATION_TRACKER_EVENT_QUEUE, -1);
+    entry.event();
+  }
+}
+
 } // namespace torrent
@@ -3,10 +3,16 @@
 #ifndef LIBTORRENT_TRACKER_MANAGER_H
 #define LIBTORRENT_TRACKER_MANAGER_H
 
+#include <deque>
+#include <map>
+#include <memory>
 #include <mutex>
 #include <set>
+#include <string>
+#include <vector>
 #include <torrent/tracker/tracker.h>
 #include <torrent/tracker/wrappers.h>
+#include <torrent/utils/scheduler.h>
 
 namespace torrent {
 class Manager;
@@ -23,8 +29,43 @@ struct TrackerListEvent {
 class LIBTORRENT_EXPORT Manager {
 public:
 
+  // UDP scrapes are held back this long so requests to the same
+  // tracker from different downloads can share a packet.
+  static constexpr std::chrono::seconds udp_scrape_delay{10};
+
+  // Announces are rate limited per tracker host with a token bucket,
+  // with started, completed and stopped events sent before regular
+  // updates. Regular updates are also delayed by a random jitter so
+  // re-announce timers started together drift apart.
+  static constexpr double               default_announce_rate{5.0};
+  static constexpr unsigned int         default_announce_burst{20};
+  static constexpr std::chrono::seconds default_announce_jitter{5};
+
+  // Results from the tracker workers reach the main thread through a
+  // lock-free queue of this size, drained in batches by one callback.
+  // When it is full they spill to a locked list until the main thread
+  // catches up, keeping their order.
+  static constexpr size_t               event_queue_size{4096};
+
   Manager(utils::Thread* main_thread, utils::Thread* tracker_thread);
-  ~Manager() = default;
+  ~Manager();
+
+  // Main thread:
+
+  double               announce_rate() const   { return m_announce_rate; }
+  unsigned int         announce_burst() const  { return m_announce_burst; }
+  std::chrono::seconds announce_jitter() const { return m_announce_jitter; }
+
+  // A rate of zero disables rate limiting.
+  void                 set_announce_rate(double per_second);
+  void                 set_announce_burst(unsigned int burst);
+  void                 set_announce_jitter(std::chrono::seconds jitter);
+
+  size_t               size_announce_queue() const { return m_announce_queued.size(); }
+
+  size_t               size_event_queue() const;
+  size_t               max_size_event_queue() const;
+  uint64_t             event_queue_overflows() const;
 
 protected:
   friend class torrent::DownloadMain;
@@ -42,6 +83,7 @@ protected:
 
   // Any thread:
 
+  // Only the thread running the tracker workers may add events, and
   // remove_events() only removes events from the main thread.
   void                add_event(torrent::TrackerWorker* tracker_worker, std::function<void()> event);
   void                remove_events(torrent::TrackerWorker* tracker_worker);
@@ -50,12 +92,51 @@ private:
   Manager(const Manager&) = delete;
   Manager& operator=(const Manager&) = delete;
 
+  struct AnnounceRequest {
+    std::weak_ptr<TrackerWorker>      worker;
+    TrackerWorker*                    worker_ptr;
+    tracker::TrackerState::event_enum event;
+  };
+
+  struct AnnounceHost {
+    double                                                    tokens;
+    std::chrono::microseconds                                 time_refill;
+    std::deque<AnnounceRequest>                               priority;
+    std::multimap<std::chrono::microseconds, AnnounceRequest> regular;
+  };
+
+  void                process_announces();
+  void                erase_announce(TrackerWorker* worker);
+
+  void                process_udp_scrapes();
+
+  struct EventChannel;
+
+  // Main thread:
+  void                collect_events();
+  void                process_events();
+
   utils::Thread*      m_main_thread{nullptr};
   utils::Thread*      m_tracker_thread{nullptr};
   unsigned int        m_signal_process_events{~0u};
 
+  std::unique_ptr<EventChannel> m_event_channel;
+
   std::mutex                         m_lock;
   std::set<TrackerControllerWrapper> m_controllers;
+
+  // Main thread only:
+  double                                m_announce_rate{default_announce_rate};
+  unsigned int                          m_announce_burst{default_announce_burst};
+  std::chrono::seconds                  m_announce_jitter{default_announce_jitter};
+
+  std::map<std::string, AnnounceHost>   m_announce_hosts;
+  std::map<TrackerWorker*, std::string> m_announce_queued;
+  utils::SchedulerEntry                 m_task_announces;
+
+  // Main thread only, keyed by tracker url.
+  std::map<std::string, std::vector<std::weak_ptr<TrackerWorker>>> m_udp_scrapes;
+  utils::SchedulerEntry                                             m_task_udp_scrapes;
 };
 
 }
@@ -2,6 +2,7 @@
 #define LIBTORRENT_TRACKER_TRACKER_STATE_H
 
 #include <algorithm>
+#include <chrono>
 #include <torrent/common.h>
 
 class TrackerTest;
@@ -67,6 +68,10 @@ public:
   uint32_t            activity_time_last() const { return failed_counter() ? m_failed_time_last : m_success_time_last; }
   uint32_t            activity_time_next() const { return failed_counter() ? failed_time_next() : success_time_next(); }
 
+  // Smoothed time from sending an announce to its response, zero
+  // until the first response.
+  std::chrono::microseconds latency() const      { return m_latency; }
+
   uint32_t            scrape_time_last() const   { return m_scrape_time_last; }
   uint32_t            scrape_counter() const     { return m_scrape_counter; }
 
@@ -91,6 +96,8 @@ protected:
 
   void                inc_request_counter();
 
+  void                update_latency(std::chrono::microseconds now);
+
   int                 m_flags;
 
   uint32_t            m_normal_interval{0};
@@ -106,6 +113,10 @@ protected:
   uint32_t            m_failed_time_last{0};
   uint32_t            m_failed_counter{0};
 
+  std::chrono::microseconds m_request_time{};
+  bool                m_request_pending{false};
+  std::chrono::microseconds m_latency{};
+
   uint32_t            m_scrape_time_last{0};
   uint32_t            m_scrape_counter{0};
 
@@ -148,6 +159,20 @@ TrackerState::clear_stats() {
   m_scrape_counter = 0;
 }
 
+inline void
+TrackerState::update_latency(std::chrono::microseconds now) {
+  if (!m_request_pending)
+    return;
+
+  auto sample = std::max(now - m_request_time, std::chrono::microseconds(1));
+  m_request_pending = false;
+
+  if (m_latency == std::chrono::microseconds{})
+    m_latency = sample;
+  else
+    m_latency = (m_latency * 3 + sample) / 4;
+}
+
 inline void
 TrackerState::set_normal_interval(int v) {
   m_normal_interval = std::min(std::max(min_normal_interval, v), max_normal_interval);
@@ -18,7 +18,7 @@ class LIBTORRENT_EXPORT TrackerControllerWrapper {
 public:
   using ptr_type          = std::shared_ptr<TrackerController>;
   using slot_string       = std::function<void(const std::string&)>;
-  using slot_address_list = std::function<uint32_t(AddressList*)>;
+  using slot_address_list = std::function<uint32_t(const Tracker&, AddressList*)>;
 
   TrackerControllerWrapper() = default;
   TrackerControllerWrapper(const HashString& info_hash, std::shared_ptr<TrackerController>&& controller);
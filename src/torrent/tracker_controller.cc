@@ -171,7 +171,7 @@ TrackerController::send_start_event() {
       break;
     }
 
-    m_tracker_list->send_event(tracker, tracker::TrackerState::EVENT_STARTED);
+    m_tracker_list->send_event_race(tracker, tracker::TrackerState::EVENT_STARTED);
     found_usable = true;
   }
 }
@@ -253,7 +253,7 @@ TrackerController::send_update_event() {
     if (!tracker.is_usable())
       continue;
 
-    m_tracker_list->send_event(tracker, tracker::TrackerState::EVENT_NONE);
+    m_tracker_list->send_event_race(tracker, tracker::TrackerState::EVENT_NONE);
     break;
   }
 }
@@ -475,7 +475,7 @@ TrackerController::do_timeout() {
       }
 
       if (preferred != group_end)
-        m_tracker_list->send_event(*preferred, send_event);
+        m_tracker_list->send_event_race(*preferred, send_event);
 
       itr = group_end;
     }
@@ -496,7 +496,7 @@ TrackerController::do_timeout() {
     int32_t next_timeout = tracker_state.activity_time_next();
 
     if (next_timeout <= cachedTime.seconds())
-      m_tracker_list->send_event(*itr, send_event);
+      m_tracker_list->send_event_race(*itr, send_event);
     else
       update_timeout(next_timeout - cachedTime.seconds());
   }
@@ -535,7 +535,7 @@ TrackerController::do_scrape() {
 uint32_t
 TrackerController::receive_success(const tracker::Tracker& tracker, TrackerController::address_list* l) {
   if (!(m_flags & flag_active))
-    return m_slot_success(l);
+    return m_slot_success(tracker, l);
 
   // if (<check if we have multiple trackers to send this event to, before we declare success>) {
   m_flags &= ~(mask_send | flag_promiscuous_mode | flag_failure_mode);
@@ -559,7 +559,7 @@ TrackerController::receive_success(const tracker::Tracker& tracker, TrackerContr
     update_timeout(normal_interval);
   }
 
-  return m_slot_success(l);
+  return m_slot_success(tracker, l);
 }
 
 void
@@ -25,7 +25,7 @@ public:
 
   using slot_void         = std::function<void(void)>;
   using slot_string       = std::function<void(const std::string&)>;
-  using slot_address_list = std::function<uint32_t(AddressList*)>;
+  using slot_address_list = std::function<uint32_t(const tracker::Tracker&, AddressList*)>;
   using slot_tracker      = std::function<void(const tracker::Tracker&)>;
 
   static constexpr int flag_send_update      = 0x1;
@@ -65,6 +65,8 @@ void
 TrackerList::close_all_excluding(int event_bitmap) {
   LT_LOG("closing all trackers with event bitmap: 0x%x", event_bitmap);
 
+  m_race.clear();
+
   for (auto tracker : *this) {
     if ((event_bitmap & (1 << tracker.state().latest_event())))
       continue;
@@ -85,6 +87,8 @@ TrackerList::disown_all_including(int event_bitmap) {
 
 void
 TrackerList::clear() {
+  m_race.clear();
+
   // Make sure the tracker_list is cleared before the trackers are deleted.
   auto list = std::move(*static_cast<base_type*>(this));
 }
@@ -116,6 +120,76 @@ TrackerList::send_event(tracker::Tracker& tracker, tracker::TrackerState::event_
   thread_tracker()->tracker_manager()->send_event(tracker, event);
 }
 
+void
+TrackerList::send_event_race(tracker::Tracker& tracker, tracker::TrackerState::event_enum new_event) {
+  uint32_t group = tracker.group();
+
+  m_race.erase(std::remove_if(m_race.begin(), m_race.end(), [group](auto& t) { return t.group() == group; }), m_race.end());
+
+  send_event(tracker, new_event);
+
+  if (m_race_size <= 1 || !tracker.is_usable())
+    return;
+
+  std::vector<std::pair<std::chrono::microseconds, iterator>> candidates;
+
+  for (auto itr = begin_group(group), last = end_group(group); itr != last; itr++) {
+    if (*itr == tracker || !itr->is_usable() || !itr->can_request_state())
+      continue;
+
+    auto state = itr->state();
+
+    if (state.failed_counter() != 0 && state.failed_time_next() > static_cast<uint32_t>(cachedTime.seconds()))
+      continue;
+
+    candidates.emplace_back(state.latency(), itr);
+  }
+
+  std::stable_sort(candidates.begin(), candidates.end(), [](const auto& a, const auto& b) { return a.first < b.first; });
+
+  if (candidates.size() > m_race_size - 1)
+    candidates.resize(m_race_size - 1);
+
+  m_race.push_back(tracker);
+
+  for (auto& candidate : candidates) {
+    LT_LOG("racing %s : requester:%p url:%s",
+           option_as_string(OPTION_TRACKER_EVENT, new_event), candidate.second->get_worker(), candidate.second->url().c_str());
+
+    send_event(*candidate.second, new_event);
+    m_race.push_back(*candidate.second);
+  }
+}
+
+void
+TrackerList::set_race_size(uint32_t n) {
+  if (n == 0)
+    throw input_error("Tracker race size must be at least one.");
+
+  m_race_size = n;
+}
+
+void
+TrackerList::cancel_race(const tracker::Tracker& winner) {
+  uint32_t group = winner.group();
+  auto     race_end = std::partition(m_race.begin(), m_race.end(), [group](auto& t) { return t.group() != group; });
+
+  base_type race(std::make_move_iterator(race_end), std::make_move_iterator(m_race.end()));
+  m_race.erase(race_end, m_race.end());
+
+  for (auto& tracker : race) {
+    if (tracker == winner)
+      continue;
+
+    LT_LOG("cancelling race : requester:%p url:%s", tracker.get_worker(), tracker.url().c_str());
+
+    thread_tracker()->tracker_manager()->erase_announce(tracker.get_worker());
+
+    if (tracker.is_busy_not_scrape())
+      tracker.get_worker()->close();
+  }
+}
+
 void
 TrackerList::send_scrape(tracker::Tracker& tracker) {
   if (!tracker.is_valid())
@@ -408,6 +482,9 @@ TrackerList::receive_success(tracker::Tracker&& tracker, AddressList* l) {
   if (tracker.is_busy())
     throw internal_error("TrackerList::receive_success(...) called but the tracker is still busy.");
 
+  if (std::find(m_race.begin(), m_race.end(), tracker) != m_race.end())
+    cancel_race(tracker);
+
   // Promote the tracker to the front of the group since it was
   // successfull.
   promote(itr);
@@ -419,6 +496,7 @@ TrackerList::receive_success(tracker::Tracker&& tracker, AddressList* l) {
 
   {
     auto guard = tracker.get_worker()->lock_guard();
+    tracker.get_worker()->state().update_latency(this_thread::cached_time());
     tracker.get_worker()->state().m_success_time_last = cachedTime.seconds();
     tracker.get_worker()->state().m_success_counter++;
     tracker.get_worker()->state().m_failed_counter = 0;
@@ -451,10 +529,13 @@ TrackerList::receive_failed(tracker::Tracker&& tracker, const std::string& msg)
 
   {
     auto guard = tracker.get_worker()->lock_guard();
+    tracker.get_worker()->state().update_latency(this_thread::cached_time());
     tracker.get_worker()->state().m_failed_time_last = cachedTime.seconds();
     tracker.get_worker()->state().m_failed_counter++;
   }
 
+  m_race.erase(std::remove(m_race.begin(), m_race.end(), tracker), m_race.end());
+
   if (m_slot_failed)
     m_slot_failed(tracker, msg);
 }
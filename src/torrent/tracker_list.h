@@ -76,6 +76,16 @@ public:
 
   void                send_scrape(tracker::Tracker& tracker);
 
+  // Also sends the event to the race_size() - 1 other trackers of the
+  // group with the lowest latency that may be requested, trackers
+  // without a measured latency first. The first success cancels the
+  // remaining requests of the race, and a race size of one disables
+  // racing.
+  void                send_event_race(tracker::Tracker& tracker, tracker::TrackerState::event_enum new_event);
+
+  uint32_t            race_size() const                       { return m_race_size; }
+  void                set_race_size(uint32_t n);
+
   DownloadInfo*       info()                                  { return m_info; }
   int                 state()                                 { return m_state; }
   uint32_t            key() const                             { return m_key; }
@@ -126,6 +136,8 @@ protected:
   void                set_key(uint32_t k)                     { m_key = k; }
 
 private:
+  void                cancel_race(const tracker::Tracker& winner);
+
   DownloadInfo*       m_info{nullptr};
   int                 m_state;
 
@@ -133,6 +145,9 @@ private:
   uint32_t            m_key{0};
   int32_t             m_numwant{-1};
 
+  uint32_t            m_race_size{1};
+  base_type           m_race;
+
   slot_address_list   m_slot_success;
   slot_string         m_slot_failed;
 
@@ -0,0 +1,284 @@
+#ifndef LIBTORRENT_UTILS_FLAT_MAP_H
+#define LIBTORRENT_UTILS_FLAT_MAP_H
+
+#include <algorithm>
+#include <functional>
+#include <memory>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+namespace torrent {
+
+// Sorted vector with the interface of std::map, for small dictionaries
+// that are mostly built in key order and then looked up, such as
+// bencode dictionaries.
+//
+// Unlike std::map, inserting or erasing invalidates iterators and
+// references to other elements, and value_type has a non-const key
+// which must not be modified through an iterator.
+//
+// Lookups accept any type comparable with the key.
+
+template <typename Key, typename T, typename Allocator = std::allocator<std::pair<Key, T>>>
+class flat_map {
+public:
+  using key_type        = Key;
+  using mapped_type     = T;
+  using value_type      = std::pair<Key, T>;
+  using key_compare     = std::less<>;
+  using allocator_type  = Allocator;
+
+  using container_type  = std::vector<value_type, allocator_type>;
+
+  using size_type       = typename container_type::size_type;
+  using difference_type = typename container_type::difference_type;
+  using reference       = value_type&;
+  using const_reference = const value_type&;
+
+  using iterator               = typename container_type::iterator;
+  using const_iterator         = typename container_type::const_iterator;
+  using reverse_iterator       = typename container_type::reverse_iterator;
+  using const_reverse_iterator = typename container_type::const_reverse_iterator;
+
+  flat_map() = default;
+  explicit flat_map(const allocator_type& alloc) : m_values(alloc) {}
+
+  flat_map(const flat_map& src) = default;
+  flat_map(const flat_map& src, const allocator_type& alloc) : m_values(src.m_values, alloc) {}
+  flat_map(flat_map&& src) noexcept = default;
+  flat_map(flat_map&& src, const allocator_type& alloc) : m_values(std::move(src.m_values), alloc) {}
+
+  flat_map& operator=(const flat_map& src) = default;
+  flat_map& operator=(flat_map&& src) = default;
+
+  allocator_type      get_allocator() const     { return m_values.get_allocator(); }
+
+  iterator            begin()                   { return m_values.begin(); }
+  const_iterator      begin() const             { return m_values.begin(); }
+  const_iterator      cbegin() const            { return m_values.cbegin(); }
+  iterator            end()                     { return m_values.end(); }
+  const_iterator      end() const               { return m_values.end(); }
+  const_iterator      cend() const              { return m_values.cend(); }
+
+  reverse_iterator       rbegin()               { return m_values.rbegin(); }
+  const_reverse_iterator rbegin() const         { return m_values.rbegin(); }
+  reverse_iterator       rend()                 { return m_values.rend(); }
+  const_reverse_iterator rend() const           { return m_values.rend(); }
+
+  bool                empty() const             { return m_values.empty(); }
+  size_type           size() const              { return m_values.size(); }
+  size_type           max_size() const          { return m_values.max_size(); }
+
+  void                clear()                   { m_values.clear(); }
+  void                reserve(size_type n)      { m_values.reserve(n); }
+  void                swap(flat_map& other)     { m_values.swap(other.m_values); }
+
+  key_compare         key_comp() const          { return key_compare(); }
+
+  template <typename K> iterator       lower_bound(const K& key);
+  template <typename K> const_iterator lower_bound(const K& key) const;
+  template <typename K> iterator       upper_bound(const K& key);
+  template <typename K> const_iterator upper_bound(const K& key) const;
+
+  template <typename K> iterator       find(const K& key);
+  template <typename K> const_iterator find(const K& key) const;
+
+  template <typename K> size_type      count(const K& key) const    { return find(key) != end(); }
+  template <typename K> bool           contains(const K& key) const { return find(key) != end(); }
+
+  T&                  at(const Key& key);
+  const T&            at(const Key& key) const;
+
+  T&                  operator [] (const Key& key)                  { return try_emplace(key).first->second; }
+  T&                  operator [] (Key&& key)                       { return try_emplace(std::move(key)).first->second; }
+
+  std::pair<iterator, bool> insert(const value_type& value)         { return try_emplace(value.first, value.second); }
+  std::pair<iterator, bool> insert(value_type&& value)              { return try_emplace(std::move(value.first), std::move(value.second)); }
+
+  iterator            insert(const_iterator hint, const value_type& value);
+  iterator            insert(const_iterator hint, value_type&& value);
+
+  template <typename InputIterator>
+  void                insert(InputIterator first, InputIterator last);
+
+  template <typename... Args>
+  std::pair<iterator, bool> emplace(Args&&... args)                 { return insert(value_type(std::forward<Args>(args)...)); }
+
+  template <typename K, typename... Args>
+  std::pair<iterator, bool> try_emplace(K&& key, Args&&... args);
+
+  template <typename K, typename M>
+  std::pair<iterator, bool> insert_or_assign(K&& key, M&& obj);
+
+  iterator            erase(const_iterator pos)                     { return m_values.erase(pos); }
+  iterator            erase(const_iterator first, const_iterator last) { return m_values.erase(first, last); }
+  size_type           erase(const Key& key);
+
+  bool operator == (const flat_map& rhs) const { return m_values == rhs.m_values; }
+  bool operator != (const flat_map& rhs) const { return m_values != rhs.m_values; }
+
+private:
+  struct compare_key {
+    template <typename K> bool operator () (const value_type& value, const K& key) const { return key_compare()(value.first, key); }
+    template <typename K> bool operator () (const K& key, const value_type& value) const { return key_compare()(key, value.first); }
+  };
+
+  bool                is_hint_valid(const_iterator hint, const Key& key) const;
+
+  container_type      m_values;
+};
+
+template <typename Key, typename T, typename Allocator>
+template <typename K>
+inline typename flat_map<Key, T, Allocator>::iterator
+flat_map<Key, T, Allocator>::lower_bound(const K& key) {
+  return std::lower_bound(m_values.begin(), m_values.end(), key, compare_key());
+}
+
+template <typename Key, typename T, typename Allocator>
+template <typename K>
+inline typename flat_map<Key, T, Allocator>::const_iterator
+flat_map<Key, T, Allocator>::lower_bound(const K& key) const {
+  return std::lower_bound(m_values.begin(), m_values.end(), key, compare_key());
+}
+
+template <typename Key, typename T, typename Allocator>
+template <typename K>
+inline typename flat_map<Key, T, Allocator>::iterator
+flat_map<Key, T, Allocator>::upper_bound(const K& key) {
+  return std::upper_bound(m_values.begin(), m_values.end(), key, compare_key());
+}
+
+template <typename Key, typename T, typename Allocator>
+template <typename K>
+inline typename flat_map<Key, T, Allocator>::const_iterator
+flat_map<Key, T, Allocator>::upper_bound(const K& key) const {
+  return std::upper_bound(m_values.begin(), m_values.end(), key, compare_key());
+}
+
+template <typename Key, typename T, typename Allocator>
+template <typename K>
+inline typename flat_map<Key, T, Allocator>::iterator
+flat_map<Key, T, Allocator>::find(const K& key) {
+  auto itr = lower_bound(key);
+
+  return itr != end() && !key_compare()(key, itr->first) ? itr : end();
+}
+
+template <typename Key, typename T, typename Allocator>
+template <typename K>
+inline typename flat_map<Key, T, Allocator>::const_iterator
+flat_map<Key, T, Allocator>::find(const K& key) const {
+  auto itr = lower_bound(key);
+
+  return itr != end() && !key_compare()(key, itr->first) ? itr : end();
+}
+
+template <typename Key, typename T, typename Allocator>
+inline T&
+flat_map<Key, T, Allocator>::at(const Key& key) {
+  auto itr = find(key);
+
+  if (itr == end())
+    throw std::out_of_range("flat_map::at");
+
+  return itr->second;
+}
+
+template <typename Key, typename T, typename Allocator>
+inline const T&
+flat_map<Key, T, Allocator>::at(const Key& key) const {
+  auto itr = find(key);
+
+  if (itr == end())
+    throw std::out_of_range("flat_map::at");
+
+  return itr->second;
+}
+
+// Keys arriving in order, as when reading bencode, are appended
+// without a search.
+template <typename Key, typename T, typename Allocator>
+template <typename K, typename... Args>
+inline std::pair<typename flat_map<Key, T, Allocator>::iterator, bool>
+flat_map<Key, T, Allocator>::try_emplace(K&& key, Args&&... args) {
+  if (m_values.empty() || key_compare()(m_values.back().first, key)) {
+    m_values.emplace_back(std::piecewise_construct,
+                          std::forward_as_tuple(std::forward<K>(key)),
+                          std::forward_as_tuple(std::forward<Args>(args)...));
+    return std::make_pair(std::prev(m_values.end()), true);
+  }
+
+  auto itr = lower_bound(key);
+
+  if (itr != end() && !key_compare()(key, itr->first))
+    return std::make_pair(itr, false);
+
+  itr = m_values.emplace(itr, std::piecewise_construct,
+                         std::forward_as_tuple(std::forward<K>(key)),
+                         std::forward_as_tuple(std::forward<Args>(args)...));
+  return std::make_pair(itr, true);
+}
+
+template <typename Key, typename T, typename Allocator>
+template <typename K, typename M>
+inline std::pair<typename flat_map<Key, T, Allocator>::iterator, bool>
+flat_map<Key, T, Allocator>::insert_or_assign(K&& key, M&& obj) {
+  auto result = try_emplace(std::forward<K>(key), std::forward<M>(obj));
+
+  if (!result.second)
+    result.first->second = std::forward<M>(obj);
+
+  return result;
+}
+
+template <typename Key, typename T, typename Allocator>
+inline bool
+flat_map<Key, T, Allocator>::is_hint_valid(const_iterator hint, const Key& key) const {
+  return
+    (hint == end() || key_compare()(key, hint->first)) &&
+    (hint == begin() || key_compare()(std::prev(hint)->first, key));
+}
+
+template <typename Key, typename T, typename Allocator>
+inline typename flat_map<Key, T, Allocator>::iterator
+flat_map<Key, T, Allocator>::insert(const_iterator hint, const value_type& value) {
+  if (!is_hint_valid(hint, value.first))
+    return insert(value).first;
+
+  return m_values.insert(hint, value);
+}
+
+template <typename Key, typename T, typename Allocator>
+inline typename flat_map<Key, T, Allocator>::iterator
+flat_map<Key, T, Allocator>::insert(const_iterator hint, value_type&& value) {
+  if (!is_hint_valid(hint, value.first))
+    return insert(std::move(value)).first;
+
+  return m_values.insert(hint, std::move(value));
+}
+
+template <typename Key, typename T, typename Allocator>
+template <typename InputIterator>
+inline void
+flat_map<Key, T, Allocator>::insert(InputIterator first, InputIterator last) {
+  for (; first != last; ++first)
+    insert(*first);
+}
+
+template <typename Key, typename T, typename Allocator>
+inline typename flat_map<Key, T, Allocator>::size_type
+flat_map<Key, T, Allocator>::erase(const Key& key) {
+  auto itr = find(key);
+
+  if (itr == end())
+    return 0;
+
+  m_values.erase(itr);
+  return 1;
+}
+
+}
+
+#endif
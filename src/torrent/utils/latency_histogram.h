@@ -0,0 +1,85 @@
+#ifndef LIBTORRENT_UTILS_LATENCY_HISTOGRAM_H
+#define LIBTORRENT_UTILS_LATENCY_HISTOGRAM_H
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cinttypes>
+
+namespace torrent::utils {
+
+// Power of two buckets in milliseconds. Bucket 0 holds latencies below
+// 1ms, bucket 'n' those in [2^(n-1), 2^n) ms, and the last bucket
+// everything above that.
+
+class latency_histogram {
+public:
+  static constexpr unsigned int bucket_count = 16;
+
+  uint64_t                  count(unsigned int bucket) const { return m_buckets.at(bucket); }
+  uint64_t                  total_count() const              { return m_total_count; }
+
+  std::chrono::microseconds total() const                    { return m_total; }
+  std::chrono::microseconds max() const                      { return m_max; }
+  std::chrono::microseconds average() const;
+
+  // Exclusive upper bound of the bucket, the last bucket has none.
+  static std::chrono::milliseconds bucket_limit(unsigned int bucket) { return std::chrono::milliseconds(uint64_t(1) << bucket); }
+  static unsigned int              bucket_index(std::chrono::microseconds latency);
+
+  void                      insert(std::chrono::microseconds latency);
+  void                      merge(const latency_histogram& other);
+  void                      clear()                          { *this = latency_histogram(); }
+
+private:
+  std::array<uint64_t, bucket_count> m_buckets{};
+
+  uint64_t                  m_total_count{0};
+  std::chrono::microseconds m_total{0};
+  std::chrono::microseconds m_max{0};
+};
+
+inline unsigned int
+latency_histogram::bucket_index(std::chrono::microseconds latency) {
+  auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(latency).count();
+  unsigned int index = 0;
+
+  while (ms > 0 && index < bucket_count - 1) {
+    ms >>= 1;
+    index++;
+  }
+
+  return index;
+}
+
+inline std::chrono::microseconds
+latency_histogram::average() const {
+  if (m_total_count == 0)
+    return std::chrono::microseconds{0};
+
+  return m_total / static_cast<int64_t>(m_total_count);
+}
+
+inline void
+latency_histogram::insert(std::chrono::microseconds latency) {
+  latency = std::max(latency, std::chrono::microseconds(0));
+
+  m_buckets[bucket_index(latency)]++;
+  m_total_count++;
+  m_total += latency;
+  m_max = std::max(m_max, latency);
+}
+
+inline void
+latency_histogram::merge(const latency_histogram& other) {
+  for (unsigned int i = 0; i < bucket_count; i++)
+    m_buckets[i] += other.m_buckets[i];
+
+  m_total_count += other.m_total_count;
+  m_total += other.m_total;
+  m_max = std::max(m_max, other.m_max);
+}
+
+}
+
+#endif // LIBTORRENT_UTILS_LATENCY_HISTOGRAM_H
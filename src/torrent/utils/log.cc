@@ -12,10 +12,14 @@
 #include <zlib.h>
 
 #include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstring>
 #include <fstream>
 #include <functional>
 #include <memory>
 #include <mutex>
+#include <thread>
 
 #define GROUPFMT (group >= LOG_NON_CASCADING) ? ("%" PRIi32 " ") : ("%" PRIi32 " %c ")
 
@@ -45,6 +49,87 @@ struct log_gz_output {
   std::unique_ptr<gzFile_s, decltype(&gzclose)> gz_file;
 };
 
+// Single producer, single consumer ring of formatted messages. The
+// owning thread pushes while the consumer holds log_mutex. Positions
+// are free-running and each record is a header followed by the
+// nul-terminated message, padded to the header alignment. A record
+// that would wrap is preceded by a padding record.
+class log_ring {
+public:
+  static constexpr uint32_t size_data = 1 << 16;
+
+  bool                push(int group, const char* data, uint32_t length);
+
+  template <typename Func>
+  void                drain(Func func);
+
+private:
+  struct header_type {
+    uint32_t          length;
+    int32_t           group;
+  };
+
+  static constexpr uint32_t length_padding = ~uint32_t();
+
+  static uint32_t     record_size(uint32_t length) { return (sizeof(header_type) + length + 1 + sizeof(header_type) - 1) & ~uint32_t(sizeof(header_type) - 1); }
+
+  std::atomic<uint32_t> m_head{0};
+  std::atomic<uint32_t> m_tail{0};
+
+  alignas(header_type) char m_data[size_data];
+};
+
+bool
+log_ring::push(int group, const char* data, uint32_t length) {
+  uint32_t head = m_head.load(std::memory_order_relaxed);
+  uint32_t used = head - m_tail.load(std::memory_order_acquire);
+  uint32_t size = record_size(length);
+  uint32_t pos = head % size_data;
+  uint32_t padding = pos + size > size_data ? size_data - pos : 0;
+
+  if (used + padding + size > size_data)
+    return false;
+
+  if (padding != 0) {
+    header_type header{length_padding, 0};
+    std::memcpy(m_data + pos, &header, sizeof(header));
+
+    head += padding;
+    pos = 0;
+  }
+
+  header_type header{length, group};
+  std::memcpy(m_data + pos, &header, sizeof(header));
+  std::memcpy(m_data + pos + sizeof(header), data, length);
+  m_data[pos + sizeof(header) + length] = '\0';
+
+  m_head.store(head + size, std::memory_order_release);
+  return true;
+}
+
+template <typename Func>
+void
+log_ring::drain(Func func) {
+  uint32_t tail = m_tail.load(std::memory_order_relaxed);
+  uint32_t head = m_head.load(std::memory_order_acquire);
+
+  while (tail != head) {
+    uint32_t pos = tail % size_data;
+    header_type header;
+    std::memcpy(&header, m_data + pos, sizeof(header));
+
+    if (header.length == length_padding) {
+      tail += size_data - pos;
+      continue;
+    }
+
+    func(header.group, m_data + pos + sizeof(header), header.length);
+    tail += record_size(header.length);
+  }
+
+  m_tail.store(tail, std::memory_order_release);
+}
+
 using log_cache_list  = std::vector<log_cache_entry>;
 using log_child_list  = std::vector<std::pair<int, int>>;
 using log_slot_list   = std::vector<log_slot>;
@@ -56,6 +141,18 @@ log_cache_list  log_cache;
 log_group_list  log_groups;
 std::mutex      log_mutex;
 
+// The rings of threads that have logged while deferred, a ring is
+// removed once its thread has exited and it has been drained.
+std::vector<std::shared_ptr<log_ring>> log_rings;
+std::mutex                             log_rings_mutex;
+thread_local std::shared_ptr<log_ring> log_ring_local;
+
+std::atomic<bool>       log_deferred{false};
+std::thread             log_writer;
+std::mutex              log_writer_mutex;
+std::condition_variable log_writer_cv;
+bool                    log_writer_stop{false};
+
 const char log_level_char[] = { 'C', 'E', 'W', 'N', 'I', 'D' };
 
 // Removing logs always triggers a check if we got any un-used
@@ -125,6 +222,61 @@ log_rebuild_cache() {
   }
 }
 
+// Must be called with log_mutex held.
+void
+log_drain_ring(log_ring* ring) {
+  ring->drain([](int group, const char* data, uint32_t length) {
+    log_groups[group].internal_write(data, length, NULL, 0);
+  });
+}
+
+void
+log_drain_rings() {
+  auto lock = std::scoped_lock(log_rings_mutex);
+
+  for (auto& ring : log_rings)
+    log_drain_ring(ring.get());
+
+  log_rings.erase(std::remove_if(log_rings.begin(), log_rings.end(), [](auto& ring) { return ring.use_count() == 1; }),
+                  log_rings.end());
+}
+
+log_ring*
+log_ring_for_thread() {
+  if (log_ring_local == nullptr) {
+    log_ring_local = std::make_shared<log_ring>();
+
+    auto lock = std::scoped_lock(log_rings_mutex);
+    log_rings.push_back(log_ring_local);
+  }
+
+  return log_ring_local.get();
+}
+
+void
+log_writer_run() {
+  auto lock = std::unique_lock(log_writer_mutex);
+
+  while (!log_writer_stop) {
+    log_writer_cv.wait_for(lock, std::chrono::milliseconds(10));
+
+    auto log_lock = std::scoped_lock(log_mutex);
+    log_drain_rings();
+  }
+}
+
+void
+log_group::internal_write(const char* data, size_t length, const void* dump_data, size_t dump_size) {
+  std::for_each(m_first, m_last, [this, data, length](const auto& elem) {
+    return elem(data, length, std::distance(log_groups.begin(), this));
+  });
+  if (dump_data != NULL) {
+    std::for_each(m_first, m_last, [dump_data, dump_size](const auto& log) {
+      return log(static_cast<const char*>(dump_data), dump_size, -1);
+    });
+  }
+}
+
 void
 log_group::internal_print(const HashString* hash, const char* subsystem, const void* dump_data, size_t dump_size, const char* fmt, ...) {
   va_list ap;
@@ -149,16 +301,57 @@ log_group::internal_print(const HashString* hash, const char* subsystem, const v
   if (count <= 0)
     return;
 
+  if (!log_deferred.load(std::memory_order_relaxed)) {
+    auto lock = std::scoped_lock(log_mutex);
+    internal_write(buffer, std::distance(buffer, first), dump_data, dump_size);
+    return;
+  }
+
+  log_ring* ring = log_ring_for_thread();
+
+  if (dump_data == NULL && ring->push(std::distance(log_groups.begin(), this), buffer, std::distance(buffer, first)))
+    return;
+
   auto lock = std::scoped_lock(log_mutex);
 
-  std::for_each(m_first, m_last, [this, &buffer, first](const auto& elem) {
-    return elem(buffer, std::distance(buffer, first), std::distance(log_groups.begin(), this));
-  });
-  if (dump_data != NULL) {
-    std::for_each(m_first, m_last, [dump_data, dump_size](const auto& log) {
-      return log(static_cast<const char*>(dump_data), dump_size, -1);
-    });
+  log_drain_ring(ring);
+  internal_write(buffer, std::distance(buffer, first), dump_data, dump_size);
+}
+
+bool
+log_is_deferred() {
+  return log_deferred;
+}
+
+void
+log_set_deferred(bool deferred) {
+  if (deferred == log_deferred)
+    return;
+
+  if (deferred) {
+    log_writer_stop = false;
+    log_writer = std::thread(&log_writer_run);
+    log_deferred = true;
+    return;
+  }
+
+  log_deferred = false;
+
+  {
+    auto lock = std::scoped_lock(log_writer_mutex);
+    log_writer_stop = true;
   }
+
+  log_writer_cv.notify_one();
+  log_writer.join();
+
+  log_flush();
+}
+
+void
+log_flush() {
+  auto lock = std::scoped_lock(log_mutex);
+  log_drain_rings();
 }
 
 #define LOG_CASCADE(parent) LOG_CHILDREN_CASCADE(parent, parent)
@@ -204,6 +397,7 @@ log_initialize() {
   LOG_LINK(LOG_CONNECTION, LOG_CONNECTION_FILTER);
   LOG_LINK(LOG_CONNECTION, LOG_CONNECTION_HANDSHAKE);
   LOG_LINK(LOG_CONNECTION, LOG_CONNECTION_LISTEN);
+  LOG_LINK(LOG_CONNECTION, LOG_CONNECTION_UTP);
 
   LOG_LINK(LOG_DHT_ALL, LOG_DHT_MANAGER);
   LOG_LINK(LOG_DHT_ALL, LOG_DHT_NODE);
@@ -217,6 +411,8 @@ log_initialize() {
 
 void
 log_cleanup() {
+  log_set_deferred(false);
+
   auto lock = std::scoped_lock(log_mutex);
 
   std::fill(log_groups.begin(), log_groups.end(), log_group());
@@ -247,6 +443,9 @@ log_open_output(const char* name, const log_slot& slot) {
     throw input_error("Cannot open more than 64 log output handlers.");
   }
 
+  // Queued messages are written to the outputs they were logged for.
+  log_drain_rings();
+
   auto itr = log_find_output_name(name);
 
   if (itr == log_outputs.end()) {
@@ -264,6 +463,8 @@ void
 log_close_output(const char* name) {
   auto lock = std::scoped_lock(log_mutex);
 
+  log_drain_rings();
+
   auto itr = log_find_output_name(name);
 
   if (itr != log_outputs.end())
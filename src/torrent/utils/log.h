@@ -78,6 +78,7 @@ enum {
   LOG_CONNECTION_FILTER,
   LOG_CONNECTION_HANDSHAKE,
   LOG_CONNECTION_LISTEN,
+  LOG_CONNECTION_UTP,
 
   // TODO: Rename dht_all to just dht.
   LOG_DHT_ALL,
@@ -91,6 +92,9 @@ enum {
   LOG_INSTRUMENTATION_CHOKE,
   LOG_INSTRUMENTATION_POLLING,
   LOG_INSTRUMENTATION_TRANSFERS,
+  LOG_INSTRUMENTATION_CHUNK_CACHE,
+  LOG_INSTRUMENTATION_TRACKER,
+  LOG_INSTRUMENTATION_THREADS,
 
   LOG_MOCK_CALLS,
 
@@ -121,38 +125,51 @@ enum {
   LOG_GROUP_MAX_SIZE
 };
 
-#define lt_log_is_valid(log_group) (torrent::log_groups[log_group].valid())
+// Call sites of groups above this level compile to nothing, including
+// the evaluation of their arguments. Set with './configure
+// --with-log-level=LEVEL'. Groups outside the level cascades, such as
+// LOG_PROTOCOL_PIECE_EVENTS, count as LOG_DEBUG.
+#ifndef LT_LOG_MAX_LEVEL
+#define LT_LOG_MAX_LEVEL LOG_DEBUG
+#endif
+
+constexpr bool
+log_group_is_compiled(int group) {
+  return (group < LOG_NON_CASCADING ? group % 6 : int(LOG_DEBUG)) <= LT_LOG_MAX_LEVEL;
+}
+
+#define lt_log_is_valid(log_group) (torrent::log_group_is_compiled(log_group) && torrent::log_groups[log_group].valid())
 
 #define lt_log_print(log_group, ...)                                    \
-  { if (torrent::log_groups[log_group].valid())                         \
+  { if (lt_log_is_valid(log_group))                                     \
       torrent::log_groups[log_group].internal_print(NULL, NULL, NULL, 0, __VA_ARGS__); }
 
 #define lt_log_print_hash(log_group, log_hash, log_subsystem, ...)      \
-  { if (torrent::log_groups[log_group].valid())                         \
+  { if (lt_log_is_valid(log_group))                                     \
     torrent::log_groups[log_group].internal_print(&log_hash, log_subsystem, NULL, 0, __VA_ARGS__); }
 
 #define lt_log_print_info(log_group, log_info, log_subsystem, ...)      \
-  { if (torrent::log_groups[log_group].valid())                         \
+  { if (lt_log_is_valid(log_group))                                     \
       torrent::log_groups[log_group].internal_print(&log_info->hash(), log_subsystem, NULL, 0, __VA_ARGS__); }
 
 #define lt_log_print_data(log_group, log_data, log_subsystem, ...)      \
-  { if (torrent::log_groups[log_group].valid())                         \
+  { if (lt_log_is_valid(log_group))                                     \
       torrent::log_groups[log_group].internal_print(&log_data->hash(), log_subsystem, NULL, 0, __VA_ARGS__); }
 
 #define lt_log_print_dump(log_group, log_dump_data, log_dump_size, ...) \
-  { if (torrent::log_groups[log_group].valid())                         \
+  { if (lt_log_is_valid(log_group))                                     \
       torrent::log_groups[log_group].internal_print(NULL, NULL, log_dump_data, log_dump_size, __VA_ARGS__); }
 
 #define lt_log_print_hash_dump(log_group, log_dump_data, log_dump_size, log_hash, log_subsystem, ...) \
-  { if (torrent::log_groups[log_group].valid())                         \
+  { if (lt_log_is_valid(log_group))                                     \
       torrent::log_groups[log_group].internal_print(&log_hash, log_subsystem, log_dump_data, log_dump_size, __VA_ARGS__); }
 
 #define lt_log_print_info_dump(log_group, log_dump_data, log_dump_size, log_info, log_subsystem, ...) \
-  { if (torrent::log_groups[log_group].valid())                         \
+  { if (lt_log_is_valid(log_group))                                     \
       torrent::log_groups[log_group].internal_print(&log_info->hash(), log_subsystem, log_dump_data, log_dump_size, __VA_ARGS__); }
 
 #define lt_log_print_subsystem(log_group, log_subsystem, ...)           \
-  { if (torrent::log_groups[log_group].valid())                         \
+  { if (lt_log_is_valid(log_group))                                     \
       torrent::log_groups[log_group].internal_print(NULL, log_subsystem, NULL, 0, __VA_ARGS__); }
 
 using log_slot = std::function<void(const char*, size_t, int)>;
@@ -181,6 +198,11 @@ public:
                                      const void* dump_data, size_t dump_size,
                                      const char* fmt, ...);
 
+  // Calls the outputs with a formatted message, the log lock must be
+  // held.
+  void                internal_write(const char* data, size_t length,
+                                     const void* dump_data, size_t dump_size);
+
   const outputs_type& outputs() const                    { return m_outputs; }
   const outputs_type& cached_outputs() const             { return m_cached_outputs; }
 
@@ -221,6 +243,19 @@ void log_remove_child(int group, int child) LIBTORRENT_EXPORT;
 void log_open_file_output(const char* name, const char* filename, bool append = false) LIBTORRENT_EXPORT;
 void log_open_gz_file_output(const char* name, const char* filename, bool append = false) LIBTORRENT_EXPORT;
 
+// When deferred, messages are queued in a lock-free ring owned by the
+// logging thread and a background thread calls the outputs. Messages
+// are still formatted by the caller as the arguments do not outlive
+// the call. Messages from different threads may be reordered, and
+// dumps or messages that do not fit in the ring are written directly
+// after the queued messages of that thread.
+//
+// Disabled by default. Disabling, log_flush() and log_cleanup() write
+// all queued messages before returning.
+bool log_is_deferred() LIBTORRENT_EXPORT;
+void log_set_deferred(bool deferred) LIBTORRENT_EXPORT;
+void log_flush() LIBTORRENT_EXPORT;
+
 //
 // Implementation:
 //
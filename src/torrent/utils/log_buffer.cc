@@ -2,8 +2,18 @@
 
 #include "log_buffer.h"
 
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
 #include "log.h"
 #include "globals.h"
+#include "torrent/exceptions.h"
 
 namespace torrent {
 
@@ -48,4 +58,93 @@ log_open_log_buffer(const char* name) {
   return buffer;
 }
 
+log_ring_file::log_ring_file(const char* filename, uint64_t size) {
+  size = std::max<uint64_t>((size + 15) & ~uint64_t(15), 4096);
+  m_length = sizeof(header_type) + size;
+
+  int fd = ::open(filename, O_RDWR | O_CREAT, 0644);
+
+  if (fd == -1)
+    throw input_error("Could not open log ring file '" + std::string(filename) + "': " + std::strerror(errno));
+
+  struct stat st;
+
+  if (fstat(fd, &st) == -1 || (static_cast<size_t>(st.st_size) != m_length && ftruncate(fd, m_length) == -1)) {
+    int error = errno;
+    ::close(fd);
+    throw input_error("Could not resize log ring file '" + std::string(filename) + "': " + std::strerror(error));
+  }
+
+  void* ptr = mmap(nullptr, m_length, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  ::close(fd);
+
+  if (ptr == MAP_FAILED)
+    throw input_error("Could not map log ring file '" + std::string(filename) + "': " + std::strerror(errno));
+
+  m_header = static_cast<header_type*>(ptr);
+  m_data   = reinterpret_cast<char*>(m_header + 1);
+
+  // Keep the messages of a previous run if the ring is intact.
+  if (static_cast<size_t>(st.st_size) == m_length && m_header->size == size && for_each(static_cast<char*>(ptr), m_length, [](auto&, auto) {}))
+    return;
+
+  m_header->magic   = magic;
+  m_header->version = version;
+  m_header->size    = size;
+  m_header->head    = 0;
+  m_header->tail    = 0;
+}
+
+log_ring_file::~log_ring_file() {
+  msync(m_header, m_length, MS_ASYNC);
+  munmap(m_header, m_length);
+}
+
+// The tail is moved past overwritten records before they are written,
+// and the head only once the record is complete, so a crash in the
+// middle of a write loses at most that message.
+void
+log_ring_file::write(const char* data, size_t length, int group) {
+  if (group < 0)
+    return;
+
+  uint64_t size = m_header->size;
+
+  // Records are at most half the ring so that padding and the record
+  // never need more than the whole ring.
+  length = std::min<uint64_t>(length, size / 2 - sizeof(record_type));
+
+  uint64_t head    = m_header->head;
+  uint64_t pos     = head % size;
+  uint64_t total   = record_size(length);
+  uint64_t padding = pos + total > size ? size - pos : 0;
+
+  while (head + padding + total - m_header->tail > size)
+    m_header->tail = next_position(m_data, size, m_header->tail);
+
+  if (padding != 0) {
+    if (padding >= sizeof(record_type)) {
+      record_type record{0, 0, length_padding};
+      std::memcpy(m_data + pos, &record, sizeof(record));
+    }
+
+    head += padding;
+    pos = 0;
+  }
+
+  record_type record{cachedTime.usec(), group, static_cast<uint32_t>(length)};
+  std::memcpy(m_data + pos, &record, sizeof(record));
+  std::memcpy(m_data + pos + sizeof(record), data, length);
+
+  std::atomic_signal_fence(std::memory_order_release);
+  m_header->head = head + total;
+}
+
+void
+log_open_ring_file_output(const char* name, const char* filename, uint64_t size) {
+  auto ring = std::make_shared<log_ring_file>(filename, size);
+
+  log_open_output(name, [ring](auto d, auto l, auto g) { ring->write(d, l, g); });
+}
+
 }
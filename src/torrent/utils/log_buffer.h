@@ -1,6 +1,7 @@
 #ifndef LIBTORRENT_TORRENT_UTILS_LOG_BUFFER_H
 #define LIBTORRENT_TORRENT_UTILS_LOG_BUFFER_H
 
+#include <cstring>
 #include <deque>
 #include <functional>
 #include <memory>
@@ -9,6 +10,7 @@
 #include <utility>
 
 #include <torrent/common.h>
+#include <torrent/memory_manager.h>
 
 namespace torrent {
 
@@ -25,9 +27,9 @@ struct log_entry {
   std::string message;
 };
 
-class LIBTORRENT_EXPORT log_buffer : private std::deque<log_entry> {
+class LIBTORRENT_EXPORT log_buffer : private std::deque<log_entry, memory_counting_allocator<log_entry, MemoryManager::category_log>> {
 public:
-  using base_type = std::deque<log_entry>;
+  using base_type = std::deque<log_entry, memory_counting_allocator<log_entry, MemoryManager::category_log>>;
   using slot_void = std::function<void()>;
 
   using base_type::iterator;
@@ -67,6 +69,117 @@ typedef std::unique_ptr<log_buffer, std::function<void (log_buffer*)>> log_buffe
 
 log_buffer_ptr log_open_log_buffer(const char* name) LIBTORRENT_EXPORT;
 
+// Fixed size ring of log messages in a shared file mapping, for
+// keeping more history than a log_buffer without allocating per
+// message. The mapping is written back by the kernel even if the
+// process crashes, and reopening a file of the same size keeps its
+// messages. Decode with extra/log_ring_reader.cc.
+//
+// Positions are free-running byte offsets. Each record is aligned to
+// 8 bytes, and a record that would wrap is preceded by padding. Dumps
+// are not kept.
+
+class LIBTORRENT_EXPORT log_ring_file {
+public:
+  static constexpr uint32_t magic          = 0x726c746c;
+  static constexpr uint32_t version        = 1;
+  static constexpr uint32_t length_padding = ~uint32_t();
+
+  struct header_type {
+    uint32_t          magic;
+    uint32_t          version;
+    uint64_t          size;
+    uint64_t          head;
+    uint64_t          tail;
+  };
+
+  struct record_type {
+    int64_t           timestamp;
+    int32_t           group;
+    uint32_t          length;
+  };
+
+  // Throws input_error if the file cannot be opened or mapped.
+  log_ring_file(const char* filename, uint64_t size);
+  ~log_ring_file();
+
+  log_ring_file(const log_ring_file&) = delete;
+  log_ring_file& operator=(const log_ring_file&) = delete;
+
+  uint64_t            size() const { return m_header->size; }
+
+  void                write(const char* data, size_t length, int group);
+
+  static uint64_t     record_size(uint32_t length) { return (sizeof(record_type) + length + 7) & ~uint64_t(7); }
+
+  // Calls 'func(const record_type&, const char* data)' for each record
+  // from the oldest, returns false if the buffer is not a valid ring.
+  template <typename Func>
+  static bool         for_each(const char* first, size_t length, Func func);
+
+private:
+  static uint64_t     next_position(const char* data, uint64_t size, uint64_t position);
+
+  header_type*        m_header;
+  char*               m_data;
+  size_t              m_length;
+};
+
+void log_open_ring_file_output(const char* name, const char* filename, uint64_t size) LIBTORRENT_EXPORT;
+
+inline uint64_t
+log_ring_file::next_position(const char* data, uint64_t size, uint64_t position) {
+  uint64_t pos = position % size;
+
+  if (size - pos < sizeof(record_type))
+    return position + size - pos;
+
+  record_type record;
+  std::memcpy(&record, data + pos, sizeof(record));
+
+  if (record.length == length_padding)
+    return position + size - pos;
+
+  return position + record_size(record.length);
+}
+
+template <typename Func>
+inline bool
+log_ring_file::for_each(const char* first, size_t length, Func func) {
+  header_type header;
+
+  if (length < sizeof(header))
+    return false;
+
+  std::memcpy(&header, first, sizeof(header));
+
+  if (header.magic != magic || header.version != version || header.size == 0 || header.size % 8 != 0 ||
+      header.size > length - sizeof(header) || header.head < header.tail || header.head - header.tail > header.size)
+    return false;
+
+  const char* data = first + sizeof(header);
+
+  for (uint64_t position = header.tail; position < header.head; ) {
+    uint64_t pos = position % header.size;
+
+    if (header.size - pos >= sizeof(record_type)) {
+      record_type record;
+      std::memcpy(&record, data + pos, sizeof(record));
+
+      if (record.length != length_padding) {
+        if (record_size(record.length) > header.size - pos)
+          return false;
+
+        func(record, data + pos + sizeof(record_type));
+      }
+    }
+
+    position = next_position(data, header.size, position);
+  }
+
+  return true;
+}
+
 }
 
 #endif
@@ -168,6 +168,7 @@ constexpr const char* option_list_log_group[] = {
   "connection_filter",
   "connection_hanshake",
   "connection_listen",
+  "connection_utp",
 
   "dht_all",
   "dht_manager",
@@ -180,6 +181,9 @@ constexpr const char* option_list_log_group[] = {
   "instrumentation_choke",
   "instrumentation_polling",
   "instrumentation_transfers",
+  "instrumentation_chunk_cache",
+  "instrumentation_tracker",
+  "instrumentation_threads",
 
   "mock_calls",
 
@@ -20,7 +20,7 @@ random_uniform_template(T min, T max) {
   std::random_device rd;
   std::mt19937 mt(rd());
 
-  return min + std::uniform_int_distribution<T>(min, max)(mt) % (max - min + 1);
+  return std::uniform_int_distribution<T>(min, max)(mt);
 }  
 
 uint16_t random_uniform_uint16(uint16_t min, uint16_t max) { return random_uniform_template<uint16_t>(min, max); }
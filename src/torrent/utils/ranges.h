@@ -6,6 +6,8 @@
 
 namespace torrent {
 
+// The ranges are kept sorted and disjoint, so lookups are binary
+// searches.
 template <typename RangesType>
 class ranges : private std::vector<std::pair<RangesType, RangesType> > {
 public:
@@ -55,7 +57,7 @@ ranges<RangesType>::insert(value_type r) {
   if (r.first >= r.second)
     return;
 
-  auto first = std::find_if(begin(), end(), [r](const value_type v) { return r.first <= v.second; });
+  auto first = std::partition_point(begin(), end(), [r](const value_type v) { return v.second < r.first; });
 
   if (first == end() || r.second < first->first) {
     // The new range is before the first, after the last or between
@@ -66,7 +68,7 @@ ranges<RangesType>::insert(value_type r) {
     first->first = std::min(r.first, first->first);
     first->second = std::max(r.second, first->second);
 
-    auto last = std::find_if(first, end(), [first](const value_type v) { return first->second < v.second; });
+    auto last = std::partition_point(first, end(), [first](const value_type v) { return v.second <= first->second; });
 
     if (last != end() && first->second >= last->first)
       first->second = (last++)->second;
@@ -81,8 +83,8 @@ ranges<RangesType>::erase(value_type r) {
   if (r.first >= r.second)
     return;
 
-  auto first = std::find_if(begin(), end(), [r](const value_type v) { return r.first < v.second; });
-  auto last  = std::find_if(first, end(), [r](const value_type v) { return r.second < v.second; });
+  auto first = std::partition_point(begin(), end(), [r](const value_type v) { return v.second <= r.first; });
+  auto last  = std::partition_point(first, end(), [r](const value_type v) { return v.second <= r.second; });
 
   if (first == end())
     return;
@@ -113,13 +115,13 @@ ranges<RangesType>::erase(value_type r) {
 template <typename RangesType>
 inline typename ranges<RangesType>::iterator
 ranges<RangesType>::find(bound_type index) {
-  return std::find_if(begin(), end(), [index](const value_type v) { return index < v.second; });
+  return std::partition_point(begin(), end(), [index](const value_type v) { return v.second <= index; });
 }
 
 template <typename RangesType>
 inline typename ranges<RangesType>::const_iterator
 ranges<RangesType>::find(bound_type index) const {
-  return std::find_if(begin(), end(), [index](const value_type v) { return index < v.second; });
+  return std::partition_point(begin(), end(), [index](const value_type v) { return v.second <= index; });
 }
 
 // Use find with no closest match.
@@ -1,5 +1,12 @@
 #include "config.h"
 
+#include <algorithm>
+#include <atomic>
+#include <cinttypes>
+#include <cstring>
+#include <memory>
+#include <thread>
+#include <tuple>
 #include <rak/file_stat.h>
 #include <rak/socket_address.h>
 
@@ -7,17 +14,23 @@
 #include "peer/peer_list.h"
 #include "torrent/tracker/tracker.h"
 #include "torrent/utils/log.h"
+#include "torrent/utils/session_store.h"
+#include "torrent/utils/startup_profile.h"
 
 #include "data/file.h"
 #include "data/file_list.h"
 #include "data/transfer_list.h"
 #include "net/address_list.h"
+#include "protocol/handshake_manager.h"
+#include "protocol/peer_connection_base.h"
 
 #include "common.h"
 #include "bitfield.h"
 #include "download.h"
 #include "download_info.h"
 #include "object.h"
+#include "object_view.h"
+#include "rate.h"
 #include "tracker_list.h"
 
 #include "globals.h"
@@ -39,20 +52,42 @@
 
 namespace torrent {
 
-void
-resume_load_progress(Download download, const Object& object) {
+// Strings are read in place, without copying them out of an
+// object_view.
+static raw_string
+resume_get_key_raw_string(const Object& object, const char* key) {
+  return raw_string::from_string(object.get_key_string(key));
+}
+
+static raw_string
+resume_get_key_raw_string(const object_view& object, const char* key) {
+  return object.get_key_raw_string(key);
+}
+
+// Without 'stats' each file is checked with stat, with 'trusted' set
+// files are assumed to match the resume data.
+template <typename T>
+static void
+resume_load_progress_impl(Download download, const T& object, const resume_file_stats* stats, bool trusted) {
+  utils::startup_scope startup(download.info()->hash().str(), utils::startup_resume);
+
   if (!object.has_key_list("files")) {
     LT_LOG_LOAD("could not find 'files' key", 0);
     return;
   }
 
-  const Object::list_type& files = object.get_key_list("files");
+  const auto& files = object.get_key_list("files");
 
   if (files.size() != download.file_list()->size_files()) {
     LT_LOG_LOAD_INVALID("number of resumable files does not match files in torrent", 0);
     return;
   }
 
+  if (stats != nullptr && stats->size() != download.file_list()->size_files()) {
+    LT_LOG_LOAD_INVALID("number of file stats does not match files in torrent", 0);
+    return;
+  }
+
   if (!resume_load_bitfield(download, object))
     return;
 
@@ -66,8 +101,6 @@ resume_load_progress(Download download, const Object& object) {
 
     unsigned int file_index = std::distance(fileList->begin(), listItr);
 
-    rak::file_stat fs;
-
     if (!filesItr->has_key_value("mtime")) {
       LT_LOG_LOAD_FILE("no mtime found, file:create|resize range:clear|recheck", 0);
 
@@ -81,7 +114,26 @@ resume_load_progress(Download download, const Object& object) {
     }
 
     int64_t mtimeValue = filesItr->get_key_value("mtime");
-    bool    fileExists = fs.update(fileList->root_dir() + (*listItr)->path()->as_string());
+    resume_file_stat fs;
+
+    if (trusted) {
+      fs.exists = true;
+      fs.size   = (*listItr)->size_bytes();
+      fs.mtime  = mtimeValue;
+
+    } else if (stats != nullptr) {
+      fs = (*stats)[file_index];
+
+    } else {
+      rak::file_stat file_stat;
+
+      if ((fs.exists = file_stat.update(fileList->root_dir() + (*listItr)->path()->as_string()))) {
+        fs.size  = file_stat.size();
+        fs.mtime = file_stat.modified_time();
+      }
+    }
+
+    bool fileExists = fs.exists;
 
     // The default action when we have 'mtime' is not to create nor
     // resize the file.
@@ -114,8 +166,8 @@ resume_load_progress(Download download, const Object& object) {
 
     // If the file is the wrong size, queue resize and clear resume
     // data for that file.
-    if (static_cast<uint64_t>(fs.size()) != (*listItr)->size_bytes()) {
-      if (fs.size() == 0) {
+    if (fs.size != (*listItr)->size_bytes()) {
+      if (fs.size == 0) {
         LT_LOG_LOAD_FILE("zero-length file found, file:resize range:clear|recheck", 0);
       } else {
         LT_LOG_LOAD_FILE("file has the wrong size, file:resize range:clear|recheck", 0);
@@ -145,7 +197,7 @@ resume_load_progress(Download download, const Object& object) {
     // the file, else clear the range. This should be set only for
     // files that have completed and got no indices in
     // TransferList::completed_list().
-    if (mtimeValue == ~int64_t{2} || mtimeValue != fs.modified_time()) {
+    if (mtimeValue == ~int64_t{2} || mtimeValue != fs.mtime) {
       LT_LOG_LOAD_FILE("resume data doesn't include uncertain pieces, range:clear|recheck", 0);
       download.update_range(Download::update_range_clear | Download::update_range_recheck,
                             (*listItr)->range().first, (*listItr)->range().second);
@@ -156,10 +208,130 @@ resume_load_progress(Download download, const Object& object) {
   }
 
   resume_load_uncertain_pieces(download, object);
+
+  LT_LOG_LOAD("chunks to recheck: %" PRIu32 " of %" PRIu32,
+              download.chunks_to_hash(0, fileList->size_chunks()), fileList->size_chunks());
+}
+
+void
+resume_load_progress(Download download, const Object& object) {
+  resume_load_progress_impl(download, object, nullptr, false);
+}
+
+void
+resume_load_progress(Download download, const object_view& object) {
+  resume_load_progress_impl(download, object, nullptr, false);
+}
+
+void
+resume_load_progress(Download download, const Object& object, const resume_file_stats& stats) {
+  resume_load_progress_impl(download, object, &stats, false);
+}
+
+void
+resume_load_progress(Download download, const object_view& object, const resume_file_stats& stats) {
+  resume_load_progress_impl(download, object, &stats, false);
+}
+
+void
+resume_load_progress_trusted(Download download, const Object& object) {
+  resume_load_progress_impl(download, object, nullptr, true);
+}
+
+void
+resume_load_progress_trusted(Download download, const object_view& object) {
+  resume_load_progress_impl(download, object, nullptr, true);
+}
+
+std::vector<std::string>
+resume_file_paths(Download download) {
+  FileList* fileList = download.file_list();
+  std::vector<std::string> paths;
+
+  paths.reserve(fileList->size_files());
+
+  for (const auto& file : *fileList)
+    paths.push_back(file->is_padding() ? std::string() : fileList->root_dir() + file->path()->as_string());
+
+  return paths;
+}
+
+// Directories are checked first, files of a missing directory are not
+// looked at. Both passes hand out indices to the threads through an
+// atomic counter.
+template <typename Func>
+static void
+resume_stat_parallel(size_t count, unsigned int max_threads, Func func) {
+  unsigned int thread_count = std::min<size_t>(std::max(max_threads, 1u), count);
+
+  if (thread_count <= 1) {
+    for (size_t i = 0; i < count; i++)
+      func(i);
+
+    return;
+  }
+
+  std::atomic<size_t> next{0};
+  std::vector<std::thread> threads;
+
+  auto worker = [&next, count, &func] {
+      for (size_t i; (i = next++) < count; )
+        func(i);
+    };
+
+  for (unsigned int i = 1; i < thread_count; i++)
+    threads.emplace_back(worker);
+
+  worker();
+
+  for (auto& thread : threads)
+    thread.join();
+}
+
+resume_file_stats
+resume_stat_files(const std::vector<std::string>& paths, unsigned int max_threads) {
+  std::vector<std::string> directories;
+  std::vector<size_t>      file_directory(paths.size());
+
+  for (size_t i = 0; i < paths.size(); i++) {
+    auto pos = paths[i].rfind('/');
+    std::string dir = pos == std::string::npos || pos == 0 ? std::string() : paths[i].substr(0, pos);
+
+    // Files of a directory are usually listed together.
+    if (directories.empty() || directories.back() != dir)
+      directories.push_back(std::move(dir));
+
+    file_directory[i] = directories.size() - 1;
+  }
+
+  std::unique_ptr<bool[]> directory_exists(new bool[directories.size()]);
+
+  resume_stat_parallel(directories.size(), max_threads, [&](size_t i) {
+      rak::file_stat fs;
+      directory_exists[i] = directories[i].empty() || (fs.update(directories[i]) && fs.is_directory());
+    });
+
+  resume_file_stats stats(paths.size());
+
+  resume_stat_parallel(paths.size(), max_threads, [&](size_t i) {
+      if (paths[i].empty() || !directory_exists[file_directory[i]])
+        return;
+
+      rak::file_stat fs;
+
+      if (!fs.update(paths[i]))
+        return;
+
+      stats[i].exists = true;
+      stats[i].size   = fs.size();
+      stats[i].mtime  = fs.modified_time();
+    });
+
+  return stats;
 }
 
 void
-resume_save_progress(Download download, Object& object) {
+resume_save_progress(Download download, Object& object, int flags) {
   // We don't remove the old hash data since it might still be valid,
   // just that the client didn't finish the check this time.
   if (!download.is_hash_checked()) {
@@ -184,7 +356,7 @@ resume_save_progress(Download download, Object& object) {
     return;
   }
 
-  resume_save_bitfield(download, object);
+  resume_save_bitfield(download, object, flags);
   
   Object::list_type&    files    = object.insert_preserve_copy("files", Object::create_list()).first->second.as_list();
   auto filesItr = files.begin();
@@ -246,12 +418,41 @@ resume_save_progress(Download download, Object& object) {
 void
 resume_clear_progress([[maybe_unused]] Download download, Object& object) {
   object.erase_key("bitfield");
+  object.erase_key("bitfield_runs");
 }
 
-bool
-resume_load_bitfield(Download download, const Object& object) {
-  if (object.has_key_string("bitfield")) {
-    const Object::string_type& bitfield = object.get_key_string("bitfield");
+// Partial bitfields are saved run-length encoded in 'bitfield_runs',
+// if enabled, when that takes less than half the space of the raw
+// bitfield, which is the case for torrents with few long stretches of
+// chunks missing.
+static bool
+resume_decode_bitfield_runs(Download download, raw_string runs) {
+  Bitfield bitfield;
+  bitfield.set_size_bits(download.file_list()->bitfield()->size_bits());
+  bitfield.allocate();
+
+  if (!bitfield_decode_runs(bitfield, runs.data(), runs.data() + runs.size()))
+    return false;
+
+  download.set_bitfield(bitfield.begin(), bitfield.end());
+  return true;
+}
+
+template <typename T>
+static bool
+resume_load_bitfield_impl(Download download, const T& object) {
+  utils::startup_scope startup(download.info()->hash().str(), utils::startup_resume);
+
+  if (object.has_key_string("bitfield_runs")) {
+    if (!resume_decode_bitfield_runs(download, resume_get_key_raw_string(object, "bitfield_runs"))) {
+      LT_LOG_LOAD_INVALID("run-length encoded bitfield does not match bitfield size of torrent", 0);
+      return false;
+    }
+
+    LT_LOG_LOAD("restoring partial bitfield from runs", 0);
+
+  } else if (object.has_key_string("bitfield")) {
+    raw_string bitfield = resume_get_key_raw_string(object, "bitfield");
 
     if (bitfield.size() != download.file_list()->bitfield()->size_bytes()) {
       LT_LOG_LOAD_INVALID("size of resumable bitfield does not match bitfield size of torrent", 0);
@@ -260,10 +461,10 @@ resume_load_bitfield(Download download, const Object& object) {
 
     LT_LOG_LOAD("restoring partial bitfield", 0);
 
-    download.set_bitfield((uint8_t*)(bitfield.c_str()), (uint8_t*)((bitfield.c_str() + bitfield.size())));
+    download.set_bitfield((uint8_t*)(bitfield.data()), (uint8_t*)((bitfield.data() + bitfield.size())));
 
   } else if (object.has_key_value("bitfield")) {
-    Object::value_type chunksDone = object.get_key_value("bitfield");
+    int64_t chunksDone = object.get_key_value("bitfield");
 
     if (chunksDone == download.file_list()->bitfield()->size_bits()) {
       LT_LOG_LOAD("restoring completed bitfield", 0);
@@ -284,21 +485,48 @@ resume_load_bitfield(Download download, const Object& object) {
   return true;
 }
 
+bool
+resume_load_bitfield(Download download, const Object& object) {
+  return resume_load_bitfield_impl(download, object);
+}
+
+bool
+resume_load_bitfield(Download download, const object_view& object) {
+  return resume_load_bitfield_impl(download, object);
+}
+
 void
-resume_save_bitfield(Download download, Object& object) {
+resume_save_bitfield(Download download, Object& object, int flags) {
   const Bitfield* bitfield = download.file_list()->bitfield();
 
+  object.erase_key("bitfield_runs");
+
   if (bitfield->is_all_set() || bitfield->is_all_unset()) {
     LT_LOG_SAVE("uniform bitfield, saving size only", 0);
     object.insert_key("bitfield", bitfield->size_set());
-  } else {
-    LT_LOG_SAVE("saving bitfield", 0);
-    object.insert_key("bitfield", std::string(bitfield->begin(), bitfield->end()));
+    return;
+  }
+
+  if (flags & resume_save_bitfield_runs) {
+    std::string runs = bitfield_encode_runs(*bitfield);
+
+    if (runs.size() < bitfield->size_bytes() / 2) {
+      LT_LOG_SAVE("saving bitfield as runs (size:%zu)", runs.size());
+      object.erase_key("bitfield");
+      object.insert_key("bitfield_runs", runs);
+      return;
+    }
   }
+
+  LT_LOG_SAVE("saving bitfield", 0);
+  object.insert_key("bitfield", std::string(bitfield->begin(), bitfield->end()));
 }
 
-void
-resume_load_uncertain_pieces(Download download, const Object& object) {
+template <typename T>
+static void
+resume_load_uncertain_pieces_impl(Download download, const T& object) {
+  utils::startup_scope startup(download.info()->hash().str(), utils::startup_resume);
+
   // Don't rehash when loading resume data within the same session.
   if (!object.has_key_string("uncertain_pieces")) {
     LT_LOG_LOAD("no uncertain pieces marked", 0);
@@ -311,7 +539,7 @@ resume_load_uncertain_pieces(Download download, const Object& object) {
     return;
   }
 
-  const Object::string_type& uncertain = object.get_key_string("uncertain_pieces");
+  raw_string uncertain = resume_get_key_raw_string(object, "uncertain_pieces");
 
   LT_LOG_LOAD("found %zu uncertain pieces", uncertain.size() / 2);
 
@@ -323,6 +551,16 @@ resume_load_uncertain_pieces(Download download, const Object& object) {
   }
 }
 
+void
+resume_load_uncertain_pieces(Download download, const Object& object) {
+  resume_load_uncertain_pieces_impl(download, object);
+}
+
+void
+resume_load_uncertain_pieces(Download download, const object_view& object) {
+  resume_load_uncertain_pieces_impl(download, object);
+}
+
 void
 resume_save_uncertain_pieces(Download download, Object& object) {
   // Add information on what chunks might still not have been properly
@@ -392,12 +630,15 @@ resume_check_target_files(Download download, [[maybe_unused]] const Object& obje
   }
 }
 
-void
-resume_load_file_priorities(Download download, const Object& object) {
+template <typename T>
+static void
+resume_load_file_priorities_impl(Download download, const T& object) {
+  utils::startup_scope startup(download.info()->hash().str(), utils::startup_resume);
+
   if (!object.has_key_list("files"))
     return;
 
-  const Object::list_type& files = object.get_key_list("files");
+  const auto& files = object.get_key_list("files");
 
   auto filesItr  = files.begin();
   auto filesLast = files.end();
@@ -418,6 +659,16 @@ resume_load_file_priorities(Download download, const Object& object) {
   }
 }
 
+void
+resume_load_file_priorities(Download download, const Object& object) {
+  resume_load_file_priorities_impl(download, object);
+}
+
+void
+resume_load_file_priorities(Download download, const object_view& object) {
+  resume_load_file_priorities_impl(download, object);
+}
+
 void
 resume_save_file_priorities(Download download, Object& object) {
   Object::list_type&    files    = object.insert_preserve_copy("files", Object::create_list()).first->second.as_list();
@@ -435,38 +686,140 @@ resume_save_file_priorities(Download download, Object& object) {
   }
 }
 
+namespace {
+
+struct resume_peer_entry {
+  rak::socket_address address;
+  uint32_t            failed;
+  uint32_t            last;
+  uint32_t            down_rate;
+  uint32_t            up_rate;
+  int                 flags;
+};
+
+// Peers we downloaded from without corrupt data are connected to
+// first, seeders before the others and then by download rate.
+bool
+resume_peer_is_good(const resume_peer_entry& entry) {
+  return entry.failed == 0 && (entry.down_rate != 0 || (entry.flags & PeerInfo::flag_seeder));
+}
+
+bool
+resume_peer_less(const resume_peer_entry& a, const resume_peer_entry& b) {
+  return std::make_tuple(resume_peer_is_good(a), (a.flags & PeerInfo::flag_seeder) != 0, a.down_rate, a.last) <
+    std::make_tuple(resume_peer_is_good(b), (b.flags & PeerInfo::flag_seeder) != 0, b.down_rate, b.last);
+}
+
+// The address is saved with the listen port of the peer.
+resume_peer_entry
+resume_peer_from_info(PeerInfo* peer_info) {
+  resume_peer_entry entry{};
+
+  entry.address = *rak::socket_address::cast_from(peer_info->socket_address());
+  entry.address.set_port(peer_info->listen_port());
+  entry.failed  = peer_info->failed_counter();
+  entry.last    = peer_info->is_connected() ? cachedTime.seconds() : peer_info->last_connection();
+
+  // Connected peers have their history updated on disconnect, so
+  // save what the current connection has seen.
+  if (const Peer* connection = peer_info->connection()) {
+    entry.flags = connection->bitfield()->is_all_set() ? PeerInfo::flag_seeder : 0;
+
+    if (connection->is_encrypted())
+      entry.flags |= PeerInfo::flag_encrypted;
+
+    entry.down_rate = connection->down_rate()->rate();
+    entry.up_rate   = connection->up_rate()->rate();
+
+  } else {
+    entry.flags     = peer_info->flags() & PeerInfo::mask_history;
+    entry.down_rate = peer_info->last_down_rate();
+    entry.up_rate   = peer_info->last_up_rate();
+  }
+
+  return entry;
+}
+
 void
-resume_load_addresses(Download download, const Object& object) {
+resume_insert_peers(Download download, std::vector<resume_peer_entry>& entries) {
+  std::stable_sort(entries.rbegin(), entries.rend(), resume_peer_less);
+
+  PeerList* peerList = download.peer_list();
+
+  for (const auto& entry : entries) {
+    int flags = 0;
+
+    // Peers that sent too many corrupt chunks are kept for their
+    // history, but not connected to.
+    if (entry.address.port() != 0 && entry.failed <= HandshakeManager::max_failed)
+      flags |= PeerList::address_available;
+
+    if (resume_peer_is_good(entry))
+      flags |= PeerList::address_priority;
+
+    PeerInfo* peerInfo = peerList->insert_address(entry.address.c_sockaddr(), flags);
+
+    if (peerInfo == NULL)
+      continue;
+
+    peerInfo->set_failed_counter(entry.failed);
+    peerInfo->set_last_connection(entry.last);
+    peerInfo->set_last_rates(entry.down_rate, entry.up_rate);
+    peerInfo->set_history_flags(entry.flags);
+  }
+}
+
+}
+
+template <typename T>
+static void
+resume_load_addresses_impl(Download download, const T& object) {
+  utils::startup_scope startup(download.info()->hash().str(), utils::startup_resume);
+
   if (!object.has_key_list("peers"))
     return;
 
-  PeerList* peerList = download.peer_list();
+  std::vector<resume_peer_entry> entries;
 
   for (const auto& key : object.get_key_list("peers")) {
     if (!key.is_map() ||
-        !key.has_key_string("inet") || key.get_key_string("inet").size() != sizeof(SocketAddressCompact) ||
+        !key.has_key_string("inet") || resume_get_key_raw_string(key, "inet").size() != sizeof(SocketAddressCompact) ||
         !key.has_key_value("failed") ||
         !key.has_key_value("last") || key.get_key_value("last") > cachedTime.seconds())
       continue;
 
-    int flags = 0;
-    rak::socket_address socketAddress = *reinterpret_cast<const SocketAddressCompact*>(key.get_key_string("inet").c_str());
+    resume_peer_entry entry{};
+    entry.address = *reinterpret_cast<const SocketAddressCompact*>(resume_get_key_raw_string(key, "inet").data());
+    entry.failed  = key.get_key_value("failed");
+    entry.last    = key.get_key_value("last");
 
-    if (socketAddress.port() != 0)
-      flags |= PeerList::address_available;
+    if (key.has_key_value("down"))
+      entry.down_rate = key.get_key_value("down");
 
-    PeerInfo* peerInfo = peerList->insert_address(socketAddress.c_sockaddr(), flags);
+    if (key.has_key_value("up"))
+      entry.up_rate = key.get_key_value("up");
 
-    if (peerInfo == NULL)
-      continue;
+    if (key.has_key_value("flags"))
+      entry.flags = key.get_key_value("flags") & PeerInfo::mask_history;
 
-    peerInfo->set_failed_counter(key.get_key_value("failed"));
-    peerInfo->set_last_connection(key.get_key_value("last"));
+    entries.push_back(entry);
   }
 
+  resume_insert_peers(download, entries);
+
   // Tell rTorrent to harvest addresses.
 }
 
+void
+resume_load_addresses(Download download, const Object& object) {
+  resume_load_addresses_impl(download, object);
+}
+
+void
+resume_load_addresses(Download download, const object_view& object) {
+  resume_load_addresses_impl(download, object);
+}
+
 void
 resume_save_addresses(Download download, Object& object) {
   Object&         dest     = object.insert_key("peers", Object::create_list());
@@ -481,22 +834,28 @@ resume_save_addresses(Download download, Object& object) {
 
     Object& peer = dest.insert_back(Object::create_map());
 
-    const rak::socket_address* sa = rak::socket_address::cast_from(dlp.second->socket_address());
+    resume_peer_entry entry = resume_peer_from_info(dlp.second);
 
-    if (sa->family() == rak::socket_address::af_inet)
-      peer.insert_key("inet", std::string(SocketAddressCompact(sa->sa_inet()->address_n(), htons(dlp.second->listen_port())).c_str(), sizeof(SocketAddressCompact)));
+    if (entry.address.family() == rak::socket_address::af_inet)
+      peer.insert_key("inet", std::string(SocketAddressCompact(entry.address.sa_inet()).c_str(), sizeof(SocketAddressCompact)));
 
-    peer.insert_key("failed", dlp.second->failed_counter());
-    peer.insert_key("last", dlp.second->is_connected() ? cachedTime.seconds() : dlp.second->last_connection());
+    peer.insert_key("failed", entry.failed);
+    peer.insert_key("last", entry.last);
+    peer.insert_key("down", entry.down_rate);
+    peer.insert_key("up", entry.up_rate);
+    peer.insert_key("flags", entry.flags);
   }
 }
 
-void
-resume_load_tracker_settings(Download download, const Object& object) {
+template <typename T>
+static void
+resume_load_tracker_settings_impl(Download download, const T& object) {
+  utils::startup_scope startup(download.info()->hash().str(), utils::startup_resume);
+
   if (!object.has_key_map("trackers"))
     return;
 
-  const Object& src = object.get_key("trackers");
+  const auto&   src = object.get_key("trackers");
   TrackerList*  tracker_list = download.tracker_list();
 
   for (const auto& map : src.as_map()) {
@@ -504,17 +863,19 @@ resume_load_tracker_settings(Download download, const Object& object) {
         !map.second.has_key("group"))
       continue;
 
-    if (tracker_list->find_url(map.first) != tracker_list->end())
+    std::string url(map.first.data(), map.first.size());
+
+    if (tracker_list->find_url(url) != tracker_list->end())
       continue;
 
-    download.tracker_list()->insert_url(map.second.get_key_value("group"), map.first);
+    download.tracker_list()->insert_url(map.second.get_key_value("group"), url);
   }
 
   for (auto tracker : *tracker_list) {
     if (!src.has_key_map(tracker.url()))
       continue;
 
-    const Object& trackerObject = src.get_key(tracker.url());
+    const auto& trackerObject = src.get_key(tracker.url());
 
     if (trackerObject.has_key_value("enabled") && trackerObject.get_key_value("enabled") == 0)
       tracker.disable();
@@ -523,6 +884,16 @@ resume_load_tracker_settings(Download download, const Object& object) {
   }
 }
 
+void
+resume_load_tracker_settings(Download download, const Object& object) {
+  resume_load_tracker_settings_impl(download, object);
+}
+
+void
+resume_load_tracker_settings(Download download, const object_view& object) {
+  resume_load_tracker_settings_impl(download, object);
+}
+
 void
 resume_save_tracker_settings(Download download, Object& object) {
   Object& dest = object.insert_preserve_copy("trackers", Object::create_map()).first->second;
@@ -540,4 +911,168 @@ resume_save_tracker_settings(Download download, Object& object) {
   }
 }
 
+namespace {
+
+// The bitfield section is the bitfield size and set count, followed
+// by the bitfield unless it is empty or complete. The bitfield is
+// run-length encoded when that is shorter than the raw bitfield, which
+// then tells the two apart.
+struct session_bitfield_header {
+  uint32_t size_bits;
+  uint32_t size_set;
+};
+
+// Peers are saved as fixed-size records, inet only. Address and port
+// are in network byte order.
+struct session_peer_record {
+  uint32_t address;
+  uint16_t port;
+  uint16_t flags;
+  uint32_t failed;
+  uint32_t last;
+  uint32_t down_rate;
+  uint32_t up_rate;
+};
+
+static_assert(sizeof(session_bitfield_header) == 8, "session_bitfield_header has invalid size.");
+static_assert(sizeof(session_peer_record) == 24, "session_peer_record has invalid size.");
+
+}
+
+void
+resume_save_session(Download download, SessionStore& store) {
+  const HashString& hash = download.info()->hash();
+  std::string       buffer;
+
+  if (download.is_hash_checked()) {
+    const Bitfield* bitfield = download.file_list()->bitfield();
+    session_bitfield_header header{bitfield->size_bits(), bitfield->size_set()};
+
+    buffer.append(reinterpret_cast<const char*>(&header), sizeof(header));
+
+    if (!bitfield->is_all_set() && !bitfield->is_all_unset()) {
+      std::string runs = bitfield_encode_runs(*bitfield);
+
+      if (runs.size() < bitfield->size_bytes())
+        buffer.append(runs);
+      else
+        buffer.append(reinterpret_cast<const char*>(bitfield->begin()), bitfield->size_bytes());
+    }
+
+    store.write(hash, SessionStore::section_bitfield, buffer.data(), buffer.size());
+  }
+
+  buffer.clear();
+
+  for (const auto& file : *download.file_list())
+    buffer.push_back(static_cast<char>(file->priority()));
+
+  store.write(hash, SessionStore::section_file_priorities, buffer.data(), buffer.size());
+
+  std::vector<session_peer_record> peers;
+
+  for (const auto& dlp : *download.peer_list()) {
+    resume_peer_entry entry = resume_peer_from_info(dlp.second);
+
+    if (entry.address.family() != rak::socket_address::af_inet)
+      continue;
+
+    peers.push_back(session_peer_record{entry.address.sa_inet()->address_n(), entry.address.sa_inet()->port_n(),
+                                        static_cast<uint16_t>(entry.flags), entry.failed, entry.last,
+                                        entry.down_rate, entry.up_rate});
+  }
+
+  store.write(hash, SessionStore::section_peers, reinterpret_cast<const char*>(peers.data()), peers.size() * sizeof(session_peer_record));
+
+  LT_LOG_SAVE("saved to session store (peers:%zu)", peers.size());
+}
+
+bool
+resume_load_session(Download download, const SessionStore& store) {
+  utils::startup_scope startup(download.info()->hash().str(), utils::startup_resume);
+
+  const HashString& hash = download.info()->hash();
+  std::string       data;
+
+  if (store.read(hash, SessionStore::section_file_priorities, data)) {
+    auto itr = data.begin();
+
+    for (const auto& file : *download.file_list()) {
+      if (itr == data.end())
+        break;
+
+      auto priority = static_cast<uint8_t>(*itr++);
+
+      if (priority <= PRIORITY_HIGH)
+        file->set_priority(static_cast<priority_enum>(priority));
+    }
+  }
+
+  if (store.read(hash, SessionStore::section_peers, data) && data.size() % sizeof(session_peer_record) == 0) {
+    std::vector<resume_peer_entry> entries;
+
+    for (size_t offset = 0; offset != data.size(); offset += sizeof(session_peer_record)) {
+      session_peer_record record;
+      std::memcpy(&record, data.data() + offset, sizeof(record));
+
+      if (static_cast<int64_t>(record.last) > cachedTime.seconds())
+        continue;
+
+      resume_peer_entry entry{};
+      entry.address   = SocketAddressCompact(record.address, record.port);
+      entry.failed    = record.failed;
+      entry.last      = record.last;
+      entry.down_rate = record.down_rate;
+      entry.up_rate   = record.up_rate;
+      entry.flags     = record.flags & PeerInfo::mask_history;
+
+      entries.push_back(entry);
+    }
+
+    resume_insert_peers(download, entries);
+  }
+
+  session_bitfield_header header;
+
+  if (!store.read(hash, SessionStore::section_bitfield, data) || data.size() < sizeof(header)) {
+    LT_LOG_LOAD_INVALID("no bitfield in session store", 0);
+    return false;
+  }
+
+  std::memcpy(&header, data.data(), sizeof(header));
+
+  const Bitfield* bitfield = download.file_list()->bitfield();
+  size_t          bitfield_size = data.size() - sizeof(header);
+
+  if (header.size_bits != bitfield->size_bits()) {
+    LT_LOG_LOAD_INVALID("size of stored bitfield does not match bitfield size of torrent", 0);
+    return false;
+  }
+
+  if (header.size_set == header.size_bits) {
+    LT_LOG_LOAD("restoring completed bitfield from session store", 0);
+    download.set_bitfield(true);
+
+  } else if (header.size_set == 0) {
+    LT_LOG_LOAD("restoring empty bitfield from session store", 0);
+    download.set_bitfield(false);
+
+  } else if (bitfield_size == bitfield->size_bytes()) {
+    LT_LOG_LOAD("restoring partial bitfield from session store", 0);
+
+    auto first = reinterpret_cast<uint8_t*>(const_cast<char*>(data.data() + sizeof(header)));
+    download.set_bitfield(first, first + bitfield_size);
+
+  } else if (bitfield_size < bitfield->size_bytes() &&
+             resume_decode_bitfield_runs(download, raw_string(data.data() + sizeof(header), bitfield_size))) {
+    LT_LOG_LOAD("restoring partial bitfield from runs in session store", 0);
+
+  } else {
+    LT_LOG_LOAD_INVALID("size of stored bitfield data does not match bitfield size of torrent", 0);
+    return false;
+  }
+
+  return true;
+}
+
 }
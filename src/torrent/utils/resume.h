@@ -39,12 +39,17 @@
 //
 // These functions use only the public interface, and thus the client
 // may choose to replace these with their own resume code.
+//
+// To write only what changed since the last full save, see
+// object_delta in torrent/object_delta.h.
 
 // Should propably move this into a sub-directory.
 
 #ifndef LIBTORRENT_UTILS_RESUME_H
 #define LIBTORRENT_UTILS_RESUME_H
 
+#include <string>
+#include <vector>
 #include <torrent/common.h>
 
 namespace torrent {
@@ -52,29 +57,85 @@ namespace torrent {
 // When saving resume data for a torrent that is currently active, set
 // 'onlyCompleted' to ensure that a crash, etc, will cause incomplete
 // files to be hashed.
+//
+// The load functions also take an object_view, which reads the resume
+// data in place without building an Object.
 
 void resume_load_progress(Download download, const Object& object) LIBTORRENT_EXPORT;
-void resume_save_progress(Download download, Object& object) LIBTORRENT_EXPORT;
+void resume_load_progress(Download download, const object_view& object) LIBTORRENT_EXPORT;
+
+// Checking the files of every torrent at startup is slow on network
+// filesystems, so the stat calls may be done ahead of time on another
+// thread:
+//
+// 'resume_file_paths' collects the paths of a download, padding files
+// get an empty path. 'resume_stat_files' may then be called from any
+// thread, it runs the stat calls on up to 'max_threads' threads and
+// skips the files of missing directories. The result is passed to
+// 'resume_load_progress' before the download is hash checked.
+//
+// The trusted variant does not look at the files, those with a valid
+// 'mtime' are assumed to be unchanged. Use it only when the files are
+// known not to have been touched since the resume data was saved.
+
+struct resume_file_stat {
+  bool     exists{false};
+  uint64_t size{0};
+  int64_t  mtime{0};
+};
+
+using resume_file_stats = std::vector<resume_file_stat>;
+
+std::vector<std::string> resume_file_paths(Download download) LIBTORRENT_EXPORT;
+resume_file_stats        resume_stat_files(const std::vector<std::string>& paths, unsigned int max_threads = 8) LIBTORRENT_EXPORT;
+
+void resume_load_progress(Download download, const Object& object, const resume_file_stats& stats) LIBTORRENT_EXPORT;
+void resume_load_progress(Download download, const object_view& object, const resume_file_stats& stats) LIBTORRENT_EXPORT;
+void resume_load_progress_trusted(Download download, const Object& object) LIBTORRENT_EXPORT;
+void resume_load_progress_trusted(Download download, const object_view& object) LIBTORRENT_EXPORT;
+void resume_save_progress(Download download, Object& object, int flags = 0) LIBTORRENT_EXPORT;
 void resume_clear_progress(Download download, Object& object) LIBTORRENT_EXPORT;
 
+// With 'resume_save_bitfield_runs', partial bitfields are saved
+// run-length encoded in 'bitfield_runs' instead of 'bitfield' when
+// that is less than half the size. Versions that only read 'bitfield'
+// then recheck the torrent, so this is opt-in.
+constexpr int resume_save_bitfield_runs = (1 << 0);
+
 bool resume_load_bitfield(Download download, const Object& object) LIBTORRENT_EXPORT;
-void resume_save_bitfield(Download download, Object& object) LIBTORRENT_EXPORT;
+bool resume_load_bitfield(Download download, const object_view& object) LIBTORRENT_EXPORT;
+void resume_save_bitfield(Download download, Object& object, int flags = 0) LIBTORRENT_EXPORT;
 
 // Do not call 'resume_load_uncertain_pieces' directly.
 void resume_load_uncertain_pieces(Download download, const Object& object) LIBTORRENT_EXPORT;
+void resume_load_uncertain_pieces(Download download, const object_view& object) LIBTORRENT_EXPORT;
 void resume_save_uncertain_pieces(Download download, Object& object) LIBTORRENT_EXPORT;
 
 bool resume_check_target_files(Download download, const Object& object) LIBTORRENT_EXPORT;
 
 void resume_load_file_priorities(Download download, const Object& object) LIBTORRENT_EXPORT;
+void resume_load_file_priorities(Download download, const object_view& object) LIBTORRENT_EXPORT;
 void resume_save_file_priorities(Download download, Object& object) LIBTORRENT_EXPORT;
 
 void resume_load_addresses(Download download, const Object& object) LIBTORRENT_EXPORT;
+void resume_load_addresses(Download download, const object_view& object) LIBTORRENT_EXPORT;
 void resume_save_addresses(Download download, Object& object) LIBTORRENT_EXPORT;
 
 void resume_load_tracker_settings(Download download, const Object& object) LIBTORRENT_EXPORT;
+void resume_load_tracker_settings(Download download, const object_view& object) LIBTORRENT_EXPORT;
 void resume_save_tracker_settings(Download download, Object& object) LIBTORRENT_EXPORT;
 
+// Saves the bitfield, file priorities and peers of a download as the
+// binary sections of a SessionStore, see torrent/utils/session_store.h.
+// The bitfield is only saved once the download is hash checked, else
+// the stored one is kept.
+//
+// Loading returns false if no valid bitfield was stored, the other
+// sections are loaded when present.
+
+void resume_save_session(Download download, SessionStore& store) LIBTORRENT_EXPORT;
+bool resume_load_session(Download download, const SessionStore& store) LIBTORRENT_EXPORT;
+
 }
 
 #endif
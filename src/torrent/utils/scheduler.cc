@@ -7,6 +7,7 @@
 
 #include "torrent/exceptions.h"
 #include "torrent/utils/chrono.h"
+#include "torrent/utils/latency_histogram.h"
 
 namespace torrent::utils {
 
@@ -20,25 +21,327 @@ SchedulerEntry::~SchedulerEntry() {
 }
 
 
+struct Scheduler::Wheel {
+  static constexpr unsigned int bitmap_words = wheel_slots / 64;
+
+  uint64_t                     tick{0};
+  SchedulerEntry*              slots[wheel_levels][wheel_slots]{};
+  uint64_t                     bitmap[wheel_levels][bitmap_words]{};
+  SchedulerEntry*              overflow{};
+  SchedulerEntry*              expired{};
+  std::vector<SchedulerEntry*> batch;
+
+  bool                         next_valid{false};
+  time_type                    next{};
+
+  static uint64_t     tick_of(time_type time) { return time.count() / wheel_tick.count(); }
+
+  bool                is_slot(SchedulerEntry** head) const;
+
+  void                link(SchedulerEntry** head, SchedulerEntry* entry);
+  void                unlink(SchedulerEntry* entry);
+  void                place(SchedulerEntry* entry);
+  void                replace(SchedulerEntry* entry);
+  void                cascade(unsigned int level, unsigned int index);
+  void                cascade_overflow();
+  void                advance(uint64_t target);
+
+  // Returns 'last' if no slot in [first, last) is used.
+  unsigned int        find_slot(unsigned int level, unsigned int first, unsigned int last) const;
+  unsigned int        find_slot_from(unsigned int level, unsigned int first) const;
+
+  time_type           find_next() const;
+};
+
+inline bool
+Scheduler::Wheel::is_slot(SchedulerEntry** head) const {
+  return head >= &slots[0][0] && head < &slots[0][0] + wheel_levels * wheel_slots;
+}
+
+inline void
+Scheduler::Wheel::link(SchedulerEntry** head, SchedulerEntry* entry) {
+  if (is_slot(head)) {
+    auto index = head - &slots[0][0];
+    bitmap[index / wheel_slots][(index % wheel_slots) / 64] |= uint64_t(1) << (index % 64);
+  }
+
+  entry->m_next = *head;
+  entry->m_pprev = head;
+
+  if (*head != nullptr)
+    (*head)->m_pprev = &entry->m_next;
+
+  *head = entry;
+}
+
+inline void
+Scheduler::Wheel::unlink(SchedulerEntry* entry) {
+  auto head = entry->m_pprev;
+
+  *head = entry->m_next;
+
+  if (entry->m_next != nullptr)
+    entry->m_next->m_pprev = head;
+
+  if (*head == nullptr && is_slot(head)) {
+    auto index = head - &slots[0][0];
+    bitmap[index / wheel_slots][(index % wheel_slots) / 64] &= ~(uint64_t(1) << (index % 64));
+  }
+
+  entry->m_next = nullptr;
+  entry->m_pprev = nullptr;
+}
+
+// Entries that are already due are placed in the current slot.
+void
+Scheduler::Wheel::place(SchedulerEntry* entry) {
+  uint64_t entry_tick = std::max(tick_of(entry->time()), tick);
+  uint64_t delta = entry_tick - tick;
+
+  for (unsigned int level = 0; level < wheel_levels; level++) {
+    if (delta < (uint64_t(1) << (wheel_slot_bits * (level + 1)))) {
+      link(&slots[level][(entry_tick >> (wheel_slot_bits * level)) % wheel_slots], entry);
+      return;
+    }
+  }
+
+  link(&overflow, entry);
+}
+
+void
+Scheduler::Wheel::replace(SchedulerEntry* entry) {
+  while (entry != nullptr) {
+    SchedulerEntry* next = entry->m_next;
+
+    entry->m_next = nullptr;
+    entry->m_pprev = nullptr;
+    place(entry);
+
+    entry = next;
+  }
+}
+
+void
+Scheduler::Wheel::cascade(unsigned int level, unsigned int index) {
+  SchedulerEntry* entry = slots[level][index];
+
+  slots[level][index] = nullptr;
+  bitmap[level][index / 64] &= ~(uint64_t(1) << (index % 64));
+
+  replace(entry);
+}
+
+void
+Scheduler::Wheel::cascade_overflow() {
+  SchedulerEntry* entry = overflow;
+
+  overflow = nullptr;
+
+  replace(entry);
+}
+
+// Moves the current tick towards 'target', stopping at the next tick
+// where a slot in the first level is used or a used slot in a higher
+// level is cascaded. Levels are cascaded lowest first when the tick
+// crosses their boundary.
+void
+Scheduler::Wheel::advance(uint64_t target) {
+  uint64_t next = target;
+
+  for (unsigned int level = 0; level < wheel_levels; level++) {
+    unsigned int shift = wheel_slot_bits * level;
+    unsigned int current = (tick >> shift) % wheel_slots;
+    unsigned int found = find_slot_from(level, (current + 1) % wheel_slots);
+
+    if (slots[level][found] == nullptr)
+      continue;
+
+    uint64_t distance = (found + wheel_slots - current - 1) % wheel_slots + 1;
+
+    next = std::min(next, ((tick >> shift) + distance) << shift);
+  }
+
+  if (overflow != nullptr) {
+    unsigned int shift = wheel_slot_bits * (wheel_levels - 1);
+
+    next = std::min(next, ((tick >> shift) + 1) << shift);
+  }
+
+  tick = next;
+
+  for (unsigned int level = 1; level < wheel_levels; level++) {
+    unsigned int shift = wheel_slot_bits * level;
+
+    if (tick % (uint64_t(1) << shift) != 0)
+      return;
+
+    cascade(level, (tick >> shift) % wheel_slots);
+  }
+
+  cascade_overflow();
+}
+
+unsigned int
+Scheduler::Wheel::find_slot(unsigned int level, unsigned int first, unsigned int last) const {
+  while (first < last) {
+    uint64_t word = bitmap[level][first / 64] >> (first % 64);
+
+    if (word != 0) {
+      unsigned int found = first + __builtin_ctzll(word);
+      return std::min(found, last);
+    }
+
+    first = (first / 64 + 1) * 64;
+  }
+
+  return last;
+}
+
+// Searches the slots in the order they expire, starting at 'first'.
+unsigned int
+Scheduler::Wheel::find_slot_from(unsigned int level, unsigned int first) const {
+  unsigned int found = find_slot(level, first, wheel_slots);
+
+  if (found != wheel_slots)
+    return found;
+
+  return find_slot(level, 0, first);
+}
+
+Scheduler::time_type
+Scheduler::Wheel::find_next() const {
+  auto result = time_type::max();
+
+  auto min_of_list = [&result](SchedulerEntry* entry) {
+      for (; entry != nullptr; entry = entry->m_next)
+        result = std::min(result, entry->time());
+    };
+
+  // The first used slot of each level holds the earliest entries of
+  // that level. Higher levels skip the current slot as it was
+  // cascaded, any entries there are a full rotation later.
+  for (unsigned int level = 0; level < wheel_levels; level++) {
+    unsigned int current = (tick >> (wheel_slot_bits * level)) % wheel_slots;
+    unsigned int first = level == 0 ? current : (current + 1) % wheel_slots;
+    unsigned int found = find_slot_from(level, first);
+
+    if (slots[level][found] == nullptr)
+      continue;
+
+    min_of_list(slots[level][found]);
+  }
+
+  min_of_list(overflow);
+  min_of_list(expired);
+
+  return result;
+}
+
+Scheduler::Scheduler() = default;
+
+Scheduler::Scheduler(mode_type mode) {
+  set_mode(mode);
+}
+
+Scheduler::~Scheduler() = default;
+
+void
+Scheduler::set_mode(mode_type mode) {
+  if (!empty())
+    throw torrent::internal_error("Scheduler::set_mode(...) called on a non-empty scheduler.");
+
+  switch (mode) {
+  case MODE_HEAP:
+    m_wheel.reset();
+    break;
+  case MODE_WHEEL:
+    m_wheel = std::make_unique<Wheel>();
+    break;
+  default:
+    throw torrent::internal_error("Scheduler::set_mode(...) received an invalid mode.");
+  }
+
+  m_mode = mode;
+}
+
 inline void
 Scheduler::make_heap() {
-  std::make_heap(begin(), end(), [](const SchedulerEntry* a, const SchedulerEntry* b) {
+  std::make_heap(m_heap.begin(), m_heap.end(), [](const SchedulerEntry* a, const SchedulerEntry* b) {
       return a->time() > b->time();
     });
 }
 
 inline void
 Scheduler::push_heap() {
-  std::push_heap(begin(), end(), [](const SchedulerEntry* a, const SchedulerEntry* b) {
+  std::push_heap(m_heap.begin(), m_heap.end(), [](const SchedulerEntry* a, const SchedulerEntry* b) {
       return a->time() > b->time();
     });
 }
 
+void
+Scheduler::insert(SchedulerEntry* entry, time_type time) {
+  entry->set_scheduler(this);
+  entry->set_time(time);
+
+  m_size++;
+
+  if (m_mode == MODE_HEAP) {
+    m_heap.push_back(entry);
+    push_heap();
+    return;
+  }
+
+  // Start the wheel at the current time so entries don't pile up in
+  // the first slot.
+  if (m_size == 1)
+    m_wheel->tick = std::min(Wheel::tick_of(m_cached_time), Wheel::tick_of(time));
+
+  m_wheel->place(entry);
+
+  if (m_wheel->next_valid && time < m_wheel->next)
+    m_wheel->next = time;
+}
+
+void
+Scheduler::remove(SchedulerEntry* entry) {
+  if (m_mode == MODE_HEAP) {
+    auto itr = std::find(m_heap.begin(), m_heap.end(), entry);
+
+    if (itr == m_heap.end())
+      throw torrent::internal_error("Scheduler::erase(...) could not find item in queue.");
+
+    m_heap.erase(itr);
+    make_heap();
+
+  } else {
+    if (entry->m_pprev == nullptr)
+      throw torrent::internal_error("Scheduler::erase(...) could not find item in queue.");
+
+    m_wheel->unlink(entry);
+
+    if (m_wheel->next_valid && entry->time() <= m_wheel->next)
+      m_wheel->next_valid = false;
+  }
+
+  m_size--;
+
+  entry->set_scheduler(nullptr);
+  entry->set_time(Scheduler::time_type{});
+}
+
 Scheduler::time_type
 Scheduler::next_timeout() const {
   assert(!empty());
 
-  return std::max(front()->time() - m_cached_time, Scheduler::time_type());
+  if (m_mode == MODE_HEAP)
+    return std::max(m_heap.front()->time() - m_cached_time, Scheduler::time_type());
+
+  if (!m_wheel->next_valid) {
+    m_wheel->next = m_wheel->find_next();
+    m_wheel->next_valid = true;
+  }
+
+  return std::max(m_wheel->next - m_cached_time, Scheduler::time_type());
 }
 
 // We can't make erase/update part of SchedulerItem in case another thread tries to call the
@@ -58,18 +361,7 @@ Scheduler::erase(SchedulerEntry* entry) {
   if (entry->scheduler() != this)
     throw torrent::internal_error("Scheduler::erase(...) called on an entry that is in another scheduler.");
 
-  auto itr = std::find_if(begin(), end(), [entry](const SchedulerEntry* e) {
-      return e == entry;
-    });
-
-  if (itr == end())
-    throw torrent::internal_error("Scheduler::erase(...) could not find item in queue.");
-
-  entry->set_scheduler(nullptr);
-  entry->set_time(Scheduler::time_type{});
-
-  base_type::erase(itr);
-  make_heap();
+  remove(entry);
 }
 
 void
@@ -88,11 +380,7 @@ Scheduler::wait_until(SchedulerEntry* entry, Scheduler::time_type time) {
   if (entry->is_scheduled())
     throw torrent::internal_error("Scheduler::wait_until(...) called on an already scheduled entry.");
 
-  entry->set_scheduler(this);
-  entry->set_time(time);
-
-  base_type::push_back(entry);
-  push_heap();
+  insert(entry, time);
 }
 
 void
@@ -128,16 +416,16 @@ Scheduler::update_wait_until(SchedulerEntry* entry, Scheduler::time_type time) {
     if (entry->scheduler() != this)
       throw torrent::internal_error("Scheduler::update_wait(...) called on an entry that is in another scheduler.");
 
-    entry->set_time(time);
-    make_heap();
-    return;
-  }
+    if (m_mode == MODE_HEAP) {
+      entry->set_time(time);
+      make_heap();
+      return;
+    }
 
-  entry->set_scheduler(this);
-  entry->set_time(time);
+    remove(entry);
+  }
 
-  base_type::push_back(entry);
-  push_heap();
+  insert(entry, time);
 }
 
 void
@@ -158,13 +446,25 @@ Scheduler::update_wait_for_ceil_seconds(SchedulerEntry* entry, Scheduler::time_t
 
 void
 Scheduler::perform(Scheduler::time_type current_time) {
-  while (!empty() && base_type::front()->time() <= current_time) {
-    auto entry = base_type::front();
+  if (m_mode == MODE_HEAP)
+    perform_heap(current_time);
+  else
+    perform_wheel(current_time);
+}
+
+void
+Scheduler::perform_heap(Scheduler::time_type current_time) {
+  while (!m_heap.empty() && m_heap.front()->time() <= current_time) {
+    auto entry = m_heap.front();
 
-    std::pop_heap(begin(), end(), [](const SchedulerEntry* a, const SchedulerEntry* b) {
+    std::pop_heap(m_heap.begin(), m_heap.end(), [](const SchedulerEntry* a, const SchedulerEntry* b) {
         return a->time() > b->time();
       });
-    base_type::pop_back();
+    m_heap.pop_back();
+    m_size--;
+
+    if (m_lateness != nullptr)
+      m_lateness->insert(current_time - entry->time());
 
     entry->set_scheduler(nullptr);
     entry->set_time(Scheduler::time_type{});
@@ -172,4 +472,61 @@ Scheduler::perform(Scheduler::time_type current_time) {
   }
 }
 
+// Due entries in the current slot are moved to the expired list, sorted
+// by time, and called in order. The expired list keeps them erasable
+// by earlier callbacks in the same batch.
+void
+Scheduler::perform_wheel(Scheduler::time_type current_time) {
+  auto& wheel = *m_wheel;
+  uint64_t target = Wheel::tick_of(current_time);
+
+  wheel.next_valid = false;
+
+  while (true) {
+    for (auto entry = wheel.slots[0][wheel.tick % wheel_slots]; entry != nullptr; entry = entry->m_next)
+      if (entry->time() <= current_time)
+        wheel.batch.push_back(entry);
+
+    if (!wheel.batch.empty()) {
+      std::sort(wheel.batch.begin(), wheel.batch.end(), [](const SchedulerEntry* a, const SchedulerEntry* b) {
+          return a->time() < b->time();
+        });
+
+      for (auto itr = wheel.batch.rbegin(); itr != wheel.batch.rend(); itr++) {
+        wheel.unlink(*itr);
+        wheel.link(&wheel.expired, *itr);
+      }
+
+      wheel.batch.clear();
+
+      while (wheel.expired != nullptr) {
+        auto entry = wheel.expired;
+
+        wheel.unlink(entry);
+        m_size--;
+
+        if (m_lateness != nullptr)
+          m_lateness->insert(current_time - entry->time());
+
+        entry->set_scheduler(nullptr);
+        entry->set_time(Scheduler::time_type{});
+        entry->slot()();
+      }
+
+      // Callbacks may have added entries that are already due.
+      continue;
+    }
+
+    if (wheel.tick >= target)
+      break;
+
+    if (empty()) {
+      wheel.tick = target;
+      break;
+    }
+
+    wheel.advance(target);
+  }
+}
+
 } // namespace torrent::utils
@@ -3,25 +3,47 @@
 
 #include <atomic>
 #include <functional>
+#include <memory>
 #include <thread>
 #include <vector>
 #include <torrent/common.h>
 
 namespace torrent::utils {
 
-class LIBTORRENT_EXPORT Scheduler : public std::vector<SchedulerEntry*> {
+class latency_histogram;
+
+// The heap keeps entries ordered with O(log n) inserts, while erase
+// and update need a linear search. The timer wheel buckets entries by
+// millisecond ticks in four levels of 256 slots with an overflow list,
+// for O(1) insert and erase. Entries that expire together are sorted
+// by time before being called, so both modes call entries in the same
+// order.
+//
+// The mode can only be changed while the scheduler is empty.
+
+class LIBTORRENT_EXPORT Scheduler {
 public:
-  using base_type = std::vector<SchedulerEntry*>;
   using time_type = std::chrono::microseconds;
 
-  using base_type::begin;
-  using base_type::end;
-  using base_type::front;
-  using base_type::size;
-  using base_type::empty;
-  using base_type::clear;
+  enum mode_type {
+    MODE_HEAP,
+    MODE_WHEEL
+  };
+
+  static constexpr unsigned int wheel_levels    = 4;
+  static constexpr unsigned int wheel_slot_bits = 8;
+  static constexpr unsigned int wheel_slots     = 1 << wheel_slot_bits;
+  static constexpr time_type    wheel_tick{1000};
+
+  Scheduler();
+  explicit Scheduler(mode_type mode);
+  ~Scheduler();
 
-  ~Scheduler() = default;
+  mode_type           mode() const { return m_mode; }
+  void                set_mode(mode_type mode);
+
+  bool                empty() const { return m_size == 0; }
+  size_t              size() const  { return m_size; }
 
   // time_type is microseconds since unix epoch.
   time_type           next_timeout() const;
@@ -44,12 +66,34 @@ protected:
   void                set_thread_id(std::thread::id id) { m_thread_id = id; }
   void                set_cached_time(time_type t)      { m_cached_time = t; }
 
+  // How late entries are called is recorded in 'h' unless null.
+  void                set_lateness_histogram(latency_histogram* h) { m_lateness = h; }
+
 private:
+  struct Wheel;
+
+  Scheduler(const Scheduler&) = delete;
+  Scheduler& operator=(const Scheduler&) = delete;
+
+  void                insert(SchedulerEntry* entry, time_type time);
+  void                remove(SchedulerEntry* entry);
+
   void                make_heap();
   void                push_heap();
 
+  void                perform_heap(time_type time);
+  void                perform_wheel(time_type time);
+
+  mode_type                    m_mode{MODE_HEAP};
+  size_t                       m_size{0};
+
+  std::vector<SchedulerEntry*> m_heap;
+  std::unique_ptr<Wheel>       m_wheel;
+
   std::atomic<std::thread::id> m_thread_id{};
   time_type                    m_cached_time{};
+
+  latency_histogram*           m_lateness{};
 };
 
 class LIBTORRENT_EXPORT SchedulerEntry {
@@ -79,6 +123,10 @@ private:
   slot_type           m_slot;
   Scheduler*          m_scheduler{};
   time_type           m_time{};
+
+  // Only used by the timer wheel.
+  SchedulerEntry*     m_next{};
+  SchedulerEntry**    m_pprev{};
 };
 
 class LIBTORRENT_EXPORT ExternalScheduler : public Scheduler {
@@ -0,0 +1,381 @@
+#include "config.h"
+
+#include "torrent/utils/session_store.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cinttypes>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "torrent/exceptions.h"
+#include "torrent/utils/log.h"
+#include "utils/siphash.h"
+
+#define LT_LOG(log_fmt, ...)                                            \
+  lt_log_print(LOG_RESUME_DATA, "session_store: " log_fmt, __VA_ARGS__);
+
+namespace torrent {
+
+// Records are padded to keep their headers aligned.
+static uint64_t
+record_size(uint32_t length) {
+  return (sizeof(SessionStore::record_header_type) + length + 7) & ~uint64_t(7);
+}
+
+// Covers everything in the record after the checksum itself.
+static uint64_t
+record_checksum(const SessionStore::record_header_type* header) {
+  auto first = reinterpret_cast<const char*>(header) + sizeof(header->checksum);
+
+  return SipHash().hash(first, sizeof(SessionStore::record_header_type) - sizeof(header->checksum) + header->length);
+}
+
+static uint64_t
+commit_checksum(const SessionStore::commit_type& commit) {
+  uint64_t words[2] = { commit.generation, commit.end };
+
+  return SipHash().hash(words, sizeof(words));
+}
+
+static void
+throw_storage_error(const char* msg, const std::string& path) {
+  throw storage_error(std::string(msg) + " '" + path + "': " + std::strerror(errno));
+}
+
+SessionStore::~SessionStore() {
+  try {
+    close();
+  } catch (const storage_error& e) {
+    LT_LOG("could not close (path:%s error:'%s')", m_path.c_str(), e.what());
+    unmap();
+  }
+}
+
+void
+SessionStore::open(const std::string& path) {
+  close();
+
+  int fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+
+  if (fd == -1)
+    throw_storage_error("Could not open session store", path);
+
+  struct stat st;
+
+  if (fstat(fd, &st) == -1) {
+    ::close(fd);
+    throw_storage_error("Could not stat session store", path);
+  }
+
+  m_fd   = fd;
+  m_path = path;
+
+  auto file_size = static_cast<uint64_t>(st.st_size);
+
+  map(std::max(min_capacity, file_size));
+
+  // A file created by a session that crashed before its first commit
+  // may still be zeroed.
+  if (file_size == 0 || header()->magic == 0) {
+    *header() = header_type{magic, version, sizeof(record_header_type), 0, {}};
+
+    m_end = m_committed = sizeof(header_type);
+    m_generation = 0;
+
+    commit();
+
+    LT_LOG("created (path:%s)", path.c_str());
+    return;
+  }
+
+  if (file_size < sizeof(header_type) ||
+      header()->magic != magic ||
+      header()->version != version ||
+      header()->record_header_size != sizeof(record_header_type)) {
+    unmap();
+    throw storage_error("Invalid session store '" + path + "'");
+  }
+
+  scan();
+
+  LT_LOG("opened (path:%s generation:%" PRIu64 " downloads:%zu length:%" PRIu64 " live:%" PRIu64 ")",
+         path.c_str(), m_generation, m_index.size(), m_end, m_live);
+}
+
+void
+SessionStore::close() {
+  if (!is_open())
+    return;
+
+  checkpoint();
+  unmap();
+}
+
+std::vector<HashString>
+SessionStore::hashes() const {
+  std::vector<HashString> result;
+  result.reserve(m_index.size());
+
+  for (const auto& entry : m_index)
+    result.push_back(entry.first);
+
+  return result;
+}
+
+bool
+SessionStore::read(const HashString& hash, section_type section, std::string& data) const {
+  auto itr = m_index.find(hash);
+
+  if (itr == m_index.end() || section >= section_count || itr->second[section] == no_record)
+    return false;
+
+  auto header = record(itr->second[section]);
+
+  data.assign(reinterpret_cast<const char*>(header + 1), header->length);
+  return true;
+}
+
+void
+SessionStore::write(const HashString& hash, section_type section, const char* data, uint32_t length) {
+  if (!is_open())
+    throw internal_error("SessionStore::write() called on a closed store.");
+
+  if (section >= section_count)
+    throw input_error("Invalid session store section.");
+
+  auto& offsets = m_index[hash];
+
+  if (offsets[section] != no_record) {
+    auto header = record(offsets[section]);
+
+    if (header->length == length && (length == 0 || std::memcmp(header + 1, data, length) == 0))
+      return;
+
+    m_live -= record_size(header->length);
+  }
+
+  offsets[section] = append(hash, section, data, length);
+  m_live += record_size(length);
+}
+
+void
+SessionStore::erase(const HashString& hash) {
+  if (!is_open())
+    throw internal_error("SessionStore::erase() called on a closed store.");
+
+  auto itr = m_index.find(hash);
+
+  if (itr == m_index.end())
+    return;
+
+  for (auto offset : itr->second)
+    if (offset != no_record)
+      m_live -= record_size(record(offset)->length);
+
+  m_index.erase(itr);
+  append(hash, section_erase, nullptr, 0);
+}
+
+void
+SessionStore::checkpoint() {
+  if (!is_open() || m_end == m_committed)
+    return;
+
+  if (m_end >= min_compact_length && m_live * 2 < m_end - sizeof(header_type)) {
+    compact();
+    return;
+  }
+
+  auto page_mask = static_cast<uint64_t>(sysconf(_SC_PAGESIZE)) - 1;
+  auto first     = m_committed & ~page_mask;
+
+  if (msync(m_data + first, m_end - first, MS_SYNC) == -1 || fdatasync(m_fd) == -1)
+    throw_storage_error("Could not sync session store", m_path);
+
+  commit();
+}
+
+// The live records are copied to a new store which replaces this one
+// once it is complete, so a crash leaves one of the two intact.
+void
+SessionStore::compact() {
+  if (!is_open())
+    throw internal_error("SessionStore::compact() called on a closed store.");
+
+  std::string path      = m_path;
+  std::string temp_path = m_path + ".tmp";
+  uint64_t    old_end   = m_end;
+
+  ::unlink(temp_path.c_str());
+
+  {
+    SessionStore compacted;
+    compacted.open(temp_path);
+
+    for (const auto& entry : m_index) {
+      for (int section = 0; section != section_count; section++) {
+        if (entry.second[section] == no_record)
+          continue;
+
+        auto header = record(entry.second[section]);
+        compacted.write(entry.first, static_cast<section_type>(section), reinterpret_cast<const char*>(header + 1), header->length);
+      }
+    }
+
+    compacted.close();
+  }
+
+  if (::rename(temp_path.c_str(), path.c_str()) == -1)
+    throw_storage_error("Could not replace session store", path);
+
+  unmap();
+  open(path);
+
+  LT_LOG("compacted (path:%s length:%" PRIu64 " old_length:%" PRIu64 ")", path.c_str(), m_end, old_end);
+}
+
+void
+SessionStore::map(uint64_t capacity) {
+  if (m_data != nullptr)
+    munmap(m_data, m_capacity);
+
+  m_data = nullptr;
+
+  struct stat st;
+
+  if (fstat(m_fd, &st) == -1 ||
+      (static_cast<uint64_t>(st.st_size) < capacity && ftruncate(m_fd, capacity) == -1))
+    throw_storage_error("Could not resize session store", m_path);
+
+  void* ptr = mmap(nullptr, capacity, PROT_READ | PROT_WRITE, MAP_SHARED, m_fd, 0);
+
+  if (ptr == MAP_FAILED)
+    throw_storage_error("Could not map session store", m_path);
+
+  m_data     = static_cast<char*>(ptr);
+  m_capacity = capacity;
+}
+
+void
+SessionStore::unmap() {
+  if (m_data != nullptr)
+    munmap(m_data, m_capacity);
+
+  if (m_fd != -1)
+    ::close(m_fd);
+
+  m_fd         = -1;
+  m_data       = nullptr;
+  m_capacity   = 0;
+  m_end        = 0;
+  m_live       = 0;
+  m_committed  = 0;
+  m_generation = 0;
+
+  m_index.clear();
+}
+
+// Replays the log up to the latest valid commit, stopping early at a
+// damaged record.
+void
+SessionStore::scan() {
+  const commit_type* latest = nullptr;
+
+  for (const auto& commit : header()->commits) {
+    if (commit.checksum != commit_checksum(commit) ||
+        commit.end < sizeof(header_type) || commit.end > m_capacity)
+      continue;
+
+    if (latest == nullptr || commit.generation > latest->generation)
+      latest = &commit;
+  }
+
+  uint64_t end    = latest != nullptr ? latest->end : sizeof(header_type);
+  uint64_t offset = sizeof(header_type);
+
+  m_generation = latest != nullptr ? latest->generation : 0;
+
+  while (offset + sizeof(record_header_type) <= end) {
+    auto header = record(offset);
+
+    if (header->length > end - offset - sizeof(record_header_type) ||
+        header->checksum != record_checksum(header)) {
+      LT_LOG("damaged record, discarding the rest of the log (path:%s offset:%" PRIu64 ")", m_path.c_str(), offset);
+      break;
+    }
+
+    auto hash = *HashString::cast_from(header->hash);
+
+    if (header->section == section_erase) {
+      auto itr = m_index.find(hash);
+
+      if (itr != m_index.end()) {
+        for (auto old : itr->second)
+          if (old != no_record)
+            m_live -= record_size(record(old)->length);
+
+        m_index.erase(itr);
+      }
+
+    } else if (header->section < section_count) {
+      auto& old = m_index[hash][header->section];
+
+      if (old != no_record)
+        m_live -= record_size(record(old)->length);
+
+      old = offset;
+      m_live += record_size(header->length);
+    }
+
+    offset += record_size(header->length);
+  }
+
+  m_end = m_committed = offset;
+}
+
+uint64_t
+SessionStore::append(const HashString& hash, uint16_t section, const char* data, uint32_t length) {
+  uint64_t size = record_size(length);
+
+  if (m_end + size > m_capacity)
+    map(std::max(m_capacity * 2, m_end + size));
+
+  auto header = record(m_end);
+
+  std::memset(header, 0, size);
+  std::memcpy(header->hash, hash.data(), sizeof(header->hash));
+  header->section = section;
+  header->length  = length;
+
+  if (length != 0)
+    std::memcpy(header + 1, data, length);
+
+  header->checksum = record_checksum(header);
+
+  uint64_t offset = m_end;
+  m_end += size;
+
+  return offset;
+}
+
+// Commits alternate between the two slots, so the last good one
+// survives a torn write of the header.
+void
+SessionStore::commit() {
+  commit_type commit{m_generation + 1, m_end, 0};
+  commit.checksum = commit_checksum(commit);
+
+  header()->commits[commit.generation % 2] = commit;
+
+  if (msync(m_data, sizeof(header_type), MS_SYNC) == -1)
+    throw_storage_error("Could not sync session store", m_path);
+
+  m_generation = commit.generation;
+  m_committed  = m_end;
+}
+
+}
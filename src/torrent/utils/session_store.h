@@ -0,0 +1,145 @@
+#ifndef LIBTORRENT_UTILS_SESSION_STORE_H
+#define LIBTORRENT_UTILS_SESSION_STORE_H
+
+#include <array>
+#include <map>
+#include <string>
+#include <vector>
+#include <torrent/common.h>
+#include <torrent/exceptions.h>
+#include <torrent/hash_string.h>
+
+namespace torrent {
+
+// The resume state of all downloads in a single memory-mapped file,
+// rather than one file per download, so that saving thousands of
+// downloads is a few appends and one sync instead of thousands of
+// file writes.
+//
+// The file is an append-only log of records, each holding one binary
+// section of a download. The latest record of a section replaces the
+// older ones, and erasing a download appends a record that drops all
+// its sections. Writing a section with unchanged data appends nothing.
+//
+// Records are only durable once 'checkpoint' has synced them and then
+// committed the new end of the log to the header. The header keeps
+// two commit slots written alternately, so a crash during a checkpoint
+// leaves the previous one intact, and on open everything after the
+// last commit is discarded.
+//
+// When more than half of the log is replaced records, 'checkpoint'
+// compacts it by writing the live records to a new file that is then
+// renamed over the old one.
+//
+// Numbers are stored in native byte order.
+
+class LIBTORRENT_EXPORT SessionStore {
+public:
+  enum section_type : uint16_t {
+    section_bitfield,
+    section_file_priorities,
+    section_peers,
+    section_count
+  };
+
+  static constexpr uint32_t magic   = 0x5353544c;  // "LTSS"
+  static constexpr uint32_t version = 1;
+
+  static constexpr uint64_t min_capacity       = 1 << 20;
+  static constexpr uint64_t min_compact_length = 1 << 20;
+
+  SessionStore() = default;
+  ~SessionStore();
+  SessionStore(const SessionStore&) = delete;
+  SessionStore& operator=(const SessionStore&) = delete;
+
+  bool                is_open() const { return m_data != nullptr; }
+  const std::string&  path() const    { return m_path; }
+
+  // Opens the store, creating the file if needed, and reads back the
+  // records of the last checkpoint. Throws storage_error.
+  void                open(const std::string& path);
+
+  // Checkpoints before closing.
+  void                close();
+
+  size_t              size() const { return m_index.size(); }
+  bool                has(const HashString& hash) const { return m_index.find(hash) != m_index.end(); }
+
+  std::vector<HashString> hashes() const;
+
+  // Copies the data out of the mapping, as appending may remap it.
+  // Returns false if the section was never written.
+  bool                read(const HashString& hash, section_type section, std::string& data) const;
+
+  void                write(const HashString& hash, section_type section, const char* data, uint32_t length);
+  void                erase(const HashString& hash);
+
+  void                checkpoint();
+  void                compact();
+
+  // Bytes used by the log, by its live records and at the last commit.
+  uint64_t            length() const           { return m_end; }
+  uint64_t            live_length() const      { return m_live; }
+  uint64_t            committed_length() const { return m_committed; }
+
+  // For internal usage.
+  struct commit_type {
+    uint64_t generation;
+    uint64_t end;
+    uint64_t checksum;
+  };
+
+  struct header_type {
+    uint32_t    magic;
+    uint32_t    version;
+    uint32_t    record_header_size;
+    uint32_t    reserved;
+    commit_type commits[2];
+  };
+
+  struct record_header_type {
+    uint64_t checksum;
+    char     hash[HashString::size_data];
+    uint32_t length;
+    uint16_t section;
+    uint16_t reserved;
+    uint32_t padding;
+  };
+
+  static_assert(sizeof(header_type) == 64, "SessionStore::header_type has invalid size.");
+  static_assert(sizeof(record_header_type) == 40, "SessionStore::record_header_type has invalid size.");
+
+private:
+  static constexpr uint16_t section_erase = 0xffff;
+  static constexpr uint64_t no_record = 0;
+
+  using offset_list = std::array<uint64_t, section_count>;
+  using index_map   = std::map<HashString, offset_list>;
+
+  header_type*        header() const { return reinterpret_cast<header_type*>(m_data); }
+  record_header_type* record(uint64_t offset) const { return reinterpret_cast<record_header_type*>(m_data + offset); }
+
+  void                map(uint64_t capacity);
+  void                unmap();
+  void                scan();
+
+  uint64_t            append(const HashString& hash, uint16_t section, const char* data, uint32_t length);
+  void                commit();
+
+  std::string         m_path;
+  int                 m_fd{-1};
+  char*               m_data{nullptr};
+  uint64_t            m_capacity{0};
+
+  uint64_t            m_end{0};
+  uint64_t            m_live{0};
+  uint64_t            m_committed{0};
+  uint64_t            m_generation{0};
+
+  index_map           m_index;
+};
+
+}
+
+#endif
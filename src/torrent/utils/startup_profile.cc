@@ -0,0 +1,153 @@
+#include "config.h"
+
+#include "torrent/utils/startup_profile.h"
+
+#include <algorithm>
+#include <map>
+#include <mutex>
+
+#include "torrent/exceptions.h"
+
+namespace torrent::utils {
+
+namespace {
+
+struct startup_entry {
+  std::array<std::chrono::microseconds, startup_phase_count>            phase_time{};
+  std::array<std::chrono::steady_clock::time_point, startup_phase_count> phase_begin{};
+};
+
+std::mutex                           startup_lock;
+std::map<std::string, startup_entry> startup_entries;
+
+thread_local bool                    startup_scope_active{false};
+
+void
+verify_phase(startup_phase phase) {
+  if (phase >= startup_phase_count)
+    throw internal_error("utils::startup_profile: invalid phase.");
+}
+
+}
+
+const char*
+startup_phase_name(startup_phase phase) {
+  static const char* names[startup_phase_count] = {
+    "initialize", "dht_bootstrap", "parse", "resume", "open", "hash_check", "first_announce"
+  };
+
+  verify_phase(phase);
+  return names[phase];
+}
+
+std::chrono::microseconds
+startup_download::total() const {
+  std::chrono::microseconds sum{};
+
+  for (auto t : phase_time)
+    sum += t;
+
+  return sum;
+}
+
+startup_report
+startup_profile_report(size_t top) {
+  std::lock_guard<std::mutex> guard(startup_lock);
+
+  startup_report report;
+
+  for (const auto& [key, entry] : startup_entries) {
+    for (unsigned int phase = 0; phase != startup_phase_count; phase++) {
+      if (entry.phase_time[phase] == std::chrono::microseconds{})
+        continue;
+
+      report.phase_time[phase] += entry.phase_time[phase];
+      report.phase_count[phase]++;
+    }
+
+    if (key.empty())
+      continue;
+
+    report.downloads++;
+    report.slowest.push_back(startup_download{key, entry.phase_time});
+  }
+
+  auto slower = [](const startup_download& a, const startup_download& b) { return a.total() > b.total(); };
+
+  if (report.slowest.size() > top) {
+    std::partial_sort(report.slowest.begin(), report.slowest.begin() + top, report.slowest.end(), slower);
+    report.slowest.resize(top);
+  } else {
+    std::sort(report.slowest.begin(), report.slowest.end(), slower);
+  }
+
+  return report;
+}
+
+void
+startup_profile_clear() {
+  std::lock_guard<std::mutex> guard(startup_lock);
+  startup_entries.clear();
+}
+
+void
+startup_record(const std::string& key, startup_phase phase, std::chrono::microseconds time) {
+  verify_phase(phase);
+
+  std::lock_guard<std::mutex> guard(startup_lock);
+  startup_entries[key].phase_time[phase] += time;
+}
+
+void
+startup_begin(const std::string& key, startup_phase phase) {
+  verify_phase(phase);
+
+  std::lock_guard<std::mutex> guard(startup_lock);
+  startup_entries[key].phase_begin[phase] = std::chrono::steady_clock::now();
+}
+
+// Only the first end after a begin counts.
+void
+startup_end(const std::string& key, startup_phase phase) {
+  verify_phase(phase);
+
+  std::lock_guard<std::mutex> guard(startup_lock);
+
+  auto itr = startup_entries.find(key);
+
+  if (itr == startup_entries.end())
+    return;
+
+  auto& begin = itr->second.phase_begin[phase];
+
+  if (begin == std::chrono::steady_clock::time_point{})
+    return;
+
+  itr->second.phase_time[phase] += std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - begin);
+  begin = std::chrono::steady_clock::time_point{};
+}
+
+startup_scope::startup_scope(const std::string& key, startup_phase phase) :
+  m_key(key),
+  m_phase(phase),
+  m_start(std::chrono::steady_clock::now()),
+  m_nested(startup_scope_active) {
+
+  startup_scope_active = true;
+}
+
+startup_scope::~startup_scope() {
+  if (m_nested)
+    return;
+
+  startup_scope_active = false;
+  startup_record(m_key, m_phase, std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - m_start));
+}
+
+void
+startup_erase(const std::string& key) {
+  std::lock_guard<std::mutex> guard(startup_lock);
+  startup_entries.erase(key);
+}
+
+}
@@ -0,0 +1,81 @@
+#ifndef LIBTORRENT_UTILS_STARTUP_PROFILE_H
+#define LIBTORRENT_UTILS_STARTUP_PROFILE_H
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <torrent/common.h>
+
+namespace torrent::utils {
+
+// Time spent in the phases of starting the library and each download,
+// to tell what dominates a cold start. Always recorded, with downloads
+// keyed by info hash and dropped when removed.
+//
+// A phase run more than once, e.g. resume data loaded by parts, adds
+// up. Phases waiting on the network or the hash queue count from
+// their start to the first result. Safe to use from any thread.
+
+enum startup_phase : unsigned int {
+  startup_initialize,       // torrent::initialize, not per download.
+  startup_dht_bootstrap,    // Until the DHT routing table is filled, not per download.
+  startup_parse,            // download_prepare.
+  startup_resume,           // The resume_load_* functions.
+  startup_open,             // Download::open.
+  startup_hash_check,       // Download::hash_check until checked.
+  startup_first_announce,   // Download::start until the first tracker reply.
+  startup_phase_count
+};
+
+const char* startup_phase_name(startup_phase phase) LIBTORRENT_EXPORT;
+
+struct startup_download {
+  std::chrono::microseconds total() const;
+
+  std::string                                                 info_hash;
+  std::array<std::chrono::microseconds, startup_phase_count> phase_time{};
+};
+
+struct startup_report {
+  // Summed over the library and all downloads, with the number of
+  // downloads, or one, having spent time in each.
+  std::array<std::chrono::microseconds, startup_phase_count> phase_time{};
+  std::array<uint32_t, startup_phase_count>                  phase_count{};
+
+  uint32_t                                                    downloads{0};
+
+  // The downloads with the largest total time, slowest first.
+  std::vector<startup_download>                               slowest;
+};
+
+startup_report startup_profile_report(size_t top = 10) LIBTORRENT_EXPORT;
+void           startup_profile_clear() LIBTORRENT_EXPORT;
+
+// For internal usage. An empty key is the library itself.
+void           startup_record(const std::string& key, startup_phase phase, std::chrono::microseconds time);
+void           startup_begin(const std::string& key, startup_phase phase);
+void           startup_end(const std::string& key, startup_phase phase);
+void           startup_erase(const std::string& key);
+
+// Records the time until destroyed. Scopes nested in another on the
+// same thread are ignored, so they don't count twice.
+class startup_scope {
+public:
+  startup_scope(const std::string& key, startup_phase phase);
+  ~startup_scope();
+
+  startup_scope(const startup_scope&) = delete;
+  startup_scope& operator=(const startup_scope&) = delete;
+
+private:
+  std::string                           m_key;
+  startup_phase                         m_phase;
+  std::chrono::steady_clock::time_point m_start;
+  bool                                  m_nested;
+};
+
+}
+
+#endif
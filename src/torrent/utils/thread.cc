@@ -2,12 +2,23 @@
 
 #include "torrent/utils/thread.h"
 
+#include <algorithm>
 #include <cassert>
+#include <cctype>
+#include <cerrno>
+#include <chrono>
 #include <cstring>
+#include <fstream>
 #include <mutex>
 #include <signal.h>
 #include <unistd.h>
 
+#ifdef USE_THREAD_AFFINITY
+#include <sched.h>
+#include <sys/syscall.h>
+#include <linux/mempolicy.h>
+#endif
+
 #include "globals.h"
 #include "torrent/exceptions.h"
 #include "torrent/poll.h"
@@ -21,6 +32,36 @@ namespace torrent::utils {
 
 thread_local Thread* Thread::m_self{nullptr};
 
+#ifdef USE_THREAD_AFFINITY
+constexpr int max_numa_nodes = 1024;
+#endif
+
+namespace {
+
+// Durations use the monotonic clock, unlike the cached time.
+std::chrono::microseconds
+stats_now() {
+  return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now().time_since_epoch());
+}
+
+void
+stats_merge(thread_stats& target, const thread_stats& source) {
+  target.loop_time.merge(source.loop_time);
+  target.callback_time.merge(source.callback_time);
+  target.timer_lateness.merge(source.timer_lateness);
+
+  for (unsigned int i = 0; i < thread_stats::depth_bucket_count; i++)
+    target.callback_depth[i] += source.callback_depth[i];
+
+  target.callback_depth_max = std::max(target.callback_depth_max, source.callback_depth_max);
+
+  for (const auto& [type, histogram] : source.handler_time)
+    if (histogram.total_count() != 0)
+      target.handler_time[type].merge(histogram);
+}
+
+}
+
 class ThreadInternal {
 public:
   static std::chrono::microseconds cached_time()    { return Thread::m_self->m_cached_time; }
@@ -34,7 +75,7 @@ Thread::Thread() :
   m_instrumentation_index(INSTRUMENTATION_POLLING_DO_POLL_OTHERS - INSTRUMENTATION_POLLING_DO_POLL),
   m_scheduler(std::make_unique<Scheduler>()) {
 
-  std::tie(m_interrupt_sender, m_interrupt_receiver) = SignalInterrupt::create_pair();
+  m_interrupt = SignalInterrupt::create();
 
   m_cached_time = time_since_epoch();
   m_scheduler->set_cached_time(m_cached_time);
@@ -80,12 +121,82 @@ Thread::stop_thread_wait() {
   assert(is_inactive());
 }
 
+void
+Thread::set_cpu_affinity(std::vector<unsigned int> cpus) {
+  if (is_active())
+    throw internal_error("Thread::set_cpu_affinity(...) called on an active thread.");
+
+  std::sort(cpus.begin(), cpus.end());
+  cpus.erase(std::unique(cpus.begin(), cpus.end()), cpus.end());
+
+  m_cpu_affinity = std::move(cpus);
+}
+
+void
+Thread::set_numa_node(int node) {
+  if (is_active())
+    throw internal_error("Thread::set_numa_node(...) called on an active thread.");
+
+  m_numa_node = std::max(node, -1);
+}
+
+std::vector<unsigned int>
+Thread::parse_cpu_list(const std::string& str) {
+  std::vector<unsigned int> result;
+
+  auto parse_number = [&str](size_t* pos) {
+      size_t first = *pos;
+      unsigned long value = 0;
+
+      while (*pos < str.size() && std::isdigit(static_cast<unsigned char>(str[*pos])))
+        value = value * 10 + (str[(*pos)++] - '0');
+
+      if (*pos == first || value > 0xffff)
+        throw input_error("Invalid cpu list: '" + str + "'");
+
+      return static_cast<unsigned int>(value);
+    };
+
+  size_t last = str.find_last_not_of(" \n");
+  size_t pos = 0;
+
+  if (last == std::string::npos)
+    return result;
+
+  while (pos <= last) {
+    unsigned int first_cpu = parse_number(&pos);
+    unsigned int last_cpu = first_cpu;
+
+    if (pos <= last && str[pos] == '-') {
+      pos++;
+      last_cpu = parse_number(&pos);
+
+      if (last_cpu < first_cpu)
+        throw input_error("Invalid cpu list: '" + str + "'");
+    }
+
+    for (unsigned int cpu = first_cpu; cpu <= last_cpu; cpu++)
+      result.push_back(cpu);
+
+    if (pos > last)
+      break;
+
+    if (str[pos++] != ',' || pos > last)
+      throw input_error("Invalid cpu list: '" + str + "'");
+  }
+
+  std::sort(result.begin(), result.end());
+  result.erase(std::unique(result.begin(), result.end()), result.end());
+
+  return result;
+}
+
 void
 Thread::callback(void* target, std::function<void ()>&& fn) {
   {
     auto lock = std::scoped_lock(m_callbacks_lock);
 
-    m_callbacks.emplace(target, std::move(fn));
+    m_callbacks.push(target, std::move(fn));
   }
 
   interrupt();
@@ -96,7 +207,7 @@ Thread::callback_interrupt_pollling(void* target, std::function<void ()>&& fn) {
   {
     auto lock = std::scoped_lock(m_callbacks_lock);
 
-    m_interrupt_callbacks.emplace(target, std::move(fn));
+    m_interrupt_callbacks.push(target, std::move(fn));
     m_callbacks_should_interrupt_polling = true;
   }
 
@@ -110,8 +221,8 @@ Thread::cancel_callback(void* target) {
 
   auto lock = std::scoped_lock(m_callbacks_lock);
 
-  m_callbacks.erase(target);
-  m_interrupt_callbacks.erase(target);
+  m_callbacks.cancel(target);
+  m_interrupt_callbacks.cancel(target);
 }
 
 void
@@ -123,11 +234,14 @@ Thread::cancel_callback_and_wait(void* target) {
 }
 
 // Fix interrupting when shutting down thread.
+//
+// Only poke when the thread may block in do_poll. The event loop sets
+// flag_polling before its last pass over the events, so work queued
+// before this check is seen either way.
 void
 Thread::interrupt() {
-  // Only poke when polling, set no_timeout
   if (is_polling())
-    m_interrupt_sender->poke();
+    m_interrupt->poke();
 }
 
 bool
@@ -152,9 +266,16 @@ Thread::event_loop() {
 
   try {
 
-    m_poll->insert_read(m_interrupt_receiver.get());
+    m_poll->insert_read(m_interrupt.get());
 
     while (true) {
+      trace_span loop_span("loop");
+
+      m_watchdog_progress.fetch_add(1, std::memory_order_relaxed);
+
+      bool stats_enabled = m_stats_enabled;
+      auto loop_start = stats_enabled ? stats_now() : std::chrono::microseconds(0);
+
       process_events();
 
       m_flags |= flag_polling;
@@ -171,12 +292,36 @@ Thread::event_loop() {
       if (!m_scheduler->empty())
         timeout = std::min(timeout, m_scheduler->next_timeout());
 
-      int event_count = m_poll->do_poll(timeout.count());
+      // The poll wait is not part of the loop time, only the handlers
+      // called by do_poll are.
+      if (stats_enabled)
+        m_stats_loop_time = stats_now() - loop_start;
+
+      m_watchdog_waiting = true;
+
+      int event_count;
+
+      {
+        trace_span poll_span("poll");
+        event_count = m_poll->do_poll(timeout.count());
+      }
+
+      m_watchdog_waiting = false;
+      m_watchdog_progress.fetch_add(1, std::memory_order_relaxed);
 
       instrumentation_update(INSTRUMENTATION_POLLING_EVENTS, event_count);
       instrumentation_update(instrumentation_enum(INSTRUMENTATION_POLLING_EVENTS + m_instrumentation_index), event_count);
 
+      update_current_cpu();
+
       m_flags &= ~flag_polling;
+
+      if (stats_enabled) {
+        m_stats_local.loop_time.insert(m_stats_loop_time);
+        m_stats_loop_time = std::chrono::microseconds(0);
+
+        stats_publish();
+      }
     }
 
   } catch (shutdown_exception& e) {
@@ -184,7 +329,7 @@ Thread::event_loop() {
   }
 
   // Some test, and perhaps other code, segfaults on this.
-  // m_poll->remove_read(m_interrupt_receiver.get());
+  // m_poll->remove_read(m_interrupt.get());
 
   auto previous_state = STATE_ACTIVE;
 
@@ -208,6 +353,8 @@ Thread::init_thread_local() {
   m_scheduler->set_thread_id(m_thread_id);
   m_signal_bitfield.handover(m_thread_id);
 
+  apply_placement();
+
   set_cached_time(time_since_epoch());
 
   if (m_resolver)
@@ -219,6 +366,114 @@ Thread::init_thread_local() {
     throw internal_error("Thread::init_thread_local() : " + std::string(name()) + " : called on an object that is not in the initialized state.");
 }
 
+void
+Thread::apply_placement() {
+  std::vector<unsigned int> cpus = m_cpu_affinity;
+
+#ifdef USE_THREAD_AFFINITY
+  if (m_numa_node >= 0) {
+    std::vector<unsigned int> node_cpus;
+
+    try {
+      std::ifstream file("/sys/devices/system/node/node" + std::to_string(m_numa_node) + "/cpulist");
+      std::string line;
+
+      if (std::getline(file, line))
+        node_cpus = parse_cpu_list(line);
+
+    } catch (const input_error& e) {
+      lt_log_print(LOG_THREAD_NOTICE, "%s : could not parse cpus of numa node : node:%i error:'%s'", name(), m_numa_node, e.what());
+    }
+
+    if (node_cpus.empty()) {
+      lt_log_print(LOG_THREAD_NOTICE, "%s : could not find cpus of numa node : node:%i", name(), m_numa_node);
+
+    } else if (cpus.empty()) {
+      cpus = std::move(node_cpus);
+
+    } else {
+      std::vector<unsigned int> both;
+      std::set_intersection(cpus.begin(), cpus.end(), node_cpus.begin(), node_cpus.end(), std::back_inserter(both));
+
+      if (both.empty()) {
+        lt_log_print(LOG_THREAD_NOTICE, "%s : cpu affinity does not include numa node, ignoring node : node:%i", name(), m_numa_node);
+      } else {
+        cpus = std::move(both);
+      }
+    }
+
+    // Prefer the node for allocations made by this thread from here
+    // on, falling back to other nodes when it is full.
+    constexpr unsigned int bits_per_long = 8 * sizeof(unsigned long);
+
+    unsigned long node_mask[max_numa_nodes / bits_per_long] = {};
+
+    if (m_numa_node < max_numa_nodes) {
+      node_mask[m_numa_node / bits_per_long] |= 1ul << (m_numa_node % bits_per_long);
+
+      // The kernel reads one bit less than 'maxnode'.
+      if (syscall(SYS_set_mempolicy, MPOL_PREFERRED, node_mask, max_numa_nodes + 1) != 0)
+        lt_log_print(LOG_THREAD_NOTICE, "%s : could not set memory policy : node:%i error:'%s'", name(), m_numa_node, std::strerror(errno));
+    }
+  }
+
+  if (!cpus.empty()) {
+    cpu_set_t cpu_set;
+    CPU_ZERO(&cpu_set);
+
+    for (auto cpu : cpus)
+      if (cpu < static_cast<unsigned int>(CPU_SETSIZE))
+        CPU_SET(cpu, &cpu_set);
+
+    int result = pthread_setaffinity_np(pthread_self(), sizeof(cpu_set), &cpu_set);
+
+    if (result != 0)
+      lt_log_print(LOG_THREAD_NOTICE, "%s : could not set cpu affinity : error:'%s'", name(), std::strerror(result));
+  }
+
+  update_current_cpu();
+
+#else
+  if (!cpus.empty() || m_numa_node >= 0)
+    lt_log_print(LOG_THREAD_NOTICE, "%s : thread placement is not supported on this platform", name());
+#endif
+
+  std::string cpus_str;
+
+  for (auto cpu : cpus)
+    cpus_str += (cpus_str.empty() ? "" : ",") + std::to_string(cpu);
+
+  lt_log_print(LOG_THREAD_NOTICE, "%s : thread placement : cpus:%s node:%i current_cpu:%i current_node:%i",
+               name(), cpus_str.empty() ? "any" : cpus_str.c_str(), m_numa_node, m_current_cpu.load(), m_current_numa_node.load());
+}
+
+// Called once per poll loop, sched_getcpu is served by the vDSO while
+// the node is only looked up when the thread migrated.
+void
+Thread::update_current_cpu() {
+#ifdef USE_THREAD_AFFINITY
+  int cpu = sched_getcpu();
+
+  if (cpu != m_current_cpu) {
+    unsigned int getcpu_cpu;
+    unsigned int getcpu_node;
+
+    if (m_current_cpu != -1) {
+      instrumentation_update(INSTRUMENTATION_THREAD_MIGRATIONS, 1);
+      instrumentation_update(instrumentation_enum(INSTRUMENTATION_THREAD_MIGRATIONS + m_instrumentation_index), 1);
+    }
+
+    m_current_cpu = cpu;
+    m_current_numa_node = syscall(SYS_getcpu, &getcpu_cpu, &getcpu_node, nullptr) == 0 ? int(getcpu_node) : -1;
+  }
+
+  if (m_numa_node >= 0 && m_current_numa_node != m_numa_node) {
+    instrumentation_update(INSTRUMENTATION_THREAD_OFF_NODE, 1);
+    instrumentation_update(instrumentation_enum(INSTRUMENTATION_THREAD_OFF_NODE + m_instrumentation_index), 1);
+  }
+#endif
+}
+
 void
 Thread::set_cached_time(std::chrono::microseconds t) {
   m_cached_time = t;
@@ -232,11 +487,18 @@ Thread::process_events() {
 
   set_cached_time(time_since_epoch());
 
-  call_events();
-  m_signal_bitfield.work();
+  {
+    trace_span span("events");
+
+    call_events();
+    m_signal_bitfield.work();
+  }
 
   set_cached_time(time_since_epoch());
 
+  trace_span span("timers");
+
+  m_scheduler->set_lateness_histogram(m_stats_enabled ? &m_stats_local.timer_lateness : nullptr);
   m_scheduler->perform(m_cached_time);
 }
 
@@ -245,6 +507,8 @@ void
 Thread::process_events_without_cached_time() {
   call_events();
   m_signal_bitfield.work();
+
+  m_scheduler->set_lateness_histogram(m_stats_enabled ? &m_stats_local.timer_lateness : nullptr);
   m_scheduler->perform(m_cached_time);
 }
 
@@ -253,17 +517,33 @@ void
 Thread::process_callbacks(bool only_interrupt) {
   m_callbacks_should_interrupt_polling = false;
 
+  bool stats_enabled = m_stats_enabled;
+  bool watched = m_watchdog_active;
+  auto start = std::chrono::microseconds(0);
+
+  // Only batches that called something are traced, this is called
+  // on every loop iteration.
+  int64_t  trace_begin = trace_is_active() ? trace_now() : 0;
+  unsigned trace_count = 0;
+
+  if (stats_enabled) {
+    auto lock = std::scoped_lock(m_callbacks_lock);
+    uint64_t depth = m_interrupt_callbacks.size() + (only_interrupt ? 0 : m_callbacks.size());
+
+    m_stats_local.callback_depth[thread_stats::depth_bucket_index(depth)]++;
+    m_stats_local.callback_depth_max = std::max(m_stats_local.callback_depth_max, depth);
+
+    start = stats_now();
+  }
+
   while (true) {
     std::function<void ()> callback;
+    const void*            target;
 
     {
       auto lock = std::scoped_lock(m_callbacks_lock);
 
-      if (!m_interrupt_callbacks.empty())
-        callback = m_interrupt_callbacks.extract(m_interrupt_callbacks.begin()).mapped();
-      else if (!only_interrupt && !m_callbacks.empty())
-        callback = m_callbacks.extract(m_callbacks.begin()).mapped();
-      else
+      if (!m_interrupt_callbacks.pop(&callback, &target) && (only_interrupt || !m_callbacks.pop(&callback, &target)))
         break;
 
       // The 'm_callbacks_processing_lock' is used by 'cancel_callback_and_wait' as a way to wait
@@ -272,11 +552,138 @@ Thread::process_callbacks(bool only_interrupt) {
       m_callbacks_processing = true;
     }
 
+    if (watched) {
+      m_watchdog_waiting = false;
+      m_watchdog_callback = target;
+    }
+
     callback();
+    trace_count++;
+
+    if (watched) {
+      m_watchdog_callback = nullptr;
+      m_watchdog_progress.fetch_add(1, std::memory_order_relaxed);
+    }
 
     m_callbacks_processing = false;
     m_callbacks_processing_lock.unlock();
   }
+
+  if (stats_enabled)
+    m_stats_local.callback_time.insert(stats_now() - start);
+
+  if (trace_begin != 0 && trace_count != 0)
+    trace_record("callbacks", trace_begin, trace_now());
+}
+
+// The type name is read before the call as the handler may delete the
+// event.
+void
+Thread::call_event_instrumented(Event* event, void (Event::*handler)()) {
+  const char* type = event->type_name();
+  bool watched = m_watchdog_active;
+
+  if (watched) {
+    m_watchdog_waiting = false;
+    m_watchdog_event = type;
+  }
+
+  if (trace_is_active()) {
+    trace_span span(type);
+    (event->*handler)();
+
+  } else if (!m_stats_enabled) {
+    (event->*handler)();
+
+  } else {
+    auto start = stats_now();
+
+    (event->*handler)();
+
+    auto elapsed = stats_now() - start;
+    auto itr = m_stats_local.handler_time.find(type);
+
+    if (itr == m_stats_local.handler_time.end())
+      itr = m_stats_local.handler_time.emplace(type, latency_histogram()).first;
+
+    itr->second.insert(elapsed);
+    m_stats_loop_time += elapsed;
+  }
+
+  if (watched) {
+    m_watchdog_event = nullptr;
+    m_watchdog_progress.fetch_add(1, std::memory_order_relaxed);
+  }
+}
+
+thread_stats
+Thread::stats() {
+  auto lock = std::scoped_lock(m_stats_lock);
+  return m_stats;
+}
+
+void
+Thread::clear_stats() {
+  auto lock = std::scoped_lock(m_stats_lock);
+  m_stats = thread_stats();
+}
+
+// Handler histograms are cleared rather than erased so the thread does
+// not reallocate the map entries every iteration.
+void
+Thread::stats_publish() {
+  {
+    auto lock = std::scoped_lock(m_stats_lock);
+    stats_merge(m_stats, m_stats_local);
+  }
+
+  auto handler_time = std::move(m_stats_local.handler_time);
+
+  for (auto& entry : handler_time)
+    entry.second.clear();
+
+  m_stats_local = thread_stats();
+  m_stats_local.handler_time = std::move(handler_time);
+}
+
+void
+Thread::callback_queue::push(const void* target, std::function<void ()>&& fn) {
+  m_pending.push_back(entry_type{target, std::move(fn)});
+}
+
+bool
+Thread::callback_queue::pop(std::function<void ()>* fn, const void** target) {
+  while (true) {
+    if (m_index == m_processing.size()) {
+      if (m_pending.empty())
+        return false;
+
+      m_processing.clear();
+      m_processing.swap(m_pending);
+      m_index = 0;
+    }
+
+    auto& entry = m_processing[m_index++];
+
+    if (!entry.fn)
+      continue;
+
+    *fn = std::move(entry.fn);
+    *target = entry.target;
+    entry.fn = nullptr;
+    return true;
+  }
+}
+
+void
+Thread::callback_queue::cancel(const void* target) {
+  for (auto itr = m_processing.begin() + m_index; itr != m_processing.end(); itr++)
+    if (itr->target == target)
+      itr->fn = nullptr;
+
+  for (auto& entry : m_pending)
+    if (entry.target == target)
+      entry.fn = nullptr;
 }
 
 }
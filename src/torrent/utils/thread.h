@@ -3,16 +3,21 @@
 
 #include <atomic>
 #include <functional>
-#include <map>
 #include <mutex>
 #include <pthread.h>
+#include <string>
 #include <sys/types.h>
+#include <vector>
 #include <torrent/common.h>
+#include <torrent/event.h>
 #include <torrent/utils/chrono.h>
 #include <torrent/utils/signal_bitfield.h>
+#include <torrent/utils/thread_stats.h>
+#include <torrent/utils/trace.h>
 
 namespace torrent {
 
+class PollInternal;
 class SignalInterrupt;
 
 inline utils::Thread* thread_self();
@@ -63,6 +68,40 @@ public:
 
   auto                cached_time() const  { return m_cached_time.load(); }
 
+  // Placement is applied by the thread itself in init_thread_local(),
+  // so it must be set before the thread is started, or initialized in
+  // the case of the main thread. An empty cpu list or a negative node
+  // leaves placement to the kernel.
+  //
+  // Setting a NUMA node restricts the thread to the cpus of that node
+  // and makes it prefer allocating memory from there.
+  const std::vector<unsigned int>& cpu_affinity() const { return m_cpu_affinity; }
+  int                 numa_node() const                 { return m_numa_node; }
+
+  void                set_cpu_affinity(std::vector<unsigned int> cpus);
+  void                set_numa_node(int node);
+
+  // The cpu and node the thread last polled on, or -1 if unknown.
+  int                 current_cpu() const       { return m_current_cpu; }
+  int                 current_numa_node() const { return m_current_numa_node; }
+
+  // Parses the kernel's cpu list format, e.g. "0-3,8,10-11". Throws
+  // input_error on malformed lists.
+  static std::vector<unsigned int> parse_cpu_list(const std::string& str);
+
+  // Event loop telemetry, see thread_stats.h. Collecting can be
+  // enabled, and the stats copied or cleared, from any thread. The
+  // thread publishes what it collected once per loop iteration.
+  bool                is_stats_enabled() const          { return m_stats_enabled; }
+  void                set_stats_enabled(bool enabled)   { m_stats_enabled = enabled; }
+
+  thread_stats        stats();
+  void                clear_stats();
+
+  // Used by the poll backends to call the handlers of polled events,
+  // timed when stats are enabled and tracked when watched.
+  void                call_event(Event* event, void (Event::*handler)());
+
   // Only call these from the same thread, or before start_thread.
   //
   // TODO: Move poll to ThreadInternal.
@@ -91,7 +130,9 @@ public:
 
 protected:
   friend class torrent::Poll;
+  friend class torrent::PollInternal;
   friend class ThreadInternal;
+  friend class Watchdog;
 
   net::Resolver*      resolver()  { return m_resolver.get(); }
   Scheduler*          scheduler() { return m_scheduler.get(); }
@@ -109,6 +150,13 @@ protected:
   void                process_events_without_cached_time();
   void                process_callbacks(bool only_interrupt = false);
 
+  void                call_event_instrumented(Event* event, void (Event::*handler)());
+
+  void                stats_publish();
+
+  void                apply_placement();
+  void                update_current_cpu();
+
   static thread_local Thread*  m_self;
 
   // TODO: Remove m_thread.
@@ -122,20 +170,65 @@ protected:
 
   int                          m_instrumentation_index;
 
+  std::vector<unsigned int>    m_cpu_affinity;
+  int                          m_numa_node{-1};
+  std::atomic_int              m_current_cpu{-1};
+  std::atomic_int              m_current_numa_node{-1};
+
   std::unique_ptr<Poll>            m_poll;
   std::unique_ptr<net::Resolver>   m_resolver;
   std::unique_ptr<Scheduler>       m_scheduler;
   class signal_bitfield            m_signal_bitfield;
 
-  std::unique_ptr<SignalInterrupt> m_interrupt_sender;
-  std::unique_ptr<SignalInterrupt> m_interrupt_receiver;
+  std::unique_ptr<SignalInterrupt> m_interrupt;
+
+  // Callbacks are queued in arrival order in a pair of vectors that
+  // swap when the processing side is drained, so their storage is
+  // reused instead of allocating a node per callback. Cancelled
+  // entries are left as tombstones with an empty function.
+  class callback_queue {
+  public:
+    void              push(const void* target, std::function<void ()>&& fn);
+    bool              pop(std::function<void ()>* fn, const void** target);
+    void              cancel(const void* target);
+
+    // Includes cancelled entries not yet popped.
+    size_t            size() const { return m_pending.size() + m_processing.size() - m_index; }
+
+  private:
+    struct entry_type {
+      const void*            target;
+      std::function<void ()> fn;
+    };
+
+    std::vector<entry_type> m_pending;
+    std::vector<entry_type> m_processing;
+    size_t                  m_index{0};
+  };
 
   std::mutex                                         m_callbacks_lock;
-  std::multimap<const void*, std::function<void ()>> m_callbacks;
-  std::multimap<const void*, std::function<void ()>> m_interrupt_callbacks;
+  callback_queue                                     m_callbacks;
+  callback_queue                                     m_interrupt_callbacks;
   std::atomic<bool>                                  m_callbacks_should_interrupt_polling{false};
   std::mutex                                         m_callbacks_processing_lock;
   std::atomic<bool>                                  m_callbacks_processing{false};
+
+  // Collected by the thread in 'm_stats_local' and merged into
+  // 'm_stats' under the lock by stats_publish().
+  std::atomic<bool>                                  m_stats_enabled{false};
+  std::mutex                                         m_stats_lock;
+  thread_stats                                       m_stats;
+  thread_stats                                       m_stats_local;
+  std::chrono::microseconds                          m_stats_loop_time{0};
+
+  // Progress seen by the watchdog. The thread is waiting while blocked
+  // in poll, and records the event or callback it is running while
+  // watched.
+  std::atomic<bool>                                  m_watchdog_active{false};
+  std::atomic<uint64_t>                              m_watchdog_progress{0};
+  std::atomic<bool>                                  m_watchdog_waiting{false};
+  std::atomic<const char*>                           m_watchdog_event{nullptr};
+  std::atomic<const void*>                           m_watchdog_callback{nullptr};
 };
 
 inline bool
@@ -148,6 +241,14 @@ Thread::is_current() const {
   return m_thread == pthread_self();
 }
 
+inline void
+Thread::call_event(Event* event, void (Event::*handler)()) {
+  if (m_stats_enabled.load(std::memory_order_relaxed) || m_watchdog_active.load(std::memory_order_relaxed) || trace_is_active())
+    call_event_instrumented(event, handler);
+  else
+    (event->*handler)();
+}
+
 inline void
 Thread::send_event_signal(unsigned int index, bool do_interrupt) {
   m_signal_bitfield.signal(index);
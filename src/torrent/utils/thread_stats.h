@@ -0,0 +1,53 @@
+#ifndef LIBTORRENT_UTILS_THREAD_STATS_H
+#define LIBTORRENT_UTILS_THREAD_STATS_H
+
+#include <array>
+#include <cinttypes>
+#include <functional>
+#include <map>
+#include <string>
+#include <torrent/utils/latency_histogram.h>
+
+namespace torrent::utils {
+
+// Event loop telemetry of a thread, collected while enabled with
+// Thread::set_stats_enabled and copied with Thread::stats().
+//
+// The loop time of an iteration is the time spent processing events,
+// timers and callbacks plus the handlers of polled events, the time
+// blocked in poll is excluded. Timer lateness is how long after its
+// deadline a scheduler entry was called. Handler times are keyed by
+// Event::type_name().
+
+struct thread_stats {
+  // Power of two buckets, bucket 0 holds empty queues, bucket 'n'
+  // depths in [2^(n-1), 2^n), and the last bucket everything above.
+  static constexpr unsigned int depth_bucket_count = 16;
+
+  static unsigned int depth_bucket_index(uint64_t depth);
+
+  latency_histogram                                     loop_time;
+  latency_histogram                                     callback_time;
+  latency_histogram                                     timer_lateness;
+
+  std::array<uint64_t, depth_bucket_count>              callback_depth{};
+  uint64_t                                              callback_depth_max{0};
+
+  std::map<std::string, latency_histogram, std::less<>> handler_time;
+};
+
+inline unsigned int
+thread_stats::depth_bucket_index(uint64_t depth) {
+  unsigned int index = 0;
+
+  while (depth > 0 && index < depth_bucket_count - 1) {
+    depth >>= 1;
+    index++;
+  }
+
+  return index;
+}
+
+}
+
+#endif // LIBTORRENT_UTILS_THREAD_STATS_H
@@ -0,0 +1,197 @@
+#include "config.h"
+
+#include "torrent/utils/trace.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cinttypes>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <pthread.h>
+#include <vector>
+
+#include "torrent/exceptions.h"
+#include "torrent/utils/thread.h"
+
+namespace torrent::utils {
+
+namespace {
+
+struct trace_entry {
+  std::atomic<const char*> name{nullptr};
+  std::atomic<int64_t>     start{0};
+  std::atomic<int64_t>     end{0};
+};
+
+struct trace_buffer {
+  trace_buffer(size_t c, uint32_t t, std::string n) :
+    entries(new trace_entry[c]), capacity(c), tid(t), thread_name(std::move(n)) {}
+
+  std::unique_ptr<trace_entry[]> entries;
+  size_t                         capacity;
+  std::atomic<uint64_t>          head{0};
+
+  uint32_t                       tid;
+  std::string                    thread_name;
+};
+
+// Threads keep a pointer to their buffer and only notice a restart on
+// their next span, so the buffers of the previous recording are freed
+// one restart later.
+std::mutex                                 trace_lock;
+std::vector<std::unique_ptr<trace_buffer>> trace_buffers;
+std::vector<std::unique_ptr<trace_buffer>> trace_retired;
+size_t                                     trace_capacity{trace_default_capacity};
+std::atomic<uint32_t>                      trace_generation{0};
+
+thread_local trace_buffer*                 trace_local{nullptr};
+thread_local uint32_t                      trace_local_generation{0};
+
+std::string
+current_thread_name() {
+  if (thread_self() != nullptr)
+    return thread_self()->name();
+
+  char name[32] = {};
+
+#if defined(HAS_PTHREAD_SETNAME_NP_GENERIC)
+  pthread_getname_np(pthread_self(), name, sizeof(name));
+#endif
+
+  return name;
+}
+
+trace_buffer*
+local_buffer() {
+  auto generation = trace_generation.load(std::memory_order_acquire);
+
+  if (trace_local != nullptr && trace_local_generation == generation)
+    return trace_local;
+
+  auto lock = std::scoped_lock(trace_lock);
+
+  trace_buffers.push_back(std::make_unique<trace_buffer>(trace_capacity, trace_buffers.size() + 1, current_thread_name()));
+
+  trace_local = trace_buffers.back().get();
+  trace_local_generation = generation;
+
+  return trace_local;
+}
+
+void
+append_escaped(std::string& output, const char* str) {
+  for (; *str != '\0'; str++) {
+    if (*str == '"' || *str == '\\')
+      output += '\\';
+
+    if (static_cast<unsigned char>(*str) >= 0x20)
+      output += *str;
+  }
+}
+
+}
+
+std::atomic<bool> trace_active{false};
+
+void
+trace_start(size_t capacity) {
+  if (capacity == 0)
+    throw input_error("Trace capacity must be non-zero.");
+
+  auto lock = std::scoped_lock(trace_lock);
+
+  trace_active = false;
+
+  trace_retired = std::move(trace_buffers);
+  trace_buffers.clear();
+
+  trace_capacity = capacity;
+  trace_generation.fetch_add(1, std::memory_order_release);
+
+  trace_active = true;
+}
+
+void
+trace_stop() {
+  trace_active = false;
+}
+
+int64_t
+trace_now() {
+  return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void
+trace_record(const char* name, int64_t start, int64_t end) {
+  if (!trace_is_active())
+    return;
+
+  trace_buffer* buffer = local_buffer();
+
+  uint64_t     head  = buffer->head.load(std::memory_order_relaxed);
+  trace_entry& entry = buffer->entries[head % buffer->capacity];
+
+  entry.name.store(name, std::memory_order_relaxed);
+  entry.start.store(start, std::memory_order_relaxed);
+  entry.end.store(end, std::memory_order_relaxed);
+
+  buffer->head.store(head + 1, std::memory_order_release);
+}
+
+// The entries are copied before formatting and those the owning thread
+// may have overwritten in the meantime are dropped.
+std::string
+trace_dump_json() {
+  auto lock = std::scoped_lock(trace_lock);
+
+  std::string output = "{\"traceEvents\":[";
+  bool        first = true;
+  char        line[128];
+
+  for (const auto& buffer : trace_buffers) {
+    if (!first)
+      output += ',';
+
+    first = false;
+
+    std::snprintf(line, sizeof(line), "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%" PRIu32 ",\"args\":{\"name\":\"", buffer->tid);
+    output += line;
+    append_escaped(output, buffer->thread_name.c_str());
+    output += "\"}}";
+
+    uint64_t head  = buffer->head.load(std::memory_order_acquire);
+    uint64_t begin = head > buffer->capacity ? head - buffer->capacity : 0;
+
+    struct copy_type { const char* name; int64_t start; int64_t end; };
+    std::vector<copy_type> copies;
+    copies.reserve(head - begin);
+
+    for (uint64_t i = begin; i != head; i++) {
+      const trace_entry& entry = buffer->entries[i % buffer->capacity];
+
+      copies.push_back(copy_type{entry.name.load(std::memory_order_relaxed),
+                                 entry.start.load(std::memory_order_relaxed),
+                                 entry.end.load(std::memory_order_relaxed)});
+    }
+
+    uint64_t new_head = buffer->head.load(std::memory_order_acquire);
+    uint64_t valid    = new_head > buffer->capacity ? new_head - buffer->capacity : 0;
+
+    for (uint64_t i = std::max(begin, valid); i < head; i++) {
+      const copy_type& span = copies[i - begin];
+
+      output += ",{\"name\":\"";
+      append_escaped(output, span.name);
+
+      std::snprintf(line, sizeof(line), "\",\"ph\":\"X\",\"pid\":1,\"tid\":%" PRIu32 ",\"ts\":%" PRId64 ",\"dur\":%" PRId64 "}",
+                    buffer->tid, span.start, span.end - span.start);
+      output += line;
+    }
+  }
+
+  output += "]}";
+  return output;
+}
+
+}
@@ -0,0 +1,54 @@
+#ifndef LIBTORRENT_UTILS_TRACE_H
+#define LIBTORRENT_UTILS_TRACE_H
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <torrent/common.h>
+
+namespace torrent::utils {
+
+// Records timed spans of the event loop iterations, callback batches,
+// scheduler timers, hash batches and chunk syncs of every thread, to
+// show how the work is laid out over time. The dump is in the Chrome
+// trace event JSON format, which chrome://tracing and the Perfetto UI
+// open.
+//
+// Each thread records to its own ring of 'capacity' spans without
+// locking, overwriting the oldest. Span names are kept as pointers and
+// must be string literals or otherwise outlive the recording.
+
+constexpr size_t trace_default_capacity = 1 << 16;
+
+extern std::atomic<bool> trace_active LIBTORRENT_EXPORT;
+
+// Starting clears the spans of the previous recording.
+void        trace_start(size_t capacity = trace_default_capacity) LIBTORRENT_EXPORT;
+void        trace_stop() LIBTORRENT_EXPORT;
+
+inline bool trace_is_active() { return trace_active.load(std::memory_order_relaxed); }
+
+// Safe to call while recording, spans overwritten during the dump are
+// left out.
+std::string trace_dump_json() LIBTORRENT_EXPORT;
+
+// For internal usage.
+int64_t     trace_now();
+void        trace_record(const char* name, int64_t start, int64_t end);
+
+class trace_span {
+public:
+  trace_span(const char* name) : m_name(name), m_start(trace_is_active() ? trace_now() : 0) {}
+  ~trace_span() { if (m_start != 0) trace_record(m_name, m_start, trace_now()); }
+
+  trace_span(const trace_span&) = delete;
+  trace_span& operator=(const trace_span&) = delete;
+
+private:
+  const char*         m_name;
+  int64_t             m_start;
+};
+
+}
+
+#endif
@@ -2,6 +2,7 @@
 
 #include <torrent/utils/uri_parser.h>
 
+#include <algorithm>
 #include <cctype>
 
 #include "rak/string_manip.h"
@@ -195,4 +196,26 @@ uri_has_query(const std::string& uri) {
   return uri.find('/', delim_options) == std::string::npos;
 }
 
+std::string
+uri_host_key(const std::string& uri) {
+  size_t delim_scheme = uri.find("://");
+  size_t first = delim_scheme != std::string::npos ? delim_scheme + 3 : 0;
+  size_t last = uri.find_first_of("/?#", first);
+
+  if (last == std::string::npos)
+    last = uri.size();
+
+  size_t delim_userinfo = uri.rfind('@', last);
+
+  std::string key = uri.substr(0, first);
+
+  if (delim_userinfo != std::string::npos && delim_userinfo >= first)
+    key += uri.substr(delim_userinfo + 1, last - delim_userinfo - 1);
+  else
+    key += uri.substr(first, last - first);
+
+  std::transform(key.begin(), key.end(), key.begin(), [](unsigned char c) { return std::tolower(c); });
+  return key;
+}
+
 } // namespace torrent::utils
@@ -58,6 +58,9 @@ std::string uri_generate_scrape_url(std::string uri) LIBTORRENT_EXPORT;
 bool uri_can_scrape(const std::string& uri) LIBTORRENT_EXPORT;
 bool uri_has_query(const std::string& uri) LIBTORRENT_EXPORT;
 
+// Scheme, host and port of the uri in lower case, without user info.
+std::string uri_host_key(const std::string& uri) LIBTORRENT_EXPORT;
+
 } // namespace torrent::utils
 
 #endif
@@ -0,0 +1,221 @@
+#include "config.h"
+
+#include "torrent/utils/watchdog.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <csignal>
+#include <cstdlib>
+#include <pthread.h>
+#include <unistd.h>
+
+#ifdef HAVE_BACKTRACE
+#include <execinfo.h>
+#endif
+
+#include "torrent/exceptions.h"
+#include "torrent/utils/log.h"
+#include "torrent/utils/thread.h"
+
+namespace torrent::utils {
+
+namespace {
+
+#if defined(HAVE_BACKTRACE) && defined(SIGRTMIN)
+
+constexpr int capture_max_frames = 64;
+
+// Only one capture runs at a time, the frames are written by the
+// signal handler on the stalled thread.
+std::mutex       capture_lock;
+void*            capture_frames[capture_max_frames];
+std::atomic<int> capture_size{-1};
+std::once_flag   capture_install;
+
+void
+capture_handler(int) {
+  int saved_errno = errno;
+  capture_size = ::backtrace(capture_frames, capture_max_frames);
+  errno = saved_errno;
+}
+
+int
+capture_signal() {
+  return SIGRTMIN + 1;
+}
+
+// The first call of backtrace() may load libgcc, which is not safe in
+// a signal handler.
+void
+capture_setup() {
+  std::call_once(capture_install, []() {
+      void* frame;
+      ::backtrace(&frame, 1);
+
+      struct sigaction sa{};
+      sa.sa_handler = &capture_handler;
+      sa.sa_flags = SA_RESTART;
+      sigemptyset(&sa.sa_mask);
+
+      if (sigaction(capture_signal(), &sa, nullptr) == -1)
+        throw internal_error("Watchdog could not install the stack capture signal handler.");
+    });
+}
+
+#else
+
+void capture_setup() {}
+
+#endif
+
+}
+
+Watchdog::~Watchdog() {
+  stop();
+}
+
+void
+Watchdog::add_thread(Thread* thread) {
+  if (is_running())
+    throw internal_error("Watchdog::add_thread(...) called while running.");
+
+  m_threads.push_back(watched_type{thread, 0, std::chrono::steady_clock::time_point(), false});
+}
+
+void
+Watchdog::start(std::chrono::milliseconds threshold) {
+  if (is_running())
+    throw internal_error("Watchdog::start(...) called while running.");
+
+  if (threshold <= std::chrono::milliseconds(0))
+    throw input_error("Watchdog threshold must be positive.");
+
+  capture_setup();
+
+  m_threshold = threshold;
+  m_stop = false;
+
+  auto now = std::chrono::steady_clock::now();
+
+  for (auto& watched : m_threads) {
+    watched.thread->m_watchdog_active = true;
+    watched.progress = watched.thread->m_watchdog_progress;
+    watched.changed = now;
+    watched.reported = false;
+  }
+
+  m_thread = std::thread(&Watchdog::run, this);
+}
+
+void
+Watchdog::stop() {
+  if (!is_running())
+    return;
+
+  {
+    auto lock = std::scoped_lock(m_lock);
+    m_stop = true;
+  }
+
+  m_cv.notify_all();
+  m_thread.join();
+
+  for (auto& watched : m_threads)
+    watched.thread->m_watchdog_active = false;
+}
+
+void
+Watchdog::run() {
+  auto interval = std::max(m_threshold / 4, std::chrono::milliseconds(1));
+  auto lock = std::unique_lock(m_lock);
+
+  while (!m_cv.wait_for(lock, interval, [this]() { return m_stop; })) {
+    auto now = std::chrono::steady_clock::now();
+    std::vector<stall_type> stalls;
+
+    for (auto& watched : m_threads)
+      if (!check(watched, now, &stalls.emplace_back()))
+        stalls.pop_back();
+
+    if (stalls.empty())
+      continue;
+
+    lock.unlock();
+
+    for (const auto& stall : stalls) {
+      lt_log_print(LOG_THREAD_WARN, "%s : event loop stalled : duration:%lli ms event:%s callback:%p",
+                   stall.thread_name.c_str(), static_cast<long long>(stall.duration.count()),
+                   stall.event_type != nullptr ? stall.event_type : "none", stall.callback_target);
+
+      for (const auto& frame : stall.backtrace)
+        lt_log_print(LOG_THREAD_WARN, "%s : %s", stall.thread_name.c_str(), frame.c_str());
+
+      if (m_slot_stall)
+        m_slot_stall(stall);
+    }
+
+    lock.lock();
+  }
+}
+
+// The thread is stalled if it neither made progress nor waited in poll
+// since the last check, for longer than the threshold.
+bool
+Watchdog::check(watched_type& watched, std::chrono::steady_clock::time_point now, stall_type* stall) {
+  Thread* thread = watched.thread;
+  uint64_t progress = thread->m_watchdog_progress;
+
+  if (progress != watched.progress || thread->m_watchdog_waiting || !thread->is_active()) {
+    watched.progress = progress;
+    watched.changed = now;
+    watched.reported = false;
+    return false;
+  }
+
+  if (watched.reported || now - watched.changed < m_threshold)
+    return false;
+
+  watched.reported = true;
+
+  stall->thread_name = thread->name();
+  stall->duration = std::chrono::duration_cast<std::chrono::milliseconds>(now - watched.changed);
+  stall->event_type = thread->m_watchdog_event;
+  stall->callback_target = thread->m_watchdog_callback;
+  stall->backtrace = capture_backtrace(thread);
+  return true;
+}
+
+std::vector<std::string>
+Watchdog::capture_backtrace(Thread* thread) {
+#if defined(HAVE_BACKTRACE) && defined(SIGRTMIN)
+  auto lock = std::scoped_lock(capture_lock);
+
+  capture_size = -1;
+
+  if (pthread_kill(thread->pthread(), capture_signal()) != 0)
+    return { "pthread_kill failed" };
+
+  for (int i = 0; i < 100 && capture_size == -1; i++)
+    usleep(1000);
+
+  int size = capture_size;
+
+  if (size == -1)
+    return { "stack capture timed out" };
+
+  char** symbols = ::backtrace_symbols(capture_frames, size);
+
+  if (symbols == nullptr)
+    return { "backtrace_symbols failed" };
+
+  std::vector<std::string> result(symbols, symbols + size);
+  std::free(symbols);
+
+  return result;
+#else
+  return { "stack dump not enabled" };
+#endif
+}
+
+}
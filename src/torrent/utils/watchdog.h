@@ -0,0 +1,86 @@
+#ifndef LIBTORRENT_UTILS_WATCHDOG_H
+#define LIBTORRENT_UTILS_WATCHDOG_H
+
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <torrent/common.h>
+
+namespace torrent::utils {
+
+// Watches event loops for iterations, event handlers or callbacks that
+// run longer than a threshold, e.g. a main thread blocked on a page
+// fault, msync or a synchronous DNS lookup. Time spent waiting in poll
+// is not a stall.
+//
+// The stalled thread is sent a signal whose handler records its stack,
+// which is reported with the Event::type_name() of the handler or the
+// target of the callback it was running. Each stall is reported once,
+// logged to LOG_THREAD_WARN and passed to slot_stall() on the watchdog
+// thread. The slot must not call stop().
+//
+// Threads are added before start() and must outlive the watchdog, or
+// at least its stop().
+
+class LIBTORRENT_EXPORT Watchdog {
+public:
+  struct stall_type {
+    std::string               thread_name;
+    std::chrono::milliseconds duration;
+
+    // Null unless the thread was in an event handler or callback.
+    const char*               event_type;
+    const void*               callback_target;
+
+    std::vector<std::string>  backtrace;
+  };
+
+  using slot_stall_type = std::function<void(const stall_type&)>;
+
+  Watchdog() = default;
+  ~Watchdog();
+
+  bool                      is_running() const { return m_thread.joinable(); }
+  std::chrono::milliseconds threshold() const  { return m_threshold; }
+
+  void                      add_thread(Thread* thread);
+
+  void                      start(std::chrono::milliseconds threshold);
+  void                      stop();
+
+  slot_stall_type&          slot_stall() { return m_slot_stall; }
+
+private:
+  struct watched_type {
+    Thread*                               thread;
+    uint64_t                              progress;
+    std::chrono::steady_clock::time_point changed;
+    bool                                  reported;
+  };
+
+  Watchdog(const Watchdog&) = delete;
+  Watchdog& operator=(const Watchdog&) = delete;
+
+  void                      run();
+  bool                      check(watched_type& watched, std::chrono::steady_clock::time_point now, stall_type* stall);
+
+  static std::vector<std::string> capture_backtrace(Thread* thread);
+
+  std::chrono::milliseconds m_threshold{0};
+  std::vector<watched_type> m_threads;
+
+  std::thread               m_thread;
+  std::mutex                m_lock;
+  std::condition_variable   m_cv;
+  bool                      m_stop{false};
+
+  slot_stall_type           m_slot_stall;
+};
+
+}
+
+#endif // LIBTORRENT_UTILS_WATCHDOG_H
@@ -9,6 +9,8 @@
 #include "torrent/poll.h"
 #include "torrent/tracker/manager.h"
 #include "torrent/utils/log.h"
+#include "tracker/tracker_http_pool.h"
+#include "tracker/tracker_udp_router.h"
 #include "tracker/tracker_worker.h"
 #include "utils/instrumentation.h"
 
@@ -16,6 +18,8 @@ namespace torrent {
 
 ThreadTracker* ThreadTracker::m_thread_tracker{nullptr};
 
+ThreadTracker::ThreadTracker() = default;
+
 ThreadTracker::~ThreadTracker() {
   m_thread_tracker = nullptr;
 }
@@ -25,6 +29,8 @@ ThreadTracker::create_thread(utils::Thread* main_thread) {
   m_thread_tracker = new ThreadTracker();
 
   m_thread_tracker->m_tracker_manager = std::make_unique<tracker::Manager>(main_thread, m_thread_tracker);
+  m_thread_tracker->m_udp_router = std::make_unique<TrackerUdpRouter>();
+  m_thread_tracker->m_http_pool = std::make_unique<TrackerHttpPool>();
 }
 
 // TODO: Deprecate this function.
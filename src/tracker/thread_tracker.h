@@ -13,6 +13,9 @@ namespace tracker {
 class Manager;
 }
 
+class TrackerHttpPool;
+class TrackerUdpRouter;
+
 struct TrackerSendEvent {
   tracker::Tracker                  tracker;
   tracker::TrackerState::event_enum event;
@@ -32,6 +35,11 @@ public:
 
   tracker::Manager*     tracker_manager() { return m_tracker_manager.get(); }
 
+  // Shared by the UDP trackers, only used from the thread running the
+  // tracker workers.
+  TrackerUdpRouter*     udp_router() { return m_udp_router.get(); }
+  TrackerHttpPool*      http_pool()  { return m_http_pool.get(); }
+
   // void                send_event(tracker::Tracker& tracker, tracker::TrackerState::event_enum new_event);
 
 protected:
@@ -41,13 +49,15 @@ protected:
   std::chrono::microseconds next_timeout() override;
 
 private:
-  ThreadTracker() = default;
+  ThreadTracker();
 
   // void                process_send_events();
 
   static ThreadTracker*         m_thread_tracker;
 
   std::unique_ptr<tracker::Manager> m_tracker_manager;
+  std::unique_ptr<TrackerUdpRouter> m_udp_router;
+  std::unique_ptr<TrackerHttpPool>  m_http_pool;
 
   unsigned int                  m_signal_send_event{~0u};
 
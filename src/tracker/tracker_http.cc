@@ -24,6 +24,10 @@
 
 #include "globals.h"
 #include "manager.h"
+#include "tracker/thread_tracker.h"
+#include "tracker/tracker_http_parser.h"
+#include "tracker/tracker_http_pool.h"
+#include "utils/probe.h"
 
 #define LT_LOG(log_fmt, ...)                                            \
   lt_log_print_hash(LOG_TRACKER_REQUESTS, info().info_hash, "tracker_http", "%p : " log_fmt, static_cast<TrackerWorker*>(this), __VA_ARGS__);
@@ -47,6 +51,16 @@ TrackerHttp::TrackerHttp(const TrackerInfo& info, int flags) :
   m_delay_scrape.slot() = [this] { delayed_send_scrape(); };
 }
 
+TrackerHttp::~TrackerHttp() {
+  if (m_data != nullptr)
+    pool()->erase(static_cast<TrackerWorker*>(this));
+}
+
+TrackerHttpPool*
+TrackerHttp::pool() {
+  return thread_tracker()->http_pool();
+}
+
 bool
 TrackerHttp::is_busy() const {
   return m_data != nullptr;
@@ -66,6 +80,7 @@ TrackerHttp::request_prefix(std::stringstream* stream, const std::string& url) {
 void
 TrackerHttp::send_event(tracker::TrackerState::event_enum new_state) {
   LT_LOG("sending event : state:%s url:%s", option_as_string(OPTION_TRACKER_EVENT, new_state), info().url.c_str());
+  LT_PROBE2(tracker_http_send, this, static_cast<int>(new_state));
 
   close_directly();
   this_thread::scheduler()->erase(&m_delay_scrape);
@@ -132,7 +147,7 @@ TrackerHttp::send_event(tracker::TrackerState::event_enum new_state) {
     break;
   }
 
-  m_data = std::make_unique<std::stringstream>();
+  m_data = std::make_unique<TrackerHttpStream>(std::string(), lt_log_is_valid(LOG_TRACKER_DEBUG));
 
   std::string request_url = s.str();
 
@@ -145,7 +160,7 @@ TrackerHttp::send_event(tracker::TrackerState::event_enum new_state) {
   m_get->set_stream(m_data.get());
   m_get->set_timeout(2 * 60);
 
-  m_get->start();
+  start_request();
 }
 
 void
@@ -185,7 +200,7 @@ TrackerHttp::delayed_send_scrape() {
 
   request_prefix(&s, utils::uri_generate_scrape_url(info().url));
 
-  m_data = std::make_unique<std::stringstream>();
+  m_data = std::make_unique<TrackerHttpStream>(info().info_hash.str(), lt_log_is_valid(LOG_TRACKER_DEBUG));
 
   std::string request_url = s.str();
 
@@ -195,7 +210,18 @@ TrackerHttp::delayed_send_scrape() {
   m_get->set_stream(m_data.get());
   m_get->set_timeout(2 * 60);
 
-  m_get->start();
+  start_request();
+}
+
+void
+TrackerHttp::start_request() {
+  pool()->insert(static_cast<TrackerWorker*>(this), info().url, [this] {
+      LT_LOG("starting request : url:%s", info().url.c_str());
+      m_get->start();
+    });
+
+  if (pool()->is_queued(static_cast<TrackerWorker*>(this)))
+    LT_LOG("request queued, too many active requests to host : url:%s", info().url.c_str());
 }
 
 void
@@ -227,8 +253,18 @@ TrackerHttp::disown() {
   LT_LOG("disowning tracker : state:%s url:%s",
          option_as_string(OPTION_TRACKER_EVENT, state().latest_event()), info().url.c_str());
 
+  bool started = pool()->is_active(static_cast<TrackerWorker*>(this));
+
+  pool()->erase(static_cast<TrackerWorker*>(this));
+
   m_slot_close();
 
+  if (!started) {
+    m_get->set_stream(nullptr);
+    m_data.reset();
+    return;
+  }
+
   m_get->set_delete_self();
   m_get->set_delete_stream();
   m_get->signal_done().clear();
@@ -260,7 +296,13 @@ TrackerHttp::close_directly() {
   // TODO: Replace m_slot_close with a ThreadWorker method.
   m_slot_close();
 
-  m_get->close();
+  bool started = pool()->is_active(static_cast<TrackerWorker*>(this));
+
+  pool()->erase(static_cast<TrackerWorker*>(this));
+
+  if (started)
+    m_get->close();
+
   m_get->set_stream(nullptr);
 
   m_data.reset();
@@ -273,23 +315,22 @@ TrackerHttp::receive_done() {
 
   LT_LOG("received reply", 0);
 
-  if (lt_log_is_valid(LOG_TRACKER_DEBUG)) {
-    std::string dump = m_data->str();
-    LT_LOG_DUMP(dump.c_str(), dump.size(), "tracker reply", 0);
-  }
+  auto& parser = m_data->parser();
+
+  LT_PROBE2(tracker_http_receive, this, parser.body().size());
 
-  Object b;
-  *m_data >> b;
+  if (lt_log_is_valid(LOG_TRACKER_DEBUG))
+    LT_LOG_DUMP(parser.body().c_str(), parser.body().size(), "tracker reply", 0);
 
   // Temporarily reset the interval
   //
   // TODO: This might be causing an issue with too frequent tracker requests.
   lock_and_clear_intervals();
 
-  if (m_data->fail()) {
-    std::string dump = m_data->str();
-    return receive_failed("Could not parse bencoded data: " + rak::sanitize(rak::striptags(dump)).substr(0,99));
-  }
+  if (!parser.is_done())
+    return receive_failed("Could not parse bencoded data: " + rak::sanitize(rak::striptags(parser.body())).substr(0,99));
+
+  const Object& b = parser.root();
 
   if (!b.is_map())
     return receive_failed("Root not a bencoded map");
@@ -309,11 +350,11 @@ TrackerHttp::receive_done() {
 
   if (state().latest_event() == tracker::TrackerState::EVENT_SCRAPE) {
     m_requested_scrape = false;
-    process_scrape(b);
+    process_scrape(b, parser.files_size());
     return;
   }
 
-  process_success(b);
+  process_success(b, std::move(parser.peers()), parser.has_peers());
 
   if (m_requested_scrape && !is_busy())
     this_thread::scheduler()->wait_for_ceil_seconds(&m_delay_scrape, 10s);
@@ -333,10 +374,8 @@ TrackerHttp::receive_failed(const std::string& msg) {
 
   LT_LOG("received failure : msg:%s", msg.c_str());
 
-  if (lt_log_is_valid(LOG_TRACKER_DEBUG)) {
-    std::string dump = m_data->str();
-    LT_LOG_DUMP(dump.c_str(), dump.size(), "received failure", 0);
-  }
+  if (lt_log_is_valid(LOG_TRACKER_DEBUG))
+    LT_LOG_DUMP(m_data->parser().body().c_str(), m_data->parser().body().size(), "received failure", 0);
 
   close_directly();
 
@@ -376,7 +415,7 @@ TrackerHttp::process_failure(const Object& object) {
 }
 
 void
-TrackerHttp::process_success(const Object& object) {
+TrackerHttp::process_success(const Object& object, AddressList&& peers, bool has_peers) {
   {
     auto guard = lock_guard();
 
@@ -403,35 +442,28 @@ TrackerHttp::process_success(const Object& object) {
       state().m_scrape_downloaded = std::max<int64_t>(object.get_key_value("downloaded"), 0);
   }
 
-  if (!object.has_key("peers") && !object.has_key("peers6"))
+  if (!has_peers)
     return receive_failed("No peers returned");
 
-  AddressList l;
+  // Compact peers were added to the list by the parser. Due to some
+  // trackers sending the wrong type when no peers are available, don't
+  // bork on other types.
+  AddressList l = std::move(peers);
 
-  if (object.has_key("peers")) {
+  if (object.has_key_list("peers")) {
     try {
-      // Due to some trackers sending the wrong type when no peers are
-      // available, don't bork on it.
-      if (object.get_key("peers").is_string())
-        l.parse_address_compact(object.get_key_string("peers"));
-
-      else if (object.get_key("peers").is_list())
-        l.parse_address_normal(object.get_key_list("peers"));
-
+      l.parse_address_normal(object.get_key_list("peers"));
     } catch (bencode_error& e) {
       return receive_failed(e.what());
     }
   }
 
-  if (object.has_key_string("peers6"))
-    l.parse_address_compact_ipv6(object.get_key_string("peers6"));
-
   close_directly();
   m_slot_success(std::move(l));
 }
 
 void
-TrackerHttp::process_scrape(const Object& object) {
+TrackerHttp::process_scrape(const Object& object, size_t files_size) {
   if (!object.has_key_map("files"))
     return receive_failed("Tracker scrape does not have files entry.");
 
@@ -456,7 +488,7 @@ TrackerHttp::process_scrape(const Object& object) {
       state().m_scrape_downloaded = std::max<int64_t>(stats.get_key_value("downloaded"), 0);
 
     LT_LOG("tracker scrape for %zu torrents : complete:%u incomplete:%u downloaded:%u",
-           files.as_map().size(), state().m_scrape_complete, state().m_scrape_incomplete, state().m_scrape_downloaded);
+           files_size, state().m_scrape_complete, state().m_scrape_incomplete, state().m_scrape_downloaded);
   }
 
   close_directly();
@@ -12,12 +12,15 @@
 namespace torrent {
 
 class Http;
+class TrackerHttpPool;
+class TrackerHttpStream;
 
 class TrackerHttp : public TrackerWorker {
 public:
   static constexpr uint32_t http_timeout = 60;
 
   TrackerHttp(const TrackerInfo& info, int flags = 0);
+  ~TrackerHttp() override;
 
   bool                is_busy() const override;
 
@@ -29,8 +32,12 @@ public:
   tracker_enum        type() const override;
 
 private:
+  static TrackerHttpPool* pool();
+
   void                close_directly();
 
+  void                start_request();
+
   void                request_prefix(std::stringstream* stream, const std::string& url);
 
   void                delayed_send_scrape();
@@ -40,13 +47,13 @@ private:
   void                receive_failed(const std::string& msg);
 
   void                process_failure(const Object& object);
-  void                process_success(const Object& object);
-  void                process_scrape(const Object& object);
+  void                process_success(const Object& object, AddressList&& peers, bool has_peers);
+  void                process_scrape(const Object& object, size_t files_size);
 
   void                update_tracker_id(const std::string& id);
 
   std::unique_ptr<Http>              m_get;
-  std::unique_ptr<std::stringstream> m_data;
+  std::unique_ptr<TrackerHttpStream> m_data;
 
   bool                  m_drop_deliminator;
   std::string           m_current_tracker_id;
@@ -0,0 +1,336 @@
+#include "config.h"
+
+#include "tracker/tracker_http_parser.h"
+
+#include <algorithm>
+#include <cstring>
+#include <limits>
+
+#include "net/address_list.h"
+#include "torrent/object_raw_bencode.h"
+
+namespace torrent {
+
+namespace {
+
+bool is_digit(char c) { return c >= '0' && c <= '9'; }
+
+}
+
+TrackerHttpParser::TrackerHttpParser(std::string scrape_key, bool keep_body) :
+    m_scrape_key(std::move(scrape_key)),
+    m_keep_body(keep_body) {
+}
+
+void
+TrackerHttpParser::parse(const char* first, const char* last) {
+  if (m_keep_body)
+    m_body.append(first, last);
+  else if (m_body.size() < body_head_size)
+    m_body.append(first, std::min<size_t>(last - first, body_head_size - m_body.size()));
+
+  while (first != last) {
+    switch (m_state) {
+    case state_value:
+    case state_key:
+      first = parse_value(first, last);
+      break;
+    case state_integer:
+      first = parse_integer(first, last);
+      break;
+    case state_length:
+      first = parse_length(first, last);
+      break;
+    case state_string:
+      first = parse_string(first, last);
+      break;
+    case state_done:
+    case state_failed:
+      return;
+    }
+  }
+}
+
+const char*
+TrackerHttpParser::parse_value(const char* first, const char* last) {
+  char c = *first;
+
+  if (c == 'e') {
+    if (m_stack.empty() || m_stack.back().is_map != (m_state == state_key)) {
+      set_failed();
+      return last;
+    }
+
+    m_stack.pop_back();
+    end_value();
+    return first + 1;
+  }
+
+  if (m_state == state_key) {
+    if (!is_digit(c)) {
+      set_failed();
+      return last;
+    }
+
+    m_key.clear();
+    m_sink = sink_key;
+    m_state = state_length;
+    m_number = 0;
+    m_has_digits = false;
+    return first;
+  }
+
+  switch (c) {
+  case 'i':
+    m_target = begin_value(c);
+    m_state = state_integer;
+    m_negative = false;
+    m_number = 0;
+    m_has_digits = false;
+    return first + 1;
+
+  case 'l':
+  case 'd':
+  {
+    bool is_map = c == 'd';
+    bool is_filter = is_map && !m_scrape_key.empty() && m_stack.size() == 1 &&
+      m_stack.back().object == &m_root && m_key == "files";
+
+    Object* object = begin_value(c);
+
+    if (object != nullptr)
+      *object = is_map ? Object::create_map() : Object::create_list();
+
+    if (m_stack.size() >= max_depth) {
+      set_failed();
+      return last;
+    }
+
+    m_stack.push_back(frame_type{object, is_map, is_filter});
+    m_state = is_map ? state_key : state_value;
+    return first + 1;
+  }
+  default:
+    if (!is_digit(c)) {
+      set_failed();
+      return last;
+    }
+
+    m_target = begin_value(c);
+    m_state = state_length;
+    m_number = 0;
+    m_has_digits = false;
+    return first;
+  }
+}
+
+const char*
+TrackerHttpParser::parse_integer(const char* first, const char* last) {
+  for (; first != last; first++) {
+    char c = *first;
+
+    if (c == 'e') {
+      if (!m_has_digits) {
+        set_failed();
+        return last;
+      }
+
+      if (m_target != nullptr)
+        *m_target = Object(m_negative ? -static_cast<int64_t>(m_number) : static_cast<int64_t>(m_number));
+
+      end_value();
+      return first + 1;
+    }
+
+    if (c == '-' && !m_negative && !m_has_digits) {
+      m_negative = true;
+      continue;
+    }
+
+    if (!is_digit(c) || m_number > (static_cast<uint64_t>(std::numeric_limits<int64_t>::max()) - (c - '0')) / 10) {
+      set_failed();
+      return last;
+    }
+
+    m_number = m_number * 10 + (c - '0');
+    m_has_digits = true;
+  }
+
+  return last;
+}
+
+const char*
+TrackerHttpParser::parse_length(const char* first, const char* last) {
+  for (; first != last; first++) {
+    char c = *first;
+
+    if (c == ':') {
+      if (!m_has_digits) {
+        set_failed();
+        return last;
+      }
+
+      m_remaining = m_number;
+      m_state = state_string;
+
+      if (m_sink == sink_object) {
+        *m_target = Object(std::string());
+        m_target->as_string().reserve(std::min<uint64_t>(m_remaining, max_string_reserve));
+      }
+
+      if (m_remaining == 0)
+        end_string();
+
+      return first + 1;
+    }
+
+    if (!is_digit(c) || m_number > (std::numeric_limits<uint32_t>::max() - (c - '0')) / 10) {
+      set_failed();
+      return last;
+    }
+
+    m_number = m_number * 10 + (c - '0');
+    m_has_digits = true;
+  }
+
+  return last;
+}
+
+const char*
+TrackerHttpParser::parse_string(const char* first, const char* last) {
+  auto length = std::min<uint64_t>(m_remaining, last - first);
+  auto string_last = first + length;
+
+  switch (m_sink) {
+  case sink_object:   m_target->as_string().append(first, string_last); break;
+  case sink_key:      m_key.append(first, string_last); break;
+  case sink_compact:  append_compact(first, string_last, sizeof(SocketAddressCompact)); break;
+  case sink_compact6: append_compact(first, string_last, sizeof(SocketAddressCompact6)); break;
+  case sink_skip:     break;
+  }
+
+  m_remaining -= length;
+
+  if (m_remaining == 0)
+    end_string();
+
+  return string_last;
+}
+
+// Returns where the value starting with 'c' is stored, or null if it
+// is skipped or sent to the address list.
+Object*
+TrackerHttpParser::begin_value(char c) {
+  m_sink = sink_object;
+
+  if (m_stack.empty())
+    return &m_root;
+
+  auto& frame = m_stack.back();
+
+  if (frame.object == nullptr) {
+    m_sink = sink_skip;
+    return nullptr;
+  }
+
+  if (!frame.is_map)
+    return &frame.object->as_list().emplace_back();
+
+  if (frame.is_filter) {
+    m_files_size++;
+
+    if (m_key != m_scrape_key) {
+      m_sink = sink_skip;
+      return nullptr;
+    }
+  }
+
+  if (frame.object == &m_root && (m_key == "peers" || m_key == "peers6")) {
+    m_has_peers = true;
+
+    if (is_digit(c)) {
+      m_sink = m_key == "peers" ? sink_compact : sink_compact6;
+      m_compact_size = 0;
+      return nullptr;
+    }
+  }
+
+  return &frame.object->insert_key(m_key, Object());
+}
+
+void
+TrackerHttpParser::end_value() {
+  if (m_stack.empty()) {
+    m_state = state_done;
+    return;
+  }
+
+  m_state = m_stack.back().is_map ? state_key : state_value;
+}
+
+void
+TrackerHttpParser::end_string() {
+  if (m_sink == sink_key)
+    m_state = state_value;
+  else
+    end_value();
+}
+
+// Trailing bytes of an incomplete entry are dropped, as when parsing
+// the whole string.
+void
+TrackerHttpParser::append_compact(const char* first, const char* last, size_t entry_size) {
+  auto append = [this, entry_size](const char* data, size_t size) {
+      if (entry_size == sizeof(SocketAddressCompact))
+        m_peers.parse_address_compact(raw_string(data, size));
+      else
+        m_peers.parse_address_compact_ipv6(raw_string(data, size));
+    };
+
+  if (m_compact_size != 0) {
+    size_t length = std::min<size_t>(entry_size - m_compact_size, last - first);
+
+    std::memcpy(m_compact + m_compact_size, first, length);
+    m_compact_size += length;
+    first += length;
+
+    if (m_compact_size != entry_size)
+      return;
+
+    append(m_compact, entry_size);
+    m_compact_size = 0;
+  }
+
+  size_t whole = (last - first) - (last - first) % entry_size;
+
+  if (whole != 0)
+    append(first, whole);
+
+  std::memcpy(m_compact, first + whole, (last - first) - whole);
+  m_compact_size = (last - first) - whole;
+}
+
+TrackerHttpStream::TrackerHttpStream(std::string scrape_key, bool keep_body) :
+    std::iostream(this),
+    m_parser(std::move(scrape_key), keep_body) {
+}
+
+std::streambuf::int_type
+TrackerHttpStream::overflow(std::streambuf::int_type c) {
+  using traits_type = std::streambuf::traits_type;
+
+  if (traits_type::eq_int_type(c, traits_type::eof()))
+    return traits_type::not_eof(c);
+
+  char ch = traits_type::to_char_type(c);
+  m_parser.parse(&ch, &ch + 1);
+  return c;
+}
+
+std::streamsize
+TrackerHttpStream::xsputn(const char* s, std::streamsize n) {
+  m_parser.parse(s, s + n);
+  return n;
+}
+
+}
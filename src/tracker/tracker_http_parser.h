@@ -0,0 +1,132 @@
+#ifndef LIBTORRENT_TRACKER_TRACKER_HTTP_PARSER_H
+#define LIBTORRENT_TRACKER_TRACKER_HTTP_PARSER_H
+
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "net/address_list.h"
+#include "torrent/object.h"
+
+namespace torrent {
+
+// Incremental bencode parser for tracker replies, fed with the body as
+// it arrives. Compact 'peers' and 'peers6' strings are decoded straight
+// into the address list instead of being kept in the object, and for
+// scrapes only the entry of 'files' matching the scrape key is kept.
+//
+// Everything else of the root is built as usual, so the reply is
+// handled as if read by object_read_bencode without those strings.
+
+class TrackerHttpParser {
+public:
+  static constexpr uint32_t max_depth          = 1024;
+  static constexpr size_t   body_head_size     = 1024;
+  static constexpr size_t   max_string_reserve = 1 << 16;
+
+  // The scrape key is the info hash to keep from the 'files' map, or
+  // empty for announces. With 'keep_body' the whole body is kept for
+  // debug logging, otherwise only its head.
+  TrackerHttpParser(std::string scrape_key = std::string(), bool keep_body = false);
+
+  // Once the root value is complete further input is ignored, as is
+  // all input after a parse error.
+  void                parse(const char* first, const char* last);
+
+  bool                is_done() const        { return m_state == state_done; }
+  bool                is_failed() const      { return m_state == state_failed; }
+
+  Object&             root()                 { return m_root; }
+  AddressList&        peers()                { return m_peers; }
+
+  // A 'peers' or 'peers6' key was in the root map, whatever its type.
+  bool                has_peers() const      { return m_has_peers; }
+
+  // Entries of the scrape 'files' map, including those not kept.
+  size_t              files_size() const     { return m_files_size; }
+
+  const std::string&  body() const           { return m_body; }
+
+private:
+  enum state_enum {
+    state_value,
+    state_key,
+    state_integer,
+    state_length,
+    state_string,
+    state_done,
+    state_failed
+  };
+
+  enum sink_enum {
+    sink_object,
+    sink_key,
+    sink_skip,
+    sink_compact,
+    sink_compact6
+  };
+
+  struct frame_type {
+    Object*           object;
+    bool              is_map;
+    bool              is_filter;
+  };
+
+  const char*         parse_value(const char* first, const char* last);
+  const char*         parse_integer(const char* first, const char* last);
+  const char*         parse_length(const char* first, const char* last);
+  const char*         parse_string(const char* first, const char* last);
+
+  Object*             begin_value(char c);
+  void                end_value();
+  void                end_string();
+
+  void                append_compact(const char* first, const char* last, size_t entry_size);
+
+  void                set_failed()           { m_state = state_failed; }
+
+  std::string         m_scrape_key;
+  bool                m_keep_body;
+  std::string         m_body;
+
+  state_enum          m_state{state_value};
+  std::vector<frame_type> m_stack;
+
+  Object              m_root;
+  AddressList         m_peers;
+  bool                m_has_peers{false};
+  size_t              m_files_size{0};
+
+  // The key of the map value being read, and the value it routes to.
+  std::string         m_key;
+  Object*             m_target{};
+  sink_enum           m_sink{sink_object};
+
+  bool                m_negative{false};
+  bool                m_has_digits{false};
+  uint64_t            m_number{0};
+  uint64_t            m_remaining{0};
+
+  // Partial compact entry split across chunks.
+  char                m_compact[18];
+  size_t              m_compact_size{0};
+};
+
+// Output stream handed to Http, which passes each written chunk to the
+// parser.
+class TrackerHttpStream : private std::streambuf, public std::iostream {
+public:
+  TrackerHttpStream(std::string scrape_key = std::string(), bool keep_body = false);
+
+  TrackerHttpParser&  parser()               { return m_parser; }
+
+private:
+  std::streambuf::int_type overflow(std::streambuf::int_type c) override;
+  std::streamsize     xsputn(const char* s, std::streamsize n) override;
+
+  TrackerHttpParser   m_parser;
+};
+
+}
+
+#endif
@@ -0,0 +1,118 @@
+#include "config.h"
+
+#include "tracker/tracker_http_pool.h"
+
+#include <algorithm>
+
+#include "torrent/exceptions.h"
+#include "torrent/utils/uri_parser.h"
+
+namespace torrent {
+
+void
+TrackerHttpPool::set_max_active(unsigned int max) {
+  if (max == 0)
+    throw internal_error("TrackerHttpPool::set_max_active() max is zero.");
+
+  m_max_active = max;
+
+  for (auto itr = m_hosts.begin(); itr != m_hosts.end();)
+    start_queued((itr++)->first);
+}
+
+unsigned int
+TrackerHttpPool::size_active(const std::string& url) const {
+  auto itr = m_hosts.find(utils::uri_host_key(url));
+
+  return itr != m_hosts.end() ? itr->second.active : 0;
+}
+
+unsigned int
+TrackerHttpPool::size_queued(const std::string& url) const {
+  auto itr = m_hosts.find(utils::uri_host_key(url));
+
+  return itr != m_hosts.end() ? itr->second.queue.size() : 0;
+}
+
+bool
+TrackerHttpPool::is_queued(void* requester) const {
+  auto itr = m_requesters.find(requester);
+
+  return itr != m_requesters.end() && !itr->second.active;
+}
+
+bool
+TrackerHttpPool::is_active(void* requester) const {
+  auto itr = m_requesters.find(requester);
+
+  return itr != m_requesters.end() && itr->second.active;
+}
+
+void
+TrackerHttpPool::insert(void* requester, const std::string& url, slot_start slot) {
+  auto key = utils::uri_host_key(url);
+
+  if (!m_requesters.emplace(requester, requester_type{key, false}).second)
+    throw internal_error("TrackerHttpPool::insert() requester already inserted.");
+
+  m_hosts[key].queue.emplace_back(requester, std::move(slot));
+
+  start_queued(key);
+}
+
+void
+TrackerHttpPool::erase(void* requester) {
+  auto itr = m_requesters.find(requester);
+
+  if (itr == m_requesters.end())
+    return;
+
+  auto key    = std::move(itr->second.key);
+  bool active = itr->second.active;
+
+  m_requesters.erase(itr);
+
+  auto host_itr = m_hosts.find(key);
+
+  if (host_itr == m_hosts.end())
+    throw internal_error("TrackerHttpPool::erase() host not found.");
+
+  auto& host = host_itr->second;
+
+  if (active) {
+    host.active--;
+  } else {
+    host.queue.erase(std::find_if(host.queue.begin(), host.queue.end(), [requester](auto& r) { return r.first == requester; }));
+  }
+
+  if (host.active == 0 && host.queue.empty()) {
+    m_hosts.erase(host_itr);
+    return;
+  }
+
+  start_queued(key);
+}
+
+// The started slots may erase requests, so look up the host again for
+// each iteration.
+void
+TrackerHttpPool::start_queued(const std::string& key) {
+  while (true) {
+    auto host_itr = m_hosts.find(key);
+
+    if (host_itr == m_hosts.end() ||
+        host_itr->second.queue.empty() ||
+        host_itr->second.active >= m_max_active)
+      return;
+
+    auto entry = std::move(host_itr->second.queue.front());
+    host_itr->second.queue.pop_front();
+    host_itr->second.active++;
+
+    m_requesters[entry.first].active = true;
+
+    entry.second();
+  }
+}
+
+}
@@ -0,0 +1,62 @@
+#ifndef LIBTORRENT_TRACKER_TRACKER_HTTP_POOL_H
+#define LIBTORRENT_TRACKER_TRACKER_HTTP_POOL_H
+
+#include <deque>
+#include <functional>
+#include <map>
+#include <string>
+
+namespace torrent {
+
+// Limits the number of concurrent HTTP tracker requests to each host,
+// as given by 'utils::uri_host_key', queuing the rest until an active
+// request finishes.
+//
+// Connection and TLS session reuse is up to the client's Http
+// implementation, bounding the requests per host keeps its connection
+// cache effective when many downloads announce to the same tracker at
+// once.
+
+class TrackerHttpPool {
+public:
+  using slot_start = std::function<void()>;
+
+  static constexpr unsigned int default_max_active = 4;
+
+  unsigned int        max_active() const { return m_max_active; }
+  void                set_max_active(unsigned int max);
+
+  size_t              size_hosts() const { return m_hosts.size(); }
+  unsigned int        size_active(const std::string& url) const;
+  unsigned int        size_queued(const std::string& url) const;
+
+  bool                is_queued(void* requester) const;
+  bool                is_active(void* requester) const;
+
+  // The slot is called immediately if the host has a free slot,
+  // otherwise once an earlier request to the host is erased.
+  void                insert(void* requester, const std::string& url, slot_start slot);
+  void                erase(void* requester);
+
+private:
+  struct host_type {
+    unsigned int                             active{};
+    std::deque<std::pair<void*, slot_start>> queue;
+  };
+
+  struct requester_type {
+    std::string       key;
+    bool              active;
+  };
+
+  void                start_queued(const std::string& key);
+
+  unsigned int                          m_max_active{default_max_active};
+
+  std::map<std::string, host_type>      m_hosts;
+  std::map<void*, requester_type>       m_requesters;
+};
+
+}
+
+#endif
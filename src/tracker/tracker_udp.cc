@@ -4,7 +4,9 @@
 
 #include "tracker_udp.h"
 
+#include <algorithm>
 #include <cstdio>
+#include <cstring>
 #include <netdb.h>
 #include <sys/types.h>
 
@@ -25,6 +27,9 @@
 #include "torrent/utils/uri_parser.h"
 
 #include "thread_main.h"
+#include "tracker/thread_tracker.h"
+#include "tracker/tracker_udp_router.h"
+#include "utils/probe.h"
 
 #define LT_LOG(log_fmt, ...)                                            \
   lt_log_print_hash(LOG_TRACKER_REQUESTS, info().info_hash, "tracker_udp", "%p : " log_fmt, static_cast<TrackerWorker*>(this), __VA_ARGS__);
@@ -36,7 +41,7 @@
 namespace torrent {
 
 TrackerUdp::TrackerUdp(const TrackerInfo& info, int flags) :
-  TrackerWorker(info, flags) {
+  TrackerWorker(info, flags | tracker::TrackerState::flag_scrapable) {
 
   m_task_timeout.slot() = [this] { receive_timeout(); };
 }
@@ -45,18 +50,48 @@ TrackerUdp::~TrackerUdp() {
   close_directly();
 }
 
+TrackerUdpRouter*
+TrackerUdp::router() {
+  return thread_tracker()->udp_router();
+}
+
 bool
 TrackerUdp::is_busy() const {
-  return get_fd().is_valid();
+  return m_router_user;
 }
 
 void
 TrackerUdp::send_event(tracker::TrackerState::event_enum new_state) {
   LT_LOG("sending event : state:%s url:%s", option_as_string(OPTION_TRACKER_EVENT, new_state), info().url.c_str());
+  LT_PROBE2(tracker_udp_send, this, static_cast<int>(new_state));
+
+  close_directly();
+  start_request(new_state);
+}
+
+void
+TrackerUdp::send_scrape() {
+  send_scrape_batch(scrape_batch_type());
+}
+
+void
+TrackerUdp::send_scrape_batch(scrape_batch_type batch) {
+  LT_LOG("sending scrape : batch:%zu url:%s", batch.size(), info().url.c_str());
+
+  if (batch.size() >= max_scrape_hashes)
+    throw internal_error("TrackerUdp::send_scrape_batch() batch is too large.");
 
-  // TODO: Don't close fd for every new request.
   close_directly();
 
+  m_scrape_batch = std::move(batch);
+
+  start_request(tracker::TrackerState::EVENT_SCRAPE);
+}
+
+void
+TrackerUdp::start_request(tracker::TrackerState::event_enum new_state) {
+  m_send_state = new_state;
+
   hostname_type hostname;
 
   if (!parse_udp_url(info().url, hostname, m_port))
@@ -64,7 +99,6 @@ TrackerUdp::send_event(tracker::TrackerState::event_enum new_state) {
 
   lock_and_set_latest_event(new_state);
 
-  m_send_state = new_state;
   m_resolver_requesting = true;
   m_sending_announce = true;
 
@@ -76,7 +110,7 @@ TrackerUdp::send_event(tracker::TrackerState::event_enum new_state) {
 
     // Currently discarding SOCK_DGRAM filter.
     this_thread::resolver()->resolve_both(static_cast<TrackerWorker*>(this), hostname.data(), AF_UNSPEC,
-                                          [this](c_sin_shared_ptr sin, c_sin6_shared_ptr sin6, int err) {
+                                          [this](const sa_inet_storage& sin, const sa_inet_storage& sin6, int err) {
                                             receive_resolved(sin, sin6, err);
                                           });
     return;
@@ -85,11 +119,6 @@ TrackerUdp::send_event(tracker::TrackerState::event_enum new_state) {
   start_announce();
 }
 
-void
-TrackerUdp::send_scrape() {
-  throw internal_error("Tracker type UDP does not support scrape.");
-}
-
 bool
 TrackerUdp::parse_udp_url(const std::string& url, hostname_type& hostname, int& port) const {
   if (std::sscanf(url.c_str(), "udp://%1023[^:]:%i", hostname.data(), &port) == 2 && hostname[0] != '\0' &&
@@ -137,16 +166,13 @@ TrackerUdp::close_directly() {
   m_read_buffer = nullptr;
   m_write_buffer = nullptr;
 
-  if (!get_fd().is_valid())
-    return;
+  cancel_scrape_batch("scrape request cancelled");
 
-  this_thread::poll()->remove_read(this);
-  this_thread::poll()->remove_write(this);
-  this_thread::poll()->remove_error(this);
-  this_thread::poll()->close(this);
+  if (!m_router_user)
+    return;
 
-  get_fd().close();
-  get_fd().clear();
+  m_router_user = false;
+  router()->remove_user(static_cast<TrackerWorker*>(this));
 }
 
 tracker_enum
@@ -154,10 +180,29 @@ TrackerUdp::type() const {
   return TRACKER_UDP;
 }
 
+void
+TrackerUdp::cancel_scrape_batch(const std::string& msg) {
+  auto batch = std::move(m_scrape_batch);
+
+  for (auto& weak_worker : batch) {
+    auto worker = weak_worker.lock();
+
+    if (worker)
+      static_cast<TrackerUdp*>(worker.get())->m_slot_scrape_failure(msg);
+  }
+}
+
 void
 TrackerUdp::receive_failed(const std::string& msg) {
   m_failed_since_last_resolved++;
 
+  if (m_send_state == tracker::TrackerState::EVENT_SCRAPE) {
+    cancel_scrape_batch(msg);
+    close_directly();
+    m_slot_scrape_failure(msg);
+    return;
+  }
+
   close_directly();
   m_slot_failure(msg);
 }
@@ -165,7 +210,7 @@ TrackerUdp::receive_failed(const std::string& msg) {
 // TODO: Only resolve when we don't have a valid address, failed too many times or network change
 // events.
 void
-TrackerUdp::receive_resolved(c_sin_shared_ptr& sin, c_sin6_shared_ptr& sin6, int err) {
+TrackerUdp::receive_resolved(const sa_inet_storage& sin, const sa_inet_storage& sin6, int err) {
   if (std::this_thread::get_id() != torrent::thread_main()->thread_id())
     throw internal_error("TrackerUdp::receive_resolved() called from a different thread.");
 
@@ -181,15 +226,15 @@ TrackerUdp::receive_resolved(c_sin_shared_ptr& sin, c_sin6_shared_ptr& sin6, int
     return receive_failed("could not resolve hostname : error:'" + std::string(gai_strerror(err)) + "'");
   }
 
-  if (sin != nullptr) {
-    m_inet_address = sin_copy(sin.get());
+  if (sin.is_inet()) {
+    m_inet_address = sin_copy(sin.get_in());
     sa_set_port(reinterpret_cast<sockaddr*>(m_inet_address.get()), m_port);
   } else {
     m_inet_address = nullptr;
   }
 
-  if (sin6 != nullptr) {
-    m_inet6_address = sin6_copy(sin6.get());
+  if (sin6.is_inet6()) {
+    m_inet6_address = sin6_copy(sin6.get_in6());
     sa_set_port(reinterpret_cast<sockaddr*>(m_inet6_address.get()), m_port);
   } else {
     m_inet6_address = nullptr;
@@ -211,8 +256,15 @@ TrackerUdp::receive_timeout() {
     return;
   }
 
+  // A tracker may silently drop announces with a connection id it no
+  // longer recognizes, so retry from the connect request.
+  if (m_action != 0)
+    router()->erase_connection_id(m_current_address);
+
+  prepare_connect_input();
+  send_request();
+
   this_thread::scheduler()->wait_for_ceil_seconds(&m_task_timeout, std::chrono::seconds(udp_timeout));
-  this_thread::poll()->insert_write(this);
 }
 
 void
@@ -233,32 +285,25 @@ TrackerUdp::start_announce() {
 
   LT_LOG("starting announce : address:%s", sa_pretty_str(m_current_address).c_str());
 
-  // TODO: Make each of these a separate error... at the very least separate open and bind.
-  if (!get_fd().open_datagram() || !get_fd().set_nonblock()) {
-    LT_LOG("could not open UDP socket", 0);
-    return receive_failed("could not open UDP socket");
+  if (!router()->add_user(static_cast<TrackerWorker*>(this), manager->connection_manager()->bind_address())) {
+    LT_LOG("could not open shared UDP socket", 0);
+    return receive_failed("could not open shared UDP socket");
   }
 
-  auto bind_address = rak::socket_address::cast_from(manager->connection_manager()->bind_address());
-
-  if (bind_address->is_bindable() && !get_fd().bind(*bind_address)) {
-    LT_LOG("failed to bind socket to udp address : address:%s error:'%s'",
-           bind_address->pretty_address_str().c_str(), rak::error_number::current().c_str());
-
-    return receive_failed("failed to bind socket to udp address '" + bind_address->pretty_address_str() +
-                          "' with error '" + rak::error_number::current().c_str() + "'");
-  }
+  m_router_user = true;
 
   // TODO: Don't recreate buffers.
   m_read_buffer = std::make_unique<ReadBuffer>();
   m_write_buffer = std::make_unique<WriteBuffer>();
 
-  prepare_connect_input();
+  if (router()->find_connection_id(m_current_address, &m_connection_id)) {
+    LT_LOG("using cached connection id : id:%" PRIx64, m_connection_id);
+    prepare_request_input();
+  } else {
+    prepare_connect_input();
+  }
 
-  this_thread::poll()->open(this);
-  this_thread::poll()->insert_read(this);
-  this_thread::poll()->insert_write(this);
-  this_thread::poll()->insert_error(this);
+  send_request();
 
   m_tries = udp_tries;
 
@@ -266,37 +311,44 @@ TrackerUdp::start_announce() {
 }
 
 void
-TrackerUdp::event_read() {
-  rak::socket_address sa;
+TrackerUdp::send_request() {
+  if (m_write_buffer->size_end() == 0)
+    throw internal_error("TrackerUdp::send_request() called but the write buffer is empty.");
 
-  int s = read_datagram(m_read_buffer->begin(), m_read_buffer->reserved(), &sa);
+  router()->send(static_cast<TrackerWorker*>(this), reinterpret_cast<const char*>(m_write_buffer->begin()), m_write_buffer->size_end(), m_current_address);
+}
 
-  if (s < 0)
-    return;
+void
+TrackerUdp::receive_datagram(const char* data, unsigned int length) {
+  int s = std::min<unsigned int>(length, m_read_buffer->reserved());
+
+  std::memcpy(m_read_buffer->begin(), data, s);
 
   m_read_buffer->reset_position();
   m_read_buffer->set_end(s);
 
   LT_LOG("received reply : size:%d", s);
+  LT_PROBE2(tracker_udp_receive, this, s);
   LT_LOG_DUMP(reinterpret_cast<const char*>(m_read_buffer->begin()), s, "received reply", 0);
 
   if (s < 4)
     return;
 
-  // Make sure sa is from the source we expected?
-
-  // Do something with the content here.
+  // The router has already matched the transaction id and source
+  // address, replies we can't process are left to the timeout.
   switch (m_read_buffer->read_32()) {
   case 0:
     if (m_action != 0 || !process_connect_output())
       return;
 
-    prepare_announce_input();
+    router()->set_connection_id(m_current_address, m_connection_id);
+
+    prepare_request_input();
+    send_request();
 
     this_thread::scheduler()->update_wait_for_ceil_seconds(&m_task_timeout, std::chrono::seconds(udp_timeout));
 
     m_tries = udp_tries;
-    this_thread::poll()->insert_write(this);
     return;
 
   case 1:
@@ -305,6 +357,12 @@ TrackerUdp::event_read() {
 
     return;
 
+  case 2:
+    if (m_action != 2 || !process_scrape_output())
+      return;
+
+    return;
+
   case 3:
     if (!process_error_output())
       return;
@@ -316,18 +374,10 @@ TrackerUdp::event_read() {
   };
 }
 
-void
-TrackerUdp::event_write() {
-  if (m_write_buffer->size_end() == 0)
-    throw internal_error("TrackerUdp::write() called but the write buffer is empty.");
-
-  [[maybe_unused]] int s = write_datagram_sa(m_write_buffer->begin(), m_write_buffer->size_end(), m_current_address);
-
-  this_thread::poll()->remove_write(this);
-}
-
-void
-TrackerUdp::event_error() {
+uint32_t
+TrackerUdp::insert_transaction() {
+  return router()->insert_transaction(static_cast<TrackerWorker*>(this), m_current_address,
+                                      [this](const char* data, unsigned int length) { receive_datagram(data, length); });
 }
 
 void
@@ -335,18 +385,26 @@ TrackerUdp::prepare_connect_input() {
   m_write_buffer->reset();
   m_write_buffer->write_64(m_connection_id = magic_connection_id);
   m_write_buffer->write_32(m_action = 0);
-  m_write_buffer->write_32(m_transaction_id = random());
+  m_write_buffer->write_32(m_transaction_id = insert_transaction());
 
   LT_LOG_DUMP(m_write_buffer->begin(), m_write_buffer->size_end(), "prepare connect (id:%" PRIx32 ")", m_transaction_id);
 }
 
+void
+TrackerUdp::prepare_request_input() {
+  if (m_send_state == tracker::TrackerState::EVENT_SCRAPE)
+    prepare_scrape_input();
+  else
+    prepare_announce_input();
+}
+
 void
 TrackerUdp::prepare_announce_input() {
   m_write_buffer->reset();
 
   m_write_buffer->write_64(m_connection_id);
   m_write_buffer->write_32(m_action = 1);
-  m_write_buffer->write_32(m_transaction_id = random());
+  m_write_buffer->write_32(m_transaction_id = insert_transaction());
 
   m_write_buffer->write_range(info().info_hash.begin(), info().info_hash.end());
   m_write_buffer->write_range(info().local_id.begin(), info().local_id.end());
@@ -379,6 +437,31 @@ TrackerUdp::prepare_announce_input() {
               m_transaction_id, parameters.uploaded_adjusted, parameters.completed_adjusted, parameters.download_left);
 }
 
+void
+TrackerUdp::prepare_scrape_input() {
+  // Trackers removed since the batch was queued are dropped here, the
+  // reply lists the stats in the order of the requested hashes.
+  m_scrape_batch.erase(std::remove_if(m_scrape_batch.begin(), m_scrape_batch.end(),
+                                      [](const std::weak_ptr<TrackerWorker>& w) { return w.expired(); }),
+                       m_scrape_batch.end());
+
+  m_write_buffer->reset();
+
+  m_write_buffer->write_64(m_connection_id);
+  m_write_buffer->write_32(m_action = 2);
+  m_write_buffer->write_32(m_transaction_id = insert_transaction());
+
+  m_write_buffer->write_range(info().info_hash.begin(), info().info_hash.end());
+
+  for (auto& weak_worker : m_scrape_batch) {
+    auto worker = weak_worker.lock();
+    m_write_buffer->write_range(worker->info().info_hash.begin(), worker->info().info_hash.end());
+  }
+
+  LT_LOG_DUMP(m_write_buffer->begin(), m_write_buffer->size_end(),
+              "prepare scrape (id:%" PRIx32 " hashes:%zu)", m_transaction_id, m_scrape_batch.size() + 1);
+}
+
 bool
 TrackerUdp::process_connect_output() {
   if (m_read_buffer->size_end() < 16 ||
@@ -422,12 +505,70 @@ TrackerUdp::process_announce_output() {
   return true;
 }
 
+bool
+TrackerUdp::process_scrape_output() {
+  if (m_read_buffer->size_end() < 20 ||
+      m_read_buffer->read_32() != m_transaction_id)
+    return false;
+
+  auto read_scrape = [this](TrackerUdp* worker) {
+      auto guard = worker->lock_guard();
+
+      worker->state().m_scrape_complete   = m_read_buffer->read_32(); // seeders
+      worker->state().m_scrape_downloaded = m_read_buffer->read_32(); // completed
+      worker->state().m_scrape_incomplete = m_read_buffer->read_32(); // leechers
+      worker->state().m_scrape_time_last  = rak::timer::current().seconds();
+    };
+
+  read_scrape(this);
+
+  auto batch = std::move(m_scrape_batch);
+
+  std::vector<std::shared_ptr<TrackerWorker>> scraped;
+  std::vector<std::shared_ptr<TrackerWorker>> missing;
+
+  for (auto& weak_worker : batch) {
+    auto worker = weak_worker.lock();
+
+    if (m_read_buffer->remaining() < 12) {
+      if (worker)
+        missing.push_back(std::move(worker));
+
+      continue;
+    }
+
+    if (!worker) {
+      m_read_buffer->set_position_itr(m_read_buffer->position() + 12);
+      continue;
+    }
+
+    read_scrape(static_cast<TrackerUdp*>(worker.get()));
+    scraped.push_back(std::move(worker));
+  }
+
+  LT_LOG("received scrape : scraped:%zu missing:%zu", scraped.size() + 1, missing.size());
+
+  close_directly();
+
+  m_slot_scrape_success();
+
+  for (auto& worker : scraped)
+    static_cast<TrackerUdp*>(worker.get())->m_slot_scrape_success();
+
+  for (auto& worker : missing)
+    static_cast<TrackerUdp*>(worker.get())->m_slot_scrape_failure("scrape reply did not include info hash");
+
+  return true;
+}
+
 bool
 TrackerUdp::process_error_output() {
   if (m_read_buffer->size_end() < 8 ||
       m_read_buffer->read_32() != m_transaction_id)
     return false;
 
+  router()->erase_connection_id(m_current_address);
+
   receive_failed("received error message: " + std::string(m_read_buffer->position(), m_read_buffer->end()));
   return true;
 }
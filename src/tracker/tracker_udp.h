@@ -3,66 +3,87 @@
 
 #include <array>
 #include <memory>
+#include <vector>
 
 #include "net/protocol_buffer.h"
-#include "net/socket_datagram.h"
 #include "torrent/net/types.h"
 #include "torrent/utils/scheduler.h"
 #include "tracker/tracker_worker.h"
 
 namespace torrent {
 
-class TrackerUdp : public SocketDatagram, public TrackerWorker {
+class TrackerUdpRouter;
+
+class TrackerUdp : public TrackerWorker {
 public:
   using hostname_type = std::array<char, 1024>;
 
-  using ReadBuffer  = ProtocolBuffer<512>;
-  using WriteBuffer = ProtocolBuffer<512>;
+  // Sized for a scrape of 'max_scrape_hashes' info hashes, which
+  // keeps the request within a 1500 byte MTU.
+  using ReadBuffer  = ProtocolBuffer<1024>;
+  using WriteBuffer = ProtocolBuffer<1500>;
+
+  using scrape_batch_type = std::vector<std::weak_ptr<TrackerWorker>>;
 
   static constexpr uint64_t magic_connection_id = 0x0000041727101980ll;
 
+  static constexpr unsigned int max_scrape_hashes = 74;
+
   static constexpr uint32_t udp_timeout = 30;
   static constexpr uint32_t udp_tries = 2;
 
   TrackerUdp(const TrackerInfo& info, int flags = 0);
   ~TrackerUdp() override;
 
-  const char*         type_name() const override { return "tracker_udp"; }
-
   bool                is_busy() const override;
 
   void                send_event(tracker::TrackerState::event_enum new_state) override;
   void                send_scrape() override;
 
+  // Scrape the other UDP trackers, which must have the same url, in
+  // the same request. Each gets its own scrape success or failure
+  // slot called.
+  void                send_scrape_batch(scrape_batch_type batch);
+
   void                close() override;
   void                disown() override;
 
   tracker_enum        type() const override;
 
-  void                event_read() override;
-  void                event_write() override;
-  void                event_error() override;
-
 private:
+  static TrackerUdpRouter* router();
+
   void                close_directly();
+  void                cancel_scrape_batch(const std::string& msg);
+
+  void                start_request(tracker::TrackerState::event_enum new_state);
 
   void                receive_failed(const std::string& msg);
-  void                receive_resolved(c_sin_shared_ptr& sin, c_sin6_shared_ptr& sin6, int err);
+  void                receive_resolved(const sa_inet_storage& sin, const sa_inet_storage& sin6, int err);
   void                receive_timeout();
 
+  void                receive_datagram(const char* data, unsigned int length);
+
   void                start_announce();
+  void                send_request();
+
+  uint32_t            insert_transaction();
 
   void                prepare_connect_input();
+  void                prepare_request_input();
   void                prepare_announce_input();
+  void                prepare_scrape_input();
 
   bool                process_connect_output();
   bool                process_announce_output();
+  bool                process_scrape_output();
   bool                process_error_output();
 
   bool                parse_udp_url(const std::string& url, hostname_type& hostname, int& port) const;
 
   bool                m_resolver_requesting{false};
   bool                m_sending_announce{false};
+  bool                m_router_user{false};
 
   sockaddr*           m_current_address{nullptr};
   sin_unique_ptr      m_inet_address;
@@ -75,6 +96,8 @@ private:
   uint64_t            m_connection_id{};
   uint32_t            m_transaction_id{};
 
+  scrape_batch_type   m_scrape_batch;
+
   std::unique_ptr<ReadBuffer>  m_read_buffer;
   std::unique_ptr<WriteBuffer> m_write_buffer;
 
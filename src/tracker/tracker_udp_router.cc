@@ -0,0 +1,340 @@
+#include "config.h"
+
+#include "tracker/tracker_udp_router.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <netinet/in.h>
+#include <sys/socket.h>
+
+#include "rak/error_number.h"
+#include "rak/socket_address.h"
+#include "torrent/common.h"
+#include "torrent/exceptions.h"
+#include "torrent/poll.h"
+#include "torrent/net/socket_address.h"
+#include "torrent/utils/log.h"
+
+#define LT_LOG(log_fmt, ...)                                            \
+  lt_log_print(LOG_TRACKER_EVENTS, "tracker_udp_router: " log_fmt, __VA_ARGS__);
+
+namespace torrent {
+
+TrackerUdpRouter::~TrackerUdpRouter() {
+  if (get_fd().is_valid())
+    close();
+}
+
+bool
+TrackerUdpRouter::add_user(void* user, const sockaddr* bind_address) {
+  if (std::find(m_users.begin(), m_users.end(), user) != m_users.end())
+    throw internal_error("TrackerUdpRouter::add_user() user already added.");
+
+  if (!get_fd().is_valid() && !open(bind_address))
+    return false;
+
+  m_users.push_back(user);
+  return true;
+}
+
+void
+TrackerUdpRouter::remove_user(void* user) {
+  auto itr = std::find(m_users.begin(), m_users.end(), user);
+
+  if (itr == m_users.end())
+    return;
+
+  m_users.erase(itr);
+
+  erase_transaction(user);
+
+  m_writes.erase(std::remove_if(m_writes.begin(), m_writes.end(), [user](const write_type& w) { return w.user == user; }),
+                 m_writes.end());
+
+  if (m_users.empty() && get_fd().is_valid())
+    close();
+}
+
+uint32_t
+TrackerUdpRouter::insert_transaction(void* user, const sockaddr* sa, slot_receive slot) {
+  erase_transaction(user);
+
+  uint32_t transaction_id;
+
+  do {
+    transaction_id = random();
+  } while (m_transactions.find(transaction_id) != m_transactions.end());
+
+  sa_unique_ptr address = sa_is_v4mapped(sa) ? sa_from_v4mapped(sa) : sa_copy(sa);
+
+  m_transactions.emplace(transaction_id, transaction_type{user, std::move(address), std::move(slot)});
+  m_user_transactions[user] = transaction_id;
+
+  return transaction_id;
+}
+
+void
+TrackerUdpRouter::erase_transaction(void* user) {
+  auto itr = m_user_transactions.find(user);
+
+  if (itr == m_user_transactions.end())
+    return;
+
+  m_transactions.erase(itr->second);
+  m_user_transactions.erase(itr);
+}
+
+bool
+TrackerUdpRouter::find_connection_id(const sockaddr* sa, uint64_t* connection_id) {
+  auto itr = m_connection_ids.find(address_key(sa));
+
+  if (itr == m_connection_ids.end())
+    return false;
+
+  if (this_thread::cached_time() - itr->second.time >= connection_id_timeout) {
+    m_connection_ids.erase(itr);
+    return false;
+  }
+
+  *connection_id = itr->second.id;
+  return true;
+}
+
+void
+TrackerUdpRouter::set_connection_id(const sockaddr* sa, uint64_t connection_id) {
+  prune_connection_ids();
+
+  m_connection_ids[address_key(sa)] = connection_id_type{connection_id, this_thread::cached_time()};
+}
+
+void
+TrackerUdpRouter::erase_connection_id(const sockaddr* sa) {
+  m_connection_ids.erase(address_key(sa));
+}
+
+void
+TrackerUdpRouter::send(void* user, const char* data, unsigned int length, const sockaddr* sa) {
+  if (!get_fd().is_valid())
+    throw internal_error("TrackerUdpRouter::send() called but the socket is not open.");
+
+  if (length == 0 || length > max_datagram_size)
+    throw internal_error("TrackerUdpRouter::send() called with an invalid length.");
+
+  write_type w{user, std::vector<char>(data, data + length), {}, 0};
+
+  if (m_ipv6_socket && sa->sa_family == AF_INET) {
+    auto sa_mapped = sa_to_v4mapped_in(reinterpret_cast<const sockaddr_in*>(sa));
+    w.address_length = sa_length(sa_mapped.get());
+    std::memcpy(&w.address, sa_mapped.get(), w.address_length);
+  } else {
+    w.address_length = sa_length(sa);
+    std::memcpy(&w.address, sa, w.address_length);
+  }
+
+  if (m_writes.empty())
+    this_thread::poll()->insert_write(this);
+
+  m_writes.push_back(std::move(w));
+}
+
+bool
+TrackerUdpRouter::receive_datagram(const char* data, unsigned int length, const sockaddr* sa) {
+  if (length < 8)
+    return false;
+
+  uint32_t transaction_id;
+  std::memcpy(&transaction_id, data + 4, sizeof(transaction_id));
+
+  auto itr = m_transactions.find(ntohl(transaction_id));
+
+  if (itr == m_transactions.end())
+    return false;
+
+  sa_unique_ptr source = sa_is_v4mapped(sa) ? sa_from_v4mapped(sa) : sa_copy(sa);
+
+  if (!sa_equal(source.get(), itr->second.address.get())) {
+    LT_LOG("reply source does not match transaction : source:%s", sa_pretty_str(source.get()).c_str());
+    return false;
+  }
+
+  // The slot may insert a new transaction or remove the user, so
+  // erase the entry before calling it.
+  auto slot = std::move(itr->second.slot);
+
+  m_user_transactions.erase(itr->second.user);
+  m_transactions.erase(itr);
+
+  slot(data, length);
+  return true;
+}
+
+void
+TrackerUdpRouter::event_read() {
+  sockaddr_storage addresses[batch_size];
+
+#ifdef USE_SENDMMSG
+  mmsghdr msgs[batch_size];
+  iovec   iovecs[batch_size];
+
+  while (get_fd().is_valid()) {
+    std::memset(msgs, 0, sizeof(msgs));
+
+    for (unsigned int i = 0; i < batch_size; i++) {
+      iovecs[i].iov_base = m_read_buffer.data() + i * max_datagram_size;
+      iovecs[i].iov_len  = max_datagram_size;
+
+      msgs[i].msg_hdr.msg_name    = &addresses[i];
+      msgs[i].msg_hdr.msg_namelen = sizeof(sockaddr_storage);
+      msgs[i].msg_hdr.msg_iov     = &iovecs[i];
+      msgs[i].msg_hdr.msg_iovlen  = 1;
+    }
+
+    int count = ::recvmmsg(m_fileDesc, msgs, batch_size, MSG_DONTWAIT, nullptr);
+
+    if (count <= 0)
+      return;
+
+    for (int i = 0; i < count && get_fd().is_valid(); i++)
+      receive_datagram(m_read_buffer.data() + i * max_datagram_size, msgs[i].msg_len, reinterpret_cast<sockaddr*>(&addresses[i]));
+
+    if (static_cast<unsigned int>(count) < batch_size)
+      return;
+  }
+#else
+  for (unsigned int i = 0; i < batch_size && get_fd().is_valid(); i++) {
+    socklen_t address_length = sizeof(sockaddr_storage);
+
+    int s = ::recvfrom(m_fileDesc, m_read_buffer.data(), max_datagram_size, 0,
+                       reinterpret_cast<sockaddr*>(&addresses[0]), &address_length);
+
+    if (s < 0)
+      return;
+
+    receive_datagram(m_read_buffer.data(), s, reinterpret_cast<sockaddr*>(&addresses[0]));
+  }
+#endif
+}
+
+void
+TrackerUdpRouter::event_write() {
+  while (!m_writes.empty()) {
+#ifdef USE_SENDMMSG
+    mmsghdr      msgs[batch_size];
+    iovec        iovecs[batch_size];
+    unsigned int count = std::min<size_t>(m_writes.size(), batch_size);
+
+    std::memset(msgs, 0, sizeof(msgs));
+
+    for (unsigned int i = 0; i < count; i++) {
+      iovecs[i].iov_base = m_writes[i].data.data();
+      iovecs[i].iov_len  = m_writes[i].data.size();
+
+      msgs[i].msg_hdr.msg_name    = &m_writes[i].address;
+      msgs[i].msg_hdr.msg_namelen = m_writes[i].address_length;
+      msgs[i].msg_hdr.msg_iov     = &iovecs[i];
+      msgs[i].msg_hdr.msg_iovlen  = 1;
+    }
+
+    int sent = ::sendmmsg(m_fileDesc, msgs, count, 0);
+#else
+    int sent = ::sendto(m_fileDesc, m_writes.front().data.data(), m_writes.front().data.size(), 0,
+                        reinterpret_cast<sockaddr*>(&m_writes.front().address), m_writes.front().address_length) < 0 ? -1 : 1;
+#endif
+
+    if (sent < 0) {
+      if (rak::error_number::current().is_blocked_momentary())
+        return;
+
+      // Drop the datagram, the requester retries on timeout.
+      LT_LOG("failed to send datagram : error:'%s'", rak::error_number::current().c_str());
+      sent = 1;
+    }
+
+    m_writes.erase(m_writes.begin(), m_writes.begin() + sent);
+  }
+
+  this_thread::poll()->remove_write(this);
+}
+
+void
+TrackerUdpRouter::event_error() {
+}
+
+bool
+TrackerUdpRouter::open(const sockaddr* bind_sa) {
+  if (!get_fd().open_datagram() || !get_fd().set_nonblock()) {
+    LT_LOG("could not open UDP socket", 0);
+
+    if (get_fd().is_valid()) {
+      get_fd().close();
+      get_fd().clear();
+    }
+
+    return false;
+  }
+
+  auto bind_address = rak::socket_address::cast_from(bind_sa);
+
+  if (bind_address->is_bindable() && !get_fd().bind(*bind_address)) {
+    LT_LOG("failed to bind socket to udp address : address:%s error:'%s'",
+           bind_address->pretty_address_str().c_str(), rak::error_number::current().c_str());
+
+    get_fd().close();
+    get_fd().clear();
+    return false;
+  }
+
+  m_read_buffer.resize(batch_size * max_datagram_size);
+
+  this_thread::poll()->open(this);
+  this_thread::poll()->insert_read(this);
+  this_thread::poll()->insert_error(this);
+
+  LT_LOG("opened shared socket : fd:%i", m_fileDesc);
+  return true;
+}
+
+void
+TrackerUdpRouter::close() {
+  LT_LOG("closing shared socket : fd:%i", m_fileDesc);
+
+  this_thread::poll()->remove_read(this);
+  this_thread::poll()->remove_write(this);
+  this_thread::poll()->remove_error(this);
+  this_thread::poll()->close(this);
+
+  get_fd().close();
+  get_fd().clear();
+
+  m_writes.clear();
+  m_read_buffer = std::vector<char>();
+}
+
+void
+TrackerUdpRouter::prune_connection_ids() {
+  auto now = this_thread::cached_time();
+
+  if (now - m_time_last_pruned < connection_id_timeout)
+    return;
+
+  m_time_last_pruned = now;
+
+  for (auto itr = m_connection_ids.begin(); itr != m_connection_ids.end();) {
+    if (now - itr->second.time >= connection_id_timeout)
+      itr = m_connection_ids.erase(itr);
+    else
+      itr++;
+  }
+}
+
+std::string
+TrackerUdpRouter::address_key(const sockaddr* sa) {
+  if (sa_is_v4mapped(sa))
+    return sa_pretty_str(sa_from_v4mapped(sa).get());
+
+  return sa_pretty_str(sa);
+}
+
+}
@@ -0,0 +1,103 @@
+#ifndef LIBTORRENT_TRACKER_TRACKER_UDP_ROUTER_H
+#define LIBTORRENT_TRACKER_TRACKER_UDP_ROUTER_H
+
+#include <chrono>
+#include <deque>
+#include <functional>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "net/socket_datagram.h"
+#include "torrent/net/types.h"
+
+namespace torrent {
+
+// Shares a single UDP socket between all UDP tracker requests on a
+// thread. Replies are routed to the requester by the transaction id,
+// and connection ids are cached per tracker address for the lifetime
+// allowed by BEP 15 so repeated announces skip the connect request.
+//
+// The socket is opened and bound when the first user is added, and
+// closed when the last one is removed.
+
+class TrackerUdpRouter : public SocketDatagram {
+public:
+  using slot_receive = std::function<void(const char* data, unsigned int length)>;
+
+  static constexpr std::chrono::seconds connection_id_timeout{60};
+
+  static constexpr unsigned int batch_size        = 32;
+  static constexpr unsigned int max_datagram_size = 2048;
+
+  TrackerUdpRouter() = default;
+  ~TrackerUdpRouter() override;
+
+  const char*         type_name() const override { return "tracker_udp_router"; }
+
+  size_t              size_users() const        { return m_users.size(); }
+  size_t              size_transactions() const { return m_transactions.size(); }
+  size_t              size_writes() const       { return m_writes.size(); }
+  size_t              size_connection_ids() const { return m_connection_ids.size(); }
+
+  bool                add_user(void* user, const sockaddr* bind_address);
+  void                remove_user(void* user);
+
+  // Replaces the user's previous transaction, if any. The slot is
+  // called at most once, when a reply from 'sa' with the returned
+  // transaction id arrives.
+  uint32_t            insert_transaction(void* user, const sockaddr* sa, slot_receive slot);
+  void                erase_transaction(void* user);
+
+  bool                find_connection_id(const sockaddr* sa, uint64_t* connection_id);
+  void                set_connection_id(const sockaddr* sa, uint64_t connection_id);
+  void                erase_connection_id(const sockaddr* sa);
+
+  void                send(void* user, const char* data, unsigned int length, const sockaddr* sa);
+
+  // Returns true if the datagram matched a transaction.
+  bool                receive_datagram(const char* data, unsigned int length, const sockaddr* sa);
+
+  void                event_read() override;
+  void                event_write() override;
+  void                event_error() override;
+
+private:
+  struct transaction_type {
+    void*             user;
+    sa_unique_ptr     address;
+    slot_receive      slot;
+  };
+
+  struct write_type {
+    void*             user;
+    std::vector<char> data;
+    sockaddr_storage  address;
+    socklen_t         address_length;
+  };
+
+  struct connection_id_type {
+    uint64_t                  id;
+    std::chrono::microseconds time;
+  };
+
+  bool                open(const sockaddr* bind_sa);
+  void                close();
+
+  void                prune_connection_ids();
+
+  static std::string  address_key(const sockaddr* sa);
+
+  std::vector<void*>                          m_users;
+  std::map<uint32_t, transaction_type>        m_transactions;
+  std::map<void*, uint32_t>                   m_user_transactions;
+  std::deque<write_type>                      m_writes;
+  std::vector<char>                           m_read_buffer;
+
+  std::map<std::string, connection_id_type>   m_connection_ids;
+  std::chrono::microseconds                   m_time_last_pruned{};
+};
+
+}
+
+#endif
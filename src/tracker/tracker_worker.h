@@ -130,6 +130,11 @@ inline void
 TrackerWorker::lock_and_set_latest_event(tracker::TrackerState::event_enum new_state) {
   auto guard = lock_guard();
   m_state.m_latest_event = new_state;
+
+  if (new_state != tracker::TrackerState::EVENT_SCRAPE) {
+    m_state.m_request_time = this_thread::cached_time();
+    m_state.m_request_pending = true;
+  }
 }
 
 inline bool
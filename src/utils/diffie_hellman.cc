@@ -78,4 +78,73 @@ DiffieHellman::store_pub_key(unsigned char* dest, unsigned int length) {
     BN_bn2bin(pub_key, dest + length - BN_num_bytes(pub_key));
 }
 
+DiffieHellmanPool::DiffieHellmanPool(const unsigned char *prime, int primeLength,
+                                     const unsigned char *generator, int generatorLength,
+                                     unsigned int max_size) :
+  m_prime(prime),
+  m_prime_length(primeLength),
+  m_generator(generator),
+  m_generator_length(generatorLength),
+  m_max_size(max_size) {
+}
+
+unsigned int
+DiffieHellmanPool::size() {
+  auto lock = std::scoped_lock(m_lock);
+
+  return m_keys.size();
+}
+
+DiffieHellmanPool::key_ptr
+DiffieHellmanPool::pop() {
+  {
+    auto lock = std::scoped_lock(m_lock);
+
+    if (!m_keys.empty()) {
+      auto key = std::move(m_keys.back());
+      m_keys.pop_back();
+      return key;
+    }
+  }
+
+  return generate();
+}
+
+bool
+DiffieHellmanPool::try_start_fill() {
+  auto lock = std::scoped_lock(m_lock);
+
+  if (m_filling || m_keys.size() >= m_max_size / 2)
+    return false;
+
+  m_filling = true;
+  return true;
+}
+
+// Keys are generated without holding the lock, so 'pop()' is never
+// blocked on a modexp.
+void
+DiffieHellmanPool::fill() {
+  while (true) {
+    {
+      auto lock = std::scoped_lock(m_lock);
+
+      if (m_keys.size() >= m_max_size) {
+        m_filling = false;
+        return;
+      }
+    }
+
+    auto key = generate();
+
+    auto lock = std::scoped_lock(m_lock);
+    m_keys.push_back(std::move(key));
+  }
+}
+
+DiffieHellmanPool::key_ptr
+DiffieHellmanPool::generate() const {
+  return std::make_unique<DiffieHellman>(m_prime, m_prime_length, m_generator, m_generator_length);
+}
+
 };
@@ -4,7 +4,9 @@
 #include "config.h"
 
 #include <memory>
+#include <mutex>
 #include <string>
+#include <vector>
 
 namespace torrent {
 
@@ -35,6 +37,44 @@ private:
   int          m_size{0};
 };
 
+// Keys generated ahead of time, so a handshake can send its public
+// key without waiting for the modexp. 'fill()' does the generation and
+// is meant to be called from a worker thread, while 'pop()' may be
+// called from any thread.
+
+class DiffieHellmanPool {
+public:
+  using key_ptr = std::unique_ptr<DiffieHellman>;
+
+  DiffieHellmanPool(const unsigned char prime[], int primeLength,
+                    const unsigned char generator[], int generatorLength,
+                    unsigned int max_size);
+
+  unsigned int size();
+  unsigned int max_size() const     { return m_max_size; }
+
+  // Returns a new key, generated on the spot if the pool is empty.
+  key_ptr      pop();
+
+  // Returns true if the pool is below half its size and no other
+  // caller is already filling it, the caller must then call 'fill()'.
+  bool         try_start_fill();
+  void         fill();
+
+private:
+  key_ptr      generate() const;
+
+  const unsigned char* m_prime;
+  int                  m_prime_length;
+  const unsigned char* m_generator;
+  int                  m_generator_length;
+  unsigned int         m_max_size;
+
+  std::mutex           m_lock;
+  std::vector<key_ptr> m_keys;
+  bool                 m_filling{false};
+};
+
 };
 
 #endif
@@ -2,64 +2,332 @@
 
 #include "instrumentation.h"
 
+#include <mutex>
+#include <vector>
+
 namespace torrent {
 
-std::array<std::atomic_int64_t, INSTRUMENTATION_MAX_SIZE> instrumentation_values;
+thread_local instrumentation_shard* instrumentation_local_shard{};
+
+static thread_local bool instrumentation_local_retired{false};
+
+namespace {
+
+// Names are the enum names, lowercase and without the prefix.
+const char* instrumentation_names[INSTRUMENTATION_MAX_SIZE] = {
+  "memory_bitfields",
+  "memory_chunk_usage",
+  "memory_chunk_count",
+  "memory_hashing_chunk_usage",
+  "memory_hashing_chunk_count",
+  "mincore_incore_touched",
+  "mincore_incore_new",
+  "mincore_not_incore_touched",
+  "mincore_not_incore_new",
+  "mincore_incore_break",
+  "mincore_sync_success",
+  "mincore_sync_failed",
+  "mincore_sync_not_synced",
+  "mincore_sync_not_deallocated",
+  "mincore_alloc_failed",
+  "mincore_allocations",
+  "mincore_deallocations",
+  "chunk_cache_hits",
+  "chunk_cache_misses",
+  "chunk_cache_evictions",
+  "chunk_cache_usage",
+  "tracker_announce_sent",
+  "tracker_announce_queue",
+  "tracker_event_queue",
+  "tracker_event_overflow",
+  "polling_interrupt_poke",
+  "polling_interrupt_read_event",
+  "polling_modify_changes",
+  "polling_modify_syscalls",
+  "polling_do_poll",
+  "polling_do_poll_main",
+  "polling_do_poll_disk",
+  "polling_do_poll_net",
+  "polling_do_poll_others",
+  "polling_do_poll_tracker",
+  "polling_events",
+  "polling_events_main",
+  "polling_events_disk",
+  "polling_events_net",
+  "polling_events_others",
+  "polling_events_tracker",
+  "thread_migrations",
+  "thread_migrations_main",
+  "thread_migrations_disk",
+  "thread_migrations_net",
+  "thread_migrations_others",
+  "thread_migrations_tracker",
+  "thread_off_node",
+  "thread_off_node_main",
+  "thread_off_node_disk",
+  "thread_off_node_net",
+  "thread_off_node_others",
+  "thread_off_node_tracker",
+  "transfer_requests_delegated",
+  "transfer_requests_downloading",
+  "transfer_requests_finished",
+  "transfer_requests_skipped",
+  "transfer_requests_unknown",
+  "transfer_requests_unordered",
+  "transfer_requests_queued_added",
+  "transfer_requests_queued_moved",
+  "transfer_requests_queued_removed",
+  "transfer_requests_queued_total",
+  "transfer_requests_unordered_added",
+  "transfer_requests_unordered_moved",
+  "transfer_requests_unordered_removed",
+  "transfer_requests_unordered_total",
+  "transfer_requests_stalled_added",
+  "transfer_requests_stalled_moved",
+  "transfer_requests_stalled_removed",
+  "transfer_requests_stalled_total",
+  "transfer_requests_choked_added",
+  "transfer_requests_choked_moved",
+  "transfer_requests_choked_removed",
+  "transfer_requests_choked_total",
+  "transfer_peer_info_unaccounted",
+};
+
+std::mutex                          instrumentation_lock;
+std::vector<instrumentation_shard*> instrumentation_shards;
+instrumentation_shard               instrumentation_retired;
+instrumentation_snapshot_type       instrumentation_counter_totals{};
+
+// Retires the thread's shard on thread exit.
+struct instrumentation_shard_owner {
+  ~instrumentation_shard_owner();
+
+  instrumentation_shard* shard{};
+};
+
+instrumentation_shard_owner::~instrumentation_shard_owner() {
+  if (shard == nullptr)
+    return;
+
+  std::lock_guard<std::mutex> guard(instrumentation_lock);
+
+  for (int i = 0; i != INSTRUMENTATION_MAX_SIZE; i++)
+    instrumentation_retired.values[i].fetch_add(shard->values[i].load(std::memory_order_relaxed), std::memory_order_relaxed);
+
+  instrumentation_shards.erase(std::find(instrumentation_shards.begin(), instrumentation_shards.end(), shard));
+
+  instrumentation_local_shard   = nullptr;
+  instrumentation_local_retired = true;
+
+  delete shard;
+  shard = nullptr;
+}
+
+// Merges the shards, clearing counters if requested. The cleared
+// values are added to the running totals.
+instrumentation_snapshot_type
+instrumentation_fetch(bool clear_counters) {
+  instrumentation_snapshot_type values{};
+
+  std::lock_guard<std::mutex> guard(instrumentation_lock);
+
+  for (int i = 0; i != INSTRUMENTATION_MAX_SIZE; i++) {
+    bool clear = clear_counters && !instrumentation_is_gauge(static_cast<instrumentation_enum>(i));
+
+    auto fetch = [clear, i](instrumentation_shard* shard) {
+      return clear ? shard->values[i].exchange(0, std::memory_order_relaxed) : shard->values[i].load(std::memory_order_relaxed);
+    };
+
+    values[i] = fetch(&instrumentation_retired);
+
+    for (auto shard : instrumentation_shards)
+      values[i] += fetch(shard);
+
+    if (clear)
+      instrumentation_counter_totals[i] += values[i];
+  }
+
+  return values;
+}
+
+}
+
+instrumentation_shard*
+instrumentation_register_shard() {
+  // Updates made while the thread's destructors run go to the retired
+  // shard.
+  if (instrumentation_local_retired)
+    return &instrumentation_retired;
+
+  thread_local instrumentation_shard_owner owner;
+
+  if (owner.shard != nullptr)
+    return owner.shard;
+
+  owner.shard = new instrumentation_shard;
+
+  std::lock_guard<std::mutex> guard(instrumentation_lock);
+
+  instrumentation_shards.push_back(owner.shard);
+  instrumentation_local_shard = owner.shard;
+
+  return owner.shard;
+}
+
+void
+instrumentation_initialize() {
+  std::lock_guard<std::mutex> guard(instrumentation_lock);
+
+  for (auto shard : instrumentation_shards)
+    for (auto& value : shard->values)
+      value.store(0, std::memory_order_relaxed);
+
+  for (auto& value : instrumentation_retired.values)
+    value.store(0, std::memory_order_relaxed);
+
+  instrumentation_counter_totals.fill(0);
+}
+
+bool
+instrumentation_is_gauge(instrumentation_enum type) {
+  switch (type) {
+  case INSTRUMENTATION_MEMORY_BITFIELDS:
+  case INSTRUMENTATION_MEMORY_CHUNK_USAGE:
+  case INSTRUMENTATION_MEMORY_CHUNK_COUNT:
+  case INSTRUMENTATION_MEMORY_HASHING_CHUNK_USAGE:
+  case INSTRUMENTATION_MEMORY_HASHING_CHUNK_COUNT:
+  case INSTRUMENTATION_CHUNK_CACHE_USAGE:
+  case INSTRUMENTATION_TRACKER_ANNOUNCE_QUEUE:
+  case INSTRUMENTATION_TRACKER_EVENT_QUEUE:
+  case INSTRUMENTATION_TRANSFER_REQUESTS_QUEUED_TOTAL:
+  case INSTRUMENTATION_TRANSFER_REQUESTS_UNORDERED_TOTAL:
+  case INSTRUMENTATION_TRANSFER_REQUESTS_STALLED_TOTAL:
+  case INSTRUMENTATION_TRANSFER_REQUESTS_CHOKED_TOTAL:
+  case INSTRUMENTATION_TRANSFER_PEER_INFO_UNACCOUNTED:
+    return true;
+  default:
+    return false;
+  }
+}
+
+const char*
+instrumentation_name(instrumentation_enum type) {
+  if (type >= INSTRUMENTATION_MAX_SIZE)
+    return "unknown";
 
-inline int64_t
-instrumentation_fetch_and_clear(instrumentation_enum type) {
-#ifdef LT_INSTRUMENTATION
-  return instrumentation_values[type].exchange(0);
-#else
-  return 0;
-#endif
+  return instrumentation_names[type];
+}
+
+int64_t
+instrumentation_value(instrumentation_enum type) {
+  std::lock_guard<std::mutex> guard(instrumentation_lock);
+
+  int64_t value = instrumentation_retired.values[type].load(std::memory_order_relaxed);
+
+  for (auto shard : instrumentation_shards)
+    value += shard->values[type].load(std::memory_order_relaxed);
+
+  return value;
+}
+
+instrumentation_snapshot_type
+instrumentation_snapshot() {
+  auto values = instrumentation_fetch(false);
+
+  std::lock_guard<std::mutex> guard(instrumentation_lock);
+
+  for (int i = 0; i != INSTRUMENTATION_MAX_SIZE; i++)
+    values[i] += instrumentation_counter_totals[i];
+
+  return values;
 }
 
 void
 instrumentation_tick() {
+  auto values = instrumentation_fetch(true);
+
   lt_log_print(LOG_INSTRUMENTATION_MEMORY,
                "%" PRIi64 " %" PRIi64 " %" PRIi64  " %" PRIi64 " %" PRIi64,
-               instrumentation_values[INSTRUMENTATION_MEMORY_CHUNK_USAGE].load(),
-               instrumentation_values[INSTRUMENTATION_MEMORY_CHUNK_COUNT].load(),
-               instrumentation_values[INSTRUMENTATION_MEMORY_HASHING_CHUNK_USAGE].load(),
-               instrumentation_values[INSTRUMENTATION_MEMORY_HASHING_CHUNK_COUNT].load(),
-               instrumentation_values[INSTRUMENTATION_MEMORY_BITFIELDS].load());
+               values[INSTRUMENTATION_MEMORY_CHUNK_USAGE],
+               values[INSTRUMENTATION_MEMORY_CHUNK_COUNT],
+               values[INSTRUMENTATION_MEMORY_HASHING_CHUNK_USAGE],
+               values[INSTRUMENTATION_MEMORY_HASHING_CHUNK_COUNT],
+               values[INSTRUMENTATION_MEMORY_BITFIELDS]);
 
   lt_log_print(LOG_INSTRUMENTATION_MINCORE,
                "%"  PRIi64 " %" PRIi64 " %" PRIi64 " %" PRIi64 " %" PRIi64
                " %" PRIi64 " %" PRIi64 " %" PRIi64 " %" PRIi64 " %" PRIi64
                " %" PRIi64 " %" PRIi64,
-               instrumentation_fetch_and_clear(INSTRUMENTATION_MINCORE_INCORE_TOUCHED),
-               instrumentation_fetch_and_clear(INSTRUMENTATION_MINCORE_INCORE_NEW),
-               instrumentation_fetch_and_clear(INSTRUMENTATION_MINCORE_NOT_INCORE_TOUCHED),
-               instrumentation_fetch_and_clear(INSTRUMENTATION_MINCORE_NOT_INCORE_NEW),
-               instrumentation_fetch_and_clear(INSTRUMENTATION_MINCORE_INCORE_BREAK),
+               values[INSTRUMENTATION_MINCORE_INCORE_TOUCHED],
+               values[INSTRUMENTATION_MINCORE_INCORE_NEW],
+               values[INSTRUMENTATION_MINCORE_NOT_INCORE_TOUCHED],
+               values[INSTRUMENTATION_MINCORE_NOT_INCORE_NEW],
+               values[INSTRUMENTATION_MINCORE_INCORE_BREAK],
+
+               values[INSTRUMENTATION_MINCORE_SYNC_SUCCESS],
+               values[INSTRUMENTATION_MINCORE_SYNC_FAILED],
+               values[INSTRUMENTATION_MINCORE_SYNC_NOT_SYNCED],
+               values[INSTRUMENTATION_MINCORE_SYNC_NOT_DEALLOCATED],
+               values[INSTRUMENTATION_MINCORE_ALLOC_FAILED],
 
-               instrumentation_fetch_and_clear(INSTRUMENTATION_MINCORE_SYNC_SUCCESS),
-               instrumentation_fetch_and_clear(INSTRUMENTATION_MINCORE_SYNC_FAILED),
-               instrumentation_fetch_and_clear(INSTRUMENTATION_MINCORE_SYNC_NOT_SYNCED),
-               instrumentation_fetch_and_clear(INSTRUMENTATION_MINCORE_SYNC_NOT_DEALLOCATED),
-               instrumentation_fetch_and_clear(INSTRUMENTATION_MINCORE_ALLOC_FAILED),
+               values[INSTRUMENTATION_MINCORE_ALLOCATIONS],
+               values[INSTRUMENTATION_MINCORE_DEALLOCATIONS]);
 
-               instrumentation_fetch_and_clear(INSTRUMENTATION_MINCORE_ALLOCATIONS),
-               instrumentation_fetch_and_clear(INSTRUMENTATION_MINCORE_DEALLOCATIONS));
+  lt_log_print(LOG_INSTRUMENTATION_CHUNK_CACHE,
+               "%" PRIi64 " %" PRIi64 " %" PRIi64 " %" PRIi64,
+               values[INSTRUMENTATION_CHUNK_CACHE_HITS],
+               values[INSTRUMENTATION_CHUNK_CACHE_MISSES],
+               values[INSTRUMENTATION_CHUNK_CACHE_EVICTIONS],
+               values[INSTRUMENTATION_CHUNK_CACHE_USAGE]);
+
+  lt_log_print(LOG_INSTRUMENTATION_TRACKER,
+               "%" PRIi64 " %" PRIi64 " %" PRIi64 " %" PRIi64,
+               values[INSTRUMENTATION_TRACKER_ANNOUNCE_SENT],
+               values[INSTRUMENTATION_TRACKER_ANNOUNCE_QUEUE],
+               values[INSTRUMENTATION_TRACKER_EVENT_QUEUE],
+               values[INSTRUMENTATION_TRACKER_EVENT_OVERFLOW]);
 
   lt_log_print(LOG_INSTRUMENTATION_POLLING,
                "%"  PRIi64 " %" PRIi64
                " %"  PRIi64 " %" PRIi64 " %" PRIi64 " %" PRIi64
-               " %"  PRIi64 " %" PRIi64 " %" PRIi64 " %" PRIi64,
-               instrumentation_fetch_and_clear(INSTRUMENTATION_POLLING_INTERRUPT_POKE),
-               instrumentation_fetch_and_clear(INSTRUMENTATION_POLLING_INTERRUPT_READ_EVENT),
+               " %"  PRIi64 " %" PRIi64 " %" PRIi64 " %" PRIi64
+               " %"  PRIi64 " %" PRIi64,
+               values[INSTRUMENTATION_POLLING_INTERRUPT_POKE],
+               values[INSTRUMENTATION_POLLING_INTERRUPT_READ_EVENT],
+
+               values[INSTRUMENTATION_POLLING_DO_POLL],
+               values[INSTRUMENTATION_POLLING_DO_POLL_MAIN],
+               values[INSTRUMENTATION_POLLING_DO_POLL_DISK],
+               values[INSTRUMENTATION_POLLING_DO_POLL_OTHERS],
+
+               values[INSTRUMENTATION_POLLING_EVENTS],
+               values[INSTRUMENTATION_POLLING_EVENTS_MAIN],
+               values[INSTRUMENTATION_POLLING_EVENTS_DISK],
+               values[INSTRUMENTATION_POLLING_EVENTS_OTHERS],
 
-               instrumentation_fetch_and_clear(INSTRUMENTATION_POLLING_DO_POLL),
-               instrumentation_fetch_and_clear(INSTRUMENTATION_POLLING_DO_POLL_MAIN),
-               instrumentation_fetch_and_clear(INSTRUMENTATION_POLLING_DO_POLL_DISK),
-               instrumentation_fetch_and_clear(INSTRUMENTATION_POLLING_DO_POLL_OTHERS),
+               // Interest changes requested versus epoll_ctl calls made,
+               // the difference is what deferring the changes saved.
+               values[INSTRUMENTATION_POLLING_MODIFY_CHANGES],
+               values[INSTRUMENTATION_POLLING_MODIFY_SYSCALLS]);
 
-               instrumentation_fetch_and_clear(INSTRUMENTATION_POLLING_EVENTS),
-               instrumentation_fetch_and_clear(INSTRUMENTATION_POLLING_EVENTS_MAIN),
-               instrumentation_fetch_and_clear(INSTRUMENTATION_POLLING_EVENTS_DISK),
-               instrumentation_fetch_and_clear(INSTRUMENTATION_POLLING_EVENTS_OTHERS));
+  lt_log_print(LOG_INSTRUMENTATION_THREADS,
+               "%"  PRIi64 " %" PRIi64 " %" PRIi64 " %" PRIi64 " %" PRIi64 " %" PRIi64
+               " %"  PRIi64 " %" PRIi64 " %" PRIi64 " %" PRIi64 " %" PRIi64 " %" PRIi64,
+
+               values[INSTRUMENTATION_THREAD_MIGRATIONS],
+               values[INSTRUMENTATION_THREAD_MIGRATIONS_MAIN],
+               values[INSTRUMENTATION_THREAD_MIGRATIONS_DISK],
+               values[INSTRUMENTATION_THREAD_MIGRATIONS_NET],
+               values[INSTRUMENTATION_THREAD_MIGRATIONS_OTHERS],
+               values[INSTRUMENTATION_THREAD_MIGRATIONS_TRACKER],
+
+               // Poll loops run on a node other than the one requested.
+               values[INSTRUMENTATION_THREAD_OFF_NODE],
+               values[INSTRUMENTATION_THREAD_OFF_NODE_MAIN],
+               values[INSTRUMENTATION_THREAD_OFF_NODE_DISK],
+               values[INSTRUMENTATION_THREAD_OFF_NODE_NET],
+               values[INSTRUMENTATION_THREAD_OFF_NODE_OTHERS],
+               values[INSTRUMENTATION_THREAD_OFF_NODE_TRACKER]);
 
   lt_log_print(LOG_INSTRUMENTATION_TRANSFERS,
                "%"  PRIi64 " %" PRIi64 " %" PRIi64 " %" PRIi64 " %" PRIi64 " %" PRIi64
@@ -69,85 +337,39 @@ instrumentation_tick() {
                " %"  PRIi64 " %" PRIi64 " %" PRIi64 " %" PRIi64
                " %" PRIi64,
 
-               instrumentation_fetch_and_clear(INSTRUMENTATION_TRANSFER_REQUESTS_DELEGATED),
-               instrumentation_fetch_and_clear(INSTRUMENTATION_TRANSFER_REQUESTS_DOWNLOADING),
-               instrumentation_fetch_and_clear(INSTRUMENTATION_TRANSFER_REQUESTS_FINISHED),
-               instrumentation_fetch_and_clear(INSTRUMENTATION_TRANSFER_REQUESTS_SKIPPED),
-               instrumentation_fetch_and_clear(INSTRUMENTATION_TRANSFER_REQUESTS_UNKNOWN),
-               instrumentation_fetch_and_clear(INSTRUMENTATION_TRANSFER_REQUESTS_UNORDERED),
-
-               instrumentation_fetch_and_clear(INSTRUMENTATION_TRANSFER_REQUESTS_QUEUED_ADDED),
-               instrumentation_fetch_and_clear(INSTRUMENTATION_TRANSFER_REQUESTS_QUEUED_MOVED),
-               instrumentation_fetch_and_clear(INSTRUMENTATION_TRANSFER_REQUESTS_QUEUED_REMOVED),
-               instrumentation_values[INSTRUMENTATION_TRANSFER_REQUESTS_QUEUED_TOTAL].load(),
-
-               instrumentation_fetch_and_clear(INSTRUMENTATION_TRANSFER_REQUESTS_UNORDERED_ADDED),
-               instrumentation_fetch_and_clear(INSTRUMENTATION_TRANSFER_REQUESTS_UNORDERED_MOVED),
-               instrumentation_fetch_and_clear(INSTRUMENTATION_TRANSFER_REQUESTS_UNORDERED_REMOVED),
-               instrumentation_values[INSTRUMENTATION_TRANSFER_REQUESTS_UNORDERED_TOTAL].load(),
-
-               instrumentation_fetch_and_clear(INSTRUMENTATION_TRANSFER_REQUESTS_STALLED_ADDED),
-               instrumentation_fetch_and_clear(INSTRUMENTATION_TRANSFER_REQUESTS_STALLED_MOVED),
-               instrumentation_fetch_and_clear(INSTRUMENTATION_TRANSFER_REQUESTS_STALLED_REMOVED),
-               instrumentation_values[INSTRUMENTATION_TRANSFER_REQUESTS_STALLED_TOTAL].load(),
-
-               instrumentation_fetch_and_clear(INSTRUMENTATION_TRANSFER_REQUESTS_CHOKED_ADDED),
-               instrumentation_fetch_and_clear(INSTRUMENTATION_TRANSFER_REQUESTS_CHOKED_MOVED),
-               instrumentation_fetch_and_clear(INSTRUMENTATION_TRANSFER_REQUESTS_CHOKED_REMOVED),
-               instrumentation_values[INSTRUMENTATION_TRANSFER_REQUESTS_CHOKED_TOTAL].load(),
-
-               instrumentation_values[INSTRUMENTATION_TRANSFER_PEER_INFO_UNACCOUNTED].load());
+               values[INSTRUMENTATION_TRANSFER_REQUESTS_DELEGATED],
+               values[INSTRUMENTATION_TRANSFER_REQUESTS_DOWNLOADING],
+               values[INSTRUMENTATION_TRANSFER_REQUESTS_FINISHED],
+               values[INSTRUMENTATION_TRANSFER_REQUESTS_SKIPPED],
+               values[INSTRUMENTATION_TRANSFER_REQUESTS_UNKNOWN],
+               values[INSTRUMENTATION_TRANSFER_REQUESTS_UNORDERED],
+
+               values[INSTRUMENTATION_TRANSFER_REQUESTS_QUEUED_ADDED],
+               values[INSTRUMENTATION_TRANSFER_REQUESTS_QUEUED_MOVED],
+               values[INSTRUMENTATION_TRANSFER_REQUESTS_QUEUED_REMOVED],
+               values[INSTRUMENTATION_TRANSFER_REQUESTS_QUEUED_TOTAL],
+
+               values[INSTRUMENTATION_TRANSFER_REQUESTS_UNORDERED_ADDED],
+               values[INSTRUMENTATION_TRANSFER_REQUESTS_UNORDERED_MOVED],
+               values[INSTRUMENTATION_TRANSFER_REQUESTS_UNORDERED_REMOVED],
+               values[INSTRUMENTATION_TRANSFER_REQUESTS_UNORDERED_TOTAL],
+
+               values[INSTRUMENTATION_TRANSFER_REQUESTS_STALLED_ADDED],
+               values[INSTRUMENTATION_TRANSFER_REQUESTS_STALLED_MOVED],
+               values[INSTRUMENTATION_TRANSFER_REQUESTS_STALLED_REMOVED],
+               values[INSTRUMENTATION_TRANSFER_REQUESTS_STALLED_TOTAL],
+
+               values[INSTRUMENTATION_TRANSFER_REQUESTS_CHOKED_ADDED],
+               values[INSTRUMENTATION_TRANSFER_REQUESTS_CHOKED_MOVED],
+               values[INSTRUMENTATION_TRANSFER_REQUESTS_CHOKED_REMOVED],
+               values[INSTRUMENTATION_TRANSFER_REQUESTS_CHOKED_TOTAL],
+
+               values[INSTRUMENTATION_TRANSFER_PEER_INFO_UNACCOUNTED]);
 }
 
 void
 instrumentation_reset() {
-  instrumentation_fetch_and_clear(INSTRUMENTATION_MINCORE_INCORE_TOUCHED);
-  instrumentation_fetch_and_clear(INSTRUMENTATION_MINCORE_INCORE_NEW);
-  instrumentation_fetch_and_clear(INSTRUMENTATION_MINCORE_NOT_INCORE_TOUCHED);
-  instrumentation_fetch_and_clear(INSTRUMENTATION_MINCORE_NOT_INCORE_NEW);
-  instrumentation_fetch_and_clear(INSTRUMENTATION_MINCORE_INCORE_BREAK);
-
-  instrumentation_fetch_and_clear(INSTRUMENTATION_MINCORE_SYNC_SUCCESS);
-  instrumentation_fetch_and_clear(INSTRUMENTATION_MINCORE_SYNC_FAILED);
-  instrumentation_fetch_and_clear(INSTRUMENTATION_MINCORE_SYNC_NOT_SYNCED);
-  instrumentation_fetch_and_clear(INSTRUMENTATION_MINCORE_SYNC_NOT_DEALLOCATED);
-  instrumentation_fetch_and_clear(INSTRUMENTATION_MINCORE_ALLOC_FAILED);
-
-  instrumentation_fetch_and_clear(INSTRUMENTATION_MINCORE_ALLOCATIONS);
-  instrumentation_fetch_and_clear(INSTRUMENTATION_MINCORE_DEALLOCATIONS);
-
-  instrumentation_fetch_and_clear(INSTRUMENTATION_POLLING_INTERRUPT_POKE);
-  instrumentation_fetch_and_clear(INSTRUMENTATION_POLLING_INTERRUPT_READ_EVENT);
-
-  instrumentation_fetch_and_clear(INSTRUMENTATION_POLLING_DO_POLL);
-  instrumentation_fetch_and_clear(INSTRUMENTATION_POLLING_DO_POLL_MAIN);
-  instrumentation_fetch_and_clear(INSTRUMENTATION_POLLING_DO_POLL_DISK);
-  instrumentation_fetch_and_clear(INSTRUMENTATION_POLLING_DO_POLL_OTHERS);
-
-  instrumentation_fetch_and_clear(INSTRUMENTATION_POLLING_EVENTS);
-  instrumentation_fetch_and_clear(INSTRUMENTATION_POLLING_EVENTS_MAIN);
-  instrumentation_fetch_and_clear(INSTRUMENTATION_POLLING_EVENTS_DISK);
-  instrumentation_fetch_and_clear(INSTRUMENTATION_POLLING_EVENTS_OTHERS);
-
-  instrumentation_fetch_and_clear(INSTRUMENTATION_TRANSFER_REQUESTS_DELEGATED);
-  instrumentation_fetch_and_clear(INSTRUMENTATION_TRANSFER_REQUESTS_DOWNLOADING);
-  instrumentation_fetch_and_clear(INSTRUMENTATION_TRANSFER_REQUESTS_FINISHED);
-  instrumentation_fetch_and_clear(INSTRUMENTATION_TRANSFER_REQUESTS_SKIPPED);
-  instrumentation_fetch_and_clear(INSTRUMENTATION_TRANSFER_REQUESTS_UNKNOWN);
-  instrumentation_fetch_and_clear(INSTRUMENTATION_TRANSFER_REQUESTS_UNORDERED);
-
-  instrumentation_fetch_and_clear(INSTRUMENTATION_TRANSFER_REQUESTS_QUEUED_ADDED);
-  instrumentation_fetch_and_clear(INSTRUMENTATION_TRANSFER_REQUESTS_QUEUED_MOVED);
-  instrumentation_fetch_and_clear(INSTRUMENTATION_TRANSFER_REQUESTS_QUEUED_REMOVED);
-  instrumentation_fetch_and_clear(INSTRUMENTATION_TRANSFER_REQUESTS_UNORDERED_ADDED);
-  instrumentation_fetch_and_clear(INSTRUMENTATION_TRANSFER_REQUESTS_UNORDERED_MOVED);
-  instrumentation_fetch_and_clear(INSTRUMENTATION_TRANSFER_REQUESTS_UNORDERED_REMOVED);
-  instrumentation_fetch_and_clear(INSTRUMENTATION_TRANSFER_REQUESTS_STALLED_ADDED);
-  instrumentation_fetch_and_clear(INSTRUMENTATION_TRANSFER_REQUESTS_STALLED_MOVED);
-  instrumentation_fetch_and_clear(INSTRUMENTATION_TRANSFER_REQUESTS_STALLED_REMOVED);
-  instrumentation_fetch_and_clear(INSTRUMENTATION_TRANSFER_REQUESTS_CHOKED_ADDED);
-  instrumentation_fetch_and_clear(INSTRUMENTATION_TRANSFER_REQUESTS_CHOKED_MOVED);
-  instrumentation_fetch_and_clear(INSTRUMENTATION_TRANSFER_REQUESTS_CHOKED_REMOVED);
+  instrumentation_fetch(true);
 }
 
 }
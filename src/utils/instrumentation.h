@@ -30,9 +30,22 @@ enum instrumentation_enum {
   INSTRUMENTATION_MINCORE_ALLOCATIONS,
   INSTRUMENTATION_MINCORE_DEALLOCATIONS,
 
+  INSTRUMENTATION_CHUNK_CACHE_HITS,
+  INSTRUMENTATION_CHUNK_CACHE_MISSES,
+  INSTRUMENTATION_CHUNK_CACHE_EVICTIONS,
+  INSTRUMENTATION_CHUNK_CACHE_USAGE,
+
+  INSTRUMENTATION_TRACKER_ANNOUNCE_SENT,
+  INSTRUMENTATION_TRACKER_ANNOUNCE_QUEUE,
+  INSTRUMENTATION_TRACKER_EVENT_QUEUE,
+  INSTRUMENTATION_TRACKER_EVENT_OVERFLOW,
+
   INSTRUMENTATION_POLLING_INTERRUPT_POKE,
   INSTRUMENTATION_POLLING_INTERRUPT_READ_EVENT,
 
+  INSTRUMENTATION_POLLING_MODIFY_CHANGES,
+  INSTRUMENTATION_POLLING_MODIFY_SYSCALLS,
+
   INSTRUMENTATION_POLLING_DO_POLL,
   INSTRUMENTATION_POLLING_DO_POLL_MAIN,
   INSTRUMENTATION_POLLING_DO_POLL_DISK,
@@ -47,6 +60,20 @@ enum instrumentation_enum {
   INSTRUMENTATION_POLLING_EVENTS_OTHERS,
   INSTRUMENTATION_POLLING_EVENTS_TRACKER,
 
+  INSTRUMENTATION_THREAD_MIGRATIONS,
+  INSTRUMENTATION_THREAD_MIGRATIONS_MAIN,
+  INSTRUMENTATION_THREAD_MIGRATIONS_DISK,
+  INSTRUMENTATION_THREAD_MIGRATIONS_NET,
+  INSTRUMENTATION_THREAD_MIGRATIONS_OTHERS,
+  INSTRUMENTATION_THREAD_MIGRATIONS_TRACKER,
+
+  INSTRUMENTATION_THREAD_OFF_NODE,
+  INSTRUMENTATION_THREAD_OFF_NODE_MAIN,
+  INSTRUMENTATION_THREAD_OFF_NODE_DISK,
+  INSTRUMENTATION_THREAD_OFF_NODE_NET,
+  INSTRUMENTATION_THREAD_OFF_NODE_OTHERS,
+  INSTRUMENTATION_THREAD_OFF_NODE_TRACKER,
+
   INSTRUMENTATION_TRANSFER_REQUESTS_DELEGATED,
   INSTRUMENTATION_TRANSFER_REQUESTS_DOWNLOADING,
   INSTRUMENTATION_TRANSFER_REQUESTS_FINISHED,
@@ -75,26 +102,52 @@ enum instrumentation_enum {
   INSTRUMENTATION_MAX_SIZE
 };
 
-extern std::array<std::atomic_int64_t, INSTRUMENTATION_MAX_SIZE> instrumentation_values;
+// Values are kept in per-thread shards, each on its own cache lines,
+// so updates from different threads never contend. Reads lock the
+// shard list and merge the shards, and shards of exited threads are
+// folded into a retired shard.
+//
+// Gauges hold a current value, e.g. memory usage, while counters are
+// cleared by instrumentation_tick() after being logged.
+
+struct alignas(64) instrumentation_shard {
+  std::array<std::atomic_int64_t, INSTRUMENTATION_MAX_SIZE> values{};
+};
+
+extern thread_local instrumentation_shard* instrumentation_local_shard;
+
+using instrumentation_snapshot_type = std::array<int64_t, INSTRUMENTATION_MAX_SIZE>;
 
 void instrumentation_initialize();
 void instrumentation_update(instrumentation_enum type, int64_t change);
 void instrumentation_tick();
 void instrumentation_reset();
 
+instrumentation_shard* instrumentation_register_shard();
+
+bool        instrumentation_is_gauge(instrumentation_enum type);
+const char* instrumentation_name(instrumentation_enum type);
+
+// Merged value of all threads.
+int64_t     instrumentation_value(instrumentation_enum type);
+
+// Merged values of all threads, counters are totals since
+// initialization rather than since the last tick.
+instrumentation_snapshot_type instrumentation_snapshot();
+
 //
 // Implementation:
 //
 
-inline void
-instrumentation_initialize() {
-  std::fill(instrumentation_values.begin(), instrumentation_values.end(), int64_t());
-}
-
 inline void
 instrumentation_update([[maybe_unused]] instrumentation_enum type, [[maybe_unused]] int64_t change) {
 #ifdef LT_INSTRUMENTATION
-  instrumentation_values[type] += change;
+  auto shard = instrumentation_local_shard;
+
+  if (shard == nullptr)
+    shard = instrumentation_register_shard();
+
+  shard->values[type].fetch_add(change, std::memory_order_relaxed);
 #endif
 }
 
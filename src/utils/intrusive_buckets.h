@@ -0,0 +1,254 @@
+#ifndef LIBTORRENT_UTILS_INTRUSIVE_BUCKETS_H
+#define LIBTORRENT_UTILS_INTRUSIVE_BUCKETS_H
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <unordered_map>
+
+#include "torrent/exceptions.h"
+#include "utils/instrumentation.h"
+
+namespace torrent {
+
+// Doubly linked queues of pointers to elements holding their own
+// links, with the same instrumentation as queue_buckets. Elements can
+// be found, moved and erased without searching, and are indexed by
+// key so the one a peer refers to is found directly.
+//
+// 'Constants' provides, in addition to those used by queue_buckets:
+//
+//   using hook_type = ...;  // Members 'prev', 'next' and 'bucket', the
+//                           // latter -1 when not in a bucket.
+//   static hook_type& hook(Type* obj);
+//   static uint64_t   key(const Type* obj);
+//
+// Elements must be in at most one bucket of one container at a time,
+// and their links are reset when removed or moved.
+
+template <typename Type, typename Constants>
+class intrusive_buckets {
+public:
+  using value_type = Type*;
+  using size_type  = size_t;
+  using hook_type  = typename Constants::hook_type;
+  using constants  = Constants;
+
+  intrusive_buckets() = default;
+  ~intrusive_buckets() = default;
+  intrusive_buckets(const intrusive_buckets&) = delete;
+  intrusive_buckets& operator=(const intrusive_buckets&) = delete;
+
+  size_type  queue_size(int idx) const   { return m_queues[idx].size; }
+  bool       queue_empty(int idx) const  { return m_queues[idx].size == 0; }
+  bool       empty() const               { return m_index.empty(); }
+
+  value_type front(int idx) const        { return m_queues[idx].first; }
+  value_type back(int idx) const         { return m_queues[idx].last; }
+
+  static value_type next(value_type obj) { return constants::hook(obj).next; }
+  static int        bucket(value_type obj) { return constants::hook(obj).bucket; }
+
+  // Returns the element with the key in the lowest bucket, or null.
+  value_type find(uint64_t key) const;
+
+  void       push_back(int idx, value_type obj);
+
+  // Removes the element from its bucket without destroying it.
+  value_type take(value_type obj);
+
+  void       move_to(value_type obj, int dst_idx);
+  void       move_all_to(int src_idx, int dst_idx);
+
+  void       destroy(value_type obj);
+  void       clear(int idx);
+
+  template <typename Ftor>
+  void       for_each(int idx, Ftor ftor) const;
+
+private:
+  struct queue_type {
+    value_type first{};
+    value_type last{};
+    size_type  size{};
+  };
+
+  void       link_back(int idx, value_type obj);
+  void       unlink(value_type obj);
+
+  void       index_erase(value_type obj);
+
+  std::array<queue_type, Constants::bucket_count> m_queues;
+  std::unordered_multimap<uint64_t, value_type>   m_index;
+};
+
+template <typename Type, typename Constants>
+inline typename intrusive_buckets<Type, Constants>::value_type
+intrusive_buckets<Type, Constants>::find(uint64_t key) const {
+  auto       range  = m_index.equal_range(key);
+  value_type result = nullptr;
+
+  for (auto itr = range.first; itr != range.second; ++itr)
+    if (result == nullptr || bucket(itr->second) < bucket(result))
+      result = itr->second;
+
+  return result;
+}
+
+template <typename Type, typename Constants>
+inline void
+intrusive_buckets<Type, Constants>::push_back(int idx, value_type obj) {
+  if (constants::hook(obj).bucket != -1)
+    throw internal_error("intrusive_buckets::push_back(...) element already in a bucket.");
+
+  link_back(idx, obj);
+  m_index.emplace(constants::key(obj), obj);
+
+  instrumentation_update(constants::instrumentation_added[idx], 1);
+  instrumentation_update(constants::instrumentation_total[idx], 1);
+}
+
+template <typename Type, typename Constants>
+inline typename intrusive_buckets<Type, Constants>::value_type
+intrusive_buckets<Type, Constants>::take(value_type obj) {
+  int idx = bucket(obj);
+
+  unlink(obj);
+  index_erase(obj);
+
+  instrumentation_update(constants::instrumentation_removed[idx], 1);
+  instrumentation_update(constants::instrumentation_total[idx], -1);
+
+  return obj;
+}
+
+template <typename Type, typename Constants>
+inline void
+intrusive_buckets<Type, Constants>::move_to(value_type obj, int dst_idx) {
+  int src_idx = bucket(obj);
+
+  unlink(obj);
+  link_back(dst_idx, obj);
+
+  instrumentation_update(constants::instrumentation_moved[src_idx], 1);
+  instrumentation_update(constants::instrumentation_total[src_idx], -1);
+  instrumentation_update(constants::instrumentation_added[dst_idx], 1);
+  instrumentation_update(constants::instrumentation_total[dst_idx], 1);
+}
+
+// The lists are spliced, only the bucket of each element is updated.
+template <typename Type, typename Constants>
+inline void
+intrusive_buckets<Type, Constants>::move_all_to(int src_idx, int dst_idx) {
+  queue_type& src = m_queues[src_idx];
+  queue_type& dst = m_queues[dst_idx];
+
+  if (src.size == 0 || src_idx == dst_idx)
+    return;
+
+  for (value_type obj = src.first; obj != nullptr; obj = next(obj))
+    constants::hook(obj).bucket = dst_idx;
+
+  if (dst.last != nullptr) {
+    constants::hook(dst.last).next = src.first;
+    constants::hook(src.first).prev = dst.last;
+  } else {
+    dst.first = src.first;
+  }
+
+  dst.last = src.last;
+
+  auto difference = static_cast<int64_t>(src.size);
+  instrumentation_update(constants::instrumentation_moved[src_idx], difference);
+  instrumentation_update(constants::instrumentation_total[src_idx], -difference);
+  instrumentation_update(constants::instrumentation_added[dst_idx], difference);
+  instrumentation_update(constants::instrumentation_total[dst_idx], difference);
+
+  dst.size += src.size;
+  src = queue_type();
+}
+
+template <typename Type, typename Constants>
+inline void
+intrusive_buckets<Type, Constants>::destroy(value_type obj) {
+  take(obj);
+  constants::template destroy<value_type>(obj);
+}
+
+template <typename Type, typename Constants>
+inline void
+intrusive_buckets<Type, Constants>::clear(int idx) {
+  while (!queue_empty(idx))
+    destroy(front(idx));
+}
+
+template <typename Type, typename Constants>
+template <typename Ftor>
+inline void
+intrusive_buckets<Type, Constants>::for_each(int idx, Ftor ftor) const {
+  for (value_type obj = front(idx); obj != nullptr; obj = next(obj))
+    ftor(obj);
+}
+
+template <typename Type, typename Constants>
+inline void
+intrusive_buckets<Type, Constants>::link_back(int idx, value_type obj) {
+  queue_type& queue = m_queues[idx];
+  hook_type&  hook  = constants::hook(obj);
+
+  hook.prev   = queue.last;
+  hook.next   = nullptr;
+  hook.bucket = idx;
+
+  if (queue.last != nullptr)
+    constants::hook(queue.last).next = obj;
+  else
+    queue.first = obj;
+
+  queue.last = obj;
+  queue.size++;
+}
+
+template <typename Type, typename Constants>
+inline void
+intrusive_buckets<Type, Constants>::unlink(value_type obj) {
+  hook_type& hook = constants::hook(obj);
+
+  if (hook.bucket < 0 || hook.bucket >= Constants::bucket_count)
+    throw internal_error("intrusive_buckets::unlink(...) element not in a bucket.");
+
+  queue_type& queue = m_queues[hook.bucket];
+
+  if (hook.prev != nullptr)
+    constants::hook(hook.prev).next = hook.next;
+  else
+    queue.first = hook.next;
+
+  if (hook.next != nullptr)
+    constants::hook(hook.next).prev = hook.prev;
+  else
+    queue.last = hook.prev;
+
+  queue.size--;
+
+  hook = hook_type();
+}
+
+template <typename Type, typename Constants>
+inline void
+intrusive_buckets<Type, Constants>::index_erase(value_type obj) {
+  auto range = m_index.equal_range(constants::key(obj));
+
+  for (auto itr = range.first; itr != range.second; ++itr) {
+    if (itr->second == obj) {
+      m_index.erase(itr);
+      return;
+    }
+  }
+
+  throw internal_error("intrusive_buckets::index_erase(...) element not indexed.");
+}
+
+}
+
+#endif // LIBTORRENT_UTILS_INTRUSIVE_BUCKETS_H
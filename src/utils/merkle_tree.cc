@@ -0,0 +1,131 @@
+#include "config.h"
+
+#include "utils/merkle_tree.h"
+
+#include <algorithm>
+
+#include "torrent/exceptions.h"
+#include "utils/sha256.h"
+
+namespace torrent {
+
+namespace {
+
+// Replaces the nodes of 'layer', 'height' layers above the leaves,
+// with their parents.
+void
+merkle_layer_up(std::vector<merkle_hash>& layer, unsigned int height) {
+  merkle_hash pad = merkle_pad_hash(height);
+
+  for (size_t i = 0; i < layer.size(); i += 2)
+    layer[i / 2] = merkle_hash_pair(layer[i], i + 1 < layer.size() ? layer[i + 1] : pad);
+
+  layer.resize((layer.size() + 1) / 2);
+}
+
+}
+
+merkle_hash
+merkle_hash_block(const char* data, uint32_t length) {
+  merkle_hash hash;
+  Sha256 sha256;
+
+  sha256.init();
+  sha256.update(data, length);
+  sha256.final_c(hash.data());
+
+  return hash;
+}
+
+merkle_hash
+merkle_hash_pair(const merkle_hash& left, const merkle_hash& right) {
+  merkle_hash hash;
+  Sha256 sha256;
+
+  sha256.init();
+  sha256.update(left.data(), left.size());
+  sha256.update(right.data(), right.size());
+  sha256.final_c(hash.data());
+
+  return hash;
+}
+
+std::vector<merkle_hash>
+merkle_hash_blocks(const char* data, uint32_t length) {
+  std::vector<merkle_hash> leaves;
+  leaves.reserve((length + merkle_block_size - 1) / merkle_block_size);
+
+  for (uint32_t offset = 0; offset < length; offset += merkle_block_size)
+    leaves.push_back(merkle_hash_block(data + offset, std::min(length - offset, merkle_block_size)));
+
+  return leaves;
+}
+
+merkle_hash
+merkle_pad_hash(unsigned int height) {
+  merkle_hash hash{};
+
+  while (height-- != 0)
+    hash = merkle_hash_pair(hash, hash);
+
+  return hash;
+}
+
+std::vector<merkle_hash>
+merkle_layer(const std::vector<merkle_hash>& leaves, unsigned int height) {
+  std::vector<merkle_hash> layer = leaves;
+
+  for (unsigned int h = 0; h < height && !layer.empty(); h++)
+    merkle_layer_up(layer, h);
+
+  return layer;
+}
+
+merkle_hash
+merkle_root(std::vector<merkle_hash> layer, unsigned int height) {
+  if (layer.empty())
+    throw internal_error("merkle_root(...) received an empty layer.");
+
+  while (layer.size() > 1)
+    merkle_layer_up(layer, height++);
+
+  return layer.front();
+}
+
+unsigned int
+merkle_piece_height(uint32_t piece_length) {
+  if (piece_length < merkle_block_size || (piece_length & (piece_length - 1)) != 0)
+    throw input_error("Piece length of a v2 torrent must be a power of two of at least 16 KiB.");
+
+  unsigned int height = 0;
+
+  while ((merkle_block_size << height) != piece_length)
+    height++;
+
+  return height;
+}
+
+// The last piece of a file is padded to a whole piece, as it is in the
+// piece layer.
+bool
+merkle_verify_piece(const char* data, uint32_t length, uint32_t piece_length, const merkle_hash& expected) {
+  if (length == 0 || length > piece_length)
+    throw internal_error("merkle_verify_piece(...) length out of range.");
+
+  std::vector<merkle_hash> layer = merkle_layer(merkle_hash_blocks(data, length), merkle_piece_height(piece_length));
+
+  return layer.size() == 1 && layer.front() == expected;
+}
+
+std::vector<uint32_t>
+merkle_failed_blocks(const char* data, uint32_t length, const std::vector<merkle_hash>& leaves) {
+  std::vector<uint32_t> failed;
+
+  for (uint32_t offset = 0, index = 0; offset < length; offset += merkle_block_size, index++)
+    if (index >= leaves.size() || merkle_hash_block(data + offset, std::min(length - offset, merkle_block_size)) != leaves[index])
+      failed.push_back(index);
+
+  return failed;
+}
+
+}
@@ -0,0 +1,50 @@
+#ifndef LIBTORRENT_UTILS_MERKLE_TREE_H
+#define LIBTORRENT_UTILS_MERKLE_TREE_H
+
+#include <array>
+#include <cinttypes>
+#include <vector>
+
+namespace torrent {
+
+// SHA-256 merkle trees of BitTorrent v2, BEP 52. Each file has its own
+// tree whose leaves are the hashes of 16 KiB blocks, the last block of
+// a file may be shorter. The leaves are padded with zero hashes to a
+// power of two, and the layer whose nodes each cover one piece is the
+// piece layer stored in the metadata.
+//
+// A piece is verified against its node in the piece layer. When the
+// leaf hashes of a failed piece are known, e.g. from a peer's hashes
+// message, the bad blocks are found without redownloading the others.
+
+using merkle_hash = std::array<char, 32>;
+
+constexpr uint32_t merkle_block_size = 16 << 10;
+
+merkle_hash              merkle_hash_block(const char* data, uint32_t length);
+merkle_hash              merkle_hash_pair(const merkle_hash& left, const merkle_hash& right);
+
+// Leaf hashes of the blocks of 'data'.
+std::vector<merkle_hash> merkle_hash_blocks(const char* data, uint32_t length);
+
+// Root of a subtree of 2^height padding leaves.
+merkle_hash              merkle_pad_hash(unsigned int height);
+
+// Nodes 'height' layers above 'leaves', padded as in the full tree.
+std::vector<merkle_hash> merkle_layer(const std::vector<merkle_hash>& leaves, unsigned int height);
+
+// Root of the tree, 'layer' being 'height' layers above the leaves.
+merkle_hash              merkle_root(std::vector<merkle_hash> layer, unsigned int height = 0);
+
+// The number of layers between the leaves and the piece layer, the
+// piece length must be a power of two of at least 16 KiB.
+unsigned int             merkle_piece_height(uint32_t piece_length);
+
+bool                     merkle_verify_piece(const char* data, uint32_t length, uint32_t piece_length, const merkle_hash& expected);
+
+// Returns the indices of blocks in 'data' that do not match 'leaves'.
+std::vector<uint32_t>    merkle_failed_blocks(const char* data, uint32_t length, const std::vector<merkle_hash>& leaves);
+
+}
+
+#endif
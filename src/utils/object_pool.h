@@ -0,0 +1,165 @@
+#ifndef LIBTORRENT_UTILS_OBJECT_POOL_H
+#define LIBTORRENT_UTILS_OBJECT_POOL_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <new>
+
+namespace torrent {
+
+struct object_pool_stats {
+  int64_t live;
+  int64_t cached;
+  int64_t allocations;
+  int64_t reused;
+};
+
+// Fixed size block allocator for objects with high churn, meant to be
+// used from class specific operator new and delete. Freed blocks are
+// kept in a cache of the thread that freed them and handed out again
+// by allocate(), so a thread never locks to reuse a block. Blocks
+// beyond 'max_cached' are returned to the system allocator.
+//
+// Allocations larger than 'BlockSize', e.g. from a derived class, are
+// passed through to the system allocator and not counted.
+
+template <typename Tag, size_t BlockSize = sizeof(Tag)>
+class object_pool {
+public:
+  static constexpr size_t       block_size = BlockSize < sizeof(void*) ? sizeof(void*) : BlockSize;
+  static constexpr unsigned int max_cached = 1024;
+
+  static void*             allocate(size_t size);
+  static void              deallocate(void* ptr, size_t size) noexcept;
+
+  static object_pool_stats stats();
+
+  // Returns the blocks cached by the calling thread to the system.
+  static void              release_local() noexcept;
+
+private:
+  struct free_block {
+    free_block* next;
+  };
+
+  struct local_cache {
+    free_block*  first{};
+    unsigned int size{};
+  };
+
+  static local_cache*      local() noexcept;
+  static void              release(local_cache* cache) noexcept;
+
+  static inline std::atomic<int64_t> m_live{0};
+  static inline std::atomic<int64_t> m_cached{0};
+  static inline std::atomic<int64_t> m_allocations{0};
+  static inline std::atomic<int64_t> m_reused{0};
+};
+
+template <typename Tag, size_t BlockSize>
+inline void*
+object_pool<Tag, BlockSize>::allocate(size_t size) {
+  if (size > block_size)
+    return ::operator new(size);
+
+  m_live.fetch_add(1, std::memory_order_relaxed);
+  m_allocations.fetch_add(1, std::memory_order_relaxed);
+
+  auto cache = local();
+
+  if (cache == nullptr || cache->first == nullptr)
+    return ::operator new(block_size);
+
+  free_block* block = cache->first;
+  cache->first = block->next;
+  cache->size--;
+
+  m_cached.fetch_sub(1, std::memory_order_relaxed);
+  m_reused.fetch_add(1, std::memory_order_relaxed);
+  return block;
+}
+
+template <typename Tag, size_t BlockSize>
+inline void
+object_pool<Tag, BlockSize>::deallocate(void* ptr, size_t size) noexcept {
+  if (ptr == nullptr)
+    return;
+
+  if (size > block_size)
+    return ::operator delete(ptr);
+
+  m_live.fetch_sub(1, std::memory_order_relaxed);
+
+  auto cache = local();
+
+  if (cache == nullptr || cache->size >= max_cached)
+    return ::operator delete(ptr);
+
+  auto block = static_cast<free_block*>(ptr);
+  block->next = cache->first;
+  cache->first = block;
+  cache->size++;
+
+  m_cached.fetch_add(1, std::memory_order_relaxed);
+}
+
+template <typename Tag, size_t BlockSize>
+inline object_pool_stats
+object_pool<Tag, BlockSize>::stats() {
+  return object_pool_stats{m_live.load(std::memory_order_relaxed),
+                           m_cached.load(std::memory_order_relaxed),
+                           m_allocations.load(std::memory_order_relaxed),
+                           m_reused.load(std::memory_order_relaxed)};
+}
+
+template <typename Tag, size_t BlockSize>
+inline void
+object_pool<Tag, BlockSize>::release_local() noexcept {
+  auto cache = local();
+
+  if (cache != nullptr)
+    release(cache);
+}
+
+// Objects may be freed after the thread's cache was destroyed, e.g. by
+// static destructors, so those go straight to the system allocator.
+template <typename Tag, size_t BlockSize>
+inline typename object_pool<Tag, BlockSize>::local_cache*
+object_pool<Tag, BlockSize>::local() noexcept {
+  static thread_local bool retired = false;
+
+  struct owner_type {
+    local_cache cache;
+
+    ~owner_type() {
+      release(&cache);
+      retired = true;
+    }
+  };
+
+  if (retired)
+    return nullptr;
+
+  static thread_local owner_type owner;
+  return &owner.cache;
+}
+
+template <typename Tag, size_t BlockSize>
+inline void
+object_pool<Tag, BlockSize>::release(local_cache* cache) noexcept {
+  m_cached.fetch_sub(cache->size, std::memory_order_relaxed);
+
+  while (cache->first != nullptr) {
+    free_block* block = cache->first;
+    cache->first = block->next;
+
+    ::operator delete(block);
+  }
+
+  cache->size = 0;
+}
+
+}
+
+#endif
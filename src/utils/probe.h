@@ -0,0 +1,30 @@
+#ifndef LIBTORRENT_UTILS_PROBE_H
+#define LIBTORRENT_UTILS_PROBE_H
+
+// Static tracepoints for SystemTap, bpftrace and DTrace under the
+// 'libtorrent' provider. Each is a nop instruction with a note in the
+// ELF file until a tracer attaches, so they are left in release
+// builds. The arguments are still evaluated, so keep them to plain
+// values already at hand.
+//
+//   bpftrace -e 'usdt:libtorrent.so:libtorrent:poll_exit { @[arg0] = count(); }'
+
+#ifdef USE_USDT
+
+#include <sys/sdt.h>
+
+#define LT_PROBE0(name)             DTRACE_PROBE(libtorrent, name)
+#define LT_PROBE1(name, a)          DTRACE_PROBE1(libtorrent, name, a)
+#define LT_PROBE2(name, a, b)       DTRACE_PROBE2(libtorrent, name, a, b)
+#define LT_PROBE3(name, a, b, c)    DTRACE_PROBE3(libtorrent, name, a, b, c)
+
+#else
+
+#define LT_PROBE0(name)
+#define LT_PROBE1(name, a)
+#define LT_PROBE2(name, a, b)
+#define LT_PROBE3(name, a, b, c)
+
+#endif
+
+#endif
@@ -0,0 +1,228 @@
+#include "config.h"
+
+#include "utils/sha1_multi.h"
+
+#include <cstring>
+
+#include "torrent/exceptions.h"
+#include "utils/sha1.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <cpuid.h>
+#include <immintrin.h>
+#define LT_SHA1_MULTI_AVX2 1
+#endif
+
+namespace torrent {
+
+#ifdef LT_SHA1_MULTI_AVX2
+
+namespace {
+
+struct sha1_lanes {
+  __m256i a, b, c, d, e;
+};
+
+__attribute__((target("avx2"))) inline __m256i
+sha1_rotl(__m256i x, int n) {
+  return _mm256_or_si256(_mm256_slli_epi32(x, n), _mm256_srli_epi32(x, 32 - n));
+}
+
+__attribute__((target("avx2"))) inline uint32_t
+sha1_load_be32(const char* p) {
+  uint32_t v;
+  std::memcpy(&v, p, sizeof(v));
+  return __builtin_bswap32(v);
+}
+
+// Process one 64 byte block from each of the eight lanes.
+__attribute__((target("avx2"))) void
+sha1_avx2_block(sha1_lanes& state, const char* const* blocks) {
+  __m256i w[16];
+
+  for (int i = 0; i < 16; i++)
+    w[i] = _mm256_set_epi32(sha1_load_be32(blocks[7] + 4 * i), sha1_load_be32(blocks[6] + 4 * i),
+                            sha1_load_be32(blocks[5] + 4 * i), sha1_load_be32(blocks[4] + 4 * i),
+                            sha1_load_be32(blocks[3] + 4 * i), sha1_load_be32(blocks[2] + 4 * i),
+                            sha1_load_be32(blocks[1] + 4 * i), sha1_load_be32(blocks[0] + 4 * i));
+
+  __m256i a = state.a;
+  __m256i b = state.b;
+  __m256i c = state.c;
+  __m256i d = state.d;
+  __m256i e = state.e;
+
+  const __m256i k0 = _mm256_set1_epi32(0x5a827999);
+  const __m256i k1 = _mm256_set1_epi32(0x6ed9eba1);
+  const __m256i k2 = _mm256_set1_epi32(int(0x8f1bbcdc));
+  const __m256i k3 = _mm256_set1_epi32(int(0xca62c1d6));
+
+  for (int t = 0; t < 80; t++) {
+    if (t >= 16)
+      w[t & 15] = sha1_rotl(_mm256_xor_si256(_mm256_xor_si256(w[(t - 3) & 15], w[(t - 8) & 15]),
+                                             _mm256_xor_si256(w[(t - 14) & 15], w[t & 15])), 1);
+
+    __m256i f;
+    __m256i k;
+
+    if (t < 20) {
+      f = _mm256_xor_si256(d, _mm256_and_si256(b, _mm256_xor_si256(c, d)));
+      k = k0;
+    } else if (t < 40) {
+      f = _mm256_xor_si256(_mm256_xor_si256(b, c), d);
+      k = k1;
+    } else if (t < 60) {
+      f = _mm256_or_si256(_mm256_and_si256(b, c), _mm256_and_si256(d, _mm256_or_si256(b, c)));
+      k = k2;
+    } else {
+      f = _mm256_xor_si256(_mm256_xor_si256(b, c), d);
+      k = k3;
+    }
+
+    __m256i temp = _mm256_add_epi32(_mm256_add_epi32(sha1_rotl(a, 5), f),
+                                    _mm256_add_epi32(_mm256_add_epi32(e, k), w[t & 15]));
+    e = d;
+    d = c;
+    c = sha1_rotl(b, 30);
+    b = a;
+    a = temp;
+  }
+
+  state.a = _mm256_add_epi32(state.a, a);
+  state.b = _mm256_add_epi32(state.b, b);
+  state.c = _mm256_add_epi32(state.c, c);
+  state.d = _mm256_add_epi32(state.d, d);
+  state.e = _mm256_add_epi32(state.e, e);
+}
+
+__attribute__((target("avx2"))) void
+sha1_multi_avx2(const char* const* buffers, unsigned int count, uint32_t length, char* results) {
+  // Unused lanes hash the first buffer again and are discarded.
+  const char* lanes[sha1_multi_max_lanes];
+
+  for (unsigned int i = 0; i < sha1_multi_max_lanes; i++)
+    lanes[i] = buffers[i < count ? i : 0];
+
+  sha1_lanes state{_mm256_set1_epi32(0x67452301), _mm256_set1_epi32(int(0xefcdab89)),
+                   _mm256_set1_epi32(int(0x98badcfe)), _mm256_set1_epi32(0x10325476),
+                   _mm256_set1_epi32(int(0xc3d2e1f0))};
+
+  const char* blocks[sha1_multi_max_lanes];
+  uint32_t    full_blocks = length / 64;
+
+  for (uint32_t i = 0; i < full_blocks; i++) {
+    for (unsigned int l = 0; l < sha1_multi_max_lanes; l++)
+      blocks[l] = lanes[l] + uint64_t(i) * 64;
+
+    sha1_avx2_block(state, blocks);
+  }
+
+  // All lanes have the same length so the padding only differs in the
+  // trailing data bytes.
+  uint32_t remaining   = length % 64;
+  uint32_t tail_length = remaining < 56 ? 64 : 128;
+  uint64_t bit_length  = uint64_t(length) * 8;
+
+  char tail[sha1_multi_max_lanes][128];
+
+  for (unsigned int l = 0; l < sha1_multi_max_lanes; l++) {
+    std::memset(tail[l], 0, sizeof(tail[l]));
+    std::memcpy(tail[l], lanes[l] + uint64_t(full_blocks) * 64, remaining);
+
+    tail[l][remaining] = char(0x80);
+
+    for (int i = 0; i < 8; i++)
+      tail[l][tail_length - 1 - i] = char(bit_length >> (8 * i));
+  }
+
+  for (uint32_t offset = 0; offset < tail_length; offset += 64) {
+    for (unsigned int l = 0; l < sha1_multi_max_lanes; l++)
+      blocks[l] = tail[l] + offset;
+
+    sha1_avx2_block(state, blocks);
+  }
+
+  alignas(32) uint32_t words[5][sha1_multi_max_lanes];
+
+  _mm256_store_si256(reinterpret_cast<__m256i*>(words[0]), state.a);
+  _mm256_store_si256(reinterpret_cast<__m256i*>(words[1]), state.b);
+  _mm256_store_si256(reinterpret_cast<__m256i*>(words[2]), state.c);
+  _mm256_store_si256(reinterpret_cast<__m256i*>(words[3]), state.d);
+  _mm256_store_si256(reinterpret_cast<__m256i*>(words[4]), state.e);
+
+  for (unsigned int l = 0; l < count; l++) {
+    for (int i = 0; i < 5; i++) {
+      uint32_t v = __builtin_bswap32(words[i][l]);
+      std::memcpy(results + 20 * l + 4 * i, &v, sizeof(v));
+    }
+  }
+}
+
+bool
+cpu_has_sha_ni() {
+  unsigned int eax, ebx, ecx, edx;
+
+  if (!__get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx))
+    return false;
+
+  return ebx & (1 << 29);
+}
+
+}
+
+#endif
+
+sha1_multi_engine
+sha1_multi_detect_engine() {
+#ifdef LT_SHA1_MULTI_AVX2
+  if (!cpu_has_sha_ni() && __builtin_cpu_supports("avx2"))
+    return SHA1_MULTI_ENGINE_AVX2;
+#endif
+
+  return SHA1_MULTI_ENGINE_EVP;
+}
+
+sha1_multi_engine
+sha1_multi_default_engine() {
+  static const sha1_multi_engine engine = sha1_multi_detect_engine();
+  return engine;
+}
+
+const char*
+sha1_multi_engine_name(sha1_multi_engine engine) {
+  switch (engine) {
+  case SHA1_MULTI_ENGINE_AVX2: return "avx2";
+  case SHA1_MULTI_ENGINE_EVP:
+  default:                     return "evp";
+  }
+}
+
+unsigned int
+sha1_multi_lanes(sha1_multi_engine engine) {
+  return engine == SHA1_MULTI_ENGINE_AVX2 ? sha1_multi_max_lanes : 1;
+}
+
+void
+sha1_multi(const char* const* buffers, unsigned int count, uint32_t length, char* results, sha1_multi_engine engine) {
+  if (count == 0 || count > sha1_multi_max_lanes)
+    throw internal_error("sha1_multi(...) received an invalid buffer count.");
+
+#ifdef LT_SHA1_MULTI_AVX2
+  if (engine == SHA1_MULTI_ENGINE_AVX2) {
+    if (!__builtin_cpu_supports("avx2"))
+      throw internal_error("sha1_multi(...) AVX2 engine not supported by the CPU.");
+
+    return sha1_multi_avx2(buffers, count, length, results);
+  }
+#endif
+
+  Sha1 sha1;
+
+  for (unsigned int i = 0; i < count; i++) {
+    sha1.init();
+    sha1.update(buffers[i], length);
+    sha1.final_c(results + 20 * i);
+  }
+}
+
+}
@@ -0,0 +1,38 @@
+#ifndef LIBTORRENT_UTILS_SHA1_MULTI_H
+#define LIBTORRENT_UTILS_SHA1_MULTI_H
+
+#include <cinttypes>
+
+namespace torrent {
+
+// Hash several buffers of the same length in one pass. The AVX2
+// engine runs eight SHA1 lanes in parallel, while the EVP engine
+// hashes each buffer in turn through OpenSSL.
+//
+// OpenSSL already dispatches to SHA-NI and the ARMv8 crypto
+// extensions at runtime, and those beat eight software lanes, so the
+// AVX2 engine is only selected on x86 CPUs without SHA-NI.
+
+enum sha1_multi_engine {
+  SHA1_MULTI_ENGINE_EVP,
+  SHA1_MULTI_ENGINE_AVX2
+};
+
+constexpr unsigned int sha1_multi_max_lanes = 8;
+
+sha1_multi_engine sha1_multi_detect_engine();
+sha1_multi_engine sha1_multi_default_engine();
+const char*       sha1_multi_engine_name(sha1_multi_engine engine);
+
+// The number of buffers the engine hashes per pass, batching more
+// than one buffer is pointless for the EVP engine.
+unsigned int      sha1_multi_lanes(sha1_multi_engine engine);
+
+// Writes 20 bytes per buffer to 'results'. The count must be between 1
+// and 'sha1_multi_max_lanes'.
+void              sha1_multi(const char* const* buffers, unsigned int count, uint32_t length, char* results,
+                             sha1_multi_engine engine = sha1_multi_default_engine());
+
+}
+
+#endif
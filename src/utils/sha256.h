@@ -0,0 +1,52 @@
+#ifndef LIBTORRENT_UTILS_SHA256_H
+#define LIBTORRENT_UTILS_SHA256_H
+
+#include <memory>
+
+#include <openssl/evp.h>
+
+namespace torrent {
+
+// Same interface as Sha1, OpenSSL dispatches to SHA-NI and the ARMv8
+// crypto extensions at runtime.
+
+class Sha256 {
+public:
+  static constexpr unsigned int size = 32;
+
+  Sha256();
+  ~Sha256();
+
+  void init();
+  void update(const void* data, unsigned int length);
+
+  void final_c(void* buffer);
+
+private:
+  std::unique_ptr<EVP_MD_CTX, decltype(&EVP_MD_CTX_free)> m_ctx;
+};
+
+inline Sha256::Sha256() :
+    m_ctx(EVP_MD_CTX_new(), EVP_MD_CTX_free) {
+}
+
+inline Sha256::~Sha256() = default;
+
+inline void
+Sha256::init() {
+  EVP_DigestInit_ex(m_ctx.get(), EVP_sha256(), nullptr);
+}
+
+inline void
+Sha256::update(const void* data, unsigned int length) {
+  EVP_DigestUpdate(m_ctx.get(), data, length);
+}
+
+inline void
+Sha256::final_c(void* buffer) {
+  EVP_DigestFinal_ex(m_ctx.get(), static_cast<unsigned char*>(buffer), nullptr);
+}
+
+}
+
+#endif
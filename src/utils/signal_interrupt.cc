@@ -2,16 +2,26 @@
 
 #include "utils/signal_interrupt.h"
 
+#include <cstdint>
+#include <unistd.h>
+
+#ifdef USE_EVENTFD
+#include <sys/eventfd.h>
+#endif
+
 #include "torrent/exceptions.h"
 #include "torrent/net/fd.h"
 #include "utils/instrumentation.h"
 
 namespace torrent {
 
-SignalInterrupt::SignalInterrupt(int fd) {
+SignalInterrupt::SignalInterrupt(int fd, int write_fd) :
+  m_other(this),
+  m_write_fd(write_fd) {
+
   m_fileDesc = fd;
 
-  if (!fd_set_nonblock(fd))
+  if (!fd_set_nonblock(fd) || (write_fd != fd && !fd_set_nonblock(write_fd)))
     throw internal_error("Could not set non-blocking mode for SignalInterrupt socket: " + std::string(std::strerror(errno)));
 
   // Not supported on socketpair on MacOS. (TODO: Check if this is true on other platforms.)
@@ -20,6 +30,11 @@ SignalInterrupt::SignalInterrupt(int fd) {
 }
 
 SignalInterrupt::~SignalInterrupt() {
+  if (m_write_fd != -1 && m_write_fd != m_fileDesc)
+    fd_close(m_write_fd);
+
+  m_write_fd = -1;
+
   if (m_fileDesc == -1)
     return;
 
@@ -27,6 +42,23 @@ SignalInterrupt::~SignalInterrupt() {
   m_fileDesc = -1;
 }
 
+std::unique_ptr<SignalInterrupt>
+SignalInterrupt::create() {
+#ifdef USE_EVENTFD
+  int fd = ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+
+  if (fd == -1)
+    throw internal_error("Could not create SignalInterrupt eventfd: " + std::string(std::strerror(errno)));
+
+  return std::unique_ptr<SignalInterrupt>(new SignalInterrupt(fd, fd));
+#else
+  int fd1, fd2;
+  fd_open_socket_pair(fd1, fd2);
+
+  return std::unique_ptr<SignalInterrupt>(new SignalInterrupt(fd1, fd2));
+#endif
+}
+
 SignalInterrupt::pair_type
 SignalInterrupt::create_pair() {
   int fd1, fd2;
@@ -35,7 +67,7 @@ SignalInterrupt::create_pair() {
   fd_open_socket_pair(fd1, fd2);
   // fd_open_pipe(fd1, fd2);
 
-  pair_type result{new SignalInterrupt(fd1), new SignalInterrupt(fd2)};
+  pair_type result{new SignalInterrupt(fd1, fd1), new SignalInterrupt(fd2, fd2)};
 
   result.first->m_other = result.second.get();
   result.second->m_other = result.first.get();
@@ -50,7 +82,9 @@ SignalInterrupt::poke() {
   if (!m_other->m_poking.compare_exchange_strong(expected, true))
     return;
 
-  int result = ::send(m_fileDesc, "a", 1, 0);
+  // An eventfd takes an 8 byte counter, sockets take it as data.
+  uint64_t value  = 1;
+  int      result = ::write(m_write_fd, &value, sizeof(value));
 
   if (result == 0)
     throw internal_error("Could not send to SignalInterrupt socket, result is 0.");
@@ -65,7 +99,7 @@ void
 SignalInterrupt::event_read() {
   char buffer[256];
 
-  int result = ::recv(m_fileDesc, buffer, 256, 0);
+  int result = ::read(m_fileDesc, buffer, 256);
 
   if (result == 0)
     throw internal_error("SignalInterrupt socket closed.");
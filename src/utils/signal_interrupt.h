@@ -8,12 +8,21 @@
 
 namespace torrent {
 
+// Wakes a thread blocked in Poll::do_poll. Pokes are coalesced until
+// the receiving side has read the interrupt, so only the first poke
+// after a read costs a syscall.
+
 class LIBTORRENT_EXPORT SignalInterrupt : public Event {
 public:
   using pair_type = std::pair<std::unique_ptr<SignalInterrupt>, std::unique_ptr<SignalInterrupt>>;
 
   ~SignalInterrupt();
 
+  // An interrupt that is both poked and read, backed by an eventfd
+  // where supported and else by a socket pair.
+  static std::unique_ptr<SignalInterrupt> create();
+
+  // Poking either of the pair makes the other readable.
   static pair_type    create_pair();
 
   bool                is_poking() const { return m_poking.load(); }
@@ -26,9 +35,10 @@ public:
 
 private:
   SignalInterrupt() = delete;
-  SignalInterrupt(int fd);
+  SignalInterrupt(int fd, int write_fd);
 
   SignalInterrupt*    m_other;
+  int                 m_write_fd;
   std::atomic_bool    m_poking{false};
 };
 
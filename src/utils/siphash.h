@@ -0,0 +1,92 @@
+#ifndef LIBTORRENT_UTILS_SIPHASH_H
+#define LIBTORRENT_UTILS_SIPHASH_H
+
+#include <cstdint>
+#include <cstring>
+
+namespace torrent {
+
+// SipHash-2-4, a keyed hash for short messages. The key is set once
+// and hashing needs no setup, which makes it suitable for tokens that
+// are generated and checked for every query.
+
+class SipHash {
+public:
+  SipHash() = default;
+  SipHash(uint64_t k0, uint64_t k1) : m_k0(k0), m_k1(k1) {}
+
+  // Key is 16 bytes, read as two little-endian words.
+  explicit SipHash(const char* key) : m_k0(load_word(key)), m_k1(load_word(key + 8)) {}
+
+  uint64_t            hash(const void* data, size_t length) const;
+
+private:
+  static uint64_t     rotl(uint64_t x, int b)    { return (x << b) | (x >> (64 - b)); }
+  static uint64_t     load_word(const char* data);
+
+  static void         round(uint64_t& v0, uint64_t& v1, uint64_t& v2, uint64_t& v3);
+
+  uint64_t            m_k0{};
+  uint64_t            m_k1{};
+};
+
+inline uint64_t
+SipHash::load_word(const char* data) {
+  uint64_t w;
+  std::memcpy(&w, data, sizeof(w));
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+  return w;
+#else
+  return __builtin_bswap64(w);
+#endif
+}
+
+inline void
+SipHash::round(uint64_t& v0, uint64_t& v1, uint64_t& v2, uint64_t& v3) {
+  v0 += v1; v1 = rotl(v1, 13); v1 ^= v0; v0 = rotl(v0, 32);
+  v2 += v3; v3 = rotl(v3, 16); v3 ^= v2;
+  v0 += v3; v3 = rotl(v3, 21); v3 ^= v0;
+  v2 += v1; v1 = rotl(v1, 17); v1 ^= v2; v2 = rotl(v2, 32);
+}
+
+inline uint64_t
+SipHash::hash(const void* data, size_t length) const {
+  uint64_t v0 = m_k0 ^ 0x736f6d6570736575ull;
+  uint64_t v1 = m_k1 ^ 0x646f72616e646f6dull;
+  uint64_t v2 = m_k0 ^ 0x6c7967656e657261ull;
+  uint64_t v3 = m_k1 ^ 0x7465646279746573ull;
+
+  auto   itr  = static_cast<const char*>(data);
+  size_t left = length;
+
+  for (; left >= 8; itr += 8, left -= 8) {
+    uint64_t m = load_word(itr);
+
+    v3 ^= m;
+    round(v0, v1, v2, v3);
+    round(v0, v1, v2, v3);
+    v0 ^= m;
+  }
+
+  uint64_t b = static_cast<uint64_t>(length) << 56;
+
+  for (size_t i = 0; i != left; i++)
+    b |= static_cast<uint64_t>(static_cast<uint8_t>(itr[i])) << (8 * i);
+
+  v3 ^= b;
+  round(v0, v1, v2, v3);
+  round(v0, v1, v2, v3);
+  v0 ^= b;
+
+  v2 ^= 0xff;
+  round(v0, v1, v2, v3);
+  round(v0, v1, v2, v3);
+  round(v0, v1, v2, v3);
+  round(v0, v1, v2, v3);
+
+  return v0 ^ v1 ^ v2 ^ v3;
+}
+
+}
+
+#endif
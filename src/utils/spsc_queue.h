@@ -0,0 +1,122 @@
+#ifndef LIBTORRENT_UTILS_SPSC_QUEUE_H
+#define LIBTORRENT_UTILS_SPSC_QUEUE_H
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <optional>
+
+#include "torrent/exceptions.h"
+
+namespace torrent {
+
+// Bounded ring buffer for handing values from one thread to another
+// without locking. Only one thread may push and only one thread may
+// pop, which may be the same thread. try_push fails when full, leaving
+// backpressure to the producer.
+//
+// The head and tail are kept on separate cache lines so the two
+// threads don't contend on them.
+
+template <typename T>
+class spsc_queue {
+public:
+  // The capacity is rounded up to a power of two.
+  spsc_queue(size_t capacity);
+  ~spsc_queue() = default;
+
+  spsc_queue(const spsc_queue&) = delete;
+  spsc_queue& operator=(const spsc_queue&) = delete;
+
+  size_t              capacity() const { return m_mask + 1; }
+
+  // Exact only when called from the producer or the consumer while the
+  // other is idle.
+  size_t              size() const;
+  bool                empty() const    { return size() == 0; }
+
+  // The largest size seen by the producer.
+  size_t              max_size() const { return m_max_size.load(std::memory_order_relaxed); }
+
+  // Producer, leaves 'value' untouched when full:
+  bool                try_push(T&& value);
+
+  // Consumer:
+  std::optional<T>    try_pop();
+
+private:
+  static size_t       round_capacity(size_t capacity);
+
+  size_t                  m_mask;
+  std::unique_ptr<T[]>    m_values;
+
+  alignas(64) std::atomic<size_t> m_tail{0};
+  std::atomic<size_t>             m_max_size{0};
+
+  alignas(64) std::atomic<size_t> m_head{0};
+};
+
+template <typename T>
+size_t
+spsc_queue<T>::round_capacity(size_t capacity) {
+  if (capacity == 0)
+    throw internal_error("spsc_queue::spsc_queue(...) capacity is zero.");
+
+  size_t rounded = 1;
+
+  while (rounded < capacity)
+    rounded <<= 1;
+
+  return rounded;
+}
+
+template <typename T>
+spsc_queue<T>::spsc_queue(size_t capacity) :
+  m_mask(round_capacity(capacity) - 1),
+  m_values(new T[m_mask + 1]) {
+}
+
+template <typename T>
+inline size_t
+spsc_queue<T>::size() const {
+  return m_tail.load(std::memory_order_acquire) - m_head.load(std::memory_order_acquire);
+}
+
+template <typename T>
+inline bool
+spsc_queue<T>::try_push(T&& value) {
+  size_t tail = m_tail.load(std::memory_order_relaxed);
+  size_t size = tail - m_head.load(std::memory_order_acquire);
+
+  if (size > m_mask)
+    return false;
+
+  m_values[tail & m_mask] = std::move(value);
+  m_tail.store(tail + 1, std::memory_order_release);
+
+  if (size + 1 > m_max_size.load(std::memory_order_relaxed))
+    m_max_size.store(size + 1, std::memory_order_relaxed);
+
+  return true;
+}
+
+template <typename T>
+inline std::optional<T>
+spsc_queue<T>::try_pop() {
+  size_t head = m_head.load(std::memory_order_relaxed);
+
+  if (head == m_tail.load(std::memory_order_acquire))
+    return std::nullopt;
+
+  std::optional<T> value(std::move(m_values[head & m_mask]));
+
+  // Don't keep the moved-from value alive until overwritten.
+  m_values[head & m_mask] = T();
+  m_head.store(head + 1, std::memory_order_release);
+
+  return value;
+}
+
+}
+
+#endif
@@ -0,0 +1,126 @@
+#include "config.h"
+
+#include "utils/tick_wheel.h"
+
+#include <algorithm>
+
+#include "torrent/exceptions.h"
+#include "torrent/utils/thread.h"
+
+namespace torrent {
+
+TickWheel::TickWheel(std::chrono::microseconds period, uint32_t buckets) :
+  m_period(period),
+  m_buckets(buckets) {
+
+  if (buckets == 0 || period < std::chrono::microseconds(buckets))
+    throw internal_error("TickWheel::TickWheel(...) invalid period or bucket count.");
+
+  m_task_step.slot() = [this] { receive_step(); };
+}
+
+TickWheel::~TickWheel() {
+  stop();
+}
+
+uint32_t
+TickWheel::bucket_size(uint32_t b) const {
+  return std::count_if(m_buckets.at(b).begin(), m_buckets.at(b).end(), [](auto& m) { return m.key != nullptr; });
+}
+
+void
+TickWheel::start() {
+  if (!m_task_step.is_scheduled())
+    this_thread::scheduler()->wait_for_ceil_seconds(&m_task_step, interval());
+}
+
+void
+TickWheel::stop() {
+  if (m_task_step.is_scheduled())
+    this_thread::scheduler()->erase(&m_task_step);
+}
+
+void
+TickWheel::insert(const void* key, slot_type slot) {
+  if (key == nullptr || m_index.find(key) != m_index.end())
+    throw internal_error("TickWheel::insert(...) key is null or already inserted.");
+
+  auto itr = std::min_element(m_buckets.begin(), m_buckets.end(), [](auto& a, auto& b) { return a.size() < b.size(); });
+
+  itr->push_back(member_type{key, std::move(slot)});
+  m_index.emplace(key, std::distance(m_buckets.begin(), itr));
+}
+
+void
+TickWheel::erase(const void* key) {
+  auto index_itr = m_index.find(key);
+
+  if (index_itr == m_index.end())
+    return;
+
+  auto& bucket = m_buckets[index_itr->second];
+  auto  itr    = std::find_if(bucket.begin(), bucket.end(), [key](auto& m) { return m.key == key; });
+
+  m_index.erase(index_itr);
+
+  if (itr == bucket.end())
+    throw internal_error("TickWheel::erase(...) key not found in its bucket.");
+
+  if (&bucket == m_walking) {
+    itr->key = nullptr;
+    itr->slot = nullptr;
+    m_walk_erased = true;
+    return;
+  }
+
+  *itr = std::move(bucket.back());
+  bucket.pop_back();
+}
+
+void
+TickWheel::step() {
+  auto& bucket = m_buckets[m_position];
+  auto  round  = m_round;
+
+  if (!bucket.empty()) {
+    // Members inserted during the walk wait for the next round.
+    size_t size  = bucket.size();
+    size_t start = round % size;
+
+    m_walking = &bucket;
+
+    // The slot is copied as inserting may move the bucket's members.
+    for (size_t i = 0; i < size; i++) {
+      if (bucket[(start + i) % size].key == nullptr)
+        continue;
+
+      auto slot = bucket[(start + i) % size].slot;
+      slot(round);
+    }
+
+    m_walking = nullptr;
+
+    if (m_walk_erased)
+      compact(bucket);
+  }
+
+  if (++m_position == m_buckets.size()) {
+    m_position = 0;
+    m_round++;
+  }
+}
+
+void
+TickWheel::compact(bucket_type& bucket) {
+  bucket.erase(std::remove_if(bucket.begin(), bucket.end(), [](auto& m) { return m.key == nullptr; }), bucket.end());
+  m_walk_erased = false;
+}
+
+void
+TickWheel::receive_step() {
+  step();
+
+  this_thread::scheduler()->wait_for_ceil_seconds(&m_task_step, interval());
+}
+
+}
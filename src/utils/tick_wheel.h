@@ -0,0 +1,84 @@
+#ifndef LIBTORRENT_UTILS_TICK_WHEEL_H
+#define LIBTORRENT_UTILS_TICK_WHEEL_H
+
+#include <chrono>
+#include <cinttypes>
+#include <functional>
+#include <unordered_map>
+#include <vector>
+
+#include "torrent/utils/scheduler.h"
+
+namespace torrent {
+
+// Calls the periodic work of many members once per 'period' from a
+// single scheduler entry. Members are spread over 'buckets' buckets,
+// each added to the one with the fewest members, and one bucket is
+// walked every period / buckets. The work is then evenly spread over
+// the period instead of every member ticking at once.
+//
+// The slot is passed the number of the round, starting at one. The
+// walk order within a bucket is rotated every round so no member is
+// always first. Members may be erased while a bucket is being walked.
+
+class TickWheel {
+public:
+  using slot_type = std::function<void(uint32_t round)>;
+
+  TickWheel(std::chrono::microseconds period, uint32_t buckets);
+  ~TickWheel();
+
+  TickWheel(const TickWheel&) = delete;
+  TickWheel& operator=(const TickWheel&) = delete;
+
+  std::chrono::microseconds period() const   { return m_period; }
+  std::chrono::microseconds interval() const { return m_period / m_buckets.size(); }
+
+  uint32_t            size() const           { return m_index.size(); }
+  uint32_t            size_buckets() const   { return m_buckets.size(); }
+  uint32_t            bucket_size(uint32_t b) const;
+
+  uint32_t            round() const          { return m_round; }
+  uint32_t            position() const       { return m_position; }
+
+  // Schedules the steps on the calling thread.
+  bool                is_active() const      { return m_task_step.is_scheduled(); }
+  void                start();
+  void                stop();
+
+  // Throws internal_error if 'key' is already inserted.
+  void                insert(const void* key, slot_type slot);
+  void                erase(const void* key);
+
+  // Walks the next bucket.
+  void                step();
+
+private:
+  struct member_type {
+    const void*       key;
+    slot_type         slot;
+  };
+
+  using bucket_type = std::vector<member_type>;
+
+  void                receive_step();
+  void                compact(bucket_type& bucket);
+
+  std::chrono::microseconds   m_period;
+  std::vector<bucket_type>    m_buckets;
+  std::unordered_map<const void*, uint32_t> m_index;
+
+  uint32_t            m_position{0};
+  uint32_t            m_round{1};
+
+  // The bucket being walked, erased members are left empty until the
+  // walk is done.
+  bucket_type*        m_walking{nullptr};
+  bool                m_walk_erased{false};
+
+  utils::SchedulerEntry m_task_step;
+};
+
+}
+
+#endif
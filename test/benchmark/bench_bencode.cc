@@ -0,0 +1,371 @@
+#include "config.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <new>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <unistd.h>
+
+#include "torrent/exceptions.h"
+#include "torrent/object.h"
+#include "torrent/object_static_map.h"
+#include "torrent/object_stream.h"
+
+// Measures the bencode functions on a corpus of torrent files and
+// resume data: object_read_bencode_c, object_write_bencode,
+// object_sha1 and static_map_read_bencode with the keys a client
+// looks up. Reports throughput and allocations per MB of input, the
+// allocations are counted by replacing the global operator new.
+//
+// Without arguments the corpus is generated: a single file torrent
+// with a large piece list, a torrent of 100k files, a v2 torrent with
+// large piece layers and the resume data of 10k files. Real files,
+// e.g. .torrent and rtorrent session files, are used instead when
+// given as arguments.
+//
+// Build with 'make -C test bench' and run as:
+//
+//   LibTorrent_Bench_Bencode [-m MiB per step] [file...]
+
+namespace {
+
+enum bench_keys {
+  key_announce,
+  key_creation_date,
+  key_info_file_tree,
+  key_info_files,
+  key_info_length,
+  key_info_name,
+  key_info_pieces,
+  key_piece_layers,
+  key_rtorrent_state,
+  key_LAST
+};
+
+}
+
+namespace torrent {
+
+// Sorted as the keys appear in bencoded dictionaries.
+template <>
+constexpr static_map_type<bench_keys, key_LAST>::key_list_type static_map_type<bench_keys, key_LAST>::keys = {
+  { key_announce,       "announce" },
+  { key_creation_date,  "creation date" },
+  { key_info_file_tree, "info::file tree" },
+  { key_info_files,     "info::files" },
+  { key_info_length,    "info::length" },
+  { key_info_name,      "info::name" },
+  { key_info_pieces,    "info::pieces*S" },
+  { key_piece_layers,   "piece layers" },
+  { key_rtorrent_state, "rtorrent::state" },
+};
+
+template <>
+constexpr static_map_type<bench_keys, key_LAST>::key_hash_type static_map_type<bench_keys, key_LAST>::key_hash =
+  static_map_make_hash<static_map_type<bench_keys, key_LAST>>();
+
+}
+
+namespace {
+
+using bench_map = torrent::static_map_type<bench_keys, key_LAST>;
+
+unsigned long allocation_count = 0;
+
+struct bench_file {
+  std::string name;
+  std::string data;
+};
+
+struct bench_result {
+  double mb_per_second;
+  double allocations_per_mb;
+};
+
+template <typename Func>
+bench_result
+measure(Func func, size_t size, uint64_t total) {
+  unsigned int rounds = std::max<uint64_t>(total / std::max<size_t>(size, 1), 3);
+  unsigned long allocations = allocation_count;
+
+  auto start = std::chrono::steady_clock::now();
+
+  for (unsigned int i = 0; i < rounds; i++)
+    func();
+
+  std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+  double mb = double(size) * rounds / (1 << 20);
+
+  return bench_result{ mb / elapsed.count(), (allocation_count - allocations) / mb };
+}
+
+std::string
+write_bencode(const torrent::Object& object) {
+  std::ostringstream output;
+  torrent::object_write_bencode(&output, &object);
+  return output.str();
+}
+
+torrent::Object
+create_torrent_base() {
+  torrent::Object torrent = torrent::Object::create_map();
+
+  torrent.insert_key("announce", "http://tracker.example.org:6969/announce");
+  torrent.insert_key("comment", "Example torrent");
+  torrent.insert_key("created by", "mktorrent 1.1");
+  torrent.insert_key("creation date", int64_t{1700000000});
+
+  torrent::Object& announce_list = torrent.insert_key("announce-list", torrent::Object::create_list());
+
+  for (int i = 0; i < 4; i++)
+    announce_list.insert_back(torrent::Object::create_list()).insert_back("udp://tracker" + std::to_string(i) + ".example.org:1337/announce");
+
+  return torrent;
+}
+
+// A 16 GiB file in 256 KiB pieces.
+std::string
+create_single_file() {
+  torrent::Object torrent = create_torrent_base();
+  torrent::Object& info = torrent.insert_key("info", torrent::Object::create_map());
+
+  info.insert_key("length", int64_t{16} << 30);
+  info.insert_key("name", "example.iso");
+  info.insert_key("piece length", int64_t{256} << 10);
+  info.insert_key("pieces", std::string(20 * (1 << 16), 'x'));
+
+  return write_bencode(torrent);
+}
+
+std::string
+create_multi_file(unsigned int file_count) {
+  torrent::Object torrent = create_torrent_base();
+  torrent::Object& info = torrent.insert_key("info", torrent::Object::create_map());
+  torrent::Object& files = info.insert_key("files", torrent::Object::create_list());
+
+  for (unsigned int i = 0; i < file_count; i++) {
+    torrent::Object& file = files.insert_back(torrent::Object::create_map());
+    file.insert_key("length", int64_t{1 << 16} + i);
+
+    torrent::Object& path = file.insert_key("path", torrent::Object::create_list());
+    path.insert_back("directory " + std::to_string(i / 1000));
+    path.insert_back("file " + std::to_string(i) + ".jpg");
+  }
+
+  info.insert_key("name", "Example");
+  info.insert_key("piece length", int64_t{1 << 22});
+  info.insert_key("pieces", std::string(20 * (uint64_t{file_count} * (1 << 16) >> 22), 'x'));
+
+  return write_bencode(torrent);
+}
+
+// BEP 52 layout, each file has a pieces root and a layer of 32 byte
+// hashes in "piece layers".
+std::string
+create_piece_layers(unsigned int file_count, unsigned int pieces_per_file) {
+  torrent::Object torrent = create_torrent_base();
+  torrent::Object& info = torrent.insert_key("info", torrent::Object::create_map());
+  torrent::Object& file_tree = info.insert_key("file tree", torrent::Object::create_map());
+  torrent::Object& layers = torrent.insert_key("piece layers", torrent::Object::create_map());
+
+  for (unsigned int i = 0; i < file_count; i++) {
+    std::string root(32, char('a' + i % 26));
+    root.replace(0, std::to_string(i).size(), std::to_string(i));
+
+    torrent::Object& file = file_tree.insert_key("file " + std::to_string(i) + ".mkv", torrent::Object::create_map());
+    torrent::Object& entry = file.insert_key("", torrent::Object::create_map());
+
+    entry.insert_key("length", int64_t{pieces_per_file} << 22);
+    entry.insert_key("pieces root", root);
+
+    layers.insert_key(root, std::string(32 * pieces_per_file, 'x'));
+  }
+
+  info.insert_key("meta version", int64_t{2});
+  info.insert_key("name", "Example");
+  info.insert_key("piece length", int64_t{1 << 22});
+
+  return write_bencode(torrent);
+}
+
+std::string
+create_resume(unsigned int file_count) {
+  torrent::Object root = torrent::Object::create_map();
+
+  torrent::Object& resume = root.insert_key("libtorrent_resume", torrent::Object::create_map());
+  resume.insert_key("bitfield", std::string(file_count / 8, '\xff'));
+
+  torrent::Object& files = resume.insert_key("files", torrent::Object::create_list());
+
+  for (unsigned int i = 0; i < file_count; i++) {
+    torrent::Object& file = files.insert_back(torrent::Object::create_map());
+    file.insert_key("completed", int64_t{17});
+    file.insert_key("mtime", int64_t{1700000000} + i);
+    file.insert_key("priority", int64_t{1});
+  }
+
+  torrent::Object& peers = resume.insert_key("peers", torrent::Object::create_list());
+
+  for (int i = 0; i < 200; i++) {
+    torrent::Object& peer = peers.insert_back(torrent::Object::create_map());
+    peer.insert_key("failed", int64_t{0});
+    peer.insert_key("inet", std::string(6, char('a' + i % 26)));
+    peer.insert_key("last", int64_t{1700000000});
+  }
+
+  torrent::Object& session = root.insert_key("rtorrent", torrent::Object::create_map());
+  session.insert_key("directory", "/home/user/downloads/Example");
+  session.insert_key("state", int64_t{1});
+
+  return write_bencode(root);
+}
+
+bool
+read_file(const char* path, bench_file* file) {
+  std::ifstream input(path, std::ios::binary);
+
+  if (!input)
+    return false;
+
+  std::ostringstream data;
+  data << input.rdbuf();
+
+  const char* name = std::strrchr(path, '/');
+
+  file->name = name != nullptr ? name + 1 : path;
+  file->data = data.str();
+  return true;
+}
+
+}
+
+void*
+operator new(size_t size) {
+  allocation_count++;
+
+  void* ptr = std::malloc(size == 0 ? 1 : size);
+
+  if (ptr == nullptr)
+    throw std::bad_alloc();
+
+  return ptr;
+}
+
+// Used by the default memory resource.
+void*
+operator new(size_t size, std::align_val_t align) {
+  allocation_count++;
+
+  void* ptr = std::aligned_alloc(static_cast<size_t>(align), (size + static_cast<size_t>(align) - 1) & ~(static_cast<size_t>(align) - 1));
+
+  if (ptr == nullptr)
+    throw std::bad_alloc();
+
+  return ptr;
+}
+
+void
+operator delete(void* ptr, std::align_val_t) noexcept {
+  std::free(ptr);
+}
+
+void
+operator delete(void* ptr, size_t, std::align_val_t) noexcept {
+  std::free(ptr);
+}
+
+void
+operator delete(void* ptr) noexcept {
+  std::free(ptr);
+}
+
+void
+operator delete(void* ptr, size_t) noexcept {
+  std::free(ptr);
+}
+
+int
+main(int argc, char** argv) {
+  uint64_t total = uint64_t{256} << 20;
+  int opt;
+
+  while ((opt = getopt(argc, argv, "m:")) != -1) {
+    switch (opt) {
+    case 'm': total = std::strtoull(optarg, nullptr, 10) << 20; break;
+    default:
+      std::fprintf(stderr, "usage: %s [-m MiB per step] [file...]\n", argv[0]);
+      return 1;
+    }
+  }
+
+  std::vector<bench_file> corpus;
+
+  for (int i = optind; i < argc; i++) {
+    if (!read_file(argv[i], &corpus.emplace_back())) {
+      std::fprintf(stderr, "could not read '%s'\n", argv[i]);
+      return 1;
+    }
+  }
+
+  if (corpus.empty()) {
+    corpus.push_back(bench_file{ "single", create_single_file() });
+    corpus.push_back(bench_file{ "multi-100k", create_multi_file(100000) });
+    corpus.push_back(bench_file{ "layers", create_piece_layers(64, 4096) });
+    corpus.push_back(bench_file{ "resume-10k", create_resume(10000) });
+  }
+
+  uint64_t sink = 0;
+
+  std::printf("%-16s %10s %8s %12s %12s\n", "file", "size", "step", "MB/s", "allocs/MB");
+
+  for (const auto& file : corpus) {
+    const char* first = file.data.data();
+    const char* last  = file.data.data() + file.data.size();
+
+    torrent::Object object;
+
+    try {
+      if (torrent::object_read_bencode_c(first, last, &object) != last)
+        throw torrent::bencode_error("trailing data");
+    } catch (const torrent::bencode_error& e) {
+      std::printf("%-16s skipped: %s\n", file.name.c_str(), e.what());
+      continue;
+    }
+
+    std::string output(file.data.size() * 2 + 1024, '\0');
+
+    auto result_read = measure([&]() {
+        torrent::Object read_object;
+        torrent::object_read_bencode_c(first, last, &read_object);
+      }, file.data.size(), total);
+
+    auto result_write = measure([&]() {
+        sink += torrent::object_write_bencode(&output[0], &output[0] + output.size(), &object).first - &output[0];
+      }, file.data.size(), total);
+
+    auto result_sha1 = measure([&]() {
+        sink += torrent::object_sha1(&object)[0];
+      }, file.data.size(), total);
+
+    auto result_static_map = measure([&]() {
+        bench_map map;
+        sink += torrent::static_map_read_bencode(first, last, map) - first;
+      }, file.data.size(), total);
+
+    const std::pair<const char*, bench_result> results[] = {
+      { "read", result_read }, { "write", result_write }, { "sha1", result_sha1 }, { "static", result_static_map }
+    };
+
+    for (const auto& result : results)
+      std::printf("%-16s %10zu %8s %12.1f %12.1f\n", file.name.c_str(), file.data.size(), result.first,
+                  result.second.mb_per_second, result.second.allocations_per_mb);
+  }
+
+  return sink == 0 ? 0 : 0;
+}
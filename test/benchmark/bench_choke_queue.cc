@@ -0,0 +1,130 @@
+#include "config.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+#include "torrent/download/choke_queue.h"
+
+// Orders the queued connections of synthetic choke groups as a choke
+// cycle does, comparing a full sort with choke_queue::sort_weights
+// bounded by the quota. The weights follow calculate_upload_unchoke,
+// where most connections are optimistic candidates in orders 1 and 2.
+// Build with 'make -C test bench' and run without arguments.
+
+namespace {
+
+using container_type = torrent::choke_queue::container_type;
+
+bool
+weight_less(const torrent::weighted_connection& v1, const torrent::weighted_connection& v2) {
+  return v1.weight < v2.weight;
+}
+
+void
+fill_weights(container_type& group) {
+  for (auto& entry : group) {
+    int r = std::rand() % 16;
+
+    if (r == 0)
+      entry.weight = std::rand() % 128;
+    else if (r < 3)
+      entry.weight = 3 * torrent::choke_queue::order_base + std::rand() % (1 << 20);
+    else
+      entry.weight = (1 + (r == 3)) * torrent::choke_queue::order_base + std::rand() % (1 << 10);
+  }
+}
+
+// The connections taken from the back of each order must have the
+// same weights as with a full sort.
+bool
+verify(container_type group, uint32_t quota) {
+  container_type sorted = group;
+  std::sort(sorted.begin(), sorted.end(), weight_less);
+
+  torrent::choke_queue::sort_weights(group.begin(), group.end(), quota);
+
+  auto order_end = [](const container_type& c, uint32_t order) {
+      return std::find_if(c.begin(), c.end(), [order](auto& v) { return v.weight / torrent::choke_queue::order_base > order; });
+    };
+
+  auto first1 = group.cbegin();
+  auto first2 = sorted.cbegin();
+
+  for (uint32_t order = 0; order < torrent::choke_queue::order_max_size; order++) {
+    auto last1 = order_end(group, order);
+    auto last2 = order_end(sorted, order);
+
+    if (last1 - first1 != last2 - first2)
+      return false;
+
+    auto count = std::min<std::ptrdiff_t>(quota, last1 - first1);
+
+    if (!std::equal(last1 - count, last1, last2 - count, [](auto& v1, auto& v2) { return v1.weight == v2.weight; }))
+      return false;
+
+    first1 = last1;
+    first2 = last2;
+  }
+
+  return true;
+}
+
+void
+measure(unsigned int peers, unsigned int group_count, uint32_t quota) {
+  const unsigned int rounds = 200;
+
+  std::vector<container_type> groups(group_count);
+
+  for (unsigned int i = 0; i < peers; i++)
+    groups[i % group_count].emplace_back(reinterpret_cast<torrent::PeerConnectionBase*>(uintptr_t{i + 1} * 64), 0);
+
+  std::chrono::duration<double, std::nano> sort_time{0};
+  std::chrono::duration<double, std::nano> partial_time{0};
+  bool valid = true;
+
+  std::srand(1);
+
+  for (unsigned int round = 0; round < rounds; round++) {
+    for (auto& group : groups)
+      fill_weights(group);
+
+    std::vector<container_type> copies = groups;
+
+    auto start = std::chrono::steady_clock::now();
+
+    for (auto& group : groups)
+      std::sort(group.begin(), group.end(), weight_less);
+
+    sort_time += std::chrono::steady_clock::now() - start;
+    start = std::chrono::steady_clock::now();
+
+    for (auto& group : copies)
+      torrent::choke_queue::sort_weights(group.begin(), group.end(), quota);
+
+    partial_time += std::chrono::steady_clock::now() - start;
+
+    if (round == 0)
+      for (auto& group : copies)
+        valid = valid && verify(group, quota);
+  }
+
+  std::printf("%8u %8u %8u %12.1f %12.1f %s\n", peers, group_count, quota,
+              sort_time.count() / (rounds * 1000), partial_time.count() / (rounds * 1000),
+              valid ? "" : "mismatch");
+}
+
+}
+
+int
+main() {
+  std::printf("%8s %8s %8s %12s %12s\n", "peers", "groups", "quota", "sort us", "partial us");
+
+  for (unsigned int group_count : { 1, 3, 16 })
+    for (uint32_t quota : { 8, 50, 200 })
+      measure(10000, group_count, quota);
+
+  return 0;
+}
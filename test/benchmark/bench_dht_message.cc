@@ -0,0 +1,109 @@
+#include "config.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+#include <string>
+
+#include "dht/dht_message.h"
+#include "torrent/object.h"
+#include "torrent/object_stream.h"
+
+// Compares decoding KRPC queries with dht_message_read, as done by
+// DhtServer, and with the generic bencode reader into a
+// torrent::Object. Allocations are counted by replacing the global
+// operator new. Build with 'make -C test bench' and run without
+// arguments.
+
+namespace {
+
+unsigned long allocation_count = 0;
+
+const std::string packets[] = {
+  "d1:ad2:id20:abcdefghij0123456789e1:q4:ping1:t2:aa1:y1:qe",
+  "d1:ad2:id20:abcdefghij01234567896:target20:mnopqrstuvwxyz123456e1:q9:find_node1:t2:aa1:y1:qe",
+  "d1:ad2:id20:abcdefghij01234567899:info_hash20:mnopqrstuvwxyz123456e1:q9:get_peers1:t2:aa1:y1:qe",
+  "d1:ad2:id20:abcdefghij012345678912:implied_porti1e9:info_hash20:mnopqrstuvwxyz1234564:porti6881e5:token8:aoeusnthe1:q13:announce_peer1:t2:aa1:y1:qe",
+};
+
+const char* const names[] = { "ping", "find_node", "get_peers", "announce_peer" };
+
+struct bench_result {
+  double ns;
+  double allocations;
+};
+
+template <typename Func>
+bench_result
+measure(Func func, unsigned int rounds) {
+  unsigned long allocations = allocation_count;
+
+  auto start = std::chrono::steady_clock::now();
+
+  for (unsigned int i = 0; i < rounds; i++)
+    func();
+
+  std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now() - start;
+
+  return bench_result{ elapsed.count() / rounds, double(allocation_count - allocations) / rounds };
+}
+
+}
+
+void*
+operator new(size_t size) {
+  allocation_count++;
+
+  void* ptr = std::malloc(size == 0 ? 1 : size);
+
+  if (ptr == nullptr)
+    throw std::bad_alloc();
+
+  return ptr;
+}
+
+void
+operator delete(void* ptr) noexcept {
+  std::free(ptr);
+}
+
+void
+operator delete(void* ptr, size_t) noexcept {
+  std::free(ptr);
+}
+
+int
+main() {
+  const unsigned int rounds = 1 << 20;
+
+  uint64_t sink = 0;
+
+  std::printf("%14s %8s %12s %12s\n", "query", "parser", "ns", "allocs");
+
+  for (unsigned int i = 0; i < 4; i++) {
+    const char* first = packets[i].data();
+    const char* last  = packets[i].data() + packets[i].size();
+
+    auto result_static = measure([&]() {
+        torrent::DhtMessage        message;
+        int                        type = '?';
+        const torrent::HashString* node_id = NULL;
+
+        if (torrent::dht_message_read(first, last, message, type, node_id))
+          sink += type + node_id->data()[0];
+      }, rounds);
+
+    auto result_object = measure([&]() {
+        torrent::Object object;
+
+        torrent::object_read_bencode_c(first, last, &object);
+        sink += object.as_map().size();
+      }, rounds);
+
+    std::printf("%14s %8s %12.1f %12.2f\n", names[i], "static", result_static.ns, result_static.allocations);
+    std::printf("%14s %8s %12.1f %12.2f\n", names[i], "object", result_object.ns, result_object.allocations);
+  }
+
+  return sink == 0 ? 0 : 0;
+}
@@ -0,0 +1,82 @@
+#include "config.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <string>
+#include <vector>
+#include <sys/mman.h>
+
+#include "torrent/data/file.h"
+#include "torrent/data/file_manager.h"
+
+// Opens files at random through a FileManager limited to a typical fd
+// budget, so that nearly every open evicts the least active file, and
+// touches files that are already open. All files point to the same
+// path so the cost of open and close is the same for each size. Build
+// with 'make -C test bench' and run without arguments.
+
+namespace {
+
+struct bench_file : public torrent::File {
+  using torrent::File::set_frozen_path;
+};
+
+double
+elapsed_ns(std::chrono::steady_clock::time_point start, unsigned int operations) {
+  std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now() - start;
+  return elapsed.count() / operations;
+}
+
+}
+
+int
+main() {
+  const unsigned int operations = 1 << 17;
+  const char* path = "/dev/null";
+
+  std::printf("%10s %10s %12s %12s %12s\n", "files", "max_open", "open ns", "touch ns", "evicted");
+
+  for (unsigned int file_count : { 1024, 16384, 131072 }) {
+    for (unsigned int max_open : { 256, 4096 }) {
+      torrent::FileManager manager;
+      manager.set_max_open_files(max_open);
+
+      std::vector<std::unique_ptr<bench_file>> files;
+
+      for (unsigned int i = 0; i < file_count; i++) {
+        files.emplace_back(new bench_file);
+        files.back()->set_frozen_path(path);
+      }
+
+      std::srand(1);
+
+      auto start = std::chrono::steady_clock::now();
+
+      for (unsigned int i = 0; i < operations; i++) {
+        auto& file = files[std::rand() % file_count];
+
+        if (!file->is_open() && !manager.open(file.get(), PROT_READ, 0)) {
+          std::printf("could not open '%s'\n", path);
+          return 1;
+        }
+      }
+
+      double open_ns = elapsed_ns(start, operations);
+      start = std::chrono::steady_clock::now();
+
+      for (unsigned int i = 0; i < operations; i++)
+        manager.touch(*(manager.begin() + std::rand() % manager.open_files()));
+
+      double touch_ns = elapsed_ns(start, operations);
+
+      std::printf("%10u %10u %12.1f %12.1f %12lu\n", file_count, max_open, open_ns, touch_ns, (unsigned long)manager.files_evicted_counter());
+
+      while (manager.open_files() != 0)
+        manager.close_least_active();
+    }
+  }
+
+  return 0;
+}
@@ -0,0 +1,113 @@
+#include "config.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <unistd.h>
+#include <vector>
+#include <sys/socket.h>
+
+#include "protocol/handshake.h"
+
+// Compares the reads Handshake made for a plaintext handshake that
+// arrives in one packet, reading exactly what each state needs, with
+// reading ahead once the encryption is settled. The peer sends the
+// handshake, an extension handshake and a bitfield together. A real
+// Handshake needs the manager and a download, so only the socket reads
+// and the parsing offsets are modelled. Build with 'make -C test bench'
+// and run without arguments.
+
+namespace {
+
+constexpr uint32_t extension_size = 4 + 2 + 120;
+constexpr uint32_t bitfield_count = 2048;
+
+// Reads until 'buffer' holds 'size' bytes, asking for at least 'want'.
+uint32_t
+fill(int fd, std::vector<char>& buffer, uint32_t& end, uint32_t position, uint32_t size, uint32_t want, unsigned int* calls) {
+  while (end - position < size) {
+    ssize_t result = ::read(fd, buffer.data() + end, std::max(size, want) - (end - position));
+
+    (*calls)++;
+
+    if (result <= 0)
+      return 0;
+
+    end += result;
+  }
+
+  return size;
+}
+
+double
+measure(int fds[2], const std::vector<char>& message, uint32_t read_ahead, unsigned int count, unsigned int* calls) {
+  std::vector<char> buffer(torrent::Handshake::buffer_size);
+  std::vector<char> bitfield(bitfield_count / 8);
+
+  auto start = std::chrono::steady_clock::now();
+
+  for (unsigned int i = 0; i < count; i++) {
+    if (::write(fds[0], message.data(), message.size()) != static_cast<ssize_t>(message.size()))
+      return 0.0;
+
+    uint32_t position = 0;
+    uint32_t end = 0;
+
+    // Info and peer id, then the extension and bitfield preambles.
+    position += fill(fds[1], buffer, end, position, torrent::Handshake::handshake_size, read_ahead, calls);
+    position += fill(fds[1], buffer, end, position, extension_size, read_ahead, calls);
+    position += fill(fds[1], buffer, end, position, 5, read_ahead, calls);
+
+    // The bitfield is copied out of the buffer, the rest read directly.
+    uint32_t copied = std::min<uint32_t>(bitfield.size(), end - position);
+    std::memcpy(bitfield.data(), buffer.data() + position, copied);
+
+    while (copied < bitfield.size()) {
+      ssize_t result = ::read(fds[1], bitfield.data() + copied, bitfield.size() - copied);
+
+      (*calls)++;
+
+      if (result <= 0)
+        return 0.0;
+
+      copied += result;
+    }
+  }
+
+  std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+  return count / elapsed.count();
+}
+
+}
+
+int
+main() {
+  const unsigned int count = 200000;
+
+  int fds[2];
+
+  if (::socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == -1)
+    return 1;
+
+  std::vector<char> message(torrent::Handshake::handshake_size + extension_size + 5 + bitfield_count / 8, 'x');
+
+  unsigned int calls_exact = 0;
+  unsigned int calls_ahead = 0;
+
+  measure(fds, message, 0, count / 10, &calls_exact);
+  calls_exact = 0;
+
+  double result_exact = measure(fds, message, 0, count, &calls_exact);
+  double result_ahead = measure(fds, message, torrent::Handshake::read_ahead_size, count, &calls_ahead);
+
+  std::printf("%14s %14s %14s\n", "", "handshakes/s", "reads/hs");
+  std::printf("%14s %14.0f %14.2f\n", "exact", result_exact, double(calls_exact) / count);
+  std::printf("%14s %14.0f %14.2f\n", "read ahead", result_ahead, double(calls_ahead) / count);
+
+  ::close(fds[0]);
+  ::close(fds[1]);
+
+  return 0;
+}
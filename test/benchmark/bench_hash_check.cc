@@ -0,0 +1,360 @@
+#include "config.h"
+
+#include <chrono>
+#include <cinttypes>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <map>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "globals.h"
+#include "manager.h"
+#include "thread_main.h"
+#include "data/chunk.h"
+#include "data/chunk_list.h"
+#include "data/hash_queue.h"
+#include "data/hash_torrent.h"
+#include "data/socket_file.h"
+#include "data/thread_disk.h"
+#include "torrent/chunk_manager.h"
+#include "torrent/exceptions.h"
+#include "torrent/hash_string.h"
+#include "torrent/poll.h"
+#include "utils/sha1.h"
+
+// Rechecks a synthetic torrent through HashTorrent, the hash queues
+// of the main and disk threads, HashChunk and Sha1, as a torrent
+// added with existing data would be. The data is written to 'dir' and
+// dropped from the page cache before checking, on tmpfs it stays in
+// memory. Reports throughput, page faults and CPU time per thread,
+// '-j' prints a single JSON object instead.
+//
+// The chunks are mapped from the files here the same way
+// FileList::create_chunk does, and HashTorrent takes the recheck
+// budget from the manager's chunk manager. The main thread only runs
+// the hash queue.
+//
+// Build with 'make -C test bench' and run as:
+//
+//   LibTorrent_Bench_Hash_Check [-d dir] [-s MiB] [-p piece KiB] [-f files] [-w workers] [-j]
+
+namespace {
+
+struct bench_options {
+  std::string  dir;
+  uint64_t     size{512 << 20};
+  uint32_t     piece_length{1 << 20};
+  unsigned int files{4};
+  int          workers{-1};
+  bool         json{false};
+};
+
+struct thread_times {
+  std::string name;
+  double      cpu_seconds{};
+};
+
+bool
+parse_options(int argc, char** argv, bench_options* options) {
+  struct stat st;
+  options->dir = ::stat("/dev/shm", &st) == 0 ? "/dev/shm" : "/tmp";
+
+  int opt;
+
+  while ((opt = getopt(argc, argv, "d:s:p:f:w:j")) != -1) {
+    switch (opt) {
+    case 'd': options->dir = optarg; break;
+    case 's': options->size = std::strtoull(optarg, nullptr, 10) << 20; break;
+    case 'p': options->piece_length = std::strtoul(optarg, nullptr, 10) << 10; break;
+    case 'f': options->files = std::strtoul(optarg, nullptr, 10); break;
+    case 'w': options->workers = std::atoi(optarg); break;
+    case 'j': options->json = true; break;
+    default:
+      return false;
+    }
+  }
+
+  return options->size != 0 && options->piece_length != 0 && options->files != 0;
+}
+
+// CPU time of each thread of the process, keyed by thread id.
+std::map<std::string, thread_times>
+read_thread_times() {
+  std::map<std::string, thread_times> result;
+  DIR* dir = opendir("/proc/self/task");
+
+  if (dir == nullptr)
+    return result;
+
+  while (dirent* entry = readdir(dir)) {
+    if (entry->d_name[0] == '.')
+      continue;
+
+    std::string   path = std::string("/proc/self/task/") + entry->d_name;
+    std::ifstream comm(path + "/comm");
+    std::ifstream stat(path + "/stat");
+
+    thread_times times;
+    std::getline(comm, times.name);
+
+    // The fields after the command name, which may contain spaces.
+    std::string line;
+    std::getline(stat, line);
+    auto position = line.rfind(')');
+
+    if (position == std::string::npos)
+      continue;
+
+    std::vector<std::string> fields;
+    char* save = nullptr;
+
+    for (char* token = strtok_r(&line[position + 2], " ", &save); token != nullptr; token = strtok_r(nullptr, " ", &save))
+      fields.emplace_back(token);
+
+    // utime and stime are the 14th and 15th fields of the line.
+    if (fields.size() > 12)
+      times.cpu_seconds = double(std::strtoull(fields[11].c_str(), nullptr, 10) + std::strtoull(fields[12].c_str(), nullptr, 10)) / sysconf(_SC_CLK_TCK);
+
+    result[entry->d_name] = times;
+  }
+
+  closedir(dir);
+  return result;
+}
+
+std::string
+file_path(const bench_options& options, unsigned int index) {
+  return options.dir + "/libtorrent-bench-hash-" + std::to_string(index);
+}
+
+uint64_t
+file_size(const bench_options& options, unsigned int index) {
+  uint64_t size = options.size / options.files;
+  return index + 1 == options.files ? options.size - size * index : size;
+}
+
+// Writes the files piece by piece, returning the piece hashes.
+std::vector<torrent::HashString>
+create_files(const bench_options& options) {
+  std::vector<torrent::HashString> hashes;
+  std::vector<char>                piece(options.piece_length);
+  std::mt19937_64                  rng(1);
+
+  unsigned int file_index = 0;
+  uint64_t     file_remaining = file_size(options, 0);
+  int          fd = ::open(file_path(options, 0).c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+
+  for (uint64_t offset = 0; offset < options.size; offset += options.piece_length) {
+    uint32_t length = std::min<uint64_t>(options.piece_length, options.size - offset);
+
+    for (uint32_t i = 0; i + sizeof(uint64_t) <= length; i += sizeof(uint64_t)) {
+      uint64_t value = rng();
+      std::memcpy(&piece[i], &value, sizeof(uint64_t));
+    }
+
+    torrent::Sha1 sha1;
+    sha1.init();
+    sha1.update(piece.data(), length);
+    hashes.emplace_back();
+    sha1.final_c(hashes.back().data());
+
+    for (uint32_t written = 0; written < length; ) {
+      if (fd == -1)
+        throw torrent::internal_error("could not create '" + file_path(options, file_index) + "'");
+
+      uint32_t count = std::min<uint64_t>(length - written, file_remaining);
+
+      if (::write(fd, &piece[written], count) != count)
+        throw torrent::internal_error("could not write '" + file_path(options, file_index) + "'");
+
+      written += count;
+      file_remaining -= count;
+
+      if (file_remaining == 0 && ++file_index < options.files) {
+        ::fsync(fd);
+        ::posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+        ::close(fd);
+
+        file_remaining = file_size(options, file_index);
+        fd = ::open(file_path(options, file_index).c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+      }
+    }
+  }
+
+  ::fsync(fd);
+  ::posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+  ::close(fd);
+
+  return hashes;
+}
+
+torrent::Chunk*
+create_chunk(const bench_options& options, const std::vector<int>& fds, uint32_t index, int prot) {
+  auto     chunk = std::make_unique<torrent::Chunk>();
+  uint64_t offset = uint64_t(index) * options.piece_length;
+  uint64_t last = std::min<uint64_t>(offset + options.piece_length, options.size);
+  uint64_t file_offset = 0;
+
+  for (unsigned int i = 0; i < options.files && offset < last; file_offset += file_size(options, i++)) {
+    uint64_t file_end = file_offset + file_size(options, i);
+
+    if (offset >= file_end)
+      continue;
+
+    uint32_t length = std::min(last, file_end) - offset;
+    auto     part = torrent::SocketFile(fds[i]).create_chunk(offset - file_offset, length, prot, torrent::MemoryChunk::map_shared);
+
+    if (!part.is_valid())
+      return nullptr;
+
+    chunk->push_back(torrent::ChunkPart::MAPPED_MMAP, part);
+    offset += length;
+  }
+
+  return chunk.release();
+}
+
+}
+
+int
+main(int argc, char** argv) {
+  bench_options options;
+
+  if (!parse_options(argc, argv, &options)) {
+    std::fprintf(stderr, "usage: %s [-d dir] [-s MiB] [-p piece KiB] [-f files] [-w workers] [-j]\n", argv[0]);
+    return 1;
+  }
+
+  std::vector<torrent::HashString> hashes = create_files(options);
+
+  std::vector<int> fds;
+
+  for (unsigned int i = 0; i < options.files; i++)
+    if ((fds.emplace_back(::open(file_path(options, i).c_str(), O_RDONLY))) == -1)
+      throw torrent::internal_error("could not open '" + file_path(options, i) + "'");
+
+  torrent::cachedTime = rak::timer::current();
+
+  torrent::Poll::slot_create_poll() = [] { return torrent::Poll::create(256); };
+  torrent::ThreadMain::create_thread();
+  torrent::thread_main()->init_thread();
+  torrent::manager = new torrent::Manager;
+
+  torrent::ThreadDisk::create_thread();
+  torrent::thread_disk()->init_thread();
+  torrent::thread_disk()->start_thread();
+
+  if (options.workers >= 0)
+    torrent::thread_disk()->hash_check_queue()->start_workers(options.workers);
+
+  torrent::ChunkList chunk_list;
+  chunk_list.set_manager(torrent::manager->chunk_manager());
+  chunk_list.slot_create_chunk() = [&](auto index, auto prot) { return create_chunk(options, fds, index, prot); };
+  chunk_list.slot_free_diskspace() = [] { return ~uint64_t(); };
+  chunk_list.slot_storage_error() = [](const std::string& message) { throw torrent::internal_error(message); };
+  chunk_list.set_chunk_size(options.piece_length);
+  chunk_list.resize(hashes.size());
+
+  torrent::HashQueue hash_queue_object;
+  torrent::HashQueue* hash_queue = &hash_queue_object;
+  hash_queue->slot_has_work() = [](bool) {};
+
+  torrent::thread_disk()->hash_check_queue()->slot_chunk_done() = [hash_queue](auto hash_chunk, const auto& hash) {
+      hash_queue->chunk_done(hash_chunk, hash);
+    };
+
+  torrent::HashTorrent hash_torrent(&chunk_list);
+  uint32_t             failed = 0;
+
+  // As DownloadWrapper::check_chunk_hash and receive_hash_done.
+  hash_torrent.slot_check_chunk() = [&](torrent::ChunkHandle handle) {
+      torrent::ChunkHandle new_handle = chunk_list.get(handle.index(), torrent::ChunkList::get_blocking);
+      chunk_list.release(&handle);
+
+      hash_queue->push_back(new_handle, nullptr, [&](torrent::ChunkHandle done, const char* hash) {
+          failed += hash == nullptr || std::memcmp(hash, hashes[done.index()].data(), torrent::HashString::size_data) != 0;
+
+          uint32_t index = done.index();
+          chunk_list.release(&done);
+          hash_torrent.receive_chunkdone(index);
+        });
+    };
+
+  // Completion is polled below, so the delayed signal is not run.
+  hash_torrent.delay_checked().slot() = [] {};
+  hash_torrent.hashing_ranges().insert(0, chunk_list.size());
+
+  rusage usage_before;
+  getrusage(RUSAGE_SELF, &usage_before);
+  auto threads_before = read_thread_times();
+  auto start = std::chrono::steady_clock::now();
+
+  hash_torrent.start(false);
+
+  while (hash_torrent.outstanding() != 0 || hash_torrent.position() != chunk_list.size()) {
+    hash_queue->work();
+    usleep(100);
+  }
+
+  std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+  auto threads_after = read_thread_times();
+  rusage usage_after;
+  getrusage(RUSAGE_SELF, &usage_after);
+
+  hash_torrent.confirm_checked();
+
+  // Per thread name, summing the hash workers.
+  std::map<std::string, double> cpu;
+
+  for (auto& thread : threads_after)
+    cpu[thread.second.name] += thread.second.cpu_seconds - threads_before[thread.first].cpu_seconds;
+
+  double gb_per_second = double(options.size) / elapsed.count() / 1e9;
+  long   minor_faults = usage_after.ru_minflt - usage_before.ru_minflt;
+  long   major_faults = usage_after.ru_majflt - usage_before.ru_majflt;
+
+  if (options.json) {
+    std::printf("{\"dir\":\"%s\",\"size\":%" PRIu64 ",\"piece_length\":%" PRIu32 ",\"files\":%u,\"workers\":%u,"
+                "\"seconds\":%.3f,\"gb_per_second\":%.3f,\"failed\":%" PRIu32 ",\"minor_faults\":%ld,\"major_faults\":%ld,\"cpu_seconds\":{",
+                options.dir.c_str(), options.size, options.piece_length, options.files, torrent::thread_disk()->hash_check_queue()->worker_count(),
+                elapsed.count(), gb_per_second, failed, minor_faults, major_faults);
+
+    for (auto itr = cpu.begin(); itr != cpu.end(); itr++)
+      std::printf("%s\"%s\":%.3f", itr == cpu.begin() ? "" : ",", itr->first.c_str(), itr->second);
+
+    std::printf("}}\n");
+
+  } else {
+    std::printf("dir: %s  size: %" PRIu64 " MiB  piece: %" PRIu32 " KiB  files: %u  workers: %u\n",
+                options.dir.c_str(), options.size >> 20, options.piece_length >> 10, options.files, torrent::thread_disk()->hash_check_queue()->worker_count());
+    std::printf("%.3f s  %.3f GB/s  failed: %" PRIu32 "  minor faults: %ld  major faults: %ld\n",
+                elapsed.count(), gb_per_second, failed, minor_faults, major_faults);
+
+    for (auto& thread : cpu)
+      std::printf("  %-24s %8.3f s cpu\n", thread.first.c_str(), thread.second);
+  }
+
+  chunk_list.clear();
+  torrent::ThreadDisk::destroy_thread();
+
+  delete torrent::manager;
+  torrent::manager = nullptr;
+  delete torrent::thread_main();
+
+  for (unsigned int i = 0; i < options.files; i++) {
+    ::close(fds[i]);
+    ::unlink(file_path(options, i).c_str());
+  }
+
+  return failed != 0;
+}
@@ -0,0 +1,309 @@
+#include "config.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <map>
+#include <new>
+#include <string>
+#include <vector>
+
+#include "torrent/object.h"
+#include "torrent/object_stream.h"
+#include "torrent/utils/flat_map.h"
+
+// Reads, queries and writes a .torrent file and its resume data as
+// rtorrent does for each download at startup, and compares the
+// dictionary containers on their own. The files are generated with
+// the layout rtorrent and common torrent makers produce. Allocations
+// are counted by replacing the global operator new. Build with
+// 'make -C test bench' and run without arguments.
+
+namespace {
+
+unsigned long allocation_count = 0;
+
+struct bench_result {
+  double ns;
+  double allocations;
+};
+
+template <typename Func>
+bench_result
+measure(Func func, unsigned int rounds) {
+  unsigned long allocations = allocation_count;
+
+  auto start = std::chrono::steady_clock::now();
+
+  for (unsigned int i = 0; i < rounds; i++)
+    func();
+
+  std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now() - start;
+
+  return bench_result{ elapsed.count() / rounds, double(allocation_count - allocations) / rounds };
+}
+
+std::string
+write_bencode(const torrent::Object& object) {
+  std::string buffer(1 << 22, '\0');
+
+  auto result = torrent::object_write_bencode(&buffer[0], &buffer[0] + buffer.size(), &object);
+  buffer.resize(result.first - &buffer[0]);
+
+  return buffer;
+}
+
+std::string
+create_torrent(unsigned int file_count) {
+  torrent::Object torrent = torrent::Object::create_map();
+
+  torrent.insert_key("announce", "http://tracker.example.org:6969/announce");
+  torrent.insert_key("comment", "Example torrent");
+  torrent.insert_key("created by", "mktorrent 1.1");
+  torrent.insert_key("creation date", int64_t{1700000000});
+
+  torrent::Object& announce_list = torrent.insert_key("announce-list", torrent::Object::create_list());
+
+  for (int i = 0; i < 4; i++)
+    announce_list.insert_back(torrent::Object::create_list()).insert_back("udp://tracker" + std::to_string(i) + ".example.org:1337/announce");
+
+  torrent::Object& info = torrent.insert_key("info", torrent::Object::create_map());
+  torrent::Object& files = info.insert_key("files", torrent::Object::create_list());
+
+  for (unsigned int i = 0; i < file_count; i++) {
+    torrent::Object& file = files.insert_back(torrent::Object::create_map());
+    file.insert_key("length", int64_t{1 << 24} + i);
+
+    torrent::Object& path = file.insert_key("path", torrent::Object::create_list());
+    path.insert_back("Season 1");
+    path.insert_back("Episode " + std::to_string(i) + ".mkv");
+  }
+
+  info.insert_key("name", "Example");
+  info.insert_key("piece length", int64_t{1 << 20});
+  info.insert_key("pieces", std::string(20 * 700, 'x'));
+
+  return write_bencode(torrent);
+}
+
+std::string
+create_resume(unsigned int file_count) {
+  torrent::Object root = torrent::Object::create_map();
+
+  torrent::Object& resume = root.insert_key("libtorrent_resume", torrent::Object::create_map());
+  resume.insert_key("bitfield", int64_t{700});
+
+  torrent::Object& files = resume.insert_key("files", torrent::Object::create_list());
+
+  for (unsigned int i = 0; i < file_count; i++) {
+    torrent::Object& file = files.insert_back(torrent::Object::create_map());
+    file.insert_key("completed", int64_t{17});
+    file.insert_key("mtime", int64_t{1700000000} + i);
+    file.insert_key("priority", int64_t{1});
+  }
+
+  torrent::Object& peers = resume.insert_key("peers", torrent::Object::create_list());
+
+  for (int i = 0; i < 20; i++) {
+    torrent::Object& peer = peers.insert_back(torrent::Object::create_map());
+    peer.insert_key("failed", int64_t{0});
+    peer.insert_key("inet", std::string(6, char('a' + i)));
+    peer.insert_key("last", int64_t{1700000000});
+  }
+
+  torrent::Object& trackers = resume.insert_key("trackers", torrent::Object::create_map());
+
+  for (int i = 0; i < 4; i++)
+    trackers.insert_key("udp://tracker" + std::to_string(i) + ".example.org:1337/announce", torrent::Object::create_map()).insert_key("enabled", int64_t{1});
+
+  resume.insert_key("uncertain_pieces.timestamp", int64_t{1700000000});
+
+  torrent::Object& session = root.insert_key("rtorrent", torrent::Object::create_map());
+
+  const char* session_keys[] = {
+    "chunks_done", "chunks_wanted", "complete", "custom1", "custom2", "custom3", "custom4", "custom5",
+    "directory", "hashing", "ignore_commands", "key", "loaded_file", "priority", "state", "state_changed",
+    "state_counter", "throttle_name", "tied_to_file", "timestamp.finished", "timestamp.started", "total_uploaded",
+    "views"
+  };
+
+  for (const char* key : session_keys)
+    session.insert_key(key, int64_t{1});
+
+  root.insert_key("libtorrent", torrent::Object::create_map()).insert_key("files", torrent::Object::create_list());
+
+  return write_bencode(root);
+}
+
+// Mirrors the lookups of DownloadConstructor and resume_load_*.
+uint64_t
+query_torrent(const torrent::Object& torrent) {
+  uint64_t sink = 0;
+
+  const torrent::Object& info = torrent.get_key("info");
+
+  sink += info.get_key_value("piece length");
+  sink += info.get_key_string("name").size();
+  sink += info.get_key_string("pieces").size();
+  sink += torrent.has_key_list("announce-list");
+  sink += torrent.has_key_value("creation date");
+  sink += info.has_key_value("private");
+
+  for (const auto& file : info.get_key_list("files"))
+    sink += file.get_key_value("length") + file.get_key_list("path").size();
+
+  return sink;
+}
+
+uint64_t
+query_resume(const torrent::Object& root) {
+  uint64_t sink = 0;
+
+  const torrent::Object& resume = root.get_key("libtorrent_resume");
+
+  sink += resume.get_key_value("bitfield");
+  sink += resume.has_key_string("uncertain_pieces");
+
+  for (const auto& file : resume.get_key_list("files"))
+    sink += file.get_key_value("mtime") + file.get_key_value("priority") + file.get_key_value("completed");
+
+  for (const auto& peer : resume.get_key_list("peers"))
+    sink += peer.get_key_string("inet").size() + peer.get_key_value("last");
+
+  const torrent::Object& session = root.get_key("rtorrent");
+
+  sink += session.get_key_value("state") + session.get_key_value("priority") + session.get_key_value("complete");
+
+  return sink;
+}
+
+template <typename Map>
+uint64_t
+build_and_find(const std::vector<std::string>& keys) {
+  Map map;
+
+  for (const auto& key : keys)
+    map[key] = key.size();
+
+  uint64_t sink = 0;
+
+  for (const auto& key : keys)
+    sink += map.find(key)->second;
+
+  return sink;
+}
+
+}
+
+void*
+operator new(size_t size) {
+  allocation_count++;
+
+  void* ptr = std::malloc(size == 0 ? 1 : size);
+
+  if (ptr == nullptr)
+    throw std::bad_alloc();
+
+  return ptr;
+}
+
+// Used by the default memory resource.
+void*
+operator new(size_t size, std::align_val_t align) {
+  allocation_count++;
+
+  void* ptr = std::aligned_alloc(static_cast<size_t>(align), (size + static_cast<size_t>(align) - 1) & ~(static_cast<size_t>(align) - 1));
+
+  if (ptr == nullptr)
+    throw std::bad_alloc();
+
+  return ptr;
+}
+
+void
+operator delete(void* ptr, std::align_val_t) noexcept {
+  std::free(ptr);
+}
+
+void
+operator delete(void* ptr, size_t, std::align_val_t) noexcept {
+  std::free(ptr);
+}
+
+void
+operator delete(void* ptr) noexcept {
+  std::free(ptr);
+}
+
+void
+operator delete(void* ptr, size_t) noexcept {
+  std::free(ptr);
+}
+
+int
+main() {
+  const unsigned int rounds = 1 << 14;
+
+  std::string files[] = { create_torrent(40), create_resume(40), create_torrent(10000) };
+  const char* names[] = { "torrent", "resume", "large" };
+
+  uint64_t sink = 0;
+  std::string output(1 << 22, '\0');
+
+  std::printf("%10s %8s %12s %12s\n", "file", "step", "ns", "allocs");
+
+  for (unsigned int i = 0; i < 3; i++) {
+    const char* first = files[i].data();
+    const char* last  = files[i].data() + files[i].size();
+
+    unsigned int file_rounds = std::max<unsigned int>(rounds * 1024 / files[i].size(), 16);
+
+    torrent::Object object;
+
+    auto result_skip = measure([&]() {
+        sink += torrent::object_read_bencode_skip_c(first, last) - first;
+      }, file_rounds);
+
+    auto result_read = measure([&]() {
+        object.clear();
+        torrent::object_read_bencode_c(first, last, &object);
+      }, file_rounds);
+
+    auto result_query = measure([&]() {
+        sink += i != 1 ? query_torrent(object) : query_resume(object);
+      }, file_rounds);
+
+    auto result_write = measure([&]() {
+        sink += torrent::object_write_bencode(&output[0], &output[0] + output.size(), &object).first - &output[0];
+      }, file_rounds);
+
+    std::printf("%10s %8s %12.1f %12.2f\n", names[i], "skip", result_skip.ns, result_skip.allocations);
+    std::printf("%10s %8s %12.1f %12.2f\n", names[i], "read", result_read.ns, result_read.allocations);
+    std::printf("%10s %8s %12.1f %12.2f\n", names[i], "query", result_query.ns, result_query.allocations);
+    std::printf("%10s %8s %12.1f %12.2f\n", names[i], "write", result_write.ns, result_write.allocations);
+  }
+
+  // Typical key sets: a file entry, a peer entry and the rtorrent
+  // session dictionary.
+  std::vector<std::vector<std::string>> key_sets = {
+    { "length", "path" },
+    { "failed", "inet", "last" },
+    { "chunks_done", "chunks_wanted", "complete", "custom1", "custom2", "custom3", "custom4", "custom5",
+      "directory", "hashing", "ignore_commands", "key", "loaded_file", "priority", "state", "state_changed",
+      "state_counter", "throttle_name", "tied_to_file", "timestamp.finished", "timestamp.started", "total_uploaded",
+      "views" }
+  };
+
+  std::printf("\n%10s %10s %12s %12s\n", "keys", "map", "ns", "allocs");
+
+  for (const auto& keys : key_sets) {
+    auto result_tree = measure([&]() { sink += build_and_find<std::map<std::string, int64_t>>(keys); }, rounds);
+    auto result_flat = measure([&]() { sink += build_and_find<torrent::flat_map<std::string, int64_t>>(keys); }, rounds);
+
+    std::printf("%10zu %10s %12.1f %12.2f\n", keys.size(), "std::map", result_tree.ns, result_tree.allocations);
+    std::printf("%10zu %10s %12.1f %12.2f\n", keys.size(), "flat_map", result_flat.ns, result_flat.allocations);
+  }
+
+  return sink == 0 ? 0 : 0;
+}
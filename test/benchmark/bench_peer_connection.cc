@@ -0,0 +1,96 @@
+#include "config.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <random>
+#include <vector>
+
+#include "protocol/peer_connection_leech.h"
+
+// Compares visiting the hot state of many connections, in random order
+// as the poll loop does, with the cold state stored inline and with it
+// moved to a side allocation. Constructing real connections pulls in
+// the manager and other symbols the shared library does not export, so
+// the objects are modelled as buffers of the measured sizes with the
+// read and write paths touching the first cache lines of each. Build
+// with 'make -C test bench' and run without arguments.
+
+using peer_type = torrent::PeerConnection<torrent::Download::CONNECTION_LEECH>;
+
+namespace {
+
+constexpr size_t cache_line_size = 64;
+constexpr size_t hot_lines       = 8;
+
+constexpr size_t size_split  = sizeof(peer_type);
+constexpr size_t size_inline = sizeof(peer_type) + sizeof(torrent::EncryptionInfo) + sizeof(torrent::DataBuffer) + sizeof(uint32_t);
+
+double
+measure(const std::vector<char*>& peers, const std::vector<uint32_t>& order, unsigned int rounds, uint64_t* sink) {
+  uint64_t sum = 0;
+
+  auto start = std::chrono::steady_clock::now();
+
+  for (unsigned int round = 0; round < rounds; round++) {
+    for (auto index : order) {
+      char* peer = peers[index];
+
+      for (size_t line = 0; line < hot_lines; line++)
+        sum += ++peer[line * cache_line_size];
+    }
+  }
+
+  std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now() - start;
+
+  *sink += sum;
+  return elapsed.count() / (double(rounds) * order.size());
+}
+
+double
+measure_layout(size_t object_size, uint32_t count, std::mt19937& rng, uint64_t* sink) {
+  std::vector<std::unique_ptr<char[]>> storage;
+  std::vector<char*>                   peers;
+
+  for (uint32_t i = 0; i < count; i++) {
+    storage.emplace_back(new char[object_size]);
+    std::memset(storage.back().get(), 0, object_size);
+    peers.push_back(storage.back().get());
+  }
+
+  std::vector<uint32_t> order(count);
+
+  for (uint32_t i = 0; i < count; i++)
+    order[i] = i;
+
+  std::shuffle(order.begin(), order.end(), rng);
+
+  unsigned int rounds = std::max<unsigned int>(1, (1 << 24) / count);
+
+  measure(peers, order, 1, sink);
+  return measure(peers, order, rounds, sink);
+}
+
+}
+
+int
+main() {
+  const uint32_t counts[] = { 256, 4096, 32768 };
+
+  std::printf("sizeof(peer) split:%zu inline:%zu\n", size_split, size_inline);
+  std::printf("%10s %14s %14s\n", "peers", "inline ns", "split ns");
+
+  uint64_t     sink = 0;
+  std::mt19937 rng(1);
+
+  for (auto count : counts) {
+    double result_inline = measure_layout(size_inline, count, rng, &sink);
+    double result_split  = measure_layout(size_split, count, rng, &sink);
+
+    std::printf("%10u %14.2f %14.2f\n", count, result_inline, result_split);
+  }
+
+  return sink == 0 ? 0 : 0;
+}
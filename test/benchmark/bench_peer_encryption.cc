@@ -0,0 +1,115 @@
+#include "config.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <memory>
+#include <random>
+#include <vector>
+
+#include "protocol/encryption_info.h"
+
+// Compares the per byte cost of the encryption check on the peer
+// connection read path, with the flag read from the separately
+// allocated cold state as PeerConnectionBase used to and with the copy
+// kept in the hot part, for plaintext and RC4 connections. The
+// connections are visited in random order as the poll loop does, each
+// receiving one message of the given size. Build with
+// 'make -C test bench' and run without arguments.
+
+namespace {
+
+constexpr uint32_t peer_count = 32768;
+
+struct cold_type {
+  torrent::EncryptionInfo encryption;
+  char                    padding[512];
+};
+
+struct peer_type {
+  bool                       encrypted;
+  std::unique_ptr<cold_type> cold;
+};
+
+template <bool use_inline>
+double
+measure(std::vector<peer_type>& peers, const std::vector<uint32_t>& order, uint32_t message_size, uint64_t* sink) {
+  std::vector<char> buffer(message_size, 'x');
+
+  unsigned int rounds = std::max<unsigned int>(1, (64 << 20) / (message_size * order.size()));
+  uint64_t     sum = 0;
+
+  auto start = std::chrono::steady_clock::now();
+
+  for (unsigned int round = 0; round < rounds; round++) {
+    for (auto index : order) {
+      peer_type& peer = peers[index];
+
+      if (use_inline ? peer.encrypted : peer.cold->encryption.is_encrypted())
+        peer.cold->encryption.decrypt(buffer.data(), message_size);
+
+      sum += buffer[0];
+    }
+  }
+
+  std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now() - start;
+
+  *sink += sum;
+  return elapsed.count() / (double(rounds) * order.size() * message_size);
+}
+
+std::vector<peer_type>
+make_peers(bool encrypted) {
+  const unsigned char key[20] = { 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15, 16, 17, 18, 19, 20 };
+
+  std::vector<peer_type> peers(peer_count);
+
+  for (auto& peer : peers) {
+    peer.cold = std::make_unique<cold_type>();
+    peer.encrypted = encrypted;
+
+    if (encrypted) {
+      peer.cold->encryption.set_encrypt(torrent::RC4(key, sizeof(key)));
+      peer.cold->encryption.set_decrypt(torrent::RC4(key, sizeof(key)));
+    }
+  }
+
+  return peers;
+}
+
+}
+
+int
+main() {
+  const uint32_t message_sizes[] = { 9, 68, 16 << 10 };
+
+  uint64_t     sink = 0;
+  std::mt19937 rng(1);
+
+  std::vector<uint32_t> order(peer_count);
+
+  for (uint32_t i = 0; i < peer_count; i++)
+    order[i] = i;
+
+  std::shuffle(order.begin(), order.end(), rng);
+
+  auto plain     = make_peers(false);
+  auto encrypted = make_peers(true);
+
+  std::printf("%10s %14s %14s %14s %14s\n", "message", "plain cold", "plain hot", "rc4 cold", "rc4 hot");
+
+  for (auto message_size : message_sizes) {
+    measure<true>(plain, order, message_size, &sink);
+
+    double plain_cold     = measure<false>(plain, order, message_size, &sink);
+    double plain_hot      = measure<true>(plain, order, message_size, &sink);
+    double encrypted_cold = measure<false>(encrypted, order, message_size, &sink);
+    double encrypted_hot  = measure<true>(encrypted, order, message_size, &sink);
+
+    std::printf("%10u %14.4f %14.4f %14.4f %14.4f\n", message_size, plain_cold, plain_hot, encrypted_cold, encrypted_hot);
+  }
+
+  std::printf("(ns per byte)\n");
+
+  return sink == 0 ? 0 : 0;
+}
@@ -0,0 +1,176 @@
+#include "config.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <map>
+#include <random>
+#include <vector>
+
+#include <netinet/in.h>
+
+#include "torrent/peer/peer_list_index.h"
+
+// Compares the address lookups done by PeerList with only the
+// multimap, and with the multimap and PeerListIndex as it is now. The
+// list itself needs a running manager, so the same container
+// operations are done with fake PeerInfo pointers. Build with
+// 'make -C test bench' and run without arguments.
+
+using torrent::PeerInfo;
+using torrent::PeerListIndex;
+using torrent::socket_address_key;
+
+using map_type = std::multimap<socket_address_key, PeerInfo*>;
+
+// Not static so the compiler cannot move the lookups past reading the
+// clock.
+uint64_t bench_sink = 0;
+
+namespace {
+
+struct bench_result {
+  double insert;
+  double lookup;
+  double cull;
+};
+
+double
+elapsed_ns(std::chrono::steady_clock::time_point start, size_t operations) {
+  std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now() - start;
+  return elapsed.count() / operations;
+}
+
+socket_address_key
+make_key(uint32_t address) {
+  sockaddr_in sa{};
+  sa.sin_family = AF_INET;
+  sa.sin_addr.s_addr = address;
+
+  return socket_address_key::from_sin_addr(sa);
+}
+
+PeerInfo*
+make_peer(uintptr_t i) {
+  return reinterpret_cast<PeerInfo*>(i * 16 + 16);
+}
+
+// Half of the lookups are for addresses not in the list, similar to
+// PEX and DHT reporting new peers.
+bench_result
+measure_map(const std::vector<socket_address_key>& keys, const std::vector<socket_address_key>& lookups) {
+  bench_result result;
+  map_type     map;
+
+  auto start = std::chrono::steady_clock::now();
+
+  for (size_t i = 0; i < keys.size(); i++) {
+    auto range = map.equal_range(keys[i]);
+
+    if (range.first == range.second)
+      map.insert(range.second, map_type::value_type(keys[i], make_peer(i)));
+  }
+
+  result.insert = elapsed_ns(start, keys.size());
+  start = std::chrono::steady_clock::now();
+
+  for (const auto& key : lookups) {
+    auto range = map.equal_range(key);
+
+    if (range.first != range.second)
+      bench_sink += reinterpret_cast<uintptr_t>(range.first->second);
+  }
+
+  result.lookup = elapsed_ns(start, lookups.size());
+  start = std::chrono::steady_clock::now();
+
+  size_t size = map.size();
+
+  for (auto itr = map.begin(); itr != map.end();) {
+    if (reinterpret_cast<uintptr_t>(itr->second) & 16)
+      itr = map.erase(itr);
+    else
+      itr++;
+  }
+
+  result.cull = elapsed_ns(start, size);
+  bench_sink += map.size();
+
+  return result;
+}
+
+bench_result
+measure_index(const std::vector<socket_address_key>& keys, const std::vector<socket_address_key>& lookups) {
+  bench_result  result;
+  map_type      map;
+  PeerListIndex index;
+
+  auto start = std::chrono::steady_clock::now();
+
+  for (size_t i = 0; i < keys.size(); i++) {
+    if (index.find(keys[i]) != NULL)
+      continue;
+
+    map.insert(map_type::value_type(keys[i], make_peer(i)));
+    index.insert(keys[i], make_peer(i));
+  }
+
+  result.insert = elapsed_ns(start, keys.size());
+  start = std::chrono::steady_clock::now();
+
+  for (const auto& key : lookups) {
+    auto entry = index.find(key);
+
+    if (entry != NULL)
+      bench_sink += reinterpret_cast<uintptr_t>(entry->first);
+  }
+
+  result.lookup = elapsed_ns(start, lookups.size());
+  start = std::chrono::steady_clock::now();
+
+  size_t size = map.size();
+
+  for (auto itr = map.begin(); itr != map.end();) {
+    if (reinterpret_cast<uintptr_t>(itr->second) & 16) {
+      index.erase(itr->first, itr->second, NULL);
+      itr = map.erase(itr);
+    } else {
+      itr++;
+    }
+  }
+
+  result.cull = elapsed_ns(start, size);
+  bench_sink += map.size() + index.size();
+
+  return result;
+}
+
+}
+
+int
+main() {
+  const uint32_t counts[] = { 1000, 10000, 50000, 200000 };
+
+  std::printf("%10s %8s %12s %12s %12s\n", "peers", "type", "insert ns", "lookup ns", "cull ns");
+
+  std::mt19937 rng(1);
+
+  for (auto count : counts) {
+    std::vector<socket_address_key> keys;
+    std::vector<socket_address_key> lookups;
+
+    for (uint32_t i = 0; i < count; i++)
+      keys.push_back(make_key(rng()));
+
+    for (uint32_t i = 0; i < count * 4; i++)
+      lookups.push_back(i % 2 ? keys[rng() % count] : make_key(rng()));
+
+    auto result_map   = measure_map(keys, lookups);
+    auto result_index = measure_index(keys, lookups);
+
+    std::printf("%10u %8s %12.1f %12.1f %12.1f\n", count, "map", result_map.insert, result_map.lookup, result_map.cull);
+    std::printf("%10u %8s %12.1f %12.1f %12.1f\n", count, "index", result_index.insert, result_index.lookup, result_index.cull);
+  }
+
+  return bench_sink == 0 ? 0 : 0;
+}
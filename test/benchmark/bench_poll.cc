@@ -0,0 +1,356 @@
+#include "config.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cinttypes>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <random>
+#include <vector>
+#include <fcntl.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "thread_main.h"
+#include "torrent/event.h"
+#include "torrent/exceptions.h"
+#include "torrent/poll.h"
+
+// Registers many socketpairs with the Poll backend of this build and
+// runs rounds similar to a busy client: a share of the peers receive
+// data, some have data queued and want write events, and some are
+// throttled and lose read interest for a round. Reports the cost of
+// open/insert, of the interest toggling and of remove/close per call,
+// and the events dispatched per second by do_poll.
+//
+// Each round also checks the backend: a read event without data, a
+// readable socket that was never reported, or in_read/in_write not
+// matching the interest set are counted and make the run fail.
+//
+// The backend is the one Poll::create was built with, the poll is
+// created through Poll::slot_create_poll as a client would. A pair
+// takes two descriptors, the counts are capped by RLIMIT_NOFILE.
+// With '-e' the events are opened edge triggered, where adding
+// interest reports the socket ready and read events without data are
+// expected.
+//
+// Build with 'make -C test bench' and run as:
+//
+//   LibTorrent_Bench_Poll [-n pairs] [-r rounds] [-a active %] [-e] [-u]
+//
+// The '-u' flag selects the io_uring backend where available.
+
+namespace {
+
+struct bench_options {
+  std::vector<unsigned int> counts;
+  unsigned int              rounds{50};
+  unsigned int              active{10};
+  bool                      edge_triggered{false};
+  bool                      io_uring{false};
+};
+
+struct bench_result {
+  unsigned int pairs;
+  double       open;
+  double       toggle;
+  double       close;
+  double       events_per_second;
+  uint64_t     spurious{};
+  uint64_t     missed{};
+  uint64_t     mismatched{};
+};
+
+class bench_event : public torrent::Event {
+public:
+  bench_event(torrent::Poll* poll, int fd) : m_poll(poll) { set_file_descriptor(fd); }
+  ~bench_event() override { ::close(m_fileDesc); }
+
+  // Drains the socket as the peer connections do, a read event that
+  // finds no data is spurious.
+  void event_read() override {
+    char buffer[256];
+    ssize_t total = 0;
+    ssize_t length;
+
+    while ((length = ::read(m_fileDesc, buffer, sizeof(buffer))) > 0)
+      total += length;
+
+    if (total == 0)
+      spurious++;
+
+    pending = false;
+    events++;
+  }
+
+  // The send buffer was flushed, drop the write interest.
+  void event_write() override {
+    m_poll->remove_write(this);
+    writing = false;
+    events++;
+  }
+
+  void event_error() override { errors++; }
+
+  bool     pending{false};
+  bool     reading{true};
+  bool     writing{false};
+
+  unsigned int events{};
+  unsigned int errors{};
+  unsigned int spurious{};
+
+private:
+  torrent::Poll* m_poll;
+};
+
+struct bench_pair {
+  std::unique_ptr<bench_event> local;
+  int                          remote;
+};
+
+double
+elapsed_ns(std::chrono::steady_clock::time_point start, uint64_t operations) {
+  std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now() - start;
+  return operations != 0 ? elapsed.count() / operations : 0.0;
+}
+
+bool
+parse_options(int argc, char** argv, bench_options* options) {
+  int opt;
+
+  while ((opt = getopt(argc, argv, "n:r:a:eu")) != -1) {
+    switch (opt) {
+    case 'n': options->counts.push_back(std::strtoul(optarg, nullptr, 10)); break;
+    case 'r': options->rounds = std::strtoul(optarg, nullptr, 10); break;
+    case 'a': options->active = std::strtoul(optarg, nullptr, 10); break;
+    case 'e': options->edge_triggered = true; break;
+    case 'u': options->io_uring = true; break;
+    default:
+      return false;
+    }
+  }
+
+  if (options->counts.empty())
+    options->counts = { 10000, 50000, 100000 };
+
+  return options->rounds != 0 && options->active != 0 && options->active <= 100 &&
+    std::find(options->counts.begin(), options->counts.end(), 0) == options->counts.end();
+}
+
+// Raises the soft descriptor limit to the hard one, returns the
+// number of pairs that fit.
+unsigned int
+raise_open_limit() {
+  struct rlimit limit;
+
+  if (getrlimit(RLIMIT_NOFILE, &limit) == -1)
+    throw torrent::internal_error("getrlimit failed");
+
+  limit.rlim_cur = limit.rlim_max;
+  setrlimit(RLIMIT_NOFILE, &limit);
+  getrlimit(RLIMIT_NOFILE, &limit);
+
+  return limit.rlim_cur > 64 ? (limit.rlim_cur - 64) / 2 : 0;
+}
+
+std::vector<bench_pair>
+create_pairs(torrent::Poll* poll, unsigned int count) {
+  std::vector<bench_pair> pairs(count);
+
+  for (auto& pair : pairs) {
+    int fds[2];
+
+    if (::socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == -1 ||
+        ::fcntl(fds[0], F_SETFL, O_NONBLOCK) == -1)
+      throw torrent::internal_error("could not create socketpair");
+
+    pair.local = std::make_unique<bench_event>(poll, fds[0]);
+    pair.remote = fds[1];
+  }
+
+  return pairs;
+}
+
+// Polls until every expected event arrived. The backends may wait up
+// to a millisecond when nothing is ready, so the loop gives up after
+// a number of empty polls and counts the rest as missed.
+uint64_t
+poll_until(torrent::Poll* poll, uint64_t expected, bench_result* result) {
+  uint64_t received = 0;
+  unsigned int empty = 0;
+
+  while (received < expected && empty < 100) {
+    unsigned int count = poll->do_poll(0);
+
+    received += count;
+    empty = count == 0 ? empty + 1 : 0;
+  }
+
+  if (received < expected)
+    result->missed += expected - received;
+
+  return received;
+}
+
+bench_result
+measure(torrent::Poll* poll, const bench_options& options, unsigned int count) {
+  bench_result result{};
+  result.pairs = count;
+
+  std::vector<bench_pair> pairs = create_pairs(poll, count);
+  std::mt19937 rng(count);
+
+  auto start = std::chrono::steady_clock::now();
+
+  for (auto& pair : pairs) {
+    if (options.edge_triggered)
+      poll->open_edge_triggered(pair.local.get());
+    else
+      poll->open(pair.local.get());
+
+    poll->insert_read(pair.local.get());
+    poll->insert_error(pair.local.get());
+  }
+
+  result.open = elapsed_ns(start, count * 3);
+
+  uint64_t toggles = 0;
+  uint64_t events = 0;
+  std::chrono::duration<double> toggle_time{};
+  std::chrono::duration<double> poll_time{};
+
+  unsigned int active = std::max<unsigned int>(count * options.active / 100, 1);
+
+  for (unsigned int round = 0; round < options.rounds; round++) {
+    // Peers that send data this round, not part of the timing.
+    for (unsigned int i = 0; i < active; i++) {
+      auto& pair = pairs[rng() % count];
+
+      if (!pair.local->pending && ::write(pair.remote, "x", 1) == 1)
+        pair.local->pending = true;
+    }
+
+    start = std::chrono::steady_clock::now();
+
+    // Half as many peers queue data to send, a fifth of that toggle
+    // read interest as the throttles would.
+    for (unsigned int i = 0; i < active / 2; i++) {
+      auto event = pairs[rng() % count].local.get();
+
+      if (!event->writing) {
+        poll->insert_write(event);
+        event->writing = true;
+        toggles++;
+      }
+    }
+
+    for (unsigned int i = 0; i < active / 10; i++) {
+      auto event = pairs[rng() % count].local.get();
+
+      if (event->reading)
+        poll->remove_read(event);
+      else
+        poll->insert_read(event);
+
+      event->reading = !event->reading;
+      toggles++;
+    }
+
+    toggle_time += std::chrono::steady_clock::now() - start;
+
+    uint64_t expected = 0;
+
+    for (auto& pair : pairs)
+      expected += (pair.local->pending && pair.local->reading) + pair.local->writing;
+
+    start = std::chrono::steady_clock::now();
+    events += poll_until(poll, expected, &result);
+    poll_time += std::chrono::steady_clock::now() - start;
+  }
+
+  // Nothing should be left to report.
+  poll->do_poll(0);
+
+  for (auto& pair : pairs) {
+    auto event = pair.local.get();
+
+    result.spurious += event->spurious + event->errors;
+    result.missed += (event->pending && event->reading) + event->writing;
+    result.mismatched += poll->in_read(event) != event->reading || poll->in_write(event) != event->writing;
+  }
+
+  result.toggle = toggles != 0 ? toggle_time.count() * 1e9 / toggles : 0.0;
+  result.events_per_second = poll_time.count() > 0 ? events / poll_time.count() : 0.0;
+
+  start = std::chrono::steady_clock::now();
+
+  for (auto& pair : pairs) {
+    poll->remove_read(pair.local.get());
+    poll->remove_write(pair.local.get());
+    poll->remove_error(pair.local.get());
+    poll->close(pair.local.get());
+  }
+
+  result.close = elapsed_ns(start, count * 4);
+
+  for (auto& pair : pairs)
+    ::close(pair.remote);
+
+  return result;
+}
+
+}
+
+int
+main(int argc, char** argv) {
+  bench_options options;
+
+  if (!parse_options(argc, argv, &options)) {
+    std::fprintf(stderr, "usage: %s [-n pairs] [-r rounds] [-a active %%] [-e] [-u]\n", argv[0]);
+    return 1;
+  }
+
+  unsigned int max_pairs = raise_open_limit();
+  int max_open = max_pairs * 2 + 64;
+
+  if (options.io_uring)
+    torrent::Poll::slot_create_poll() = [max_open] { return torrent::Poll::create_io_uring(max_open); };
+  else
+    torrent::Poll::slot_create_poll() = [max_open] { return torrent::Poll::create(max_open); };
+  torrent::ThreadMain::create_thread();
+  torrent::thread_main()->init_thread();
+
+  torrent::Poll* poll = torrent::thread_main()->poll();
+
+  if (poll == nullptr)
+    throw torrent::internal_error("could not create poll");
+
+  std::printf("backend %s%s, %u rounds, %u%% active\n", poll->backend_name(), options.edge_triggered ? " (edge triggered)" : "",
+              options.rounds, options.active);
+  std::printf("%8s %10s %10s %10s %12s %9s %7s %10s\n", "pairs", "open", "toggle", "close", "events/s", "spurious", "missed", "mismatched");
+
+  bool failed = false;
+
+  for (unsigned int count : options.counts) {
+    if (count > max_pairs) {
+      std::printf("%8u pairs exceed RLIMIT_NOFILE, using %u\n", count, max_pairs);
+      count = max_pairs;
+    }
+
+    auto result = measure(poll, options, count);
+
+    std::printf("%8u %8.1fns %8.1fns %8.1fns %12.0f %9" PRIu64 " %7" PRIu64 " %10" PRIu64 "\n",
+                result.pairs, result.open, result.toggle, result.close, result.events_per_second,
+                result.spurious, result.missed, result.mismatched);
+
+    // Edge triggered events are reported ready when interest is added,
+    // the read handler may then find nothing.
+    failed |= (result.spurious != 0 && !options.edge_triggered) || result.missed != 0 || result.mismatched != 0;
+  }
+
+  return failed ? 1 : 0;
+}
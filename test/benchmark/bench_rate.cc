@@ -0,0 +1,109 @@
+#include "config.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <deque>
+#include <vector>
+
+#include "globals.h"
+#include "torrent/rate.h"
+
+// Compares Rate with the deque based estimator it replaced, as used
+// for peer connections: bytes are inserted a few times per second and
+// the choke queue reads the rate of every peer when sorting. Build
+// with 'make -C test bench' and run without arguments.
+
+namespace {
+
+class deque_rate {
+public:
+  deque_rate(int32_t span) : m_span(span) {}
+
+  uint64_t
+  rate() const {
+    discard_old();
+    return m_current / m_span;
+  }
+
+  void
+  insert(uint64_t bytes) {
+    discard_old();
+
+    if (m_container.empty() || m_container.front().first != torrent::cachedTime.seconds())
+      m_container.emplace_front(torrent::cachedTime.seconds(), bytes);
+    else
+      m_container.front().second += bytes;
+
+    m_current += bytes;
+  }
+
+private:
+  void
+  discard_old() const {
+    while (!m_container.empty() && m_container.back().first < torrent::cachedTime.seconds() - m_span) {
+      m_current -= m_container.back().second;
+      m_container.pop_back();
+    }
+  }
+
+  mutable std::deque<std::pair<int32_t, uint64_t>> m_container;
+  mutable uint64_t m_current{0};
+  int32_t          m_span;
+};
+
+template <typename RateType>
+void
+measure(const char* name, unsigned int count, int32_t span) {
+  std::vector<RateType> rates;
+  rates.reserve(count);
+
+  for (unsigned int i = 0; i < count; i++)
+    rates.emplace_back(span);
+
+  const unsigned int seconds = 600;
+  uint64_t sink = 0;
+
+  std::srand(1);
+
+  std::chrono::duration<double, std::nano> insert_time{0};
+  std::chrono::duration<double, std::nano> read_time{0};
+
+  for (unsigned int second = 0; second < seconds; second++) {
+    torrent::cachedTime = rak::timer::from_seconds(1000000 + second);
+
+    auto start = std::chrono::steady_clock::now();
+
+    for (auto& rate : rates)
+      for (int i = std::rand() % 4; i != 0; i--)
+        rate.insert(16384);
+
+    insert_time += std::chrono::steady_clock::now() - start;
+    start = std::chrono::steady_clock::now();
+
+    // A choke cycle sorts by rate, reading each several times.
+    for (int i = 0; i < 16; i++)
+      for (const auto& rate : rates)
+        sink += rate.rate();
+
+    read_time += std::chrono::steady_clock::now() - start;
+  }
+
+  std::printf("%10s %8u %6d %12.1f %12.1f %s\n", name, count, span,
+              insert_time.count() / (seconds * count), read_time.count() / (seconds * count * 16),
+              sink == 0 ? "-" : "");
+}
+
+}
+
+int
+main() {
+  std::printf("%10s %8s %6s %12s %12s\n", "rate", "count", "span", "second ns", "read ns");
+
+  for (int32_t span : { 30, 600 }) {
+    measure<deque_rate>("deque", 10000, span);
+    measure<torrent::Rate>("ring", 10000, span);
+  }
+
+  return 0;
+}
@@ -0,0 +1,65 @@
+#include "config.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+#include "utils/rc4.h"
+
+// Compares how PeerConnectionBase::up_chunk_encrypt() used to fill the
+// encrypt buffer, copying the chunk data and then encrypting it in
+// place, with encrypting straight from the chunk into the buffer. The
+// chunk is larger than the cache, as in a seeding client. Build with
+// 'make -C test bench' and run without arguments.
+
+namespace {
+
+constexpr uint32_t chunk_size = 64 << 20;
+
+double
+measure(const std::vector<char>& chunk, uint32_t block_size, bool copy_first) {
+  const unsigned char key[20] = { 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15, 16, 17, 18, 19, 20 };
+
+  torrent::RC4      rc4(key, sizeof(key));
+  std::vector<char> buffer(block_size);
+
+  auto start = std::chrono::steady_clock::now();
+
+  for (uint32_t offset = 0; offset + block_size <= chunk.size(); offset += block_size) {
+    if (copy_first) {
+      std::memcpy(buffer.data(), chunk.data() + offset, block_size);
+      rc4.crypt(buffer.data(), block_size);
+    } else {
+      rc4.crypt(chunk.data() + offset, buffer.data(), block_size);
+    }
+  }
+
+  std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+  return double(chunk.size()) / elapsed.count() / (1 << 20);
+}
+
+}
+
+int
+main() {
+  const uint32_t block_sizes[] = { 4 << 10, 16 << 10, 128 << 10 };
+
+  std::vector<char> chunk(chunk_size);
+
+  for (auto& c : chunk)
+    c = char(std::rand());
+
+  std::printf("%10s %14s %14s\n", "block", "copy MiB/s", "direct MiB/s");
+
+  for (auto block_size : block_sizes) {
+    double result_copy = measure(chunk, block_size, true);
+    double result_direct = measure(chunk, block_size, false);
+
+    std::printf("%10u %14.1f %14.1f\n", block_size, result_copy, result_direct);
+  }
+
+  return 0;
+}
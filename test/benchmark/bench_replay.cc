@@ -0,0 +1,265 @@
+#include "config.h"
+
+#include <atomic>
+#include <chrono>
+#include <cinttypes>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "torrent/download.h"
+#include "torrent/exceptions.h"
+#include "torrent/object.h"
+#include "torrent/object_stream.h"
+#include "torrent/poll.h"
+#include "torrent/torrent.h"
+#include "torrent/connection_manager.h"
+#include "torrent/data/download_data.h"
+#include "torrent/data/file_list.h"
+#include "torrent/peer/peer_capture.h"
+#include "torrent/utils/thread.h"
+
+// Replays peer captures, recorded with Peer::start_capture, against a
+// leecher running the library through its public interface. Each
+// capture is sent by its own thread over a loopback connection to the
+// leecher, after a plaintext handshake and the bitfield and unchoke
+// state stored in the capture, so the same bytes reach the peer wire
+// code on every run.
+//
+// The records are sent with their recorded spacing divided by '-x',
+// or back to back with '-x 0'. The leecher requests whatever it likes,
+// pieces it did not request are skipped as with any peer, so the
+// completed chunks show how much of the capture was used.
+//
+// Reports the time from the first connection to the last one closing,
+// the replay rate and the CPU time of the process per MB replayed.
+// Build with 'make -C test bench' and run as:
+//
+//   LibTorrent_Bench_Replay -T torrent [-d dir] [-P port] [-x speed] capture...
+
+namespace {
+
+struct bench_options {
+  std::string              torrent;
+  std::string              dir;
+  uint16_t                 port{26981};
+  double                   speed{0};
+  std::vector<std::string> captures;
+};
+
+std::atomic<unsigned int> replays_left;
+std::atomic<uint64_t>     replayed_bytes{0};
+
+int64_t
+monotonic_us() {
+  return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+bool
+parse_options(int argc, char** argv, bench_options* options) {
+  struct stat st;
+  options->dir = (::stat("/dev/shm", &st) == 0 ? "/dev/shm" : "/tmp") + std::string("/libtorrent-bench-replay");
+
+  int opt;
+
+  while ((opt = getopt(argc, argv, "T:d:P:x:")) != -1) {
+    switch (opt) {
+    case 'T': options->torrent = optarg; break;
+    case 'd': options->dir = optarg; break;
+    case 'P': options->port = std::strtoul(optarg, nullptr, 10); break;
+    case 'x': options->speed = std::strtod(optarg, nullptr); break;
+    default:
+      return false;
+    }
+  }
+
+  for (int i = optind; i < argc; i++)
+    options->captures.push_back(argv[i]);
+
+  return !options->torrent.empty() && !options->captures.empty() && options->speed >= 0;
+}
+
+void
+write_all(int fd, const char* data, size_t length) {
+  while (length != 0) {
+    ssize_t r = ::send(fd, data, length, MSG_NOSIGNAL);
+
+    if (r <= 0)
+      throw torrent::internal_error("replay connection closed by the leecher");
+
+    data += r;
+    length -= r;
+  }
+}
+
+std::string
+message_header(uint32_t length, char id) {
+  uint32_t be_length = htonl(length + 1);
+
+  return std::string(reinterpret_cast<const char*>(&be_length), 4) + id;
+}
+
+// The leecher refuses a second connection with the same peer id, so
+// captures after the first get theirs changed in the last byte.
+void
+replay(const bench_options& options, unsigned int index) {
+  torrent::PeerCaptureReader reader;
+  reader.open(options.captures[index]);
+
+  const auto& header = reader.header();
+
+  std::string handshake("\x13" "BitTorrent protocol", 20);
+  std::string reserved(8, '\0');
+
+  if (header.flags & torrent::PeerCapture::flag_extensions)
+    reserved[5] |= 0x10;
+
+  if (header.flags & torrent::PeerCapture::flag_fast)
+    reserved[7] |= 0x04;
+
+  handshake += reserved;
+  handshake.append(header.info_hash, sizeof(header.info_hash));
+  handshake.append(header.peer_id, sizeof(header.peer_id));
+  handshake.back() ^= index;
+
+  handshake += message_header(reader.bitfield().size(), 5) + reader.bitfield();
+
+  if (header.flags & torrent::PeerCapture::flag_unchoked)
+    handshake += message_header(0, 1);
+
+  int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+
+  sockaddr_in sa{};
+  sa.sin_family = AF_INET;
+  sa.sin_port = htons(options.port);
+  sa.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+  if (fd == -1 || ::connect(fd, reinterpret_cast<sockaddr*>(&sa), sizeof(sa)) != 0)
+    throw torrent::internal_error("could not connect to the leecher");
+
+  // Everything the leecher sends is discarded, the connection closing
+  // once it has read the whole capture.
+  std::thread drain([fd] {
+      char buffer[65536];
+
+      while (::recv(fd, buffer, sizeof(buffer), 0) > 0)
+        ;
+    });
+
+  write_all(fd, handshake.data(), handshake.size());
+
+  int64_t     start_us = monotonic_us();
+  uint64_t    time;
+  std::string data;
+
+  while (reader.read(&time, &data)) {
+    if (options.speed != 0) {
+      int64_t wait_us = start_us + int64_t(time / options.speed) - monotonic_us();
+
+      if (wait_us > 0)
+        std::this_thread::sleep_for(std::chrono::microseconds(wait_us));
+    }
+
+    write_all(fd, data.data(), data.size());
+    replayed_bytes += data.size();
+  }
+
+  ::shutdown(fd, SHUT_WR);
+  drain.join();
+  ::close(fd);
+}
+
+}
+
+int
+main(int argc, char** argv) {
+  bench_options options;
+
+  if (!parse_options(argc, argv, &options)) {
+    std::fprintf(stderr, "usage: %s -T torrent [-d dir] [-P port] [-x speed] capture...\n", argv[0]);
+    return 1;
+  }
+
+  std::ifstream input(options.torrent);
+  auto*         torrent_object = new torrent::Object;
+
+  torrent::object_read_bencode(&input, torrent_object);
+
+  if (input.fail()) {
+    std::fprintf(stderr, "could not read torrent '%s'\n", options.torrent.c_str());
+    return 1;
+  }
+
+  torrent::Poll::slot_create_poll() = [] { return torrent::Poll::create(1024); };
+  torrent::initialize_main_thread();
+  torrent::initialize();
+
+  if (!torrent::connection_manager()->listen_open(options.port, options.port)) {
+    std::fprintf(stderr, "could not listen on port %u\n", options.port);
+    return 1;
+  }
+
+  ::mkdir(options.dir.c_str(), 0755);
+
+  torrent::Download download = torrent::download_add(torrent_object, 0);
+  download.file_list()->set_root_dir(options.dir);
+  download.set_uploads_max(options.captures.size());
+
+  int64_t                  start_us = 0;
+  std::vector<std::thread> threads;
+
+  replays_left = options.captures.size();
+
+  auto finish = [&] {
+      int64_t elapsed_us = monotonic_us() - start_us;
+
+      rusage usage;
+      ::getrusage(RUSAGE_SELF, &usage);
+
+      double megabytes = replayed_bytes / 1e6;
+      double seconds = elapsed_us / 1e6;
+      double cpu_seconds = usage.ru_utime.tv_sec + usage.ru_stime.tv_sec + (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1e6;
+
+      std::printf("captures: %zu  replayed: %.1f MB  speed: %s\n", options.captures.size(), megabytes,
+                  options.speed != 0 ? std::to_string(options.speed).c_str() : "unlimited");
+      std::printf("%.3f s  %.1f MB/s  %.3f cpu ms/MB\n", seconds, megabytes / seconds, cpu_seconds * 1000 / megabytes);
+      std::printf("completed: %" PRIu64 " bytes  %" PRIu32 " of %" PRIu32 " chunks\n",
+                  download.bytes_done(), download.file_list()->completed_chunks(), download.file_list()->size_chunks());
+
+      std::fflush(stdout);
+      _exit(0);
+    };
+
+  download.data()->slot_initial_hash() = [&] {
+      download.start(torrent::Download::start_skip_tracker);
+      start_us = monotonic_us();
+
+      for (unsigned int i = 0; i < options.captures.size(); i++)
+        threads.emplace_back([&, i] {
+            try {
+              replay(options, i);
+            } catch (torrent::base_error& e) {
+              std::fprintf(stderr, "capture '%s': %s\n", options.captures[i].c_str(), e.what());
+            }
+
+            if (--replays_left == 0)
+              torrent::main_thread()->callback(nullptr, finish);
+          });
+    };
+
+  download.open();
+  download.hash_check(false);
+
+  torrent::main_thread()->event_loop();
+  return 0;
+}
@@ -0,0 +1,170 @@
+#include "config.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <memory>
+#include <random>
+#include <vector>
+
+#include "utils/intrusive_buckets.h"
+#include "utils/queue_buckets.h"
+
+// Replays the request queue operations of RequestList for a deep
+// pipeline, comparing the deque based queue_buckets searched linearly
+// by piece with the indexed intrusive_buckets. Pieces arrive in order,
+// in a shuffled order where most requests pass through the unordered
+// queue, and after a choke moved the pipeline to the choked queue.
+// RequestList needs a download and thread to run, so the queues are
+// driven directly with the same bucket layout. Build with
+// 'make -C test bench' and run without arguments.
+
+namespace {
+
+enum { bucket_queued, bucket_unordered, bucket_stalled, bucket_choked };
+
+struct request_type {
+  struct hook_type {
+    request_type* prev{};
+    request_type* next{};
+    int           bucket{-1};
+  };
+
+  uint32_t  index;
+  uint32_t  offset;
+  hook_type hook;
+};
+
+struct request_constants {
+  static constexpr int bucket_count = 4;
+
+  static constexpr torrent::instrumentation_enum instrumentation_added[bucket_count] = {
+    torrent::INSTRUMENTATION_TRANSFER_REQUESTS_QUEUED_ADDED,
+    torrent::INSTRUMENTATION_TRANSFER_REQUESTS_UNORDERED_ADDED,
+    torrent::INSTRUMENTATION_TRANSFER_REQUESTS_STALLED_ADDED,
+    torrent::INSTRUMENTATION_TRANSFER_REQUESTS_CHOKED_ADDED
+  };
+  static constexpr torrent::instrumentation_enum instrumentation_moved[bucket_count] = {
+    torrent::INSTRUMENTATION_TRANSFER_REQUESTS_QUEUED_MOVED,
+    torrent::INSTRUMENTATION_TRANSFER_REQUESTS_UNORDERED_MOVED,
+    torrent::INSTRUMENTATION_TRANSFER_REQUESTS_STALLED_MOVED,
+    torrent::INSTRUMENTATION_TRANSFER_REQUESTS_CHOKED_MOVED
+  };
+  static constexpr torrent::instrumentation_enum instrumentation_removed[bucket_count] = {
+    torrent::INSTRUMENTATION_TRANSFER_REQUESTS_QUEUED_REMOVED,
+    torrent::INSTRUMENTATION_TRANSFER_REQUESTS_UNORDERED_REMOVED,
+    torrent::INSTRUMENTATION_TRANSFER_REQUESTS_STALLED_REMOVED,
+    torrent::INSTRUMENTATION_TRANSFER_REQUESTS_CHOKED_REMOVED
+  };
+  static constexpr torrent::instrumentation_enum instrumentation_total[bucket_count] = {
+    torrent::INSTRUMENTATION_TRANSFER_REQUESTS_QUEUED_TOTAL,
+    torrent::INSTRUMENTATION_TRANSFER_REQUESTS_UNORDERED_TOTAL,
+    torrent::INSTRUMENTATION_TRANSFER_REQUESTS_STALLED_TOTAL,
+    torrent::INSTRUMENTATION_TRANSFER_REQUESTS_CHOKED_TOTAL
+  };
+
+  template <typename Type>
+  static void destroy([[maybe_unused]] Type& obj) {}
+
+  using hook_type = request_type::hook_type;
+
+  static hook_type& hook(request_type* obj)      { return obj->hook; }
+  static uint64_t   key(const request_type* obj) { return key(obj->index, obj->offset); }
+  static uint64_t   key(uint32_t index, uint32_t offset) { return (uint64_t(index) << 32) | offset; }
+};
+
+using deque_queues     = torrent::queue_buckets<request_type*, request_constants>;
+using intrusive_queues = torrent::intrusive_buckets<request_type, request_constants>;
+
+// As RequestList::downloading(...) before the queues were indexed.
+request_type*
+take_deque(deque_queues& queues, const request_type& piece) {
+  auto itr = torrent::queue_bucket_find_if_in_any(queues, [&piece](request_type* r) {
+      return r->index == piece.index && r->offset == piece.offset;
+    });
+
+  if (itr.first == bucket_queued && itr.second != queues.begin(bucket_queued)) {
+    queues.move_to(bucket_queued, queues.begin(bucket_queued), itr.second, bucket_unordered);
+    itr.second = queues.begin(bucket_queued);
+  }
+
+  return queues.take(itr.first, itr.second);
+}
+
+request_type*
+take_intrusive(intrusive_queues& queues, const request_type& piece) {
+  request_type* request = queues.find(request_constants::key(piece.index, piece.offset));
+
+  if (queues.bucket(request) == bucket_queued) {
+    while (queues.front(bucket_queued) != request)
+      queues.move_to(queues.front(bucket_queued), bucket_unordered);
+  }
+
+  return queues.take(request);
+}
+
+template <typename Queues, typename Take>
+double
+measure(std::vector<request_type>& requests, const std::vector<uint32_t>& order, bool choke, unsigned int rounds, Take take) {
+  Queues queues;
+  size_t taken = 0;
+
+  auto start = std::chrono::steady_clock::now();
+
+  for (unsigned int round = 0; round < rounds; round++) {
+    for (auto& request : requests)
+      queues.push_back(bucket_queued, &request);
+
+    if (choke)
+      queues.move_all_to(bucket_queued, bucket_choked);
+
+    for (auto index : order)
+      taken += take(queues, requests[index]) == &requests[index];
+  }
+
+  std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now() - start;
+
+  if (taken != size_t(rounds) * order.size())
+    std::printf("mismatch\n");
+
+  return elapsed.count() / (double(rounds) * order.size());
+}
+
+void
+measure_pipeline(uint32_t depth, const char* name, bool shuffle, bool choke) {
+  const unsigned int rounds = std::max<unsigned int>(1, (1 << 20) / (depth * depth / 16 + depth));
+
+  std::vector<request_type> requests(depth);
+  std::vector<uint32_t>     order(depth);
+
+  for (uint32_t i = 0; i < depth; i++) {
+    requests[i].index  = i / 16;
+    requests[i].offset = (i % 16) << 14;
+    order[i] = i;
+  }
+
+  if (shuffle) {
+    std::mt19937 rng(1);
+    std::shuffle(order.begin(), order.end(), rng);
+  }
+
+  double deque_time = measure<deque_queues>(requests, order, choke, rounds, take_deque);
+  double intrusive_time = measure<intrusive_queues>(requests, order, choke, rounds, take_intrusive);
+
+  std::printf("%8u %12s %12.1f %12.1f\n", depth, name, deque_time, intrusive_time);
+}
+
+}
+
+int
+main() {
+  std::printf("%8s %12s %12s %12s\n", "depth", "pattern", "deque ns", "intrusive ns");
+
+  for (uint32_t depth : { 16, 128, 512, 2048 }) {
+    measure_pipeline(depth, "in order", false, false);
+    measure_pipeline(depth, "shuffled", true, false);
+    measure_pipeline(depth, "choked", true, true);
+  }
+
+  return 0;
+}
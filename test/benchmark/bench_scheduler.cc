@@ -0,0 +1,104 @@
+#include "config.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+#include "torrent/utils/scheduler.h"
+
+// Compares the heap and timer wheel schedulers with timers similar to
+// those of many peer connections. Build with 'make -C test bench' and
+// run without arguments.
+
+using torrent::utils::ExternalScheduler;
+using torrent::utils::Scheduler;
+using torrent::utils::SchedulerEntry;
+
+namespace {
+
+const auto bench_epoch = std::chrono::microseconds(std::chrono::hours(365 * 24 * 50));
+
+struct bench_result {
+  double insert;
+  double update;
+  double erase;
+  double expire;
+};
+
+double
+elapsed_ns(std::chrono::steady_clock::time_point start, unsigned int operations) {
+  std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now() - start;
+  return elapsed.count() / operations;
+}
+
+bench_result
+measure(Scheduler::mode_type mode, unsigned int count) {
+  ExternalScheduler scheduler;
+  scheduler.set_mode(mode);
+  scheduler.external_set_cached_time(bench_epoch);
+
+  std::vector<SchedulerEntry> entries(count);
+  unsigned int fired = 0;
+
+  for (auto& entry : entries)
+    entry.slot() = [&fired]() { fired++; };
+
+  bench_result result;
+  std::srand(1);
+
+  auto start = std::chrono::steady_clock::now();
+
+  for (auto& entry : entries)
+    scheduler.wait_for(&entry, std::chrono::milliseconds(1000 + std::rand() % 120000));
+
+  result.insert = elapsed_ns(start, count);
+  start = std::chrono::steady_clock::now();
+
+  // Keepalive and timeout timers are pushed back on every message.
+  for (unsigned int round = 0; round < 10; round++)
+    for (auto& entry : entries)
+      scheduler.update_wait_for(&entry, std::chrono::milliseconds(1000 + std::rand() % 120000));
+
+  result.update = elapsed_ns(start, count * 10);
+  start = std::chrono::steady_clock::now();
+
+  for (auto& entry : entries)
+    scheduler.erase(&entry);
+
+  result.erase = elapsed_ns(start, count);
+
+  for (auto& entry : entries)
+    scheduler.wait_for(&entry, std::chrono::milliseconds(1000 + std::rand() % 120000));
+
+  start = std::chrono::steady_clock::now();
+
+  // Run the event loop at 10 ms intervals until all timers expired.
+  for (auto t = bench_epoch; !scheduler.empty(); t += std::chrono::milliseconds(10)) {
+    scheduler.external_set_cached_time(t);
+    scheduler.external_perform(t);
+  }
+
+  result.expire = elapsed_ns(start, fired);
+  return result;
+}
+
+}
+
+int
+main(int argc, char** argv) {
+  const unsigned int counts[] = { 1000, 10000, 50000 };
+
+  std::printf("%8s %6s %10s %10s %10s %10s\n", "timers", "mode", "insert", "update", "erase", "expire");
+
+  for (auto count : counts) {
+    for (auto mode : { Scheduler::MODE_HEAP, Scheduler::MODE_WHEEL }) {
+      auto result = measure(mode, count);
+
+      std::printf("%8u %6s %8.1fns %8.1fns %8.1fns %8.1fns\n", count, mode == Scheduler::MODE_HEAP ? "heap" : "wheel",
+                  result.insert, result.update, result.erase, result.expire);
+    }
+  }
+
+  return 0;
+}
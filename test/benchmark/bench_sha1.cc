@@ -0,0 +1,63 @@
+#include "config.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+#include "utils/sha1_multi.h"
+
+// Compares the EVP and multi-buffer SHA1 engines on typical piece
+// sizes. Build with 'make -C test bench' and run without arguments.
+
+namespace {
+
+double
+measure(torrent::sha1_multi_engine engine, const char* const* buffers, uint32_t length, unsigned int rounds) {
+  char results[torrent::sha1_multi_max_lanes * 20];
+  unsigned int lanes = torrent::sha1_multi_max_lanes;
+
+  auto start = std::chrono::steady_clock::now();
+
+  for (unsigned int i = 0; i < rounds; i++)
+    torrent::sha1_multi(buffers, lanes, length, results, engine);
+
+  std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+  return double(length) * lanes * rounds / elapsed.count() / (1 << 20);
+}
+
+}
+
+int
+main(int argc, char** argv) {
+  const uint32_t sizes[] = { 256 << 10, 4 << 20, 16 << 20 };
+
+  std::printf("default engine: %s\n", torrent::sha1_multi_engine_name(torrent::sha1_multi_default_engine()));
+
+  for (auto size : sizes) {
+    std::vector<std::vector<char>> data(torrent::sha1_multi_max_lanes, std::vector<char>(size));
+    const char* buffers[torrent::sha1_multi_max_lanes];
+
+    for (unsigned int i = 0; i < torrent::sha1_multi_max_lanes; i++) {
+      for (uint32_t j = 0; j < size; j++)
+        data[i][j] = char(std::rand());
+
+      buffers[i] = data[i].data();
+    }
+
+    // Hash roughly 512 MiB per engine.
+    unsigned int rounds = std::max<uint32_t>(1, (512u << 20) / (size * torrent::sha1_multi_max_lanes));
+
+    std::printf("%8u KiB  evp: %8.1f MiB/s", size >> 10, measure(torrent::SHA1_MULTI_ENGINE_EVP, buffers, size, rounds));
+
+#if defined(__x86_64__) || defined(__i386__)
+    if (__builtin_cpu_supports("avx2"))
+      std::printf("  avx2: %8.1f MiB/s", measure(torrent::SHA1_MULTI_ENGINE_AVX2, buffers, size, rounds));
+#endif
+
+    std::printf("\n");
+  }
+
+  return 0;
+}
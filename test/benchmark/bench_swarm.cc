@@ -0,0 +1,482 @@
+#include "config.h"
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cinttypes>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <random>
+#include <string>
+#include <vector>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "torrent/download.h"
+#include "torrent/exceptions.h"
+#include "torrent/hash_string.h"
+#include "torrent/object.h"
+#include "torrent/poll.h"
+#include "torrent/throttle.h"
+#include "torrent/torrent.h"
+#include "torrent/connection_manager.h"
+#include "torrent/data/download_data.h"
+#include "torrent/data/file_list.h"
+#include "torrent/utils/latency_histogram.h"
+#include "torrent/utils/thread.h"
+
+#include <openssl/evp.h>
+
+// Transfers a throwaway torrent between seeders and leechers on the
+// loopback interface, each peer a forked process running the library
+// through its public interface as a client would. All the peer wire
+// code is exercised, from the handshake manager and peer connections
+// to the throttles, and '-r' limits the download rate of each leecher
+// to include the throttle list, with '-H' ticking the throttles at
+// high resolution.
+//
+// Reports the aggregate download rate from the first leecher starting
+// to the last finishing, CPU time and read/write syscalls of all peers
+// per MB downloaded, and request latency percentiles, the bucket
+// limits of the merged request latency histograms of the leechers,
+// and the average and max lateness of the timers, such as the
+// throttle ticks, on the main threads of the leechers.
+// '-j' prints a single JSON object instead.
+//
+// The test fixtures depend on CppUnit and replace the main thread, so
+// the peers use the library's own threads instead. Build with
+// 'make -C test bench' and run as:
+//
+//   LibTorrent_Bench_Swarm [-d dir] [-s MiB] [-p piece KiB] [-S seeders] [-L leechers]
+//                          [-P port] [-r KiB/s] [-H] [-t timeout] [-j]
+
+namespace {
+
+using histogram_counts = std::array<uint64_t, torrent::utils::latency_histogram::bucket_count>;
+
+struct bench_options {
+  std::string  dir;
+  uint64_t     size{256 << 20};
+  uint32_t     piece_length{1 << 20};
+  unsigned int seeders{1};
+  unsigned int leechers{2};
+  uint16_t     port{26881};
+  uint64_t     rate{0};
+  bool         high_resolution{false};
+  unsigned int timeout{120};
+  bool         json{false};
+};
+
+struct peer_result {
+  pid_t            pid{};
+  bool             done{false};
+  int64_t          start_us{};
+  int64_t          end_us{};
+  histogram_counts latency{};
+  uint64_t         timer_count{};
+  int64_t          timer_total_us{};
+  int64_t          timer_max_us{};
+};
+
+int result_fd = -1;
+
+int64_t
+monotonic_us() {
+  return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+bool
+parse_options(int argc, char** argv, bench_options* options) {
+  struct stat st;
+  options->dir = ::stat("/dev/shm", &st) == 0 ? "/dev/shm" : "/tmp";
+
+  int opt;
+
+  while ((opt = getopt(argc, argv, "d:s:p:S:L:P:r:Ht:j")) != -1) {
+    switch (opt) {
+    case 'd': options->dir = optarg; break;
+    case 's': options->size = std::strtoull(optarg, nullptr, 10) << 20; break;
+    case 'p': options->piece_length = std::strtoul(optarg, nullptr, 10) << 10; break;
+    case 'S': options->seeders = std::strtoul(optarg, nullptr, 10); break;
+    case 'L': options->leechers = std::strtoul(optarg, nullptr, 10); break;
+    case 'P': options->port = std::strtoul(optarg, nullptr, 10); break;
+    case 'r': options->rate = std::strtoull(optarg, nullptr, 10) << 10; break;
+    case 'H': options->high_resolution = true; break;
+    case 't': options->timeout = std::strtoul(optarg, nullptr, 10); break;
+    case 'j': options->json = true; break;
+    default:
+      return false;
+    }
+  }
+
+  return options->size != 0 && options->piece_length != 0 && options->seeders != 0 && options->leechers != 0;
+}
+
+std::string
+peer_dir(const bench_options& options, unsigned int index) {
+  return options.dir + "/libtorrent-bench-swarm-" + std::to_string(index);
+}
+
+// The seeders share the data of the first directory.
+std::string
+data_dir(const bench_options& options, unsigned int index) {
+  return peer_dir(options, index < options.seeders ? 0 : index);
+}
+
+// Writes the data of the seeders and returns the torrent.
+torrent::Object
+create_torrent(const bench_options& options) {
+  std::string       pieces;
+  std::vector<char> piece(options.piece_length);
+  std::mt19937_64   rng(1);
+
+  ::mkdir(peer_dir(options, 0).c_str(), 0755);
+  int fd = ::open((peer_dir(options, 0) + "/data").c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+
+  if (fd == -1)
+    throw torrent::internal_error("could not create '" + peer_dir(options, 0) + "/data'");
+
+  for (uint64_t offset = 0; offset < options.size; offset += options.piece_length) {
+    uint32_t length = std::min<uint64_t>(options.piece_length, options.size - offset);
+
+    for (uint32_t i = 0; i + sizeof(uint64_t) <= length; i += sizeof(uint64_t)) {
+      uint64_t value = rng();
+      std::memcpy(&piece[i], &value, sizeof(uint64_t));
+    }
+
+    char hash[torrent::HashString::size_data];
+    EVP_Digest(piece.data(), length, reinterpret_cast<unsigned char*>(hash), nullptr, EVP_sha1(), nullptr);
+    pieces.append(hash, sizeof(hash));
+
+    if (::write(fd, piece.data(), length) != length)
+      throw torrent::internal_error("could not write '" + peer_dir(options, 0) + "/data'");
+  }
+
+  ::close(fd);
+
+  torrent::Object torrent = torrent::Object::create_map();
+  torrent::Object info = torrent::Object::create_map();
+
+  info.insert_key("length", int64_t(options.size));
+  info.insert_key("name", "data");
+  info.insert_key("piece length", int64_t(options.piece_length));
+  info.insert_key("pieces", pieces);
+
+  // Nothing listens on the tracker, the peers are added directly.
+  torrent.insert_key("announce", "udp://127.0.0.1:1/announce");
+  torrent.insert_key("info", info);
+
+  return torrent;
+}
+
+// The read and write class syscalls of a process, which include the
+// readv, writev and sendfile calls of the peer connections.
+uint64_t
+read_syscalls(pid_t pid) {
+  std::ifstream io("/proc/" + std::to_string(pid) + "/io");
+  std::string   key;
+  uint64_t      value;
+  uint64_t      syscalls = 0;
+
+  while (io >> key >> value)
+    if (key == "syscr:" || key == "syscw:")
+      syscalls += value;
+
+  return syscalls;
+}
+
+void
+write_result(const std::string& line) {
+  if (::write(result_fd, line.c_str(), line.size()) != ssize_t(line.size()))
+    _exit(1);
+}
+
+[[noreturn]] void
+run_peer(const bench_options& options, const torrent::Object& torrent_object, unsigned int index) {
+  bool    is_seeder = index < options.seeders;
+  int64_t start_us = 0;
+
+  torrent::Poll::slot_create_poll() = [] { return torrent::Poll::create(1024); };
+  torrent::initialize_main_thread();
+  torrent::initialize();
+
+  if (!torrent::connection_manager()->listen_open(options.port + index, options.port + index))
+    throw torrent::internal_error("could not listen on port " + std::to_string(options.port + index));
+
+  if (!is_seeder && options.rate != 0)
+    torrent::down_throttle_global()->set_max_rate(options.rate);
+
+  torrent::down_throttle_global()->set_high_resolution(options.high_resolution);
+  torrent::up_throttle_global()->set_high_resolution(options.high_resolution);
+  torrent::main_thread()->set_stats_enabled(!is_seeder);
+
+  ::mkdir(data_dir(options, index).c_str(), 0755);
+
+  torrent::Download download = torrent::download_add(new torrent::Object(torrent_object), 0);
+  download.file_list()->set_root_dir(data_dir(options, index));
+  download.set_uploads_max(options.seeders + options.leechers);
+
+  download.data()->slot_initial_hash() = [&] {
+      download.start(torrent::Download::start_skip_tracker);
+      start_us = monotonic_us();
+
+      // Leechers connect to the seeders and the leechers started
+      // before them, the others connect back.
+      sockaddr_in sa{};
+      sa.sin_family = AF_INET;
+      sa.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+      for (unsigned int i = 0; i < index && !is_seeder; i++)
+        download.add_peer(reinterpret_cast<sockaddr*>(&sa), options.port + i);
+
+      if (is_seeder)
+        write_result("ready " + std::to_string(index) + "\n");
+    };
+
+  download.data()->slot_download_done() = [&] {
+      if (is_seeder)
+        return;
+
+      std::string line = "done " + std::to_string(index) + " " + std::to_string(start_us) + " " + std::to_string(monotonic_us());
+
+      for (unsigned int i = 0; i < torrent::utils::latency_histogram::bucket_count; i++)
+        line += " " + std::to_string(download.request_latency().count(i));
+
+      auto lateness = torrent::main_thread()->stats().timer_lateness;
+
+      line += " " + std::to_string(lateness.total_count()) + " " + std::to_string(lateness.total().count()) + " " + std::to_string(lateness.max().count());
+
+      write_result(line + "\n");
+    };
+
+  download.open();
+  download.hash_check(false);
+
+  torrent::main_thread()->event_loop();
+  _exit(0);
+}
+
+double
+percentile(const histogram_counts& counts, double fraction) {
+  uint64_t total = 0;
+
+  for (auto count : counts)
+    total += count;
+
+  uint64_t target = std::max<uint64_t>(1, total * fraction);
+
+  for (unsigned int i = 0; i < counts.size(); i++) {
+    if (counts[i] >= target || i + 1 == counts.size())
+      return torrent::utils::latency_histogram::bucket_limit(i).count();
+
+    target -= counts[i];
+  }
+
+  return 0;
+}
+
+pid_t
+fork_peer(const bench_options& options, const torrent::Object& torrent, unsigned int index) {
+  pid_t pid = fork();
+
+  if (pid == 0) {
+    try {
+      run_peer(options, torrent, index);
+    } catch (torrent::base_error& e) {
+      std::fprintf(stderr, "peer %u: %s\n", index, e.what());
+      _exit(1);
+    }
+  }
+
+  if (pid == -1)
+    throw torrent::internal_error("could not fork");
+
+  return pid;
+}
+
+// Reads result lines until 'count' lines of 'type' have arrived,
+// returns false on timeout.
+bool
+read_results(int fd, const char* type, unsigned int count, std::vector<peer_result>* results, int64_t deadline_us) {
+  static std::string buffer;
+
+  while (count != 0) {
+    auto newline = buffer.find('\n');
+
+    if (newline == std::string::npos) {
+      if (monotonic_us() > deadline_us)
+        return false;
+
+      char data[4096];
+      ssize_t r = ::read(fd, data, sizeof(data));
+
+      if (r > 0)
+        buffer.append(data, r);
+      else
+        usleep(1000);
+
+      continue;
+    }
+
+    std::string line = buffer.substr(0, newline);
+    buffer.erase(0, newline + 1);
+
+    char     line_type[16];
+    unsigned index;
+    int      offset = 0;
+
+    if (std::sscanf(line.c_str(), "%15s %u%n", line_type, &index, &offset) != 2 || index >= results->size())
+      continue;
+
+    if (std::strcmp(line_type, type) == 0)
+      count--;
+
+    if (std::strcmp(line_type, "done") == 0) {
+      auto& result = (*results)[index];
+      const char* position = line.c_str() + offset;
+      int consumed;
+
+      result.done = true;
+      std::sscanf(position, "%" SCNd64 " %" SCNd64 "%n", &result.start_us, &result.end_us, &consumed);
+      position += consumed;
+
+      for (auto& bucket : result.latency) {
+        std::sscanf(position, "%" SCNu64 "%n", &bucket, &consumed);
+        position += consumed;
+      }
+
+      std::sscanf(position, "%" SCNu64 " %" SCNd64 " %" SCNd64, &result.timer_count, &result.timer_total_us, &result.timer_max_us);
+    }
+  }
+
+  return true;
+}
+
+}
+
+int
+main(int argc, char** argv) {
+  bench_options options;
+
+  if (!parse_options(argc, argv, &options)) {
+    std::fprintf(stderr, "usage: %s [-d dir] [-s MiB] [-p piece KiB] [-S seeders] [-L leechers] [-P port] [-r KiB/s] [-H] [-t timeout] [-j]\n", argv[0]);
+    return 1;
+  }
+
+  unsigned int peer_count = options.seeders + options.leechers;
+
+  torrent::Object torrent = create_torrent(options);
+
+  int fds[2];
+
+  if (::pipe(fds) != 0)
+    return 1;
+
+  fcntl(fds[0], F_SETFL, O_NONBLOCK);
+  result_fd = fds[1];
+
+  std::vector<peer_result> results(peer_count);
+  int64_t deadline_us = monotonic_us() + int64_t(options.timeout) * 1000000;
+  bool    finished = true;
+
+  for (unsigned int i = 0; i < options.seeders; i++)
+    results[i].pid = fork_peer(options, torrent, i);
+
+  if (!read_results(fds[0], "ready", options.seeders, &results, deadline_us)) {
+    std::fprintf(stderr, "seeders did not finish the hash check in time\n");
+    finished = false;
+  }
+
+  for (unsigned int i = options.seeders; i < peer_count && finished; i++)
+    results[i].pid = fork_peer(options, torrent, i);
+
+  if (finished && !read_results(fds[0], "done", options.leechers, &results, deadline_us)) {
+    std::fprintf(stderr, "leechers did not finish in time\n");
+    finished = false;
+  }
+
+  uint64_t syscalls = 0;
+  double   cpu_seconds = 0;
+
+  for (auto& result : results) {
+    if (result.pid == 0)
+      continue;
+
+    syscalls += read_syscalls(result.pid);
+    ::kill(result.pid, SIGKILL);
+
+    int    status;
+    rusage usage;
+    ::wait4(result.pid, &status, 0, &usage);
+
+    cpu_seconds += usage.ru_utime.tv_sec + usage.ru_stime.tv_sec + (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1e6;
+  }
+
+  for (unsigned int i = 0; i < peer_count; i++) {
+    if (i < options.seeders)
+      ::unlink((peer_dir(options, i) + "/data").c_str());
+    else
+      ::unlink((data_dir(options, i) + "/data").c_str());
+
+    ::rmdir(peer_dir(options, i).c_str());
+  }
+
+  if (!finished)
+    return 1;
+
+  int64_t          first_start = INT64_MAX;
+  int64_t          last_end = 0;
+  histogram_counts latency{};
+  uint64_t         timer_count = 0;
+  int64_t          timer_total_us = 0;
+  int64_t          timer_max_us = 0;
+
+  for (auto& result : results) {
+    if (!result.done)
+      continue;
+
+    first_start = std::min(first_start, result.start_us);
+    last_end = std::max(last_end, result.end_us);
+
+    timer_count += result.timer_count;
+    timer_total_us += result.timer_total_us;
+    timer_max_us = std::max(timer_max_us, result.timer_max_us);
+
+    for (unsigned int i = 0; i < latency.size(); i++)
+      latency[i] += result.latency[i];
+  }
+
+  double megabytes = double(options.size) * options.leechers / 1e6;
+  double seconds = double(last_end - first_start) / 1e6;
+  double timer_average_us = timer_count != 0 ? double(timer_total_us) / timer_count : 0;
+
+  if (options.json) {
+    std::printf("{\"size\":%" PRIu64 ",\"piece_length\":%" PRIu32 ",\"seeders\":%u,\"leechers\":%u,\"rate_limit\":%" PRIu64 ",\"high_resolution\":%s,"
+                "\"seconds\":%.3f,\"mb_per_second\":%.1f,\"cpu_ms_per_mb\":%.3f,\"syscalls_per_mb\":%.1f,"
+                "\"latency_p50_ms\":%.0f,\"latency_p90_ms\":%.0f,\"latency_p99_ms\":%.0f,"
+                "\"timer_lateness_avg_us\":%.0f,\"timer_lateness_max_us\":%" PRId64 "}\n",
+                options.size, options.piece_length, options.seeders, options.leechers, options.rate,
+                options.high_resolution ? "true" : "false",
+                seconds, megabytes / seconds, cpu_seconds * 1000 / megabytes, syscalls / megabytes,
+                percentile(latency, 0.5), percentile(latency, 0.9), percentile(latency, 0.99),
+                timer_average_us, timer_max_us);
+  } else {
+    std::printf("size: %" PRIu64 " MiB  piece: %" PRIu32 " KiB  seeders: %u  leechers: %u  rate limit: %" PRIu64 " KiB/s%s\n",
+                options.size >> 20, options.piece_length >> 10, options.seeders, options.leechers, options.rate >> 10,
+                options.high_resolution ? " (high resolution)" : "");
+    std::printf("%.3f s  %.1f MB/s  %.3f cpu ms/MB  %.1f syscalls/MB\n",
+                seconds, megabytes / seconds, cpu_seconds * 1000 / megabytes, syscalls / megabytes);
+    std::printf("request latency  p50: <%.0f ms  p90: <%.0f ms  p99: <%.0f ms\n",
+                percentile(latency, 0.5), percentile(latency, 0.9), percentile(latency, 0.99));
+    std::printf("timer lateness  avg: %.0f us  max: %" PRId64 " us\n", timer_average_us, timer_max_us);
+  }
+
+  return 0;
+}
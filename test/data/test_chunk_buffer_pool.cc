@@ -0,0 +1,122 @@
+#include "config.h"
+
+#include "test_chunk_buffer_pool.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <unistd.h>
+
+#include "data/chunk_buffer_pool.h"
+#include "data/socket_file.h"
+#include "torrent/exceptions.h"
+
+CPPUNIT_TEST_SUITE_NAMED_REGISTRATION(test_chunk_buffer_pool, "data");
+
+void
+test_chunk_buffer_pool::test_allocate() {
+  torrent::ChunkBufferPool pool;
+
+  CPPUNIT_ASSERT_THROW(pool.allocate(0, torrent::MemoryChunk::prot_read), torrent::internal_error);
+
+  torrent::MemoryChunk chunk = pool.allocate(1000, torrent::MemoryChunk::prot_read);
+
+  CPPUNIT_ASSERT(chunk.is_valid());
+  CPPUNIT_ASSERT(chunk.size() == 1000);
+  CPPUNIT_ASSERT(chunk.page_align() == 0);
+  CPPUNIT_ASSERT(chunk.is_readable() && !chunk.is_writable());
+
+  // The buffer is writable regardless of the recorded protection.
+  std::memset(chunk.begin(), 0xaa, chunk.size());
+
+  pool.release(chunk);
+
+  CPPUNIT_ASSERT(!chunk.is_valid());
+  CPPUNIT_ASSERT(pool.cached_size() == torrent::MemoryChunk::page_size());
+}
+
+void
+test_chunk_buffer_pool::test_reuse() {
+  torrent::ChunkBufferPool pool;
+
+  torrent::MemoryChunk first = pool.allocate(2 * torrent::MemoryChunk::page_size(), torrent::MemoryChunk::prot_read);
+  char* ptr = first.ptr();
+
+  pool.release(first);
+
+  torrent::MemoryChunk other_size = pool.allocate(torrent::MemoryChunk::page_size(), torrent::MemoryChunk::prot_read);
+  CPPUNIT_ASSERT(other_size.ptr() != ptr);
+
+  torrent::MemoryChunk same_size = pool.allocate(2 * torrent::MemoryChunk::page_size() - 10, torrent::MemoryChunk::prot_read);
+  CPPUNIT_ASSERT(same_size.ptr() == ptr);
+  CPPUNIT_ASSERT(pool.cached_size() == 0);
+
+  pool.release(other_size);
+  pool.release(same_size);
+
+  CPPUNIT_ASSERT(pool.cached_size() == 3 * torrent::MemoryChunk::page_size());
+
+  pool.clear();
+  CPPUNIT_ASSERT(pool.cached_size() == 0);
+}
+
+void
+test_chunk_buffer_pool::test_max_cached_size() {
+  torrent::ChunkBufferPool pool;
+
+  pool.set_max_cached_size(torrent::MemoryChunk::page_size());
+
+  torrent::MemoryChunk first = pool.allocate(torrent::MemoryChunk::page_size(), torrent::MemoryChunk::prot_read);
+  torrent::MemoryChunk second = pool.allocate(torrent::MemoryChunk::page_size(), torrent::MemoryChunk::prot_read);
+
+  pool.release(first);
+  pool.release(second);
+
+  CPPUNIT_ASSERT(pool.cached_size() == torrent::MemoryChunk::page_size());
+
+  pool.set_max_cached_size(0);
+  CPPUNIT_ASSERT(pool.cached_size() == 0);
+}
+
+void
+test_chunk_buffer_pool::test_buffer_chunk() {
+  char filename[] = "test_chunk_buffer_pool.XXXXXX";
+  int fd = mkstemp(filename);
+
+  CPPUNIT_ASSERT(fd != -1);
+
+  char data[5000];
+
+  for (unsigned int i = 0; i < sizeof(data); i++)
+    data[i] = static_cast<char>(i);
+
+  CPPUNIT_ASSERT(write(fd, data, sizeof(data)) == sizeof(data));
+
+  torrent::ChunkBufferPool pool;
+  torrent::SocketFile file(fd);
+
+  int prot = torrent::MemoryChunk::prot_read | torrent::MemoryChunk::prot_write;
+
+  CPPUNIT_ASSERT(!file.create_buffer_chunk(4000, 2000, prot, &pool).is_valid());
+
+  torrent::MemoryChunk chunk = file.create_buffer_chunk(1000, 3000, prot, &pool);
+
+  CPPUNIT_ASSERT(chunk.is_valid());
+  CPPUNIT_ASSERT(chunk.size() == 3000);
+  CPPUNIT_ASSERT(std::memcmp(chunk.begin(), data + 1000, 3000) == 0);
+
+  std::memset(chunk.begin(), 'x', chunk.size());
+  CPPUNIT_ASSERT(file.write_buffer_chunk(chunk, 1000));
+  CPPUNIT_ASSERT(file.sync_data());
+
+  char result[sizeof(data)];
+  CPPUNIT_ASSERT(pread(fd, result, sizeof(result), 0) == sizeof(result));
+
+  std::memset(data + 1000, 'x', 3000);
+  CPPUNIT_ASSERT(std::memcmp(result, data, sizeof(data)) == 0);
+
+  pool.release(chunk);
+
+  ::close(fd);
+  std::remove(filename);
+}
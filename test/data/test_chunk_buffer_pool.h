@@ -0,0 +1,18 @@
+#include "helpers/test_fixture.h"
+
+class test_chunk_buffer_pool : public test_fixture {
+  CPPUNIT_TEST_SUITE(test_chunk_buffer_pool);
+
+  CPPUNIT_TEST(test_allocate);
+  CPPUNIT_TEST(test_reuse);
+  CPPUNIT_TEST(test_max_cached_size);
+  CPPUNIT_TEST(test_buffer_chunk);
+
+  CPPUNIT_TEST_SUITE_END();
+
+public:
+  void test_allocate();
+  void test_reuse();
+  void test_max_cached_size();
+  void test_buffer_chunk();
+};
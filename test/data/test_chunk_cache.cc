@@ -0,0 +1,148 @@
+#include "config.h"
+
+#include "test_chunk_cache.h"
+
+#include "data/chunk_cache.h"
+#include "torrent/chunk_manager.h"
+#include "torrent/exceptions.h"
+
+#include "test_chunk_list.h"
+
+CPPUNIT_TEST_SUITE_NAMED_REGISTRATION(test_chunk_cache, "data");
+
+static bool
+upload_chunk(torrent::ChunkCache* cache, torrent::ChunkList* chunk_list, uint32_t index) {
+  torrent::ChunkHandle handle = chunk_list->get(index);
+
+  CPPUNIT_ASSERT(handle.is_valid());
+
+  bool result = cache->insert(chunk_list, &handle);
+
+  CPPUNIT_ASSERT(!handle.is_valid());
+  return result;
+}
+
+void
+test_chunk_cache::test_basic() {
+  SETUP_CHUNK_LIST();
+
+  torrent::ChunkCache* cache = chunk_manager->chunk_cache();
+
+  CPPUNIT_ASSERT(!cache->is_enabled());
+
+  // Disabled caches just release the handle.
+  CPPUNIT_ASSERT(!upload_chunk(cache, chunk_list, 0));
+  CPPUNIT_ASSERT(!(*chunk_list)[0].is_valid());
+
+  chunk_manager->set_chunk_cache_size(2 * chunk_list->chunk_size());
+
+  CPPUNIT_ASSERT(!upload_chunk(cache, chunk_list, 0));
+  CPPUNIT_ASSERT(cache->is_cached(chunk_list, 0));
+  CPPUNIT_ASSERT((*chunk_list)[0].is_valid());
+  CPPUNIT_ASSERT((*chunk_list)[0].references() == 1);
+
+  CPPUNIT_ASSERT(upload_chunk(cache, chunk_list, 0));
+  CPPUNIT_ASSERT((*chunk_list)[0].references() == 1);
+  CPPUNIT_ASSERT(cache->frequent_size() == chunk_list->chunk_size());
+
+  CPPUNIT_ASSERT(cache->hits() == 1);
+  CPPUNIT_ASSERT(cache->misses() == 1);
+
+  torrent::ChunkHandle writable = chunk_list->get(1, torrent::ChunkList::get_writable);
+  CPPUNIT_ASSERT_THROW(cache->insert(chunk_list, &writable), torrent::internal_error);
+  chunk_list->release(&writable);
+  chunk_list->sync_chunks(torrent::ChunkList::sync_all | torrent::ChunkList::sync_force);
+
+  chunk_manager->set_chunk_cache_size(0);
+
+  CPPUNIT_ASSERT(cache->size() == 0);
+  CPPUNIT_ASSERT(!(*chunk_list)[0].is_valid());
+
+  CLEANUP_CHUNK_LIST();
+}
+
+void
+test_chunk_cache::test_frequency() {
+  SETUP_CHUNK_LIST();
+
+  torrent::ChunkCache* cache = chunk_manager->chunk_cache();
+  chunk_manager->set_chunk_cache_size(2 * chunk_list->chunk_size());
+
+  // A frequently used chunk survives a scan of chunks used once.
+  upload_chunk(cache, chunk_list, 0);
+  upload_chunk(cache, chunk_list, 0);
+
+  for (uint32_t i = 1; i < 8; i++)
+    CPPUNIT_ASSERT(!upload_chunk(cache, chunk_list, i));
+
+  CPPUNIT_ASSERT(cache->is_cached(chunk_list, 0));
+  CPPUNIT_ASSERT(cache->is_cached(chunk_list, 7));
+  CPPUNIT_ASSERT(!cache->is_cached(chunk_list, 6));
+  CPPUNIT_ASSERT(!(*chunk_list)[6].is_valid());
+
+  CPPUNIT_ASSERT(cache->size() == 2 * chunk_list->chunk_size());
+  CPPUNIT_ASSERT(cache->evictions() == 6);
+  CPPUNIT_ASSERT(cache->size() + cache->ghost_size() <= 4 * chunk_list->chunk_size());
+
+  cache->evict(1);
+  CPPUNIT_ASSERT(cache->size() == chunk_list->chunk_size());
+
+  cache->clear();
+  CPPUNIT_ASSERT(cache->size() == 0 && cache->ghost_size() == 0);
+
+  CLEANUP_CHUNK_LIST();
+}
+
+void
+test_chunk_cache::test_ghost_hit() {
+  SETUP_CHUNK_LIST();
+
+  torrent::ChunkCache* cache = chunk_manager->chunk_cache();
+  chunk_manager->set_chunk_cache_size(3 * chunk_list->chunk_size());
+
+  upload_chunk(cache, chunk_list, 0);
+  upload_chunk(cache, chunk_list, 1);
+  upload_chunk(cache, chunk_list, 1);
+  upload_chunk(cache, chunk_list, 2);
+  upload_chunk(cache, chunk_list, 3);
+
+  CPPUNIT_ASSERT(!cache->is_cached(chunk_list, 0));
+  CPPUNIT_ASSERT(cache->ghost_size() == chunk_list->chunk_size());
+  CPPUNIT_ASSERT(cache->target_recent_size() == 0);
+
+  // Chunk 0 was evicted from the recency list too early, so the
+  // target grows and the chunk is cached as frequent.
+  CPPUNIT_ASSERT(!upload_chunk(cache, chunk_list, 0));
+  CPPUNIT_ASSERT(cache->target_recent_size() == chunk_list->chunk_size());
+  CPPUNIT_ASSERT(cache->is_cached(chunk_list, 0));
+  CPPUNIT_ASSERT(cache->is_cached(chunk_list, 1));
+  CPPUNIT_ASSERT(cache->frequent_size() == 2 * chunk_list->chunk_size());
+  CPPUNIT_ASSERT(cache->size() == 3 * chunk_list->chunk_size());
+
+  cache->clear();
+
+  CLEANUP_CHUNK_LIST();
+}
+
+void
+test_chunk_cache::test_erase() {
+  SETUP_CHUNK_LIST();
+
+  torrent::ChunkCache* cache = chunk_manager->chunk_cache();
+  chunk_manager->set_chunk_cache_size(4 * chunk_list->chunk_size());
+
+  upload_chunk(cache, chunk_list, 0);
+  upload_chunk(cache, chunk_list, 1);
+
+  CPPUNIT_ASSERT(cache->size(chunk_list) == 2 * chunk_list->chunk_size());
+  CPPUNIT_ASSERT(cache->size(nullptr) == 0);
+
+  // Clearing the chunk list drops its cached chunks.
+  chunk_list->clear();
+
+  CPPUNIT_ASSERT(cache->size() == 0);
+  CPPUNIT_ASSERT(cache->size(chunk_list) == 0);
+  CPPUNIT_ASSERT(chunk_manager->memory_usage() == 0);
+
+  CLEANUP_CHUNK_LIST();
+}
@@ -0,0 +1,18 @@
+#include "helpers/test_fixture.h"
+
+class test_chunk_cache : public test_fixture {
+  CPPUNIT_TEST_SUITE(test_chunk_cache);
+
+  CPPUNIT_TEST(test_basic);
+  CPPUNIT_TEST(test_frequency);
+  CPPUNIT_TEST(test_ghost_hit);
+  CPPUNIT_TEST(test_erase);
+
+  CPPUNIT_TEST_SUITE_END();
+
+public:
+  void test_basic();
+  void test_frequency();
+  void test_ghost_hit();
+  void test_erase();
+};
@@ -1,10 +1,24 @@
 #import "config.h"
 
+#import <cstdio>
+#import <cstdint>
+#import <set>
+#import <thread>
+#import <unistd.h>
+
 #import "test_chunk_list.h"
 
+#import "data/chunk_buffer_pool.h"
+#import "data/chunk_lru.h"
+#import "data/chunk_part.h"
+#import "data/socket_file.h"
+#import "data/thread_disk.h"
 #import "torrent/chunk_manager.h"
 #import "torrent/exceptions.h"
 
+#import "helpers/test_main_thread.h"
+#import "helpers/test_thread.h"
+
 CPPUNIT_TEST_SUITE_NAMED_REGISTRATION(test_chunk_list, "data");
 
 torrent::Chunk*
@@ -18,7 +32,7 @@ func_create_chunk(uint32_t index, int prot_flags) {
   std::memset(memory_part1, index, 10);
 
   torrent::Chunk* chunk = new torrent::Chunk();
-  chunk->push_back(torrent::ChunkPart::MAPPED_MMAP, torrent::MemoryChunk(memory_part1, memory_part1, memory_part1 + 10, torrent::MemoryChunk::prot_read, 0));
+  chunk->push_back(torrent::ChunkPart::MAPPED_MMAP, torrent::MemoryChunk(memory_part1, memory_part1, memory_part1 + 10, prot_flags, 0));
 
   if (chunk == NULL)
     throw torrent::internal_error("func_create_chunk() failed: chunk == NULL.");
@@ -135,3 +149,302 @@ test_chunk_list::test_blocking() {
 
   CLEANUP_CHUNK_LIST();
 }
+
+void
+test_chunk_list::test_async_write() {
+  set_create_poll();
+
+  auto test_main_thread = TestMainThread::create();
+  test_main_thread->init_thread();
+
+  SETUP_CHUNK_LIST();
+  SETUP_THREAD_DISK();
+
+  chunk_manager->set_async_write(true);
+
+  torrent::ChunkHandle handle_0 = chunk_list->get(0, torrent::ChunkList::get_writable);
+  chunk_list->release(&handle_0);
+
+  torrent::ChunkHandle handle_1 = chunk_list->get(1, torrent::ChunkList::get_writable);
+  chunk_list->release(&handle_1);
+
+  CPPUNIT_ASSERT(chunk_list->queue_size() == 2);
+  CPPUNIT_ASSERT(chunk_list->sync_chunks(torrent::ChunkList::sync_force) == 0);
+
+  // Both chunks stay queued until the disk thread is done.
+  CPPUNIT_ASSERT(chunk_list->queue_size() == 2);
+  CPPUNIT_ASSERT((*chunk_list)[0].is_write_pending());
+  CPPUNIT_ASSERT((*chunk_list)[1].is_write_pending());
+
+  // Modified during the write, so chunk 1 must not be released.
+  handle_1 = chunk_list->get(1, torrent::ChunkList::get_writable);
+  chunk_list->release(&handle_1);
+
+  CPPUNIT_ASSERT(wait_for_true([&]() {
+        test_main_thread->test_process_callbacks();
+        return !(*chunk_list)[0].is_write_pending();
+      }));
+
+  CPPUNIT_ASSERT(!(*chunk_list)[1].is_write_pending());
+  CPPUNIT_ASSERT(!(*chunk_list)[0].is_valid());
+  CPPUNIT_ASSERT((*chunk_list)[1].is_valid());
+  CPPUNIT_ASSERT((*chunk_list)[1].writable() == 1);
+  CPPUNIT_ASSERT(chunk_list->queue_size() == 1);
+
+  // Syncing everything is always done directly.
+  CPPUNIT_ASSERT(chunk_list->sync_chunks(torrent::ChunkList::sync_all | torrent::ChunkList::sync_force) == 0);
+  CPPUNIT_ASSERT(chunk_list->queue_size() == 0);
+  CPPUNIT_ASSERT(!(*chunk_list)[1].is_valid());
+
+  CLEANUP_THREAD_DISK();
+  CLEANUP_CHUNK_LIST();
+}
+
+void
+test_chunk_list::test_huge_pages() {
+  SETUP_CHUNK_LIST();
+
+  uint32_t huge_size = torrent::ChunkManager::huge_page_size;
+
+  CPPUNIT_ASSERT(chunk_manager->chunk_memory_size(huge_size + 1) == huge_size + 1);
+
+  chunk_manager->set_huge_pages(true);
+
+  CPPUNIT_ASSERT(chunk_manager->chunk_memory_size(1 << 16) == 1 << 16);
+  CPPUNIT_ASSERT(chunk_manager->chunk_memory_size(huge_size) == huge_size);
+  CPPUNIT_ASSERT(chunk_manager->chunk_memory_size(huge_size + 1) == 2 * huge_size);
+
+  // Chunks are released with the size they were accounted with.
+  chunk_list->set_chunk_size(huge_size + (1 << 16));
+
+  auto handle = chunk_list->get(0);
+
+  CPPUNIT_ASSERT(handle.is_valid());
+  CPPUNIT_ASSERT(chunk_manager->memory_usage() == 2 * huge_size);
+
+  chunk_manager->set_huge_pages(false);
+  chunk_list->release(&handle);
+
+  CPPUNIT_ASSERT(chunk_manager->memory_usage() == 0);
+
+  CLEANUP_CHUNK_LIST();
+
+  // The mapping is aligned to the file offset modulo the huge page
+  // size, use a small one to keep the file small.
+  char filename[] = "test_chunk_list.XXXXXX";
+  int fd = mkstemp(filename);
+
+  CPPUNIT_ASSERT(fd != -1);
+
+  uint32_t page_size = torrent::MemoryChunk::page_size();
+  uint32_t fake_huge_size = 4 * page_size;
+
+  CPPUNIT_ASSERT(ftruncate(fd, 16 * page_size) == 0);
+
+  torrent::SocketFile file(fd);
+
+  int prot = torrent::MemoryChunk::prot_read;
+
+  CPPUNIT_ASSERT(!file.create_huge_chunk(15 * page_size, 2 * page_size, prot, torrent::MemoryChunk::map_shared, fake_huge_size).is_valid());
+  CPPUNIT_ASSERT_THROW(file.create_huge_chunk(0, page_size, prot, torrent::MemoryChunk::map_shared, page_size + 1), torrent::internal_error);
+
+  for (uint64_t offset : { uint64_t(0), uint64_t(page_size), uint64_t(5 * page_size + 100) }) {
+    torrent::MemoryChunk chunk = file.create_huge_chunk(offset, 8 * page_size, prot, torrent::MemoryChunk::map_shared, fake_huge_size);
+
+    CPPUNIT_ASSERT(chunk.is_valid());
+    CPPUNIT_ASSERT(chunk.size() == 8 * page_size);
+    CPPUNIT_ASSERT(reinterpret_cast<uintptr_t>(chunk.begin()) % fake_huge_size == offset % fake_huge_size);
+
+    chunk.unmap();
+  }
+
+  ::close(fd);
+  std::remove(filename);
+}
+
+void
+test_chunk_list::test_zero_chunk() {
+  CPPUNIT_ASSERT_THROW(torrent::SocketFile::create_zero_chunk(0), torrent::internal_error);
+
+  torrent::MemoryChunk small = torrent::SocketFile::create_zero_chunk(1000);
+
+  CPPUNIT_ASSERT(small.is_valid());
+  CPPUNIT_ASSERT(small.size() == 1000);
+  CPPUNIT_ASSERT(small.is_readable() && !small.is_writable());
+  CPPUNIT_ASSERT(std::count(small.begin(), small.end(), 0) == 1000);
+
+  // Growing the region keeps the old one mapped.
+  torrent::MemoryChunk large = torrent::SocketFile::create_zero_chunk(40 << 20);
+
+  CPPUNIT_ASSERT(large.is_valid());
+  CPPUNIT_ASSERT(large.size() == 40 << 20);
+  CPPUNIT_ASSERT(large.begin()[(40 << 20) - 1] == 0);
+  CPPUNIT_ASSERT(small.begin()[999] == 0);
+
+  // Static parts are neither unmapped nor synced.
+  torrent::ChunkPart part(torrent::ChunkPart::MAPPED_STATIC, small, 0);
+
+  CPPUNIT_ASSERT(part.sync(torrent::MemoryChunk::sync_sync));
+  CPPUNIT_ASSERT(part.is_incore(0));
+
+  part.clear();
+
+  CPPUNIT_ASSERT(!part.is_valid());
+  CPPUNIT_ASSERT(torrent::SocketFile::create_zero_chunk(1000).begin() == large.begin());
+}
+
+void
+test_chunk_list::test_get_shared() {
+  SETUP_CHUNK_LIST();
+
+  // Chunks not held by the main thread are not handed out.
+  CPPUNIT_ASSERT(!chunk_list->get_shared(0).is_valid());
+  CPPUNIT_ASSERT(chunk_list->get_shared(0).error_number() == rak::error_number::e_again);
+
+  auto handle = chunk_list->get(0);
+  torrent::ChunkHandle shared_handle;
+
+  std::thread([&]() { shared_handle = chunk_list->get_shared(0); }).join();
+
+  CPPUNIT_ASSERT(shared_handle.is_loaded());
+  CPPUNIT_ASSERT(shared_handle.chunk() == handle.chunk());
+  CPPUNIT_ASSERT((*chunk_list)[0].references() == 2);
+
+  // Shared handles block replacing the chunk with a writable one.
+  CPPUNIT_ASSERT(chunk_list->get(0, torrent::ChunkList::get_writable | torrent::ChunkList::get_nonblock).error_number() == rak::error_number::e_again);
+
+  chunk_list->release(&handle);
+  CPPUNIT_ASSERT(chunk_manager->memory_usage() != 0);
+
+  // The last reference is released by the next sync on the main thread.
+  std::thread([&]() { chunk_list->release_shared(&shared_handle); }).join();
+
+  CPPUNIT_ASSERT(!shared_handle.is_valid());
+  CPPUNIT_ASSERT((*chunk_list)[0].references() == 1);
+
+  chunk_list->sync_chunks(0);
+
+  CPPUNIT_ASSERT((*chunk_list)[0].references() == 0);
+  CPPUNIT_ASSERT(!(*chunk_list)[0].is_valid());
+  CPPUNIT_ASSERT(chunk_manager->memory_usage() == 0);
+
+  CLEANUP_CHUNK_LIST();
+}
+
+void
+test_chunk_list::test_evict() {
+  SETUP_CHUNK_LIST();
+
+  chunk_list->slot_free_diskspace() = [] { return uint64_t{1} << 40; };
+  chunk_manager->set_max_memory_usage(8 << 16);
+
+  for (unsigned int i = 0; i < 4; i++) {
+    torrent::ChunkHandle handle = chunk_list->get(i, torrent::ChunkList::get_writable);
+    chunk_list->release(&handle);
+  }
+
+  CPPUNIT_ASSERT(chunk_list->queue_size() == 4);
+  CPPUNIT_ASSERT(chunk_manager->chunk_lru()->size() == 4);
+  CPPUNIT_ASSERT(chunk_manager->chunk_lru()->front() == &(*chunk_list)[0]);
+
+  // Chunk 1 is held while becoming the least recently used.
+  torrent::ChunkHandle handle_1 = chunk_list->get(1);
+
+  for (unsigned int i : { 0, 2 }) {
+    torrent::ChunkHandle handle = chunk_list->get(i);
+    chunk_list->release(&handle);
+  }
+
+  CPPUNIT_ASSERT(chunk_manager->chunk_lru()->front() == &(*chunk_list)[3]);
+  CPPUNIT_ASSERT(chunk_manager->chunk_lru()->next(&(*chunk_list)[3]) == &(*chunk_list)[1]);
+
+  torrent::ChunkHandle handle_4 = chunk_list->get(4, torrent::ChunkList::get_writable);
+  torrent::ChunkHandle handle_5 = chunk_list->get(5, torrent::ChunkList::get_writable);
+
+  CPPUNIT_ASSERT(chunk_manager->memory_usage() == 6 << 16);
+  CPPUNIT_ASSERT(chunk_manager->stats_evicted() == 0);
+
+  // Going past 3/4 of the max frees a quarter of it, taking the
+  // coldest queued chunks that nothing else holds.
+  torrent::ChunkHandle handle_6 = chunk_list->get(6, torrent::ChunkList::get_writable);
+
+  CPPUNIT_ASSERT(handle_6.is_valid());
+  CPPUNIT_ASSERT(chunk_manager->stats_evicted() == 2);
+  CPPUNIT_ASSERT(chunk_manager->memory_usage() == 5 << 16);
+
+  CPPUNIT_ASSERT(!(*chunk_list)[0].is_valid());
+  CPPUNIT_ASSERT((*chunk_list)[1].is_valid());
+  CPPUNIT_ASSERT((*chunk_list)[2].is_valid());
+  CPPUNIT_ASSERT(!(*chunk_list)[3].is_valid());
+
+  CPPUNIT_ASSERT(chunk_list->queue_size() == 2);
+  CPPUNIT_ASSERT(chunk_manager->chunk_lru()->size() == 2);
+
+  chunk_list->release(&handle_1);
+  chunk_list->release(&handle_4);
+  chunk_list->release(&handle_5);
+  chunk_list->release(&handle_6);
+
+  CPPUNIT_ASSERT(chunk_manager->chunk_lru()->size() == 5);
+
+  chunk_list->clear();
+
+  CPPUNIT_ASSERT(chunk_manager->chunk_lru()->empty());
+  CPPUNIT_ASSERT(chunk_manager->memory_usage() == 0);
+
+  CLEANUP_CHUNK_LIST();
+}
+
+// Buffered chunks without a file fail any write back, so a sync
+// returning zero failures did not try to write them.
+void
+test_chunk_list::test_write_held() {
+  SETUP_CHUNK_LIST();
+
+  std::set<uint32_t> unverified{0, 1};
+
+  chunk_manager->set_buffered_writes(true);
+  chunk_list->slot_free_diskspace() = [] { return uint64_t{1} << 40; };
+  chunk_list->slot_is_unverified() = [&unverified](uint32_t index) { return unverified.count(index) != 0; };
+  chunk_list->slot_create_chunk() = [chunk_manager](uint32_t index, int prot_flags) {
+      auto pool = chunk_manager->buffer_pool();
+      auto chunk = new torrent::Chunk();
+
+      chunk->push_back(torrent::ChunkPart::MAPPED_BUFFER, pool->allocate(10, prot_flags));
+      chunk->back().set_buffer_pool(pool);
+      return chunk;
+    };
+
+  for (unsigned int i = 0; i < 2; i++) {
+    torrent::ChunkHandle handle = chunk_list->get(i, torrent::ChunkList::get_writable);
+    chunk_list->release(&handle);
+  }
+
+  for (int flags : { torrent::ChunkList::sync_use_timeout,
+                     0,
+                     torrent::ChunkList::sync_force,
+                     torrent::ChunkList::sync_all | torrent::ChunkList::sync_force }) {
+    CPPUNIT_ASSERT(chunk_list->sync_chunks(flags) == 0);
+    CPPUNIT_ASSERT(chunk_list->queue_size() == 2);
+  }
+
+  chunk_manager->try_free_memory(chunk_manager->memory_usage());
+
+  CPPUNIT_ASSERT(chunk_manager->stats_evicted() == 0);
+  CPPUNIT_ASSERT(chunk_list->queue_size() == 2);
+
+  // Chunk 1 passed the hash check and is written.
+  unverified.erase(1);
+
+  CPPUNIT_ASSERT(chunk_list->sync_chunks(torrent::ChunkList::sync_use_timeout | torrent::ChunkList::sync_ignore_error) == 1);
+  CPPUNIT_ASSERT(chunk_list->queue_size() == 2);
+
+  unverified.insert(1);
+
+  CPPUNIT_ASSERT(chunk_list->sync_chunks(torrent::ChunkList::sync_all | torrent::ChunkList::sync_force | torrent::ChunkList::sync_discard_unverified) == 0);
+  CPPUNIT_ASSERT(chunk_list->queue_size() == 0);
+  CPPUNIT_ASSERT(chunk_manager->chunk_lru()->empty());
+  CPPUNIT_ASSERT(chunk_manager->memory_usage() == 0);
+
+  CLEANUP_CHUNK_LIST();
+}
@@ -6,6 +6,12 @@ class test_chunk_list : public test_fixture {
   CPPUNIT_TEST(test_basic);
   CPPUNIT_TEST(test_get_release);
   CPPUNIT_TEST(test_blocking);
+  CPPUNIT_TEST(test_async_write);
+  CPPUNIT_TEST(test_huge_pages);
+  CPPUNIT_TEST(test_zero_chunk);
+  CPPUNIT_TEST(test_get_shared);
+  CPPUNIT_TEST(test_evict);
+  CPPUNIT_TEST(test_write_held);
 
   CPPUNIT_TEST_SUITE_END();
 
@@ -13,6 +19,12 @@ public:
   void test_basic();
   void test_get_release();
   void test_blocking();
+  void test_async_write();
+  void test_huge_pages();
+  void test_zero_chunk();
+  void test_get_shared();
+  void test_evict();
+  void test_write_held();
 };
 
 #include "data/chunk_list.h"
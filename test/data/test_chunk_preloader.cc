@@ -0,0 +1,141 @@
+#include "config.h"
+
+#include "test_chunk_preloader.h"
+
+#include "data/chunk_preloader.h"
+#include "data/thread_disk.h"
+#include "torrent/chunk_manager.h"
+#include "torrent/exceptions.h"
+
+#include "helpers/test_main_thread.h"
+#include "helpers/test_thread.h"
+#include "test_chunk_list.h"
+
+CPPUNIT_TEST_SUITE_NAMED_REGISTRATION(test_chunk_preloader, "data");
+
+void
+test_chunk_preloader::test_insert_take() {
+  SETUP_CHUNK_LIST();
+
+  {
+    torrent::ChunkPreloader preloader(chunk_list, chunk_manager);
+
+    CPPUNIT_ASSERT_THROW(preloader.insert(32), torrent::internal_error);
+
+    // Without a disk thread the chunk is preloaded directly.
+    CPPUNIT_ASSERT(preloader.insert(0));
+    CPPUNIT_ASSERT(preloader.insert(0));
+    CPPUNIT_ASSERT(preloader.size() == 1);
+    CPPUNIT_ASSERT(preloader.is_loaded(0));
+    CPPUNIT_ASSERT((*chunk_list)[0].references() == 1);
+    CPPUNIT_ASSERT(chunk_manager->preload_memory_usage() == chunk_list->chunk_size());
+
+    CPPUNIT_ASSERT(!preloader.take(1));
+    CPPUNIT_ASSERT(preloader.take(0));
+
+    CPPUNIT_ASSERT(preloader.empty());
+    CPPUNIT_ASSERT(!(*chunk_list)[0].is_valid());
+    CPPUNIT_ASSERT(chunk_manager->preload_memory_usage() == 0);
+
+    CPPUNIT_ASSERT(preloader.insert(1));
+  }
+
+  CPPUNIT_ASSERT(!(*chunk_list)[1].is_valid());
+  CPPUNIT_ASSERT(chunk_manager->preload_memory_usage() == 0);
+
+  CLEANUP_CHUNK_LIST();
+}
+
+void
+test_chunk_preloader::test_budget() {
+  SETUP_CHUNK_LIST();
+
+  chunk_manager->set_preload_budget(chunk_list->chunk_size());
+
+  torrent::ChunkPreloader preloader(chunk_list, chunk_manager);
+
+  CPPUNIT_ASSERT(preloader.insert(0));
+  CPPUNIT_ASSERT(!preloader.insert(1));
+  CPPUNIT_ASSERT(chunk_manager->stats_not_preloaded() == 1);
+
+  preloader.clear();
+  CPPUNIT_ASSERT(preloader.insert(1));
+
+  chunk_manager->set_storage_backend(torrent::ChunkManager::storage_pread);
+  preloader.clear();
+
+  CPPUNIT_ASSERT(!preloader.insert(2));
+  CPPUNIT_ASSERT(!(*chunk_list)[2].is_valid());
+
+  CLEANUP_CHUNK_LIST();
+}
+
+void
+test_chunk_preloader::test_disk_thread() {
+  set_create_poll();
+
+  auto test_main_thread = TestMainThread::create();
+  test_main_thread->init_thread();
+
+  SETUP_CHUNK_LIST();
+  SETUP_THREAD_DISK();
+
+  chunk_manager->set_preload_type(2);
+
+  torrent::ChunkPreloader preloader(chunk_list, chunk_manager);
+
+  CPPUNIT_ASSERT(preloader.insert(0));
+  CPPUNIT_ASSERT(preloader.insert(1));
+
+  // Nothing is loaded until the main thread gets the completion.
+  CPPUNIT_ASSERT(!preloader.is_loaded(0));
+  CPPUNIT_ASSERT(!preloader.take(0));
+
+  CPPUNIT_ASSERT(wait_for_true([&]() {
+        test_main_thread->test_process_callbacks();
+        return preloader.is_loaded(0) && preloader.is_loaded(1);
+      }));
+
+  CPPUNIT_ASSERT(preloader.take(0));
+  CPPUNIT_ASSERT(preloader.size() == 1);
+
+  // Pending preloads are dropped when cleared.
+  CPPUNIT_ASSERT(preloader.insert(2));
+  preloader.clear();
+
+  CPPUNIT_ASSERT(preloader.empty());
+  CPPUNIT_ASSERT(!(*chunk_list)[1].is_valid() && !(*chunk_list)[2].is_valid());
+
+  CLEANUP_THREAD_DISK();
+  CLEANUP_CHUNK_LIST();
+}
+
+void
+test_chunk_preloader::test_elevator_order() {
+  using request_type = torrent::ChunkPreloader::request_type;
+  using std::chrono::microseconds;
+
+  std::vector<request_type> requests = {
+    { 7, microseconds(50) }, { 2, microseconds(60) }, { 9, microseconds(10) },
+    { 5, microseconds(70) }, { 1, microseconds(20) }, { 4, microseconds(80) },
+  };
+
+  torrent::ChunkPreloader::elevator_order(requests, 5, microseconds(0));
+
+  std::vector<uint32_t> indices;
+
+  for (const auto& request : requests)
+    indices.push_back(request.index);
+
+  CPPUNIT_ASSERT((indices == std::vector<uint32_t>{ 5, 7, 9, 1, 2, 4 }));
+
+  // Requests past the deadline go first, oldest first.
+  torrent::ChunkPreloader::elevator_order(requests, 5, microseconds(30));
+
+  indices.clear();
+
+  for (const auto& request : requests)
+    indices.push_back(request.index);
+
+  CPPUNIT_ASSERT((indices == std::vector<uint32_t>{ 9, 1, 5, 7, 2, 4 }));
+}
@@ -0,0 +1,18 @@
+#include "helpers/test_fixture.h"
+
+class test_chunk_preloader : public test_fixture {
+  CPPUNIT_TEST_SUITE(test_chunk_preloader);
+
+  CPPUNIT_TEST(test_insert_take);
+  CPPUNIT_TEST(test_budget);
+  CPPUNIT_TEST(test_disk_thread);
+  CPPUNIT_TEST(test_elevator_order);
+
+  CPPUNIT_TEST_SUITE_END();
+
+public:
+  void test_insert_take();
+  void test_budget();
+  void test_disk_thread();
+  void test_elevator_order();
+};
@@ -0,0 +1,74 @@
+#include "config.h"
+
+#include "test_chunk_residency.h"
+
+#include "data/chunk_preloader.h"
+#include "data/chunk_residency.h"
+#include "torrent/chunk_manager.h"
+#include "torrent/exceptions.h"
+
+#include "test_chunk_list.h"
+
+CPPUNIT_TEST_SUITE_NAMED_REGISTRATION(test_chunk_residency, "data");
+
+void
+test_chunk_residency::test_sample() {
+  SETUP_CHUNK_LIST();
+
+  torrent::ChunkResidency residency(chunk_list, chunk_manager);
+
+  CPPUNIT_ASSERT(!residency.is_resident(0));
+  CPPUNIT_ASSERT(residency.sample() == 0);
+
+  // The test chunks are anonymous memory touched when created.
+  auto handle_0 = chunk_list->get(0);
+  auto handle_1 = chunk_list->get(1);
+
+  CPPUNIT_ASSERT(residency.sample() == 2);
+  CPPUNIT_ASSERT(residency.is_resident(0));
+  CPPUNIT_ASSERT(residency.is_resident(1));
+  CPPUNIT_ASSERT(!residency.is_resident(2));
+  CPPUNIT_ASSERT(residency.size_resident() == 2);
+
+  // Released chunks keep their state until it is too old.
+  chunk_list->release(&handle_0);
+  chunk_list->release(&handle_1);
+
+  CPPUNIT_ASSERT(residency.sample() == 0);
+  CPPUNIT_ASSERT(residency.is_resident(0));
+
+  CPPUNIT_ASSERT_THROW(residency.set_resident(32), torrent::internal_error);
+  residency.set_resident(31);
+  CPPUNIT_ASSERT(residency.is_resident(31));
+
+  // Nothing is tracked with the pread backend.
+  chunk_manager->set_storage_backend(torrent::ChunkManager::storage_pread);
+
+  CPPUNIT_ASSERT(residency.sample() == 0);
+  CPPUNIT_ASSERT(!residency.is_resident(0));
+  CPPUNIT_ASSERT(residency.size_resident() == 0);
+
+  CLEANUP_CHUNK_LIST();
+}
+
+void
+test_chunk_residency::test_preloader() {
+  SETUP_CHUNK_LIST();
+
+  {
+    torrent::ChunkResidency residency(chunk_list, chunk_manager);
+    torrent::ChunkPreloader preloader(chunk_list, chunk_manager, &residency);
+
+    // Preloaded chunks are marked resident.
+    CPPUNIT_ASSERT(preloader.insert(0));
+    CPPUNIT_ASSERT(residency.is_resident(0));
+    CPPUNIT_ASSERT(preloader.take(0));
+
+    // Resident chunks are not queued.
+    CPPUNIT_ASSERT(preloader.insert(0));
+    CPPUNIT_ASSERT(preloader.empty());
+    CPPUNIT_ASSERT(!(*chunk_list)[0].is_valid());
+  }
+
+  CLEANUP_CHUNK_LIST();
+}
@@ -0,0 +1,14 @@
+#include "helpers/test_fixture.h"
+
+class test_chunk_residency : public test_fixture {
+  CPPUNIT_TEST_SUITE(test_chunk_residency);
+
+  CPPUNIT_TEST(test_sample);
+  CPPUNIT_TEST(test_preloader);
+
+  CPPUNIT_TEST_SUITE_END();
+
+public:
+  void test_sample();
+  void test_preloader();
+};
@@ -0,0 +1,89 @@
+#include "config.h"
+
+#include "test_content_index.h"
+
+#include <string>
+
+#include "data/content_index.h"
+
+CPPUNIT_TEST_SUITE_NAMED_REGISTRATION(test_content_index, "data");
+
+namespace {
+
+std::string
+make_hashes(const std::string& pieces) {
+  std::string hashes;
+
+  for (char c : pieces)
+    hashes += std::string(torrent::HashString::size_data, c);
+
+  return hashes;
+}
+
+torrent::DownloadWrapper*
+fake_download(uintptr_t id) {
+  return reinterpret_cast<torrent::DownloadWrapper*>(id);
+}
+
+torrent::File*
+fake_file(uintptr_t id) {
+  return reinterpret_cast<torrent::File*>(id);
+}
+
+}
+
+void
+test_content_index::test_make_key() {
+  torrent::content_key key1;
+  torrent::content_key key2;
+
+  // Pieces 'abcd' and 'xbcy' share the two middle pieces.
+  std::string hashes1 = make_hashes("abcd");
+  std::string hashes2 = make_hashes("xbcy");
+
+  CPPUNIT_ASSERT(torrent::ContentIndex::make_key(400, 100, 100, 200, hashes1.c_str(), &key1));
+  CPPUNIT_ASSERT(torrent::ContentIndex::make_key(400, 100, 100, 200, hashes2.c_str(), &key2));
+  CPPUNIT_ASSERT(key1 == key2);
+  CPPUNIT_ASSERT(key1.size == 200 && key1.chunk_size == 100);
+
+  // The tail piece may end the torrent.
+  CPPUNIT_ASSERT(torrent::ContentIndex::make_key(350, 100, 200, 150, hashes1.c_str(), &key1));
+  CPPUNIT_ASSERT(torrent::ContentIndex::make_key(350, 100, 200, 150, hashes2.c_str(), &key2));
+  CPPUNIT_ASSERT(!(key1 == key2));
+
+  // Pieces shared with other files.
+  CPPUNIT_ASSERT(!torrent::ContentIndex::make_key(400, 100, 50, 150, hashes1.c_str(), &key1));
+  CPPUNIT_ASSERT(!torrent::ContentIndex::make_key(400, 100, 100, 150, hashes1.c_str(), &key1));
+  CPPUNIT_ASSERT(!torrent::ContentIndex::make_key(400, 100, 100, 0, hashes1.c_str(), &key1));
+}
+
+void
+test_content_index::test_insert_find() {
+  torrent::ContentIndex index;
+  torrent::content_key key1;
+  torrent::content_key key2;
+
+  std::string hashes = make_hashes("abcd");
+
+  CPPUNIT_ASSERT(torrent::ContentIndex::make_key(400, 100, 0, 100, hashes.c_str(), &key1));
+  CPPUNIT_ASSERT(torrent::ContentIndex::make_key(400, 100, 100, 100, hashes.c_str(), &key2));
+
+  index.insert(key1, fake_download(1), fake_file(10));
+  index.insert(key1, fake_download(2), fake_file(20));
+  index.insert(key2, fake_download(2), fake_file(21));
+
+  CPPUNIT_ASSERT(index.size() == 3);
+  CPPUNIT_ASSERT(index.find(key1).size() == 2);
+  CPPUNIT_ASSERT(index.find(key2).size() == 1);
+  CPPUNIT_ASSERT(index.find(key2)[0].second == fake_file(21));
+
+  index.erase_download(fake_download(2));
+
+  CPPUNIT_ASSERT(index.size() == 1);
+  CPPUNIT_ASSERT(index.find(key1).size() == 1);
+  CPPUNIT_ASSERT(index.find(key1)[0].first == fake_download(1));
+  CPPUNIT_ASSERT(index.find(key2).empty());
+
+  index.erase_download(fake_download(1));
+  CPPUNIT_ASSERT(index.empty());
+}
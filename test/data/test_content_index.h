@@ -0,0 +1,14 @@
+#include "helpers/test_fixture.h"
+
+class test_content_index : public test_fixture {
+  CPPUNIT_TEST_SUITE(test_content_index);
+
+  CPPUNIT_TEST(test_make_key);
+  CPPUNIT_TEST(test_insert_find);
+
+  CPPUNIT_TEST_SUITE_END();
+
+public:
+  void test_make_key();
+  void test_insert_find();
+};
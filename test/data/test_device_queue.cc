@@ -0,0 +1,61 @@
+#include "config.h"
+
+#include "test_device_queue.h"
+
+#include <atomic>
+#include <future>
+#include <vector>
+
+#include "data/device_queue.h"
+
+CPPUNIT_TEST_SUITE_NAMED_REGISTRATION(test_device_queue, "data");
+
+void
+test_device_queue::test_callback() {
+  torrent::DeviceQueue queue(1);
+  CPPUNIT_ASSERT(queue.device() == 1);
+
+  std::vector<int> order;
+  std::promise<void> done;
+
+  for (int i = 0; i != 8; i++)
+    queue.callback(this, [&order, i]() { order.push_back(i); });
+
+  queue.callback(this, [&done]() { done.set_value(); });
+  done.get_future().wait();
+
+  CPPUNIT_ASSERT((order == std::vector<int>{ 0, 1, 2, 3, 4, 5, 6, 7 }));
+}
+
+void
+test_device_queue::test_cancel() {
+  torrent::DeviceQueue queue(1);
+
+  std::promise<void> started;
+  std::promise<void> release;
+  std::shared_future<void> released = release.get_future().share();
+  std::atomic<int> calls{0};
+
+  int other_target;
+
+  queue.callback(this, [&started, released, &calls]() { started.set_value(); released.wait(); calls++; });
+  queue.callback(this, [&calls]() { calls++; });
+  queue.callback(&other_target, [&calls]() { calls += 10; });
+
+  started.get_future().wait();
+
+  auto cancelled = std::async(std::launch::async, [&queue, this]() { queue.cancel_callback_and_wait(this); });
+
+  // The running callback is waited for, the queued one dropped.
+  CPPUNIT_ASSERT(cancelled.wait_for(std::chrono::milliseconds(50)) == std::future_status::timeout);
+
+  release.set_value();
+  cancelled.wait();
+
+  // Callbacks of other targets are kept.
+  std::promise<void> done;
+  queue.callback(this, [&done]() { done.set_value(); });
+  done.get_future().wait();
+
+  CPPUNIT_ASSERT(calls == 11);
+}
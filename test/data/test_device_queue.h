@@ -0,0 +1,14 @@
+#include "helpers/test_fixture.h"
+
+class test_device_queue : public test_fixture {
+  CPPUNIT_TEST_SUITE(test_device_queue);
+
+  CPPUNIT_TEST(test_callback);
+  CPPUNIT_TEST(test_cancel);
+
+  CPPUNIT_TEST_SUITE_END();
+
+public:
+  void test_callback();
+  void test_cancel();
+};
@@ -0,0 +1,98 @@
+#include "config.h"
+
+#include "test_disk_space_sampler.h"
+
+#include "data/disk_space_sampler.h"
+
+CPPUNIT_TEST_SUITE_NAMED_REGISTRATION(test_disk_space_sampler, "data");
+
+using namespace std::chrono_literals;
+
+static void
+set_stat(torrent::DiskSpaceSampler& sampler, int* calls, uint64_t* space) {
+  sampler.slot_stat_path() = [calls, space](const std::string& path, uint64_t* bytes) {
+      (*calls)++;
+
+      if (path == "invalid")
+        return false;
+
+      *bytes = *space;
+      return true;
+    };
+}
+
+void
+test_disk_space_sampler::test_sample() {
+  torrent::DiskSpaceSampler sampler;
+
+  int      calls = 0;
+  uint64_t space = uint64_t{100} << 30;
+  uint64_t bytes = 0;
+
+  set_stat(sampler, &calls, &space);
+
+  CPPUNIT_ASSERT(sampler.free_space("a", 1000s, &bytes));
+  CPPUNIT_ASSERT(bytes == space && calls == 1);
+
+  // Further calls use the sampled value until resampled.
+  space = uint64_t{50} << 30;
+
+  CPPUNIT_ASSERT(sampler.free_space("a", 1001s, &bytes));
+  CPPUNIT_ASSERT(bytes == uint64_t{100} << 30 && calls == 1);
+  CPPUNIT_ASSERT(sampler.next_sample(1001s) == 9s);
+
+  sampler.sample(1005s);
+  CPPUNIT_ASSERT(calls == 1);
+
+  sampler.sample(1010s);
+  CPPUNIT_ASSERT(calls == 2);
+
+  CPPUNIT_ASSERT(sampler.free_space("a", 1010s, &bytes));
+  CPPUNIT_ASSERT(bytes == space);
+
+  CPPUNIT_ASSERT(!sampler.free_space("invalid", 1010s, &bytes));
+  CPPUNIT_ASSERT(!sampler.free_space("invalid", 1010s, &bytes));
+  CPPUNIT_ASSERT(calls == 3);
+  CPPUNIT_ASSERT(sampler.size() == 2);
+}
+
+void
+test_disk_space_sampler::test_low_space() {
+  torrent::DiskSpaceSampler sampler;
+
+  int      calls = 0;
+  uint64_t space = torrent::DiskSpaceSampler::low_space - 1;
+  uint64_t bytes = 0;
+
+  set_stat(sampler, &calls, &space);
+
+  CPPUNIT_ASSERT(sampler.free_space("a", 1000s, &bytes));
+  CPPUNIT_ASSERT(sampler.next_sample(1000s) == torrent::DiskSpaceSampler::low_sample_interval);
+
+  sampler.sample(1001s);
+  CPPUNIT_ASSERT(calls == 2);
+
+  space = torrent::DiskSpaceSampler::low_space;
+
+  sampler.sample(1002s);
+  CPPUNIT_ASSERT(calls == 3);
+  CPPUNIT_ASSERT(sampler.next_sample(1002s) == torrent::DiskSpaceSampler::sample_interval);
+}
+
+void
+test_disk_space_sampler::test_expire() {
+  torrent::DiskSpaceSampler sampler;
+
+  int      calls = 0;
+  uint64_t space = uint64_t{100} << 30;
+  uint64_t bytes = 0;
+
+  set_stat(sampler, &calls, &space);
+
+  CPPUNIT_ASSERT(sampler.free_space("a", 1000s, &bytes));
+  CPPUNIT_ASSERT(sampler.free_space("b", 1000s + torrent::DiskSpaceSampler::expire_interval, &bytes));
+
+  sampler.sample(1001s + torrent::DiskSpaceSampler::expire_interval);
+
+  CPPUNIT_ASSERT(sampler.size() == 1);
+}
@@ -0,0 +1,16 @@
+#include "helpers/test_fixture.h"
+
+class test_disk_space_sampler : public test_fixture {
+  CPPUNIT_TEST_SUITE(test_disk_space_sampler);
+
+  CPPUNIT_TEST(test_sample);
+  CPPUNIT_TEST(test_low_space);
+  CPPUNIT_TEST(test_expire);
+
+  CPPUNIT_TEST_SUITE_END();
+
+public:
+  void test_sample();
+  void test_low_space();
+  void test_expire();
+};
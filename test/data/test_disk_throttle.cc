@@ -0,0 +1,94 @@
+#include "config.h"
+
+#include "test_disk_throttle.h"
+
+#include "data/disk_throttle.h"
+
+CPPUNIT_TEST_SUITE_NAMED_REGISTRATION(test_disk_throttle, "data");
+
+using namespace std::chrono_literals;
+
+using torrent::DiskThrottle;
+
+void
+test_disk_throttle::test_unlimited() {
+  DiskThrottle throttle;
+
+  CPPUNIT_ASSERT(!throttle.is_throttled(DiskThrottle::class_read));
+
+  for (int i = 0; i < 100; i++)
+    CPPUNIT_ASSERT(throttle.try_acquire(DiskThrottle::class_read, 1 << 30, 1, 1000s));
+
+  CPPUNIT_ASSERT(throttle.wait_time(DiskThrottle::class_read, 1000s) == 0us);
+  CPPUNIT_ASSERT(throttle.total(DiskThrottle::class_read) == uint64_t{100} << 30);
+  CPPUNIT_ASSERT(throttle.total(DiskThrottle::class_write) == 0);
+}
+
+void
+test_disk_throttle::test_rate() {
+  DiskThrottle throttle;
+
+  throttle.set_max_rate(DiskThrottle::class_write, 1 << 20);
+
+  CPPUNIT_ASSERT(throttle.is_throttled(DiskThrottle::class_write));
+  CPPUNIT_ASSERT(!throttle.is_throttled(DiskThrottle::class_hash));
+  CPPUNIT_ASSERT(throttle.max_rate(DiskThrottle::class_write) == 1 << 20);
+
+  // The bucket starts full, a second's worth.
+  CPPUNIT_ASSERT(throttle.try_acquire(DiskThrottle::class_write, 1 << 20, 1, 1000s));
+  CPPUNIT_ASSERT(throttle.try_acquire(DiskThrottle::class_write, 1, 1, 1000s));
+
+  // In debt by a byte, paid off in a microsecond.
+  CPPUNIT_ASSERT(!throttle.try_acquire(DiskThrottle::class_write, 1, 1, 1000s));
+  CPPUNIT_ASSERT(throttle.wait_time(DiskThrottle::class_write, 1000s) == 1us);
+
+  // Operations larger than the limit pass, and those after wait for
+  // the debt.
+  CPPUNIT_ASSERT(throttle.try_acquire(DiskThrottle::class_write, 4 << 20, 1, 1000s + 1us));
+  CPPUNIT_ASSERT(throttle.wait_time(DiskThrottle::class_write, 1000s + 1us) == 4s);
+  CPPUNIT_ASSERT(throttle.wait_time(DiskThrottle::class_write, 1002s + 1us) == 2s);
+  CPPUNIT_ASSERT(throttle.try_acquire(DiskThrottle::class_write, 1, 1, 1004s + 1us));
+
+  // Idle time refills at most a second's worth.
+  CPPUNIT_ASSERT(throttle.try_acquire(DiskThrottle::class_write, 2 << 20, 1, 2000s));
+  CPPUNIT_ASSERT(throttle.wait_time(DiskThrottle::class_write, 2000s) == 1s);
+
+  throttle.set_max_rate(DiskThrottle::class_write, 0);
+
+  CPPUNIT_ASSERT(!throttle.is_throttled(DiskThrottle::class_write));
+  CPPUNIT_ASSERT(throttle.wait_time(DiskThrottle::class_write, 2000s) == 0us);
+}
+
+void
+test_disk_throttle::test_iops() {
+  DiskThrottle throttle;
+
+  throttle.set_max_iops(DiskThrottle::class_hash, 10);
+
+  CPPUNIT_ASSERT(throttle.max_iops(DiskThrottle::class_hash) == 10);
+
+  for (int i = 0; i < 11; i++)
+    CPPUNIT_ASSERT(throttle.try_acquire(DiskThrottle::class_hash, 1 << 20, 1, 1000s));
+
+  CPPUNIT_ASSERT(!throttle.try_acquire(DiskThrottle::class_hash, 1, 1, 1000s));
+  CPPUNIT_ASSERT(throttle.wait_time(DiskThrottle::class_hash, 1000s) == 100ms);
+  CPPUNIT_ASSERT(throttle.try_acquire(DiskThrottle::class_hash, 1, 1, 1000s + 100ms));
+
+  // Other classes are not affected.
+  CPPUNIT_ASSERT(throttle.try_acquire(DiskThrottle::class_read, 1, 1, 1000s + 100ms));
+}
+
+void
+test_disk_throttle::test_acquire() {
+  DiskThrottle throttle;
+
+  throttle.set_max_iops(DiskThrottle::class_read, 100);
+
+  auto start = DiskThrottle::current_time();
+
+  // A full bucket and one more, then waits for two operations.
+  for (int i = 0; i < 103; i++)
+    throttle.acquire(DiskThrottle::class_read, 0, 1);
+
+  CPPUNIT_ASSERT(DiskThrottle::current_time() - start >= 19ms);
+}
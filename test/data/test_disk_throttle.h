@@ -0,0 +1,18 @@
+#include "helpers/test_fixture.h"
+
+class test_disk_throttle : public test_fixture {
+  CPPUNIT_TEST_SUITE(test_disk_throttle);
+
+  CPPUNIT_TEST(test_unlimited);
+  CPPUNIT_TEST(test_rate);
+  CPPUNIT_TEST(test_iops);
+  CPPUNIT_TEST(test_acquire);
+
+  CPPUNIT_TEST_SUITE_END();
+
+public:
+  void test_unlimited();
+  void test_rate();
+  void test_iops();
+  void test_acquire();
+};
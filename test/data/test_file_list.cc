@@ -0,0 +1,154 @@
+#include "config.h"
+
+#include "test_file_list.h"
+
+#include <cstdlib>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <unistd.h>
+
+#include "manager.h"
+#include "thread_main.h"
+#include "data/chunk.h"
+#include "test/helpers/test_thread.h"
+#include "torrent/chunk_manager.h"
+#include "torrent/data/file_list.h"
+#include "torrent/data/file_manager.h"
+#include "torrent/path.h"
+
+CPPUNIT_TEST_SUITE_NAMED_REGISTRATION(test_file_list, "data");
+
+namespace {
+
+// A single chunk spanning two small files and a larger one.
+constexpr uint32_t chunk_size = 64 << 10;
+constexpr uint64_t file_sizes[] = { 4 << 10, 12 << 10, 48 << 10 };
+
+class file_list_access : public torrent::FileList {
+public:
+  using FileList::open_no_create;
+
+  using FileList::initialize;
+  using FileList::open;
+  using FileList::close;
+  using FileList::create_chunk_index;
+};
+
+std::string
+file_data(unsigned int index, uint64_t size) {
+  std::string data(size, '\0');
+
+  for (uint64_t i = 0; i < size; i++)
+    data[i] = static_cast<char>('a' + index + i % 7);
+
+  return data;
+}
+
+void
+open_file_list(file_list_access* file_list, const std::string& dir) {
+  torrent::FileList::split_type files[3];
+  uint64_t total = 0;
+
+  for (unsigned int i = 0; i < 3; i++) {
+    torrent::Path path;
+    path.push_back("file_" + std::to_string(i));
+
+    files[i] = torrent::FileList::split_type(file_sizes[i], path, 0);
+    total += file_sizes[i];
+
+    std::ofstream(dir + "/file_" + std::to_string(i), std::ios::binary) << file_data(i, file_sizes[i]);
+  }
+
+  file_list->initialize(total, chunk_size);
+  file_list->split(file_list->begin(), std::begin(files), std::end(files));
+  file_list->set_root_dir(dir);
+  file_list->open(file_list_access::open_no_create);
+}
+
+void
+verify_chunk(torrent::Chunk* chunk) {
+  CPPUNIT_ASSERT(chunk != nullptr);
+  CPPUNIT_ASSERT(std::distance(chunk->begin(), chunk->end()) == 3);
+  CPPUNIT_ASSERT(chunk->chunk_size() == chunk_size);
+
+  unsigned int index = 0;
+
+  for (auto& part : *chunk) {
+    std::string expected = file_data(index, file_sizes[index]);
+
+    CPPUNIT_ASSERT(part.size() == file_sizes[index]);
+    CPPUNIT_ASSERT(std::string(part.chunk().begin(), part.size()) == expected);
+    index++;
+  }
+}
+
+}
+
+void
+test_file_list::setUp() {
+  test_fixture::setUp();
+
+  char dir[] = "/tmp/libtorrent_test_file_list.XXXXXX";
+  CPPUNIT_ASSERT(mkdtemp(dir) != nullptr);
+
+  m_dir = dir;
+
+  // FileList::create_chunk uses the global chunk and file managers.
+  mock_redirect_defaults();
+  set_create_poll();
+  torrent::ThreadMain::create_thread();
+  torrent::thread_main()->init_thread();
+
+  torrent::manager = new torrent::Manager;
+  torrent::manager->file_manager()->set_max_open_files(16);
+}
+
+void
+test_file_list::tearDown() {
+  delete torrent::manager;
+  torrent::manager = nullptr;
+
+  delete torrent::thread_main();
+
+  std::system(("rm -rf '" + m_dir + "'").c_str());
+
+  test_fixture::tearDown();
+}
+
+void
+test_file_list::test_mapped_parts() {
+  CPPUNIT_ASSERT(torrent::manager->chunk_manager()->buffered_part_size() == 0);
+
+  file_list_access file_list;
+  open_file_list(&file_list, m_dir);
+
+  std::unique_ptr<torrent::Chunk> chunk(file_list.create_chunk_index(0, torrent::MemoryChunk::prot_read));
+  verify_chunk(chunk.get());
+
+  for (auto& part : *chunk)
+    CPPUNIT_ASSERT(part.mapped() == torrent::ChunkPart::MAPPED_MMAP);
+
+  chunk.reset();
+  file_list.close();
+}
+
+void
+test_file_list::test_buffered_parts() {
+  torrent::manager->chunk_manager()->set_buffered_part_size(16 << 10);
+
+  file_list_access file_list;
+  open_file_list(&file_list, m_dir);
+
+  std::unique_ptr<torrent::Chunk> chunk(file_list.create_chunk_index(0, torrent::MemoryChunk::prot_read));
+  verify_chunk(chunk.get());
+
+  // Only the parts smaller than the limit are read into buffers.
+  auto itr = chunk->begin();
+  CPPUNIT_ASSERT(itr[0].mapped() == torrent::ChunkPart::MAPPED_BUFFER);
+  CPPUNIT_ASSERT(itr[1].mapped() == torrent::ChunkPart::MAPPED_BUFFER);
+  CPPUNIT_ASSERT(itr[2].mapped() == torrent::ChunkPart::MAPPED_MMAP);
+
+  chunk.reset();
+  file_list.close();
+}
@@ -0,0 +1,20 @@
+#include "helpers/test_fixture.h"
+
+class test_file_list : public test_fixture {
+  CPPUNIT_TEST_SUITE(test_file_list);
+
+  CPPUNIT_TEST(test_mapped_parts);
+  CPPUNIT_TEST(test_buffered_parts);
+
+  CPPUNIT_TEST_SUITE_END();
+
+public:
+  void setUp();
+  void tearDown();
+
+  void test_mapped_parts();
+  void test_buffered_parts();
+
+private:
+  std::string m_dir;
+};
@@ -0,0 +1,158 @@
+#include "config.h"
+
+#include "test_file_relocation.h"
+
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "data/file_relocation.h"
+
+CPPUNIT_TEST_SUITE_NAMED_REGISTRATION(test_file_relocation, "data");
+
+namespace {
+
+void
+write_file(const std::string& path, const std::string& data) {
+  std::ofstream(path, std::ios::binary) << data;
+}
+
+std::string
+read_file(const std::string& path) {
+  std::ifstream file(path, std::ios::binary);
+  std::stringstream stream;
+
+  if (!file)
+    return "<none>";
+
+  stream << file.rdbuf();
+  return stream.str();
+}
+
+bool
+exists(const std::string& path) {
+  struct stat st;
+  return ::stat(path.c_str(), &st) == 0;
+}
+
+}
+
+void
+test_file_relocation::setUp() {
+  test_fixture::setUp();
+
+  char dir[] = "/tmp/libtorrent_test_file_relocation.XXXXXX";
+  CPPUNIT_ASSERT(mkdtemp(dir) != nullptr);
+
+  m_dir = dir;
+}
+
+void
+test_file_relocation::tearDown() {
+  std::system(("rm -rf '" + m_dir + "'").c_str());
+
+  test_fixture::tearDown();
+}
+
+void
+test_file_relocation::test_copy_file() {
+  std::string error;
+  std::string data(3 << 20, 'x');
+  data[12345] = 'y';
+
+  write_file(m_dir + "/source", data);
+
+  CPPUNIT_ASSERT(torrent::relocation_copy_file(m_dir + "/source", m_dir + "/target", &error));
+  CPPUNIT_ASSERT(error.empty());
+  CPPUNIT_ASSERT(read_file(m_dir + "/target") == data);
+
+  write_file(m_dir + "/empty", "");
+
+  CPPUNIT_ASSERT(torrent::relocation_copy_file(m_dir + "/empty", m_dir + "/empty_target", &error));
+  CPPUNIT_ASSERT(read_file(m_dir + "/empty_target").empty());
+
+  CPPUNIT_ASSERT(!torrent::relocation_copy_file(m_dir + "/missing", m_dir + "/missing_target", &error));
+  CPPUNIT_ASSERT(!error.empty());
+  CPPUNIT_ASSERT(!exists(m_dir + "/missing_target"));
+}
+
+void
+test_file_relocation::test_copy_and_remove() {
+  std::string old_root = m_dir + "/old";
+  std::string new_root = m_dir + "/new";
+
+  CPPUNIT_ASSERT(mkdir(old_root.c_str(), 0777) == 0);
+  CPPUNIT_ASSERT(mkdir((old_root + "/a").c_str(), 0777) == 0);
+  CPPUNIT_ASSERT(mkdir((old_root + "/a/b").c_str(), 0777) == 0);
+  CPPUNIT_ASSERT(mkdir((old_root + "/empty").c_str(), 0777) == 0);
+
+  write_file(old_root + "/top", "top");
+  write_file(old_root + "/a/b/deep", "deep");
+
+  torrent::relocation_list entries{
+    { old_root + "/top", new_root + "/top" },
+    { old_root + "/a/b/deep", new_root + "/a/b/deep" },
+    { old_root + "/empty/", new_root + "/empty/" },
+  };
+
+  CPPUNIT_ASSERT(torrent::relocation_copy(entries, new_root).empty());
+
+  CPPUNIT_ASSERT(read_file(new_root + "/top") == "top");
+  CPPUNIT_ASSERT(read_file(new_root + "/a/b/deep") == "deep");
+  CPPUNIT_ASSERT(exists(new_root + "/empty"));
+
+  torrent::relocation_remove_sources(entries, old_root);
+
+  CPPUNIT_ASSERT(!exists(old_root + "/top"));
+  CPPUNIT_ASSERT(!exists(old_root + "/a"));
+  CPPUNIT_ASSERT(!exists(old_root + "/empty"));
+  CPPUNIT_ASSERT(exists(old_root));
+}
+
+void
+test_file_relocation::test_copy_failure() {
+  std::string old_root = m_dir + "/old";
+  std::string new_root = m_dir + "/new";
+
+  CPPUNIT_ASSERT(mkdir(old_root.c_str(), 0777) == 0);
+  CPPUNIT_ASSERT(mkdir(new_root.c_str(), 0777) == 0);
+
+  write_file(old_root + "/first", "first");
+
+  torrent::relocation_list entries{
+    { old_root + "/first", new_root + "/dir/first" },
+    { old_root + "/missing", new_root + "/dir/missing" },
+  };
+
+  CPPUNIT_ASSERT(!torrent::relocation_copy(entries, new_root).empty());
+
+  CPPUNIT_ASSERT(!exists(new_root + "/dir"));
+  CPPUNIT_ASSERT(exists(new_root));
+  CPPUNIT_ASSERT(read_file(old_root + "/first") == "first");
+}
+
+void
+test_file_relocation::test_link_file() {
+  std::string error;
+  struct stat source_stat;
+  struct stat target_stat;
+
+  write_file(m_dir + "/source", "shared");
+  write_file(m_dir + "/target", "old");
+
+  CPPUNIT_ASSERT(torrent::relocation_link_file(m_dir + "/source", m_dir + "/target", &error));
+  CPPUNIT_ASSERT(torrent::relocation_link_file(m_dir + "/source", m_dir + "/dir/target", &error));
+  CPPUNIT_ASSERT(torrent::relocation_link_file(m_dir + "/source", m_dir + "/target", &error));
+
+  CPPUNIT_ASSERT(::stat((m_dir + "/source").c_str(), &source_stat) == 0);
+  CPPUNIT_ASSERT(::stat((m_dir + "/target").c_str(), &target_stat) == 0);
+  CPPUNIT_ASSERT(source_stat.st_ino == target_stat.st_ino);
+  CPPUNIT_ASSERT(read_file(m_dir + "/dir/target") == "shared");
+  CPPUNIT_ASSERT(!exists(m_dir + "/target.link"));
+
+  CPPUNIT_ASSERT(!torrent::relocation_link_file(m_dir + "/missing", m_dir + "/target", &error));
+  CPPUNIT_ASSERT(read_file(m_dir + "/target") == "shared");
+}
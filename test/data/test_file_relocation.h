@@ -0,0 +1,24 @@
+#include "helpers/test_fixture.h"
+
+class test_file_relocation : public test_fixture {
+  CPPUNIT_TEST_SUITE(test_file_relocation);
+
+  CPPUNIT_TEST(test_copy_file);
+  CPPUNIT_TEST(test_copy_and_remove);
+  CPPUNIT_TEST(test_copy_failure);
+  CPPUNIT_TEST(test_link_file);
+
+  CPPUNIT_TEST_SUITE_END();
+
+public:
+  void setUp();
+  void tearDown();
+
+  void test_copy_file();
+  void test_copy_and_remove();
+  void test_copy_failure();
+  void test_link_file();
+
+private:
+  std::string m_dir;
+};
@@ -11,6 +11,7 @@
 #include "data/chunk_handle.h"
 #include "data/thread_disk.h"
 #include "utils/sha1.h"
+#include "utils/sha1_multi.h"
 #include "torrent/chunk_manager.h"
 #include "torrent/exceptions.h"
 
@@ -107,6 +108,29 @@ test_hash_check_queue::test_single() {
   CLEANUP_CHUNK_LIST();
 }
 
+void
+test_hash_check_queue::test_cancelled() {
+  SETUP_CHUNK_LIST();
+  torrent::HashCheckQueue hash_queue;
+
+  done_chunks_type done_chunks;
+  hash_queue.slot_chunk_done() = std::bind(&chunk_done, &done_chunks, std::placeholders::_1, std::placeholders::_2);
+
+  torrent::ChunkHandle handle_0 = chunk_list->get(0, torrent::ChunkList::get_blocking);
+
+  hash_queue.push_back(new torrent::HashChunk(handle_0));
+  hash_queue.front()->cancel();
+  hash_queue.perform();
+
+  // Cancelled chunks are passed on without being hashed.
+  CPPUNIT_ASSERT(done_chunks.find(0) != done_chunks.end());
+  CPPUNIT_ASSERT(done_chunks[0] != hash_for_index(0));
+
+  chunk_list->release(&handle_0);
+
+  CLEANUP_CHUNK_LIST();
+}
+
 void
 test_hash_check_queue::test_multiple() {
   SETUP_CHUNK_LIST();
@@ -120,11 +144,13 @@ test_hash_check_queue::test_multiple() {
   for (unsigned int i = 0; i < 20; i++) {
     handles.push_back(chunk_list->get(i, torrent::ChunkList::get_blocking));
 
-    hash_queue.push_back(new torrent::HashChunk(handles.back()));
+    auto hash_chunk = new torrent::HashChunk(handles.back());
+    hash_queue.push_back(hash_chunk);
 
     CPPUNIT_ASSERT(hash_queue.size() == i + 1);
-    CPPUNIT_ASSERT(hash_queue.back()->handle().is_blocking());
-    CPPUNIT_ASSERT(hash_queue.back()->handle().object() == &((*chunk_list)[i]));
+    CPPUNIT_ASSERT(hash_queue.front()->handle().object() == &((*chunk_list)[0]));
+    CPPUNIT_ASSERT(hash_chunk->handle().is_blocking());
+    CPPUNIT_ASSERT(hash_chunk->handle().object() == &((*chunk_list)[i]));
   }
 
   hash_queue.perform();
@@ -173,6 +199,178 @@ test_hash_check_queue::test_erase() {
   // CLEANUP_CHUNK_LIST();
 }
 
+void
+test_hash_check_queue::test_workers() {
+  SETUP_CHUNK_LIST();
+  torrent::HashCheckQueue hash_queue;
+
+  done_chunks_type done_chunks;
+  hash_queue.slot_chunk_done() = std::bind(&chunk_done, &done_chunks, std::placeholders::_1, std::placeholders::_2);
+
+  hash_queue.start_workers(4);
+  CPPUNIT_ASSERT(hash_queue.worker_count() == 4);
+
+  handle_list handles;
+
+  for (unsigned int i = 0; i < 20; i++) {
+    handles.push_back(chunk_list->get(i, torrent::ChunkList::get_blocking));
+    hash_queue.push_back(new torrent::HashChunk(handles.back()));
+  }
+
+  for (unsigned int i = 0; i < 20; i++)
+    CPPUNIT_ASSERT(wait_for_true(std::bind(&verify_hash, &done_chunks, i, hash_for_index(i))));
+
+  hash_queue.stop_workers();
+  CPPUNIT_ASSERT(hash_queue.worker_count() == 0);
+  CPPUNIT_ASSERT(hash_queue.empty());
+
+  for (auto& handle : handles)
+    chunk_list->release(&handle);
+
+  CLEANUP_CHUNK_LIST();
+}
+
+void
+test_hash_check_queue::test_multi_buffer() {
+  // Cover the block boundaries, including lengths needing two padding
+  // blocks.
+  const uint32_t lengths[] = { 0, 1, 55, 56, 63, 64, 65, 119, 120, 1000, 1 << 16 };
+
+  std::vector<std::string> data;
+
+  for (unsigned int i = 0; i < torrent::sha1_multi_max_lanes; i++) {
+    std::string buffer(1 << 16, '\0');
+
+    for (unsigned int j = 0; j < buffer.size(); j++)
+      buffer[j] = char(i * 31 + j * 7 + (j >> 8));
+
+    data.push_back(buffer);
+  }
+
+  const char* buffers[torrent::sha1_multi_max_lanes];
+
+  for (unsigned int i = 0; i < torrent::sha1_multi_max_lanes; i++)
+    buffers[i] = data[i].c_str();
+
+  for (auto length : lengths) {
+    for (unsigned int count = 1; count <= torrent::sha1_multi_max_lanes; count++) {
+      char expected[torrent::sha1_multi_max_lanes * 20];
+      torrent::sha1_multi(buffers, count, length, expected, torrent::SHA1_MULTI_ENGINE_EVP);
+
+      for (unsigned int i = 0; i < count; i++) {
+        char single[20];
+        torrent::Sha1 sha1;
+        sha1.init();
+        sha1.update(buffers[i], length);
+        sha1.final_c(single);
+
+        CPPUNIT_ASSERT(std::memcmp(single, expected + 20 * i, 20) == 0);
+      }
+
+#if defined(__x86_64__) || defined(__i386__)
+      if (!__builtin_cpu_supports("avx2"))
+        continue;
+
+      char result[torrent::sha1_multi_max_lanes * 20];
+      torrent::sha1_multi(buffers, count, length, result, torrent::SHA1_MULTI_ENGINE_AVX2);
+
+      CPPUNIT_ASSERT(std::memcmp(expected, result, 20 * count) == 0);
+#endif
+    }
+  }
+}
+
+void
+test_hash_check_queue::test_priority() {
+  SETUP_CHUNK_LIST();
+  torrent::HashCheckQueue hash_queue;
+
+  std::vector<uint32_t> order;
+  hash_queue.slot_chunk_done() = [&order](auto hash_chunk, const auto&) { order.push_back(hash_chunk->handle().index()); };
+
+  int owner_a = 0;
+  int owner_b = 0;
+
+  const struct { torrent::HashChunk::priority_type priority; const void* owner; } chunks[] = {
+    { torrent::HashChunk::priority_background, &owner_a },
+    { torrent::HashChunk::priority_recheck,    &owner_a },
+    { torrent::HashChunk::priority_recheck,    &owner_a },
+    { torrent::HashChunk::priority_recheck,    &owner_b },
+    { torrent::HashChunk::priority_verify,     &owner_b },
+  };
+
+  handle_list handles;
+
+  for (unsigned int i = 0; i < 5; i++) {
+    handles.push_back(chunk_list->get(i, torrent::ChunkList::get_blocking));
+
+    auto hash_chunk = new torrent::HashChunk(handles.back());
+    hash_chunk->set_priority(chunks[i].priority);
+    hash_chunk->set_owner(chunks[i].owner);
+
+    hash_queue.push_back(hash_chunk);
+  }
+
+  CPPUNIT_ASSERT(hash_queue.size() == 5);
+  torrent::HashChunk* verify_chunk = hash_queue.front();
+  CPPUNIT_ASSERT(verify_chunk->handle().index() == 4);
+
+  CPPUNIT_ASSERT(hash_queue.remove(verify_chunk));
+  CPPUNIT_ASSERT(hash_queue.size() == 4);
+  delete verify_chunk;
+
+  hash_queue.perform();
+
+  // Owners take turns within a priority class.
+  CPPUNIT_ASSERT((order == std::vector<uint32_t>{ 1, 3, 2, 0 }));
+  CPPUNIT_ASSERT(hash_queue.empty());
+
+  for (auto& handle : handles)
+    chunk_list->release(&handle);
+
+  CLEANUP_CHUNK_LIST();
+}
+
+void
+test_hash_check_queue::test_weight() {
+  SETUP_CHUNK_LIST();
+  torrent::HashCheckQueue hash_queue;
+  torrent::DiskThrottle   throttle;
+
+  hash_queue.set_disk_throttle(&throttle);
+
+  std::vector<uint32_t> order;
+  hash_queue.slot_chunk_done() = [&order](auto hash_chunk, const auto&) { order.push_back(hash_chunk->handle().index()); };
+
+  int owner_a = 0;
+  int owner_b = 0;
+
+  handle_list handles;
+
+  for (unsigned int i = 0; i < 6; i++) {
+    handles.push_back(chunk_list->get(i, torrent::ChunkList::get_blocking));
+
+    auto hash_chunk = new torrent::HashChunk(handles.back());
+    hash_chunk->set_priority(torrent::HashChunk::priority_recheck);
+    hash_chunk->set_owner(i < 3 ? &owner_a : &owner_b);
+    hash_chunk->set_weight(i < 3 ? 2 : 1);
+
+    hash_queue.push_back(hash_chunk);
+  }
+
+  hash_queue.perform();
+
+  // Owners take as many chunks per turn as their weight.
+  CPPUNIT_ASSERT((order == std::vector<uint32_t>{ 0, 1, 3, 2, 4, 5 }));
+  // Each test chunk holds 10 bytes.
+  CPPUNIT_ASSERT(throttle.total(torrent::DiskThrottle::class_hash) == 6 * 10);
+
+  for (auto& handle : handles)
+    chunk_list->release(&handle);
+
+  CLEANUP_CHUNK_LIST();
+}
+
 void
 test_hash_check_queue::test_thread_interrupt() {
   SETUP_CHUNK_LIST();
@@ -15,6 +15,11 @@ class test_hash_check_queue : public test_fixture {
   CPPUNIT_TEST(test_single);
   CPPUNIT_TEST(test_multiple);
   CPPUNIT_TEST(test_erase);
+  CPPUNIT_TEST(test_workers);
+  CPPUNIT_TEST(test_multi_buffer);
+  CPPUNIT_TEST(test_cancelled);
+  CPPUNIT_TEST(test_priority);
+  CPPUNIT_TEST(test_weight);
 
   CPPUNIT_TEST(test_thread_interrupt);
 
@@ -26,7 +31,12 @@ public:
 
   void test_single();
   void test_multiple();
+  void test_cancelled();
   void test_erase();
+  void test_workers();
+  void test_multi_buffer();
+  void test_priority();
+  void test_weight();
 
   void test_thread_interrupt();
 };
@@ -8,13 +8,19 @@
 #include "globals.h"
 #include "data/hash_queue.h"
 #include "data/hash_queue_node.h"
+#include "rak/socket_address.h"
 #include "torrent/chunk_manager.h"
 #include "torrent/exceptions.h"
 #include "torrent/hash_string.h"
+#include "torrent/data/block.h"
+#include "torrent/data/block_list.h"
+#include "torrent/data/block_transfer.h"
+#include "torrent/peer/peer_info.h"
 #include "data/thread_disk.h"
 
 #include "test_chunk_list.h"
 #include "test_hash_check_queue.h"
+#include "helpers/test_main_thread.h"
 #include "helpers/test_thread.h"
 #include "helpers/test_utils.h"
 
@@ -169,6 +175,64 @@ test_hash_queue::test_erase_stress() {
   CLEANUP_CHUNK_LIST();
 }
 
+static void
+finish_block(torrent::BlockList* block_list, uint32_t index, torrent::PeerInfo* peer_info, torrent::Chunk* chunk) {
+  torrent::Block* block = &(*block_list)[index];
+  torrent::BlockTransfer* transfer = block->insert(peer_info);
+
+  block->transfering(transfer);
+  transfer->adjust_position(block->piece().length());
+
+  block_list->hash_finished_blocks(chunk);
+  block->completed(transfer);
+}
+
+void
+test_hash_queue::test_incremental() {
+  auto test_main_thread = TestMainThread::create();
+  test_main_thread->init_thread();
+
+  SETUP_CHUNK_LIST();
+  SETUP_THREAD_DISK();
+  SETUP_HASH_QUEUE();
+
+  rak::socket_address sa;
+  torrent::PeerInfo peer_info(sa.c_sockaddr());
+
+  torrent::ChunkHandle handle = chunk_list->get(0, torrent::ChunkList::get_blocking);
+  torrent::BlockList block_list(torrent::Piece(0, 0, 10), 3);
+
+  // Blocks after a gap are hashed once it is filled.
+  finish_block(&block_list, 1, &peer_info, handle.chunk());
+  CPPUNIT_ASSERT(block_list.hash_position() == 0);
+
+  finish_block(&block_list, 0, &peer_info, handle.chunk());
+  CPPUNIT_ASSERT(block_list.hash_position() == 6);
+
+  finish_block(&block_list, 3, &peer_info, handle.chunk());
+  CPPUNIT_ASSERT(block_list.hash_position() == 6);
+  CPPUNIT_ASSERT(!block_list.is_hash_complete());
+
+  finish_block(&block_list, 2, &peer_info, handle.chunk());
+  CPPUNIT_ASSERT(block_list.is_hash_complete());
+
+  torrent::HashString hash;
+  block_list.hash_final(hash.data());
+  CPPUNIT_ASSERT(block_list.hash_position() == 0);
+
+  hash_queue->push_back_hashed(handle, NULL, hash, std::bind(&chunk_done, chunk_list, &done_chunks, std::placeholders::_1, std::placeholders::_2));
+  CPPUNIT_ASSERT(torrent::thread_disk()->hash_check_queue()->empty());
+
+  hash_queue->work();
+  CPPUNIT_ASSERT(hash_queue->empty());
+  CPPUNIT_ASSERT(done_chunks[0] == hash_for_index(0));
+
+  delete hash_queue;
+
+  CLEANUP_THREAD_DISK();
+  CLEANUP_CHUNK_LIST();
+}
+
 // Test erase of different id's.
 
 // Current code doesn't work well if we remove a hash...
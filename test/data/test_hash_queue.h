@@ -7,6 +7,7 @@ class test_hash_queue : public test_fixture {
   CPPUNIT_TEST(test_multiple);
   CPPUNIT_TEST(test_erase);
   CPPUNIT_TEST(test_erase_stress);
+  CPPUNIT_TEST(test_incremental);
 
   CPPUNIT_TEST_SUITE_END();
 
@@ -18,5 +19,6 @@ public:
   void test_multiple();
   void test_erase();
   void test_erase_stress();
+  void test_incremental();
 };
 
@@ -0,0 +1,27 @@
+#include "config.h"
+
+#include "test_hash_torrent.h"
+
+#include <vector>
+
+#include "data/hash_torrent.h"
+
+CPPUNIT_TEST_SUITE_NAMED_REGISTRATION(test_hash_torrent, "data");
+
+void
+test_hash_torrent::test_physical_order() {
+  torrent::HashTorrent::Ranges ranges;
+  ranges.insert(0, 5);
+
+  std::vector<uint64_t> addresses{ 50, 10, ~uint64_t(), 30, 20 };
+
+  CPPUNIT_ASSERT((torrent::HashTorrent::physical_order(ranges, addresses) == std::vector<uint32_t>{ 1, 4, 3, 0, 2 }));
+
+  // Chunks outside the ranges or past the known addresses are skipped.
+  ranges.clear();
+  ranges.insert(1, 3);
+  ranges.insert(4, 8);
+
+  CPPUNIT_ASSERT((torrent::HashTorrent::physical_order(ranges, addresses) == std::vector<uint32_t>{ 1, 4, 2 }));
+  CPPUNIT_ASSERT(torrent::HashTorrent::physical_order(ranges, std::vector<uint64_t>()).empty());
+}
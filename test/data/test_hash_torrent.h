@@ -0,0 +1,12 @@
+#include "helpers/test_fixture.h"
+
+class test_hash_torrent : public test_fixture {
+  CPPUNIT_TEST_SUITE(test_hash_torrent);
+
+  CPPUNIT_TEST(test_physical_order);
+
+  CPPUNIT_TEST_SUITE_END();
+
+public:
+  void test_physical_order();
+};
@@ -0,0 +1,88 @@
+#include "config.h"
+
+#include "test_io_priority.h"
+
+#include <thread>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "data/io_priority.h"
+
+CPPUNIT_TEST_SUITE_NAMED_REGISTRATION(test_io_priority, "data");
+
+using namespace torrent;
+
+// The I/O priority of the calling thread, or -1 if unsupported.
+static int
+thread_io_priority() {
+#ifdef SYS_ioprio_get
+  return syscall(SYS_ioprio_get, 1, 0);
+#else
+  return -1;
+#endif
+}
+
+// The threads only record what they observe, as a failed assertion
+// would throw on the worker thread and terminate the test runner.
+
+void
+test_io_priority::test_disabled() {
+  int initial = 0;
+  io_class_type current_class{};
+  int priority = 0;
+
+  std::thread([&] {
+      io_priority_set_enabled(false);
+      initial = thread_io_priority();
+
+      io_priority_set(io_class_recheck);
+
+      current_class = io_priority_current();
+      priority = thread_io_priority();
+    }).join();
+
+  CPPUNIT_ASSERT(current_class == io_class_default);
+  CPPUNIT_ASSERT(priority == initial);
+}
+
+void
+test_io_priority::test_classes() {
+  io_class_type upload_class{};
+  int upload_priority = 0;
+  io_class_type recheck_class{};
+  int recheck_priority = 0;
+  io_class_type disabled_class{};
+  int disabled_priority = 0;
+
+  std::thread([&] {
+      io_priority_set_enabled(true);
+
+      io_priority_set(io_class_upload);
+      upload_class = io_priority_current();
+      upload_priority = thread_io_priority();
+
+      io_priority_set(io_class_recheck);
+      recheck_class = io_priority_current();
+      recheck_priority = thread_io_priority();
+
+      // Disabling resets the thread on its next job.
+      io_priority_set_enabled(false);
+      io_priority_set(io_class_write);
+
+      disabled_class = io_priority_current();
+      disabled_priority = thread_io_priority();
+    }).join();
+
+  CPPUNIT_ASSERT(upload_class == io_class_upload);
+
+  if (upload_priority != -1)
+    CPPUNIT_ASSERT(upload_priority == (2 << 13 | 0));
+
+  CPPUNIT_ASSERT(recheck_class == io_class_recheck);
+
+  if (recheck_priority != -1)
+    CPPUNIT_ASSERT(recheck_priority >> 13 == 3);
+
+  CPPUNIT_ASSERT(disabled_class == io_class_default);
+  CPPUNIT_ASSERT(disabled_priority >> 13 != 3);
+}
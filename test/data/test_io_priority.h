@@ -0,0 +1,14 @@
+#include "helpers/test_fixture.h"
+
+class test_io_priority : public test_fixture {
+  CPPUNIT_TEST_SUITE(test_io_priority);
+
+  CPPUNIT_TEST(test_disabled);
+  CPPUNIT_TEST(test_classes);
+
+  CPPUNIT_TEST_SUITE_END();
+
+public:
+  void test_disabled();
+  void test_classes();
+};
@@ -0,0 +1,174 @@
+#include "config.h"
+
+#include "test_memory_governor.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <unistd.h>
+
+#include "data/memory_governor.h"
+#include "torrent/chunk_manager.h"
+
+CPPUNIT_TEST_SUITE_NAMED_REGISTRATION(test_memory_governor, "data");
+
+using torrent::MemoryGovernor;
+
+static constexpr uint64_t mib = uint64_t{1} << 20;
+
+static void
+write_file(const std::string& path, const std::string& content) {
+  std::FILE* file = std::fopen(path.c_str(), "w");
+  CPPUNIT_ASSERT(file != nullptr);
+
+  std::fputs(content.c_str(), file);
+  std::fclose(file);
+}
+
+static void
+write_cgroup(const std::string& path, const std::string& limit, uint64_t current, double pressure) {
+  char buffer[256];
+
+  write_file(path + "/memory.max", limit + "\n");
+  write_file(path + "/memory.current", std::to_string(current) + "\n");
+
+  std::snprintf(buffer, sizeof(buffer), "some avg10=%.2f avg60=0.00 avg300=0.00 total=0\nfull avg10=0.00 avg60=0.00 avg300=0.00 total=0\n", pressure);
+  write_file(path + "/memory.pressure", buffer);
+}
+
+void
+test_memory_governor::setUp() {
+  test_fixture::setUp();
+
+  char path[] = "/tmp/test_memory_governor.XXXXXX";
+  CPPUNIT_ASSERT(::mkdtemp(path) != nullptr);
+
+  m_path = path;
+}
+
+void
+test_memory_governor::tearDown() {
+  ::unlink((m_path + "/memory.max").c_str());
+  ::unlink((m_path + "/memory.current").c_str());
+  ::unlink((m_path + "/memory.pressure").c_str());
+  ::rmdir(m_path.c_str());
+
+  test_fixture::tearDown();
+}
+
+void
+test_memory_governor::test_read_sample() {
+  auto chunk_manager = std::make_unique<torrent::ChunkManager>();
+  MemoryGovernor governor(chunk_manager.get());
+
+  governor.set_cgroup_path(m_path);
+
+  MemoryGovernor::sample_type sample;
+  CPPUNIT_ASSERT(!governor.read_sample(&sample));
+  CPPUNIT_ASSERT(!governor.start(false));
+  CPPUNIT_ASSERT(!governor.is_active());
+
+  write_cgroup(m_path, "1073741824", 512 * mib, 12.5);
+
+  CPPUNIT_ASSERT(governor.read_sample(&sample));
+  CPPUNIT_ASSERT(sample.limit == 1024 * mib);
+  CPPUNIT_ASSERT(sample.current == 512 * mib);
+  CPPUNIT_ASSERT(sample.pressure == 12.5);
+
+  write_cgroup(m_path, "max", 512 * mib, 0);
+
+  CPPUNIT_ASSERT(governor.read_sample(&sample));
+  CPPUNIT_ASSERT(sample.limit == 0);
+  CPPUNIT_ASSERT(sample.pressure == 0);
+}
+
+void
+test_memory_governor::test_limit() {
+  auto chunk_manager = std::make_unique<torrent::ChunkManager>();
+  chunk_manager->set_max_memory_usage(1024 * mib);
+  chunk_manager->set_chunk_cache_size(128 * mib);
+
+  MemoryGovernor governor(chunk_manager.get());
+  governor.set_cgroup_path(m_path);
+
+  // The rest of the cgroup uses 200 MiB of the 1 GiB limit.
+  write_cgroup(m_path, std::to_string(1024 * mib), 200 * mib, 0);
+
+  CPPUNIT_ASSERT(governor.start(false));
+  CPPUNIT_ASSERT(governor.is_active());
+  CPPUNIT_ASSERT(governor.base_max_memory_usage() == 1024 * mib);
+  CPPUNIT_ASSERT(chunk_manager->max_memory_usage() == 824 * mib / 4 * 3);
+  CPPUNIT_ASSERT(chunk_manager->chunk_cache_size() == 128 * mib * (824 * mib / 4 * 3) / (1024 * mib));
+
+  // Without a limit the max grows back to the base gradually, by at
+  // least the minimum.
+  MemoryGovernor::sample_type sample{0, 200 * mib, 0};
+
+  governor.update(sample);
+  CPPUNIT_ASSERT(chunk_manager->max_memory_usage() == 824 * mib / 4 * 3 + MemoryGovernor::min_memory_usage);
+
+  for (int i = 0; i < 10; i++)
+    governor.update(sample);
+
+  CPPUNIT_ASSERT(chunk_manager->max_memory_usage() == 1024 * mib);
+  CPPUNIT_ASSERT(chunk_manager->chunk_cache_size() == 128 * mib);
+
+  // A limit below the minimum still leaves the minimum.
+  governor.update(MemoryGovernor::sample_type{32 * mib, 32 * mib, 0});
+  CPPUNIT_ASSERT(chunk_manager->max_memory_usage() == MemoryGovernor::min_memory_usage);
+}
+
+void
+test_memory_governor::test_pressure() {
+  auto chunk_manager = std::make_unique<torrent::ChunkManager>();
+  chunk_manager->set_max_memory_usage(1024 * mib);
+
+  MemoryGovernor governor(chunk_manager.get());
+  governor.set_cgroup_path(m_path);
+
+  write_cgroup(m_path, "max", 200 * mib, 0);
+
+  CPPUNIT_ASSERT(governor.start(false));
+  CPPUNIT_ASSERT(chunk_manager->max_memory_usage() == 1024 * mib);
+  CPPUNIT_ASSERT(!chunk_manager->is_preload_paused());
+  CPPUNIT_ASSERT(chunk_manager->preload_budget() == 1024 * mib / 16);
+
+  governor.update(MemoryGovernor::sample_type{0, 200 * mib, MemoryGovernor::pressure_threshold});
+
+  CPPUNIT_ASSERT(governor.is_under_pressure());
+  CPPUNIT_ASSERT(chunk_manager->max_memory_usage() == 896 * mib);
+  CPPUNIT_ASSERT(chunk_manager->is_preload_paused());
+  CPPUNIT_ASSERT(chunk_manager->preload_budget() == 0);
+
+  governor.update(MemoryGovernor::sample_type{0, 200 * mib, MemoryGovernor::pressure_threshold});
+  CPPUNIT_ASSERT(chunk_manager->max_memory_usage() == 784 * mib);
+
+  governor.update(MemoryGovernor::sample_type{0, 200 * mib, 1.0});
+
+  CPPUNIT_ASSERT(!governor.is_under_pressure());
+  CPPUNIT_ASSERT(chunk_manager->max_memory_usage() == 784 * mib + MemoryGovernor::min_memory_usage);
+  CPPUNIT_ASSERT(!chunk_manager->is_preload_paused());
+}
+
+void
+test_memory_governor::test_stop() {
+  auto chunk_manager = std::make_unique<torrent::ChunkManager>();
+  chunk_manager->set_max_memory_usage(1024 * mib);
+  chunk_manager->set_chunk_cache_size(64 * mib);
+
+  MemoryGovernor governor(chunk_manager.get());
+  governor.set_cgroup_path(m_path);
+
+  write_cgroup(m_path, std::to_string(512 * mib), 0, 50.0);
+
+  CPPUNIT_ASSERT(governor.start(false));
+  CPPUNIT_ASSERT(chunk_manager->max_memory_usage() == 384 * mib);
+  CPPUNIT_ASSERT(chunk_manager->is_preload_paused());
+
+  governor.stop();
+
+  CPPUNIT_ASSERT(!governor.is_active());
+  CPPUNIT_ASSERT(chunk_manager->max_memory_usage() == 1024 * mib);
+  CPPUNIT_ASSERT(chunk_manager->chunk_cache_size() == 64 * mib);
+  CPPUNIT_ASSERT(!chunk_manager->is_preload_paused());
+}
@@ -0,0 +1,24 @@
+#include "helpers/test_fixture.h"
+
+class test_memory_governor : public test_fixture {
+  CPPUNIT_TEST_SUITE(test_memory_governor);
+
+  CPPUNIT_TEST(test_read_sample);
+  CPPUNIT_TEST(test_limit);
+  CPPUNIT_TEST(test_pressure);
+  CPPUNIT_TEST(test_stop);
+
+  CPPUNIT_TEST_SUITE_END();
+
+public:
+  void setUp();
+  void tearDown();
+
+  void test_read_sample();
+  void test_limit();
+  void test_pressure();
+  void test_stop();
+
+private:
+  std::string m_path;
+};
@@ -0,0 +1,129 @@
+#include "config.h"
+
+#include "test_metadata_cache.h"
+
+#include <cstring>
+#include <memory>
+
+#include "data/metadata_cache.h"
+#include "torrent/chunk_manager.h"
+
+CPPUNIT_TEST_SUITE_NAMED_REGISTRATION(test_metadata_cache, "data");
+
+// The cache only uses the download as a key.
+static torrent::DownloadMain*
+fake_download(uintptr_t id) {
+  return reinterpret_cast<torrent::DownloadMain*>(id);
+}
+
+static torrent::DataBuffer
+make_buffer(size_t length, char c = 'x') {
+  auto data = new char[length];
+  std::memset(data, c, length);
+
+  return torrent::DataBuffer(data, data + length);
+}
+
+void
+test_metadata_cache::test_basic() {
+  auto chunk_manager = std::make_unique<torrent::ChunkManager>();
+  torrent::MetadataCache* cache = chunk_manager->metadata_cache();
+
+  CPPUNIT_ASSERT(cache->max_size() == torrent::ChunkManager::default_metadata_cache_size);
+  CPPUNIT_ASSERT(cache->find(fake_download(1)).empty());
+  CPPUNIT_ASSERT(cache->misses() == 1);
+
+  torrent::DataBuffer buffer = cache->insert(fake_download(1), make_buffer(1000));
+
+  CPPUNIT_ASSERT(buffer.shared());
+  CPPUNIT_ASSERT(cache->size() == 1000);
+  CPPUNIT_ASSERT(cache->entries() == 1);
+  CPPUNIT_ASSERT(chunk_manager->memory_usage() == 1000);
+
+  torrent::DataBuffer found = cache->find(fake_download(1));
+
+  CPPUNIT_ASSERT(found.data() == buffer.data());
+  CPPUNIT_ASSERT(cache->hits() == 1);
+
+  found.clear();
+  buffer.clear();
+
+  cache->erase(fake_download(1));
+
+  CPPUNIT_ASSERT(cache->size() == 0);
+  CPPUNIT_ASSERT(cache->entries() == 0);
+  CPPUNIT_ASSERT(chunk_manager->memory_usage() == 0);
+}
+
+void
+test_metadata_cache::test_lru() {
+  auto chunk_manager = std::make_unique<torrent::ChunkManager>();
+  torrent::MetadataCache* cache = chunk_manager->metadata_cache();
+
+  chunk_manager->set_metadata_cache_size(3000);
+
+  cache->insert(fake_download(1), make_buffer(1000)).clear();
+  cache->insert(fake_download(2), make_buffer(1000)).clear();
+  cache->insert(fake_download(3), make_buffer(1000)).clear();
+
+  cache->find(fake_download(1)).clear();
+  cache->insert(fake_download(4), make_buffer(1000)).clear();
+
+  CPPUNIT_ASSERT(cache->entries() == 3);
+  CPPUNIT_ASSERT(cache->evictions() == 1);
+  CPPUNIT_ASSERT(cache->find(fake_download(2)).empty());
+  CPPUNIT_ASSERT(!cache->find(fake_download(1)).empty());
+
+  cache->evict(1500);
+
+  CPPUNIT_ASSERT(cache->entries() == 1);
+  CPPUNIT_ASSERT(cache->size() == 1000);
+  CPPUNIT_ASSERT(!cache->find(fake_download(1)).empty());
+
+  cache->clear();
+
+  CPPUNIT_ASSERT(chunk_manager->memory_usage() == 0);
+}
+
+void
+test_metadata_cache::test_max_size() {
+  auto chunk_manager = std::make_unique<torrent::ChunkManager>();
+  torrent::MetadataCache* cache = chunk_manager->metadata_cache();
+
+  chunk_manager->set_metadata_cache_size(1000);
+
+  // Buffers too large for the cache are still returned shared.
+  torrent::DataBuffer buffer = cache->insert(fake_download(1), make_buffer(2000));
+
+  CPPUNIT_ASSERT(buffer.shared());
+  CPPUNIT_ASSERT(buffer.length() == 2000);
+  CPPUNIT_ASSERT(cache->entries() == 0);
+  buffer.clear();
+
+  cache->insert(fake_download(2), make_buffer(1000)).clear();
+  CPPUNIT_ASSERT(cache->entries() == 1);
+
+  chunk_manager->set_metadata_cache_size(0);
+
+  CPPUNIT_ASSERT(cache->entries() == 0);
+  CPPUNIT_ASSERT(chunk_manager->memory_usage() == 0);
+}
+
+void
+test_metadata_cache::test_slice() {
+  auto chunk_manager = std::make_unique<torrent::ChunkManager>();
+  torrent::MetadataCache* cache = chunk_manager->metadata_cache();
+
+  torrent::DataBuffer buffer = cache->insert(fake_download(1), make_buffer(1000, 'a'));
+  torrent::DataBuffer slice = buffer.slice(900, 100);
+
+  buffer.clear();
+  cache->erase(fake_download(1));
+
+  // The slice keeps the evicted buffer alive.
+  CPPUNIT_ASSERT(slice.shared());
+  CPPUNIT_ASSERT(slice.length() == 100);
+  CPPUNIT_ASSERT(slice.data()[0] == 'a' && slice.data()[99] == 'a');
+
+  slice.clear();
+}
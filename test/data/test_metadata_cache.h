@@ -0,0 +1,18 @@
+#include "helpers/test_fixture.h"
+
+class test_metadata_cache : public test_fixture {
+  CPPUNIT_TEST_SUITE(test_metadata_cache);
+
+  CPPUNIT_TEST(test_basic);
+  CPPUNIT_TEST(test_lru);
+  CPPUNIT_TEST(test_max_size);
+  CPPUNIT_TEST(test_slice);
+
+  CPPUNIT_TEST_SUITE_END();
+
+public:
+  void test_basic();
+  void test_lru();
+  void test_max_size();
+  void test_slice();
+};
@@ -0,0 +1,163 @@
+#include "config.h"
+
+#include "test_sync_scheduler.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <unistd.h>
+
+#include "data/chunk.h"
+#include "data/chunk_buffer_pool.h"
+#include "data/sync_scheduler.h"
+#include "torrent/exceptions.h"
+#include "torrent/data/file.h"
+#include "torrent/utils/latency_histogram.h"
+
+CPPUNIT_TEST_SUITE_NAMED_REGISTRATION(test_sync_scheduler, "data");
+
+void
+test_sync_scheduler::test_latency_histogram() {
+  using torrent::utils::latency_histogram;
+  using std::chrono::microseconds;
+
+  CPPUNIT_ASSERT(latency_histogram::bucket_index(microseconds(0)) == 0);
+  CPPUNIT_ASSERT(latency_histogram::bucket_index(microseconds(999)) == 0);
+  CPPUNIT_ASSERT(latency_histogram::bucket_index(microseconds(1000)) == 1);
+  CPPUNIT_ASSERT(latency_histogram::bucket_index(microseconds(3999)) == 2);
+  CPPUNIT_ASSERT(latency_histogram::bucket_index(microseconds(4000)) == 3);
+  CPPUNIT_ASSERT(latency_histogram::bucket_index(std::chrono::hours(1)) == latency_histogram::bucket_count - 1);
+
+  latency_histogram histogram;
+
+  histogram.insert(microseconds(500));
+  histogram.insert(microseconds(1500));
+  histogram.insert(microseconds(-10));
+
+  CPPUNIT_ASSERT(histogram.total_count() == 3);
+  CPPUNIT_ASSERT(histogram.count(0) == 2);
+  CPPUNIT_ASSERT(histogram.count(1) == 1);
+  CPPUNIT_ASSERT(histogram.total() == microseconds(2000));
+  CPPUNIT_ASSERT(histogram.max() == microseconds(1500));
+
+  histogram.clear();
+  CPPUNIT_ASSERT(histogram.total_count() == 0);
+}
+
+static void
+push_buffer_part(torrent::Chunk& chunk, torrent::ChunkBufferPool& pool, torrent::File* file, uint64_t offset, uint32_t length, char c) {
+  torrent::MemoryChunk memory = pool.allocate(length, torrent::MemoryChunk::prot_read | torrent::MemoryChunk::prot_write);
+  std::memset(memory.begin(), c, length);
+
+  chunk.push_back(torrent::ChunkPart::MAPPED_BUFFER, memory);
+  chunk.back().set_file(file, offset);
+  chunk.back().set_buffer_pool(&pool);
+}
+
+void
+test_sync_scheduler::test_merge_ranges() {
+  char filename[] = "test_sync_scheduler.XXXXXX";
+  int fd = mkstemp(filename);
+
+  CPPUNIT_ASSERT(fd != -1);
+
+  torrent::ChunkBufferPool pool;
+  torrent::File file;
+
+  // Two adjacent chunks and one further away, the second chunk also
+  // has a part in another file.
+  torrent::File other_file;
+  char other_filename[] = "test_sync_scheduler.XXXXXX";
+  int other_fd = mkstemp(other_filename);
+
+  CPPUNIT_ASSERT(other_fd != -1);
+
+  torrent::Chunk first;
+  torrent::Chunk second;
+  torrent::Chunk third;
+
+  push_buffer_part(first, pool, &file, 0, 3000, 'a');
+  push_buffer_part(second, pool, &file, 3000, 2000, 'b');
+  push_buffer_part(second, pool, &other_file, 0, 1000, 'c');
+  push_buffer_part(third, pool, &file, 8000, 1000, 'd');
+
+  std::vector<int> first_fds{::dup(fd)};
+  std::vector<int> second_fds{::dup(fd), ::dup(other_fd)};
+  std::vector<int> third_fds{::dup(fd)};
+  std::vector<int> invalid_fds;
+
+  torrent::SyncScheduler scheduler;
+
+  CPPUNIT_ASSERT_THROW(scheduler.add(&first, torrent::MemoryChunk::sync_sync, &invalid_fds), torrent::internal_error);
+
+  scheduler.add(&first, torrent::MemoryChunk::sync_sync, &first_fds);
+  scheduler.add(&second, torrent::MemoryChunk::sync_async, &second_fds);
+  scheduler.add(&third, torrent::MemoryChunk::sync_async, &third_fds);
+  scheduler.perform();
+
+  CPPUNIT_ASSERT(scheduler.size() == 3);
+  CPPUNIT_ASSERT(scheduler.is_success(0) && scheduler.is_success(1) && scheduler.is_success(2));
+  CPPUNIT_ASSERT(scheduler.range_count() == 4);
+  CPPUNIT_ASSERT(scheduler.merged_count() == 3);
+
+  CPPUNIT_ASSERT(first_fds.empty() && second_fds.empty() && third_fds.empty());
+
+  char expected[9000];
+  char result[9000];
+
+  std::memset(expected, 'a', 3000);
+  std::memset(expected + 3000, 'b', 2000);
+  std::memset(expected + 5000, 0, 3000);
+  std::memset(expected + 8000, 'd', 1000);
+
+  CPPUNIT_ASSERT(pread(fd, result, sizeof(result), 0) == sizeof(result));
+  CPPUNIT_ASSERT(std::memcmp(result, expected, sizeof(expected)) == 0);
+
+  std::memset(expected, 'c', 1000);
+
+  CPPUNIT_ASSERT(pread(other_fd, result, 1000, 0) == 1000);
+  CPPUNIT_ASSERT(std::memcmp(result, expected, 1000) == 0);
+
+  ::close(fd);
+  ::close(other_fd);
+  std::remove(filename);
+  std::remove(other_filename);
+}
+
+void
+test_sync_scheduler::test_drop_cache() {
+  char filename[] = "test_sync_scheduler.XXXXXX";
+  int fd = mkstemp(filename);
+
+  CPPUNIT_ASSERT(fd != -1);
+
+  torrent::ChunkBufferPool pool;
+  torrent::File file;
+  torrent::Chunk chunk;
+
+  push_buffer_part(chunk, pool, &file, 4096, 4096, 'a');
+
+  std::vector<int> fds{::dup(fd)};
+
+  torrent::SyncScheduler scheduler;
+  scheduler.set_drop_cache(true);
+
+  CPPUNIT_ASSERT(scheduler.is_drop_cache());
+
+  scheduler.add(&chunk, torrent::MemoryChunk::sync_async, &fds);
+  scheduler.perform();
+
+  CPPUNIT_ASSERT(scheduler.is_success(0));
+  CPPUNIT_ASSERT(fds.empty());
+
+  char expected[4096];
+  char result[4096];
+
+  std::memset(expected, 'a', sizeof(expected));
+
+  CPPUNIT_ASSERT(pread(fd, result, sizeof(result), 4096) == sizeof(result));
+  CPPUNIT_ASSERT(std::memcmp(result, expected, sizeof(expected)) == 0);
+
+  ::close(fd);
+  std::remove(filename);
+}
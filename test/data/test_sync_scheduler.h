@@ -0,0 +1,16 @@
+#include "helpers/test_fixture.h"
+
+class test_sync_scheduler : public test_fixture {
+  CPPUNIT_TEST_SUITE(test_sync_scheduler);
+
+  CPPUNIT_TEST(test_latency_histogram);
+  CPPUNIT_TEST(test_merge_ranges);
+  CPPUNIT_TEST(test_drop_cache);
+
+  CPPUNIT_TEST_SUITE_END();
+
+public:
+  void test_latency_histogram();
+  void test_merge_ranges();
+  void test_drop_cache();
+};
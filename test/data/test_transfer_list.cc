@@ -0,0 +1,196 @@
+#include "config.h"
+
+#include "test_transfer_list.h"
+
+#include <cstring>
+#include <set>
+
+#include "data/chunk.h"
+#include "rak/socket_address.h"
+#include "test/helpers/test_main_thread.h"
+#include "torrent/chunk_manager.h"
+#include "torrent/data/block.h"
+#include "torrent/data/block_list.h"
+#include "torrent/data/block_transfer.h"
+#include "torrent/data/transfer_list.h"
+#include "torrent/peer/peer_info.h"
+
+#include "test_chunk_list.h"
+
+CPPUNIT_TEST_SUITE_NAMED_REGISTRATION(test_transfer_list, "data");
+
+// The chunks are 10 bytes, split into blocks of 3, 3, 3 and 1 bytes.
+static constexpr uint32_t test_block_size = 3;
+
+struct transfer_list_fixture {
+  transfer_list_fixture() {
+    transfer_list.slot_canceled()  = [](uint32_t) {};
+    transfer_list.slot_queued()    = [](uint32_t) {};
+    transfer_list.slot_completed() = [this](uint32_t) { completed++; };
+    transfer_list.slot_corrupt()   = [this](torrent::PeerInfo* p) { corrupt.insert(p); };
+
+    block_list = *transfer_list.insert(torrent::Piece(0, 0, 10), test_block_size);
+  }
+
+  void finish_block(uint32_t index, torrent::PeerInfo* peer_info, torrent::Chunk* chunk, char value) {
+    torrent::Block* block = &(*block_list)[index];
+    torrent::BlockTransfer* transfer = block->insert(peer_info);
+
+    char buffer[test_block_size];
+    std::memset(buffer, value, block->piece().length());
+    chunk->from_buffer(buffer, block->piece().offset(), block->piece().length());
+
+    block->transfering(transfer);
+    transfer->adjust_position(block->piece().length());
+    transfer_list.finished(transfer);
+  }
+
+  rak::socket_address         address;
+  torrent::PeerInfo           peer_a{address.c_sockaddr()};
+  torrent::PeerInfo           peer_b{address.c_sockaddr()};
+  torrent::PeerInfo           peer_c{address.c_sockaddr()};
+
+  torrent::TransferList       transfer_list;
+  torrent::BlockList*         block_list;
+
+  unsigned int                completed{0};
+  std::set<torrent::PeerInfo*> corrupt;
+};
+
+void
+test_transfer_list::test_retry_disputed() {
+  set_create_poll();
+  auto test_main_thread = TestMainThread::create();
+  test_main_thread->init_thread();
+
+  SETUP_CHUNK_LIST();
+
+  {
+    torrent::ChunkHandle handle = chunk_list->get(0, torrent::ChunkList::get_writable);
+    torrent::Chunk* chunk = handle.chunk();
+    transfer_list_fixture f;
+
+    // The first peer corrupts block 1, with nothing to compare
+    // against the whole chunk is downloaded again.
+    f.finish_block(0, &f.peer_a, chunk, 'g');
+    f.finish_block(1, &f.peer_a, chunk, 'a');
+    f.finish_block(2, &f.peer_a, chunk, 'g');
+    f.finish_block(3, &f.peer_a, chunk, 'g');
+    CPPUNIT_ASSERT(f.completed == 1);
+
+    f.transfer_list.hash_failed(0, chunk);
+    CPPUNIT_ASSERT(f.completed == 2);
+    CPPUNIT_ASSERT(f.block_list->is_all_finished());
+
+    f.transfer_list.hash_failed(0, chunk);
+    CPPUNIT_ASSERT(f.block_list->finished() == 0);
+
+    // The second peer corrupts block 3.
+    f.finish_block(0, &f.peer_b, chunk, 'g');
+    f.finish_block(1, &f.peer_b, chunk, 'g');
+    f.finish_block(2, &f.peer_b, chunk, 'g');
+    f.finish_block(3, &f.peer_b, chunk, 'b');
+    CPPUNIT_ASSERT(f.completed == 3);
+
+    f.transfer_list.hash_failed(0, chunk);
+    CPPUNIT_ASSERT(f.completed == 4);
+
+    // Only the blocks the peers disagree on are downloaded again.
+    f.transfer_list.hash_failed(0, chunk);
+    CPPUNIT_ASSERT(f.block_list->finished() == 2);
+    CPPUNIT_ASSERT((*f.block_list)[0].is_finished());
+    CPPUNIT_ASSERT(!(*f.block_list)[1].is_finished());
+    CPPUNIT_ASSERT((*f.block_list)[2].is_finished());
+    CPPUNIT_ASSERT(!(*f.block_list)[3].is_finished());
+
+    f.finish_block(1, &f.peer_c, chunk, 'g');
+    f.finish_block(3, &f.peer_c, chunk, 'g');
+    CPPUNIT_ASSERT(f.completed == 5);
+
+    f.transfer_list.hash_succeeded(0, chunk);
+    CPPUNIT_ASSERT(f.transfer_list.empty());
+    CPPUNIT_ASSERT(f.corrupt == std::set<torrent::PeerInfo*>({ &f.peer_a, &f.peer_b }));
+
+    chunk_list->release(&handle);
+  }
+
+  CLEANUP_CHUNK_LIST();
+}
+
+void
+test_transfer_list::test_retry_all() {
+  set_create_poll();
+  auto test_main_thread = TestMainThread::create();
+  test_main_thread->init_thread();
+
+  SETUP_CHUNK_LIST();
+
+  {
+    torrent::ChunkHandle handle = chunk_list->get(0, torrent::ChunkList::get_writable);
+    torrent::Chunk* chunk = handle.chunk();
+    transfer_list_fixture f;
+
+    for (uint32_t i = 0; i < 4; i++)
+      f.finish_block(i, &f.peer_a, chunk, 'a');
+
+    f.transfer_list.hash_failed(0, chunk);
+    f.transfer_list.hash_failed(0, chunk);
+    CPPUNIT_ASSERT(f.block_list->finished() == 0);
+
+    // Every block is disputed, so the chunk is downloaded again.
+    for (uint32_t i = 0; i < 4; i++)
+      f.finish_block(i, &f.peer_b, chunk, 'b');
+
+    f.transfer_list.hash_failed(0, chunk);
+    f.transfer_list.hash_failed(0, chunk);
+    CPPUNIT_ASSERT(f.block_list->finished() == 0);
+
+    for (uint32_t i = 0; i < 4; i++)
+      f.finish_block(i, &f.peer_c, chunk, 'g');
+
+    f.transfer_list.hash_succeeded(0, chunk);
+    CPPUNIT_ASSERT(f.corrupt == std::set<torrent::PeerInfo*>({ &f.peer_a, &f.peer_b }));
+
+    chunk_list->release(&handle);
+  }
+
+  CLEANUP_CHUNK_LIST();
+}
+
+void
+test_transfer_list::test_queued_overflow() {
+  set_create_poll();
+  auto test_main_thread = TestMainThread::create();
+  test_main_thread->init_thread();
+
+  transfer_list_fixture f;
+  torrent::Block* block = &(*f.block_list)[0];
+
+  size_t initial_size = f.transfer_list.sizeof_data();
+
+  auto transfer_a = block->insert(&f.peer_a);
+  auto transfer_b = block->insert(&f.peer_b);
+  CPPUNIT_ASSERT(!block->queued()->is_overflow());
+
+  auto transfer_c = block->insert(&f.peer_c);
+  CPPUNIT_ASSERT(block->queued()->is_overflow());
+  CPPUNIT_ASSERT(block->insert(&f.peer_b) == nullptr);
+
+  CPPUNIT_ASSERT(block->queued()->size() == 3);
+  CPPUNIT_ASSERT(block->is_peer_queued(&f.peer_c));
+  CPPUNIT_ASSERT(f.transfer_list.sizeof_data() > initial_size + 3 * sizeof(torrent::BlockTransfer));
+
+  torrent::Block::release(transfer_b);
+
+  CPPUNIT_ASSERT(block->queued()->size() == 2);
+  CPPUNIT_ASSERT(!block->is_peer_queued(&f.peer_b));
+  CPPUNIT_ASSERT((*block->queued())[0] == transfer_a);
+  CPPUNIT_ASSERT((*block->queued())[1] == transfer_c);
+
+  torrent::Block::release(transfer_a);
+  torrent::Block::release(transfer_c);
+
+  CPPUNIT_ASSERT(block->queued()->empty());
+
+  f.transfer_list.clear();
+}
@@ -0,0 +1,16 @@
+#include "helpers/test_fixture.h"
+
+class test_transfer_list : public test_fixture {
+  CPPUNIT_TEST_SUITE(test_transfer_list);
+
+  CPPUNIT_TEST(test_retry_disputed);
+  CPPUNIT_TEST(test_retry_all);
+  CPPUNIT_TEST(test_queued_overflow);
+
+  CPPUNIT_TEST_SUITE_END();
+
+public:
+  void test_retry_disputed();
+  void test_retry_all();
+  void test_queued_overflow();
+};
@@ -0,0 +1,172 @@
+#include "config.h"
+
+#include "test/dht/test_dht_message.h"
+
+#include <random>
+#include <string>
+
+#include "dht/dht_message.h"
+
+CPPUNIT_TEST_SUITE_REGISTRATION(TestDhtMessage);
+
+using torrent::DhtMessage;
+using torrent::HashString;
+
+static const std::string packet_ping =
+  "d1:ad2:id20:abcdefghij0123456789e1:q4:ping1:t2:aa1:y1:qe";
+static const std::string packet_get_peers =
+  "d1:ad2:id20:abcdefghij01234567899:info_hash20:mnopqrstuvwxyz123456e1:q9:get_peers1:t2:aa1:y1:qe";
+static const std::string packet_announce =
+  "d1:ad2:id20:abcdefghij012345678912:implied_porti1e9:info_hash20:mnopqrstuvwxyz1234564:porti6881e5:token8:aoeusnthe1:q13:announce_peer1:t2:aa1:y1:qe";
+static const std::string packet_reply =
+  "d1:rd2:id20:mnopqrstuvwxyz1234565:nodes26:abcdefghij0123456789abcdef5:token8:aoeusnth6:valuesl6:axje.u6:idhtnmee1:t1:a1:y1:re";
+static const std::string packet_error =
+  "d1:eli201e23:A Generic Error Ocurrede1:t1:a1:y1:ee";
+
+static bool
+read_message(const std::string& packet, DhtMessage& message, int& type, const HashString*& node_id) {
+  type = '?';
+  node_id = NULL;
+
+  return torrent::dht_message_read(packet.data(), packet.data() + packet.size(), message, type, node_id);
+}
+
+// Returns the error code thrown, or zero if the message was valid.
+static int
+read_error_code(const std::string& packet) {
+  DhtMessage        message;
+  int               type;
+  const HashString* node_id;
+
+  try {
+    CPPUNIT_ASSERT(read_message(packet, message, type, node_id));
+  } catch (torrent::dht_error& e) {
+    return e.code();
+  }
+
+  return 0;
+}
+
+void
+TestDhtMessage::test_query() {
+  DhtMessage        message;
+  int               type;
+  const HashString* node_id;
+
+  CPPUNIT_ASSERT(read_message(packet_get_peers, message, type, node_id));
+  CPPUNIT_ASSERT(type == 'q');
+
+  // The strings point into the receive buffer.
+  CPPUNIT_ASSERT(node_id != NULL);
+  CPPUNIT_ASSERT(node_id->data() == packet_get_peers.data() + 12);
+  CPPUNIT_ASSERT(message[torrent::key_q].as_raw_string().as_string() == "get_peers");
+  CPPUNIT_ASSERT(message[torrent::key_a_infoHash].as_raw_string().as_string() == "mnopqrstuvwxyz123456");
+  CPPUNIT_ASSERT(message[torrent::key_t].as_raw_string().as_string() == "aa");
+
+  DhtMessage announce;
+
+  CPPUNIT_ASSERT(read_message(packet_announce, announce, type, node_id));
+  CPPUNIT_ASSERT(announce[torrent::key_q].as_raw_string().as_string() == "announce_peer");
+  CPPUNIT_ASSERT(announce[torrent::key_a_port].as_value() == 6881);
+  CPPUNIT_ASSERT(announce[torrent::key_a_token].as_raw_string().as_string() == "aoeusnth");
+}
+
+void
+TestDhtMessage::test_reply() {
+  DhtMessage        message;
+  int               type;
+  const HashString* node_id;
+
+  CPPUNIT_ASSERT(read_message(packet_reply, message, type, node_id));
+  CPPUNIT_ASSERT(type == 'r');
+  CPPUNIT_ASSERT(node_id != NULL);
+  CPPUNIT_ASSERT(std::string(node_id->data(), HashString::size_data) == "mnopqrstuvwxyz123456");
+
+  CPPUNIT_ASSERT(message[torrent::key_r_nodes].as_raw_string().size() == 26);
+  CPPUNIT_ASSERT(message[torrent::key_r_token].as_raw_string().as_string() == "aoeusnth");
+  CPPUNIT_ASSERT(message[torrent::key_r_values].is_raw_list());
+}
+
+void
+TestDhtMessage::test_error() {
+  DhtMessage        message;
+  int               type;
+  const HashString* node_id;
+
+  CPPUNIT_ASSERT(read_message(packet_error, message, type, node_id));
+  CPPUNIT_ASSERT(type == 'e');
+  CPPUNIT_ASSERT(node_id == NULL);
+  CPPUNIT_ASSERT(message[torrent::key_e_0].as_raw_bencode().as_value_string() == "201");
+}
+
+void
+TestDhtMessage::test_invalid() {
+  DhtMessage        message;
+  int               type;
+  const HashString* node_id;
+
+  // Not a dictionary, or broken bencode, is dropped without an error.
+  CPPUNIT_ASSERT(!read_message("", message, type, node_id));
+  CPPUNIT_ASSERT(!read_message("li1ee", message, type, node_id));
+  CPPUNIT_ASSERT(!read_message(packet_ping.substr(0, packet_ping.size() - 1), message, type, node_id));
+
+  CPPUNIT_ASSERT(read_error_code(packet_ping) == 0);
+  CPPUNIT_ASSERT(read_error_code("d1:y1:qe") == torrent::dht_error_protocol);
+  CPPUNIT_ASSERT(read_error_code("d1:t21:aaaaaaaaaaaaaaaaaaaaa1:y1:qe") == torrent::dht_error_protocol);
+  CPPUNIT_ASSERT(read_error_code("d1:t2:aae") == torrent::dht_error_protocol);
+  CPPUNIT_ASSERT(read_error_code("d1:t2:aa1:y2:qqe") == torrent::dht_error_bad_method);
+  CPPUNIT_ASSERT(read_error_code("d1:ad2:id3:abce1:q4:ping1:t2:aa1:y1:qe") == torrent::dht_error_protocol);
+
+  // Replies must echo our single byte transaction id, the node id is
+  // still set so the sender can be blamed.
+  std::string reply = "d1:rd2:id20:mnopqrstuvwxyz123456e1:t2:aa1:y1:re";
+
+  try {
+    read_message(reply, message, type, node_id);
+    CPPUNIT_ASSERT(false);
+  } catch (torrent::dht_error& e) {
+    CPPUNIT_ASSERT(e.code() == torrent::dht_error_protocol);
+    CPPUNIT_ASSERT(type == 'r' && node_id != NULL);
+  }
+}
+
+// Randomly corrupted and truncated packets must either be decoded,
+// dropped or rejected with dht_error, with any node id inside the
+// buffer.
+void
+TestDhtMessage::test_fuzz() {
+  const std::string packets[] = { packet_ping, packet_get_peers, packet_announce, packet_reply, packet_error };
+
+  std::mt19937 rng(1);
+
+  for (unsigned int i = 0; i < 20000; i++) {
+    std::string packet = packets[rng() % 5];
+
+    for (unsigned int changes = rng() % 4 + 1; changes != 0 && !packet.empty(); changes--) {
+      size_t pos = rng() % packet.size();
+
+      switch (rng() % 4) {
+      case 0: packet[pos] = "de:il0123456789x"[rng() % 16]; break;
+      case 1: packet[pos] = rng(); break;
+      case 2: packet.erase(pos, 1); break;
+      default: packet.resize(pos + 1); break;
+      }
+    }
+
+    DhtMessage        message;
+    int               type;
+    const HashString* node_id;
+
+    try {
+      if (!read_message(packet, message, type, node_id))
+        continue;
+
+    } catch (torrent::dht_error& e) {
+    }
+
+    if (node_id != NULL) {
+      CPPUNIT_ASSERT(node_id->data() >= packet.data());
+      CPPUNIT_ASSERT(node_id->data() + HashString::size_data <= packet.data() + packet.size());
+    }
+  }
+}
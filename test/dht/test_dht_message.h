@@ -0,0 +1,18 @@
+#include <cppunit/extensions/HelperMacros.h>
+
+class TestDhtMessage : public CppUnit::TestFixture {
+  CPPUNIT_TEST_SUITE(TestDhtMessage);
+  CPPUNIT_TEST(test_query);
+  CPPUNIT_TEST(test_reply);
+  CPPUNIT_TEST(test_error);
+  CPPUNIT_TEST(test_invalid);
+  CPPUNIT_TEST(test_fuzz);
+  CPPUNIT_TEST_SUITE_END();
+
+public:
+  void test_query();
+  void test_reply();
+  void test_error();
+  void test_invalid();
+  void test_fuzz();
+};
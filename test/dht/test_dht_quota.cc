@@ -0,0 +1,84 @@
+#include "config.h"
+
+#include "test/dht/test_dht_quota.h"
+
+#include <arpa/inet.h>
+
+#include "dht/dht_quota.h"
+
+CPPUNIT_TEST_SUITE_REGISTRATION(TestDhtQuota);
+
+using torrent::DhtQuota;
+
+static uint32_t
+make_addr(uint32_t i) {
+  return htonl(0x0a000000 + i);
+}
+
+void
+TestDhtQuota::test_limits() {
+  DhtQuota quota;
+
+  for (unsigned int i = 0; i < DhtQuota::soft_limit; i++)
+    CPPUNIT_ASSERT(quota.insert(make_addr(1), 1000) == DhtQuota::admit);
+
+  for (unsigned int i = DhtQuota::soft_limit; i < DhtQuota::hard_limit; i++)
+    CPPUNIT_ASSERT(quota.insert(make_addr(1), 1000) == DhtQuota::admit_quiet);
+
+  CPPUNIT_ASSERT(quota.insert(make_addr(1), 1000) == DhtQuota::drop);
+  CPPUNIT_ASSERT(quota.insert(make_addr(1), 1000 + DhtQuota::window - 1) == DhtQuota::drop);
+
+  // Dropped packets are not counted.
+  CPPUNIT_ASSERT(quota.estimate(make_addr(1)) == DhtQuota::hard_limit);
+
+  quota.clear();
+  CPPUNIT_ASSERT(quota.insert(make_addr(1), 1000) == DhtQuota::admit);
+}
+
+void
+TestDhtQuota::test_decay() {
+  DhtQuota quota;
+  uint32_t now = 1000;
+
+  quota.insert(make_addr(1), now);
+
+  for (unsigned int i = 1; i < DhtQuota::hard_limit; i++)
+    quota.insert(make_addr(1), now);
+
+  CPPUNIT_ASSERT(quota.insert(make_addr(1), now) == DhtQuota::drop);
+
+  // Each window halves the counters.
+  now += DhtQuota::window;
+  CPPUNIT_ASSERT(quota.insert(make_addr(1), now) != DhtQuota::drop);
+  CPPUNIT_ASSERT(quota.estimate(make_addr(1)) == DhtQuota::hard_limit / 2 + 1);
+
+  now += 3 * DhtQuota::window;
+  quota.insert(make_addr(2), now);
+  CPPUNIT_ASSERT(quota.estimate(make_addr(1)) == (DhtQuota::hard_limit / 2 + 1) >> 3);
+
+  // A source sending at the hard rate is never dropped.
+  DhtQuota steady;
+
+  for (now = 0; now < 100 * DhtQuota::window; now++)
+    for (unsigned int i = 0; i < DhtQuota::hard_rate; i++)
+      CPPUNIT_ASSERT(steady.insert(make_addr(3), now) != DhtQuota::drop);
+}
+
+void
+TestDhtQuota::test_isolation() {
+  DhtQuota quota;
+
+  for (unsigned int i = 0; i <= DhtQuota::hard_limit; i++)
+    quota.insert(make_addr(1), 1000);
+
+  // Many other sources, a few packets each, are unaffected by the
+  // flooding one.
+  unsigned int dropped = 0;
+
+  for (uint32_t addr = 2; addr < 10000; addr++)
+    for (unsigned int i = 0; i < 4; i++)
+      dropped += quota.insert(make_addr(addr), 1000) == DhtQuota::drop;
+
+  CPPUNIT_ASSERT(dropped == 0);
+  CPPUNIT_ASSERT(quota.insert(make_addr(1), 1000) == DhtQuota::drop);
+}
@@ -0,0 +1,14 @@
+#include <cppunit/extensions/HelperMacros.h>
+
+class TestDhtQuota : public CppUnit::TestFixture {
+  CPPUNIT_TEST_SUITE(TestDhtQuota);
+  CPPUNIT_TEST(test_limits);
+  CPPUNIT_TEST(test_decay);
+  CPPUNIT_TEST(test_isolation);
+  CPPUNIT_TEST_SUITE_END();
+
+public:
+  void test_limits();
+  void test_decay();
+  void test_isolation();
+};
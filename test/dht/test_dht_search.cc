@@ -0,0 +1,256 @@
+#include "config.h"
+
+#include "test/dht/test_dht_search.h"
+
+#include <cstdlib>
+#include <memory>
+#include <vector>
+
+#include "dht/dht_bucket.h"
+#include "dht/dht_transaction.h"
+
+CPPUNIT_TEST_SUITE_REGISTRATION(TestDhtSearch);
+
+using torrent::DhtBucket;
+using torrent::DhtNode;
+using torrent::DhtSearch;
+using torrent::DhtTransactionFindNode;
+using torrent::HashString;
+
+// Node IDs differ from the zero target only in the last byte, so a
+// lower 'distance' is closer.
+static HashString
+make_id(unsigned int distance) {
+  HashString id;
+  id.clear();
+  id[HashString::size_data - 1] = distance;
+  return id;
+}
+
+static rak::socket_address
+make_address(unsigned int i) {
+  rak::socket_address sa;
+  sa.sa_inet()->clear();
+  sa.sa_inet()->set_address_h(0x0a000000 + i);
+  sa.sa_inet()->set_port(6881);
+  return sa;
+}
+
+static unsigned int
+distance(const DhtSearch::const_accessor& n) {
+  return static_cast<uint8_t>(n.node()->id()[HashString::size_data - 1]);
+}
+
+// Completed transactions are deleted right away, as the last one to
+// go deletes the search.
+static void
+finish(std::unique_ptr<DhtTransactionFindNode>& transaction, bool success) {
+  transaction->complete(success);
+  transaction.reset();
+}
+
+struct search_fixture {
+  search_fixture(unsigned int count) : bucket(make_id(0), make_id(255)), target(make_id(0)) {
+    // Add nodes in reverse order, the search sorts them.
+    for (unsigned int i = count; i != 0; i--) {
+      rak::socket_address sa = make_address(i);
+      nodes.emplace_back(new DhtNode(make_id(i), &sa));
+      bucket.add_node(nodes.back().get());
+    }
+  }
+
+  std::vector<std::unique_ptr<DhtTransactionFindNode>> contact_all(DhtSearch* search) {
+    std::vector<std::unique_ptr<DhtTransactionFindNode>> result;
+    DhtSearch::const_accessor n;
+
+    while ((n = search->get_contact()) != search->end())
+      result.emplace_back(new DhtTransactionFindNode(n));
+
+    return result;
+  }
+
+  std::vector<std::unique_ptr<DhtNode>> nodes;
+  DhtBucket                             bucket;
+  HashString                            target;
+};
+
+void
+TestDhtSearch::test_order() {
+  search_fixture fixture(10);
+  auto search = new DhtSearch(fixture.target, fixture.bucket);
+
+  CPPUNIT_ASSERT(search->size() == 10);
+  CPPUNIT_ASSERT(search->alpha() == DhtSearch::min_alpha);
+
+  // Closer contacts are inserted in order and duplicates are ignored.
+  rak::socket_address sa = make_address(100);
+  CPPUNIT_ASSERT(!search->add_contact(make_id(5), &sa));
+
+  sa = make_address(0);
+  CPPUNIT_ASSERT(search->add_contact(make_id(0), &sa));
+
+  DhtSearch::const_accessor n = search->get_contact();
+  CPPUNIT_ASSERT(n.node()->id() == make_id(0));
+  CPPUNIT_ASSERT(n.search() == search);
+
+  auto first = std::make_unique<DhtTransactionFindNode>(n);
+  auto rest = fixture.contact_all(search);
+
+  CPPUNIT_ASSERT(rest.size() == DhtSearch::min_alpha - 1);
+  CPPUNIT_ASSERT(distance(rest[0]->node()) == 1);
+  CPPUNIT_ASSERT(distance(rest[1]->node()) == 2);
+
+  CPPUNIT_ASSERT(search->start());
+
+  finish(first, true);
+
+  for (auto& transaction : rest)
+    finish(transaction, false);
+
+  // All transactions are done, the last one deleted the search.
+}
+
+void
+TestDhtSearch::test_alpha() {
+  search_fixture fixture(16);
+  auto search = new DhtSearch(fixture.target, fixture.bucket);
+  auto transactions = fixture.contact_all(search);
+
+  CPPUNIT_ASSERT(transactions.size() == DhtSearch::min_alpha);
+  CPPUNIT_ASSERT(search->start());
+
+  // Each failure lets one more query run concurrently.
+  finish(transactions[0], false);
+  CPPUNIT_ASSERT(search->alpha() == DhtSearch::min_alpha + 1);
+
+  auto more = fixture.contact_all(search);
+  CPPUNIT_ASSERT(more.size() == 2);
+
+  // Replies bring alpha back down.
+  finish(transactions[1], true);
+  CPPUNIT_ASSERT(search->alpha() == DhtSearch::min_alpha);
+  CPPUNIT_ASSERT(fixture.contact_all(search).empty());
+
+  // Stalled queries don't count against alpha.
+  transactions[2]->set_stalled();
+  more.push_back(std::move(fixture.contact_all(search).at(0)));
+  CPPUNIT_ASSERT(fixture.contact_all(search).empty());
+
+  finish(transactions[2], false);
+
+  for (auto& transaction : more)
+    finish(transaction, false);
+}
+
+void
+TestDhtSearch::test_converge() {
+  search_fixture fixture(DhtSearch::converge_nodes + 4);
+  auto search = new DhtSearch(fixture.target, fixture.bucket);
+  auto pending = fixture.contact_all(search);
+  unsigned int replied = 0;
+
+  CPPUNIT_ASSERT(search->start());
+
+  while (!search->is_converged()) {
+    CPPUNIT_ASSERT(!pending.empty());
+
+    finish(pending.front(), true);
+    pending.erase(pending.begin());
+    replied++;
+
+    auto more = fixture.contact_all(search);
+    std::move(more.begin(), more.end(), std::back_inserter(pending));
+  }
+
+  // Converged after the closest nodes replied, without contacting the rest.
+  CPPUNIT_ASSERT(replied == DhtSearch::converge_nodes);
+  CPPUNIT_ASSERT(search->num_contacted() < (int)search->size());
+  CPPUNIT_ASSERT(fixture.contact_all(search).empty());
+
+  for (auto& transaction : pending)
+    finish(transaction, false);
+}
+
+void
+TestDhtSearch::test_abandon() {
+  search_fixture fixture(DhtSearch::converge_nodes + 4);
+  auto search = new DhtSearch(fixture.target, fixture.bucket);
+  auto pending = fixture.contact_all(search);
+
+  CPPUNIT_ASSERT(search->start());
+
+  // Let the search converge while a query to a distant node is
+  // stalled, and keep that one pending.
+  std::unique_ptr<DhtTransactionFindNode> distant;
+
+  while (!search->is_converged()) {
+    if (distant == nullptr && distance(pending.back()->node()) > DhtSearch::converge_nodes) {
+      distant = std::move(pending.back());
+      distant->set_stalled();
+      pending.pop_back();
+    }
+
+    finish(pending.front(), true);
+    pending.erase(pending.begin());
+
+    auto more = fixture.contact_all(search);
+    std::move(more.begin(), more.end(), std::back_inserter(pending));
+  }
+
+  CPPUNIT_ASSERT(distant != nullptr);
+  CPPUNIT_ASSERT(!search->complete());
+
+  search->abandon_pending();
+
+  CPPUNIT_ASSERT(distant->is_abandoned());
+  CPPUNIT_ASSERT(search->complete());
+  CPPUNIT_ASSERT(search->alpha() == DhtSearch::min_alpha);
+
+  // Abandoned transactions no longer reference the search.
+  distant.reset();
+  pending.clear();
+  delete search;
+}
+
+// Compare the word based XOR helpers against byte by byte versions,
+// with IDs that share random length prefixes.
+void
+TestDhtSearch::test_distance() {
+  for (unsigned int n = 0; n != 10000; n++) {
+    HashString ids[3];
+
+    for (auto& id : ids)
+      for (auto& c : id)
+        c = random();
+
+    unsigned int shared = random() % (HashString::size_data + 1);
+    std::copy(ids[2].begin(), ids[2].begin() + shared, ids[0].begin());
+    std::copy(ids[2].begin(), ids[2].begin() + random() % (shared + 1), ids[1].begin());
+
+    unsigned int prefix = 0;
+    while (prefix != HashString::size_data * 8 &&
+           ((ids[0][prefix / 8] ^ ids[2][prefix / 8]) & (0x80 >> (prefix % 8))) == 0)
+      prefix++;
+
+    CPPUNIT_ASSERT(torrent::hash_string_common_prefix(ids[0], ids[2]) == prefix);
+    CPPUNIT_ASSERT(torrent::hash_string_common_prefix(ids[2], ids[0]) == prefix);
+
+    bool closer = false;
+
+    for (unsigned int i = 0; i != HashString::size_data; i++) {
+      uint8_t a = ids[0][i] ^ ids[2][i];
+      uint8_t b = ids[1][i] ^ ids[2][i];
+
+      if (a != b) {
+        closer = a < b;
+        break;
+      }
+    }
+
+    CPPUNIT_ASSERT(DhtSearch::is_closer(ids[0], ids[1], ids[2]) == closer);
+  }
+
+  CPPUNIT_ASSERT(torrent::hash_string_common_prefix(make_id(1), make_id(1)) == HashString::size_data * 8);
+  CPPUNIT_ASSERT(torrent::hash_string_common_prefix(make_id(1), make_id(0)) == HashString::size_data * 8 - 1);
+  CPPUNIT_ASSERT(!DhtSearch::is_closer(make_id(1), make_id(1), make_id(0)));
+}
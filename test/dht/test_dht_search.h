@@ -0,0 +1,18 @@
+#include <cppunit/extensions/HelperMacros.h>
+
+class TestDhtSearch : public CppUnit::TestFixture {
+  CPPUNIT_TEST_SUITE(TestDhtSearch);
+  CPPUNIT_TEST(test_order);
+  CPPUNIT_TEST(test_alpha);
+  CPPUNIT_TEST(test_converge);
+  CPPUNIT_TEST(test_abandon);
+  CPPUNIT_TEST(test_distance);
+  CPPUNIT_TEST_SUITE_END();
+
+public:
+  void test_order();
+  void test_alpha();
+  void test_converge();
+  void test_abandon();
+  void test_distance();
+};
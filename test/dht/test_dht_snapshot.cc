@@ -0,0 +1,172 @@
+#include "config.h"
+
+#include "test/dht/test_dht_snapshot.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <memory>
+#include <vector>
+#include <arpa/inet.h>
+#include <unistd.h>
+
+#include "globals.h"
+#include "dht/dht_node.h"
+#include "dht/dht_snapshot.h"
+
+CPPUNIT_TEST_SUITE_REGISTRATION(TestDhtSnapshot);
+
+using torrent::DhtNode;
+using torrent::DhtSnapshot;
+
+static std::unique_ptr<DhtNode>
+make_node(uint32_t i, unsigned int last_seen = 1000, unsigned int rtt = 0) {
+  torrent::HashString id;
+  id.clear(i);
+
+  rak::socket_address sa;
+  sa.sa_inet()->clear();
+  sa.sa_inet()->set_address_h(0x0a000000 + i);
+  sa.sa_inet()->set_port(6881 + i);
+
+  return std::unique_ptr<DhtNode>(new DhtNode(id, &sa, last_seen, rtt));
+}
+
+void
+TestDhtSnapshot::setUp() {
+  char path[] = "/tmp/test_dht_snapshot.XXXXXX";
+  int fd = mkstemp(path);
+
+  CPPUNIT_ASSERT(fd != -1);
+  close(fd);
+
+  m_path = path;
+}
+
+void
+TestDhtSnapshot::tearDown() {
+  unlink(m_path.c_str());
+}
+
+void
+TestDhtSnapshot::test_basic() {
+  DhtSnapshot::record_list records;
+
+  {
+    DhtSnapshot snapshot;
+    CPPUNIT_ASSERT(snapshot.open(m_path, &records));
+    CPPUNIT_ASSERT(records.empty());
+
+    auto node1 = make_node(1, 1000, 40);
+    auto node2 = make_node(2, 2000, 70000);
+
+    snapshot.update(node1.get());
+    snapshot.update(node2.get());
+    snapshot.update(node1.get());
+
+    CPPUNIT_ASSERT(snapshot.size() == 2);
+    CPPUNIT_ASSERT(node1->snapshot_slot() != node2->snapshot_slot());
+  }
+
+  DhtSnapshot snapshot;
+  CPPUNIT_ASSERT(snapshot.open(m_path, &records));
+  CPPUNIT_ASSERT(records.size() == 2);
+  CPPUNIT_ASSERT(snapshot.size() == 0);
+
+  std::sort(records.begin(), records.end(), [](auto& a, auto& b) { return a.last_seen < b.last_seen; });
+
+  CPPUNIT_ASSERT(*torrent::HashString::cast_from(records[0].id) == make_node(1)->id());
+  CPPUNIT_ASSERT(records[0].address == htonl(0x0a000001));
+  CPPUNIT_ASSERT(records[0].port == htons(6882));
+  CPPUNIT_ASSERT(records[0].rtt == 40);
+  CPPUNIT_ASSERT(records[0].last_seen == 1000);
+
+  CPPUNIT_ASSERT(records[1].rtt == 0xffff);
+  CPPUNIT_ASSERT(records[1].last_seen == 2000);
+
+  // Opening clears the file, so records only survive one restart
+  // unless the nodes are added again.
+  records.clear();
+  snapshot.close();
+
+  CPPUNIT_ASSERT(snapshot.open(m_path, &records));
+  CPPUNIT_ASSERT(records.empty());
+}
+
+void
+TestDhtSnapshot::test_erase() {
+  DhtSnapshot::record_list records;
+
+  {
+    DhtSnapshot snapshot;
+    CPPUNIT_ASSERT(snapshot.open(m_path, &records));
+
+    auto node1 = make_node(1);
+    auto node2 = make_node(2);
+    auto node3 = make_node(3);
+
+    snapshot.update(node1.get());
+    snapshot.update(node2.get());
+    snapshot.erase(node1.get());
+
+    CPPUNIT_ASSERT(node1->snapshot_slot() == DhtSnapshot::invalid_slot);
+    CPPUNIT_ASSERT(snapshot.size() == 1);
+
+    // Freed slots are reused.
+    uint32_t slot = node2->snapshot_slot();
+    snapshot.erase(node2.get());
+    snapshot.update(node3.get());
+
+    CPPUNIT_ASSERT(node3->snapshot_slot() == slot);
+  }
+
+  DhtSnapshot snapshot;
+  CPPUNIT_ASSERT(snapshot.open(m_path, &records));
+  CPPUNIT_ASSERT(records.size() == 1);
+  CPPUNIT_ASSERT(records[0].port == htons(6884));
+}
+
+void
+TestDhtSnapshot::test_full() {
+  DhtSnapshot snapshot;
+  CPPUNIT_ASSERT(snapshot.open(m_path, nullptr));
+
+  std::vector<std::unique_ptr<DhtNode>> nodes;
+
+  for (uint32_t i = 0; i != DhtSnapshot::max_nodes + 1; ++i) {
+    nodes.push_back(make_node(i));
+    snapshot.update(nodes.back().get());
+  }
+
+  CPPUNIT_ASSERT(snapshot.size() == DhtSnapshot::max_nodes);
+  CPPUNIT_ASSERT(nodes.back()->snapshot_slot() == DhtSnapshot::invalid_slot);
+
+  snapshot.erase(nodes.front().get());
+  snapshot.update(nodes.back().get());
+
+  CPPUNIT_ASSERT(nodes.back()->snapshot_slot() != DhtSnapshot::invalid_slot);
+}
+
+void
+TestDhtSnapshot::test_invalid() {
+  {
+    std::ofstream file(m_path, std::ios::trunc);
+    file << "not a snapshot";
+  }
+
+  DhtSnapshot::record_list records;
+  DhtSnapshot snapshot;
+
+  CPPUNIT_ASSERT(snapshot.open(m_path, &records));
+  CPPUNIT_ASSERT(records.empty());
+
+  auto node = make_node(1);
+  snapshot.update(node.get());
+  snapshot.close();
+
+  CPPUNIT_ASSERT(snapshot.open(m_path, &records));
+  CPPUNIT_ASSERT(records.size() == 1);
+
+  CPPUNIT_ASSERT(!snapshot.open("/nonexistent/dht_snapshot", &records));
+  CPPUNIT_ASSERT(!snapshot.is_open());
+}
@@ -0,0 +1,24 @@
+#include <cppunit/extensions/HelperMacros.h>
+
+#include <string>
+
+class TestDhtSnapshot : public CppUnit::TestFixture {
+  CPPUNIT_TEST_SUITE(TestDhtSnapshot);
+  CPPUNIT_TEST(test_basic);
+  CPPUNIT_TEST(test_erase);
+  CPPUNIT_TEST(test_full);
+  CPPUNIT_TEST(test_invalid);
+  CPPUNIT_TEST_SUITE_END();
+
+public:
+  void setUp();
+  void tearDown();
+
+  void test_basic();
+  void test_erase();
+  void test_full();
+  void test_invalid();
+
+private:
+  std::string m_path;
+};
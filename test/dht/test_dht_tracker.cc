@@ -0,0 +1,203 @@
+#include "config.h"
+
+#include "test/dht/test_dht_tracker.h"
+
+#include <cstring>
+#include <set>
+#include <string>
+#include <arpa/inet.h>
+
+#include "globals.h"
+#include "dht/dht_tracker.h"
+#include "utils/sha1.h"
+
+CPPUNIT_TEST_SUITE_REGISTRATION(TestDhtTracker);
+
+using torrent::DhtTracker;
+
+static uint32_t
+make_addr(uint32_t i) {
+  return htonl(0x0a000000 + i);
+}
+
+static std::string
+peers_string(const torrent::raw_list& peers) {
+  return std::string(peers.data(), peers.size());
+}
+
+// Returns the set of addresses in a compact IPv4 'values' list.
+static std::set<uint32_t>
+peers_set(const torrent::raw_list& peers) {
+  std::set<uint32_t> result;
+
+  CPPUNIT_ASSERT(peers.size() % 8 == 0);
+
+  for (const char* itr = peers.data(); itr != peers.data() + peers.size(); itr += 8) {
+    CPPUNIT_ASSERT(std::string(itr, 2) == "6:");
+
+    uint32_t addr;
+    std::memcpy(&addr, itr + 2, sizeof(addr));
+    result.insert(addr);
+  }
+
+  return result;
+}
+
+static std::string
+addr_string(uint32_t addr) {
+  return std::string(reinterpret_cast<const char*>(&addr), sizeof(addr));
+}
+
+// Checks both bits BEP 33 sets for the address.
+static bool
+bloom_test(const torrent::raw_string& filter, const std::string& addr) {
+  unsigned char hash[20];
+
+  torrent::Sha1 sha;
+  sha.init();
+  sha.update(addr.data(), addr.size());
+  sha.final_c(hash);
+
+  unsigned int index1 = (hash[0] | hash[1] << 8) % 2048;
+  unsigned int index2 = (hash[2] | hash[3] << 8) % 2048;
+
+  return (filter.data()[index1 / 8] & (1 << (index1 % 8))) && (filter.data()[index2 / 8] & (1 << (index2 % 8)));
+}
+
+void
+TestDhtTracker::setUp() {
+  torrent::cachedTime = rak::timer::from_seconds(1000000);
+}
+
+void
+TestDhtTracker::test_basic() {
+  DhtTracker tracker;
+
+  CPPUNIT_ASSERT(tracker.empty());
+  CPPUNIT_ASSERT(tracker.get_peers().empty());
+
+  tracker.add_peer(make_addr(1), 0);
+  CPPUNIT_ASSERT(tracker.empty());
+
+  tracker.add_peer(make_addr(1), 0x1234);
+  CPPUNIT_ASSERT(tracker.size() == 1);
+
+  // The address and port are in network byte order.
+  CPPUNIT_ASSERT(peers_string(tracker.get_peers()) == std::string("6:\x0a\x00\x00\x01\x12\x34", 8));
+}
+
+void
+TestDhtTracker::test_reannounce() {
+  DhtTracker tracker;
+
+  tracker.add_peer(make_addr(1), 1000);
+  tracker.add_peer(make_addr(2), 1000);
+  tracker.add_peer(make_addr(1), 2000);
+
+  CPPUNIT_ASSERT(tracker.size() == 2);
+  CPPUNIT_ASSERT(peers_set(tracker.get_peers()) == std::set<uint32_t>({ make_addr(1), make_addr(2) }));
+  // Reannounces update the peer in place.
+  CPPUNIT_ASSERT(peers_string(tracker.get_peers()).substr(6, 2) == std::string("\x07\xd0", 2));
+}
+
+void
+TestDhtTracker::test_full() {
+  DhtTracker tracker;
+  size_t     capacity = DhtTracker::max_memory / torrent::DhtPeerRing<torrent::SocketAddressCompact>::bytes_per_peer;
+
+  for (uint32_t i = 0; i < capacity; i++)
+    tracker.add_peer(make_addr(i), 1000);
+
+  CPPUNIT_ASSERT(tracker.size() == capacity);
+
+  // Refresh the oldest peer, then add enough peers to replace all but
+  // the refreshed one.
+  torrent::cachedTime = rak::timer::from_seconds(1000001);
+  tracker.add_peer(make_addr(0), 1000);
+
+  for (uint32_t i = capacity; i < 2 * capacity - 1; i++)
+    tracker.add_peer(make_addr(i), 1000);
+
+  CPPUNIT_ASSERT(tracker.size() == capacity);
+
+  std::set<uint32_t> peers = peers_set(tracker.get_peers(capacity));
+
+  CPPUNIT_ASSERT(peers.size() == capacity);
+  CPPUNIT_ASSERT(peers.find(make_addr(0)) != peers.end());
+  CPPUNIT_ASSERT(peers.find(make_addr(1)) == peers.end());
+  CPPUNIT_ASSERT(peers.find(make_addr(2 * capacity - 2)) != peers.end());
+
+  // Blocks returned are contiguous and never larger than requested.
+  for (int i = 0; i < 100; i++)
+    CPPUNIT_ASSERT(peers_set(tracker.get_peers()).size() == DhtTracker::max_peers);
+}
+
+void
+TestDhtTracker::test_prune() {
+  DhtTracker tracker;
+
+  for (uint32_t i = 0; i < 100; i++) {
+    torrent::cachedTime = rak::timer::from_seconds(1000000 + i);
+    tracker.add_peer(make_addr(i), 1000);
+  }
+
+  torrent::cachedTime = rak::timer::from_seconds(1000000 + 150);
+  tracker.prune(100);
+
+  std::set<uint32_t> peers = peers_set(tracker.get_peers(100));
+
+  CPPUNIT_ASSERT(tracker.size() == 50);
+  CPPUNIT_ASSERT(peers.find(make_addr(49)) == peers.end());
+  CPPUNIT_ASSERT(peers.find(make_addr(50)) != peers.end());
+
+  tracker.prune(0);
+  CPPUNIT_ASSERT(tracker.empty());
+}
+
+void
+TestDhtTracker::test_inet6() {
+  DhtTracker tracker;
+  in6_addr   addr;
+
+  inet_pton(AF_INET6, "2001:db8::1", &addr);
+
+  tracker.add_peer(addr, 0x1234);
+  tracker.add_peer(addr, 0x1234);
+
+  CPPUNIT_ASSERT(tracker.size() == 1);
+  CPPUNIT_ASSERT(tracker.get_peers().empty());
+
+  std::string peers = peers_string(tracker.get_peers6());
+
+  CPPUNIT_ASSERT(peers.size() == 21);
+  CPPUNIT_ASSERT(peers.substr(0, 3) == "18:");
+  CPPUNIT_ASSERT(std::memcmp(peers.data() + 3, &addr, 16) == 0);
+  CPPUNIT_ASSERT(peers.substr(19) == std::string("\x12\x34", 2));
+}
+
+void
+TestDhtTracker::test_bloom() {
+  DhtTracker tracker;
+
+  tracker.add_peer(make_addr(1), 1000, true);
+  tracker.add_peer(make_addr(2), 1000, false);
+
+  CPPUNIT_ASSERT(tracker.bloom_seeds().size() == DhtTracker::bloom_size);
+  CPPUNIT_ASSERT(tracker.bloom_peers().size() == DhtTracker::bloom_size);
+
+  CPPUNIT_ASSERT(bloom_test(tracker.bloom_seeds(), addr_string(make_addr(1))));
+  CPPUNIT_ASSERT(!bloom_test(tracker.bloom_peers(), addr_string(make_addr(1))));
+  CPPUNIT_ASSERT(bloom_test(tracker.bloom_peers(), addr_string(make_addr(2))));
+
+  // A seed that re-announces as a downloader moves between filters.
+  tracker.add_peer(make_addr(1), 1000, false);
+
+  CPPUNIT_ASSERT(!bloom_test(tracker.bloom_seeds(), addr_string(make_addr(1))));
+  CPPUNIT_ASSERT(bloom_test(tracker.bloom_peers(), addr_string(make_addr(1))));
+
+  torrent::cachedTime = rak::timer::from_seconds(1000001);
+  tracker.prune(0);
+
+  CPPUNIT_ASSERT(tracker.empty());
+  CPPUNIT_ASSERT(std::string(tracker.bloom_peers().data(), DhtTracker::bloom_size) == std::string(DhtTracker::bloom_size, '\0'));
+}
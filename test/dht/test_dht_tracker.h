@@ -0,0 +1,22 @@
+#include <cppunit/extensions/HelperMacros.h>
+
+class TestDhtTracker : public CppUnit::TestFixture {
+  CPPUNIT_TEST_SUITE(TestDhtTracker);
+  CPPUNIT_TEST(test_basic);
+  CPPUNIT_TEST(test_reannounce);
+  CPPUNIT_TEST(test_full);
+  CPPUNIT_TEST(test_prune);
+  CPPUNIT_TEST(test_inet6);
+  CPPUNIT_TEST(test_bloom);
+  CPPUNIT_TEST_SUITE_END();
+
+public:
+  void setUp();
+
+  void test_basic();
+  void test_reannounce();
+  void test_full();
+  void test_prune();
+  void test_inet6();
+  void test_bloom();
+};
@@ -0,0 +1,261 @@
+#include "config.h"
+
+#include "test/download/test_available_list.h"
+
+#include <set>
+#include <string>
+
+#include "download/available_list.h"
+#include "torrent/exceptions.h"
+#include "torrent/memory_manager.h"
+
+CPPUNIT_TEST_SUITE_REGISTRATION(test_available_list);
+
+static rak::socket_address
+make_inet(const char* address, uint16_t port) {
+  rak::socket_address sa;
+  sa.sa_inet()->clear();
+  sa.sa_inet()->set_address_str(address);
+  sa.sa_inet()->set_port(port);
+  return sa;
+}
+
+static rak::socket_address
+make_inet6(const char* address, uint16_t port) {
+  rak::socket_address sa;
+  sa.sa_inet6()->clear();
+  sa.sa_inet6()->set_address_str(address);
+  sa.sa_inet6()->set_port(port);
+  return sa;
+}
+
+void
+test_available_list::test_push_back() {
+  torrent::AvailableList list;
+
+  auto sa1 = make_inet("10.0.0.1", 6881);
+  auto sa2 = make_inet("10.0.0.1", 6882);
+  auto sa3 = make_inet6("2001:db8::1", 6881);
+
+  CPPUNIT_ASSERT(list.empty());
+  CPPUNIT_ASSERT(!list.contains(sa1));
+
+  CPPUNIT_ASSERT(list.push_back(&sa1));
+  CPPUNIT_ASSERT(list.push_back(&sa2));
+  CPPUNIT_ASSERT(list.push_back(&sa3));
+
+  CPPUNIT_ASSERT(!list.push_back(&sa1));
+  CPPUNIT_ASSERT(!list.push_back(&sa3));
+
+  CPPUNIT_ASSERT(list.size() == 3);
+  CPPUNIT_ASSERT(list.size_inet() == 2);
+  CPPUNIT_ASSERT(list.size_inet6() == 1);
+
+  CPPUNIT_ASSERT(list.contains(sa1) && list.contains(sa2) && list.contains(sa3));
+  CPPUNIT_ASSERT(!list.contains(make_inet("10.0.0.2", 6881)));
+  CPPUNIT_ASSERT(!list.contains(make_inet6("2001:db8::1", 6882)));
+
+  list.clear();
+
+  CPPUNIT_ASSERT(list.empty());
+  CPPUNIT_ASSERT(!list.contains(sa1));
+  CPPUNIT_ASSERT(list.push_back(&sa1));
+}
+
+static std::string
+address_key(const rak::socket_address& sa) {
+  return sa.address_str() + ":" + std::to_string(sa.port());
+}
+
+void
+test_available_list::test_pop_random() {
+  torrent::AvailableList list;
+
+  CPPUNIT_ASSERT_THROW(list.pop_random(), torrent::internal_error);
+
+  std::set<std::string> addresses;
+
+  for (uint16_t port = 1; port <= 50; port++) {
+    auto sa = make_inet("10.0.0.1", port);
+    auto sa6 = make_inet6("2001:db8::1", port);
+
+    list.push_back(&sa);
+    list.push_back(&sa6);
+
+    addresses.insert(address_key(sa));
+    addresses.insert(address_key(sa6));
+  }
+
+  std::set<std::string> popped;
+
+  while (!list.empty()) {
+    auto sa = list.pop_random();
+
+    CPPUNIT_ASSERT(!list.contains(sa));
+    CPPUNIT_ASSERT(popped.insert(address_key(sa)).second);
+  }
+
+  CPPUNIT_ASSERT(popped == addresses);
+}
+
+void
+test_available_list::test_pop_best() {
+  torrent::AvailableList list;
+
+  auto score = [](const rak::socket_address& sa) { return int64_t{sa.port()}; };
+
+  CPPUNIT_ASSERT_THROW(list.pop_best(AF_INET, 4, score), torrent::internal_error);
+
+  for (uint16_t port = 1; port <= 8; port++) {
+    auto sa = make_inet("10.0.0.1", port);
+    list.push_back(&sa);
+  }
+
+  auto sa6 = make_inet6("2001:db8::1", 1);
+  list.push_back(&sa6);
+
+  // With more samples than addresses all are scored.
+  uint16_t last = 0xffff;
+
+  while (list.size_inet() != 0) {
+    auto sa = list.pop_best(AF_INET, 64, score);
+
+    CPPUNIT_ASSERT(sa.family() == AF_INET);
+    CPPUNIT_ASSERT(!list.contains(sa));
+    CPPUNIT_ASSERT(sa.port() <= last);
+
+    last = sa.port();
+  }
+
+  CPPUNIT_ASSERT(list.pop_best(AF_INET, 64, score).family() == AF_INET6);
+  CPPUNIT_ASSERT(list.empty());
+}
+
+void
+test_available_list::test_priority() {
+  torrent::AvailableList list;
+
+  auto sa_1 = make_inet("10.0.0.1", 6881);
+  auto sa_2 = make_inet("10.0.0.2", 6881);
+  auto sa_3 = make_inet6("2001:db8::1", 6881);
+  auto sa_4 = make_inet("10.0.0.4", 6881);
+
+  for (int i = 0; i != 16; i++) {
+    auto sa = make_inet("10.0.1.1", 1000 + i);
+    list.push_back(&sa);
+  }
+
+  CPPUNIT_ASSERT(list.push_back(&sa_1));
+  CPPUNIT_ASSERT(list.push_priority(&sa_3));
+  CPPUNIT_ASSERT(list.push_priority(&sa_1));
+  CPPUNIT_ASSERT(list.push_priority(&sa_2));
+  CPPUNIT_ASSERT(list.push_priority(&sa_4));
+  CPPUNIT_ASSERT(list.size() == 20);
+  CPPUNIT_ASSERT(list.size_priority() == 4);
+
+  // Erased addresses are skipped, the others popped in order
+  // regardless of family.
+  list.erase(sa_2);
+
+  CPPUNIT_ASSERT(list.pop_random(AF_INET) == sa_3);
+  CPPUNIT_ASSERT(list.pop_best(AF_INET6, 4, [](auto&) { return int64_t{0}; }) == sa_1);
+
+  // Shrinking drops other addresses first.
+  list.shrink(1);
+
+  CPPUNIT_ASSERT(list.size() == 1);
+  CPPUNIT_ASSERT(list.size_priority() == 1);
+  CPPUNIT_ASSERT(list.pop_random() == sa_4);
+  CPPUNIT_ASSERT(list.empty());
+}
+
+void
+test_available_list::test_insert() {
+  torrent::AvailableList list;
+  torrent::AddressList   addresses;
+
+  addresses.push_back(make_inet("10.0.0.2", 6881));
+  addresses.push_back(make_inet("10.0.0.1", 6881));
+  addresses.push_back(make_inet("10.0.0.2", 6881));
+
+  list.insert(&addresses);
+
+  CPPUNIT_ASSERT(list.size() == 2);
+
+  // Compact entries decode to the same addresses.
+  torrent::AddressList compact;
+  compact.parse_address_compact(std::string("\x0a\x00\x00\x01\x1a\xe1" "\x0a\x00\x00\x03\x1a\xe1", 12));
+
+  list.insert(&compact);
+
+  CPPUNIT_ASSERT(list.size() == 3);
+  CPPUNIT_ASSERT(list.contains(make_inet("10.0.0.3", 6881)));
+
+  list.set_max_size(2);
+  addresses.push_back(make_inet("10.0.0.4", 6881));
+  list.insert(&addresses);
+
+  CPPUNIT_ASSERT(list.size() == 3);
+}
+
+void
+test_available_list::test_erase() {
+  torrent::AvailableList list;
+
+  auto sa1 = make_inet("10.0.0.1", 6881);
+  auto sa2 = make_inet("10.0.0.2", 6881);
+  auto sa3 = make_inet6("2001:db8::1", 6881);
+
+  list.push_back(&sa1);
+  list.push_back(&sa2);
+  list.push_back(&sa3);
+
+  list.erase(sa1);
+  list.erase(make_inet("10.0.0.9", 6881));
+
+  CPPUNIT_ASSERT(list.size() == 2);
+  CPPUNIT_ASSERT(!list.contains(sa1) && list.contains(sa2));
+
+  list.erase(sa3);
+
+  CPPUNIT_ASSERT(list.size() == 1);
+  CPPUNIT_ASSERT(!list.contains(sa3));
+  CPPUNIT_ASSERT(list.pop_random() == sa2);
+}
+
+void
+test_available_list::test_shrink() {
+  using torrent::MemoryManager;
+
+  auto usage_before = MemoryManager::usage(MemoryManager::category_available_list);
+
+  {
+    torrent::AvailableList list;
+
+    for (uint16_t i = 0; i < 100; i++) {
+      auto sa = make_inet("10.0.0.1", 1000 + i);
+      list.push_back(&sa);
+    }
+
+    CPPUNIT_ASSERT(MemoryManager::usage(MemoryManager::category_available_list) > usage_before);
+
+    auto sizeof_before = list.sizeof_data();
+
+    list.shrink(10);
+
+    CPPUNIT_ASSERT(list.size() == 10);
+    CPPUNIT_ASSERT(list.sizeof_data() < sizeof_before);
+
+    for (uint16_t i = 0, found = 0; i < 100; i++) {
+      found += list.contains(make_inet("10.0.0.1", 1000 + i));
+
+      if (i == 99)
+        CPPUNIT_ASSERT(found == 10);
+    }
+
+    list.shrink(20);
+    CPPUNIT_ASSERT(list.size() == 10);
+  }
+
+  CPPUNIT_ASSERT(MemoryManager::usage(MemoryManager::category_available_list) == usage_before);
+}
@@ -0,0 +1,24 @@
+#include "test/helpers/test_fixture.h"
+
+class test_available_list : public test_fixture {
+  CPPUNIT_TEST_SUITE(test_available_list);
+
+  CPPUNIT_TEST(test_push_back);
+  CPPUNIT_TEST(test_pop_random);
+  CPPUNIT_TEST(test_pop_best);
+  CPPUNIT_TEST(test_priority);
+  CPPUNIT_TEST(test_insert);
+  CPPUNIT_TEST(test_erase);
+  CPPUNIT_TEST(test_shrink);
+
+  CPPUNIT_TEST_SUITE_END();
+
+public:
+  void test_push_back();
+  void test_pop_random();
+  void test_pop_best();
+  void test_priority();
+  void test_insert();
+  void test_erase();
+  void test_shrink();
+};
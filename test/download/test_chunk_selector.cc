@@ -0,0 +1,138 @@
+#include "config.h"
+
+#include "test/download/test_chunk_selector.h"
+
+#include <memory>
+#include <vector>
+
+#include "download/chunk_selector.h"
+#include "download/chunk_statistics.h"
+#include "protocol/peer_chunks.h"
+
+CPPUNIT_TEST_SUITE_REGISTRATION(test_chunk_selector);
+
+static constexpr uint32_t size_chunks = 20;
+static constexpr uint32_t rare_index  = 3;
+
+struct selector_data : public torrent::download_data {
+  using torrent::download_data::mutable_completed_bitfield;
+  using torrent::download_data::mutable_high_priority;
+  using torrent::download_data::mutable_normal_priority;
+};
+
+static void
+init_bitfield(torrent::Bitfield* bitfield, bool all_set) {
+  bitfield->set_size_bits(size_chunks);
+  bitfield->allocate();
+
+  if (all_set)
+    bitfield->set_all();
+  else
+    bitfield->unset_all();
+}
+
+// The peer has every chunk, and another peer all but 'rare_index',
+// which makes it the first rarest-first pick.
+struct selector_fixture {
+  selector_fixture() : selector(&data) {
+    init_bitfield(data.mutable_completed_bitfield(), false);
+    data.mutable_normal_priority()->insert(0, size_chunks);
+
+    init_bitfield(peer.bitfield(), true);
+    init_bitfield(other.bitfield(), true);
+    other.bitfield()->unset(rare_index);
+
+    statistics.initialize(size_chunks);
+    statistics.received_connect(&other);
+
+    selector.initialize(&statistics);
+    selector.update_priorities();
+  }
+
+  ~selector_fixture() {
+    statistics.received_disconnect(&other);
+    selector.cleanup();
+  }
+
+  uint32_t pick() {
+    uint32_t index = selector.find(&peer, false);
+
+    if (index != torrent::ChunkSelector::invalid_chunk)
+      selector.using_index(index);
+
+    return index;
+  }
+
+  selector_data            data;
+  torrent::ChunkStatistics statistics;
+  torrent::ChunkSelector   selector;
+  torrent::PeerChunks      peer;
+  torrent::PeerChunks      other;
+};
+
+void
+test_chunk_selector::test_locality_disabled() {
+  selector_fixture f;
+
+  CPPUNIT_ASSERT(f.pick() == rare_index);
+  CPPUNIT_ASSERT(f.peer.locality_next() == ~uint32_t{0});
+}
+
+void
+test_chunk_selector::test_locality_run() {
+  selector_fixture f;
+  f.selector.set_locality_window(4);
+
+  std::vector<uint32_t> picks;
+
+  for (int i = 0; i != 5; i++)
+    picks.push_back(f.pick());
+
+  CPPUNIT_ASSERT((picks == std::vector<uint32_t>{3, 4, 5, 6, 7}));
+  CPPUNIT_ASSERT(f.peer.locality_left() == 0);
+
+  // The run is over, so the next one starts rarest-first.
+  f.pick();
+  CPPUNIT_ASSERT(f.peer.locality_left() == 4);
+}
+
+void
+test_chunk_selector::test_locality_skip() {
+  selector_fixture f;
+  f.selector.set_locality_window(4);
+
+  // Chunks in progress for other peers are skipped, extending their
+  // run, while those beyond the window are not reached.
+  f.selector.using_index(4);
+  f.selector.using_index(5);
+
+  CPPUNIT_ASSERT(f.pick() == rare_index);
+  CPPUNIT_ASSERT(f.pick() == 6);
+
+  for (uint32_t index = 7; index != 11; index++)
+    f.selector.using_index(index);
+
+  uint32_t index = f.pick();
+
+  CPPUNIT_ASSERT(f.peer.locality_left() == 4 && f.peer.locality_next() == index + 1);
+}
+
+void
+test_chunk_selector::test_locality_priority() {
+  selector_fixture f;
+  f.selector.set_locality_window(4);
+
+  // Runs stay within the priority of the chunk they started from.
+  f.data.mutable_normal_priority()->clear();
+  f.data.mutable_high_priority()->insert(0, 5);
+  f.data.mutable_normal_priority()->insert(5, size_chunks);
+  f.selector.update_priorities();
+
+  CPPUNIT_ASSERT(f.pick() == rare_index);
+  CPPUNIT_ASSERT(f.pick() == 4);
+
+  uint32_t index = f.pick();
+
+  CPPUNIT_ASSERT(index < rare_index);
+  CPPUNIT_ASSERT(f.peer.locality_left() == 4);
+}
@@ -0,0 +1,18 @@
+#include "test/helpers/test_fixture.h"
+
+class test_chunk_selector : public test_fixture {
+  CPPUNIT_TEST_SUITE(test_chunk_selector);
+
+  CPPUNIT_TEST(test_locality_disabled);
+  CPPUNIT_TEST(test_locality_run);
+  CPPUNIT_TEST(test_locality_skip);
+  CPPUNIT_TEST(test_locality_priority);
+
+  CPPUNIT_TEST_SUITE_END();
+
+public:
+  void test_locality_disabled();
+  void test_locality_run();
+  void test_locality_skip();
+  void test_locality_priority();
+};
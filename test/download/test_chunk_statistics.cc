@@ -0,0 +1,274 @@
+#include "config.h"
+
+#include "test/download/test_chunk_statistics.h"
+
+#include <memory>
+#include <random>
+#include <vector>
+
+#include "download/chunk_statistics.h"
+#include "protocol/peer_chunks.h"
+#include "torrent/exceptions.h"
+
+CPPUNIT_TEST_SUITE_REGISTRATION(test_chunk_statistics);
+
+static std::unique_ptr<torrent::PeerChunks>
+make_peer_chunks(uint32_t size, const std::vector<uint32_t>& chunks) {
+  auto pc = std::make_unique<torrent::PeerChunks>();
+
+  pc->bitfield()->set_size_bits(size);
+  pc->bitfield()->allocate();
+  pc->bitfield()->unset_all();
+
+  for (auto index : chunks)
+    pc->bitfield()->set(index);
+
+  return pc;
+}
+
+// Check that every chunk is in the bucket of its rarity exactly once.
+static bool
+verify_order(const torrent::ChunkStatistics& cs) {
+  std::vector<bool> seen(cs.size());
+
+  if (cs.rarity_begin(0) != 0 || cs.rarity_end(torrent::ChunkStatistics::max_accounted) != cs.size())
+    return false;
+
+  for (uint32_t r = 0; r <= torrent::ChunkStatistics::max_accounted; r++) {
+    for (uint32_t pos = cs.rarity_begin(r); pos != cs.rarity_end(r); pos++) {
+      uint32_t index = cs.rarest_at(pos);
+
+      if (index >= cs.size() || seen[index] || cs.rarity(index) != r)
+        return false;
+
+      seen[index] = true;
+    }
+  }
+
+  return true;
+}
+
+void
+test_chunk_statistics::test_basic() {
+  torrent::ChunkStatistics cs;
+  cs.initialize(10);
+
+  CPPUNIT_ASSERT(cs.size() == 10);
+  CPPUNIT_ASSERT(cs.rarity_begin(0) == 0);
+  CPPUNIT_ASSERT(cs.rarity_end(0) == 10);
+  CPPUNIT_ASSERT(verify_order(cs));
+
+  CPPUNIT_ASSERT_THROW(cs.initialize(10), torrent::internal_error);
+
+  cs.clear();
+  CPPUNIT_ASSERT(cs.empty());
+}
+
+void
+test_chunk_statistics::test_connect() {
+  torrent::ChunkStatistics cs;
+  cs.initialize(100);
+
+  auto pc_1 = make_peer_chunks(100, {0, 1, 2, 50, 99});
+  auto pc_2 = make_peer_chunks(100, {1, 2, 3, 99});
+
+  cs.received_connect(pc_1.get());
+  cs.received_connect(pc_2.get());
+
+  CPPUNIT_ASSERT(cs.accounted() == 2);
+  CPPUNIT_ASSERT(cs.rarity(0) == 1 && cs.rarity(1) == 2 && cs.rarity(3) == 1 && cs.rarity(4) == 0);
+  CPPUNIT_ASSERT(cs.rarity_end(0) - cs.rarity_begin(0) == 94);
+  CPPUNIT_ASSERT(cs.rarity_end(1) - cs.rarity_begin(1) == 3);
+  CPPUNIT_ASSERT(cs.rarity_end(2) - cs.rarity_begin(2) == 3);
+  CPPUNIT_ASSERT(verify_order(cs));
+
+  cs.received_disconnect(pc_1.get());
+
+  CPPUNIT_ASSERT(cs.accounted() == 1);
+  CPPUNIT_ASSERT(cs.rarity(0) == 0 && cs.rarity(1) == 1 && cs.rarity(50) == 0);
+  CPPUNIT_ASSERT(cs.rarity_end(0) - cs.rarity_begin(0) == 96);
+  CPPUNIT_ASSERT(verify_order(cs));
+
+  cs.received_disconnect(pc_2.get());
+
+  CPPUNIT_ASSERT(cs.rarity_end(0) == 100);
+  CPPUNIT_ASSERT(verify_order(cs));
+}
+
+void
+test_chunk_statistics::test_have_chunk() {
+  torrent::ChunkStatistics cs;
+  cs.initialize(20);
+
+  auto pc_1 = make_peer_chunks(20, {});
+  auto pc_2 = make_peer_chunks(20, {5});
+
+  cs.received_connect(pc_1.get());
+  cs.received_connect(pc_2.get());
+
+  CPPUNIT_ASSERT(!pc_1->using_counter());
+
+  cs.received_have_chunk(pc_1.get(), 5, 1 << 10);
+  cs.received_have_chunk(pc_1.get(), 7, 1 << 10);
+  cs.received_have_chunk(pc_2.get(), 7, 1 << 10);
+
+  CPPUNIT_ASSERT(pc_1->using_counter());
+  CPPUNIT_ASSERT(cs.rarity(5) == 2 && cs.rarity(7) == 2);
+  CPPUNIT_ASSERT(cs.rarity_end(2) - cs.rarity_begin(2) == 2);
+  CPPUNIT_ASSERT(verify_order(cs));
+
+  cs.received_disconnect(pc_1.get());
+  cs.received_disconnect(pc_2.get());
+
+  CPPUNIT_ASSERT(verify_order(cs));
+  CPPUNIT_ASSERT(cs.rarity_end(0) == 20);
+}
+
+void
+test_chunk_statistics::test_become_seeder() {
+  torrent::ChunkStatistics cs;
+  cs.initialize(4);
+
+  auto pc_1 = make_peer_chunks(4, {0, 1, 2});
+  auto pc_2 = make_peer_chunks(4, {0});
+
+  cs.received_connect(pc_1.get());
+  cs.received_connect(pc_2.get());
+
+  CPPUNIT_ASSERT(cs.rarity(0) == 2 && cs.rarity(3) == 0);
+
+  // The last chunk makes 'pc_1' a seeder, which is no longer counted
+  // per chunk.
+  cs.received_have_chunk(pc_1.get(), 3, 1 << 10);
+
+  CPPUNIT_ASSERT(cs.complete() == 1);
+  CPPUNIT_ASSERT(cs.accounted() == 1);
+  CPPUNIT_ASSERT(cs.rarity(0) == 1 && cs.rarity(1) == 0 && cs.rarity(3) == 0);
+  CPPUNIT_ASSERT(cs.rarity_end(0) - cs.rarity_begin(0) == 3);
+  CPPUNIT_ASSERT(verify_order(cs));
+
+  cs.received_disconnect(pc_1.get());
+  cs.received_disconnect(pc_2.get());
+
+  CPPUNIT_ASSERT(cs.complete() == 0);
+  CPPUNIT_ASSERT(verify_order(cs));
+}
+
+void
+test_chunk_statistics::test_bulk_update() {
+  const uint32_t size = 1003;
+
+  torrent::ChunkStatistics cs;
+  cs.initialize(size);
+
+  std::mt19937 rng(1);
+  std::vector<std::unique_ptr<torrent::PeerChunks>> peers;
+
+  // Mix dense peers, which use the bulk path, with sparse peers.
+  for (int i = 0; i < 8; i++) {
+    std::vector<uint32_t> chunks;
+
+    for (uint32_t index = 0; index < size; index++)
+      if (rng() % (i % 2 ? 2 : 64) == 0)
+        chunks.push_back(index);
+
+    peers.push_back(make_peer_chunks(size, chunks));
+    cs.received_connect(peers.back().get());
+  }
+
+  auto verify_counts = [&]() {
+    for (uint32_t index = 0; index < size; index++) {
+      uint32_t count = 0;
+
+      for (const auto& pc : peers)
+        count += pc->using_counter() && pc->bitfield()->get(index);
+
+      if (cs.rarity(index) != count)
+        return false;
+    }
+
+    return true;
+  };
+
+  CPPUNIT_ASSERT(cs.accounted() == 8);
+  CPPUNIT_ASSERT(verify_counts());
+  CPPUNIT_ASSERT(verify_order(cs));
+
+  for (int i = 0; i < 8; i += 3) {
+    cs.received_disconnect(peers[i].get());
+
+    CPPUNIT_ASSERT(verify_counts());
+    CPPUNIT_ASSERT(verify_order(cs));
+  }
+
+  for (const auto& pc : peers)
+    cs.received_disconnect(pc.get());
+
+  CPPUNIT_ASSERT(cs.accounted() == 0);
+  CPPUNIT_ASSERT(cs.rarity_end(0) == size);
+}
+
+void
+test_chunk_statistics::test_disconnect_batch() {
+  torrent::ChunkStatistics cs;
+  cs.initialize(20);
+
+  auto pc_1 = make_peer_chunks(20, {0, 1, 2});
+  auto pc_2 = make_peer_chunks(20, {1, 2, 3});
+  auto pc_3 = make_peer_chunks(20, {2, 19});
+  auto pc_4 = make_peer_chunks(20, {});
+
+  cs.received_connect(pc_1.get());
+  cs.received_connect(pc_2.get());
+  cs.received_connect(pc_3.get());
+  cs.received_connect(pc_4.get());
+
+  // Peers not counted, such as those with empty bitfields, are
+  // skipped.
+  std::vector<torrent::PeerChunks*> batch{pc_1.get(), pc_3.get(), pc_4.get()};
+  cs.received_disconnect(batch.data(), batch.data() + batch.size());
+
+  CPPUNIT_ASSERT(cs.accounted() == 1);
+  CPPUNIT_ASSERT(!pc_1->using_counter() && !pc_3->using_counter());
+  CPPUNIT_ASSERT(cs.rarity(0) == 0 && cs.rarity(1) == 1 && cs.rarity(2) == 1 && cs.rarity(19) == 0);
+  CPPUNIT_ASSERT(cs.rarity_end(1) - cs.rarity_begin(1) == 3);
+  CPPUNIT_ASSERT(verify_order(cs));
+
+  batch.assign({pc_2.get()});
+  cs.received_disconnect(batch.data(), batch.data() + batch.size());
+
+  CPPUNIT_ASSERT(cs.accounted() == 0);
+  CPPUNIT_ASSERT(cs.rarity_end(0) == 20);
+  CPPUNIT_ASSERT(verify_order(cs));
+}
+
+void
+test_chunk_statistics::test_distributed_copies() {
+  torrent::ChunkStatistics cs;
+  cs.initialize(4);
+
+  CPPUNIT_ASSERT(cs.distributed_copies() == 0.0);
+
+  auto pc_1 = make_peer_chunks(4, {0, 1});
+  auto pc_2 = make_peer_chunks(4, {2, 3});
+  auto pc_3 = make_peer_chunks(4, {0, 1, 2});
+
+  cs.received_connect(pc_1.get());
+  cs.received_connect(pc_2.get());
+
+  CPPUNIT_ASSERT(cs.distributed_copies() == 1.0);
+
+  cs.received_connect(pc_3.get());
+
+  CPPUNIT_ASSERT(cs.distributed_copies() == 1.75);
+
+  // Seeders count as whole copies.
+  cs.received_have_chunk(pc_3.get(), 3, 1 << 10);
+
+  CPPUNIT_ASSERT(cs.complete() == 1);
+  CPPUNIT_ASSERT(cs.distributed_copies() == 2.0);
+
+  cs.received_disconnect(pc_1.get());
+  cs.received_disconnect(pc_2.get());
+  cs.received_disconnect(pc_3.get());
+}
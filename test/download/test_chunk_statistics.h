@@ -0,0 +1,24 @@
+#include "test/helpers/test_fixture.h"
+
+class test_chunk_statistics : public test_fixture {
+  CPPUNIT_TEST_SUITE(test_chunk_statistics);
+
+  CPPUNIT_TEST(test_basic);
+  CPPUNIT_TEST(test_connect);
+  CPPUNIT_TEST(test_have_chunk);
+  CPPUNIT_TEST(test_become_seeder);
+  CPPUNIT_TEST(test_bulk_update);
+  CPPUNIT_TEST(test_disconnect_batch);
+  CPPUNIT_TEST(test_distributed_copies);
+
+  CPPUNIT_TEST_SUITE_END();
+
+public:
+  void test_basic();
+  void test_connect();
+  void test_have_chunk();
+  void test_become_seeder();
+  void test_bulk_update();
+  void test_disconnect_batch();
+  void test_distributed_copies();
+};
@@ -0,0 +1,56 @@
+#include "config.h"
+
+#include "test/download/test_connect_score.h"
+
+#include "download/connect_score.h"
+#include "test/helpers/network.h"
+#include "torrent/net/socket_address.h"
+#include "torrent/peer/peer_info.h"
+
+CPPUNIT_TEST_SUITE_REGISTRATION(test_connect_score);
+
+using torrent::connect_score;
+
+void
+test_connect_score::test_prefix() {
+  auto own  = wrap_ai_get_first_sa("10.0.0.1");
+  auto near = wrap_ai_get_first_sa("10.0.0.2");
+  auto far  = wrap_ai_get_first_sa("138.0.0.1");
+
+  CPPUNIT_ASSERT(connect_score::calculate(near.get(), nullptr, own.get(), 0) == 30 * connect_score::prefix_weight);
+  CPPUNIT_ASSERT(connect_score::calculate(far.get(), nullptr, own.get(), 0) == 0);
+  CPPUNIT_ASSERT(connect_score::calculate(far.get(), nullptr, own.get(), 5) == 5);
+  CPPUNIT_ASSERT(connect_score::calculate(near.get(), nullptr, nullptr, 0) == 0);
+
+  auto own6  = wrap_ai_get_first_sa("2001:db8::1");
+  auto near6 = wrap_ai_get_first_sa("2001:db8::2");
+
+  CPPUNIT_ASSERT(connect_score::calculate(near6.get(), nullptr, own6.get(), 0) == 32 * connect_score::prefix_weight);
+  CPPUNIT_ASSERT(connect_score::calculate(near6.get(), nullptr, own.get(), 0) == 0);
+}
+
+void
+test_connect_score::test_peer_info() {
+  auto sa = wrap_ai_get_first_sa("138.0.0.1");
+
+  torrent::PeerInfo fast(sa.get());
+  torrent::PeerInfo slow(sa.get());
+  torrent::PeerInfo unknown(sa.get());
+
+  fast.add_rtt_sample(std::chrono::milliseconds(1));
+  slow.add_rtt_sample(std::chrono::milliseconds(100));
+
+  auto fast_score    = connect_score::calculate(sa.get(), &fast, nullptr, 0);
+  auto slow_score    = connect_score::calculate(sa.get(), &slow, nullptr, 0);
+  auto unknown_score = connect_score::calculate(sa.get(), &unknown, nullptr, 0);
+
+  CPPUNIT_ASSERT(fast_score > slow_score);
+  CPPUNIT_ASSERT(slow_score > unknown_score);
+  CPPUNIT_ASSERT(unknown_score == 0);
+
+  slow.add_rtt_sample(std::chrono::milliseconds(20));
+  CPPUNIT_ASSERT(slow.rtt() == std::chrono::milliseconds(80));
+
+  unknown.set_failed_counter(2);
+  CPPUNIT_ASSERT(connect_score::calculate(sa.get(), &unknown, nullptr, 0) == -2 * connect_score::failed_weight);
+}
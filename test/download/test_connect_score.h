@@ -0,0 +1,14 @@
+#include "test/helpers/test_fixture.h"
+
+class test_connect_score : public test_fixture {
+  CPPUNIT_TEST_SUITE(test_connect_score);
+
+  CPPUNIT_TEST(test_prefix);
+  CPPUNIT_TEST(test_peer_info);
+
+  CPPUNIT_TEST_SUITE_END();
+
+public:
+  void test_prefix();
+  void test_peer_info();
+};
@@ -0,0 +1,360 @@
+#include "config.h"
+
+#include "test/download/test_delegator.h"
+
+#include <algorithm>
+#include <memory>
+#include <vector>
+
+#include "download/delegator.h"
+#include "protocol/peer_chunks.h"
+#include "rak/socket_address.h"
+#include "test/helpers/test_main_thread.h"
+#include "torrent/exceptions.h"
+#include "torrent/data/block.h"
+#include "torrent/data/block_list.h"
+#include "torrent/data/block_transfer.h"
+#include "torrent/peer/peer_info.h"
+
+CPPUNIT_TEST_SUITE_REGISTRATION(test_delegator);
+
+static constexpr uint32_t deadline_index = 2;
+static constexpr uint32_t normal_index   = 5;
+
+struct delegator_peer {
+  delegator_peer() : info(new torrent::PeerInfo(rak::socket_address().c_sockaddr())) {
+    chunks.set_peer_info(info.get());
+    chunks.bitfield()->set_size_bits(10);
+    chunks.bitfield()->allocate();
+    chunks.bitfield()->set_all();
+  }
+
+  std::unique_ptr<torrent::PeerInfo> info;
+  torrent::PeerChunks                chunks;
+};
+
+// Each chunk is two blocks.
+static std::unique_ptr<torrent::Delegator>
+make_delegator(std::chrono::microseconds* deadline, bool* deadline_found, bool* normal_found) {
+  auto delegator = std::make_unique<torrent::Delegator>();
+
+  delegator->slot_chunk_size() = [](uint32_t) { return 2 * torrent::Delegator::block_size; };
+
+  delegator->slot_chunk_find() = [normal_found](torrent::PeerChunks*, bool high_priority) {
+    if (high_priority || *normal_found)
+      return ~uint32_t{0};
+
+    *normal_found = true;
+    return normal_index;
+  };
+
+  delegator->slot_chunk_find_deadline() = [deadline_found](torrent::PeerChunks*) {
+    if (*deadline_found)
+      return ~uint32_t{0};
+
+    *deadline_found = true;
+    return deadline_index;
+  };
+
+  delegator->slot_chunk_deadline() = [deadline](uint32_t index) {
+    return index == deadline_index ? *deadline : std::chrono::microseconds{};
+  };
+
+  delegator->transfer_list()->slot_canceled()  = [](uint32_t) {};
+  delegator->transfer_list()->slot_queued()    = [](uint32_t) {};
+  delegator->transfer_list()->slot_completed() = [](uint32_t) {};
+  delegator->transfer_list()->slot_corrupt()   = [](torrent::PeerInfo*) {};
+
+  return delegator;
+}
+
+static uint32_t
+count_index(const std::vector<torrent::BlockTransfer*>& transfers, uint32_t index) {
+  return std::count_if(transfers.begin(), transfers.end(), [index](auto t) { return t->piece().index() == index; });
+}
+
+// Releases the transfers even if an assertion fails, as the transfer
+// list must be empty when destroyed.
+struct transfers_guard {
+  transfers_guard(torrent::Delegator* d) : delegator(d) {}
+  ~transfers_guard() {
+    for (auto transfer : transfers)
+      torrent::Block::release(transfer);
+
+    delegator->transfer_list()->clear();
+  }
+
+  void add(const std::vector<torrent::BlockTransfer*>& t) { transfers.insert(transfers.end(), t.begin(), t.end()); }
+
+  torrent::Delegator*                  delegator;
+  std::vector<torrent::BlockTransfer*> transfers;
+};
+
+void
+test_delegator::test_deadline_first() {
+  set_create_poll();
+  auto test_main_thread = TestMainThread::create();
+  test_main_thread->init_thread();
+  test_main_thread->test_set_cached_time(0s);
+
+  std::chrono::microseconds deadline = torrent::this_thread::cached_time() + 100s;
+  bool deadline_found = false;
+  bool normal_found = false;
+
+  auto delegator = make_delegator(&deadline, &deadline_found, &normal_found);
+  transfers_guard guard(delegator.get());
+  delegator_peer peer;
+
+  auto transfers = delegator->delegate(&peer.chunks, ~uint32_t{0}, 3);
+  guard.add(transfers);
+
+  CPPUNIT_ASSERT(transfers.size() == 3);
+  CPPUNIT_ASSERT(transfers[0]->piece().index() == deadline_index);
+  CPPUNIT_ASSERT(transfers[1]->piece().index() == deadline_index);
+  CPPUNIT_ASSERT(transfers[2]->piece().index() == normal_index);
+
+  CPPUNIT_ASSERT(delegator->transfer_list()->find(deadline_index) != delegator->transfer_list()->end());
+  CPPUNIT_ASSERT((*delegator->transfer_list()->find(deadline_index))->priority() == torrent::PRIORITY_HIGH);
+}
+
+void
+test_delegator::test_deadline_duplicate() {
+  set_create_poll();
+  auto test_main_thread = TestMainThread::create();
+  test_main_thread->init_thread();
+  test_main_thread->test_set_cached_time(0s);
+
+  std::chrono::microseconds deadline = torrent::this_thread::cached_time() + 100s;
+  bool deadline_found = false;
+  bool normal_found = true;
+
+  auto delegator = make_delegator(&deadline, &deadline_found, &normal_found);
+  transfers_guard guard(delegator.get());
+  delegator_peer peer_1;
+  delegator_peer peer_2;
+  delegator_peer peer_3;
+
+  auto transfers_1 = delegator->delegate(&peer_1.chunks, ~uint32_t{0}, 4);
+  guard.add(transfers_1);
+  CPPUNIT_ASSERT(transfers_1.size() == 2);
+  CPPUNIT_ASSERT(count_index(transfers_1, deadline_index) == 2);
+
+  // Far from the deadline nothing is duplicated.
+  auto transfers_2 = delegator->delegate(&peer_2.chunks, ~uint32_t{0}, 4);
+  guard.add(transfers_2);
+  CPPUNIT_ASSERT(transfers_2.empty());
+
+  test_main_thread->test_set_cached_time(99s);
+
+  transfers_2 = delegator->delegate(&peer_2.chunks, ~uint32_t{0}, 4);
+  guard.add(transfers_2);
+  CPPUNIT_ASSERT(transfers_2.size() == 2);
+  CPPUNIT_ASSERT(count_index(transfers_2, deadline_index) == 2);
+
+  // Only one duplicate per block.
+  auto transfers_3 = delegator->delegate(&peer_3.chunks, ~uint32_t{0}, 4);
+  guard.add(transfers_3);
+  CPPUNIT_ASSERT(transfers_3.empty());
+}
+
+void
+test_delegator::test_straggler_duplicate() {
+  set_create_poll();
+  auto test_main_thread = TestMainThread::create();
+  test_main_thread->init_thread();
+  test_main_thread->test_set_cached_time(0s);
+
+  std::chrono::microseconds deadline{};
+  bool deadline_found = true;
+  bool normal_found = false;
+
+  auto delegator = make_delegator(&deadline, &deadline_found, &normal_found);
+  transfers_guard guard(delegator.get());
+  delegator_peer peer_1;
+  delegator_peer peer_2;
+  delegator_peer peer_3;
+  delegator_peer peer_4;
+
+  delegator->set_straggler_timeout(5s);
+
+  auto transfers_1 = delegator->delegate(&peer_1.chunks, ~uint32_t{0}, 4);
+  guard.add(transfers_1);
+  CPPUNIT_ASSERT(transfers_1.size() == 2);
+  CPPUNIT_ASSERT(count_index(transfers_1, normal_index) == 2);
+
+  auto transfers_2 = delegator->delegate(&peer_2.chunks, ~uint32_t{0}, 4);
+  guard.add(transfers_2);
+  CPPUNIT_ASSERT(transfers_2.empty());
+
+  test_main_thread->test_set_cached_time(6s);
+
+  transfers_2 = delegator->delegate(&peer_2.chunks, ~uint32_t{0}, 4);
+  guard.add(transfers_2);
+  CPPUNIT_ASSERT(transfers_2.size() == 2);
+
+  // The requests to the second peer are recent.
+  auto transfers_3 = delegator->delegate(&peer_3.chunks, ~uint32_t{0}, 4);
+  guard.add(transfers_3);
+  CPPUNIT_ASSERT(transfers_3.empty());
+
+  test_main_thread->test_set_cached_time(12s);
+
+  transfers_3 = delegator->delegate(&peer_3.chunks, ~uint32_t{0}, 1);
+  guard.add(transfers_3);
+  CPPUNIT_ASSERT(transfers_3.size() == 1);
+
+  test_main_thread->test_set_cached_time(20s);
+
+  // The first block has reached the limit of requests.
+  auto transfers_4 = delegator->delegate(&peer_4.chunks, ~uint32_t{0}, 4);
+  guard.add(transfers_4);
+  CPPUNIT_ASSERT(transfers_4.size() == 1);
+  CPPUNIT_ASSERT(transfers_4[0]->piece().offset() == torrent::Delegator::block_size);
+
+  delegator->set_straggler_timeout(std::chrono::microseconds{});
+}
+
+void
+test_delegator::test_endgame_budget() {
+  set_create_poll();
+  auto test_main_thread = TestMainThread::create();
+  test_main_thread->init_thread();
+  test_main_thread->test_set_cached_time(0s);
+
+  std::chrono::microseconds deadline{};
+  bool deadline_found = true;
+  bool normal_found = false;
+
+  auto delegator = make_delegator(&deadline, &deadline_found, &normal_found);
+  transfers_guard guard(delegator.get());
+  delegator_peer peer_1;
+  delegator_peer peer_2;
+  delegator_peer peer_3;
+
+  auto transfers_1 = delegator->delegate(&peer_1.chunks, ~uint32_t{0}, 4);
+  guard.add(transfers_1);
+  CPPUNIT_ASSERT(transfers_1.size() == 2);
+
+  // No duplicates outside end-game mode.
+  auto transfers_2 = delegator->delegate(&peer_2.chunks, ~uint32_t{0}, 4);
+  guard.add(transfers_2);
+  CPPUNIT_ASSERT(transfers_2.empty());
+
+  delegator->set_aggressive(true);
+
+  transfers_2 = delegator->delegate(&peer_2.chunks, ~uint32_t{0}, 4);
+  guard.add(transfers_2);
+  CPPUNIT_ASSERT(transfers_2.size() == 2);
+
+  auto transfers_3 = delegator->delegate(&peer_3.chunks, ~uint32_t{0}, 4);
+  guard.add(transfers_3);
+  CPPUNIT_ASSERT(transfers_3.empty());
+
+  delegator->set_endgame_duplicates(2);
+
+  transfers_3 = delegator->delegate(&peer_3.chunks, ~uint32_t{0}, 4);
+  guard.add(transfers_3);
+  CPPUNIT_ASSERT(transfers_3.size() == 2);
+}
+
+void
+test_delegator::test_endgame_latency() {
+  set_create_poll();
+  auto test_main_thread = TestMainThread::create();
+  test_main_thread->init_thread();
+  test_main_thread->test_set_cached_time(0s);
+
+  std::chrono::microseconds deadline{};
+  bool deadline_found = true;
+  bool normal_found = false;
+
+  auto delegator = make_delegator(&deadline, &deadline_found, &normal_found);
+  transfers_guard guard(delegator.get());
+  delegator_peer peer_1;
+  delegator_peer peer_2;
+  delegator_peer peer_3;
+  delegator_peer peer_4;
+
+  delegator->slot_peer_latency() = [&](torrent::PeerInfo* peer) {
+    if (peer == peer_1.info.get())
+      return std::chrono::microseconds(10ms);
+    if (peer == peer_2.info.get())
+      return std::chrono::microseconds(20ms);
+    if (peer == peer_3.info.get())
+      return std::chrono::microseconds(5ms);
+
+    return std::chrono::microseconds{};
+  };
+
+  delegator->set_aggressive(true);
+
+  auto transfers_1 = delegator->delegate(&peer_1.chunks, ~uint32_t{0}, 4);
+  guard.add(transfers_1);
+  CPPUNIT_ASSERT(transfers_1.size() == 2);
+
+  // Slower or unmeasured peers don't get duplicates.
+  auto transfers_2 = delegator->delegate(&peer_2.chunks, ~uint32_t{0}, 4);
+  guard.add(transfers_2);
+  CPPUNIT_ASSERT(transfers_2.empty());
+
+  auto transfers_4 = delegator->delegate(&peer_4.chunks, ~uint32_t{0}, 4);
+  guard.add(transfers_4);
+  CPPUNIT_ASSERT(transfers_4.empty());
+
+  auto transfers_3 = delegator->delegate(&peer_3.chunks, ~uint32_t{0}, 4);
+  guard.add(transfers_3);
+  CPPUNIT_ASSERT(transfers_3.size() == 2);
+
+  // Stalled requests don't count against the peer.
+  torrent::Block::stalled(transfers_3[0]);
+
+  transfers_2 = delegator->delegate(&peer_2.chunks, ~uint32_t{0}, 4);
+  guard.add(transfers_2);
+  CPPUNIT_ASSERT(transfers_2.empty());
+
+  torrent::Block::stalled(transfers_1[0]);
+
+  transfers_2 = delegator->delegate(&peer_2.chunks, ~uint32_t{0}, 4);
+  guard.add(transfers_2);
+  CPPUNIT_ASSERT(transfers_2.size() == 1);
+  CPPUNIT_ASSERT(transfers_2[0]->piece().offset() == 0);
+}
+
+void
+test_delegator::test_stalled_count() {
+  set_create_poll();
+  auto test_main_thread = TestMainThread::create();
+  test_main_thread->init_thread();
+  test_main_thread->test_set_cached_time(0s);
+
+  delegator_peer peer_1;
+  delegator_peer peer_2;
+
+  torrent::BlockList block_list(torrent::Piece(0, 0, 3 * torrent::Delegator::block_size), torrent::Delegator::block_size);
+
+  CPPUNIT_ASSERT(block_list.stalled() == 3);
+
+  auto transfer_1 = block_list[0].insert(peer_1.info.get());
+  auto transfer_2 = block_list[0].insert(peer_2.info.get());
+  auto transfer_3 = block_list[1].insert(peer_1.info.get());
+
+  CPPUNIT_ASSERT(block_list.stalled() == 1);
+
+  torrent::Block::stalled(transfer_1);
+  CPPUNIT_ASSERT(block_list.stalled() == 1);
+
+  torrent::Block::stalled(transfer_2);
+  torrent::Block::stalled(transfer_3);
+  CPPUNIT_ASSERT(block_list.stalled() == 3);
+
+  torrent::Block::release(transfer_1);
+  torrent::Block::release(transfer_2);
+  torrent::Block::release(transfer_3);
+  CPPUNIT_ASSERT(block_list.stalled() == 3);
+
+  auto transfer_4 = block_list[2].insert(peer_2.info.get());
+  CPPUNIT_ASSERT(block_list.stalled() == 2);
+
+  torrent::Block::release(transfer_4);
+  CPPUNIT_ASSERT(block_list.stalled() == 3);
+}
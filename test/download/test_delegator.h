@@ -0,0 +1,22 @@
+#include "test/helpers/test_fixture.h"
+
+class test_delegator : public test_fixture {
+  CPPUNIT_TEST_SUITE(test_delegator);
+
+  CPPUNIT_TEST(test_deadline_first);
+  CPPUNIT_TEST(test_deadline_duplicate);
+  CPPUNIT_TEST(test_straggler_duplicate);
+  CPPUNIT_TEST(test_endgame_budget);
+  CPPUNIT_TEST(test_endgame_latency);
+  CPPUNIT_TEST(test_stalled_count);
+
+  CPPUNIT_TEST_SUITE_END();
+
+public:
+  void test_deadline_first();
+  void test_deadline_duplicate();
+  void test_straggler_duplicate();
+  void test_endgame_budget();
+  void test_endgame_latency();
+  void test_stalled_count();
+};
@@ -0,0 +1,72 @@
+#include "config.h"
+
+#include "test/download/test_metadata_fetch.h"
+
+#include <string>
+
+#include "download/delegator.h"
+#include "download/metadata_fetch.h"
+#include "test/helpers/test_main_thread.h"
+
+CPPUNIT_TEST_SUITE_REGISTRATION(test_metadata_fetch);
+
+static const std::string pieces_20 = "20:" + std::string(20, 'x');
+
+static bool
+validate(const std::string& info) {
+  return torrent::MetadataFetch::validate(info.data(), info.size());
+}
+
+void
+test_metadata_fetch::test_validate() {
+  CPPUNIT_ASSERT(validate("d6:lengthi10e4:name1:a12:piece lengthi16384e6:pieces" + pieces_20 + "e"));
+  CPPUNIT_ASSERT(validate("d5:filesld6:lengthi1e4:pathl1:beee4:name1:a12:piece lengthi16384e6:pieces" + pieces_20 + "e"));
+}
+
+void
+test_metadata_fetch::test_validate_invalid() {
+  // Not bencode, not a dictionary or trailing data.
+  CPPUNIT_ASSERT(!validate("garbage"));
+  CPPUNIT_ASSERT(!validate("li1ee"));
+  CPPUNIT_ASSERT(!validate("d6:lengthi10e4:name1:a12:piece lengthi16384e6:pieces" + pieces_20 + "ee"));
+  CPPUNIT_ASSERT(!validate("d6:lengthi10e4:name1:a"));
+
+  // Missing or malformed fields.
+  CPPUNIT_ASSERT(!validate("d4:name1:a12:piece lengthi16384e6:pieces" + pieces_20 + "e"));
+  CPPUNIT_ASSERT(!validate("d6:lengthi10e12:piece lengthi16384e6:pieces" + pieces_20 + "e"));
+  CPPUNIT_ASSERT(!validate("d6:lengthi10e4:name1:a6:pieces" + pieces_20 + "e"));
+  CPPUNIT_ASSERT(!validate("d6:lengthi10e4:name1:a12:piece lengthi16384e6:pieces3:abce"));
+
+  // Unordered keys are rejected when parsing the torrent.
+  CPPUNIT_ASSERT(!validate("d4:name1:a6:lengthi10e12:piece lengthi16384e6:pieces" + pieces_20 + "e"));
+}
+
+void
+test_metadata_fetch::test_time_to_metadata() {
+  set_create_poll();
+  auto test_main_thread = TestMainThread::create();
+  test_main_thread->init_thread();
+  test_main_thread->test_set_cached_time(10s);
+
+  torrent::Delegator delegator;
+  torrent::MetadataFetch fetch;
+
+  fetch.start(&delegator);
+
+  CPPUNIT_ASSERT(fetch.is_started() && !fetch.is_finished());
+  CPPUNIT_ASSERT(delegator.straggler_timeout() == torrent::MetadataFetch::straggler_timeout);
+  CPPUNIT_ASSERT(fetch.time_to_metadata() == std::chrono::microseconds{});
+
+  test_main_thread->test_set_cached_time(13s);
+
+  CPPUNIT_ASSERT(!fetch.finish("li1ee", 5));
+  CPPUNIT_ASSERT(fetch.failed_count() == 1 && !fetch.is_finished());
+
+  std::string info = "d6:lengthi10e4:name1:a12:piece lengthi16384e6:pieces" + pieces_20 + "e";
+
+  CPPUNIT_ASSERT(fetch.finish(info.data(), info.size()));
+  CPPUNIT_ASSERT(fetch.time_to_metadata() == 3s);
+
+  fetch.stop(&delegator);
+  CPPUNIT_ASSERT(delegator.straggler_timeout() == std::chrono::microseconds{});
+}
@@ -0,0 +1,16 @@
+#include "test/helpers/test_fixture.h"
+
+class test_metadata_fetch : public test_fixture {
+  CPPUNIT_TEST_SUITE(test_metadata_fetch);
+
+  CPPUNIT_TEST(test_validate);
+  CPPUNIT_TEST(test_validate_invalid);
+  CPPUNIT_TEST(test_time_to_metadata);
+
+  CPPUNIT_TEST_SUITE_END();
+
+public:
+  void test_validate();
+  void test_validate_invalid();
+  void test_time_to_metadata();
+};
@@ -0,0 +1,95 @@
+#include "config.h"
+
+#include "test/download/test_web_seed.h"
+
+#include <iterator>
+
+#include "download/web_seed.h"
+#include "torrent/data/file.h"
+#include "torrent/data/file_list.h"
+#include "torrent/path.h"
+
+CPPUNIT_TEST_SUITE_REGISTRATION(test_web_seed);
+
+namespace {
+
+class file_list_access : public torrent::FileList {
+public:
+  using FileList::initialize;
+};
+
+torrent::FileList::split_type
+make_file(uint64_t size, const std::string& dir, const std::string& name, int flags = 0) {
+  torrent::Path path;
+
+  if (!dir.empty())
+    path.push_back(dir);
+
+  path.push_back(name);
+
+  return torrent::FileList::split_type(size, path, flags);
+}
+
+}
+
+void
+test_web_seed::test_file_url_single() {
+  torrent::File file;
+
+  CPPUNIT_ASSERT(torrent::WebSeed::file_url("http://a/b/file", "name", &file, false) == "http://a/b/file");
+  CPPUNIT_ASSERT(torrent::WebSeed::file_url("http://a/b/", "name", &file, false) == "http://a/b/name");
+  CPPUNIT_ASSERT(torrent::WebSeed::file_url("http://a/b/", "a b", &file, false) == "http://a/b/a%20b");
+}
+
+void
+test_web_seed::test_file_url_multi() {
+  torrent::File file;
+  file.mutable_path()->push_back("dir");
+  file.mutable_path()->push_back("file");
+
+  CPPUNIT_ASSERT(torrent::WebSeed::file_url("http://a/b", "name", &file, true) == "http://a/b/name/dir/file");
+  CPPUNIT_ASSERT(torrent::WebSeed::file_url("http://a/b/", "name", &file, true) == "http://a/b/name/dir/file");
+}
+
+void
+test_web_seed::test_file_url_escape() {
+  torrent::File file;
+  file.mutable_path()->push_back("a-b_c.d~e");
+  file.mutable_path()->push_back("f g/h%");
+
+  CPPUNIT_ASSERT(torrent::WebSeed::file_url("http://a/", "x.y", &file, true) == "http://a/x.y/a-b_c.d~e/f%20g%2Fh%25");
+}
+
+void
+test_web_seed::test_segments_padding() {
+  torrent::FileList::split_type files[] = {
+    make_file(100, "", "first"),
+    make_file(28, ".pad", "28", torrent::File::flag_attr_padding),
+    make_file(200, "", "second"),
+  };
+
+  file_list_access file_list;
+  file_list.initialize(328, 64);
+  file_list.split(file_list.begin(), std::begin(files), std::end(files));
+  file_list.set_multi_file(true);
+
+  auto segments = torrent::WebSeed::create_segments("http://a/", "name", &file_list, 50, 250);
+
+  CPPUNIT_ASSERT(segments.size() == 3);
+
+  CPPUNIT_ASSERT(segments[0].url == "http://a/name/first");
+  CPPUNIT_ASSERT(segments[0].offset == 50 && segments[0].length == 50);
+
+  CPPUNIT_ASSERT(segments[1].is_padding());
+  CPPUNIT_ASSERT(segments[1].offset == 0 && segments[1].length == 28);
+
+  CPPUNIT_ASSERT(segments[2].url == "http://a/name/second");
+  CPPUNIT_ASSERT(segments[2].offset == 0 && segments[2].length == 122);
+
+  // A range only within the padding makes no requests.
+  segments = torrent::WebSeed::create_segments("http://a/", "name", &file_list, 110, 120);
+
+  CPPUNIT_ASSERT(segments.size() == 1);
+  CPPUNIT_ASSERT(segments[0].is_padding());
+  CPPUNIT_ASSERT(segments[0].offset == 10 && segments[0].length == 10);
+}
@@ -0,0 +1,18 @@
+#include "test/helpers/test_fixture.h"
+
+class test_web_seed : public test_fixture {
+  CPPUNIT_TEST_SUITE(test_web_seed);
+
+  CPPUNIT_TEST(test_file_url_single);
+  CPPUNIT_TEST(test_file_url_multi);
+  CPPUNIT_TEST(test_file_url_escape);
+  CPPUNIT_TEST(test_segments_padding);
+
+  CPPUNIT_TEST_SUITE_END();
+
+public:
+  void test_file_url_single();
+  void test_file_url_multi();
+  void test_file_url_escape();
+  void test_segments_padding();
+};
@@ -5,6 +5,7 @@
 
 #include "test/helpers/test_thread.h"
 #include "torrent/common.h"
+#include "torrent/tracker/manager.h"
 #include "torrent/utils/thread.h"
 #include "tracker/thread_tracker.h"
 
@@ -20,6 +21,8 @@ public:
 
   void                test_set_cached_time(std::chrono::microseconds t) { set_cached_time(365 * 24h + t); }
   void                test_process_events_without_cached_time()         { process_events_without_cached_time(); }
+  void                test_process_callbacks()                          { process_callbacks(); }
+  void                test_stats_publish()                              { stats_publish(); }
 
 private:
   TestMainThread();
@@ -34,7 +37,9 @@ private:
   test_main_thread->init_thread();                                  \
   torrent::ThreadTracker::create_thread(test_main_thread.get());    \
   torrent::thread_tracker()->init_thread();                         \
-  torrent::thread_tracker()->start_thread();
+  torrent::thread_tracker()->start_thread();                        \
+  torrent::thread_tracker()->tracker_manager()->set_announce_rate(0); \
+  torrent::thread_tracker()->tracker_manager()->set_announce_jitter(std::chrono::seconds(0));
 
 // Make sure tearDown also calls torrent::ThreadTracker::destroy_thread().
 
@@ -0,0 +1,144 @@
+#include "config.h"
+
+#include "test/net/test_local_discovery.h"
+
+#include "manager.h"
+#include "thread_main.h"
+#include "net/local_discovery.h"
+#include "net/thread_net.h"
+#include "test/helpers/test_thread.h"
+#include "torrent/poll.h"
+
+CPPUNIT_TEST_SUITE_REGISTRATION(test_local_discovery);
+
+using torrent::LocalDiscovery;
+
+static torrent::HashString
+make_hash(char c) {
+  torrent::HashString hash;
+  hash.clear(c);
+  return hash;
+}
+
+static bool
+parse(const std::string& message, uint16_t* port, LocalDiscovery::hash_list* hashes, std::string* cookie) {
+  return LocalDiscovery::parse_announce(message.data(), message.size(), port, hashes, cookie);
+}
+
+void
+test_local_discovery::test_create() {
+  auto messages = LocalDiscovery::create_announces(6881, { make_hash(0x12) }, "abc");
+
+  CPPUNIT_ASSERT(messages.size() == 1);
+  CPPUNIT_ASSERT(messages[0] ==
+                 "BT-SEARCH * HTTP/1.1\r\n"
+                 "Host: 239.192.152.143:6771\r\n"
+                 "Port: 6881\r\n"
+                 "Infohash: 1212121212121212121212121212121212121212\r\n"
+                 "cookie: abc\r\n"
+                 "\r\n\r\n");
+}
+
+void
+test_local_discovery::test_create_split() {
+  LocalDiscovery::hash_list hashes;
+
+  for (int i = 0; i < 100; i++)
+    hashes.push_back(make_hash(i));
+
+  auto messages = LocalDiscovery::create_announces(6881, hashes, "abc");
+
+  CPPUNIT_ASSERT(messages.size() > 1);
+
+  LocalDiscovery::hash_list parsed;
+
+  for (const auto& message : messages) {
+    uint16_t port;
+    LocalDiscovery::hash_list message_hashes;
+    std::string cookie;
+
+    CPPUNIT_ASSERT(message.size() <= LocalDiscovery::max_message_size);
+    CPPUNIT_ASSERT(parse(message, &port, &message_hashes, &cookie));
+    CPPUNIT_ASSERT(port == 6881 && cookie == "abc");
+
+    parsed.insert(parsed.end(), message_hashes.begin(), message_hashes.end());
+  }
+
+  CPPUNIT_ASSERT(parsed == hashes);
+}
+
+void
+test_local_discovery::test_parse() {
+  uint16_t port;
+  LocalDiscovery::hash_list hashes;
+  std::string cookie;
+
+  CPPUNIT_ASSERT(parse("BT-SEARCH * HTTP/1.1\r\n"
+                       "Host: 239.192.152.143:6771\r\n"
+                       "port:  51413 \r\n"
+                       "Infohash: abababababababababababababababababababab\r\n"
+                       "INFOHASH: cdcdcdcdcdcdcdcdcdcdcdcdcdcdcdcdcdcdcdcd\r\n"
+                       "\r\n\r\n", &port, &hashes, &cookie));
+
+  CPPUNIT_ASSERT(port == 51413);
+  CPPUNIT_ASSERT(cookie.empty());
+  CPPUNIT_ASSERT(hashes.size() == 2);
+  CPPUNIT_ASSERT(hashes[0] == make_hash(0xab));
+  CPPUNIT_ASSERT(hashes[1] == make_hash(0xcd));
+}
+
+void
+test_local_discovery::test_parse_invalid() {
+  uint16_t port;
+  LocalDiscovery::hash_list hashes;
+  std::string cookie;
+
+  const std::string hash_line = "Infohash: abababababababababababababababababababab\r\n";
+
+  CPPUNIT_ASSERT(!parse("", &port, &hashes, &cookie));
+  CPPUNIT_ASSERT(!parse("GET / HTTP/1.1\r\nPort: 1\r\n" + hash_line + "\r\n", &port, &hashes, &cookie));
+  CPPUNIT_ASSERT(!parse("BT-SEARCH * HTTP/1.1\r\n" + hash_line + "\r\n", &port, &hashes, &cookie));
+  CPPUNIT_ASSERT(!parse("BT-SEARCH * HTTP/1.1\r\nPort: 0\r\n" + hash_line + "\r\n", &port, &hashes, &cookie));
+  CPPUNIT_ASSERT(!parse("BT-SEARCH * HTTP/1.1\r\nPort: 70000\r\n" + hash_line + "\r\n", &port, &hashes, &cookie));
+  CPPUNIT_ASSERT(!parse("BT-SEARCH * HTTP/1.1\r\nPort: 1x\r\n" + hash_line + "\r\n", &port, &hashes, &cookie));
+  CPPUNIT_ASSERT(!parse("BT-SEARCH * HTTP/1.1\r\nPort: 1\r\nInfohash: abab\r\n\r\n", &port, &hashes, &cookie));
+  CPPUNIT_ASSERT(!parse("BT-SEARCH * HTTP/1.1\r\nPort: 1\r\nInfohash: zzabababababababababababababababababababab\r\n\r\n", &port, &hashes, &cookie));
+}
+
+// Without a running thread_net the socket is registered in the poll
+// of the caller, and must be removed from the same poll on close.
+void
+test_local_discovery::test_open_close() {
+  mock_redirect_defaults();
+  set_create_poll();
+
+  torrent::ThreadMain::create_thread();
+  torrent::thread_main()->init_thread();
+  torrent::ThreadNet::create_thread();
+  torrent::thread_net()->init_thread();
+
+  torrent::manager = new torrent::Manager;
+
+  {
+    LocalDiscovery local_discovery;
+
+    for (int i = 0; i < 2; i++) {
+      if (!local_discovery.open(6881))
+        break;
+
+      CPPUNIT_ASSERT(torrent::thread_main()->poll()->in_read(&local_discovery));
+      CPPUNIT_ASSERT(!torrent::thread_net()->poll()->in_read(&local_discovery));
+
+      // A stale registration in the main poll makes reopening with
+      // the same descriptor throw.
+      local_discovery.close();
+      CPPUNIT_ASSERT(!local_discovery.is_open());
+    }
+  }
+
+  delete torrent::manager;
+  torrent::manager = nullptr;
+
+  delete torrent::thread_net();
+  delete torrent::thread_main();
+}
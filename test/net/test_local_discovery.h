@@ -0,0 +1,20 @@
+#include "helpers/test_fixture.h"
+
+class test_local_discovery : public test_fixture {
+  CPPUNIT_TEST_SUITE(test_local_discovery);
+
+  CPPUNIT_TEST(test_create);
+  CPPUNIT_TEST(test_create_split);
+  CPPUNIT_TEST(test_parse);
+  CPPUNIT_TEST(test_parse_invalid);
+  CPPUNIT_TEST(test_open_close);
+
+  CPPUNIT_TEST_SUITE_END();
+
+public:
+  void test_create();
+  void test_create_split();
+  void test_parse();
+  void test_parse_invalid();
+  void test_open_close();
+};
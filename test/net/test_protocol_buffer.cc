@@ -0,0 +1,56 @@
+#include "config.h"
+
+#include "test_protocol_buffer.h"
+
+#include <memory>
+
+#include "net/protocol_buffer.h"
+
+CPPUNIT_TEST_SUITE_NAMED_REGISTRATION(test_protocol_buffer, "net");
+
+void
+test_protocol_buffer::test_basic() {
+  torrent::ProtocolBuffer<64> buffer;
+  buffer.reset();
+
+  buffer.write_32(0x01020304);
+  buffer.write_8(5);
+  buffer.write_16(0x0607);
+
+  CPPUNIT_ASSERT(buffer.size_end() == 7);
+  CPPUNIT_ASSERT(buffer.remaining() == 7);
+  CPPUNIT_ASSERT(buffer.reserved_left() == 57);
+
+  CPPUNIT_ASSERT(buffer.read_32() == 0x01020304);
+  CPPUNIT_ASSERT(!buffer.consume(1));
+  CPPUNIT_ASSERT(buffer.peek_16() == 0x0607);
+
+  buffer.move_unused();
+
+  CPPUNIT_ASSERT(buffer.size_position() == 0);
+  CPPUNIT_ASSERT(buffer.remaining() == 2);
+  CPPUNIT_ASSERT(buffer.read_16() == 0x0607);
+  CPPUNIT_ASSERT(buffer.remaining() == 0);
+}
+
+// Sizes and offsets beyond 64 KiB used to wrap around.
+void
+test_protocol_buffer::test_large() {
+  using buffer_type = torrent::ProtocolBuffer<(1 << 18)>;
+
+  auto buffer = std::make_unique<buffer_type>();
+  buffer->reset();
+
+  CPPUNIT_ASSERT(buffer->reserved() == (1 << 18));
+
+  CPPUNIT_ASSERT(buffer->move_end(100000) == 100000);
+  CPPUNIT_ASSERT(buffer->remaining() == 100000);
+  CPPUNIT_ASSERT(buffer->reserved_left() == (1 << 18) - 100000);
+
+  buffer->write_32(0xdeadbeef);
+
+  CPPUNIT_ASSERT(!buffer->consume(100000));
+  CPPUNIT_ASSERT(buffer->size_position() == 100000);
+  CPPUNIT_ASSERT(buffer->read_32() == 0xdeadbeef);
+  CPPUNIT_ASSERT(buffer->remaining() == 0);
+}
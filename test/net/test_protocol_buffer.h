@@ -0,0 +1,14 @@
+#include "helpers/test_fixture.h"
+
+class test_protocol_buffer : public test_fixture {
+  CPPUNIT_TEST_SUITE(test_protocol_buffer);
+
+  CPPUNIT_TEST(test_basic);
+  CPPUNIT_TEST(test_large);
+
+  CPPUNIT_TEST_SUITE_END();
+
+public:
+  void test_basic();
+  void test_large();
+};
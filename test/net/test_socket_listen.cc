@@ -385,13 +385,13 @@ test_socket_listen::test_accept() {
     expect_fd_bind_listen(1000, c_sin6_any_5000);
     TEST_SL_ASSERT_OPEN_SEQUENTIAL(torrent::sap_copy(sin6_any), c_sin6_any_5000, 5000, 5010, torrent::fd_flag_stream);
 
-    std::vector<torrent::fd_sap_tuple> accepted_connections;
+    std::vector<torrent::fd_sa_tuple> accepted_connections;
 
-    sl->set_slot_accepted([&accepted_connections](int accept_fd, torrent::sa_unique_ptr sap) {
-        accepted_connections.push_back(torrent::fd_sap_tuple{accept_fd, std::move(sap)});
+    sl->set_slot_accepted([&accepted_connections](int accept_fd, const torrent::sa_inet_storage& sa) {
+        accepted_connections.push_back(torrent::fd_sa_tuple{accept_fd, sa});
       });
 
-    // CPPUNIT_ASSERT(accepted_connections.size() > 0 && torrent::fd_sap_equal(accepted_connections[0], torrent::fd_sap_tuple{2000, torrent::sap_copy(sin6_1_5100)}));
+    // CPPUNIT_ASSERT(accepted_connections.size() > 0 && std::get<0>(accepted_connections[0]) == 2000 && torrent::sa_equal(std::get<1>(accepted_connections[0]).get(), sin6_1_5100.get()));
 
     TEST_SL_CLOSE(1000);
   };
@@ -0,0 +1,155 @@
+#include "config.h"
+
+#include "test_socket_stream.h"
+
+#include <string>
+#include <vector>
+#include <csignal>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/socket.h>
+
+#include "net/socket_stream.h"
+#include "torrent/exceptions.h"
+
+CPPUNIT_TEST_SUITE_NAMED_REGISTRATION(test_socket_stream, "net");
+
+namespace {
+
+class test_stream : public torrent::SocketStream {
+public:
+  test_stream(int fd) { set_file_descriptor(fd); }
+  ~test_stream() override { ::close(m_fileDesc); get_fd().clear(); }
+
+  void event_read() override {}
+  void event_write() override {}
+  void event_error() override {}
+};
+
+struct stream_pair {
+  stream_pair() {
+    int fds[2];
+    CPPUNIT_ASSERT(::socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == 0);
+    CPPUNIT_ASSERT(::fcntl(fds[0], F_SETFL, O_NONBLOCK) == 0);
+
+    local = std::make_unique<test_stream>(fds[0]);
+    remote = fds[1];
+  }
+
+  ~stream_pair() {
+    if (remote != -1)
+      ::close(remote);
+  }
+
+  std::string read_remote(size_t length) {
+    std::string result(length, '\0');
+    size_t      pos = 0;
+
+    while (pos < length) {
+      ssize_t r = ::read(remote, &result[pos], length - pos);
+      CPPUNIT_ASSERT(r > 0);
+      pos += r;
+    }
+
+    return result;
+  }
+
+  std::unique_ptr<test_stream> local;
+  int                          remote;
+};
+
+}
+
+void
+test_socket_stream::test_read_vector() {
+  stream_pair pair;
+
+  char  first[6] = {};
+  char  second[8] = {};
+  iovec vec[] = { { first, 5 }, { second, 7 } };
+
+  CPPUNIT_ASSERT(pair.local->read_vector_throws(vec, 2) == 0);
+
+  CPPUNIT_ASSERT(::write(pair.remote, "piecedheader", 12) == 12);
+  CPPUNIT_ASSERT(pair.local->read_vector_throws(vec, 2) == 12);
+
+  CPPUNIT_ASSERT(std::string(first) == "piece");
+  CPPUNIT_ASSERT(std::string(second) == "dheader");
+
+  CPPUNIT_ASSERT_THROW(pair.local->read_vector_throws(vec, 0), torrent::internal_error);
+
+  ::close(pair.remote);
+  pair.remote = -1;
+
+  CPPUNIT_ASSERT_THROW(pair.local->read_vector_throws(vec, 2), torrent::close_connection);
+}
+
+// Only what is available is read, filling the vectors in order.
+void
+test_socket_stream::test_read_vector_partial() {
+  stream_pair pair;
+
+  char  first[6] = {};
+  char  second[8] = {};
+  iovec vec[] = { { first, 5 }, { second, 7 } };
+
+  CPPUNIT_ASSERT(::write(pair.remote, "pieced", 6) == 6);
+  CPPUNIT_ASSERT(pair.local->read_vector_throws(vec, 2) == 6);
+
+  CPPUNIT_ASSERT(std::string(first) == "piece");
+  CPPUNIT_ASSERT(std::string(second) == "d");
+}
+
+void
+test_socket_stream::test_write_vector() {
+  stream_pair pair;
+
+  char header[] = "header";
+  char first[] = "first";
+  char second[] = "second";
+
+  iovec vec[] = { { header, 6 }, { first, 5 }, { second, 6 } };
+
+  CPPUNIT_ASSERT(pair.local->write_vector_throws(vec, 3) == 17);
+  CPPUNIT_ASSERT(pair.read_remote(17) == "headerfirstsecond");
+
+  CPPUNIT_ASSERT_THROW(pair.local->write_vector_throws(vec, 0), torrent::internal_error);
+}
+
+void
+test_socket_stream::test_write_vector_blocked() {
+  stream_pair pair;
+
+  std::vector<char> data(1 << 16, 'x');
+  iovec             vec[] = { { data.data(), data.size() } };
+  size_t            total = 0;
+
+  while (true) {
+    uint32_t written = pair.local->write_vector_throws(vec, 1);
+
+    if (written == 0)
+      break;
+
+    total += written;
+    CPPUNIT_ASSERT(total < (64 << 20));
+  }
+
+  CPPUNIT_ASSERT(total != 0);
+}
+
+void
+test_socket_stream::test_write_vector_closed() {
+  stream_pair pair;
+
+  ::close(pair.remote);
+  pair.remote = -1;
+
+  char  data[] = "data";
+  iovec vec[] = { { data, 4 } };
+
+  auto old_handler = std::signal(SIGPIPE, SIG_IGN);
+
+  CPPUNIT_ASSERT_THROW(pair.local->write_vector_throws(vec, 1), torrent::network_error);
+
+  std::signal(SIGPIPE, old_handler);
+}
@@ -0,0 +1,20 @@
+#include "helpers/test_fixture.h"
+
+class test_socket_stream : public test_fixture {
+  CPPUNIT_TEST_SUITE(test_socket_stream);
+
+  CPPUNIT_TEST(test_read_vector);
+  CPPUNIT_TEST(test_read_vector_partial);
+  CPPUNIT_TEST(test_write_vector);
+  CPPUNIT_TEST(test_write_vector_blocked);
+  CPPUNIT_TEST(test_write_vector_closed);
+
+  CPPUNIT_TEST_SUITE_END();
+
+public:
+  void test_read_vector();
+  void test_read_vector_partial();
+  void test_write_vector();
+  void test_write_vector_blocked();
+  void test_write_vector_closed();
+};
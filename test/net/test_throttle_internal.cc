@@ -0,0 +1,149 @@
+#include "config.h"
+
+#include "test_throttle_internal.h"
+
+#include <memory>
+
+#include "test/helpers/test_main_thread.h"
+#include "net/throttle_list.h"
+#include "torrent/exceptions.h"
+#include "torrent/throttle.h"
+
+CPPUNIT_TEST_SUITE_NAMED_REGISTRATION(test_throttle_internal, "net");
+
+struct test_throttle_deleter {
+  void operator()(torrent::Throttle* t) const { torrent::Throttle::destroy_throttle(t); }
+};
+
+// The root throttle must be destroyed before the thread, so declare
+// it after.
+#define SETUP_THROTTLE()                                                \
+  set_create_poll();                                                    \
+  auto test_main_thread = TestMainThread::create();                     \
+  test_main_thread->init_thread();                                      \
+  test_main_thread->test_set_cached_time(0s);                           \
+  std::unique_ptr<torrent::Throttle, test_throttle_deleter> root(torrent::Throttle::create_throttle());
+
+// Enabling the root throttle does the first tick, and the quota a
+// throttle list receives in a tick becomes available to its nodes on
+// the next one.
+#define ENABLE_THROTTLE(rate)                                           \
+  root->set_max_rate(rate);                                             \
+  test_main_thread->test_set_cached_time(1s);                           \
+  test_main_thread->test_process_events_without_cached_time();
+
+void
+test_throttle_internal::test_min_rate() {
+  SETUP_THROTTLE();
+
+  auto slave_a = root->create_slave();
+  auto slave_b = root->create_slave();
+
+  slave_a->set_min_rate(60 << 10);
+  CPPUNIT_ASSERT(slave_a->min_rate() == (60 << 10));
+  CPPUNIT_ASSERT_THROW(slave_a->set_min_rate(uint64_t(1) << 32), torrent::input_error);
+
+  ENABLE_THROTTLE(100 << 10);
+
+  // The 40 KiB left after the guaranteed rate is split between both
+  // slaves and the root's own list.
+  CPPUNIT_ASSERT(slave_a->throttle_list()->unallocated_quota() == (60 << 10) + 13654);
+  CPPUNIT_ASSERT(slave_b->throttle_list()->unallocated_quota() == 13653);
+  CPPUNIT_ASSERT(root->throttle_list()->unallocated_quota() == 13653);
+}
+
+void
+test_throttle_internal::test_max_rate() {
+  SETUP_THROTTLE();
+
+  auto slave_a = root->create_slave();
+  auto slave_b = root->create_slave();
+
+  slave_a->set_max_rate(20 << 10);
+  slave_b->set_max_rate(0);
+
+  ENABLE_THROTTLE(100 << 10);
+
+  CPPUNIT_ASSERT(slave_a->throttle_list()->unallocated_quota() == (20 << 10));
+  CPPUNIT_ASSERT(slave_b->throttle_list()->unallocated_quota() == (40 << 10));
+  CPPUNIT_ASSERT(root->throttle_list()->unallocated_quota() == (40 << 10));
+}
+
+void
+test_throttle_internal::test_min_rate_oversubscribed() {
+  SETUP_THROTTLE();
+
+  auto slave_a = root->create_slave();
+  auto slave_b = root->create_slave();
+
+  slave_a->set_min_rate(80 << 10);
+  slave_b->set_min_rate(80 << 10);
+
+  ENABLE_THROTTLE(100 << 10);
+
+  CPPUNIT_ASSERT(slave_a->throttle_list()->unallocated_quota() == (50 << 10));
+  CPPUNIT_ASSERT(slave_b->throttle_list()->unallocated_quota() == (50 << 10));
+  CPPUNIT_ASSERT(root->throttle_list()->unallocated_quota() == 0);
+}
+
+void
+test_throttle_internal::test_nested() {
+  SETUP_THROTTLE();
+
+  auto slave_b = root->create_slave();
+  auto slave_c = slave_b->create_slave();
+
+  slave_b->set_max_rate(0);
+  slave_c->set_min_rate(40 << 10);
+
+  ENABLE_THROTTLE(100 << 10);
+
+  CPPUNIT_ASSERT(slave_c->throttle_list()->is_enabled());
+
+  // 'slave_b' gets half of the root's quota, and shares what is left
+  // after the guaranteed rate of 'slave_c' with its own list.
+  CPPUNIT_ASSERT(slave_b->throttle_list()->unallocated_quota() == (5 << 10));
+  CPPUNIT_ASSERT(slave_c->throttle_list()->unallocated_quota() == (45 << 10));
+  CPPUNIT_ASSERT(root->throttle_list()->unallocated_quota() == (50 << 10));
+
+  root->set_max_rate(0);
+
+  CPPUNIT_ASSERT(!slave_b->throttle_list()->is_enabled());
+  CPPUNIT_ASSERT(!slave_c->throttle_list()->is_enabled());
+}
+
+void
+test_throttle_internal::test_high_resolution() {
+  SETUP_THROTTLE();
+
+  auto slave_a = root->create_slave();
+
+  root->set_high_resolution(true);
+  CPPUNIT_ASSERT(root->is_high_resolution());
+
+  ENABLE_THROTTLE(100 << 10);
+
+  CPPUNIT_ASSERT(torrent::this_thread::scheduler()->next_timeout() == torrent::Throttle::high_resolution_interval);
+
+  // Each tick hands out 10ms worth of quota, and the unused quota of
+  // the first second is capped at a min chunk.
+  test_main_thread->test_set_cached_time(1s + torrent::Throttle::high_resolution_interval);
+  test_main_thread->test_process_events_without_cached_time();
+
+  CPPUNIT_ASSERT(torrent::this_thread::scheduler()->next_timeout() == torrent::Throttle::high_resolution_interval);
+  CPPUNIT_ASSERT(slave_a->throttle_list()->unallocated_quota() == slave_a->throttle_list()->min_chunk_size());
+  CPPUNIT_ASSERT(root->throttle_list()->unallocated_quota() == root->throttle_list()->min_chunk_size());
+
+  // Switching back reschedules the pending tick on whole seconds.
+  root->set_high_resolution(false);
+
+  CPPUNIT_ASSERT(!root->is_high_resolution());
+  auto next_tick = 1s + torrent::Throttle::high_resolution_interval + torrent::this_thread::scheduler()->next_timeout();
+
+  CPPUNIT_ASSERT(next_tick >= 2s && next_tick % 1s == 0us);
+
+  test_main_thread->test_set_cached_time(next_tick);
+  test_main_thread->test_process_events_without_cached_time();
+
+  CPPUNIT_ASSERT(torrent::this_thread::scheduler()->next_timeout() >= 1s);
+}
@@ -0,0 +1,20 @@
+#include "helpers/test_fixture.h"
+
+class test_throttle_internal : public test_fixture {
+  CPPUNIT_TEST_SUITE(test_throttle_internal);
+
+  CPPUNIT_TEST(test_min_rate);
+  CPPUNIT_TEST(test_max_rate);
+  CPPUNIT_TEST(test_min_rate_oversubscribed);
+  CPPUNIT_TEST(test_nested);
+  CPPUNIT_TEST(test_high_resolution);
+
+  CPPUNIT_TEST_SUITE_END();
+
+public:
+  void test_min_rate();
+  void test_max_rate();
+  void test_min_rate_oversubscribed();
+  void test_nested();
+  void test_high_resolution();
+};
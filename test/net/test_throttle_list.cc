@@ -0,0 +1,307 @@
+#include "config.h"
+
+#include "test_throttle_list.h"
+
+#include <limits>
+#include <memory>
+#include <vector>
+
+#include "net/throttle_list.h"
+#include "net/throttle_node.h"
+#include "torrent/exceptions.h"
+
+CPPUNIT_TEST_SUITE_NAMED_REGISTRATION(test_throttle_list, "net");
+
+namespace {
+
+struct test_nodes {
+  test_nodes(torrent::ThrottleList* list, unsigned int count) {
+    for (unsigned int i = 0; i < count; i++) {
+      nodes.emplace_back(new torrent::ThrottleNode(30));
+      nodes.back()->slot_activate() = [this, i] { activated.push_back(i); };
+
+      list->insert(nodes.back().get());
+    }
+  }
+
+  torrent::ThrottleNode* operator[](unsigned int i) { return nodes[i].get(); }
+
+  std::vector<std::unique_ptr<torrent::ThrottleNode>> nodes;
+  std::vector<unsigned int>                          activated;
+};
+
+// Use up the node's quota and deactivate it.
+void
+drain_node(torrent::ThrottleList* list, torrent::ThrottleNode* node) {
+  list->node_used(node, node->quota());
+  list->node_deactivate(node);
+}
+
+}
+
+void
+test_throttle_list::test_basic() {
+  torrent::ThrottleList list;
+  torrent::ThrottleNode node(30);
+
+  CPPUNIT_ASSERT(!list.is_enabled());
+  CPPUNIT_ASSERT(list.size() == 0);
+  CPPUNIT_ASSERT(!list.is_throttled(&node));
+
+  list.insert(&node);
+
+  CPPUNIT_ASSERT(list.size() == 1);
+  CPPUNIT_ASSERT(list.is_throttled(&node));
+  CPPUNIT_ASSERT(list.is_active(&node));
+  CPPUNIT_ASSERT(list.node_quota(&node) == uint32_t(std::numeric_limits<int32_t>::max()));
+
+  CPPUNIT_ASSERT_THROW(list.update_quota(1000), torrent::internal_error);
+
+  list.enable();
+
+  // Quota given in a tick is first reserved for unthrottled use, and is
+  // handed out to throttled nodes on the following tick.
+  list.update_quota(16 << 10);
+
+  CPPUNIT_ASSERT(list.node_quota(&node) == 0);
+
+  list.node_deactivate(&node);
+
+  CPPUNIT_ASSERT(list.is_inactive(&node));
+  CPPUNIT_ASSERT(list.size_inactive() == 1);
+  CPPUNIT_ASSERT_THROW(list.node_quota(&node), torrent::internal_error);
+  CPPUNIT_ASSERT_THROW(list.node_deactivate(&node), torrent::internal_error);
+
+  list.update_quota(16 << 10);
+
+  CPPUNIT_ASSERT(list.is_active(&node));
+  CPPUNIT_ASSERT(list.size_inactive() == 0);
+  CPPUNIT_ASSERT(node.quota() == (16 << 10));
+  CPPUNIT_ASSERT(list.outstanding_quota() == (16 << 10));
+
+  list.erase(&node);
+
+  CPPUNIT_ASSERT(list.size() == 0);
+  CPPUNIT_ASSERT(!list.is_throttled(&node));
+  CPPUNIT_ASSERT(node.quota() == 0);
+  CPPUNIT_ASSERT(list.outstanding_quota() == 0);
+}
+
+void
+test_throttle_list::test_insert_erase() {
+  torrent::ThrottleList list;
+  torrent::ThrottleList other;
+  test_nodes nodes(&list, 4);
+
+  CPPUNIT_ASSERT(list.size() == 4);
+
+  list.insert(nodes[1]);
+  CPPUNIT_ASSERT(list.size() == 4);
+
+  CPPUNIT_ASSERT_THROW(other.insert(nodes[1]), torrent::internal_error);
+
+  list.erase(nodes[1]);
+  list.erase(nodes[1]);
+  other.erase(nodes[2]);
+
+  CPPUNIT_ASSERT(list.size() == 3);
+  CPPUNIT_ASSERT(!list.is_throttled(nodes[1]));
+
+  for (unsigned int i : {0, 2, 3})
+    CPPUNIT_ASSERT(list.is_active(nodes[i]));
+
+  list.erase(nodes[0]);
+  list.erase(nodes[3]);
+  list.erase(nodes[2]);
+
+  CPPUNIT_ASSERT(list.size() == 0);
+}
+
+void
+test_throttle_list::test_round_robin() {
+  torrent::ThrottleList list;
+  list.enable();
+  list.update_quota(32 << 10);
+
+  test_nodes nodes(&list, 4);
+
+  for (unsigned int i : {2, 0, 3, 1})
+    list.node_deactivate(nodes[i]);
+
+  // Each tick only has enough quota for two nodes, so they should be
+  // served in the order they were deactivated.
+  list.update_quota(32 << 10);
+  CPPUNIT_ASSERT((nodes.activated == std::vector<unsigned int>{2, 0}));
+
+  drain_node(&list, nodes[2]);
+  drain_node(&list, nodes[0]);
+
+  list.update_quota(32 << 10);
+  CPPUNIT_ASSERT((nodes.activated == std::vector<unsigned int>{2, 0, 3, 1}));
+
+  list.update_quota(32 << 10);
+  CPPUNIT_ASSERT((nodes.activated == std::vector<unsigned int>{2, 0, 3, 1, 2, 0}));
+  CPPUNIT_ASSERT(list.size_inactive() == 0);
+}
+
+void
+test_throttle_list::test_deficit() {
+  torrent::ThrottleList list;
+  list.enable();
+  list.update_quota(1 << 10);
+
+  test_nodes nodes(&list, 2);
+
+  list.node_deactivate(nodes[0]);
+  list.node_deactivate(nodes[1]);
+
+  // Less than the min chunk size is kept by the first node and it stays
+  // at the front of the queue.
+  list.update_quota(1 << 10);
+
+  CPPUNIT_ASSERT(nodes.activated.empty());
+  CPPUNIT_ASSERT(nodes[0]->quota() == (1 << 10));
+  CPPUNIT_ASSERT(nodes[1]->quota() == 0);
+
+  list.update_quota(1 << 10);
+
+  CPPUNIT_ASSERT((nodes.activated == std::vector<unsigned int>{0}));
+  CPPUNIT_ASSERT(nodes[0]->quota() == (2 << 10));
+  CPPUNIT_ASSERT(list.is_inactive(nodes[1]));
+}
+
+void
+test_throttle_list::test_weight() {
+  torrent::ThrottleList list;
+  list.enable();
+  list.update_quota(256 << 10);
+
+  test_nodes nodes(&list, 2);
+
+  nodes[1]->set_weight(3);
+  CPPUNIT_ASSERT(nodes[1]->weight() == 3);
+
+  list.node_deactivate(nodes[0]);
+  list.node_deactivate(nodes[1]);
+
+  list.update_quota(256 << 10);
+
+  CPPUNIT_ASSERT((nodes.activated == std::vector<unsigned int>{0, 1}));
+  CPPUNIT_ASSERT(nodes[0]->quota() == (16 << 10));
+  CPPUNIT_ASSERT(nodes[1]->quota() == (48 << 10));
+
+  nodes[0]->set_weight(0);
+  CPPUNIT_ASSERT(nodes[0]->weight() == 1);
+
+  nodes[0]->set_weight(1000);
+  CPPUNIT_ASSERT(nodes[0]->weight() == torrent::ThrottleNode::max_weight);
+}
+
+void
+test_throttle_list::test_erase_inactive() {
+  torrent::ThrottleList list;
+  list.enable();
+  list.update_quota(16 << 10);
+
+  test_nodes nodes(&list, 3);
+
+  for (unsigned int i = 0; i < 3; i++)
+    list.node_deactivate(nodes[i]);
+
+  list.erase(nodes[0]);
+  list.erase(nodes[1]);
+
+  CPPUNIT_ASSERT(list.size() == 1);
+  CPPUNIT_ASSERT(list.size_inactive() == 1);
+
+  list.update_quota(32 << 10);
+
+  CPPUNIT_ASSERT((nodes.activated == std::vector<unsigned int>{2}));
+  CPPUNIT_ASSERT(list.size_inactive() == 0);
+
+  // Erased nodes may be inserted and queued again.
+  list.insert(nodes[0]);
+  drain_node(&list, nodes[0]);
+  drain_node(&list, nodes[2]);
+
+  list.update_quota(32 << 10);
+
+  CPPUNIT_ASSERT((nodes.activated == std::vector<unsigned int>{2, 0, 2}));
+}
+
+void
+test_throttle_list::test_disable() {
+  torrent::ThrottleList list;
+  list.enable();
+  list.update_quota(1 << 10);
+
+  test_nodes nodes(&list, 3);
+
+  list.node_deactivate(nodes[1]);
+  list.node_deactivate(nodes[2]);
+  list.erase(nodes[1]);
+
+  list.update_quota(1 << 10);
+  list.disable();
+
+  CPPUNIT_ASSERT((nodes.activated == std::vector<unsigned int>{2}));
+  CPPUNIT_ASSERT(list.size_inactive() == 0);
+  CPPUNIT_ASSERT(list.outstanding_quota() == 0);
+
+  for (unsigned int i : {0, 2}) {
+    CPPUNIT_ASSERT(list.is_active(nodes[i]));
+    CPPUNIT_ASSERT(nodes[i]->quota() == 0);
+  }
+
+  list.enable();
+  list.node_deactivate(nodes[0]);
+  list.update_quota(16 << 10);
+
+  CPPUNIT_ASSERT(list.is_inactive(nodes[0]));
+
+  list.update_quota(16 << 10);
+
+  CPPUNIT_ASSERT((nodes.activated == std::vector<unsigned int>{2, 0}));
+}
+
+void
+test_throttle_list::test_pacing() {
+  torrent::ThrottleList list;
+  list.enable();
+  list.update_quota(256 << 10);
+
+  test_nodes nodes(&list, 2);
+  std::vector<uint64_t> rates[2];
+
+  for (unsigned int i = 0; i < 2; i++)
+    nodes[i]->slot_pacing_rate() = [&rates, i](uint64_t rate) { rates[i].push_back(rate); };
+
+  nodes[1]->set_weight(3);
+
+  // Not pacing, so no rates are set.
+  list.update_pacing(400 << 10);
+  CPPUNIT_ASSERT(rates[0].empty() && rates[1].empty());
+
+  list.set_pacing(true);
+  list.update_pacing(400 << 10);
+
+  CPPUNIT_ASSERT((rates[0] == std::vector<uint64_t>{100 << 10}));
+  CPPUNIT_ASSERT((rates[1] == std::vector<uint64_t>{300 << 10}));
+
+  // Small changes are not passed on.
+  list.update_pacing(420 << 10);
+  CPPUNIT_ASSERT(rates[0].size() == 1 && rates[1].size() == 1);
+
+  list.update_pacing(800 << 10);
+  CPPUNIT_ASSERT(nodes[0]->pacing_rate() == (200 << 10) && rates[0].size() == 2);
+  CPPUNIT_ASSERT(nodes[1]->pacing_rate() == (600 << 10) && rates[1].size() == 2);
+
+  // Pacing nodes get larger chunks of quota.
+  list.node_deactivate(nodes[0]);
+  list.update_quota(256 << 10);
+  CPPUNIT_ASSERT(nodes[0]->quota() == (16 << 10) * torrent::ThrottleList::pacing_chunk_factor);
+
+  list.set_pacing(false);
+  CPPUNIT_ASSERT(rates[0].back() == 0 && rates[1].back() == 0);
+  CPPUNIT_ASSERT(nodes[0]->pacing_rate() == 0);
+}
@@ -0,0 +1,26 @@
+#include "helpers/test_fixture.h"
+
+class test_throttle_list : public test_fixture {
+  CPPUNIT_TEST_SUITE(test_throttle_list);
+
+  CPPUNIT_TEST(test_basic);
+  CPPUNIT_TEST(test_insert_erase);
+  CPPUNIT_TEST(test_round_robin);
+  CPPUNIT_TEST(test_deficit);
+  CPPUNIT_TEST(test_weight);
+  CPPUNIT_TEST(test_erase_inactive);
+  CPPUNIT_TEST(test_disable);
+  CPPUNIT_TEST(test_pacing);
+
+  CPPUNIT_TEST_SUITE_END();
+
+public:
+  void test_basic();
+  void test_insert_erase();
+  void test_round_robin();
+  void test_deficit();
+  void test_weight();
+  void test_erase_inactive();
+  void test_disable();
+  void test_pacing();
+};
@@ -0,0 +1,154 @@
+#include "config.h"
+
+#include "test_utp.h"
+
+#include <cstring>
+
+#include "net/utp_ledbat.h"
+#include "net/utp_manager.h"
+#include "net/utp_socket.h"
+
+CPPUNIT_TEST_SUITE_NAMED_REGISTRATION(test_utp, "net");
+
+namespace {
+
+torrent::UtpHeader
+make_header() {
+  torrent::UtpHeader header;
+
+  header.type = torrent::UtpHeader::ST_DATA;
+  header.connection_id = 0x1234;
+  header.timestamp = 0x89abcdef;
+  header.timestamp_diff = 0x01020304;
+  header.window = 1 << 20;
+  header.seq_nr = 0xfffe;
+  header.ack_nr = 7;
+
+  return header;
+}
+
+}
+
+void
+test_utp::test_header() {
+  char buffer[torrent::UtpHeader::size];
+  make_header().write(buffer);
+
+  CPPUNIT_ASSERT(buffer[0] == 0x01);
+  CPPUNIT_ASSERT(buffer[2] == 0x12 && buffer[3] == 0x34);
+
+  torrent::UtpHeader header;
+
+  CPPUNIT_ASSERT(torrent::UtpHeader::read(buffer, sizeof(buffer), &header) == torrent::UtpHeader::size);
+  CPPUNIT_ASSERT(header.type == torrent::UtpHeader::ST_DATA);
+  CPPUNIT_ASSERT(header.connection_id == 0x1234);
+  CPPUNIT_ASSERT(header.timestamp == 0x89abcdef);
+  CPPUNIT_ASSERT(header.timestamp_diff == 0x01020304);
+  CPPUNIT_ASSERT(header.window == 1 << 20);
+  CPPUNIT_ASSERT(header.seq_nr == 0xfffe);
+  CPPUNIT_ASSERT(header.ack_nr == 7);
+
+  CPPUNIT_ASSERT(torrent::UtpHeader::read(buffer, sizeof(buffer) - 1, &header) == 0);
+
+  buffer[0] = 0x02;
+  CPPUNIT_ASSERT(torrent::UtpHeader::read(buffer, sizeof(buffer), &header) == 0);
+}
+
+void
+test_utp::test_header_extension() {
+  char buffer[torrent::UtpHeader::size + 6 + 3];
+  make_header().write(buffer);
+
+  // A selective ack extension of four bytes followed by the payload.
+  buffer[1] = 1;
+  std::memcpy(buffer + torrent::UtpHeader::size, "\x00\x04\xff\x00\x00\x00", 6);
+  std::memcpy(buffer + torrent::UtpHeader::size + 6, "abc", 3);
+
+  torrent::UtpHeader header;
+
+  CPPUNIT_ASSERT(torrent::UtpHeader::read(buffer, sizeof(buffer), &header) == torrent::UtpHeader::size + 6);
+
+  // The extension claims more bytes than the packet holds.
+  buffer[torrent::UtpHeader::size + 1] = 16;
+  CPPUNIT_ASSERT(torrent::UtpHeader::read(buffer, sizeof(buffer), &header) == 0);
+}
+
+void
+test_utp::test_is_packet() {
+  char buffer[torrent::UtpHeader::size];
+  make_header().write(buffer);
+
+  CPPUNIT_ASSERT(torrent::UtpManager::is_packet(buffer, sizeof(buffer)));
+  CPPUNIT_ASSERT(!torrent::UtpManager::is_packet(buffer, sizeof(buffer) - 1));
+
+  const char dht_message[] = "d1:ad2:id20:abcdefghij0123456789e1:q4:ping1:t2:aa1:y1:qe";
+
+  CPPUNIT_ASSERT(!torrent::UtpManager::is_packet(dht_message, sizeof(dht_message) - 1));
+}
+
+void
+test_utp::test_ledbat_slow_start() {
+  torrent::UtpLedbat ledbat(1000);
+
+  CPPUNIT_ASSERT(ledbat.window() == 2000);
+  CPPUNIT_ASSERT(ledbat.is_slow_start());
+
+  ledbat.add_sample(50000, 0);
+  CPPUNIT_ASSERT(ledbat.queuing_delay() == 0);
+
+  // Not growing the window while it is not filled.
+  ledbat.on_ack(1000, 0);
+  CPPUNIT_ASSERT(ledbat.window() == 2000);
+
+  ledbat.on_ack(1000, 2000);
+  CPPUNIT_ASSERT(ledbat.window() == 3000);
+  CPPUNIT_ASSERT(ledbat.is_slow_start());
+}
+
+void
+test_utp::test_ledbat_delay() {
+  torrent::UtpLedbat ledbat(1000);
+
+  ledbat.add_sample(10000, 0);
+  ledbat.on_ack(1000, 2000);
+  CPPUNIT_ASSERT(ledbat.window() == 3000);
+
+  // Queuing delay above half the target ends slow start, and above the
+  // target shrinks the window.
+  for (int i = 0; i < 3; i++)
+    ledbat.add_sample(10000 + 2 * torrent::UtpLedbat::target_delay, 1);
+
+  CPPUNIT_ASSERT(ledbat.base_delay() == 10000);
+  CPPUNIT_ASSERT(ledbat.queuing_delay() == 2 * torrent::UtpLedbat::target_delay);
+
+  ledbat.on_ack(3000, 3000);
+  CPPUNIT_ASSERT(!ledbat.is_slow_start());
+  CPPUNIT_ASSERT(ledbat.window() < 3000);
+
+  // Timestamps wrapping does not count as a lower delay.
+  torrent::UtpLedbat wrapped(1000);
+
+  wrapped.add_sample(0xffffff00, 0);
+  wrapped.add_sample(0x100, 0);
+  CPPUNIT_ASSERT(wrapped.base_delay() == 0xffffff00);
+}
+
+void
+test_utp::test_ledbat_loss() {
+  torrent::UtpLedbat ledbat(1000);
+
+  for (int i = 0; i < 8; i++)
+    ledbat.on_ack(ledbat.window(), ledbat.window());
+
+  uint32_t window = ledbat.window();
+
+  ledbat.on_loss();
+  CPPUNIT_ASSERT(ledbat.window() == window / 2);
+  CPPUNIT_ASSERT(!ledbat.is_slow_start());
+
+  ledbat.on_timeout();
+  CPPUNIT_ASSERT(ledbat.window() == 1000);
+
+  ledbat.on_loss();
+  CPPUNIT_ASSERT(ledbat.window() == 1000);
+}
@@ -0,0 +1,24 @@
+#include "helpers/test_fixture.h"
+
+class test_utp : public test_fixture {
+  CPPUNIT_TEST_SUITE(test_utp);
+
+  CPPUNIT_TEST(test_header);
+  CPPUNIT_TEST(test_header_extension);
+  CPPUNIT_TEST(test_is_packet);
+
+  CPPUNIT_TEST(test_ledbat_slow_start);
+  CPPUNIT_TEST(test_ledbat_delay);
+  CPPUNIT_TEST(test_ledbat_loss);
+
+  CPPUNIT_TEST_SUITE_END();
+
+public:
+  void test_header();
+  void test_header_extension();
+  void test_is_packet();
+
+  void test_ledbat_slow_start();
+  void test_ledbat_delay();
+  void test_ledbat_loss();
+};
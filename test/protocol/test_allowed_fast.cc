@@ -0,0 +1,63 @@
+#include "config.h"
+
+#include "test/protocol/test_allowed_fast.h"
+
+#include <cstring>
+#include <arpa/inet.h>
+
+#include "protocol/allowed_fast.h"
+#include "torrent/net/socket_address.h"
+
+CPPUNIT_TEST_SUITE_REGISTRATION(TestAllowedFast);
+
+static torrent::HashString
+make_hash(char c) {
+  torrent::HashString hash;
+  std::memset(hash.data(), c, torrent::HashString::size_data);
+  return hash;
+}
+
+static sockaddr_in
+make_inet(const char* address) {
+  sockaddr_in sa{};
+  sa.sin_family = AF_INET;
+  inet_pton(AF_INET, address, &sa.sin_addr);
+  return sa;
+}
+
+// The example given in BEP 6.
+void
+TestAllowedFast::test_reference() {
+  auto sa = make_inet("80.4.4.200");
+  auto hash = make_hash('\xaa');
+
+  std::vector<uint32_t> expected_7{1059, 431, 808, 1217, 287, 376, 1188};
+  std::vector<uint32_t> expected_9{1059, 431, 808, 1217, 287, 376, 1188, 353, 508};
+
+  CPPUNIT_ASSERT(torrent::allowed_fast_set(reinterpret_cast<sockaddr*>(&sa), hash, 1313, 7) == expected_7);
+  CPPUNIT_ASSERT(torrent::allowed_fast_set(reinterpret_cast<sockaddr*>(&sa), hash, 1313, 9) == expected_9);
+
+  // Only the /24 is used.
+  auto other = make_inet("80.4.4.1");
+  CPPUNIT_ASSERT(torrent::allowed_fast_set(reinterpret_cast<sockaddr*>(&other), hash, 1313, 7) == expected_7);
+
+  sockaddr_in6 mapped{};
+  mapped.sin6_family = AF_INET6;
+  inet_pton(AF_INET6, "::ffff:80.4.4.200", &mapped.sin6_addr);
+  CPPUNIT_ASSERT(torrent::allowed_fast_set(reinterpret_cast<sockaddr*>(&mapped), hash, 1313, 7) == expected_7);
+}
+
+void
+TestAllowedFast::test_limits() {
+  auto sa = make_inet("10.0.0.1");
+  auto hash = make_hash('\x01');
+
+  CPPUNIT_ASSERT(torrent::allowed_fast_set(reinterpret_cast<sockaddr*>(&sa), hash, 0, 10).empty());
+  CPPUNIT_ASSERT(torrent::allowed_fast_set(reinterpret_cast<sockaddr*>(&sa), hash, 3, 10).size() == 3);
+
+  sockaddr_in6 sin6{};
+  sin6.sin6_family = AF_INET6;
+  sin6.sin6_addr.s6_addr[15] = 1;
+
+  CPPUNIT_ASSERT(torrent::allowed_fast_set(reinterpret_cast<sockaddr*>(&sin6), hash, 100, 10).empty());
+}
@@ -0,0 +1,12 @@
+#include <cppunit/extensions/HelperMacros.h>
+
+class TestAllowedFast : public CppUnit::TestFixture {
+  CPPUNIT_TEST_SUITE(TestAllowedFast);
+  CPPUNIT_TEST(test_reference);
+  CPPUNIT_TEST(test_limits);
+  CPPUNIT_TEST_SUITE_END();
+
+public:
+  void test_reference();
+  void test_limits();
+};
@@ -0,0 +1,88 @@
+#include "config.h"
+
+#include "test/protocol/test_encryption_info.h"
+
+#include <cstring>
+#include <vector>
+#include <sys/mman.h>
+
+#include "data/chunk.h"
+#include "protocol/encryption_info.h"
+#include "torrent/exceptions.h"
+
+CPPUNIT_TEST_SUITE_REGISTRATION(TestEncryptionInfo);
+
+static const unsigned char test_key[20] = { 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15, 16, 17, 18, 19, 20 };
+
+// Builds a chunk of anonymous mappings with the given part sizes,
+// filled with a pattern that continues across the parts.
+static void
+fill_chunk(torrent::Chunk* chunk, const std::vector<uint32_t>& sizes, std::vector<char>* plain) {
+  for (auto size : sizes) {
+    auto ptr = static_cast<char*>(mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0));
+
+    CPPUNIT_ASSERT(ptr != MAP_FAILED);
+
+    for (uint32_t i = 0; i < size; i++) {
+      ptr[i] = char(plain->size() * 7 + 3);
+      plain->push_back(ptr[i]);
+    }
+
+    chunk->push_back(torrent::ChunkPart::MAPPED_MMAP,
+                     torrent::MemoryChunk(ptr, ptr, ptr + size, torrent::MemoryChunk::prot_read | torrent::MemoryChunk::prot_write, 0));
+  }
+}
+
+static torrent::EncryptionInfo
+make_info() {
+  torrent::EncryptionInfo info;
+  info.set_encrypt(torrent::RC4(test_key, sizeof(test_key)));
+
+  return info;
+}
+
+void
+TestEncryptionInfo::test_encrypt_chunk() {
+  torrent::Chunk    chunk;
+  std::vector<char> plain;
+
+  fill_chunk(&chunk, { 3000, 100, 5000 }, &plain);
+
+  auto info = make_info();
+  std::vector<char> result(plain.size());
+
+  info.encrypt_chunk(&chunk, 0, plain.size(), result.data());
+
+  torrent::RC4 expected_rc4(test_key, sizeof(test_key));
+  std::vector<char> expected(plain);
+
+  expected_rc4.crypt(expected.data(), expected.size());
+
+  CPPUNIT_ASSERT(result == expected);
+
+  CPPUNIT_ASSERT_THROW(info.encrypt_chunk(&chunk, 1, plain.size(), result.data()), torrent::internal_error);
+}
+
+// Encrypting in pieces continues the stream, as up_chunk_encrypt()
+// does when the throttle quota splits a piece.
+void
+TestEncryptionInfo::test_encrypt_chunk_offset() {
+  torrent::Chunk    chunk;
+  std::vector<char> plain;
+
+  fill_chunk(&chunk, { 3000, 5000 }, &plain);
+
+  auto info = make_info();
+  std::vector<char> result(5000);
+
+  info.encrypt_chunk(&chunk, 1000, 2500, result.data());
+  info.encrypt_chunk(&chunk, 3500, 0, result.data() + 2500);
+  info.encrypt_chunk(&chunk, 3500, 2500, result.data() + 2500);
+
+  torrent::RC4 expected_rc4(test_key, sizeof(test_key));
+  std::vector<char> expected(plain.begin() + 1000, plain.begin() + 6000);
+
+  expected_rc4.crypt(expected.data(), expected.size());
+
+  CPPUNIT_ASSERT(result == expected);
+}
@@ -0,0 +1,12 @@
+#include <cppunit/extensions/HelperMacros.h>
+
+class TestEncryptionInfo : public CppUnit::TestFixture {
+  CPPUNIT_TEST_SUITE(TestEncryptionInfo);
+  CPPUNIT_TEST(test_encrypt_chunk);
+  CPPUNIT_TEST(test_encrypt_chunk_offset);
+  CPPUNIT_TEST_SUITE_END();
+
+public:
+  void test_encrypt_chunk();
+  void test_encrypt_chunk_offset();
+};
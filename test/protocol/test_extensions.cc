@@ -0,0 +1,90 @@
+#include "config.h"
+
+#include "test/protocol/test_extensions.h"
+
+#include <cstring>
+#include <string>
+#include <arpa/inet.h>
+
+#include "protocol/extensions.h"
+#include "torrent/object_stream.h"
+
+CPPUNIT_TEST_SUITE_REGISTRATION(TestExtensions);
+
+static std::string
+to_string(const torrent::DataBuffer& buffer) {
+  return std::string(buffer.data(), buffer.length());
+}
+
+void
+TestExtensions::test_data_buffer_share() {
+  auto data = new char[4];
+  std::memcpy(data, "abcd", 4);
+
+  torrent::DataBuffer buffer(data, data + 4);
+  buffer.share();
+
+  CPPUNIT_ASSERT(buffer.shared() && !buffer.owned());
+
+  torrent::DataBuffer first = buffer.clone();
+  torrent::DataBuffer second = buffer.clone();
+
+  CPPUNIT_ASSERT(first.data() == data && second.data() == data);
+
+  // The data stays valid until the last reference is cleared.
+  buffer.clear();
+  first.clear();
+
+  CPPUNIT_ASSERT(buffer.empty() && !buffer.shared());
+  CPPUNIT_ASSERT(to_string(second) == "abcd");
+
+  second.clear();
+}
+
+void
+TestExtensions::test_ut_pex_message() {
+  torrent::ProtocolExtension::PEXList added{torrent::SocketAddressCompact(htonl(0x01020304), htons(0x0506))};
+  torrent::ProtocolExtension::PEXList removed;
+
+  CPPUNIT_ASSERT(torrent::ProtocolExtension::generate_ut_pex_message(removed, removed).empty());
+
+  torrent::DataBuffer message = torrent::ProtocolExtension::generate_ut_pex_message(added, removed);
+
+  CPPUNIT_ASSERT(message.owned());
+  CPPUNIT_ASSERT(to_string(message) == std::string("d5:added6:\x01\x02\x03\x04\x05\x06" "7:dropped0:e"));
+
+  message.clear();
+
+  // Only removed addresses.
+  message = torrent::ProtocolExtension::generate_ut_pex_message(removed, added);
+
+  CPPUNIT_ASSERT(to_string(message) == std::string("d5:added0:7:dropped6:\x01\x02\x03\x04\x05\x06" "e"));
+
+  message.clear();
+}
+
+void
+TestExtensions::test_ut_pex_message_inet6() {
+  in6_addr addr{};
+  addr.s6_addr[0] = 0x20;
+  addr.s6_addr[15] = 0x01;
+
+  torrent::ProtocolExtension::PEXList  empty;
+  torrent::ProtocolExtension::PEXList6 empty6;
+  torrent::ProtocolExtension::PEXList6 added6{torrent::SocketAddressCompact6(addr, htons(0x0102))};
+
+  torrent::DataBuffer message = torrent::ProtocolExtension::generate_ut_pex_message(empty, empty, added6, empty6);
+
+  std::string compact6(reinterpret_cast<const char*>(&addr), sizeof(addr));
+  compact6 += "\x01\x02";
+
+  CPPUNIT_ASSERT(to_string(message) == "d5:added0:6:added618:" + compact6 + "7:dropped0:8:dropped60:e");
+
+  torrent::ExtPEXMessage read_message;
+  torrent::static_map_read_bencode(message.data(), message.end(), read_message);
+
+  CPPUNIT_ASSERT(read_message[torrent::key_pex_added6].is_raw_string());
+  CPPUNIT_ASSERT(read_message[torrent::key_pex_added6].as_raw_string().as_string() == compact6);
+
+  message.clear();
+}
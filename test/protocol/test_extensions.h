@@ -0,0 +1,14 @@
+#include <cppunit/extensions/HelperMacros.h>
+
+class TestExtensions : public CppUnit::TestFixture {
+  CPPUNIT_TEST_SUITE(TestExtensions);
+  CPPUNIT_TEST(test_data_buffer_share);
+  CPPUNIT_TEST(test_ut_pex_message);
+  CPPUNIT_TEST(test_ut_pex_message_inet6);
+  CPPUNIT_TEST_SUITE_END();
+
+public:
+  void test_data_buffer_share();
+  void test_ut_pex_message();
+  void test_ut_pex_message_inet6();
+};
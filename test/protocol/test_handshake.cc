@@ -0,0 +1,88 @@
+#include "config.h"
+
+#include "test/protocol/test_handshake.h"
+
+#include <string>
+
+#include "protocol/handshake.h"
+#include "torrent/connection_manager.h"
+#include "torrent/error.h"
+
+CPPUNIT_TEST_SUITE_REGISTRATION(TestHandshake);
+
+static const int plaintext_options = torrent::ConnectionManager::encryption_none;
+static const int allow_options = torrent::ConnectionManager::encryption_allow_incoming;
+static const int require_options = torrent::ConnectionManager::encryption_require;
+
+static std::string
+make_header() {
+  std::string header("\x13" "BitTorrent protocol");
+
+  header += std::string(8, '\0');
+  header += std::string(20, 'h');
+  header += std::string(20, 'p');
+
+  return header;
+}
+
+static int
+check(const std::string& data, uint32_t length, int options, const char** hash) {
+  return torrent::Handshake::check_incoming(data.data(), length, options, hash);
+}
+
+void
+TestHandshake::test_check_incoming_plaintext() {
+  std::string header = make_header();
+  const char* hash;
+
+  CPPUNIT_ASSERT(check(header, header.size(), plaintext_options, &hash) == 0);
+  CPPUNIT_ASSERT(hash == header.data() + 28);
+
+  CPPUNIT_ASSERT(check(header, header.size(), allow_options, &hash) == 0);
+  CPPUNIT_ASSERT(hash == header.data() + 28);
+
+  CPPUNIT_ASSERT(check(header, header.size(), require_options, &hash) == torrent::e_handshake_unencrypted_rejected);
+  CPPUNIT_ASSERT(hash == NULL);
+
+  std::string http("GET / HTTP/1.1\r\nHost: localhost\r\n\r\n");
+
+  CPPUNIT_ASSERT(check(http, http.size(), plaintext_options, &hash) == torrent::e_handshake_not_bittorrent);
+  CPPUNIT_ASSERT(check(http, 1, plaintext_options, &hash) == torrent::e_handshake_not_bittorrent);
+}
+
+void
+TestHandshake::test_check_incoming_encrypted() {
+  std::string key(96, 'k');
+  const char* hash;
+
+  CPPUNIT_ASSERT(check(key, key.size(), allow_options, &hash) == 0);
+  CPPUNIT_ASSERT(hash == NULL);
+  CPPUNIT_ASSERT(check(key, key.size(), require_options, &hash) == 0);
+  CPPUNIT_ASSERT(check(key, key.size(), plaintext_options, &hash) == torrent::e_handshake_not_bittorrent);
+
+  // A key starting with the protocol length byte.
+  key[0] = 19;
+
+  CPPUNIT_ASSERT(check(key, key.size(), require_options, &hash) == 0);
+  CPPUNIT_ASSERT(check(key, key.size(), plaintext_options, &hash) == torrent::e_handshake_not_bittorrent);
+}
+
+void
+TestHandshake::test_check_incoming_partial() {
+  std::string header = make_header();
+  const char* hash;
+
+  CPPUNIT_ASSERT(check(header, 0, plaintext_options, &hash) == 0);
+  CPPUNIT_ASSERT(check(header, 1, plaintext_options, &hash) == 0);
+  CPPUNIT_ASSERT(check(header, 19, plaintext_options, &hash) == 0);
+  CPPUNIT_ASSERT(check(header, 19, require_options, &hash) == 0);
+
+  CPPUNIT_ASSERT(check(header, 20, plaintext_options, &hash) == 0);
+  CPPUNIT_ASSERT(hash == NULL);
+
+  CPPUNIT_ASSERT(check(header, 47, plaintext_options, &hash) == 0);
+  CPPUNIT_ASSERT(hash == NULL);
+
+  CPPUNIT_ASSERT(check(header, 48, plaintext_options, &hash) == 0);
+  CPPUNIT_ASSERT(hash == header.data() + 28);
+}
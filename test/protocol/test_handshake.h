@@ -0,0 +1,14 @@
+#include <cppunit/extensions/HelperMacros.h>
+
+class TestHandshake : public CppUnit::TestFixture {
+  CPPUNIT_TEST_SUITE(TestHandshake);
+  CPPUNIT_TEST(test_check_incoming_plaintext);
+  CPPUNIT_TEST(test_check_incoming_encrypted);
+  CPPUNIT_TEST(test_check_incoming_partial);
+  CPPUNIT_TEST_SUITE_END();
+
+public:
+  void test_check_incoming_plaintext();
+  void test_check_incoming_encrypted();
+  void test_check_incoming_partial();
+};
@@ -265,3 +265,168 @@ TestRequestList::test_choke_unchoke_transfer() {
 
   CLEAR_TRANSFERS();
 }
+
+void
+TestRequestList::test_choke_deep_pipeline() {
+  SETUP_ALL(basic);
+
+  auto pieces = request_list->delegate(300);
+  CPPUNIT_ASSERT(pieces.size() == 300);
+
+  CPPUNIT_ASSERT(request_list->downloading(*pieces[100]));
+  request_list->transfer()->adjust_position(pieces[100]->length());
+  request_list->finished();
+  VERIFY_QUEUE_SIZES(199, 100, 0, 0);
+
+  CPPUNIT_ASSERT(request_list->downloading(*pieces[50]));
+  request_list->transfer()->adjust_position(pieces[50]->length());
+  request_list->finished();
+
+  CPPUNIT_ASSERT(request_list->downloading(*pieces[101]));
+  request_list->transfer()->adjust_position(pieces[101]->length());
+  request_list->finished();
+  VERIFY_QUEUE_SIZES(198, 99, 0, 0);
+
+  request_list->choked();
+  VERIFY_QUEUE_SIZES(0, 0, 0, 297);
+
+  CPPUNIT_ASSERT(request_list->downloading(*pieces[200]));
+  request_list->transfer()->adjust_position(pieces[200]->length());
+  request_list->finished();
+  VERIFY_QUEUE_SIZES(0, 0, 0, 296);
+
+  request_list->unchoked();
+
+  test_main_thread->test_set_cached_time(10s);
+  test_main_thread->test_process_events_without_cached_time();
+  VERIFY_QUEUE_SIZES(0, 0, 0, 0);
+
+  CLEAR_TRANSFERS();
+}
+
+void
+TestRequestList::test_unordered() {
+  SETUP_ALL_WITH_3(basic);
+
+  CPPUNIT_ASSERT(request_list->downloading(*piece_3));
+  request_list->transfer()->adjust_position(piece_3->length());
+  request_list->finished();
+  VERIFY_QUEUE_SIZES(0, 2, 0, 0);
+
+  CPPUNIT_ASSERT(request_list->downloading(*piece_1));
+  request_list->transfer()->adjust_position(piece_1->length());
+  request_list->finished();
+  VERIFY_QUEUE_SIZES(0, 1, 0, 0);
+
+  // Transfers still unordered when the timer runs were skipped.
+  test_main_thread->test_set_cached_time(61s);
+  test_main_thread->test_process_events_without_cached_time();
+  VERIFY_QUEUE_SIZES(0, 0, 0, 0);
+
+  CLEAR_TRANSFERS();
+}
+
+void
+TestRequestList::test_rejected() {
+  SETUP_ALL_WITH_3(basic);
+  CPPUNIT_ASSERT(peer_info->transfer_counter() == 3);
+
+  torrent::Piece rejected_2 = *piece_2;
+
+  CPPUNIT_ASSERT(request_list->rejected(rejected_2));
+  CPPUNIT_ASSERT(!request_list->rejected(rejected_2));
+  VERIFY_QUEUE_SIZES(2, 0, 0, 0);
+  CPPUNIT_ASSERT(peer_info->transfer_counter() == 2);
+
+  // Rejects following a choke are found in the choked queue.
+  torrent::Piece rejected_1 = *piece_1;
+  request_list->choked();
+
+  CPPUNIT_ASSERT(request_list->rejected(rejected_1));
+  VERIFY_QUEUE_SIZES(0, 0, 0, 1);
+  CPPUNIT_ASSERT(peer_info->transfer_counter() == 1);
+}
+
+void
+TestRequestList::test_rtt_pipe_size() {
+  SETUP_ALL(basic);
+
+  CPPUNIT_ASSERT(request_list->rtt() == 0us);
+  CPPUNIT_ASSERT(request_list->calculate_pipe_size(1024 * 100) == 38);
+  CPPUNIT_ASSERT(request_list->pipe_size_target() == 38);
+
+  // The kernel's round-trip time is used until a request is timed.
+  request_list->set_path_rtt(50ms);
+  CPPUNIT_ASSERT(request_list->calculate_pipe_size(10 << 20) == 2 * 32 + torrent::RequestList::pipe_size_min);
+
+  auto pieces = request_list->delegate(2);
+  CPPUNIT_ASSERT(pieces.size() == 2);
+
+  test_main_thread->test_set_cached_time(100ms);
+
+  // Only the request sent on an empty pipe is sampled.
+  CPPUNIT_ASSERT(request_list->downloading(*pieces[0]));
+  CPPUNIT_ASSERT(request_list->rtt() == 100ms);
+
+  request_list->transfer()->adjust_position(pieces[0]->length());
+  request_list->finished();
+
+  test_main_thread->test_set_cached_time(500ms);
+
+  CPPUNIT_ASSERT(request_list->downloading(*pieces[1]));
+  CPPUNIT_ASSERT(request_list->rtt() == 100ms);
+
+  request_list->transfer()->adjust_position(pieces[1]->length());
+  request_list->finished();
+
+  // 10 MiB/s over 100ms is 64 blocks in flight.
+  CPPUNIT_ASSERT(request_list->calculate_pipe_size(10 << 20) == 2 * 64 + torrent::RequestList::pipe_size_min);
+  CPPUNIT_ASSERT(request_list->calculate_pipe_size(0) == torrent::RequestList::pipe_size_min);
+  CPPUNIT_ASSERT(request_list->calculate_pipe_size(~uint32_t{0}) == torrent::RequestList::pipe_size_max);
+
+  // Idle again, so the next request is a new sample.
+  pieces = request_list->delegate(1);
+  CPPUNIT_ASSERT(pieces.size() == 1);
+
+  test_main_thread->test_set_cached_time(500ms + 900ms);
+
+  CPPUNIT_ASSERT(request_list->downloading(*pieces[0]));
+  CPPUNIT_ASSERT(request_list->rtt() == 200ms);
+
+  request_list->transfer()->adjust_position(pieces[0]->length());
+  request_list->finished();
+}
+
+void
+TestRequestList::test_request_latency() {
+  SETUP_ALL(basic);
+
+  torrent::utils::latency_histogram download_latency;
+  request_list->set_download_request_latency(&download_latency);
+
+  auto pieces = request_list->delegate(2);
+  CPPUNIT_ASSERT(pieces.size() == 2);
+
+  test_main_thread->test_set_cached_time(5ms);
+
+  CPPUNIT_ASSERT(request_list->downloading(*pieces[0]));
+  request_list->transfer()->adjust_position(pieces[0]->length());
+  request_list->finished();
+
+  test_main_thread->test_set_cached_time(300ms);
+
+  CPPUNIT_ASSERT(request_list->downloading(*pieces[1]));
+  request_list->transfer()->adjust_position(pieces[1]->length());
+  request_list->finished();
+
+  const auto& latency = request_list->request_latency();
+
+  CPPUNIT_ASSERT(latency.total_count() == 2);
+  CPPUNIT_ASSERT(latency.total() == 305ms);
+  CPPUNIT_ASSERT(latency.max() == 300ms);
+  CPPUNIT_ASSERT(latency.count(torrent::utils::latency_histogram::bucket_index(5ms)) == 1);
+  CPPUNIT_ASSERT(latency.count(torrent::utils::latency_histogram::bucket_index(300ms)) == 1);
+
+  CPPUNIT_ASSERT(download_latency.total_count() == 2);
+  CPPUNIT_ASSERT(download_latency.total() == 305ms);
+}
@@ -11,6 +11,13 @@ class TestRequestList : public CppUnit::TestFixture {
   CPPUNIT_TEST(test_choke_normal);
   CPPUNIT_TEST(test_choke_unchoke_discard);
   CPPUNIT_TEST(test_choke_unchoke_transfer);
+  CPPUNIT_TEST(test_choke_deep_pipeline);
+
+  CPPUNIT_TEST(test_unordered);
+  CPPUNIT_TEST(test_rejected);
+
+  CPPUNIT_TEST(test_rtt_pipe_size);
+  CPPUNIT_TEST(test_request_latency);
 
   CPPUNIT_TEST_SUITE_END();
 
@@ -26,4 +33,11 @@ public:
   void test_choke_normal();
   void test_choke_unchoke_discard();
   void test_choke_unchoke_transfer();
+  void test_choke_deep_pipeline();
+
+  void test_unordered();
+  void test_rejected();
+
+  void test_rtt_pipe_size();
+  void test_request_latency();
 };
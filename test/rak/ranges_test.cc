@@ -147,3 +147,27 @@ RangesTest::test_create_union() {
   CPPUNIT_ASSERT(verify_ranges(range_1u));
   CPPUNIT_ASSERT(range_1u.intersect_distance(-5, 60) == 32);
 }
+
+void
+RangesTest::test_insert_erase() {
+  torrent::ranges<int> range;
+  std::vector<bool> expected(64);
+
+  for (int i = 0; i < 2000; i++) {
+    int first = random() % 64;
+    int last = first + random() % (64 - first + 1);
+    bool insert = random() % 3 != 0;
+
+    if (insert)
+      range.insert(first, last);
+    else
+      range.erase(first, last);
+
+    std::fill(expected.begin() + first, expected.begin() + last, insert);
+
+    CPPUNIT_ASSERT(verify_ranges(range));
+
+    for (int index = 0; index < 64; index++)
+      CPPUNIT_ASSERT(range.has(index) == expected[index]);
+  }
+}
@@ -9,6 +9,7 @@ class RangesTest : public CppUnit::TestFixture {
   CPPUNIT_TEST(test_basic);
   CPPUNIT_TEST(test_intersect);
   CPPUNIT_TEST(test_create_union);
+  CPPUNIT_TEST(test_insert_erase);
   CPPUNIT_TEST_SUITE_END();
 
 public:
@@ -19,4 +20,5 @@ public:
   void test_intersect();
 
   void test_create_union();
+  void test_insert_erase();
 };
@@ -2,8 +2,15 @@
 
 #include "test_fd.h"
 
+#include <cerrno>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <unistd.h>
 #include <torrent/net/fd.h>
 
+#include "helpers/mock_function.h"
+
 CPPUNIT_TEST_SUITE_NAMED_REGISTRATION(test_fd, "torrent/net");
 
 void
@@ -31,3 +38,65 @@ test_fd::test_valid_flags() {
   CPPUNIT_ASSERT(!torrent::fd_valid_flags(torrent::fd_flags(torrent::fd_flag_stream | ~torrent::fd_flag_all)));
   CPPUNIT_ASSERT(!torrent::fd_valid_flags(torrent::fd_flags(0x3245132)));
 }
+
+void
+test_fd::test_socket_tuning() {
+  mock_expect(&torrent::fd__setsockopt_int, 0, 1000, (int)SOL_SOCKET, (int)SO_SNDBUF, 1 << 20);
+  CPPUNIT_ASSERT(torrent::fd_set_send_buffer_size(1000, 1 << 20));
+
+  mock_expect(&torrent::fd__setsockopt_int, -1, 1000, (int)SOL_SOCKET, (int)SO_RCVBUF, 1 << 20);
+  CPPUNIT_ASSERT(!torrent::fd_set_receive_buffer_size(1000, 1 << 20));
+
+#ifdef TCP_NOTSENT_LOWAT
+  mock_expect(&torrent::fd__setsockopt_int, 0, 1000, (int)IPPROTO_TCP, (int)TCP_NOTSENT_LOWAT, 1 << 17);
+  CPPUNIT_ASSERT(torrent::fd_set_tcp_notsent_lowat(1000, 1 << 17));
+#else
+  CPPUNIT_ASSERT(!torrent::fd_set_tcp_notsent_lowat(1000, 1 << 17));
+  CPPUNIT_ASSERT(errno == ENOPROTOOPT);
+#endif
+
+#ifdef TCP_CONGESTION
+  int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+  CPPUNIT_ASSERT(fd != -1);
+
+  CPPUNIT_ASSERT(torrent::fd_set_tcp_congestion(fd, "reno"));
+  CPPUNIT_ASSERT(!torrent::fd_set_tcp_congestion(fd, "no_such_algorithm"));
+
+  ::close(fd);
+#endif
+}
+
+void
+test_fd::test_tcp_info() {
+  torrent::fd_tcp_info info;
+
+  int listen_fd = ::socket(AF_INET, SOCK_STREAM, 0);
+  int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+  CPPUNIT_ASSERT(listen_fd != -1 && fd != -1);
+
+  sockaddr_in sa{};
+  socklen_t sa_length = sizeof(sa);
+  sa.sin_family = AF_INET;
+  sa.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+  CPPUNIT_ASSERT(::bind(listen_fd, reinterpret_cast<sockaddr*>(&sa), sizeof(sa)) == 0);
+  CPPUNIT_ASSERT(::getsockname(listen_fd, reinterpret_cast<sockaddr*>(&sa), &sa_length) == 0);
+  CPPUNIT_ASSERT(::listen(listen_fd, 1) == 0);
+  CPPUNIT_ASSERT(::connect(fd, reinterpret_cast<sockaddr*>(&sa), sizeof(sa)) == 0);
+
+#if defined(TCP_INFO) && defined(__linux__)
+  CPPUNIT_ASSERT(torrent::fd_get_tcp_info(fd, &info));
+  CPPUNIT_ASSERT(info.is_valid());
+  CPPUNIT_ASSERT(info.snd_cwnd != 0 && info.snd_mss != 0);
+  CPPUNIT_ASSERT(info.path_rate() != 0);
+#else
+  CPPUNIT_ASSERT(!torrent::fd_get_tcp_info(fd, &info));
+  CPPUNIT_ASSERT(!info.is_valid());
+#endif
+
+  ::close(fd);
+  ::close(listen_fd);
+
+  CPPUNIT_ASSERT(!torrent::fd_get_tcp_info(fd, &info));
+  CPPUNIT_ASSERT(!info.is_valid() && info.path_rate() == 0);
+}
@@ -4,9 +4,13 @@ class test_fd : public test_fixture {
   CPPUNIT_TEST_SUITE(test_fd);
 
   CPPUNIT_TEST(test_valid_flags);
+  CPPUNIT_TEST(test_socket_tuning);
+  CPPUNIT_TEST(test_tcp_info);
 
   CPPUNIT_TEST_SUITE_END();
 
 public:
   void test_valid_flags();
+  void test_socket_tuning();
+  void test_tcp_info();
 };
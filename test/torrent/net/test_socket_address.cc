@@ -381,3 +381,56 @@ test_socket_address::test_sa_to_v4mapped() {
   CPPUNIT_ASSERT_THROW(torrent::sap_to_v4mapped(sin6_v4_bc), torrent::internal_error);
   CPPUNIT_ASSERT_THROW(torrent::sap_to_v4mapped(sin6_v4_1), torrent::internal_error);
 }
+
+void
+test_socket_address::test_sa_common_prefix() {
+  auto prefix = [](const char* lhs, const char* rhs) {
+      return torrent::sa_common_prefix(wrap_ai_get_first_sa(lhs).get(), wrap_ai_get_first_sa(rhs).get());
+    };
+
+  CPPUNIT_ASSERT(prefix("10.0.0.1", "10.0.0.1") == 32);
+  CPPUNIT_ASSERT(prefix("10.0.0.1", "10.0.0.2") == 30);
+  CPPUNIT_ASSERT(prefix("10.0.1.1", "10.0.0.1") == 23);
+  CPPUNIT_ASSERT(prefix("10.0.0.1", "138.0.0.1") == 0);
+
+  CPPUNIT_ASSERT(prefix("2001:db8::1", "2001:db8::1") == 128);
+  CPPUNIT_ASSERT(prefix("2001:db8:0:1::1", "2001:db8::1") == 63);
+
+  CPPUNIT_ASSERT(prefix("::ffff:10.0.0.1", "10.0.0.2") == 30);
+  CPPUNIT_ASSERT(prefix("10.0.0.1", "2001:db8::1") == 0);
+  CPPUNIT_ASSERT(torrent::sa_common_prefix(torrent::sa_make_unspec().get(), torrent::sa_make_unspec().get()) == 0);
+}
+
+void
+test_socket_address::test_sa_inet_storage() {
+  TEST_DEFAULT_SA;
+
+  torrent::sa_inet_storage empty;
+
+  CPPUNIT_ASSERT(empty.empty());
+  CPPUNIT_ASSERT(empty.length() == 0);
+  CPPUNIT_ASSERT(torrent::sa_inet_storage(static_cast<const sockaddr*>(nullptr)).empty());
+  CPPUNIT_ASSERT(torrent::sa_inet_storage(torrent::sa_make_unspec().get()).empty());
+  CPPUNIT_ASSERT(torrent::sa_inet_storage(torrent::sa_make_unix("").get()).empty());
+
+  torrent::sa_inet_storage inet(sin_1_5000.get());
+
+  CPPUNIT_ASSERT(inet.is_inet() && !inet.is_inet6());
+  CPPUNIT_ASSERT(inet.length() == sizeof(sockaddr_in));
+  CPPUNIT_ASSERT(torrent::sa_equal(inet.get(), sin_1_5000.get()));
+
+  torrent::sa_inet_storage inet6(reinterpret_cast<const sockaddr_in6*>(sin6_1_5000.get()));
+
+  CPPUNIT_ASSERT(inet6.is_inet6() && !inet6.is_inet());
+  CPPUNIT_ASSERT(inet6.length() == sizeof(sockaddr_in6));
+  CPPUNIT_ASSERT(torrent::sa_equal(inet6.get(), sin6_1_5000.get()));
+
+  torrent::sa_inet_storage copy = inet6;
+  inet6.clear();
+
+  CPPUNIT_ASSERT(inet6.empty());
+  CPPUNIT_ASSERT(torrent::sa_equal(copy.get(), sin6_1_5000.get()));
+
+  copy = inet;
+  CPPUNIT_ASSERT(torrent::sa_equal(copy.get(), sin_1_5000.get()));
+}
@@ -19,6 +19,10 @@ class test_socket_address : public CppUnit::TestFixture {
   CPPUNIT_TEST(test_sa_from_v4mapped);
   CPPUNIT_TEST(test_sa_to_v4mapped);
 
+  CPPUNIT_TEST(test_sa_common_prefix);
+
+  CPPUNIT_TEST(test_sa_inet_storage);
+
   CPPUNIT_TEST_SUITE_END();
 
 public:
@@ -40,4 +44,8 @@ public:
 
   void test_sa_from_v4mapped();
   void test_sa_to_v4mapped();
+
+  void test_sa_common_prefix();
+
+  void test_sa_inet_storage();
 };
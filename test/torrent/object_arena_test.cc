@@ -0,0 +1,117 @@
+#include "config.h"
+
+#include <cstring>
+#include <torrent/object.h>
+#include <torrent/object_stream.h>
+
+#include "object_arena_test.h"
+#include "object_test_utils.h"
+
+CPPUNIT_TEST_SUITE_REGISTRATION(ObjectArenaTest);
+
+static const char* torrent_bencode = "d8:announce3:url4:infod5:filesld6:lengthi5e4:pathl1:aeed6:lengthi7e4:pathl1:b1:ceee4:name4:test12:piece lengthi16384eee";
+
+static void
+arena_read(torrent::object_arena& arena, const char* str) {
+  CPPUNIT_ASSERT(arena.read_bencode(str, str + std::strlen(str)) == str + std::strlen(str));
+}
+
+void
+ObjectArenaTest::test_read() {
+  torrent::object_arena arena;
+  arena_read(arena, torrent_bencode);
+
+  CPPUNIT_ASSERT(compare_bencode(arena.root(), torrent_bencode));
+  CPPUNIT_ASSERT(arena.root().get_key("info").get_key_list("files").size() == 2);
+
+  // Reading again replaces the root.
+  arena_read(arena, "li1ei2ee");
+  CPPUNIT_ASSERT(compare_bencode(arena.root(), "li1ei2ee"));
+}
+
+void
+ObjectArenaTest::test_resource() {
+  torrent::object_arena arena;
+  arena_read(arena, torrent_bencode);
+
+  const torrent::Object& info = arena.root().get_key("info");
+
+  CPPUNIT_ASSERT(arena.root().as_map().get_allocator().resource() == arena.resource());
+  CPPUNIT_ASSERT(info.as_map().get_allocator().resource() == arena.resource());
+  CPPUNIT_ASSERT(info.get_key_list("files").get_allocator().resource() == arena.resource());
+
+  CPPUNIT_ASSERT(arena.create_list().as_list().get_allocator().resource() == arena.resource());
+  CPPUNIT_ASSERT(torrent::Object::create_map().as_map().get_allocator().resource() == std::pmr::get_default_resource());
+}
+
+void
+ObjectArenaTest::test_copy() {
+  torrent::Object copy;
+
+  {
+    torrent::object_arena arena;
+    arena_read(arena, torrent_bencode);
+
+    copy = arena.root();
+
+    CPPUNIT_ASSERT(copy.as_map().get_allocator().resource() == std::pmr::get_default_resource());
+    CPPUNIT_ASSERT(copy.get_key("info").get_key_list("files").get_allocator().resource() == std::pmr::get_default_resource());
+
+    // Assigning into the arena tree allocates from the default resource.
+    arena.root().insert_key("copy", torrent::Object::create_map()).insert_key("a", "b");
+  }
+
+  CPPUNIT_ASSERT(compare_bencode(copy, torrent_bencode));
+}
+
+void
+ObjectArenaTest::test_swap() {
+  torrent::Object object = torrent::Object::create_map();
+  object.insert_key("x", int64_t{1});
+
+  {
+    torrent::object_arena arena;
+    arena_read(arena, torrent_bencode);
+
+    torrent::Object& files = arena.root().get_key("info").get_key("files");
+    torrent::Object list = torrent::Object::create_list();
+    list.insert_back("item");
+
+    files.swap(list);
+
+    // The containers stay in their own resource.
+    CPPUNIT_ASSERT(files.as_list().get_allocator().resource() == arena.resource());
+    CPPUNIT_ASSERT(list.as_list().get_allocator().resource() == std::pmr::get_default_resource());
+
+    // Elements are moved across, so 'files' is no longer in the tree.
+    object.swap(arena.root().get_key("info"));
+
+    CPPUNIT_ASSERT(object.as_map().get_allocator().resource() == std::pmr::get_default_resource());
+    CPPUNIT_ASSERT(arena.root().get_key("info").as_map().get_allocator().resource() == arena.resource());
+
+    CPPUNIT_ASSERT(list.as_list().size() == 2);
+    CPPUNIT_ASSERT(compare_bencode(arena.root().get_key("info"), "d1:xi1ee"));
+  }
+
+  CPPUNIT_ASSERT(object.get_key_string("name") == "test");
+  CPPUNIT_ASSERT(compare_bencode(object.get_key("files"), "l4:iteme"));
+}
+
+void
+ObjectArenaTest::test_move() {
+  torrent::Object object = create_bencode("d1:ad1:bl1:ceee");
+  torrent::Object moved(std::move(object));
+
+  CPPUNIT_ASSERT(object.is_empty());
+  CPPUNIT_ASSERT(compare_bencode(moved, "d1:ad1:bl1:ceee"));
+
+  // Moving an element over its parent.
+  moved = std::move(moved.get_key("a"));
+  CPPUNIT_ASSERT(compare_bencode(moved, "d1:bl1:cee"));
+
+  moved = std::move(moved.get_key("b"));
+  CPPUNIT_ASSERT(compare_bencode(moved, "l1:ce"));
+
+  moved = torrent::Object("string");
+  CPPUNIT_ASSERT(moved.as_string() == "string");
+}
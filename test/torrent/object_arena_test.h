@@ -0,0 +1,23 @@
+#include <cppunit/extensions/HelperMacros.h>
+
+#include "torrent/object_arena.h"
+
+class ObjectArenaTest : public CppUnit::TestFixture {
+  CPPUNIT_TEST_SUITE(ObjectArenaTest);
+  CPPUNIT_TEST(test_read);
+  CPPUNIT_TEST(test_resource);
+  CPPUNIT_TEST(test_copy);
+  CPPUNIT_TEST(test_swap);
+  CPPUNIT_TEST(test_move);
+  CPPUNIT_TEST_SUITE_END();
+
+public:
+  void setUp() {}
+  void tearDown() {}
+
+  void test_read();
+  void test_resource();
+  void test_copy();
+  void test_swap();
+  void test_move();
+};
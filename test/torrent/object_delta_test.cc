@@ -0,0 +1,112 @@
+#include "config.h"
+
+#include <torrent/exceptions.h>
+#include <torrent/object.h>
+
+#include "object_delta_test.h"
+#include "object_test_utils.h"
+
+CPPUNIT_TEST_SUITE_REGISTRATION(ObjectDeltaTest);
+
+static const char* resume_bencode =
+  "d17:libtorrent_resumed8:bitfield4:\xff\xff\x01\x01" "5:filesld9:completedi1e8:priorityi1eee"
+  "5:peersld4:inet6:AAAAAA4:lasti10eeee8:rtorrentd7:custom13:foo5:statei1eee";
+
+static bool
+delta_round_trip(const char* base_str, const char* current_str, const char* delta_str) {
+  torrent::Object base = create_bencode(base_str);
+  torrent::Object current = create_bencode(current_str);
+  torrent::Object delta = torrent::object_delta(base, current);
+
+  torrent::object_apply_delta(base, delta);
+
+  return compare_bencode(delta, delta_str) && compare_bencode(base, current_str);
+}
+
+void
+ObjectDeltaTest::test_unchanged() {
+  torrent::Object resume = create_bencode(resume_bencode);
+
+  CPPUNIT_ASSERT(compare_bencode(torrent::object_delta(resume, resume), "le"));
+  CPPUNIT_ASSERT(compare_bencode(torrent::object_delta(resume, create_bencode(resume_bencode)), "le"));
+  CPPUNIT_ASSERT(compare_bencode(torrent::object_delta(torrent::Object(), torrent::Object()), "le"));
+}
+
+void
+ObjectDeltaTest::test_map() {
+  CPPUNIT_ASSERT(delta_round_trip("d1:ai1e1:bi2ee", "d1:ai1e1:bi3ee", "lll1:bei3eee"));
+  CPPUNIT_ASSERT(delta_round_trip("d1:ai1e1:bi2ee", "d1:ai1e1:ci3ee", "lll1:beell1:cei3eee"));
+  CPPUNIT_ASSERT(delta_round_trip("d1:bi2ee", "d1:ai1e1:bi2ee", "lll1:aei1eee"));
+  CPPUNIT_ASSERT(delta_round_trip("d1:ai1e1:bi2ee", "de", "lll1:aeell1:beee"));
+  CPPUNIT_ASSERT(delta_round_trip("d1:ad1:bd1:ci1e1:di2eeee", "d1:ad1:bd1:ci1e1:di3eeee", "lll1:a1:b1:dei3eee"));
+
+  CPPUNIT_ASSERT(delta_round_trip(resume_bencode,
+                                  "d17:libtorrent_resumed8:bitfield4:\xff\xff\xff\x01" "5:filesld9:completedi1e8:priorityi1eee"
+                                  "5:peersld4:inet6:AAAAAA4:lasti10eeee8:rtorrentd5:statei1eee",
+                                  "lll17:libtorrent_resume8:bitfielde4:\xff\xff\xff\x01" "ell8:rtorrent7:custom1eee"));
+}
+
+void
+ObjectDeltaTest::test_replace() {
+  // Anything but dictionaries is replaced whole.
+  CPPUNIT_ASSERT(delta_round_trip("d1:ali1ei2eee", "d1:ali1ei3eee", "lll1:aeli1ei3eeee"));
+  CPPUNIT_ASSERT(delta_round_trip("d1:ai1ee", "d1:ad1:bi1eee", "lll1:aed1:bi1eeee"));
+  CPPUNIT_ASSERT(delta_round_trip("d1:ad1:bi1eee", "d1:ai1ee", "lll1:aei1eee"));
+
+  CPPUNIT_ASSERT(delta_round_trip("li1ee", "li2ee", "llleli2eeee"));
+  CPPUNIT_ASSERT(delta_round_trip("i1e", "d1:ai1ee", "llled1:ai1eeee"));
+}
+
+void
+ObjectDeltaTest::test_skip() {
+  torrent::Object base = create_bencode("d1:ai1e1:bi2ee");
+  torrent::Object current = create_bencode("d1:ai1e1:bi3ee");
+
+  current.get_key("b").set_flags(torrent::Object::flag_session_data);
+  current.insert_key("c", torrent::Object());
+
+  CPPUNIT_ASSERT(compare_bencode(torrent::object_delta(base, current, torrent::Object::flag_session_data), "lll1:beee"));
+  CPPUNIT_ASSERT(compare_bencode(torrent::object_delta(base, current), "lll1:bei3eee"));
+
+  torrent::Object list = create_bencode("d1:ali1ei2eee");
+  list.get_key("a").as_list().back().set_flags(torrent::Object::flag_session_data);
+
+  CPPUNIT_ASSERT(compare_bencode(torrent::object_delta(create_bencode("d1:ali1eee"), list, torrent::Object::flag_session_data), "le"));
+}
+
+void
+ObjectDeltaTest::test_apply() {
+  torrent::Object object = create_bencode("d1:ai1ee");
+
+  // Paths are created as needed, erasing missing keys does nothing.
+  torrent::object_apply_delta(object, create_bencode("lll1:b1:cei1eell1:d1:eeell1:aeee"));
+  CPPUNIT_ASSERT(compare_bencode(object, "d1:bd1:ci1eee"));
+
+  torrent::object_apply_delta(object, create_bencode("lll1:b1:c1:dei2eee"));
+  CPPUNIT_ASSERT(compare_bencode(object, "d1:bd1:cd1:di2eeee"));
+
+  // Consecutive deltas may be concatenated.
+  torrent::Object base = create_bencode("d1:ai1ee");
+  torrent::Object first = torrent::object_delta(base, create_bencode("d1:ai2ee"));
+  torrent::Object second = torrent::object_delta(create_bencode("d1:ai2ee"), create_bencode("d1:ai2e1:bi3ee"));
+
+  for (const auto& operation : second.as_list())
+    first.insert_back(operation);
+
+  torrent::object_apply_delta(base, first);
+  CPPUNIT_ASSERT(compare_bencode(base, "d1:ai2e1:bi3ee"));
+}
+
+void
+ObjectDeltaTest::test_invalid() {
+  torrent::Object object = create_bencode("d1:ai1ee");
+
+  CPPUNIT_ASSERT_THROW(torrent::object_apply_delta(object, create_bencode("i1e")), torrent::bencode_error);
+  CPPUNIT_ASSERT_THROW(torrent::object_apply_delta(object, create_bencode("li1ee")), torrent::bencode_error);
+  CPPUNIT_ASSERT_THROW(torrent::object_apply_delta(object, create_bencode("llee")), torrent::bencode_error);
+  CPPUNIT_ASSERT_THROW(torrent::object_apply_delta(object, create_bencode("llleee")), torrent::bencode_error);
+  CPPUNIT_ASSERT_THROW(torrent::object_apply_delta(object, create_bencode("llli1eei1eee")), torrent::bencode_error);
+  CPPUNIT_ASSERT_THROW(torrent::object_apply_delta(object, create_bencode("lll1:aei1ei2eee")), torrent::bencode_error);
+
+  CPPUNIT_ASSERT(compare_bencode(object, "d1:ai1ee"));
+}
@@ -0,0 +1,25 @@
+#include <cppunit/extensions/HelperMacros.h>
+
+#include "torrent/object_delta.h"
+
+class ObjectDeltaTest : public CppUnit::TestFixture {
+  CPPUNIT_TEST_SUITE(ObjectDeltaTest);
+  CPPUNIT_TEST(test_unchanged);
+  CPPUNIT_TEST(test_map);
+  CPPUNIT_TEST(test_replace);
+  CPPUNIT_TEST(test_skip);
+  CPPUNIT_TEST(test_apply);
+  CPPUNIT_TEST(test_invalid);
+  CPPUNIT_TEST_SUITE_END();
+
+public:
+  void setUp() {}
+  void tearDown() {}
+
+  void test_unchanged();
+  void test_map();
+  void test_replace();
+  void test_skip();
+  void test_apply();
+  void test_invalid();
+};
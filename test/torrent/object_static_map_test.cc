@@ -45,7 +45,7 @@ typedef torrent::static_map_type<keys_2, key_2_LAST> test_map_2_type;
 // Unsupported keys we receive are dropped (ignored) while decoding.
 // See torrent/object_static_map.h for how this works.
 template <>
-const test_map_type::key_list_type test_map_type::keys = {
+constexpr test_map_type::key_list_type test_map_type::keys = {
   { key_d_a,          "d_a::b" },
   { key_d_d_a,        "d_a::c::a" },
   { key_d_b,          "d_a::d" },
@@ -62,7 +62,10 @@ const test_map_type::key_list_type test_map_type::keys = {
 };
 
 template <>
-const test_map_2_type::key_list_type test_map_2_type::keys = {
+constexpr test_map_type::key_hash_type test_map_type::key_hash = torrent::static_map_make_hash<test_map_type>();
+
+template <>
+constexpr test_map_2_type::key_list_type test_map_2_type::keys = {
   { key_2_d_x_y,        "d_x::f" },
   { key_2_d_x_z,        "d_x::g" },
   { key_2_l_x_1,        "l_x[]" },
@@ -71,6 +74,9 @@ const test_map_2_type::key_list_type test_map_2_type::keys = {
   { key_2_v_a,          "v_a" },
 };
 
+template <>
+constexpr test_map_2_type::key_hash_type test_map_2_type::key_hash = torrent::static_map_make_hash<test_map_2_type>();
+
 void
 ObjectStaticMapTest::test_basics() {
   test_map_type test_map;
@@ -166,7 +172,7 @@ enum ext_test_keys {
 typedef torrent::static_map_type<ext_test_keys, key_test_LAST> ext_test_message;
 
 template <>
-const ext_test_message::key_list_type ext_test_message::keys = {
+constexpr ext_test_message::key_list_type ext_test_message::keys = {
   { key_e,            "e" },
   { key_m_utPex,      "m::ut_pex" },
   { key_p,            "p" },
@@ -174,6 +180,9 @@ const ext_test_message::key_list_type ext_test_message::keys = {
   { key_v,            "v" },
 };
 
+template <>
+constexpr ext_test_message::key_hash_type ext_test_message::key_hash = torrent::static_map_make_hash<ext_test_message>();
+
 void
 ObjectStaticMapTest::test_read_extensions() {
   ext_test_message test_ext;
@@ -219,22 +228,35 @@ typedef torrent::static_map_type<keys_raw_types, key_raw_types_LAST> test_raw_ty
 typedef torrent::static_map_type<keys_multiple, key_multiple_LAST> test_multiple_type;
 typedef torrent::static_map_type<keys_dict, key_dict_LAST> test_dict_type;
 
-template <> const test_empty_type::key_list_type
+template <> constexpr test_empty_type::key_list_type
 test_empty_type::keys = { };
-template <> const test_single_type::key_list_type
+template <> constexpr test_single_type::key_list_type
 test_single_type::keys = { { key_single_a, "b" } };
-template <> const test_raw_type::key_list_type
+template <> constexpr test_raw_type::key_list_type
 test_raw_type::keys = { { key_raw_a, "b*" } };
-template <> const test_raw_types_type::key_list_type
+template <> constexpr test_raw_types_type::key_list_type
 test_raw_types_type::keys = { { key_raw_types_empty, "e*"},
                               { key_raw_types_list, "l*L"},
                               { key_raw_types_map, "m*M"},
                               { key_raw_types_str, "s*S"} };
-template <> const test_multiple_type::key_list_type
+template <> constexpr test_multiple_type::key_list_type
 test_multiple_type::keys = { { key_multiple_a, "a" }, { key_multiple_b, "b*" }, { key_multiple_c, "c" } };
-template <> const test_dict_type::key_list_type
+template <> constexpr test_dict_type::key_list_type
 test_dict_type::keys = { { key_dict_a_b, "a::b" } };
 
+template <> constexpr test_empty_type::key_hash_type
+test_empty_type::key_hash = torrent::static_map_make_hash<test_empty_type>();
+template <> constexpr test_single_type::key_hash_type
+test_single_type::key_hash = torrent::static_map_make_hash<test_single_type>();
+template <> constexpr test_raw_type::key_hash_type
+test_raw_type::key_hash = torrent::static_map_make_hash<test_raw_type>();
+template <> constexpr test_raw_types_type::key_hash_type
+test_raw_types_type::key_hash = torrent::static_map_make_hash<test_raw_types_type>();
+template <> constexpr test_multiple_type::key_hash_type
+test_multiple_type::key_hash = torrent::static_map_make_hash<test_multiple_type>();
+template <> constexpr test_dict_type::key_hash_type
+test_dict_type::key_hash = torrent::static_map_make_hash<test_dict_type>();
+
 void
 ObjectStaticMapTest::test_read_empty() {
   test_empty_type map_normal;
@@ -385,3 +407,43 @@ ObjectStaticMapTest::test_write_multiple() {
   
 //   CPPUNIT_ASSERT(static_map_write_bencode(map_value, "de"));
 }
+
+static bool
+key_hash_matches(const char* key, const torrent::static_map_mapping_type* expected, unsigned int length) {
+  auto result = test_map_type::key_hash.view().find(test_map_type::keys, key, std::strlen(key));
+
+  return result.first == expected && result.second == length;
+}
+
+void
+ObjectStaticMapTest::test_key_hash() {
+  CPPUNIT_ASSERT(key_hash_matches("d_a", test_map_type::keys + 0, 3));
+  CPPUNIT_ASSERT(key_hash_matches("d_a::b", test_map_type::keys + 0, 6));
+  CPPUNIT_ASSERT(key_hash_matches("d_a::c", test_map_type::keys + 1, 6));
+  CPPUNIT_ASSERT(key_hash_matches("d_a::c::a", test_map_type::keys + 1, 9));
+  CPPUNIT_ASSERT(key_hash_matches("d_a::d", test_map_type::keys + 2, 6));
+  CPPUNIT_ASSERT(key_hash_matches("e", test_map_type::keys + 3, 1));
+  CPPUNIT_ASSERT(key_hash_matches("s_b", test_map_type::keys + 7, 3));
+  CPPUNIT_ASSERT(key_hash_matches("v_a", test_map_type::keys + 8, 3));
+
+  CPPUNIT_ASSERT(key_hash_matches("", test_map_type::keys, 0));
+  CPPUNIT_ASSERT(key_hash_matches("d", test_map_type::keys, 0));
+  CPPUNIT_ASSERT(key_hash_matches("d_a:", test_map_type::keys, 0));
+  CPPUNIT_ASSERT(key_hash_matches("d_a::c::", test_map_type::keys, 0));
+  CPPUNIT_ASSERT(key_hash_matches("s_c", test_map_type::keys, 0));
+  CPPUNIT_ASSERT(key_hash_matches("v_a_", test_map_type::keys, 0));
+
+  // All slots of the empty map are empty.
+  for (auto& entry : test_empty_type::key_hash.entries)
+    CPPUNIT_ASSERT(entry.length == 0);
+}
+
+// As with the scan, a key before one already read is skipped.
+void
+ObjectStaticMapTest::test_read_unsorted() {
+  test_multiple_type map;
+
+  CPPUNIT_ASSERT(static_map_read_bencode(map, "d1:ci3e1:ai1ee"));
+  CPPUNIT_ASSERT(map[key_multiple_c].as_value() == 3);
+  CPPUNIT_ASSERT(map[key_multiple_a].is_empty());
+}
@@ -19,6 +19,9 @@ class ObjectStaticMapTest : public CppUnit::TestFixture {
   CPPUNIT_TEST(test_write_empty);
   CPPUNIT_TEST(test_write_single);
   CPPUNIT_TEST(test_write_multiple);
+
+  CPPUNIT_TEST(test_key_hash);
+  CPPUNIT_TEST(test_read_unsorted);
   CPPUNIT_TEST_SUITE_END();
 
 public:
@@ -43,5 +46,8 @@ public:
   void test_write_empty();
   void test_write_single();
   void test_write_multiple();
+
+  void test_key_hash();
+  void test_read_unsorted();
 };
 
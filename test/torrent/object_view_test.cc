@@ -0,0 +1,154 @@
+#include "config.h"
+
+#include <cstring>
+#include <torrent/exceptions.h>
+#include <torrent/object.h>
+
+#include "object_view_test.h"
+#include "object_test_utils.h"
+
+CPPUNIT_TEST_SUITE_REGISTRATION(ObjectViewTest);
+
+static const char* ordered_bencode = "d1:ei0e4:ipv44:XXXX4:ipv616:XXXXXXXXXXXXXXXX1:md11:upload_onlyi3e12:ut_holepunchi4e11:ut_metadatai2e6:ut_pexi1ee13:metadata_sizei15408e1:pi16033e4:reqqi255e1:v15:uuTorrent 1.8.46:yourip4:XXXXe";
+static const char* unordered_bencode = "d1:ei0e1:md11:upload_onlyi3e12:ut_holepunchi4e11:ut_metadatai2e6:ut_pexi1ee4:ipv44:XXXX4:ipv616:XXXXXXXXXXXXXXXX13:metadata_sizei15408e1:pi16033e4:reqqi255e1:v15:uuTorrent 1.8.46:yourip4:XXXXe";
+
+static torrent::object_index
+create_index(const char* str) {
+  return torrent::object_index(str, str + std::strlen(str));
+}
+
+static bool
+object_view_read_catch(const char* str) {
+  try {
+    create_index(str);
+    return false;
+  } catch (torrent::bencode_error& e) {
+    return true;
+  }
+}
+
+void
+ObjectViewTest::test_basic() {
+  CPPUNIT_ASSERT(create_index("i0e").root().as_value() == 0);
+  CPPUNIT_ASSERT(create_index("i-123e").root().as_value() == -123);
+  CPPUNIT_ASSERT(create_index("i123456789012345e").root().as_value() == INT64_C(123456789012345));
+
+  CPPUNIT_ASSERT(create_index("0:").root().as_string() == "");
+  CPPUNIT_ASSERT(create_index("4:test").root().as_string() == "test");
+
+  // Trailing data is left for the caller.
+  const char* str = "4:testi1e";
+  torrent::object_index index(str, str + std::strlen(str));
+
+  CPPUNIT_ASSERT(index.end() == str + 6);
+  CPPUNIT_ASSERT(index.root().is_string());
+  CPPUNIT_ASSERT(!index.root().is_value());
+  CPPUNIT_ASSERT_THROW(index.root().as_value(), torrent::bencode_error);
+}
+
+void
+ObjectViewTest::test_list() {
+  torrent::object_index index = create_index("li1e4:testleli2eee");
+  torrent::object_view::list_type list = index.root().as_list();
+
+  CPPUNIT_ASSERT(list.size() == 4);
+
+  auto itr = list.begin();
+  CPPUNIT_ASSERT(itr->as_value() == 1);
+  CPPUNIT_ASSERT((++itr)->as_string() == "test");
+  CPPUNIT_ASSERT((++itr)->as_list().empty());
+  CPPUNIT_ASSERT((++itr)->as_list().size() == 1);
+  CPPUNIT_ASSERT(itr->as_list().begin()->as_value() == 2);
+  CPPUNIT_ASSERT(++itr == list.end());
+
+  CPPUNIT_ASSERT(create_index("le").root().as_list().empty());
+}
+
+void
+ObjectViewTest::test_map() {
+  torrent::object_index index = create_index(ordered_bencode);
+  torrent::object_view root = index.root();
+
+  CPPUNIT_ASSERT(root.is_map());
+  CPPUNIT_ASSERT(root.as_map().size() == 9);
+
+  CPPUNIT_ASSERT(root.has_key("e"));
+  CPPUNIT_ASSERT(root.has_key_value("e"));
+  CPPUNIT_ASSERT(!root.has_key_string("e"));
+  CPPUNIT_ASSERT(!root.has_key("missing"));
+  CPPUNIT_ASSERT_THROW(root.get_key("missing"), torrent::bencode_error);
+
+  CPPUNIT_ASSERT(root.get_key_value("metadata_size") == 15408);
+  CPPUNIT_ASSERT(root.get_key_string("v") == "uuTorrent 1.8.4");
+  CPPUNIT_ASSERT(root.get_key_raw_string(std::string("ipv4")).size() == 4);
+  CPPUNIT_ASSERT(root.get_key_map("m").size() == 4);
+  CPPUNIT_ASSERT(root.get_key("m").get_key_value("ut_pex") == 1);
+
+  auto itr = root.as_map().begin();
+  CPPUNIT_ASSERT(itr->first.as_string() == "e" && itr->second.as_value() == 0);
+  CPPUNIT_ASSERT((++itr)->first.as_string() == "ipv4");
+
+  // Non-map views have no keys.
+  CPPUNIT_ASSERT(!root.get_key("e").has_key("e"));
+  CPPUNIT_ASSERT_THROW(root.get_key("e").get_key("e"), torrent::bencode_error);
+
+  // Duplicate keys resolve to the last entry, as with Object.
+  CPPUNIT_ASSERT(create_index("d1:ai1e1:ai2ee").root().get_key_value("a") == 2);
+}
+
+void
+ObjectViewTest::test_ordered() {
+  CPPUNIT_ASSERT(!create_index(ordered_bencode).root().is_unordered());
+  CPPUNIT_ASSERT(create_index(unordered_bencode).root().is_unordered());
+  CPPUNIT_ASSERT(create_index(unordered_bencode).root().flags() & torrent::Object::flag_unordered);
+
+  CPPUNIT_ASSERT(!create_index("d0:i1e5:filesi2ee").root().is_unordered());
+  CPPUNIT_ASSERT(create_index("d0:i1e0:i2ee").root().is_unordered());
+
+  // Inherited from nested dictionaries, as with object_read_bencode_c.
+  CPPUNIT_ASSERT(create_index("ld1:bi1e1:ai2eee").root().is_unordered());
+  CPPUNIT_ASSERT(create_index("d1:ad1:bi1e1:ai2eee").root().is_unordered());
+  CPPUNIT_ASSERT(!create_index("d1:ad1:bi1e1:ai2eee").root().get_key("a").get_key("a").is_unordered());
+}
+
+void
+ObjectViewTest::test_raw_bencode() {
+  torrent::object_index index = create_index("d4:infod6:lengthi5e4:name4:teste5:valuei-12ee");
+  torrent::object_view root = index.root();
+
+  CPPUNIT_ASSERT(std::string(root.get_key("info").as_raw_bencode().begin(), root.get_key("info").as_raw_bencode().end()) == "d6:lengthi5e4:name4:teste");
+  CPPUNIT_ASSERT(std::string(root.get_key("value").as_raw_bencode().begin(), root.get_key("value").as_raw_bencode().end()) == "i-12e");
+  CPPUNIT_ASSERT(std::string(root.get_key("info").get_key("name").as_raw_bencode().begin(),
+                             root.get_key("info").get_key("name").as_raw_bencode().end()) == "4:test");
+}
+
+void
+ObjectViewTest::test_to_object() {
+  torrent::object_index index = create_index(ordered_bencode);
+
+  CPPUNIT_ASSERT(compare_bencode(index.root().to_object(), ordered_bencode));
+  CPPUNIT_ASSERT(compare_bencode(index.root().get_key("m").to_object(), "d11:upload_onlyi3e12:ut_holepunchi4e11:ut_metadatai2e6:ut_pexi1ee"));
+}
+
+void
+ObjectViewTest::test_invalid() {
+  CPPUNIT_ASSERT(object_view_read_catch(""));
+  CPPUNIT_ASSERT(object_view_read_catch("i"));
+  CPPUNIT_ASSERT(object_view_read_catch("1"));
+  CPPUNIT_ASSERT(object_view_read_catch("5:test"));
+  CPPUNIT_ASSERT(object_view_read_catch("d"));
+  CPPUNIT_ASSERT(object_view_read_catch("l"));
+  CPPUNIT_ASSERT(object_view_read_catch("e"));
+  CPPUNIT_ASSERT(object_view_read_catch("d1:ae"));
+  CPPUNIT_ASSERT(object_view_read_catch("di1ei2ee"));
+
+  CPPUNIT_ASSERT(object_view_read_catch("i-0e"));
+  CPPUNIT_ASSERT(object_view_read_catch("i--1e"));
+  CPPUNIT_ASSERT(object_view_read_catch("-1"));
+
+  std::string deep(torrent::object_index::max_depth, 'l');
+  deep.append(torrent::object_index::max_depth, 'e');
+
+  CPPUNIT_ASSERT(object_view_read_catch(deep.c_str()));
+  CPPUNIT_ASSERT(!object_view_read_catch(deep.c_str() + 1));
+}
@@ -0,0 +1,27 @@
+#include <cppunit/extensions/HelperMacros.h>
+
+#include "torrent/object_view.h"
+
+class ObjectViewTest : public CppUnit::TestFixture {
+  CPPUNIT_TEST_SUITE(ObjectViewTest);
+  CPPUNIT_TEST(test_basic);
+  CPPUNIT_TEST(test_list);
+  CPPUNIT_TEST(test_map);
+  CPPUNIT_TEST(test_ordered);
+  CPPUNIT_TEST(test_raw_bencode);
+  CPPUNIT_TEST(test_to_object);
+  CPPUNIT_TEST(test_invalid);
+  CPPUNIT_TEST_SUITE_END();
+
+public:
+  void setUp() {}
+  void tearDown() {}
+
+  void test_basic();
+  void test_list();
+  void test_map();
+  void test_ordered();
+  void test_raw_bencode();
+  void test_to_object();
+  void test_invalid();
+};
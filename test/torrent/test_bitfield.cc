@@ -0,0 +1,293 @@
+#include "config.h"
+
+#include "test/torrent/test_bitfield.h"
+
+#include <random>
+
+#include "torrent/bitfield.h"
+#include "torrent/exceptions.h"
+
+CPPUNIT_TEST_SUITE_REGISTRATION(test_bitfield);
+
+static const uint32_t test_sizes[] = { 1, 7, 8, 9, 63, 64, 65, 127, 128, 200, 1000 };
+
+static void
+fill_random(torrent::Bitfield* bf, std::mt19937& rng) {
+  for (auto itr = bf->begin(); itr != bf->end(); itr++)
+    *itr = rng();
+
+  bf->update();
+}
+
+static uint32_t
+naive_count(const torrent::Bitfield& a, const torrent::Bitfield* b, bool invert, uint32_t first, uint32_t last) {
+  uint32_t count = 0;
+
+  for (uint32_t i = first; i != last; i++)
+    count += a.get(i) && (b == nullptr || b->get(i) != invert);
+
+  return count;
+}
+
+void
+test_bitfield::test_basic() {
+  torrent::Bitfield bf;
+
+  CPPUNIT_ASSERT(bf.empty());
+
+  bf.set_size_bits(65);
+  bf.allocate();
+  bf.unset_all();
+
+  CPPUNIT_ASSERT(!bf.empty());
+  CPPUNIT_ASSERT(bf.size_bytes() == 9);
+  CPPUNIT_ASSERT(bf.size_words() == 2);
+  CPPUNIT_ASSERT(bf.is_all_unset());
+
+  bf.set(0);
+  bf.set(64);
+
+  CPPUNIT_ASSERT(bf.get(0) && bf.get(64) && !bf.get(1));
+  CPPUNIT_ASSERT(bf.size_set() == 2);
+  CPPUNIT_ASSERT(bf.begin()[0] == 0x80 && bf.begin()[8] == 0x80);
+
+  bf.set_all();
+
+  CPPUNIT_ASSERT(bf.is_all_set());
+  CPPUNIT_ASSERT(bf.is_tail_cleared());
+  CPPUNIT_ASSERT(bf.count_range(0, 65) == 65);
+
+  torrent::Bitfield other;
+  other.copy(bf);
+
+  CPPUNIT_ASSERT(other.size_bits() == 65);
+  CPPUNIT_ASSERT(other.size_set() == 65);
+  CPPUNIT_ASSERT(other.count_and(bf) == 65);
+}
+
+void
+test_bitfield::test_update() {
+  std::mt19937 rng(1);
+
+  for (auto size : test_sizes) {
+    torrent::Bitfield bf;
+    bf.set_size_bits(size);
+    bf.allocate();
+
+    fill_random(&bf, rng);
+
+    CPPUNIT_ASSERT(bf.is_tail_cleared());
+    CPPUNIT_ASSERT(bf.size_set() == naive_count(bf, nullptr, false, 0, size));
+  }
+}
+
+void
+test_bitfield::test_set_range() {
+  std::mt19937 rng(2);
+
+  for (auto size : test_sizes) {
+    for (int i = 0; i < 20; i++) {
+      torrent::Bitfield bf;
+      bf.set_size_bits(size);
+      bf.allocate();
+
+      fill_random(&bf, rng);
+
+      uint32_t first = rng() % (size + 1);
+      uint32_t last  = first + rng() % (size - first + 1);
+
+      if (i % 2)
+        bf.set_range(first, last);
+      else
+        bf.unset_range(first, last);
+
+      CPPUNIT_ASSERT(bf.size_set() == naive_count(bf, nullptr, false, 0, size));
+      CPPUNIT_ASSERT(bf.count_range(first, last) == (i % 2 ? last - first : 0));
+      CPPUNIT_ASSERT(bf.is_tail_cleared());
+    }
+  }
+
+  torrent::Bitfield bf;
+  bf.set_size_bits(10);
+  bf.allocate();
+
+  CPPUNIT_ASSERT_THROW(bf.set_range(5, 11), torrent::internal_error);
+  CPPUNIT_ASSERT_THROW(bf.unset_range(6, 5), torrent::internal_error);
+}
+
+void
+test_bitfield::test_count_range() {
+  std::mt19937 rng(3);
+
+  for (auto size : test_sizes) {
+    torrent::Bitfield bf;
+    bf.set_size_bits(size);
+    bf.allocate();
+
+    fill_random(&bf, rng);
+
+    for (uint32_t first = 0; first <= size; first += 1 + first / 4)
+      for (uint32_t last = first; last <= size; last += 1 + last / 3)
+        CPPUNIT_ASSERT(bf.count_range(first, last) == naive_count(bf, nullptr, false, first, last));
+  }
+}
+
+void
+test_bitfield::test_count_and() {
+  std::mt19937 rng(4);
+
+  for (auto size : test_sizes) {
+    torrent::Bitfield a;
+    torrent::Bitfield b;
+
+    a.set_size_bits(size);
+    a.allocate();
+    b.set_size_bits(size);
+    b.allocate();
+
+    fill_random(&a, rng);
+    fill_random(&b, rng);
+
+    CPPUNIT_ASSERT(a.count_and(b) == naive_count(a, &b, false, 0, size));
+    CPPUNIT_ASSERT(a.count_and_not(b) == naive_count(a, &b, true, 0, size));
+
+    for (uint32_t first = 0; first <= size; first += 1 + first / 4) {
+      uint32_t last = first + (size - first) / 2;
+
+      CPPUNIT_ASSERT(a.count_and(b, first, last) == naive_count(a, &b, false, first, last));
+      CPPUNIT_ASSERT(a.count_and_not(b, first, last) == naive_count(a, &b, true, first, last));
+    }
+  }
+
+  torrent::Bitfield a;
+  torrent::Bitfield b;
+
+  a.set_size_bits(10);
+  a.allocate();
+  b.set_size_bits(11);
+  b.allocate();
+
+  CPPUNIT_ASSERT_THROW(a.count_and(b), torrent::internal_error);
+}
+
+void
+test_bitfield::test_find_first() {
+  torrent::Bitfield bf;
+  bf.set_size_bits(130);
+  bf.allocate();
+  bf.unset_all();
+
+  CPPUNIT_ASSERT(bf.find_first_set() == 130);
+  CPPUNIT_ASSERT(bf.find_first_unset() == 0);
+  CPPUNIT_ASSERT(bf.find_first_unset(129) == 129);
+  CPPUNIT_ASSERT(bf.find_first_unset(130) == 130);
+
+  bf.set(3);
+  bf.set(70);
+  bf.set(129);
+
+  CPPUNIT_ASSERT(bf.find_first_set() == 3);
+  CPPUNIT_ASSERT(bf.find_first_set(3) == 3);
+  CPPUNIT_ASSERT(bf.find_first_set(4) == 70);
+  CPPUNIT_ASSERT(bf.find_first_set(71) == 129);
+  CPPUNIT_ASSERT(bf.find_first_set(130) == 130);
+
+  bf.set_all();
+  bf.unset(66);
+
+  CPPUNIT_ASSERT(bf.find_first_unset() == 66);
+  CPPUNIT_ASSERT(bf.find_first_unset(67) == 130);
+}
+
+void
+test_bitfield::test_share_uniform() {
+  torrent::Bitfield seed1, seed2, leech;
+
+  for (auto bf : { &seed1, &seed2, &leech }) {
+    bf->set_size_bits(130);
+    bf->allocate();
+  }
+
+  seed1.set_all();
+  seed2.set_all();
+  leech.unset_all();
+  leech.set(5);
+
+  seed1.share_uniform();
+  seed2.share_uniform();
+  leech.share_uniform();
+
+  CPPUNIT_ASSERT(seed1.is_shared() && seed2.is_shared() && !leech.is_shared());
+  CPPUNIT_ASSERT(static_cast<const torrent::Bitfield&>(seed1).begin() == static_cast<const torrent::Bitfield&>(seed2).begin());
+  CPPUNIT_ASSERT(seed1.is_all_set() && seed1.get(129) && seed1.count_range(0, 130) == 130);
+
+  seed2.set_all();
+  CPPUNIT_ASSERT(seed2.is_shared());
+
+  seed2.unset(7);
+  CPPUNIT_ASSERT(!seed2.is_shared() && !seed2.get(7) && seed2.size_set() == 129);
+  CPPUNIT_ASSERT(seed1.is_shared() && seed1.get(7) && seed1.size_set() == 130);
+
+  torrent::Bitfield copy;
+  copy.copy(seed1);
+  CPPUNIT_ASSERT(copy.is_shared() && copy.is_all_set());
+
+  leech.unset_all();
+  leech.share_uniform();
+  CPPUNIT_ASSERT(leech.is_shared() && leech.is_all_unset() && leech.find_first_set() == 130);
+
+  leech.swap(seed2);
+  CPPUNIT_ASSERT(!leech.is_shared() && seed2.is_shared() && seed2.is_all_unset());
+
+  seed2.set_range(10, 20);
+  CPPUNIT_ASSERT(!seed2.is_shared() && seed2.size_set() == 10);
+
+  seed1.clear();
+  CPPUNIT_ASSERT(!seed1.is_shared() && seed1.empty());
+  CPPUNIT_ASSERT(copy.get(0) && copy.get(129));
+}
+
+void
+test_bitfield::test_runs() {
+  std::mt19937 rng(1);
+
+  for (auto size : test_sizes) {
+    for (int density : { 0, 1, 50, 99, 100 }) {
+      torrent::Bitfield bf, decoded;
+      bf.set_size_bits(size);
+      bf.allocate();
+      bf.unset_all();
+
+      for (uint32_t i = 0; i != size; i++)
+        if (static_cast<int>(rng() % 100) < density)
+          bf.set(i);
+
+      std::string runs = torrent::bitfield_encode_runs(bf);
+
+      decoded.set_size_bits(size);
+      decoded.allocate();
+
+      CPPUNIT_ASSERT(torrent::bitfield_decode_runs(decoded, runs.data(), runs.data() + runs.size()));
+      CPPUNIT_ASSERT(decoded.size_set() == bf.size_set());
+      CPPUNIT_ASSERT(std::equal(bf.begin(), bf.end(), decoded.begin()));
+
+      if (!runs.empty())
+        CPPUNIT_ASSERT(!torrent::bitfield_decode_runs(decoded, runs.data(), runs.data() + runs.size() - 1) || bf.is_all_unset());
+    }
+  }
+
+  torrent::Bitfield bf;
+  bf.set_size_bits(1000);
+  bf.allocate();
+  bf.unset_all();
+  bf.set_range(200, 900);
+
+  std::string runs = torrent::bitfield_encode_runs(bf);
+  CPPUNIT_ASSERT(runs == std::string("\xc8\x01\xbc\x05\x64", 5));
+
+  std::string too_long("\xe8\x07\x01", 3);
+  CPPUNIT_ASSERT(!torrent::bitfield_decode_runs(bf, too_long.data(), too_long.data() + too_long.size()));
+
+  std::string truncated("\xc8", 1);
+  CPPUNIT_ASSERT(!torrent::bitfield_decode_runs(bf, truncated.data(), truncated.data() + truncated.size()));
+}
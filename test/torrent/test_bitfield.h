@@ -0,0 +1,26 @@
+#include "test/helpers/test_fixture.h"
+
+class test_bitfield : public test_fixture {
+  CPPUNIT_TEST_SUITE(test_bitfield);
+
+  CPPUNIT_TEST(test_basic);
+  CPPUNIT_TEST(test_update);
+  CPPUNIT_TEST(test_set_range);
+  CPPUNIT_TEST(test_count_range);
+  CPPUNIT_TEST(test_count_and);
+  CPPUNIT_TEST(test_find_first);
+  CPPUNIT_TEST(test_share_uniform);
+  CPPUNIT_TEST(test_runs);
+
+  CPPUNIT_TEST_SUITE_END();
+
+public:
+  void test_basic();
+  void test_update();
+  void test_set_range();
+  void test_count_range();
+  void test_count_and();
+  void test_find_first();
+  void test_share_uniform();
+  void test_runs();
+};
@@ -0,0 +1,216 @@
+#include "config.h"
+
+#include "test/torrent/test_connection_manager.h"
+
+#include <algorithm>
+#include <string>
+#include <vector>
+#include <arpa/inet.h>
+
+#include "test/helpers/test_main_thread.h"
+#include "net/bind_list.h"
+#include "net/throttle_list.h"
+#include "torrent/connection_manager.h"
+#include "torrent/exceptions.h"
+#include "torrent/throttle.h"
+
+CPPUNIT_TEST_SUITE_REGISTRATION(test_connection_manager);
+
+static sockaddr_in
+make_inet(const char* address) {
+  sockaddr_in sa{};
+  sa.sin_family = AF_INET;
+  inet_pton(AF_INET, address, &sa.sin_addr);
+  return sa;
+}
+
+static std::string
+select_address(torrent::ConnectionManager& cm) {
+  return cm.bind_list()->select()->address.address_str();
+}
+
+void
+test_connection_manager::test_connect_budget() {
+  set_create_poll();
+  auto test_main_thread = TestMainThread::create();
+  test_main_thread->init_thread();
+  test_main_thread->test_set_cached_time(0s);
+
+  torrent::ConnectionManager cm;
+  cm.set_connect_rate(10);
+
+  CPPUNIT_ASSERT(cm.connect_budget() == 10);
+
+  cm.consume_connect_budget(4);
+
+  CPPUNIT_ASSERT(cm.connect_budget() == 6);
+
+  test_main_thread->test_set_cached_time(100ms);
+
+  CPPUNIT_ASSERT(cm.connect_budget() == 7);
+
+  cm.consume_connect_budget(7);
+
+  CPPUNIT_ASSERT(cm.connect_budget() == 0);
+
+  // Bursts are capped at one second's worth.
+  test_main_thread->test_set_cached_time(10s);
+
+  CPPUNIT_ASSERT(cm.connect_budget() == 10);
+}
+
+void
+test_connection_manager::test_connect_unlimited() {
+  set_create_poll();
+  auto test_main_thread = TestMainThread::create();
+  test_main_thread->init_thread();
+  test_main_thread->test_set_cached_time(0s);
+
+  torrent::ConnectionManager cm;
+
+  CPPUNIT_ASSERT(cm.connect_rate() == 0);
+  CPPUNIT_ASSERT(cm.connect_budget() == torrent::ConnectionManager::unlimited_connect_budget);
+
+  cm.consume_connect_budget(1000);
+
+  CPPUNIT_ASSERT(cm.connect_budget() == torrent::ConnectionManager::unlimited_connect_budget);
+}
+
+void
+test_connection_manager::test_request_connect() {
+  set_create_poll();
+  auto test_main_thread = TestMainThread::create();
+  test_main_thread->init_thread();
+  test_main_thread->test_set_cached_time(0s);
+
+  torrent::ConnectionManager cm;
+  cm.set_connect_rate(10);
+
+  uint32_t deficit = 25;
+  std::vector<uint32_t> budgets;
+
+  cm.slot_connect() = [&](uint32_t budget) {
+      budgets.push_back(budget);
+
+      uint32_t attempts = std::min(budget, deficit);
+      deficit -= attempts;
+      return attempts;
+    };
+  cm.slot_connect_deficit() = [&] { return deficit; };
+
+  cm.request_connect();
+  cm.request_connect();
+  test_main_thread->test_process_events_without_cached_time();
+
+  CPPUNIT_ASSERT(budgets == std::vector<uint32_t>({ 10 }));
+  CPPUNIT_ASSERT(deficit == 15);
+
+  // Nothing more until the budget refills.
+  test_main_thread->test_set_cached_time(500ms);
+  test_main_thread->test_process_events_without_cached_time();
+
+  CPPUNIT_ASSERT(budgets.size() == 1);
+
+  test_main_thread->test_set_cached_time(1s);
+  test_main_thread->test_process_events_without_cached_time();
+  test_main_thread->test_set_cached_time(2s);
+  test_main_thread->test_process_events_without_cached_time();
+
+  CPPUNIT_ASSERT(budgets == std::vector<uint32_t>({ 10, 10, 10 }));
+  CPPUNIT_ASSERT(deficit == 0);
+
+  test_main_thread->test_set_cached_time(3s);
+  test_main_thread->test_process_events_without_cached_time();
+
+  CPPUNIT_ASSERT(budgets.size() == 3);
+}
+
+void
+test_connection_manager::test_bind_invalid() {
+  set_create_poll();
+  auto test_main_thread = TestMainThread::create();
+  test_main_thread->init_thread();
+
+  torrent::ConnectionManager cm;
+
+  auto sa_1 = make_inet("10.0.0.1");
+  auto sa_any = make_inet("0.0.0.0");
+
+  sockaddr_in6 sa_inet6{};
+  sa_inet6.sin6_family = AF_INET6;
+
+  CPPUNIT_ASSERT(cm.bind_list()->select() == nullptr);
+
+  CPPUNIT_ASSERT_THROW(cm.add_bind_address(reinterpret_cast<sockaddr*>(&sa_1), 0), torrent::input_error);
+  CPPUNIT_ASSERT_THROW(cm.add_bind_address(reinterpret_cast<sockaddr*>(&sa_any)), torrent::input_error);
+  CPPUNIT_ASSERT_THROW(cm.add_bind_address(reinterpret_cast<sockaddr*>(&sa_inet6)), torrent::input_error);
+
+  cm.add_bind_address(reinterpret_cast<sockaddr*>(&sa_1));
+
+  CPPUNIT_ASSERT_THROW(cm.add_bind_address(reinterpret_cast<sockaddr*>(&sa_1)), torrent::input_error);
+  CPPUNIT_ASSERT_THROW(cm.set_bind_selection(2), torrent::input_error);
+
+  CPPUNIT_ASSERT(cm.bind_address_count() == 1);
+
+  cm.clear_bind_addresses();
+
+  CPPUNIT_ASSERT(cm.bind_address_count() == 0);
+}
+
+void
+test_connection_manager::test_bind_round_robin() {
+  set_create_poll();
+  auto test_main_thread = TestMainThread::create();
+  test_main_thread->init_thread();
+
+  torrent::ConnectionManager cm;
+
+  auto sa_1 = make_inet("10.0.0.1");
+  auto sa_2 = make_inet("10.0.0.2");
+
+  cm.add_bind_address(reinterpret_cast<sockaddr*>(&sa_1), 3);
+  cm.add_bind_address(reinterpret_cast<sockaddr*>(&sa_2), 1);
+
+  CPPUNIT_ASSERT(cm.bind_address_weight(0) == 3);
+  CPPUNIT_ASSERT(cm.bind_list()->find(reinterpret_cast<sockaddr*>(&sa_2)) == &cm.bind_list()->at(1));
+
+  std::vector<std::string> picks;
+
+  for (int i = 0; i < 8; i++)
+    picks.push_back(select_address(cm));
+
+  // The lighter address is picked in between rather than after a run.
+  CPPUNIT_ASSERT(picks == std::vector<std::string>({ "10.0.0.1", "10.0.0.1", "10.0.0.2", "10.0.0.1",
+                                                     "10.0.0.1", "10.0.0.1", "10.0.0.2", "10.0.0.1" }));
+}
+
+void
+test_connection_manager::test_bind_least_loaded() {
+  set_create_poll();
+  auto test_main_thread = TestMainThread::create();
+  test_main_thread->init_thread();
+  test_main_thread->test_set_cached_time(10s);
+
+  torrent::ConnectionManager cm;
+  cm.set_bind_selection(torrent::ConnectionManager::bind_select_least_loaded);
+
+  auto sa_1 = make_inet("10.0.0.1");
+  auto sa_2 = make_inet("10.0.0.2");
+
+  cm.add_bind_address(reinterpret_cast<sockaddr*>(&sa_1), 2);
+  cm.add_bind_address(reinterpret_cast<sockaddr*>(&sa_2), 1);
+
+  // Idle addresses take turns by weight.
+  CPPUNIT_ASSERT(select_address(cm) == "10.0.0.1");
+  CPPUNIT_ASSERT(select_address(cm) == "10.0.0.2");
+
+  cm.bind_upload_throttle(0)->throttle_list()->add_rate(30000);
+
+  CPPUNIT_ASSERT(select_address(cm) == "10.0.0.2");
+  CPPUNIT_ASSERT(select_address(cm) == "10.0.0.2");
+
+  // Per weight the first address now has less traffic.
+  cm.bind_download_throttle(1)->throttle_list()->add_rate(20000);
+
+  CPPUNIT_ASSERT(select_address(cm) == "10.0.0.1");
+}
@@ -0,0 +1,22 @@
+#include "test/helpers/test_fixture.h"
+
+class test_connection_manager : public test_fixture {
+  CPPUNIT_TEST_SUITE(test_connection_manager);
+
+  CPPUNIT_TEST(test_connect_budget);
+  CPPUNIT_TEST(test_connect_unlimited);
+  CPPUNIT_TEST(test_request_connect);
+  CPPUNIT_TEST(test_bind_invalid);
+  CPPUNIT_TEST(test_bind_round_robin);
+  CPPUNIT_TEST(test_bind_least_loaded);
+
+  CPPUNIT_TEST_SUITE_END();
+
+public:
+  void test_connect_budget();
+  void test_connect_unlimited();
+  void test_request_connect();
+  void test_bind_invalid();
+  void test_bind_round_robin();
+  void test_bind_least_loaded();
+};
@@ -0,0 +1,109 @@
+#include "config.h"
+
+#include "test/torrent/test_event_journal.h"
+
+#include "torrent/exceptions.h"
+#include "torrent/download/event_journal.h"
+
+CPPUNIT_TEST_SUITE_REGISTRATION(test_event_journal);
+
+using torrent::EventJournal;
+
+static torrent::HashString
+hash_for(char c) {
+  torrent::HashString hash;
+  std::fill(hash.begin(), hash.end(), c);
+  return hash;
+}
+
+void
+test_event_journal::test_basic() {
+  EventJournal journal(4);
+  std::vector<torrent::EventRecord> records;
+  uint64_t sequence = 0;
+
+  CPPUNIT_ASSERT(journal.empty());
+  CPPUNIT_ASSERT(journal.drain(sequence, records));
+  CPPUNIT_ASSERT(records.empty() && sequence == 0);
+
+  journal.push(EventJournal::event_started, hash_for('a'));
+  journal.push(EventJournal::event_tracker_success, hash_for('b'), 50);
+
+  CPPUNIT_ASSERT(journal.size() == 2);
+  CPPUNIT_ASSERT(journal.tail() == 0 && journal.head() == 2);
+
+  CPPUNIT_ASSERT(journal.drain(sequence, records));
+  CPPUNIT_ASSERT(sequence == 2);
+  CPPUNIT_ASSERT(records.size() == 2);
+  CPPUNIT_ASSERT(records[0].sequence == 0);
+  CPPUNIT_ASSERT(records[0].type == EventJournal::event_started);
+  CPPUNIT_ASSERT(records[0].hash == hash_for('a'));
+  CPPUNIT_ASSERT(records[1].sequence == 1);
+  CPPUNIT_ASSERT(records[1].type == EventJournal::event_tracker_success);
+  CPPUNIT_ASSERT(records[1].value == 50);
+
+  records.clear();
+
+  CPPUNIT_ASSERT(journal.drain(sequence, records));
+  CPPUNIT_ASSERT(records.empty() && sequence == 2);
+
+  journal.push(EventJournal::event_completed, hash_for('a'));
+
+  CPPUNIT_ASSERT(journal.drain(sequence, records));
+  CPPUNIT_ASSERT(records.size() == 1 && records[0].sequence == 2 && sequence == 3);
+}
+
+void
+test_event_journal::test_max_count() {
+  EventJournal journal(8);
+  std::vector<torrent::EventRecord> records;
+  uint64_t sequence = 0;
+
+  for (int i = 0; i < 5; i++)
+    journal.push(EventJournal::event_priority, hash_for('a'), i);
+
+  CPPUNIT_ASSERT(journal.drain(sequence, records, 3));
+  CPPUNIT_ASSERT(records.size() == 3 && sequence == 3);
+
+  CPPUNIT_ASSERT(journal.drain(sequence, records, 3));
+  CPPUNIT_ASSERT(records.size() == 5 && sequence == 5);
+  CPPUNIT_ASSERT(records[4].value == 4);
+}
+
+void
+test_event_journal::test_overrun() {
+  EventJournal journal(4);
+  std::vector<torrent::EventRecord> records;
+  uint64_t sequence = 0;
+
+  for (int i = 0; i < 10; i++)
+    journal.push(EventJournal::event_priority, hash_for('a'), i);
+
+  CPPUNIT_ASSERT(journal.size() == 4);
+  CPPUNIT_ASSERT(journal.tail() == 6 && journal.head() == 10);
+
+  CPPUNIT_ASSERT(!journal.drain(sequence, records));
+  CPPUNIT_ASSERT(sequence == 10);
+  CPPUNIT_ASSERT(records.size() == 4);
+  CPPUNIT_ASSERT(records[0].sequence == 6 && records[0].value == 6);
+  CPPUNIT_ASSERT(records[3].sequence == 9 && records[3].value == 9);
+}
+
+void
+test_event_journal::test_capacity() {
+  CPPUNIT_ASSERT_THROW(EventJournal(0), torrent::input_error);
+
+  EventJournal journal(4);
+  std::vector<torrent::EventRecord> records;
+  uint64_t sequence = 0;
+
+  journal.push(EventJournal::event_added, hash_for('a'));
+  journal.push(EventJournal::event_removed, hash_for('a'));
+  journal.set_capacity(16);
+
+  CPPUNIT_ASSERT(journal.capacity() == 16);
+  CPPUNIT_ASSERT(journal.empty() && journal.head() == 2);
+
+  CPPUNIT_ASSERT(!journal.drain(sequence, records));
+  CPPUNIT_ASSERT(records.empty() && sequence == 2);
+}
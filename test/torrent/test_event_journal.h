@@ -0,0 +1,18 @@
+#include "test/helpers/test_fixture.h"
+
+class test_event_journal : public test_fixture {
+  CPPUNIT_TEST_SUITE(test_event_journal);
+
+  CPPUNIT_TEST(test_basic);
+  CPPUNIT_TEST(test_max_count);
+  CPPUNIT_TEST(test_overrun);
+  CPPUNIT_TEST(test_capacity);
+
+  CPPUNIT_TEST_SUITE_END();
+
+public:
+  void test_basic();
+  void test_max_count();
+  void test_overrun();
+  void test_capacity();
+};
@@ -0,0 +1,72 @@
+#include "config.h"
+
+#include "test/torrent/test_hash_string.h"
+
+#include <cstdlib>
+#include <unordered_map>
+
+#include "torrent/hash_string.h"
+
+CPPUNIT_TEST_SUITE_REGISTRATION(test_hash_string);
+
+using torrent::HashString;
+
+static HashString
+random_hash() {
+  HashString hash;
+
+  for (auto& c : hash)
+    c = random();
+
+  return hash;
+}
+
+void
+test_hash_string::test_compare() {
+  for (int i = 0; i < 1000; i++) {
+    HashString one = random_hash();
+    HashString two = one;
+
+    CPPUNIT_ASSERT(one == two && !(one != two) && !(one < two) && one <= two);
+    CPPUNIT_ASSERT(one.equal_to(two.data()) && !one.not_equal_to(two.data()));
+
+    // Differ in a single byte, including the last 4 byte word.
+    unsigned int index = random() % HashString::size_data;
+    two[index] = static_cast<char>(two[index] + 1 + random() % 255);
+
+    int expected = std::memcmp(one.data(), two.data(), HashString::size_data);
+
+    CPPUNIT_ASSERT(one != two && !(one == two));
+    CPPUNIT_ASSERT(!one.equal_to(two.data()));
+    CPPUNIT_ASSERT((one < two) == (expected < 0));
+    CPPUNIT_ASSERT((one <= two) == (expected < 0));
+    CPPUNIT_ASSERT((two < one) == (expected > 0));
+    CPPUNIT_ASSERT(torrent::hash_string_common_prefix(one, two) < index * 8 + 8);
+    CPPUNIT_ASSERT(torrent::hash_string_common_prefix(one, two) >= index * 8);
+  }
+}
+
+void
+test_hash_string::test_hash() {
+  HashString one = random_hash();
+  HashString two = one;
+
+  CPPUNIT_ASSERT(torrent::hash_string_hash()(one) == torrent::hash_string_hash()(two));
+  CPPUNIT_ASSERT(torrent::hash_string_hash()(&one) == torrent::hash_string_hash()(two));
+
+  // The leading bytes, shared by DHT node IDs close to ours, are not
+  // part of the hash.
+  two[8] = static_cast<char>(two[8] + 1);
+  CPPUNIT_ASSERT(torrent::hash_string_hash()(one) != torrent::hash_string_hash()(two));
+
+  std::unordered_map<HashString, int, torrent::hash_string_hash> map;
+
+  for (int i = 0; i < 1000; i++)
+    map.emplace(random_hash(), i);
+
+  map.emplace(one, -1);
+
+  CPPUNIT_ASSERT(map.size() == 1001);
+  CPPUNIT_ASSERT(map.find(one) != map.end() && map.find(one)->second == -1);
+  CPPUNIT_ASSERT(map.find(two) == map.end());
+}
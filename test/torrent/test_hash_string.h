@@ -0,0 +1,14 @@
+#include "test/helpers/test_fixture.h"
+
+class test_hash_string : public test_fixture {
+  CPPUNIT_TEST_SUITE(test_hash_string);
+
+  CPPUNIT_TEST(test_compare);
+  CPPUNIT_TEST(test_hash);
+
+  CPPUNIT_TEST_SUITE_END();
+
+public:
+  void test_compare();
+  void test_hash();
+};
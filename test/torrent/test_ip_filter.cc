@@ -0,0 +1,178 @@
+#include "config.h"
+
+#include "test/torrent/test_ip_filter.h"
+
+#include <arpa/inet.h>
+#include <random>
+#include <vector>
+
+#include "torrent/exceptions.h"
+#include "torrent/peer/ip_filter.h"
+
+CPPUNIT_TEST_SUITE_REGISTRATION(test_ip_filter);
+
+using torrent::ip_filter;
+using torrent::ip_filter_builder;
+
+void
+test_ip_filter::test_basic() {
+  ip_filter_builder builder;
+
+  CPPUNIT_ASSERT(builder.build()->at_ipv4(0) == 0);
+
+  builder.insert_ipv4(0x0a000000, 0x0affffff, 1);
+  builder.insert_ipv4(0xc0a80100, 0xc0a801ff, 2);
+  builder.insert_ipv4(0xffffffff, 0xffffffff, 4);
+
+  CPPUNIT_ASSERT_THROW(builder.insert_ipv4(2, 1, 1), torrent::input_error);
+
+  auto filter = builder.build();
+
+  CPPUNIT_ASSERT(builder.size() == 0);
+  CPPUNIT_ASSERT(filter->ipv4_ranges().size() == 3);
+
+  CPPUNIT_ASSERT(filter->at_ipv4(0) == 0);
+  CPPUNIT_ASSERT(filter->at_ipv4(0x09ffffff) == 0);
+  CPPUNIT_ASSERT(filter->at_ipv4(0x0a000000) == 1);
+  CPPUNIT_ASSERT(filter->at_ipv4(0x0a123456) == 1);
+  CPPUNIT_ASSERT(filter->at_ipv4(0x0affffff) == 1);
+  CPPUNIT_ASSERT(filter->at_ipv4(0x0b000000) == 0);
+  CPPUNIT_ASSERT(filter->at_ipv4(0xc0a801ff) == 2);
+  CPPUNIT_ASSERT(filter->at_ipv4(0xc0a80200) == 0);
+  CPPUNIT_ASSERT(filter->at_ipv4(0xfffffffe) == 0);
+  CPPUNIT_ASSERT(filter->at_ipv4(0xffffffff) == 4);
+}
+
+void
+test_ip_filter::test_overlap() {
+  ip_filter_builder builder;
+
+  builder.insert_ipv4(100, 200, 1);
+  builder.insert_ipv4(150, 300, 2);
+  builder.insert_ipv4(0, 0xffffffff, 4);
+
+  auto filter = builder.build();
+
+  CPPUNIT_ASSERT(filter->ipv4_ranges().size() == 5);
+
+  CPPUNIT_ASSERT(filter->at_ipv4(0) == 4);
+  CPPUNIT_ASSERT(filter->at_ipv4(99) == 4);
+  CPPUNIT_ASSERT(filter->at_ipv4(100) == 5);
+  CPPUNIT_ASSERT(filter->at_ipv4(149) == 5);
+  CPPUNIT_ASSERT(filter->at_ipv4(150) == 7);
+  CPPUNIT_ASSERT(filter->at_ipv4(200) == 7);
+  CPPUNIT_ASSERT(filter->at_ipv4(201) == 6);
+  CPPUNIT_ASSERT(filter->at_ipv4(300) == 6);
+  CPPUNIT_ASSERT(filter->at_ipv4(301) == 4);
+  CPPUNIT_ASSERT(filter->at_ipv4(0xffffffff) == 4);
+}
+
+void
+test_ip_filter::test_merge() {
+  ip_filter_builder builder;
+
+  builder.insert_ipv4(300, 400, 1);
+  builder.insert_ipv4(100, 199, 1);
+  builder.insert_ipv4(200, 299, 1);
+  builder.insert_ipv4(150, 250, 1);
+  builder.insert_ipv4(402, 500, 1);
+
+  auto filter = builder.build();
+
+  CPPUNIT_ASSERT(filter->ipv4_ranges().size() == 2);
+  CPPUNIT_ASSERT(filter->ipv4_ranges()[0].first == 100);
+  CPPUNIT_ASSERT(filter->ipv4_ranges()[0].last == 400);
+  CPPUNIT_ASSERT(filter->ipv4_ranges()[1].first == 402);
+  CPPUNIT_ASSERT(filter->ipv4_ranges()[1].last == 500);
+}
+
+// Compares lookups against a linear scan of the inserted ranges, with
+// ranges clustered in a few buckets of the index.
+void
+test_ip_filter::test_random() {
+  std::mt19937 rng(1234);
+  std::uniform_int_distribution<uint32_t> base_dist(0, 7);
+  std::uniform_int_distribution<uint32_t> offset_dist(0, 0x3ffff);
+  std::uniform_int_distribution<uint32_t> length_dist(0, 0x2000);
+  std::uniform_int_distribution<int>      value_dist(0, 3);
+
+  std::vector<ip_filter::ipv4_range> ranges;
+  ip_filter_builder builder;
+
+  for (int i = 0; i < 2000; i++) {
+    uint32_t first = (base_dist(rng) << 29) + offset_dist(rng);
+    uint32_t last = first + length_dist(rng);
+    int value = 1 << value_dist(rng);
+
+    ranges.push_back(ip_filter::ipv4_range{first, last, value});
+    builder.insert_ipv4(first, last, value);
+  }
+
+  auto filter = builder.build();
+
+  for (int i = 0; i < 20000; i++) {
+    uint32_t address = (base_dist(rng) << 29) + offset_dist(rng);
+    int expected = 0;
+
+    for (const auto& range : ranges)
+      if (range.first <= address && address <= range.last)
+        expected |= range.value;
+
+    CPPUNIT_ASSERT_EQUAL(expected, filter->at_ipv4(address));
+  }
+}
+
+void
+test_ip_filter::test_inet6() {
+  ip_filter_builder builder;
+
+  builder.insert_ipv6(ip_filter::ipv6_address{0x20010db800000000, 0},
+                      ip_filter::ipv6_address{0x20010db8ffffffff, ~uint64_t()}, 1);
+  builder.insert_ipv6(ip_filter::ipv6_address{0x20010db800000001, ~uint64_t()},
+                      ip_filter::ipv6_address{0x20010db800000002, 0}, 2);
+
+  auto filter = builder.build();
+
+  CPPUNIT_ASSERT(filter->ipv4_ranges().empty());
+  CPPUNIT_ASSERT(filter->ipv6_ranges().size() == 3);
+
+  CPPUNIT_ASSERT(filter->at_ipv6(ip_filter::ipv6_address{0x20010db7ffffffff, ~uint64_t()}) == 0);
+  CPPUNIT_ASSERT(filter->at_ipv6(ip_filter::ipv6_address{0x20010db800000000, 0}) == 1);
+  CPPUNIT_ASSERT(filter->at_ipv6(ip_filter::ipv6_address{0x20010db800000001, ~uint64_t() - 1}) == 1);
+  CPPUNIT_ASSERT(filter->at_ipv6(ip_filter::ipv6_address{0x20010db800000001, ~uint64_t()}) == 3);
+  CPPUNIT_ASSERT(filter->at_ipv6(ip_filter::ipv6_address{0x20010db800000002, 0}) == 3);
+  CPPUNIT_ASSERT(filter->at_ipv6(ip_filter::ipv6_address{0x20010db800000002, 1}) == 1);
+  CPPUNIT_ASSERT(filter->at_ipv6(ip_filter::ipv6_address{0x20010db900000000, 0}) == 0);
+}
+
+void
+test_ip_filter::test_sockaddr() {
+  ip_filter_builder builder;
+
+  builder.insert_ipv4(0xc0a80100, 0xc0a801ff, 1);
+  builder.insert_ipv6(ip_filter::ipv6_address{0x20010db800000000, 0},
+                      ip_filter::ipv6_address{0x20010db800000000, ~uint64_t()}, 2);
+
+  auto filter = builder.build();
+
+  sockaddr_in sin{};
+  sin.sin_family = AF_INET;
+  inet_pton(AF_INET, "192.168.1.20", &sin.sin_addr);
+
+  CPPUNIT_ASSERT(filter->at(reinterpret_cast<sockaddr*>(&sin)) == 1);
+
+  inet_pton(AF_INET, "192.168.2.20", &sin.sin_addr);
+  CPPUNIT_ASSERT(filter->at(reinterpret_cast<sockaddr*>(&sin)) == 0);
+
+  sockaddr_in6 sin6{};
+  sin6.sin6_family = AF_INET6;
+  inet_pton(AF_INET6, "::ffff:192.168.1.20", &sin6.sin6_addr);
+
+  CPPUNIT_ASSERT(filter->at(reinterpret_cast<sockaddr*>(&sin6)) == 1);
+
+  inet_pton(AF_INET6, "2001:db8::1", &sin6.sin6_addr);
+  CPPUNIT_ASSERT(filter->at(reinterpret_cast<sockaddr*>(&sin6)) == 2);
+
+  inet_pton(AF_INET6, "2001:db8:0:1::1", &sin6.sin6_addr);
+  CPPUNIT_ASSERT(filter->at(reinterpret_cast<sockaddr*>(&sin6)) == 0);
+}
@@ -0,0 +1,22 @@
+#include "test/helpers/test_fixture.h"
+
+class test_ip_filter : public test_fixture {
+  CPPUNIT_TEST_SUITE(test_ip_filter);
+
+  CPPUNIT_TEST(test_basic);
+  CPPUNIT_TEST(test_overlap);
+  CPPUNIT_TEST(test_merge);
+  CPPUNIT_TEST(test_random);
+  CPPUNIT_TEST(test_inet6);
+  CPPUNIT_TEST(test_sockaddr);
+
+  CPPUNIT_TEST_SUITE_END();
+
+public:
+  void test_basic();
+  void test_overlap();
+  void test_merge();
+  void test_random();
+  void test_inet6();
+  void test_sockaddr();
+};
@@ -0,0 +1,69 @@
+#include "config.h"
+
+#include "test/torrent/test_memory_manager.h"
+
+#include <map>
+#include <vector>
+
+#include "torrent/exceptions.h"
+#include "torrent/memory_manager.h"
+
+CPPUNIT_TEST_SUITE_REGISTRATION(test_memory_manager);
+
+using torrent::MemoryManager;
+
+void
+test_memory_manager::test_allocator() {
+  auto usage_before = MemoryManager::usage(MemoryManager::category_log);
+  auto total_before = MemoryManager::usage_total();
+
+  {
+    std::vector<uint64_t, torrent::memory_counting_allocator<uint64_t, MemoryManager::category_log>> values;
+    values.reserve(100);
+
+    CPPUNIT_ASSERT(MemoryManager::usage(MemoryManager::category_log) == usage_before + 100 * sizeof(uint64_t));
+    CPPUNIT_ASSERT(MemoryManager::usage_total() == total_before + 100 * sizeof(uint64_t));
+
+    // Rebinding to node types counts in the same category.
+    std::map<int, int, std::less<int>, torrent::memory_counting_allocator<std::pair<const int, int>, MemoryManager::category_log>> map;
+    map[1] = 1;
+
+    CPPUNIT_ASSERT(MemoryManager::usage(MemoryManager::category_log) > usage_before + 100 * sizeof(uint64_t));
+  }
+
+  CPPUNIT_ASSERT(MemoryManager::usage(MemoryManager::category_log) == usage_before);
+}
+
+void
+test_memory_manager::test_budget() {
+  MemoryManager manager;
+
+  std::vector<std::pair<MemoryManager::category_type, uint64_t>> shed;
+  manager.add_shed_slot([&shed](auto category, auto excess) { shed.emplace_back(category, excess); });
+
+  MemoryManager::inc_usage(MemoryManager::category_dht, 1000);
+  auto usage = MemoryManager::usage(MemoryManager::category_dht);
+
+  manager.check_budgets();
+  CPPUNIT_ASSERT(shed.empty());
+
+  manager.set_budget(MemoryManager::category_dht, usage);
+  manager.check_budgets();
+  CPPUNIT_ASSERT(shed.empty());
+
+  manager.set_budget(MemoryManager::category_dht, usage - 100);
+  manager.check_budgets();
+
+  CPPUNIT_ASSERT(shed.size() == 1);
+  CPPUNIT_ASSERT(shed[0].first == MemoryManager::category_dht && shed[0].second == 100);
+  CPPUNIT_ASSERT(manager.stats_shed(MemoryManager::category_dht) == 1);
+  CPPUNIT_ASSERT(manager.stats_shed(MemoryManager::category_log) == 0);
+
+  MemoryManager::dec_usage(MemoryManager::category_dht, 1000);
+
+  manager.check_budgets();
+  CPPUNIT_ASSERT(shed.size() == 1);
+
+  CPPUNIT_ASSERT_THROW(manager.set_budget(MemoryManager::category_size, 1), torrent::input_error);
+  CPPUNIT_ASSERT(std::string(MemoryManager::category_name(MemoryManager::category_available_list)) == "available_list");
+}
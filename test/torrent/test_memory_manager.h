@@ -0,0 +1,14 @@
+#include "test/helpers/test_fixture.h"
+
+class test_memory_manager : public test_fixture {
+  CPPUNIT_TEST_SUITE(test_memory_manager);
+
+  CPPUNIT_TEST(test_allocator);
+  CPPUNIT_TEST(test_budget);
+
+  CPPUNIT_TEST_SUITE_END();
+
+public:
+  void test_allocator();
+  void test_budget();
+};
@@ -0,0 +1,117 @@
+#include "config.h"
+
+#include "test/torrent/test_peer_capture.h"
+
+#include <cstdio>
+#include <cstring>
+#include <unistd.h>
+
+#include "torrent/exceptions.h"
+#include "torrent/peer/peer_capture.h"
+
+CPPUNIT_TEST_SUITE_REGISTRATION(test_peer_capture);
+
+using torrent::PeerCapture;
+using torrent::PeerCaptureReader;
+
+static std::string
+capture_path() {
+  return "/tmp/test_peer_capture." + std::to_string(::getpid());
+}
+
+static PeerCapture::header_type
+make_header(uint32_t size_bits) {
+  PeerCapture::header_type header{};
+  header.magic     = PeerCapture::magic;
+  header.version   = PeerCapture::version;
+  header.flags     = PeerCapture::flag_fast;
+  header.size_bits = size_bits;
+
+  std::memset(header.info_hash, 'a', sizeof(header.info_hash));
+  std::memset(header.peer_id, 'b', sizeof(header.peer_id));
+  return header;
+}
+
+void
+test_peer_capture::test_round_trip() {
+  auto path = capture_path();
+
+  {
+    PeerCapture capture;
+    capture.open(path, make_header(12), "\xff\xf0", 2);
+
+    CPPUNIT_ASSERT(capture.is_open());
+
+    capture.write(1000, "\x00\x00\x00\x01\x02", 5);
+    capture.write(1500, "", 0);
+    capture.write(3500, "\x00\x00\x00\x00", 4);
+  }
+
+  PeerCaptureReader reader;
+  reader.open(path);
+
+  CPPUNIT_ASSERT(reader.header().flags == PeerCapture::flag_fast);
+  CPPUNIT_ASSERT(reader.header().size_bits == 12);
+  CPPUNIT_ASSERT(std::string(reader.header().info_hash, 20) == std::string(20, 'a'));
+  CPPUNIT_ASSERT(std::string(reader.header().peer_id, 20) == std::string(20, 'b'));
+  CPPUNIT_ASSERT(reader.bitfield() == "\xff\xf0");
+
+  uint64_t    time;
+  std::string data;
+
+  CPPUNIT_ASSERT(reader.read(&time, &data));
+  CPPUNIT_ASSERT(time == 0 && data == std::string("\x00\x00\x00\x01\x02", 5));
+
+  CPPUNIT_ASSERT(reader.read(&time, &data));
+  CPPUNIT_ASSERT(time == 2500 && data == std::string(4, '\0'));
+
+  CPPUNIT_ASSERT(!reader.read(&time, &data));
+
+  std::remove(path.c_str());
+}
+
+void
+test_peer_capture::test_truncated() {
+  auto path = capture_path();
+
+  {
+    PeerCapture capture;
+    capture.open(path, make_header(0), nullptr, 0);
+    capture.write(0, "abcd", 4);
+    capture.write(10, "efgh", 4);
+  }
+
+  CPPUNIT_ASSERT(::truncate(path.c_str(), sizeof(PeerCapture::header_type) + 2 * sizeof(PeerCapture::record_header) + 6) == 0);
+
+  PeerCaptureReader reader;
+  reader.open(path);
+
+  uint64_t    time;
+  std::string data;
+
+  CPPUNIT_ASSERT(reader.bitfield().empty());
+  CPPUNIT_ASSERT(reader.read(&time, &data) && data == "abcd");
+  CPPUNIT_ASSERT(!reader.read(&time, &data));
+
+  std::remove(path.c_str());
+}
+
+void
+test_peer_capture::test_invalid() {
+  auto path = capture_path();
+
+  PeerCaptureReader reader;
+  CPPUNIT_ASSERT_THROW(reader.open(path), torrent::input_error);
+
+  std::FILE* file = std::fopen(path.c_str(), "wb");
+  std::fputs("not a peer capture, but long enough to hold the whole header", file);
+  std::fclose(file);
+
+  CPPUNIT_ASSERT_THROW(reader.open(path), torrent::input_error);
+
+  PeerCapture capture;
+  CPPUNIT_ASSERT_THROW(capture.open("/nonexistent/capture", make_header(0), nullptr, 0), torrent::storage_error);
+  CPPUNIT_ASSERT(!capture.is_open());
+
+  std::remove(path.c_str());
+}
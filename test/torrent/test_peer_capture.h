@@ -0,0 +1,16 @@
+#include "test/helpers/test_fixture.h"
+
+class test_peer_capture : public test_fixture {
+  CPPUNIT_TEST_SUITE(test_peer_capture);
+
+  CPPUNIT_TEST(test_round_trip);
+  CPPUNIT_TEST(test_truncated);
+  CPPUNIT_TEST(test_invalid);
+
+  CPPUNIT_TEST_SUITE_END();
+
+public:
+  void test_round_trip();
+  void test_truncated();
+  void test_invalid();
+};
@@ -0,0 +1,155 @@
+#include "config.h"
+
+#include "test/torrent/test_peer_list_index.h"
+
+#include <arpa/inet.h>
+#include <random>
+#include <vector>
+
+#include "torrent/exceptions.h"
+#include "torrent/peer/peer_list_index.h"
+
+CPPUNIT_TEST_SUITE_REGISTRATION(test_peer_list_index);
+
+using torrent::PeerListIndex;
+using torrent::socket_address_key;
+
+static socket_address_key
+make_key(uint32_t address) {
+  sockaddr_in sa{};
+  sa.sin_family = AF_INET;
+  sa.sin_addr.s_addr = htonl(address);
+
+  return socket_address_key::from_sin_addr(sa);
+}
+
+// The index only stores the pointers, so fake ones are enough.
+static torrent::PeerInfo*
+make_peer(uintptr_t i) {
+  return reinterpret_cast<torrent::PeerInfo*>(i * 16 + 16);
+}
+
+void
+test_peer_list_index::test_basic() {
+  PeerListIndex index;
+
+  CPPUNIT_ASSERT(index.empty());
+  CPPUNIT_ASSERT(index.find(make_key(1)) == NULL);
+
+  index.insert(make_key(1), make_peer(1));
+
+  CPPUNIT_ASSERT(index.size() == 1);
+  CPPUNIT_ASSERT(index.capacity() == PeerListIndex::min_capacity);
+  CPPUNIT_ASSERT(index.find(make_key(1)) != NULL);
+  CPPUNIT_ASSERT(index.find(make_key(1))->first == make_peer(1));
+  CPPUNIT_ASSERT(index.find(make_key(1))->count == 1);
+  CPPUNIT_ASSERT(index.find(make_key(2)) == NULL);
+
+  index.erase(make_key(1), make_peer(1), NULL);
+
+  CPPUNIT_ASSERT(index.empty());
+  CPPUNIT_ASSERT(index.find(make_key(1)) == NULL);
+
+  CPPUNIT_ASSERT_THROW(index.erase(make_key(1), make_peer(1), NULL), torrent::internal_error);
+}
+
+void
+test_peer_list_index::test_multiple_ports() {
+  PeerListIndex index;
+
+  index.insert(make_key(1), make_peer(1));
+  index.insert(make_key(1), make_peer(2));
+  index.insert(make_key(1), make_peer(3));
+
+  CPPUNIT_ASSERT(index.size() == 1);
+  CPPUNIT_ASSERT(index.find(make_key(1))->count == 3);
+  CPPUNIT_ASSERT(index.find(make_key(1))->first == make_peer(1));
+
+  // Erasing a later one keeps the first.
+  index.erase(make_key(1), make_peer(3), NULL);
+
+  CPPUNIT_ASSERT(index.find(make_key(1))->count == 2);
+  CPPUNIT_ASSERT(index.find(make_key(1))->first == make_peer(1));
+
+  CPPUNIT_ASSERT_THROW(index.erase(make_key(1), make_peer(1), NULL), torrent::internal_error);
+
+  index.insert(make_key(1), make_peer(1));
+  index.erase(make_key(1), make_peer(1), make_peer(2));
+
+  CPPUNIT_ASSERT(index.find(make_key(1))->count == 2);
+  CPPUNIT_ASSERT(index.find(make_key(1))->first == make_peer(2));
+}
+
+void
+test_peer_list_index::test_grow() {
+  PeerListIndex index;
+
+  for (uint32_t i = 0; i < 10000; i++)
+    index.insert(make_key(i * 7919), make_peer(i));
+
+  CPPUNIT_ASSERT(index.size() == 10000);
+  CPPUNIT_ASSERT(index.capacity() * 3 >= index.size() * 4);
+
+  for (uint32_t i = 0; i < 10000; i++) {
+    auto entry = index.find(make_key(i * 7919));
+
+    CPPUNIT_ASSERT(entry != NULL && entry->first == make_peer(i) && entry->count == 1);
+  }
+
+  CPPUNIT_ASSERT(index.find(make_key(1)) == NULL);
+
+  index.clear();
+
+  CPPUNIT_ASSERT(index.empty());
+  CPPUNIT_ASSERT(index.find(make_key(0)) == NULL);
+}
+
+void
+test_peer_list_index::test_erase_probe() {
+  PeerListIndex index;
+  std::mt19937 rng(1);
+
+  std::vector<uint32_t> keys;
+
+  for (uint32_t i = 0; i < 2000; i++) {
+    keys.push_back(rng());
+    index.insert(make_key(keys.back()), make_peer(i));
+  }
+
+  // Erase every other key and make sure entries beyond the holes are
+  // still found.
+  for (uint32_t i = 0; i < keys.size(); i += 2)
+    index.erase(make_key(keys[i]), make_peer(i), NULL);
+
+  CPPUNIT_ASSERT(index.size() == 1000);
+
+  for (uint32_t i = 0; i < keys.size(); i++) {
+    auto entry = index.find(make_key(keys[i]));
+
+    if (i % 2 == 0)
+      CPPUNIT_ASSERT(entry == NULL);
+    else
+      CPPUNIT_ASSERT(entry != NULL && entry->first == make_peer(i));
+  }
+}
+
+void
+test_peer_list_index::test_inet6() {
+  PeerListIndex index;
+
+  sockaddr_in6 sa6{};
+  sa6.sin6_family = AF_INET6;
+  inet_pton(AF_INET6, "2001:db8::1", &sa6.sin6_addr);
+
+  auto key6 = socket_address_key::from_sin6_addr(sa6);
+
+  index.insert(key6, make_peer(1));
+  index.insert(make_key(1), make_peer(2));
+
+  CPPUNIT_ASSERT(index.find(key6)->first == make_peer(1));
+  CPPUNIT_ASSERT(index.find(make_key(1))->first == make_peer(2));
+
+  inet_pton(AF_INET6, "2001:db8::2", &sa6.sin6_addr);
+
+  CPPUNIT_ASSERT(index.find(socket_address_key::from_sin6_addr(sa6)) == NULL);
+}
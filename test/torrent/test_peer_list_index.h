@@ -0,0 +1,20 @@
+#include "test/helpers/test_fixture.h"
+
+class test_peer_list_index : public test_fixture {
+  CPPUNIT_TEST_SUITE(test_peer_list_index);
+
+  CPPUNIT_TEST(test_basic);
+  CPPUNIT_TEST(test_multiple_ports);
+  CPPUNIT_TEST(test_grow);
+  CPPUNIT_TEST(test_erase_probe);
+  CPPUNIT_TEST(test_inet6);
+
+  CPPUNIT_TEST_SUITE_END();
+
+public:
+  void test_basic();
+  void test_multiple_ports();
+  void test_grow();
+  void test_erase_probe();
+  void test_inet6();
+};
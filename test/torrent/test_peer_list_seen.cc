@@ -0,0 +1,101 @@
+#include "config.h"
+
+#include "test/torrent/test_peer_list_seen.h"
+
+#include <arpa/inet.h>
+#include <cstring>
+
+#include "torrent/peer/peer_list_seen.h"
+
+CPPUNIT_TEST_SUITE_REGISTRATION(test_peer_list_seen);
+
+using torrent::PeerListSeen;
+
+static sockaddr_in
+make_sin(uint32_t address, uint16_t port) {
+  sockaddr_in sa{};
+  sa.sin_family = AF_INET;
+  sa.sin_addr.s_addr = htonl(address);
+  sa.sin_port = htons(port);
+
+  return sa;
+}
+
+static sockaddr_in6
+make_sin6(uint8_t last, uint16_t port) {
+  sockaddr_in6 sa{};
+  sa.sin6_family = AF_INET6;
+  sa.sin6_addr.s6_addr[0] = 0x20;
+  sa.sin6_addr.s6_addr[1] = 0x01;
+  sa.sin6_addr.s6_addr[15] = last;
+  sa.sin6_port = htons(port);
+
+  return sa;
+}
+
+static const sockaddr*
+as_sa(const void* sa) {
+  return static_cast<const sockaddr*>(sa);
+}
+
+void
+test_peer_list_seen::test_basic() {
+  PeerListSeen seen;
+
+  auto sa_1 = make_sin(0x0a000001, 6881);
+  auto sa_2 = make_sin(0x0a000001, 6882);
+  auto sa_3 = make_sin(0x0a000002, 6881);
+
+  CPPUNIT_ASSERT(seen.insert(as_sa(&sa_1), std::chrono::seconds(1)));
+  CPPUNIT_ASSERT(!seen.insert(as_sa(&sa_1), std::chrono::seconds(1)));
+  CPPUNIT_ASSERT(seen.insert(as_sa(&sa_2), std::chrono::seconds(1)));
+  CPPUNIT_ASSERT(seen.insert(as_sa(&sa_3), std::chrono::seconds(1)));
+  CPPUNIT_ASSERT(seen.size() == 3);
+
+  seen.clear();
+
+  CPPUNIT_ASSERT(seen.size() == 0);
+  CPPUNIT_ASSERT(seen.insert(as_sa(&sa_1), std::chrono::seconds(1)));
+}
+
+void
+test_peer_list_seen::test_window() {
+  PeerListSeen seen;
+
+  auto sa_1 = make_sin(0x0a000001, 6881);
+  auto sa_2 = make_sin(0x0a000002, 6881);
+
+  auto start = std::chrono::seconds(1000);
+
+  CPPUNIT_ASSERT(seen.insert(as_sa(&sa_1), start));
+
+  // Still remembered in the previous generation.
+  CPPUNIT_ASSERT(seen.insert(as_sa(&sa_2), start + PeerListSeen::window));
+  CPPUNIT_ASSERT(!seen.insert(as_sa(&sa_1), start + PeerListSeen::window));
+
+  CPPUNIT_ASSERT(seen.insert(as_sa(&sa_1), start + 2 * PeerListSeen::window));
+  CPPUNIT_ASSERT(!seen.insert(as_sa(&sa_2), start + 2 * PeerListSeen::window));
+
+  // Both generations are dropped after a long pause.
+  CPPUNIT_ASSERT(seen.insert(as_sa(&sa_1), start + 10 * PeerListSeen::window));
+  CPPUNIT_ASSERT(seen.insert(as_sa(&sa_2), start + 10 * PeerListSeen::window));
+  CPPUNIT_ASSERT(seen.size() == 2);
+}
+
+void
+test_peer_list_seen::test_inet6() {
+  PeerListSeen seen;
+
+  auto sa_1 = make_sin6(1, 6881);
+  auto sa_2 = make_sin6(1, 6882);
+  auto sa_3 = make_sin6(2, 6881);
+  auto sa_4 = make_sin(0xffffffff, 0xffff);
+
+  CPPUNIT_ASSERT(seen.insert(as_sa(&sa_1), std::chrono::seconds(1)));
+  CPPUNIT_ASSERT(!seen.insert(as_sa(&sa_1), std::chrono::seconds(1)));
+  CPPUNIT_ASSERT(seen.insert(as_sa(&sa_2), std::chrono::seconds(1)));
+  CPPUNIT_ASSERT(seen.insert(as_sa(&sa_3), std::chrono::seconds(1)));
+
+  CPPUNIT_ASSERT(PeerListSeen::key(as_sa(&sa_1)) >> 63);
+  CPPUNIT_ASSERT(!(PeerListSeen::key(as_sa(&sa_4)) >> 63));
+}
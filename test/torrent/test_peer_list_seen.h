@@ -0,0 +1,16 @@
+#include "test/helpers/test_fixture.h"
+
+class test_peer_list_seen : public test_fixture {
+  CPPUNIT_TEST_SUITE(test_peer_list_seen);
+
+  CPPUNIT_TEST(test_basic);
+  CPPUNIT_TEST(test_window);
+  CPPUNIT_TEST(test_inet6);
+
+  CPPUNIT_TEST_SUITE_END();
+
+public:
+  void test_basic();
+  void test_window();
+  void test_inet6();
+};
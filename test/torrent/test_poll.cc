@@ -0,0 +1,178 @@
+#include "config.h"
+
+#include "test/torrent/test_poll.h"
+
+#include <fcntl.h>
+#include <string>
+#include <unistd.h>
+#include <sys/socket.h>
+
+#include "test/helpers/test_main_thread.h"
+#include "torrent/event.h"
+#include "torrent/poll.h"
+
+CPPUNIT_TEST_SUITE_REGISTRATION(test_poll);
+
+namespace {
+
+class test_event : public torrent::Event {
+public:
+  test_event(int fd) { set_file_descriptor(fd); }
+  ~test_event() override { ::close(m_fileDesc); }
+
+  void event_read() override  { reads++; }
+  void event_write() override { writes++; }
+  void event_error() override {}
+
+  unsigned int reads{};
+  unsigned int writes{};
+};
+
+struct event_pair {
+  event_pair() {
+    int fds[2];
+    CPPUNIT_ASSERT(::socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == 0);
+    CPPUNIT_ASSERT(::fcntl(fds[0], F_SETFL, O_NONBLOCK) == 0);
+
+    local = std::make_unique<test_event>(fds[0]);
+    remote = fds[1];
+  }
+
+  ~event_pair() { ::close(remote); }
+
+  std::unique_ptr<test_event> local;
+  int                         remote;
+};
+
+void
+check_level_triggered(torrent::Poll* poll) {
+  event_pair pair;
+
+  poll->open(pair.local.get());
+  poll->insert_read(pair.local.get());
+
+  poll->do_poll(0);
+  CPPUNIT_ASSERT(pair.local->reads == 0);
+
+  CPPUNIT_ASSERT(::write(pair.remote, "data", 4) == 4);
+
+  poll->do_poll(0);
+  poll->do_poll(0);
+  CPPUNIT_ASSERT(pair.local->reads == 2);
+
+  poll->remove_read(pair.local.get());
+  poll->close(pair.local.get());
+}
+
+}
+
+#define SETUP_POLL()                                    \
+  set_create_poll();                                    \
+  auto test_main_thread = TestMainThread::create();     \
+  test_main_thread->init_thread();                      \
+  auto poll = test_main_thread->poll();                 \
+  event_pair pair;
+
+void
+test_poll::test_level_triggered() {
+  set_create_poll();
+  auto test_main_thread = TestMainThread::create();
+  test_main_thread->init_thread();
+
+  check_level_triggered(test_main_thread->poll());
+}
+
+// Falls back to the default backend if io_uring is not built in or
+// the kernel does not support it.
+void
+test_poll::test_io_uring() {
+  torrent::Poll::slot_create_poll() = [] { return torrent::Poll::create_io_uring(256); };
+
+  auto test_main_thread = TestMainThread::create();
+  test_main_thread->init_thread();
+
+  auto poll = test_main_thread->poll();
+  CPPUNIT_ASSERT(poll != nullptr);
+
+#ifndef USE_IO_URING
+  CPPUNIT_ASSERT(std::string(poll->backend_name()) != "io_uring");
+#endif
+
+  check_level_triggered(poll);
+}
+
+// Unread data is only reported once, and adding interest reports the
+// fd as ready so an edge filtered out meanwhile is not lost.
+void
+test_poll::test_edge_triggered() {
+#ifdef USE_EPOLL
+  SETUP_POLL();
+
+  // Keeps the fd registered in the kernel while read and write are
+  // removed, as peer connections do.
+  poll->open_edge_triggered(pair.local.get());
+  poll->insert_error(pair.local.get());
+  poll->insert_read(pair.local.get());
+
+  poll->do_poll(0);
+  CPPUNIT_ASSERT(pair.local->reads == 1);
+
+  poll->do_poll(0);
+  CPPUNIT_ASSERT(pair.local->reads == 1);
+
+  CPPUNIT_ASSERT(::write(pair.remote, "data", 4) == 4);
+
+  poll->do_poll(0);
+  poll->do_poll(0);
+  CPPUNIT_ASSERT(pair.local->reads == 2);
+
+  poll->remove_read(pair.local.get());
+  CPPUNIT_ASSERT(::write(pair.remote, "data", 4) == 4);
+
+  poll->do_poll(0);
+  CPPUNIT_ASSERT(pair.local->reads == 2);
+
+  poll->insert_read(pair.local.get());
+  poll->do_poll(0);
+  CPPUNIT_ASSERT(pair.local->reads == 3);
+
+  poll->insert_write(pair.local.get());
+  poll->do_poll(0);
+  poll->do_poll(0);
+  CPPUNIT_ASSERT(pair.local->reads == 3);
+  CPPUNIT_ASSERT(pair.local->writes == 1);
+
+  poll->remove_read(pair.local.get());
+  poll->remove_write(pair.local.get());
+  poll->remove_error(pair.local.get());
+  poll->close(pair.local.get());
+#endif
+}
+
+void
+test_poll::test_edge_triggered_close() {
+#ifdef USE_EPOLL
+  SETUP_POLL();
+
+  poll->open_edge_triggered(pair.local.get());
+  poll->insert_read(pair.local.get());
+  poll->remove_read(pair.local.get());
+  poll->close(pair.local.get());
+
+  CPPUNIT_ASSERT(::write(pair.remote, "data", 4) == 4);
+
+  poll->do_poll(0);
+  CPPUNIT_ASSERT(pair.local->reads == 0);
+
+  // Reopening the fd level-triggered clears the edge flag.
+  poll->open(pair.local.get());
+  poll->insert_read(pair.local.get());
+
+  poll->do_poll(0);
+  poll->do_poll(0);
+  CPPUNIT_ASSERT(pair.local->reads == 2);
+
+  poll->remove_read(pair.local.get());
+  poll->close(pair.local.get());
+#endif
+}
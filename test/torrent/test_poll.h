@@ -0,0 +1,18 @@
+#include "test/helpers/test_fixture.h"
+
+class test_poll : public test_fixture {
+  CPPUNIT_TEST_SUITE(test_poll);
+
+  CPPUNIT_TEST(test_level_triggered);
+  CPPUNIT_TEST(test_edge_triggered);
+  CPPUNIT_TEST(test_edge_triggered_close);
+  CPPUNIT_TEST(test_io_uring);
+
+  CPPUNIT_TEST_SUITE_END();
+
+public:
+  void test_level_triggered();
+  void test_edge_triggered();
+  void test_edge_triggered_close();
+  void test_io_uring();
+};
@@ -0,0 +1,112 @@
+#include "config.h"
+
+#include "test/torrent/test_rate.h"
+
+#include "globals.h"
+#include "torrent/exceptions.h"
+#include "torrent/rate.h"
+
+CPPUNIT_TEST_SUITE_REGISTRATION(test_rate);
+
+static void
+set_time(int32_t seconds) {
+  torrent::cachedTime = rak::timer::from_seconds(seconds);
+}
+
+void
+test_rate::tearDown() {
+  torrent::cachedTime = rak::timer::current();
+  test_fixture::tearDown();
+}
+
+void
+test_rate::test_basic() {
+  set_time(1000);
+
+  torrent::Rate rate(10);
+
+  CPPUNIT_ASSERT(rate.span() == 10);
+  CPPUNIT_ASSERT(rate.bucket_width() == 1);
+  CPPUNIT_ASSERT(rate.rate() == 0);
+
+  rate.insert(500);
+  rate.insert(500);
+
+  CPPUNIT_ASSERT(rate.rate() == 100);
+  CPPUNIT_ASSERT(rate.total() == 1000);
+
+  CPPUNIT_ASSERT_THROW(rate.insert(torrent::Rate::rate_type{1} << 29), torrent::internal_error);
+  CPPUNIT_ASSERT_THROW(rate.set_span(0), torrent::internal_error);
+}
+
+void
+test_rate::test_window() {
+  set_time(1000);
+
+  torrent::Rate rate(10);
+  rate.insert(1000);
+
+  set_time(1005);
+  rate.insert(2000);
+
+  CPPUNIT_ASSERT(rate.rate() == 300);
+
+  // Entries exactly 'span' seconds old are still counted.
+  set_time(1010);
+  CPPUNIT_ASSERT(rate.rate() == 300);
+
+  set_time(1011);
+  CPPUNIT_ASSERT(rate.rate() == 200);
+
+  set_time(1016);
+  CPPUNIT_ASSERT(rate.rate() == 0);
+  CPPUNIT_ASSERT(rate.total() == 3000);
+
+  // Far ahead, and back in time.
+  rate.insert(1000);
+  set_time(5000);
+  CPPUNIT_ASSERT(rate.rate() == 0);
+
+  rate.insert(1000);
+  set_time(4000);
+  CPPUNIT_ASSERT(rate.rate() == 0);
+}
+
+void
+test_rate::test_long_span() {
+  set_time(6000);
+
+  torrent::Rate rate(600);
+
+  CPPUNIT_ASSERT(rate.bucket_width() == 10);
+
+  for (int32_t i = 0; i < 600; i++) {
+    set_time(6000 + i);
+    rate.insert(600);
+  }
+
+  CPPUNIT_ASSERT(rate.rate() == 600);
+
+  // Buckets leave the window 'bucket_width' seconds at a time.
+  set_time(6000 + 610);
+  CPPUNIT_ASSERT(rate.rate() == 590);
+
+  set_time(6000 + 1210);
+  CPPUNIT_ASSERT(rate.rate() == 0);
+}
+
+void
+test_rate::test_reset() {
+  set_time(1000);
+
+  torrent::Rate rate(10);
+  rate.insert(1000);
+
+  rate.reset_rate();
+  CPPUNIT_ASSERT(rate.rate() == 0);
+  CPPUNIT_ASSERT(rate.total() == 1000);
+
+  rate.insert(1000);
+  rate.set_span(20);
+  CPPUNIT_ASSERT(rate.rate() == 0);
+}
@@ -0,0 +1,20 @@
+#include "test/helpers/test_fixture.h"
+
+class test_rate : public test_fixture {
+  CPPUNIT_TEST_SUITE(test_rate);
+
+  CPPUNIT_TEST(test_basic);
+  CPPUNIT_TEST(test_window);
+  CPPUNIT_TEST(test_long_span);
+  CPPUNIT_TEST(test_reset);
+
+  CPPUNIT_TEST_SUITE_END();
+
+public:
+  void tearDown();
+
+  void test_basic();
+  void test_window();
+  void test_long_span();
+  void test_reset();
+};
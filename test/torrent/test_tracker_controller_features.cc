@@ -362,3 +362,27 @@ test_tracker_controller_features::test_groups_scrape() {
 
   TEST_MULTIPLE_END(0, 0);
 }
+
+void
+test_tracker_controller_features::test_groups_race() {
+  TEST_GROUP_BEGIN();
+
+  tracker_list.set_race_size(2);
+  tracker_controller.send_start_event();
+
+  CPPUNIT_ASSERT(TrackerTest::count_active(&tracker_list) == 2);
+  TEST_GROUP_IS_BUSY("110000", "110000");
+
+  auto tracker_0_1_worker = TrackerTest::test_worker(tracker_0_1);
+
+  // The first response cancels the other request of the race and
+  // moves the winner to the front of the group.
+  CPPUNIT_ASSERT(tracker_0_1_worker->trigger_success());
+  TEST_GROUP_IS_BUSY("000000", "000000");
+
+  CPPUNIT_ASSERT(tracker_list[0] == tracker_0_1);
+  CPPUNIT_ASSERT(tracker_0_1.state().latency() != std::chrono::microseconds{});
+  CPPUNIT_ASSERT(tracker_0_0.state().latency() == std::chrono::microseconds{});
+
+  TEST_MULTIPLE_END(1, 0);
+}
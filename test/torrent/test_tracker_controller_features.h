@@ -14,6 +14,7 @@ class test_tracker_controller_features : public test_fixture {
 
   CPPUNIT_TEST(test_groups_requesting);
   CPPUNIT_TEST(test_groups_scrape);
+  CPPUNIT_TEST(test_groups_race);
 
   CPPUNIT_TEST_SUITE_END();
 
@@ -31,4 +32,5 @@ public:
 
   void test_groups_requesting();
   void test_groups_scrape();
+  void test_groups_race();
 };
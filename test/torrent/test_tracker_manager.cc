@@ -0,0 +1,149 @@
+#include "config.h"
+
+#include "test/torrent/test_tracker_manager.h"
+
+#include "torrent/exceptions.h"
+#include "torrent/tracker/manager.h"
+
+CPPUNIT_TEST_SUITE_REGISTRATION(test_tracker_manager);
+
+#define TRACKER_MANAGER_SETUP(rate, burst, jitter)                      \
+  SETUP_THREAD_TRACKER();                                               \
+  test_main_thread->test_set_cached_time(0s);                           \
+                                                                        \
+  auto tracker_manager = torrent::thread_tracker()->tracker_manager();  \
+  tracker_manager->set_announce_rate(rate);                             \
+  tracker_manager->set_announce_burst(burst);                           \
+  tracker_manager->set_announce_jitter(jitter);                         \
+                                                                        \
+  torrent::TrackerList tracker_list;
+
+#define TRACKER_MANAGER_INSERT(name, url)                               \
+  auto name = TrackerTest::new_tracker(&tracker_list, url);             \
+  TrackerTest::insert_tracker(&tracker_list, 0, name);
+
+#define TRACKER_MANAGER_ADVANCE(t)                                      \
+  test_main_thread->test_set_cached_time(t);                            \
+  test_main_thread->test_process_events_without_cached_time();
+
+void
+test_tracker_manager::tearDown() {
+  torrent::ThreadTracker::destroy_thread();
+
+  test_fixture::tearDown();
+}
+
+void
+test_tracker_manager::test_announce_burst() {
+  TRACKER_MANAGER_SETUP(1.0, 2, 0s);
+  TRACKER_MANAGER_INSERT(tracker_0, "http://example.com/announce");
+  TRACKER_MANAGER_INSERT(tracker_1, "http://example.com/announce?a");
+  TRACKER_MANAGER_INSERT(tracker_2, "http://example.com/announce?b");
+
+  tracker_list.send_event(tracker_0, torrent::tracker::TrackerState::EVENT_STARTED);
+  tracker_list.send_event(tracker_1, torrent::tracker::TrackerState::EVENT_STARTED);
+  tracker_list.send_event(tracker_2, torrent::tracker::TrackerState::EVENT_STARTED);
+
+  CPPUNIT_ASSERT(tracker_0.is_busy());
+  CPPUNIT_ASSERT(tracker_1.is_busy());
+  CPPUNIT_ASSERT(!tracker_2.is_busy());
+  CPPUNIT_ASSERT(tracker_manager->size_announce_queue() == 1);
+
+  TRACKER_MANAGER_ADVANCE(500ms);
+  CPPUNIT_ASSERT(!tracker_2.is_busy());
+
+  TRACKER_MANAGER_ADVANCE(1s);
+  CPPUNIT_ASSERT(tracker_2.is_busy());
+  CPPUNIT_ASSERT(tracker_manager->size_announce_queue() == 0);
+
+  CLEANUP_THREAD_TRACKER();
+}
+
+void
+test_tracker_manager::test_announce_priority() {
+  TRACKER_MANAGER_SETUP(1.0, 1, 0s);
+  TRACKER_MANAGER_INSERT(tracker_0, "http://example.com/announce");
+  TRACKER_MANAGER_INSERT(tracker_1, "http://example.com/announce?a");
+  TRACKER_MANAGER_INSERT(tracker_2, "http://example.com/announce?b");
+
+  tracker_list.send_event(tracker_0, torrent::tracker::TrackerState::EVENT_STARTED);
+  tracker_list.send_event(tracker_1, torrent::tracker::TrackerState::EVENT_NONE);
+  tracker_list.send_event(tracker_2, torrent::tracker::TrackerState::EVENT_COMPLETED);
+
+  CPPUNIT_ASSERT(tracker_0.is_busy());
+  CPPUNIT_ASSERT(tracker_manager->size_announce_queue() == 2);
+
+  TRACKER_MANAGER_ADVANCE(1s);
+  CPPUNIT_ASSERT(!tracker_1.is_busy());
+  CPPUNIT_ASSERT(tracker_2.is_busy());
+
+  TRACKER_MANAGER_ADVANCE(2s);
+  CPPUNIT_ASSERT(tracker_1.is_busy());
+  CPPUNIT_ASSERT(tracker_manager->size_announce_queue() == 0);
+
+  CLEANUP_THREAD_TRACKER();
+}
+
+void
+test_tracker_manager::test_announce_hosts() {
+  TRACKER_MANAGER_SETUP(1.0, 1, 0s);
+  TRACKER_MANAGER_INSERT(tracker_0, "http://example.com/announce");
+  TRACKER_MANAGER_INSERT(tracker_1, "http://example.org/announce");
+  TRACKER_MANAGER_INSERT(tracker_2, "https://example.com/announce");
+  TRACKER_MANAGER_INSERT(tracker_3, "http://EXAMPLE.com/announce?a");
+
+  tracker_list.send_event(tracker_0, torrent::tracker::TrackerState::EVENT_STARTED);
+  tracker_list.send_event(tracker_1, torrent::tracker::TrackerState::EVENT_STARTED);
+  tracker_list.send_event(tracker_2, torrent::tracker::TrackerState::EVENT_STARTED);
+  tracker_list.send_event(tracker_3, torrent::tracker::TrackerState::EVENT_STARTED);
+
+  CPPUNIT_ASSERT(tracker_0.is_busy());
+  CPPUNIT_ASSERT(tracker_1.is_busy());
+  CPPUNIT_ASSERT(tracker_2.is_busy());
+  CPPUNIT_ASSERT(!tracker_3.is_busy());
+  CPPUNIT_ASSERT(tracker_manager->size_announce_queue() == 1);
+
+  // Sending a new event replaces the queued one.
+  tracker_list.send_event(tracker_3, torrent::tracker::TrackerState::EVENT_STOPPED);
+  CPPUNIT_ASSERT(tracker_manager->size_announce_queue() == 1);
+
+  TRACKER_MANAGER_ADVANCE(1s);
+  CPPUNIT_ASSERT(tracker_3.is_busy());
+  CPPUNIT_ASSERT(TrackerTest::test_worker(tracker_3)->requesting_state() == torrent::tracker::TrackerState::EVENT_STOPPED);
+
+  CLEANUP_THREAD_TRACKER();
+}
+
+void
+test_tracker_manager::test_announce_jitter() {
+  TRACKER_MANAGER_SETUP(0.0, 1, 10s);
+  TRACKER_MANAGER_INSERT(tracker_0, "http://example.com/announce");
+  TRACKER_MANAGER_INSERT(tracker_1, "http://example.com/announce?a");
+
+  tracker_list.send_event(tracker_0, torrent::tracker::TrackerState::EVENT_STARTED);
+  tracker_list.send_event(tracker_1, torrent::tracker::TrackerState::EVENT_NONE);
+
+  CPPUNIT_ASSERT(tracker_0.is_busy());
+  CPPUNIT_ASSERT(tracker_manager->size_announce_queue() <= 1);
+
+  TRACKER_MANAGER_ADVANCE(10s);
+  CPPUNIT_ASSERT(tracker_1.is_busy());
+  CPPUNIT_ASSERT(tracker_manager->size_announce_queue() == 0);
+
+  CLEANUP_THREAD_TRACKER();
+}
+
+void
+test_tracker_manager::test_announce_settings() {
+  TRACKER_MANAGER_SETUP(1.0, 1, 0s);
+
+  CPPUNIT_ASSERT_THROW(tracker_manager->set_announce_rate(-1.0), torrent::input_error);
+  CPPUNIT_ASSERT_THROW(tracker_manager->set_announce_burst(0), torrent::input_error);
+  CPPUNIT_ASSERT_THROW(tracker_manager->set_announce_jitter(-1s), torrent::input_error);
+
+  CPPUNIT_ASSERT(tracker_manager->announce_rate() == 1.0);
+  CPPUNIT_ASSERT(tracker_manager->announce_burst() == 1);
+  CPPUNIT_ASSERT(tracker_manager->announce_jitter() == 0s);
+
+  CLEANUP_THREAD_TRACKER();
+}
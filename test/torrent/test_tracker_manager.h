@@ -0,0 +1,24 @@
+#include "test/helpers/test_fixture.h"
+#include "test/helpers/test_main_thread.h"
+#include "test/helpers/tracker_test.h"
+
+class test_tracker_manager : public test_fixture {
+  CPPUNIT_TEST_SUITE(test_tracker_manager);
+
+  CPPUNIT_TEST(test_announce_burst);
+  CPPUNIT_TEST(test_announce_priority);
+  CPPUNIT_TEST(test_announce_hosts);
+  CPPUNIT_TEST(test_announce_jitter);
+  CPPUNIT_TEST(test_announce_settings);
+
+  CPPUNIT_TEST_SUITE_END();
+
+public:
+  void tearDown();
+
+  void test_announce_burst();
+  void test_announce_priority();
+  void test_announce_hosts();
+  void test_announce_jitter();
+  void test_announce_settings();
+};
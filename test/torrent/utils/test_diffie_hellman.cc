@@ -0,0 +1,101 @@
+#include "config.h"
+
+#include "test_diffie_hellman.h"
+
+#include <cstring>
+
+#include "protocol/handshake_encryption.h"
+#include "utils/diffie_hellman.h"
+
+CPPUNIT_TEST_SUITE_NAMED_REGISTRATION(test_diffie_hellman, "torrent/utils");
+
+using torrent::DiffieHellman;
+using torrent::DiffieHellmanPool;
+using torrent::HandshakeEncryption;
+
+namespace {
+
+DiffieHellmanPool::key_ptr
+make_key() {
+  return std::make_unique<DiffieHellman>(HandshakeEncryption::dh_prime, HandshakeEncryption::dh_prime_length,
+                                         HandshakeEncryption::dh_generator, HandshakeEncryption::dh_generator_length);
+}
+
+DiffieHellmanPool
+make_pool(unsigned int size) {
+  return DiffieHellmanPool(HandshakeEncryption::dh_prime, HandshakeEncryption::dh_prime_length,
+                           HandshakeEncryption::dh_generator, HandshakeEncryption::dh_generator_length,
+                           size);
+}
+
+}
+
+void
+test_diffie_hellman::test_shared_secret() {
+  auto local = make_key();
+  auto remote = make_key();
+
+  CPPUNIT_ASSERT(local->is_valid());
+  CPPUNIT_ASSERT(remote->is_valid());
+
+  unsigned char local_pub[96];
+  unsigned char remote_pub[96];
+
+  local->store_pub_key(local_pub, 96);
+  remote->store_pub_key(remote_pub, 96);
+
+  CPPUNIT_ASSERT(std::memcmp(local_pub, remote_pub, 96) != 0);
+
+  CPPUNIT_ASSERT(local->compute_secret(remote_pub, 96));
+  CPPUNIT_ASSERT(remote->compute_secret(local_pub, 96));
+
+  CPPUNIT_ASSERT(local->size() == 96);
+  CPPUNIT_ASSERT(local->secret_str() == remote->secret_str());
+}
+
+void
+test_diffie_hellman::test_pool_pop() {
+  auto pool = make_pool(4);
+
+  CPPUNIT_ASSERT(pool.size() == 0);
+
+  auto first = pool.pop();
+  auto second = pool.pop();
+
+  CPPUNIT_ASSERT(first != nullptr && first->is_valid());
+  CPPUNIT_ASSERT(second != nullptr && second->is_valid());
+  CPPUNIT_ASSERT(pool.size() == 0);
+
+  unsigned char first_pub[96];
+  unsigned char second_pub[96];
+
+  first->store_pub_key(first_pub, 96);
+  second->store_pub_key(second_pub, 96);
+
+  CPPUNIT_ASSERT(std::memcmp(first_pub, second_pub, 96) != 0);
+}
+
+void
+test_diffie_hellman::test_pool_fill() {
+  auto pool = make_pool(4);
+
+  CPPUNIT_ASSERT(pool.try_start_fill());
+  CPPUNIT_ASSERT(!pool.try_start_fill());
+
+  pool.fill();
+
+  CPPUNIT_ASSERT(pool.size() == 4);
+  CPPUNIT_ASSERT(!pool.try_start_fill());
+
+  CPPUNIT_ASSERT(pool.pop()->is_valid());
+  CPPUNIT_ASSERT(pool.pop()->is_valid());
+  CPPUNIT_ASSERT(pool.size() == 2);
+  CPPUNIT_ASSERT(!pool.try_start_fill());
+
+  pool.pop();
+  CPPUNIT_ASSERT(pool.size() == 1);
+  CPPUNIT_ASSERT(pool.try_start_fill());
+
+  pool.fill();
+  CPPUNIT_ASSERT(pool.size() == 4);
+}
@@ -0,0 +1,16 @@
+#include "helpers/test_fixture.h"
+
+class test_diffie_hellman : public test_fixture {
+  CPPUNIT_TEST_SUITE(test_diffie_hellman);
+
+  CPPUNIT_TEST(test_shared_secret);
+  CPPUNIT_TEST(test_pool_pop);
+  CPPUNIT_TEST(test_pool_fill);
+
+  CPPUNIT_TEST_SUITE_END();
+
+public:
+  void test_shared_secret();
+  void test_pool_pop();
+  void test_pool_fill();
+};
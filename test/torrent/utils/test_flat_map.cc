@@ -0,0 +1,125 @@
+#include "config.h"
+
+#include "test_flat_map.h"
+
+#include <algorithm>
+#include <memory_resource>
+#include <string>
+
+#include "torrent/utils/flat_map.h"
+
+CPPUNIT_TEST_SUITE_NAMED_REGISTRATION(test_flat_map, "torrent/utils");
+
+using map_type = torrent::flat_map<std::string, int>;
+
+namespace {
+
+bool
+is_sorted(const map_type& map) {
+  return std::is_sorted(map.begin(), map.end(), [](const auto& a, const auto& b) { return a.first < b.first; });
+}
+
+}
+
+void
+test_flat_map::test_insert() {
+  map_type map;
+
+  CPPUNIT_ASSERT(map.insert(map_type::value_type("b", 2)).second);
+  CPPUNIT_ASSERT(map.insert(map_type::value_type("d", 4)).second);
+  CPPUNIT_ASSERT(map.insert(map_type::value_type("a", 1)).second);
+  CPPUNIT_ASSERT(map.emplace("c", 3).second);
+
+  CPPUNIT_ASSERT(!map.insert(map_type::value_type("b", 5)).second);
+  CPPUNIT_ASSERT(!map.try_emplace("c", 5).second);
+
+  CPPUNIT_ASSERT(map.size() == 4);
+  CPPUNIT_ASSERT(is_sorted(map));
+  CPPUNIT_ASSERT(map["b"] == 2 && map["c"] == 3);
+
+  map["e"] = 6;
+  CPPUNIT_ASSERT(map.size() == 5 && map.rbegin()->second == 6);
+
+  CPPUNIT_ASSERT(!map.insert_or_assign("e", 7).second);
+  CPPUNIT_ASSERT(map.insert_or_assign("0", 0).second);
+  CPPUNIT_ASSERT(map.at("e") == 7 && map.begin()->first == "0");
+  CPPUNIT_ASSERT(is_sorted(map));
+}
+
+void
+test_flat_map::test_find() {
+  map_type map;
+
+  for (auto key : { "peers", "bitfield", "files", "trackers" })
+    map[key] = 1;
+
+  CPPUNIT_ASSERT(map.find("files") != map.end());
+  CPPUNIT_ASSERT(map.find(std::string("files"))->first == "files");
+  CPPUNIT_ASSERT(map.find("file") == map.end());
+  CPPUNIT_ASSERT(map.find("") == map.end());
+  CPPUNIT_ASSERT(map.find("zzz") == map.end());
+
+  CPPUNIT_ASSERT(map.count("peers") == 1 && map.count("peer") == 0);
+  CPPUNIT_ASSERT(map.contains("trackers"));
+
+  CPPUNIT_ASSERT(map.lower_bound("c")->first == "files");
+  CPPUNIT_ASSERT(map.upper_bound("files")->first == "peers");
+
+  CPPUNIT_ASSERT_THROW(map.at("missing"), std::out_of_range);
+}
+
+void
+test_flat_map::test_erase() {
+  map_type map;
+
+  for (auto key : { "a", "b", "c", "d" })
+    map[key] = 1;
+
+  CPPUNIT_ASSERT(map.erase("b") == 1);
+  CPPUNIT_ASSERT(map.erase("b") == 0);
+  CPPUNIT_ASSERT(map.erase(map.find("a"))->first == "c");
+  CPPUNIT_ASSERT(map.size() == 2);
+
+  map.erase(map.begin(), map.end());
+  CPPUNIT_ASSERT(map.empty());
+}
+
+void
+test_flat_map::test_hint() {
+  map_type map;
+
+  // Valid hints insert in place, invalid ones fall back to a search.
+  auto itr = map.insert(map.end(), map_type::value_type("b", 2));
+  CPPUNIT_ASSERT(itr->first == "b");
+
+  itr = map.insert(map.begin(), map_type::value_type("a", 1));
+  CPPUNIT_ASSERT(itr->first == "a");
+
+  itr = map.insert(map.begin(), map_type::value_type("c", 3));
+  CPPUNIT_ASSERT(itr->first == "c");
+
+  itr = map.insert(map.end(), map_type::value_type("a", 4));
+  CPPUNIT_ASSERT(itr->first == "a" && itr->second == 1);
+
+  CPPUNIT_ASSERT(map.size() == 3);
+  CPPUNIT_ASSERT(is_sorted(map));
+}
+
+void
+test_flat_map::test_allocator() {
+  using pmr_map_type = torrent::flat_map<std::string, int, std::pmr::polymorphic_allocator<std::pair<std::string, int>>>;
+
+  char buffer[1024];
+  std::pmr::monotonic_buffer_resource resource(buffer, sizeof(buffer), std::pmr::null_memory_resource());
+
+  pmr_map_type map(&resource);
+  map.reserve(4);
+  map["a"] = 1;
+  map["b"] = 2;
+
+  CPPUNIT_ASSERT(map.get_allocator().resource() == &resource);
+
+  pmr_map_type copy(map, std::pmr::get_default_resource());
+  CPPUNIT_ASSERT(copy.get_allocator().resource() == std::pmr::get_default_resource());
+  CPPUNIT_ASSERT(copy == map);
+}
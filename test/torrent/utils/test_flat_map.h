@@ -0,0 +1,20 @@
+#include "helpers/test_fixture.h"
+
+class test_flat_map : public test_fixture {
+  CPPUNIT_TEST_SUITE(test_flat_map);
+
+  CPPUNIT_TEST(test_insert);
+  CPPUNIT_TEST(test_find);
+  CPPUNIT_TEST(test_erase);
+  CPPUNIT_TEST(test_hint);
+  CPPUNIT_TEST(test_allocator);
+
+  CPPUNIT_TEST_SUITE_END();
+
+public:
+  void test_insert();
+  void test_find();
+  void test_erase();
+  void test_hint();
+  void test_allocator();
+};
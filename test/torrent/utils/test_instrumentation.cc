@@ -0,0 +1,83 @@
+#include "config.h"
+
+#include "test_instrumentation.h"
+
+#include <cstring>
+#include <thread>
+#include <vector>
+
+#include "utils/instrumentation.h"
+
+CPPUNIT_TEST_SUITE_NAMED_REGISTRATION(test_instrumentation, "torrent/utils");
+
+void
+test_instrumentation::test_basic() {
+  torrent::instrumentation_initialize();
+
+  CPPUNIT_ASSERT(torrent::instrumentation_is_gauge(torrent::INSTRUMENTATION_MEMORY_CHUNK_USAGE));
+  CPPUNIT_ASSERT(!torrent::instrumentation_is_gauge(torrent::INSTRUMENTATION_CHUNK_CACHE_HITS));
+
+  CPPUNIT_ASSERT(std::strcmp(torrent::instrumentation_name(torrent::INSTRUMENTATION_MEMORY_BITFIELDS), "memory_bitfields") == 0);
+  CPPUNIT_ASSERT(std::strcmp(torrent::instrumentation_name(torrent::INSTRUMENTATION_TRANSFER_PEER_INFO_UNACCOUNTED),
+                             "transfer_peer_info_unaccounted") == 0);
+
+  torrent::instrumentation_update(torrent::INSTRUMENTATION_CHUNK_CACHE_HITS, 3);
+  torrent::instrumentation_update(torrent::INSTRUMENTATION_CHUNK_CACHE_USAGE, 100);
+
+  CPPUNIT_ASSERT(torrent::instrumentation_value(torrent::INSTRUMENTATION_CHUNK_CACHE_HITS) == 3);
+  CPPUNIT_ASSERT(torrent::instrumentation_value(torrent::INSTRUMENTATION_CHUNK_CACHE_USAGE) == 100);
+
+  // Only counters are cleared.
+  torrent::instrumentation_reset();
+
+  CPPUNIT_ASSERT(torrent::instrumentation_value(torrent::INSTRUMENTATION_CHUNK_CACHE_HITS) == 0);
+  CPPUNIT_ASSERT(torrent::instrumentation_value(torrent::INSTRUMENTATION_CHUNK_CACHE_USAGE) == 100);
+}
+
+void
+test_instrumentation::test_threads() {
+  torrent::instrumentation_initialize();
+
+  std::vector<std::thread> threads;
+
+  for (int i = 0; i != 4; i++)
+    threads.emplace_back([] {
+        for (int j = 0; j != 1000; j++)
+          torrent::instrumentation_update(torrent::INSTRUMENTATION_CHUNK_CACHE_MISSES, 1);
+
+        torrent::instrumentation_update(torrent::INSTRUMENTATION_MEMORY_CHUNK_COUNT, -1);
+      });
+
+  torrent::instrumentation_update(torrent::INSTRUMENTATION_MEMORY_CHUNK_COUNT, 4);
+
+  for (auto& thread : threads)
+    thread.join();
+
+  // The exited threads' shards are kept in the retired shard.
+  CPPUNIT_ASSERT(torrent::instrumentation_value(torrent::INSTRUMENTATION_CHUNK_CACHE_MISSES) == 4000);
+  CPPUNIT_ASSERT(torrent::instrumentation_value(torrent::INSTRUMENTATION_MEMORY_CHUNK_COUNT) == 0);
+
+  torrent::instrumentation_reset();
+
+  CPPUNIT_ASSERT(torrent::instrumentation_value(torrent::INSTRUMENTATION_CHUNK_CACHE_MISSES) == 0);
+}
+
+void
+test_instrumentation::test_snapshot() {
+  torrent::instrumentation_initialize();
+
+  torrent::instrumentation_update(torrent::INSTRUMENTATION_TRACKER_ANNOUNCE_SENT, 2);
+  torrent::instrumentation_update(torrent::INSTRUMENTATION_TRACKER_ANNOUNCE_QUEUE, 5);
+
+  torrent::instrumentation_tick();
+
+  torrent::instrumentation_update(torrent::INSTRUMENTATION_TRACKER_ANNOUNCE_SENT, 1);
+  torrent::instrumentation_update(torrent::INSTRUMENTATION_TRACKER_ANNOUNCE_QUEUE, -2);
+
+  // Counters in the snapshot include what the tick cleared.
+  auto values = torrent::instrumentation_snapshot();
+
+  CPPUNIT_ASSERT(torrent::instrumentation_value(torrent::INSTRUMENTATION_TRACKER_ANNOUNCE_SENT) == 1);
+  CPPUNIT_ASSERT(values[torrent::INSTRUMENTATION_TRACKER_ANNOUNCE_SENT] == 3);
+  CPPUNIT_ASSERT(values[torrent::INSTRUMENTATION_TRACKER_ANNOUNCE_QUEUE] == 3);
+}
@@ -0,0 +1,16 @@
+#include "helpers/test_fixture.h"
+
+class test_instrumentation : public test_fixture {
+  CPPUNIT_TEST_SUITE(test_instrumentation);
+
+  CPPUNIT_TEST(test_basic);
+  CPPUNIT_TEST(test_threads);
+  CPPUNIT_TEST(test_snapshot);
+
+  CPPUNIT_TEST_SUITE_END();
+
+public:
+  void test_basic();
+  void test_threads();
+  void test_snapshot();
+};
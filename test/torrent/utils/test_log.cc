@@ -8,6 +8,9 @@
 #include <fstream>
 #include <functional>
 #include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
 
 #include "torrent/exceptions.h"
 #include "torrent/utils/log.h"
@@ -195,3 +198,40 @@ test_log::test_file_output_append() {
   CPPUNIT_ASSERT_MESSAGE(buffer_line2, std::string(buffer_line2).find("test_line_2") != std::string::npos);
   std::remove(filename.c_str());
 }
+
+void
+test_log::test_deferred() {
+  std::vector<std::string> messages;
+
+  torrent::log_open_output("test_deferred", [&messages](const char* data, size_t length, int group) {
+      CPPUNIT_ASSERT(group == GROUP_PARENT_1);
+      CPPUNIT_ASSERT(std::strlen(data) == length);
+      messages.emplace_back(data, length);
+    });
+  torrent::log_add_group_output(GROUP_PARENT_1, "test_deferred");
+
+  torrent::log_set_deferred(true);
+  CPPUNIT_ASSERT(torrent::log_is_deferred());
+
+  // Enough messages to wrap and fill the ring several times.
+  for (int i = 0; i < 10000; i++)
+    lt_log_print(GROUP_PARENT_1, "message %i %s", i, std::string(i % 300, 'x').c_str());
+
+  std::thread([] { lt_log_print(GROUP_PARENT_1, "other thread"); }).join();
+
+  torrent::log_flush();
+
+  CPPUNIT_ASSERT(messages.size() == 10001);
+  CPPUNIT_ASSERT(std::find(messages.begin(), messages.end(), "other thread") != messages.end());
+
+  messages.erase(std::remove(messages.begin(), messages.end(), "other thread"), messages.end());
+
+  for (int i = 0; i < 10000; i++)
+    CPPUNIT_ASSERT(messages[i] == "message " + std::to_string(i) + " " + std::string(i % 300, 'x'));
+
+  torrent::log_set_deferred(false);
+  CPPUNIT_ASSERT(!torrent::log_is_deferred());
+
+  lt_log_print(GROUP_PARENT_1, "direct");
+  CPPUNIT_ASSERT(messages.back() == "direct");
+}
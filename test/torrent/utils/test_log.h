@@ -9,6 +9,7 @@ class test_log : public test_fixture {
   CPPUNIT_TEST(test_children);
   CPPUNIT_TEST(test_file_output);
   CPPUNIT_TEST(test_file_output_append);
+  CPPUNIT_TEST(test_deferred);
   CPPUNIT_TEST_SUITE_END();
 
 public:
@@ -22,4 +23,5 @@ public:
   void test_children();
   void test_file_output();
   void test_file_output_append();
+  void test_deferred();
 };
@@ -2,6 +2,14 @@
 
 #include "test_log_buffer.h"
 
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <vector>
+#include <unistd.h>
+
 #include "globals.h"
 #include "torrent/utils/log_buffer.h"
 
@@ -55,3 +63,62 @@ test_log_buffer::test_timestamps() {
   CPPUNIT_ASSERT(log.find_older(1010)      == log.end());
   CPPUNIT_ASSERT(log.find_older(1010 + 1)  == log.end());
 }
+
+static std::vector<std::string>
+read_ring_file(const std::string& filename) {
+  std::ifstream file(filename, std::ios::binary);
+  std::string buffer(std::istreambuf_iterator<char>(file), {});
+  std::vector<std::string> messages;
+
+  CPPUNIT_ASSERT(torrent::log_ring_file::for_each(buffer.data(), buffer.size(), [&messages](auto& record, const char* data) {
+      messages.emplace_back(data, record.length);
+    }));
+
+  return messages;
+}
+
+void
+test_log_buffer::test_ring_file() {
+  char filename[] = "test_log_ring.XXXXXX";
+  ::close(mkstemp(filename));
+
+  torrent::cachedTime = rak::timer::from_seconds(1000);
+
+  {
+    torrent::log_ring_file ring(filename, 4096);
+    CPPUNIT_ASSERT(ring.size() == 4096);
+
+    ring.write("dump", 4, -1);
+    ring.write("first", 5, 0);
+    ring.write("second", 6, 1);
+  }
+
+  CPPUNIT_ASSERT(read_ring_file(filename) == std::vector<std::string>({ "first", "second" }));
+
+  // Reopening keeps the messages, and wrapping drops the oldest.
+  {
+    torrent::log_ring_file ring(filename, 4096);
+
+    for (int i = 0; i < 1000; i++) {
+      std::string message = "message " + std::to_string(i) + std::string(i % 50, 'x');
+      ring.write(message.data(), message.size(), 0);
+    }
+  }
+
+  auto messages = read_ring_file(filename);
+
+  CPPUNIT_ASSERT(!messages.empty() && messages.size() < 1000);
+  CPPUNIT_ASSERT(messages.back() == "message 999" + std::string(999 % 50, 'x'));
+
+  for (size_t i = 0, first = 1000 - messages.size(); i < messages.size(); i++)
+    CPPUNIT_ASSERT(messages[i] == "message " + std::to_string(first + i) + std::string((first + i) % 50, 'x'));
+
+  // A ring of a different size is not reused.
+  {
+    torrent::log_ring_file ring(filename, 8192);
+  }
+
+  CPPUNIT_ASSERT(read_ring_file(filename).empty());
+
+  std::remove(filename);
+}
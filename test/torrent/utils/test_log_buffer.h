@@ -4,9 +4,11 @@ class test_log_buffer : public test_fixture {
   CPPUNIT_TEST_SUITE(test_log_buffer);
   CPPUNIT_TEST(test_basic);
   CPPUNIT_TEST(test_timestamps);
+  CPPUNIT_TEST(test_ring_file);
   CPPUNIT_TEST_SUITE_END();
 
 public:
   void test_basic();
   void test_timestamps();
+  void test_ring_file();
 };
@@ -0,0 +1,131 @@
+#include "config.h"
+
+#include "test_merkle_tree.h"
+
+#include <string>
+
+#include "torrent/exceptions.h"
+#include "utils/merkle_tree.h"
+
+CPPUNIT_TEST_SUITE_NAMED_REGISTRATION(test_merkle_tree, "torrent/utils");
+
+using torrent::merkle_block_size;
+using torrent::merkle_hash;
+
+namespace {
+
+std::string
+make_data(uint32_t length) {
+  std::string data(length, '\0');
+
+  for (uint32_t i = 0; i < length; i++)
+    data[i] = static_cast<char>(i * 7 + i / merkle_block_size);
+
+  return data;
+}
+
+merkle_hash
+block_hash(const std::string& data, uint32_t index) {
+  uint32_t offset = index * merkle_block_size;
+
+  return torrent::merkle_hash_block(data.data() + offset, std::min<uint32_t>(data.size() - offset, merkle_block_size));
+}
+
+}
+
+void
+test_merkle_tree::test_hash_block() {
+  const unsigned char expected[32] = {
+    0xba, 0x78, 0x16, 0xbf, 0x8f, 0x01, 0xcf, 0xea, 0x41, 0x41, 0x40, 0xde, 0x5d, 0xae, 0x22, 0x23,
+    0xb0, 0x03, 0x61, 0xa3, 0x96, 0x17, 0x7a, 0x9c, 0xb4, 0x10, 0xff, 0x61, 0xf2, 0x00, 0x15, 0xad
+  };
+
+  merkle_hash hash = torrent::merkle_hash_block("abc", 3);
+
+  CPPUNIT_ASSERT(std::equal(hash.begin(), hash.end(), reinterpret_cast<const char*>(expected)));
+}
+
+void
+test_merkle_tree::test_pad_hash() {
+  merkle_hash zero{};
+
+  CPPUNIT_ASSERT(torrent::merkle_pad_hash(0) == zero);
+  CPPUNIT_ASSERT(torrent::merkle_pad_hash(1) == torrent::merkle_hash_pair(zero, zero));
+  CPPUNIT_ASSERT(torrent::merkle_pad_hash(2) == torrent::merkle_hash_pair(torrent::merkle_pad_hash(1), torrent::merkle_pad_hash(1)));
+}
+
+void
+test_merkle_tree::test_root() {
+  std::string data = make_data(2 * merkle_block_size + 100);
+  auto leaves = torrent::merkle_hash_blocks(data.data(), data.size());
+
+  CPPUNIT_ASSERT(leaves.size() == 3);
+  CPPUNIT_ASSERT(leaves[2] == block_hash(data, 2));
+
+  merkle_hash expected = torrent::merkle_hash_pair(torrent::merkle_hash_pair(leaves[0], leaves[1]),
+                                                   torrent::merkle_hash_pair(leaves[2], merkle_hash{}));
+
+  CPPUNIT_ASSERT(torrent::merkle_root(leaves) == expected);
+
+  // A single block file has its leaf as root.
+  CPPUNIT_ASSERT(torrent::merkle_root({ leaves[0] }) == leaves[0]);
+
+  CPPUNIT_ASSERT_THROW(torrent::merkle_root({}), torrent::internal_error);
+}
+
+void
+test_merkle_tree::test_piece_layer() {
+  std::string data = make_data(5 * merkle_block_size);
+  auto leaves = torrent::merkle_hash_blocks(data.data(), data.size());
+
+  unsigned int height = torrent::merkle_piece_height(2 * merkle_block_size);
+  CPPUNIT_ASSERT(height == 1);
+
+  auto layer = torrent::merkle_layer(leaves, height);
+
+  CPPUNIT_ASSERT(layer.size() == 3);
+  CPPUNIT_ASSERT(layer[0] == torrent::merkle_hash_pair(leaves[0], leaves[1]));
+  CPPUNIT_ASSERT(layer[2] == torrent::merkle_hash_pair(leaves[4], merkle_hash{}));
+
+  // The root from the piece layer pads with whole padding pieces.
+  CPPUNIT_ASSERT(torrent::merkle_root(layer, height) == torrent::merkle_root(leaves));
+
+  CPPUNIT_ASSERT(torrent::merkle_piece_height(merkle_block_size) == 0);
+  CPPUNIT_ASSERT(torrent::merkle_piece_height(1 << 22) == 8);
+  CPPUNIT_ASSERT_THROW(torrent::merkle_piece_height(3 * merkle_block_size), torrent::input_error);
+  CPPUNIT_ASSERT_THROW(torrent::merkle_piece_height(merkle_block_size / 2), torrent::input_error);
+}
+
+void
+test_merkle_tree::test_verify_piece() {
+  uint32_t    piece_length = 4 * merkle_block_size;
+  std::string data = make_data(piece_length + merkle_block_size + 10);
+
+  auto leaves = torrent::merkle_hash_blocks(data.data(), data.size());
+  auto layer = torrent::merkle_layer(leaves, torrent::merkle_piece_height(piece_length));
+
+  CPPUNIT_ASSERT(layer.size() == 2);
+  CPPUNIT_ASSERT(torrent::merkle_verify_piece(data.data(), piece_length, piece_length, layer[0]));
+
+  // The last piece of the file is shorter.
+  CPPUNIT_ASSERT(torrent::merkle_verify_piece(data.data() + piece_length, data.size() - piece_length, piece_length, layer[1]));
+
+  data[merkle_block_size + 1] ^= 1;
+  CPPUNIT_ASSERT(!torrent::merkle_verify_piece(data.data(), piece_length, piece_length, layer[0]));
+}
+
+void
+test_merkle_tree::test_failed_blocks() {
+  std::string data = make_data(3 * merkle_block_size + 10);
+  auto leaves = torrent::merkle_hash_blocks(data.data(), data.size());
+
+  CPPUNIT_ASSERT(torrent::merkle_failed_blocks(data.data(), data.size(), leaves).empty());
+
+  data[2 * merkle_block_size] ^= 1;
+  data[3 * merkle_block_size + 9] ^= 1;
+
+  auto failed = torrent::merkle_failed_blocks(data.data(), data.size(), leaves);
+
+  CPPUNIT_ASSERT(failed.size() == 2);
+  CPPUNIT_ASSERT(failed[0] == 2 && failed[1] == 3);
+}
@@ -0,0 +1,22 @@
+#include "helpers/test_fixture.h"
+
+class test_merkle_tree : public test_fixture {
+  CPPUNIT_TEST_SUITE(test_merkle_tree);
+
+  CPPUNIT_TEST(test_hash_block);
+  CPPUNIT_TEST(test_pad_hash);
+  CPPUNIT_TEST(test_root);
+  CPPUNIT_TEST(test_piece_layer);
+  CPPUNIT_TEST(test_verify_piece);
+  CPPUNIT_TEST(test_failed_blocks);
+
+  CPPUNIT_TEST_SUITE_END();
+
+public:
+  void test_hash_block();
+  void test_pad_hash();
+  void test_root();
+  void test_piece_layer();
+  void test_verify_piece();
+  void test_failed_blocks();
+};
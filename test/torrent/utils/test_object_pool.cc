@@ -0,0 +1,118 @@
+#include "config.h"
+
+#include "test_object_pool.h"
+
+#include <thread>
+#include <vector>
+
+#include "utils/object_pool.h"
+
+CPPUNIT_TEST_SUITE_NAMED_REGISTRATION(test_object_pool, "torrent/utils");
+
+namespace {
+
+// Each test uses its own pool so the counters start at zero.
+template <int Id>
+struct pooled_object {
+  static void* operator new(size_t size)                     { return torrent::object_pool<pooled_object>::allocate(size); }
+  static void  operator delete(void* ptr, size_t size) noexcept { torrent::object_pool<pooled_object>::deallocate(ptr, size); }
+
+  virtual ~pooled_object() = default;
+
+  char data[100];
+};
+
+template <int Id>
+struct pooled_derived : public pooled_object<Id> {
+  char more_data[100];
+};
+
+}
+
+void
+test_object_pool::test_reuse() {
+  using pool_type = torrent::object_pool<pooled_object<0>>;
+
+  auto first = new pooled_object<0>;
+  auto first_ptr = static_cast<void*>(first);
+
+  CPPUNIT_ASSERT(pool_type::stats().live == 1);
+  CPPUNIT_ASSERT(pool_type::stats().cached == 0);
+
+  delete first;
+
+  CPPUNIT_ASSERT(pool_type::stats().live == 0);
+  CPPUNIT_ASSERT(pool_type::stats().cached == 1);
+
+  auto second = new pooled_object<0>;
+
+  CPPUNIT_ASSERT(static_cast<void*>(second) == first_ptr);
+  CPPUNIT_ASSERT(pool_type::stats().cached == 0);
+  CPPUNIT_ASSERT(pool_type::stats().allocations == 2);
+  CPPUNIT_ASSERT(pool_type::stats().reused == 1);
+
+  delete second;
+  pool_type::release_local();
+
+  CPPUNIT_ASSERT(pool_type::stats().cached == 0);
+}
+
+void
+test_object_pool::test_max_cached() {
+  using pool_type = torrent::object_pool<pooled_object<1>>;
+
+  std::vector<pooled_object<1>*> objects;
+
+  for (unsigned int i = 0; i < pool_type::max_cached + 10; i++)
+    objects.push_back(new pooled_object<1>);
+
+  CPPUNIT_ASSERT(pool_type::stats().live == pool_type::max_cached + 10);
+
+  for (auto object : objects)
+    delete object;
+
+  CPPUNIT_ASSERT(pool_type::stats().live == 0);
+  CPPUNIT_ASSERT(pool_type::stats().cached == pool_type::max_cached);
+
+  pool_type::release_local();
+
+  CPPUNIT_ASSERT(pool_type::stats().cached == 0);
+}
+
+void
+test_object_pool::test_oversized() {
+  using pool_type = torrent::object_pool<pooled_object<2>>;
+
+  pooled_object<2>* object = new pooled_derived<2>;
+
+  CPPUNIT_ASSERT(pool_type::stats().live == 0);
+  CPPUNIT_ASSERT(pool_type::stats().allocations == 0);
+
+  delete object;
+
+  CPPUNIT_ASSERT(pool_type::stats().cached == 0);
+}
+
+void
+test_object_pool::test_threads() {
+  using pool_type = torrent::object_pool<pooled_object<3>>;
+
+  std::vector<pooled_object<3>*> objects;
+
+  for (int i = 0; i < 10; i++)
+    objects.push_back(new pooled_object<3>);
+
+  // Blocks freed on another thread go to that thread's cache, which is
+  // released when the thread exits.
+  std::thread thread([&objects]() {
+      for (auto object : objects)
+        delete object;
+
+      CPPUNIT_ASSERT(pool_type::stats().cached == 10);
+    });
+
+  thread.join();
+
+  CPPUNIT_ASSERT(pool_type::stats().live == 0);
+  CPPUNIT_ASSERT(pool_type::stats().cached == 0);
+}
@@ -0,0 +1,18 @@
+#include "helpers/test_fixture.h"
+
+class test_object_pool : public test_fixture {
+  CPPUNIT_TEST_SUITE(test_object_pool);
+
+  CPPUNIT_TEST(test_reuse);
+  CPPUNIT_TEST(test_max_cached);
+  CPPUNIT_TEST(test_oversized);
+  CPPUNIT_TEST(test_threads);
+
+  CPPUNIT_TEST_SUITE_END();
+
+public:
+  void test_reuse();
+  void test_max_cached();
+  void test_oversized();
+  void test_threads();
+};
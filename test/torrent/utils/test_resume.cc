@@ -0,0 +1,86 @@
+#include "config.h"
+
+#include "test_resume.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "torrent/utils/resume.h"
+
+CPPUNIT_TEST_SUITE_NAMED_REGISTRATION(test_resume, "torrent/utils");
+
+namespace {
+
+void
+write_file(const std::string& path, size_t size) {
+  FILE* file = std::fopen(path.c_str(), "w");
+  CPPUNIT_ASSERT(file != nullptr);
+
+  std::fwrite(std::string(size, 'x').data(), 1, size, file);
+  std::fclose(file);
+}
+
+}
+
+void
+test_resume::setUp() {
+  test_fixture::setUp();
+
+  char dir[] = "/tmp/libtorrent_test_resume.XXXXXX";
+  CPPUNIT_ASSERT(mkdtemp(dir) != nullptr);
+
+  m_dir = dir;
+  CPPUNIT_ASSERT(mkdir((m_dir + "/a").c_str(), 0700) == 0);
+
+  write_file(m_dir + "/a/1", 10);
+  write_file(m_dir + "/a/2", 20);
+  write_file(m_dir + "/3", 30);
+}
+
+void
+test_resume::tearDown() {
+  unlink((m_dir + "/a/1").c_str());
+  unlink((m_dir + "/a/2").c_str());
+  unlink((m_dir + "/3").c_str());
+  rmdir((m_dir + "/a").c_str());
+  rmdir(m_dir.c_str());
+
+  test_fixture::tearDown();
+}
+
+void
+test_resume::test_stat_files() {
+  std::vector<std::string> paths = { m_dir + "/a/1", m_dir + "/a/2", "", m_dir + "/3", m_dir + "/4" };
+
+  for (unsigned int threads : { 1, 4 }) {
+    auto stats = torrent::resume_stat_files(paths, threads);
+    struct stat st;
+
+    CPPUNIT_ASSERT(stats.size() == 5);
+    CPPUNIT_ASSERT(stats[0].exists && stats[0].size == 10);
+    CPPUNIT_ASSERT(stats[1].exists && stats[1].size == 20);
+    CPPUNIT_ASSERT(!stats[2].exists);
+    CPPUNIT_ASSERT(stats[3].exists && stats[3].size == 30);
+    CPPUNIT_ASSERT(!stats[4].exists);
+
+    CPPUNIT_ASSERT(stat(paths[3].c_str(), &st) == 0);
+    CPPUNIT_ASSERT(stats[3].mtime == st.st_mtime);
+  }
+}
+
+void
+test_resume::test_stat_missing_directory() {
+  std::vector<std::string> paths = { m_dir + "/b/1", m_dir + "/b/2", m_dir + "/a/1", m_dir + "/3/1" };
+
+  auto stats = torrent::resume_stat_files(paths, 2);
+
+  CPPUNIT_ASSERT(stats.size() == 4);
+  CPPUNIT_ASSERT(!stats[0].exists);
+  CPPUNIT_ASSERT(!stats[1].exists);
+  CPPUNIT_ASSERT(stats[2].exists && stats[2].size == 10);
+  CPPUNIT_ASSERT(!stats[3].exists);
+}
@@ -0,0 +1,20 @@
+#include "helpers/test_fixture.h"
+
+class test_resume : public test_fixture {
+  CPPUNIT_TEST_SUITE(test_resume);
+
+  CPPUNIT_TEST(test_stat_files);
+  CPPUNIT_TEST(test_stat_missing_directory);
+
+  CPPUNIT_TEST_SUITE_END();
+
+public:
+  void setUp();
+  void tearDown();
+
+  void test_stat_files();
+  void test_stat_missing_directory();
+
+private:
+  std::string m_dir;
+};
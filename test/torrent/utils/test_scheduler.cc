@@ -0,0 +1,246 @@
+#include "config.h"
+
+#include "test/torrent/utils/test_scheduler.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <vector>
+
+#include "torrent/exceptions.h"
+
+CPPUNIT_TEST_SUITE_NAMED_REGISTRATION(test_scheduler, "torrent/utils");
+
+using torrent::utils::Scheduler;
+using torrent::utils::SchedulerEntry;
+
+// Every test is run against both the heap and the timer wheel.
+#define TEST_BOTH_MODES(name)                   \
+  void                                          \
+  test_scheduler::test_##name() {               \
+    check_##name(Scheduler::MODE_HEAP);         \
+    check_##name(Scheduler::MODE_WHEEL);        \
+  }
+
+TEST_BOTH_MODES(basic)
+TEST_BOTH_MODES(erase)
+TEST_BOTH_MODES(update)
+TEST_BOTH_MODES(order)
+TEST_BOTH_MODES(long_timers)
+TEST_BOTH_MODES(erase_in_slot)
+
+static const auto test_epoch = std::chrono::microseconds(365 * 24h) + 1000h;
+
+#define SCHEDULER_SETUP(mode)                                   \
+  torrent::utils::ExternalScheduler scheduler;                  \
+  scheduler.set_mode(mode);                                     \
+  scheduler.external_set_cached_time(test_epoch);               \
+                                                                \
+  std::vector<int> called;                                      \
+  auto perform = [&](std::chrono::microseconds t) {             \
+      scheduler.external_set_cached_time(test_epoch + t);       \
+      scheduler.external_perform(test_epoch + t);               \
+    };
+
+#define SCHEDULER_ENTRY(name, value)                            \
+  SchedulerEntry name;                                          \
+  name.slot() = [&called]() { called.push_back(value); };
+
+void
+test_scheduler::check_basic(Scheduler::mode_type mode) {
+  SCHEDULER_SETUP(mode);
+  SCHEDULER_ENTRY(entry_1, 1);
+  SCHEDULER_ENTRY(entry_2, 2);
+  SCHEDULER_ENTRY(entry_3, 3);
+
+  CPPUNIT_ASSERT(scheduler.empty());
+
+  scheduler.wait_for(&entry_1, 10ms);
+  scheduler.wait_for(&entry_2, 5ms);
+  scheduler.wait_for(&entry_3, 2s);
+
+  CPPUNIT_ASSERT(scheduler.size() == 3);
+  CPPUNIT_ASSERT(entry_1.scheduler() == &scheduler);
+  CPPUNIT_ASSERT(entry_1.time() == test_epoch + 10ms);
+  CPPUNIT_ASSERT(scheduler.next_timeout() == 5ms);
+
+  perform(4999us);
+  CPPUNIT_ASSERT(called.empty());
+
+  perform(5ms);
+  CPPUNIT_ASSERT(called == std::vector<int>({2}));
+  CPPUNIT_ASSERT(!entry_2.is_scheduled());
+  CPPUNIT_ASSERT(entry_2.time() == std::chrono::microseconds());
+  CPPUNIT_ASSERT(scheduler.next_timeout() == 5ms);
+
+  perform(1s);
+  CPPUNIT_ASSERT(called == std::vector<int>({2, 1}));
+  CPPUNIT_ASSERT(scheduler.next_timeout() == 1s);
+
+  perform(3s);
+  CPPUNIT_ASSERT(called == std::vector<int>({2, 1, 3}));
+  CPPUNIT_ASSERT(scheduler.empty());
+}
+
+void
+test_scheduler::check_erase(Scheduler::mode_type mode) {
+  SCHEDULER_SETUP(mode);
+  SCHEDULER_ENTRY(entry_1, 1);
+  SCHEDULER_ENTRY(entry_2, 2);
+  SCHEDULER_ENTRY(entry_3, 3);
+
+  scheduler.erase(&entry_1);
+
+  scheduler.wait_for(&entry_1, 10ms);
+  scheduler.wait_for(&entry_2, 10ms);
+  scheduler.wait_for(&entry_3, 20s);
+
+  scheduler.erase(&entry_1);
+  CPPUNIT_ASSERT(!entry_1.is_scheduled());
+  CPPUNIT_ASSERT(scheduler.size() == 2);
+
+  scheduler.erase(&entry_3);
+  CPPUNIT_ASSERT(scheduler.next_timeout() == 10ms);
+
+  CPPUNIT_ASSERT_THROW(scheduler.wait_for(&entry_2, 1s), torrent::internal_error);
+
+  perform(1min);
+  CPPUNIT_ASSERT(called == std::vector<int>({2}));
+  CPPUNIT_ASSERT(scheduler.empty());
+}
+
+void
+test_scheduler::check_update(Scheduler::mode_type mode) {
+  SCHEDULER_SETUP(mode);
+  SCHEDULER_ENTRY(entry_1, 1);
+  SCHEDULER_ENTRY(entry_2, 2);
+
+  scheduler.update_wait_for(&entry_1, 10s);
+  scheduler.update_wait_for(&entry_2, 20s);
+  CPPUNIT_ASSERT(scheduler.next_timeout() == 10s);
+
+  scheduler.update_wait_for(&entry_1, 30s);
+  CPPUNIT_ASSERT(scheduler.next_timeout() == 20s);
+
+  scheduler.update_wait_for(&entry_2, 1ms);
+  CPPUNIT_ASSERT(scheduler.next_timeout() == 1ms);
+  CPPUNIT_ASSERT(scheduler.size() == 2);
+
+  perform(25s);
+  CPPUNIT_ASSERT(called == std::vector<int>({2}));
+
+  scheduler.update_wait_for_ceil_seconds(&entry_1, 500ms);
+  CPPUNIT_ASSERT(entry_1.time() == test_epoch + 26s);
+
+  perform(26s);
+  CPPUNIT_ASSERT(called == std::vector<int>({2, 1}));
+  CPPUNIT_ASSERT(scheduler.empty());
+}
+
+void
+test_scheduler::check_order(Scheduler::mode_type mode) {
+  SCHEDULER_SETUP(mode);
+
+  std::vector<std::chrono::microseconds> times;
+  std::vector<SchedulerEntry> entries(1000);
+
+  std::srand(1);
+
+  for (int i = 0; i < 1000; i++) {
+    // Mix entries in the same tick with entries spread over the levels.
+    auto t = i % 2 ? std::chrono::microseconds(std::rand() % 3000) : std::chrono::microseconds(std::rand() % 100000000);
+
+    times.push_back(t);
+    entries[i].slot() = [&called, i]() { called.push_back(i); };
+    scheduler.wait_for(&entries[i], t);
+  }
+
+  for (auto t = 0s; t <= 100s; t += 7s)
+    perform(t);
+
+  perform(101s);
+
+  CPPUNIT_ASSERT(called.size() == 1000);
+  CPPUNIT_ASSERT(std::is_sorted(called.begin(), called.end(), [&times](int a, int b) { return times[a] < times[b]; }));
+  CPPUNIT_ASSERT(scheduler.empty());
+}
+
+void
+test_scheduler::check_long_timers(Scheduler::mode_type mode) {
+  SCHEDULER_SETUP(mode);
+  SCHEDULER_ENTRY(entry_1, 1);
+  SCHEDULER_ENTRY(entry_2, 2);
+  SCHEDULER_ENTRY(entry_3, 3);
+
+  // Beyond the range of the wheel levels.
+  scheduler.wait_for(&entry_1, 24h * 100);
+  scheduler.wait_for(&entry_2, 5h);
+  scheduler.wait_for(&entry_3, 24h * 3000);
+
+  CPPUNIT_ASSERT(scheduler.next_timeout() == 5h);
+
+  perform(5h);
+  CPPUNIT_ASSERT(called == std::vector<int>({2}));
+  CPPUNIT_ASSERT(scheduler.next_timeout() == 24h * 100 - 5h);
+
+  perform(24h * 100 - 1us);
+  CPPUNIT_ASSERT(called == std::vector<int>({2}));
+
+  perform(24h * 100);
+  CPPUNIT_ASSERT(called == std::vector<int>({2, 1}));
+
+  perform(24h * 3000);
+  CPPUNIT_ASSERT(called == std::vector<int>({2, 1, 3}));
+  CPPUNIT_ASSERT(scheduler.empty());
+}
+
+void
+test_scheduler::check_erase_in_slot(Scheduler::mode_type mode) {
+  SCHEDULER_SETUP(mode);
+  SCHEDULER_ENTRY(entry_2, 2);
+  SCHEDULER_ENTRY(entry_3, 3);
+  SCHEDULER_ENTRY(entry_4, 4);
+
+  SchedulerEntry entry_1;
+
+  // Entries due in the same perform can erase or reschedule each other.
+  entry_1.slot() = [&]() {
+      called.push_back(1);
+      scheduler.erase(&entry_2);
+      scheduler.update_wait_for(&entry_3, 1s);
+      scheduler.wait_for(&entry_4, 0ms);
+    };
+
+  scheduler.wait_for(&entry_1, 1ms);
+  scheduler.wait_for(&entry_2, 2ms);
+  scheduler.wait_for(&entry_3, 3ms);
+
+  perform(10ms);
+  CPPUNIT_ASSERT(called == std::vector<int>({1, 4}));
+  CPPUNIT_ASSERT(scheduler.size() == 1);
+  CPPUNIT_ASSERT(scheduler.next_timeout() == 1s);
+
+  perform(1010ms);
+  CPPUNIT_ASSERT(called == std::vector<int>({1, 4, 3}));
+  CPPUNIT_ASSERT(scheduler.empty());
+}
+
+void
+test_scheduler::test_set_mode() {
+  torrent::utils::ExternalScheduler scheduler;
+  scheduler.external_set_cached_time(test_epoch);
+
+  CPPUNIT_ASSERT(scheduler.mode() == Scheduler::MODE_HEAP);
+
+  scheduler.set_mode(Scheduler::MODE_WHEEL);
+  CPPUNIT_ASSERT(scheduler.mode() == Scheduler::MODE_WHEEL);
+
+  SchedulerEntry entry;
+  entry.slot() = []() {};
+
+  scheduler.wait_for(&entry, 1s);
+  CPPUNIT_ASSERT_THROW(scheduler.set_mode(Scheduler::MODE_HEAP), torrent::internal_error);
+
+  scheduler.erase(&entry);
+  scheduler.set_mode(Scheduler::MODE_HEAP);
+  CPPUNIT_ASSERT(scheduler.mode() == Scheduler::MODE_HEAP);
+}
@@ -0,0 +1,34 @@
+#include "helpers/test_fixture.h"
+
+#include "torrent/utils/scheduler.h"
+
+class test_scheduler : public test_fixture {
+  CPPUNIT_TEST_SUITE(test_scheduler);
+
+  CPPUNIT_TEST(test_basic);
+  CPPUNIT_TEST(test_erase);
+  CPPUNIT_TEST(test_update);
+  CPPUNIT_TEST(test_order);
+  CPPUNIT_TEST(test_long_timers);
+  CPPUNIT_TEST(test_erase_in_slot);
+  CPPUNIT_TEST(test_set_mode);
+
+  CPPUNIT_TEST_SUITE_END();
+
+public:
+  void test_basic();
+  void test_erase();
+  void test_update();
+  void test_order();
+  void test_long_timers();
+  void test_erase_in_slot();
+  void test_set_mode();
+
+private:
+  void check_basic(torrent::utils::Scheduler::mode_type mode);
+  void check_erase(torrent::utils::Scheduler::mode_type mode);
+  void check_update(torrent::utils::Scheduler::mode_type mode);
+  void check_order(torrent::utils::Scheduler::mode_type mode);
+  void check_long_timers(torrent::utils::Scheduler::mode_type mode);
+  void check_erase_in_slot(torrent::utils::Scheduler::mode_type mode);
+};
@@ -0,0 +1,296 @@
+#include "config.h"
+
+#include "test_session_store.h"
+
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "torrent/exceptions.h"
+#include "torrent/utils/session_store.h"
+
+CPPUNIT_TEST_SUITE_NAMED_REGISTRATION(test_session_store, "torrent/utils");
+
+namespace {
+
+torrent::HashString
+make_hash(char c) {
+  torrent::HashString hash;
+  hash.clear(c);
+  return hash;
+}
+
+std::string
+read_section(const torrent::SessionStore& store, const torrent::HashString& hash, torrent::SessionStore::section_type section) {
+  std::string data;
+
+  if (!store.read(hash, section, data))
+    return "<none>";
+
+  return data;
+}
+
+void
+write_section(torrent::SessionStore& store, const torrent::HashString& hash, torrent::SessionStore::section_type section, const std::string& data) {
+  store.write(hash, section, data.data(), data.size());
+}
+
+}
+
+void
+test_session_store::setUp() {
+  test_fixture::setUp();
+
+  char dir[] = "/tmp/libtorrent_test_session_store.XXXXXX";
+  CPPUNIT_ASSERT(mkdtemp(dir) != nullptr);
+
+  m_dir = dir;
+  m_path = m_dir + "/session";
+}
+
+void
+test_session_store::tearDown() {
+  unlink(m_path.c_str());
+  unlink((m_path + ".tmp").c_str());
+  rmdir(m_dir.c_str());
+
+  test_fixture::tearDown();
+}
+
+void
+test_session_store::test_write_read() {
+  torrent::SessionStore store;
+  store.open(m_path);
+
+  CPPUNIT_ASSERT(store.is_open());
+  CPPUNIT_ASSERT(store.size() == 0);
+
+  write_section(store, make_hash('a'), torrent::SessionStore::section_bitfield, "bits");
+  write_section(store, make_hash('a'), torrent::SessionStore::section_peers, "");
+  write_section(store, make_hash('b'), torrent::SessionStore::section_file_priorities, "prio");
+
+  CPPUNIT_ASSERT(store.size() == 2);
+  CPPUNIT_ASSERT(store.has(make_hash('a')) && !store.has(make_hash('c')));
+
+  CPPUNIT_ASSERT(read_section(store, make_hash('a'), torrent::SessionStore::section_bitfield) == "bits");
+  CPPUNIT_ASSERT(read_section(store, make_hash('a'), torrent::SessionStore::section_peers) == "");
+  CPPUNIT_ASSERT(read_section(store, make_hash('a'), torrent::SessionStore::section_file_priorities) == "<none>");
+  CPPUNIT_ASSERT(read_section(store, make_hash('b'), torrent::SessionStore::section_file_priorities) == "prio");
+
+  write_section(store, make_hash('a'), torrent::SessionStore::section_bitfield, "bits2");
+  CPPUNIT_ASSERT(read_section(store, make_hash('a'), torrent::SessionStore::section_bitfield) == "bits2");
+
+  CPPUNIT_ASSERT_THROW(store.write(make_hash('a'), torrent::SessionStore::section_count, "", 0), torrent::input_error);
+}
+
+void
+test_session_store::test_unchanged() {
+  torrent::SessionStore store;
+  store.open(m_path);
+
+  write_section(store, make_hash('a'), torrent::SessionStore::section_bitfield, "bits");
+  write_section(store, make_hash('a'), torrent::SessionStore::section_peers, "");
+
+  uint64_t length = store.length();
+
+  write_section(store, make_hash('a'), torrent::SessionStore::section_bitfield, "bits");
+  write_section(store, make_hash('a'), torrent::SessionStore::section_peers, "");
+  CPPUNIT_ASSERT(store.length() == length);
+
+  write_section(store, make_hash('a'), torrent::SessionStore::section_bitfield, "bitz");
+  CPPUNIT_ASSERT(store.length() > length);
+  CPPUNIT_ASSERT(store.live_length() == length - sizeof(torrent::SessionStore::header_type));
+}
+
+void
+test_session_store::test_erase() {
+  torrent::SessionStore store;
+  store.open(m_path);
+
+  write_section(store, make_hash('a'), torrent::SessionStore::section_bitfield, "bits");
+  write_section(store, make_hash('b'), torrent::SessionStore::section_bitfield, "bits");
+
+  uint64_t live = store.live_length();
+
+  store.erase(make_hash('a'));
+  store.erase(make_hash('c'));
+
+  CPPUNIT_ASSERT(store.size() == 1 && !store.has(make_hash('a')));
+  CPPUNIT_ASSERT(store.live_length() == live / 2);
+
+  store.close();
+  store.open(m_path);
+
+  CPPUNIT_ASSERT(store.size() == 1 && !store.has(make_hash('a')) && store.has(make_hash('b')));
+  CPPUNIT_ASSERT(store.live_length() == live / 2);
+}
+
+void
+test_session_store::test_reopen() {
+  {
+    torrent::SessionStore store;
+    store.open(m_path);
+
+    write_section(store, make_hash('a'), torrent::SessionStore::section_bitfield, "bits");
+    write_section(store, make_hash('a'), torrent::SessionStore::section_bitfield, "bits2");
+    write_section(store, make_hash('b'), torrent::SessionStore::section_peers, "peers");
+  }
+
+  torrent::SessionStore store;
+  store.open(m_path);
+
+  CPPUNIT_ASSERT(store.size() == 2);
+  CPPUNIT_ASSERT(read_section(store, make_hash('a'), torrent::SessionStore::section_bitfield) == "bits2");
+  CPPUNIT_ASSERT(read_section(store, make_hash('b'), torrent::SessionStore::section_peers) == "peers");
+  CPPUNIT_ASSERT(store.length() == store.committed_length());
+}
+
+// Records written after the last checkpoint are lost when the process
+// dies, here simulated by copying the file before closing.
+void
+test_session_store::test_uncommitted() {
+  std::string copy_path = m_path + ".copy";
+
+  {
+    torrent::SessionStore store;
+    store.open(m_path);
+
+    write_section(store, make_hash('a'), torrent::SessionStore::section_bitfield, "bits");
+    store.checkpoint();
+
+    write_section(store, make_hash('a'), torrent::SessionStore::section_bitfield, "bits2");
+    write_section(store, make_hash('b'), torrent::SessionStore::section_bitfield, "bits");
+
+    CPPUNIT_ASSERT(system(("cp " + m_path + " " + copy_path).c_str()) == 0);
+  }
+
+  torrent::SessionStore store;
+  store.open(copy_path);
+
+  CPPUNIT_ASSERT(store.size() == 1);
+  CPPUNIT_ASSERT(read_section(store, make_hash('a'), torrent::SessionStore::section_bitfield) == "bits");
+
+  store.close();
+  unlink(copy_path.c_str());
+}
+
+// A damaged record drops it and everything after it.
+void
+test_session_store::test_damaged() {
+  uint64_t offset;
+
+  {
+    torrent::SessionStore store;
+    store.open(m_path);
+
+    write_section(store, make_hash('a'), torrent::SessionStore::section_bitfield, "bits");
+    offset = store.length();
+    write_section(store, make_hash('b'), torrent::SessionStore::section_bitfield, "bits");
+    write_section(store, make_hash('c'), torrent::SessionStore::section_bitfield, "bits");
+  }
+
+  int fd = open(m_path.c_str(), O_WRONLY);
+  CPPUNIT_ASSERT(fd != -1);
+  CPPUNIT_ASSERT(pwrite(fd, "x", 1, offset + sizeof(torrent::SessionStore::record_header_type)) == 1);
+  close(fd);
+
+  torrent::SessionStore store;
+  store.open(m_path);
+
+  CPPUNIT_ASSERT(store.size() == 1 && store.has(make_hash('a')));
+  CPPUNIT_ASSERT(store.length() == offset);
+
+  write_section(store, make_hash('d'), torrent::SessionStore::section_bitfield, "bits");
+  store.close();
+  store.open(m_path);
+
+  CPPUNIT_ASSERT(store.size() == 2 && store.has(make_hash('d')));
+}
+
+void
+test_session_store::test_compact() {
+  torrent::SessionStore store;
+  store.open(m_path);
+
+  std::string data(1000, 'x');
+
+  for (int i = 0; i != 2000; i++) {
+    data[0] = static_cast<char>(i);
+    write_section(store, make_hash('a' + i % 4), torrent::SessionStore::section_bitfield, data);
+  }
+
+  CPPUNIT_ASSERT(store.length() > torrent::SessionStore::min_compact_length);
+
+  store.checkpoint();
+
+  CPPUNIT_ASSERT(store.size() == 4);
+  CPPUNIT_ASSERT(store.length() == sizeof(torrent::SessionStore::header_type) + store.live_length());
+  CPPUNIT_ASSERT(store.length() == store.committed_length());
+  CPPUNIT_ASSERT(access((m_path + ".tmp").c_str(), F_OK) == -1);
+
+  data[0] = static_cast<char>(1999);
+  CPPUNIT_ASSERT(read_section(store, make_hash('d'), torrent::SessionStore::section_bitfield) == data);
+
+  store.close();
+  store.open(m_path);
+
+  CPPUNIT_ASSERT(store.size() == 4);
+  CPPUNIT_ASSERT(read_section(store, make_hash('d'), torrent::SessionStore::section_bitfield) == data);
+}
+
+void
+test_session_store::test_grow() {
+  torrent::SessionStore store;
+  store.open(m_path);
+
+  std::string data(4000, 'x');
+
+  for (int i = 0; i != 1000; i++) {
+    torrent::HashString hash;
+    hash.clear();
+    std::memcpy(hash.data(), &i, sizeof(i));
+
+    write_section(store, hash, torrent::SessionStore::section_file_priorities, data);
+  }
+
+  CPPUNIT_ASSERT(store.size() == 1000);
+  CPPUNIT_ASSERT(store.length() > torrent::SessionStore::min_capacity);
+
+  store.close();
+  store.open(m_path);
+
+  CPPUNIT_ASSERT(store.size() == 1000);
+  CPPUNIT_ASSERT(read_section(store, store.hashes().back(), torrent::SessionStore::section_file_priorities) == data);
+}
+
+void
+test_session_store::test_read_while_growing() {
+  torrent::SessionStore store;
+  store.open(m_path);
+
+  write_section(store, make_hash('a'), torrent::SessionStore::section_peers, "peers");
+
+  std::string held;
+  CPPUNIT_ASSERT(store.read(make_hash('a'), torrent::SessionStore::section_peers, held));
+
+  // Grow the log past its initial capacity so that it is remapped.
+  std::string data(4000, 'x');
+
+  for (int i = 0; i != 1000; i++) {
+    torrent::HashString hash;
+    hash.clear();
+    std::memcpy(hash.data(), &i, sizeof(i));
+
+    write_section(store, hash, torrent::SessionStore::section_file_priorities, data);
+  }
+
+  CPPUNIT_ASSERT(store.length() > torrent::SessionStore::min_capacity);
+  CPPUNIT_ASSERT(held == "peers");
+
+  store.erase(make_hash('a'));
+  store.checkpoint();
+
+  CPPUNIT_ASSERT(held == "peers");
+}
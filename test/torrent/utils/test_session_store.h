@@ -0,0 +1,35 @@
+#include "helpers/test_fixture.h"
+
+class test_session_store : public test_fixture {
+  CPPUNIT_TEST_SUITE(test_session_store);
+
+  CPPUNIT_TEST(test_write_read);
+  CPPUNIT_TEST(test_unchanged);
+  CPPUNIT_TEST(test_erase);
+  CPPUNIT_TEST(test_reopen);
+  CPPUNIT_TEST(test_uncommitted);
+  CPPUNIT_TEST(test_damaged);
+  CPPUNIT_TEST(test_compact);
+  CPPUNIT_TEST(test_grow);
+  CPPUNIT_TEST(test_read_while_growing);
+
+  CPPUNIT_TEST_SUITE_END();
+
+public:
+  void setUp();
+  void tearDown();
+
+  void test_write_read();
+  void test_unchanged();
+  void test_erase();
+  void test_reopen();
+  void test_uncommitted();
+  void test_damaged();
+  void test_compact();
+  void test_grow();
+  void test_read_while_growing();
+
+private:
+  std::string m_dir;
+  std::string m_path;
+};
@@ -48,6 +48,32 @@ TestSignalInterrupt::test_basic() {
   }
 }
 
+void
+TestSignalInterrupt::test_single() {
+  mock_redirect_defaults();
+
+  auto interrupt = torrent::SignalInterrupt::create();
+
+  CPPUNIT_ASSERT(interrupt != nullptr);
+  CPPUNIT_ASSERT(interrupt->file_descriptor() >= 0);
+
+  for (int i = 0; i < 10; i++) {
+    CPPUNIT_ASSERT(!interrupt->is_poking());
+    CPPUNIT_ASSERT(!check_event_is_readable(interrupt.get(), 0ms));
+
+    // Pokes are coalesced until read.
+    interrupt->poke();
+    interrupt->poke();
+
+    CPPUNIT_ASSERT(interrupt->is_poking());
+    CPPUNIT_ASSERT(check_event_is_readable(interrupt.get(), 1ms));
+
+    interrupt->event_read();
+
+    CPPUNIT_ASSERT(!check_event_is_readable(interrupt.get(), 0ms));
+  }
+}
+
 // TODO: Add some allowance for loop_count checks not being ready after 1ms.
 
 void
@@ -7,6 +7,7 @@ class TestSignalInterrupt : public test_fixture {
   CPPUNIT_TEST_SUITE(TestSignalInterrupt);
 
   CPPUNIT_TEST(test_basic);
+  CPPUNIT_TEST(test_single);
   CPPUNIT_TEST(test_thread_interrupt);
   CPPUNIT_TEST(test_latency);
   CPPUNIT_TEST(test_hammer);
@@ -15,6 +16,7 @@ class TestSignalInterrupt : public test_fixture {
 
 public:
   void test_basic();
+  void test_single();
   void test_thread_interrupt();
   void test_latency();
   void test_hammer();
@@ -0,0 +1,55 @@
+#include "config.h"
+
+#include "test_siphash.h"
+
+#include "utils/siphash.h"
+
+CPPUNIT_TEST_SUITE_NAMED_REGISTRATION(test_siphash, "torrent/utils");
+
+using torrent::SipHash;
+
+namespace {
+
+// Reference outputs from the SipHash paper's test vectors, key bytes
+// 00..0f and message bytes 00..(length-1).
+const uint64_t vectors[] = {
+  0x726fdb47dd0e0e31ull, 0x74f839c593dc67fdull, 0x0d6c8009d9a94f5aull, 0x85676696d7fb7e2dull,
+  0xcf2794e0277187b7ull, 0x18765564cd99a68dull, 0xcbc9466e58fee3ceull, 0xab0200f58b01d137ull,
+  0x93f5f5799a932462ull, 0x9e0082df0ba9e4b0ull, 0x7a5dbbc594ddb9f3ull, 0xf4b32f46226bada7ull,
+  0x751e8fbc860ee5fbull, 0x14ea5627c0843d90ull, 0xf723ca908e7af2eeull, 0xa129ca6149be45e5ull,
+  0x3f2acc7f57c29bdbull,
+};
+
+SipHash
+reference_key() {
+  char key[16];
+
+  for (int i = 0; i < 16; i++)
+    key[i] = i;
+
+  return SipHash(key);
+}
+
+}
+
+void
+test_siphash::test_vectors() {
+  SipHash hash = reference_key();
+  char message[sizeof(vectors) / sizeof(vectors[0])];
+
+  for (unsigned int i = 0; i < sizeof(message); i++)
+    message[i] = i;
+
+  for (unsigned int i = 0; i < sizeof(message); i++)
+    CPPUNIT_ASSERT(hash.hash(message, i) == vectors[i]);
+}
+
+void
+test_siphash::test_key() {
+  SipHash hash = reference_key();
+  uint32_t address = 0x0100000a;
+
+  CPPUNIT_ASSERT(hash.hash(&address, sizeof(address)) == SipHash(0x0706050403020100ull, 0x0f0e0d0c0b0a0908ull).hash(&address, sizeof(address)));
+  CPPUNIT_ASSERT(hash.hash(&address, sizeof(address)) != SipHash(0x0706050403020100ull, 0x0f0e0d0c0b0a0909ull).hash(&address, sizeof(address)));
+  CPPUNIT_ASSERT(hash.hash(&address, sizeof(address)) != hash.hash(&address, sizeof(address) - 1));
+}
@@ -0,0 +1,90 @@
+#include "config.h"
+
+#include "test_spsc_queue.h"
+
+#include <memory>
+#include <thread>
+
+#include "torrent/exceptions.h"
+#include "utils/spsc_queue.h"
+
+CPPUNIT_TEST_SUITE_NAMED_REGISTRATION(test_spsc_queue, "torrent/utils");
+
+void
+test_spsc_queue::test_basic() {
+  CPPUNIT_ASSERT_THROW(torrent::spsc_queue<int>(0), torrent::internal_error);
+
+  torrent::spsc_queue<std::unique_ptr<int>> queue(5);
+
+  CPPUNIT_ASSERT(queue.capacity() == 8);
+  CPPUNIT_ASSERT(queue.empty() && !queue.try_pop());
+
+  for (int i = 0; i != 3; i++)
+    CPPUNIT_ASSERT(queue.try_push(std::make_unique<int>(i)));
+
+  CPPUNIT_ASSERT(queue.size() == 3 && queue.max_size() == 3);
+
+  for (int i = 0; i != 3; i++) {
+    auto value = queue.try_pop();
+    CPPUNIT_ASSERT(value && **value == i);
+  }
+
+  CPPUNIT_ASSERT(queue.empty() && queue.max_size() == 3);
+}
+
+void
+test_spsc_queue::test_full() {
+  torrent::spsc_queue<std::unique_ptr<int>> queue(4);
+
+  for (int i = 0; i != 4; i++)
+    CPPUNIT_ASSERT(queue.try_push(std::make_unique<int>(i)));
+
+  // A failed push leaves the value to the caller.
+  auto value = std::make_unique<int>(4);
+
+  CPPUNIT_ASSERT(!queue.try_push(std::move(value)));
+  CPPUNIT_ASSERT(value && *value == 4);
+
+  CPPUNIT_ASSERT(**queue.try_pop() == 0);
+  CPPUNIT_ASSERT(queue.try_push(std::move(value)));
+
+  for (int i = 1; i != 5; i++)
+    CPPUNIT_ASSERT(**queue.try_pop() == i);
+
+  CPPUNIT_ASSERT(queue.empty() && queue.max_size() == 4);
+}
+
+void
+test_spsc_queue::test_threads() {
+  constexpr unsigned int count = 100000;
+
+  torrent::spsc_queue<unsigned int> queue(64);
+
+  std::thread producer([&queue] {
+      for (unsigned int i = 0; i != count;)
+        if (queue.try_push(std::move(i)))
+          i++;
+        else
+          std::this_thread::yield();
+    });
+
+  unsigned int next = 0;
+  bool         in_order = true;
+
+  while (next != count) {
+    auto value = queue.try_pop();
+
+    if (!value) {
+      std::this_thread::yield();
+      continue;
+    }
+
+    in_order = in_order && *value == next;
+    next++;
+  }
+
+  producer.join();
+
+  CPPUNIT_ASSERT(in_order);
+  CPPUNIT_ASSERT(queue.empty() && queue.max_size() <= 64);
+}
@@ -0,0 +1,16 @@
+#include "helpers/test_fixture.h"
+
+class test_spsc_queue : public test_fixture {
+  CPPUNIT_TEST_SUITE(test_spsc_queue);
+
+  CPPUNIT_TEST(test_basic);
+  CPPUNIT_TEST(test_full);
+  CPPUNIT_TEST(test_threads);
+
+  CPPUNIT_TEST_SUITE_END();
+
+public:
+  void test_basic();
+  void test_full();
+  void test_threads();
+};
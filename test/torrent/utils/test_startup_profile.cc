@@ -0,0 +1,105 @@
+#include "config.h"
+
+#include "test_startup_profile.h"
+
+#include <thread>
+
+#include "torrent/exceptions.h"
+#include "torrent/utils/chrono.h"
+#include "torrent/utils/startup_profile.h"
+
+CPPUNIT_TEST_SUITE_NAMED_REGISTRATION(test_startup_profile, "torrent/utils");
+
+using namespace torrent::utils;
+
+void
+test_startup_profile::setUp() {
+  test_fixture::setUp();
+  startup_profile_clear();
+}
+
+void
+test_startup_profile::test_report() {
+  startup_record(std::string(), startup_initialize, 5ms);
+
+  for (int i = 0; i != 5; i++) {
+    std::string key(20, 'a' + i);
+
+    startup_record(key, startup_parse, std::chrono::milliseconds(i));
+    startup_record(key, startup_resume, 1ms);
+    startup_record(key, startup_resume, 1ms);
+  }
+
+  auto report = startup_profile_report(3);
+
+  CPPUNIT_ASSERT(report.downloads == 5);
+  CPPUNIT_ASSERT(report.phase_time[startup_initialize] == 5ms && report.phase_count[startup_initialize] == 1);
+  CPPUNIT_ASSERT(report.phase_time[startup_parse] == 10ms && report.phase_count[startup_parse] == 4);
+  CPPUNIT_ASSERT(report.phase_time[startup_resume] == 10ms && report.phase_count[startup_resume] == 5);
+  CPPUNIT_ASSERT(report.phase_count[startup_open] == 0);
+
+  CPPUNIT_ASSERT(report.slowest.size() == 3);
+  CPPUNIT_ASSERT(report.slowest[0].info_hash == std::string(20, 'e') && report.slowest[0].total() == 6ms);
+  CPPUNIT_ASSERT(report.slowest[1].info_hash == std::string(20, 'd'));
+  CPPUNIT_ASSERT(report.slowest[2].info_hash == std::string(20, 'c'));
+
+  CPPUNIT_ASSERT(std::string(startup_phase_name(startup_first_announce)) == "first_announce");
+  CPPUNIT_ASSERT_THROW(startup_phase_name(startup_phase_count), torrent::internal_error);
+}
+
+void
+test_startup_profile::test_begin_end() {
+  std::string key(20, 'a');
+
+  // Ending a phase that was not begun is ignored.
+  startup_end(key, startup_hash_check);
+  CPPUNIT_ASSERT(startup_profile_report().downloads == 0);
+
+  startup_begin(key, startup_hash_check);
+  std::this_thread::sleep_for(2ms);
+  startup_end(key, startup_hash_check);
+
+  auto first = startup_profile_report().phase_time[startup_hash_check];
+  CPPUNIT_ASSERT(first >= 2ms);
+
+  // Only the first reply after beginning counts.
+  std::this_thread::sleep_for(2ms);
+  startup_end(key, startup_hash_check);
+
+  CPPUNIT_ASSERT(startup_profile_report().phase_time[startup_hash_check] == first);
+}
+
+void
+test_startup_profile::test_scope_nested() {
+  std::string key(20, 'a');
+
+  {
+    startup_scope outer(key, startup_resume);
+    startup_scope inner(key, startup_resume);
+
+    std::this_thread::sleep_for(2ms);
+  }
+
+  auto report = startup_profile_report();
+
+  CPPUNIT_ASSERT(report.phase_time[startup_resume] >= 2ms && report.phase_time[startup_resume] < 4ms);
+
+  // The outer scope being done, the next one counts again.
+  {
+    startup_scope after(key, startup_open);
+    std::this_thread::sleep_for(1ms);
+  }
+
+  CPPUNIT_ASSERT(startup_profile_report().phase_time[startup_open] >= 1ms);
+}
+
+void
+test_startup_profile::test_erase() {
+  startup_record(std::string(20, 'a'), startup_open, 1ms);
+  startup_record(std::string(20, 'b'), startup_open, 1ms);
+  startup_erase(std::string(20, 'a'));
+
+  auto report = startup_profile_report();
+
+  CPPUNIT_ASSERT(report.downloads == 1 && report.slowest[0].info_hash == std::string(20, 'b'));
+}
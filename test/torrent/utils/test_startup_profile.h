@@ -0,0 +1,20 @@
+#include "helpers/test_fixture.h"
+
+class test_startup_profile : public test_fixture {
+  CPPUNIT_TEST_SUITE(test_startup_profile);
+
+  CPPUNIT_TEST(test_report);
+  CPPUNIT_TEST(test_begin_end);
+  CPPUNIT_TEST(test_scope_nested);
+  CPPUNIT_TEST(test_erase);
+
+  CPPUNIT_TEST_SUITE_END();
+
+public:
+  void setUp() override;
+
+  void test_report();
+  void test_begin_end();
+  void test_scope_nested();
+  void test_erase();
+};
@@ -5,12 +5,22 @@
 #include <functional>
 #include <future>
 #include <thread>
+#include <fcntl.h>
+#include <sys/socket.h>
 #include <unistd.h>
 
+#ifdef USE_THREAD_AFFINITY
+#include <sched.h>
+#endif
+
+#include "helpers/test_main_thread.h"
 #include "helpers/test_thread.h"
 #include "helpers/test_utils.h"
+#include "torrent/event.h"
 #include "torrent/exceptions.h"
+#include "torrent/poll.h"
 #include "torrent/utils/log.h"
+#include "torrent/utils/scheduler.h"
 #include "torrent/utils/thread.h"
 
 CPPUNIT_TEST_SUITE_NAMED_REGISTRATION(test_thread_base, "torrent/utils");
@@ -20,6 +30,22 @@ CPPUNIT_TEST_SUITE_NAMED_REGISTRATION(test_thread_base, "torrent/utils");
 
 void throw_shutdown_exception() { throw torrent::shutdown_exception(); }
 
+namespace {
+
+class stats_event : public torrent::Event {
+public:
+  stats_event(int fd) { set_file_descriptor(fd); }
+  ~stats_event() override { ::close(m_fileDesc); }
+
+  const char* type_name() const override { return "stats_test"; }
+
+  void event_read() override  { char c; while (::read(m_fileDesc, &c, 1) == 1); }
+  void event_write() override {}
+  void event_error() override {}
+};
+
+}
+
 void
 test_thread_base::test_basic() {
   auto thread = test_thread::create();
@@ -100,3 +126,200 @@ test_thread_base::test_stop() {
     }
   }
 }
+
+void
+test_thread_base::test_callbacks() {
+  auto thread = TestMainThread::create();
+
+  std::string order;
+  int target_a, target_b;
+
+  thread->callback(&target_b, [&]() { order += 'b'; });
+  thread->callback(&target_a, [&]() {
+      order += 'a';
+      thread->callback(&target_a, [&]() { order += 'c'; });
+    });
+  thread->callback_interrupt_pollling(&target_b, [&]() { order += 'i'; });
+
+  thread->test_process_callbacks();
+  CPPUNIT_ASSERT(order == "ibac");
+
+  thread->test_process_callbacks();
+  CPPUNIT_ASSERT(order == "ibac");
+}
+
+void
+test_thread_base::test_callbacks_cancel() {
+  auto thread = TestMainThread::create();
+
+  std::string order;
+  int target_a, target_b;
+
+  thread->callback(&target_a, [&]() { order += 'a'; });
+  thread->callback(&target_b, [&]() {
+      order += 'b';
+      thread->cancel_callback(&target_a);
+    });
+  thread->callback(&target_a, [&]() { order += 'a'; });
+  thread->callback(&target_b, [&]() { order += 'b'; });
+
+  thread->cancel_callback(&target_a);
+  thread->callback(&target_a, [&]() { order += 'c'; });
+
+  thread->test_process_callbacks();
+  CPPUNIT_ASSERT(order == "bb");
+
+  thread->callback(&target_a, [&]() { order += 'a'; });
+  thread->callback(&target_b, [&]() { order += 'b'; });
+  thread->cancel_callback(&target_b);
+
+  thread->test_process_callbacks();
+  CPPUNIT_ASSERT(order == "bba");
+
+  CPPUNIT_ASSERT_THROW(thread->cancel_callback(nullptr), torrent::internal_error);
+}
+
+void
+test_thread_base::test_parse_cpu_list() {
+  using torrent::utils::Thread;
+
+  CPPUNIT_ASSERT(Thread::parse_cpu_list("").empty());
+  CPPUNIT_ASSERT(Thread::parse_cpu_list("0\n") == std::vector<unsigned int>({0}));
+  CPPUNIT_ASSERT(Thread::parse_cpu_list("0-3,8,10-11") == std::vector<unsigned int>({0, 1, 2, 3, 8, 10, 11}));
+  CPPUNIT_ASSERT(Thread::parse_cpu_list("4,2-3,3") == std::vector<unsigned int>({2, 3, 4}));
+
+  CPPUNIT_ASSERT_THROW(Thread::parse_cpu_list("a"), torrent::input_error);
+  CPPUNIT_ASSERT_THROW(Thread::parse_cpu_list("1-"), torrent::input_error);
+  CPPUNIT_ASSERT_THROW(Thread::parse_cpu_list("3-1"), torrent::input_error);
+  CPPUNIT_ASSERT_THROW(Thread::parse_cpu_list("1,"), torrent::input_error);
+  CPPUNIT_ASSERT_THROW(Thread::parse_cpu_list("1,,2"), torrent::input_error);
+}
+
+void
+test_thread_base::test_placement() {
+  auto thread = test_thread::create();
+
+  thread->set_cpu_affinity({3, 1, 3});
+  CPPUNIT_ASSERT(thread->cpu_affinity() == std::vector<unsigned int>({1, 3}));
+
+  thread->set_numa_node(-5);
+  CPPUNIT_ASSERT(thread->numa_node() == -1);
+
+#ifdef USE_THREAD_AFFINITY
+  // Pin to a cpu this process is allowed to run on.
+  unsigned int cpu = sched_getcpu();
+  thread->set_cpu_affinity({cpu});
+#else
+  thread->set_cpu_affinity({});
+#endif
+
+  thread->init_thread();
+  thread->start_thread();
+
+#ifdef USE_THREAD_AFFINITY
+  CPPUNIT_ASSERT(wait_for_true([&thread, cpu]() { return thread->current_cpu() == int(cpu); }));
+#endif
+
+  CPPUNIT_ASSERT_THROW(thread->set_cpu_affinity({0}), torrent::internal_error);
+  CPPUNIT_ASSERT_THROW(thread->set_numa_node(0), torrent::internal_error);
+
+  thread->stop_thread_wait();
+}
+
+void
+test_thread_base::test_stats_callbacks() {
+  using torrent::utils::thread_stats;
+
+  auto thread = TestMainThread::create();
+  int target;
+
+  thread->set_stats_enabled(true);
+
+  for (int i = 0; i < 3; i++)
+    thread->callback(&target, []() {});
+
+  thread->test_process_callbacks();
+  thread->test_stats_publish();
+
+  auto stats = thread->stats();
+  CPPUNIT_ASSERT(stats.callback_time.total_count() == 1);
+  CPPUNIT_ASSERT(stats.callback_depth[thread_stats::depth_bucket_index(3)] == 1);
+  CPPUNIT_ASSERT(stats.callback_depth_max == 3);
+
+  thread->clear_stats();
+  CPPUNIT_ASSERT(thread->stats().callback_time.total_count() == 0);
+
+  thread->set_stats_enabled(false);
+  thread->callback(&target, []() {});
+
+  thread->test_process_callbacks();
+  thread->test_stats_publish();
+  CPPUNIT_ASSERT(thread->stats().callback_time.total_count() == 0);
+}
+
+void
+test_thread_base::test_stats_timers() {
+  set_create_poll();
+
+  auto thread = TestMainThread::create();
+  thread->init_thread();
+  thread->set_stats_enabled(true);
+
+  torrent::utils::SchedulerEntry entry;
+  entry.slot() = []() {};
+
+  thread->test_set_cached_time(0s);
+  torrent::this_thread::scheduler()->wait_for(&entry, 1s);
+
+  thread->test_set_cached_time(1s + 5ms);
+  thread->test_process_events_without_cached_time();
+  thread->test_stats_publish();
+
+  auto lateness = thread->stats().timer_lateness;
+  CPPUNIT_ASSERT(lateness.total_count() == 1);
+  CPPUNIT_ASSERT(lateness.total() == 5ms);
+  CPPUNIT_ASSERT(lateness.count(lateness.bucket_index(5ms)) == 1);
+}
+
+void
+test_thread_base::test_stats_handlers() {
+  set_create_poll();
+
+  auto thread = TestMainThread::create();
+  thread->init_thread();
+  thread->set_stats_enabled(true);
+
+  int fds[2];
+  CPPUNIT_ASSERT(::socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == 0);
+  CPPUNIT_ASSERT(::fcntl(fds[0], F_SETFL, O_NONBLOCK) == 0);
+
+  stats_event event(fds[0]);
+
+  thread->poll()->open(&event);
+  thread->poll()->insert_read(&event);
+
+  CPPUNIT_ASSERT(::write(fds[1], "data", 4) == 4);
+  thread->poll()->do_poll(0);
+  thread->test_stats_publish();
+
+  auto stats = thread->stats();
+  CPPUNIT_ASSERT(stats.handler_time.size() == 1);
+  CPPUNIT_ASSERT(stats.handler_time["stats_test"].total_count() == 1);
+
+  thread->poll()->remove_read(&event);
+  thread->poll()->close(&event);
+  ::close(fds[1]);
+}
+
+void
+test_thread_base::test_stats_loop() {
+  auto thread = test_thread::create();
+
+  thread->set_stats_enabled(true);
+  thread->init_thread();
+  thread->start_thread();
+
+  CPPUNIT_ASSERT(wait_for_true([&thread]() { thread->interrupt(); return thread->stats().loop_time.total_count() >= 2; }));
+
+  thread->stop_thread_wait();
+}
@@ -9,6 +9,17 @@ class test_thread_base : public test_fixture {
   CPPUNIT_TEST(test_interrupt);
   CPPUNIT_TEST(test_stop);
 
+  CPPUNIT_TEST(test_callbacks);
+  CPPUNIT_TEST(test_callbacks_cancel);
+
+  CPPUNIT_TEST(test_parse_cpu_list);
+  CPPUNIT_TEST(test_placement);
+
+  CPPUNIT_TEST(test_stats_callbacks);
+  CPPUNIT_TEST(test_stats_timers);
+  CPPUNIT_TEST(test_stats_handlers);
+  CPPUNIT_TEST(test_stats_loop);
+
   CPPUNIT_TEST_SUITE_END();
 
 public:
@@ -18,4 +29,15 @@ public:
   void test_interrupt();
   void test_interrupt_legacy();
   void test_stop();
+
+  void test_callbacks();
+  void test_callbacks_cancel();
+
+  void test_parse_cpu_list();
+  void test_placement();
+
+  void test_stats_callbacks();
+  void test_stats_timers();
+  void test_stats_handlers();
+  void test_stats_loop();
 };
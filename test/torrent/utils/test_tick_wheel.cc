@@ -0,0 +1,102 @@
+#include "config.h"
+
+#include "test_tick_wheel.h"
+
+#include <algorithm>
+#include <vector>
+
+#include "torrent/exceptions.h"
+#include "utils/tick_wheel.h"
+
+CPPUNIT_TEST_SUITE_NAMED_REGISTRATION(test_tick_wheel, "torrent/utils");
+
+void
+test_tick_wheel::test_spread() {
+  torrent::TickWheel wheel(30s, 3);
+
+  CPPUNIT_ASSERT(wheel.interval() == 10s);
+
+  std::vector<int>      keys(6);
+  std::vector<uint32_t> rounds(6, 0);
+
+  for (int i = 0; i < 6; i++)
+    wheel.insert(&keys[i], [&rounds, i](uint32_t round) { rounds[i] = round; });
+
+  CPPUNIT_ASSERT_THROW(wheel.insert(&keys[0], [](uint32_t) {}), torrent::internal_error);
+
+  CPPUNIT_ASSERT(wheel.size() == 6);
+  CPPUNIT_ASSERT(wheel.bucket_size(0) == 2);
+  CPPUNIT_ASSERT(wheel.bucket_size(1) == 2);
+  CPPUNIT_ASSERT(wheel.bucket_size(2) == 2);
+
+  // Each step only ticks the members of one bucket.
+  wheel.step();
+  CPPUNIT_ASSERT(std::count(rounds.begin(), rounds.end(), 1) == 2);
+
+  wheel.step();
+  wheel.step();
+  CPPUNIT_ASSERT(std::count(rounds.begin(), rounds.end(), 1) == 6);
+  CPPUNIT_ASSERT(wheel.round() == 2 && wheel.position() == 0);
+
+  wheel.erase(&keys[0]);
+  wheel.erase(&keys[0]);
+
+  for (int i = 0; i < 3; i++)
+    wheel.step();
+
+  CPPUNIT_ASSERT(rounds[0] == 1);
+  CPPUNIT_ASSERT(std::count(rounds.begin(), rounds.end(), 2) == 5);
+
+  // New members go to the emptiest bucket.
+  int key;
+  wheel.insert(&key, [](uint32_t) {});
+
+  CPPUNIT_ASSERT(wheel.bucket_size(0) == 2);
+}
+
+void
+test_tick_wheel::test_rotate() {
+  torrent::TickWheel wheel(1s, 1);
+
+  std::vector<int> keys(3);
+  std::vector<int> order;
+
+  for (int i = 0; i < 3; i++)
+    wheel.insert(&keys[i], [&order, i](uint32_t) { order.push_back(i); });
+
+  wheel.step();
+  wheel.step();
+
+  CPPUNIT_ASSERT(order == std::vector<int>({ 1, 2, 0, 2, 0, 1 }));
+}
+
+void
+test_tick_wheel::test_erase_in_walk() {
+  torrent::TickWheel wheel(1s, 1);
+
+  std::vector<int> keys(4);
+  std::vector<int> called;
+
+  // The first member to tick erases itself and the others, except the
+  // last, and inserts a new member.
+  wheel.insert(&keys[0], [&](uint32_t) { called.push_back(0); });
+  wheel.insert(&keys[1], [&](uint32_t) {
+      called.push_back(1);
+      wheel.erase(&keys[1]);
+      wheel.erase(&keys[0]);
+      wheel.erase(&keys[2]);
+      wheel.insert(&keys[3], [&](uint32_t) { called.push_back(3); });
+    });
+  wheel.insert(&keys[2], [&](uint32_t) { called.push_back(2); });
+
+  wheel.step();
+
+  CPPUNIT_ASSERT(called == std::vector<int>({ 1 }));
+  CPPUNIT_ASSERT(wheel.size() == 1);
+  CPPUNIT_ASSERT(wheel.bucket_size(0) == 1);
+
+  called.clear();
+  wheel.step();
+
+  CPPUNIT_ASSERT(called == std::vector<int>({ 3 }));
+}
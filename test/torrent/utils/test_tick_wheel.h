@@ -0,0 +1,16 @@
+#include "helpers/test_fixture.h"
+
+class test_tick_wheel : public test_fixture {
+  CPPUNIT_TEST_SUITE(test_tick_wheel);
+
+  CPPUNIT_TEST(test_spread);
+  CPPUNIT_TEST(test_rotate);
+  CPPUNIT_TEST(test_erase_in_walk);
+
+  CPPUNIT_TEST_SUITE_END();
+
+public:
+  void test_spread();
+  void test_rotate();
+  void test_erase_in_walk();
+};
@@ -0,0 +1,99 @@
+#include "config.h"
+
+#include "test_trace.h"
+
+#include <thread>
+
+#include "torrent/exceptions.h"
+#include "torrent/utils/trace.h"
+
+CPPUNIT_TEST_SUITE_NAMED_REGISTRATION(test_trace, "torrent/utils");
+
+static size_t
+count_of(const std::string& str, const std::string& pattern) {
+  size_t count = 0;
+
+  for (auto pos = str.find(pattern); pos != std::string::npos; pos = str.find(pattern, pos + 1))
+    count++;
+
+  return count;
+}
+
+void
+test_trace::tearDown() {
+  torrent::utils::trace_stop();
+  test_fixture::tearDown();
+}
+
+void
+test_trace::test_inactive() {
+  torrent::utils::trace_start();
+  torrent::utils::trace_stop();
+
+  { torrent::utils::trace_span span("ignored"); }
+
+  CPPUNIT_ASSERT(torrent::utils::trace_dump_json() == "{\"traceEvents\":[]}");
+  CPPUNIT_ASSERT_THROW(torrent::utils::trace_start(0), torrent::input_error);
+}
+
+void
+test_trace::test_spans() {
+  torrent::utils::trace_start();
+
+  { torrent::utils::trace_span span("first"); }
+  torrent::utils::trace_record("second", 100, 150);
+
+  auto json = torrent::utils::trace_dump_json();
+
+  CPPUNIT_ASSERT(json.compare(0, 16, "{\"traceEvents\":[") == 0);
+  CPPUNIT_ASSERT(json.compare(json.size() - 2, 2, "]}") == 0);
+  CPPUNIT_ASSERT(count_of(json, "\"ph\":\"M\"") == 1);
+  CPPUNIT_ASSERT(count_of(json, "\"ph\":\"X\"") == 2);
+  CPPUNIT_ASSERT(count_of(json, "\"name\":\"first\"") == 1);
+  CPPUNIT_ASSERT(count_of(json, "\"name\":\"second\"") == 1);
+  CPPUNIT_ASSERT(count_of(json, "\"ts\":100,\"dur\":50}") == 1);
+
+  // Restarting drops the previous recording.
+  torrent::utils::trace_start();
+
+  CPPUNIT_ASSERT(count_of(torrent::utils::trace_dump_json(), "\"ph\":\"X\"") == 0);
+}
+
+void
+test_trace::test_overwrite() {
+  torrent::utils::trace_start(4);
+
+  for (int i = 0; i < 10; i++)
+    torrent::utils::trace_record("span", i, i + 1);
+
+  auto json = torrent::utils::trace_dump_json();
+
+  CPPUNIT_ASSERT(count_of(json, "\"ph\":\"X\"") == 4);
+  CPPUNIT_ASSERT(count_of(json, "\"ts\":5,") == 0);
+  CPPUNIT_ASSERT(count_of(json, "\"ts\":6,") == 1);
+  CPPUNIT_ASSERT(count_of(json, "\"ts\":9,") == 1);
+}
+
+void
+test_trace::test_threads() {
+  torrent::utils::trace_start(1 << 10);
+
+  std::thread thread([] {
+      for (int i = 0; i < 1000; i++)
+        torrent::utils::trace_record("worker", i, i + 1);
+    });
+
+  for (int i = 0; i < 100; i++) {
+    auto json = torrent::utils::trace_dump_json();
+    CPPUNIT_ASSERT(count_of(json, "\"ph\":\"X\"") <= 1 << 10);
+  }
+
+  thread.join();
+  torrent::utils::trace_record("main", 0, 1);
+
+  auto json = torrent::utils::trace_dump_json();
+
+  CPPUNIT_ASSERT(count_of(json, "\"ph\":\"M\"") == 2);
+  CPPUNIT_ASSERT(count_of(json, "\"name\":\"worker\"") == 1000);
+  CPPUNIT_ASSERT(count_of(json, "\"name\":\"main\"") == 1);
+}
@@ -0,0 +1,20 @@
+#include "helpers/test_fixture.h"
+
+class test_trace : public test_fixture {
+  CPPUNIT_TEST_SUITE(test_trace);
+
+  CPPUNIT_TEST(test_inactive);
+  CPPUNIT_TEST(test_spans);
+  CPPUNIT_TEST(test_overwrite);
+  CPPUNIT_TEST(test_threads);
+
+  CPPUNIT_TEST_SUITE_END();
+
+public:
+  void tearDown() override;
+
+  void test_inactive();
+  void test_spans();
+  void test_overwrite();
+  void test_threads();
+};
@@ -6,6 +6,7 @@ class test_uri_parser : public test_fixture {
   CPPUNIT_TEST(test_basic);
   CPPUNIT_TEST(test_basic_magnet);
   CPPUNIT_TEST(test_query_magnet);
+  CPPUNIT_TEST(test_host_key);
 
   CPPUNIT_TEST_SUITE_END();
 
@@ -13,4 +14,5 @@ public:
   void test_basic();
   void test_basic_magnet();
   void test_query_magnet();
+  void test_host_key();
 };
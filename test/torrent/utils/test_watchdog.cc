@@ -0,0 +1,87 @@
+#include "config.h"
+
+#include "test_watchdog.h"
+
+#include <atomic>
+#include <unistd.h>
+
+#include "helpers/test_thread.h"
+#include "helpers/test_utils.h"
+#include "torrent/exceptions.h"
+#include "torrent/utils/watchdog.h"
+
+CPPUNIT_TEST_SUITE_NAMED_REGISTRATION(test_watchdog, "torrent/utils");
+
+using torrent::utils::Watchdog;
+
+void
+test_watchdog::test_basic() {
+  auto thread = test_thread::create();
+  Watchdog watchdog;
+
+  CPPUNIT_ASSERT(!watchdog.is_running());
+  CPPUNIT_ASSERT_THROW(watchdog.start(0ms), torrent::input_error);
+
+  watchdog.add_thread(thread.get());
+  watchdog.start(100ms);
+
+  CPPUNIT_ASSERT(watchdog.is_running());
+  CPPUNIT_ASSERT(watchdog.threshold() == 100ms);
+  CPPUNIT_ASSERT_THROW(watchdog.start(100ms), torrent::internal_error);
+  CPPUNIT_ASSERT_THROW(watchdog.add_thread(thread.get()), torrent::internal_error);
+
+  watchdog.stop();
+  CPPUNIT_ASSERT(!watchdog.is_running());
+}
+
+// A thread blocked in poll is idle, not stalled.
+void
+test_watchdog::test_idle() {
+  auto thread = test_thread::create();
+  thread->set_test_flag(test_thread::test_flag_long_timeout);
+  thread->init_thread();
+  thread->start_thread();
+
+  std::atomic<int> stalls{0};
+
+  Watchdog watchdog;
+  watchdog.slot_stall() = [&stalls](const Watchdog::stall_type&) { stalls++; };
+  watchdog.add_thread(thread.get());
+  watchdog.start(20ms);
+
+  usleep(200 * 1000);
+  watchdog.stop();
+
+  CPPUNIT_ASSERT(stalls == 0);
+
+  thread->stop_thread_wait();
+}
+
+void
+test_watchdog::test_stalled_callback() {
+  auto thread = test_thread::create();
+  thread->init_thread();
+  thread->start_thread();
+
+  std::atomic<bool> stalled{false};
+  Watchdog::stall_type stall{};
+
+  Watchdog watchdog;
+  watchdog.slot_stall() = [&](const Watchdog::stall_type& s) { stall = s; stalled = true; };
+  watchdog.add_thread(thread.get());
+  watchdog.start(50ms);
+
+  int target;
+  thread->callback(&target, []() { usleep(500 * 1000); });
+
+  CPPUNIT_ASSERT(wait_for_true([&stalled]() { return stalled.load(); }));
+  watchdog.stop();
+
+  CPPUNIT_ASSERT(stall.thread_name == "test_thread");
+  CPPUNIT_ASSERT(stall.duration >= 50ms);
+  CPPUNIT_ASSERT(stall.event_type == nullptr);
+  CPPUNIT_ASSERT(stall.callback_target == &target);
+  CPPUNIT_ASSERT(!stall.backtrace.empty());
+
+  thread->stop_thread_wait();
+}
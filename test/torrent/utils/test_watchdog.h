@@ -0,0 +1,16 @@
+#include "helpers/test_fixture.h"
+
+class test_watchdog : public test_fixture {
+  CPPUNIT_TEST_SUITE(test_watchdog);
+
+  CPPUNIT_TEST(test_basic);
+  CPPUNIT_TEST(test_idle);
+  CPPUNIT_TEST(test_stalled_callback);
+
+  CPPUNIT_TEST_SUITE_END();
+
+public:
+  void test_basic();
+  void test_idle();
+  void test_stalled_callback();
+};
@@ -0,0 +1,85 @@
+#include "config.h"
+
+#include "test/tracker/test_tracker_http_parser.h"
+
+#include "tracker/tracker_http_parser.h"
+
+CPPUNIT_TEST_SUITE_NAMED_REGISTRATION(test_tracker_http_parser, "tracker");
+
+static void
+parse_bytewise(torrent::TrackerHttpParser& parser, const std::string& data) {
+  for (const char& c : data)
+    parser.parse(&c, &c + 1);
+}
+
+void
+test_tracker_http_parser::test_announce() {
+  std::string peers("\x01\x02\x03\x04\x1a\xe1" "\x05\x06\x07\x08\x1a\xe2", 12);
+  std::string reply = "d8:intervali1800e5:peers12:" + peers + "10:tracker id3:abce";
+
+  torrent::TrackerHttpParser parser;
+  parse_bytewise(parser, reply);
+
+  CPPUNIT_ASSERT(parser.is_done());
+  CPPUNIT_ASSERT(parser.has_peers());
+  CPPUNIT_ASSERT(parser.peers().size() == 2);
+  CPPUNIT_ASSERT(parser.peers().front().sa_inet()->port() == 6881);
+  CPPUNIT_ASSERT(parser.peers().back().sa_inet()->port() == 6882);
+
+  CPPUNIT_ASSERT(parser.root().get_key_value("interval") == 1800);
+  CPPUNIT_ASSERT(parser.root().get_key_string("tracker id") == "abc");
+  CPPUNIT_ASSERT(!parser.root().has_key("peers"));
+
+  // Trailing data after the root is ignored.
+  parse_bytewise(parser, "i1e");
+  CPPUNIT_ASSERT(parser.is_done());
+
+  torrent::TrackerHttpStream stream;
+  stream.write(reply.data(), 20);
+  stream << reply.substr(20);
+
+  CPPUNIT_ASSERT(stream.parser().is_done());
+  CPPUNIT_ASSERT(stream.parser().peers().size() == 2);
+}
+
+void
+test_tracker_http_parser::test_scrape() {
+  std::string hash_1(20, 'a');
+  std::string hash_2(20, 'b');
+  std::string reply = "d5:filesd20:" + hash_1 + "d8:completei5ee20:" + hash_2 + "d8:completei7eeee";
+
+  torrent::TrackerHttpParser parser(hash_2);
+  parse_bytewise(parser, reply);
+
+  CPPUNIT_ASSERT(parser.is_done());
+  CPPUNIT_ASSERT(!parser.has_peers());
+  CPPUNIT_ASSERT(parser.files_size() == 2);
+
+  const auto& files = parser.root().get_key_map("files");
+
+  CPPUNIT_ASSERT(files.size() == 1);
+  CPPUNIT_ASSERT(parser.root().get_key("files").get_key(hash_2).get_key_value("complete") == 7);
+}
+
+void
+test_tracker_http_parser::test_malformed() {
+  const char* replies[] = {
+    "d8:intervali18x0ee",
+    "d5:peers",
+    "di1e3:abce",
+    "l1:a",
+    "<html>error</html>",
+  };
+
+  for (auto reply : replies) {
+    torrent::TrackerHttpParser parser;
+    parse_bytewise(parser, reply);
+
+    CPPUNIT_ASSERT(!parser.is_done());
+  }
+
+  torrent::TrackerHttpParser parser;
+  parser.parse("", "");
+
+  CPPUNIT_ASSERT(!parser.is_done() && !parser.is_failed());
+}
@@ -0,0 +1,14 @@
+#include "helpers/test_fixture.h"
+
+class test_tracker_http_parser : public test_fixture {
+  CPPUNIT_TEST_SUITE(test_tracker_http_parser);
+  CPPUNIT_TEST(test_announce);
+  CPPUNIT_TEST(test_scrape);
+  CPPUNIT_TEST(test_malformed);
+  CPPUNIT_TEST_SUITE_END();
+
+public:
+  void test_announce();
+  void test_scrape();
+  void test_malformed();
+};
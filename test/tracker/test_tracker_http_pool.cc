@@ -0,0 +1,98 @@
+#include "config.h"
+
+#include "test/tracker/test_tracker_http_pool.h"
+
+#include "torrent/exceptions.h"
+#include "tracker/tracker_http_pool.h"
+
+CPPUNIT_TEST_SUITE_NAMED_REGISTRATION(test_tracker_http_pool, "tracker");
+
+void
+test_tracker_http_pool::test_max_active() {
+  torrent::TrackerHttpPool pool;
+  pool.set_max_active(2);
+
+  int requesters[4];
+  int started = 0;
+
+  for (auto& r : requesters)
+    pool.insert(&r, "http://example.com/announce", [&started] { started++; });
+
+  int other;
+  pool.insert(&other, "http://other.com/announce", [&started] { started++; });
+
+  CPPUNIT_ASSERT(started == 3);
+  CPPUNIT_ASSERT(pool.size_hosts() == 2);
+  CPPUNIT_ASSERT(pool.size_active("http://example.com/") == 2);
+  CPPUNIT_ASSERT(pool.size_queued("http://example.com/") == 2);
+  CPPUNIT_ASSERT(pool.is_active(&requesters[0]) && pool.is_active(&requesters[1]));
+  CPPUNIT_ASSERT(pool.is_queued(&requesters[2]) && pool.is_queued(&requesters[3]));
+
+  CPPUNIT_ASSERT_THROW(pool.insert(&requesters[0], "http://example.com/announce", [] {}), torrent::internal_error);
+
+  pool.erase(&requesters[0]);
+
+  CPPUNIT_ASSERT(started == 4);
+  CPPUNIT_ASSERT(pool.is_active(&requesters[2]));
+  CPPUNIT_ASSERT(pool.size_queued("http://example.com/") == 1);
+
+  pool.set_max_active(3);
+
+  CPPUNIT_ASSERT(started == 5);
+  CPPUNIT_ASSERT(pool.size_queued("http://example.com/") == 0);
+
+  for (auto& r : requesters)
+    pool.erase(&r);
+
+  pool.erase(&other);
+
+  CPPUNIT_ASSERT(pool.size_hosts() == 0);
+  CPPUNIT_ASSERT_THROW(pool.set_max_active(0), torrent::internal_error);
+}
+
+void
+test_tracker_http_pool::test_erase_queued() {
+  torrent::TrackerHttpPool pool;
+  pool.set_max_active(1);
+
+  int requesters[3];
+  int started[3]{};
+
+  for (int i = 0; i < 3; i++)
+    pool.insert(&requesters[i], "http://example.com/announce", [&started, i] { started[i]++; });
+
+  pool.erase(&requesters[1]);
+
+  CPPUNIT_ASSERT(!pool.is_queued(&requesters[1]) && !pool.is_active(&requesters[1]));
+
+  pool.erase(&requesters[0]);
+
+  CPPUNIT_ASSERT(started[0] == 1 && started[1] == 0 && started[2] == 1);
+  CPPUNIT_ASSERT(pool.is_active(&requesters[2]));
+
+  pool.erase(&requesters[2]);
+  CPPUNIT_ASSERT(pool.size_hosts() == 0);
+}
+
+void
+test_tracker_http_pool::test_reentrant() {
+  torrent::TrackerHttpPool pool;
+  pool.set_max_active(1);
+
+  int requesters[3];
+  int started = 0;
+
+  // Requests that fail immediately erase themselves from the start
+  // slot, which should start the next queued request.
+  pool.insert(&requesters[0], "http://example.com/announce", [] {});
+
+  for (int i = 1; i < 3; i++)
+    pool.insert(&requesters[i], "http://example.com/announce", [&, i] { started++; pool.erase(&requesters[i]); });
+
+  CPPUNIT_ASSERT(started == 0);
+
+  pool.erase(&requesters[0]);
+
+  CPPUNIT_ASSERT(started == 2);
+  CPPUNIT_ASSERT(pool.size_hosts() == 0);
+}
@@ -0,0 +1,14 @@
+#include "helpers/test_fixture.h"
+
+class test_tracker_http_pool : public test_fixture {
+  CPPUNIT_TEST_SUITE(test_tracker_http_pool);
+  CPPUNIT_TEST(test_max_active);
+  CPPUNIT_TEST(test_erase_queued);
+  CPPUNIT_TEST(test_reentrant);
+  CPPUNIT_TEST_SUITE_END();
+
+public:
+  void test_max_active();
+  void test_erase_queued();
+  void test_reentrant();
+};
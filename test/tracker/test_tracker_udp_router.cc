@@ -0,0 +1,143 @@
+#include "config.h"
+
+#include "test/tracker/test_tracker_udp_router.h"
+
+#include <cstring>
+#include <netinet/in.h>
+
+#include "test/helpers/network.h"
+#include "test/helpers/test_main_thread.h"
+#include "torrent/exceptions.h"
+#include "torrent/net/socket_address.h"
+#include "tracker/tracker_udp_router.h"
+
+CPPUNIT_TEST_SUITE_NAMED_REGISTRATION(test_tracker_udp_router, "tracker");
+
+#define SETUP_ROUTER()                                  \
+  set_create_poll();                                    \
+  auto test_main_thread = TestMainThread::create();     \
+  test_main_thread->init_thread();                      \
+  test_main_thread->test_set_cached_time(0s);           \
+  auto router = std::make_unique<torrent::TrackerUdpRouter>();
+
+static std::vector<char>
+make_reply(uint32_t action, uint32_t transaction_id) {
+  std::vector<char> reply(16);
+
+  action = htonl(action);
+  transaction_id = htonl(transaction_id);
+
+  std::memcpy(reply.data(), &action, 4);
+  std::memcpy(reply.data() + 4, &transaction_id, 4);
+  return reply;
+}
+
+void
+test_tracker_udp_router::test_transactions() {
+  SETUP_ROUTER();
+
+  auto sin_1_5000 = wrap_ai_get_first_sa("1.2.3.4", "5000");
+  auto sin_2_5000 = wrap_ai_get_first_sa("2.3.4.5", "5000");
+
+  int user_1 = 0;
+  int user_2 = 0;
+  int received_1 = 0;
+  int received_2 = 0;
+
+  auto tid_1 = router->insert_transaction(&user_1, sin_1_5000.get(), [&](const char*, unsigned int) { received_1++; });
+  auto tid_2 = router->insert_transaction(&user_2, sin_2_5000.get(), [&](const char*, unsigned int) { received_2++; });
+
+  CPPUNIT_ASSERT(tid_1 != tid_2);
+  CPPUNIT_ASSERT(router->size_transactions() == 2);
+
+  auto reply_1 = make_reply(0, tid_1);
+  auto reply_2 = make_reply(0, tid_2);
+
+  CPPUNIT_ASSERT(!router->receive_datagram(reply_1.data(), 7, sin_1_5000.get()));
+  CPPUNIT_ASSERT(!router->receive_datagram(make_reply(0, tid_1 + tid_2).data(), 16, sin_1_5000.get()));
+
+  CPPUNIT_ASSERT(router->receive_datagram(reply_2.data(), reply_2.size(), sin_2_5000.get()));
+  CPPUNIT_ASSERT(received_1 == 0 && received_2 == 1);
+
+  // Transactions are removed after the first reply.
+  CPPUNIT_ASSERT(!router->receive_datagram(reply_2.data(), reply_2.size(), sin_2_5000.get()));
+  CPPUNIT_ASSERT(received_2 == 1);
+  CPPUNIT_ASSERT(router->size_transactions() == 1);
+
+  // A new transaction replaces the user's previous one.
+  auto tid_3 = router->insert_transaction(&user_1, sin_1_5000.get(), [&](const char*, unsigned int) { received_1 += 10; });
+  auto reply_3 = make_reply(1, tid_3);
+
+  CPPUNIT_ASSERT(router->size_transactions() == 1);
+  CPPUNIT_ASSERT(!router->receive_datagram(reply_1.data(), reply_1.size(), sin_1_5000.get()));
+  CPPUNIT_ASSERT(router->receive_datagram(reply_3.data(), reply_3.size(), sin_1_5000.get()));
+  CPPUNIT_ASSERT(received_1 == 10);
+
+  router->insert_transaction(&user_2, sin_2_5000.get(), [&](const char*, unsigned int) { received_2++; });
+  router->erase_transaction(&user_2);
+
+  CPPUNIT_ASSERT(router->size_transactions() == 0);
+}
+
+void
+test_tracker_udp_router::test_transaction_source() {
+  SETUP_ROUTER();
+
+  auto sin_1_5000 = wrap_ai_get_first_sa("1.2.3.4", "5000");
+  auto sin_1_5005 = wrap_ai_get_first_sa("1.2.3.4", "5005");
+  auto sin6_1_5000 = wrap_ai_get_first_sa("ff01::1", "5000");
+  auto sin_1_5000_mapped = torrent::sa_to_v4mapped(sin_1_5000.get());
+
+  int user = 0;
+  int received = 0;
+
+  auto tid = router->insert_transaction(&user, sin_1_5000.get(), [&](const char*, unsigned int) { received++; });
+  auto reply = make_reply(0, tid);
+
+  CPPUNIT_ASSERT(!router->receive_datagram(reply.data(), reply.size(), sin_1_5005.get()));
+  CPPUNIT_ASSERT(!router->receive_datagram(reply.data(), reply.size(), sin6_1_5000.get()));
+  CPPUNIT_ASSERT(received == 0);
+
+  // Replies on a dual-stack socket arrive from v4-mapped addresses.
+  CPPUNIT_ASSERT(router->receive_datagram(reply.data(), reply.size(), sin_1_5000_mapped.get()));
+  CPPUNIT_ASSERT(received == 1);
+}
+
+void
+test_tracker_udp_router::test_connection_ids() {
+  SETUP_ROUTER();
+
+  auto sin_1_5000 = wrap_ai_get_first_sa("1.2.3.4", "5000");
+  auto sin_2_5000 = wrap_ai_get_first_sa("2.3.4.5", "5000");
+  auto sin_1_5000_mapped = torrent::sa_to_v4mapped(sin_1_5000.get());
+
+  uint64_t connection_id = 0;
+
+  CPPUNIT_ASSERT(!router->find_connection_id(sin_1_5000.get(), &connection_id));
+
+  router->set_connection_id(sin_1_5000.get(), 0x1234);
+
+  CPPUNIT_ASSERT(router->find_connection_id(sin_1_5000.get(), &connection_id) && connection_id == 0x1234);
+  CPPUNIT_ASSERT(router->find_connection_id(sin_1_5000_mapped.get(), &connection_id) && connection_id == 0x1234);
+  CPPUNIT_ASSERT(!router->find_connection_id(sin_2_5000.get(), &connection_id));
+
+  test_main_thread->test_set_cached_time(30s);
+  router->set_connection_id(sin_2_5000.get(), 0x5678);
+
+  test_main_thread->test_set_cached_time(59s);
+  CPPUNIT_ASSERT(router->find_connection_id(sin_1_5000.get(), &connection_id) && connection_id == 0x1234);
+
+  test_main_thread->test_set_cached_time(60s);
+  CPPUNIT_ASSERT(!router->find_connection_id(sin_1_5000.get(), &connection_id));
+  CPPUNIT_ASSERT(router->find_connection_id(sin_2_5000.get(), &connection_id) && connection_id == 0x5678);
+
+  router->erase_connection_id(sin_2_5000.get());
+  CPPUNIT_ASSERT(!router->find_connection_id(sin_2_5000.get(), &connection_id));
+
+  // Expired entries are pruned when new ones are added.
+  router->set_connection_id(sin_1_5000.get(), 0x1);
+  test_main_thread->test_set_cached_time(200s);
+  router->set_connection_id(sin_2_5000.get(), 0x2);
+
+  CPPUNIT_ASSERT(router->size_connection_ids() == 1);
+}
@@ -0,0 +1,14 @@
+#include "helpers/test_fixture.h"
+
+class test_tracker_udp_router : public test_fixture {
+  CPPUNIT_TEST_SUITE(test_tracker_udp_router);
+  CPPUNIT_TEST(test_transactions);
+  CPPUNIT_TEST(test_transaction_source);
+  CPPUNIT_TEST(test_connection_ids);
+  CPPUNIT_TEST_SUITE_END();
+
+public:
+  void test_transactions();
+  void test_transaction_source();
+  void test_connection_ids();
+};